@@ -0,0 +1,199 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file custom_metrics.c
+ *
+ * @brief Registry of the numeric custom metrics added to each Device Defender report.
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Interface includes. */
+#include "custom_metrics.h"
+#include "metrics.h"
+#include "metrics_collector.h"
+
+typedef struct
+{
+    const char * pcName;
+    CustomMetricRead_t xRead;
+    void * pvCtx;
+    const volatile uint32_t * pulCounter;
+} CustomMetric_t;
+
+typedef struct
+{
+    CborEncoder * pxEncoder;
+    CborError xError;
+} RegistryEncodeCtx_t;
+
+static CustomMetric_t xMetrics[ CUSTOM_METRICS_MAX ] = { 0 };
+static size_t uxMetricCount = 0;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRegister( const CustomMetric_t * pxMetric )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxMetric->pcName != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        size_t uxIdx = 0;
+
+        while( ( uxIdx < uxMetricCount ) &&
+               ( strcmp( xMetrics[ uxIdx ].pcName, pxMetric->pcName ) != 0 ) )
+        {
+            uxIdx++;
+        }
+
+        if( uxIdx < CUSTOM_METRICS_MAX )
+        {
+            xMetrics[ uxIdx ] = *pxMetric;
+
+            if( uxIdx == uxMetricCount )
+            {
+                uxMetricCount++;
+            }
+
+            xResult = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    configASSERT_CONTINUE( xResult == pdTRUE );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCustomMetricRegister( const char * pcName,
+                                  CustomMetricRead_t xRead,
+                                  void * pvCtx )
+{
+    const CustomMetric_t xMetric = { .pcName = pcName, .xRead = xRead, .pvCtx = pvCtx };
+
+    configASSERT( xRead != NULL );
+
+    return prvRegister( &xMetric );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCustomMetricRegisterCounter( const char * pcName,
+                                         const volatile uint32_t * pulCounter )
+{
+    const CustomMetric_t xMetric = { .pcName = pcName, .pulCounter = pulCounter };
+
+    configASSERT( pulCounter != NULL );
+
+    return prvRegister( &xMetric );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Counters and gauges of the metrics registry as numbers, histograms as a list of buckets */
+static BaseType_t prvAddRegistryMetric( const MetricSnapshot_t * pxMetric,
+                                        void * pvCtx )
+{
+    RegistryEncodeCtx_t * pxCtx = ( RegistryEncodeCtx_t * ) pvCtx;
+
+    if( pxMetric->xType != MetricTypeHistogram )
+    {
+        pxCtx->xError = xAddCustomMetricNumber( pxCtx->pxEncoder, pxMetric->pcName, pxMetric->ulValue );
+    }
+    else if( pxMetric->uxBuckets > 0 )
+    {
+        uint64_t pxBuckets[ METRICS_HISTOGRAM_BUCKETS ];
+
+        for( size_t uxIdx = 0; uxIdx < pxMetric->uxBuckets; uxIdx++ )
+        {
+            pxBuckets[ uxIdx ] = pxMetric->pulBuckets[ uxIdx ];
+        }
+
+        pxCtx->xError = xAddCustomMetricNumberList( pxCtx->pxEncoder, pxMetric->pcName, pxBuckets, pxMetric->uxBuckets );
+    }
+    else
+    {
+        /* Nothing observed yet */
+    }
+
+    return( ( pxCtx->xError == CborNoError ) ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+CborError xGetRegisteredCustomMetrics( CborEncoder * pxCustomMetricsEncoder )
+{
+    static CustomMetric_t xSnapshot[ CUSTOM_METRICS_MAX ];
+    size_t uxCount = 0;
+    CborError xError = CborNoError;
+
+    /* Read the values outside of the critical section, readers may take locks */
+    taskENTER_CRITICAL();
+    {
+        uxCount = uxMetricCount;
+        ( void ) memcpy( xSnapshot, xMetrics, uxCount * sizeof( CustomMetric_t ) );
+    }
+    taskEXIT_CRITICAL();
+
+    for( size_t uxIdx = 0; ( uxIdx < uxCount ) && ( xError == CborNoError ); uxIdx++ )
+    {
+        const CustomMetric_t * pxMetric = &( xSnapshot[ uxIdx ] );
+        uint64_t ullValue = 0;
+
+        if( pxMetric->pulCounter != NULL )
+        {
+            ullValue = *( pxMetric->pulCounter );
+        }
+        else
+        {
+            ullValue = pxMetric->xRead( pxMetric->pvCtx );
+        }
+
+        xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, pxMetric->pcName, ullValue );
+    }
+
+    if( xError == CborNoError )
+    {
+        RegistryEncodeCtx_t xCtx = { .pxEncoder = pxCustomMetricsEncoder, .xError = CborNoError };
+
+        vMetricsSnapshot( prvAddRegistryMetric, &xCtx );
+        xError = xCtx.xError;
+    }
+
+    return xError;
+}
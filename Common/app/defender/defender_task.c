@@ -68,6 +68,12 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_dispatch.h"
+#include "freertos_command_pool.h"
+#include "mqtt_agent_stats.h"
+#include "cpu_load.h"
+#include "periodic_work.h"
+#include "custom_metrics.h"
 
 /* Device Defender Client Library. */
 #include "defender.h"
@@ -75,18 +81,24 @@
 /* Metrics collector. */
 #include "metrics_collector.h"
 
+/* Transport statistics and handshake timing */
+#include "mbedtls_transport.h"
+
 #include "cbor.h"
 
 #define TCP_PORTS_MAX                      10
 #define UDP_PORTS_MAX                      10
 #define CONNECTIONS_MAX                    10
 #define TASKS_MAX                          10
-#define REPORT_BUFFER_SIZE                 1024
+#define DEFENDER_CPU_TOP_TASKS             3
+#define REPORT_BUFFER_SIZE                 1536
 
 #define REPORT_MAJOR_VERSION               1
 #define REPORT_MINOR_VERSION               0
 
 #define MS_BETWEEN_REPORTS                 ( 5 * 60 * 1000U )      /* 5 Minute reporting interval */
+#define MS_MAX_BETWEEN_REPORTS             ( 30 * 60 * 1000U )     /* Longest interval while the metrics are stable */
+#define MS_BETWEEN_FULL_REPORTS            ( 60 * 60 * 1000U )     /* Unchanged sections are resent at least this often */
 #define RESPONSE_TIMEOUT_MS                ( 30 * 1000U )
 #define MQTT_BLOCK_TIME_MS                 ( 10 * 1000U )
 
@@ -119,12 +131,47 @@ struct MQTTAgentCommandContext
     uint16_t usPublishTopicLen;
     BaseType_t xWaitingForCallback;
     MQTTAgentHandle_t xAgentHandle;
+    MqttAgentDeferredCallback_t xAcceptedCallback;
+    MqttAgentDeferredCallback_t xRejectedCallback;
 };
 
 typedef struct MQTTAgentCommandContext DefenderAgentCtx_t;
 
+/*
+ * Sections of the "met" map. A section whose encoding matches the one of the
+ * last accepted report is left out, as all of them are optional in the
+ * Device Defender schema.
+ */
+typedef struct
+{
+    const char * pcName;
+    CborError ( * pxCollect )( CborEncoder * pxEncoder );
+    bool xCounter; /* Changes with any traffic, so does not hold back the reporting interval. */
+} MetricSection_t;
+
 BaseType_t xExitFlag = pdFALSE;
 
+static const MetricSection_t xMetricSections[] =
+{
+    { "ns", xGetNetworkStats,           true  },
+    { "tp", xGetListeningTcpPorts,      false },
+    { "up", xGetListeningUdpPorts,      false },
+    { "tc", xGetEstablishedConnections, false },
+};
+
+#define METRIC_SECTIONS    ( sizeof( xMetricSections ) / sizeof( xMetricSections[ 0 ] ) )
+
+/* Section hashes of the last accepted report and of the report in flight */
+typedef struct
+{
+    bool xAcceptedValid;
+    TickType_t xLastFullReport;
+    uint32_t pulAcceptedHash[ METRIC_SECTIONS ];
+    uint32_t pulPendingHash[ METRIC_SECTIONS ];
+} ReportHistory_t;
+
+static ReportHistory_t xReportHistory = { 0 };
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -166,10 +213,27 @@ static void prvReportRejectedCallback( void * pxSubscriptionContext,
 /**
  * @brief Collect all the metrics to be sent in the device defender report.
  *
- * @return true if all the metrics are successfully collected;
- * false otherwise.
+ * Sections which are unchanged since the last accepted report are left out
+ * unless xFullReport is set.
+ *
+ * @param[in] pxEncoder Encoder for the top level report map.
+ * @param[in] pucReportBuf Buffer the encoder writes to.
+ * @param[in] xFullReport Include every section.
+ * @param[out] pxChanged Set if a section other than the counters changed.
+ *
+ * @return CborNoError if all the metrics are successfully collected.
  */
-static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder );
+static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder,
+                                          const uint8_t * pucReportBuf,
+                                          bool xFullReport,
+                                          bool * pxChanged );
+
+/**
+ * @brief Collect custom metrics into the "cmet" section of the report.
+ *
+ * @param[in] pxEncoder Encoder for the top level report map.
+ */
+static CborError prvCollectCustomMetrics( CborEncoder * pxEncoder );
 
 /**
  * @brief Publish the generated device defender report.
@@ -296,35 +360,38 @@ static bool prvBuildDefenderTopicStrings( DefenderAgentCtx_t * pxCtx )
 static bool prvSubscribeToDefenderTopics( DefenderAgentCtx_t * pxCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
+    MQTTSubAckStatus_t pxSubAckStatus[ 2 ];
 
-    xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                       pxCtx->pcAcceptedTopic,
-                                       MQTTQoS1,
-                                       prvReportAcceptedCallback,
-                                       pxCtx );
+    /* Responses are validated and logged in a dispatch worker rather than the agent task */
+    pxCtx->xAcceptedCallback.pxCallback = prvReportAcceptedCallback;
+    pxCtx->xAcceptedCallback.pvCallbackCtx = pxCtx;
+    pxCtx->xRejectedCallback.pxCallback = prvReportRejectedCallback;
+    pxCtx->xRejectedCallback.pvCallbackCtx = pxCtx;
 
-    configASSERT_CONTINUE( xStatus == MQTTSuccess );
-
-    if( xStatus != MQTTSuccess )
-    {
-        LogError( "Failed to subscribe to topic: %s", pxCtx->pcAcceptedTopic );
-    }
-    else
+    const MqttAgentSubscription_t pxSubscriptions[ 2 ] =
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcRejectedTopic,
-                                           MQTTQoS1,
-                                           prvReportRejectedCallback,
-                                           pxCtx );
+        { pxCtx->pcAcceptedTopic, MQTTQoS1, MqttAgent_DeferredCallback, &( pxCtx->xAcceptedCallback ) },
+        { pxCtx->pcRejectedTopic, MQTTQoS1, MqttAgent_DeferredCallback, &( pxCtx->xRejectedCallback ) },
+    };
 
-        configASSERT_CONTINUE( xStatus == MQTTSuccess );
+    /* Subscribe to both topics with a single SUBSCRIBE packet */
+    xStatus = MqttAgent_SubscribeMultiSync( pxCtx->xAgentHandle,
+                                            pxSubscriptions,
+                                            2,
+                                            pxSubAckStatus );
 
-        if( xStatus != MQTTSuccess )
+    for( uint32_t ulIdx = 0; ulIdx < 2; ulIdx++ )
+    {
+        if( ( xStatus != MQTTSuccess ) ||
+            ( pxSubAckStatus[ ulIdx ] == MQTTSubAckFailure ) )
         {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcRejectedTopic );
+            LogError( "Failed to subscribe to topic: %s", pxSubscriptions[ ulIdx ].pcTopicFilter );
+            xStatus = MQTTServerRefused;
         }
     }
 
+    configASSERT_CONTINUE( xStatus == MQTTSuccess );
+
     return( xStatus == MQTTSuccess );
 }
 
@@ -334,18 +401,21 @@ static void prvUnsubscribeFromDefenderTopics( DefenderAgentCtx_t * pxCtx )
 
     xStatus = MqttAgent_UnSubscribeSync( pxCtx->xAgentHandle,
                                          pxCtx->pcAcceptedTopic,
-                                         prvReportAcceptedCallback,
-                                         pxCtx );
+                                         MqttAgent_DeferredCallback,
+                                         &( pxCtx->xAcceptedCallback ) );
 
     configASSERT_CONTINUE( xStatus == MQTTSuccess );
 
 
     xStatus = MqttAgent_UnSubscribeSync( pxCtx->xAgentHandle,
                                          pxCtx->pcRejectedTopic,
-                                         prvReportRejectedCallback,
-                                         pxCtx );
+                                         MqttAgent_DeferredCallback,
+                                         &( pxCtx->xRejectedCallback ) );
 
     configASSERT_CONTINUE( xStatus == MQTTSuccess );
+
+    /* Responses queued before the unsubscribe still refer to pxCtx */
+    vMqttDispatchFlush();
 }
 
 /*-----------------------------------------------------------*/
@@ -353,7 +423,7 @@ static void prvUnsubscribeFromDefenderTopics( DefenderAgentCtx_t * pxCtx )
 static void prvPrintHex( const uint8_t * pcPayload,
                          size_t xPayloadLen )
 {
-    #if ( LOG_LEVEL >= LOG_DEBUG )
+    #if ( LOG_LEVEL_MAX >= LOG_DEBUG )
         for( uint32_t i = 0; i < xPayloadLen; i += 16 )
         {
             LogDebug( "\t%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
@@ -362,10 +432,10 @@ static void prvPrintHex( const uint8_t * pcPayload,
                       pcPayload[ i + 8 ], pcPayload[ i + 9 ], pcPayload[ i + 10 ], pcPayload[ i + 11 ],
                       pcPayload[ i + 12 ], pcPayload[ i + 13 ], pcPayload[ i + 14 ], pcPayload[ i + 15 ] );
         }
-    #else /* LOG_LEVEL >= LOG_DEBUG */
+    #else /* LOG_LEVEL_MAX >= LOG_DEBUG */
         ( void ) pcPayload;
         ( void ) xPayloadLen;
-    #endif /* LOG_LEVEL < LOG_DEBUG */
+    #endif /* LOG_LEVEL_MAX < LOG_DEBUG */
 }
 
 /*-----------------------------------------------------------*/
@@ -444,12 +514,35 @@ static void prvReportRejectedCallback( void * pvCtx,
 
 /*-----------------------------------------------------------*/
 
-static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder )
+/* FNV-1a hash of an encoded report section */
+static uint32_t prvHashSection( const uint8_t * pucData,
+                                size_t uxLen )
+{
+    uint32_t ulHash = 2166136261UL;
+
+    for( size_t uxIdx = 0; uxIdx < uxLen; uxIdx++ )
+    {
+        ulHash ^= pucData[ uxIdx ];
+        ulHash *= 16777619UL;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder,
+                                          const uint8_t * pucReportBuf,
+                                          bool xFullReport,
+                                          bool * pxChanged )
 {
     CborEncoder xMetricsEncoder;
     CborError xError = CborNoError;
 
     configASSERT( pxEncoder != NULL );
+    configASSERT( pxChanged != NULL );
+
+    *pxChanged = false;
 
     xError = cbor_encode_text_stringz( pxEncoder, "met" );
     configASSERT_CONTINUE( xError == CborNoError );
@@ -460,41 +553,290 @@ static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder )
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
+    for( size_t uxIdx = 0; ( uxIdx < METRIC_SECTIONS ) && ( xError == CborNoError ); uxIdx++ )
+    {
+        /* The map has an indefinite length, so restoring the encoder drops the section. */
+        CborEncoder xSectionStart = xMetricsEncoder;
+        size_t uxStart = cbor_encoder_get_buffer_size( &xMetricsEncoder, pucReportBuf );
+
+        xError = xMetricSections[ uxIdx ].pxCollect( &xMetricsEncoder );
+        configASSERT_CONTINUE( xError == CborNoError );
+
+        if( xError == CborNoError )
+        {
+            size_t uxEnd = cbor_encoder_get_buffer_size( &xMetricsEncoder, pucReportBuf );
+            uint32_t ulHash = prvHashSection( &( pucReportBuf[ uxStart ] ), uxEnd - uxStart );
+
+            xReportHistory.pulPendingHash[ uxIdx ] = ulHash;
+
+            if( xReportHistory.xAcceptedValid &&
+                ( ulHash == xReportHistory.pulAcceptedHash[ uxIdx ] ) )
+            {
+                if( xFullReport == false )
+                {
+                    LogDebug( "Skipping unchanged metrics section \"%s\".", xMetricSections[ uxIdx ].pcName );
+                    xMetricsEncoder = xSectionStart;
+                }
+            }
+            else if( xMetricSections[ uxIdx ].xCounter == false )
+            {
+                *pxChanged = true;
+            }
+            else
+            {
+                /* Empty */
+            }
+        }
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, &xMetricsEncoder );
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
+    return xError;
+}
+
+
+/*-----------------------------------------------------------*/
+
+/*
+ * CPU busy permille over the last 1 s, 10 s and 60 s, followed by the names and 60 s loads of the
+ * DEFENDER_CPU_TOP_TASKS busiest tasks so that the report stays within REPORT_BUFFER_SIZE.
+ */
+static CborError prvAddCpuLoadMetrics( CborEncoder * pxEncoder )
+{
+    static CpuLoadTask_t xLoads[ CPU_LOAD_MAX_TASKS ];
+    const char * pcTopNames[ DEFENDER_CPU_TOP_TASKS ];
+    uint64_t ullTopLoads[ DEFENDER_CPU_TOP_TASKS ];
+    uint16_t usBusy[ CPU_LOAD_WINDOWS ] = { 0 };
+    size_t uxTop = 0;
+    UBaseType_t uxTasks;
+    CborError xError;
+
+    uxTasks = uxCpuLoadGet( xLoads, CPU_LOAD_MAX_TASKS, usBusy );
+
+    /* Insertion into the short list of the busiest tasks, idle included */
+    for( UBaseType_t i = 0; i < uxTasks; i++ )
+    {
+        size_t uxPos = uxTop;
+
+        while( ( uxPos > 0 ) && ( ullTopLoads[ uxPos - 1 ] < xLoads[ i ].usPermille[ 2 ] ) )
+        {
+            if( uxPos < DEFENDER_CPU_TOP_TASKS )
+            {
+                ullTopLoads[ uxPos ] = ullTopLoads[ uxPos - 1 ];
+                pcTopNames[ uxPos ] = pcTopNames[ uxPos - 1 ];
+            }
+
+            uxPos--;
+        }
+
+        if( uxPos < DEFENDER_CPU_TOP_TASKS )
+        {
+            ullTopLoads[ uxPos ] = xLoads[ i ].usPermille[ 2 ];
+            pcTopNames[ uxPos ] = xLoads[ i ].pcName;
+
+            if( uxTop < DEFENDER_CPU_TOP_TASKS )
+            {
+                uxTop++;
+            }
+        }
+    }
+
+    xError = xAddCustomMetricNumber( pxEncoder, "cpu_busy_pmil_1s", usBusy[ 0 ] );
+
+    if( xError == CborNoError )
+    {
+        xError = xAddCustomMetricNumber( pxEncoder, "cpu_busy_pmil_10s", usBusy[ 1 ] );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = xAddCustomMetricNumber( pxEncoder, "cpu_busy_pmil_60s", usBusy[ 2 ] );
+    }
+
+    if( ( xError == CborNoError ) && ( uxTop > 0 ) )
+    {
+        xError = xAddCustomMetricStringList( pxEncoder, "cpu_top_tasks", pcTopNames, uxTop );
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumberList( pxEncoder, "cpu_top_pmil_60s", ullTopLoads, uxTop );
+        }
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint64_t prvReadFreeHeap( void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    return xPortGetFreeHeapSize();
+}
+
+static uint64_t prvReadMinFreeHeap( void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    return xPortGetMinimumEverFreeHeapSize();
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError prvCollectCustomMetrics( CborEncoder * pxEncoder )
+{
+    CborEncoder xCustomMetricsEncoder;
+    CborError xError = CborNoError;
+
+    configASSERT( pxEncoder != NULL );
+
+    xError = cbor_encode_text_stringz( pxEncoder, "cmet" );
+    configASSERT_CONTINUE( xError == CborNoError );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_map( pxEncoder, &xCustomMetricsEncoder, CborIndefiniteLength );
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = xGetLwipPortCustomMetrics( &xCustomMetricsEncoder );
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
+    if( xError == CborNoError )
+    {
+        TlsTransportStats_t xTlsStats;
+
+        mbedtls_transport_get_stats( &xTlsStats );
+
+        xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_send_stalls", xTlsStats.ulSendStalls );
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_send_stall_max_ms", xTlsStats.ulSendStallMaxMs );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_send_stall_total_ms", xTlsStats.ullSendStallTotalMs );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_handshakes", xTlsStats.ulHandshakes );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_resumed_handshakes", xTlsStats.ulResumedHandshakes );
+        }
+
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
+    if( xError == CborNoError )
+    {
+        TlsHandshakeTiming_t xTiming;
+
+        /* Phase timing of the most recent connection attempt */
+        if( mbedtls_transport_get_handshake_timing( &xTiming, 1 ) == 1 )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_connect_us", xTiming.ulTotalUs );
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_server_cert_us",
+                                                 xTiming.pulPhaseUs[ TLS_PHASE_SERVER_CERT ] );
+            }
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_client_sign_us",
+                                                 xTiming.pulPhaseUs[ TLS_PHASE_CLIENT_SIGN ] );
+            }
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "tls_client_kex_us",
+                                                 xTiming.pulPhaseUs[ TLS_PHASE_CLIENT_KEX ] );
+            }
+        }
+
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
     if( xError == CborNoError )
     {
-        xError = xGetNetworkStats( &xMetricsEncoder );
+        AgentCommandPoolStats_t xPoolStats;
+
+        Agent_GetPoolStats( &xPoolStats );
+
+        xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_cmd_pool_peak", xPoolStats.ulPeakInUse );
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_cmd_pool_failed_gets", xPoolStats.ulFailedGets );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_cmd_pool_max_wait_ms", xPoolStats.ulMaxWaitMs );
+        }
+
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
     if( xError == CborNoError )
     {
-        xError = xGetListeningTcpPorts( &xMetricsEncoder );
+        MqttAgentQueueStats_t xQueueStats;
+        MqttAgentCommandStats_t xPublishStats;
+
+        MqttAgent_GetQueueStats( &xQueueStats );
+        MqttAgent_GetCommandStats( PUBLISH, &xPublishStats );
+
+        xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_queue_hwm", xQueueStats.ulQueueHighWaterMark );
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_pub_queue_max_us", xPublishStats.xQueueWait.ulMaxUs );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = xAddCustomMetricNumber( &xCustomMetricsEncoder, "mqtt_pub_complete_max_us", xPublishStats.xComplete.ulMaxUs );
+        }
+
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
     if( xError == CborNoError )
     {
-        xError = xGetListeningUdpPorts( &xMetricsEncoder );
+        xError = xGetRegisteredCustomMetrics( &xCustomMetricsEncoder );
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
     if( xError == CborNoError )
     {
-        xError = xGetEstablishedConnections( &xMetricsEncoder );
+        xError = prvAddCpuLoadMetrics( &xCustomMetricsEncoder );
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
     if( xError == CborNoError )
     {
-        xError = cbor_encoder_close_container( pxEncoder, &xMetricsEncoder );
+        xError = cbor_encoder_close_container( pxEncoder, &xCustomMetricsEncoder );
         configASSERT_CONTINUE( xError == CborNoError );
     }
 
     return xError;
 }
 
-
-
 /*-----------------------------------------------------------*/
 
 static bool prvPublishDeviceMetricsReport( DefenderAgentCtx_t * pxCtx,
@@ -566,6 +908,8 @@ void vDefenderAgentTask( void * pvParameters )
 {
     DefenderAgentCtx_t xCtx = { 0 };
     bool xSuccess = false;
+    uint32_t ulReportIntervalMs = MS_BETWEEN_REPORTS;
+    static PeriodicWork_t xReportWork;
 
     xExitFlag = pdFALSE;
 
@@ -574,6 +918,9 @@ void vDefenderAgentTask( void * pvParameters )
     /* Remove compiler warnings about unused parameters. */
     ( void ) pvParameters;
 
+    ( void ) xCustomMetricRegister( "heap_free", prvReadFreeHeap, NULL );
+    ( void ) xCustomMetricRegister( "heap_min_free", prvReadMinFreeHeap, NULL );
+
     xCtx.pcDeviceId = KVStore_getStringHeap( CS_CORE_THING_NAME, &( xCtx.uxDeviceIdLen ) );
     xCtx.xWaitingForCallback = pdFALSE;
     xCtx.xAgentTask = xTaskGetCurrentTaskHandle();
@@ -602,7 +949,7 @@ void vDefenderAgentTask( void * pvParameters )
 
     vSleepUntilMQTTAgentReady();
 
-    xCtx.xAgentHandle = xGetMqttAgentHandle();
+    xCtx.xAgentHandle = xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_BULK );
 
     /* Subscribe to relevant topics */
     if( xSuccess )
@@ -626,11 +973,18 @@ void vDefenderAgentTask( void * pvParameters )
         xExitFlag = pdTRUE;
     }
 
+    /* The report is not time critical, any other periodic wakeup within a tenth of the shortest interval is taken */
+    vPeriodicWorkStart( &xReportWork, pdMS_TO_TICKS( MS_BETWEEN_REPORTS ), pdMS_TO_TICKS( MS_BETWEEN_REPORTS / 10 ) );
+
     while( xExitFlag == pdFALSE )
     {
+        uint32_t ulLastIntervalMs = ulReportIntervalMs;
         uint64_t ulReportId = ( uint32_t ) xTaskGetTickCount(); /* TODO: Use a proper timestamp */
         uint32_t ulNotificationValue = 0;
         ReportStatus_t xReportStatus = ReportStatusNotReceived;
+        bool xFullReport = ( xReportHistory.xAcceptedValid == false ) ||
+                           ( ( xTaskGetTickCount() - xReportHistory.xLastFullReport ) >= pdMS_TO_TICKS( MS_BETWEEN_FULL_REPORTS ) );
+        bool xChanged = true;
 
         CborEncoder xEncoder;
         CborEncoder xMapEncoder;
@@ -686,7 +1040,13 @@ void vDefenderAgentTask( void * pvParameters )
         {
             /* Collect device metrics. */
             LogInfo( "Collecting device metrics..." );
-            xError = prvCollectDeviceMetrics( &xMapEncoder );
+            xError = prvCollectDeviceMetrics( &xMapEncoder, pucReportBuffer, xFullReport, &xChanged );
+            configASSERT_CONTINUE( xError == CborNoError );
+        }
+
+        if( xError == CborNoError )
+        {
+            xError = prvCollectCustomMetrics( &xMapEncoder );
             configASSERT_CONTINUE( xError == CborNoError );
         }
 
@@ -746,10 +1106,50 @@ void vDefenderAgentTask( void * pvParameters )
                 break;
         }
 
-        LogDebug( "Sleeping until next report." );
-        vTaskDelay( pdMS_TO_TICKS( MS_BETWEEN_REPORTS ) );
+        /*
+         * Only an accepted report becomes the reference for the next one, anything else
+         * results in a full report at the base interval.
+         */
+        if( ( xReportStatus == ReportStatusAccepted ) && ( xError == CborNoError ) )
+        {
+            ( void ) memcpy( xReportHistory.pulAcceptedHash, xReportHistory.pulPendingHash, sizeof( xReportHistory.pulAcceptedHash ) );
+            xReportHistory.xAcceptedValid = true;
+
+            if( xFullReport )
+            {
+                xReportHistory.xLastFullReport = xTaskGetTickCount();
+            }
+
+            if( xChanged || xFullReport )
+            {
+                ulReportIntervalMs = MS_BETWEEN_REPORTS;
+            }
+            else if( ulReportIntervalMs < MS_MAX_BETWEEN_REPORTS / 2 )
+            {
+                ulReportIntervalMs *= 2;
+            }
+            else
+            {
+                ulReportIntervalMs = MS_MAX_BETWEEN_REPORTS;
+            }
+        }
+        else
+        {
+            xReportHistory.xAcceptedValid = false;
+            ulReportIntervalMs = MS_BETWEEN_REPORTS;
+        }
+
+        if( ulReportIntervalMs != ulLastIntervalMs )
+        {
+            vPeriodicWorkSetPeriod( &xReportWork, pdMS_TO_TICKS( ulReportIntervalMs ) );
+        }
+
+        LogDebug( "Sleeping until the next multiple of %lu ms.", ( unsigned long ) ulReportIntervalMs );
+        vPeriodicWorkWait( &xReportWork );
     }
 
+    vPeriodicWorkStop( &xReportWork );
+
     LogSys( "Exiting..." );
 
     prvUnsubscribeFromDefenderTopics( &xCtx );
@@ -57,4 +57,39 @@ CborError xGetListeningUdpPorts( CborEncoder * pxMetricsEncoder );
  */
 CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder );
 
+/**
+ * @brief Encode a single numeric Device Defender custom metric,
+ * "name": [ { "number": value } ], into an open "cmet" map.
+ */
+CborError xAddCustomMetricNumber( CborEncoder * pxEncoder,
+                                  const char * pcName,
+                                  uint64_t xValue );
+
+/**
+ * @brief Encode Device Defender number-list and string-list custom metrics,
+ * "name": [ { "number_list": [ values ] } ] and "name": [ { "string_list": [ values ] } ].
+ */
+CborError xAddCustomMetricNumberList( CborEncoder * pxEncoder,
+                                      const char * pcName,
+                                      const uint64_t * pxValues,
+                                      size_t uxCount );
+
+CborError xAddCustomMetricStringList( CborEncoder * pxEncoder,
+                                      const char * pcName,
+                                      const char * const * ppcValues,
+                                      size_t uxCount );
+
+/**
+ * @brief Append lwIP port contention statistics (core lock, semaphore and mailbox)
+ * as entries of an open Device Defender custom metrics ("cmet") map.
+ */
+CborError xGetLwipPortCustomMetrics( CborEncoder * pxCustomMetricsEncoder );
+
+/**
+ * @brief Append the metrics registered with xCustomMetricRegister and
+ * xCustomMetricRegisterCounter, followed by the metrics registry, to an
+ * open "cmet" map.
+ */
+CborError xGetRegisteredCustomMetrics( CborEncoder * pxCustomMetricsEncoder );
+
 #endif /* __METRICS_COLLECTOR_H__ */
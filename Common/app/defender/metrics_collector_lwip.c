@@ -37,6 +37,7 @@
 #include "lwip/tcpip.h"         /* #define LOCK_TCPIP_CORE()     sys_mutex_lock(&lock_tcpip_core) */
 #include "lwip/ip_addr.h"       /* ip_addr_t, ipaddr_ntoa, ip_addr_copy */
 #include "lwip/tcp.h"           /* struct tcp_pcb */
+#include "lwip/sys.h"           /* sys_arch_get_stats, sys_arch_mbox_get_stats */
 #include "lwip/udp.h"           /* struct udp_pcb */
 #include "lwip/priv/tcp_priv.h" /* tcp_listen_pcbs_t */
 
@@ -58,6 +59,7 @@
 #endif
 
 #define UINT16_STR_LEN         5
+#define METRICS_MAX_MBOX       16
 #define IPADDR_PORT_STR_LEN    ( IPADDR_STRLEN_MAX + sizeof( ':' ) + UINT16_STR_LEN + sizeof( '\0' ) )
 
 /* Variables defined in the LWIP source code. */
@@ -166,20 +168,45 @@ CborError xGetNetworkStats( CborEncoder * pxEncoder )
 
 /*-----------------------------------------------------------*/
 
-static size_t xCountListeningTcpPorts( void )
-{
-    size_t xPortCount = 0;
+/*
+ * Connection table snapshots. The PCB lists are copied in a single pass with
+ * the core lock held and encoded once the lock has been released, so the
+ * tcpip thread is never blocked by CBOR encoding or address formatting.
+ * The snapshots are sized by the PCB pools, so nothing is dropped unless the
+ * pools are allocated from the heap.
+ */
+#ifndef METRICS_TCP_PORTS_MAX
+    #define METRICS_TCP_PORTS_MAX      MEMP_NUM_TCP_PCB_LISTEN
+#endif
 
-    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
-    {
-        if( pxCurPcb->state == LISTEN )
-        {
-            xPortCount++;
-        }
-    }
+#ifndef METRICS_UDP_PORTS_MAX
+    #define METRICS_UDP_PORTS_MAX      MEMP_NUM_UDP_PCB
+#endif
 
-    return xPortCount;
-}
+#ifndef METRICS_CONNECTIONS_MAX
+    #define METRICS_CONNECTIONS_MAX    MEMP_NUM_TCP_PCB
+#endif
+
+typedef struct
+{
+    uint16_t usLocalPort;
+    bool xNetifValid;
+    char pcNetifName[ NETIF_NAMESIZE ];
+} PortEntry_t;
+
+typedef struct
+{
+    ip_addr_t xRemoteIp;
+    uint16_t usRemotePort;
+    uint16_t usLocalPort;
+    bool xNetifValid;
+    char pcNetifName[ NETIF_NAMESIZE ];
+} ConnectionEntry_t;
+
+/* Only accessed from the defender task. */
+static PortEntry_t xTcpPortSnapshot[ METRICS_TCP_PORTS_MAX ];
+static PortEntry_t xUdpPortSnapshot[ METRICS_UDP_PORTS_MAX ];
+static ConnectionEntry_t xConnectionSnapshot[ METRICS_CONNECTIONS_MAX ];
 
 /*-----------------------------------------------------------*/
 
@@ -212,172 +239,134 @@ static char * pcGetNetifName( uint8_t ucNetifIdx,
 
 /*-----------------------------------------------------------*/
 
-static CborError xAppendTcpPtsToList( CborEncoder * pxPTSEncoder )
+/* Must be called with the core lock held. */
+static void prvSnapshotNetif( uint8_t ucNetifIdx,
+                              bool * pxNetifValid,
+                              char * pcNetifName )
 {
-    CborError xError = CborNoError;
+    *pxNetifValid = ( pcGetNetifName( ucNetifIdx, pcNetifName ) != NULL );
+}
 
-    configASSERT( pxPTSEncoder != NULL );
+/*-----------------------------------------------------------*/
 
-    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
-    {
-        CborEncoder xPTEncoder;
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifNameFound = NULL;
+static size_t xSnapshotListeningTcpPorts( PortEntry_t * pxEntries,
+                                          size_t uxMaxEntries,
+                                          size_t * puxCopied )
+{
+    size_t uxPortCount = 0;
 
-        pcNetifNameFound = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
+    *puxCopied = 0;
 
-        if( pcNetifNameFound != NULL )
-        {
-            xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 2 );
-            configASSERT_CONTINUE( xError == CborNoError );
+    LOCK_TCPIP_CORE();
 
-            if( xError == CborNoError )
-            {
-                xError = cbor_add_kv_str( &xPTEncoder, "if", pcNetifNameFound );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-        }
-        else
+    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    {
+        if( pxCurPcb->state == LISTEN )
         {
-            xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 1 );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+            if( *puxCopied < uxMaxEntries )
+            {
+                PortEntry_t * pxEntry = &( pxEntries[ *puxCopied ] );
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxCurPcb->local_port );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+                pxEntry->usLocalPort = pxCurPcb->local_port;
+                prvSnapshotNetif( pxCurPcb->netif_idx, &( pxEntry->xNetifValid ), pxEntry->pcNetifName );
+                ( *puxCopied )++;
+            }
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_encoder_close_container( pxPTSEncoder, &xPTEncoder );
+            uxPortCount++;
         }
     }
 
-    return xError;
+    UNLOCK_TCPIP_CORE();
+
+    return uxPortCount;
 }
 
 /*-----------------------------------------------------------*/
 
-CborError xGetListeningTcpPorts( CborEncoder * pxMetricsEncoder )
+static size_t xSnapshotListeningUdpPorts( PortEntry_t * pxEntries,
+                                          size_t uxMaxEntries,
+                                          size_t * puxCopied )
 {
-    CborError xError = CborNoError;
-    uint32_t ulPortCount = 0;
+    size_t uxPortCount = 0;
 
-    if( pxMetricsEncoder == NULL )
-    {
-        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
-        xError = CborErrorImproperValue;
-    }
-    else
-    {
-        CborEncoder xTPEncoder;
-        CborEncoder xPTSEncoder;
+    *puxCopied = 0;
 
-        LOCK_TCPIP_CORE();
-        ulPortCount = xCountListeningTcpPorts();
+    LOCK_TCPIP_CORE();
 
-        xError = cbor_encode_text_stringz( pxMetricsEncoder, "tp" );
-        configASSERT_CONTINUE( xError == CborNoError );
-
-        if( xError == CborNoError )
-        {
-            /* Create listening_tcp_ports / tp object */
-            if( ulPortCount > 0 )
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xTPEncoder, 2 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-            else
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xTPEncoder, 1 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-        }
-
-        /* Encode number of ports parameter */
-        if( xError == CborNoError )
-        {
-            xError = cbor_add_kv_uint( &xTPEncoder, "t", ulPortCount );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
-
-        /* Construct ports list / pts if any tcp ports are listening */
-        if( ulPortCount > 0 )
+    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    {
+        if( *puxCopied < uxMaxEntries )
         {
-            if( xError == CborNoError )
-            {
-                xError = cbor_encode_text_stringz( &xTPEncoder, "pts" );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            PortEntry_t * pxEntry = &( pxEntries[ *puxCopied ] );
 
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_create_array( &xTPEncoder, &xPTSEncoder, ulPortCount );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = xAppendTcpPtsToList( &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_close_container( &xTPEncoder, &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            pxEntry->usLocalPort = pxCurPcb->local_port;
+            prvSnapshotNetif( pxCurPcb->netif_idx, &( pxEntry->xNetifValid ), pxEntry->pcNetifName );
+            ( *puxCopied )++;
         }
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_encoder_close_container( pxMetricsEncoder, &xTPEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
-
-        UNLOCK_TCPIP_CORE();
+        uxPortCount++;
     }
 
-    return xError;
+    UNLOCK_TCPIP_CORE();
+
+    return uxPortCount;
 }
+
 /*-----------------------------------------------------------*/
 
-static size_t xCountListeningUdpPorts( void )
+static size_t xSnapshotTcpConnections( ConnectionEntry_t * pxEntries,
+                                       size_t uxMaxEntries,
+                                       size_t * puxCopied )
 {
-    size_t xPortCount = 0;
+    size_t uxConnectionCount = 0;
 
-    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    *puxCopied = 0;
+
+    LOCK_TCPIP_CORE();
+
+    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
     {
-        xPortCount++;
+        if( *puxCopied < uxMaxEntries )
+        {
+            ConnectionEntry_t * pxEntry = &( pxEntries[ *puxCopied ] );
+
+            ip_addr_copy( pxEntry->xRemoteIp, pxCurPcb->remote_ip );
+            pxEntry->usRemotePort = pxCurPcb->remote_port;
+            pxEntry->usLocalPort = pxCurPcb->local_port;
+            prvSnapshotNetif( pxCurPcb->netif_idx, &( pxEntry->xNetifValid ), pxEntry->pcNetifName );
+            ( *puxCopied )++;
+        }
+
+        uxConnectionCount++;
     }
 
-    return xPortCount;
+    UNLOCK_TCPIP_CORE();
+
+    return uxConnectionCount;
 }
 
-static CborError xAppendUdpPtsToList( CborEncoder * pxPTSEncoder )
+/*-----------------------------------------------------------*/
+
+static CborError xAppendPtsToList( CborEncoder * pxPTSEncoder,
+                                   const PortEntry_t * pxEntries,
+                                   size_t uxEntries )
 {
     CborError xError = CborNoError;
 
     configASSERT( pxPTSEncoder != NULL );
 
-    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    for( size_t i = 0; ( i < uxEntries ) && ( xError == CborNoError ); i++ )
     {
         CborEncoder xPTEncoder;
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifName = NULL;
-
-        pcNetifName = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
 
-        if( pcNetifName != NULL )
+        if( pxEntries[ i ].xNetifValid )
         {
             xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 2 );
             configASSERT_CONTINUE( xError == CborNoError );
 
             if( xError == CborNoError )
             {
-                xError = cbor_add_kv_str( &xPTEncoder, "if", pcNetifName );
+                xError = cbor_add_kv_str( &xPTEncoder, "if", pxEntries[ i ].pcNetifName );
                 configASSERT_CONTINUE( xError == CborNoError );
             }
         }
@@ -389,7 +378,7 @@ static CborError xAppendUdpPtsToList( CborEncoder * pxPTSEncoder )
 
         if( xError == CborNoError )
         {
-            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxCurPcb->local_port );
+            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxEntries[ i ].usLocalPort );
             configASSERT_CONTINUE( xError == CborNoError );
         }
 
@@ -402,108 +391,142 @@ static CborError xAppendUdpPtsToList( CborEncoder * pxPTSEncoder )
     return xError;
 }
 
+/*-----------------------------------------------------------*/
 
-
-CborError xGetListeningUdpPorts( CborEncoder * pxMetricsEncoder )
+/*
+ * "key": { "t": total, "pts": [ { "if": name, "pt": port } ] }, the pts list
+ * being omitted when no port is open.
+ */
+static CborError xEncodeListeningPorts( CborEncoder * pxMetricsEncoder,
+                                        const char * pcKey,
+                                        const PortEntry_t * pxEntries,
+                                        size_t uxEntries,
+                                        size_t uxPortCount )
 {
     CborError xError = CborNoError;
-    uint32_t ulPortCount = 0;
+    CborEncoder xPortsEncoder;
+    CborEncoder xPTSEncoder;
 
-    if( pxMetricsEncoder == NULL )
+    xError = cbor_encode_text_stringz( pxMetricsEncoder, pcKey );
+    configASSERT_CONTINUE( xError == CborNoError );
+
+    if( xError == CborNoError )
     {
-        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
-        xError = CborErrorImproperValue;
+        if( uxEntries > 0 )
+        {
+            xError = cbor_encoder_create_map( pxMetricsEncoder, &xPortsEncoder, 2 );
+            configASSERT_CONTINUE( xError == CborNoError );
+        }
+        else
+        {
+            xError = cbor_encoder_create_map( pxMetricsEncoder, &xPortsEncoder, 1 );
+            configASSERT_CONTINUE( xError == CborNoError );
+        }
     }
-    else
-    {
-        CborEncoder xUPEncoder;
-        CborEncoder xPTSEncoder;
 
-        LOCK_TCPIP_CORE();
-        ulPortCount = xCountListeningUdpPorts();
-
-        xError = cbor_encode_text_stringz( pxMetricsEncoder, "up" );
+    /* Encode number of ports parameter */
+    if( xError == CborNoError )
+    {
+        xError = cbor_add_kv_uint( &xPortsEncoder, "t", uxPortCount );
         configASSERT_CONTINUE( xError == CborNoError );
+    }
 
+    /* Construct ports list / pts if any ports are listening */
+    if( uxEntries > 0 )
+    {
         if( xError == CborNoError )
         {
-            /* Create listening_udp_ports / up object */
-            if( ulPortCount > 0 )
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xUPEncoder, 2 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-            else
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xUPEncoder, 1 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError = cbor_encode_text_stringz( &xPortsEncoder, "pts" );
+            configASSERT_CONTINUE( xError == CborNoError );
         }
 
-        /* Encode number of ports parameter */
         if( xError == CborNoError )
         {
-            xError = cbor_add_kv_uint( &xUPEncoder, "t", ulPortCount );
+            xError = cbor_encoder_create_array( &xPortsEncoder, &xPTSEncoder, uxEntries );
             configASSERT_CONTINUE( xError == CborNoError );
         }
 
-        /* Construct ports list / pts if any udp ports are listening */
-        if( ulPortCount > 0 )
+        if( xError == CborNoError )
         {
-            if( xError == CborNoError )
-            {
-                xError = cbor_encode_text_stringz( &xUPEncoder, "pts" );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_create_array( &xUPEncoder, &xPTSEncoder, ulPortCount );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = xAppendUdpPtsToList( &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_close_container( &xUPEncoder, &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError = xAppendPtsToList( &xPTSEncoder, pxEntries, uxEntries );
+            configASSERT_CONTINUE( xError == CborNoError );
         }
 
         if( xError == CborNoError )
         {
-            xError = cbor_encoder_close_container( pxMetricsEncoder, &xUPEncoder );
+            xError = cbor_encoder_close_container( &xPortsEncoder, &xPTSEncoder );
             configASSERT_CONTINUE( xError == CborNoError );
         }
+    }
 
-        UNLOCK_TCPIP_CORE();
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxMetricsEncoder, &xPortsEncoder );
+        configASSERT_CONTINUE( xError == CborNoError );
     }
 
     return xError;
 }
+
 /*-----------------------------------------------------------*/
 
+CborError xGetListeningTcpPorts( CborEncoder * pxMetricsEncoder )
+{
+    CborError xError = CborNoError;
 
-static size_t xCountTcpConnections( void )
+    if( pxMetricsEncoder == NULL )
+    {
+        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
+        xError = CborErrorImproperValue;
+    }
+    else
+    {
+        size_t uxEntries = 0;
+        size_t uxPortCount = xSnapshotListeningTcpPorts( xTcpPortSnapshot, METRICS_TCP_PORTS_MAX, &uxEntries );
+
+        if( uxEntries < uxPortCount )
+        {
+            LogWarn( "Reporting %lu of %lu listening TCP ports.", ( unsigned long ) uxEntries, ( unsigned long ) uxPortCount );
+        }
+
+        /* Create listening_tcp_ports / tp object */
+        xError = xEncodeListeningPorts( pxMetricsEncoder, "tp", xTcpPortSnapshot, uxEntries, uxPortCount );
+    }
+
+    return xError;
+}
+/*-----------------------------------------------------------*/
+
+CborError xGetListeningUdpPorts( CborEncoder * pxMetricsEncoder )
 {
-    size_t xConnectionCount = 0;
+    CborError xError = CborNoError;
 
-    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    if( pxMetricsEncoder == NULL )
+    {
+        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
+        xError = CborErrorImproperValue;
+    }
+    else
     {
-        xConnectionCount++;
+        size_t uxEntries = 0;
+        size_t uxPortCount = xSnapshotListeningUdpPorts( xUdpPortSnapshot, METRICS_UDP_PORTS_MAX, &uxEntries );
+
+        if( uxEntries < uxPortCount )
+        {
+            LogWarn( "Reporting %lu of %lu listening UDP ports.", ( unsigned long ) uxEntries, ( unsigned long ) uxPortCount );
+        }
+
+        /* Create listening_udp_ports / up object */
+        xError = xEncodeListeningPorts( pxMetricsEncoder, "up", xUdpPortSnapshot, uxEntries, uxPortCount );
     }
 
-    return xConnectionCount;
+    return xError;
 }
+/*-----------------------------------------------------------*/
 
 static bool xIpAddrPortToString( char * pcBuffer,
                                  size_t xBuffLen,
-                                 ip_addr_t * pxIpAddr,
+                                 const ip_addr_t * pxIpAddr,
                                  uint16_t usPort )
 {
     bool xReturn = false;
@@ -523,18 +546,18 @@ static bool xIpAddrPortToString( char * pcBuffer,
     return xReturn;
 }
 
-static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
+static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder,
+                                              const ConnectionEntry_t * pxEntries,
+                                              size_t uxEntries )
 {
     CborError xError = CborNoError;
 
     configASSERT( pxCSEncoder != NULL );
 
-    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    for( size_t i = 0; ( i < uxEntries ) && ( xError == CborNoError ); i++ )
     {
         CborEncoder xCEncoder;
         char pcRemoteIpBuf[ IPADDR_PORT_STR_LEN ] = { 0 };
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifName = NULL;
 
         xError = cbor_encoder_create_map( pxCSEncoder, &xCEncoder, 3 );
         configASSERT_CONTINUE( xError == CborNoError );
@@ -542,7 +565,7 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
         /* Add remote ip / port attribute */
         if( xError == CborNoError )
         {
-            if( xIpAddrPortToString( pcRemoteIpBuf, IPADDR_PORT_STR_LEN, &( pxCurPcb->remote_ip ), pxCurPcb->remote_port ) )
+            if( xIpAddrPortToString( pcRemoteIpBuf, IPADDR_PORT_STR_LEN, &( pxEntries[ i ].xRemoteIp ), pxEntries[ i ].usRemotePort ) )
             {
                 xError = cbor_add_kv_str( &xCEncoder, "rad", pcRemoteIpBuf );
                 configASSERT_CONTINUE( xError == CborNoError );
@@ -553,14 +576,12 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
             }
         }
 
-        pcNetifName = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
-
         /* add local interface attribute */
-        if( pcNetifName != NULL )
+        if( pxEntries[ i ].xNetifValid )
         {
             if( xError == CborNoError )
             {
-                xError = cbor_add_kv_str( &xCEncoder, "li", pcNetifName );
+                xError = cbor_add_kv_str( &xCEncoder, "li", pxEntries[ i ].pcNetifName );
                 configASSERT_CONTINUE( xError == CborNoError );
             }
         }
@@ -573,7 +594,7 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
         /* Add local port attribute */
         if( xError == CborNoError )
         {
-            xError = cbor_add_kv_uint( &xCEncoder, "lp", pxCurPcb->local_port );
+            xError = cbor_add_kv_uint( &xCEncoder, "lp", pxEntries[ i ].usLocalPort );
             configASSERT_CONTINUE( xError == CborNoError );
         }
 
@@ -590,7 +611,6 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
 CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
 {
     CborError xError = CborNoError;
-    uint32_t ulConnCount = 0;
 
     if( pxMetricsEncoder == NULL )
     {
@@ -602,9 +622,13 @@ CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
         CborEncoder xTCEncoder; /* tc object */
         CborEncoder xECEncoder; /* ec object */
         CborEncoder xCSEncoder; /* cs list */
+        size_t uxEntries = 0;
+        size_t uxConnCount = xSnapshotTcpConnections( xConnectionSnapshot, METRICS_CONNECTIONS_MAX, &uxEntries );
 
-        LOCK_TCPIP_CORE();
-        ulConnCount = xCountTcpConnections();
+        if( uxEntries < uxConnCount )
+        {
+            LogWarn( "Reporting %lu of %lu TCP connections.", ( unsigned long ) uxEntries, ( unsigned long ) uxConnCount );
+        }
 
         xError = cbor_encode_text_stringz( pxMetricsEncoder, "tc" );
         configASSERT_CONTINUE( xError == CborNoError );
@@ -625,7 +649,7 @@ CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
         if( xError == CborNoError )
         {
             /* Create established_connections / ec object */
-            if( ulConnCount > 0 )
+            if( uxEntries > 0 )
             {
                 xError = cbor_encoder_create_map( &xTCEncoder, &xECEncoder, 2 );
                 configASSERT_CONTINUE( xError == CborNoError );
@@ -640,12 +664,12 @@ CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
         /* Encode number of connections parameter */
         if( xError == CborNoError )
         {
-            xError = cbor_add_kv_uint( &xECEncoder, "t", ulConnCount );
+            xError = cbor_add_kv_uint( &xECEncoder, "t", uxConnCount );
             configASSERT_CONTINUE( xError == CborNoError );
         }
 
         /* Construct connections_list / cs if any tcp ports are connected */
-        if( ulConnCount > 0 )
+        if( uxEntries > 0 )
         {
             if( xError == CborNoError )
             {
@@ -655,13 +679,13 @@ CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
 
             if( xError == CborNoError )
             {
-                xError = cbor_encoder_create_array( &xECEncoder, &xCSEncoder, ulConnCount );
+                xError = cbor_encoder_create_array( &xECEncoder, &xCSEncoder, uxEntries );
                 configASSERT_CONTINUE( xError == CborNoError );
             }
 
             if( xError == CborNoError )
             {
-                xError = xAppendTcpConnectionsToList( &xCSEncoder );
+                xError = xAppendTcpConnectionsToList( &xCSEncoder, xConnectionSnapshot, uxEntries );
                 configASSERT_CONTINUE( xError == CborNoError );
             }
 
@@ -683,11 +707,203 @@ CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
             xError = cbor_encoder_close_container( pxMetricsEncoder, &xTCEncoder );
             configASSERT_CONTINUE( xError == CborNoError );
         }
-
-        UNLOCK_TCPIP_CORE();
     }
 
     return xError;
 }
 
 /*-----------------------------------------------------------*/
+/*-----------------------------------------------------------*/
+
+CborError xAddCustomMetricNumber( CborEncoder * pxEncoder,
+                                  const char * pcName,
+                                  uint64_t xValue )
+{
+    CborError xError = CborNoError;
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+
+    xError = cbor_encode_text_stringz( pxEncoder, pcName );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_array( pxEncoder, &xListEncoder, 1 );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_map( &xListEncoder, &xValueEncoder, 1 );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_add_kv_uint( &xValueEncoder, "number", xValue );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xListEncoder, &xValueEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, &xListEncoder );
+    }
+
+    configASSERT_CONTINUE( xError == CborNoError );
+
+    return xError;
+}
+
+/*
+ * "name": [ { pcType: [ values ] } ], with the values encoded by pxEncodeValue
+ */
+static CborError prvAddCustomMetricList( CborEncoder * pxEncoder,
+                                         const char * pcName,
+                                         const char * pcType,
+                                         const void * pvValues,
+                                         size_t uxCount,
+                                         CborError ( * pxEncodeValue )( CborEncoder *, const void *, size_t ) )
+{
+    CborError xError = CborNoError;
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+    CborEncoder xArrayEncoder;
+
+    xError = cbor_encode_text_stringz( pxEncoder, pcName );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_array( pxEncoder, &xListEncoder, 1 );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_map( &xListEncoder, &xValueEncoder, 1 );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encode_text_stringz( &xValueEncoder, pcType );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_create_array( &xValueEncoder, &xArrayEncoder, uxCount );
+    }
+
+    for( size_t i = 0; ( i < uxCount ) && ( xError == CborNoError ); i++ )
+    {
+        xError = pxEncodeValue( &xArrayEncoder, pvValues, i );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xValueEncoder, &xArrayEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xListEncoder, &xValueEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, &xListEncoder );
+    }
+
+    configASSERT_CONTINUE( xError == CborNoError );
+
+    return xError;
+}
+
+static CborError prvEncodeNumber( CborEncoder * pxEncoder,
+                                  const void * pvValues,
+                                  size_t uxIndex )
+{
+    return cbor_encode_uint( pxEncoder, ( ( const uint64_t * ) pvValues )[ uxIndex ] );
+}
+
+static CborError prvEncodeString( CborEncoder * pxEncoder,
+                                  const void * pvValues,
+                                  size_t uxIndex )
+{
+    return cbor_encode_text_stringz( pxEncoder, ( ( const char * const * ) pvValues )[ uxIndex ] );
+}
+
+CborError xAddCustomMetricNumberList( CborEncoder * pxEncoder,
+                                      const char * pcName,
+                                      const uint64_t * pxValues,
+                                      size_t uxCount )
+{
+    return prvAddCustomMetricList( pxEncoder, pcName, "number_list", pxValues, uxCount, prvEncodeNumber );
+}
+
+CborError xAddCustomMetricStringList( CborEncoder * pxEncoder,
+                                      const char * pcName,
+                                      const char * const * ppcValues,
+                                      size_t uxCount )
+{
+    return prvAddCustomMetricList( pxEncoder, pcName, "string_list", ppcValues, uxCount, prvEncodeString );
+}
+
+CborError xGetLwipPortCustomMetrics( CborEncoder * pxCustomMetricsEncoder )
+{
+    CborError xError = CborNoError;
+
+    if( pxCustomMetricsEncoder == NULL )
+    {
+        LogError( "Invalid parameter: pxCustomMetricsEncoder: %p", pxCustomMetricsEncoder );
+        xError = CborErrorImproperValue;
+    }
+
+    #if LWIP_SYS_ARCH_STATS
+        if( xError == CborNoError )
+        {
+            static sys_arch_stats_t xSysStats;
+
+            sys_arch_get_stats( &xSysStats );
+
+            xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, "lwip_core_lock_wait_max", xSysStats.xCoreLockWait.ulMax );
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, "lwip_core_lock_hold_max", xSysStats.xCoreLockHold.ulMax );
+            }
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, "lwip_sem_wait_max", xSysStats.xSemWait.ulMax );
+            }
+        }
+    #endif /* LWIP_SYS_ARCH_STATS */
+
+    #if LWIP_MBOX_STATS
+        if( xError == CborNoError )
+        {
+            static sys_mbox_stats_t xMboxStats[ METRICS_MAX_MBOX ];
+            uint32_t ulEntries = sys_arch_mbox_get_stats( xMboxStats, METRICS_MAX_MBOX );
+            uint32_t ulMaxHighWaterMark = 0;
+            uint32_t ulFullCount = 0;
+
+            for( uint32_t i = 0; i < ulEntries; i++ )
+            {
+                ulFullCount += xMboxStats[ i ].ulFullCount;
+
+                if( xMboxStats[ i ].ulHighWaterMark > ulMaxHighWaterMark )
+                {
+                    ulMaxHighWaterMark = xMboxStats[ i ].ulHighWaterMark;
+                }
+            }
+
+            xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, "lwip_mbox_hwm_max", ulMaxHighWaterMark );
+
+            if( xError == CborNoError )
+            {
+                xError = xAddCustomMetricNumber( pxCustomMetricsEncoder, "lwip_mbox_full", ulFullCount );
+            }
+        }
+    #endif /* LWIP_MBOX_STATS */
+
+    return xError;
+}
@@ -35,6 +35,8 @@
 /* Standard includes. */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
@@ -54,28 +56,113 @@
 /* Sensor includes */
 #include "b_u585i_iot02a_env_sensors.h"
 
+#include "telemetry_encode.h"
+#include "telemetry_series.h"
+#include "sensor_publish.h"
+#include "mqtt_payload_pool.h"
+#include "i2c_bus.h"
+#include "hw_defs.h"
+#include "periodic_work.h"
+#include "watchdog.h"
+
 
 #define MQTT_PUBLISH_MAX_LEN                 ( 512 )
-#define MQTT_PUBLISH_TIME_BETWEEN_MS         ( 1000 )
-#define MQTT_PUBLISH_TOPIC                   "env_sensor_data"
-#define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
-#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 1000 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
 
-#define MQTT_NOTIFY_IDX                      ( 1 )
+/* Period of the sensor readings, which are published or added to a series block */
+#ifndef ENV_SENSOR_POLL_PERIOD_MS
+    #define ENV_SENSOR_POLL_PERIOD_MS        ( 1000 )
+#endif
+
+#define MQTT_PUBLISH_TIME_BETWEEN_MS         ENV_SENSOR_POLL_PERIOD_MS
+#define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
 #define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
 
-/*-----------------------------------------------------------*/
+/* Topic after "<thing name>/", sent in full with every publish. A shorter name saves as many
+ * bytes per publish, the cloud side rules must subscribe to the same name. */
+#ifndef ENV_SENSOR_PUBLISH_TOPIC
+    #define ENV_SENSOR_PUBLISH_TOPIC         "env_sensor_data"
+#endif
+
+#define MQTT_PUBLISH_TOPIC                   ENV_SENSOR_PUBLISH_TOPIC
+
+/* TELEMETRY_FORMAT_CBOR publishes to MQTT_PUBLISH_TOPIC TELEMETRY_CBOR_TOPIC_SUFFIX */
+#ifndef ENV_SENSOR_PUBLISH_FORMAT
+    #define ENV_SENSOR_PUBLISH_FORMAT        TELEMETRY_FORMAT_JSON
+#endif
+
+/* Readings per telemetry series block when above 0. The readings are then added to a block,
+ * published to MQTT_PUBLISH_TOPIC TELEMETRY_SERIES_TOPIC_SUFFIX once it holds that many readings
+ * or the next one does not fit, instead of one payload per reading. */
+#ifndef ENV_SENSOR_SERIES_SAMPLES
+    #define ENV_SENSOR_SERIES_SAMPLES        0
+#endif
+
+#define ENV_SENSOR_SERIES_CHANNELS           4
+#define ENV_SENSOR_SERIES_DECIMALS           2
+#define ENV_SENSOR_SERIES_TIME_UNIT_MS       ( MQTT_PUBLISH_TIME_BETWEEN_MS / 10 )
+
+#if ( ENV_SENSOR_SERIES_SAMPLES > 0 )
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        TELEMETRY_SERIES_TOPIC_SUFFIX
+#elif ( ENV_SENSOR_PUBLISH_FORMAT == TELEMETRY_FORMAT_CBOR )
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        TELEMETRY_CBOR_TOPIC_SUFFIX
+#else
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        ""
+#endif
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
+/*
+ * Readings are published when one of them moved by at least its deadband since the last publish,
+ * or when nothing was published for the max silence. The env_publish key overrides these
+ * defaults with "temp=<C>,rh=<%>,baro=<mbar>,silence=<s>", any subset in any order.
+ * A deadband or max silence of 0 publishes every reading.
  */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-};
+#define ENV_PUBLISH_DEADBAND_TEMP_C          ( 0.2f )
+#define ENV_PUBLISH_DEADBAND_RH_PCT          ( 1.0f )
+#define ENV_PUBLISH_DEADBAND_BARO_MBAR       ( 0.5f )
+#define ENV_PUBLISH_MAX_SILENCE_S            ( 300 )
+#define ENV_PUBLISH_POLICY_LEN               ( 64 )
+
+/*
+ * With ENV_SENSOR_ONE_SHOT, the HTS221 and LPS22HH stay powered down between readings: each
+ * reading starts one conversion, so the sensors convert once per poll period instead of at
+ * their lowest continuous rate of 1 Hz. The task sleeps on ENV_SENSOR_DRDY_NOTIFY_IDX until both
+ * status registers report new data, checking them every ENV_SENSOR_DRDY_POLL_MS.
+ *
+ * A board which routes the LPS22HH INT_DRDY output to a gpio defines ENV_SENSOR_DRDY_Pin,
+ * ENV_SENSOR_DRDY_GPIO_Port and ENV_SENSOR_DRDY_EXTI_IRQn: its rising edge then wakes the task
+ * as soon as the pressure is ready. Set ENV_SENSOR_ONE_SHOT to 0 for continuous 1 Hz conversion.
+ */
+#ifndef ENV_SENSOR_ONE_SHOT
+    #define ENV_SENSOR_ONE_SHOT              1
+#endif
+
+#ifndef ENV_SENSOR_DRDY_NOTIFY_IDX
+    #define ENV_SENSOR_DRDY_NOTIFY_IDX       3
+#endif
+
+#define ENV_SENSOR_DRDY_POLL_MS              ( 10 )
+#define ENV_SENSOR_DRDY_TIMEOUT_MS           ( 250 )
+#define ENV_SENSOR_I2C_TIMEOUT_MS            ( 50 )
+
+/* HTS221 and LPS22HH on I2C2 */
+#define HTS221_I2C_ADDR                      ( 0xBF )
+#define HTS221_CTRL_REG1                     ( 0x20 )
+#define HTS221_CTRL_REG2                     ( 0x21 )
+#define HTS221_STATUS_REG                    ( 0x27 )
+#define HTS221_ODR_MASK                      ( 0x03 )
+#define HTS221_ONE_SHOT                      ( 0x01 )
+#define HTS221_STATUS_T_H_DA                 ( 0x03 )
+
+#define LPS22HH_I2C_ADDR                     ( 0xBB )
+#define LPS22HH_CTRL_REG1                    ( 0x10 )
+#define LPS22HH_CTRL_REG2                    ( 0x11 )
+#define LPS22HH_CTRL_REG3                    ( 0x12 )
+#define LPS22HH_STATUS                       ( 0x27 )
+#define LPS22HH_ODR_MASK                     ( 0x70 )
+#define LPS22HH_ONE_SHOT                     ( 0x01 )
+#define LPS22HH_INT_DRDY                     ( 0x04 )
+#define LPS22HH_STATUS_P_T_DA                ( 0x03 )
+
+/*-----------------------------------------------------------*/
 
 typedef struct
 {
@@ -85,117 +172,147 @@ typedef struct
     float_t fBarometricPressure;
 } EnvironmentalSensorData_t;
 
-/*-----------------------------------------------------------*/
-
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+typedef struct
 {
-    configASSERT( pxCommandContext != NULL );
-    configASSERT( pxReturnInfo != NULL );
+    float fTempC;
+    float fRhPct;
+    float fBaroMbar;
+    uint32_t ulMaxSilenceS;
+} EnvPublishPolicy_t;
+
+/* Set by the kvstore when env_publish is committed, the task reloads the policy */
+static volatile BaseType_t xPolicyChanged = pdFALSE;
+
+/*-----------------------------------------------------------*/
 
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+#if ( ENV_SENSOR_ONE_SHOT == 1 )
 
-    if( pxCommandContext->xTaskToNotify != NULL )
+/* Read, modify and write a register, with the bus locked */
+    static BaseType_t xRegUpdate( uint16_t usDevAddr,
+                                  uint16_t usReg,
+                                  uint8_t ucMask,
+                                  uint8_t ucValue )
     {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyGiveIndexed( pxCommandContext->xTaskToNotify,
-                                         MQTT_NOTIFY_IDX );
+        uint8_t ucReg = 0;
+        I2cBusXfer_t xXfer = { usDevAddr, usReg, &ucReg, 1, 1 };
+        BaseType_t xResult = xI2cBusTransfer( &xXfer, 1, pdMS_TO_TICKS( ENV_SENSOR_I2C_TIMEOUT_MS ) );
+
+        if( xResult == pdTRUE )
+        {
+            ucReg = ( ucReg & ~ucMask ) | ( ucValue & ucMask );
+            xXfer.ucRead = 0;
+            xResult = xI2cBusTransfer( &xXfer, 1, pdMS_TO_TICKS( ENV_SENSOR_I2C_TIMEOUT_MS ) );
+        }
+
+        return xResult;
     }
-}
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
-                                           const char * pcTopic,
-                                           const void * pvPublishData,
-                                           size_t xPublishDataLen )
-{
-    BaseType_t xResult = pdFALSE;
-    MQTTStatus_t xStatus;
+/* Power down mode with an output data rate of 0, from which each ONE_SHOT starts a conversion */
+    static BaseType_t xConfigureOneShot( void )
+    {
+        BaseType_t xResult = pdFALSE;
 
-    configASSERT( pcTopic != NULL );
-    configASSERT( pvPublishData != NULL );
-    configASSERT( xPublishDataLen > 0 );
+        if( ( xRegUpdate( HTS221_I2C_ADDR, HTS221_CTRL_REG1, HTS221_ODR_MASK, 0 ) == pdTRUE ) &&
+            ( xRegUpdate( LPS22HH_I2C_ADDR, LPS22HH_CTRL_REG1, LPS22HH_ODR_MASK, 0 ) == pdTRUE ) )
+        {
+            xResult = pdTRUE;
+        }
 
-    MQTTPublishInfo_t xPublishInfo =
-    {
-        .qos             = MQTT_PUBLISH_QOS,
-        .retain          = 0,
-        .dup             = 0,
-        .pTopicName      = pcTopic,
-        .topicNameLength = strlen( pcTopic ),
-        .pPayload        = pvPublishData,
-        .payloadLength   = xPublishDataLen
-    };
+        #ifdef ENV_SENSOR_DRDY_Pin
+            if( xResult == pdTRUE )
+            {
+                GPIO_InitTypeDef xGpioInit =
+                {
+                    .Pin       = ENV_SENSOR_DRDY_Pin,
+                    .Mode      = GPIO_MODE_IT_RISING,
+                    .Pull      = GPIO_NOPULL,
+                    .Speed     = GPIO_SPEED_FREQ_LOW,
+                    .Alternate = 0X0,
+                };
 
-    MQTTAgentCommandContext_t xCommandContext =
-    {
-        .xTaskToNotify = xTaskGetCurrentTaskHandle(),
-        .xReturnStatus = MQTTIllegalState,
-    };
+                HAL_GPIO_Init( ENV_SENSOR_DRDY_GPIO_Port, &xGpioInit );
 
-    MQTTAgentCommandInfo_t xCommandParams =
-    {
-        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = &xCommandContext,
-    };
+                GPIO_EXTI_Register_Notify( ENV_SENSOR_DRDY_Pin, xTaskGetCurrentTaskHandle(), ENV_SENSOR_DRDY_NOTIFY_IDX, 0 );
 
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
+                HAL_NVIC_SetPriority( ENV_SENSOR_DRDY_EXTI_IRQn, 5, 5 );
+                HAL_NVIC_EnableIRQ( ENV_SENSOR_DRDY_EXTI_IRQn );
 
+                xResult = xRegUpdate( LPS22HH_I2C_ADDR, LPS22HH_CTRL_REG3, LPS22HH_INT_DRDY, LPS22HH_INT_DRDY );
+            }
+        #endif /* ENV_SENSOR_DRDY_Pin */
+
+        return xResult;
+    }
 
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
+/*-----------------------------------------------------------*/
 
-    if( xStatus == MQTTSuccess )
+/*
+ * Start a conversion on both sensors and sleep until both have new data. The bus is only
+ * locked for each transfer, so the motion sensors are read in the meantime.
+ */
+    static BaseType_t xStartAndWaitConversion( void )
     {
-        xResult = ulTaskNotifyTakeIndexed( MQTT_NOTIFY_IDX,
-                                           pdTRUE,
-                                           pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
+        BaseType_t xResult = pdFALSE;
+        TickType_t xStart;
 
-        if( xResult == 0 )
+        /* Drop a data ready edge left over from the previous reading */
+        ( void ) ulTaskNotifyTakeIndexed( ENV_SENSOR_DRDY_NOTIFY_IDX, pdTRUE, 0 );
+
+        if( xI2cBusLock( pdMS_TO_TICKS( ENV_SENSOR_I2C_TIMEOUT_MS ) ) == pdTRUE )
         {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
+            if( ( xRegUpdate( HTS221_I2C_ADDR, HTS221_CTRL_REG2, HTS221_ONE_SHOT, HTS221_ONE_SHOT ) == pdTRUE ) &&
+                ( xRegUpdate( LPS22HH_I2C_ADDR, LPS22HH_CTRL_REG2, LPS22HH_ONE_SHOT, LPS22HH_ONE_SHOT ) == pdTRUE ) )
+            {
+                xResult = pdTRUE;
+            }
+
+            vI2cBusUnlock();
         }
-        else if( xCommandContext.xReturnStatus != MQTTSuccess )
+
+        xStart = xTaskGetTickCount();
+
+        while( xResult == pdTRUE )
         {
-            LogError( "MQTT Agent returned error code: %d during publish operation.",
-                      xCommandContext.xReturnStatus );
-            xResult = pdFALSE;
-        }
-    }
-    else
-    {
-        LogError( "MQTTAgent_Publish returned error code: %d.",
-                  xStatus );
-    }
+            uint8_t ucHts221Status = 0;
+            uint8_t ucLps22hhStatus = 0;
+            const I2cBusXfer_t xXfers[] =
+            {
+                { HTS221_I2C_ADDR,  HTS221_STATUS_REG, &ucHts221Status,  1, 1 },
+                { LPS22HH_I2C_ADDR, LPS22HH_STATUS,    &ucLps22hhStatus, 1, 1 },
+            };
 
-    return xResult;
-}
+            ( void ) ulTaskNotifyTakeIndexed( ENV_SENSOR_DRDY_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( ENV_SENSOR_DRDY_POLL_MS ) );
 
-static BaseType_t xIsMqttConnected( void )
-{
-    /* Wait for MQTT to be connected */
-    EventBits_t uxEvents = xEventGroupWaitBits( xSystemEvents,
-                                                EVT_MASK_MQTT_CONNECTED,
-                                                pdFALSE,
-                                                pdTRUE,
-                                                0 );
-
-    return( ( uxEvents & EVT_MASK_MQTT_CONNECTED ) == EVT_MASK_MQTT_CONNECTED );
-}
+            xResult = xI2cBusTransfer( xXfers, 2, pdMS_TO_TICKS( ENV_SENSOR_I2C_TIMEOUT_MS ) );
+
+            if( ( xResult == pdTRUE ) &&
+                ( ( ucHts221Status & HTS221_STATUS_T_H_DA ) == HTS221_STATUS_T_H_DA ) &&
+                ( ( ucLps22hhStatus & LPS22HH_STATUS_P_T_DA ) == LPS22HH_STATUS_P_T_DA ) )
+            {
+                break;
+            }
+
+            if( ( xTaskGetTickCount() - xStart ) > pdMS_TO_TICKS( ENV_SENSOR_DRDY_TIMEOUT_MS ) )
+            {
+                LogError( "Timed out waiting for the environmental sensors." );
+                xResult = pdFALSE;
+            }
+        }
+
+        return xResult;
+    }
+#endif /* ENV_SENSOR_ONE_SHOT == 1 */
 
 /*-----------------------------------------------------------*/
 
 static BaseType_t xInitSensors( void )
 {
     int32_t lBspError = BSP_ERROR_NONE;
+    BaseType_t xResult;
+
+    ( void ) xI2cBusLock( portMAX_DELAY );
 
     lBspError = BSP_ENV_SENSOR_Init( 0, ENV_TEMPERATURE );
 
@@ -213,44 +330,272 @@ static BaseType_t xInitSensors( void )
 
     lBspError |= BSP_ENV_SENSOR_Enable( 1, ENV_PRESSURE );
 
-    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_TEMPERATURE, 1.0f );
+    #if ( ENV_SENSOR_ONE_SHOT == 1 )
+        /* The BSP has no one-shot rate, its lowest setting is continuous 1 Hz */
+        xResult = ( lBspError == BSP_ERROR_NONE ) ? xConfigureOneShot() : pdFALSE;
+    #else
+        lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_TEMPERATURE, 1.0f );
 
-    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_HUMIDITY, 1.0f );
+        lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_HUMIDITY, 1.0f );
 
-    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_TEMPERATURE, 1.0f );
+        lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_TEMPERATURE, 1.0f );
 
-    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_PRESSURE, 1.0f );
+        lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_PRESSURE, 1.0f );
 
-    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+        xResult = ( lBspError == BSP_ERROR_NONE ) ? pdTRUE : pdFALSE;
+    #endif
+
+    vI2cBusUnlock();
+
+    return xResult;
 }
 
 static BaseType_t xUpdateSensorData( EnvironmentalSensorData_t * pxData )
 {
-    int32_t lBspError = BSP_ERROR_NONE;
+    int32_t lBspError = BSP_ERROR_NO_INIT;
+    BaseType_t xReady = pdTRUE;
+
+    #if ( ENV_SENSOR_ONE_SHOT == 1 )
+        xReady = xStartAndWaitConversion();
+    #endif
+
+    /* The BSP drivers apply the calibration, so the reads stay on them with the bus locked */
+    if( ( xReady == pdTRUE ) &&
+        ( xI2cBusLock( pdMS_TO_TICKS( MQTT_PUBLISH_TIME_BETWEEN_MS ) ) == pdTRUE ) )
+    {
+        lBspError = BSP_ENV_SENSOR_GetValue( 0, ENV_TEMPERATURE, &pxData->fTemperature0 );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 0, ENV_HUMIDITY, &pxData->fHumidity );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_TEMPERATURE, &pxData->fTemperature1 );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_PRESSURE, &pxData->fBarometricPressure );
 
-    lBspError = BSP_ENV_SENSOR_GetValue( 0, ENV_TEMPERATURE, &pxData->fTemperature0 );
-    lBspError |= BSP_ENV_SENSOR_GetValue( 0, ENV_HUMIDITY, &pxData->fHumidity );
-    lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_TEMPERATURE, &pxData->fTemperature1 );
-    lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_PRESSURE, &pxData->fBarometricPressure );
+        vI2cBusUnlock();
+    }
 
     return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
 }
 
 /*-----------------------------------------------------------*/
 
+static BaseType_t xParsePolicy( const char * pcPolicy,
+                                EnvPublishPolicy_t * pxPolicy )
+{
+    char pcBuf[ ENV_PUBLISH_POLICY_LEN ];
+    char * pcSave = NULL;
+    BaseType_t xResult = pdTRUE;
+
+    ( void ) strlcpy( pcBuf, pcPolicy, sizeof( pcBuf ) );
+
+    for( char * pcEntry = strtok_r( pcBuf, ",", &pcSave );
+         ( pcEntry != NULL ) && ( xResult == pdTRUE );
+         pcEntry = strtok_r( NULL, ",", &pcSave ) )
+    {
+        char * pcValue = strchr( pcEntry, '=' );
+        char * pcEnd = NULL;
+        float fValue = 0.0f;
+
+        if( pcValue != NULL )
+        {
+            *pcValue = '\0';
+            pcValue++;
+            fValue = strtof( pcValue, &pcEnd );
+        }
+
+        if( ( pcValue == NULL ) || ( pcEnd == pcValue ) || ( *pcEnd != '\0' ) || ( fValue < 0.0f ) )
+        {
+            xResult = pdFALSE;
+        }
+        else if( strcmp( pcEntry, "temp" ) == 0 )
+        {
+            pxPolicy->fTempC = fValue;
+        }
+        else if( strcmp( pcEntry, "rh" ) == 0 )
+        {
+            pxPolicy->fRhPct = fValue;
+        }
+        else if( strcmp( pcEntry, "baro" ) == 0 )
+        {
+            pxPolicy->fBaroMbar = fValue;
+        }
+        else if( strcmp( pcEntry, "silence" ) == 0 )
+        {
+            pxPolicy->ulMaxSilenceS = ( uint32_t ) fValue;
+        }
+        else
+        {
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLoadPolicy( EnvPublishPolicy_t * pxPolicy )
+{
+    char pcPolicy[ ENV_PUBLISH_POLICY_LEN ] = { 0 };
+    EnvPublishPolicy_t xPolicy =
+    {
+        .fTempC        = ENV_PUBLISH_DEADBAND_TEMP_C,
+        .fRhPct        = ENV_PUBLISH_DEADBAND_RH_PCT,
+        .fBaroMbar     = ENV_PUBLISH_DEADBAND_BARO_MBAR,
+        .ulMaxSilenceS = ENV_PUBLISH_MAX_SILENCE_S,
+    };
+
+    ( void ) KVStore_getString( CS_ENV_PUBLISH_POLICY, pcPolicy, sizeof( pcPolicy ) );
+
+    if( xParsePolicy( pcPolicy, &xPolicy ) == pdTRUE )
+    {
+        *pxPolicy = xPolicy;
+    }
+    else
+    {
+        LogError( "Ignored invalid env_publish key: %s", pcPolicy );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPolicyChangedCallback( KVStoreKey_t xKey,
+                                      void * pvCtx )
+{
+    ( void ) xKey;
+    ( void ) pvCtx;
+
+    xPolicyChanged = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xShouldPublish( const EnvPublishPolicy_t * pxPolicy,
+                                  const EnvironmentalSensorData_t * pxData,
+                                  const EnvironmentalSensorData_t * pxLast,
+                                  TickType_t xSilentTicks )
+{
+    return( ( fabsf( pxData->fTemperature0 - pxLast->fTemperature0 ) >= pxPolicy->fTempC ) ||
+            ( fabsf( pxData->fTemperature1 - pxLast->fTemperature1 ) >= pxPolicy->fTempC ) ||
+            ( fabsf( pxData->fHumidity - pxLast->fHumidity ) >= pxPolicy->fRhPct ) ||
+            ( fabsf( pxData->fBarometricPressure - pxLast->fBarometricPressure ) >= pxPolicy->fBaroMbar ) ||
+            ( xSilentTicks >= pdMS_TO_TICKS( pxPolicy->ulMaxSilenceS * 1000U ) ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( ENV_SENSOR_SERIES_SAMPLES > 0 )
+
+    /* Built in a pooled buffer, which is handed to the publisher once full. pdFALSE while none is free */
+    static BaseType_t prvSeriesBegin( TelemetrySeries_t * pxSeries )
+    {
+        static const uint8_t ucDecimals[ ENV_SENSOR_SERIES_CHANNELS ] =
+        {
+            ENV_SENSOR_SERIES_DECIMALS, ENV_SENSOR_SERIES_DECIMALS,
+            ENV_SENSOR_SERIES_DECIMALS, ENV_SENSOR_SERIES_DECIMALS
+        };
+        uint8_t * pucBuf = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+
+        if( pucBuf != NULL )
+        {
+            vTelemetrySeriesBegin( pxSeries, pucBuf, MQTT_PUBLISH_MAX_LEN,
+                                   ENV_SENSOR_SERIES_CHANNELS, ucDecimals, ENV_SENSOR_SERIES_TIME_UNIT_MS );
+        }
+        else
+        {
+            pxSeries->pucBuffer = NULL;
+        }
+
+        return ( pucBuf != NULL ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    /* Readings are kept while offline, the block is then spooled or dropped by xSensorPublishSubmitPooled */
+    static void prvSeriesPublish( TelemetrySeries_t * pxSeries,
+                                  const char * pcTopic )
+    {
+        size_t xPayloadLen = xTelemetrySeriesEnd( pxSeries );
+
+        if( xPayloadLen > 0 )
+        {
+            LogDebug( "Queueing %lu readings in %u bytes.", pxSeries->ulSamples, xPayloadLen );
+            ( void ) xSensorPublishSubmitPooled( pcTopic, pxSeries->pucBuffer, xPayloadLen, MQTT_PUBLISH_QOS );
+        }
+        else
+        {
+            vMqttPayloadRelease( pxSeries->pucBuffer );
+        }
+
+        ( void ) prvSeriesBegin( pxSeries );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvSeriesAdd( TelemetrySeries_t * pxSeries,
+                                    const char * pcTopic,
+                                    const EnvironmentalSensorData_t * pxData )
+    {
+        uint32_t ulTimeMs = ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS );
+        int32_t lValues[ ENV_SENSOR_SERIES_CHANNELS ] =
+        {
+            lTelemetrySeriesScale( pxData->fTemperature0, ENV_SENSOR_SERIES_DECIMALS ),
+            lTelemetrySeriesScale( pxData->fHumidity, ENV_SENSOR_SERIES_DECIMALS ),
+            lTelemetrySeriesScale( pxData->fTemperature1, ENV_SENSOR_SERIES_DECIMALS ),
+            lTelemetrySeriesScale( pxData->fBarometricPressure, ENV_SENSOR_SERIES_DECIMALS ),
+        };
+        BaseType_t xResult = pdFALSE;
+
+        /* While every buffer is still waiting for the broker the reading is dropped */
+        if( ( pxSeries->pucBuffer != NULL ) ||
+            ( prvSeriesBegin( pxSeries ) == pdTRUE ) )
+        {
+            xResult = xTelemetrySeriesAdd( pxSeries, ulTimeMs, lValues );
+
+            if( xResult == pdFALSE )
+            {
+                prvSeriesPublish( pxSeries, pcTopic );
+
+                if( pxSeries->pucBuffer != NULL )
+                {
+                    xResult = xTelemetrySeriesAdd( pxSeries, ulTimeMs, lValues );
+                }
+            }
+
+            if( ( pxSeries->pucBuffer != NULL ) &&
+                ( pxSeries->ulSamples >= ENV_SENSOR_SERIES_SAMPLES ) )
+            {
+                prvSeriesPublish( pxSeries, pcTopic );
+            }
+        }
+
+        return xResult;
+    }
+#endif /* ENV_SENSOR_SERIES_SAMPLES > 0 */
+
+/*-----------------------------------------------------------*/
+
 extern UBaseType_t uxRand( void );
 
 void vEnvironmentSensorPublishTask( void * pvParameters )
 {
     BaseType_t xResult = pdFALSE;
     BaseType_t xExitFlag = pdFALSE;
-    char payloadBuf[ MQTT_PUBLISH_MAX_LEN ];
-    MQTTAgentHandle_t xAgentHandle = NULL;
     char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
     size_t uxTopicLen = 0;
+    EnvPublishPolicy_t xPolicy = { 0 };
+    EnvironmentalSensorData_t xLastPublished = { 0 };
+    BaseType_t xPublished = pdFALSE;
+    TickType_t xLastPublishTime = 0;
+    static PeriodicWork_t xPollWork;
+    static WatchdogClient_t xWatch;
+
+    #if ( ENV_SENSOR_SERIES_SAMPLES > 0 )
+        TelemetrySeries_t xSeries;
+    #endif
 
     ( void ) pvParameters;
 
+    prvLoadPolicy( &xPolicy );
+    ( void ) KVStore_subscribe( CS_ENV_PUBLISH_POLICY, prvPolicyChangedCallback, NULL );
+
     xResult = xInitSensors();
 
     if( xResult != pdTRUE )
@@ -263,7 +608,7 @@ void vEnvironmentSensorPublishTask( void * pvParameters )
 
     if( uxTopicLen > 0 )
     {
-        uxTopicLen = strlcat( pcTopicString, "/" MQTT_PUBLISH_TOPIC, MQTT_PUBLICH_TOPIC_STR_LEN );
+        uxTopicLen = strlcat( pcTopicString, "/" MQTT_PUBLISH_TOPIC MQTT_PUBLISH_TOPIC_SUFFIX, MQTT_PUBLICH_TOPIC_STR_LEN );
     }
 
     if( ( uxTopicLen == 0 ) || ( uxTopicLen >= MQTT_PUBLICH_TOPIC_STR_LEN ) )
@@ -272,64 +617,104 @@ void vEnvironmentSensorPublishTask( void * pvParameters )
         xExitFlag = pdTRUE;
     }
 
+    #if ( ENV_SENSOR_SERIES_SAMPLES > 0 )
+        ( void ) prvSeriesBegin( &xSeries );
+    #endif
+
     vSleepUntilMQTTAgentReady();
 
-    xAgentHandle = xGetMqttAgentHandle();
+    /* Up to a tenth of a period late, so the poll can share a wakeup with the other periodic tasks */
+    vPeriodicWorkStart( &xPollWork, pdMS_TO_TICKS( MQTT_PUBLISH_TIME_BETWEEN_MS ),
+                        pdMS_TO_TICKS( MQTT_PUBLISH_TIME_BETWEEN_MS / 10 ) );
+
+    /* Catches a sensor read stuck on the I2C bus */
+    vWatchdogStart( &xWatch, "EnvSense", pdMS_TO_TICKS( 10 * MQTT_PUBLISH_TIME_BETWEEN_MS ) );
 
     while( xExitFlag == pdFALSE )
     {
-        TickType_t xTicksToWait = pdMS_TO_TICKS( MQTT_PUBLISH_TIME_BETWEEN_MS );
-        TimeOut_t xTimeOut;
+        EnvironmentalSensorData_t xEnvData;
 
-        vTaskSetTimeOutState( &xTimeOut );
+        vWatchdogCheckIn( &xWatch );
+
+        if( xPolicyChanged == pdTRUE )
+        {
+            xPolicyChanged = pdFALSE;
+            prvLoadPolicy( &xPolicy );
+        }
 
-        EnvironmentalSensorData_t xEnvData;
         xResult = xUpdateSensorData( &xEnvData );
 
         if( xResult != pdTRUE )
         {
             LogError( "Error while reading sensor data." );
         }
-        else if( xIsMqttConnected() == pdTRUE )
+        else if( ( xPublished == pdTRUE ) &&
+                 ( xShouldPublish( &xPolicy, &xEnvData, &xLastPublished, xTaskGetTickCount() - xLastPublishTime ) == pdFALSE ) )
         {
-            int bytesWritten = 0;
-
-            /* Write to */
-            bytesWritten = snprintf( payloadBuf,
-                                     MQTT_PUBLISH_MAX_LEN,
-                                     "{ \"temp_0_c\": %f, \"rh_pct\": %f, \"temp_1_c\": %f, \"baro_mbar\": %f }",
-                                     xEnvData.fTemperature0,
-                                     xEnvData.fHumidity,
-                                     xEnvData.fTemperature1,
-                                     xEnvData.fBarometricPressure );
-
-            if( bytesWritten < MQTT_PUBLISH_MAX_LEN )
-            {
-                xResult = prvPublishAndWaitForAck( xAgentHandle,
-                                                   pcTopicString,
-                                                   payloadBuf,
-                                                   bytesWritten );
-            }
-            else if( bytesWritten > 0 )
-            {
-                LogError( "Not enough buffer space." );
-            }
-            else
+            /* No meaningful change */
+        }
+        #if ( ENV_SENSOR_SERIES_SAMPLES > 0 )
+            else if( prvSeriesAdd( &xSeries, pcTopicString, &xEnvData ) == pdTRUE )
             {
-                LogError( "Printf call failed." );
+                xLastPublished = xEnvData;
+                xLastPublishTime = xTaskGetTickCount();
+                xPublished = pdTRUE;
             }
-
-            if( xResult == pdTRUE )
+        #else
+            else if( xSensorPublishIsAccepting() == pdTRUE )
             {
-                LogDebug( payloadBuf );
+                TelemetryEncoder_t xEncoder;
+                size_t xPayloadLen = 0;
+                uint8_t * pucPayload = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+
+                if( pucPayload != NULL )
+                {
+                    vTelemetryBegin( &xEncoder, ENV_SENSOR_PUBLISH_FORMAT, pucPayload, MQTT_PUBLISH_MAX_LEN );
+                    vTelemetryAddFloat( &xEncoder, "temp_0_c", xEnvData.fTemperature0, 2 );
+                    vTelemetryAddFloat( &xEncoder, "rh_pct", xEnvData.fHumidity, 2 );
+                    vTelemetryAddFloat( &xEncoder, "temp_1_c", xEnvData.fTemperature1, 2 );
+                    vTelemetryAddFloat( &xEncoder, "baro_mbar", xEnvData.fBarometricPressure, 2 );
+                    xPayloadLen = xTelemetryEnd( &xEncoder );
+                }
+
+                if( pucPayload == NULL )
+                {
+                    LogError( "No payload buffer free." );
+                    xResult = pdFALSE;
+                }
+                else if( xPayloadLen > 0 )
+                {
+                    #if ( ENV_SENSOR_PUBLISH_FORMAT == TELEMETRY_FORMAT_CBOR )
+                        LogDebug( "Queueing %u bytes.", xPayloadLen );
+                    #else
+                        LogDebug( ( const char * ) pucPayload );
+                    #endif
+
+                    /* Returns at once and hands the buffer over, the publisher task waits for the agent */
+                    xResult = xSensorPublishSubmitPooled( pcTopicString,
+                                                          pucPayload,
+                                                          xPayloadLen,
+                                                          MQTT_PUBLISH_QOS );
+                }
+                else
+                {
+                    LogError( "Not enough buffer space." );
+                    vMqttPayloadRelease( pucPayload );
+                    xResult = pdFALSE;
+                }
+
+                if( xResult == pdTRUE )
+                {
+                    xLastPublished = xEnvData;
+                    xLastPublishTime = xTaskGetTickCount();
+                    xPublished = pdTRUE;
+                }
             }
-        }
+        #endif /* ENV_SENSOR_SERIES_SAMPLES > 0 */
 
-        /* Adjust remaining tick count */
-        if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
-        {
-            /* Wait until its time to poll the sensors again */
-            vTaskDelay( xTicksToWait );
-        }
+        /* Wait until its time to poll the sensors again */
+        vPeriodicWorkWait( &xPollWork );
     }
+
+    vWatchdogStop( &xWatch );
 }
@@ -0,0 +1,364 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "json_writer.h"
+
+/*-----------------------------------------------------------*/
+
+/* Bytes are counted whether or not they fit, and only those which fit entirely are written */
+static void prvAppend( JsonWriter_t * pxWriter,
+                       const char * pcData,
+                       size_t xDataLen )
+{
+    if( ( pxWriter->pcBuffer != NULL ) &&
+        ( pxWriter->xLen <= pxWriter->xBufferLen ) &&
+        ( xDataLen <= ( pxWriter->xBufferLen - pxWriter->xLen ) ) )
+    {
+        ( void ) memcpy( &pxWriter->pcBuffer[ pxWriter->xLen ], pcData, xDataLen );
+    }
+
+    pxWriter->xLen += xDataLen;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Unsigned decimal of ulValue, zero padded to at least ulMinDigits digits */
+static void prvAppendDecimal( JsonWriter_t * pxWriter,
+                              uint32_t ulValue,
+                              uint32_t ulMinDigits )
+{
+    char pcDigits[ 10 ];
+    size_t xDigits = 0;
+
+    if( ulMinDigits > sizeof( pcDigits ) )
+    {
+        ulMinDigits = sizeof( pcDigits );
+    }
+
+    do
+    {
+        pcDigits[ sizeof( pcDigits ) - 1 - xDigits ] = ( char ) ( '0' + ( ulValue % 10 ) );
+        ulValue /= 10;
+        xDigits++;
+    } while( ( ulValue > 0 ) || ( xDigits < ulMinDigits ) );
+
+    prvAppend( pxWriter, &pcDigits[ sizeof( pcDigits ) - xDigits ], xDigits );
+}
+
+/*-----------------------------------------------------------*/
+
+/* pcValue between quotes. Runs of bytes which need no escape are copied at once */
+static void prvAppendString( JsonWriter_t * pxWriter,
+                             const char * pcValue )
+{
+    static const char pcHex[] = "0123456789abcdef";
+    const char * pcRun = pcValue;
+
+    prvAppend( pxWriter, "\"", 1 );
+
+    for( ; *pcValue != '\0'; pcValue++ )
+    {
+        uint8_t ucChar = ( uint8_t ) *pcValue;
+        char pcEscape[ 6 ] = { '\\', 0, '0', '0', 0, 0 };
+        size_t xEscapeLen = 2;
+
+        switch( ucChar )
+        {
+            case '"':
+            case '\\':
+                pcEscape[ 1 ] = ( char ) ucChar;
+                break;
+
+            case '\b':
+                pcEscape[ 1 ] = 'b';
+                break;
+
+            case '\f':
+                pcEscape[ 1 ] = 'f';
+                break;
+
+            case '\n':
+                pcEscape[ 1 ] = 'n';
+                break;
+
+            case '\r':
+                pcEscape[ 1 ] = 'r';
+                break;
+
+            case '\t':
+                pcEscape[ 1 ] = 't';
+                break;
+
+            default:
+
+                /* Other control characters as \u00XX, UTF-8 sequences are kept as they are */
+                if( ucChar < 0x20U )
+                {
+                    pcEscape[ 1 ] = 'u';
+                    pcEscape[ 4 ] = pcHex[ ucChar >> 4 ];
+                    pcEscape[ 5 ] = pcHex[ ucChar & 0xFU ];
+                    xEscapeLen = 6;
+                }
+                else
+                {
+                    xEscapeLen = 0;
+                }
+
+                break;
+        }
+
+        if( xEscapeLen > 0 )
+        {
+            prvAppend( pxWriter, pcRun, ( size_t ) ( pcValue - pcRun ) );
+            prvAppend( pxWriter, pcEscape, xEscapeLen );
+            pcRun = pcValue + 1;
+        }
+    }
+
+    prvAppend( pxWriter, pcRun, ( size_t ) ( pcValue - pcRun ) );
+    prvAppend( pxWriter, "\"", 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* The separator before a value, and its key in an object below the top level */
+static void prvMember( JsonWriter_t * pxWriter,
+                       const char * pcKey )
+{
+    uint32_t ulDepth = pxWriter->ulDepth;
+
+    if( pxWriter->ucFirst[ ulDepth ] != 0 )
+    {
+        /* First value at this level */
+    }
+    else if( ulDepth == 0 )
+    {
+        /* A document holds a single value */
+        pxWriter->xError = pdTRUE;
+    }
+    else
+    {
+        prvAppend( pxWriter, ",", 1 );
+    }
+
+    pxWriter->ucFirst[ ulDepth ] = 0;
+
+    if( ( ulDepth > 0 ) && ( pxWriter->ucArray[ ulDepth ] == 0 ) )
+    {
+        if( pcKey == NULL )
+        {
+            pxWriter->xError = pdTRUE;
+        }
+        else
+        {
+            prvAppendString( pxWriter, pcKey );
+            prvAppend( pxWriter, ":", 1 );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvOpen( JsonWriter_t * pxWriter,
+                     const char * pcKey,
+                     uint8_t ucArray )
+{
+    prvMember( pxWriter, pcKey );
+
+    if( pxWriter->ulDepth >= JSON_WRITER_MAX_DEPTH )
+    {
+        pxWriter->xError = pdTRUE;
+    }
+    else
+    {
+        prvAppend( pxWriter, ( ucArray != 0 ) ? "[" : "{", 1 );
+        pxWriter->ulDepth++;
+        pxWriter->ucFirst[ pxWriter->ulDepth ] = 1;
+        pxWriter->ucArray[ pxWriter->ulDepth ] = ucArray;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvClose( JsonWriter_t * pxWriter,
+                      uint8_t ucArray )
+{
+    if( ( pxWriter->ulDepth == 0 ) || ( pxWriter->ucArray[ pxWriter->ulDepth ] != ucArray ) )
+    {
+        pxWriter->xError = pdTRUE;
+    }
+    else
+    {
+        prvAppend( pxWriter, ( ucArray != 0 ) ? "]" : "}", 1 );
+        pxWriter->ulDepth--;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterInit( JsonWriter_t * pxWriter,
+                      char * pcBuffer,
+                      size_t xBufferLen )
+{
+    configASSERT( pxWriter != NULL );
+
+    pxWriter->pcBuffer = pcBuffer;
+    pxWriter->xBufferLen = ( pcBuffer != NULL ) ? xBufferLen : 0;
+    pxWriter->xLen = 0;
+    pxWriter->ulDepth = 0;
+    pxWriter->xError = pdFALSE;
+    pxWriter->ucFirst[ 0 ] = 1;
+    pxWriter->ucArray[ 0 ] = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterObjectOpen( JsonWriter_t * pxWriter,
+                            const char * pcKey )
+{
+    prvOpen( pxWriter, pcKey, 0 );
+}
+
+void vJsonWriterObjectClose( JsonWriter_t * pxWriter )
+{
+    prvClose( pxWriter, 0 );
+}
+
+void vJsonWriterArrayOpen( JsonWriter_t * pxWriter,
+                           const char * pcKey )
+{
+    prvOpen( pxWriter, pcKey, 1 );
+}
+
+void vJsonWriterArrayClose( JsonWriter_t * pxWriter )
+{
+    prvClose( pxWriter, 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterUint( JsonWriter_t * pxWriter,
+                      const char * pcKey,
+                      uint32_t ulValue )
+{
+    prvMember( pxWriter, pcKey );
+    prvAppendDecimal( pxWriter, ulValue, 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterInt( JsonWriter_t * pxWriter,
+                     const char * pcKey,
+                     int32_t lValue )
+{
+    prvMember( pxWriter, pcKey );
+
+    if( lValue < 0 )
+    {
+        prvAppend( pxWriter, "-", 1 );
+    }
+
+    prvAppendDecimal( pxWriter, ( lValue < 0 ) ? ( uint32_t ) -( int64_t ) lValue : ( uint32_t ) lValue, 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterBool( JsonWriter_t * pxWriter,
+                      const char * pcKey,
+                      BaseType_t xValue )
+{
+    prvMember( pxWriter, pcKey );
+
+    if( xValue != pdFALSE )
+    {
+        prvAppend( pxWriter, "true", 4 );
+    }
+    else
+    {
+        prvAppend( pxWriter, "false", 5 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterString( JsonWriter_t * pxWriter,
+                        const char * pcKey,
+                        const char * pcValue )
+{
+    prvMember( pxWriter, pcKey );
+    prvAppendString( pxWriter, pcValue );
+}
+
+/*-----------------------------------------------------------*/
+
+void vJsonWriterDecimalString( JsonWriter_t * pxWriter,
+                               const char * pcKey,
+                               uint32_t ulValue,
+                               uint32_t ulMinDigits )
+{
+    prvMember( pxWriter, pcKey );
+    prvAppend( pxWriter, "\"", 1 );
+    prvAppendDecimal( pxWriter, ulValue, ulMinDigits );
+    prvAppend( pxWriter, "\"", 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xJsonWriterLen( const JsonWriter_t * pxWriter )
+{
+    return pxWriter->xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xJsonWriterEnd( JsonWriter_t * pxWriter )
+{
+    size_t xLen = pxWriter->xLen;
+
+    if( ( pxWriter->xError != pdFALSE ) || ( pxWriter->ulDepth != 0 ) )
+    {
+        xLen = 0;
+    }
+    else if( pxWriter->pcBuffer == NULL )
+    {
+        /* Only counting */
+    }
+    else if( xLen < pxWriter->xBufferLen )
+    {
+        pxWriter->pcBuffer[ xLen ] = '\0';
+    }
+    else
+    {
+        xLen = 0;
+    }
+
+    return xLen;
+}
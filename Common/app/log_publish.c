@@ -0,0 +1,555 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Publishes the console log lines in batches on <thing name>/logs.
+ *
+ * Each line is shortened to "<level letter> <s>.<us> <task> <message>", and the time of every line
+ * but the first of a batch is sent as "+<us since the previous line>". Batches are sent with QoS0
+ * once LOG_PUBLISH_BATCH_MS has passed or the payload is full, within a byte rate limit, and only
+ * while the MQTT agent command queue is close to empty so that telemetry goes out first.
+ *
+ * Lines which do not fit in the queue are dropped and counted in a "# <n> dropped" line.
+ * This task only logs errors when publishing starts or stops failing, so that its own lines do
+ * not keep it busy.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "message_buffer.h"
+#include "static_alloc.h"
+
+#include "kvstore.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+#include "sys_evt.h"
+
+/* Lowest priority of the lines published: LOG_ERROR, LOG_WARN, LOG_INFO or LOG_DEBUG */
+#ifndef LOG_PUBLISH_LEVEL
+    #define LOG_PUBLISH_LEVEL    LOG_INFO
+#endif
+
+/* Bytes of log lines held while a batch is being built or published */
+#ifndef LOG_PUBLISH_QUEUE_LEN
+    #define LOG_PUBLISH_QUEUE_LEN    ( 2048 )
+#endif
+
+#ifndef LOG_PUBLISH_BATCH_LEN
+    #define LOG_PUBLISH_BATCH_LEN    ( 1024 )
+#endif
+
+/* Longest time a line waits for the rest of its batch */
+#ifndef LOG_PUBLISH_BATCH_MS
+    #define LOG_PUBLISH_BATCH_MS    ( 5000 )
+#endif
+
+/* Average payload rate, and the longest burst sent after a quiet period */
+#ifndef LOG_PUBLISH_RATE_BYTES_PER_S
+    #define LOG_PUBLISH_RATE_BYTES_PER_S    ( 256 )
+#endif
+
+#ifndef LOG_PUBLISH_BURST_BYTES
+    #define LOG_PUBLISH_BURST_BYTES    ( 2 * LOG_PUBLISH_BATCH_LEN )
+#endif
+
+/* A batch waits while more commands than this are queued to the MQTT agent */
+#ifndef LOG_PUBLISH_MAX_AGENT_QUEUE_DEPTH
+    #define LOG_PUBLISH_MAX_AGENT_QUEUE_DEPTH    ( 1 )
+#endif
+
+#if ( LOG_PUBLISH_BURST_BYTES < LOG_PUBLISH_BATCH_LEN )
+    #error "LOG_PUBLISH_BURST_BYTES must be at least LOG_PUBLISH_BATCH_LEN"
+#endif
+
+#define LOG_PUBLISH_TOPIC                    "logs"
+#define LOG_PUBLISH_TOPIC_STR_LEN            ( 256 )
+#define LOG_PUBLISH_RETRY_MS                 ( 100 )
+#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 200 )
+#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
+
+#define MQTT_NOTIFY_IDX                      ( 1 )
+
+/* Longest compact line, the level letter and separators take less than the original header */
+#define LOG_PUBLISH_LINE_LEN                 ( dlMAX_PRINT_STRING_LENGTH + 1 )
+
+/*-----------------------------------------------------------*/
+
+struct MQTTAgentCommandContext
+{
+    MQTTStatus_t xReturnStatus;
+    TaskHandle_t xTaskToNotify;
+};
+
+/* Written by the console transmit thread, read by the publish task */
+static MessageBufferHandle_t xLogPublishMBuf = NULL;
+static uint32_t ulLinesDropped = 0;
+
+static char pcBatch[ LOG_PUBLISH_BATCH_LEN ];
+static char pcLine[ LOG_PUBLISH_LINE_LEN ];
+
+/*-----------------------------------------------------------*/
+
+static uint8_t ucLineLevel( const char * pcLine,
+                            size_t xLineLen )
+{
+    uint8_t ucLevel = LOG_ERROR;
+
+    /* Lines that are not tagged with a module level, such as SYS and KRN, are always sent */
+    if( ( xLineLen > 5 ) && ( pcLine[ 0 ] == '<' ) && ( pcLine[ 4 ] == '>' ) )
+    {
+        if( strncmp( pcLine, "<WRN>", 5 ) == 0 )
+        {
+            ucLevel = LOG_WARN;
+        }
+        else if( strncmp( pcLine, "<INF>", 5 ) == 0 )
+        {
+            ucLevel = LOG_INFO;
+        }
+        else if( strncmp( pcLine, "<DBG>", 5 ) == 0 )
+        {
+            ucLevel = LOG_DEBUG;
+        }
+    }
+
+    return ucLevel;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Registered with vLoggingSetSink, runs in the console transmit thread so it must not block */
+static void prvLogPublishPut( const char * pcLine,
+                              size_t xLineLen )
+{
+    if( xLineLen > dlMAX_PRINT_STRING_LENGTH )
+    {
+        xLineLen = dlMAX_PRINT_STRING_LENGTH;
+    }
+
+    if( ucLineLevel( pcLine, xLineLen ) <= LOG_PUBLISH_LEVEL )
+    {
+        if( xMessageBufferSend( xLogPublishMBuf, pcLine, xLineLen, 0 ) == 0 )
+        {
+            ( void ) __atomic_fetch_add( &ulLinesDropped, 1, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Write the compact form of the line "<LVL> <s>.<us> [<task>] <message>" to pcOut. The time is
+ * written relative to *pullLastUs unless xFirst is set. Lines in another format are copied.
+ */
+static size_t xLineCompact( const char * pcIn,
+                            size_t xInLen,
+                            char * pcOut,
+                            size_t xOutLen,
+                            BaseType_t xFirst,
+                            uint64_t * pullLastUs )
+{
+    size_t xIdx = 0;
+    size_t xLen = 0;
+    const char * pcTask = NULL;
+    size_t xTaskLen = 0;
+    uint64_t ullSeconds = 0;
+    uint32_t ulMicros = 0;
+    BaseType_t xDigits = pdFALSE;
+    int lLen;
+
+    if( ( xInLen > 5 ) && ( pcIn[ 0 ] == '<' ) && ( pcIn[ 4 ] == '>' ) )
+    {
+        xIdx = 5;
+
+        while( ( xIdx < xInLen ) && ( pcIn[ xIdx ] == ' ' ) )
+        {
+            xIdx++;
+        }
+
+        while( ( xIdx < xInLen ) && ( pcIn[ xIdx ] >= '0' ) && ( pcIn[ xIdx ] <= '9' ) )
+        {
+            ullSeconds = ( ullSeconds * 10 ) + ( uint64_t ) ( pcIn[ xIdx ] - '0' );
+            xIdx++;
+        }
+
+        if( ( xIdx < xInLen ) && ( pcIn[ xIdx ] == '.' ) )
+        {
+            xIdx++;
+
+            while( ( xIdx < xInLen ) && ( pcIn[ xIdx ] >= '0' ) && ( pcIn[ xIdx ] <= '9' ) )
+            {
+                ulMicros = ( ulMicros * 10 ) + ( uint32_t ) ( pcIn[ xIdx ] - '0' );
+                xDigits = pdTRUE;
+                xIdx++;
+            }
+        }
+
+        if( ( xIdx + 2 < xInLen ) && ( pcIn[ xIdx ] == ' ' ) && ( pcIn[ xIdx + 1 ] == '[' ) )
+        {
+            xIdx += 2;
+            pcTask = &pcIn[ xIdx ];
+
+            while( ( xIdx < xInLen ) && ( pcIn[ xIdx ] != ']' ) )
+            {
+                xIdx++;
+            }
+
+            xTaskLen = &pcIn[ xIdx ] - pcTask;
+
+            while( ( xTaskLen > 0 ) && ( pcTask[ xTaskLen - 1 ] == ' ' ) )
+            {
+                xTaskLen--;
+            }
+
+            /* Skip "] " */
+            xIdx += 2;
+        }
+    }
+
+    if( ( pcTask == NULL ) || ( xDigits == pdFALSE ) || ( xIdx > xInLen ) )
+    {
+        xLen = ( xInLen < xOutLen ) ? xInLen : xOutLen;
+        ( void ) memcpy( pcOut, pcIn, xLen );
+    }
+    else
+    {
+        uint64_t ullUs = ( ullSeconds * 1000000 ) + ulMicros;
+
+        /* The header time is monotonic, a gap which does not fit in a delta is clamped */
+        if( xFirst == pdTRUE )
+        {
+            lLen = snprintf( pcOut, xOutLen, "%c %lu.%06lu %.*s ",
+                             pcIn[ 1 ], ( unsigned long ) ullSeconds, ( unsigned long ) ulMicros,
+                             ( int ) xTaskLen, pcTask );
+        }
+        else
+        {
+            uint64_t ullDelta = ( ullUs > *pullLastUs ) ? ( ullUs - *pullLastUs ) : 0;
+
+            lLen = snprintf( pcOut, xOutLen, "%c +%lu %.*s ",
+                             pcIn[ 1 ], ( unsigned long ) ( ( ullDelta > UINT32_MAX ) ? UINT32_MAX : ullDelta ),
+                             ( int ) xTaskLen, pcTask );
+        }
+
+        *pullLastUs = ullUs;
+
+        if( lLen > 0 )
+        {
+            xLen = ( ( size_t ) lLen < xOutLen ) ? ( size_t ) lLen : xOutLen;
+
+            if( ( xInLen - xIdx ) > ( xOutLen - xLen ) )
+            {
+                xInLen = xIdx + ( xOutLen - xLen );
+            }
+
+            ( void ) memcpy( &pcOut[ xLen ], &pcIn[ xIdx ], xInLen - xIdx );
+            xLen += xInLen - xIdx;
+        }
+    }
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    configASSERT( pxCommandContext != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxCommandContext->xTaskToNotify != NULL )
+    {
+        ( void ) xTaskNotifyGiveIndexed( pxCommandContext->xTaskToNotify,
+                                         MQTT_NOTIFY_IDX );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvPublish( MQTTAgentHandle_t xAgentHandle,
+                                const char * pcTopic,
+                                const void * pvPublishData,
+                                size_t xPublishDataLen )
+{
+    MQTTStatus_t xStatus;
+
+    MQTTPublishInfo_t xPublishInfo =
+    {
+        .qos             = MQTTQoS0,
+        .retain          = 0,
+        .dup             = 0,
+        .pTopicName      = pcTopic,
+        .topicNameLength = strlen( pcTopic ),
+        .pPayload        = pvPublishData,
+        .payloadLength   = xPublishDataLen
+    };
+
+    MQTTAgentCommandContext_t xCommandContext =
+    {
+        .xTaskToNotify = xTaskGetCurrentTaskHandle(),
+        .xReturnStatus = MQTTIllegalState,
+    };
+
+    MQTTAgentCommandInfo_t xCommandParams =
+    {
+        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
+        .cmdCompleteCallback         = prvPublishCommandCallback,
+        .pCmdCompleteCallbackContext = &xCommandContext,
+    };
+
+    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
+
+    xStatus = MQTTAgent_Publish( xAgentHandle,
+                                 &xPublishInfo,
+                                 &xCommandParams );
+
+    if( xStatus == MQTTSuccess )
+    {
+        if( ulTaskNotifyTakeIndexed( MQTT_NOTIFY_IDX,
+                                     pdTRUE,
+                                     pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) ) == 0 )
+        {
+            /* The payload is still referenced by the command, wait until it completes */
+            ( void ) ulTaskNotifyTakeIndexed( MQTT_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+            xStatus = MQTTSendFailed;
+        }
+        else
+        {
+            xStatus = xCommandContext.xReturnStatus;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xIsMqttConnected( void )
+{
+    EventBits_t uxEvents = xEventGroupWaitBits( xSystemEvents,
+                                                EVT_MASK_MQTT_CONNECTED,
+                                                pdFALSE,
+                                                pdTRUE,
+                                                0 );
+
+    return( ( uxEvents & EVT_MASK_MQTT_CONNECTED ) == EVT_MASK_MQTT_CONNECTED );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Add the tokens earned since *pxLastFill, up to LOG_PUBLISH_BURST_BYTES */
+static void prvTokensRefill( uint32_t * pulTokens,
+                             TickType_t * pxLastFill )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    uint32_t ulElapsedMs = ( uint32_t ) ( xNow - *pxLastFill ) * portTICK_PERIOD_MS;
+    uint32_t ulEarned = LOG_PUBLISH_BURST_BYTES;
+
+    /* Long idle periods fill the bucket without the product overflowing */
+    if( ulElapsedMs < ( ( LOG_PUBLISH_BURST_BYTES * 1000 ) / LOG_PUBLISH_RATE_BYTES_PER_S ) )
+    {
+        ulEarned = ( ulElapsedMs * LOG_PUBLISH_RATE_BYTES_PER_S ) / 1000;
+    }
+
+    if( ulEarned >= ( LOG_PUBLISH_BURST_BYTES - *pulTokens ) )
+    {
+        *pulTokens = LOG_PUBLISH_BURST_BYTES;
+        *pxLastFill = xNow;
+    }
+    else if( ulEarned > 0 )
+    {
+        /* Only the time which earned a whole token is consumed */
+        *pulTokens += ulEarned;
+        *pxLastFill += pdMS_TO_TICKS( ( ulEarned * 1000 ) / LOG_PUBLISH_RATE_BYTES_PER_S );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLogPublishTask( void * pvParameters )
+{
+    MQTTAgentHandle_t xAgentHandle = NULL;
+    char pcTopicString[ LOG_PUBLISH_TOPIC_STR_LEN ] = { 0 };
+    size_t uxTopicLen = 0;
+    size_t xBatchLen = 0;
+    size_t xLineLen = 0;
+    uint64_t ullLastUs = 0;
+    uint32_t ulTokens = LOG_PUBLISH_BURST_BYTES;
+    TickType_t xLastFill;
+    TickType_t xBatchStart = 0;
+    BaseType_t xFailing = pdFALSE;
+
+    ( void ) pvParameters;
+
+    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, pcTopicString, LOG_PUBLISH_TOPIC_STR_LEN );
+
+    if( uxTopicLen > 0 )
+    {
+        uxTopicLen = strlcat( pcTopicString, "/" LOG_PUBLISH_TOPIC, LOG_PUBLISH_TOPIC_STR_LEN );
+    }
+
+    if( ( uxTopicLen == 0 ) || ( uxTopicLen >= LOG_PUBLISH_TOPIC_STR_LEN ) )
+    {
+        LogError( "Failed to construct topic string." );
+        vTaskDelete( NULL );
+    }
+
+    xLogPublishMBuf = xAppMessageBufferCreate( LOG_PUBLISH_QUEUE_LEN );
+
+    if( xLogPublishMBuf == NULL )
+    {
+        LogError( "Failed to allocate the log publish buffer." );
+        vTaskDelete( NULL );
+    }
+
+    vSleepUntilMQTTAgentReady();
+
+    xAgentHandle = xGetMqttAgentHandle();
+
+    /* Lines logged from here on are published */
+    vLoggingSetSink( prvLogPublishPut );
+
+    xLastFill = xTaskGetTickCount();
+
+    for( ; ; )
+    {
+        TickType_t xWait = pdMS_TO_TICKS( LOG_PUBLISH_BATCH_MS );
+        BaseType_t xSend = pdFALSE;
+
+        if( xBatchLen > 0 )
+        {
+            TickType_t xElapsed = xTaskGetTickCount() - xBatchStart;
+
+            xWait = ( xElapsed < xWait ) ? ( xWait - xElapsed ) : 0;
+        }
+
+        /* A line which did not fit in the last batch starts the next one */
+        if( xLineLen == 0 )
+        {
+            xLineLen = xMessageBufferReceive( xLogPublishMBuf, pcLine, LOG_PUBLISH_LINE_LEN - 1, xWait );
+        }
+
+        if( xLineLen > 0 )
+        {
+            char pcCompact[ 32 ];
+            size_t xCompactLen;
+            uint32_t ulDropped = __atomic_exchange_n( &ulLinesDropped, 0, __ATOMIC_RELAXED );
+
+            if( xBatchLen == 0 )
+            {
+                xBatchStart = xTaskGetTickCount();
+            }
+
+            /* The drop count goes in front of the line it was noticed with */
+            if( ulDropped > 0 )
+            {
+                xCompactLen = ( size_t ) snprintf( pcCompact, sizeof( pcCompact ), "# %lu dropped\n", ( unsigned long ) ulDropped );
+
+                if( ( xBatchLen + xCompactLen ) < LOG_PUBLISH_BATCH_LEN )
+                {
+                    ( void ) memcpy( &pcBatch[ xBatchLen ], pcCompact, xCompactLen );
+                    xBatchLen += xCompactLen;
+                }
+                else
+                {
+                    ( void ) __atomic_fetch_add( &ulLinesDropped, ulDropped, __ATOMIC_RELAXED );
+                }
+            }
+
+            /* Compacting never makes a line longer than the original, keep room for the newline */
+            if( ( xBatchLen == 0 ) || ( ( xBatchLen + xLineLen + 1 ) <= LOG_PUBLISH_BATCH_LEN ) )
+            {
+                xCompactLen = xLineCompact( pcLine, xLineLen,
+                                            &pcBatch[ xBatchLen ], LOG_PUBLISH_BATCH_LEN - xBatchLen - 1,
+                                            ( xBatchLen == 0 ), &ullLastUs );
+                xBatchLen += xCompactLen;
+                pcBatch[ xBatchLen++ ] = '\n';
+                xLineLen = 0;
+            }
+            else
+            {
+                xSend = pdTRUE;
+            }
+        }
+
+        if( ( xBatchLen > 0 ) &&
+            ( ( xTaskGetTickCount() - xBatchStart ) >= pdMS_TO_TICKS( LOG_PUBLISH_BATCH_MS ) ) )
+        {
+            xSend = pdTRUE;
+        }
+
+        if( xSend == pdTRUE )
+        {
+            prvTokensRefill( &ulTokens, &xLastFill );
+
+            /* The batch is held, and new lines queue up or are dropped, until it can be sent */
+            if( ( ulTokens < xBatchLen ) ||
+                ( xIsMqttConnected() == pdFALSE ) ||
+                ( MqttAgent_GetQueueDepth( xAgentHandle ) > LOG_PUBLISH_MAX_AGENT_QUEUE_DEPTH ) )
+            {
+                vTaskDelay( pdMS_TO_TICKS( LOG_PUBLISH_RETRY_MS ) );
+            }
+            else
+            {
+                MQTTStatus_t xStatus = prvPublish( xAgentHandle, pcTopicString, pcBatch, xBatchLen );
+
+                if( xStatus == MQTTSuccess )
+                {
+                    ulTokens -= xBatchLen;
+                    xBatchLen = 0;
+
+                    xFailing = pdFALSE;
+                }
+                else
+                {
+                    if( xFailing == pdFALSE )
+                    {
+                        LogError( "Failed to publish logs, error code: %d.", xStatus );
+                        xFailing = pdTRUE;
+                    }
+
+                    vTaskDelay( pdMS_TO_TICKS( LOG_PUBLISH_RETRY_MS ) );
+                }
+            }
+        }
+    }
+}
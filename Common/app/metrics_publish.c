@@ -0,0 +1,289 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file metrics_publish.c
+ *
+ * @brief Publish a snapshot of the metrics registry to <thing name>/metrics every
+ * METRICS_PUBLISH_INTERVAL_MS, as a JSON object with counters and gauges as numbers and each
+ * histogram as an object of bucket counts keyed by the smallest value of the bucket.
+ *
+ * A post-mortem snapshot left by the previous boot (postmortem.h) is published once to
+ * <thing name>/postmortem when MQTT first connects, then cleared.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "kvstore.h"
+#include "sys_evt.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+
+/* Subscription manager header include. */
+#include "subscription_manager.h"
+
+#include "metrics.h"
+#include "telemetry_encode.h"
+#include "sensor_publish.h"
+#include "mqtt_payload_pool.h"
+#include "periodic_work.h"
+#include "postmortem.h"
+
+#ifndef METRICS_PUBLISH_INTERVAL_MS
+    #define METRICS_PUBLISH_INTERVAL_MS    ( 60 * 1000 )
+#endif
+
+#define METRICS_PUBLISH_TOPIC              "metrics"
+#define METRICS_PUBLISH_TOPIC_STR_LEN      ( 128 )
+#define METRICS_PUBLISH_MAX_LEN            ( SENSOR_PUBLISH_SLOT_LEN )
+#define METRICS_PUBLISH_QOS                ( MQTTQoS0 )
+
+#define POSTMORTEM_PUBLISH_TOPIC           "postmortem"
+#define POSTMORTEM_PUBLISH_BLOCK_TIME_MS   ( 200 )
+#define POSTMORTEM_PUBLISH_WAIT_MS         ( 5000 )
+#define POSTMORTEM_NOTIFY_IDX              ( 1 )
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvAddMetric( const MetricSnapshot_t * pxMetric,
+                                void * pvCtx )
+{
+    TelemetryEncoder_t * pxEncoder = ( TelemetryEncoder_t * ) pvCtx;
+
+    if( pxMetric->xType != MetricTypeHistogram )
+    {
+        vTelemetryAddUint( pxEncoder, pxMetric->pcName, pxMetric->ulValue );
+    }
+    else
+    {
+        vTelemetryOpenMap( pxEncoder, pxMetric->pcName );
+
+        for( size_t uxIdx = 0; uxIdx < pxMetric->uxBuckets; uxIdx++ )
+        {
+            char pcBucket[ 12 ];
+
+            ( void ) snprintf( pcBucket, sizeof( pcBucket ), "%lu",
+                               ( uxIdx == 0 ) ? 0UL : ( 1UL << ( uxIdx - 1 ) ) );
+
+            vTelemetryAddUint( pxEncoder, pcBucket, pxMetric->pulBuckets[ uxIdx ] );
+        }
+
+        vTelemetryCloseMap( pxEncoder );
+    }
+
+    return( ( pxEncoder->xError == pdFALSE ) ? pdTRUE : pdFALSE );
+}
+
+#if ( POSTMORTEM_ENABLED == 1 )
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    configASSERT( pxCommandContext != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+
+    if( pxCommandContext->xTaskToNotify != NULL )
+    {
+        ( void ) xTaskNotifyGiveIndexed( pxCommandContext->xTaskToNotify,
+                                         POSTMORTEM_NOTIFY_IDX );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Too large for the sensor publisher slots, published at QoS 1 straight from the buffer */
+static void prvPublishPostMortem( const char * pcTopic )
+{
+    char * pcPayload = NULL;
+    size_t uxPayloadLen = 0;
+
+    pcPayload = ( char * ) pvPortMalloc( POSTMORTEM_JSON_MAX );
+
+    if( pcPayload != NULL )
+    {
+        uxPayloadLen = uxPostMortemFormat( pcPayload, POSTMORTEM_JSON_MAX );
+    }
+
+    if( uxPayloadLen > 0 )
+    {
+        MQTTStatus_t xStatus;
+
+        MQTTPublishInfo_t xPublishInfo =
+        {
+            .qos             = MQTTQoS1,
+            .retain          = 0,
+            .dup             = 0,
+            .pTopicName      = pcTopic,
+            .topicNameLength = strlen( pcTopic ),
+            .pPayload        = pcPayload,
+            .payloadLength   = uxPayloadLen
+        };
+
+        MQTTAgentCommandContext_t xCommandContext =
+        {
+            .xTaskToNotify = xTaskGetCurrentTaskHandle(),
+            .xReturnStatus = MQTTIllegalState,
+        };
+
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = POSTMORTEM_PUBLISH_BLOCK_TIME_MS,
+            .cmdCompleteCallback         = prvPublishCommandCallback,
+            .pCmdCompleteCallbackContext = &xCommandContext,
+        };
+
+        xTaskNotifyStateClearIndexed( NULL, POSTMORTEM_NOTIFY_IDX );
+
+        xStatus = MQTTAgent_Publish( xGetMqttAgentHandle(), &xPublishInfo, &xCommandParams );
+
+        if( xStatus == MQTTSuccess )
+        {
+            if( ulTaskNotifyTakeIndexed( POSTMORTEM_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( POSTMORTEM_PUBLISH_WAIT_MS ) ) == 0 )
+            {
+                /* The payload is still referenced by the command, wait until it completes */
+                ( void ) ulTaskNotifyTakeIndexed( POSTMORTEM_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+                xStatus = MQTTSendFailed;
+            }
+            else
+            {
+                xStatus = xCommandContext.xReturnStatus;
+            }
+        }
+
+        if( xStatus == MQTTSuccess )
+        {
+            LogInfo( "Published the post-mortem snapshot, %u bytes.", ( unsigned int ) uxPayloadLen );
+            vPostMortemClear();
+        }
+        else
+        {
+            /* Kept for the next boot */
+            LogError( "Failed to publish the post-mortem snapshot, error code: %d.", xStatus );
+        }
+    }
+
+    vPortFree( pcPayload );
+}
+
+#endif /* POSTMORTEM_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+void vMetricsPublishTask( void * pvParameters )
+{
+    static PeriodicWork_t xPublishWork;
+    char pcTopic[ METRICS_PUBLISH_TOPIC_STR_LEN ] = { 0 };
+    size_t uxTopicLen = 0;
+
+    ( void ) pvParameters;
+
+    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, pcTopic, METRICS_PUBLISH_TOPIC_STR_LEN );
+
+    if( uxTopicLen > 0 )
+    {
+        uxTopicLen = strlcat( pcTopic, "/" METRICS_PUBLISH_TOPIC, METRICS_PUBLISH_TOPIC_STR_LEN );
+    }
+
+    if( ( uxTopicLen == 0 ) || ( uxTopicLen >= METRICS_PUBLISH_TOPIC_STR_LEN ) )
+    {
+        LogError( "Failed to construct topic string." );
+        vTaskDelete( NULL );
+    }
+
+    vSleepUntilMQTTAgentReady();
+
+    #if ( POSTMORTEM_ENABLED == 1 )
+    {
+        char pcPostMortemTopic[ METRICS_PUBLISH_TOPIC_STR_LEN ] = { 0 };
+
+        ( void ) KVStore_getString( CS_CORE_THING_NAME, pcPostMortemTopic, METRICS_PUBLISH_TOPIC_STR_LEN );
+
+        if( strlcat( pcPostMortemTopic, "/" POSTMORTEM_PUBLISH_TOPIC, METRICS_PUBLISH_TOPIC_STR_LEN ) < METRICS_PUBLISH_TOPIC_STR_LEN )
+        {
+            ( void ) xEventGroupWaitBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED, pdFALSE, pdTRUE, portMAX_DELAY );
+            prvPublishPostMortem( pcPostMortemTopic );
+        }
+    }
+    #endif /* POSTMORTEM_ENABLED == 1 */
+
+    vPeriodicWorkStart( &xPublishWork, pdMS_TO_TICKS( METRICS_PUBLISH_INTERVAL_MS ),
+                        pdMS_TO_TICKS( METRICS_PUBLISH_INTERVAL_MS / 10 ) );
+
+    for( ; ; )
+    {
+        vPeriodicWorkWait( &xPublishWork );
+
+        if( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_MQTT_CONNECTED ) == EVT_MASK_MQTT_CONNECTED )
+        {
+            TelemetryEncoder_t xEncoder;
+            size_t xPayloadLen = 0;
+            uint8_t * pucPayload = pvMqttPayloadAlloc( METRICS_PUBLISH_MAX_LEN );
+
+            if( pucPayload != NULL )
+            {
+                vTelemetryBegin( &xEncoder, TELEMETRY_FORMAT_JSON, pucPayload, METRICS_PUBLISH_MAX_LEN );
+                vMetricsSnapshot( prvAddMetric, &xEncoder );
+                xPayloadLen = xTelemetryEnd( &xEncoder );
+            }
+
+            if( pucPayload == NULL )
+            {
+                /* Every buffer is waiting for the broker, counted by the pool */
+            }
+            else if( xPayloadLen == 0 )
+            {
+                LogError( "Metrics do not fit in %u bytes.", METRICS_PUBLISH_MAX_LEN );
+                vMqttPayloadRelease( pucPayload );
+            }
+            else
+            {
+                LogDebug( ( const char * ) pucPayload );
+
+                /* Hands the buffer over, dropped and counted by the publisher if it can not be queued */
+                ( void ) xSensorPublishSubmitPooled( pcTopic, pucPayload, xPayloadLen, METRICS_PUBLISH_QOS );
+            }
+        }
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "motion_anomaly.h"
+
+/*-----------------------------------------------------------*/
+
+static void prvAddFeatures( float * pfFeatures,
+                            const MotionFifoWindow_t * pxWindow )
+{
+    const float fSamples = ( float ) pxWindow->ulSamples;
+
+    for( uint32_t i = 0; i < 3; i++ )
+    {
+        const MotionFifoAxis_t * pxAxis = &pxWindow->xAxis[ i ];
+        float fMean = ( float ) pxAxis->llSum / fSamples;
+        float fVar = ( ( float ) pxAxis->ullSumSquares / fSamples ) - ( fMean * fMean );
+
+        pfFeatures[ 2 * i ] = fMean;
+        pfFeatures[ ( 2 * i ) + 1 ] = ( fVar > 0.0f ) ? sqrtf( fVar ) : 0.0f;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionAnomalyInit( MotionAnomaly_t * pxModel )
+{
+    memset( pxModel, 0, sizeof( MotionAnomaly_t ) );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMotionAnomalyUpdate( MotionAnomaly_t * pxModel,
+                                 const MotionFifoWindow_t * pxAccel,
+                                 const MotionFifoWindow_t * pxGyro,
+                                 float * pfScore )
+{
+    float fFeatures[ MOTION_ANOMALY_FEATURES ];
+    float fScore = 0.0f;
+    BaseType_t xAnomaly = pdFALSE;
+
+    if( ( pxAccel->ulSamples == 0 ) || ( pxGyro->ulSamples == 0 ) )
+    {
+        *pfScore = 0.0f;
+        return pdFALSE;
+    }
+
+    prvAddFeatures( &fFeatures[ 0 ], pxAccel );
+    prvAddFeatures( &fFeatures[ 6 ], pxGyro );
+
+    if( pxModel->ulTrained < MOTION_ANOMALY_TRAIN_WINDOWS )
+    {
+        /* Welford's running mean and sum of squared deviations */
+        pxModel->ulTrained++;
+
+        for( uint32_t i = 0; i < MOTION_ANOMALY_FEATURES; i++ )
+        {
+            float fDelta = fFeatures[ i ] - pxModel->fMean[ i ];
+
+            pxModel->fMean[ i ] += fDelta / ( float ) pxModel->ulTrained;
+            pxModel->fVar[ i ] += fDelta * ( fFeatures[ i ] - pxModel->fMean[ i ] );
+        }
+
+        if( pxModel->ulTrained == MOTION_ANOMALY_TRAIN_WINDOWS )
+        {
+            for( uint32_t i = 0; i < MOTION_ANOMALY_FEATURES; i++ )
+            {
+                pxModel->fVar[ i ] /= ( float ) pxModel->ulTrained;
+            }
+        }
+    }
+    else
+    {
+        const float fMinVar = MOTION_ANOMALY_MIN_STDDEV * MOTION_ANOMALY_MIN_STDDEV;
+
+        /* Compared squared, the square root is only taken of the largest */
+        for( uint32_t i = 0; i < MOTION_ANOMALY_FEATURES; i++ )
+        {
+            float fDelta = fFeatures[ i ] - pxModel->fMean[ i ];
+            float fVar = ( pxModel->fVar[ i ] > fMinVar ) ? pxModel->fVar[ i ] : fMinVar;
+            float fZ2 = ( fDelta * fDelta ) / fVar;
+
+            if( fZ2 > fScore )
+            {
+                fScore = fZ2;
+            }
+        }
+
+        fScore = sqrtf( fScore );
+
+        if( fScore >= MOTION_ANOMALY_THRESHOLD )
+        {
+            xAnomaly = pdTRUE;
+        }
+        else
+        {
+            for( uint32_t i = 0; i < MOTION_ANOMALY_FEATURES; i++ )
+            {
+                float fDelta = fFeatures[ i ] - pxModel->fMean[ i ];
+
+                pxModel->fMean[ i ] += MOTION_ANOMALY_ALPHA * fDelta;
+                pxModel->fVar[ i ] = ( 1.0f - MOTION_ANOMALY_ALPHA ) *
+                                     ( pxModel->fVar[ i ] + ( MOTION_ANOMALY_ALPHA * fDelta * fDelta ) );
+            }
+        }
+    }
+
+    *pfScore = fScore;
+
+    return xAnomaly;
+}
@@ -0,0 +1,346 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "b_u585i_iot02a_bus.h"
+#include "b_u585i_iot02a_motion_sensors.h"
+
+#include "i2c_bus.h"
+#include "motion_fifo.h"
+
+/* ISM330DHCX on I2C2, SA0 high */
+#define ISM330_I2C_ADDR                 ( 0xD7 )
+
+#define ISM330_FIFO_CTRL1               ( 0x07 )
+#define ISM330_FIFO_CTRL2               ( 0x08 )
+#define ISM330_FIFO_CTRL3               ( 0x09 )
+#define ISM330_FIFO_CTRL4               ( 0x0A )
+#define ISM330_INT1_CTRL                ( 0x0D )
+#define ISM330_FIFO_STATUS1             ( 0x3A )
+#define ISM330_FIFO_DATA_OUT_TAG        ( 0x78 )
+
+#define ISM330_FIFO_CTRL2_WTM8          ( 0x01 )
+#define ISM330_FIFO_MODE_BYPASS         ( 0x00 )
+#define ISM330_FIFO_MODE_CONTINUOUS     ( 0x06 )
+#define ISM330_INT1_FIFO_TH             ( 0x08 )
+#define ISM330_FIFO_STATUS2_OVR         ( 0x40 )
+#define ISM330_FIFO_STATUS2_DIFF_MASK   ( 0x03 )
+
+/* Tag byte followed by X, Y and Z, little endian. Reads past Z_H roll back to the tag */
+#define ISM330_FIFO_WORD_LEN            ( 7 )
+#define ISM330_TAG_GYRO                 ( 0x01 )
+#define ISM330_TAG_ACCEL                ( 0x02 )
+
+#define MOTION_FIFO_DMA_TIMEOUT_MS      ( 50 )
+
+/* More bursts are left for the next call, so that a stuck FIFO level does not spin the task */
+#define MOTION_FIFO_MAX_BURSTS          ( 4 )
+
+#if ( MOTION_FIFO_WATERMARK > 511 ) || ( MOTION_FIFO_WATERMARK > MOTION_FIFO_BURST_WORDS )
+    #error "MOTION_FIFO_WATERMARK must be at most 511 and MOTION_FIFO_BURST_WORDS"
+#endif
+
+static TaskHandle_t xFifoTask = NULL;
+static float fAccelSensitivity = 0.0f; /* mg per LSB */
+static float fGyroSensitivity = 0.0f;  /* mdps per LSB */
+static MotionFifoStats_t xStats = { 0 };
+static uint8_t ucFifoBuffer[ MOTION_FIFO_BURST_WORDS * ISM330_FIFO_WORD_LEN ];
+
+/*-----------------------------------------------------------*/
+
+static void prvFifoThresholdCallback( void * pvContext )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ( void ) pvContext;
+
+    if( xFifoTask != NULL )
+    {
+        vTaskNotifyGiveIndexedFromISR( xFifoTask, MOTION_FIFO_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+    }
+
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+static BaseType_t xRegWrite( uint16_t usReg,
+                             uint8_t ucValue )
+{
+    I2cBusXfer_t xXfer = { ISM330_I2C_ADDR, usReg, &ucValue, 1, 0 };
+
+    return xI2cBusTransfer( &xXfer, 1, pdMS_TO_TICKS( MOTION_FIFO_DMA_TIMEOUT_MS ) );
+}
+
+static BaseType_t xRegUpdate( uint16_t usReg,
+                              uint8_t ucMask,
+                              uint8_t ucValue )
+{
+    uint8_t ucReg = 0;
+    I2cBusXfer_t xXfer = { ISM330_I2C_ADDR, usReg, &ucReg, 1, 1 };
+    BaseType_t xResult = pdFALSE;
+
+    /* Held across the read and the write back */
+    if( xI2cBusLock( pdMS_TO_TICKS( MOTION_FIFO_DMA_TIMEOUT_MS ) ) == pdTRUE )
+    {
+        if( xI2cBusTransfer( &xXfer, 1, pdMS_TO_TICKS( MOTION_FIFO_DMA_TIMEOUT_MS ) ) == pdTRUE )
+        {
+            xResult = xRegWrite( usReg, ( ucReg & ~ucMask ) | ( ucValue & ucMask ) );
+        }
+
+        vI2cBusUnlock();
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Batch data rate field of FIFO_CTRL3, the same codes as the ODR fields */
+static uint8_t ucRateCode( uint32_t ulRateHz )
+{
+    static const uint16_t usRates[] = { 26, 52, 104, 208, 417, 833, 1667 };
+    uint8_t ucCode = 0;
+
+    for( uint32_t i = 0; i < ( sizeof( usRates ) / sizeof( usRates[ 0 ] ) ); i++ )
+    {
+        if( usRates[ i ] == ulRateHz )
+        {
+            ucCode = ( uint8_t ) ( i + 2 );
+        }
+    }
+
+    return ucCode;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Data rates, sensitivities and FIFO registers, with the bus locked */
+static BaseType_t xConfigure( uint8_t ucRate )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, ( float ) MOTION_FIFO_ODR_HZ ) != BSP_ERROR_NONE ) ||
+        ( BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, ( float ) MOTION_FIFO_ODR_HZ ) != BSP_ERROR_NONE ) ||
+        ( BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_ACCELERO, &fAccelSensitivity ) != BSP_ERROR_NONE ) ||
+        ( BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_GYRO, &fGyroSensitivity ) != BSP_ERROR_NONE ) )
+    {
+        LogError( "Failed to set the motion sensor data rate." );
+    }
+    else if( ( xRegWrite( ISM330_FIFO_CTRL4, ISM330_FIFO_MODE_BYPASS ) != pdTRUE ) ||
+             ( xRegWrite( ISM330_FIFO_CTRL1, ( uint8_t ) ( MOTION_FIFO_WATERMARK & 0xFF ) ) != pdTRUE ) ||
+             ( xRegUpdate( ISM330_FIFO_CTRL2, ISM330_FIFO_CTRL2_WTM8, ( uint8_t ) ( MOTION_FIFO_WATERMARK >> 8 ) ) != pdTRUE ) ||
+             ( xRegWrite( ISM330_FIFO_CTRL3, ( uint8_t ) ( ( ucRate << 4 ) | ucRate ) ) != pdTRUE ) ||
+             ( xRegUpdate( ISM330_INT1_CTRL, ISM330_INT1_FIFO_TH, ISM330_INT1_FIFO_TH ) != pdTRUE ) )
+    {
+        LogError( "Failed to configure the motion sensor FIFO." );
+    }
+    else
+    {
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMotionFifoStart( void )
+{
+    uint8_t ucRate = ucRateCode( MOTION_FIFO_ODR_HZ );
+    BaseType_t xResult = pdFALSE;
+
+    xFifoTask = xTaskGetCurrentTaskHandle();
+
+    if( ucRate == 0 )
+    {
+        LogError( "Unsupported MOTION_FIFO_ODR_HZ: %d.", MOTION_FIFO_ODR_HZ );
+    }
+    else if( xI2cBusLock( portMAX_DELAY ) == pdTRUE )
+    {
+        xResult = xConfigure( ucRate );
+        vI2cBusUnlock();
+    }
+
+    if( xResult == pdTRUE )
+    {
+        GPIO_InitTypeDef xGpioInit =
+        {
+            .Pin       = GYRO_ACC_INT_Pin,
+            .Mode      = GPIO_MODE_IT_RISING,
+            .Pull      = GPIO_NOPULL,
+            .Speed     = GPIO_SPEED_FREQ_LOW,
+            .Alternate = 0X0,
+        };
+
+        __HAL_RCC_GPIOE_CLK_ENABLE();
+        HAL_GPIO_Init( GYRO_ACC_INT_GPIO_Port, &xGpioInit );
+
+        GPIO_EXTI_Register_Callback( GYRO_ACC_INT_Pin, prvFifoThresholdCallback, NULL );
+
+        HAL_NVIC_SetPriority( GYRO_ACC_INT_EXTI_IRQn, 5, 5 );
+        HAL_NVIC_EnableIRQ( GYRO_ACC_INT_EXTI_IRQn );
+
+        /* Batching starts with the FIFO mode, after INT1 is ready for the first threshold */
+        xResult = xRegWrite( ISM330_FIFO_CTRL4, ISM330_FIFO_MODE_CONTINUOUS );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFifoWindowReset( MotionFifoWindow_t * pxWindow )
+{
+    pxWindow->ulSamples = 0;
+
+    for( uint32_t i = 0; i < 3; i++ )
+    {
+        pxWindow->xAxis[ i ].lMin = INT32_MAX;
+        pxWindow->xAxis[ i ].lMax = INT32_MIN;
+        pxWindow->xAxis[ i ].llSum = 0;
+        pxWindow->xAxis[ i ].ullSumSquares = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWindowAdd( MotionFifoWindow_t * pxWindow,
+                          const uint8_t * pucData,
+                          float fSensitivity )
+{
+    for( uint32_t i = 0; i < 3; i++ )
+    {
+        int16_t sRaw = ( int16_t ) ( ( uint16_t ) pucData[ 2 * i ] | ( ( uint16_t ) pucData[ 2 * i + 1 ] << 8 ) );
+        int32_t lValue = ( int32_t ) ( ( float ) sRaw * fSensitivity );
+        MotionFifoAxis_t * pxAxis = &pxWindow->xAxis[ i ];
+
+        pxAxis->lMin = ( lValue < pxAxis->lMin ) ? lValue : pxAxis->lMin;
+        pxAxis->lMax = ( lValue > pxAxis->lMax ) ? lValue : pxAxis->lMax;
+        pxAxis->llSum += lValue;
+        pxAxis->ullSumSquares += ( uint64_t ) ( ( int64_t ) lValue * lValue );
+    }
+
+    pxWindow->ulSamples++;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Read ulWords FIFO words by DMA. Returns pdTRUE once they are in ucFifoBuffer */
+static BaseType_t xFifoRead( uint32_t ulWords )
+{
+    I2cBusXfer_t xXfer =
+    {
+        ISM330_I2C_ADDR, ISM330_FIFO_DATA_OUT_TAG, ucFifoBuffer, ( uint16_t ) ( ulWords * ISM330_FIFO_WORD_LEN ), 1
+    };
+
+    return xI2cBusTransfer( &xXfer, 1, pdMS_TO_TICKS( MOTION_FIFO_DMA_TIMEOUT_MS ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFifoService( TickType_t xTimeout,
+                         MotionFifoWindow_t * pxAccel,
+                         MotionFifoWindow_t * pxGyro )
+{
+    BaseType_t xMore = pdTRUE;
+
+    configASSERT( xTaskGetCurrentTaskHandle() == xFifoTask );
+
+    /* INT1 is a level, so a FIFO left above the threshold gives no new edge and is drained on timeout */
+    ( void ) ulTaskNotifyTakeIndexed( MOTION_FIFO_NOTIFY_IDX, pdTRUE, xTimeout );
+
+    for( uint32_t ulBurst = 0; ( ulBurst < MOTION_FIFO_MAX_BURSTS ) && ( xMore == pdTRUE ); ulBurst++ )
+    {
+        uint8_t ucStatus[ 2 ] = { 0 };
+        uint32_t ulLevel = 0;
+        uint32_t ulWords = 0;
+        I2cBusXfer_t xStatusXfer = { ISM330_I2C_ADDR, ISM330_FIFO_STATUS1, ucStatus, 2, 1 };
+
+        xMore = pdFALSE;
+
+        if( xI2cBusTransfer( &xStatusXfer, 1, pdMS_TO_TICKS( MOTION_FIFO_DMA_TIMEOUT_MS ) ) != pdTRUE )
+        {
+            xStats.ulBusErrors++;
+        }
+        else
+        {
+            ulLevel = ucStatus[ 0 ] | ( ( uint32_t ) ( ucStatus[ 1 ] & ISM330_FIFO_STATUS2_DIFF_MASK ) << 8 );
+            ulWords = ( ulLevel < MOTION_FIFO_BURST_WORDS ) ? ulLevel : MOTION_FIFO_BURST_WORDS;
+
+            if( ( ucStatus[ 1 ] & ISM330_FIFO_STATUS2_OVR ) != 0 )
+            {
+                xStats.ulOverruns++;
+            }
+        }
+
+        if( ulWords == 0 )
+        {
+            /* Nothing to read */
+        }
+        else if( xFifoRead( ulWords ) != pdTRUE )
+        {
+            xStats.ulBusErrors++;
+        }
+        else
+        {
+            for( uint32_t i = 0; i < ulWords; i++ )
+            {
+                const uint8_t * pucWord = &ucFifoBuffer[ i * ISM330_FIFO_WORD_LEN ];
+                uint8_t ucTag = pucWord[ 0 ] >> 3;
+
+                if( ucTag == ISM330_TAG_ACCEL )
+                {
+                    prvWindowAdd( pxAccel, &pucWord[ 1 ], fAccelSensitivity );
+                }
+                else if( ucTag == ISM330_TAG_GYRO )
+                {
+                    prvWindowAdd( pxGyro, &pucWord[ 1 ], fGyroSensitivity );
+                }
+            }
+
+            xStats.ulSamples += ulWords;
+            xMore = ( ulLevel > ulWords ) ? pdTRUE : pdFALSE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFifoGetStats( MotionFifoStats_t * pxStats )
+{
+    *pxStats = xStats;
+}
@@ -0,0 +1,166 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include <math.h>
+#include <stddef.h>
+
+#include "motion_fusion.h"
+
+/*-----------------------------------------------------------*/
+
+static float fNormalize( float * pfV,
+                         size_t xLen )
+{
+    float fNorm = 0.0f;
+
+    for( size_t i = 0; i < xLen; i++ )
+    {
+        fNorm += pfV[ i ] * pfV[ i ];
+    }
+
+    fNorm = sqrtf( fNorm );
+
+    if( fNorm > 0.0f )
+    {
+        float fRecip = 1.0f / fNorm;
+
+        for( size_t i = 0; i < xLen; i++ )
+        {
+            pfV[ i ] *= fRecip;
+        }
+    }
+
+    return fNorm;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFusionInit( MotionFusion_t * pxFusion,
+                        float fBeta )
+{
+    pxFusion->fQ[ 0 ] = 1.0f;
+    pxFusion->fQ[ 1 ] = 0.0f;
+    pxFusion->fQ[ 2 ] = 0.0f;
+    pxFusion->fQ[ 3 ] = 0.0f;
+    pxFusion->fBeta = fBeta;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * pfStep += J^T f, where f is the difference between the measured field pfM and the reference
+ * field ( fBx, 0, fBz ) rotated into the sensor frame, and J its Jacobian in q.
+ * Gravity is the reference ( 0, 0, 1 ).
+ */
+static void prvAddGradient( const float * pfQ,
+                            float fBx,
+                            float fBz,
+                            const float * pfM,
+                            float * pfStep )
+{
+    float q0 = pfQ[ 0 ], q1 = pfQ[ 1 ], q2 = pfQ[ 2 ], q3 = pfQ[ 3 ];
+    float f0, f1, f2;
+
+    f0 = 2.0f * fBx * ( 0.5f - q2 * q2 - q3 * q3 ) + 2.0f * fBz * ( q1 * q3 - q0 * q2 ) - pfM[ 0 ];
+    f1 = 2.0f * fBx * ( q1 * q2 - q0 * q3 ) + 2.0f * fBz * ( q0 * q1 + q2 * q3 ) - pfM[ 1 ];
+    f2 = 2.0f * fBx * ( q0 * q2 + q1 * q3 ) + 2.0f * fBz * ( 0.5f - q1 * q1 - q2 * q2 ) - pfM[ 2 ];
+
+    pfStep[ 0 ] += ( -2.0f * fBz * q2 ) * f0 +
+                   ( -2.0f * fBx * q3 + 2.0f * fBz * q1 ) * f1 +
+                   ( 2.0f * fBx * q2 ) * f2;
+    pfStep[ 1 ] += ( 2.0f * fBz * q3 ) * f0 +
+                   ( 2.0f * fBx * q2 + 2.0f * fBz * q0 ) * f1 +
+                   ( 2.0f * fBx * q3 - 4.0f * fBz * q1 ) * f2;
+    pfStep[ 2 ] += ( -4.0f * fBx * q2 - 2.0f * fBz * q0 ) * f0 +
+                   ( 2.0f * fBx * q1 + 2.0f * fBz * q3 ) * f1 +
+                   ( 2.0f * fBx * q0 - 4.0f * fBz * q2 ) * f2;
+    pfStep[ 3 ] += ( -4.0f * fBx * q3 + 2.0f * fBz * q1 ) * f0 +
+                   ( -2.0f * fBx * q0 + 2.0f * fBz * q2 ) * f1 +
+                   ( 2.0f * fBx * q1 ) * f2;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFusionUpdate( MotionFusion_t * pxFusion,
+                          const float pfGyro[ 3 ],
+                          const float pfAccel[ 3 ],
+                          const float pfMag[ 3 ],
+                          float fDt )
+{
+    float * pfQ = pxFusion->fQ;
+    float fAccel[ 3 ] = { pfAccel[ 0 ], pfAccel[ 1 ], pfAccel[ 2 ] };
+    float fStep[ 4 ] = { 0.0f };
+    float fQDot[ 4 ];
+
+    /* Rate of change from the gyroscope, 0.5 * q x ( 0, w ) */
+    fQDot[ 0 ] = 0.5f * ( -pfQ[ 1 ] * pfGyro[ 0 ] - pfQ[ 2 ] * pfGyro[ 1 ] - pfQ[ 3 ] * pfGyro[ 2 ] );
+    fQDot[ 1 ] = 0.5f * ( pfQ[ 0 ] * pfGyro[ 0 ] + pfQ[ 2 ] * pfGyro[ 2 ] - pfQ[ 3 ] * pfGyro[ 1 ] );
+    fQDot[ 2 ] = 0.5f * ( pfQ[ 0 ] * pfGyro[ 1 ] - pfQ[ 1 ] * pfGyro[ 2 ] + pfQ[ 3 ] * pfGyro[ 0 ] );
+    fQDot[ 3 ] = 0.5f * ( pfQ[ 0 ] * pfGyro[ 2 ] + pfQ[ 1 ] * pfGyro[ 1 ] - pfQ[ 2 ] * pfGyro[ 0 ] );
+
+    /* No correction in free fall */
+    if( fNormalize( fAccel, 3 ) > 0.0f )
+    {
+        float fMag[ 3 ] = { 0.0f };
+
+        prvAddGradient( pfQ, 0.0f, 1.0f, fAccel, fStep );
+
+        if( pfMag != NULL )
+        {
+            fMag[ 0 ] = pfMag[ 0 ];
+            fMag[ 1 ] = pfMag[ 1 ];
+            fMag[ 2 ] = pfMag[ 2 ];
+        }
+
+        if( fNormalize( fMag, 3 ) > 0.0f )
+        {
+            float q0 = pfQ[ 0 ], q1 = pfQ[ 1 ], q2 = pfQ[ 2 ], q3 = pfQ[ 3 ];
+            float fHx, fHy, fHz;
+
+            /* Half of the field in the earth frame, reduced to its horizontal and vertical parts */
+            fHx = fMag[ 0 ] * ( 0.5f - q2 * q2 - q3 * q3 ) + fMag[ 1 ] * ( q1 * q2 - q0 * q3 ) + fMag[ 2 ] * ( q1 * q3 + q0 * q2 );
+            fHy = fMag[ 0 ] * ( q1 * q2 + q0 * q3 ) + fMag[ 1 ] * ( 0.5f - q1 * q1 - q3 * q3 ) + fMag[ 2 ] * ( q2 * q3 - q0 * q1 );
+            fHz = fMag[ 0 ] * ( q1 * q3 - q0 * q2 ) + fMag[ 1 ] * ( q2 * q3 + q0 * q1 ) + fMag[ 2 ] * ( 0.5f - q1 * q1 - q2 * q2 );
+
+            prvAddGradient( pfQ, 2.0f * sqrtf( fHx * fHx + fHy * fHy ), 2.0f * fHz, fMag, fStep );
+        }
+
+        ( void ) fNormalize( fStep, 4 );
+
+        for( size_t i = 0; i < 4; i++ )
+        {
+            fQDot[ i ] -= pxFusion->fBeta * fStep[ i ];
+        }
+    }
+
+    for( size_t i = 0; i < 4; i++ )
+    {
+        pfQ[ i ] += fQDot[ i ] * fDt;
+    }
+
+    ( void ) fNormalize( pfQ, 4 );
+}
@@ -61,157 +61,426 @@
 /* Sensor includes */
 #include "b_u585i_iot02a_motion_sensors.h"
 
+#include "telemetry_encode.h"
+#include "telemetry_series.h"
+#include "sensor_publish.h"
+#include "mqtt_payload_pool.h"
+#include "i2c_bus.h"
+#include "periodic_work.h"
+
+/* 1 to batch the accelerometer and gyroscope in the sensor FIFO at MOTION_FIFO_ODR_HZ and
+ * publish the mean, min, max and rms of each axis over every publish period */
+#ifndef MOTION_SENSOR_FIFO_MODE
+    #define MOTION_SENSOR_FIFO_MODE    0
+#endif
+
+#if ( MOTION_SENSOR_FIFO_MODE == 1 )
+    #include <math.h>
+    #include "motion_fifo.h"
+#endif
+
+/* 1 to score every FIFO window with the anomaly model of motion_anomaly.h and publish only the
+ * anomalous windows, with their score, and a summary every MOTION_ANOMALY_SUMMARY_WINDOWS */
+#ifndef MOTION_SENSOR_ANOMALY_GATE
+    #define MOTION_SENSOR_ANOMALY_GATE    0
+#endif
+
+#if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+    #if ( MOTION_SENSOR_FIFO_MODE == 0 )
+        #error "MOTION_SENSOR_ANOMALY_GATE requires MOTION_SENSOR_FIFO_MODE"
+    #endif
+
+    #include "hw_defs.h"
+    #include "motion_anomaly.h"
+
+    #ifndef MOTION_ANOMALY_SUMMARY_WINDOWS
+        #define MOTION_ANOMALY_SUMMARY_WINDOWS    120
+    #endif
+
+    typedef struct
+    {
+        uint32_t ulWindows;
+        uint32_t ulAnomalies;
+        float fMaxScore;
+        uint32_t ulMaxInferUs;
+        uint64_t ullInferUs;
+    } MotionAnomalySummary_t;
+#endif
+
+/* 1 to fuse the three sensors into an orientation quaternion every MOTION_FUSION_PERIOD_MS and
+ * publish only the quaternion */
+#ifndef MOTION_SENSOR_FUSION
+    #define MOTION_SENSOR_FUSION    0
+#endif
+
+#if ( MOTION_SENSOR_FUSION == 1 )
+    #if ( MOTION_SENSOR_FIFO_MODE == 1 )
+        #error "MOTION_SENSOR_FUSION and MOTION_SENSOR_FIFO_MODE cannot both be enabled"
+    #endif
+
+    #include "hw_defs.h"
+    #include "motion_fusion.h"
+
+    #define MOTION_FUSION_PERIOD_MS    ( 20 )
+    #define MOTION_FUSION_ODR_HZ       ( 52.0f )
+    #define MOTION_FUSION_MAG_ODR_HZ   ( 50.0f )
+    #define MDPS_TO_RAD_S              ( 3.14159265f / 180000.0f )
+#endif
+
+/* Readings per telemetry series block when above 0. The accelerometer, gyroscope and magnetometer
+ * axes read every publish period are then added to a block, published to
+ * MOTION_SENSOR_PUBLISH_TOPIC TELEMETRY_SERIES_TOPIC_SUFFIX once it holds that many readings or
+ * the next one does not fit, instead of one payload per reading. */
+#ifndef MOTION_SENSOR_SERIES_SAMPLES
+    #define MOTION_SENSOR_SERIES_SAMPLES    0
+#endif
+
+#if ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+    #if ( MOTION_SENSOR_FIFO_MODE == 1 ) || ( MOTION_SENSOR_FUSION == 1 )
+        #error "MOTION_SENSOR_SERIES_SAMPLES cannot be used with MOTION_SENSOR_FIFO_MODE or MOTION_SENSOR_FUSION"
+    #endif
+
+    #define MOTION_SERIES_CHANNELS          9
+#endif
+
 /**
  * @brief Size of statically allocated buffers for holding topic names and
  * payloads.
  */
-#define MQTT_PUBLISH_MAX_LEN                 ( 200 )
+#if ( MOTION_SENSOR_FIFO_MODE == 1 ) || ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+    #define MQTT_PUBLISH_MAX_LEN             ( 768 )
+#else
+    #define MQTT_PUBLISH_MAX_LEN             ( 200 )
+#endif
 #define MQTT_PUBLISH_PERIOD_MS               ( 500 )
 #define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
-#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 200 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
-#define MQTT_NOTIFY_IDX                      ( 1 )
 #define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
 
+/* Topic after "<thing name>/", sent in full with every publish. A shorter name saves as many
+ * bytes per publish, the cloud side rules must subscribe to the same name. */
+#ifndef MOTION_SENSOR_PUBLISH_TOPIC
+    #define MOTION_SENSOR_PUBLISH_TOPIC      "motion_sensor_data"
+#endif
+
+/* TELEMETRY_FORMAT_CBOR publishes to MOTION_SENSOR_PUBLISH_TOPIC TELEMETRY_CBOR_TOPIC_SUFFIX */
+#ifndef MOTION_SENSOR_PUBLISH_FORMAT
+    #define MOTION_SENSOR_PUBLISH_FORMAT     TELEMETRY_FORMAT_JSON
+#endif
+
+#if ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        TELEMETRY_SERIES_TOPIC_SUFFIX
+#elif ( MOTION_SENSOR_PUBLISH_FORMAT == TELEMETRY_FORMAT_CBOR )
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        TELEMETRY_CBOR_TOPIC_SUFFIX
+#else
+    #define MQTT_PUBLISH_TOPIC_SUFFIX        ""
+#endif
+
+/* Output registers read in one transfer list: gyro then accelerometer, then magnetometer */
+#define ISM330_I2C_ADDR                      ( 0xD7 )
+#define ISM330_OUTX_L_G                      ( 0x22 )
+#define IIS2MDC_I2C_ADDR                     ( 0x3D )
+#define IIS2MDC_OUTX_L_REG                   ( 0x68 )
+#define MOTION_AXES_READ_TIMEOUT_MS          ( 50 )
+
+static float fGyroSensitivity = 0.0f;    /* mdps per LSB */
+static float fAcceleroSensitivity = 0.0f; /* mg per LSB */
+static float fMagnetoSensitivity = 0.0f; /* mgauss per LSB */
 
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-    uint32_t ulNotificationValue;
-};
-
 /*-----------------------------------------------------------*/
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+static BaseType_t xInitSensors( void )
 {
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
-
-    configASSERT( pxReturnInfo != NULL );
-
-    uint32_t ulNotifyValue = pxReturnInfo->returnCode;
+    int32_t lBspError = BSP_ERROR_NO_INIT;
 
-    if( xTaskHandle != NULL )
+    if( xI2cBusLock( portMAX_DELAY ) == pdTRUE )
     {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
+        /* Gyro + Accelerometer*/
+        lBspError = BSP_MOTION_SENSOR_Init( 0, MOTION_GYRO | MOTION_ACCELERO );
+        lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_GYRO );
+        lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_ACCELERO );
+        lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, 1.0f );
+        lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, 1.0f );
+
+        /* Magnetometer */
+        lBspError |= BSP_MOTION_SENSOR_Init( 1, MOTION_MAGNETO );
+        lBspError |= BSP_MOTION_SENSOR_Enable( 1, MOTION_MAGNETO );
+        lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 1, MOTION_MAGNETO, 1.0f );
+
+        /* Scale factors for the raw reads of xReadAxes */
+        lBspError |= BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_GYRO, &fGyroSensitivity );
+        lBspError |= BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_ACCELERO, &fAcceleroSensitivity );
+        lBspError |= BSP_MOTION_SENSOR_GetSensitivity( 1, MOTION_MAGNETO, &fMagnetoSensitivity );
+
+        vI2cBusUnlock();
     }
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
 }
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
-                                           const char * pcTopic,
-                                           const void * pvPublishData,
-                                           size_t xPublishDataLen )
+static void prvAxesFromRaw( BSP_MOTION_SENSOR_Axes_t * pxAxes,
+                            const uint8_t * pucRaw,
+                            float fSensitivity )
 {
-    MQTTStatus_t xStatus;
-    size_t uxTopicLen = 0;
+    int16_t sRaw[ 3 ];
 
-    configASSERT( pcTopic != NULL );
-    configASSERT( pvPublishData != NULL );
-    configASSERT( xPublishDataLen > 0 );
+    for( uint32_t i = 0; i < 3; i++ )
+    {
+        sRaw[ i ] = ( int16_t ) ( ( uint16_t ) pucRaw[ 2 * i ] | ( ( uint16_t ) pucRaw[ 2 * i + 1 ] << 8 ) );
+    }
 
-    uxTopicLen = strnlen( pcTopic, UINT16_MAX );
+    pxAxes->x = ( int32_t ) ( ( float ) sRaw[ 0 ] * fSensitivity );
+    pxAxes->y = ( int32_t ) ( ( float ) sRaw[ 1 ] * fSensitivity );
+    pxAxes->z = ( int32_t ) ( ( float ) sRaw[ 2 ] * fSensitivity );
+}
 
-    MQTTPublishInfo_t xPublishInfo =
+/* The three GetAxes calls as a single DMA transfer list, without a bus round trip per axis */
+static BaseType_t xReadAxes( BSP_MOTION_SENSOR_Axes_t * pxGyroAxes,
+                             BSP_MOTION_SENSOR_Axes_t * pxAcceleroAxes,
+                             BSP_MOTION_SENSOR_Axes_t * pxMagnetoAxes )
+{
+    static uint8_t ucImuRaw[ 12 ];
+    static uint8_t ucMagRaw[ 6 ];
+    const I2cBusXfer_t xXfers[] =
     {
-        .qos             = MQTT_PUBLISH_QOS,
-        .retain          = 0,
-        .dup             = 0,
-        .pTopicName      = pcTopic,
-        .topicNameLength = ( uint16_t ) uxTopicLen,
-        .pPayload        = pvPublishData,
-        .payloadLength   = xPublishDataLen
+        { ISM330_I2C_ADDR,  ISM330_OUTX_L_G,    ucImuRaw, sizeof( ucImuRaw ), 1 },
+        { IIS2MDC_I2C_ADDR, IIS2MDC_OUTX_L_REG, ucMagRaw, sizeof( ucMagRaw ), 1 },
     };
+    BaseType_t xResult;
 
-    MQTTAgentCommandInfo_t xCommandParams =
-    {
-        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle(),
-    };
+    xResult = xI2cBusTransfer( xXfers, sizeof( xXfers ) / sizeof( xXfers[ 0 ] ), pdMS_TO_TICKS( MOTION_AXES_READ_TIMEOUT_MS ) );
 
-    if( xPublishInfo.qos > MQTTQoS0 )
+    if( xResult == pdTRUE )
     {
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle();
+        prvAxesFromRaw( pxGyroAxes, &ucImuRaw[ 0 ], fGyroSensitivity );
+        prvAxesFromRaw( pxAcceleroAxes, &ucImuRaw[ 6 ], fAcceleroSensitivity );
+        prvAxesFromRaw( pxMagnetoAxes, ucMagRaw, fMagnetoSensitivity );
     }
 
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
-
+    return xResult;
+}
 
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
+/*-----------------------------------------------------------*/
 
-    if( xStatus == MQTTSuccess )
+#if ( MOTION_SENSOR_FIFO_MODE == 1 )
+    static void prvAddWindow( TelemetryEncoder_t * pxEncoder,
+                              const char * pcKey,
+                              const MotionFifoWindow_t * pxWindow )
     {
-        uint32_t ulNotifyValue = 0;
-        BaseType_t xResult = pdFALSE;
+        static const char * const pcAxisKeys[ 3 ] = { "x", "y", "z" };
 
-        xResult = xTaskNotifyWaitIndexed( MQTT_NOTIFY_IDX,
-                                          0xFFFFFFFF,
-                                          0xFFFFFFFF,
-                                          &ulNotifyValue,
-                                          pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
+        vTelemetryOpenMap( pxEncoder, pcKey );
 
-        if( xResult )
+        for( uint32_t i = 0; i < 3; i++ )
         {
-            xStatus = ( MQTTStatus_t ) ulNotifyValue;
+            const MotionFifoAxis_t * pxAxis = &pxWindow->xAxis[ i ];
 
-            if( xStatus != MQTTSuccess )
+            vTelemetryOpenMap( pxEncoder, pcAxisKeys[ i ] );
+
+            if( pxWindow->ulSamples > 0 )
             {
-                LogError( "MQTT Agent returned error code: %d during publish operation.",
-                          xStatus );
-                xResult = pdFALSE;
+                vTelemetryAddInt( pxEncoder, "mean", ( int32_t ) ( pxAxis->llSum / ( int64_t ) pxWindow->ulSamples ) );
+                vTelemetryAddInt( pxEncoder, "min", pxAxis->lMin );
+                vTelemetryAddInt( pxEncoder, "max", pxAxis->lMax );
+                vTelemetryAddFloat( pxEncoder, "rms",
+                                    sqrtf( ( float ) pxAxis->ullSumSquares / ( float ) pxWindow->ulSamples ), 0 );
             }
+
+            vTelemetryCloseMap( pxEncoder );
         }
-        else
+
+        vTelemetryCloseMap( pxEncoder );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static size_t prvEncodeWindows( uint8_t * pucBuf,
+                                    const MotionFifoWindow_t * pxAccel,
+                                    const MotionFifoWindow_t * pxGyro,
+                                    const BSP_MOTION_SENSOR_Axes_t * pxMagnetoAxes,
+                                    float fScore )
+    {
+        TelemetryEncoder_t xEncoder;
+        MotionFifoStats_t xStats;
+
+        vMotionFifoGetStats( &xStats );
+
+        vTelemetryBegin( &xEncoder, MOTION_SENSOR_PUBLISH_FORMAT, pucBuf, MQTT_PUBLISH_MAX_LEN );
+
+        vTelemetryAddInt( &xEncoder, "samples", ( int32_t ) pxAccel->ulSamples );
+        vTelemetryAddInt( &xEncoder, "rate_hz", MOTION_FIFO_ODR_HZ );
+        vTelemetryAddInt( &xEncoder, "overruns", ( int32_t ) xStats.ulOverruns );
+
+        #if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+            vTelemetryAddFloat( &xEncoder, "anomaly_score", fScore, 2 );
+        #else
+            ( void ) fScore;
+        #endif
+
+        prvAddWindow( &xEncoder, "acceleration_mG", pxAccel );
+        prvAddWindow( &xEncoder, "gyro_mDPS", pxGyro );
+
+        vTelemetryOpenMap( &xEncoder, "magnetometer_mGauss" );
+        vTelemetryAddInt( &xEncoder, "x", pxMagnetoAxes->x );
+        vTelemetryAddInt( &xEncoder, "y", pxMagnetoAxes->y );
+        vTelemetryAddInt( &xEncoder, "z", pxMagnetoAxes->z );
+        vTelemetryCloseMap( &xEncoder );
+
+        return xTelemetryEnd( &xEncoder );
+    }
+#endif /* MOTION_SENSOR_FIFO_MODE == 1 */
+
+#if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+    static size_t prvEncodeSummary( uint8_t * pucBuf,
+                                    const MotionAnomalySummary_t * pxSummary,
+                                    const MotionAnomaly_t * pxModel )
+    {
+        TelemetryEncoder_t xEncoder;
+
+        vTelemetryBegin( &xEncoder, MOTION_SENSOR_PUBLISH_FORMAT, pucBuf, MQTT_PUBLISH_MAX_LEN );
+
+        vTelemetryOpenMap( &xEncoder, "anomaly_summary" );
+        vTelemetryAddInt( &xEncoder, "windows", ( int32_t ) pxSummary->ulWindows );
+        vTelemetryAddInt( &xEncoder, "anomalies", ( int32_t ) pxSummary->ulAnomalies );
+        vTelemetryAddInt( &xEncoder, "trained", ( pxModel->ulTrained >= MOTION_ANOMALY_TRAIN_WINDOWS ) ? 1 : 0 );
+        vTelemetryAddFloat( &xEncoder, "max_score", pxSummary->fMaxScore, 2 );
+        vTelemetryAddInt( &xEncoder, "infer_us_max", ( int32_t ) pxSummary->ulMaxInferUs );
+        vTelemetryAddInt( &xEncoder, "infer_us_avg",
+                          ( int32_t ) ( pxSummary->ullInferUs / ( ( pxSummary->ulWindows > 0 ) ? pxSummary->ulWindows : 1 ) ) );
+        vTelemetryAddInt( &xEncoder, "model_bytes", ( int32_t ) sizeof( MotionAnomaly_t ) );
+        vTelemetryCloseMap( &xEncoder );
+
+        return xTelemetryEnd( &xEncoder );
+    }
+#endif /* MOTION_SENSOR_ANOMALY_GATE == 1 */
+
+#if ( MOTION_SENSOR_FUSION == 1 )
+    static void prvFusionUpdate( MotionFusion_t * pxFusion,
+                                 const BSP_MOTION_SENSOR_Axes_t * pxGyroAxes,
+                                 const BSP_MOTION_SENSOR_Axes_t * pxAcceleroAxes,
+                                 const BSP_MOTION_SENSOR_Axes_t * pxMagnetoAxes,
+                                 float fDt )
+    {
+        const float fGyro[ 3 ] =
         {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
-        }
+            ( float ) pxGyroAxes->x * MDPS_TO_RAD_S,
+            ( float ) pxGyroAxes->y * MDPS_TO_RAD_S,
+            ( float ) pxGyroAxes->z * MDPS_TO_RAD_S,
+        };
+        const float fAccel[ 3 ] = { ( float ) pxAcceleroAxes->x, ( float ) pxAcceleroAxes->y, ( float ) pxAcceleroAxes->z };
+        const float fMag[ 3 ] = { ( float ) pxMagnetoAxes->x, ( float ) pxMagnetoAxes->y, ( float ) pxMagnetoAxes->z };
+
+        vMotionFusionUpdate( pxFusion, fGyro, fAccel, fMag, fDt );
+    }
+#endif /* MOTION_SENSOR_FUSION == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Hand a payload encoded in a pooled buffer to the publisher without copying it, or release it */
+static BaseType_t prvSubmitPooled( const char * pcTopic,
+                                   uint8_t * pucPayload,
+                                   size_t xPayloadLen )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( pucPayload == NULL )
+    {
+        /* No buffer free, counted by the pool */
+    }
+    else if( xPayloadLen == 0 )
+    {
+        LogError( "Not enough buffer space." );
+        vMqttPayloadRelease( pucPayload );
     }
     else
     {
-        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+        xResult = xSensorPublishSubmitPooled( pcTopic, pucPayload, xPayloadLen, MQTT_PUBLISH_QOS );
     }
 
-    return( xStatus == MQTTSuccess );
+    return xResult;
 }
 
 /*-----------------------------------------------------------*/
-static BaseType_t xInitSensors( void )
-{
-    int32_t lBspError = BSP_ERROR_NONE;
 
-    /* Gyro + Accelerometer*/
-    lBspError = BSP_MOTION_SENSOR_Init( 0, MOTION_GYRO | MOTION_ACCELERO );
-    lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_GYRO );
-    lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_ACCELERO );
-    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, 1.0f );
-    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, 1.0f );
+#if ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+
+    /* Built in a pooled buffer, which is handed to the publisher once full. pdFALSE while none is free */
+    static BaseType_t prvSeriesBegin( TelemetrySeries_t * pxSeries )
+    {
+        /* mG, mDPS and mGauss are already integers */
+        static const uint8_t ucDecimals[ MOTION_SERIES_CHANNELS ] = { 0 };
+        uint8_t * pucBuf = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
 
-    /* Magnetometer */
-    lBspError |= BSP_MOTION_SENSOR_Init( 1, MOTION_MAGNETO );
-    lBspError |= BSP_MOTION_SENSOR_Enable( 1, MOTION_MAGNETO );
-    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 1, MOTION_MAGNETO, 1.0f );
+        if( pucBuf != NULL )
+        {
+            vTelemetrySeriesBegin( pxSeries, pucBuf, MQTT_PUBLISH_MAX_LEN,
+                                   MOTION_SERIES_CHANNELS, ucDecimals, MQTT_PUBLISH_PERIOD_MS / 10 );
+        }
+        else
+        {
+            pxSeries->pucBuffer = NULL;
+        }
 
-    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
-}
+        return ( pucBuf != NULL ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    /* Readings are kept while offline, the block is then spooled or dropped by xSensorPublishSubmitPooled */
+    static void prvSeriesPublish( TelemetrySeries_t * pxSeries,
+                                  const char * pcTopic )
+    {
+        size_t xPayloadLen = xTelemetrySeriesEnd( pxSeries );
+
+        ( void ) prvSubmitPooled( pcTopic, pxSeries->pucBuffer, xPayloadLen );
+        ( void ) prvSeriesBegin( pxSeries );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvSeriesAdd( TelemetrySeries_t * pxSeries,
+                              const char * pcTopic,
+                              const BSP_MOTION_SENSOR_Axes_t * pxAcceleroAxes,
+                              const BSP_MOTION_SENSOR_Axes_t * pxGyroAxes,
+                              const BSP_MOTION_SENSOR_Axes_t * pxMagnetoAxes )
+    {
+        uint32_t ulTimeMs = ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS );
+        int32_t lValues[ MOTION_SERIES_CHANNELS ] =
+        {
+            pxAcceleroAxes->x, pxAcceleroAxes->y, pxAcceleroAxes->z,
+            pxGyroAxes->x,     pxGyroAxes->y,     pxGyroAxes->z,
+            pxMagnetoAxes->x,  pxMagnetoAxes->y,  pxMagnetoAxes->z,
+        };
+
+        /* While every buffer is still waiting for the broker the reading is dropped */
+        if( ( pxSeries->pucBuffer == NULL ) &&
+            ( prvSeriesBegin( pxSeries ) == pdFALSE ) )
+        {
+            /* Dropped */
+        }
+        else if( xTelemetrySeriesAdd( pxSeries, ulTimeMs, lValues ) == pdFALSE )
+        {
+            prvSeriesPublish( pxSeries, pcTopic );
+
+            if( pxSeries->pucBuffer != NULL )
+            {
+                ( void ) xTelemetrySeriesAdd( pxSeries, ulTimeMs, lValues );
+            }
+        }
+        else
+        {
+            /* Added */
+        }
+
+        if( ( pxSeries->pucBuffer != NULL ) &&
+            ( pxSeries->ulSamples >= MOTION_SENSOR_SERIES_SAMPLES ) )
+        {
+            prvSeriesPublish( pxSeries, pcTopic );
+        }
+    }
+#endif /* MOTION_SENSOR_SERIES_SAMPLES > 0 */
 
 /*-----------------------------------------------------------*/
 void vMotionSensorsPublish( void * pvParameters )
@@ -220,21 +489,58 @@ void vMotionSensorsPublish( void * pvParameters )
     BaseType_t xResult = pdFALSE;
     BaseType_t xExitFlag = pdFALSE;
 
-    MQTTAgentHandle_t xAgentHandle = NULL;
-    char pcPayloadBuf[ MQTT_PUBLISH_MAX_LEN ];
     char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
-    char * pcDeviceId = NULL;
+    const char * pcDeviceId = NULL;
     int lTopicLen = 0;
 
     xResult = xInitSensors();
 
+    #if ( MOTION_SENSOR_FIFO_MODE == 1 )
+        MotionFifoWindow_t xAccelWindow;
+        MotionFifoWindow_t xGyroWindow;
+
+        if( xResult == pdTRUE )
+        {
+            xResult = xMotionFifoStart();
+        }
+
+        vMotionFifoWindowReset( &xAccelWindow );
+        vMotionFifoWindowReset( &xGyroWindow );
+    #endif
+
+    #if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+        static MotionAnomaly_t xAnomalyModel;
+        MotionAnomalySummary_t xSummary = { 0 };
+
+        vMotionAnomalyInit( &xAnomalyModel );
+    #endif
+
+    #if ( MOTION_SENSOR_FUSION == 1 )
+        MotionFusion_t xFusion;
+
+        vMotionFusionInit( &xFusion, MOTION_FUSION_BETA );
+
+        /* Sample at least as fast as the filter runs */
+        if( ( xResult == pdTRUE ) && ( xI2cBusLock( portMAX_DELAY ) == pdTRUE ) )
+        {
+            int32_t lBspError = BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, MOTION_FUSION_ODR_HZ );
+
+            lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, MOTION_FUSION_ODR_HZ );
+            lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 1, MOTION_MAGNETO, MOTION_FUSION_MAG_ODR_HZ );
+
+            vI2cBusUnlock();
+
+            xResult = ( lBspError == BSP_ERROR_NONE ) ? pdTRUE : pdFALSE;
+        }
+    #endif
+
     if( xResult != pdTRUE )
     {
         LogError( "Error while initializing motion sensors." );
         vTaskDelete( NULL );
     }
 
-    pcDeviceId = KVStore_getStringHeap( CS_CORE_THING_NAME, NULL );
+    pcDeviceId = KVStore_peekString( CS_CORE_THING_NAME, NULL );
 
     if( pcDeviceId == NULL )
     {
@@ -242,7 +548,8 @@ void vMotionSensorsPublish( void * pvParameters )
     }
     else
     {
-        lTopicLen = snprintf( pcTopicString, ( size_t ) MQTT_PUBLICH_TOPIC_STR_LEN, "%s/motion_sensor_data", pcDeviceId );
+        lTopicLen = snprintf( pcTopicString, ( size_t ) MQTT_PUBLICH_TOPIC_STR_LEN, "%s/" MOTION_SENSOR_PUBLISH_TOPIC MQTT_PUBLISH_TOPIC_SUFFIX, pcDeviceId );
+        KVStore_peekEnd();
     }
 
     if( ( lTopicLen <= 0 ) || ( lTopicLen > MQTT_PUBLICH_TOPIC_STR_LEN ) )
@@ -253,63 +560,235 @@ void vMotionSensorsPublish( void * pvParameters )
 
     vSleepUntilMQTTAgentReady();
 
-    xAgentHandle = xGetMqttAgentHandle();
+    #if ( MOTION_SENSOR_FIFO_MODE == 1 )
+        while( xExitFlag == pdFALSE )
+        {
+            TimeOut_t xTimeOut;
+            TickType_t xTicksLeft = pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS );
+            BSP_MOTION_SENSOR_Axes_t xMagnetoAxes;
+
+            vTaskSetTimeOutState( &xTimeOut );
+
+            /* The FIFO is drained at least once per period, the last time by a timeout */
+            do
+            {
+                vMotionFifoService( xTicksLeft, &xAccelWindow, &xGyroWindow );
+            }
+            while( xTaskCheckForTimeOut( &xTimeOut, &xTicksLeft ) == pdFALSE );
+
+            int32_t lBspError = BSP_ERROR_NO_INIT;
+
+            if( xI2cBusLock( pdMS_TO_TICKS( MOTION_AXES_READ_TIMEOUT_MS ) ) == pdTRUE )
+            {
+                lBspError = BSP_MOTION_SENSOR_GetAxes( 1, MOTION_MAGNETO, &xMagnetoAxes );
+                vI2cBusUnlock();
+            }
+
+            float fScore = 0.0f;
+            BaseType_t xPublish = pdTRUE;
+
+            #if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+            {
+                uint64_t ullStartUs = ullGetMonotonicUs();
+                uint32_t ulInferUs;
+
+                xPublish = xMotionAnomalyUpdate( &xAnomalyModel, &xAccelWindow, &xGyroWindow, &fScore );
+
+                ulInferUs = ( uint32_t ) ( ullGetMonotonicUs() - ullStartUs );
+
+                xSummary.ulWindows++;
+                xSummary.ullInferUs += ulInferUs;
+
+                if( ulInferUs > xSummary.ulMaxInferUs )
+                {
+                    xSummary.ulMaxInferUs = ulInferUs;
+                }
+
+                if( fScore > xSummary.fMaxScore )
+                {
+                    xSummary.fMaxScore = fScore;
+                }
+
+                if( xPublish == pdTRUE )
+                {
+                    xSummary.ulAnomalies++;
+                }
+            }
+            #endif /* MOTION_SENSOR_ANOMALY_GATE == 1 */
+
+            if( ( lBspError == BSP_ERROR_NONE ) && ( xPublish == pdTRUE ) &&
+                ( xSensorPublishIsAccepting() == pdTRUE ) )
+            {
+                uint8_t * pucPayload = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+                size_t xPayloadLen = 0;
+
+                if( pucPayload != NULL )
+                {
+                    xPayloadLen = prvEncodeWindows( pucPayload, &xAccelWindow, &xGyroWindow, &xMagnetoAxes, fScore );
+                }
+
+                /* Returns at once, so the FIFO keeps being drained while the publish is sent */
+                xResult = prvSubmitPooled( pcTopicString, pucPayload, xPayloadLen );
+
+                if( xResult != pdPASS )
+                {
+                    LogError( "Failed to queue motion sensor data" );
+                }
+            }
+
+            #if ( MOTION_SENSOR_ANOMALY_GATE == 1 )
+                if( xSummary.ulWindows >= MOTION_ANOMALY_SUMMARY_WINDOWS )
+                {
+                    if( xSensorPublishIsAccepting() == pdTRUE )
+                    {
+                        uint8_t * pucPayload = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+                        size_t xPayloadLen = 0;
+
+                        if( pucPayload != NULL )
+                        {
+                            xPayloadLen = prvEncodeSummary( pucPayload, &xSummary, &xAnomalyModel );
+                        }
+
+                        if( prvSubmitPooled( pcTopicString, pucPayload, xPayloadLen ) != pdPASS )
+                        {
+                            LogError( "Failed to queue motion anomaly summary" );
+                        }
+                    }
+
+                    memset( &xSummary, 0, sizeof( xSummary ) );
+                }
+            #endif
+
+            vMotionFifoWindowReset( &xAccelWindow );
+            vMotionFifoWindowReset( &xGyroWindow );
+        }
+    #endif /* MOTION_SENSOR_FIFO_MODE == 1 */
+
+    #if ( MOTION_SENSOR_FUSION == 1 )
+        TickType_t xFusionWake = xTaskGetTickCount();
+        uint64_t ullLastUs = ullGetMonotonicUs();
+        uint32_t ulUpdates = 0;
+
+        while( xExitFlag == pdFALSE )
+        {
+            BaseType_t xRead;
+            BSP_MOTION_SENSOR_Axes_t xAcceleroAxes, xGyroAxes, xMagnetoAxes;
+            uint64_t ullNowUs;
+
+            vTaskDelayUntil( &xFusionWake, pdMS_TO_TICKS( MOTION_FUSION_PERIOD_MS ) );
+
+            xRead = xReadAxes( &xGyroAxes, &xAcceleroAxes, &xMagnetoAxes );
+
+            /* Integrate over the time actually elapsed, the task may have been delayed */
+            ullNowUs = ullGetMonotonicUs();
+
+            if( xRead == pdTRUE )
+            {
+                prvFusionUpdate( &xFusion, &xGyroAxes, &xAcceleroAxes, &xMagnetoAxes,
+                                 ( float ) ( ullNowUs - ullLastUs ) * 1.0e-6f );
+                ulUpdates++;
+            }
+
+            ullLastUs = ullNowUs;
+
+            if( ulUpdates >= ( MQTT_PUBLISH_PERIOD_MS / MOTION_FUSION_PERIOD_MS ) )
+            {
+                ulUpdates = 0;
+
+                if( xSensorPublishIsAccepting() == pdTRUE )
+                {
+                    TelemetryEncoder_t xEncoder;
+                    size_t xPayloadLen = 0;
+                    uint8_t * pucPayload = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+
+                    if( pucPayload != NULL )
+                    {
+                        vTelemetryBegin( &xEncoder, MOTION_SENSOR_PUBLISH_FORMAT, pucPayload, MQTT_PUBLISH_MAX_LEN );
+
+                        vTelemetryOpenMap( &xEncoder, "quaternion" );
+                        vTelemetryAddFloat( &xEncoder, "w", xFusion.fQ[ 0 ], 4 );
+                        vTelemetryAddFloat( &xEncoder, "x", xFusion.fQ[ 1 ], 4 );
+                        vTelemetryAddFloat( &xEncoder, "y", xFusion.fQ[ 2 ], 4 );
+                        vTelemetryAddFloat( &xEncoder, "z", xFusion.fQ[ 3 ], 4 );
+                        vTelemetryCloseMap( &xEncoder );
+
+                        xPayloadLen = xTelemetryEnd( &xEncoder );
+                    }
+
+                    xResult = prvSubmitPooled( pcTopicString, pucPayload, xPayloadLen );
+
+                    if( xResult != pdPASS )
+                    {
+                        LogError( "Failed to queue motion sensor data" );
+                    }
+                }
+            }
+        }
+    #endif /* MOTION_SENSOR_FUSION == 1 */
+
+    static PeriodicWork_t xPublishWork;
+
+    #if ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+        TelemetrySeries_t xSeries;
+
+        ( void ) prvSeriesBegin( &xSeries );
+    #endif
+
+    vPeriodicWorkStart( &xPublishWork, pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS ),
+                        pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS / 10 ) );
 
     while( xExitFlag == pdFALSE )
     {
         /* Interpret sensor data */
-        int32_t lBspError = BSP_ERROR_NONE;
         BSP_MOTION_SENSOR_Axes_t xAcceleroAxes, xGyroAxes, xMagnetoAxes;
 
-        lBspError = BSP_MOTION_SENSOR_GetAxes( 0, MOTION_GYRO, &xGyroAxes );
-        lBspError |= BSP_MOTION_SENSOR_GetAxes( 0, MOTION_ACCELERO, &xAcceleroAxes );
-        lBspError |= BSP_MOTION_SENSOR_GetAxes( 1, MOTION_MAGNETO, &xMagnetoAxes );
-
-        if( lBspError == BSP_ERROR_NONE )
-        {
-            int lbytesWritten = snprintf( pcPayloadBuf,
-                                          MQTT_PUBLISH_MAX_LEN,
-                                          "{"
-                                          "\"acceleration_mG\":"
-                                          "{"
-                                          "\"x\": %ld,"
-                                          "\"y\": %ld,"
-                                          "\"z\": %ld"
-                                          "},"
-                                          "\"gyro_mDPS\":"
-                                          "{"
-                                          "\"x\": %ld,"
-                                          "\"y\": %ld,"
-                                          "\"z\": %ld"
-                                          "},"
-                                          "\"magnetometer_mGauss\":"
-                                          "{"
-                                          "\"x\": %ld,"
-                                          "\"y\": %ld,"
-                                          "\"z\": %ld"
-                                          "}"
-                                          "}",
-                                          xAcceleroAxes.x, xAcceleroAxes.y, xAcceleroAxes.z,
-                                          xGyroAxes.x, xGyroAxes.y, xGyroAxes.z,
-                                          xMagnetoAxes.x, xMagnetoAxes.y, xMagnetoAxes.z );
-
-            if( ( lbytesWritten < MQTT_PUBLISH_MAX_LEN ) &&
-                ( xIsMqttAgentConnected() == pdTRUE ) )
+        #if ( MOTION_SENSOR_SERIES_SAMPLES > 0 )
+            if( xReadAxes( &xGyroAxes, &xAcceleroAxes, &xMagnetoAxes ) == pdTRUE )
             {
-                xResult = prvPublishAndWaitForAck( xAgentHandle,
-                                                   pcTopicString,
-                                                   pcPayloadBuf,
-                                                   ( size_t ) lbytesWritten );
+                prvSeriesAdd( &xSeries, pcTopicString, &xAcceleroAxes, &xGyroAxes, &xMagnetoAxes );
+            }
+        #else
+            if( ( xReadAxes( &xGyroAxes, &xAcceleroAxes, &xMagnetoAxes ) == pdTRUE ) &&
+                ( xSensorPublishIsAccepting() == pdTRUE ) )
+            {
+                TelemetryEncoder_t xEncoder;
+                size_t xPayloadLen = 0;
+                uint8_t * pucPayload = pvMqttPayloadAlloc( MQTT_PUBLISH_MAX_LEN );
+
+                if( pucPayload != NULL )
+                {
+                    vTelemetryBegin( &xEncoder, MOTION_SENSOR_PUBLISH_FORMAT, pucPayload, MQTT_PUBLISH_MAX_LEN );
+
+                    vTelemetryOpenMap( &xEncoder, "acceleration_mG" );
+                    vTelemetryAddInt( &xEncoder, "x", xAcceleroAxes.x );
+                    vTelemetryAddInt( &xEncoder, "y", xAcceleroAxes.y );
+                    vTelemetryAddInt( &xEncoder, "z", xAcceleroAxes.z );
+                    vTelemetryCloseMap( &xEncoder );
+
+                    vTelemetryOpenMap( &xEncoder, "gyro_mDPS" );
+                    vTelemetryAddInt( &xEncoder, "x", xGyroAxes.x );
+                    vTelemetryAddInt( &xEncoder, "y", xGyroAxes.y );
+                    vTelemetryAddInt( &xEncoder, "z", xGyroAxes.z );
+                    vTelemetryCloseMap( &xEncoder );
+
+                    vTelemetryOpenMap( &xEncoder, "magnetometer_mGauss" );
+                    vTelemetryAddInt( &xEncoder, "x", xMagnetoAxes.x );
+                    vTelemetryAddInt( &xEncoder, "y", xMagnetoAxes.y );
+                    vTelemetryAddInt( &xEncoder, "z", xMagnetoAxes.z );
+                    vTelemetryCloseMap( &xEncoder );
+
+                    xPayloadLen = xTelemetryEnd( &xEncoder );
+                }
+
+                xResult = prvSubmitPooled( pcTopicString, pucPayload, xPayloadLen );
 
                 if( xResult != pdPASS )
                 {
-                    LogError( "Failed to publish motion sensor data" );
+                    LogError( "Failed to queue motion sensor data" );
                 }
             }
-        }
+        #endif /* MOTION_SENSOR_SERIES_SAMPLES > 0 */
 
-        vTaskDelay( pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS ) );
+        vPeriodicWorkWait( &xPublishWork );
     }
-
-    vPortFree( pcDeviceId );
 }
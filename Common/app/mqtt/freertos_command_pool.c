@@ -39,6 +39,7 @@
 /* Standard includes. */
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
@@ -54,23 +55,107 @@
  */
 static MQTTAgentCommand_t commandStructurePool[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
 
-static QueueHandle_t xCommandPoolQueue = NULL;
+/*
+ * Free structures form a lock-free stack of pool indices. The head word holds the index of
+ * the top entry in the low 16 bits and a modification tag in the upper 16 bits, which keeps
+ * a concurrent pop and push of the same entry from corrupting the list (ABA).
+ */
+#define POOL_IDX_NONE              ( 0xFFFFU )
+#define POOL_HEAD( idx, tag )      ( ( ( uint32_t ) ( tag ) << 16 ) | ( uint32_t ) ( idx ) )
+#define POOL_HEAD_IDX( head )      ( ( uint16_t ) ( ( head ) & 0xFFFFU ) )
+#define POOL_HEAD_TAG( head )      ( ( uint16_t ) ( ( head ) >> 16 ) )
+
+static_assert( MQTT_COMMAND_CONTEXTS_POOL_SIZE < POOL_IDX_NONE, "Pool indices must fit in 16 bits" );
+
+static uint32_t ulFreeListHead = POOL_HEAD( POOL_IDX_NONE, 0 );
+static uint16_t pusNextFree[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/* Set while a structure is handed out, so that releasing it twice is caught before it is pushed twice */
+static uint8_t pucInUse[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/* Tasks blocked in Agent_GetCommand are woken through this semaphore when a structure is returned */
+static SemaphoreHandle_t xPoolWaitSem = NULL;
+static uint32_t ulPoolWaiters = 0;
+
+static AgentCommandPoolStats_t xPoolStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static MQTTAgentCommand_t * prvPoolPop( void )
+{
+    MQTTAgentCommand_t * pxCommand = NULL;
+    uint32_t ulHead = __atomic_load_n( &ulFreeListHead, __ATOMIC_ACQUIRE );
+    uint32_t ulNewHead;
+    uint16_t usIdx;
+
+    do
+    {
+        usIdx = POOL_HEAD_IDX( ulHead );
+
+        if( usIdx == POOL_IDX_NONE )
+        {
+            break;
+        }
+
+        ulNewHead = POOL_HEAD( __atomic_load_n( &( pusNextFree[ usIdx ] ), __ATOMIC_RELAXED ),
+                               POOL_HEAD_TAG( ulHead ) + 1 );
+    } while( !__atomic_compare_exchange_n( &ulFreeListHead, &ulHead, ulNewHead, true,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+    if( usIdx != POOL_IDX_NONE )
+    {
+        __atomic_store_n( &( pucInUse[ usIdx ] ), 1U, __ATOMIC_RELAXED );
+        pxCommand = &( commandStructurePool[ usIdx ] );
+    }
+
+    return pxCommand;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPoolPush( uint16_t usIdx )
+{
+    uint32_t ulHead = __atomic_load_n( &ulFreeListHead, __ATOMIC_ACQUIRE );
+    uint32_t ulNewHead;
+
+    do
+    {
+        __atomic_store_n( &( pusNextFree[ usIdx ] ), POOL_HEAD_IDX( ulHead ), __ATOMIC_RELAXED );
+        ulNewHead = POOL_HEAD( usIdx, POOL_HEAD_TAG( ulHead ) + 1 );
+    } while( !__atomic_compare_exchange_n( &ulFreeListHead, &ulHead, ulNewHead, true,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvUpdateMax( uint32_t * pulMax,
+                          uint32_t ulValue )
+{
+    uint32_t ulCurrent = __atomic_load_n( pulMax, __ATOMIC_RELAXED );
+
+    while( ( ulValue > ulCurrent ) &&
+           !__atomic_compare_exchange_n( pulMax, &ulCurrent, ulValue, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+    }
+}
 
 /*-----------------------------------------------------------*/
 
 void Agent_InitializePool( void )
 {
-    if( xCommandPoolQueue == NULL )
+    if( xPoolWaitSem == NULL )
     {
-        xCommandPoolQueue = xQueueCreate( MQTT_COMMAND_CONTEXTS_POOL_SIZE, sizeof( MQTTAgentCommand_t * ) );
+        xPoolWaitSem = xSemaphoreCreateCounting( MQTT_COMMAND_CONTEXTS_POOL_SIZE, 0 );
 
-        /* Populate the queue with pointers to each command structure. */
+        /* Link every command structure into the free list. */
         for( uint32_t ulIdx = 0; ulIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE; ulIdx++ )
         {
-            MQTTAgentCommand_t * pCommand = &commandStructurePool[ ulIdx ];
-
-            ( void ) xQueueSend( xCommandPoolQueue, &pCommand, 0U );
+            pusNextFree[ ulIdx ] = ( ulIdx + 1 < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ? ( uint16_t ) ( ulIdx + 1 ) : POOL_IDX_NONE;
+            pucInUse[ ulIdx ] = 0U;
         }
+
+        __atomic_store_n( &ulFreeListHead, POOL_HEAD( 0, 0 ), __ATOMIC_RELEASE );
     }
 }
 
@@ -80,10 +165,49 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t ulBlockTimeMs )
 {
     MQTTAgentCommand_t * pxCommandStruct = NULL;
 
-    if( xCommandPoolQueue )
+    if( xPoolWaitSem )
     {
-        if( !xQueueReceive( xCommandPoolQueue, &pxCommandStruct, pdMS_TO_TICKS( ulBlockTimeMs ) ) )
+        pxCommandStruct = prvPoolPop();
+
+        /* Slow path: wait for a structure to be returned */
+        if( ( pxCommandStruct == NULL ) &&
+            ( ulBlockTimeMs > 0 ) )
         {
+            TickType_t xTicksToWait = pdMS_TO_TICKS( ulBlockTimeMs );
+            TickType_t xStartTicks = xTaskGetTickCount();
+            TimeOut_t xTimeOut;
+            uint32_t ulWaitMs;
+
+            vTaskSetTimeOutState( &xTimeOut );
+
+            ( void ) __atomic_fetch_add( &( xPoolStats.ulBlockedGets ), 1, __ATOMIC_RELAXED );
+
+            /* Register as a waiter before retrying so that a concurrent release can not be missed */
+            ( void ) __atomic_fetch_add( &ulPoolWaiters, 1, __ATOMIC_SEQ_CST );
+
+            while( ( ( pxCommandStruct = prvPoolPop() ) == NULL ) &&
+                   ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE ) )
+            {
+                ( void ) xSemaphoreTake( xPoolWaitSem, xTicksToWait );
+            }
+
+            ( void ) __atomic_fetch_sub( &ulPoolWaiters, 1, __ATOMIC_SEQ_CST );
+
+            ulWaitMs = ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - xStartTicks );
+            ( void ) __atomic_fetch_add( &( xPoolStats.ulTotalWaitMs ), ulWaitMs, __ATOMIC_RELAXED );
+            prvUpdateMax( &( xPoolStats.ulMaxWaitMs ), ulWaitMs );
+        }
+
+        if( pxCommandStruct != NULL )
+        {
+            uint32_t ulInUse = __atomic_add_fetch( &( xPoolStats.ulInUse ), 1, __ATOMIC_RELAXED );
+
+            prvUpdateMax( &( xPoolStats.ulPeakInUse ), ulInUse );
+            ( void ) __atomic_fetch_add( &( xPoolStats.ulGets ), 1, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            ( void ) __atomic_fetch_add( &( xPoolStats.ulFailedGets ), 1, __ATOMIC_RELAXED );
             LogError( ( "No command structure available." ) );
         }
     }
@@ -101,19 +225,35 @@ bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 {
     BaseType_t xStructReturned = pdFALSE;
 
-    if( !xCommandPoolQueue )
+    if( !xPoolWaitSem )
     {
         LogError( ( "Command pool not initialized." ) );
     }
     /* See if the structure being returned is actually from the pool. */
     else if( ( pCommandToRelease < commandStructurePool ) ||
-             ( pCommandToRelease > ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+             ( pCommandToRelease >= ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
     {
         LogError( ( "Provided pointer: %p does not belong to the command pool.", pCommandToRelease ) );
     }
+    else if( __atomic_exchange_n( &( pucInUse[ pCommandToRelease - commandStructurePool ] ), 0U, __ATOMIC_RELAXED ) == 0U )
+    {
+        /* Pushing an entry that is already on the free list would hand it out twice */
+        configASSERT( pdFALSE );
+        LogError( ( "Command Context %d released twice.",
+                    ( int ) ( pCommandToRelease - commandStructurePool ) ) );
+    }
     else
     {
-        xStructReturned = xQueueSend( xCommandPoolQueue, &pCommandToRelease, 0U );
+        prvPoolPush( ( uint16_t ) ( pCommandToRelease - commandStructurePool ) );
+
+        ( void ) __atomic_fetch_sub( &( xPoolStats.ulInUse ), 1, __ATOMIC_RELAXED );
+
+        if( __atomic_load_n( &ulPoolWaiters, __ATOMIC_SEQ_CST ) > 0 )
+        {
+            ( void ) xSemaphoreGive( xPoolWaitSem );
+        }
+
+        xStructReturned = pdTRUE;
 
         LogDebug( ( "Returned Command Context %d to pool",
                     ( int ) ( pCommandToRelease - commandStructurePool ) ) );
@@ -121,3 +261,33 @@ bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 
     return ( bool ) xStructReturned;
 }
+
+/*-----------------------------------------------------------*/
+
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    pxStats->ulInUse = __atomic_load_n( &( xPoolStats.ulInUse ), __ATOMIC_RELAXED );
+    pxStats->ulPeakInUse = __atomic_load_n( &( xPoolStats.ulPeakInUse ), __ATOMIC_RELAXED );
+    pxStats->ulGets = __atomic_load_n( &( xPoolStats.ulGets ), __ATOMIC_RELAXED );
+    pxStats->ulFailedGets = __atomic_load_n( &( xPoolStats.ulFailedGets ), __ATOMIC_RELAXED );
+    pxStats->ulBlockedGets = __atomic_load_n( &( xPoolStats.ulBlockedGets ), __ATOMIC_RELAXED );
+    pxStats->ulMaxWaitMs = __atomic_load_n( &( xPoolStats.ulMaxWaitMs ), __ATOMIC_RELAXED );
+    pxStats->ulTotalWaitMs = __atomic_load_n( &( xPoolStats.ulTotalWaitMs ), __ATOMIC_RELAXED );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t Agent_GetCommandIndex( const MQTTAgentCommand_t * pxCommand )
+{
+    size_t uxIdx = MQTT_COMMAND_CONTEXTS_POOL_SIZE;
+
+    if( ( pxCommand >= commandStructurePool ) &&
+        ( pxCommand < ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+    {
+        uxIdx = ( size_t ) ( pxCommand - commandStructurePool );
+    }
+
+    return uxIdx;
+}
@@ -34,6 +34,20 @@
 /* MQTT agent includes. */
 #include "core_mqtt_agent.h"
 
+/**
+ * @brief Command pool usage counters, see Agent_GetPoolStats.
+ */
+typedef struct AgentCommandPoolStats
+{
+    uint32_t ulInUse;       /* Structures currently handed out */
+    uint32_t ulPeakInUse;   /* Highest value of ulInUse since boot */
+    uint32_t ulGets;        /* Successful calls to Agent_GetCommand */
+    uint32_t ulFailedGets;  /* Calls to Agent_GetCommand which returned NULL */
+    uint32_t ulBlockedGets; /* Calls which found the pool empty and had to wait */
+    uint32_t ulMaxWaitMs;   /* Longest wait for a structure */
+    uint32_t ulTotalWaitMs; /* Sum of all waits for a structure */
+} AgentCommandPoolStats_t;
+
 /**
  * @brief Initialize the common task pool. Not thread safe.
  */
@@ -80,4 +94,20 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs );
  */
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
 
+/**
+ * @brief Copy a snapshot of the command pool usage counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats );
+
+/**
+ * @brief Get the position of a command structure within the pool.
+ *
+ * @param[in] pxCommand Command structure.
+ *
+ * @return Index of pxCommand, or MQTT_COMMAND_CONTEXTS_POOL_SIZE if it does not belong to the pool.
+ */
+size_t Agent_GetCommandIndex( const MQTTAgentCommand_t * pxCommand );
+
 #endif /* FREERTOS_COMMAND_POOL_H */
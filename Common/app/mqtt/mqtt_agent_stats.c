@@ -0,0 +1,273 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_agent_stats.c
+ * @brief Latency and queue depth statistics for the MQTT agent task.
+ *
+ * All statistics are written from the MQTT agent task only. The completion
+ * callback of each dequeued command is temporarily replaced so that the time
+ * until the agent completes it can be recorded.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* DWT cycle counter */
+#include "stm32u5xx.h"
+
+#include "mqtt_agent_stats.h"
+#include "freertos_command_pool.h"
+#include "trace_rec.h"
+
+/* Per command state kept between dequeue and completion */
+typedef struct
+{
+    MQTTAgentCommandCallback_t pxCallback;
+    MQTTAgentCommandContext_t * pxCallbackCtx;
+    MQTTAgentCommandType_t xCommandType;
+    MqttAgentTimestamp_t xDequeued;
+    MqttAgentTimestamp_t xSent;
+    BaseType_t xIsSent;
+} CommandTrace_t;
+
+static MqttAgentCommandStats_t xCommandStats[ NUM_COMMANDS ] = { 0 };
+static MqttAgentQueueStats_t xQueueStats = { 0 };
+
+static CommandTrace_t xTraces[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/* Trace of the command the agent is currently processing */
+static CommandTrace_t * pxCurrentTrace = NULL;
+
+/* Type of the command the agent is processing, for the trace recorder, NUM_COMMANDS if none */
+static MQTTAgentCommandType_t xProcessingType = NUM_COMMANDS;
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentStatsTimestamp( MqttAgentTimestamp_t * pxTimestamp )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    pxTimestamp->ulCycles = DWT->CYCCNT;
+    pxTimestamp->xTicks = xTaskGetTickCount();
+}
+
+/*-----------------------------------------------------------*/
+
+/* Record the time elapsed since pxStart in a histogram. Falls back to the tick count once the cycle counter may have wrapped. */
+static void prvStatsRecord( MqttAgentHistogram_t * pxHist,
+                            const MqttAgentTimestamp_t * pxStart )
+{
+    uint32_t ulElapsedMs = ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - pxStart->xTicks );
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000;
+    uint32_t ulElapsedUs;
+    uint32_t ulBucket = 0;
+
+    if( ulElapsedMs >= 10000U )
+    {
+        ulElapsedUs = ulElapsedMs * 1000U;
+    }
+    else
+    {
+        ulElapsedUs = ( DWT->CYCCNT - pxStart->ulCycles ) / ( ulCyclesPerUs > 0 ? ulCyclesPerUs : 1 );
+    }
+
+    /* Find the bucket number: the number of significant bits in ulElapsedUs */
+    if( ulElapsedUs > 0 )
+    {
+        ulBucket = 32 - __CLZ( ulElapsedUs );
+    }
+
+    if( ulBucket >= MQTT_AGENT_STATS_HIST_BUCKETS )
+    {
+        ulBucket = MQTT_AGENT_STATS_HIST_BUCKETS - 1;
+    }
+
+    pxHist->ulBuckets[ ulBucket ]++;
+    pxHist->ulCount++;
+    pxHist->ullTotalUs += ulElapsedUs;
+
+    if( ulElapsedUs > pxHist->ulMaxUs )
+    {
+        pxHist->ulMaxUs = ulElapsedUs;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTracedCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                      MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    CommandTrace_t * pxTrace = ( CommandTrace_t * ) pxCommandContext;
+
+    configASSERT( pxTrace != NULL );
+
+    if( pxTrace->xIsSent == pdTRUE )
+    {
+        prvStatsRecord( &( xCommandStats[ pxTrace->xCommandType ].xComplete ), &( pxTrace->xSent ) );
+    }
+
+    if( pxTrace == pxCurrentTrace )
+    {
+        pxCurrentTrace = NULL;
+    }
+
+    if( pxTrace->pxCallback != NULL )
+    {
+        pxTrace->pxCallback( pxTrace->pxCallbackCtx, pxReturnInfo );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentStatsCommandDequeued( MQTTAgentCommand_t * pxCommand,
+                                     const MqttAgentTimestamp_t * pxEnqueued,
+                                     UBaseType_t uxQueueDepth )
+{
+    size_t uxIdx;
+
+    configASSERT( pxCommand != NULL );
+    configASSERT( pxEnqueued != NULL );
+
+    xQueueStats.ulCommandsProcessed++;
+
+    xProcessingType = pxCommand->commandType;
+    vTraceRecBegin( TraceRecSliceMqttCmd, ( uint32_t ) xProcessingType );
+
+    if( uxQueueDepth > xQueueStats.ulQueueHighWaterMark )
+    {
+        xQueueStats.ulQueueHighWaterMark = ( uint32_t ) uxQueueDepth;
+    }
+
+    if( pxCommand->commandType < NUM_COMMANDS )
+    {
+        prvStatsRecord( &( xCommandStats[ pxCommand->commandType ].xQueueWait ), pxEnqueued );
+
+        uxIdx = Agent_GetCommandIndex( pxCommand );
+
+        /* Only pool commands stay valid until their completion callback runs */
+        if( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE )
+        {
+            CommandTrace_t * pxTrace = &( xTraces[ uxIdx ] );
+
+            pxTrace->pxCallback = pxCommand->pCommandCompleteCallback;
+            pxTrace->pxCallbackCtx = pxCommand->pCmdContext;
+            pxTrace->xCommandType = pxCommand->commandType;
+            pxTrace->xIsSent = pdFALSE;
+            vMqttAgentStatsTimestamp( &( pxTrace->xDequeued ) );
+
+            pxCommand->pCommandCompleteCallback = prvTracedCommandCallback;
+            pxCommand->pCmdContext = ( MQTTAgentCommandContext_t * ) pxTrace;
+
+            pxCurrentTrace = pxTrace;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentStatsCommandProcessed( void )
+{
+    pxCurrentTrace = NULL;
+
+    if( xProcessingType != NUM_COMMANDS )
+    {
+        vTraceRecEnd( TraceRecSliceMqttCmd, ( uint32_t ) xProcessingType );
+        xProcessingType = NUM_COMMANDS;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentStatsTransportSend( void )
+{
+    CommandTrace_t * pxTrace = pxCurrentTrace;
+
+    if( ( pxTrace != NULL ) &&
+        ( pxTrace->xIsSent == pdFALSE ) )
+    {
+        vMqttAgentStatsTimestamp( &( pxTrace->xSent ) );
+        pxTrace->xIsSent = pdTRUE;
+
+        prvStatsRecord( &( xCommandStats[ pxTrace->xCommandType ].xDispatch ), &( pxTrace->xDequeued ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_GetCommandStats( MQTTAgentCommandType_t xCommandType,
+                                MqttAgentCommandStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        if( xCommandType < NUM_COMMANDS )
+        {
+            taskENTER_CRITICAL();
+            {
+                ( void ) memcpy( pxStats, &( xCommandStats[ xCommandType ] ), sizeof( MqttAgentCommandStats_t ) );
+            }
+            taskEXIT_CRITICAL();
+        }
+        else
+        {
+            ( void ) memset( pxStats, 0, sizeof( MqttAgentCommandStats_t ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_GetQueueStats( MqttAgentQueueStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xQueueStats, sizeof( MqttAgentQueueStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_ResetStats( void )
+{
+    taskENTER_CRITICAL();
+    {
+        ( void ) memset( xCommandStats, 0, sizeof( xCommandStats ) );
+        ( void ) memset( &xQueueStats, 0, sizeof( xQueueStats ) );
+    }
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,101 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_agent_stats.h
+ * @brief Latency and queue depth statistics for the MQTT agent task.
+ */
+#ifndef _MQTT_AGENT_STATS_H_
+#define _MQTT_AGENT_STATS_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt_agent.h"
+
+/*
+ * Number of histogram buckets. Bucket 0 counts events shorter than 1 us and
+ * bucket n counts events in the range [ 2^(n-1), 2^n ) us. The last bucket
+ * also counts any longer events.
+ */
+#define MQTT_AGENT_STATS_HIST_BUCKETS    24
+
+typedef struct
+{
+    uint32_t ulCount;
+    uint32_t ulMaxUs;
+    uint64_t ullTotalUs;
+    uint32_t ulBuckets[ MQTT_AGENT_STATS_HIST_BUCKETS ];
+} MqttAgentHistogram_t;
+
+typedef struct
+{
+    MqttAgentHistogram_t xQueueWait; /* From enqueue until the agent dequeues the command */
+    MqttAgentHistogram_t xDispatch;  /* From dequeue until the first packet byte is handed to the transport */
+    MqttAgentHistogram_t xComplete;  /* From that send until the completion callback, e.g. the PUBACK of a QoS1 publish */
+} MqttAgentCommandStats_t;
+
+typedef struct
+{
+    uint32_t ulCommandsProcessed;
+    uint32_t ulQueueHighWaterMark; /* Most commands seen waiting in the agent queue */
+} MqttAgentQueueStats_t;
+
+/* Point in time used to measure intervals which may exceed the cycle counter range */
+typedef struct
+{
+    uint32_t ulCycles;
+    TickType_t xTicks;
+} MqttAgentTimestamp_t;
+
+/*
+ * @brief Copy a snapshot of the statistics for one command type into pxStats.
+ */
+void MqttAgent_GetCommandStats( MQTTAgentCommandType_t xCommandType,
+                                MqttAgentCommandStats_t * pxStats );
+
+/*
+ * @brief Copy a snapshot of the command queue statistics into pxStats.
+ */
+void MqttAgent_GetQueueStats( MqttAgentQueueStats_t * pxStats );
+
+/*
+ * @brief Reset all MQTT agent statistics to zero.
+ */
+void MqttAgent_ResetStats( void );
+
+/* Hooks called by the MQTT agent task */
+void vMqttAgentStatsTimestamp( MqttAgentTimestamp_t * pxTimestamp );
+
+void vMqttAgentStatsCommandDequeued( MQTTAgentCommand_t * pxCommand,
+                                     const MqttAgentTimestamp_t * pxEnqueued,
+                                     UBaseType_t uxQueueDepth );
+
+void vMqttAgentStatsCommandProcessed( void );
+
+void vMqttAgentStatsTransportSend( void );
+
+#endif /* _MQTT_AGENT_STATS_H_ */
@@ -55,6 +55,14 @@
 
 /* MQTT Agent ports. */
 #include "freertos_command_pool.h"
+#include "mqtt_agent_stats.h"
+#include "mqtt_outbox.h"
+#include "mqtt_dispatch.h"
+#include "mqtt_policy.h"
+#include "mqtt_stream.h"
+#include "mqtt_keepalive.h"
+#include "custom_metrics.h"
+#include "metrics.h"
 
 /* Exponential backoff retry include. */
 #include "backoff_algorithm.h"
@@ -64,6 +72,12 @@
 
 #include "mbedtls_transport.h"
 #include "sys_evt.h"
+#include "periodic_work.h"
+#include "static_alloc.h"
+#include "boot_prof.h"
+
+/* DWT cycle counter used for the callback time of each subscription */
+#include "stm32u5xx.h"
 
 /*-----------------------------------------------------------*/
 
@@ -101,44 +115,199 @@ static_assert( ( ( uint64_t ) RETRY_BACKOFF_MULTIPLIER * ( uint64_t ) RETRY_MAX_
  *  It is the responsibility of the Client to ensure that the interval between
  *  Control Packets being sent does not exceed the this Keep Alive value. In the
  *  absence of sending any other Control Packets, the Client MUST send a
- *  PINGREQ Packet.
+ *  PINGREQ Packet. With MQTT_KEEPALIVE_ADAPTIVE the PINGREQs are sent at the
+ *  shorter interval learned by mqtt_keepalive.c.
  */
-#define KEEP_ALIVE_INTERVAL_S                 ( 60U )
+#if ( MQTT_KEEPALIVE_ADAPTIVE == 1 )
+    #define KEEP_ALIVE_INTERVAL_S    MQTT_KEEPALIVE_MAX_S
+#else
+    #define KEEP_ALIVE_INTERVAL_S    MQTT_KEEPALIVE_MIN_S
+#endif
 
 #define MQTT_AGENT_NOTIFY_IDX                 ( 3U )
 
 #define MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV    ( 1U << 31 )
 #define MQTT_AGENT_NOTIFY_FLAG_M_QUEUE        ( 1U << 30 )
+#define MQTT_AGENT_NOTIFY_FLAG_KEEPALIVE      ( 1U << 29 )
+#define MQTT_AGENT_NOTIFY_FLAG_NET_DOWN       ( 1U << 28 )
+#define MQTT_AGENT_NOTIFY_FLAG_DISCONNECT     ( 1U << 27 )
+
+/* The process loop runs at least this often to send a PINGREQ in time, up to a quarter period late */
+#define MQTT_AGENT_KEEPALIVE_PERIOD_MS( usIntervalS )    ( ( uint32_t ) ( usIntervalS ) * 1000U / 4U )
 
 /**
  * @brief Socket send and receive timeouts to use.
  */
 #define SEND_TIMEOUT_MS                       ( 2000U )
 
+/**
+ * @brief Time to wait for space in the agent command queue when enqueueing a (un)subscribe.
+ */
+#define SUBSCRIBE_ENQUEUE_TIMEOUT_MS          ( 10000U )
+
 #define AGENT_READY_EVT_MASK                  ( 1U )
 
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
+/**
+ * @brief Number of slots in the open addressing table used to look up exact (non wildcard) topic filters.
+ * Must be larger than MQTT_AGENT_MAX_SUBSCRIPTIONS so that every probe sequence ends at an empty slot.
+ */
+#ifndef MQTT_AGENT_SUB_INDEX_SIZE
+    #define MQTT_AGENT_SUB_INDEX_SIZE    ( 2U * MQTT_AGENT_MAX_SUBSCRIPTIONS )
+#endif
+
+#define SUB_INDEX_EMPTY                  UINT16_MAX
+
+/**
+ * @brief Time a QoS0 publish may be held in the transport cork buffer waiting for further
+ * commands, so that telemetry from several tasks goes out in one TLS record. 0 disables the window.
+ * Held data is sent earlier when the cork buffer fills or a non QoS0 command is processed.
+ */
+#ifndef MQTT_AGENT_QOS0_COALESCE_WINDOW_MS
+    #define MQTT_AGENT_QOS0_COALESCE_WINDOW_MS    ( 0U )
+#endif
+
+/**
+ * @brief Coalescing window of publishes given a low priority by the mqtt_policy key, whatever
+ * their QoS. High priority publishes are sent at once.
+ */
+#ifndef MQTT_AGENT_LOW_PRIORITY_COALESCE_WINDOW_MS
+    #define MQTT_AGENT_LOW_PRIORITY_COALESCE_WINDOW_MS    ( 50U )
+#endif
+
+/**
+ * @brief Smallest coalescing window of both kinds of publishes above while the network reports
+ * SYS_EVT_LINK_POOR, so that fewer and fuller frames are sent over a marginal link.
+ */
+#ifndef MQTT_AGENT_POOR_LINK_COALESCE_WINDOW_MS
+    #define MQTT_AGENT_POOR_LINK_COALESCE_WINDOW_MS    ( 250U )
+#endif
+
+static_assert( MQTT_AGENT_SUB_INDEX_SIZE > MQTT_AGENT_MAX_SUBSCRIPTIONS );
+static_assert( MQTT_AGENT_MAX_SUBSCRIPTIONS < SUB_INDEX_EMPTY );
+static_assert( MQTT_AGENT_MAX_CALLBACKS < SUB_INDEX_EMPTY );
+
+/**
+ * @brief Number of network buffers the agent rotates between. A subscriber may keep a
+ * buffer returned by MqttAgent_RetainRxBuffer while the agent receives into another one.
+ */
+#ifndef MQTT_AGENT_RX_BUFFER_COUNT
+    #define MQTT_AGENT_RX_BUFFER_COUNT    2U
+#endif
+
+static_assert( MQTT_AGENT_RX_BUFFER_COUNT >= 1 );
+
+/**
+ * @brief Appended to the thing name to form the client ID of the bulk connection,
+ * the broker drops an older connection using the same client ID.
+ */
+#ifndef MQTT_AGENT_BULK_CLIENT_ID_SUFFIX
+    #define MQTT_AGENT_BULK_CLIENT_ID_SUFFIX    "-bulk"
+#endif
+
+/**
+ * @brief Network buffer of the bulk connection. Incoming publishes are received whole into it,
+ * the streaming of larger publishes is only done on the control connection.
+ */
+#ifndef MQTT_AGENT_BULK_NETWORK_BUFFER_SIZE
+    #define MQTT_AGENT_BULK_NETWORK_BUFFER_SIZE    MQTT_AGENT_NETWORK_BUFFER_SIZE
+#endif
+
+#ifndef MQTT_AGENT_BULK_TASK_STACK_SIZE
+    #define MQTT_AGENT_BULK_TASK_STACK_SIZE    2048U
+#endif
+
+#if ( MQTT_AGENT_BULK_CONNECTION == 1 )
+    #define MQTT_AGENT_CONN_COUNT    ( 2U )
+#else
+    #define MQTT_AGENT_CONN_COUNT    ( 1U )
+#endif
+
+struct MqttAgentRxBuffer
+{
+    uint8_t * pucData;
+    uint32_t ulRefCount;
+};
+
+/* Element of the agent command queue */
+typedef struct AgentQueueItem
+{
+    MQTTAgentCommand_t * pxCommand;
+    MqttAgentTimestamp_t xEnqueued;
+} AgentQueueItem_t;
+
 struct MQTTAgentMessageContext
 {
     QueueHandle_t xQueue;
     TaskHandle_t xAgentTaskHandle;
+
+    /* Transport writes are coalesced while the command loop has queued work */
+    NetworkContext_t * pxNetworkContext;
+    BaseType_t xCoalesceWrites;
+
+    /* Only QoS0 or low priority publishes have been corked since xCoalesceStart */
+    BaseType_t xCoalesceWindowOpen;
+    TickType_t xCoalesceStart;
+    TickType_t xCoalesceWindow;
+
+    /* Number of MqttAgent_PublishBatch calls currently enqueueing commands */
+    volatile UBaseType_t uxBatchDepth;
+
+    /* The command latency statistics follow a single agent task, the control connection */
+    BaseType_t xRecordStats;
+
+    /* PINGREQs sent by coreMQTT, followed between process loops for the adaptive keep alive */
+    MQTTContext_t * pxMqttContext;
+    PeriodicWork_t * pxKeepAliveWork;
+    MqttKeepAlive_t xKeepAlive;
+    volatile uint32_t ulRxEvents;
+    uint32_t ulRxEventsAcked;
+    BaseType_t xPingPending;
+    BaseType_t xPingIdle;
 };
 
+/* Incoming traffic of one subscription, cleared when its slot is given a new topic filter */
+typedef struct
+{
+    uint32_t ulMessages;
+    uint64_t ullBytes;
+    uint64_t ullCallbackCycles;
+    uint32_t ulMaxCallbackCycles;
+} SubTrafficStats_t;
+
 typedef struct MQTTAgentSubscriptionManagerCtx
 {
     MQTTSubscribeInfo_t pxSubscriptions[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
     MQTTSubAckStatus_t pxSubAckStatus[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
     uint32_t pulSubCbCount[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    SubTrafficStats_t pxTraffic[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
     SubCallbackElement_t pxCallbacks[ MQTT_AGENT_MAX_CALLBACKS ];
 
     size_t uxSubscriptionCount;
     size_t uxCallbackCount;
     MQTTAgentSubscribeArgs_t xInitialSubscribeArgs;
 
+    /* Dispatch index, rebuilt by prvSubIndexRebuild whenever the lists above change */
+    uint32_t pulFilterHash[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    uint16_t pusExactIndex[ MQTT_AGENT_SUB_INDEX_SIZE ];
+    uint16_t pusWildcardSubs[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    size_t uxWildcardCount;
+    uint16_t pusSubFirstCb[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    uint16_t pusCbNext[ MQTT_AGENT_MAX_CALLBACKS ];
+
     SemaphoreHandle_t xMutex;
 } SubMgrCtx_t;
 
+/* Per connection settings of an agent instance */
+typedef struct MqttAgentInstanceConfig
+{
+    MqttAgentConnection_t xConnection;
+    const char * pcName;
+    const char * pcClientIdSuffix;
+    size_t uxNetworkBufferSize;
+    TlsSocketProfile_t xSocketProfile;
+} MqttAgentInstanceConfig_t;
 
 typedef struct MQTTAgentTaskCtx
 {
@@ -152,16 +321,102 @@ typedef struct MQTTAgentTaskCtx
 
     SubMgrCtx_t xSubMgrCtx;
 
+    /* Receive buffers, pxActiveRxBuffer is the one currently used by the MQTT context */
+    MqttAgentRxBuffer_t pxRxBuffers[ MQTT_AGENT_RX_BUFFER_COUNT ];
+    MqttAgentRxBuffer_t * pxActiveRxBuffer;
+
+    /* Set while an incoming publish is being dispatched to subscribers */
+    const MQTTPublishInfo_t * pxDeliveringPublish;
+    MqttAgentRxBuffer_t * pxNextRxBuffer;
+
     MQTTConnectInfo_t xConnectInfo;
     char * pcMqttEndpoint;
     size_t uxMqttEndpointLen;
     uint32_t ulMqttPort;
+
+    /* Set when a new endpoint or port has been committed to the kvstore */
+    volatile BaseType_t xBrokerConfigChanged;
+
+    /* Set while the command loop of this instance runs */
+    volatile BaseType_t xConnected;
+
+    const MqttAgentInstanceConfig_t * pxConfig;
+
+    /* Outside of the agent context, a periodic work item stays linked once started */
+    PeriodicWork_t xKeepAliveWork;
 } MQTTAgentTaskCtx_t;
 
+#define SUB_REQUEST_NOT_SENT    UINT8_MAX
+
+static_assert( MQTT_AGENT_SUBSCRIBE_BATCH_MAX < SUB_REQUEST_NOT_SENT );
+
+/* State of a MqttAgent_SubscribeAsync call, kept until the SUBACK arrives */
+typedef struct SubscribeRequest
+{
+    MQTTAgentTaskCtx_t * pxTaskCtx;
+    SubscribeCompleteCallback_t pxCompleteCallback;
+    void * pvCompleteCtx;
+
+    /* Per caller entry: index into pxSubInfo, or SUB_REQUEST_NOT_SENT */
+    size_t uxCount;
+    uint8_t pucPacketIdx[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ];
+    MQTTSubAckStatus_t pxSubAckStatus[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ];
+
+    /* Topic filters sent in the SUBSCRIBE packet */
+    size_t uxPacketCount;
+    uint16_t pusPacketSubIdx[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ];
+    MQTTSubAckStatus_t pxPacketSubAck[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ];
+    MQTTSubscribeInfo_t pxSubInfo[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ];
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+} SubscribeRequest_t;
+
+/* State of a MqttAgent_UnSubscribeAsync call, kept until the UNSUBACK arrives */
+typedef struct UnsubscribeRequest
+{
+    MQTTAgentTaskCtx_t * pxTaskCtx;
+    UnsubscribeCompleteCallback_t pxCompleteCallback;
+    void * pvCompleteCtx;
+
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+    uint32_t ulCallbackCount;
+
+    MQTTSubscribeInfo_t xSubInfo;
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+} UnsubscribeRequest_t;
+
+/* Completion context used by the blocking wrappers around the async calls */
+typedef struct SyncRequestCtx
+{
+    TaskHandle_t xTaskHandle;
+    MQTTStatus_t xStatus;
+    MQTTSubAckStatus_t * pxSubAckStatus;
+} SyncRequestCtx_t;
+
 /* ALPN protocols must be a NULL-terminated list of strings. */
 static const char * pcAlpnProtocols[] = { AWS_IOT_MQTT_ALPN, NULL };
 
-static MQTTAgentHandle_t xDefaultInstanceHandle = NULL;
+static const MqttAgentInstanceConfig_t xInstanceConfigs[ MQTT_AGENT_CONN_MAX ] =
+{
+    /* Small publishes and acks, sent without waiting for more data */
+    { MQTT_AGENT_CONN_CONTROL, "control", "",                               MQTT_AGENT_NETWORK_BUFFER_SIZE,      TLS_SOCKET_PROFILE_INTERACTIVE },
+    { MQTT_AGENT_CONN_BULK,    "bulk",    MQTT_AGENT_BULK_CLIENT_ID_SUFFIX, MQTT_AGENT_BULK_NETWORK_BUFFER_SIZE, TLS_SOCKET_PROFILE_BULK },
+};
+
+/* Agent instances which completed their initialization, indexed by connection */
+static MQTTAgentTaskCtx_t * volatile pxInstances[ MQTT_AGENT_CONN_MAX ] = { NULL };
+
+/* Instances done initializing, successfully or not. EVT_MASK_MQTT_INIT is set once all of them are */
+static UBaseType_t uxInstancesDone = 0;
+
+/* Data plane metrics */
+static METRIC_COUNTER( xTxBytesMetric, "mqtt_tx_bytes" );
+static METRIC_COUNTER( xRxPublishesMetric, "mqtt_rx_publishes" );
+static METRIC_COUNTER( xRxPayloadBytesMetric, "mqtt_rx_payload_bytes" );
+static METRIC_HISTOGRAM( xRxPayloadSizeMetric, "mqtt_rx_payload_size" );
+static METRIC_COUNTER( xAgentWakeupsMetric, "mqtt_agent_wakeups" );
+static METRIC_COUNTER( xRxUnmatchedMetric, "mqtt_rx_unmatched" );
+static METRIC_HISTOGRAM( xRxCallbackTimeMetric, "mqtt_rx_callback_us" );
 
 /*-----------------------------------------------------------*/
 
@@ -178,6 +433,24 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Rebuild the topic filter hash index and per-subscription callback chains
+ * used by prvIncomingPublishCallback.
+ *
+ * @param[in] pxCtx Subscription manager context, with its mutex held.
+ */
+static void prvSubIndexRebuild( SubMgrCtx_t * pxCtx );
+
+/**
+ * @brief Switch the MQTT context over to the receive buffer reserved by
+ * MqttAgent_RetainRxBuffer, leaving the lent buffer untouched.
+ *
+ * @param[in] pxTaskCtx Agent task context.
+ * @param[in] pxPublishInfo Publish which was just delivered from the current buffer.
+ */
+static void prvRxBufferSwap( MQTTAgentTaskCtx_t * pxTaskCtx,
+                             const MQTTPublishInfo_t * pxPublishInfo );
+
 /**
  * @brief Function to attempt to resubscribe to the topics already present in the
  * subscription list.
@@ -204,6 +477,17 @@ static uint32_t prvGetTimeMs( void );
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Sleep for a reconnect back-off delay, returning early if the network link goes down.
+ *
+ * The reconnect loop then waits for the link and restarts the back-off from
+ * RETRY_BACKOFF_BASE once it is back, rather than sitting out a delay sized
+ * for an unreachable broker.
+ */
+static void prvReconnectDelay( uint32_t ulDelayMs );
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Global entry time into the application to use as a reference timestamp
  * in the #prvGetTimeMs function. #prvGetTimeMs will always return the difference
@@ -263,6 +547,21 @@ static inline BaseType_t xUnlockSubCtx( SubMgrCtx_t * pxSubCtx )
 }
 
 /*-----------------------------------------------------------*/
+
+/* Publish pxCtx, or NULL if its initialization failed, and set EVT_MASK_MQTT_INIT once every instance is done */
+static void prvInstanceInitDone( const MqttAgentInstanceConfig_t * pxConfig,
+                                 MQTTAgentTaskCtx_t * pxCtx )
+{
+    pxInstances[ pxConfig->xConnection ] = pxCtx;
+
+    if( __atomic_add_fetch( &uxInstancesDone, 1, __ATOMIC_ACQ_REL ) == MQTT_AGENT_CONN_COUNT )
+    {
+        ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_INIT );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 void vSleepUntilMQTTAgentReady( void )
 {
     configASSERT( xSystemEvents != NULL );
@@ -346,6 +645,7 @@ static inline void prvUpdateCallbackRefs( SubCallbackElement_t * pxCallbacksList
 
 static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
                                                 SubCallbackElement_t * pxCallbacksList,
+                                                SubTrafficStats_t * pxTrafficList,
                                                 size_t * puxSubCount )
 {
     size_t uxLastOccupiedIndex = 0;
@@ -366,7 +666,7 @@ static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
             }
 
             /* Iterate over remainder of list for occupied spots */
-            for( ; uxLastOccupiedIndex < MQTT_AGENT_MAX_CALLBACKS; uxLastOccupiedIndex++ )
+            for( ; uxLastOccupiedIndex < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxLastOccupiedIndex++ )
             {
                 if( pxSubList[ uxLastOccupiedIndex ].topicFilterLength != 0 )
                 {
@@ -376,6 +676,9 @@ static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
                     /* Clear old location */
                     memset( &( pxSubList[ uxLastOccupiedIndex ] ), 0, sizeof( MQTTSubscribeInfo_t ) );
 
+                    /* The traffic counters follow their topic filter */
+                    pxTrafficList[ uxIdx ] = pxTrafficList[ uxLastOccupiedIndex ];
+
                     prvUpdateCallbackRefs( pxCallbacksList, pxSubList, uxLastOccupiedIndex, uxIdx );
 
                     /* Increment count of active subscriptions */
@@ -405,65 +708,48 @@ static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
 
 /*-----------------------------------------------------------*/
 
-static inline void prvCompressCallbackList( SubCallbackElement_t * pxCallbackList,
-                                            size_t * puxCallbackCount )
+/* Return a command to the pool once the agent is done with it, freeing its outbox copy */
+static bool prvReleaseCommand( MQTTAgentCommand_t * pxCommand )
 {
-    size_t uxLastOccupiedIndex = 0;
-    size_t uxCallbackCount = 0;
+    vMqttOutboxRelease( pxCommand );
 
-    configASSERT( pxCallbackList );
-    configASSERT( puxCallbackCount );
+    return Agent_ReleaseCommand( pxCommand );
+}
 
-    for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
-    {
-        if( ( pxCallbackList[ uxIdx ].pxSubInfo == NULL ) &&     /* Current slot at uxIdx is Empty */
-            ( uxLastOccupiedIndex < MQTT_AGENT_MAX_CALLBACKS ) ) /* There may be occupied slots after the current one */
-        {
-            /* uxLastOccupiedIndex is always > uxIdx */
-            if( uxLastOccupiedIndex <= uxIdx )
-            {
-                uxLastOccupiedIndex = uxIdx + 1;
-            }
+/*-----------------------------------------------------------*/
 
-            /* Iterate over remainder of list for occupied spots */
-            for( ; uxLastOccupiedIndex < MQTT_AGENT_MAX_CALLBACKS; uxLastOccupiedIndex++ )
-            {
-                if( pxCallbackList[ uxLastOccupiedIndex ].pxSubInfo != NULL )
-                {
-                    configASSERT( uxLastOccupiedIndex > uxIdx );
+/* Transport send hook of the bulk connection, which is not followed by the command statistics */
+static int32_t prvBulkTransportSend( NetworkContext_t * pxNetworkContext,
+                                     const void * pvBuffer,
+                                     size_t uxBytesToSend )
+{
+    int32_t lSent = mbedtls_transport_send( pxNetworkContext, pvBuffer, uxBytesToSend );
 
-                    /* Move context from uxLastOccupiedIndex to uxIdx */
-                    pxCallbackList[ uxIdx ] = pxCallbackList[ uxLastOccupiedIndex ];
+    if( lSent > 0 )
+    {
+        vMetricAdd( &xTxBytesMetric, ( uint32_t ) lSent );
+    }
 
-                    /* Clear old context location */
-                    memset( &( pxCallbackList[ uxLastOccupiedIndex ] ), 0, sizeof( SubCallbackElement_t ) );
+    return lSent;
+}
 
-                    pxCallbackList[ uxLastOccupiedIndex ].pxIncomingPublishCallback = NULL;
-                    pxCallbackList[ uxLastOccupiedIndex ].pvIncomingPublishCallbackContext = NULL;
-                    pxCallbackList[ uxLastOccupiedIndex ].xTaskHandle = NULL;
-                    pxCallbackList[ uxLastOccupiedIndex ].pxSubInfo = NULL;
+/*-----------------------------------------------------------*/
 
-                    /* Increment count of active callbacks */
-                    uxCallbackCount++;
+/* Transport send hook which marks when the packet of the current command starts going out */
+static int32_t prvTransportSend( NetworkContext_t * pxNetworkContext,
+                                 const void * pvBuffer,
+                                 size_t uxBytesToSend )
+{
+    vMqttAgentStatsTransportSend();
 
-                    /* Increment counter so we don't visit this empty location again */
-                    uxLastOccupiedIndex++;
-                    break;
-                }
-            }
-        }
-        else if( pxCallbackList[ uxIdx ].pxSubInfo != NULL )
-        {
-            /* Increment count of valid contexts */
-            uxCallbackCount++;
-        }
-        else /* pxCallbackList[ uxIdx ].pxSubInfo == NULL */
-        {
-            /* Continue iterating, ignore empty slot. */
-        }
-    }
+    return prvBulkTransportSend( pxNetworkContext, pvBuffer, uxBytesToSend );
+}
+
+/*-----------------------------------------------------------*/
 
-    *puxCallbackCount = uxCallbackCount;
+static uint64_t prvReadQueueDepth( void * pvCtx )
+{
+    return uxQueueMessagesWaiting( ( QueueHandle_t ) pvCtx );
 }
 
 /*-----------------------------------------------------------*/
@@ -474,6 +760,8 @@ static void prvSocketRecvReadyCallback( void * pvCtx )
 
     if( pxMsgCtx )
     {
+        pxMsgCtx->ulRxEvents++;
+
         ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
                                      MQTT_AGENT_NOTIFY_IDX,
                                      MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV,
@@ -483,159 +771,478 @@ static void prvSocketRecvReadyCallback( void * pvCtx )
 
 /*-----------------------------------------------------------*/
 
-static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
-                                 MQTTAgentCommand_t * const * pxCommandToSend,
-                                 uint32_t blockTimeMs )
+/* Called from the timer task, the command loop sends the PINGREQ when the keep alive interval is close */
+static void prvKeepAliveCallback( void * pvCtx )
 {
-    BaseType_t xQueueStatus = pdFAIL;
+    MQTTAgentMessageContext_t * pxMsgCtx = ( MQTTAgentMessageContext_t * ) pvCtx;
 
-    if( pxMsgCtx && pxCommandToSend )
-    {
-        xQueueStatus = xQueueSendToBack( pxMsgCtx->xQueue, pxCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
+    ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                 MQTT_AGENT_NOTIFY_IDX,
+                                 MQTT_AGENT_NOTIFY_FLAG_KEEPALIVE,
+                                 eSetBits );
+}
 
-        /* Notify the agent that a message is waiting */
-        if( pxMsgCtx->xAgentTaskHandle )
-        {
-            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
-                                         MQTT_AGENT_NOTIFY_IDX,
-                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
-                                         eSetBits );
-        }
-    }
+/*-----------------------------------------------------------*/
 
-    return ( bool ) xQueueStatus;
+/* Send PINGREQs every usIntervalS, the interval given to the broker in CONNECT stays as it was */
+static void prvKeepAliveApply( MQTTAgentMessageContext_t * pxMsgCtx,
+                               uint16_t usIntervalS )
+{
+    pxMsgCtx->pxMqttContext->keepAliveIntervalSec = usIntervalS;
+
+    vPeriodicWorkStartCallback( pxMsgCtx->pxKeepAliveWork, prvKeepAliveCallback,
+                                pxMsgCtx, pdMS_TO_TICKS( MQTT_AGENT_KEEPALIVE_PERIOD_MS( usIntervalS ) ),
+                                pdMS_TO_TICKS( MQTT_AGENT_KEEPALIVE_PERIOD_MS( usIntervalS ) / 4U ) );
 }
 
 /*-----------------------------------------------------------*/
 
-static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
-                                    MQTTAgentCommand_t ** ppxReceivedCommand,
-                                    uint32_t blockTimeMs )
+/*
+ * Runs in the agent task between process loops. coreMQTT only sends a PINGREQ once nothing was sent
+ * for the interval, so an acknowledged one with nothing received since the previous PINGRESP shows
+ * that the NAT mapping held for that long.
+ */
+static void prvKeepAliveObserve( MQTTAgentMessageContext_t * pxMsgCtx )
 {
-    BaseType_t xQueueStatus = pdFAIL;
-    uint32_t ulNotifyValue = 0;
+    const MQTTContext_t * pxMqttContext = pxMsgCtx->pxMqttContext;
 
-    if( pxMsgCtx && ppxReceivedCommand )
+    if( ( pxMqttContext != NULL ) &&
+        ( pxMqttContext->connectStatus == MQTTConnected ) )
     {
-        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
-                                    0x0,
-                                    0xFFFFFFFF,
-                                    &ulNotifyValue,
-                                    pdMS_TO_TICKS( blockTimeMs ) ) )
+        if( pxMqttContext->waitingForPingResp == true )
         {
-            /* Prioritize processing incoming network packets over local requests */
-            if( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV )
+            if( pxMsgCtx->xPingPending == pdFALSE )
             {
-                *ppxReceivedCommand = NULL;
+                pxMsgCtx->xPingPending = pdTRUE;
+                pxMsgCtx->xPingIdle = ( pxMsgCtx->ulRxEvents == pxMsgCtx->ulRxEventsAcked ) ? pdTRUE : pdFALSE;
             }
-            else
+        }
+        else if( pxMsgCtx->xPingPending == pdTRUE )
+        {
+            pxMsgCtx->xPingPending = pdFALSE;
+            pxMsgCtx->ulRxEventsAcked = pxMsgCtx->ulRxEvents;
+
+            if( ( pxMsgCtx->xPingIdle == pdTRUE ) &&
+                ( xMqttKeepAliveAcked( &( pxMsgCtx->xKeepAlive ) ) == pdTRUE ) )
             {
-                xQueueStatus = xQueueReceive( pxMsgCtx->xQueue, ppxReceivedCommand, 0 );
+                prvKeepAliveApply( pxMsgCtx, pxMsgCtx->xKeepAlive.usIntervalS );
             }
         }
+        else
+        {
+            /* No ping in flight */
+        }
     }
-
-    return ( bool ) xQueueStatus;
 }
 
-
 /*-----------------------------------------------------------*/
 
-static void prvResubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                                 MQTTAgentCommand_t * const * pxCommandToSend,
+                                 uint32_t blockTimeMs )
 {
-    SubMgrCtx_t * pxCtx = ( SubMgrCtx_t * ) pxCommandContext;
-
-    configASSERT( pxCommandContext != NULL );
-    configASSERT( pxReturnInfo != NULL );
-    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+    BaseType_t xQueueStatus = pdFAIL;
+    BaseType_t xAllowed = pdTRUE;
 
-    /* Ignore pxReturnInfo->returnCode */
+    /* Apply the rate limit and QoS of the mqtt_policy key. The agent task itself never waits for the rate limit. */
+    if( pxMsgCtx && pxCommandToSend &&
+        ( *pxCommandToSend != NULL ) &&
+        ( ( *pxCommandToSend )->commandType == PUBLISH ) )
+    {
+        xAllowed = xMqttPolicyApply( *pxCommandToSend,
+                                     ( xTaskGetCurrentTaskHandle() == pxMsgCtx->xAgentTaskHandle ) ? 0U : blockTimeMs );
+    }
 
-    for( uint32_t ulSubIdx = 0; ulSubIdx < pxCtx->uxSubscriptionCount; ulSubIdx++ )
+    if( pxMsgCtx && pxCommandToSend && ( xAllowed == pdTRUE ) )
     {
-        /* Update cached SubAck status */
-        pxCtx->pxSubAckStatus[ ulSubIdx ] = pxReturnInfo->pSubackCodes[ ulSubIdx ];
+        BaseType_t xNotify = ( pxMsgCtx->uxBatchDepth == 0 ) ? pdTRUE : pdFALSE;
 
-        if( pxReturnInfo->pSubackCodes[ ulSubIdx ] == MQTTSubAckFailure )
+        /* Wake the agent to drain the queue instead of blocking on a batch it has not been told about */
+        if( ( xNotify == pdFALSE ) &&
+            ( uxQueueSpacesAvailable( pxMsgCtx->xQueue ) == 0 ) &&
+            ( pxMsgCtx->xAgentTaskHandle ) )
         {
-            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ ulSubIdx ] );
+            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                         MQTT_AGENT_NOTIFY_IDX,
+                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
+                                         eSetBits );
+        }
 
-            LogError( "Failed to re-subscribe to topic filter \"%.*s\".",
-                      pxSubInfo->topicFilterLength,
-                      pxSubInfo->pTopicFilter );
+        AgentQueueItem_t xItem = { .pxCommand = *pxCommandToSend };
 
-            for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
-            {
-                SubCallbackElement_t * const pxCbInfo = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+        /* Keep QoS1/2 publishes in agent memory until acknowledged, so that the caller's buffers
+         * are free once this returns and a resumed session resends from the copy. */
+        if( xItem.pxCommand != NULL )
+        {
+            ( void ) xMqttOutboxStore( xItem.pxCommand );
+        }
 
-                if( ( pxCbInfo->pxSubInfo == pxSubInfo ) &&
-                    ( pxCbInfo->xTaskHandle != NULL ) )
-                {
-                    LogWarn( "Detected orphaned callback for task: %s due to failed re-subscribe operation.",
-                             pcTaskGetName( pxCbInfo->xTaskHandle ) );
-                }
-            }
+        vMqttAgentStatsTimestamp( &( xItem.xEnqueued ) );
+
+        if( ( xItem.pxCommand != NULL ) &&
+            ( xMqttPolicyGetPriority( xItem.pxCommand ) == eMqttPolicyPrioHigh ) )
+        {
+            xQueueStatus = xQueueSendToFront( pxMsgCtx->xQueue, &xItem, pdMS_TO_TICKS( blockTimeMs ) );
+        }
+        else
+        {
+            xQueueStatus = xQueueSendToBack( pxMsgCtx->xQueue, &xItem, pdMS_TO_TICKS( blockTimeMs ) );
+        }
+
+        /* Notify the agent that a message is waiting. A batch notifies once all of its commands are queued. */
+        if( ( xNotify == pdTRUE ) &&
+            ( pxMsgCtx->xAgentTaskHandle ) )
+        {
+            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                         MQTT_AGENT_NOTIFY_IDX,
+                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
+                                         eSetBits );
         }
     }
 
-    ( void ) xUnlockSubCtx( pxCtx );
+    return ( bool ) xQueueStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
-                                          SubMgrCtx_t * pxCtx )
+/*
+ * Send the coalesced writes. After a failed flush the transport fails every call of the command
+ * loop, which then returns so that the connection is closed and opened again, as for a failed send.
+ */
+static BaseType_t prvCorkFlush( MQTTAgentMessageContext_t * pxMsgCtx )
 {
-    MQTTStatus_t xStatus;
-
-    configASSERT( pxCtx );
-    configASSERT( pxCtx->xMutex );
-    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+    int32_t lResult = mbedtls_transport_cork( pxMsgCtx->pxNetworkContext, pdFALSE );
 
-    prvCompressSubscriptionList( pxCtx->pxSubscriptions,
-                                 pxCtx->pxCallbacks,
-                                 &( pxCtx->uxSubscriptionCount ) );
+    pxMsgCtx->xCoalesceWindowOpen = pdFALSE;
 
-    if( pxCtx->uxSubscriptionCount > 0U )
+    if( lResult < 0 )
     {
-        MQTTAgentCommandInfo_t xCommandParams =
-        {
-            .blockTimeMs                 = 0U,
-            .cmdCompleteCallback         = prvResubscribeCommandCallback,
-            .pCmdCompleteCallbackContext = ( void * ) pxCtx,
-        };
+        LogError( "Failed to send the coalesced writes: %ld.", ( long ) lResult );
+    }
 
-        pxCtx->xInitialSubscribeArgs.pSubscribeInfo = pxCtx->pxSubscriptions;
-        pxCtx->xInitialSubscribeArgs.numSubscriptions = pxCtx->uxSubscriptionCount;
+    return ( lResult < 0 ) ? pdFALSE : pdTRUE;
+}
 
-        /* Enqueue the subscribe command */
-        xStatus = MQTTAgent_Subscribe( pxMqttAgentCtx,
-                                       &( pxCtx->xInitialSubscribeArgs ),
-                                       &xCommandParams );
+/*-----------------------------------------------------------*/
 
-        /* prvResubscribeCommandCallback handles giving the mutex */
+/*
+ * Disconnect command for a MQTT_AGENT_NOTIFY_FLAG_DISCONNECT request, taken from the pool without
+ * waiting since only the agent returns commands to it. NULL if the pool is empty, the request is
+ * then posted again and served once a processed command has been released.
+ */
+static MQTTAgentCommand_t * prvDisconnectCommandGet( MQTTAgentMessageContext_t * pxMsgCtx )
+{
+    MQTTAgentCommand_t * pxCommand = Agent_GetCommand( 0 );
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
-                      MQTT_Status_strerror( xStatus ) );
-        }
+    if( pxCommand != NULL )
+    {
+        ( void ) memset( pxCommand, 0, sizeof( MQTTAgentCommand_t ) );
+        pxCommand->commandType = DISCONNECT;
     }
     else
     {
-        ( void ) xUnlockSubCtx( pxCtx );
-
-        /* Mark the resubscribe as success if there is nothing to be subscribed to. */
-        xStatus = MQTTSuccess;
+        ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                     MQTT_AGENT_NOTIFY_IDX,
+                                     MQTT_AGENT_NOTIFY_FLAG_DISCONNECT,
+                                     eSetBits );
     }
 
-    return xStatus;
+    return pxCommand;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline bool prvMatchTopic( MQTTSubscribeInfo_t * pxSubscribeInfo,
+static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                                    MQTTAgentCommand_t ** ppxReceivedCommand,
+                                    uint32_t blockTimeMs )
+{
+    BaseType_t xQueueStatus = pdFAIL;
+    uint32_t ulNotifyValue = 0;
+    MQTTAgentCommand_t * pxDisconnect = NULL;
+
+    if( pxMsgCtx && ppxReceivedCommand )
+    {
+        TickType_t xWaitTicks = pdMS_TO_TICKS( blockTimeMs );
+        BaseType_t xWindowWait = pdFALSE;
+        BaseType_t xNotified;
+
+        /* The previously received command, if any, has been processed */
+        if( pxMsgCtx->xRecordStats == pdTRUE )
+        {
+            vMqttAgentStatsCommandProcessed();
+        }
+
+        prvKeepAliveObserve( pxMsgCtx );
+
+        /*
+         * The notification is the only thing the loop blocks on. One notification may stand for
+         * several queued commands, and the queue bit is cleared along with the socket bit, so the
+         * loop only blocks once the queue is empty.
+         */
+        if( uxQueueMessagesWaiting( pxMsgCtx->xQueue ) > 0 )
+        {
+            xWaitTicks = 0;
+        }
+
+        /* Send everything coalesced so far before waiting for more work, unless the coalescing window is still open */
+        else if( pxMsgCtx->xCoalesceWrites == pdTRUE )
+        {
+            TickType_t xElapsed = xTaskGetTickCount() - pxMsgCtx->xCoalesceStart;
+
+            if( ( pxMsgCtx->xCoalesceWindowOpen == pdTRUE ) &&
+                ( xElapsed < pxMsgCtx->xCoalesceWindow ) )
+            {
+                TickType_t xRemaining = pxMsgCtx->xCoalesceWindow - xElapsed;
+
+                if( xRemaining < xWaitTicks )
+                {
+                    xWaitTicks = xRemaining;
+                    xWindowWait = pdTRUE;
+                }
+            }
+            else if( prvCorkFlush( pxMsgCtx ) == pdFALSE )
+            {
+                /* Run the process loop at once, its transport calls fail and end the command loop */
+                xWaitTicks = 0;
+            }
+            else
+            {
+                /* Nothing left coalesced */
+            }
+        }
+
+        xNotified = xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
+                                            0x0,
+                                            0xFFFFFFFF,
+                                            &ulNotifyValue,
+                                            xWaitTicks );
+
+        if( ( xNotified == pdTRUE ) &&
+            ( xWaitTicks > 0 ) )
+        {
+            vMetricIncrement( &xAgentWakeupsMetric );
+        }
+
+        if( ( xNotified == pdTRUE ) &&
+            ( ( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_DISCONNECT ) != 0 ) )
+        {
+            pxDisconnect = prvDisconnectCommandGet( pxMsgCtx );
+        }
+
+        /* A requested disconnect ends the command loop before anything else is processed */
+        if( pxDisconnect != NULL )
+        {
+            *ppxReceivedCommand = pxDisconnect;
+            xQueueStatus = pdTRUE;
+        }
+
+        /* Prioritize processing incoming network packets over local requests. The process loop run
+         * for the NULL command reads the socket, which rearms its notification. */
+        else if( ( xNotified == pdTRUE ) &&
+                 ( ( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV ) != 0 ) )
+        {
+            *ppxReceivedCommand = NULL;
+        }
+        else if( uxQueueMessagesWaiting( pxMsgCtx->xQueue ) > 0 )
+        {
+            AgentQueueItem_t xItem;
+            UBaseType_t uxQueueDepth = uxQueueMessagesWaiting( pxMsgCtx->xQueue );
+
+            xQueueStatus = xQueueReceive( pxMsgCtx->xQueue, &xItem, 0 );
+
+            if( xQueueStatus == pdTRUE )
+            {
+                *ppxReceivedCommand = xItem.pxCommand;
+
+                if( ( xItem.pxCommand != NULL ) &&
+                    ( pxMsgCtx->xRecordStats == pdTRUE ) )
+                {
+                    vMqttAgentStatsCommandDequeued( xItem.pxCommand, &( xItem.xEnqueued ), uxQueueDepth );
+
+                    if( xItem.pxCommand->commandType == PUBLISH )
+                    {
+                        vBootPhaseMark( BOOT_PHASE_FIRST_PUBLISH );
+                    }
+                }
+            }
+        }
+        else if( ( xNotified == pdFALSE ) &&
+                 ( xWindowWait == pdTRUE ) )
+        {
+            /* Window expired without further commands. No command is returned, so a failed flush
+             * ends the command loop in the process loop which runs next. */
+            ( void ) prvCorkFlush( pxMsgCtx );
+        }
+        else
+        {
+            /* Keep alive or backstop timeout, the process loop runs when no command is returned */
+        }
+
+        if( ( xQueueStatus == pdTRUE ) &&
+            ( pxMsgCtx->xCoalesceWrites == pdTRUE ) )
+        {
+            const MQTTAgentCommand_t * pxCommand = *ppxReceivedCommand;
+            TickType_t xWindow = 0;
+
+            if( ( pxCommand != NULL ) &&
+                ( pxCommand->commandType == PUBLISH ) &&
+                ( pxCommand->pArgs != NULL ) )
+            {
+                MqttPolicyPriority_t xPriority = xMqttPolicyGetPriority( pxCommand );
+
+                BaseType_t xDeferrable = pdTRUE;
+
+                if( xPriority == eMqttPolicyPrioLow )
+                {
+                    xWindow = pdMS_TO_TICKS( MQTT_AGENT_LOW_PRIORITY_COALESCE_WINDOW_MS );
+                }
+                else if( ( xPriority == eMqttPolicyPrioNormal ) &&
+                         ( ( ( const MQTTPublishInfo_t * ) pxCommand->pArgs )->qos == MQTTQoS0 ) )
+                {
+                    xWindow = pdMS_TO_TICKS( MQTT_AGENT_QOS0_COALESCE_WINDOW_MS );
+                }
+                else
+                {
+                    /* High priority or acknowledged publish, send at once */
+                    xDeferrable = pdFALSE;
+                }
+
+                if( ( xDeferrable == pdTRUE ) &&
+                    ( xWindow < pdMS_TO_TICKS( MQTT_AGENT_POOR_LINK_COALESCE_WINDOW_MS ) ) &&
+                    ( xSysEventIsUp( SYS_EVT_LINK_POOR ) == pdTRUE ) )
+                {
+                    xWindow = pdMS_TO_TICKS( MQTT_AGENT_POOR_LINK_COALESCE_WINDOW_MS );
+                }
+            }
+
+            if( xWindow == 0 )
+            {
+                pxMsgCtx->xCoalesceWindowOpen = pdFALSE;
+            }
+            else if( pxMsgCtx->xCoalesceWindowOpen == pdFALSE )
+            {
+                pxMsgCtx->xCoalesceWindowOpen = pdTRUE;
+                pxMsgCtx->xCoalesceStart = xTaskGetTickCount();
+                pxMsgCtx->xCoalesceWindow = xWindow;
+            }
+            else
+            {
+                /* Window already running */
+            }
+
+            /* More commands are waiting or the coalescing window is open, let their packets share TLS records */
+            if( ( uxQueueMessagesWaiting( pxMsgCtx->xQueue ) > 0 ) ||
+                ( pxMsgCtx->xCoalesceWindowOpen == pdTRUE ) )
+            {
+                ( void ) mbedtls_transport_cork( pxMsgCtx->pxNetworkContext, pdTRUE );
+            }
+        }
+    }
+
+    return ( bool ) xQueueStatus;
+}
+
+
+/*-----------------------------------------------------------*/
+
+static void prvResubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    SubMgrCtx_t * pxCtx = ( SubMgrCtx_t * ) pxCommandContext;
+
+    configASSERT( pxCommandContext != NULL );
+    configASSERT( pxReturnInfo != NULL );
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    /* Ignore pxReturnInfo->returnCode */
+
+    for( uint32_t ulSubIdx = 0; ulSubIdx < pxCtx->uxSubscriptionCount; ulSubIdx++ )
+    {
+        /* Update cached SubAck status */
+        pxCtx->pxSubAckStatus[ ulSubIdx ] = pxReturnInfo->pSubackCodes[ ulSubIdx ];
+
+        if( pxReturnInfo->pSubackCodes[ ulSubIdx ] == MQTTSubAckFailure )
+        {
+            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ ulSubIdx ] );
+
+            LogError( "Failed to re-subscribe to topic filter \"%.*s\".",
+                      pxSubInfo->topicFilterLength,
+                      pxSubInfo->pTopicFilter );
+
+            for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+            {
+                SubCallbackElement_t * const pxCbInfo = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+
+                if( ( pxCbInfo->pxSubInfo == pxSubInfo ) &&
+                    ( pxCbInfo->xTaskHandle != NULL ) )
+                {
+                    LogWarn( "Detected orphaned callback for task: %s due to failed re-subscribe operation.",
+                             pcTaskGetName( pxCbInfo->xTaskHandle ) );
+                }
+            }
+        }
+    }
+
+    ( void ) xUnlockSubCtx( pxCtx );
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
+                                          SubMgrCtx_t * pxCtx )
+{
+    MQTTStatus_t xStatus;
+
+    configASSERT( pxCtx );
+    configASSERT( pxCtx->xMutex );
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    prvCompressSubscriptionList( pxCtx->pxSubscriptions,
+                                 pxCtx->pxCallbacks,
+                                 pxCtx->pxTraffic,
+                                 &( pxCtx->uxSubscriptionCount ) );
+
+    prvSubIndexRebuild( pxCtx );
+
+    if( pxCtx->uxSubscriptionCount > 0U )
+    {
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = 0U,
+            .cmdCompleteCallback         = prvResubscribeCommandCallback,
+            .pCmdCompleteCallbackContext = ( void * ) pxCtx,
+        };
+
+        pxCtx->xInitialSubscribeArgs.pSubscribeInfo = pxCtx->pxSubscriptions;
+        pxCtx->xInitialSubscribeArgs.numSubscriptions = pxCtx->uxSubscriptionCount;
+
+        /* Enqueue the subscribe command */
+        xStatus = MQTTAgent_Subscribe( pxMqttAgentCtx,
+                                       &( pxCtx->xInitialSubscribeArgs ),
+                                       &xCommandParams );
+
+        /* prvResubscribeCommandCallback handles giving the mutex */
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
+                      MQTT_Status_strerror( xStatus ) );
+        }
+    }
+    else
+    {
+        ( void ) xUnlockSubCtx( pxCtx );
+
+        /* Mark the resubscribe as success if there is nothing to be subscribed to. */
+        xStatus = MQTTSuccess;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvMatchTopic( MQTTSubscribeInfo_t * pxSubscribeInfo,
                                   const char * pcTopicName,
                                   const uint16_t usTopicLen )
 {
@@ -665,10 +1272,158 @@ static inline bool prvMatchCbCtx( SubCallbackElement_t * pxCbCtx,
 
 /*-----------------------------------------------------------*/
 
+/* FNV-1a hash of a topic name or topic filter */
+static inline uint32_t prvHashTopic( const char * pcTopic,
+                                     uint16_t usTopicLen )
+{
+    uint32_t ulHash = 2166136261UL;
+
+    for( uint16_t usIdx = 0; usIdx < usTopicLen; usIdx++ )
+    {
+        ulHash ^= ( uint8_t ) pcTopic[ usIdx ];
+        ulHash *= 16777619UL;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvIsWildcardFilter( const MQTTSubscribeInfo_t * pxSubInfo )
+{
+    return( ( memchr( pxSubInfo->pTopicFilter, '+', pxSubInfo->topicFilterLength ) != NULL ) ||
+            ( memchr( pxSubInfo->pTopicFilter, '#', pxSubInfo->topicFilterLength ) != NULL ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Exact topic filters go into a hash table, wildcard filters into a short list which is still
+ * matched with MQTT_MatchTopic. Callbacks are chained per subscription.
+ * Called with the subscription manager mutex held.
+ */
+static void prvSubIndexRebuild( SubMgrCtx_t * pxCtx )
+{
+    configASSERT( pxCtx );
+
+    for( size_t uxSlot = 0; uxSlot < MQTT_AGENT_SUB_INDEX_SIZE; uxSlot++ )
+    {
+        pxCtx->pusExactIndex[ uxSlot ] = SUB_INDEX_EMPTY;
+    }
+
+    pxCtx->uxWildcardCount = 0;
+
+    for( size_t uxSubIdx = 0; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+    {
+        const MQTTSubscribeInfo_t * pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+
+        pxCtx->pusSubFirstCb[ uxSubIdx ] = SUB_INDEX_EMPTY;
+
+        if( ( pxSubInfo->pTopicFilter == NULL ) ||
+            ( pxSubInfo->topicFilterLength == 0 ) )
+        {
+            continue;
+        }
+
+        if( prvIsWildcardFilter( pxSubInfo ) )
+        {
+            pxCtx->pusWildcardSubs[ pxCtx->uxWildcardCount ] = ( uint16_t ) uxSubIdx;
+            pxCtx->uxWildcardCount++;
+        }
+        else
+        {
+            uint32_t ulHash = prvHashTopic( pxSubInfo->pTopicFilter, pxSubInfo->topicFilterLength );
+            size_t uxSlot = ulHash % MQTT_AGENT_SUB_INDEX_SIZE;
+
+            while( pxCtx->pusExactIndex[ uxSlot ] != SUB_INDEX_EMPTY )
+            {
+                uxSlot = ( uxSlot + 1 ) % MQTT_AGENT_SUB_INDEX_SIZE;
+            }
+
+            pxCtx->pulFilterHash[ uxSubIdx ] = ulHash;
+            pxCtx->pusExactIndex[ uxSlot ] = ( uint16_t ) uxSubIdx;
+        }
+    }
+
+    /* Walk backwards so each chain is in callback list order */
+    for( size_t uxCbIdx = MQTT_AGENT_MAX_CALLBACKS; uxCbIdx > 0; uxCbIdx-- )
+    {
+        const SubCallbackElement_t * pxCallback = &( pxCtx->pxCallbacks[ uxCbIdx - 1 ] );
+
+        pxCtx->pusCbNext[ uxCbIdx - 1 ] = SUB_INDEX_EMPTY;
+
+        if( pxCallback->pxSubInfo != NULL )
+        {
+            size_t uxSubIdx = ( size_t ) ( pxCallback->pxSubInfo - pxCtx->pxSubscriptions );
+
+            configASSERT( uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS );
+
+            pxCtx->pusCbNext[ uxCbIdx - 1 ] = pxCtx->pusSubFirstCb[ uxSubIdx ];
+            pxCtx->pusSubFirstCb[ uxSubIdx ] = ( uint16_t ) ( uxCbIdx - 1 );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Run every callback registered against the subscription at usSubIdx */
+static bool prvDispatchToSubscription( SubMgrCtx_t * pxCtx,
+                                       uint16_t usSubIdx,
+                                       MQTTPublishInfo_t * pxPublishInfo )
+{
+    MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ usSubIdx ] );
+    SubTrafficStats_t * const pxTraffic = &( pxCtx->pxTraffic[ usSubIdx ] );
+    uint32_t ulStartCycles = DWT->CYCCNT;
+    uint32_t ulCycles;
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+    bool xPublishHandled = false;
+
+    for( uint16_t usCbIdx = pxCtx->pusSubFirstCb[ usSubIdx ];
+         usCbIdx != SUB_INDEX_EMPTY;
+         usCbIdx = pxCtx->pusCbNext[ usCbIdx ] )
+    {
+        SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ usCbIdx ] );
+        char * pcTaskName = pcTaskGetName( pxCallback->xTaskHandle );
+
+        if( !pcTaskName )
+        {
+            pcTaskName = "Unknown";
+        }
+
+        LogInfo( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
+                 pcTaskName,
+                 pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
+                 pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+
+        pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
+                                               pxPublishInfo );
+        xPublishHandled = true;
+    }
+
+    /* Updated with the subscription manager mutex held, as is MqttAgent_GetTopicStats */
+    ulCycles = DWT->CYCCNT - ulStartCycles;
+
+    pxTraffic->ulMessages++;
+    pxTraffic->ullBytes += pxPublishInfo->payloadLength;
+    pxTraffic->ullCallbackCycles += ulCycles;
+
+    if( ulCycles > pxTraffic->ulMaxCallbackCycles )
+    {
+        pxTraffic->ulMaxCallbackCycles = ulCycles;
+    }
+
+    vMetricObserve( &xRxCallbackTimeMetric, ulCycles / ( ( ulCyclesPerUs > 0 ) ? ulCyclesPerUs : 1U ) );
+
+    return xPublishHandled;
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo )
 {
+    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) pMqttAgentContext;
     SubMgrCtx_t * pxCtx = NULL;
     bool xPublishHandled = false;
 
@@ -680,35 +1435,55 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
     pxCtx = ( SubMgrCtx_t * ) pMqttAgentContext->pIncomingCallbackContext;
 
+    vMetricIncrement( &xRxPublishesMetric );
+    vMetricAdd( &xRxPayloadBytesMetric, ( uint32_t ) pxPublishInfo->payloadLength );
+    vMetricObserve( &xRxPayloadSizeMetric, ( uint32_t ) pxPublishInfo->payloadLength );
+
     if( xLockSubCtx( pxCtx ) )
     {
-        /* Iterate over pxCtx->pxCallbacks list */
-        for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+        pxTaskCtx->pxDeliveringPublish = pxPublishInfo;
+
+        uint32_t ulHash = prvHashTopic( pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+        size_t uxSlot = ulHash % MQTT_AGENT_SUB_INDEX_SIZE;
+
+        /* Exact filters: at most one can be equal to the topic name */
+        while( pxCtx->pusExactIndex[ uxSlot ] != SUB_INDEX_EMPTY )
+        {
+            uint16_t usSubIdx = pxCtx->pusExactIndex[ uxSlot ];
+            const MQTTSubscribeInfo_t * pxSubInfo = &( pxCtx->pxSubscriptions[ usSubIdx ] );
+
+            if( ( pxCtx->pulFilterHash[ usSubIdx ] == ulHash ) &&
+                ( pxSubInfo->topicFilterLength == pxPublishInfo->topicNameLength ) &&
+                ( memcmp( pxSubInfo->pTopicFilter, pxPublishInfo->pTopicName, pxSubInfo->topicFilterLength ) == 0 ) )
+            {
+                xPublishHandled = prvDispatchToSubscription( pxCtx, usSubIdx, pxPublishInfo );
+                break;
+            }
+
+            uxSlot = ( uxSlot + 1 ) % MQTT_AGENT_SUB_INDEX_SIZE;
+        }
+
+        /* Wildcard filters */
+        for( size_t uxIdx = 0; uxIdx < pxCtx->uxWildcardCount; uxIdx++ )
         {
-            SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ ulCbIdx ] );
-            MQTTSubscribeInfo_t * const pxSubInfo = pxCallback->pxSubInfo;
+            uint16_t usSubIdx = pxCtx->pusWildcardSubs[ uxIdx ];
 
-            if( ( pxSubInfo != NULL ) &&
-                prvMatchTopic( pxSubInfo,
+            if( prvMatchTopic( &( pxCtx->pxSubscriptions[ usSubIdx ] ),
                                pxPublishInfo->pTopicName,
                                pxPublishInfo->topicNameLength ) )
             {
-                char * pcTaskName = pcTaskGetName( pxCallback->xTaskHandle );
-
-                if( !pcTaskName )
+                if( prvDispatchToSubscription( pxCtx, usSubIdx, pxPublishInfo ) )
                 {
-                    pcTaskName = "Unknown";
+                    xPublishHandled = true;
                 }
+            }
+        }
 
-                LogInfo( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
-                         pcTaskName,
-                         pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
-                         pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+        pxTaskCtx->pxDeliveringPublish = NULL;
 
-                pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
-                                                       pxPublishInfo );
-                xPublishHandled = true;
-            }
+        if( pxTaskCtx->pxNextRxBuffer != NULL )
+        {
+            prvRxBufferSwap( pxTaskCtx, pxPublishInfo );
         }
 
         ( void ) xUnlockSubCtx( pxCtx );
@@ -716,6 +1491,8 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
     if( !xPublishHandled )
     {
+        vMetricIncrement( &xRxUnmatchedMetric );
+
         LogWarn( "Incoming publish with topic=\"%.*s\" does not match any callback functions.",
                  pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
     }
@@ -723,110 +1500,385 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
 /*-----------------------------------------------------------*/
 
+static void prvRxBufferSwap( MQTTAgentTaskCtx_t * pxTaskCtx,
+                             const MQTTPublishInfo_t * pxPublishInfo )
+{
+    MQTTContext_t * pxMqttCtx = &( pxTaskCtx->xAgentContext.mqttContext );
+    uint8_t * pucOldBuffer = pxMqttCtx->networkBuffer.pBuffer;
+    uint8_t * pucNewBuffer = pxTaskCtx->pxNextRxBuffer->pucData;
+
+    /* The payload is the last field of a PUBLISH, so anything past it belongs to the next packet. */
+    size_t uxPacketEnd = ( size_t ) ( ( ( const uint8_t * ) pxPublishInfo->pPayload + pxPublishInfo->payloadLength ) - pucOldBuffer );
+
+    configASSERT( uxPacketEnd <= pxMqttCtx->index );
+
+    /*
+     * Once this callback returns, coreMQTT moves the bytes following the current packet to the
+     * start of the network buffer. Copy them to the same offset in the new buffer so that move
+     * happens there instead of over the lent payload.
+     */
+    if( pxMqttCtx->index > uxPacketEnd )
+    {
+        ( void ) memcpy( &( pucNewBuffer[ uxPacketEnd ] ),
+                         &( pucOldBuffer[ uxPacketEnd ] ),
+                         pxMqttCtx->index - uxPacketEnd );
+    }
+
+    pxMqttCtx->networkBuffer.pBuffer = pucNewBuffer;
+    pxTaskCtx->pxActiveRxBuffer = pxTaskCtx->pxNextRxBuffer;
+    pxTaskCtx->pxNextRxBuffer = NULL;
+
+    LogDebug( "Lent receive buffer %p, now receiving into %p.", pucOldBuffer, pucNewBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+MqttAgentRxBufferHandle_t MqttAgent_RetainRxBuffer( MQTTAgentHandle_t xHandle )
+{
+    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
+    MqttAgentRxBuffer_t * pxRxBuffer = NULL;
+
+    if( xHandle == NULL )
+    {
+        LogError( "Invalid xHandle parameter." );
+    }
+    else if( ( pxTaskCtx->pxDeliveringPublish == NULL ) ||
+             ( xTaskGetCurrentTaskHandle() != pxTaskCtx->xAgentMessageCtx.xAgentTaskHandle ) )
+    {
+        LogError( "MqttAgent_RetainRxBuffer may only be called from an incoming publish callback." );
+    }
+    else if( pxTaskCtx->pxDeliveringPublish->payloadLength == 0 )
+    {
+        LogDebug( "Not lending a receive buffer for an empty publish." );
+    }
+    else
+    {
+        /* Reserve a buffer for the agent to continue receiving into on the first retain */
+        for( size_t uxIdx = 0; ( pxTaskCtx->pxNextRxBuffer == NULL ) && ( uxIdx < MQTT_AGENT_RX_BUFFER_COUNT ); uxIdx++ )
+        {
+            MqttAgentRxBuffer_t * pxCandidate = &( pxTaskCtx->pxRxBuffers[ uxIdx ] );
+
+            if( ( pxCandidate != pxTaskCtx->pxActiveRxBuffer ) &&
+                ( pxCandidate->pucData != NULL ) &&
+                ( __atomic_load_n( &( pxCandidate->ulRefCount ), __ATOMIC_ACQUIRE ) == 0 ) )
+            {
+                pxTaskCtx->pxNextRxBuffer = pxCandidate;
+            }
+        }
+
+        if( pxTaskCtx->pxNextRxBuffer != NULL )
+        {
+            pxRxBuffer = pxTaskCtx->pxActiveRxBuffer;
+            ( void ) __atomic_fetch_add( &( pxRxBuffer->ulRefCount ), 1, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            LogDebug( "No spare receive buffer available, payload must be copied." );
+        }
+    }
+
+    return pxRxBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_ReleaseRxBuffer( MqttAgentRxBufferHandle_t xRxBuffer )
+{
+    configASSERT( xRxBuffer != NULL );
+
+    if( xRxBuffer != NULL )
+    {
+        uint32_t ulPrevRefCount = __atomic_fetch_sub( &( xRxBuffer->ulRefCount ), 1, __ATOMIC_RELEASE );
+
+        configASSERT( ulPrevRefCount > 0 );
+        ( void ) ulPrevRefCount;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvSubscriptionManagerCtxFree( SubMgrCtx_t * pxSubMgrCtx )
 {
     configASSERT( pxSubMgrCtx );
 
-    if( pxSubMgrCtx->xMutex )
-    {
-        configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
-        vSemaphoreDelete( pxSubMgrCtx->xMutex );
+    if( pxSubMgrCtx->xMutex )
+    {
+        configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
+        vSemaphoreDelete( pxSubMgrCtx->xMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscriptionManagerCtxReset( SubMgrCtx_t * pxSubMgrCtx )
+{
+    configASSERT( pxSubMgrCtx );
+    configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
+
+    pxSubMgrCtx->uxSubscriptionCount = 0;
+    pxSubMgrCtx->uxCallbackCount = 0;
+
+    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
+    {
+        pxSubMgrCtx->pxSubAckStatus[ uxIdx ] = MQTTSubAckFailure;
+        pxSubMgrCtx->pulSubCbCount[ uxIdx ] = 0;
+        ( void ) memset( &( pxSubMgrCtx->pxTraffic[ uxIdx ] ), 0, sizeof( SubTrafficStats_t ) );
+
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].pTopicFilter = NULL;
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].qos = 0;
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].topicFilterLength = 0;
+    }
+
+    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
+    {
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pvIncomingPublishCallbackContext = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxIncomingPublishCallback = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxSubInfo = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].xTaskHandle = NULL;
+    }
+
+    pxSubMgrCtx->xInitialSubscribeArgs.numSubscriptions = 0;
+    pxSubMgrCtx->xInitialSubscribeArgs.pSubscribeInfo = NULL;
+
+    prvSubIndexRebuild( pxSubMgrCtx );
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvSubscriptionManagerCtxInit( SubMgrCtx_t * pxSubMgrCtx,
+                                                   MqttAgentConnection_t xConnection )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+
+    configASSERT( pxSubMgrCtx );
+
+    /* Each use of the static allocation macros has its own storage, so every connection needs its own */
+    if( xConnection == MQTT_AGENT_CONN_CONTROL )
+    {
+        pxSubMgrCtx->xMutex = xAppSemaphoreCreateMutex();
+    }
+    else
+    {
+        pxSubMgrCtx->xMutex = xAppSemaphoreCreateMutex();
+    }
+
+    if( pxSubMgrCtx->xMutex )
+    {
+        LogDebug( "Creating MqttAgent Mutex." );
+        ( void ) xLockSubCtx( pxSubMgrCtx );
+        prvSubscriptionManagerCtxReset( pxSubMgrCtx );
+    }
+    else
+    {
+        xStatus = MQTTNoMemory;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Ends early on SYS_EVT_IP_DOWN, the connect loop then waits for the network to come back */
+static void prvReconnectDelay( uint32_t ulDelayMs )
+{
+    TickType_t xRemainingTicks = pdMS_TO_TICKS( ulDelayMs );
+    TimeOut_t xTimeOut;
+    uint32_t ulNotifyValue = 0;
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    while( ( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) != 0 ) &&
+           ( ( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_NET_DOWN ) == 0 ) &&
+           ( xTaskCheckForTimeOut( &xTimeOut, &xRemainingTicks ) == pdFALSE ) )
+    {
+        ( void ) xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
+                                         0x0,
+                                         MQTT_AGENT_NOTIFY_FLAG_NET_DOWN,
+                                         &ulNotifyValue,
+                                         xRemainingTicks );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFreeAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx )
+{
+    if( pxCtx )
+    {
+        /* The timer task has a higher priority, so its callback is not running while the context is freed */
+        vPeriodicWorkStop( &( pxCtx->xKeepAliveWork ) );
+
+        if( pxCtx->xAgentMessageCtx.xQueue != NULL )
+        {
+            vQueueDelete( pxCtx->xAgentMessageCtx.xQueue );
+        }
+
+        if( pxCtx->xConnectInfo.pClientIdentifier != NULL )
+        {
+            vPortFree( ( void * ) pxCtx->xConnectInfo.pClientIdentifier );
+        }
+
+        if( pxCtx->pcMqttEndpoint != NULL )
+        {
+            vPortFree( pxCtx->pcMqttEndpoint );
+        }
+
+        prvSubscriptionManagerCtxFree( &( pxCtx->xSubMgrCtx ) );
+
+        /* Entry 0 is the network buffer owned by the caller */
+        for( size_t uxIdx = 1; uxIdx < MQTT_AGENT_RX_BUFFER_COUNT; uxIdx++ )
+        {
+            if( pxCtx->pxRxBuffers[ uxIdx ].pucData != NULL )
+            {
+                vPortFree( pxCtx->pxRxBuffers[ uxIdx ].pucData );
+            }
+        }
+
+        vPortFree( ( void * ) pxCtx );
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvSubscriptionManagerCtxReset( SubMgrCtx_t * pxSubMgrCtx )
+/*
+ * @brief Read the broker endpoint and port from the kvstore into pxCtx.
+ * The previous values are kept if the new ones are invalid.
+ */
+static MQTTStatus_t prvReadBrokerConfig( MQTTAgentTaskCtx_t * pxCtx )
 {
-    configASSERT( pxSubMgrCtx );
-    configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
-
-    pxSubMgrCtx->uxSubscriptionCount = 0;
-    pxSubMgrCtx->uxCallbackCount = 0;
+    MQTTStatus_t xStatus = MQTTSuccess;
+    BaseType_t xSuccess = pdFALSE;
+    size_t uxEndpointLen = 0;
+    char * pcEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT, &uxEndpointLen );
+    uint32_t ulPort = KVStore_getUInt32( CS_CORE_MQTT_PORT, &( xSuccess ) );
 
-    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
+    if( ( uxEndpointLen == 0 ) ||
+        ( pcEndpoint == NULL ) )
     {
-        pxSubMgrCtx->pxSubAckStatus[ uxIdx ] = MQTTSubAckFailure;
-        pxSubMgrCtx->pulSubCbCount[ uxIdx ] = 0;
+        LogError( "Invalid mqtt endpoint read from KVStore." );
+        xStatus = MQTTNoMemory;
+    }
+    else if( ( ulPort == 0 ) ||
+             ( xSuccess == pdFALSE ) )
+    {
+        LogError( "Invalid mqtt port number read from KVStore." );
+        xStatus = MQTTNoMemory;
+    }
+    else
+    {
+        if( pxCtx->pcMqttEndpoint != NULL )
+        {
+            vPortFree( pxCtx->pcMqttEndpoint );
+        }
 
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].pTopicFilter = NULL;
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].qos = 0;
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].topicFilterLength = 0;
+        pxCtx->pcMqttEndpoint = pcEndpoint;
+        pxCtx->uxMqttEndpointLen = uxEndpointLen;
+        pxCtx->ulMqttPort = ulPort;
     }
 
-    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
+    if( ( xStatus != MQTTSuccess ) &&
+        ( pcEndpoint != NULL ) )
     {
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pvIncomingPublishCallbackContext = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxIncomingPublishCallback = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxSubInfo = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].xTaskHandle = NULL;
+        vPortFree( pcEndpoint );
     }
 
-    pxSubMgrCtx->xInitialSubscribeArgs.numSubscriptions = 0;
-    pxSubMgrCtx->xInitialSubscribeArgs.pSubscribeInfo = NULL;
+    return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvSubscriptionManagerCtxInit( SubMgrCtx_t * pxSubMgrCtx )
+/*
+ * @brief Called when the broker endpoint or port is committed to the kvstore.
+ * Has the agent disconnect from the current broker so that the reconnect loop picks up the new
+ * settings. The callback must not block, so the request is a notification rather than a command.
+ */
+static void prvBrokerConfigChangedCallback( KVStoreKey_t xKey,
+                                            void * pvCtx )
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
+    MQTTAgentTaskCtx_t * pxCtx = ( MQTTAgentTaskCtx_t * ) pvCtx;
 
-    configASSERT( pxSubMgrCtx );
+    LogInfo( "Configuration key %s changed, reconnecting to the broker.", kvKeyToString( xKey ) );
 
-    pxSubMgrCtx->xMutex = xSemaphoreCreateMutex();
+    pxCtx->xBrokerConfigChanged = pdTRUE;
 
-    if( pxSubMgrCtx->xMutex )
+    if( pxCtx->xConnected == pdTRUE )
     {
-        LogDebug( "Creating MqttAgent Mutex." );
-        ( void ) xLockSubCtx( pxSubMgrCtx );
-        prvSubscriptionManagerCtxReset( pxSubMgrCtx );
+        ( void ) xTaskNotifyIndexed( pxCtx->xAgentMessageCtx.xAgentTaskHandle,
+                                     MQTT_AGENT_NOTIFY_IDX,
+                                     MQTT_AGENT_NOTIFY_FLAG_DISCONNECT,
+                                     eSetBits );
     }
-    else
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Clearing the address on link loss aborts the TLS connection in lwIP.
+ * End the session now rather than at the next keep alive.
+ */
+static void prvNetDownCallback( SysEvent_t xEvent,
+                                void * pvCtx )
+{
+    MQTTAgentTaskCtx_t * pxCtx = ( MQTTAgentTaskCtx_t * ) pvCtx;
+    uint32_t ulBits = MQTT_AGENT_NOTIFY_FLAG_NET_DOWN;
+
+    ( void ) xEvent;
+
+    if( pxCtx->xConnected == pdTRUE )
     {
-        xStatus = MQTTNoMemory;
+        ulBits |= MQTT_AGENT_NOTIFY_FLAG_DISCONNECT;
     }
 
-    return xStatus;
+    ( void ) xTaskNotifyIndexed( pxCtx->xAgentMessageCtx.xAgentTaskHandle,
+                                 MQTT_AGENT_NOTIFY_IDX,
+                                 ulBits,
+                                 eSetBits );
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvFreeAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx )
+/*
+ * @brief Thing name followed by the client ID suffix of pxConfig, on the heap.
+ */
+static char * prvGetClientIdentifier( const MqttAgentInstanceConfig_t * pxConfig,
+                                      size_t * puxLen )
 {
-    if( pxCtx )
-    {
-        if( pxCtx->xAgentMessageCtx.xQueue != NULL )
-        {
-            vQueueDelete( pxCtx->xAgentMessageCtx.xQueue );
-        }
+    size_t uxThingNameLen = 0;
+    char * pcThingName = KVStore_getStringHeap( CS_CORE_THING_NAME, &uxThingNameLen );
+    char * pcClientId = pcThingName;
+    size_t uxSuffixLen = strlen( pxConfig->pcClientIdSuffix );
 
-        if( pxCtx->xConnectInfo.pClientIdentifier != NULL )
-        {
-            vPortFree( ( void * ) pxCtx->xConnectInfo.pClientIdentifier );
-        }
+    *puxLen = uxThingNameLen;
 
-        if( pxCtx->pcMqttEndpoint != NULL )
+    if( ( pcThingName != NULL ) &&
+        ( uxSuffixLen > 0 ) )
+    {
+        pcClientId = pvPortMalloc( uxThingNameLen + uxSuffixLen + 1 );
+
+        if( pcClientId != NULL )
         {
-            vPortFree( pxCtx->pcMqttEndpoint );
+            ( void ) memcpy( pcClientId, pcThingName, uxThingNameLen );
+            ( void ) memcpy( &( pcClientId[ uxThingNameLen ] ), pxConfig->pcClientIdSuffix, uxSuffixLen + 1 );
+            *puxLen = uxThingNameLen + uxSuffixLen;
         }
 
-        prvSubscriptionManagerCtxFree( &( pxCtx->xSubMgrCtx ) );
-
-        vPortFree( ( void * ) pxCtx );
+        vPortFree( pcThingName );
     }
+
+    return pcClientId;
 }
 
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
+                                              const MqttAgentInstanceConfig_t * pxConfig,
                                               NetworkContext_t * pxNetworkContext,
                                               uint8_t * pucNetworkBuffer,
                                               size_t uxNetworkBufferLen )
 {
-    BaseType_t xSuccess = pdTRUE;
     MQTTStatus_t xStatus = MQTTSuccess;
     size_t uxTempSize = 0;
+    const BaseType_t xControl = ( pxConfig->xConnection == MQTT_AGENT_CONN_CONTROL ) ? pdTRUE : pdFALSE;
 
     if( pxCtx == NULL )
     {
@@ -847,6 +1899,8 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
     {
         /* Zero Initialize */
         memset( pxCtx, 0, sizeof( MQTTAgentTaskCtx_t ) );
+
+        pxCtx->pxConfig = pxConfig;
     }
 
     if( xStatus == MQTTSuccess )
@@ -855,10 +1909,24 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         pxCtx->xNetworkFixedBuffer.pBuffer = pucNetworkBuffer;
         pxCtx->xNetworkFixedBuffer.size = uxNetworkBufferLen;
 
-        /* Setup transport interface */
+        pxCtx->pxRxBuffers[ 0 ].pucData = pucNetworkBuffer;
+        pxCtx->pxActiveRxBuffer = &( pxCtx->pxRxBuffers[ 0 ] );
+
+        /* Spare buffers are optional, without them every payload is copied by its subscriber */
+        for( size_t uxIdx = 1; uxIdx < MQTT_AGENT_RX_BUFFER_COUNT; uxIdx++ )
+        {
+            pxCtx->pxRxBuffers[ uxIdx ].pucData = ( uint8_t * ) pvPortMalloc( uxNetworkBufferLen );
+
+            if( pxCtx->pxRxBuffers[ uxIdx ].pucData == NULL )
+            {
+                LogWarn( "Failed to allocate %d bytes for spare receive buffer %d.", uxNetworkBufferLen, uxIdx );
+            }
+        }
+
+        /* Setup transport interface. The stream parser and command statistics follow one connection. */
         pxCtx->xTransport.pNetworkContext = pxNetworkContext;
-        pxCtx->xTransport.send = mbedtls_transport_send;
-        pxCtx->xTransport.recv = mbedtls_transport_recv;
+        pxCtx->xTransport.send = ( xControl == pdTRUE ) ? prvTransportSend : prvBulkTransportSend;
+        pxCtx->xTransport.recv = ( xControl == pdTRUE ) ? lMqttStreamRecv : mbedtls_transport_recv;
 
         /* MQTTConnectInfo_t */
         /* Always start the initial connection with a clean session */
@@ -869,7 +1937,7 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         pxCtx->xConnectInfo.pPassword = NULL;
         pxCtx->xConnectInfo.passwordLength = 0U;
 
-        pxCtx->xConnectInfo.pClientIdentifier = KVStore_getStringHeap( CS_CORE_THING_NAME, &uxTempSize );
+        pxCtx->xConnectInfo.pClientIdentifier = prvGetClientIdentifier( pxConfig, &uxTempSize );
 
         if( ( pxCtx->xConnectInfo.pClientIdentifier != NULL ) &&
             ( uxTempSize > 0 ) &&
@@ -886,8 +1954,17 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
 
     if( xStatus == MQTTSuccess )
     {
-        pxCtx->xAgentMessageCtx.xQueue = xQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                                       sizeof( MQTTAgentCommand_t * ) );
+        /* Each use of the static allocation macros has its own storage, so every connection needs its own */
+        if( xControl == pdTRUE )
+        {
+            pxCtx->xAgentMessageCtx.xQueue = xAppQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                                                              sizeof( AgentQueueItem_t ) );
+        }
+        else
+        {
+            pxCtx->xAgentMessageCtx.xQueue = xAppQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                                                              sizeof( AgentQueueItem_t ) );
+        }
 
         if( pxCtx->xAgentMessageCtx.xQueue == NULL )
         {
@@ -896,6 +1973,34 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         }
 
         pxCtx->xAgentMessageCtx.xAgentTaskHandle = xTaskGetCurrentTaskHandle();
+        pxCtx->xAgentMessageCtx.pxNetworkContext = pxNetworkContext;
+        pxCtx->xAgentMessageCtx.xRecordStats = xControl;
+
+        /* The control connection learns the interval for the network, the bulk one follows it */
+        pxCtx->xAgentMessageCtx.pxMqttContext = &( pxCtx->xAgentContext.mqttContext );
+        pxCtx->xAgentMessageCtx.pxKeepAliveWork = &( pxCtx->xKeepAliveWork );
+        vMqttKeepAliveInit( &( pxCtx->xAgentMessageCtx.xKeepAlive ), xControl );
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        vPeriodicWorkStartCallback( &( pxCtx->xKeepAliveWork ), prvKeepAliveCallback,
+                                    &( pxCtx->xAgentMessageCtx ), pdMS_TO_TICKS( MQTT_AGENT_KEEPALIVE_PERIOD_MS( MQTT_KEEPALIVE_MIN_S ) ),
+                                    pdMS_TO_TICKS( MQTT_AGENT_KEEPALIVE_PERIOD_MS( MQTT_KEEPALIVE_MIN_S ) / 4U ) );
+    }
+
+    /* The shared metrics are registered once, the bulk connection starts after the control one */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( xControl == pdTRUE ) )
+    {
+        ( void ) xCustomMetricRegister( "mqtt_queue_depth", prvReadQueueDepth, pxCtx->xAgentMessageCtx.xQueue );
+        vMetricRegister( &xTxBytesMetric );
+        vMetricRegister( &xRxPublishesMetric );
+        vMetricRegister( &xRxPayloadBytesMetric );
+        vMetricRegister( &xRxPayloadSizeMetric );
+        vMetricRegister( &xAgentWakeupsMetric );
+        vMetricRegister( &xRxUnmatchedMetric );
+        vMetricRegister( &xRxCallbackTimeMetric );
     }
 
     if( xStatus == MQTTSuccess )
@@ -905,61 +2010,255 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         pxCtx->xMessageInterface.send = prvAgentMessageSend;
         pxCtx->xMessageInterface.recv = prvAgentMessageReceive;
         pxCtx->xMessageInterface.getCommand = Agent_GetCommand;
-        pxCtx->xMessageInterface.releaseCommand = Agent_ReleaseCommand;
+        pxCtx->xMessageInterface.releaseCommand = prvReleaseCommand;
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        xStatus = prvReadBrokerConfig( pxCtx );
     }
 
     if( xStatus == MQTTSuccess )
     {
-        pxCtx->pcMqttEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT,
-                                                       &( pxCtx->uxMqttEndpointLen ) );
+        xStatus = prvSubscriptionManagerCtxInit( &( pxCtx->xSubMgrCtx ), pxConfig->xConnection );
 
-        if( ( pxCtx->uxMqttEndpointLen == 0 ) ||
-            ( pxCtx->pcMqttEndpoint == NULL ) )
+        if( xStatus != MQTTSuccess )
         {
-            LogError( "Invalid mqtt endpoint read from KVStore." );
-            xStatus = MQTTNoMemory;
+            LogError( "Failed to initialize Subscription Manager Context." );
         }
     }
 
-    if( xStatus == MQTTSuccess )
+    if( ( xStatus == MQTTSuccess ) &&
+        ( ( xMqttDispatchInit() != pdTRUE ) ||
+          ( xMqttPolicyInit() != pdTRUE ) ) )
+    {
+        xStatus = MQTTNoMemory;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTAgentHandle_t xGetMqttAgentHandle( void )
+{
+    return xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_CONTROL );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTAgentHandle_t xGetMqttAgentConnectionHandle( MqttAgentConnection_t xConnection )
+{
+    MQTTAgentTaskCtx_t * pxCtx = NULL;
+
+    if( xConnection < MQTT_AGENT_CONN_MAX )
+    {
+        pxCtx = pxInstances[ xConnection ];
+    }
+
+    if( pxCtx == NULL )
+    {
+        pxCtx = pxInstances[ MQTT_AGENT_CONN_CONTROL ];
+    }
+
+    return ( pxCtx != NULL ) ? &( pxCtx->xAgentContext ) : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTAgentHandle_t xGetMqttAgentHandleOfCallingTask( void )
+{
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    MQTTAgentHandle_t xHandle = NULL;
+
+    for( size_t uxIdx = 0; ( xHandle == NULL ) && ( uxIdx < MQTT_AGENT_CONN_MAX ); uxIdx++ )
     {
-        pxCtx->ulMqttPort = KVStore_getUInt32( CS_CORE_MQTT_PORT, &( xSuccess ) );
+        MQTTAgentTaskCtx_t * pxCtx = pxInstances[ uxIdx ];
 
-        if( ( pxCtx->ulMqttPort == 0 ) ||
-            ( xSuccess == pdFALSE ) )
+        if( ( pxCtx != NULL ) &&
+            ( pxCtx->xAgentMessageCtx.xAgentTaskHandle == xTask ) )
         {
-            LogError( "Invalid mqtt port number read from KVStore." );
-            xStatus = MQTTNoMemory;
+            xHandle = &( pxCtx->xAgentContext );
         }
     }
 
-    if( xStatus == MQTTSuccess )
+    return xHandle;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishBatch( MQTTAgentHandle_t xHandle,
+                                     MQTTPublishInfo_t * pxPublishInfoList,
+                                     const MQTTAgentCommandInfo_t * pxCommandInfoList,
+                                     size_t uxCount,
+                                     size_t * puxQueued )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    size_t uxQueued = 0;
+
+    if( ( xHandle == NULL ) ||
+        ( pxPublishInfoList == NULL ) ||
+        ( pxCommandInfoList == NULL ) ||
+        ( uxCount == 0 ) )
+    {
+        LogError( "Invalid parameter." );
+        xStatus = MQTTBadParameter;
+    }
+    else if( uxCount > MQTT_AGENT_PUBLISH_BATCH_MAX )
+    {
+        LogError( "Batch of %lu publishes exceeds MQTT_AGENT_PUBLISH_BATCH_MAX (%lu).",
+                  uxCount, MQTT_AGENT_PUBLISH_BATCH_MAX );
+        xStatus = MQTTBadParameter;
+    }
+    else
     {
-        xStatus = prvSubscriptionManagerCtxInit( &( pxCtx->xSubMgrCtx ) );
+        MQTTAgentMessageContext_t * pxMsgCtx = xHandle->agentInterface.pMsgCtx;
+
+        configASSERT( pxMsgCtx );
+
+        taskENTER_CRITICAL();
+        {
+            pxMsgCtx->uxBatchDepth++;
+        }
+        taskEXIT_CRITICAL();
+
+        while( ( xStatus == MQTTSuccess ) &&
+               ( uxQueued < uxCount ) )
+        {
+            xStatus = MQTTAgent_Publish( xHandle,
+                                         &( pxPublishInfoList[ uxQueued ] ),
+                                         &( pxCommandInfoList[ uxQueued ] ) );
+
+            if( xStatus == MQTTSuccess )
+            {
+                uxQueued++;
+            }
+        }
+
+        taskENTER_CRITICAL();
+        {
+            pxMsgCtx->uxBatchDepth--;
+        }
+        taskEXIT_CRITICAL();
+
+        /* Wake the agent once for the whole batch */
+        if( pxMsgCtx->xAgentTaskHandle )
+        {
+            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                         MQTT_AGENT_NOTIFY_IDX,
+                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
+                                         eSetBits );
+        }
 
         if( xStatus != MQTTSuccess )
         {
-            LogError( "Failed to initialize Subscription Manager Context." );
+            LogError( "Failed to enqueue publish %lu of %lu: %s.",
+                      uxQueued + 1, uxCount, MQTT_Status_strerror( xStatus ) );
         }
     }
 
+    if( puxQueued != NULL )
+    {
+        *puxQueued = uxQueued;
+    }
+
     return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTAgentHandle_t xGetMqttAgentHandle( void )
+UBaseType_t MqttAgent_GetQueueDepth( MQTTAgentHandle_t xHandle )
 {
-    return xDefaultInstanceHandle;
+    UBaseType_t uxDepth = 0;
+
+    if( ( xHandle != NULL ) &&
+        ( xHandle->agentInterface.pMsgCtx != NULL ) )
+    {
+        uxDepth = uxQueueMessagesWaiting( xHandle->agentInterface.pMsgCtx->xQueue );
+    }
+
+    return uxDepth;
 }
 
 /*-----------------------------------------------------------*/
 
-void vMQTTAgentTask( void * pvParameters )
+size_t MqttAgent_GetTopicStats( MQTTAgentHandle_t xHandle,
+                                MqttAgentTopicStats_t * pxStats,
+                                size_t uxMaxStats )
+{
+    size_t uxCount = 0;
+    SubMgrCtx_t * pxCtx = NULL;
+
+    configASSERT( pxStats != NULL );
+
+    if( xHandle != NULL )
+    {
+        pxCtx = ( SubMgrCtx_t * ) xHandle->pIncomingCallbackContext;
+    }
+
+    if( ( pxCtx != NULL ) &&
+        xLockSubCtx( pxCtx ) )
+    {
+        for( size_t uxSubIdx = 0; ( uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS ) && ( uxCount < uxMaxStats ); uxSubIdx++ )
+        {
+            const MQTTSubscribeInfo_t * pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+            const SubTrafficStats_t * pxTraffic = &( pxCtx->pxTraffic[ uxSubIdx ] );
+
+            if( pxSubInfo->pTopicFilter != NULL )
+            {
+                ( void ) snprintf( pxStats[ uxCount ].pcTopicFilter, MQTT_AGENT_TOPIC_STATS_FILTER_LEN, "%.*s",
+                                   ( int ) pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+                pxStats[ uxCount ].ulCallbacks = pxCtx->pulSubCbCount[ uxSubIdx ];
+                pxStats[ uxCount ].ulMessages = pxTraffic->ulMessages;
+                pxStats[ uxCount ].ullBytes = pxTraffic->ullBytes;
+                pxStats[ uxCount ].ullCallbackCycles = pxTraffic->ullCallbackCycles;
+                pxStats[ uxCount ].ulMaxCallbackCycles = pxTraffic->ulMaxCallbackCycles;
+                uxCount++;
+            }
+        }
+
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_ResetTopicStats( MQTTAgentHandle_t xHandle )
+{
+    SubMgrCtx_t * pxCtx = NULL;
+
+    if( xHandle != NULL )
+    {
+        pxCtx = ( SubMgrCtx_t * ) xHandle->pIncomingCallbackContext;
+    }
+
+    if( ( pxCtx != NULL ) &&
+        xLockSubCtx( pxCtx ) )
+    {
+        ( void ) memset( pxCtx->pxTraffic, 0, sizeof( pxCtx->pxTraffic ) );
+
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_AGENT_BULK_CONNECTION == 1 )
+    static void prvBulkAgentTask( void * pvParameters );
+#endif
+
+/*
+ * Connect, run and reconnect one agent instance. Returns when the instance could not be
+ * initialized or gave up reconnecting.
+ */
+static void prvRunAgentInstance( const MqttAgentInstanceConfig_t * pxConfig )
 {
     MQTTStatus_t xMQTTStatus = MQTTSuccess;
     TlsTransportStatus_t xTlsStatus = TLS_TRANSPORT_CONNECT_FAILURE;
     BaseType_t xExitFlag = pdFALSE;
+    const BaseType_t xControl = ( pxConfig->xConnection == MQTT_AGENT_CONN_CONTROL ) ? pdTRUE : pdFALSE;
 
     MQTTAgentTaskCtx_t * pxCtx = NULL;
     uint8_t * pucNetworkBuffer = NULL;
@@ -970,17 +2269,18 @@ void vMQTTAgentTask( void * pvParameters )
     PkiObject_t xClientCertificate = xPkiObjectFromLabel( TLS_CERT_LABEL );
     PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
 
-    ( void ) pvParameters;
-
-    /* Miscellaneous initialization. */
-    ulGlobalEntryTimeMs = prvGetTimeMs();
+    /* Miscellaneous initialization, once for the time base shared by every instance. */
+    if( xControl == pdTRUE )
+    {
+        ulGlobalEntryTimeMs = prvGetTimeMs();
+    }
 
     /* Memory Allocation */
-    pucNetworkBuffer = ( uint8_t * ) pvPortMalloc( MQTT_AGENT_NETWORK_BUFFER_SIZE );
+    pucNetworkBuffer = ( uint8_t * ) pvPortMalloc( pxConfig->uxNetworkBufferSize );
 
     if( pucNetworkBuffer == NULL )
     {
-        LogError( "Failed to allocate %d bytes for pucNetworkBuffer.", MQTT_AGENT_NETWORK_BUFFER_SIZE );
+        LogError( "Failed to allocate %d bytes for pucNetworkBuffer.", pxConfig->uxNetworkBufferSize );
         xMQTTStatus = MQTTNoMemory;
     }
 
@@ -1009,6 +2309,15 @@ void vMQTTAgentTask( void * pvParameters )
             LogError( "Failed to configure mbedtls transport." );
             xMQTTStatus = MQTTBadParameter;
         }
+        else
+        {
+            ( void ) mbedtls_transport_set_socket_profile( pxNetworkContext, pxConfig->xSocketProfile );
+
+            if( xControl == pdTRUE )
+            {
+                vBootPhaseMark( BOOT_PHASE_TLS_CONFIGURED );
+            }
+        }
     }
 
     if( xMQTTStatus == MQTTSuccess )
@@ -1017,9 +2326,9 @@ void vMQTTAgentTask( void * pvParameters )
 
         if( pxCtx != NULL )
         {
-            xMQTTStatus = prvConfigureAgentTaskCtx( pxCtx, pxNetworkContext,
+            xMQTTStatus = prvConfigureAgentTaskCtx( pxCtx, pxConfig, pxNetworkContext,
                                                     pucNetworkBuffer,
-                                                    MQTT_AGENT_NETWORK_BUFFER_SIZE );
+                                                    pxConfig->uxNetworkBufferSize );
         }
         else
         {
@@ -1028,7 +2337,9 @@ void vMQTTAgentTask( void * pvParameters )
         }
     }
 
-    if( xMQTTStatus == MQTTSuccess )
+    /* The command pool is shared by every instance */
+    if( ( xMQTTStatus == MQTTSuccess ) &&
+        ( xControl == pdTRUE ) )
     {
         Agent_InitializePool();
     }
@@ -1048,11 +2359,6 @@ void vMQTTAgentTask( void * pvParameters )
         {
             LogError( "MQTTAgent_Init failed." );
         }
-        else
-        {
-            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_INIT );
-            xDefaultInstanceHandle = &( pxCtx->xAgentContext );
-        }
     }
 
     if( xMQTTStatus == MQTTSuccess )
@@ -1068,11 +2374,38 @@ void vMQTTAgentTask( void * pvParameters )
         }
     }
 
+    if( xMQTTStatus == MQTTSuccess )
+    {
+        ( void ) KVStore_subscribe( CS_CORE_MQTT_ENDPOINT, prvBrokerConfigChangedCallback, pxCtx );
+        ( void ) KVStore_subscribe( CS_CORE_MQTT_PORT, prvBrokerConfigChangedCallback, pxCtx );
+        ( void ) xSysEventSubscribe( SYS_EVT_BIT( SYS_EVT_IP_DOWN ), prvNetDownCallback, pxCtx );
+    }
+
     if( xMQTTStatus != MQTTSuccess )
     {
+        LogError( "Failed to initialize the %s connection.", pxConfig->pcName );
         xExitFlag = pdTRUE;
     }
 
+    /* The subsystems of a bulk connection which failed to initialize share the control connection */
+    if( ( xMQTTStatus == MQTTSuccess ) ||
+        ( xControl == pdFALSE ) )
+    {
+        prvInstanceInitDone( pxConfig, ( xMQTTStatus == MQTTSuccess ) ? pxCtx : NULL );
+    }
+
+    #if ( MQTT_AGENT_BULK_CONNECTION == 1 )
+        /* Started once the shared state is initialized, one priority below so that control traffic goes first */
+        if( ( xMQTTStatus == MQTTSuccess ) &&
+            ( xControl == pdTRUE ) &&
+            ( xAppTaskCreateCpuBank( prvBulkAgentTask, "MQTTBulk", MQTT_AGENT_BULK_TASK_STACK_SIZE,
+                                     NULL, uxTaskPriorityGet( NULL ) - 1, NULL ) != pdPASS ) )
+        {
+            LogError( "Failed to create the bulk connection task." );
+            prvInstanceInitDone( &( xInstanceConfigs[ MQTT_AGENT_CONN_BULK ] ), NULL );
+        }
+    #endif
+
     /* Outer Reconnect loop */
     while( xExitFlag != pdTRUE )
     {
@@ -1092,14 +2425,31 @@ void vMQTTAgentTask( void * pvParameters )
                xBackoffAlgStatus == BackoffAlgorithmSuccess )
         {
             /* Block until the network interface is connected */
-            ( void ) xEventGroupWaitBits( xSystemEvents,
-                                          EVT_MASK_NET_CONNECTED,
-                                          0x00,
-                                          pdTRUE,
-                                          portMAX_DELAY );
+            if( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) == 0 )
+            {
+                ( void ) xEventGroupWaitBits( xSystemEvents,
+                                              EVT_MASK_NET_CONNECTED,
+                                              0x00,
+                                              pdTRUE,
+                                              portMAX_DELAY );
+
+                /* The link has just come back (e.g. after roaming), so retry promptly */
+                BackoffAlgorithm_InitializeParams( &xReconnectParams,
+                                                   RETRY_BACKOFF_BASE,
+                                                   RETRY_MAX_BACKOFF_DELAY,
+                                                   BACKOFF_ALGORITHM_RETRY_FOREVER );
+            }
+
+            if( pxCtx->xBrokerConfigChanged == pdTRUE )
+            {
+                pxCtx->xBrokerConfigChanged = pdFALSE;
 
-            LogInfo( "Attempting a TLS connection to %s:%d.",
-                     pxCtx->pcMqttEndpoint, pxCtx->ulMqttPort );
+                /* A new broker has no session, so existing subscriptions are sent again after connecting */
+                ( void ) prvReadBrokerConfig( pxCtx );
+            }
+
+            LogInfo( "Attempting a TLS connection to %s:%d for the %s connection.",
+                     pxCtx->pcMqttEndpoint, pxCtx->ulMqttPort, pxConfig->pcName );
 
             xTlsStatus = mbedtls_transport_connect( pxNetworkContext,
                                                     pxCtx->pcMqttEndpoint,
@@ -1118,7 +2468,7 @@ void vMQTTAgentTask( void * pvParameters )
                     LogWarn( "Connecting to the mqtt broker failed. "
                              "Retrying connection in %lu ms.",
                              RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
-                    vTaskDelay( pdMS_TO_TICKS( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff ) );
+                    prvReconnectDelay( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
                 }
                 else
                 {
@@ -1132,6 +2482,13 @@ void vMQTTAgentTask( void * pvParameters )
         {
             bool xSessionPresent = false;
 
+            if( xControl == pdTRUE )
+            {
+                vBootPhaseMark( BOOT_PHASE_TLS_CONNECTED );
+
+                vMqttStreamReset( mbedtls_transport_recv, prvTransportSend );
+            }
+
             configASSERT_CONTINUE( MUTEX_IS_OWNED( pxCtx->xSubMgrCtx.xMutex ) );
 
             ( void ) MQTTAgent_CancelAll( &( pxCtx->xAgentContext ) );
@@ -1203,7 +2560,20 @@ void vMQTTAgentTask( void * pvParameters )
 
         if( xMQTTStatus == MQTTSuccess )
         {
-            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+            /* A disconnect requested for the previous connection does not apply to this one */
+            ( void ) ulTaskNotifyValueClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX, MQTT_AGENT_NOTIFY_FLAG_DISCONNECT );
+            pxCtx->xConnected = pdTRUE;
+
+            /* The system events and the connected event bit follow the control connection */
+            if( xControl == pdTRUE )
+            {
+                vSysEventPublish( SYS_EVT_MQTT_CONNECTED );
+                vBootPhaseMark( BOOT_PHASE_MQTT_CONNECTED );
+            }
+            else
+            {
+                LogInfo( "The %s connection is up.", pxConfig->pcName );
+            }
 
             /* Reset backoff timer */
             BackoffAlgorithm_InitializeParams( &xReconnectParams,
@@ -1211,13 +2581,35 @@ void vMQTTAgentTask( void * pvParameters )
                                                RETRY_MAX_BACKOFF_DELAY,
                                                BACKOFF_ALGORITHM_RETRY_FOREVER );
 
+            pxCtx->xAgentMessageCtx.xPingPending = pdFALSE;
+            pxCtx->xAgentMessageCtx.ulRxEventsAcked = pxCtx->xAgentMessageCtx.ulRxEvents;
+            prvKeepAliveApply( &( pxCtx->xAgentMessageCtx ),
+                               usMqttKeepAliveConnected( &( pxCtx->xAgentMessageCtx.xKeepAlive ) ) );
+
             /* MQTTAgent_CommandLoop() is effectively the agent implementation.  It
              * will manage the MQTT protocol until such time that an error occurs,
              * which could be a disconnect.  If an error occurs the MQTT context on
              * which the error happened is returned so there can be an attempt to
              * clean up and reconnect however the application writer prefers. */
+            pxCtx->xAgentMessageCtx.xCoalesceWrites = pdTRUE;
+
             xMQTTStatus = MQTTAgent_CommandLoop( &( pxCtx->xAgentContext ) );
 
+            pxCtx->xAgentMessageCtx.xCoalesceWrites = pdFALSE;
+            pxCtx->xAgentMessageCtx.xCoalesceWindowOpen = pdFALSE;
+            pxCtx->xConnected = pdFALSE;
+
+            /* Lost during a ping with the network still up: the NAT or access point dropped the mapping */
+            if( ( ( xMQTTStatus == MQTTKeepAliveTimeout ) ||
+                  ( xMQTTStatus == MQTTRecvFailed ) ||
+                  ( xMQTTStatus == MQTTSendFailed ) ) &&
+                ( ( pxCtx->xAgentMessageCtx.xPingPending == pdTRUE ) ||
+                  ( pxCtx->xAgentContext.mqttContext.waitingForPingResp == true ) ) &&
+                ( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) != 0 ) )
+            {
+                vMqttKeepAliveLost( &( pxCtx->xAgentMessageCtx.xKeepAlive ) );
+            }
+
             LogDebug( "MQTTAgent_CommandLoop returned with status: %s.",
                       MQTT_Status_strerror( xMQTTStatus ) );
         }
@@ -1226,7 +2618,13 @@ void vMQTTAgentTask( void * pvParameters )
 
         mbedtls_transport_disconnect( pxNetworkContext );
 
-        ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+        if( xControl == pdTRUE )
+        {
+            /* Tell the handler of a publish cut short by the disconnect */
+            vMqttStreamReset( mbedtls_transport_recv, prvTransportSend );
+
+            vSysEventPublish( SYS_EVT_MQTT_DISCONNECTED );
+        }
 
         /* Wait for any subscription related calls to complete */
         if( !MUTEX_IS_OWNED( pxCtx->xSubMgrCtx.xMutex ) )
@@ -1251,7 +2649,7 @@ void vMQTTAgentTask( void * pvParameters )
                 LogWarn( "Disconnected from the MQTT Broker. Retrying in %lu ms.",
                          RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
 
-                vTaskDelay( pdMS_TO_TICKS( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff ) );
+                prvReconnectDelay( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
             }
             else
             {
@@ -1263,6 +2661,15 @@ void vMQTTAgentTask( void * pvParameters )
 
     if( pxCtx != NULL )
     {
+        if( pxInstances[ pxConfig->xConnection ] == pxCtx )
+        {
+            pxInstances[ pxConfig->xConnection ] = NULL;
+        }
+
+        KVStore_unsubscribe( CS_CORE_MQTT_ENDPOINT, prvBrokerConfigChangedCallback, pxCtx );
+        KVStore_unsubscribe( CS_CORE_MQTT_PORT, prvBrokerConfigChangedCallback, pxCtx );
+        vSysEventUnsubscribe( prvNetDownCallback, pxCtx );
+
         prvFreeAgentTaskCtx( pxCtx );
         pxCtx = NULL;
     }
@@ -1274,9 +2681,35 @@ void vMQTTAgentTask( void * pvParameters )
         pxNetworkContext = NULL;
     }
 
-    ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_INIT | EVT_MASK_MQTT_CONNECTED );
+    if( xControl == pdTRUE )
+    {
+        vSysEventPublish( SYS_EVT_MQTT_DISCONNECTED );
+        ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_INIT );
+    }
+
+    LogError( "Terminating the %s connection.", pxConfig->pcName );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_AGENT_BULK_CONNECTION == 1 )
+    static void prvBulkAgentTask( void * pvParameters )
+    {
+        ( void ) pvParameters;
+
+        prvRunAgentInstance( &( xInstanceConfigs[ MQTT_AGENT_CONN_BULK ] ) );
+
+        vTaskDelete( NULL );
+    }
+#endif /* MQTT_AGENT_BULK_CONNECTION == 1 */
+
+/*-----------------------------------------------------------*/
+
+void vMQTTAgentTask( void * pvParameters )
+{
+    ( void ) pvParameters;
 
-    LogError( "Terminating MqttAgentTask." );
+    prvRunAgentInstance( &( xInstanceConfigs[ MQTT_AGENT_CONN_CONTROL ] ) );
 
     vTaskDelete( NULL );
 }
@@ -1302,99 +2735,444 @@ static inline MQTTQoS_t prvGetNewQoS( MQTTQoS_t xCurrentQoS,
 
     if( xCurrentQoS == xRequestedQoS )
     {
-        xNewQoS = xCurrentQoS;
+        xNewQoS = xCurrentQoS;
+    }
+    /* Otherwise, upgrade to QoS1 */
+    else
+    {
+        xNewQoS = MQTTQoS1;
+    }
+
+    return xNewQoS;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvValidateQoS( MQTTQoS_t xQoS )
+{
+    return( xQoS == MQTTQoS0 || xQoS == MQTTQoS1 || xQoS == MQTTQoS2 );
+}
+
+
+/*-----------------------------------------------------------*/
+
+/* Find or allocate the subscription and callback entries for pxSubscription. Must be called with the mutex held. */
+static MQTTStatus_t prvSubMgrRegister( SubMgrCtx_t * pxCtx,
+                                       const MqttAgentSubscription_t * pxSubscription,
+                                       size_t uxTopicFilterLen,
+                                       size_t * puxSubIdx )
+{
+    MQTTStatus_t xStatus = MQTTNoMemory;
+    MQTTQoS_t xRequestedQoS = pxSubscription->xRequestedQoS;
+    size_t uxTargetSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
+    size_t uxTargetCbIdx = MQTT_AGENT_MAX_CALLBACKS;
+
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    /* If no slot is found, return MQTTNoMemory */
+    for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+    {
+        MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+
+        if( pxSubInfo->pTopicFilter == NULL )
+        {
+            if( uxTargetSubIdx == MQTT_AGENT_MAX_SUBSCRIPTIONS )
+            {
+                /* Check that the current context is indeed empty */
+                configASSERT( pxSubInfo->topicFilterLength == 0 );
+
+                uxTargetSubIdx = uxSubIdx;
+                xStatus = MQTTSuccess;
+
+                /* Reset SubAckStatus to trigger a subscribe op */
+                pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
+            }
+        }
+        else if( ( pxSubInfo->topicFilterLength == uxTopicFilterLen ) &&
+                 ( strncmp( pxSubInfo->pTopicFilter, pxSubscription->pcTopicFilter, uxTopicFilterLen ) == 0 ) )
+        {
+            xRequestedQoS = prvGetNewQoS( pxSubInfo->qos, xRequestedQoS );
+            xStatus = MQTTSuccess;
+            uxTargetSubIdx = uxSubIdx;
+
+            /* If QoS differs, trigger a subscribe op */
+            if( pxSubInfo->qos != xRequestedQoS )
+            {
+                pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
+            }
+
+            break;
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+
+    /* Add Callback to list */
+    if( xStatus == MQTTSuccess )
+    {
+        /* If no slot is found, return MQTTNoMemory */
+        xStatus = MQTTNoMemory;
+
+        /* Find matching or empty callback context */
+        for( size_t uxCbIdx = 0U; uxCbIdx < MQTT_AGENT_MAX_CALLBACKS; uxCbIdx++ )
+        {
+            if( ( uxTargetCbIdx == MQTT_AGENT_MAX_CALLBACKS ) &&
+                ( pxCtx->pxCallbacks[ uxCbIdx ].pxSubInfo == NULL ) )
+            {
+                uxTargetCbIdx = uxCbIdx;
+                xStatus = MQTTSuccess;
+            }
+            else if( prvMatchCbCtx( &( pxCtx->pxCallbacks[ uxCbIdx ] ),
+                                    &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
+                                    pxSubscription->pxCallback,
+                                    pxSubscription->pvCallbackCtx ) )
+            {
+                uxTargetCbIdx = uxCbIdx;
+                xStatus = MQTTSuccess;
+                break;
+            }
+        }
+    }
+
+    /*
+     * Populate the subscription entry (by copying topic filter to heap)
+     */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+    {
+        if( pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter == NULL )
+        {
+            char * pcDupTopicFilter = pvPortMalloc( uxTopicFilterLen + 1 );
+
+            if( pcDupTopicFilter == NULL )
+            {
+                xStatus = MQTTNoMemory;
+            }
+            else
+            {
+                ( void ) strncpy( pcDupTopicFilter, pxSubscription->pcTopicFilter, uxTopicFilterLen + 1 );
+
+                /* Ensure null terminated */
+                pcDupTopicFilter[ uxTopicFilterLen ] = '\00';
+
+                pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter = pcDupTopicFilter;
+                pxCtx->pxSubscriptions[ uxTargetSubIdx ].topicFilterLength = ( uint16_t ) uxTopicFilterLen;
+                ( void ) memset( &( pxCtx->pxTraffic[ uxTargetSubIdx ] ), 0, sizeof( SubTrafficStats_t ) );
+
+                pxCtx->uxSubscriptionCount++;
+            }
+        }
+
+        if( xStatus == MQTTSuccess )
+        {
+            pxCtx->pxSubscriptions[ uxTargetSubIdx ].qos = xRequestedQoS;
+        }
+    }
+
+    /*
+     * Populate the callback entry
+     */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo == NULL ) )
+    {
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo = &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] );
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].xTaskHandle = xTaskGetCurrentTaskHandle();
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pxIncomingPublishCallback = pxSubscription->pxCallback;
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pvIncomingPublishCallbackContext = pxSubscription->pvCallbackCtx;
+
+        /* Increment subscription reference count. */
+        pxCtx->pulSubCbCount[ uxTargetSubIdx ]++;
+
+        pxCtx->uxCallbackCount++;
+
+        LogInfo( "Callback registered with filter=\"%.*s\".", uxTopicFilterLen, pxSubscription->pcTopicFilter );
+    }
+
+    *puxSubIdx = uxTargetSubIdx;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscribeRequestCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                         MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    SubscribeRequest_t * pxRequest = ( SubscribeRequest_t * ) pxCommandContext;
+    SubMgrCtx_t * pxCtx = NULL;
+    BaseType_t xLocked = pdFALSE;
+
+    configASSERT( pxRequest );
+    configASSERT( pxReturnInfo );
+
+    pxCtx = &( pxRequest->pxTaskCtx->xSubMgrCtx );
+
+    /* The agent task already holds the mutex while (re)connecting */
+    if( !MUTEX_IS_OWNED( pxCtx->xMutex ) )
+    {
+        xLocked = xLockSubCtx( pxCtx );
+    }
+
+    for( size_t uxPktIdx = 0; uxPktIdx < pxRequest->uxPacketCount; uxPktIdx++ )
+    {
+        const MQTTSubscribeInfo_t * pxSentInfo = &( pxRequest->pxSubInfo[ uxPktIdx ] );
+        MQTTSubscribeInfo_t * pxSubInfo = &( pxCtx->pxSubscriptions[ pxRequest->pusPacketSubIdx[ uxPktIdx ] ] );
+        MQTTSubAckStatus_t xSubAck = MQTTSubAckFailure;
+
+        if( ( pxReturnInfo->returnCode == MQTTSuccess ) &&
+            ( pxReturnInfo->pSubackCodes != NULL ) )
+        {
+            xSubAck = pxReturnInfo->pSubackCodes[ uxPktIdx ];
+        }
+
+        pxRequest->pxPacketSubAck[ uxPktIdx ] = xSubAck;
+
+        /* Skip entries which were removed or reused while the request was outstanding */
+        if( ( pxSubInfo->pTopicFilter == pxSentInfo->pTopicFilter ) &&
+            ( pxSubInfo->topicFilterLength == pxSentInfo->topicFilterLength ) )
+        {
+            pxCtx->pxSubAckStatus[ pxRequest->pusPacketSubIdx[ uxPktIdx ] ] = xSubAck;
+        }
+    }
+
+    if( xLocked )
+    {
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+
+    for( size_t uxIdx = 0; uxIdx < pxRequest->uxCount; uxIdx++ )
+    {
+        if( pxRequest->pucPacketIdx[ uxIdx ] != SUB_REQUEST_NOT_SENT )
+        {
+            pxRequest->pxSubAckStatus[ uxIdx ] = pxRequest->pxPacketSubAck[ pxRequest->pucPacketIdx[ uxIdx ] ];
+        }
+    }
+
+    if( pxRequest->pxCompleteCallback != NULL )
+    {
+        pxRequest->pxCompleteCallback( pxRequest->pvCompleteCtx,
+                                       pxReturnInfo->returnCode,
+                                       pxRequest->pxSubAckStatus,
+                                       pxRequest->uxCount );
+    }
+
+    vPortFree( pxRequest );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_SubscribeAsync( MQTTAgentHandle_t xHandle,
+                                       const MqttAgentSubscription_t * pxSubscriptions,
+                                       size_t uxCount,
+                                       SubscribeCompleteCallback_t pxCompleteCallback,
+                                       void * pvCompleteCtx )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
+    SubscribeRequest_t * pxRequest = NULL;
+    size_t puxTopicFilterLen[ MQTT_AGENT_SUBSCRIBE_BATCH_MAX ] = { 0 };
+
+    if( ( xHandle == NULL ) ||
+        ( pxSubscriptions == NULL ) ||
+        ( uxCount == 0 ) ||
+        ( uxCount > MQTT_AGENT_SUBSCRIBE_BATCH_MAX ) )
+    {
+        xStatus = MQTTBadParameter;
+    }
+
+    for( size_t uxIdx = 0; ( xStatus == MQTTSuccess ) && ( uxIdx < uxCount ); uxIdx++ )
+    {
+        if( ( pxSubscriptions[ uxIdx ].pcTopicFilter == NULL ) ||
+            ( pxSubscriptions[ uxIdx ].pxCallback == NULL ) ||
+            !prvValidateQoS( pxSubscriptions[ uxIdx ].xRequestedQoS ) )
+        {
+            xStatus = MQTTBadParameter;
+        }
+        else
+        {
+            puxTopicFilterLen[ uxIdx ] = strnlen( pxSubscriptions[ uxIdx ].pcTopicFilter, UINT16_MAX );
+
+            if( ( puxTopicFilterLen[ uxIdx ] == 0 ) || ( puxTopicFilterLen[ uxIdx ] >= UINT16_MAX ) )
+            {
+                xStatus = MQTTBadParameter;
+            }
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        pxRequest = ( SubscribeRequest_t * ) pvPortMalloc( sizeof( SubscribeRequest_t ) );
+
+        if( pxRequest == NULL )
+        {
+            LogError( "Failed to allocate %d bytes for a subscribe request.", sizeof( SubscribeRequest_t ) );
+            xStatus = MQTTNoMemory;
+        }
+        else
+        {
+            ( void ) memset( pxRequest, 0, sizeof( SubscribeRequest_t ) );
+            pxRequest->pxTaskCtx = pxTaskCtx;
+            pxRequest->pxCompleteCallback = pxCompleteCallback;
+            pxRequest->pvCompleteCtx = pvCompleteCtx;
+            pxRequest->uxCount = uxCount;
+        }
+    }
+
+    /* Acquire mutex */
+    if( xStatus == MQTTSuccess )
+    {
+        SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
+
+        if( xLockSubCtx( pxCtx ) )
+        {
+            for( size_t uxIdx = 0; uxIdx < uxCount; uxIdx++ )
+            {
+                size_t uxSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
+                MQTTStatus_t xEntryStatus = prvSubMgrRegister( pxCtx, &( pxSubscriptions[ uxIdx ] ),
+                                                               puxTopicFilterLen[ uxIdx ], &uxSubIdx );
+
+                pxRequest->pucPacketIdx[ uxIdx ] = SUB_REQUEST_NOT_SENT;
+
+                if( xEntryStatus != MQTTSuccess )
+                {
+                    LogError( "Failed to register callback for filter=\"%.*s\", xStatus=%s.",
+                              puxTopicFilterLen[ uxIdx ], pxSubscriptions[ uxIdx ].pcTopicFilter,
+                              MQTT_Status_strerror( xEntryStatus ) );
+                    pxRequest->pxSubAckStatus[ uxIdx ] = MQTTSubAckFailure;
+                }
+                else if( pxCtx->pxSubAckStatus[ uxSubIdx ] == MQTTSubAckFailure )
+                {
+                    size_t uxPktIdx = 0;
+
+                    /* Several entries of one request may share a topic filter */
+                    while( ( uxPktIdx < pxRequest->uxPacketCount ) &&
+                           ( pxRequest->pusPacketSubIdx[ uxPktIdx ] != uxSubIdx ) )
+                    {
+                        uxPktIdx++;
+                    }
+
+                    if( uxPktIdx == pxRequest->uxPacketCount )
+                    {
+                        pxRequest->pusPacketSubIdx[ uxPktIdx ] = ( uint16_t ) uxSubIdx;
+                        pxRequest->uxPacketCount++;
+                    }
+
+                    /* Take the QoS upgraded by a later entry into account */
+                    pxRequest->pxSubInfo[ uxPktIdx ] = pxCtx->pxSubscriptions[ uxSubIdx ];
+                    pxRequest->pucPacketIdx[ uxIdx ] = ( uint8_t ) uxPktIdx;
+                }
+                else
+                {
+                    /* Already subscribed with a sufficient QoS */
+                    pxRequest->pxSubAckStatus[ uxIdx ] = pxCtx->pxSubAckStatus[ uxSubIdx ];
+                }
+            }
+
+            prvSubIndexRebuild( pxCtx );
+
+            ( void ) xUnlockSubCtx( pxCtx );
+        }
+        else
+        {
+            xStatus = MQTTIllegalState;
+            LogError( "Failed to acquire MQTTAgent mutex." );
+            vPortFree( pxRequest );
+            pxRequest = NULL;
+        }
+    }
+
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxRequest->uxPacketCount > 0 ) )
+    {
+        MQTTAgentCommandInfo_t xCommandInfo =
+        {
+            .blockTimeMs                 = SUBSCRIBE_ENQUEUE_TIMEOUT_MS,
+            .cmdCompleteCallback         = prvSubscribeRequestCallback,
+            .pCmdCompleteCallbackContext = ( void * ) pxRequest,
+        };
+
+        pxRequest->xSubscribeArgs.pSubscribeInfo = pxRequest->pxSubInfo;
+        pxRequest->xSubscribeArgs.numSubscriptions = pxRequest->uxPacketCount;
+
+        LogInfo( "MQTT Subscribe, %d filter(s), first filter=\"%.*s\"", pxRequest->uxPacketCount,
+                 pxRequest->pxSubInfo[ 0 ].topicFilterLength, pxRequest->pxSubInfo[ 0 ].pTopicFilter );
+
+        xStatus = MQTTAgent_Subscribe( &( pxTaskCtx->xAgentContext ),
+                                       &( pxRequest->xSubscribeArgs ),
+                                       &xCommandInfo );
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
+                      MQTT_Status_strerror( xStatus ) );
+            vPortFree( pxRequest );
+        }
+    }
+    else if( xStatus == MQTTSuccess )
+    {
+        /* Nothing needs to be sent to the broker */
+        if( pxCompleteCallback != NULL )
+        {
+            pxCompleteCallback( pvCompleteCtx, MQTTSuccess, pxRequest->pxSubAckStatus, uxCount );
+        }
+
+        vPortFree( pxRequest );
     }
-    /* Otherwise, upgrade to QoS1 */
     else
     {
-        xNewQoS = MQTTQoS1;
+        /* Empty */
     }
 
-    return xNewQoS;
-}
-
-/*-----------------------------------------------------------*/
-
-static inline bool prvValidateQoS( MQTTQoS_t xQoS )
-{
-    return( xQoS == MQTTQoS0 || xQoS == MQTTQoS1 || xQoS == MQTTQoS2 );
+    return xStatus;
 }
 
-
 /*-----------------------------------------------------------*/
 
-static void prvSubscribeRqCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                    MQTTAgentReturnInfo_t * pxReturnInfo )
+static void prvSyncSubscribeComplete( void * pvCompleteCtx,
+                                      MQTTStatus_t xStatus,
+                                      const MQTTSubAckStatus_t * pxSubAckStatus,
+                                      size_t uxCount )
 {
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
+    SyncRequestCtx_t * pxSyncCtx = ( SyncRequestCtx_t * ) pvCompleteCtx;
 
-    configASSERT( pxReturnInfo );
+    configASSERT( pxSyncCtx );
 
-    if( xTaskHandle != NULL )
+    if( pxSyncCtx->pxSubAckStatus != NULL )
     {
-        uint32_t ulNotifyValue = ( pxReturnInfo->returnCode & 0xFFFFFF );
+        ( void ) memcpy( pxSyncCtx->pxSubAckStatus, pxSubAckStatus, uxCount * sizeof( MQTTSubAckStatus_t ) );
+    }
 
-        if( pxReturnInfo->pSubackCodes )
-        {
-            ulNotifyValue += ( pxReturnInfo->pSubackCodes[ 0 ] << 24 );
-        }
+    pxSyncCtx->xStatus = xStatus;
 
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_AGENT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
-    }
+    ( void ) xTaskNotifyGiveIndexed( pxSyncCtx->xTaskHandle, MQTT_AGENT_NOTIFY_IDX );
 }
 
 /*-----------------------------------------------------------*/
 
-static inline MQTTStatus_t prvSendSubRequest( MQTTAgentContext_t * pxAgentCtx,
-                                              MQTTSubscribeInfo_t * pxSubInfo,
-                                              MQTTSubAckStatus_t * pxSubAckStatus,
-                                              TickType_t xTimeout )
+MQTTStatus_t MqttAgent_SubscribeMultiSync( MQTTAgentHandle_t xHandle,
+                                           const MqttAgentSubscription_t * pxSubscriptions,
+                                           size_t uxCount,
+                                           MQTTSubAckStatus_t * pxSubAckStatus )
 {
     MQTTStatus_t xStatus;
-
-    MQTTAgentSubscribeArgs_t xSubscribeArgs =
+    SyncRequestCtx_t xSyncCtx =
     {
-        .numSubscriptions = 1,
-        .pSubscribeInfo   = pxSubInfo,
+        .xTaskHandle    = xTaskGetCurrentTaskHandle(),
+        .xStatus        = MQTTSuccess,
+        .pxSubAckStatus = pxSubAckStatus,
     };
 
-    MQTTAgentCommandInfo_t xCommandInfo =
-    {
-        .blockTimeMs                 = xTimeout,
-        .cmdCompleteCallback         = prvSubscribeRqCallback,
-        .pCmdCompleteCallbackContext = ( void * ) ( xTaskGetCurrentTaskHandle() ),
-    };
-
-    configASSERT( pxAgentCtx );
-    configASSERT( pxSubInfo );
-    configASSERT( pxSubAckStatus );
-
     ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
 
-    xStatus = MQTTAgent_Subscribe( pxAgentCtx, &xSubscribeArgs, &xCommandInfo );
-
-    LogInfo( "MQTT Subscribe, filter=\"%.*s\"", pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+    xStatus = MqttAgent_SubscribeAsync( xHandle, pxSubscriptions, uxCount,
+                                        prvSyncSubscribeComplete, &xSyncCtx );
 
     if( xStatus == MQTTSuccess )
     {
-        uint32_t ulNotifyValue = 0;
-
-        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
-                                    0x0,
-                                    0xFFFFFFFF,
-                                    &ulNotifyValue,
-                                    xTimeout ) )
-        {
-            *pxSubAckStatus = ( ulNotifyValue >> 24 );
-            xStatus = ( ulNotifyValue & 0x00FFFFFF );
-        }
-        else
-        {
-            xStatus = MQTTKeepAliveTimeout;
-        }
+        ( void ) ulTaskNotifyTakeIndexed( MQTT_AGENT_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+        xStatus = xSyncCtx.xStatus;
     }
 
     return xStatus;
@@ -1408,259 +3186,162 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
                                       IncomingPubCallback_t pxCallback,
                                       void * pvCallbackCtx )
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
-    size_t xTopicFilterLen = 0;
-    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
-    SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
-
-    if( ( xHandle == NULL ) ||
-        ( pcTopicFilter == NULL ) ||
-        ( pxCallback == NULL ) ||
-        !prvValidateQoS( xRequestedQoS ) )
-    {
-        xStatus = MQTTBadParameter;
-    }
-    else /* pcTopicFilter != NULL */
+    MqttAgentSubscription_t xSubscription =
     {
-        xTopicFilterLen = strnlen( pcTopicFilter, UINT16_MAX );
-    }
+        .pcTopicFilter = pcTopicFilter,
+        .xRequestedQoS = xRequestedQoS,
+        .pxCallback    = pxCallback,
+        .pvCallbackCtx = pvCallbackCtx,
+    };
 
-    if( ( xTopicFilterLen == 0 ) || ( xTopicFilterLen >= UINT16_MAX ) )
+    return MqttAgent_SubscribeMultiSync( xHandle, &xSubscription, 1, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Remove the callback entry of an unsubscribe request and free the subscription once unused.
+ * Must be called with the mutex held. */
+static MQTTStatus_t prvSubMgrRemoveCallback( SubMgrCtx_t * pxCtx,
+                                             const UnsubscribeRequest_t * pxRequest )
+{
+    MQTTStatus_t xStatus = MQTTNoDataAvailable;
+    MQTTSubscribeInfo_t * pxSubInfo = NULL;
+    size_t uxSubInfoIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
+    const size_t uxTopicFilterLen = pxRequest->xSubInfo.topicFilterLength;
+
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    /* Find matching subscription context again */
+    for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
     {
-        xStatus = MQTTBadParameter;
+        if( ( pxCtx->pulSubCbCount[ uxIdx ] == 0 ) &&
+            ( pxCtx->pxSubscriptions[ uxIdx ].pTopicFilter == pxRequest->xSubInfo.pTopicFilter ) &&
+            ( uxTopicFilterLen == pxCtx->pxSubscriptions[ uxIdx ].topicFilterLength ) )
+        {
+            uxSubInfoIdx = uxIdx;
+            pxSubInfo = &( pxCtx->pxSubscriptions[ uxIdx ] );
+            xStatus = MQTTSuccess;
+            break;
+        }
     }
 
-    /* Acquire mutex */
-    if( ( xStatus == MQTTSuccess ) &&
-        xLockSubCtx( pxCtx ) )
+    if( xStatus == MQTTSuccess )
     {
-        size_t uxTargetSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
-        size_t uxTargetCbIdx = MQTT_AGENT_MAX_CALLBACKS;
-
-        /* If no slot is found, return MQTTNoMemory */
-        xStatus = MQTTNoMemory;
+        xStatus = MQTTNoDataAvailable;
 
-        for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+        /* Find matching callback context, and remove it. */
+        for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
         {
-            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+            SubCallbackElement_t * pxCbCtx = &( pxCtx->pxCallbacks[ uxIdx ] );
 
-            if( ( pxCtx->pxSubscriptions[ uxSubIdx ].pTopicFilter == NULL ) &&
-                ( uxTargetSubIdx == MQTT_AGENT_MAX_SUBSCRIPTIONS ) )
+            if( prvMatchCbCtx( pxCbCtx, pxSubInfo, pxRequest->pxCallback, pxRequest->pvCallbackCtx ) )
             {
-                /* Check that the current context is indeed empty */
-                configASSERT( pxCtx->pxSubscriptions[ uxSubIdx ].topicFilterLength == 0 );
-
-                uxTargetSubIdx = uxSubIdx;
                 xStatus = MQTTSuccess;
+                pxCbCtx->pvIncomingPublishCallbackContext = NULL;
+                pxCbCtx->pxIncomingPublishCallback = NULL;
+                pxCbCtx->pxSubInfo = NULL;
+                pxCbCtx->xTaskHandle = NULL;
 
-                /* Reset SubAckStatus to trigger a subscribe op */
-                pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
-            }
-            else if( strncmp( pxSubInfo->pTopicFilter, pcTopicFilter, pxSubInfo->topicFilterLength ) == 0 )
-            {
-                xRequestedQoS = prvGetNewQoS( pxSubInfo->qos, xRequestedQoS );
-                xStatus = MQTTSuccess;
-                uxTargetSubIdx = uxSubIdx;
+                configASSERT( pxCtx->uxCallbackCount > 0 );
 
-                /* If QoS differs, trigger a subscribe op */
-                if( pxSubInfo->qos != xRequestedQoS )
-                {
-                    pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
-                }
+                pxCtx->uxCallbackCount--;
 
+                LogInfo( "Callback de-registered, filter=\"%.*s\".", uxTopicFilterLen, pxSubInfo->pTopicFilter );
                 break;
             }
-            else
-            {
-                /* Empty */
-            }
-        }
-
-        /* Add Callback to list */
-        if( xStatus == MQTTSuccess )
-        {
-            /* If no slot is found, return MQTTNoMemory */
-            xStatus = MQTTNoMemory;
-
-            /* Find matching or empty callback context */
-            for( size_t uxCbIdx = 0U; uxCbIdx < MQTT_AGENT_MAX_CALLBACKS; uxCbIdx++ )
-            {
-                if( ( uxTargetCbIdx == MQTT_AGENT_MAX_CALLBACKS ) &&
-                    ( pxCtx->pxCallbacks[ uxCbIdx ].pxSubInfo == NULL ) )
-                {
-                    uxTargetCbIdx = uxCbIdx;
-                    xStatus = MQTTSuccess;
-                }
-                else if( prvMatchCbCtx( &( pxCtx->pxCallbacks[ uxCbIdx ] ),
-                                        &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
-                                        pxCallback,
-                                        pvCallbackCtx ) )
-                {
-                    uxTargetCbIdx = uxCbIdx;
-                    xStatus = MQTTSuccess;
-                    break;
-                }
-            }
         }
 
-        /*
-         * Populate the subscription entry (by copying topic filter to heap)
-         */
         if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+            ( pxRequest->ulCallbackCount == 1 ) &&
+            ( pxCtx->pulSubCbCount[ uxSubInfoIdx ] == 0 ) )
         {
-            if( pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter == NULL )
-            {
-                char * pcDupTopicFilter = pvPortMalloc( xTopicFilterLen + 1 );
-
-                if( pcDupTopicFilter == NULL )
-                {
-                    xStatus = MQTTNoMemory;
-                }
-                else
-                {
-                    ( void ) strncpy( pcDupTopicFilter, pcTopicFilter, xTopicFilterLen + 1 );
+            /* Free heap allocated topic filter */
+            vPortFree( ( void * ) pxSubInfo->pTopicFilter );
 
-                    /* Ensure null terminated */
-                    pcDupTopicFilter[ xTopicFilterLen ] = '\00';
+            pxSubInfo->pTopicFilter = NULL;
+            pxSubInfo->topicFilterLength = 0;
+            pxSubInfo->qos = 0;
+            pxCtx->pxSubAckStatus[ uxSubInfoIdx ] = MQTTSubAckFailure;
 
-                    pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter = pcDupTopicFilter;
-                    pxCtx->pxSubscriptions[ uxTargetSubIdx ].topicFilterLength = ( uint16_t ) xTopicFilterLen;
+            configASSERT( pxCtx->uxSubscriptionCount > 0 );
 
-                    pxCtx->uxSubscriptionCount++;
-                }
+            if( pxCtx->uxSubscriptionCount > 0 )
+            {
+                pxCtx->uxSubscriptionCount--;
             }
-
-            pxCtx->pxSubscriptions[ uxTargetSubIdx ].qos = xRequestedQoS;
-        }
-
-        /*
-         * Populate the callback entry
-         */
-        if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo == NULL ) )
-        {
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo = &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] );
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].xTaskHandle = xTaskGetCurrentTaskHandle();
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pxIncomingPublishCallback = pxCallback;
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pvIncomingPublishCallbackContext = pvCallbackCtx;
-
-            /* Increment subscription reference count. */
-            pxCtx->pulSubCbCount[ uxTargetSubIdx ]++;
-
-            pxCtx->uxCallbackCount++;
-
-            LogInfo( "Callback registered with filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
-        }
-
-        ( void ) xUnlockSubCtx( pxCtx );
-
-        if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
-        {
-            xStatus = prvSendSubRequest( &( pxTaskCtx->xAgentContext ),
-                                         &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
-                                         &( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] ),
-                                         portMAX_DELAY );
         }
     }
-    else
-    {
-        xStatus = MQTTIllegalState;
-        LogError( "Failed to acquire MQTTAgent mutex." );
-    }
+
+    prvSubIndexRebuild( pxCtx );
 
     return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvAgentRequestCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                     MQTTAgentReturnInfo_t * pxReturnInfo )
+/* Finish an unsubscribe request once the UNSUBACK (if any) has been received */
+static MQTTStatus_t prvUnsubscribeComplete( UnsubscribeRequest_t * pxRequest,
+                                            MQTTStatus_t xUnsubStatus )
 {
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
-
-    configASSERT( pxReturnInfo );
+    SubMgrCtx_t * pxCtx = &( pxRequest->pxTaskCtx->xSubMgrCtx );
+    MQTTStatus_t xStatus = MQTTIllegalState;
 
-    if( xTaskHandle != NULL )
+    /* The agent task already holds the mutex while (re)connecting */
+    if( MUTEX_IS_OWNED( pxCtx->xMutex ) )
     {
-        uint32_t ulNotifyValue = pxReturnInfo->returnCode;
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_AGENT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
+        xStatus = prvSubMgrRemoveCallback( pxCtx, pxRequest );
     }
-}
-
-/*-----------------------------------------------------------*/
-
-static inline MQTTStatus_t prvSendUnsubRequest( MQTTAgentContext_t * pxAgentCtx,
-                                                const char * pcTopicFilter,
-                                                size_t xTopicFilterLen,
-                                                MQTTQoS_t xQos,
-                                                TickType_t xTimeout )
-{
-    MQTTStatus_t xStatus = MQTTSuccess;
-
-    MQTTSubscribeInfo_t xSubInfo =
+    else if( xLockSubCtx( pxCtx ) )
     {
-        .pTopicFilter      = pcTopicFilter,
-        .topicFilterLength = ( uint16_t ) xTopicFilterLen,
-        .qos               = xQos,
-    };
+        xStatus = prvSubMgrRemoveCallback( pxCtx, pxRequest );
 
-    MQTTAgentSubscribeArgs_t xSubscribeArgs =
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+    else
     {
-        .numSubscriptions = 1,
-        .pSubscribeInfo   = &xSubInfo,
-    };
+        LogError( "Failed to acquire MQTTAgent mutex." );
+    }
 
-    MQTTAgentCommandInfo_t xCommandInfo =
+    if( xStatus == MQTTSuccess )
     {
-        .blockTimeMs                 = xTimeout,
-        .cmdCompleteCallback         = prvAgentRequestCallback,
-        .pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle(),
-    };
+        xStatus = xUnsubStatus;
+    }
 
-    ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
+    if( pxRequest->pxCompleteCallback != NULL )
+    {
+        pxRequest->pxCompleteCallback( pxRequest->pvCompleteCtx, xStatus );
+    }
 
-    xStatus = MQTTAgent_Unsubscribe( pxAgentCtx, &xSubscribeArgs, &xCommandInfo );
+    vPortFree( pxRequest );
 
-    if( xStatus == MQTTSuccess )
-    {
-        uint32_t ulNotifyValue = 0;
+    return xStatus;
+}
 
-        LogInfo( "MQTT Unsubscribe: \"%.*s\"", xTopicFilterLen, pcTopicFilter );
+/*-----------------------------------------------------------*/
 
-        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
-                                    0x0,
-                                    0xFFFFFFFF,
-                                    &ulNotifyValue,
-                                    xTimeout ) )
-        {
-            xStatus = ulNotifyValue;
-        }
-        else
-        {
-            xStatus = MQTTKeepAliveTimeout;
-        }
-    }
+static void prvUnsubscribeRequestCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    configASSERT( pxCommandContext );
+    configASSERT( pxReturnInfo );
 
-    return xStatus;
+    ( void ) prvUnsubscribeComplete( ( UnsubscribeRequest_t * ) pxCommandContext,
+                                     pxReturnInfo->returnCode );
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
-                                        const char * pcTopicFilter,
-                                        IncomingPubCallback_t pxCallback,
-                                        void * pvCallbackCtx )
+MQTTStatus_t MqttAgent_UnSubscribeAsync( MQTTAgentHandle_t xHandle,
+                                         const char * pcTopicFilter,
+                                         IncomingPubCallback_t pxCallback,
+                                         void * pvCallbackCtx,
+                                         UnsubscribeCompleteCallback_t pxCompleteCallback,
+                                         void * pvCompleteCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
     size_t xTopicFilterLen = 0;
     MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
-    SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
-    uint32_t ulCallbackCount = 0;
+    UnsubscribeRequest_t * pxRequest = NULL;
 
     if( ( xHandle == NULL ) ||
         ( pcTopicFilter == NULL ) ||
@@ -1680,6 +3361,28 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
 
     if( xStatus == MQTTSuccess )
     {
+        pxRequest = ( UnsubscribeRequest_t * ) pvPortMalloc( sizeof( UnsubscribeRequest_t ) );
+
+        if( pxRequest == NULL )
+        {
+            LogError( "Failed to allocate %d bytes for an unsubscribe request.", sizeof( UnsubscribeRequest_t ) );
+            xStatus = MQTTNoMemory;
+        }
+        else
+        {
+            ( void ) memset( pxRequest, 0, sizeof( UnsubscribeRequest_t ) );
+            pxRequest->pxTaskCtx = pxTaskCtx;
+            pxRequest->pxCompleteCallback = pxCompleteCallback;
+            pxRequest->pvCompleteCtx = pvCompleteCtx;
+            pxRequest->pxCallback = pxCallback;
+            pxRequest->pvCallbackCtx = pvCallbackCtx;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
+
         xStatus = MQTTNoDataAvailable;
 
         /* Acquire mutex */
@@ -1693,13 +3396,15 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                                pcTopicFilter,
                                pxCtx->pxSubscriptions[ uxIdx ].topicFilterLength ) == 0 ) )
                 {
-                    ulCallbackCount = pxCtx->pulSubCbCount[ uxIdx ];
+                    pxRequest->ulCallbackCount = pxCtx->pulSubCbCount[ uxIdx ];
 
-                    if( ulCallbackCount > 0 )
+                    if( pxRequest->ulCallbackCount > 0 )
                     {
-                        pxCtx->pulSubCbCount[ uxIdx ] = ulCallbackCount - 1;
+                        pxCtx->pulSubCbCount[ uxIdx ] = pxRequest->ulCallbackCount - 1;
                     }
 
+                    /* The stored filter stays allocated until prvSubMgrRemoveCallback runs */
+                    pxRequest->xSubInfo = pxCtx->pxSubscriptions[ uxIdx ];
                     xStatus = MQTTSuccess;
                     break;
                 }
@@ -1713,96 +3418,94 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
             LogError( "Failed to acquire MQTTAgent mutex." );
         }
 
-        /* Send unsubscribe request if only one callback is left for this subscription */
-        if( ( xStatus == MQTTSuccess ) &&
-            ( ulCallbackCount == 1 ) )
+        if( xStatus != MQTTSuccess )
         {
-            /* TODO: Use a reasonable timeout value here */
-            xStatus = prvSendUnsubRequest( &( pxTaskCtx->xAgentContext ),
-                                           pcTopicFilter,
-                                           xTopicFilterLen,
-                                           MQTTQoS1,
-                                           portMAX_DELAY );
+            vPortFree( pxRequest );
+            pxRequest = NULL;
         }
+    }
 
-        /* Acquire mutex */
-        if( xLockSubCtx( pxCtx ) )
+    /* Send unsubscribe request if only one callback is left for this subscription */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxRequest->ulCallbackCount == 1 ) )
+    {
+        MQTTAgentCommandInfo_t xCommandInfo =
         {
-            MQTTSubscribeInfo_t * pxSubInfo = NULL;
-            size_t uxSubInfoIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
+            .blockTimeMs                 = SUBSCRIBE_ENQUEUE_TIMEOUT_MS,
+            .cmdCompleteCallback         = prvUnsubscribeRequestCallback,
+            .pCmdCompleteCallbackContext = ( void * ) pxRequest,
+        };
 
-            /* Find matching subscription context again */
-            for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
-            {
-                if( ( pxCtx->pulSubCbCount[ uxIdx ] == 0 ) &&
-                    ( xTopicFilterLen == pxCtx->pxSubscriptions[ uxIdx ].topicFilterLength ) &&
-                    ( strncmp( pxCtx->pxSubscriptions[ uxIdx ].pTopicFilter,
-                               pcTopicFilter,
-                               pxCtx->pxSubscriptions[ uxIdx ].topicFilterLength ) == 0 ) )
-                {
-                    uxSubInfoIdx = uxIdx;
-                    pxSubInfo = &( pxCtx->pxSubscriptions[ uxIdx ] );
-                    xStatus = MQTTSuccess;
-                    break;
-                }
-            }
+        pxRequest->xSubInfo.qos = MQTTQoS1;
+        pxRequest->xSubscribeArgs.pSubscribeInfo = &( pxRequest->xSubInfo );
+        pxRequest->xSubscribeArgs.numSubscriptions = 1;
 
-            if( xStatus == MQTTSuccess )
-            {
-                xStatus = MQTTNoDataAvailable;
+        LogInfo( "MQTT Unsubscribe: \"%.*s\"", xTopicFilterLen, pcTopicFilter );
 
-                /* Find matching callback context, and remove it. */
-                for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
-                {
-                    SubCallbackElement_t * pxCbCtx = &( pxCtx->pxCallbacks[ uxIdx ] );
+        xStatus = MQTTAgent_Unsubscribe( &( pxTaskCtx->xAgentContext ),
+                                         &( pxRequest->xSubscribeArgs ),
+                                         &xCommandInfo );
 
-                    if( prvMatchCbCtx( pxCbCtx, pxSubInfo, pxCallback, pvCallbackCtx ) )
-                    {
-                        xStatus = MQTTSuccess;
-                        pxCbCtx->pvIncomingPublishCallbackContext = NULL;
-                        pxCbCtx->pxIncomingPublishCallback = NULL;
-                        pxCbCtx->pxSubInfo = NULL;
-                        pxCbCtx->xTaskHandle = NULL;
+        /* Drop the callback even if the broker could not be told */
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "Failed to enqueue the MQTT unsubscribe command. xStatus=%s.",
+                      MQTT_Status_strerror( xStatus ) );
+            ( void ) prvUnsubscribeComplete( pxRequest, xStatus );
+            xStatus = MQTTSuccess;
+        }
+    }
+    else if( xStatus == MQTTSuccess )
+    {
+        /* Other callbacks still use the subscription */
+        ( void ) prvUnsubscribeComplete( pxRequest, MQTTSuccess );
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return xStatus;
+}
 
-                        configASSERT( pxCtx->uxCallbackCount > 0 );
+/*-----------------------------------------------------------*/
 
-                        pxCtx->uxCallbackCount--;
+static void prvSyncUnsubscribeComplete( void * pvCompleteCtx,
+                                        MQTTStatus_t xStatus )
+{
+    SyncRequestCtx_t * pxSyncCtx = ( SyncRequestCtx_t * ) pvCompleteCtx;
 
-                        LogInfo( "Callback de-registered, filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
+    configASSERT( pxSyncCtx );
 
-                        prvCompressCallbackList( pxCtx->pxCallbacks, &( pxCtx->uxCallbackCount ) );
-                        break;
-                    }
-                }
+    pxSyncCtx->xStatus = xStatus;
 
-                if( ( xStatus == MQTTSuccess ) &&
-                    ( ulCallbackCount == 1 ) &&
-                    ( pxCtx->pulSubCbCount[ uxSubInfoIdx ] == 0 ) )
-                {
-                    /* Free heap allocated topic filter */
-                    vPortFree( ( void * ) pxSubInfo->pTopicFilter );
+    ( void ) xTaskNotifyGiveIndexed( pxSyncCtx->xTaskHandle, MQTT_AGENT_NOTIFY_IDX );
+}
 
-                    pxSubInfo->pTopicFilter = NULL;
-                    pxSubInfo->topicFilterLength = 0;
-                    pxSubInfo->qos = 0;
-                    pxCtx->pxSubAckStatus[ uxSubInfoIdx ] = MQTTSubAckFailure;
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
+                                        const char * pcTopicFilter,
+                                        IncomingPubCallback_t pxCallback,
+                                        void * pvCallbackCtx )
+{
+    MQTTStatus_t xStatus;
+    SyncRequestCtx_t xSyncCtx =
+    {
+        .xTaskHandle    = xTaskGetCurrentTaskHandle(),
+        .xStatus        = MQTTSuccess,
+        .pxSubAckStatus = NULL,
+    };
 
-                    configASSERT( pxCtx->uxSubscriptionCount > 0 );
+    ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
 
-                    if( pxCtx->uxSubscriptionCount > 0 )
-                    {
-                        pxCtx->uxSubscriptionCount--;
-                    }
-                }
-            }
+    xStatus = MqttAgent_UnSubscribeAsync( xHandle, pcTopicFilter, pxCallback, pvCallbackCtx,
+                                          prvSyncUnsubscribeComplete, &xSyncCtx );
 
-            ( void ) xUnlockSubCtx( pxCtx );
-        }
-        else
-        {
-            xStatus = MQTTIllegalState;
-            LogError( "Failed to acquire MQTTAgent mutex." );
-        }
+    if( xStatus == MQTTSuccess )
+    {
+        ( void ) ulTaskNotifyTakeIndexed( MQTT_AGENT_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+        xStatus = xSyncCtx.xStatus;
     }
 
     return xStatus;
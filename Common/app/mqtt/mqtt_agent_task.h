@@ -4,14 +4,86 @@
 #include "FreeRTOS.h"
 #include <stdbool.h>
 
+#include "core_mqtt_agent.h"
+
+/**
+ * @brief Maximum number of publishes accepted by one MqttAgent_PublishBatch call.
+ */
+#ifndef MQTT_AGENT_PUBLISH_BATCH_MAX
+    #define MQTT_AGENT_PUBLISH_BATCH_MAX    8U
+#endif /* MQTT_AGENT_PUBLISH_BATCH_MAX */
+
+/**
+ * @brief 1 to open a second broker connection, with its own agent task, TLS session and
+ * client ID, for the subsystems moving large payloads. Their transfers then no longer hold
+ * up keep alives and small publishes on the control connection.
+ *
+ * The client ID of the bulk connection is the thing name followed by
+ * MQTT_AGENT_BULK_CLIENT_ID_SUFFIX, which the IoT policy of the device must allow.
+ */
+#ifndef MQTT_AGENT_BULK_CONNECTION
+    #define MQTT_AGENT_BULK_CONNECTION    0
+#endif /* MQTT_AGENT_BULK_CONNECTION */
+
+typedef enum MqttAgentConnection
+{
+    MQTT_AGENT_CONN_CONTROL = 0, /* Shadow, telemetry, logs and other small messages */
+    MQTT_AGENT_CONN_BULK,        /* OTA jobs and file blocks, Device Defender reports */
+    MQTT_AGENT_CONN_MAX
+} MqttAgentConnection_t;
+
 struct MQTTAgentTaskCtx;
 typedef struct MQTTAgentContext * MQTTAgentHandle_t;
 
+/**
+ * @brief Handle of the control connection.
+ */
 MQTTAgentHandle_t xGetMqttAgentHandle( void );
 
-/* Event group based mechanism that can be used to block tasks until agent is ready */
+/**
+ * @brief Handle of the given connection. The bulk connection falls back to the control
+ * connection when MQTT_AGENT_BULK_CONNECTION is 0 or it could not be initialized.
+ * Valid once vSleepUntilMQTTAgentReady has returned.
+ */
+MQTTAgentHandle_t xGetMqttAgentConnectionHandle( MqttAgentConnection_t xConnection );
+
+/**
+ * @brief Handle of the agent instance running the calling task, NULL outside of the agent tasks.
+ * Lets code called back from the agent, such as an incoming publish callback, find its connection.
+ */
+MQTTAgentHandle_t xGetMqttAgentHandleOfCallingTask( void );
+
+/**
+ * @brief Enqueue several publishes and wake the agent once for all of them.
+ *
+ * The agent processes the commands back to back and coalesces their packets into
+ * shared TLS records. Each publish completes through its own command info callback.
+ * The publish info and command info arrays must stay valid until every callback has run.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pxPublishInfoList Array of uxCount publishes.
+ * @param[in] pxCommandInfoList Array of uxCount command infos, one per publish.
+ * @param[in] uxCount Number of publishes, at most MQTT_AGENT_PUBLISH_BATCH_MAX.
+ * @param[out] puxQueued Optional, set to the number of publishes which were enqueued.
+ * @return `MQTTSuccess` if every publish was enqueued.
+ */
+MQTTStatus_t MqttAgent_PublishBatch( MQTTAgentHandle_t xHandle,
+                                     MQTTPublishInfo_t * pxPublishInfoList,
+                                     const MQTTAgentCommandInfo_t * pxCommandInfoList,
+                                     size_t uxCount,
+                                     size_t * puxQueued );
+
+/**
+ * @brief Number of commands currently waiting in the agent command queue.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ */
+UBaseType_t MqttAgent_GetQueueDepth( MQTTAgentHandle_t xHandle );
+
+/* Event group based mechanism that can be used to block tasks until every agent instance is ready */
 void vSleepUntilMQTTAgentReady( void );
 
+/* Connection state of the control connection */
 void vSleepUntilMQTTAgentConnected( void );
 
 bool xIsMqttAgentConnected( void );
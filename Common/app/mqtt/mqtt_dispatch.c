@@ -0,0 +1,264 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_dispatch.c
+ * @brief Worker tasks running incoming publish callbacks outside of the MQTT agent task.
+ *
+ * The agent task only queues the publish. Its topic and payload are left in the
+ * receive buffer lent with MqttAgent_RetainRxBuffer, or copied to the heap when no
+ * spare receive buffer is free, and released once the worker has run the callback.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+#include "static_alloc.h"
+
+#include "mqtt_dispatch.h"
+#include "subscription_manager.h"
+
+typedef struct
+{
+    const MqttAgentDeferredCallback_t * pxDeferred;
+    MQTTPublishInfo_t xPublishInfo;
+    MqttAgentRxBufferHandle_t xRxBuffer;
+    void * pvCopy;
+} DispatchItem_t;
+
+static QueueHandle_t xDispatchQueue = NULL;
+
+#if ( STATIC_ALLOC_ENABLED == 1 )
+    /* One xAppTaskCreate expansion holds a single task, the workers are created in a loop */
+    static StackType_t puxWorkerStacks[ MQTT_DISPATCH_TASKS ][ MQTT_DISPATCH_STACK_SIZE ] STATIC_ALLOC_STACK;
+    static StaticTask_t xWorkerBuffers[ MQTT_DISPATCH_TASKS ] STATIC_ALLOC_DATA;
+#endif
+
+/* Publishes queued and not yet delivered, waited on by vMqttDispatchFlush */
+static uint32_t ulPending = 0;
+
+static MqttDispatchStats_t xDispatchStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static void prvDispatchTask( void * pvParameters )
+{
+    DispatchItem_t xItem;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        if( xQueueReceive( xDispatchQueue, &xItem, portMAX_DELAY ) == pdTRUE )
+        {
+            xItem.pxDeferred->pxCallback( xItem.pxDeferred->pvCallbackCtx, &( xItem.xPublishInfo ) );
+
+            if( xItem.xRxBuffer != NULL )
+            {
+                MqttAgent_ReleaseRxBuffer( xItem.xRxBuffer );
+            }
+            else
+            {
+                vPortFree( xItem.pvCopy );
+            }
+
+            ( void ) __atomic_fetch_sub( &ulPending, 1, __ATOMIC_RELEASE );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttDispatchInit( void )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( xDispatchQueue == NULL )
+    {
+        UBaseType_t uxPriority = MQTT_DISPATCH_TASK_PRIORITY;
+
+        xDispatchQueue = xAppQueueCreate( MQTT_DISPATCH_QUEUE_LENGTH, sizeof( DispatchItem_t ) );
+
+        if( xDispatchQueue == NULL )
+        {
+            LogError( "Failed to allocate the dispatch queue." );
+            xResult = pdFALSE;
+        }
+
+        for( uint32_t ulIdx = 0; ( xResult == pdTRUE ) && ( ulIdx < MQTT_DISPATCH_TASKS ); ulIdx++ )
+        {
+            #if ( STATIC_ALLOC_ENABLED == 1 )
+                xResult = ( xTaskCreateStatic( prvDispatchTask, "MQTTDispatch", MQTT_DISPATCH_STACK_SIZE,
+                                               NULL, uxPriority, puxWorkerStacks[ ulIdx ],
+                                               &( xWorkerBuffers[ ulIdx ] ) ) != NULL ) ? pdTRUE : pdFALSE;
+            #else
+                xResult = xTaskCreate( prvDispatchTask, "MQTTDispatch", MQTT_DISPATCH_STACK_SIZE,
+                                       NULL, uxPriority, NULL );
+            #endif
+
+            if( xResult != pdTRUE )
+            {
+                LogError( "Failed to create dispatch worker %lu.", ulIdx );
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_DeferredCallback( void * pvDeferredCallback,
+                                 MQTTPublishInfo_t * pxPublishInfo )
+{
+    const MqttAgentDeferredCallback_t * pxDeferred = ( const MqttAgentDeferredCallback_t * ) pvDeferredCallback;
+    DispatchItem_t xItem = { 0 };
+    BaseType_t xQueued = pdFALSE;
+
+    configASSERT( pxDeferred != NULL );
+    configASSERT( pxDeferred->pxCallback != NULL );
+    configASSERT( pxPublishInfo != NULL );
+
+    xItem.pxDeferred = pxDeferred;
+    xItem.xPublishInfo = *pxPublishInfo;
+
+    if( ( xDispatchQueue != NULL ) &&
+        ( uxQueueSpacesAvailable( xDispatchQueue ) > 0 ) )
+    {
+        xItem.xRxBuffer = MqttAgent_RetainRxBuffer( xGetMqttAgentHandleOfCallingTask() );
+
+        if( xItem.xRxBuffer == NULL )
+        {
+            xItem.pvCopy = pvPortMalloc( pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength );
+
+            if( xItem.pvCopy != NULL )
+            {
+                char * pcTopic = ( char * ) xItem.pvCopy;
+
+                ( void ) memcpy( pcTopic, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+                xItem.xPublishInfo.pTopicName = pcTopic;
+
+                if( pxPublishInfo->payloadLength > 0 )
+                {
+                    ( void ) memcpy( &( pcTopic[ pxPublishInfo->topicNameLength ] ),
+                                     pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+                    xItem.xPublishInfo.pPayload = &( pcTopic[ pxPublishInfo->topicNameLength ] );
+                }
+            }
+        }
+
+        if( ( xItem.xRxBuffer != NULL ) ||
+            ( xItem.pvCopy != NULL ) )
+        {
+            ( void ) __atomic_fetch_add( &ulPending, 1, __ATOMIC_RELAXED );
+
+            /* Each agent connection sends to the queue, another one may have taken the space checked above */
+            xQueued = xQueueSend( xDispatchQueue, &xItem, 0 );
+
+            if( xQueued != pdTRUE )
+            {
+                ( void ) __atomic_fetch_sub( &ulPending, 1, __ATOMIC_RELEASE );
+
+                if( xItem.xRxBuffer != NULL )
+                {
+                    MqttAgent_ReleaseRxBuffer( xItem.xRxBuffer );
+                }
+                else
+                {
+                    vPortFree( xItem.pvCopy );
+                }
+            }
+        }
+    }
+
+    taskENTER_CRITICAL();
+    {
+        if( xQueued == pdTRUE )
+        {
+            UBaseType_t uxQueued = uxQueueMessagesWaiting( xDispatchQueue );
+
+            xDispatchStats.ulDeferred++;
+
+            if( xItem.xRxBuffer != NULL )
+            {
+                xDispatchStats.ulLent++;
+            }
+            else
+            {
+                xDispatchStats.ulCopied++;
+            }
+
+            if( uxQueued > xDispatchStats.ulPeakQueued )
+            {
+                xDispatchStats.ulPeakQueued = uxQueued;
+            }
+        }
+        else
+        {
+            xDispatchStats.ulInline++;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xQueued == pdFALSE )
+    {
+        LogDebug( "Delivering publish on %.*s in the agent task.",
+                  pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+        pxDeferred->pxCallback( pxDeferred->pvCallbackCtx, pxPublishInfo );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttDispatchFlush( void )
+{
+    while( __atomic_load_n( &ulPending, __ATOMIC_ACQUIRE ) > 0 )
+    {
+        vTaskDelay( 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttDispatchGetStats( MqttDispatchStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xDispatchStats, sizeof( MqttDispatchStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+}
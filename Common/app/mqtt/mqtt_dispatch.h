@@ -0,0 +1,97 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_dispatch.h
+ * @brief Worker tasks running incoming publish callbacks outside of the MQTT agent task.
+ */
+#ifndef _MQTT_DISPATCH_H_
+#define _MQTT_DISPATCH_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Number of deferred publishes which may wait for a worker. A publish arriving
+ * while the queue is full is delivered in the agent task.
+ */
+#ifndef MQTT_DISPATCH_QUEUE_LENGTH
+    #define MQTT_DISPATCH_QUEUE_LENGTH    ( 8U )
+#endif /* MQTT_DISPATCH_QUEUE_LENGTH */
+
+/**
+ * @brief Number of worker tasks. With more than one worker, publishes are no longer
+ * delivered in the order they were received.
+ */
+#ifndef MQTT_DISPATCH_TASKS
+    #define MQTT_DISPATCH_TASKS    ( 1U )
+#endif /* MQTT_DISPATCH_TASKS */
+
+#ifndef MQTT_DISPATCH_STACK_SIZE
+    #define MQTT_DISPATCH_STACK_SIZE    ( 1024U )
+#endif /* MQTT_DISPATCH_STACK_SIZE */
+
+/**
+ * @brief Priority of the worker tasks. Defaults to one below the MQTT agent task.
+ */
+#ifndef MQTT_DISPATCH_TASK_PRIORITY
+    #define MQTT_DISPATCH_TASK_PRIORITY    ( uxTaskPriorityGet( NULL ) - 1U )
+#endif /* MQTT_DISPATCH_TASK_PRIORITY */
+
+typedef struct
+{
+    uint32_t ulDeferred;   /* Publishes handed to a worker */
+    uint32_t ulLent;       /* Deferred publishes which kept the agent receive buffer */
+    uint32_t ulCopied;     /* Deferred publishes copied to the heap */
+    uint32_t ulInline;     /* Publishes delivered in the agent task, queue full or out of memory */
+    uint32_t ulPeakQueued;
+} MqttDispatchStats_t;
+
+/**
+ * @brief Create the dispatch queue and worker tasks. Called from the MQTT agent task,
+ * does nothing once the workers exist.
+ *
+ * @return pdTRUE on success.
+ */
+BaseType_t xMqttDispatchInit( void );
+
+/**
+ * @brief Wait until every publish deferred before this call has been delivered.
+ *
+ * A subscriber calls this after unsubscribing and before releasing the context
+ * referenced by its MqttAgentDeferredCallback_t. Must not be called from a worker.
+ */
+void vMqttDispatchFlush( void );
+
+/**
+ * @brief Copy a snapshot of the dispatch counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void vMqttDispatchGetStats( MqttDispatchStats_t * pxStats );
+
+#endif /* _MQTT_DISPATCH_H_ */
@@ -0,0 +1,377 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_keepalive.c
+ * @brief Keep alive interval learned per network from the NAT and access point timeouts.
+ *
+ * The table of networks is shared by the agent instances and only written to the kvstore when
+ * an interval is confirmed good or found to time out, not on every ping.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "kvstore.h"
+#include "mqtt_keepalive.h"
+
+/* Losses in a row at the good interval before it is lowered */
+#define KEEPALIVE_LOSSES_MAX    ( 2U )
+
+typedef struct
+{
+    char cNetwork[ MQTT_KEEPALIVE_NETWORK_LEN ];
+    uint16_t usGoodS;
+    uint16_t usTimeoutS;
+} KeepAliveEntry_t;
+
+static_assert( MQTT_KEEPALIVE_MIN_S < MQTT_KEEPALIVE_MAX_S );
+static_assert( MQTT_KEEPALIVE_MAX_S <= UINT16_MAX );
+
+#if ( MQTT_KEEPALIVE_ADAPTIVE == 1 )
+
+/* Most recently used network first, zero filled entries are unused */
+    static KeepAliveEntry_t pxNetworks[ MQTT_KEEPALIVE_NETWORKS ];
+    static BaseType_t xNetworksLoaded = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+    static void prvNetworksLoad( void )
+    {
+        KeepAliveEntry_t pxLoaded[ MQTT_KEEPALIVE_NETWORKS ];
+        size_t uxLen = KVStore_getBlob( CS_MQTT_KEEPALIVE, pxLoaded, sizeof( pxLoaded ) );
+
+        if( uxLen != sizeof( pxLoaded ) )
+        {
+            memset( pxLoaded, 0, sizeof( pxLoaded ) );
+        }
+
+        for( size_t i = 0; i < MQTT_KEEPALIVE_NETWORKS; i++ )
+        {
+            KeepAliveEntry_t * pxEntry = &( pxLoaded[ i ] );
+
+            pxEntry->cNetwork[ MQTT_KEEPALIVE_NETWORK_LEN - 1 ] = '\0';
+
+            if( ( pxEntry->usGoodS < MQTT_KEEPALIVE_MIN_S ) ||
+                ( pxEntry->usGoodS > MQTT_KEEPALIVE_MAX_S ) ||
+                ( ( pxEntry->usTimeoutS != 0 ) && ( pxEntry->usTimeoutS <= pxEntry->usGoodS ) ) )
+            {
+                memset( pxEntry, 0, sizeof( KeepAliveEntry_t ) );
+            }
+        }
+
+        /* Both connections may get here on their first connect */
+        taskENTER_CRITICAL();
+        {
+            if( xNetworksLoaded == pdFALSE )
+            {
+                memcpy( pxNetworks, pxLoaded, sizeof( pxNetworks ) );
+                xNetworksLoaded = pdTRUE;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Move the entry of pcNetwork to the front, replacing the least recently used one if it is new */
+    static KeepAliveEntry_t prvNetworksLookup( const char * pcNetwork )
+    {
+        KeepAliveEntry_t xEntry = { 0 };
+        size_t uxIdx = MQTT_KEEPALIVE_NETWORKS - 1;
+
+        for( size_t i = 0; i < MQTT_KEEPALIVE_NETWORKS; i++ )
+        {
+            if( ( pxNetworks[ i ].usGoodS != 0 ) &&
+                ( strncmp( pxNetworks[ i ].cNetwork, pcNetwork, MQTT_KEEPALIVE_NETWORK_LEN ) == 0 ) )
+            {
+                xEntry = pxNetworks[ i ];
+                uxIdx = i;
+                break;
+            }
+        }
+
+        if( xEntry.usGoodS == 0 )
+        {
+            ( void ) strncpy( xEntry.cNetwork, pcNetwork, MQTT_KEEPALIVE_NETWORK_LEN - 1 );
+            xEntry.usGoodS = MQTT_KEEPALIVE_MIN_S;
+        }
+
+        memmove( &( pxNetworks[ 1 ] ), &( pxNetworks[ 0 ] ), uxIdx * sizeof( KeepAliveEntry_t ) );
+        pxNetworks[ 0 ] = xEntry;
+
+        return xEntry;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Update the entry of the controller's network and write the table to the kvstore */
+    static void prvNetworksStore( const MqttKeepAlive_t * pxKeepAlive )
+    {
+        KeepAliveEntry_t pxCopy[ MQTT_KEEPALIVE_NETWORKS ];
+
+        taskENTER_CRITICAL();
+        {
+            for( size_t i = 0; i < MQTT_KEEPALIVE_NETWORKS; i++ )
+            {
+                if( strncmp( pxNetworks[ i ].cNetwork, pxKeepAlive->cNetwork, MQTT_KEEPALIVE_NETWORK_LEN ) == 0 )
+                {
+                    pxNetworks[ i ].usGoodS = pxKeepAlive->usGoodS;
+                    pxNetworks[ i ].usTimeoutS = pxKeepAlive->usTimeoutS;
+                }
+            }
+
+            memcpy( pxCopy, pxNetworks, sizeof( pxCopy ) );
+        }
+        taskEXIT_CRITICAL();
+
+        if( KVStore_setBlob( CS_MQTT_KEEPALIVE, sizeof( pxCopy ), pxCopy ) == pdTRUE )
+        {
+            #if KV_STORE_CACHE_ENABLE
+                KVStore_commitDeferred();
+            #endif
+        }
+        else
+        {
+            LogError( "Failed to store the keep alive of network %s.", pxKeepAlive->cNetwork );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Next interval to try from the good one, or the good one once the timeout is found */
+    static uint16_t prvNextInterval( const MqttKeepAlive_t * pxKeepAlive )
+    {
+        uint32_t ulGood = pxKeepAlive->usGoodS;
+        uint32_t ulNext;
+
+        if( pxKeepAlive->usTimeoutS != 0 )
+        {
+            ulNext = ( ( uint32_t ) pxKeepAlive->usTimeoutS - ulGood > MQTT_KEEPALIVE_RESOLUTION_S ) ?
+                     ( ( ulGood + pxKeepAlive->usTimeoutS ) / 2U ) : ulGood;
+        }
+        else
+        {
+            ulNext = ulGood + ( ( ( ulGood / 2U ) > MQTT_KEEPALIVE_RESOLUTION_S ) ? ( ulGood / 2U ) : MQTT_KEEPALIVE_RESOLUTION_S );
+        }
+
+        return ( uint16_t ) ( ( ulNext > MQTT_KEEPALIVE_MAX_S ) ? MQTT_KEEPALIVE_MAX_S : ulNext );
+    }
+
+#endif /* MQTT_KEEPALIVE_ADAPTIVE == 1 */
+
+/*-----------------------------------------------------------*/
+
+void vMqttKeepAliveInit( MqttKeepAlive_t * pxKeepAlive,
+                         BaseType_t xProbe )
+{
+    configASSERT( pxKeepAlive != NULL );
+
+    memset( pxKeepAlive, 0, sizeof( MqttKeepAlive_t ) );
+
+    pxKeepAlive->xProbe = xProbe;
+    pxKeepAlive->usIntervalS = MQTT_KEEPALIVE_MIN_S;
+    pxKeepAlive->usGoodS = MQTT_KEEPALIVE_MIN_S;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t usMqttKeepAliveConnected( MqttKeepAlive_t * pxKeepAlive )
+{
+    configASSERT( pxKeepAlive != NULL );
+
+    #if ( MQTT_KEEPALIVE_ADAPTIVE == 1 )
+    {
+        char cNetwork[ MQTT_KEEPALIVE_NETWORK_LEN ] = { 0 };
+        KeepAliveEntry_t xEntry;
+
+        ( void ) KVStore_getString( CS_WIFI_SSID, cNetwork, sizeof( cNetwork ) );
+
+        if( xNetworksLoaded == pdFALSE )
+        {
+            prvNetworksLoad();
+        }
+
+        taskENTER_CRITICAL();
+        {
+            xEntry = prvNetworksLookup( cNetwork );
+        }
+        taskEXIT_CRITICAL();
+
+        memcpy( pxKeepAlive->cNetwork, xEntry.cNetwork, sizeof( pxKeepAlive->cNetwork ) );
+        pxKeepAlive->usGoodS = xEntry.usGoodS;
+        pxKeepAlive->usTimeoutS = xEntry.usTimeoutS;
+        pxKeepAlive->usIntervalS = xEntry.usGoodS;
+        pxKeepAlive->usConfirmed = 0;
+
+        LogInfo( "Keep alive %u s on network %s, %u s timed out.",
+                 pxKeepAlive->usGoodS, pxKeepAlive->cNetwork, pxKeepAlive->usTimeoutS );
+    }
+    #endif /* MQTT_KEEPALIVE_ADAPTIVE == 1 */
+
+    return pxKeepAlive->usIntervalS;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttKeepAliveAcked( MqttKeepAlive_t * pxKeepAlive )
+{
+    BaseType_t xChanged = pdFALSE;
+
+    configASSERT( pxKeepAlive != NULL );
+
+    #if ( MQTT_KEEPALIVE_ADAPTIVE == 1 )
+        if( pxKeepAlive->xProbe == pdFALSE )
+        {
+            uint16_t usGoodS = pxKeepAlive->usIntervalS;
+
+            /* Follow the connection which probes */
+            taskENTER_CRITICAL();
+            {
+                if( strncmp( pxNetworks[ 0 ].cNetwork, pxKeepAlive->cNetwork, MQTT_KEEPALIVE_NETWORK_LEN ) == 0 )
+                {
+                    usGoodS = pxNetworks[ 0 ].usGoodS;
+                }
+            }
+            taskEXIT_CRITICAL();
+
+            xChanged = ( usGoodS != pxKeepAlive->usIntervalS ) ? pdTRUE : pdFALSE;
+            pxKeepAlive->usGoodS = usGoodS;
+            pxKeepAlive->usIntervalS = usGoodS;
+        }
+        else
+        {
+            uint16_t usNextS;
+
+            pxKeepAlive->usConfirmed++;
+            pxKeepAlive->ucLosses = 0;
+
+            if( ( pxKeepAlive->usIntervalS > pxKeepAlive->usGoodS ) &&
+                ( pxKeepAlive->usConfirmed >= MQTT_KEEPALIVE_CONFIRM ) )
+            {
+                pxKeepAlive->usGoodS = pxKeepAlive->usIntervalS;
+
+                if( pxKeepAlive->usGoodS >= pxKeepAlive->usTimeoutS )
+                {
+                    pxKeepAlive->usTimeoutS = 0;
+                }
+
+                prvNetworksStore( pxKeepAlive );
+
+                LogInfo( "Keep alive of %u s holds on network %s.", pxKeepAlive->usGoodS, pxKeepAlive->cNetwork );
+            }
+
+            usNextS = prvNextInterval( pxKeepAlive );
+
+            if( pxKeepAlive->usIntervalS == pxKeepAlive->usGoodS )
+            {
+                if( usNextS == pxKeepAlive->usGoodS )
+                {
+                    /* Settled, try the interval which timed out again after a while in case the network changed */
+                    if( ( pxKeepAlive->usTimeoutS != 0 ) &&
+                        ( pxKeepAlive->usConfirmed >= MQTT_KEEPALIVE_REPROBE_PINGS ) )
+                    {
+                        pxKeepAlive->usIntervalS = pxKeepAlive->usTimeoutS;
+                        pxKeepAlive->usConfirmed = 0;
+                        xChanged = pdTRUE;
+
+                        LogInfo( "Probing a keep alive of %u s again.", pxKeepAlive->usIntervalS );
+                    }
+                }
+                else if( pxKeepAlive->usConfirmed >= MQTT_KEEPALIVE_CONFIRM )
+                {
+                    pxKeepAlive->usIntervalS = usNextS;
+                    pxKeepAlive->usConfirmed = 0;
+                    xChanged = pdTRUE;
+
+                    LogInfo( "Probing a keep alive of %u s.", usNextS );
+                }
+            }
+        }
+    #endif /* MQTT_KEEPALIVE_ADAPTIVE == 1 */
+
+    return xChanged;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttKeepAliveLost( MqttKeepAlive_t * pxKeepAlive )
+{
+    configASSERT( pxKeepAlive != NULL );
+
+    #if ( MQTT_KEEPALIVE_ADAPTIVE == 1 )
+        if( pxKeepAlive->xProbe == pdTRUE )
+        {
+            BaseType_t xStore = pdTRUE;
+
+            if( pxKeepAlive->usIntervalS > pxKeepAlive->usGoodS )
+            {
+                if( ( pxKeepAlive->usTimeoutS == 0 ) ||
+                    ( pxKeepAlive->usIntervalS < pxKeepAlive->usTimeoutS ) )
+                {
+                    pxKeepAlive->usTimeoutS = pxKeepAlive->usIntervalS;
+                }
+
+                LogWarn( "Keep alive of %u s timed out on network %s, back to %u s.",
+                         pxKeepAlive->usIntervalS, pxKeepAlive->cNetwork, pxKeepAlive->usGoodS );
+            }
+            else if( ( ++( pxKeepAlive->ucLosses ) >= KEEPALIVE_LOSSES_MAX ) &&
+                     ( pxKeepAlive->usGoodS > MQTT_KEEPALIVE_MIN_S ) )
+            {
+                uint32_t ulLowered = ( ( uint32_t ) pxKeepAlive->usGoodS * 3U ) / 4U;
+
+                pxKeepAlive->usTimeoutS = pxKeepAlive->usGoodS;
+                pxKeepAlive->usGoodS = ( uint16_t ) ( ( ulLowered < MQTT_KEEPALIVE_MIN_S ) ? MQTT_KEEPALIVE_MIN_S : ulLowered );
+                pxKeepAlive->ucLosses = 0;
+
+                LogWarn( "Keep alive of %u s no longer holds on network %s, lowered to %u s.",
+                         pxKeepAlive->usTimeoutS, pxKeepAlive->cNetwork, pxKeepAlive->usGoodS );
+            }
+            else
+            {
+                /* A single loss at the good interval may have been something else */
+                xStore = pdFALSE;
+            }
+
+            pxKeepAlive->usIntervalS = pxKeepAlive->usGoodS;
+            pxKeepAlive->usConfirmed = 0;
+
+            if( xStore == pdTRUE )
+            {
+                prvNetworksStore( pxKeepAlive );
+            }
+        }
+    #endif /* MQTT_KEEPALIVE_ADAPTIVE == 1 */
+}
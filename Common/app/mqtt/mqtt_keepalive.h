@@ -0,0 +1,128 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_keepalive.h
+ * @brief Keep alive interval learned per network from the NAT and access point timeouts.
+ */
+#ifndef _MQTT_KEEPALIVE_H_
+#define _MQTT_KEEPALIVE_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * The broker is given MQTT_KEEPALIVE_MAX_S in CONNECT, the agent sends its PINGREQs at a shorter
+ * interval which it raises while it holds, starting from MQTT_KEEPALIVE_MIN_S:
+ *
+ * - After MQTT_KEEPALIVE_CONFIRM pings acknowledged at an interval with nothing received in
+ *   between, the interval is confirmed good and the next one is tried: half as long again, or
+ *   half way to the shortest interval known to time out.
+ * - A connection lost during a ping on a network which is still up marks the interval as timing
+ *   out, the connection comes back at the last good interval. Two losses in a row at the good
+ *   interval lower it by a quarter.
+ * - Once the good and timing out intervals are within MQTT_KEEPALIVE_RESOLUTION_S, the interval
+ *   stays. After MQTT_KEEPALIVE_REPROBE_PINGS further pings the one which timed out is tried again,
+ *   in case the network changed.
+ *
+ * The good and timing out intervals of the last MQTT_KEEPALIVE_NETWORKS networks are kept in the
+ * mqtt_keepalive key, keyed by SSID. Only the control connection probes, the bulk connection uses
+ * the good interval of the same network.
+ */
+
+#ifndef MQTT_KEEPALIVE_ADAPTIVE
+    #define MQTT_KEEPALIVE_ADAPTIVE    1
+#endif
+
+/* Used at once on a new network, and the interval of CONNECT with MQTT_KEEPALIVE_ADAPTIVE 0 */
+#ifndef MQTT_KEEPALIVE_MIN_S
+    #define MQTT_KEEPALIVE_MIN_S    ( 60U )
+#endif
+
+/* Longest interval accepted by AWS IoT Core, the broker closes the connection after 1.5 times it */
+#ifndef MQTT_KEEPALIVE_MAX_S
+    #define MQTT_KEEPALIVE_MAX_S    ( 1200U )
+#endif
+
+#ifndef MQTT_KEEPALIVE_RESOLUTION_S
+    #define MQTT_KEEPALIVE_RESOLUTION_S    ( 30U )
+#endif
+
+#ifndef MQTT_KEEPALIVE_CONFIRM
+    #define MQTT_KEEPALIVE_CONFIRM    ( 3U )
+#endif
+
+#ifndef MQTT_KEEPALIVE_REPROBE_PINGS
+    #define MQTT_KEEPALIVE_REPROBE_PINGS    ( 144U )
+#endif
+
+#ifndef MQTT_KEEPALIVE_NETWORKS
+    #define MQTT_KEEPALIVE_NETWORKS    ( 4U )
+#endif
+
+/* An SSID of up to 32 bytes and its terminator */
+#define MQTT_KEEPALIVE_NETWORK_LEN    ( 33U )
+
+typedef struct
+{
+    char cNetwork[ MQTT_KEEPALIVE_NETWORK_LEN ];
+    BaseType_t xProbe;
+    uint16_t usIntervalS;  /* PINGREQ interval in use */
+    uint16_t usGoodS;      /* Longest interval confirmed on this network */
+    uint16_t usTimeoutS;   /* Shortest interval which timed out, 0 if none did */
+    uint16_t usConfirmed;  /* Idle pings acknowledged at usIntervalS, or since settling */
+    uint8_t ucLosses;      /* Consecutive losses at usGoodS */
+} MqttKeepAlive_t;
+
+/**
+ * @brief Initialize the controller of one connection.
+ *
+ * @param[in] xProbe pdTRUE for the connection which probes longer intervals.
+ */
+void vMqttKeepAliveInit( MqttKeepAlive_t * pxKeepAlive,
+                         BaseType_t xProbe );
+
+/**
+ * @brief Called once connected: look up the current network.
+ *
+ * @return Interval to send PINGREQs at, in seconds.
+ */
+uint16_t usMqttKeepAliveConnected( MqttKeepAlive_t * pxKeepAlive );
+
+/**
+ * @brief Called when a PINGREQ sent with nothing received since the previous one is acknowledged.
+ *
+ * @return pdTRUE if usIntervalS changed.
+ */
+BaseType_t xMqttKeepAliveAcked( MqttKeepAlive_t * pxKeepAlive );
+
+/**
+ * @brief Called when the connection was lost waiting for a PINGRESP while the network was up.
+ */
+void vMqttKeepAliveLost( MqttKeepAlive_t * pxKeepAlive );
+
+#endif /* _MQTT_KEEPALIVE_H_ */
@@ -0,0 +1,302 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_outbox.c
+ * @brief Agent owned copies of outgoing QoS1 and QoS2 publishes.
+ *
+ * Publishes are stored in one ring buffer as variable length records and freed
+ * when the agent releases the command, i.e. once the publish has been
+ * acknowledged or cancelled. Records are normally acknowledged in order, so the
+ * space of freed records at the head is reclaimed as soon as all older records
+ * are free. A resumed session retransmits pending publishes from these copies.
+ *
+ * A payload from mqtt_payload_pool.c is not copied. The command holds a reference
+ * to it instead, whatever the QoS, so that the publisher may drop its own as soon
+ * as the command is queued.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mqtt_outbox.h"
+#include "mqtt_payload_pool.h"
+#include "freertos_command_pool.h"
+
+/* Records are 8 byte aligned so that any remainder at the end of the ring can hold a padding record */
+#define OUTBOX_ALIGN( x )    ( ( ( x ) + 7U ) & ~( ( size_t ) 7U ) )
+
+typedef struct
+{
+    uint32_t ulLen;   /* Record length including this header */
+    uint32_t ulInUse; /* 0 for padding and released records */
+} OutboxRecord_t;
+
+static_assert( sizeof( OutboxRecord_t ) == 8, "Record header must match the ring alignment" );
+static_assert( ( MQTT_OUTBOX_SIZE % 8U ) == 0, "MQTT_OUTBOX_SIZE must be a multiple of 8" );
+
+static uint64_t pullOutbox[ MQTT_OUTBOX_SIZE / sizeof( uint64_t ) ];
+
+static size_t uxHead = 0; /* Offset of the oldest record */
+static size_t uxTail = 0; /* Offset of the next free byte */
+static size_t uxUsed = 0; /* Bytes from uxHead to uxTail, including padding */
+
+/* Record held by each command of the command pool */
+static OutboxRecord_t * pxCommandRecords[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ] = { NULL };
+
+/* Pooled payload referenced by each command of the command pool */
+static const void * pvCommandPayloads[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ] = { NULL };
+
+static MqttOutboxStats_t xOutboxStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static inline OutboxRecord_t * prvRecordAt( size_t uxOffset )
+{
+    return ( OutboxRecord_t * ) &( ( ( uint8_t * ) pullOutbox )[ uxOffset ] );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reserve uxLen contiguous bytes at the tail. Must be called from a critical section. */
+static OutboxRecord_t * prvRecordAlloc( size_t uxLen )
+{
+    OutboxRecord_t * pxRecord = NULL;
+
+    if( uxUsed == 0 )
+    {
+        uxHead = 0;
+        uxTail = 0;
+    }
+
+    if( ( uxUsed == MQTT_OUTBOX_SIZE ) || ( uxLen > MQTT_OUTBOX_SIZE ) )
+    {
+        /* Full */
+    }
+    else if( uxTail >= uxHead )
+    {
+        if( ( MQTT_OUTBOX_SIZE - uxTail ) >= uxLen )
+        {
+            pxRecord = prvRecordAt( uxTail );
+        }
+        else if( uxHead >= uxLen )
+        {
+            /* Pad out the end of the ring and wrap around */
+            OutboxRecord_t * pxPadding = prvRecordAt( uxTail );
+
+            pxPadding->ulLen = ( uint32_t ) ( MQTT_OUTBOX_SIZE - uxTail );
+            pxPadding->ulInUse = 0;
+            uxUsed += pxPadding->ulLen;
+            uxTail = 0;
+
+            pxRecord = prvRecordAt( 0 );
+        }
+        else
+        {
+            /* No contiguous space */
+        }
+    }
+    else if( ( uxHead - uxTail ) >= uxLen )
+    {
+        pxRecord = prvRecordAt( uxTail );
+    }
+    else
+    {
+        /* No contiguous space */
+    }
+
+    if( pxRecord != NULL )
+    {
+        pxRecord->ulLen = ( uint32_t ) uxLen;
+        pxRecord->ulInUse = 1;
+
+        uxUsed += uxLen;
+        uxTail = ( uxTail + uxLen ) % MQTT_OUTBOX_SIZE;
+    }
+
+    return pxRecord;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Release a record and reclaim every free record at the head. Must be called from a critical section. */
+static void prvRecordFree( OutboxRecord_t * pxRecord )
+{
+    pxRecord->ulInUse = 0;
+
+    while( uxUsed > 0 )
+    {
+        OutboxRecord_t * pxOldest = prvRecordAt( uxHead );
+
+        if( pxOldest->ulInUse != 0 )
+        {
+            break;
+        }
+
+        configASSERT( pxOldest->ulLen <= uxUsed );
+
+        uxUsed -= pxOldest->ulLen;
+        uxHead = ( uxHead + pxOldest->ulLen ) % MQTT_OUTBOX_SIZE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttOutboxStore( MQTTAgentCommand_t * pxCommand )
+{
+    BaseType_t xStored = pdFALSE;
+    const MQTTPublishInfo_t * pxSrcInfo = NULL;
+    size_t uxIdx = MQTT_COMMAND_CONTEXTS_POOL_SIZE;
+
+    configASSERT( pxCommand != NULL );
+
+    if( ( pxCommand->commandType == PUBLISH ) &&
+        ( pxCommand->pArgs != NULL ) )
+    {
+        pxSrcInfo = ( const MQTTPublishInfo_t * ) pxCommand->pArgs;
+        uxIdx = Agent_GetCommandIndex( pxCommand );
+    }
+
+    if( ( pxSrcInfo != NULL ) &&
+        ( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) &&
+        ( pxSrcInfo->payloadLength > 0 ) &&
+        ( xMqttPayloadIsPooled( pxSrcInfo->pPayload ) == pdTRUE ) )
+    {
+        configASSERT( pvCommandPayloads[ uxIdx ] == NULL );
+
+        vMqttPayloadRetain( pxSrcInfo->pPayload );
+        pvCommandPayloads[ uxIdx ] = pxSrcInfo->pPayload;
+
+        taskENTER_CRITICAL();
+        xOutboxStats.ulReferenced++;
+        taskEXIT_CRITICAL();
+    }
+
+    /* A pooled payload also needs the publish info and topic copied for QoS0, the caller may return before it is sent */
+    if( ( pxSrcInfo != NULL ) &&
+        ( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) &&
+        ( ( pxSrcInfo->qos != MQTTQoS0 ) || ( pvCommandPayloads[ uxIdx ] != NULL ) ) )
+    {
+        size_t uxPayloadLen = ( pvCommandPayloads[ uxIdx ] != NULL ) ? 0U : pxSrcInfo->payloadLength;
+        size_t uxLen = OUTBOX_ALIGN( sizeof( OutboxRecord_t ) + sizeof( MQTTPublishInfo_t ) +
+                                     pxSrcInfo->topicNameLength + uxPayloadLen );
+        OutboxRecord_t * pxRecord = NULL;
+
+        configASSERT( pxCommandRecords[ uxIdx ] == NULL );
+
+        taskENTER_CRITICAL();
+        {
+            pxRecord = prvRecordAlloc( uxLen );
+
+            if( pxRecord != NULL )
+            {
+                xOutboxStats.ulStored++;
+                xOutboxStats.ulBytesInUse = ( uint32_t ) uxUsed;
+
+                if( uxUsed > xOutboxStats.ulPeakBytesInUse )
+                {
+                    xOutboxStats.ulPeakBytesInUse = ( uint32_t ) uxUsed;
+                }
+            }
+            else
+            {
+                xOutboxStats.ulFull++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        /* The record is owned by this command, fill it outside of the critical section */
+        if( pxRecord != NULL )
+        {
+            MQTTPublishInfo_t * pxInfo = ( MQTTPublishInfo_t * ) &( pxRecord[ 1 ] );
+            char * pcTopic = ( char * ) &( pxInfo[ 1 ] );
+            uint8_t * pucPayload = ( uint8_t * ) &( pcTopic[ pxSrcInfo->topicNameLength ] );
+
+            *pxInfo = *pxSrcInfo;
+
+            ( void ) memcpy( pcTopic, pxSrcInfo->pTopicName, pxSrcInfo->topicNameLength );
+            pxInfo->pTopicName = pcTopic;
+
+            if( uxPayloadLen > 0 )
+            {
+                ( void ) memcpy( pucPayload, pxSrcInfo->pPayload, pxSrcInfo->payloadLength );
+                pxInfo->pPayload = pucPayload;
+            }
+
+            pxCommandRecords[ uxIdx ] = pxRecord;
+            pxCommand->pArgs = pxInfo;
+            xStored = pdTRUE;
+        }
+    }
+
+    return xStored;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttOutboxRelease( const MQTTAgentCommand_t * pxCommand )
+{
+    size_t uxIdx = Agent_GetCommandIndex( pxCommand );
+
+    if( ( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) &&
+        ( pvCommandPayloads[ uxIdx ] != NULL ) )
+    {
+        vMqttPayloadRelease( pvCommandPayloads[ uxIdx ] );
+        pvCommandPayloads[ uxIdx ] = NULL;
+    }
+
+    if( ( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) &&
+        ( pxCommandRecords[ uxIdx ] != NULL ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            prvRecordFree( pxCommandRecords[ uxIdx ] );
+            xOutboxStats.ulBytesInUse = ( uint32_t ) uxUsed;
+        }
+        taskEXIT_CRITICAL();
+
+        pxCommandRecords[ uxIdx ] = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttOutboxGetStats( MqttOutboxStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xOutboxStats, sizeof( MqttOutboxStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_outbox.h
+ * @brief Agent owned copies of outgoing QoS1 and QoS2 publishes.
+ */
+#ifndef _MQTT_OUTBOX_H_
+#define _MQTT_OUTBOX_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt_agent.h"
+
+/**
+ * @brief Size in bytes of the ring buffer holding outgoing publishes until they are acknowledged.
+ * Must be a multiple of 8.
+ */
+#ifndef MQTT_OUTBOX_SIZE
+    #define MQTT_OUTBOX_SIZE    ( 4096U )
+#endif /* MQTT_OUTBOX_SIZE */
+
+typedef struct
+{
+    uint32_t ulStored;     /* Publishes copied into the outbox */
+    uint32_t ulFull;       /* Publishes left in the caller's buffers because the outbox was full */
+    uint32_t ulReferenced; /* Pooled payloads referenced rather than copied */
+    uint32_t ulBytesInUse;
+    uint32_t ulPeakBytesInUse;
+} MqttOutboxStats_t;
+
+/**
+ * @brief Copy the publish referenced by a PUBLISH command into the outbox and point the
+ * command at the copy, so the caller's topic and payload buffers may be reused at once.
+ * A payload from mqtt_payload_pool.h is referenced instead of copied, for any QoS.
+ *
+ * @param[in] pxCommand PUBLISH command from the command pool which has not been enqueued yet.
+ *
+ * @return pdTRUE if the publish was copied, pdFALSE if it still refers to the caller's buffers.
+ */
+BaseType_t xMqttOutboxStore( MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Free the outbox copy and the payload reference held by a command, if any. Called when
+ * the command is released.
+ *
+ * @param[in] pxCommand Command being returned to the command pool.
+ */
+void vMqttOutboxRelease( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Copy a snapshot of the outbox usage counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void vMqttOutboxGetStats( MqttOutboxStats_t * pxStats );
+
+#endif /* _MQTT_OUTBOX_H_ */
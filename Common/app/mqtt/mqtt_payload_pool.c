@@ -0,0 +1,231 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+
+/**
+ * @file mqtt_payload_pool.c
+ * @brief Reference counted publish payload buffers shared by the application tasks.
+ *
+ * Each class is a static array of equal sized buffers with one reference count per buffer, a
+ * count of 0 marking a free buffer. The classes hold a handful of buffers each, so a free one is
+ * found by scanning the counts in a critical section.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mqtt_payload_pool.h"
+
+#define PAYLOAD_CLASSES    ( 3U )
+
+static_assert( ( MQTT_PAYLOAD_POOL_SMALL_LEN % 8U ) == 0, "Buffers must stay 8 byte aligned" );
+static_assert( ( MQTT_PAYLOAD_POOL_MEDIUM_LEN % 8U ) == 0, "Buffers must stay 8 byte aligned" );
+static_assert( ( MQTT_PAYLOAD_POOL_LARGE_LEN % 8U ) == 0, "Buffers must stay 8 byte aligned" );
+static_assert( ( MQTT_PAYLOAD_POOL_SMALL_LEN < MQTT_PAYLOAD_POOL_MEDIUM_LEN ) &&
+               ( MQTT_PAYLOAD_POOL_MEDIUM_LEN < MQTT_PAYLOAD_POOL_LARGE_LEN ), "Classes must be in increasing size" );
+
+typedef struct
+{
+    uint8_t * pucBase;
+    size_t uxLen;
+    size_t uxCount;
+    uint8_t * pucRefs;
+} PayloadClass_t;
+
+static uint64_t pullSmall[ MQTT_PAYLOAD_POOL_SMALL_COUNT * MQTT_PAYLOAD_POOL_SMALL_LEN / sizeof( uint64_t ) ];
+static uint64_t pullMedium[ MQTT_PAYLOAD_POOL_MEDIUM_COUNT * MQTT_PAYLOAD_POOL_MEDIUM_LEN / sizeof( uint64_t ) ];
+static uint64_t pullLarge[ MQTT_PAYLOAD_POOL_LARGE_COUNT * MQTT_PAYLOAD_POOL_LARGE_LEN / sizeof( uint64_t ) ];
+
+static uint8_t pucSmallRefs[ MQTT_PAYLOAD_POOL_SMALL_COUNT ] = { 0 };
+static uint8_t pucMediumRefs[ MQTT_PAYLOAD_POOL_MEDIUM_COUNT ] = { 0 };
+static uint8_t pucLargeRefs[ MQTT_PAYLOAD_POOL_LARGE_COUNT ] = { 0 };
+
+static const PayloadClass_t xClasses[ PAYLOAD_CLASSES ] =
+{
+    { ( uint8_t * ) pullSmall,  MQTT_PAYLOAD_POOL_SMALL_LEN,  MQTT_PAYLOAD_POOL_SMALL_COUNT,  pucSmallRefs  },
+    { ( uint8_t * ) pullMedium, MQTT_PAYLOAD_POOL_MEDIUM_LEN, MQTT_PAYLOAD_POOL_MEDIUM_COUNT, pucMediumRefs },
+    { ( uint8_t * ) pullLarge,  MQTT_PAYLOAD_POOL_LARGE_LEN,  MQTT_PAYLOAD_POOL_LARGE_COUNT,  pucLargeRefs  },
+};
+
+static MqttPayloadPoolStats_t xPoolStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+/* Find the class and index of the buffer holding pvPayload, returns NULL if it is not pooled */
+static const PayloadClass_t * prvLookup( const void * pvPayload,
+                                         size_t * puxIdx )
+{
+    const PayloadClass_t * pxClass = NULL;
+    const uint8_t * pucPayload = ( const uint8_t * ) pvPayload;
+
+    for( size_t uxClass = 0; ( uxClass < PAYLOAD_CLASSES ) && ( pxClass == NULL ); uxClass++ )
+    {
+        const PayloadClass_t * pxCandidate = &( xClasses[ uxClass ] );
+
+        if( ( pucPayload >= pxCandidate->pucBase ) &&
+            ( pucPayload < ( pxCandidate->pucBase + ( pxCandidate->uxLen * pxCandidate->uxCount ) ) ) )
+        {
+            pxClass = pxCandidate;
+            *puxIdx = ( size_t ) ( pucPayload - pxCandidate->pucBase ) / pxCandidate->uxLen;
+        }
+    }
+
+    return pxClass;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvMqttPayloadAlloc( size_t uxLen )
+{
+    void * pvPayload = NULL;
+
+    taskENTER_CRITICAL();
+    {
+        for( size_t uxClass = 0; ( uxClass < PAYLOAD_CLASSES ) && ( pvPayload == NULL ); uxClass++ )
+        {
+            const PayloadClass_t * pxClass = &( xClasses[ uxClass ] );
+
+            if( uxLen > pxClass->uxLen )
+            {
+                continue;
+            }
+
+            for( size_t uxIdx = 0; uxIdx < pxClass->uxCount; uxIdx++ )
+            {
+                if( pxClass->pucRefs[ uxIdx ] == 0 )
+                {
+                    pxClass->pucRefs[ uxIdx ] = 1;
+                    pvPayload = &( pxClass->pucBase[ uxIdx * pxClass->uxLen ] );
+                    break;
+                }
+            }
+
+            if( ( pvPayload != NULL ) && ( uxClass > 0 ) && ( uxLen <= xClasses[ uxClass - 1 ].uxLen ) )
+            {
+                xPoolStats.ulFallbacks++;
+            }
+        }
+
+        if( pvPayload != NULL )
+        {
+            xPoolStats.ulAllocs++;
+            xPoolStats.ulInUse++;
+
+            if( xPoolStats.ulInUse > xPoolStats.ulPeakInUse )
+            {
+                xPoolStats.ulPeakInUse = xPoolStats.ulInUse;
+            }
+        }
+        else
+        {
+            xPoolStats.ulFailed++;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return pvPayload;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxMqttPayloadCapacity( const void * pvPayload )
+{
+    size_t uxIdx = 0;
+    const PayloadClass_t * pxClass = prvLookup( pvPayload, &uxIdx );
+
+    return ( pxClass != NULL ) ? pxClass->uxLen : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttPayloadIsPooled( const void * pvPayload )
+{
+    size_t uxIdx = 0;
+
+    return ( prvLookup( pvPayload, &uxIdx ) != NULL ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttPayloadRetain( const void * pvPayload )
+{
+    size_t uxIdx = 0;
+    const PayloadClass_t * pxClass = prvLookup( pvPayload, &uxIdx );
+
+    configASSERT( pxClass != NULL );
+
+    if( pxClass != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            configASSERT( ( pxClass->pucRefs[ uxIdx ] > 0 ) && ( pxClass->pucRefs[ uxIdx ] < UINT8_MAX ) );
+            pxClass->pucRefs[ uxIdx ]++;
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttPayloadRelease( const void * pvPayload )
+{
+    size_t uxIdx = 0;
+    const PayloadClass_t * pxClass = prvLookup( pvPayload, &uxIdx );
+
+    if( pxClass != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            configASSERT( pxClass->pucRefs[ uxIdx ] > 0 );
+            pxClass->pucRefs[ uxIdx ]--;
+
+            if( pxClass->pucRefs[ uxIdx ] == 0 )
+            {
+                xPoolStats.ulInUse--;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttPayloadGetStats( MqttPayloadPoolStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xPoolStats, sizeof( MqttPayloadPoolStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+
+/**
+ * @file mqtt_payload_pool.h
+ * @brief Reference counted publish payload buffers shared by the application tasks.
+ */
+#ifndef _MQTT_PAYLOAD_POOL_H_
+#define _MQTT_PAYLOAD_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * A publisher takes a buffer with pvMqttPayloadAlloc, fills it and publishes it. The agent takes
+ * a reference to a pooled payload when the PUBLISH command is queued and drops it when the
+ * command is released, i.e. once a QoS0 publish was sent or a QoS1 or QoS2 one acknowledged. The
+ * publisher drops its own reference with vMqttPayloadRelease as soon as it no longer needs the
+ * buffer, which may be right after MQTTAgent_Publish returned. The outbox then keeps only the
+ * topic of the publish, not a copy of the payload.
+ *
+ * Buffers come in three size classes. A request is served from the smallest class it fits in,
+ * or from a larger one when that class is used up.
+ */
+
+#ifndef MQTT_PAYLOAD_POOL_SMALL_LEN
+    #define MQTT_PAYLOAD_POOL_SMALL_LEN    ( 128U )
+#endif
+
+#ifndef MQTT_PAYLOAD_POOL_SMALL_COUNT
+    #define MQTT_PAYLOAD_POOL_SMALL_COUNT    ( 8U )
+#endif
+
+#ifndef MQTT_PAYLOAD_POOL_MEDIUM_LEN
+    #define MQTT_PAYLOAD_POOL_MEDIUM_LEN    ( 512U )
+#endif
+
+#ifndef MQTT_PAYLOAD_POOL_MEDIUM_COUNT
+    #define MQTT_PAYLOAD_POOL_MEDIUM_COUNT    ( 4U )
+#endif
+
+#ifndef MQTT_PAYLOAD_POOL_LARGE_LEN
+    #define MQTT_PAYLOAD_POOL_LARGE_LEN    ( 768U )
+#endif
+
+#ifndef MQTT_PAYLOAD_POOL_LARGE_COUNT
+    #define MQTT_PAYLOAD_POOL_LARGE_COUNT    ( 6U )
+#endif
+
+#define MQTT_PAYLOAD_POOL_MAX_LEN    MQTT_PAYLOAD_POOL_LARGE_LEN
+
+typedef struct
+{
+    uint32_t ulAllocs;
+    uint32_t ulFallbacks; /* Served from a larger class because the matching one was used up */
+    uint32_t ulFailed;    /* Too long, or every class it fits in was used up */
+    uint32_t ulInUse;
+    uint32_t ulPeakInUse;
+} MqttPayloadPoolStats_t;
+
+/**
+ * @brief Take a buffer of at least uxLen bytes, held by one reference.
+ *
+ * @return The buffer, or NULL if none is free. Does not block.
+ */
+void * pvMqttPayloadAlloc( size_t uxLen );
+
+/**
+ * @brief Usable length of a pooled buffer, which may be more than was asked for.
+ */
+size_t uxMqttPayloadCapacity( const void * pvPayload );
+
+/**
+ * @brief pdTRUE if pvPayload points anywhere inside a pooled buffer.
+ */
+BaseType_t xMqttPayloadIsPooled( const void * pvPayload );
+
+/**
+ * @brief Add a reference to the pooled buffer holding pvPayload.
+ */
+void vMqttPayloadRetain( const void * pvPayload );
+
+/**
+ * @brief Drop a reference to the pooled buffer holding pvPayload, which is freed with the last
+ * one. Does nothing for a NULL or non pooled pointer.
+ */
+void vMqttPayloadRelease( const void * pvPayload );
+
+/**
+ * @brief Copy a snapshot of the pool usage counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void vMqttPayloadGetStats( MqttPayloadPoolStats_t * pxStats );
+
+#endif /* _MQTT_PAYLOAD_POOL_H_ */
@@ -0,0 +1,438 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_policy.c
+ * @brief Per topic QoS, rate limit and priority of outgoing publishes.
+ *
+ * The rate limit is a token bucket per policy entry. A publish reserves its token
+ * when it is checked, possibly driving the bucket into debt, and the publishing
+ * task then sleeps until the debt is repaid. Tasks publishing to the same entry so
+ * get their turn in order, and the agent queue never holds more than the burst.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdlib.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "static_alloc.h"
+
+#include "core_mqtt.h"
+#include "kvstore.h"
+#include "mqtt_policy.h"
+#include "freertos_command_pool.h"
+
+/* Bucket credit gained per ms at a rate of one publish per minute, and spent per publish */
+#define POLICY_CREDIT_PER_PUBLISH    ( 60000 )
+
+#define POLICY_MAX_RATE              ( 60000U ) /* Publishes per minute */
+#define POLICY_MAX_BURST             ( 1000U )
+
+typedef struct
+{
+    const char * pcFilter;
+    uint16_t usFilterLen;
+    int8_t cQoS; /* -1 keeps the QoS requested by the publishing task */
+    MqttPolicyPriority_t xPriority;
+    uint32_t ulRatePerMin;
+    uint32_t ulBurst;
+    int32_t lCredit;
+    TickType_t xLastRefill;
+} PolicyEntry_t;
+
+/* Two copies of the table, a new policy is parsed into the inactive one */
+typedef struct
+{
+    char pcPolicy[ MQTT_POLICY_LEN ];
+    PolicyEntry_t pxEntries[ MQTT_POLICY_MAX_ENTRIES ];
+    size_t uxCount;
+} PolicyTable_t;
+
+static PolicyTable_t pxTables[ 2 ] = { 0 };
+static PolicyTable_t * pxActive = &( pxTables[ 0 ] );
+
+static SemaphoreHandle_t xPolicyMutex = NULL;
+static volatile BaseType_t xPolicyChanged = pdFALSE;
+
+static uint8_t pucCommandPriority[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ] = { 0 };
+
+static MqttPolicyStats_t xPolicyStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseEntry( char * pcEntry,
+                                 PolicyEntry_t * pxEntry )
+{
+    char * pcSave = NULL;
+    char * pcField = strtok_r( pcEntry, ",", &pcSave );
+    BaseType_t xResult = ( pcField != NULL ) ? pdTRUE : pdFALSE;
+
+    if( xResult == pdTRUE )
+    {
+        *pxEntry = ( PolicyEntry_t ) {
+            .pcFilter    = pcField,
+            .usFilterLen = ( uint16_t ) strlen( pcField ),
+            .cQoS        = -1,
+            .xPriority   = eMqttPolicyPrioNormal,
+            .ulBurst     = 1,
+        };
+    }
+
+    for( pcField = strtok_r( NULL, ",", &pcSave );
+         ( pcField != NULL ) && ( xResult == pdTRUE );
+         pcField = strtok_r( NULL, ",", &pcSave ) )
+    {
+        char * pcValue = strchr( pcField, '=' );
+        char * pcEnd = NULL;
+        unsigned long ulValue = 0;
+        BaseType_t xNumeric = pdFALSE;
+
+        if( pcValue != NULL )
+        {
+            *pcValue = '\0';
+            pcValue++;
+            ulValue = strtoul( pcValue, &pcEnd, 10 );
+            xNumeric = ( ( pcEnd != pcValue ) && ( *pcEnd == '\0' ) ) ? pdTRUE : pdFALSE;
+        }
+
+        if( pcValue == NULL )
+        {
+            xResult = pdFALSE;
+        }
+        else if( strcmp( pcField, "qos" ) == 0 )
+        {
+            xResult = ( ( xNumeric == pdTRUE ) && ( ulValue <= MQTTQoS2 ) ) ? pdTRUE : pdFALSE;
+            pxEntry->cQoS = ( int8_t ) ulValue;
+        }
+        else if( strcmp( pcField, "rate" ) == 0 )
+        {
+            xResult = ( ( xNumeric == pdTRUE ) && ( ulValue <= POLICY_MAX_RATE ) ) ? pdTRUE : pdFALSE;
+            pxEntry->ulRatePerMin = ( uint32_t ) ulValue;
+        }
+        else if( strcmp( pcField, "burst" ) == 0 )
+        {
+            xResult = ( ( xNumeric == pdTRUE ) && ( ulValue >= 1 ) && ( ulValue <= POLICY_MAX_BURST ) ) ? pdTRUE : pdFALSE;
+            pxEntry->ulBurst = ( uint32_t ) ulValue;
+        }
+        else if( strcmp( pcField, "prio" ) == 0 )
+        {
+            if( strcmp( pcValue, "low" ) == 0 )
+            {
+                pxEntry->xPriority = eMqttPolicyPrioLow;
+            }
+            else if( strcmp( pcValue, "high" ) == 0 )
+            {
+                pxEntry->xPriority = eMqttPolicyPrioHigh;
+            }
+            else
+            {
+                xResult = pdFALSE;
+            }
+        }
+        else
+        {
+            xResult = pdFALSE;
+        }
+    }
+
+    /* A full bucket to start with */
+    pxEntry->lCredit = ( int32_t ) pxEntry->ulBurst * POLICY_CREDIT_PER_PUBLISH;
+    pxEntry->xLastRefill = xTaskGetTickCount();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Parse the policy held in pxTable->pcPolicy in place */
+static BaseType_t prvParsePolicy( PolicyTable_t * pxTable )
+{
+    char * pcSave = NULL;
+    BaseType_t xResult = pdTRUE;
+
+    pxTable->uxCount = 0;
+
+    for( char * pcEntry = strtok_r( pxTable->pcPolicy, ";", &pcSave );
+         ( pcEntry != NULL ) && ( xResult == pdTRUE );
+         pcEntry = strtok_r( NULL, ";", &pcSave ) )
+    {
+        if( pxTable->uxCount >= MQTT_POLICY_MAX_ENTRIES )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            xResult = prvParseEntry( pcEntry, &( pxTable->pxEntries[ pxTable->uxCount ] ) );
+            pxTable->uxCount++;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with xPolicyMutex held */
+static void prvLoadPolicy( void )
+{
+    PolicyTable_t * pxNext = ( pxActive == &( pxTables[ 0 ] ) ) ? &( pxTables[ 1 ] ) : &( pxTables[ 0 ] );
+
+    ( void ) KVStore_getString( CS_MQTT_PUBLISH_POLICY, pxNext->pcPolicy, sizeof( pxNext->pcPolicy ) );
+
+    if( prvParsePolicy( pxNext ) == pdTRUE )
+    {
+        pxActive = pxNext;
+        LogInfo( "Loaded %u mqtt_policy entries.", ( unsigned int ) pxActive->uxCount );
+    }
+    else
+    {
+        LogError( "Ignored invalid mqtt_policy key." );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPolicyChangedCallback( KVStoreKey_t xKey,
+                                      void * pvCtx )
+{
+    ( void ) xKey;
+    ( void ) pvCtx;
+
+    xPolicyChanged = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static PolicyEntry_t * prvMatchEntry( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    PolicyEntry_t * pxMatch = NULL;
+
+    for( size_t uxIdx = 0; ( pxMatch == NULL ) && ( uxIdx < pxActive->uxCount ); uxIdx++ )
+    {
+        PolicyEntry_t * pxEntry = &( pxActive->pxEntries[ uxIdx ] );
+        bool xIsMatch = false;
+
+        ( void ) MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                                  pxPublishInfo->topicNameLength,
+                                  pxEntry->pcFilter,
+                                  pxEntry->usFilterLen,
+                                  &xIsMatch );
+
+        if( xIsMatch == true )
+        {
+            pxMatch = pxEntry;
+        }
+    }
+
+    return pxMatch;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reserve the credit of one publish, returns the time in ms until the bucket is out of debt */
+static uint32_t prvReserveCredit( PolicyEntry_t * pxEntry )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    int32_t lMaxCredit = ( int32_t ) pxEntry->ulBurst * POLICY_CREDIT_PER_PUBLISH;
+    uint64_t ullGain = ( uint64_t ) ( xNow - pxEntry->xLastRefill ) * portTICK_PERIOD_MS * pxEntry->ulRatePerMin;
+    uint32_t ulWaitMs = 0;
+
+    pxEntry->xLastRefill = xNow;
+
+    if( ullGain >= ( uint64_t ) ( lMaxCredit - pxEntry->lCredit ) )
+    {
+        pxEntry->lCredit = lMaxCredit;
+    }
+    else
+    {
+        pxEntry->lCredit += ( int32_t ) ullGain;
+    }
+
+    pxEntry->lCredit -= POLICY_CREDIT_PER_PUBLISH;
+
+    if( pxEntry->lCredit < 0 )
+    {
+        ulWaitMs = ( ( uint32_t ) -pxEntry->lCredit + pxEntry->ulRatePerMin - 1 ) / pxEntry->ulRatePerMin;
+    }
+
+    return ulWaitMs;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttPolicyInit( void )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( xPolicyMutex == NULL )
+    {
+        xPolicyMutex = xAppSemaphoreCreateMutex();
+
+        if( xPolicyMutex == NULL )
+        {
+            LogError( "Failed to allocate the policy mutex." );
+            xResult = pdFALSE;
+        }
+        else
+        {
+            ( void ) xSemaphoreTake( xPolicyMutex, portMAX_DELAY );
+            prvLoadPolicy();
+            ( void ) xSemaphoreGive( xPolicyMutex );
+
+            ( void ) KVStore_subscribe( CS_MQTT_PUBLISH_POLICY, prvPolicyChangedCallback, NULL );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttPolicyApply( MQTTAgentCommand_t * pxCommand,
+                             uint32_t ulBlockTimeMs )
+{
+    MQTTPublishInfo_t * pxPublishInfo = ( MQTTPublishInfo_t * ) pxCommand->pArgs;
+    MqttPolicyPriority_t xPriority = eMqttPolicyPrioNormal;
+    uint32_t ulWaitMs = 0;
+    BaseType_t xResult = pdTRUE;
+
+    if( ( xPolicyMutex != NULL ) &&
+        ( pxPublishInfo != NULL ) &&
+        ( xSemaphoreTake( xPolicyMutex, portMAX_DELAY ) == pdTRUE ) )
+    {
+        PolicyEntry_t * pxEntry = NULL;
+
+        if( xPolicyChanged == pdTRUE )
+        {
+            xPolicyChanged = pdFALSE;
+            prvLoadPolicy();
+        }
+
+        pxEntry = prvMatchEntry( pxPublishInfo );
+
+        if( pxEntry != NULL )
+        {
+            xPriority = pxEntry->xPriority;
+
+            if( ( pxEntry->cQoS >= 0 ) &&
+                ( pxPublishInfo->qos != ( MQTTQoS_t ) pxEntry->cQoS ) )
+            {
+                pxPublishInfo->qos = ( MQTTQoS_t ) pxEntry->cQoS;
+                xPolicyStats.ulQoSChanged++;
+            }
+
+            if( pxEntry->ulRatePerMin > 0 )
+            {
+                ulWaitMs = prvReserveCredit( pxEntry );
+
+                if( ulWaitMs > ulBlockTimeMs )
+                {
+                    /* Give the reservation back, the publish is not sent */
+                    pxEntry->lCredit += POLICY_CREDIT_PER_PUBLISH;
+                    xPolicyStats.ulRejected++;
+                    xResult = pdFALSE;
+                }
+                else if( ulWaitMs > 0 )
+                {
+                    xPolicyStats.ulLimited++;
+                }
+                else
+                {
+                    /* Within the burst */
+                }
+            }
+
+            if( ( xResult == pdTRUE ) &&
+                ( xPriority == eMqttPolicyPrioHigh ) )
+            {
+                xPolicyStats.ulHighPriority++;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xPolicyMutex );
+    }
+
+    if( xResult == pdTRUE )
+    {
+        size_t uxIdx = Agent_GetCommandIndex( pxCommand );
+
+        if( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE )
+        {
+            pucCommandPriority[ uxIdx ] = ( uint8_t ) xPriority;
+        }
+
+        if( ulWaitMs > 0 )
+        {
+            LogDebug( "Delaying publish to %.*s by %lu ms.",
+                      pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName, ulWaitMs );
+            vTaskDelay( pdMS_TO_TICKS( ulWaitMs ) + 1 );
+        }
+    }
+    else
+    {
+        LogWarn( "Publish to %.*s refused by the rate limit.",
+                 pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+MqttPolicyPriority_t xMqttPolicyGetPriority( const MQTTAgentCommand_t * pxCommand )
+{
+    MqttPolicyPriority_t xPriority = eMqttPolicyPrioNormal;
+    size_t uxIdx = Agent_GetCommandIndex( pxCommand );
+
+    if( ( pxCommand->commandType == PUBLISH ) &&
+        ( uxIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) )
+    {
+        xPriority = ( MqttPolicyPriority_t ) pucCommandPriority[ uxIdx ];
+    }
+
+    return xPriority;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttPolicyGetStats( MqttPolicyStats_t * pxStats )
+{
+    if( ( pxStats != NULL ) &&
+        ( xPolicyMutex != NULL ) &&
+        ( xSemaphoreTake( xPolicyMutex, portMAX_DELAY ) == pdTRUE ) )
+    {
+        ( void ) memcpy( pxStats, &xPolicyStats, sizeof( MqttPolicyStats_t ) );
+        ( void ) xSemaphoreGive( xPolicyMutex );
+    }
+}
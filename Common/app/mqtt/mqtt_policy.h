@@ -0,0 +1,114 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_policy.h
+ * @brief Per topic QoS, rate limit and priority of outgoing publishes.
+ *
+ * The policy is read from the mqtt_policy kvstore key, which holds entries separated
+ * by ';'. Each entry is a topic filter followed by any of these ',' separated fields:
+ * - qos=<0-2>: QoS used instead of the one requested by the publishing task.
+ * - rate=<n>: Publishes per minute, 0 or absent for no limit.
+ * - burst=<n>: Publishes which may be sent back to back, 1 by default.
+ * - prio=<low|high>: Low priority publishes are coalesced with other traffic, high
+ *   priority ones jump the agent queue and are sent at once.
+ *
+ * For example "+/env_sensor_data,rate=60,burst=3,prio=low;+/ota/#,prio=high".
+ * The first entry matching the topic of a publish applies.
+ */
+#ifndef _MQTT_POLICY_H_
+#define _MQTT_POLICY_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt_agent.h"
+
+/**
+ * @brief Longest mqtt_policy kvstore value.
+ */
+#ifndef MQTT_POLICY_LEN
+    #define MQTT_POLICY_LEN    ( 128U )
+#endif /* MQTT_POLICY_LEN */
+
+#ifndef MQTT_POLICY_MAX_ENTRIES
+    #define MQTT_POLICY_MAX_ENTRIES    ( 8U )
+#endif /* MQTT_POLICY_MAX_ENTRIES */
+
+typedef enum
+{
+    eMqttPolicyPrioNormal = 0,
+    eMqttPolicyPrioLow,
+    eMqttPolicyPrioHigh
+} MqttPolicyPriority_t;
+
+typedef struct
+{
+    uint32_t ulLimited;     /* Publishes which waited for the rate limit */
+    uint32_t ulRejected;    /* Publishes refused, the rate limit did not allow them within the block time */
+    uint32_t ulQoSChanged;  /* Publishes sent with the QoS of their policy entry */
+    uint32_t ulHighPriority;
+} MqttPolicyStats_t;
+
+/**
+ * @brief Load the policy and follow changes of the mqtt_policy key. Called from the agent
+ * task context init, does nothing once done.
+ *
+ * @return pdTRUE on success.
+ */
+BaseType_t xMqttPolicyInit( void );
+
+/**
+ * @brief Apply the policy to a PUBLISH command before it is enqueued.
+ *
+ * The QoS of the publish info referenced by the command is updated in place. When the rate
+ * limit of the matching entry is reached, the calling task is delayed for up to ulBlockTimeMs.
+ *
+ * @param[in] pxCommand PUBLISH command from the command pool.
+ * @param[in] ulBlockTimeMs Longest time to wait for the rate limit.
+ *
+ * @return pdTRUE if the command may be enqueued, pdFALSE if the rate limit refused it.
+ */
+BaseType_t xMqttPolicyApply( MQTTAgentCommand_t * pxCommand,
+                             uint32_t ulBlockTimeMs );
+
+/**
+ * @brief Priority which xMqttPolicyApply assigned to a command.
+ *
+ * @param[in] pxCommand Command from the command pool.
+ *
+ * @return eMqttPolicyPrioNormal for commands other than policy checked publishes.
+ */
+MqttPolicyPriority_t xMqttPolicyGetPriority( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Copy a snapshot of the policy counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void vMqttPolicyGetStats( MqttPolicyStats_t * pxStats );
+
+#endif /* _MQTT_POLICY_H_ */
@@ -0,0 +1,602 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_stream.c
+ * @brief Chunked delivery of incoming publishes larger than the agent network buffer.
+ *
+ * Sits between coreMQTT and the TLS transport and reads one packet at a time.
+ * The fixed header of each packet is read first: packets which fit in the
+ * network buffer are copied to coreMQTT unchanged, while an oversized PUBLISH
+ * is consumed here and its payload handed to the matching stream callback in
+ * MQTT_STREAM_CHUNK_SIZE pieces as it is decrypted. coreMQTT never sees these
+ * publishes, so QoS1 ones are acknowledged from here once fully received.
+ * Reading resumes where it stopped whenever the transport runs out of data.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "core_mqtt_serializer.h"
+#include "mqtt_stream.h"
+
+/* Fixed header byte and up to four bytes of remaining length */
+#define STREAM_FIXED_HEADER_MAX    ( 5U )
+
+typedef enum
+{
+    StreamFixedHeader = 0, /* Reading the fixed header of the next packet */
+    StreamPassThrough,     /* Copying the current packet to coreMQTT */
+    StreamTopicLength,
+    StreamTopic,
+    StreamPacketId,
+    StreamPayload
+} StreamState_t;
+
+typedef struct
+{
+    const char * pcTopicFilter;
+    MqttStreamCallback_t pxCallback;
+    void * pvCtx;
+} StreamHandler_t;
+
+typedef struct
+{
+    StreamState_t xState;
+    TransportRecv_t xRecv;
+    TransportSend_t xSend;
+
+    uint8_t pucHeader[ STREAM_FIXED_HEADER_MAX ];
+    size_t uxHeaderLen;
+    size_t uxHeaderCopied; /* Fixed header bytes already passed to coreMQTT */
+    uint32_t ulRemaining;  /* Bytes of the current packet left to read after the fixed header */
+
+    uint8_t pucField[ 2 ]; /* Topic length or packet identifier being read */
+    size_t uxFieldLen;
+    uint16_t usTopicRead;
+    uint16_t usPacketId;
+
+    MqttStreamCallback_t pxCallback; /* NULL while a publish is discarded */
+    void * pvCtx;
+    MqttStreamChunk_t xChunk;
+
+    char pcTopic[ MQTT_STREAM_MAX_TOPIC_LEN ];
+    uint8_t pucChunk[ MQTT_STREAM_CHUNK_SIZE ];
+    size_t uxChunkLen;
+} StreamParser_t;
+
+static StreamHandler_t xHandlers[ MQTT_STREAM_MAX_HANDLERS ] = { 0 };
+
+/* Only used by the MQTT agent task */
+static StreamParser_t xParser = { 0 };
+
+static MqttStreamStats_t xStreamStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttStreamRegister( const char * pcTopicFilter,
+                                MqttStreamCallback_t pxCallback,
+                                void * pvCtx )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    configASSERT( pcTopicFilter != NULL );
+    configASSERT( pxCallback != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        for( size_t uxIdx = 0; ( uxIdx < MQTT_STREAM_MAX_HANDLERS ) && ( xSuccess == pdFALSE ); uxIdx++ )
+        {
+            if( xHandlers[ uxIdx ].pxCallback == NULL )
+            {
+                xHandlers[ uxIdx ].pcTopicFilter = pcTopicFilter;
+                xHandlers[ uxIdx ].pxCallback = pxCallback;
+                xHandlers[ uxIdx ].pvCtx = pvCtx;
+                xSuccess = pdTRUE;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttStreamUnregister( const char * pcTopicFilter,
+                            MqttStreamCallback_t pxCallback,
+                            void * pvCtx )
+{
+    taskENTER_CRITICAL();
+    {
+        for( size_t uxIdx = 0; uxIdx < MQTT_STREAM_MAX_HANDLERS; uxIdx++ )
+        {
+            if( ( xHandlers[ uxIdx ].pcTopicFilter == pcTopicFilter ) &&
+                ( xHandlers[ uxIdx ].pxCallback == pxCallback ) &&
+                ( xHandlers[ uxIdx ].pvCtx == pvCtx ) )
+            {
+                xHandlers[ uxIdx ].pxCallback = NULL;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+/* Find the handler of the topic just read, leaving pxCallback NULL if none matches */
+static void prvFindHandler( void )
+{
+    xParser.pxCallback = NULL;
+    xParser.pvCtx = NULL;
+
+    taskENTER_CRITICAL();
+    {
+        for( size_t uxIdx = 0; ( uxIdx < MQTT_STREAM_MAX_HANDLERS ) && ( xParser.pxCallback == NULL ); uxIdx++ )
+        {
+            bool xMatch = false;
+
+            if( xHandlers[ uxIdx ].pxCallback != NULL )
+            {
+                ( void ) MQTT_MatchTopic( xParser.pcTopic,
+                                          xParser.xChunk.usTopicLen,
+                                          xHandlers[ uxIdx ].pcTopicFilter,
+                                          ( uint16_t ) strlen( xHandlers[ uxIdx ].pcTopicFilter ),
+                                          &xMatch );
+            }
+
+            if( xMatch )
+            {
+                xParser.pxCallback = xHandlers[ uxIdx ].pxCallback;
+                xParser.pvCtx = xHandlers[ uxIdx ].pvCtx;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDeliverChunk( void )
+{
+    if( xParser.pxCallback != NULL )
+    {
+        xParser.xChunk.pucData = xParser.pucChunk;
+        xParser.xChunk.uxLen = xParser.uxChunkLen;
+        xParser.xChunk.xAborted = pdFALSE;
+
+        xParser.pxCallback( xParser.pvCtx, &( xParser.xChunk ) );
+
+        xStreamStats.ulChunks++;
+        xStreamStats.ulBytes += ( uint32_t ) xParser.uxChunkLen;
+    }
+
+    xParser.xChunk.ulOffset += ( uint32_t ) xParser.uxChunkLen;
+    xParser.uxChunkLen = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvEndPublish( NetworkContext_t * pxNetworkContext )
+{
+    if( xParser.pxCallback != NULL )
+    {
+        xStreamStats.ulStreamed++;
+    }
+    else
+    {
+        LogWarn( "Discarded a %lu byte QoS%d publish on %.*s.",
+                 xParser.xChunk.ulTotalLen,
+                 ( int ) xParser.xChunk.xQoS,
+                 ( int ) ( ( xParser.xChunk.usTopicLen < MQTT_STREAM_MAX_TOPIC_LEN ) ?
+                           xParser.xChunk.usTopicLen : MQTT_STREAM_MAX_TOPIC_LEN ),
+                 xParser.pcTopic );
+        xStreamStats.ulDiscarded++;
+    }
+
+    /* Discarded publishes are acknowledged too, the broker would only send them again */
+    if( xParser.xChunk.xQoS == MQTTQoS1 )
+    {
+        uint8_t pucAck[ MQTT_PUBLISH_ACK_PACKET_SIZE ];
+        MQTTFixedBuffer_t xAckBuffer = { .pBuffer = pucAck, .size = sizeof( pucAck ) };
+
+        if( ( MQTT_SerializeAck( &xAckBuffer, MQTT_PACKET_TYPE_PUBACK, xParser.usPacketId ) != MQTTSuccess ) ||
+            ( xParser.xSend( pxNetworkContext, pucAck, sizeof( pucAck ) ) != ( int32_t ) sizeof( pucAck ) ) )
+        {
+            LogError( "Failed to send the PUBACK of packet %u.", xParser.usPacketId );
+        }
+    }
+
+    xParser.pxCallback = NULL;
+    xParser.uxHeaderLen = 0;
+    xParser.xState = StreamFixedHeader;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvStartPayload( NetworkContext_t * pxNetworkContext )
+{
+    xParser.xChunk.ulOffset = 0;
+    xParser.xChunk.ulTotalLen = xParser.ulRemaining;
+    xParser.uxChunkLen = 0;
+    xParser.xState = StreamPayload;
+
+    if( xParser.ulRemaining == 0U )
+    {
+        prvDeliverChunk();
+        prvEndPublish( pxNetworkContext );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvEndTopic( NetworkContext_t * pxNetworkContext )
+{
+    xParser.pxCallback = NULL;
+
+    /* QoS2 publishes would need the PUBREC / PUBREL exchange owned by coreMQTT */
+    if( ( xParser.xChunk.usTopicLen <= MQTT_STREAM_MAX_TOPIC_LEN ) &&
+        ( xParser.xChunk.xQoS != MQTTQoS2 ) )
+    {
+        prvFindHandler();
+    }
+
+    if( xParser.xChunk.xQoS != MQTTQoS0 )
+    {
+        xParser.uxFieldLen = 0;
+        xParser.xState = StreamPacketId;
+    }
+    else
+    {
+        prvStartPayload( pxNetworkContext );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Account for uxLen bytes of the streamed publish read at the current state */
+static void prvStreamConsumed( NetworkContext_t * pxNetworkContext,
+                               size_t uxLen )
+{
+    xParser.ulRemaining -= ( uint32_t ) uxLen;
+
+    switch( xParser.xState )
+    {
+        case StreamTopicLength:
+            xParser.uxFieldLen += uxLen;
+
+            if( xParser.uxFieldLen == sizeof( xParser.pucField ) )
+            {
+                xParser.xChunk.usTopicLen = ( uint16_t ) ( ( xParser.pucField[ 0 ] << 8 ) | xParser.pucField[ 1 ] );
+                xParser.usTopicRead = 0;
+                xParser.xState = StreamTopic;
+
+                if( xParser.xChunk.usTopicLen == 0U )
+                {
+                    prvEndTopic( pxNetworkContext );
+                }
+            }
+
+            break;
+
+        case StreamTopic:
+            xParser.usTopicRead += ( uint16_t ) uxLen;
+
+            if( xParser.usTopicRead == xParser.xChunk.usTopicLen )
+            {
+                prvEndTopic( pxNetworkContext );
+            }
+
+            break;
+
+        case StreamPacketId:
+            xParser.uxFieldLen += uxLen;
+
+            if( xParser.uxFieldLen == sizeof( xParser.pucField ) )
+            {
+                xParser.usPacketId = ( uint16_t ) ( ( xParser.pucField[ 0 ] << 8 ) | xParser.pucField[ 1 ] );
+                prvStartPayload( pxNetworkContext );
+            }
+
+            break;
+
+        default:
+            xParser.uxChunkLen += uxLen;
+
+            if( ( xParser.uxChunkLen == sizeof( xParser.pucChunk ) ) ||
+                ( xParser.ulRemaining == 0U ) )
+            {
+                prvDeliverChunk();
+            }
+
+            if( xParser.ulRemaining == 0U )
+            {
+                prvEndPublish( pxNetworkContext );
+            }
+
+            break;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Read the next part of a streamed publish, returns the transport result */
+static int32_t prvStreamRead( NetworkContext_t * pxNetworkContext )
+{
+    uint8_t * pucDest;
+    size_t uxWant;
+    int32_t lResult = -1;
+
+    switch( xParser.xState )
+    {
+        case StreamTopicLength:
+        case StreamPacketId:
+            pucDest = &( xParser.pucField[ xParser.uxFieldLen ] );
+            uxWant = sizeof( xParser.pucField ) - xParser.uxFieldLen;
+            break;
+
+        case StreamTopic:
+            uxWant = ( size_t ) xParser.xChunk.usTopicLen - xParser.usTopicRead;
+
+            if( xParser.usTopicRead < MQTT_STREAM_MAX_TOPIC_LEN )
+            {
+                pucDest = ( uint8_t * ) &( xParser.pcTopic[ xParser.usTopicRead ] );
+
+                if( uxWant > ( MQTT_STREAM_MAX_TOPIC_LEN - xParser.usTopicRead ) )
+                {
+                    uxWant = MQTT_STREAM_MAX_TOPIC_LEN - xParser.usTopicRead;
+                }
+            }
+            else
+            {
+                /* The end of a topic too long to be matched is skipped through the chunk buffer */
+                pucDest = xParser.pucChunk;
+                uxWant = ( uxWant < sizeof( xParser.pucChunk ) ) ? uxWant : sizeof( xParser.pucChunk );
+            }
+
+            break;
+
+        default:
+            pucDest = &( xParser.pucChunk[ xParser.uxChunkLen ] );
+            uxWant = sizeof( xParser.pucChunk ) - xParser.uxChunkLen;
+            break;
+    }
+
+    if( uxWant > xParser.ulRemaining )
+    {
+        uxWant = xParser.ulRemaining;
+    }
+
+    if( uxWant == 0U )
+    {
+        /* The remaining length ends within the variable header */
+        LogError( "Malformed PUBLISH packet." );
+    }
+    else
+    {
+        lResult = xParser.xRecv( pxNetworkContext, pucDest, uxWant );
+
+        if( lResult > 0 )
+        {
+            prvStreamConsumed( pxNetworkContext, ( size_t ) lResult );
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Decode the remaining length and choose between passing the packet on and streaming it */
+static void prvStartPacket( void )
+{
+    uint32_t ulMultiplier = 1;
+    uint8_t ucLast = xParser.pucHeader[ xParser.uxHeaderLen - 1U ];
+
+    xParser.ulRemaining = 0;
+    xParser.uxHeaderCopied = 0;
+
+    for( size_t uxIdx = 1; uxIdx < xParser.uxHeaderLen; uxIdx++ )
+    {
+        xParser.ulRemaining += ( xParser.pucHeader[ uxIdx ] & 0x7FU ) * ulMultiplier;
+        ulMultiplier *= 128U;
+    }
+
+    /* A malformed remaining length is left for coreMQTT to reject */
+    if( ( ( xParser.pucHeader[ 0 ] & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH ) &&
+        ( ( ucLast & 0x80U ) == 0U ) &&
+        ( ( xParser.uxHeaderLen + xParser.ulRemaining ) > MQTT_STREAM_THRESHOLD ) )
+    {
+        xParser.xChunk.pcTopic = xParser.pcTopic;
+        xParser.xChunk.xQoS = ( MQTTQoS_t ) ( ( xParser.pucHeader[ 0 ] >> 1 ) & 0x03U );
+        xParser.uxFieldLen = 0;
+        xParser.xState = StreamTopicLength;
+    }
+    else
+    {
+        xParser.xState = StreamPassThrough;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvReadFixedHeader( NetworkContext_t * pxNetworkContext )
+{
+    int32_t lResult = 1;
+
+    while( ( lResult > 0 ) && ( xParser.xState == StreamFixedHeader ) )
+    {
+        lResult = xParser.xRecv( pxNetworkContext, &( xParser.pucHeader[ xParser.uxHeaderLen ] ), 1U );
+
+        if( lResult > 0 )
+        {
+            xParser.uxHeaderLen++;
+
+            if( ( xParser.uxHeaderLen == STREAM_FIXED_HEADER_MAX ) ||
+                ( ( xParser.uxHeaderLen > 1U ) &&
+                  ( ( xParser.pucHeader[ xParser.uxHeaderLen - 1U ] & 0x80U ) == 0U ) ) )
+            {
+                prvStartPacket();
+            }
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Copy the rest of the current packet to coreMQTT, returns the bytes copied or the transport result */
+static int32_t prvPassThrough( NetworkContext_t * pxNetworkContext,
+                               uint8_t * pucBuffer,
+                               size_t uxBufferLen )
+{
+    size_t uxCopied = xParser.uxHeaderLen - xParser.uxHeaderCopied;
+    int32_t lResult = 0;
+
+    if( uxCopied > uxBufferLen )
+    {
+        uxCopied = uxBufferLen;
+    }
+
+    ( void ) memcpy( pucBuffer, &( xParser.pucHeader[ xParser.uxHeaderCopied ] ), uxCopied );
+    xParser.uxHeaderCopied += uxCopied;
+
+    if( ( xParser.uxHeaderCopied == xParser.uxHeaderLen ) &&
+        ( xParser.ulRemaining > 0U ) &&
+        ( uxCopied < uxBufferLen ) )
+    {
+        size_t uxWant = uxBufferLen - uxCopied;
+
+        if( uxWant > xParser.ulRemaining )
+        {
+            uxWant = xParser.ulRemaining;
+        }
+
+        lResult = xParser.xRecv( pxNetworkContext, &( pucBuffer[ uxCopied ] ), uxWant );
+
+        if( lResult > 0 )
+        {
+            xParser.ulRemaining -= ( uint32_t ) lResult;
+            uxCopied += ( size_t ) lResult;
+        }
+    }
+
+    if( ( xParser.uxHeaderCopied == xParser.uxHeaderLen ) &&
+        ( xParser.ulRemaining == 0U ) )
+    {
+        xParser.uxHeaderLen = 0;
+        xParser.xState = StreamFixedHeader;
+    }
+
+    return ( uxCopied > 0U ) ? ( int32_t ) uxCopied : lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lMqttStreamRecv( NetworkContext_t * pxNetworkContext,
+                         void * pvBuffer,
+                         size_t uxBytesToRecv )
+{
+    uint8_t * pucBuffer = ( uint8_t * ) pvBuffer;
+    size_t uxCopied = 0;
+    int32_t lResult = 1;
+
+    configASSERT( xParser.xRecv != NULL );
+
+    /* Keep going until the transport has no more data or the buffer is full */
+    while( ( lResult > 0 ) && ( uxCopied < uxBytesToRecv ) )
+    {
+        switch( xParser.xState )
+        {
+            case StreamFixedHeader:
+                lResult = prvReadFixedHeader( pxNetworkContext );
+                break;
+
+            case StreamPassThrough:
+                lResult = prvPassThrough( pxNetworkContext, &( pucBuffer[ uxCopied ] ), uxBytesToRecv - uxCopied );
+
+                if( lResult > 0 )
+                {
+                    uxCopied += ( size_t ) lResult;
+                }
+
+                break;
+
+            default:
+                lResult = prvStreamRead( pxNetworkContext );
+                break;
+        }
+    }
+
+    /* A transport error after some bytes were copied is reported by the next call */
+    return ( uxCopied > 0U ) ? ( int32_t ) uxCopied : lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttStreamReset( TransportRecv_t xRecv,
+                       TransportSend_t xSend )
+{
+    if( ( xParser.xState == StreamPayload ) && ( xParser.pxCallback != NULL ) )
+    {
+        xParser.xChunk.pucData = NULL;
+        xParser.xChunk.uxLen = 0;
+        xParser.xChunk.xAborted = pdTRUE;
+
+        xParser.pxCallback( xParser.pvCtx, &( xParser.xChunk ) );
+
+        xStreamStats.ulAborted++;
+    }
+
+    xParser.xRecv = xRecv;
+    xParser.xSend = xSend;
+    xParser.pxCallback = NULL;
+    xParser.uxHeaderLen = 0;
+    xParser.xState = StreamFixedHeader;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttStreamGetStats( MqttStreamStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xStreamStats, sizeof( MqttStreamStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+}
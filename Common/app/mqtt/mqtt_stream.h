@@ -0,0 +1,149 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_stream.h
+ * @brief Chunked delivery of incoming publishes larger than the agent network buffer.
+ */
+#ifndef _MQTT_STREAM_H_
+#define _MQTT_STREAM_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt.h"
+
+/**
+ * @brief Incoming PUBLISH packets longer than this, fixed header included, are streamed
+ * instead of being received into the network buffer.
+ */
+#ifndef MQTT_STREAM_THRESHOLD
+    #define MQTT_STREAM_THRESHOLD    ( MQTT_AGENT_NETWORK_BUFFER_SIZE )
+#endif /* MQTT_STREAM_THRESHOLD */
+
+/**
+ * @brief Payload bytes handed to the stream callback at a time, except for the last chunk.
+ */
+#ifndef MQTT_STREAM_CHUNK_SIZE
+    #define MQTT_STREAM_CHUNK_SIZE    ( 1024U )
+#endif /* MQTT_STREAM_CHUNK_SIZE */
+
+#ifndef MQTT_STREAM_MAX_HANDLERS
+    #define MQTT_STREAM_MAX_HANDLERS    ( 4U )
+#endif /* MQTT_STREAM_MAX_HANDLERS */
+
+/**
+ * @brief Longest topic name of a streamed publish. Publishes with a longer topic are discarded.
+ */
+#ifndef MQTT_STREAM_MAX_TOPIC_LEN
+    #define MQTT_STREAM_MAX_TOPIC_LEN    ( 128U )
+#endif /* MQTT_STREAM_MAX_TOPIC_LEN */
+
+typedef struct
+{
+    const char * pcTopic;     /* Topic name of the publish, not NUL terminated */
+    uint16_t usTopicLen;
+    MQTTQoS_t xQoS;
+    uint32_t ulOffset;        /* Offset of pucData within the payload */
+    uint32_t ulTotalLen;      /* Payload length of the whole publish */
+    const uint8_t * pucData;
+    size_t uxLen;
+    BaseType_t xAborted;      /* pdTRUE if the connection was lost before the end of the payload */
+} MqttStreamChunk_t;
+
+/**
+ * @brief Called in the MQTT agent task for each chunk of a streamed publish, in order.
+ * The chunk with ulOffset + uxLen == ulTotalLen is the last one. pxChunk and the data
+ * it references are only valid for the duration of the call.
+ *
+ * The callback must not block: the agent does not process any other packet until the
+ * whole payload has been received.
+ */
+typedef void ( * MqttStreamCallback_t )( void * pvCtx,
+                                         const MqttStreamChunk_t * pxChunk );
+
+typedef struct
+{
+    uint32_t ulStreamed;   /* Publishes delivered to a stream callback */
+    uint32_t ulChunks;
+    uint32_t ulBytes;      /* Payload bytes delivered to stream callbacks */
+    uint32_t ulDiscarded;  /* Oversized publishes without a handler, with a long topic or at QoS2 */
+    uint32_t ulAborted;    /* Streams cut by a disconnect */
+} MqttStreamStats_t;
+
+/**
+ * @brief Deliver oversized publishes on topics matching a filter to a stream callback.
+ *
+ * The topic must still be subscribed to, with MqttAgent_SubscribeSync. Publishes on it
+ * which fit in the network buffer keep going to the subscription callback.
+ *
+ * @param[in] pcTopicFilter NUL terminated topic filter, referenced until unregistered.
+ * @param[in] pxCallback Callback receiving the chunks.
+ * @param[in] pvCtx Context passed to the callback.
+ *
+ * @return pdTRUE on success, pdFALSE if all MQTT_STREAM_MAX_HANDLERS handlers are in use.
+ */
+BaseType_t xMqttStreamRegister( const char * pcTopicFilter,
+                                MqttStreamCallback_t pxCallback,
+                                void * pvCtx );
+
+/**
+ * @brief Remove a handler added with xMqttStreamRegister. A publish being streamed
+ * to the handler keeps being delivered to it until its last chunk, so the context
+ * should only be released after unsubscribing from the topic.
+ */
+void vMqttStreamUnregister( const char * pcTopicFilter,
+                            MqttStreamCallback_t pxCallback,
+                            void * pvCtx );
+
+/**
+ * @brief Start parsing a new connection. Called by the MQTT agent task after each
+ * transport connect and disconnect, a stream in progress is reported as aborted.
+ *
+ * @param[in] xRecv Transport function the packets are read with.
+ * @param[in] xSend Transport function the PUBACKs of streamed publishes are sent with.
+ */
+void vMqttStreamReset( TransportRecv_t xRecv,
+                       TransportSend_t xSend );
+
+/**
+ * @brief Transport receive function of the MQTT agent. Reads whole packets for coreMQTT,
+ * streaming oversized publishes to their handler on the way.
+ *
+ * @return Bytes copied to pvBuffer, or a negative value on a transport error.
+ */
+int32_t lMqttStreamRecv( NetworkContext_t * pxNetworkContext,
+                         void * pvBuffer,
+                         size_t uxBytesToRecv );
+
+/**
+ * @brief Copy a snapshot of the stream counters.
+ *
+ * @param[out] pxStats Destination for the counters.
+ */
+void vMqttStreamGetStats( MqttStreamStats_t * pxStats );
+
+#endif /* _MQTT_STREAM_H_ */
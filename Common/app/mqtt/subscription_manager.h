@@ -49,6 +49,13 @@
     #define MQTT_AGENT_MAX_CALLBACKS    10U
 #endif /* MQTT_AGENT_MAX_CALLBACKS */
 
+/**
+ * @brief Maximum number of topic filters in a single MqttAgent_SubscribeAsync call.
+ */
+#ifndef MQTT_AGENT_SUBSCRIBE_BATCH_MAX
+    #define MQTT_AGENT_SUBSCRIBE_BATCH_MAX    4U
+#endif /* MQTT_AGENT_SUBSCRIBE_BATCH_MAX */
+
 /**
  * @brief Callback function called when receiving a publish.
  *
@@ -58,6 +65,34 @@
 typedef void (* IncomingPubCallback_t )( void * pvIncomingPublishCallbackContext,
                                          MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Length of the topic filter text copied by MqttAgent_GetTopicStats, longer filters are truncated.
+ */
+#ifndef MQTT_AGENT_TOPIC_STATS_FILTER_LEN
+    #define MQTT_AGENT_TOPIC_STATS_FILTER_LEN    48U
+#endif /* MQTT_AGENT_TOPIC_STATS_FILTER_LEN */
+
+/**
+ * @brief Incoming traffic of one subscription since it was added or the statistics were reset.
+ *
+ * A publish which matches several filters is counted once for each of them. The callback cycles are
+ * DWT cycles spent in all the callbacks of the filter, on the MQTT agent task. For a callback
+ * registered through MqttAgent_DeferredCallback, that is the time to hand the publish to a
+ * dispatch worker.
+ */
+typedef struct
+{
+    char pcTopicFilter[ MQTT_AGENT_TOPIC_STATS_FILTER_LEN ];
+    uint32_t ulCallbacks;
+    uint32_t ulMessages;
+    uint64_t ullBytes;
+    uint64_t ullCallbackCycles;
+    uint32_t ulMaxCallbackCycles;
+} MqttAgentTopicStats_t;
+
+typedef struct MqttAgentRxBuffer   MqttAgentRxBuffer_t;
+typedef MqttAgentRxBuffer_t * MqttAgentRxBufferHandle_t;
+
 /**
  * @brief An element in the list of subscriptions.
  *
@@ -79,6 +114,71 @@ typedef struct
 } SubCallbackElement_t;
 
 
+/**
+ * @brief One entry of a multi-topic subscribe request.
+ */
+typedef struct
+{
+    const char * pcTopicFilter;
+    MQTTQoS_t xRequestedQoS;
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+} MqttAgentSubscription_t;
+
+/**
+ * @brief Called once a subscribe request has completed.
+ *
+ * @param[in] pvCompleteCtx Context passed to MqttAgent_SubscribeAsync.
+ * @param[in] xStatus Result of the SUBSCRIBE operation.
+ * @param[in] pxSubAckStatus Granted QoS or MQTTSubAckFailure for each requested entry, in request order.
+ * @param[in] uxCount Number of entries in pxSubAckStatus.
+ */
+typedef void (* SubscribeCompleteCallback_t )( void * pvCompleteCtx,
+                                               MQTTStatus_t xStatus,
+                                               const MQTTSubAckStatus_t * pxSubAckStatus,
+                                               size_t uxCount );
+
+/**
+ * @brief Called once an unsubscribe request has completed.
+ *
+ * @param[in] pvCompleteCtx Context passed to MqttAgent_UnSubscribeAsync.
+ * @param[in] xStatus Result of the UNSUBSCRIBE operation.
+ */
+typedef void (* UnsubscribeCompleteCallback_t )( void * pvCompleteCtx,
+                                                 MQTTStatus_t xStatus );
+
+/* @brief Add callbacks for up to MQTT_AGENT_SUBSCRIBE_BATCH_MAX topic filters without blocking.
+ *
+ * Every filter which is not already subscribed with a sufficient QoS is sent in one SUBSCRIBE packet.
+ * pxCompleteCallback runs in the MQTT agent task once the SUBACK arrives, or before this function
+ * returns when no SUBSCRIBE is needed. The pxSubscriptions array may be reused once this call returns.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pxSubscriptions Array of uxCount subscriptions.
+ * @param[in] uxCount Number of subscriptions.
+ * @param[in] pxCompleteCallback Optional completion callback.
+ * @param[in] pvCompleteCtx Context for the completion callback.
+ * @return `MQTTSuccess` if the request was accepted, in which case pxCompleteCallback will be called.
+ **/
+MQTTStatus_t MqttAgent_SubscribeAsync( MQTTAgentHandle_t xHandle,
+                                       const MqttAgentSubscription_t * pxSubscriptions,
+                                       size_t uxCount,
+                                       SubscribeCompleteCallback_t pxCompleteCallback,
+                                       void * pvCompleteCtx );
+
+/* @brief Blocking version of MqttAgent_SubscribeAsync.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pxSubscriptions Array of uxCount subscriptions.
+ * @param[in] uxCount Number of subscriptions.
+ * @param[out] pxSubAckStatus Optional array of uxCount entries receiving the per filter results.
+ * @return `MQTTSuccess` if the SUBSCRIBE operation completed successfully.
+ **/
+MQTTStatus_t MqttAgent_SubscribeMultiSync( MQTTAgentHandle_t xHandle,
+                                           const MqttAgentSubscription_t * pxSubscriptions,
+                                           size_t uxCount,
+                                           MQTTSubAckStatus_t * pxSubAckStatus );
+
 /* @brief Add a callback for a given topic filter. Subscribe if not already subscribed.
  *
  * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
@@ -108,4 +208,82 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                                         IncomingPubCallback_t pxCallback,
                                         void * pvCallbackCtx );
 
+/* @brief Remove the specified callback from the given topic filter without blocking.
+ * An UNSUBSCRIBE is sent when no other callback uses the filter.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pcTopicFilter Topic filter string to unsubscribe from.
+ * @param[in] pxCallback Callback function for the subscription.
+ * @param[in] pvCallbackCtx Context for the subscription callback.
+ * @param[in] pxCompleteCallback Optional completion callback, may run before this function returns.
+ * @param[in] pvCompleteCtx Context for the completion callback.
+ * @return `MQTTSuccess` if the request was accepted, in which case pxCompleteCallback will be called.
+ **/
+MQTTStatus_t MqttAgent_UnSubscribeAsync( MQTTAgentHandle_t xHandle,
+                                         const char * pcTopicFilter,
+                                         IncomingPubCallback_t pxCallback,
+                                         void * pvCallbackCtx,
+                                         UnsubscribeCompleteCallback_t pxCompleteCallback,
+                                         void * pvCompleteCtx );
+
+/* @brief Keep the receive buffer holding the publish currently being delivered.
+ *
+ * May only be called from an IncomingPubCallback_t. While the reference is held the
+ * topic and payload pointers in pxPublishInfo remain valid after the callback returns,
+ * and the agent receives subsequent packets into a spare buffer.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @return A buffer reference to pass to MqttAgent_ReleaseRxBuffer, or NULL when no spare
+ * buffer is free. In that case the payload must be copied before the callback returns.
+ **/
+MqttAgentRxBufferHandle_t MqttAgent_RetainRxBuffer( MQTTAgentHandle_t xHandle );
+
+/* @brief Drop a reference taken with MqttAgent_RetainRxBuffer. May be called from any task.
+ *
+ * @param[in] xRxBuffer Buffer reference returned by MqttAgent_RetainRxBuffer.
+ **/
+void MqttAgent_ReleaseRxBuffer( MqttAgentRxBufferHandle_t xRxBuffer );
+
+/**
+ * @brief Callback and context of a subscription delivered by the dispatch workers.
+ *
+ * Register MqttAgent_DeferredCallback as the IncomingPubCallback_t with a pointer to
+ * one of these as its context. The structure and pvCallbackCtx must stay valid until
+ * the subscription is removed and vMqttDispatchFlush has returned.
+ */
+typedef struct
+{
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+} MqttAgentDeferredCallback_t;
+
+/* @brief Queue a publish for delivery to the callback described by pvDeferredCallback
+ * in a dispatch worker task instead of the MQTT agent task.
+ *
+ * The topic and payload stay in the lent receive buffer when one is available, or are
+ * copied otherwise. The publish is delivered at once when it cannot be queued.
+ *
+ * @param[in] pvDeferredCallback Pointer to an MqttAgentDeferredCallback_t.
+ * @param[in] pxPublishInfo Deserialized publish information.
+ **/
+void MqttAgent_DeferredCallback( void * pvDeferredCallback,
+                                 MQTTPublishInfo_t * pxPublishInfo );
+
+/* @brief Copy the incoming traffic of up to uxMaxStats subscriptions of an agent instance.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[out] pxStats Array of uxMaxStats entries.
+ * @param[in] uxMaxStats Number of entries in pxStats.
+ * @return The number of entries written.
+ **/
+size_t MqttAgent_GetTopicStats( MQTTAgentHandle_t xHandle,
+                                MqttAgentTopicStats_t * pxStats,
+                                size_t uxMaxStats );
+
+/* @brief Clear the incoming traffic counters of every subscription of an agent instance.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ **/
+void MqttAgent_ResetTopicStats( MQTTAgentHandle_t xHandle );
+
 #endif /* SUBSCRIPTION_MANAGER_H */
@@ -0,0 +1,539 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * See mqtt_bench.h. The subscription and command completion callbacks run in the MQTT agent
+ * task and only update counters written by nobody else, then wake the benchmark task.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdlib.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "kvstore.h"
+#include "hw_defs.h"
+#include "dvfs.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+#include "subscription_manager.h"
+
+#include "mqtt_bench.h"
+
+#ifndef MQTT_BENCH_TASK_PRIORITY
+    #define MQTT_BENCH_TASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+#endif
+
+#define MQTT_BENCH_TASK_STACK          ( 1024 )
+
+/* Longest time without a publish completing or a message coming back */
+#define MQTT_BENCH_RX_TIMEOUT_MS       ( 5000 )
+#define MQTT_BENCH_BLOCK_TIME_MS       ( 500 )
+
+#define MQTT_BENCH_TOPIC               "bench/loopback"
+#define MQTT_BENCH_TOPIC_STR_LEN       ( 128 )
+
+/* Fixed header, remaining length, topic length and packet identifier of a PUBLISH */
+#define MQTT_BENCH_PUBLISH_OVERHEAD    ( 1 + 4 + 2 + 2 )
+
+#define MQTT_BENCH_NOTIFY_IDX          ( 1 )
+#define MQTT_BENCH_DONE_NOTIFY_IDX     ( 2 )
+
+#define MQTT_BENCH_NOT_RECEIVED        UINT32_MAX
+
+/*-----------------------------------------------------------*/
+
+struct MQTTAgentCommandContext
+{
+    volatile BaseType_t xBusy;
+    MQTTStatus_t xReturnStatus;
+    TaskHandle_t xTaskToNotify;
+};
+
+typedef struct
+{
+    MQTTPublishInfo_t xPublishInfo;
+    MQTTAgentCommandInfo_t xCommandInfo;
+    MQTTAgentCommandContext_t xCommandContext;
+    uint8_t * pucPayload;
+} MqttBenchSlot_t;
+
+typedef struct
+{
+    const MqttBenchConfig_t * pxConfig;
+    MqttBenchResult_t * pxResults;
+    size_t uxMaxResults;
+    size_t uxResults;
+    BaseType_t xStatus;
+    TaskHandle_t xCaller;
+} MqttBenchJob_t;
+
+/* State of the payload length being measured, shared with the agent task callbacks */
+typedef struct
+{
+    TaskHandle_t xTask;
+    uint32_t ulTag;               /* Payload length, tells echoes of the previous length apart */
+    uint32_t ulMessages;
+    uint32_t * pulRttUs;          /* Round trip of each sequence number */
+    volatile uint32_t ulReceived; /* Written by the subscription callback only */
+    volatile uint32_t ulLastRxUs;
+} MqttBenchRun_t;
+
+static MqttBenchRun_t xRun = { 0 };
+
+static TaskHandle_t volatile xBenchTask = NULL;
+
+static const uint32_t ulSweepLengths[] = { 16, 64, 256, 1024, 4096 };
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+    pxCommandContext->xBusy = pdFALSE;
+
+    ( void ) xTaskNotifyGiveIndexed( pxCommandContext->xTaskToNotify, MQTT_BENCH_NOTIFY_IDX );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvIncomingPublishCallback( void * pvCtx,
+                                        MQTTPublishInfo_t * pxPublishInfo )
+{
+    uint32_t ulHeader[ 3 ];
+    uint32_t ulNowUs = ( uint32_t ) ullGetMonotonicUs();
+
+    ( void ) pvCtx;
+
+    if( pxPublishInfo->payloadLength >= sizeof( ulHeader ) )
+    {
+        ( void ) memcpy( ulHeader, pxPublishInfo->pPayload, sizeof( ulHeader ) );
+
+        if( ( ulHeader[ 2 ] == xRun.ulTag ) &&
+            ( ulHeader[ 0 ] < xRun.ulMessages ) &&
+            ( xRun.pulRttUs[ ulHeader[ 0 ] ] == MQTT_BENCH_NOT_RECEIVED ) )
+        {
+            xRun.pulRttUs[ ulHeader[ 0 ] ] = ulNowUs - ulHeader[ 1 ];
+            xRun.ulLastRxUs = ulNowUs;
+            xRun.ulReceived++;
+
+            ( void ) xTaskNotifyGiveIndexed( xRun.xTask, MQTT_BENCH_NOTIFY_IDX );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCompareU32( const void * pvA,
+                          const void * pvB )
+{
+    uint32_t ulA = *( const uint32_t * ) pvA;
+    uint32_t ulB = *( const uint32_t * ) pvB;
+
+    return ( ulA > ulB ) - ( ulA < ulB );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Round trip percentiles, in permille, of the messages received back */
+static void prvComputeLatency( MqttBenchResult_t * pxResult )
+{
+    uint32_t ulCount = 0;
+
+    for( uint32_t i = 0; i < xRun.ulMessages; i++ )
+    {
+        if( xRun.pulRttUs[ i ] != MQTT_BENCH_NOT_RECEIVED )
+        {
+            xRun.pulRttUs[ ulCount++ ] = xRun.pulRttUs[ i ];
+        }
+    }
+
+    if( ulCount > 0 )
+    {
+        qsort( xRun.pulRttUs, ulCount, sizeof( uint32_t ), prvCompareU32 );
+
+        pxResult->ulRttP50Us = xRun.pulRttUs[ ( ulCount * 500 ) / 1000 ];
+        pxResult->ulRttP99Us = xRun.pulRttUs[ ( ulCount * 990 ) / 1000 ];
+        pxResult->ulRttP999Us = xRun.pulRttUs[ ( ulCount * 999 ) / 1000 ];
+        pxResult->ulRttMaxUs = xRun.pulRttUs[ ulCount - 1 ];
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Wait for a publish completion or an echo, pdFALSE if neither came in time */
+static BaseType_t prvWaitEvent( void )
+{
+    return( ulTaskNotifyTakeIndexed( MQTT_BENCH_NOTIFY_IDX,
+                                     pdTRUE,
+                                     pdMS_TO_TICKS( MQTT_BENCH_RX_TIMEOUT_MS ) ) != 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRunLength( MQTTAgentHandle_t xAgentHandle,
+                                const char * pcTopic,
+                                const MqttBenchConfig_t * pxConfig,
+                                uint32_t ulPayloadLen,
+                                MqttBenchResult_t * pxResult )
+{
+    MqttBenchSlot_t xSlots[ MQTT_BENCH_WINDOW ] = { 0 };
+    uint8_t * pucPayloads = pvPortMalloc( MQTT_BENCH_WINDOW * ulPayloadLen );
+    BaseType_t xResult = pdPASS;
+    uint32_t ulStartUs = 0;
+    uint32_t ulGivenUp = 0;
+    uint32_t ulSeq;
+
+    if( pucPayloads == NULL )
+    {
+        LogError( "Failed to allocate %lu payload bytes.", MQTT_BENCH_WINDOW * ulPayloadLen );
+        return pdFAIL;
+    }
+
+    ( void ) memset( pucPayloads, 0x5A, MQTT_BENCH_WINDOW * ulPayloadLen );
+    ( void ) memset( pxResult, 0, sizeof( MqttBenchResult_t ) );
+    pxResult->ulPayloadLen = ulPayloadLen;
+
+    for( uint32_t i = 0; i < MQTT_BENCH_WINDOW; i++ )
+    {
+        xSlots[ i ].pucPayload = &( pucPayloads[ i * ulPayloadLen ] );
+        xSlots[ i ].xPublishInfo.qos = ( MQTTQoS_t ) pxConfig->ucQoS;
+        xSlots[ i ].xPublishInfo.pTopicName = pcTopic;
+        xSlots[ i ].xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopic );
+        xSlots[ i ].xPublishInfo.pPayload = xSlots[ i ].pucPayload;
+        xSlots[ i ].xPublishInfo.payloadLength = ulPayloadLen;
+        xSlots[ i ].xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
+        xSlots[ i ].xCommandInfo.blockTimeMs = MQTT_BENCH_BLOCK_TIME_MS;
+        xSlots[ i ].xCommandInfo.cmdCompleteCallback = prvPublishCommandCallback;
+        xSlots[ i ].xCommandInfo.pCmdCompleteCallbackContext = &( xSlots[ i ].xCommandContext );
+    }
+
+    for( uint32_t i = 0; i < pxConfig->ulMessages; i++ )
+    {
+        xRun.pulRttUs[ i ] = MQTT_BENCH_NOT_RECEIVED;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        xRun.ulMessages = pxConfig->ulMessages;
+        xRun.ulTag = ulPayloadLen;
+        xRun.ulReceived = 0;
+        xRun.ulLastRxUs = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    xTaskNotifyStateClearIndexed( NULL, MQTT_BENCH_NOTIFY_IDX );
+    ( void ) ulTaskNotifyValueClearIndexed( NULL, MQTT_BENCH_NOTIFY_IDX, UINT32_MAX );
+
+    for( ulSeq = 0; ( ulSeq < pxConfig->ulMessages ) && ( xResult == pdPASS ); ulSeq++ )
+    {
+        MqttBenchSlot_t * pxSlot = &( xSlots[ ulSeq % MQTT_BENCH_WINDOW ] );
+        uint32_t ulHeader[ 3 ];
+        MQTTStatus_t xStatus;
+
+        /*
+         * Wait for the slot's previous publish to complete and for a message of the window to
+         * come back. A lost QoS0 message holds the window until the timeout, then it no longer
+         * counts as in flight, even if it comes back later.
+         */
+        while( ( xResult == pdPASS ) &&
+               ( ( pxSlot->xCommandContext.xBusy == pdTRUE ) ||
+                 ( ( int32_t ) ( ulSeq - xRun.ulReceived - ulGivenUp ) >= ( int32_t ) MQTT_BENCH_WINDOW ) ) )
+        {
+            if( ( prvWaitEvent() == pdFALSE ) &&
+                ( pxSlot->xCommandContext.xBusy == pdFALSE ) )
+            {
+                ulGivenUp++;
+            }
+
+            if( xIsMqttAgentConnected() == false )
+            {
+                xResult = pdFAIL;
+            }
+        }
+
+        if( xResult == pdPASS )
+        {
+            ulHeader[ 0 ] = ulSeq;
+            ulHeader[ 1 ] = ( uint32_t ) ullGetMonotonicUs();
+            ulHeader[ 2 ] = ulPayloadLen;
+            ( void ) memcpy( pxSlot->pucPayload, ulHeader, sizeof( ulHeader ) );
+
+            if( ulSeq == 0 )
+            {
+                ulStartUs = ulHeader[ 1 ];
+            }
+
+            pxSlot->xCommandContext.xBusy = pdTRUE;
+
+            xStatus = MQTTAgent_Publish( xAgentHandle,
+                                         &( pxSlot->xPublishInfo ),
+                                         &( pxSlot->xCommandInfo ) );
+
+            if( xStatus != MQTTSuccess )
+            {
+                LogError( "Failed to enqueue publish %lu: %s.", ulSeq, MQTT_Status_strerror( xStatus ) );
+                pxSlot->xCommandContext.xBusy = pdFALSE;
+                xResult = pdFAIL;
+            }
+        }
+    }
+
+    pxResult->ulSent = ulSeq;
+
+    /* Wait for the stragglers, as long as they keep coming */
+    while( ( xResult == pdPASS ) &&
+           ( xRun.ulReceived < pxResult->ulSent ) &&
+           ( prvWaitEvent() == pdTRUE ) )
+    {
+    }
+
+    /* The payloads stay referenced by the agent until every publish completes */
+    for( uint32_t i = 0; i < MQTT_BENCH_WINDOW; i++ )
+    {
+        while( xSlots[ i ].xCommandContext.xBusy == pdTRUE )
+        {
+            ( void ) prvWaitEvent();
+        }
+    }
+
+    /* Later echoes of this length are ignored */
+    taskENTER_CRITICAL();
+    {
+        xRun.ulTag = 0;
+        pxResult->ulReceived = xRun.ulReceived;
+    }
+    taskEXIT_CRITICAL();
+
+    vPortFree( pucPayloads );
+
+    if( pxResult->ulReceived > 0 )
+    {
+        pxResult->ulElapsedUs = xRun.ulLastRxUs - ulStartUs;
+    }
+
+    if( pxResult->ulElapsedUs > 0 )
+    {
+        pxResult->ulMsgsPerSec = ( uint32_t ) ( ( ( uint64_t ) pxResult->ulReceived * 1000000 ) / pxResult->ulElapsedUs );
+        pxResult->ulGoodputBytesPerSec = ( uint32_t ) ( ( ( uint64_t ) pxResult->ulReceived * ulPayloadLen * 1000000 ) / pxResult->ulElapsedUs );
+    }
+
+    prvComputeLatency( pxResult );
+
+    LogInfo( "length: %lu, sent: %lu, received: %lu, msg/s: %lu, goodput: %lu B/s, rtt p50: %lu us, p99: %lu us, p999: %lu us",
+             ulPayloadLen, pxResult->ulSent, pxResult->ulReceived, pxResult->ulMsgsPerSec,
+             pxResult->ulGoodputBytesPerSec, pxResult->ulRttP50Us, pxResult->ulRttP99Us, pxResult->ulRttP999Us );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchTask( void * pvParameters )
+{
+    MqttBenchJob_t * pxJob = ( MqttBenchJob_t * ) pvParameters;
+    const MqttBenchConfig_t * pxConfig = pxJob->pxConfig;
+    MQTTAgentHandle_t xAgentHandle = xGetMqttAgentHandle();
+    char pcTopic[ MQTT_BENCH_TOPIC_STR_LEN ] = { 0 };
+    size_t uxTopicLen;
+    uint32_t ulMaxPayload = 0;
+    MQTTStatus_t xStatus = MQTTBadParameter;
+
+    pxJob->xStatus = pdFAIL;
+
+    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, pcTopic, MQTT_BENCH_TOPIC_STR_LEN );
+
+    if( uxTopicLen > 0 )
+    {
+        uxTopicLen = strlcat( pcTopic, "/" MQTT_BENCH_TOPIC, MQTT_BENCH_TOPIC_STR_LEN );
+    }
+
+    if( ( uxTopicLen > 0 ) && ( uxTopicLen < MQTT_BENCH_TOPIC_STR_LEN ) )
+    {
+        ulMaxPayload = MQTT_AGENT_NETWORK_BUFFER_SIZE - MQTT_BENCH_PUBLISH_OVERHEAD - uxTopicLen;
+
+        xRun.xTask = xTaskGetCurrentTaskHandle();
+        xRun.pulRttUs = pvPortMalloc( pxConfig->ulMessages * sizeof( uint32_t ) );
+    }
+
+    if( xRun.pulRttUs != NULL )
+    {
+        xStatus = MqttAgent_SubscribeSync( xAgentHandle,
+                                           pcTopic,
+                                           ( MQTTQoS_t ) pxConfig->ucQoS,
+                                           prvIncomingPublishCallback,
+                                           NULL );
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        pxJob->xStatus = pdPASS;
+
+        /* Measured at full speed */
+        vDvfsRequest( DVFS_CLIENT_BULK );
+
+        if( pxConfig->ulPayloadLen > 0 )
+        {
+            uint32_t ulLength = ( pxConfig->ulPayloadLen < ulMaxPayload ) ? pxConfig->ulPayloadLen : ulMaxPayload;
+
+            pxJob->xStatus = prvRunLength( xAgentHandle, pcTopic, pxConfig, ulLength, &( pxJob->pxResults[ 0 ] ) );
+            pxJob->uxResults = 1;
+        }
+        else
+        {
+            for( size_t i = 0; ( i <= ( sizeof( ulSweepLengths ) / sizeof( ulSweepLengths[ 0 ] ) ) ) &&
+                 ( pxJob->uxResults < pxJob->uxMaxResults ) && ( pxJob->xStatus == pdPASS ); i++ )
+            {
+                uint32_t ulLength = ulMaxPayload;
+
+                if( i < ( sizeof( ulSweepLengths ) / sizeof( ulSweepLengths[ 0 ] ) ) )
+                {
+                    if( ulSweepLengths[ i ] >= ulMaxPayload )
+                    {
+                        continue;
+                    }
+
+                    ulLength = ulSweepLengths[ i ];
+                }
+
+                pxJob->xStatus = prvRunLength( xAgentHandle, pcTopic, pxConfig, ulLength,
+                                               &( pxJob->pxResults[ pxJob->uxResults ] ) );
+                pxJob->uxResults++;
+            }
+        }
+
+        vDvfsRelease( DVFS_CLIENT_BULK );
+
+        ( void ) MqttAgent_UnSubscribeSync( xAgentHandle, pcTopic, prvIncomingPublishCallback, NULL );
+    }
+    else
+    {
+        LogError( "Failed to subscribe to %s.", pcTopic );
+    }
+
+    if( xRun.pulRttUs != NULL )
+    {
+        vPortFree( xRun.pulRttUs );
+        xRun.pulRttUs = NULL;
+    }
+
+    /* pxJob belongs to the caller, which returns once notified */
+    xBenchTask = NULL;
+    ( void ) xTaskNotifyGiveIndexed( pxJob->xCaller, MQTT_BENCH_DONE_NOTIFY_IDX );
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttBenchRun( const MqttBenchConfig_t * pxConfig,
+                          MqttBenchResult_t * pxResults,
+                          size_t uxMaxResults,
+                          size_t * puxResults )
+{
+    MqttBenchJob_t xJob =
+    {
+        .pxConfig     = pxConfig,
+        .pxResults    = pxResults,
+        .uxMaxResults = uxMaxResults,
+        .uxResults    = 0,
+        .xStatus      = pdFAIL,
+        .xCaller      = xTaskGetCurrentTaskHandle(),
+    };
+    BaseType_t xResult = pdFAIL;
+    TaskHandle_t xTask = NULL;
+
+    configASSERT( pxConfig != NULL );
+    configASSERT( pxResults != NULL );
+    configASSERT( puxResults != NULL );
+
+    *puxResults = 0;
+
+    if( ( pxConfig->ulMessages == 0 ) ||
+        ( pxConfig->ulMessages > MQTT_BENCH_MAX_MESSAGES ) ||
+        ( pxConfig->ucQoS > 1 ) ||
+        ( ( pxConfig->ulPayloadLen > 0 ) && ( pxConfig->ulPayloadLen < MQTT_BENCH_MIN_PAYLOAD ) ) ||
+        ( uxMaxResults == 0 ) )
+    {
+        LogError( "Invalid benchmark parameters." );
+    }
+    else if( xIsMqttAgentConnected() == false )
+    {
+        LogError( "The MQTT agent is not connected." );
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            if( xBenchTask == NULL )
+            {
+                /* Claim the benchmark until the task is created */
+                xBenchTask = xJob.xCaller;
+                xResult = pdPASS;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    if( xResult == pdPASS )
+    {
+        xTaskNotifyStateClearIndexed( NULL, MQTT_BENCH_DONE_NOTIFY_IDX );
+
+        xResult = xTaskCreate( prvBenchTask, "MqttBench", MQTT_BENCH_TASK_STACK,
+                               &xJob, MQTT_BENCH_TASK_PRIORITY, &xTask );
+
+        if( xResult == pdPASS )
+        {
+            /* The benchmark task gives up on messages which do not come back in time */
+            ( void ) ulTaskNotifyTakeIndexed( MQTT_BENCH_DONE_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+
+            *puxResults = xJob.uxResults;
+            xResult = xJob.xStatus;
+        }
+        else
+        {
+            LogError( "Failed to create the benchmark task." );
+            xBenchTask = NULL;
+        }
+    }
+
+    return xResult;
+}
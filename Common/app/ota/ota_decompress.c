@@ -0,0 +1,224 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file ota_decompress.c
+ * @brief Streaming heatshrink decoder used by the OTA PAL, see ota_decompress.h.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "ota_decompress.h"
+
+#define WINDOW_MASK    ( ( 1U << OTA_DECOMPRESS_WINDOW_BITS ) - 1U )
+
+/* Decoder states, named after the field expected next */
+#define STATE_TAG         ( 0U )
+#define STATE_LITERAL     ( 1U )
+#define STATE_INDEX       ( 2U )
+#define STATE_COUNT       ( 3U )
+
+static_assert( ( OTA_DECOMPRESS_WINDOW_BITS >= 4U ) && ( OTA_DECOMPRESS_WINDOW_BITS <= 15U ),
+               "heatshrink supports window sizes of 2^4 to 2^15 bytes" );
+static_assert( ( OTA_DECOMPRESS_LOOKAHEAD_BITS >= 3U ) && ( OTA_DECOMPRESS_LOOKAHEAD_BITS < OTA_DECOMPRESS_WINDOW_BITS ),
+               "The lookahead must be at least 3 bits and shorter than the window" );
+static_assert( OTA_DECOMPRESS_OUT_CHUNK_SIZE > 0, "OTA_DECOMPRESS_OUT_CHUNK_SIZE must not be 0" );
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvOutputFlush( OtaDecompressCtx_t * pxCtx )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pxCtx->ulOutLen > 0 )
+    {
+        xResult = pxCtx->xOutput( pxCtx->pvOutputCtx, pxCtx->pucOut, pxCtx->ulOutLen );
+        pxCtx->ulOutLen = 0;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvEmit( OtaDecompressCtx_t * pxCtx,
+                     uint8_t ucByte )
+{
+    pxCtx->pucWindow[ pxCtx->ulHead & WINDOW_MASK ] = ucByte;
+    pxCtx->ulHead++;
+
+    pxCtx->pucOut[ pxCtx->ulOutLen ] = ucByte;
+    pxCtx->ulOutLen++;
+    pxCtx->ulTotalOut++;
+
+    if( ( pxCtx->ulOutLen == OTA_DECOMPRESS_OUT_CHUNK_SIZE ) &&
+        ( prvOutputFlush( pxCtx ) != pdTRUE ) )
+    {
+        pxCtx->xStatus = OTA_DECOMPRESS_ERR_OUTPUT;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Take the next ulCount bits of input, returns pdFALSE when not enough have been received */
+static BaseType_t prvTakeBits( OtaDecompressCtx_t * pxCtx,
+                               uint32_t ulCount,
+                               uint32_t * pulValue )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( pxCtx->ulBitCount >= ulCount )
+    {
+        pxCtx->ulBitCount -= ulCount;
+        *pulValue = ( pxCtx->ulBits >> pxCtx->ulBitCount ) & ( ( 1UL << ulCount ) - 1UL );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaDecompressInit( OtaDecompressCtx_t * pxCtx,
+                         OtaDecompressOutput_t xOutput,
+                         void * pvOutputCtx )
+{
+    configASSERT( pxCtx != NULL );
+    configASSERT( xOutput != NULL );
+
+    /* heatshrink treats history before the start of the stream as zeros */
+    ( void ) memset( pxCtx, 0, sizeof( OtaDecompressCtx_t ) );
+
+    pxCtx->ucState = STATE_TAG;
+    pxCtx->xOutput = xOutput;
+    pxCtx->pvOutputCtx = pvOutputCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+OtaDecompressStatus_t xOtaDecompressProcess( OtaDecompressCtx_t * pxCtx,
+                                             const uint8_t * pucInput,
+                                             size_t uxLength )
+{
+    configASSERT( pxCtx != NULL );
+    configASSERT( ( pucInput != NULL ) || ( uxLength == 0 ) );
+
+    for( size_t uxIdx = 0; ( uxIdx < uxLength ) && ( pxCtx->xStatus == OTA_DECOMPRESS_OK ); uxIdx++ )
+    {
+        BaseType_t xMoreBits = pdTRUE;
+        uint32_t ulValue = 0;
+
+        pxCtx->ulBits = ( pxCtx->ulBits << 8 ) | pucInput[ uxIdx ];
+        pxCtx->ulBitCount += 8U;
+
+        while( ( xMoreBits == pdTRUE ) &&
+               ( pxCtx->xStatus == OTA_DECOMPRESS_OK ) )
+        {
+            switch( pxCtx->ucState )
+            {
+                case STATE_TAG:
+                    xMoreBits = prvTakeBits( pxCtx, 1U, &ulValue );
+
+                    if( xMoreBits == pdTRUE )
+                    {
+                        pxCtx->ucState = ( ulValue != 0 ) ? STATE_LITERAL : STATE_INDEX;
+                    }
+
+                    break;
+
+                case STATE_LITERAL:
+                    xMoreBits = prvTakeBits( pxCtx, 8U, &ulValue );
+
+                    if( xMoreBits == pdTRUE )
+                    {
+                        prvEmit( pxCtx, ( uint8_t ) ulValue );
+                        pxCtx->ucState = STATE_TAG;
+                    }
+
+                    break;
+
+                case STATE_INDEX:
+                    xMoreBits = prvTakeBits( pxCtx, OTA_DECOMPRESS_WINDOW_BITS, &ulValue );
+
+                    if( xMoreBits == pdTRUE )
+                    {
+                        pxCtx->ulOffset = ulValue + 1U;
+                        pxCtx->ucState = STATE_COUNT;
+                    }
+
+                    break;
+
+                case STATE_COUNT:
+                    xMoreBits = prvTakeBits( pxCtx, OTA_DECOMPRESS_LOOKAHEAD_BITS, &ulValue );
+
+                    if( xMoreBits == pdTRUE )
+                    {
+                        for( uint32_t i = 0; ( i <= ulValue ) && ( pxCtx->xStatus == OTA_DECOMPRESS_OK ); i++ )
+                        {
+                            prvEmit( pxCtx, pxCtx->pucWindow[ ( pxCtx->ulHead - pxCtx->ulOffset ) & WINDOW_MASK ] );
+                        }
+
+                        pxCtx->ucState = STATE_TAG;
+                    }
+
+                    break;
+
+                default:
+                    configASSERT( 0 );
+                    break;
+            }
+        }
+    }
+
+    return pxCtx->xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+OtaDecompressStatus_t xOtaDecompressFinish( OtaDecompressCtx_t * pxCtx,
+                                            uint32_t * pulTotalOut )
+{
+    configASSERT( pxCtx != NULL );
+
+    /* Any remaining bits are padding of the last byte */
+    if( ( pxCtx->xStatus == OTA_DECOMPRESS_OK ) &&
+        ( prvOutputFlush( pxCtx ) != pdTRUE ) )
+    {
+        pxCtx->xStatus = OTA_DECOMPRESS_ERR_OUTPUT;
+    }
+
+    if( pulTotalOut != NULL )
+    {
+        *pulTotalOut = pxCtx->ulTotalOut;
+    }
+
+    return pxCtx->xStatus;
+}
@@ -0,0 +1,409 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file ota_delta.c
+ * @brief Streaming decoder for the delta OTA patch format described in ota_delta.h.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "ota_delta.h"
+
+#define OTA_DELTA_HEADER_LEN    ( 12U )
+
+static_assert( OTA_DELTA_WINDOW_SIZE > 0, "OTA_DELTA_WINDOW_SIZE must not be 0" );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvReadLe32( const uint8_t * pucField )
+{
+    return ( ( uint32_t ) pucField[ 0 ] ) |
+           ( ( uint32_t ) pucField[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucField[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucField[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvWindowFlush( OtaDeltaCtx_t * pxCtx )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pxCtx->ulWindowLen > 0 )
+    {
+        xResult = pxCtx->xWrite( pxCtx->pvWriteCtx,
+                                 pxCtx->ulNewOffset - pxCtx->ulWindowLen,
+                                 pxCtx->pucWindow,
+                                 pxCtx->ulWindowLen );
+        pxCtx->ulWindowLen = 0;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Produce ulLength output bytes from pucSource, or from pucSource plus pucAddend when given */
+static BaseType_t prvEmit( OtaDeltaCtx_t * pxCtx,
+                           const uint8_t * pucSource,
+                           const uint8_t * pucAddend,
+                           uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+
+    while( ( xResult == pdTRUE ) &&
+           ( ulLength > 0 ) )
+    {
+        uint32_t ulChunk = OTA_DELTA_WINDOW_SIZE - pxCtx->ulWindowLen;
+
+        if( ulChunk > ulLength )
+        {
+            ulChunk = ulLength;
+        }
+
+        if( pucAddend == NULL )
+        {
+            ( void ) memcpy( &( pxCtx->pucWindow[ pxCtx->ulWindowLen ] ), pucSource, ulChunk );
+        }
+        else
+        {
+            for( uint32_t i = 0; i < ulChunk; i++ )
+            {
+                pxCtx->pucWindow[ pxCtx->ulWindowLen + i ] = ( uint8_t ) ( pucSource[ i ] + pucAddend[ i ] );
+            }
+
+            pucAddend += ulChunk;
+        }
+
+        pucSource += ulChunk;
+        ulLength -= ulChunk;
+        pxCtx->ulWindowLen += ulChunk;
+        pxCtx->ulNewOffset += ulChunk;
+
+        if( pxCtx->ulWindowLen == OTA_DELTA_WINDOW_SIZE )
+        {
+            xResult = prvWindowFlush( pxCtx );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetError( OtaDeltaCtx_t * pxCtx,
+                         OtaDeltaStatus_t xError )
+{
+    pxCtx->xState = OTA_DELTA_STATE_ERROR;
+    pxCtx->xError = xError;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvExpectFields( OtaDeltaCtx_t * pxCtx,
+                             OtaDeltaState_t xState,
+                             uint32_t ulFieldsNeeded )
+{
+    pxCtx->xState = xState;
+    pxCtx->ulFieldsLen = 0;
+    pxCtx->ulFieldsNeeded = ulFieldsNeeded;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called at the end of each operation */
+static void prvOperationDone( OtaDeltaCtx_t * pxCtx )
+{
+    if( pxCtx->ulNewOffset < pxCtx->ulNewSize )
+    {
+        pxCtx->xState = OTA_DELTA_STATE_OPCODE;
+    }
+    else if( prvWindowFlush( pxCtx ) == pdTRUE )
+    {
+        LogInfo( ( "Delta update complete: %lu byte image reconstructed.", pxCtx->ulNewSize ) );
+        pxCtx->xState = OTA_DELTA_STATE_DONE;
+    }
+    else
+    {
+        prvSetError( pxCtx, OTA_DELTA_ERR_WRITE );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvParseHeader( OtaDeltaCtx_t * pxCtx )
+{
+    uint32_t ulMagic = prvReadLe32( &( pxCtx->pucFields[ 0 ] ) );
+    uint32_t ulNewSize = prvReadLe32( &( pxCtx->pucFields[ 4 ] ) );
+    uint32_t ulOldSize = prvReadLe32( &( pxCtx->pucFields[ 8 ] ) );
+
+    if( ( ulMagic != OTA_DELTA_MAGIC ) ||
+        ( ulNewSize == 0 ) )
+    {
+        LogError( ( "Invalid delta patch header." ) );
+        prvSetError( pxCtx, OTA_DELTA_ERR_FORMAT );
+    }
+    else if( ulOldSize > pxCtx->ulOldImageLen )
+    {
+        LogError( ( "Delta patch expects a %lu byte base image, only %lu bytes are available.",
+                    ulOldSize, pxCtx->ulOldImageLen ) );
+        prvSetError( pxCtx, OTA_DELTA_ERR_BOUNDS );
+    }
+    else
+    {
+        LogInfo( ( "Delta patch: base image %lu bytes, new image %lu bytes.", ulOldSize, ulNewSize ) );
+        pxCtx->ulNewSize = ulNewSize;
+        pxCtx->ulOldSize = ulOldSize;
+        pxCtx->xState = OTA_DELTA_STATE_OPCODE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvParseArgs( OtaDeltaCtx_t * pxCtx )
+{
+    uint32_t ulLength = 0;
+
+    if( pxCtx->ucOpcode == OTA_DELTA_OP_INSERT )
+    {
+        ulLength = prvReadLe32( &( pxCtx->pucFields[ 0 ] ) );
+        pxCtx->ulOldOffset = 0;
+    }
+    else
+    {
+        pxCtx->ulOldOffset = prvReadLe32( &( pxCtx->pucFields[ 0 ] ) );
+        ulLength = prvReadLe32( &( pxCtx->pucFields[ 4 ] ) );
+
+        if( ( pxCtx->ulOldOffset > pxCtx->ulOldSize ) ||
+            ( ulLength > ( pxCtx->ulOldSize - pxCtx->ulOldOffset ) ) )
+        {
+            prvSetError( pxCtx, OTA_DELTA_ERR_BOUNDS );
+        }
+    }
+
+    if( ( pxCtx->xState != OTA_DELTA_STATE_ERROR ) &&
+        ( ulLength > ( pxCtx->ulNewSize - pxCtx->ulNewOffset ) ) )
+    {
+        prvSetError( pxCtx, OTA_DELTA_ERR_BOUNDS );
+    }
+
+    if( pxCtx->xState == OTA_DELTA_STATE_ERROR )
+    {
+        LogError( ( "Delta patch operation %u at output offset %lu is out of bounds.",
+                    pxCtx->ucOpcode, pxCtx->ulNewOffset ) );
+    }
+    else if( pxCtx->ucOpcode == OTA_DELTA_OP_COPY )
+    {
+        /* Copies carry no patch data and complete immediately */
+        if( prvEmit( pxCtx, &( pxCtx->pucOldImage[ pxCtx->ulOldOffset ] ), NULL, ulLength ) == pdTRUE )
+        {
+            prvOperationDone( pxCtx );
+        }
+        else
+        {
+            prvSetError( pxCtx, OTA_DELTA_ERR_WRITE );
+        }
+    }
+    else if( ulLength == 0 )
+    {
+        prvOperationDone( pxCtx );
+    }
+    else
+    {
+        pxCtx->ulRemaining = ulLength;
+        pxCtx->xState = OTA_DELTA_STATE_DATA;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaDeltaInit( OtaDeltaCtx_t * pxCtx,
+                    const uint8_t * pucOldImage,
+                    size_t uxOldImageLen,
+                    OtaDeltaWrite_t xWrite,
+                    void * pvWriteCtx )
+{
+    configASSERT( pxCtx != NULL );
+    configASSERT( pucOldImage != NULL );
+    configASSERT( xWrite != NULL );
+
+    ( void ) memset( pxCtx, 0, sizeof( OtaDeltaCtx_t ) );
+
+    pxCtx->pucOldImage = pucOldImage;
+    pxCtx->ulOldImageLen = ( uint32_t ) uxOldImageLen;
+    pxCtx->xWrite = xWrite;
+    pxCtx->pvWriteCtx = pvWriteCtx;
+
+    prvExpectFields( pxCtx, OTA_DELTA_STATE_HEADER, OTA_DELTA_HEADER_LEN );
+}
+
+/*-----------------------------------------------------------*/
+
+OtaDeltaStatus_t xOtaDeltaProcess( OtaDeltaCtx_t * pxCtx,
+                                   const uint8_t * pucPatch,
+                                   size_t uxLength )
+{
+    OtaDeltaStatus_t xStatus = OTA_DELTA_OK;
+
+    configASSERT( pxCtx != NULL );
+    configASSERT( ( pucPatch != NULL ) || ( uxLength == 0 ) );
+
+    while( ( uxLength > 0 ) &&
+           ( pxCtx->xState != OTA_DELTA_STATE_DONE ) &&
+           ( pxCtx->xState != OTA_DELTA_STATE_ERROR ) )
+    {
+        uint32_t ulChunk = 0;
+
+        switch( pxCtx->xState )
+        {
+            case OTA_DELTA_STATE_HEADER:
+            case OTA_DELTA_STATE_ARGS:
+                ulChunk = pxCtx->ulFieldsNeeded - pxCtx->ulFieldsLen;
+
+                if( ulChunk > uxLength )
+                {
+                    ulChunk = ( uint32_t ) uxLength;
+                }
+
+                ( void ) memcpy( &( pxCtx->pucFields[ pxCtx->ulFieldsLen ] ), pucPatch, ulChunk );
+                pxCtx->ulFieldsLen += ulChunk;
+
+                if( pxCtx->ulFieldsLen == pxCtx->ulFieldsNeeded )
+                {
+                    if( pxCtx->xState == OTA_DELTA_STATE_HEADER )
+                    {
+                        prvParseHeader( pxCtx );
+                    }
+                    else
+                    {
+                        prvParseArgs( pxCtx );
+                    }
+                }
+
+                break;
+
+            case OTA_DELTA_STATE_OPCODE:
+                ulChunk = 1;
+                pxCtx->ucOpcode = pucPatch[ 0 ];
+
+                if( pxCtx->ucOpcode == OTA_DELTA_OP_INSERT )
+                {
+                    prvExpectFields( pxCtx, OTA_DELTA_STATE_ARGS, 4U );
+                }
+                else if( ( pxCtx->ucOpcode == OTA_DELTA_OP_COPY ) ||
+                         ( pxCtx->ucOpcode == OTA_DELTA_OP_ADD ) )
+                {
+                    prvExpectFields( pxCtx, OTA_DELTA_STATE_ARGS, 8U );
+                }
+                else
+                {
+                    LogError( ( "Unknown delta patch opcode: 0x%02x.", pxCtx->ucOpcode ) );
+                    prvSetError( pxCtx, OTA_DELTA_ERR_FORMAT );
+                }
+
+                break;
+
+            case OTA_DELTA_STATE_DATA:
+                ulChunk = pxCtx->ulRemaining;
+
+                if( ulChunk > uxLength )
+                {
+                    ulChunk = ( uint32_t ) uxLength;
+                }
+
+                if( pxCtx->ucOpcode == OTA_DELTA_OP_ADD )
+                {
+                    if( prvEmit( pxCtx, &( pxCtx->pucOldImage[ pxCtx->ulOldOffset ] ), pucPatch, ulChunk ) != pdTRUE )
+                    {
+                        prvSetError( pxCtx, OTA_DELTA_ERR_WRITE );
+                    }
+
+                    pxCtx->ulOldOffset += ulChunk;
+                }
+                else if( prvEmit( pxCtx, pucPatch, NULL, ulChunk ) != pdTRUE )
+                {
+                    prvSetError( pxCtx, OTA_DELTA_ERR_WRITE );
+                }
+                else
+                {
+                    /* Empty */
+                }
+
+                pxCtx->ulRemaining -= ulChunk;
+
+                if( ( pxCtx->xState == OTA_DELTA_STATE_DATA ) &&
+                    ( pxCtx->ulRemaining == 0 ) )
+                {
+                    prvOperationDone( pxCtx );
+                }
+
+                break;
+
+            default:
+                break;
+        }
+
+        pucPatch += ulChunk;
+        uxLength -= ulChunk;
+    }
+
+    if( pxCtx->xState == OTA_DELTA_STATE_DONE )
+    {
+        xStatus = OTA_DELTA_COMPLETE;
+    }
+    else if( pxCtx->xState == OTA_DELTA_STATE_ERROR )
+    {
+        xStatus = pxCtx->xError;
+    }
+    else
+    {
+        xStatus = OTA_DELTA_OK;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulOtaDeltaNewSize( const OtaDeltaCtx_t * pxCtx )
+{
+    configASSERT( pxCtx != NULL );
+
+    return pxCtx->ulNewSize;
+}
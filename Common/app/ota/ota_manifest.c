@@ -0,0 +1,331 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file ota_manifest.c
+ * @brief Receive and check the block hash manifest described in ota_manifest.h.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "mbedtls/md.h"
+
+#include "ota_manifest.h"
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvReadLe32( const uint8_t * pucField )
+{
+    return ( ( uint32_t ) pucField[ 0 ] ) |
+           ( ( uint32_t ) pucField[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucField[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucField[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvSignedLen( const OtaManifestCtx_t * pxCtx )
+{
+    return OTA_MANIFEST_HEADER_LEN + ( pxCtx->ulBlocks * OTA_MANIFEST_HASH_LEN );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSha256( const uint8_t * pucData,
+                             size_t uxLength,
+                             uint8_t pucDigest[ OTA_MANIFEST_HASH_LEN ] )
+{
+    /* On the HASH peripheral when MBEDTLS_SHA256_ALT is enabled */
+    int lRslt = mbedtls_md( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ), pucData, uxLength, pucDigest );
+
+    return ( lRslt == 0 ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaManifestStatus_t prvParseHeader( OtaManifestCtx_t * pxCtx,
+                                           const uint8_t * pucData,
+                                           uint32_t ulLength )
+{
+    OtaManifestStatus_t xStatus = OTA_MANIFEST_OK;
+    const uint32_t ulBlockSize = ( 1UL << pxCtx->ulLog2BlockSize );
+    uint32_t ulManifestSize = 0;
+    uint32_t ulImageSize = 0;
+    uint32_t ulSigLen = 0;
+    uint32_t ulBlocks = 0;
+
+    if( ulLength < OTA_MANIFEST_HEADER_LEN )
+    {
+        xStatus = OTA_MANIFEST_ERR_FORMAT;
+    }
+    else
+    {
+        ulSigLen = ( uint32_t ) pucData[ 6 ] | ( ( uint32_t ) pucData[ 7 ] << 8 );
+        ulImageSize = prvReadLe32( &( pucData[ 8 ] ) );
+        ulManifestSize = prvReadLe32( &( pucData[ 12 ] ) );
+        ulBlocks = ( ulImageSize + ulBlockSize - 1U ) >> pxCtx->ulLog2BlockSize;
+
+        if( ( prvReadLe32( pucData ) != OTA_MANIFEST_MAGIC ) ||
+            ( pucData[ 4 ] != OTA_MANIFEST_VERSION ) )
+        {
+            LogError( "Not an OTA block hash manifest." );
+            xStatus = OTA_MANIFEST_ERR_FORMAT;
+        }
+        else if( pucData[ 5 ] != pxCtx->ulLog2BlockSize )
+        {
+            LogError( "Manifest hashes %u byte blocks, the download uses %u byte blocks.",
+                      ( uint32_t ) ( 1UL << ( pucData[ 5 ] & 0x1FU ) ), ulBlockSize );
+            xStatus = OTA_MANIFEST_ERR_FORMAT;
+        }
+        else if( ( ulSigLen == 0 ) ||
+                 ( ulSigLen > OTA_MANIFEST_MAX_SIG_LEN ) ||
+                 ( ulImageSize == 0 ) ||
+                 ( ( ulManifestSize & ( ulBlockSize - 1U ) ) != 0 ) ||
+                 ( ulManifestSize >= pxCtx->ulFileSize ) ||
+                 ( ulImageSize != ( pxCtx->ulFileSize - ulManifestSize ) ) ||
+                 ( ulManifestSize > pxCtx->uxBufferLen ) ||
+                 ( ( OTA_MANIFEST_HEADER_LEN + ( ulBlocks * OTA_MANIFEST_HASH_LEN ) + ulSigLen ) > ulManifestSize ) )
+        {
+            LogError( "Inconsistent manifest header: image %u bytes, manifest %u bytes, signature %u bytes, file %u bytes.",
+                      ulImageSize, ulManifestSize, ulSigLen, pxCtx->ulFileSize );
+            xStatus = OTA_MANIFEST_ERR_FORMAT;
+        }
+        else
+        {
+            pxCtx->ulManifestSize = ulManifestSize;
+            pxCtx->ulImageSize = ulImageSize;
+            pxCtx->ulSigLen = ulSigLen;
+            pxCtx->ulBlocks = ulBlocks;
+            pxCtx->ulMissing = ulManifestSize >> pxCtx->ulLog2BlockSize;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxOtaManifestBufferSize( uint32_t ulFileSize,
+                                uint32_t ulLog2BlockSize )
+{
+    const uint32_t ulBlockSize = ( 1UL << ulLog2BlockSize );
+    uint32_t ulBlocks = ( ulFileSize + ulBlockSize - 1U ) >> ulLog2BlockSize;
+
+    /* The hashes of every block of the file bound those of the image */
+    size_t uxSize = OTA_MANIFEST_HEADER_LEN + ( ( size_t ) ulBlocks * OTA_MANIFEST_HASH_LEN ) + OTA_MANIFEST_MAX_SIG_LEN;
+
+    uxSize = ( uxSize + ulBlockSize - 1U ) & ~( ( size_t ) ulBlockSize - 1U );
+
+    if( uxSize > ( ( size_t ) OTA_MANIFEST_MAX_BLOCKS << ulLog2BlockSize ) )
+    {
+        uxSize = 0;
+    }
+
+    return uxSize;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaManifestInit( OtaManifestCtx_t * pxCtx,
+                       uint8_t * pucBuffer,
+                       size_t uxBufferLen,
+                       uint32_t ulFileSize,
+                       uint32_t ulLog2BlockSize )
+{
+    configASSERT( pxCtx != NULL );
+
+    ( void ) memset( pxCtx, 0, sizeof( OtaManifestCtx_t ) );
+
+    pxCtx->pucBuffer = pucBuffer;
+    pxCtx->uxBufferLen = uxBufferLen;
+    pxCtx->ulFileSize = ulFileSize;
+    pxCtx->ulLog2BlockSize = ulLog2BlockSize;
+    pxCtx->xVerified = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+OtaManifestStatus_t xOtaManifestFeed( OtaManifestCtx_t * pxCtx,
+                                      uint32_t ulOffset,
+                                      const uint8_t * pucData,
+                                      uint32_t ulLength )
+{
+    OtaManifestStatus_t xStatus = OTA_MANIFEST_OK;
+    uint32_t ulBlock = ulOffset >> pxCtx->ulLog2BlockSize;
+
+    configASSERT( pxCtx != NULL );
+    configASSERT( pucData != NULL );
+
+    if( pxCtx->ulManifestSize == 0 )
+    {
+        xStatus = ( ulOffset == 0 ) ? prvParseHeader( pxCtx, pucData, ulLength ) : OTA_MANIFEST_SKIP;
+    }
+    else if( ( pxCtx->xVerified == pdTRUE ) ||
+             ( ulOffset >= pxCtx->ulManifestSize ) )
+    {
+        xStatus = OTA_MANIFEST_SKIP;
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    if( xStatus != OTA_MANIFEST_OK )
+    {
+        /* Empty */
+    }
+    else if( ( ulBlock >= OTA_MANIFEST_MAX_BLOCKS ) ||
+             ( ( ulOffset + ulLength ) > pxCtx->ulManifestSize ) )
+    {
+        xStatus = OTA_MANIFEST_ERR_FORMAT;
+    }
+    else if( ( pxCtx->pucReceived[ ulBlock >> 3 ] & ( 1U << ( ulBlock & 7U ) ) ) == 0U )
+    {
+        ( void ) memcpy( &( pxCtx->pucBuffer[ ulOffset ] ), pucData, ulLength );
+        pxCtx->pucReceived[ ulBlock >> 3 ] |= ( uint8_t ) ( 1U << ( ulBlock & 7U ) );
+        pxCtx->ulMissing--;
+    }
+    else
+    {
+        /* Duplicate */
+    }
+
+    if( ( xStatus == OTA_MANIFEST_OK ) &&
+        ( pxCtx->ulMissing == 0 ) )
+    {
+        xStatus = OTA_MANIFEST_COMPLETE;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaManifestDigest( const OtaManifestCtx_t * pxCtx,
+                               uint8_t pucDigest[ OTA_MANIFEST_HASH_LEN ],
+                               const uint8_t ** ppucSignature,
+                               size_t * puxSignatureLen )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxCtx != NULL );
+    configASSERT( ppucSignature != NULL );
+    configASSERT( puxSignatureLen != NULL );
+
+    if( ( pxCtx->ulManifestSize != 0 ) &&
+        ( pxCtx->ulMissing == 0 ) )
+    {
+        xResult = prvSha256( pxCtx->pucBuffer, prvSignedLen( pxCtx ), pucDigest );
+
+        *ppucSignature = &( pxCtx->pucBuffer[ prvSignedLen( pxCtx ) ] );
+        *puxSignatureLen = pxCtx->ulSigLen;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaManifestSetVerified( OtaManifestCtx_t * pxCtx )
+{
+    configASSERT( pxCtx != NULL );
+    configASSERT( pxCtx->ulMissing == 0 );
+
+    pxCtx->xVerified = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaManifestIsVerified( const OtaManifestCtx_t * pxCtx )
+{
+    return pxCtx->xVerified;
+}
+
+/*-----------------------------------------------------------*/
+
+OtaManifestStatus_t xOtaManifestCheckBlock( const OtaManifestCtx_t * pxCtx,
+                                            uint32_t ulImageOffset,
+                                            const uint8_t * pucData,
+                                            uint32_t ulLength )
+{
+    OtaManifestStatus_t xStatus = OTA_MANIFEST_ERR_HASH;
+    const uint32_t ulBlockSize = ( 1UL << pxCtx->ulLog2BlockSize );
+    uint32_t ulBlock = ulImageOffset >> pxCtx->ulLog2BlockSize;
+
+    configASSERT( pxCtx != NULL );
+
+    if( pxCtx->xVerified == pdFALSE )
+    {
+        xStatus = OTA_MANIFEST_ERR_STATE;
+    }
+    else if( ( ( ulImageOffset & ( ulBlockSize - 1U ) ) == 0 ) &&
+             ( ulBlock < pxCtx->ulBlocks ) &&
+             ( ulLength == ( ( ( pxCtx->ulImageSize - ulImageOffset ) > ulBlockSize ) ? ulBlockSize : ( pxCtx->ulImageSize - ulImageOffset ) ) ) )
+    {
+        uint8_t pucDigest[ OTA_MANIFEST_HASH_LEN ];
+
+        if( ( prvSha256( pucData, ulLength, pucDigest ) == pdTRUE ) &&
+            ( memcmp( pucDigest,
+                      &( pxCtx->pucBuffer[ OTA_MANIFEST_HEADER_LEN + ( ulBlock * OTA_MANIFEST_HASH_LEN ) ] ),
+                      OTA_MANIFEST_HASH_LEN ) == 0 ) )
+        {
+            xStatus = OTA_MANIFEST_OK;
+        }
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulOtaManifestSize( const OtaManifestCtx_t * pxCtx )
+{
+    return pxCtx->ulManifestSize;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulOtaManifestImageSize( const OtaManifestCtx_t * pxCtx )
+{
+    return pxCtx->ulImageSize;
+}
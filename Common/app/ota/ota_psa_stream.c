@@ -0,0 +1,355 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include "ota.h"
+#include "ota_config.h"
+#include "ota_pal.h"
+
+#include "ota_psa_stream.h"
+#include "static_alloc.h"
+
+#if ( OTA_PSA_STREAM_ENABLED == 1 )
+
+    #if ( OTA_PSA_STREAM_CHUNK_SIZE > INT16_MAX ) || ( ( OTA_PSA_STREAM_CHUNK_SIZE % otaconfigFILE_BLOCK_SIZE ) != 0 )
+        #error "OTA_PSA_STREAM_CHUNK_SIZE must be a multiple of otaconfigFILE_BLOCK_SIZE and fit the int16_t PAL return."
+    #endif
+
+    #define STREAM_NUM_BUFFERS    2U
+
+    typedef struct
+    {
+        uint8_t * pucData;
+        uint32_t ulOffset;
+        uint32_t ulLength;
+    } StreamWrite_t;
+
+    static QueueHandle_t xWriteQueue = NULL;
+    static SemaphoreHandle_t xFreeBuffers = NULL;
+
+/* Owned by the OTA agent task, between create and close or abort */
+    static OtaFileContext_t * pxStreamFile = NULL;
+    static uint8_t * pucBuffers[ STREAM_NUM_BUFFERS ] = { NULL };
+    static uint32_t ulActive = 0;
+    static uint32_t ulFill = 0;
+    static uint32_t ulFillOffset = 0;
+
+/* Set by the writer task, cleared when a file is created */
+    static volatile BaseType_t xWriteFailed = pdFALSE;
+
+    static OtaPsaStreamStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+    static void prvWriterTask( void * pvParameters )
+    {
+        StreamWrite_t xWrite;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            if( xQueueReceive( xWriteQueue, &xWrite, portMAX_DELAY ) == pdTRUE )
+            {
+                /* Nothing more is written to the secure side after a failure */
+                if( xWriteFailed == pdFALSE )
+                {
+                    int16_t sResult = otaPal_WriteBlock( pxStreamFile, xWrite.ulOffset,
+                                                         xWrite.pucData, xWrite.ulLength );
+
+                    if( ( sResult < 0 ) || ( ( uint32_t ) sResult != xWrite.ulLength ) )
+                    {
+                        LogError( "Failed to write %u bytes at offset %u: %d.",
+                                  xWrite.ulLength, xWrite.ulOffset, sResult );
+                        xStats.ulErrors++;
+                        xWriteFailed = pdTRUE;
+                    }
+                    else
+                    {
+                        xStats.ulChunks++;
+                        xStats.ulBytes += xWrite.ulLength;
+                    }
+                }
+
+                ( void ) xSemaphoreGive( xFreeBuffers );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Queue the active buffer and take the other one, waiting for its write to end */
+    static void prvSubmitActive( void )
+    {
+        StreamWrite_t xWrite =
+        {
+            .pucData  = pucBuffers[ ulActive ],
+            .ulOffset = ulFillOffset,
+            .ulLength = ulFill
+        };
+
+        ( void ) xQueueSend( xWriteQueue, &xWrite, portMAX_DELAY );
+
+        /* Writes complete in order, so the free buffer is always the other one */
+        if( xSemaphoreTake( xFreeBuffers, 0 ) == pdFALSE )
+        {
+            xStats.ulWaits++;
+            ( void ) xSemaphoreTake( xFreeBuffers, portMAX_DELAY );
+        }
+
+        ulActive = ( ulActive + 1 ) % STREAM_NUM_BUFFERS;
+        ulFillOffset += ulFill;
+        ulFill = 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Wait for every queued write, the active buffer is kept */
+    static void prvDrain( void )
+    {
+        for( uint32_t i = 1; i < STREAM_NUM_BUFFERS; i++ )
+        {
+            ( void ) xSemaphoreTake( xFreeBuffers, portMAX_DELAY );
+        }
+
+        for( uint32_t i = 1; i < STREAM_NUM_BUFFERS; i++ )
+        {
+            ( void ) xSemaphoreGive( xFreeBuffers );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvFreeBuffers( void )
+    {
+        for( uint32_t i = 0; i < STREAM_NUM_BUFFERS; i++ )
+        {
+            vPortFree( pucBuffers[ i ] );
+            pucBuffers[ i ] = NULL;
+        }
+
+        if( pxStreamFile != NULL )
+        {
+            /* Give back the active buffer */
+            ( void ) xSemaphoreGive( xFreeBuffers );
+            pxStreamFile = NULL;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t xOtaPsaStreamInit( void )
+    {
+        BaseType_t xResult = pdPASS;
+
+        if( xWriteQueue == NULL )
+        {
+            xWriteQueue = xAppQueueCreate( STREAM_NUM_BUFFERS, sizeof( StreamWrite_t ) );
+            xFreeBuffers = xAppSemaphoreCreateCounting( STREAM_NUM_BUFFERS, STREAM_NUM_BUFFERS );
+
+            xResult = xAppTaskCreate( prvWriterTask, "OTAWriter", OTA_PSA_STREAM_TASK_STACK_SIZE,
+                                      NULL, OTA_PSA_STREAM_TASK_PRIORITY, NULL );
+
+            configASSERT( xResult == pdPASS );
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    OtaPalStatus_t xOtaPsaStreamCreateFile( OtaFileContext_t * const pFileContext )
+    {
+        OtaPalStatus_t xStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+
+        configASSERT( xWriteQueue != NULL );
+        configASSERT( pxStreamFile == NULL );
+
+        for( uint32_t i = 0; i < STREAM_NUM_BUFFERS; i++ )
+        {
+            pucBuffers[ i ] = pvPortMalloc( OTA_PSA_STREAM_CHUNK_SIZE );
+        }
+
+        if( ( pucBuffers[ 0 ] == NULL ) || ( pucBuffers[ 1 ] == NULL ) )
+        {
+            LogError( "Failed to allocate the OTA chunk buffers." );
+            prvFreeBuffers();
+        }
+        else
+        {
+            xStatus = otaPal_CreateFileForRx( pFileContext );
+
+            if( OTA_PAL_MAIN_ERR( xStatus ) == OtaPalSuccess )
+            {
+                ( void ) xSemaphoreTake( xFreeBuffers, portMAX_DELAY );
+                pxStreamFile = pFileContext;
+                ulActive = 0;
+                ulFill = 0;
+                ulFillOffset = 0;
+                xWriteFailed = pdFALSE;
+
+                taskENTER_CRITICAL();
+                {
+                    ( void ) memset( &xStats, 0, sizeof( xStats ) );
+                }
+                taskEXIT_CRITICAL();
+            }
+            else
+            {
+                prvFreeBuffers();
+            }
+        }
+
+        return xStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    int16_t sOtaPsaStreamWriteBlock( OtaFileContext_t * const pFileContext,
+                                     uint32_t ulOffset,
+                                     uint8_t * const pData,
+                                     uint32_t ulBlockSize )
+    {
+        int16_t sResult = -1;
+
+        if( ( pFileContext == pxStreamFile ) &&
+            ( pxStreamFile != NULL ) &&
+            ( xWriteFailed == pdFALSE ) )
+        {
+            uint32_t ulCopied = 0;
+
+            /* Blocks re-requested out of order start a new chunk */
+            if( ( ulFill > 0 ) && ( ulOffset != ( ulFillOffset + ulFill ) ) )
+            {
+                xStats.ulSplits++;
+                prvSubmitActive();
+            }
+
+            if( ulFill == 0 )
+            {
+                ulFillOffset = ulOffset;
+            }
+
+            while( ulCopied < ulBlockSize )
+            {
+                uint32_t ulLen = OTA_PSA_STREAM_CHUNK_SIZE - ulFill;
+
+                if( ulLen > ( ulBlockSize - ulCopied ) )
+                {
+                    ulLen = ulBlockSize - ulCopied;
+                }
+
+                ( void ) memcpy( &( pucBuffers[ ulActive ][ ulFill ] ), &( pData[ ulCopied ] ), ulLen );
+                ulFill += ulLen;
+                ulCopied += ulLen;
+
+                if( ulFill == OTA_PSA_STREAM_CHUNK_SIZE )
+                {
+                    prvSubmitActive();
+                }
+            }
+
+            sResult = ( int16_t ) ulBlockSize;
+        }
+
+        return sResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    OtaPalStatus_t xOtaPsaStreamCloseFile( OtaFileContext_t * const pFileContext )
+    {
+        OtaPalStatus_t xStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+
+        if( pxStreamFile != NULL )
+        {
+            if( ulFill > 0 )
+            {
+                prvSubmitActive();
+            }
+
+            prvDrain();
+
+            if( xWriteFailed == pdFALSE )
+            {
+                LogInfo( "Wrote %u bytes to the staging slot in %u chunks, %u waits for the secure side.",
+                         xStats.ulBytes, xStats.ulChunks, xStats.ulWaits );
+                xStatus = otaPal_CloseFile( pFileContext );
+            }
+            else
+            {
+                ( void ) otaPal_Abort( pFileContext );
+            }
+
+            prvFreeBuffers();
+        }
+
+        return xStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    OtaPalStatus_t xOtaPsaStreamAbort( OtaFileContext_t * const pFileContext )
+    {
+        if( pxStreamFile != NULL )
+        {
+            /* Skip the queued writes */
+            xWriteFailed = pdTRUE;
+            ulFill = 0;
+            prvDrain();
+            prvFreeBuffers();
+        }
+
+        return otaPal_Abort( pFileContext );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vOtaPsaStreamGetStats( OtaPsaStreamStats_t * pxStats )
+    {
+        configASSERT( pxStats != NULL );
+
+        taskENTER_CRITICAL();
+        {
+            *pxStats = xStats;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+#endif /* OTA_PSA_STREAM_ENABLED == 1 */
@@ -0,0 +1,221 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ota_timing.h"
+
+/*-----------------------------------------------------------*/
+
+static OtaTimingReport_t xReport = { .ulMagic = OTA_TIMING_MAGIC };
+
+/* Start of the phases in progress, not part of the saved report */
+static TickType_t pxPhaseStart[ OTA_TIMING_PHASE_MAX ] = { 0 };
+static BaseType_t pxPhaseStarted[ OTA_TIMING_PHASE_MAX ] = { 0 };
+
+static const char * const pcPhaseNames[ OTA_TIMING_PHASE_MAX ] =
+{
+    "job_fetch_ms",
+    "erase_ms",
+    "download_ms",
+    "hash_ms",
+    "signature_ms",
+    "bank_swap_ms",
+    "self_test_ms",
+};
+
+/*-----------------------------------------------------------*/
+
+void vOtaTimingStart( OtaTimingPhase_t xPhase )
+{
+    configASSERT( xPhase < OTA_TIMING_PHASE_MAX );
+
+    taskENTER_CRITICAL();
+    {
+        pxPhaseStart[ xPhase ] = xTaskGetTickCount();
+        pxPhaseStarted[ xPhase ] = pdTRUE;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaTimingStop( OtaTimingPhase_t xPhase )
+{
+    configASSERT( xPhase < OTA_TIMING_PHASE_MAX );
+
+    taskENTER_CRITICAL();
+    {
+        if( pxPhaseStarted[ xPhase ] == pdTRUE )
+        {
+            xReport.pulPhaseMs[ xPhase ] = ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - pxPhaseStart[ xPhase ] );
+            pxPhaseStarted[ xPhase ] = pdFALSE;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaTimingRecordBlock( uint32_t ulBytes,
+                            uint32_t ulWriteUs )
+{
+    taskENTER_CRITICAL();
+    {
+        xReport.ulBlocks++;
+        xReport.ulBytes += ulBytes;
+        xReport.ullBlockWriteTotalUs += ulWriteUs;
+
+        if( ulWriteUs > xReport.ulBlockWriteMaxUs )
+        {
+            xReport.ulBlockWriteMaxUs = ulWriteUs;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaTimingGetReport( OtaTimingReport_t * pxReport )
+{
+    configASSERT( pxReport != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        ( void ) memcpy( pxReport, &xReport, sizeof( OtaTimingReport_t ) );
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaTimingRestore( const OtaTimingReport_t * pxReport )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxReport != NULL ) &&
+        ( pxReport->ulMagic == OTA_TIMING_MAGIC ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( &xReport, pxReport, sizeof( OtaTimingReport_t ) );
+        }
+        taskEXIT_CRITICAL();
+
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaTimingReset( void )
+{
+    taskENTER_CRITICAL();
+    {
+        ( void ) memset( &xReport, 0, sizeof( OtaTimingReport_t ) );
+        xReport.ulMagic = OTA_TIMING_MAGIC;
+        ( void ) memset( pxPhaseStarted, 0, sizeof( pxPhaseStarted ) );
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxOtaTimingFormat( const char * pcResult,
+                          char * pcBuffer,
+                          size_t uxBufferLen )
+{
+    OtaTimingReport_t xCopy;
+    size_t uxLen = 0;
+    int lRslt = 0;
+    uint32_t ulThroughput = 0;
+    uint32_t ulWriteAvgUs = 0;
+
+    configASSERT( pcResult != NULL );
+    configASSERT( pcBuffer != NULL );
+
+    vOtaTimingGetReport( &xCopy );
+
+    if( xCopy.pulPhaseMs[ OTA_TIMING_DOWNLOAD ] > 0 )
+    {
+        ulThroughput = ( uint32_t ) ( ( ( uint64_t ) xCopy.ulBytes * 1000U ) / xCopy.pulPhaseMs[ OTA_TIMING_DOWNLOAD ] );
+    }
+
+    if( xCopy.ulBlocks > 0 )
+    {
+        ulWriteAvgUs = ( uint32_t ) ( xCopy.ullBlockWriteTotalUs / xCopy.ulBlocks );
+    }
+
+    lRslt = snprintf( pcBuffer, uxBufferLen, "{\"result\":\"%s\"", pcResult );
+
+    for( uint32_t ulPhase = 0; ( lRslt > 0 ) && ( ulPhase < OTA_TIMING_PHASE_MAX ); ulPhase++ )
+    {
+        uxLen += ( size_t ) lRslt;
+
+        if( uxLen >= uxBufferLen )
+        {
+            break;
+        }
+
+        lRslt = snprintf( &pcBuffer[ uxLen ], uxBufferLen - uxLen, ",\"%s\":%lu",
+                          pcPhaseNames[ ulPhase ], xCopy.pulPhaseMs[ ulPhase ] );
+    }
+
+    if( ( lRslt > 0 ) && ( ( uxLen + ( size_t ) lRslt ) < uxBufferLen ) )
+    {
+        uxLen += ( size_t ) lRslt;
+
+        lRslt = snprintf( &pcBuffer[ uxLen ], uxBufferLen - uxLen,
+                          ",\"blocks\":%lu,\"bytes\":%lu,\"throughput_bps\":%lu"
+                          ",\"block_write_avg_us\":%lu,\"block_write_max_us\":%lu}",
+                          xCopy.ulBlocks, xCopy.ulBytes, ulThroughput,
+                          ulWriteAvgUs, xCopy.ulBlockWriteMaxUs );
+    }
+
+    if( ( lRslt > 0 ) && ( ( uxLen + ( size_t ) lRslt ) < uxBufferLen ) )
+    {
+        uxLen += ( size_t ) lRslt;
+    }
+    else
+    {
+        LogError( ( "OTA timing report does not fit in %u bytes.", uxBufferLen ) );
+        uxLen = 0;
+    }
+
+    return uxLen;
+}
@@ -48,6 +48,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 
 /* Kernel includes. */
@@ -79,11 +80,30 @@
 
 #include "mqtt_agent_task.h"
 
+#include "ota_timing.h"
+#include "custom_metrics.h"
+#include "dma_copy.h"
+#include "dvfs.h"
+#include "ota_psa_stream.h"
+
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+    /* HTTP data plane includes. */
+    #include "ota_http_interface.h"
+    #include "core_http_client.h"
+    #include "mbedtls_transport.h"
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 #include "kvstore.h"
 
 #ifdef TFM_PSA_API
     #include "tfm_fwu_defs.h"
     #include "psa/update.h"
+#else
+    /* Ends the rollback window of a new image once MQTT is connected, in ota_pal_stm32u5_ntz.c */
+    extern void otaPal_CommitOnConnect( void );
+
+    /* Sets the bits of the blocks refused by the PAL again, in ota_pal_stm32u5_ntz.c */
+    extern void otaPal_RequeueRejectedBlocks( void );
 #endif
 
 
@@ -118,6 +138,123 @@
  */
 #define otaexampleMQTT_TIMEOUT_MS                 ( 10 * 1000U )
 
+/**
+ * @brief Upper bound on the MQTT and CBOR framing around a file block: the fixed header,
+ * the $aws/things/<thing>/streams/<stream>/data/cbor topic and the stream message fields.
+ */
+#define otaexampleSTREAM_MSG_OVERHEAD             ( 512U )
+
+/**
+ * @brief Topic, below the thing name, on which the timing report of each OTA job is published.
+ */
+#define otaexampleTIMING_TOPIC                    "ota_timing"
+
+/**
+ * @brief Maximum length of the OTA timing report topic and payload.
+ */
+#define otaexampleTIMING_TOPIC_MAX_LEN            ( 160U )
+#define otaexampleTIMING_REPORT_MAX_LEN           ( 384U )
+
+/**
+ * @brief Suffix of the topic the OTA agent publishes to when it requests a job document.
+ */
+#define otaexampleJOB_REQUEST_TOPIC_SUFFIX        "/jobs/$next/get"
+
+/**
+ * @brief Suffix of the topic the OTA agent publishes to when it requests file blocks.
+ */
+#define otaexampleSTREAM_REQUEST_TOPIC_SUFFIX     "/get/cbor"
+
+#if ( otaconfigSHAPER_SHARE_PERCENT < 100U )
+
+/**
+ * @brief Token bucket limits of the OTA download shaper, in bytes and bytes per second.
+ *
+ * The bucket holds at most one request window. The fill rate never drops below one block
+ * per second and recovers in steps of 1/16 of the configured share.
+ */
+    #define otaexampleSHAPER_MAX_RATE     ( ( otaconfigSHAPER_LINK_CAPACITY_BPS / 100U ) * otaconfigSHAPER_SHARE_PERCENT )
+    #define otaexampleSHAPER_MIN_RATE     ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE )
+    #define otaexampleSHAPER_RATE_STEP    ( ( otaexampleSHAPER_MAX_RATE / 16U ) + 1U )
+    #define otaexampleSHAPER_BURST        ( otaconfigMAX_NUM_BLOCKS_REQUEST << otaconfigLOG2_FILE_BLOCK_SIZE )
+
+/**
+ * @brief Interval at which a throttled request re-checks the agent queue depth.
+ */
+    #define otaexampleSHAPER_POLL_MS      ( 100U )
+
+    typedef struct OtaShaper
+    {
+        uint32_t ulRate;         /* Current fill rate */
+        int32_t lTokens;         /* Negative while a request is being repaid */
+        TickType_t xLastRefill;
+    } OtaShaper_t;
+
+/**
+ * @brief Shaper state, only used from the OTA agent task.
+ */
+    static OtaShaper_t xShaper = { 0 };
+#endif /* otaconfigSHAPER_SHARE_PERCENT < 100U */
+
+static_assert( ( ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE ) + otaexampleSTREAM_MSG_OVERHEAD ) <= MQTT_AGENT_NETWORK_BUFFER_SIZE,
+               "MQTT_AGENT_NETWORK_BUFFER_SIZE is too small for otaconfigLOG2_FILE_BLOCK_SIZE." );
+
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief TCP port used for the HTTPS data plane.
+ */
+    #define otaexampleHTTPS_PORT                  ( 443U )
+
+/**
+ * @brief Send and receive timeout of the HTTPS data plane connection.
+ */
+    #define otaexampleHTTP_TIMEOUT_MS             ( 10 * 1000U )
+
+/**
+ * @brief Maximum length of the host name of a pre-signed URL.
+ */
+    #define otaexampleHTTP_MAX_HOST_LEN           ( 128U )
+
+/**
+ * @brief Size of the range fetched with each GET request.
+ */
+    #define otaexampleHTTP_WINDOW_SIZE            ( otaconfigMAX_NUM_BLOCKS_REQUEST << otaconfigLOG2_FILE_BLOCK_SIZE )
+
+/**
+ * @brief Buffer shared by the request headers and the response, which carries a window of the
+ * file. The request line holds the pre-signed URL path and query string.
+ */
+    #define otaexampleHTTP_BUFFER_SIZE            ( otaexampleHTTP_WINDOW_SIZE + OTA_REQUEST_URL_MAX_SIZE + 512U )
+
+/**
+ * @brief HTTP status codes handled by the data plane.
+ */
+    #define otaexampleHTTP_STATUS_PARTIAL_CONTENT    ( 206U )
+    #define otaexampleHTTP_STATUS_BAD_REQUEST        ( 400U )
+    #define otaexampleHTTP_STATUS_FORBIDDEN          ( 403U )
+    #define otaexampleHTTP_STATUS_NOT_FOUND          ( 404U )
+
+/**
+ * @brief State of the HTTPS data plane, owned by the OTA agent task.
+ */
+    typedef struct OtaHttpCtx
+    {
+        NetworkContext_t * pxNetworkContext;
+        TransportInterface_t xTransport;
+        BaseType_t xConnected;
+        char pcHost[ otaexampleHTTP_MAX_HOST_LEN + 1 ];
+        const char * pcPath;
+        size_t uxPathLen;
+        const uint8_t * pucWindow;   /* Body of the last response */
+        uint32_t ulWindowStart;      /* File offset of pucWindow[ 0 ] */
+        uint32_t ulWindowLen;
+        uint8_t pucBuffer[ otaexampleHTTP_BUFFER_SIZE ];
+    } OtaHttpCtx_t;
+
+    static OtaHttpCtx_t xHttpCtx = { 0 };
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 /**
  * @brief The common prefix for all OTA topics.
  *
@@ -173,10 +310,6 @@
 #define OTA_DATA_STREAM_TOPIC_FILTER_LENGTH       ( ( uint16_t ) ( sizeof( OTA_DATA_STREAM_TOPIC_FILTER ) - 1 ) )
 
 
-/**
- * @brief Starting index of client identifier within OTA topic.
- */
-#define OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX    ( OTA_PREFIX_LENGTH + 1 )
 
 /**
  * @brief Used to clear bits in a task's notification value.
@@ -332,6 +465,67 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
                                            uint16_t topicFilterLength,
                                            uint8_t ucQoS );
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief Function used by OTA agent to start downloading a file over HTTPS.
+ *
+ * The implementation splits the pre-signed URL from the job document into host and path and
+ * opens a persistent TLS connection to the host. The connection is reused for every range
+ * request of the download.
+ *
+ * @param[in] pUrl Pre-signed URL of the file. Remains valid until the download completes.
+ * @return OtaHttpSuccess if successful. OtaHttpInitFailed otherwise.
+ */
+    static OtaHttpStatus_t prvHttpInit( char * pUrl );
+
+/**
+ * @brief Function used by OTA agent to request a range of the file over HTTPS.
+ *
+ * A single GET fetches otaconfigMAX_NUM_BLOCKS_REQUEST blocks starting at rangeStart into a
+ * window buffer. Block requests which fall inside the window are answered from it without a
+ * round trip to the server. Each block is handed to the OTA agent with an
+ * OtaAgentEventReceivedFileBlock event, as blocks received over MQTT are.
+ *
+ * @param[in] rangeStart First byte of the requested block.
+ * @param[in] rangeEnd Last byte of the requested block.
+ * @return OtaHttpSuccess if successful. OtaHttpRequestFailed otherwise.
+ */
+    static OtaHttpStatus_t prvHttpRequest( uint32_t rangeStart,
+                                           uint32_t rangeEnd );
+
+/**
+ * @brief Function used by OTA agent to close the HTTPS connection when a download ends.
+ *
+ * @return OtaHttpSuccess.
+ */
+    static OtaHttpStatus_t prvHttpDeinit( void );
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
+/**
+ * @brief Debit ulBytes of download from the bandwidth shaper.
+ *
+ * Blocks the OTA agent task until the token bucket has been repaid for the previous
+ * requests, adapting the fill rate to the MQTT agent queue depth while it waits.
+ *
+ * @param[in] ulBytes Number of bytes the next data request asks for.
+ */
+static void prvShaperConsume( uint32_t ulBytes );
+
+/**
+ * @brief Check whether an MQTT topic ends with pcSuffix.
+ */
+static BaseType_t prvTopicHasSuffix( const char * pcTopic,
+                                     uint16_t usTopicLen,
+                                     const char * pcSuffix );
+
+/**
+ * @brief Publish the timing report of the OTA job which just completed and clear it.
+ *
+ * @param[in] pcResult Outcome of the job recorded in the report.
+ */
+static void prvPublishTimingReport( const char * pcResult );
+
 /**
  * @brief Initialize the OTA event buffer pool.
  *
@@ -422,19 +616,15 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
                                           MQTTPublishInfo_t * pPublishInfo );
 
 /**
- * @brief Matches a client identifier within an OTA topic.
- * This function is used to validate that topic is valid and intended for this device thing name.
+ * @brief Check that an OTA topic is intended for this device: it starts with
+ * pcThingTopicPrefix, built once from the thing name.
  *
  * @param[in] pTopic Pointer to the topic
  * @param[in] topicNameLength length of the topic
- * @param[in] pClientIdentifier Client identifier, should be null terminated.
- * @param[in] clientIdentifierLength Length of the client identifier.
- * @return pdTRUE if client identifier is found within the topic at the right index.
+ * @return pdTRUE if the topic starts with "$aws/things/<thing name>/".
  */
-static BaseType_t prvMatchClientIdentifierInTopic( const char * pTopic,
-                                                   size_t topicNameLength,
-                                                   const char * pClientIdentifier,
-                                                   size_t clientIdentifierLength );
+static BaseType_t prvTopicIsForThing( const char * pTopic,
+                                      size_t topicNameLength );
 
 
 /**
@@ -460,6 +650,20 @@ static char * pcThingName = NULL;
  */
 static size_t uxThingNameLength = 0UL;
 
+/**
+ * @brief "$aws/things/<thing name>/", compared with the start of every incoming OTA topic
+ * instead of parsing the thing name out of it.
+ */
+static char * pcThingTopicPrefix = NULL;
+
+static size_t uxThingTopicPrefixLength = 0UL;
+
+/**
+ * @brief Job messages are handled by the MQTT dispatch workers. File blocks are only
+ * copied to an event buffer and stay in the agent task.
+ */
+static MqttAgentDeferredCallback_t xJobMessageCallback = { prvProcessIncomingJobMessage, NULL };
+
 /*---------------------------------------------------------*/
 
 static BaseType_t prvOTAEventBufferPoolInit( OtaEventBufferPool_t * pxBufferPool )
@@ -753,6 +957,7 @@ static void otaAppCallback( OtaJobEvent_t event,
              * No user action is needed here. OTA agent handles the job failure event.
              */
             LogInfo( ( "Received an OtaJobEventFail notification from OTA Agent." ) );
+            prvPublishTimingReport( "failed" );
 
             break;
 
@@ -804,6 +1009,7 @@ static void otaAppCallback( OtaJobEvent_t event,
             if( err == OtaErrNone )
             {
                 LogInfo( ( "New image validation succeeded in self test mode." ) );
+                prvPublishTimingReport( "succeeded" );
             }
             else
             {
@@ -826,6 +1032,7 @@ static void otaAppCallback( OtaJobEvent_t event,
             /* Requires manual activation of previous image as self-test for
              * new image downloaded failed.*/
             LogError( ( "OTA Self-test failed for new image. shutting down OTA Agent." ) );
+            prvPublishTimingReport( "self_test_failed" );
             break;
 
         case OtaJobEventUpdateComplete:
@@ -841,6 +1048,143 @@ static void otaAppCallback( OtaJobEvent_t event,
 
 /*-----------------------------------------------------------*/
 
+#if ( otaconfigSHAPER_SHARE_PERCENT < 100U )
+
+    static void prvShaperAdapt( OtaShaper_t * pxShaper )
+    {
+        UBaseType_t uxQueueDepth = 0;
+
+        /* Telemetry waits in the control connection queue, also when OTA has its own connection */
+        MQTTAgentHandle_t xMQTTAgentHandle = xGetMqttAgentHandle();
+
+        if( xMQTTAgentHandle != NULL )
+        {
+            uxQueueDepth = MqttAgent_GetQueueDepth( xMQTTAgentHandle );
+        }
+
+        /* Back off quickly while other publishes are waiting, recover gradually */
+        if( uxQueueDepth > otaconfigSHAPER_QUEUE_HIGH )
+        {
+            pxShaper->ulRate = pxShaper->ulRate / 2U;
+
+            if( pxShaper->ulRate < otaexampleSHAPER_MIN_RATE )
+            {
+                pxShaper->ulRate = otaexampleSHAPER_MIN_RATE;
+            }
+        }
+        else if( uxQueueDepth <= otaconfigSHAPER_QUEUE_LOW )
+        {
+            pxShaper->ulRate += otaexampleSHAPER_RATE_STEP;
+
+            if( pxShaper->ulRate > otaexampleSHAPER_MAX_RATE )
+            {
+                pxShaper->ulRate = otaexampleSHAPER_MAX_RATE;
+            }
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvShaperRefill( OtaShaper_t * pxShaper )
+    {
+        TickType_t xNow = xTaskGetTickCount();
+        uint32_t ulElapsedMs = ( uint32_t ) pdTICKS_TO_MS( xNow - pxShaper->xLastRefill );
+        int64_t llTokens = pxShaper->lTokens + ( ( ( int64_t ) pxShaper->ulRate * ulElapsedMs ) / 1000 );
+
+        /* Idle time only builds up one request window of credit */
+        if( llTokens > ( int64_t ) otaexampleSHAPER_BURST )
+        {
+            llTokens = otaexampleSHAPER_BURST;
+        }
+
+        pxShaper->lTokens = ( int32_t ) llTokens;
+        pxShaper->xLastRefill = xNow;
+    }
+#endif /* otaconfigSHAPER_SHARE_PERCENT < 100U */
+
+/*-----------------------------------------------------------*/
+
+static void prvShaperConsume( uint32_t ulBytes )
+{
+    #if ( otaconfigSHAPER_SHARE_PERCENT < 100U )
+        OtaShaper_t * pxShaper = &xShaper;
+
+        if( pxShaper->ulRate == 0 )
+        {
+            pxShaper->ulRate = otaexampleSHAPER_MAX_RATE;
+            pxShaper->lTokens = otaexampleSHAPER_BURST;
+            pxShaper->xLastRefill = xTaskGetTickCount();
+        }
+
+        prvShaperAdapt( pxShaper );
+        prvShaperRefill( pxShaper );
+
+        /* A request may leave the bucket in debt, the next one waits until it is repaid */
+        while( pxShaper->lTokens < 0 )
+        {
+            uint32_t ulWaitMs = ( uint32_t ) ( ( ( uint64_t ) ( -pxShaper->lTokens ) * 1000U ) / pxShaper->ulRate ) + 1U;
+
+            if( ulWaitMs > otaexampleSHAPER_POLL_MS )
+            {
+                ulWaitMs = otaexampleSHAPER_POLL_MS;
+            }
+
+            vTaskDelay( pdMS_TO_TICKS( ulWaitMs ) );
+
+            prvShaperAdapt( pxShaper );
+            prvShaperRefill( pxShaper );
+        }
+
+        pxShaper->lTokens -= ( int32_t ) ulBytes;
+    #else /* otaconfigSHAPER_SHARE_PERCENT < 100U */
+        ( void ) ulBytes;
+    #endif /* otaconfigSHAPER_SHARE_PERCENT < 100U */
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTopicHasSuffix( const char * pcTopic,
+                                     uint16_t usTopicLen,
+                                     const char * pcSuffix )
+{
+    size_t uxSuffixLen = strlen( pcSuffix );
+
+    return ( ( usTopicLen >= uxSuffixLen ) &&
+             ( memcmp( &pcTopic[ usTopicLen - uxSuffixLen ], pcSuffix, uxSuffixLen ) == 0 ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishTimingReport( const char * pcResult )
+{
+    char pcTopic[ otaexampleTIMING_TOPIC_MAX_LEN ];
+    char pcReport[ otaexampleTIMING_REPORT_MAX_LEN ];
+    int lTopicLen = 0;
+    size_t uxReportLen = 0;
+
+    configASSERT( pcThingName != NULL );
+
+    lTopicLen = snprintf( pcTopic, sizeof( pcTopic ), "%s/" otaexampleTIMING_TOPIC, pcThingName );
+    uxReportLen = uxOtaTimingFormat( pcResult, pcReport, sizeof( pcReport ) );
+
+    if( ( lTopicLen > 0 ) &&
+        ( ( size_t ) lTopicLen < sizeof( pcTopic ) ) &&
+        ( uxReportLen > 0 ) )
+    {
+        LogInfo( ( "OTA timing report: %s", pcReport ) );
+
+        ( void ) prvMQTTPublish( pcTopic, ( uint16_t ) lTopicLen, pcReport, uxReportLen, MQTTQoS1 );
+    }
+
+    vOtaTimingReset();
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvProcessIncomingData( void * pxContext,
                                     MQTTPublishInfo_t * pPublishInfo )
 {
@@ -853,10 +1197,7 @@ static void prvProcessIncomingData( void * pxContext,
     configASSERT( pPublishInfo != NULL );
 
 
-    isMatch = prvMatchClientIdentifierInTopic( pPublishInfo->pTopicName,
-                                               pPublishInfo->topicNameLength,
-                                               pcThingName,
-                                               uxThingNameLength );
+    isMatch = prvTopicIsForThing( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
 
     if( isMatch == pdTRUE )
     {
@@ -868,13 +1209,18 @@ static void prvProcessIncomingData( void * pxContext,
 
             if( pData != NULL )
             {
-                memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+                ( void ) pvDmaCopy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
                 pData->dataLength = pPublishInfo->payloadLength;
                 eventMsg.eventId = OtaAgentEventReceivedFileBlock;
                 eventMsg.pEventData = pData;
 
-                /* Send job document received event. */
-                OTA_SignalEvent( &eventMsg );
+                /* Send file block received event. With several blocks in flight the
+                 * agent queue may be full, drop the block so it is requested again. */
+                if( OTA_SignalEvent( &eventMsg ) == false )
+                {
+                    LogWarn( ( "OTA event queue is full, dropping file block." ) );
+                    prvOTAEventBufferFree( &xAppStaticBuffer.eventBufferPool, pData );
+                }
             }
             else
             {
@@ -907,29 +1253,30 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
 
     ( void ) pxSubscriptionContext;
     configASSERT( pPublishInfo != NULL );
-    configASSERT( pcThingName != NULL );
 
-    isMatch = prvMatchClientIdentifierInTopic( pPublishInfo->pTopicName,
-                                               pPublishInfo->topicNameLength,
-                                               pcThingName,
-                                               strlen( pcThingName ) );
+    isMatch = prvTopicIsForThing( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
 
     if( isMatch == pdTRUE )
     {
         if( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE )
         {
             LogInfo( ( "Received OTA job message, size: %d.\n\n", pPublishInfo->payloadLength ) );
+            vOtaTimingStop( OTA_TIMING_JOB_FETCH );
             pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool );
 
             if( pData != NULL )
             {
-                memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+                ( void ) pvDmaCopy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
                 pData->dataLength = pPublishInfo->payloadLength;
                 eventMsg.eventId = OtaAgentEventReceivedJobDocument;
                 eventMsg.pEventData = pData;
 
                 /* Send job document received event. */
-                OTA_SignalEvent( &eventMsg );
+                if( OTA_SignalEvent( &eventMsg ) == false )
+                {
+                    LogWarn( ( "OTA event queue is full, dropping job document." ) );
+                    prvOTAEventBufferFree( &xAppStaticBuffer.eventBufferPool, pData );
+                }
             }
             else
             {
@@ -954,11 +1301,14 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
 
 
 static IncomingPubCallback_t prvGetPublishCallbackFromTopic( const char * pcTopicFilter,
-                                                             size_t usTopicFilterLength )
+                                                             size_t usTopicFilterLength,
+                                                             void ** ppvCallbackCtx )
 {
     bool xIsMatch = false;
     IncomingPubCallback_t xCallback = NULL;
 
+    *ppvCallbackCtx = NULL;
+
 
     ( void ) MQTT_MatchTopic( pcTopicFilter,
                               usTopicFilterLength,
@@ -968,7 +1318,8 @@ static IncomingPubCallback_t prvGetPublishCallbackFromTopic( const char * pcTopi
 
     if( xIsMatch == true )
     {
-        xCallback = prvProcessIncomingJobMessage;
+        xCallback = MqttAgent_DeferredCallback;
+        *ppvCallbackCtx = &xJobMessageCallback;
     }
 
     if( xIsMatch == false )
@@ -990,37 +1341,13 @@ static IncomingPubCallback_t prvGetPublishCallbackFromTopic( const char * pcTopi
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvMatchClientIdentifierInTopic( const char * pTopic,
-                                                   size_t topicNameLength,
-                                                   const char * pClientIdentifier,
-                                                   size_t clientIdentifierLength )
+static BaseType_t prvTopicIsForThing( const char * pTopic,
+                                      size_t topicNameLength )
 {
-    BaseType_t isMatch = pdFALSE;
-    size_t idx, matchIdx = 0;
-
-    for( idx = OTA_TOPIC_CLIENT_IDENTIFIER_START_IDX; idx < topicNameLength; idx++ )
-    {
-        if( matchIdx == clientIdentifierLength )
-        {
-            if( pTopic[ idx ] == '/' )
-            {
-                isMatch = pdTRUE;
-            }
-
-            break;
-        }
-        else
-        {
-            if( pClientIdentifier[ matchIdx ] != pTopic[ idx ] )
-            {
-                break;
-            }
-        }
+    configASSERT( pcThingTopicPrefix != NULL );
 
-        matchIdx++;
-    }
-
-    return isMatch;
+    return ( ( topicNameLength > uxThingTopicPrefixLength ) &&
+             ( memcmp( pTopic, pcThingTopicPrefix, uxThingTopicPrefixLength ) == 0 ) ) ? pdTRUE : pdFALSE;
 }
 
 /*-----------------------------------------------------------*/
@@ -1045,14 +1372,15 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
     MQTTStatus_t mqttStatus;
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
     IncomingPubCallback_t xPublishCallback;
+    void * pvCallbackCtx = NULL;
     MQTTAgentHandle_t xMQTTAgentHandle = NULL;
 
     configASSERT( pTopicFilter != NULL );
     configASSERT( topicFilterLength > 0 );
 
-    xPublishCallback = prvGetPublishCallbackFromTopic( pTopicFilter, topicFilterLength );
+    xPublishCallback = prvGetPublishCallbackFromTopic( pTopicFilter, topicFilterLength, &pvCallbackCtx );
 
-    xMQTTAgentHandle = xGetMqttAgentHandle();
+    xMQTTAgentHandle = xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_BULK );
 
     if( ( xMQTTAgentHandle == NULL ) ||
         ( xPublishCallback == NULL ) )
@@ -1065,7 +1393,7 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
                                               pTopicFilter,
                                               ucQoS,
                                               xPublishCallback,
-                                              NULL );
+                                              pvCallbackCtx );
 
         if( mqttStatus != MQTTSuccess )
         {
@@ -1102,6 +1430,21 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     MQTTAgentCommandContext_t xCommandContext = { 0 };
     MQTTAgentHandle_t xMQTTAgentHandle = NULL;
 
+    /* Time the job document request, except the one made while the new image is under test */
+    if( ( prvTopicHasSuffix( pacTopic, topicLen, otaexampleJOB_REQUEST_TOPIC_SUFFIX ) == pdTRUE ) &&
+        ( OTA_GetImageState() != OtaImageStateTesting ) )
+    {
+        vOtaTimingStart( OTA_TIMING_JOB_FETCH );
+    }
+    else if( prvTopicHasSuffix( pacTopic, topicLen, otaexampleSTREAM_REQUEST_TOPIC_SUFFIX ) == pdTRUE )
+    {
+        prvShaperConsume( otaconfigMAX_NUM_BLOCKS_REQUEST << otaconfigLOG2_FILE_BLOCK_SIZE );
+    }
+    else
+    {
+        /* Empty */
+    }
+
     publishInfo.pTopicName = pacTopic;
     publishInfo.topicNameLength = topicLen;
     publishInfo.qos = qos;
@@ -1117,7 +1460,7 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     xCommandParams.cmdCompleteCallback = prvCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
 
-    xMQTTAgentHandle = xGetMqttAgentHandle();
+    xMQTTAgentHandle = xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_BULK );
 
     if( xMQTTAgentHandle == NULL )
     {
@@ -1170,14 +1513,15 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
     MQTTStatus_t mqttStatus;
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
     IncomingPubCallback_t xPublishCallback;
+    void * pvCallbackCtx = NULL;
     MQTTAgentHandle_t xMQTTAgentHandle = NULL;
 
     configASSERT( pTopicFilter != NULL );
     configASSERT( topicFilterLength > 0 );
 
-    xPublishCallback = prvGetPublishCallbackFromTopic( pTopicFilter, topicFilterLength );
+    xPublishCallback = prvGetPublishCallbackFromTopic( pTopicFilter, topicFilterLength, &pvCallbackCtx );
 
-    xMQTTAgentHandle = xGetMqttAgentHandle();
+    xMQTTAgentHandle = xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_BULK );
 
     if( ( xMQTTAgentHandle == NULL ) ||
         ( xPublishCallback == NULL ) )
@@ -1189,7 +1533,7 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
         mqttStatus = MqttAgent_UnSubscribeSync( xMQTTAgentHandle,
                                                 pTopicFilter,
                                                 xPublishCallback,
-                                                NULL );
+                                                pvCallbackCtx );
 
         if( mqttStatus != MQTTSuccess )
         {
@@ -1215,6 +1559,371 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
 
 /*-----------------------------------------------------------*/
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+    static BaseType_t prvHttpConnect( OtaHttpCtx_t * pxCtx )
+    {
+        BaseType_t xResult = pdTRUE;
+        TlsTransportStatus_t xTlsStatus;
+        PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+
+        if( pxCtx->pxNetworkContext == NULL )
+        {
+            pxCtx->pxNetworkContext = mbedtls_transport_allocate();
+
+            /* Pre-signed URLs need server authentication only */
+            if( ( pxCtx->pxNetworkContext == NULL ) ||
+                ( mbedtls_transport_configure( pxCtx->pxNetworkContext, NULL, NULL, NULL,
+                                               pxRootCaChain, 1 ) != TLS_TRANSPORT_SUCCESS ) )
+            {
+                LogError( ( "Failed to set up a TLS context for the HTTPS data plane." ) );
+                xResult = pdFALSE;
+            }
+            else
+            {
+                /* Keep the bulk download off the AES peripheral used by the MQTT connection */
+                ( void ) mbedtls_transport_prefer_chachapoly( pxCtx->pxNetworkContext, pdTRUE );
+                ( void ) mbedtls_transport_set_socket_profile( pxCtx->pxNetworkContext, TLS_SOCKET_PROFILE_BULK );
+            }
+
+            pxCtx->xTransport.pNetworkContext = pxCtx->pxNetworkContext;
+            pxCtx->xTransport.send = mbedtls_transport_send;
+            pxCtx->xTransport.recv = mbedtls_transport_recv;
+        }
+
+        if( xResult == pdTRUE )
+        {
+            xTlsStatus = mbedtls_transport_connect( pxCtx->pxNetworkContext,
+                                                    pxCtx->pcHost,
+                                                    otaexampleHTTPS_PORT,
+                                                    otaexampleHTTP_TIMEOUT_MS,
+                                                    otaexampleHTTP_TIMEOUT_MS );
+
+            if( xTlsStatus != TLS_TRANSPORT_SUCCESS )
+            {
+                LogError( ( "Failed to connect to %s, error: %d.", pxCtx->pcHost, xTlsStatus ) );
+                xResult = pdFALSE;
+            }
+        }
+
+        pxCtx->xConnected = xResult;
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvHttpDisconnect( OtaHttpCtx_t * pxCtx )
+    {
+        if( pxCtx->xConnected == pdTRUE )
+        {
+            mbedtls_transport_disconnect( pxCtx->pxNetworkContext );
+            pxCtx->xConnected = pdFALSE;
+        }
+
+        pxCtx->pucWindow = NULL;
+        pxCtx->ulWindowLen = 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static HTTPStatus_t prvHttpGetWindow( OtaHttpCtx_t * pxCtx,
+                                          uint32_t ulRangeStart,
+                                          HTTPResponse_t * pxResponse )
+    {
+        HTTPStatus_t xHttpStatus;
+        HTTPRequestInfo_t xRequestInfo = { 0 };
+        HTTPRequestHeaders_t xRequestHeaders = { 0 };
+
+        xRequestInfo.pMethod = HTTP_METHOD_GET;
+        xRequestInfo.methodLen = sizeof( HTTP_METHOD_GET ) - 1;
+        xRequestInfo.pPath = pxCtx->pcPath;
+        xRequestInfo.pathLen = pxCtx->uxPathLen;
+        xRequestInfo.pHost = pxCtx->pcHost;
+        xRequestInfo.hostLen = strlen( pxCtx->pcHost );
+        xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+
+        /* The request is sent before the response is received into the same buffer */
+        xRequestHeaders.pBuffer = pxCtx->pucBuffer;
+        xRequestHeaders.bufferLen = sizeof( pxCtx->pucBuffer );
+
+        memset( pxResponse, 0, sizeof( HTTPResponse_t ) );
+        pxResponse->pBuffer = pxCtx->pucBuffer;
+        pxResponse->bufferLen = sizeof( pxCtx->pucBuffer );
+
+        xHttpStatus = HTTPClient_InitializeRequestHeaders( &xRequestHeaders, &xRequestInfo );
+
+        /* The server truncates a range which runs past the end of the file */
+        if( xHttpStatus == HTTPSuccess )
+        {
+            xHttpStatus = HTTPClient_AddRangeHeader( &xRequestHeaders,
+                                                     ( int32_t ) ulRangeStart,
+                                                     ( int32_t ) ( ulRangeStart + otaexampleHTTP_WINDOW_SIZE - 1U ) );
+        }
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            xHttpStatus = HTTPClient_Send( &pxCtx->xTransport, &xRequestHeaders, NULL, 0, pxResponse, 0 );
+        }
+
+        return xHttpStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static OtaHttpStatus_t prvHttpInit( char * pUrl )
+    {
+        OtaHttpStatus_t xStatus = OtaHttpSuccess;
+        const char * pcHost = NULL;
+        const char * pcPath = NULL;
+
+        configASSERT( pUrl != NULL );
+
+        pcHost = strstr( pUrl, "://" );
+
+        if( pcHost != NULL )
+        {
+            pcHost += 3;
+            pcPath = strchr( pcHost, '/' );
+        }
+
+        if( ( pcPath == NULL ) ||
+            ( pcPath == pcHost ) ||
+            ( ( size_t ) ( pcPath - pcHost ) > otaexampleHTTP_MAX_HOST_LEN ) )
+        {
+            LogError( ( "Failed to parse the OTA file URL." ) );
+            xStatus = OtaHttpInitFailed;
+        }
+        else
+        {
+            prvHttpDisconnect( &xHttpCtx );
+
+            memcpy( xHttpCtx.pcHost, pcHost, ( size_t ) ( pcPath - pcHost ) );
+            xHttpCtx.pcHost[ pcPath - pcHost ] = '\0';
+            xHttpCtx.pcPath = pcPath;
+            xHttpCtx.uxPathLen = strlen( pcPath );
+
+            if( prvHttpConnect( &xHttpCtx ) != pdTRUE )
+            {
+                xStatus = OtaHttpInitFailed;
+            }
+            else
+            {
+                LogInfo( ( "Connected to %s for the OTA file download.", xHttpCtx.pcHost ) );
+            }
+        }
+
+        return xStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static OtaHttpStatus_t prvHttpRequest( uint32_t rangeStart,
+                                           uint32_t rangeEnd )
+    {
+        OtaHttpStatus_t xStatus = OtaHttpSuccess;
+        OtaEventData_t * pData = NULL;
+        OtaEventMsg_t eventMsg = { 0 };
+        uint32_t ulBlockLen = rangeEnd - rangeStart + 1U;
+
+        configASSERT( rangeEnd >= rangeStart );
+        configASSERT( ulBlockLen <= OTA_DATA_BLOCK_SIZE );
+
+        /* Fetch the window which starts at this block unless it is already buffered */
+        if( ( xHttpCtx.pucWindow == NULL ) ||
+            ( rangeStart < xHttpCtx.ulWindowStart ) ||
+            ( ( rangeEnd - xHttpCtx.ulWindowStart ) >= xHttpCtx.ulWindowLen ) )
+        {
+            HTTPResponse_t xResponse;
+            HTTPStatus_t xHttpStatus = HTTPNetworkError;
+
+            xHttpCtx.pucWindow = NULL;
+
+            prvShaperConsume( otaexampleHTTP_WINDOW_SIZE );
+
+            /* Reconnect once if the server closed the persistent connection */
+            for( uint32_t ulAttempt = 0; ( ulAttempt < 2U ) && ( xHttpStatus == HTTPNetworkError ); ulAttempt++ )
+            {
+                if( ( xHttpCtx.xConnected == pdTRUE ) ||
+                    ( prvHttpConnect( &xHttpCtx ) == pdTRUE ) )
+                {
+                    xHttpStatus = prvHttpGetWindow( &xHttpCtx, rangeStart, &xResponse );
+
+                    if( xHttpStatus == HTTPNetworkError )
+                    {
+                        prvHttpDisconnect( &xHttpCtx );
+                    }
+                }
+            }
+
+            if( xHttpStatus != HTTPSuccess )
+            {
+                LogError( ( "HTTP range request failed: %s.", HTTPClient_strerror( xHttpStatus ) ) );
+                xStatus = OtaHttpRequestFailed;
+            }
+            else if( xResponse.statusCode == otaexampleHTTP_STATUS_PARTIAL_CONTENT )
+            {
+                xHttpCtx.pucWindow = xResponse.pBody;
+                xHttpCtx.ulWindowStart = rangeStart;
+                xHttpCtx.ulWindowLen = xResponse.bodyLen;
+            }
+            else if( ( xResponse.statusCode == otaexampleHTTP_STATUS_BAD_REQUEST ) ||
+                     ( xResponse.statusCode == otaexampleHTTP_STATUS_FORBIDDEN ) ||
+                     ( xResponse.statusCode == otaexampleHTTP_STATUS_NOT_FOUND ) )
+            {
+                /* The pre-signed URL has most likely expired, fetch the job document for a new one */
+                LogWarn( ( "HTTP range request rejected with status %u, requesting a new URL.",
+                           xResponse.statusCode ) );
+                eventMsg.eventId = OtaAgentEventRequestJobDocument;
+                ( void ) OTA_SignalEvent( &eventMsg );
+            }
+            else
+            {
+                LogError( ( "Unexpected HTTP status %u.", xResponse.statusCode ) );
+                xStatus = OtaHttpRequestFailed;
+            }
+        }
+
+        if( xHttpCtx.pucWindow == NULL )
+        {
+            /* Empty */
+        }
+        else if( ( rangeEnd - xHttpCtx.ulWindowStart ) >= xHttpCtx.ulWindowLen )
+        {
+            LogError( ( "HTTP response is shorter than the requested block." ) );
+            xHttpCtx.pucWindow = NULL;
+            xStatus = OtaHttpRequestFailed;
+        }
+        else if( ( pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool ) ) == NULL )
+        {
+            LogError( ( "Error: No OTA data buffers available." ) );
+            xStatus = OtaHttpRequestFailed;
+        }
+        else
+        {
+            ( void ) pvDmaCopy( pData->data, &( xHttpCtx.pucWindow[ rangeStart - xHttpCtx.ulWindowStart ] ), ulBlockLen );
+            pData->dataLength = ulBlockLen;
+            eventMsg.eventId = OtaAgentEventReceivedFileBlock;
+            eventMsg.pEventData = pData;
+
+            if( OTA_SignalEvent( &eventMsg ) == false )
+            {
+                prvOTAEventBufferFree( &xAppStaticBuffer.eventBufferPool, pData );
+                xStatus = OtaHttpRequestFailed;
+            }
+        }
+
+        return xStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static OtaHttpStatus_t prvHttpDeinit( void )
+    {
+        prvHttpDisconnect( &xHttpCtx );
+
+        if( xHttpCtx.pxNetworkContext != NULL )
+        {
+            mbedtls_transport_free( xHttpCtx.pxNetworkContext );
+            xHttpCtx.pxNetworkContext = NULL;
+        }
+
+        return OtaHttpSuccess;
+    }
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
+/*-----------------------------------------------------------*/
+
+#if ( OTA_PSA_STREAM_ENABLED == 1 )
+    #define OTA_PAL_CREATE_FILE    xOtaPsaStreamCreateFile
+    #define OTA_PAL_WRITE_BLOCK    sOtaPsaStreamWriteBlock
+    #define OTA_PAL_CLOSE_FILE     xOtaPsaStreamCloseFile
+    #define OTA_PAL_ABORT          xOtaPsaStreamAbort
+#else
+    #define OTA_PAL_CREATE_FILE    otaPal_CreateFileForRx
+    #define OTA_PAL_WRITE_BLOCK    otaPal_WriteBlock
+    #define OTA_PAL_CLOSE_FILE     otaPal_CloseFile
+    #define OTA_PAL_ABORT          otaPal_Abort
+#endif /* OTA_PSA_STREAM_ENABLED == 1 */
+
+#if ( DVFS_ENABLED == 1 )
+
+/* Full speed from the file creation to the end of the signature check, for the block decoding and the image hash */
+    static BaseType_t xOtaPerformanceHeld = pdFALSE;
+
+    static void prvOtaPerformanceRelease( void )
+    {
+        if( xOtaPerformanceHeld == pdTRUE )
+        {
+            xOtaPerformanceHeld = pdFALSE;
+            vDvfsRelease( DVFS_CLIENT_OTA );
+        }
+    }
+
+    static OtaPalStatus_t prvPalCreateFile( OtaFileContext_t * const pFileContext )
+    {
+        OtaPalStatus_t xStatus;
+
+        if( xOtaPerformanceHeld == pdFALSE )
+        {
+            xOtaPerformanceHeld = pdTRUE;
+            vDvfsRequest( DVFS_CLIENT_OTA );
+        }
+
+        xStatus = OTA_PAL_CREATE_FILE( pFileContext );
+
+        if( OTA_PAL_MAIN_ERR( xStatus ) != OtaPalSuccess )
+        {
+            prvOtaPerformanceRelease();
+        }
+
+        return xStatus;
+    }
+
+    static OtaPalStatus_t prvPalCloseFile( OtaFileContext_t * const pFileContext )
+    {
+        OtaPalStatus_t xStatus = OTA_PAL_CLOSE_FILE( pFileContext );
+
+        prvOtaPerformanceRelease();
+
+        return xStatus;
+    }
+
+    static OtaPalStatus_t prvPalAbort( OtaFileContext_t * const pFileContext )
+    {
+        OtaPalStatus_t xStatus = OTA_PAL_ABORT( pFileContext );
+
+        prvOtaPerformanceRelease();
+
+        return xStatus;
+    }
+
+#endif /* DVFS_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+#ifndef TFM_PSA_API
+
+/* Requests are built from the block bitmap of the file, which must list the blocks refused by the PAL */
+    static OtaOsStatus_t prvReceiveEvent( OtaEventContext_t * pEventCtx,
+                                          void * pEventMsg,
+                                          uint32_t timeout )
+    {
+        OtaOsStatus_t xStatus = OtaReceiveEvent_FreeRTOS( pEventCtx, pEventMsg, timeout );
+
+        if( ( xStatus == OtaOsSuccess ) &&
+            ( ( ( OtaEventMsg_t * ) pEventMsg )->eventId == OtaAgentEventRequestFileBlock ) )
+        {
+            otaPal_RequeueRejectedBlocks();
+        }
+
+        return xStatus;
+    }
+
+#endif /* TFM_PSA_API */
+
+/*-----------------------------------------------------------*/
+
 static void prvSetOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
 {
     configASSERT( pOtaInterfaces != NULL );
@@ -1222,7 +1931,11 @@ static void prvSetOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
     /* Initialize OTA library OS Interface. */
     pOtaInterfaces->os.event.init = OtaInitEvent_FreeRTOS;
     pOtaInterfaces->os.event.send = OtaSendEvent_FreeRTOS;
-    pOtaInterfaces->os.event.recv = OtaReceiveEvent_FreeRTOS;
+    #ifdef TFM_PSA_API
+        pOtaInterfaces->os.event.recv = OtaReceiveEvent_FreeRTOS;
+    #else
+        pOtaInterfaces->os.event.recv = prvReceiveEvent;
+    #endif
     pOtaInterfaces->os.event.deinit = OtaDeinitEvent_FreeRTOS;
     pOtaInterfaces->os.timer.start = OtaStartTimer_FreeRTOS;
     pOtaInterfaces->os.timer.stop = OtaStopTimer_FreeRTOS;
@@ -1235,15 +1948,29 @@ static void prvSetOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
     pOtaInterfaces->mqtt.publish = prvMQTTPublish;
     pOtaInterfaces->mqtt.unsubscribe = prvMQTTUnsubscribe;
 
+    #if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+        /* Initialize the OTA library HTTP Interface.*/
+        pOtaInterfaces->http.init = prvHttpInit;
+        pOtaInterfaces->http.request = prvHttpRequest;
+        pOtaInterfaces->http.deinit = prvHttpDeinit;
+    #endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
     /* Initialize the OTA library PAL Interface.*/
     pOtaInterfaces->pal.getPlatformImageState = otaPal_GetPlatformImageState;
     pOtaInterfaces->pal.setPlatformImageState = otaPal_SetPlatformImageState;
-    pOtaInterfaces->pal.writeBlock = otaPal_WriteBlock;
+    pOtaInterfaces->pal.writeBlock = OTA_PAL_WRITE_BLOCK;
     pOtaInterfaces->pal.activate = otaPal_ActivateNewImage;
-    pOtaInterfaces->pal.closeFile = otaPal_CloseFile;
     pOtaInterfaces->pal.reset = otaPal_ResetDevice;
-    pOtaInterfaces->pal.abort = otaPal_Abort;
-    pOtaInterfaces->pal.createFile = otaPal_CreateFileForRx;
+
+    #if ( DVFS_ENABLED == 1 )
+        pOtaInterfaces->pal.closeFile = prvPalCloseFile;
+        pOtaInterfaces->pal.abort = prvPalAbort;
+        pOtaInterfaces->pal.createFile = prvPalCreateFile;
+    #else
+        pOtaInterfaces->pal.closeFile = OTA_PAL_CLOSE_FILE;
+        pOtaInterfaces->pal.abort = OTA_PAL_ABORT;
+        pOtaInterfaces->pal.createFile = OTA_PAL_CREATE_FILE;
+    #endif
 }
 
 static void prvSetOTAAppBuffer( OtaAppBuffer_t * pOtaAppBuffer )
@@ -1289,6 +2016,29 @@ static inline BaseType_t xIsOtaAgentActive( void )
     return xResult;
 }
 
+/* Read the OtaAgentStatistics_t field at offset pvCtx, 0 while the agent is not running */
+static uint64_t prvReadOtaStatistic( void * pvCtx )
+{
+    OtaAgentStatistics_t xStats = { 0 };
+    uint32_t ulValue = 0;
+
+    if( OTA_GetStatistics( &xStats ) == OtaErrNone )
+    {
+        ( void ) memcpy( &ulValue, ( const uint8_t * ) &xStats + ( uintptr_t ) pvCtx, sizeof( ulValue ) );
+    }
+
+    return ulValue;
+}
+
+static uint64_t prvReadOtaState( void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    return ( uint64_t ) OTA_GetState();
+}
+
+/*-----------------------------------------------------------*/
+
 void vOTAUpdateTask( void * pvParam )
 {
     ( void ) pvParam;
@@ -1320,6 +2070,13 @@ void vOTAUpdateTask( void * pvParam )
     /* Set OTA buffers for use by OTA agent. */
     prvSetOTAAppBuffer( &otaAppBuffer );
 
+    /* Progress of an update in the Device Defender reports */
+    ( void ) xCustomMetricRegister( "ota_state", prvReadOtaState, NULL );
+    ( void ) xCustomMetricRegister( "ota_packets_processed", prvReadOtaStatistic,
+                                    ( void * ) offsetof( OtaAgentStatistics_t, otaPacketsProcessed ) );
+    ( void ) xCustomMetricRegister( "ota_packets_dropped", prvReadOtaStatistic,
+                                    ( void * ) offsetof( OtaAgentStatistics_t, otaPacketsDropped ) );
+
     #ifndef TFM_PSA_API
     {
         /*
@@ -1361,6 +2118,23 @@ void vOTAUpdateTask( void * pvParam )
         }
     }
 
+    if( xResult == pdPASS )
+    {
+        size_t uxPrefixSize = sizeof( OTA_TOPIC_PREFIX "/" "/" ) + strlen( pcThingName );
+
+        pcThingTopicPrefix = pvPortMalloc( uxPrefixSize );
+
+        if( pcThingTopicPrefix == NULL )
+        {
+            xResult = pdFAIL;
+            LogError( ( "Failed to allocate the OTA topic prefix." ) );
+        }
+        else
+        {
+            uxThingTopicPrefixLength = ( size_t ) snprintf( pcThingTopicPrefix, uxPrefixSize, OTA_TOPIC_PREFIX "/%s/", pcThingName );
+        }
+    }
+
     if( xResult == pdPASS )
     {
         EventBits_t uxEvents;
@@ -1375,7 +2149,11 @@ void vOTAUpdateTask( void * pvParam )
         if( uxEvents & EVT_MASK_MQTT_CONNECTED )
         {
             LogInfo( "MQTT Agent is connected. Resuming..." );
-            xMQTTAgentHandle = xGetMqttAgentHandle();
+            xMQTTAgentHandle = xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_BULK );
+
+            #ifndef TFM_PSA_API
+                otaPal_CommitOnConnect();
+            #endif
         }
         else
         {
@@ -1387,29 +2165,29 @@ void vOTAUpdateTask( void * pvParam )
     if( ( xResult == pdPASS ) &&
         ( xMQTTAgentHandle != NULL ) )
     {
-        xMQTTStatus = MqttAgent_SubscribeSync( xMQTTAgentHandle,
-                                               OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
-                                               MQTTQoS0,
-                                               prvProcessIncomingJobMessage,
-                                               NULL );
+        MQTTSubAckStatus_t pxSubAckStatus[ 2 ];
 
-        if( xMQTTStatus != MQTTSuccess )
+        const MqttAgentSubscription_t pxSubscriptions[ 2 ] =
+        {
+            { OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER, MQTTQoS0, MqttAgent_DeferredCallback, &xJobMessageCallback },
+            { OTA_JOB_NOTIFY_TOPIC_FILTER,            MQTTQoS0, MqttAgent_DeferredCallback, &xJobMessageCallback },
+        };
+
+        /* Subscribe to the job accepted and job notify topics with a single SUBSCRIBE packet */
+        xMQTTStatus = MqttAgent_SubscribeMultiSync( xMQTTAgentHandle,
+                                                    pxSubscriptions,
+                                                    2,
+                                                    pxSubAckStatus );
+
+        if( ( xMQTTStatus != MQTTSuccess ) ||
+            ( pxSubAckStatus[ 0 ] == MQTTSubAckFailure ) )
         {
             LogError( "Failed to subscribe to Job Accepted response topic filter." );
             xResult = pdFAIL;
         }
-    }
-
-    if( ( xResult == pdPASS ) &&
-        ( xMQTTAgentHandle != NULL ) )
-    {
-        xMQTTStatus = MqttAgent_SubscribeSync( xMQTTAgentHandle,
-                                               OTA_JOB_NOTIFY_TOPIC_FILTER,
-                                               MQTTQoS0,
-                                               prvProcessIncomingJobMessage,
-                                               NULL );
 
-        if( xMQTTStatus != MQTTSuccess )
+        if( ( xMQTTStatus != MQTTSuccess ) ||
+            ( pxSubAckStatus[ 1 ] == MQTTSubAckFailure ) )
         {
             LogError( "Failed to subscribe to Job Update topic filter." );
             xResult = pdFAIL;
@@ -1422,6 +2200,13 @@ void vOTAUpdateTask( void * pvParam )
         xResult = prvOTAEventBufferPoolInit( &xAppStaticBuffer.eventBufferPool );
     }
 
+    #if ( OTA_PSA_STREAM_ENABLED == 1 )
+        if( xResult == pdPASS )
+        {
+            xResult = xOtaPsaStreamInit();
+        }
+    #endif
+
     if( xResult == pdPASS )
     {
         if( ( otaRet = OTA_Init( &otaAppBuffer,
@@ -1485,8 +2270,8 @@ void vOTAUpdateTask( void * pvParam )
     {
         xMQTTStatus = MqttAgent_UnSubscribeSync( xMQTTAgentHandle,
                                                  OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
-                                                 prvProcessIncomingJobMessage,
-                                                 NULL );
+                                                 MqttAgent_DeferredCallback,
+                                                 &xJobMessageCallback );
 
         if( xMQTTStatus != MQTTSuccess )
         {
@@ -1494,6 +2279,12 @@ void vOTAUpdateTask( void * pvParam )
         }
     }
 
+    if( pcThingTopicPrefix != NULL )
+    {
+        vPortFree( pcThingTopicPrefix );
+        pcThingTopicPrefix = NULL;
+    }
+
     if( pcThingName != NULL )
     {
         vPortFree( pcThingName );
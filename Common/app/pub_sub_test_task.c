@@ -50,6 +50,7 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_payload_pool.h"
 
 
 /**
@@ -73,7 +74,7 @@
 #define configMAX_COMMAND_SEND_BLOCK_TIME_MS         ( 500 )
 
 /**
- * @brief Size of statically allocated buffers for holding payloads.
+ * @brief Size of the pooled buffers holding outgoing payloads.
  */
 #define configPAYLOAD_BUFFER_LENGTH                  ( 100 )
 
@@ -340,7 +341,7 @@ static MQTTStatus_t prvPublishToTopic( MQTTQoS_t xQoS,
 
 void vSubscribePublishTestTask( void * pvParameters )
 {
-    char cPayloadBuf[ configPAYLOAD_BUFFER_LENGTH ];
+    char * pcPayload = NULL;
     size_t xPayloadLength;
     uint32_t ulPublishCount = 0U, ulSuccessCount = 0U, ulFailCount = 0U;
     BaseType_t xStatus = pdPASS;
@@ -381,45 +382,60 @@ void vSubscribePublishTestTask( void * pvParameters )
             xQoS = ( MQTTQoS_t ) ( ( ulPublishCount + 1 ) % 2UL );
 
 
-            /* Create a payload to send with the publish message.  This contains
-             * the task name and an incrementing number. */
-            xPayloadLength = snprintf( cPayloadBuf,
-                                       configPAYLOAD_BUFFER_LENGTH,
-                                       "Test message %lu",
-                                       ( ulPublishCount + 1 ) );
+            /* The buffer is shared with the agent until the publish completes */
+            pcPayload = pvMqttPayloadAlloc( configPAYLOAD_BUFFER_LENGTH );
 
-            /* Assert if the buffer length is large enough to hold the message. */
-            configASSERT( xPayloadLength <= configPAYLOAD_BUFFER_LENGTH );
-
-            LogInfo( ( "Sending publish message to topic: %s with qos: %d, message : %*s",
-                       configPUBLISH_TOPIC_FORMAT,
-                       xQoS,
-                       xPayloadLength,
-                       ( char * ) cPayloadBuf ) );
-
-            xMQTTStatus = prvPublishToTopic( xQoS,
-                                             configPUBLISH_TOPIC_FORMAT,
-                                             ( uint8_t * ) cPayloadBuf,
-                                             xPayloadLength );
-
-            if( xMQTTStatus == MQTTSuccess )
-            {
-                ulSuccessCount++;
-                LogInfo( ( "Successfully sent QoS %u publish to topic: %s (PassCount:%d, FailCount:%d).",
-                           xQoS,
-                           configPUBLISH_TOPIC_FORMAT,
-                           ulSuccessCount,
-                           ulFailCount ) );
-            }
-            else
+            if( pcPayload == NULL )
             {
                 ulFailCount++;
-                LogError( ( "Timed out while sending QoS %u publish to topic: %s (PassCount:%d, FailCount: %d)",
-                            xQoS,
-                            configPUBLISH_TOPIC_FORMAT,
+                LogError( ( "No payload buffer free (PassCount:%d, FailCount: %d)",
                             ulSuccessCount,
                             ulFailCount ) );
             }
+            else
+            {
+                /* Create a payload to send with the publish message.  This contains
+                 * the task name and an incrementing number. */
+                xPayloadLength = snprintf( pcPayload,
+                                           configPAYLOAD_BUFFER_LENGTH,
+                                           "Test message %lu",
+                                           ( ulPublishCount + 1 ) );
+
+                /* Assert if the buffer length is large enough to hold the message. */
+                configASSERT( xPayloadLength <= configPAYLOAD_BUFFER_LENGTH );
+
+                LogInfo( ( "Sending publish message to topic: %s with qos: %d, message : %*s",
+                           configPUBLISH_TOPIC_FORMAT,
+                           xQoS,
+                           xPayloadLength,
+                           pcPayload ) );
+
+                xMQTTStatus = prvPublishToTopic( xQoS,
+                                                 configPUBLISH_TOPIC_FORMAT,
+                                                 ( uint8_t * ) pcPayload,
+                                                 xPayloadLength );
+
+                if( xMQTTStatus == MQTTSuccess )
+                {
+                    ulSuccessCount++;
+                    LogInfo( ( "Successfully sent QoS %u publish to topic: %s (PassCount:%d, FailCount:%d).",
+                               xQoS,
+                               configPUBLISH_TOPIC_FORMAT,
+                               ulSuccessCount,
+                               ulFailCount ) );
+                }
+                else
+                {
+                    ulFailCount++;
+                    LogError( ( "Timed out while sending QoS %u publish to topic: %s (PassCount:%d, FailCount: %d)",
+                                xQoS,
+                                configPUBLISH_TOPIC_FORMAT,
+                                ulSuccessCount,
+                                ulFailCount ) );
+                }
+
+                vMqttPayloadRelease( pcPayload );
+            }
 
             /* Add a little randomness into the delay so the tasks don't remain
              * in lockstep. */
@@ -420,6 +420,10 @@ uint32_t FRTest_GetTimeMs( void )
 #endif /* if ( OTA_PAL_TEST_ENABLED == 1 ) */
 /*-----------------------------------------------------------*/
 
+#if ( PERFORMANCE_TEST_ENABLED == 1 )
+    extern int RunPerformanceTest( void );
+#endif
+
 void run_qualification_main( void * pvArgs )
 {
     ( void ) pvArgs;
@@ -438,6 +442,12 @@ void run_qualification_main( void * pvArgs )
 
     RunQualificationTest();
 
+    #if ( PERFORMANCE_TEST_ENABLED == 1 )
+        LogInfo( "Run performance test." );
+
+        ( void ) RunPerformanceTest();
+    #endif
+
     LogInfo( "End qualification test." );
 
     for( ; ; )
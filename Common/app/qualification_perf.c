@@ -0,0 +1,511 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Performance regression test of the qualification application.
+ *
+ * Runs the on-target benchmarks as a Unity test group: crypto kernels, TLS handshakes, MQTT
+ * round trips with the SPI data plane statistics taken during them, and littlefs writes and
+ * reads. Each metric is printed through TEST_SubmitResult as a "PERF," line and compared
+ * against its baseline in perf_test_config.h; a test case fails when any of its metrics is
+ * worse than its baseline by more than the tolerance.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "test_execution_config.h"
+
+#if ( PERFORMANCE_TEST_ENABLED == 1 )
+
+/* Standard includes. */
+    #include <stdio.h>
+    #include <string.h>
+
+/* FreeRTOS includes. */
+    #include "FreeRTOS.h"
+    #include "task.h"
+
+    #include "unity_fixture.h"
+
+    #include "perf_test_config.h"
+    #include "hw_defs.h"
+    #include "kvstore.h"
+    #include "mbedtls_transport.h"
+    #include "micro_bench.h"
+    #include "mqtt_bench.h"
+    #include "mqtt_metrics.h"
+    #include "mx_stats.h"
+    #include "sys_evt.h"
+
+    #include "mbedtls/gcm.h"
+    #include "mbedtls/sha256.h"
+
+/* littlefs is only built by the projects which define LFS_CONFIG */
+    #ifdef LFS_CONFIG
+        #include "lfs.h"
+        #include "fs/lfs_port.h"
+        #define PERF_TEST_LFS    1
+    #endif
+
+    #define PERF_CRYPTO_LEN           1024U
+    #define PERF_CRYPTO_WARMUP        4U
+    #define PERF_CRYPTO_RUNS          32U
+    #define PERF_GCM_TAG_LEN          16U
+
+    #define PERF_LFS_CHUNK_LEN        256U
+    #define PERF_LFS_PATH             "/perf_test.bin"
+
+    #define PERF_MQTT_CONNECT_WAIT    pdMS_TO_TICKS( 60000UL )
+
+    #define PERF_LINE_LEN             128U
+
+    typedef enum
+    {
+        PERF_SHA256_CYCLES,
+        PERF_AES_GCM_CYCLES,
+        PERF_TLS_HANDSHAKE_MS,
+        PERF_MQTT_RTT_P50_US,
+        PERF_MQTT_RTT_P99_US,
+        PERF_MQTT_MSGS_PER_SEC,
+        PERF_SPI_HEADER_US,
+        PERF_SPI_PAYLOAD_KBPS,
+        PERF_LFS_WRITE_KBPS,
+        PERF_LFS_READ_KBPS,
+        PERF_METRIC_COUNT
+    } PerfMetricId_t;
+
+    typedef struct
+    {
+        const char * pcName;
+        uint32_t ulBaseline; /* 0 if not captured yet */
+        uint32_t ulTolerancePct;
+        BaseType_t xHigherIsBetter;
+    } PerfMetric_t;
+
+    static const PerfMetric_t xPerfMetrics[ PERF_METRIC_COUNT ] =
+    {
+        [ PERF_SHA256_CYCLES ] =     { "sha256_1k_cycles",    PERF_BASELINE_SHA256_CYCLES,     PERF_TEST_TOLERANCE_PCT,     pdFALSE },
+        [ PERF_AES_GCM_CYCLES ] =    { "aes_gcm_1k_cycles",   PERF_BASELINE_AES_GCM_CYCLES,    PERF_TEST_TOLERANCE_PCT,     pdFALSE },
+        [ PERF_TLS_HANDSHAKE_MS ] =  { "tls_handshake_ms",    PERF_BASELINE_TLS_HANDSHAKE_MS,  PERF_TEST_NET_TOLERANCE_PCT, pdFALSE },
+        [ PERF_MQTT_RTT_P50_US ] =   { "mqtt_rtt_p50_us",     PERF_BASELINE_MQTT_RTT_P50_US,   PERF_TEST_NET_TOLERANCE_PCT, pdFALSE },
+        [ PERF_MQTT_RTT_P99_US ] =   { "mqtt_rtt_p99_us",     PERF_BASELINE_MQTT_RTT_P99_US,   PERF_TEST_NET_TOLERANCE_PCT, pdFALSE },
+        [ PERF_MQTT_MSGS_PER_SEC ] = { "mqtt_msgs_per_sec",   PERF_BASELINE_MQTT_MSGS_PER_SEC, PERF_TEST_NET_TOLERANCE_PCT, pdTRUE  },
+        [ PERF_SPI_HEADER_US ] =     { "spi_header_us",       PERF_BASELINE_SPI_HEADER_US,     PERF_TEST_TOLERANCE_PCT,     pdFALSE },
+        [ PERF_SPI_PAYLOAD_KBPS ] =  { "spi_payload_kbps",    PERF_BASELINE_SPI_PAYLOAD_KBPS,  PERF_TEST_TOLERANCE_PCT,     pdTRUE  },
+        [ PERF_LFS_WRITE_KBPS ] =    { "lfs_write_kbps",      PERF_BASELINE_LFS_WRITE_KBPS,    PERF_TEST_TOLERANCE_PCT,     pdTRUE  },
+        [ PERF_LFS_READ_KBPS ] =     { "lfs_read_kbps",       PERF_BASELINE_LFS_READ_KBPS,     PERF_TEST_TOLERANCE_PCT,     pdTRUE  },
+    };
+
+    static uint8_t ucCryptoIn[ PERF_CRYPTO_LEN ];
+    static uint8_t ucCryptoOut[ PERF_CRYPTO_LEN + PERF_GCM_TAG_LEN ];
+    static mbedtls_gcm_context xGcmCtx;
+
+    void TEST_SubmitResult( const char * pcResult );
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Print the value of a metric with its baseline and return pdFALSE if it regressed.
+ */
+    static BaseType_t prvReportMetric( PerfMetricId_t xId,
+                                       uint32_t ulValue )
+    {
+        const PerfMetric_t * pxMetric = &( xPerfMetrics[ xId ] );
+        char pcLine[ PERF_LINE_LEN ];
+        BaseType_t xPass = pdTRUE;
+        const char * pcResult = "NEW";
+
+        if( pxMetric->ulBaseline != 0 )
+        {
+            uint64_t ullScaled = ( uint64_t ) ulValue * 100U;
+
+            if( pxMetric->xHigherIsBetter == pdTRUE )
+            {
+                xPass = ( ullScaled >= ( ( uint64_t ) pxMetric->ulBaseline * ( 100U - pxMetric->ulTolerancePct ) ) ) ? pdTRUE : pdFALSE;
+            }
+            else
+            {
+                xPass = ( ullScaled <= ( ( uint64_t ) pxMetric->ulBaseline * ( 100U + pxMetric->ulTolerancePct ) ) ) ? pdTRUE : pdFALSE;
+            }
+
+            pcResult = ( xPass == pdTRUE ) ? "PASS" : "FAIL";
+        }
+
+        ( void ) snprintf( pcLine, sizeof( pcLine ), "PERF,%s,%lu,%lu,%lu,%s\n",
+                           pxMetric->pcName, ( unsigned long ) ulValue,
+                           ( unsigned long ) pxMetric->ulBaseline,
+                           ( unsigned long ) pxMetric->ulTolerancePct, pcResult );
+        TEST_SubmitResult( pcLine );
+
+        return xPass;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int prvSha256Kernel( void * pvCtx )
+    {
+        ( void ) pvCtx;
+
+        return mbedtls_sha256( ucCryptoIn, PERF_CRYPTO_LEN, ucCryptoOut, 0 );
+    }
+
+    static int prvGcmKernel( void * pvCtx )
+    {
+        static const uint8_t ucIv[ 12 ] = { 0 };
+
+        return mbedtls_gcm_crypt_and_tag( ( mbedtls_gcm_context * ) pvCtx, MBEDTLS_GCM_ENCRYPT,
+                                          PERF_CRYPTO_LEN, ucIv, sizeof( ucIv ), NULL, 0,
+                                          ucCryptoIn, ucCryptoOut,
+                                          PERF_GCM_TAG_LEN, &( ucCryptoOut[ PERF_CRYPTO_LEN ] ) );
+    }
+
+    static MICRO_BENCH( xBenchSha256, "perf_sha256", prvSha256Kernel, NULL, PERF_CRYPTO_LEN, 0 );
+    static MICRO_BENCH( xBenchGcm, "perf_aes_gcm", prvGcmKernel, &xGcmCtx, PERF_CRYPTO_LEN, 0 );
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Connect to the MQTT endpoint PERF_TEST_HANDSHAKE_ITER times, as "bench handshake" does,
+ * and return the average connection time in ms, or 0 if a connection failed.
+ */
+    static uint32_t prvMeasureHandshake( void )
+    {
+        static const char * pcAlpnProtocols[] = { AWS_IOT_MQTT_ALPN, NULL };
+        PkiObject_t xPrivateKey = xPkiObjectFromLabel( TLS_KEY_PRV_LABEL );
+        PkiObject_t xClientCertificate = xPkiObjectFromLabel( TLS_CERT_LABEL );
+        PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+        TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+        BaseType_t xSuccess = pdFALSE;
+        size_t uxEndpointLen = 0;
+        char * pcEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT, &uxEndpointLen );
+        uint32_t ulPort = KVStore_getUInt32( CS_CORE_MQTT_PORT, &( xSuccess ) );
+        uint64_t ullTotalUs = 0;
+
+        if( ( pcEndpoint == NULL ) ||
+            ( uxEndpointLen == 0 ) ||
+            ( xSuccess == pdFALSE ) ||
+            ( ulPort == 0 ) ||
+            ( ulPort > UINT16_MAX ) )
+        {
+            LogError( "mqtt_endpoint and mqtt_port must be configured." );
+            xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+        }
+
+        for( uint32_t i = 0; ( i < PERF_TEST_HANDSHAKE_ITER ) && ( xStatus == TLS_TRANSPORT_SUCCESS ); i++ )
+        {
+            NetworkContext_t * pxNetworkContext = mbedtls_transport_allocate();
+
+            if( pxNetworkContext == NULL )
+            {
+                xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+            }
+            else
+            {
+                xStatus = mbedtls_transport_configure( pxNetworkContext, pcAlpnProtocols,
+                                                       &xPrivateKey, &xClientCertificate,
+                                                       pxRootCaChain, 1 );
+            }
+
+            if( xStatus == TLS_TRANSPORT_SUCCESS )
+            {
+                uint64_t ullStartUs = ullGetMonotonicUs();
+
+                xStatus = mbedtls_transport_connect( pxNetworkContext, pcEndpoint, ( uint16_t ) ulPort, 0, 0 );
+
+                ullTotalUs += ullGetMonotonicUs() - ullStartUs;
+
+                mbedtls_transport_disconnect( pxNetworkContext );
+            }
+
+            if( pxNetworkContext != NULL )
+            {
+                mbedtls_transport_free( pxNetworkContext );
+            }
+        }
+
+        if( pcEndpoint != NULL )
+        {
+            vPortFree( pcEndpoint );
+        }
+
+        if( xStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            LogError( "TLS connection failed: %ld", ( int32_t ) xStatus );
+            ullTotalUs = 0;
+        }
+
+        return ( uint32_t ) ( ullTotalUs / ( PERF_TEST_HANDSHAKE_ITER * 1000U ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    #ifdef PERF_TEST_LFS
+
+/*
+ * Write PERF_TEST_LFS_FILE_LEN bytes to a file and read them back, in PERF_LFS_CHUNK_LEN
+ * chunks. The write time includes closing the file, which programs the last blocks.
+ */
+        static BaseType_t prvMeasureLfs( uint32_t * pulWriteUs,
+                                         uint32_t * pulReadUs )
+        {
+            lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+            lfs_file_t xFile = { 0 };
+            lfs_ssize_t lReturn = LFS_ERR_OK;
+            uint64_t ullStartUs;
+
+            configASSERT( pLfsCtx != NULL );
+
+            ( void ) memset( ucCryptoOut, 0xA5, PERF_LFS_CHUNK_LEN );
+
+            ullStartUs = ullGetMonotonicUs();
+
+            if( lfs_file_open( pLfsCtx, &xFile, PERF_LFS_PATH, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC ) == LFS_ERR_OK )
+            {
+                for( uint32_t i = 0; ( i < PERF_TEST_LFS_FILE_LEN ) && ( lReturn >= 0 ); i += PERF_LFS_CHUNK_LEN )
+                {
+                    lReturn = lfs_file_write( pLfsCtx, &xFile, ucCryptoOut, PERF_LFS_CHUNK_LEN );
+                }
+
+                if( lfs_file_close( pLfsCtx, &xFile ) != LFS_ERR_OK )
+                {
+                    lReturn = LFS_ERR_IO;
+                }
+            }
+            else
+            {
+                lReturn = LFS_ERR_IO;
+            }
+
+            *pulWriteUs = ( uint32_t ) ( ullGetMonotonicUs() - ullStartUs );
+
+            if( lReturn >= 0 )
+            {
+                ullStartUs = ullGetMonotonicUs();
+
+                if( lfs_file_open( pLfsCtx, &xFile, PERF_LFS_PATH, LFS_O_RDONLY ) == LFS_ERR_OK )
+                {
+                    for( uint32_t i = 0; ( i < PERF_TEST_LFS_FILE_LEN ) && ( lReturn >= 0 ); i += PERF_LFS_CHUNK_LEN )
+                    {
+                        lReturn = lfs_file_read( pLfsCtx, &xFile, ucCryptoIn, PERF_LFS_CHUNK_LEN );
+
+                        if( lReturn != ( lfs_ssize_t ) PERF_LFS_CHUNK_LEN )
+                        {
+                            lReturn = LFS_ERR_IO;
+                        }
+                    }
+
+                    ( void ) lfs_file_close( pLfsCtx, &xFile );
+                }
+                else
+                {
+                    lReturn = LFS_ERR_IO;
+                }
+
+                *pulReadUs = ( uint32_t ) ( ullGetMonotonicUs() - ullStartUs );
+            }
+
+            ( void ) lfs_remove( pLfsCtx, PERF_LFS_PATH );
+
+            if( lReturn < 0 )
+            {
+                LogError( "littlefs test failed: %ld", ( int32_t ) lReturn );
+            }
+
+            return ( lReturn >= 0 ) ? pdTRUE : pdFALSE;
+        }
+
+    #endif /* PERF_TEST_LFS */
+
+/*-----------------------------------------------------------*/
+
+/* KiB per second of ullBytes transferred in ullUs, 0 if nothing was timed */
+    static uint32_t prvKiBPerSec( uint64_t ullBytes,
+                                  uint64_t ullUs )
+    {
+        return ( ullUs == 0 ) ? 0 : ( uint32_t ) ( ( ullBytes * 1000000ULL ) / ( ullUs * 1024ULL ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    TEST_GROUP( Full_Performance );
+
+    TEST_SETUP( Full_Performance )
+    {
+    }
+
+    TEST_TEAR_DOWN( Full_Performance )
+    {
+    }
+
+/*-----------------------------------------------------------*/
+
+    TEST( Full_Performance, Crypto )
+    {
+        static const uint8_t ucKey[ 16 ] = { 0 };
+        MicroBenchStats_t xStats = { 0 };
+        BaseType_t xPass = pdTRUE;
+
+        ( void ) memset( ucCryptoIn, 0x5A, sizeof( ucCryptoIn ) );
+
+        mbedtls_gcm_init( &xGcmCtx );
+        TEST_ASSERT_EQUAL( 0, mbedtls_gcm_setkey( &xGcmCtx, MBEDTLS_CIPHER_ID_AES, ucKey, 128 ) );
+
+        vMicroBenchRegister( &xBenchSha256 );
+        vMicroBenchRegister( &xBenchGcm );
+
+        TEST_ASSERT_EQUAL( pdTRUE, xMicroBenchRun( &xBenchSha256, PERF_CRYPTO_WARMUP, PERF_CRYPTO_RUNS, &xStats ) );
+        xPass &= prvReportMetric( PERF_SHA256_CYCLES, xStats.ulMedianCycles );
+
+        TEST_ASSERT_EQUAL( pdTRUE, xMicroBenchRun( &xBenchGcm, PERF_CRYPTO_WARMUP, PERF_CRYPTO_RUNS, &xStats ) );
+        xPass &= prvReportMetric( PERF_AES_GCM_CYCLES, xStats.ulMedianCycles );
+
+        mbedtls_gcm_free( &xGcmCtx );
+
+        TEST_ASSERT_TRUE_MESSAGE( xPass, "Crypto performance regressed" );
+    }
+
+/*-----------------------------------------------------------*/
+
+    TEST( Full_Performance, TlsHandshake )
+    {
+        uint32_t ulHandshakeMs = prvMeasureHandshake();
+
+        TEST_ASSERT_NOT_EQUAL_MESSAGE( 0, ulHandshakeMs, "TLS connection failed" );
+        TEST_ASSERT_TRUE_MESSAGE( prvReportMetric( PERF_TLS_HANDSHAKE_MS, ulHandshakeMs ),
+                                  "TLS handshake performance regressed" );
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * MQTT loopback round trips. The SPI data plane statistics are reset before them, so they
+ * cover the same traffic.
+ */
+    TEST( Full_Performance, MqttAndSpi )
+    {
+        const MqttBenchConfig_t xConfig =
+        {
+            .ulMessages   = PERF_TEST_MQTT_MESSAGES,
+            .ulPayloadLen = PERF_TEST_MQTT_PAYLOAD_LEN,
+            .ucQoS        = 1
+        };
+        MqttBenchResult_t xResult = { 0 };
+        MxDataplaneStats_t xSpiStats = { 0 };
+        size_t uxResults = 0;
+        BaseType_t xPass = pdTRUE;
+        EventBits_t xBits;
+
+        xBits = xEventGroupWaitBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED, pdFALSE, pdTRUE, PERF_MQTT_CONNECT_WAIT );
+        TEST_ASSERT_TRUE_MESSAGE( ( xBits & EVT_MASK_MQTT_CONNECTED ) != 0, "MQTT agent not connected" );
+
+        mx_ResetDataplaneStats();
+
+        TEST_ASSERT_EQUAL( pdPASS, xMqttBenchRun( &xConfig, &xResult, 1, &uxResults ) );
+        TEST_ASSERT_EQUAL( 1, uxResults );
+
+        mx_GetDataplaneStats( &xSpiStats );
+
+        xPass &= prvReportMetric( PERF_MQTT_RTT_P50_US, xResult.ulRttP50Us );
+        xPass &= prvReportMetric( PERF_MQTT_RTT_P99_US, xResult.ulRttP99Us );
+        xPass &= prvReportMetric( PERF_MQTT_MSGS_PER_SEC, xResult.ulMsgsPerSec );
+
+        TEST_ASSERT_NOT_EQUAL( 0, xSpiStats.xHeaderExchange.ulCount );
+
+        xPass &= prvReportMetric( PERF_SPI_HEADER_US,
+                                  ( uint32_t ) ( xSpiStats.xHeaderExchange.ullTotalUs / xSpiStats.xHeaderExchange.ulCount ) );
+        xPass &= prvReportMetric( PERF_SPI_PAYLOAD_KBPS,
+                                  prvKiBPerSec( xSpiStats.ullTxBytes + xSpiStats.ullRxBytes,
+                                                xSpiStats.xPayloadTransfer.ullTotalUs ) );
+
+        TEST_ASSERT_TRUE_MESSAGE( xPass, "MQTT or SPI performance regressed" );
+    }
+
+/*-----------------------------------------------------------*/
+
+    #ifdef PERF_TEST_LFS
+        TEST( Full_Performance, Littlefs )
+        {
+            uint32_t ulWriteUs = 0;
+            uint32_t ulReadUs = 0;
+            BaseType_t xPass = pdTRUE;
+
+            TEST_ASSERT_EQUAL( pdTRUE, prvMeasureLfs( &ulWriteUs, &ulReadUs ) );
+
+            xPass &= prvReportMetric( PERF_LFS_WRITE_KBPS, prvKiBPerSec( PERF_TEST_LFS_FILE_LEN, ulWriteUs ) );
+            xPass &= prvReportMetric( PERF_LFS_READ_KBPS, prvKiBPerSec( PERF_TEST_LFS_FILE_LEN, ulReadUs ) );
+
+            TEST_ASSERT_TRUE_MESSAGE( xPass, "littlefs performance regressed" );
+        }
+    #endif /* PERF_TEST_LFS */
+
+/*-----------------------------------------------------------*/
+
+    TEST_GROUP_RUNNER( Full_Performance )
+    {
+        TEST_SubmitResult( "PERF,name,value,baseline,tolerance_pct,result\n" );
+
+        RUN_TEST_CASE( Full_Performance, Crypto );
+        RUN_TEST_CASE( Full_Performance, TlsHandshake );
+        RUN_TEST_CASE( Full_Performance, MqttAndSpi );
+
+        #ifdef PERF_TEST_LFS
+            RUN_TEST_CASE( Full_Performance, Littlefs );
+        #endif
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvRunPerformanceTests( void )
+    {
+        RUN_TEST_GROUP( Full_Performance );
+    }
+
+/*-----------------------------------------------------------*/
+
+    extern void vMQTTAgentTask( void * );
+
+/*
+ * @brief Run the performance test group and return its number of failures.
+ * Called by the qualification task once the network is up.
+ */
+    int RunPerformanceTest( void )
+    {
+        /* The Device Advisor and OTA end to end tests start their own MQTT agent */
+        #if ( DEVICE_ADVISOR_TEST_ENABLED == 0 ) && ( OTA_E2E_TEST_ENABLED == 0 )
+            BaseType_t xResult = xTaskCreate( vMQTTAgentTask, "MQTTAgent", 2048, NULL, 10, NULL );
+
+            configASSERT( xResult == pdTRUE );
+        #endif
+
+        return UnityMain( 0, NULL, prvRunPerformanceTests );
+    }
+
+#endif /* PERFORMANCE_TEST_ENABLED == 1 */
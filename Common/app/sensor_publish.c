@@ -0,0 +1,513 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "static_alloc.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+
+#include "sensor_publish.h"
+#include "mqtt_payload_pool.h"
+#include "telemetry_spool.h"
+#include "sys_evt.h"
+
+#define MQTT_PUBLISH_BLOCK_TIME_MS    ( 200 )
+
+static_assert( ( SENSOR_PUBLISH_POOR_LINK_BATCH > 0 ) && ( SENSOR_PUBLISH_POOR_LINK_BATCH <= SENSOR_PUBLISH_SLOTS ),
+               "A batch is made of ready slots" );
+
+static_assert( SENSOR_PUBLISH_SLOT_LEN <= MQTT_PAYLOAD_POOL_MAX_LEN, "Every payload must fit in a pooled buffer" );
+
+#if ( TELEMETRY_SPOOL_ENABLED == 1 )
+    static_assert( SENSOR_PUBLISH_SLOT_LEN <= TELEMETRY_SPOOL_PAYLOAD_LEN, "Every slot must fit in a spool record" );
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A queued publish. Used as the command callback context, so that the slot is freed by
+ * the agent once the publish completes. The slot holds a reference to its pooled payload.
+ */
+struct MQTTAgentCommandContext
+{
+    const char * pcTopic;
+    size_t xPayloadLen;
+    MQTTQoS_t xQoS;
+    TickType_t xSubmitted;
+    uint8_t * pucPayload;
+    #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+        char pcSpoolTopic[ TELEMETRY_SPOOL_TOPIC_LEN + 1 ]; /* Topic of a record read back from the spool */
+    #endif
+};
+
+static MQTTAgentCommandContext_t xSlots[ SENSOR_PUBLISH_SLOTS ];
+
+/* Queues of slot pointers, both SENSOR_PUBLISH_SLOTS long so that sends never block */
+static QueueHandle_t xFreeSlots = NULL;
+static QueueHandle_t xReadySlots = NULL;
+
+static SemaphoreHandle_t xInFlight = NULL;
+
+static SensorPublishStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static void prvSlotFree( MQTTAgentCommandContext_t * pxSlot )
+{
+    vMqttPayloadRelease( pxSlot->pucPayload );
+    pxSlot->pucPayload = NULL;
+
+    ( void ) xQueueSendToBack( xFreeSlots, &pxSlot, 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    uint32_t ulLatencyMs;
+
+    configASSERT( pxCommandContext != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    ulLatencyMs = ( uint32_t ) ( xTaskGetTickCount() - pxCommandContext->xSubmitted ) * portTICK_PERIOD_MS;
+
+    taskENTER_CRITICAL();
+    {
+        xStats.ulInFlight--;
+        xStats.ulCompleted++;
+
+        if( pxReturnInfo->returnCode != MQTTSuccess )
+        {
+            xStats.ulFailed++;
+        }
+
+        if( ulLatencyMs > xStats.ulMaxLatencyMs )
+        {
+            xStats.ulMaxLatencyMs = ulLatencyMs;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    prvSlotFree( pxCommandContext );
+
+    ( void ) xSemaphoreGive( xInFlight );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSensorPublishSubmitPooled( const char * pcTopic,
+                                       uint8_t * pucPayload,
+                                       size_t xPayloadLen,
+                                       MQTTQoS_t xQoS )
+{
+    MQTTAgentCommandContext_t * pxSlot = NULL;
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pcTopic != NULL );
+    configASSERT( xMqttPayloadIsPooled( pucPayload ) == pdTRUE );
+
+    if( ( xPayloadLen == 0 ) || ( xPayloadLen > SENSOR_PUBLISH_SLOT_LEN ) )
+    {
+        LogError( "Payload length %u is out of range.", xPayloadLen );
+        vMqttPayloadRelease( pucPayload );
+    }
+    else if( ( xFreeSlots != NULL ) &&
+             ( xQueueReceive( xFreeSlots, &pxSlot, 0 ) == pdTRUE ) )
+    {
+        pxSlot->pcTopic = pcTopic;
+        pxSlot->xPayloadLen = xPayloadLen;
+        pxSlot->xQoS = xQoS;
+        pxSlot->xSubmitted = xTaskGetTickCount();
+        pxSlot->pucPayload = pucPayload;
+
+        ( void ) xQueueSendToBack( xReadySlots, &pxSlot, 0 );
+        xResult = pdTRUE;
+    }
+    else
+    {
+        vMqttPayloadRelease( pucPayload );
+
+        taskENTER_CRITICAL();
+        xStats.ulDroppedFull++;
+        taskEXIT_CRITICAL();
+    }
+
+    taskENTER_CRITICAL();
+    xStats.ulSubmitted++;
+    taskEXIT_CRITICAL();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSensorPublishSubmit( const char * pcTopic,
+                                 const void * pvPayload,
+                                 size_t xPayloadLen,
+                                 MQTTQoS_t xQoS )
+{
+    uint8_t * pucPayload = NULL;
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pvPayload != NULL );
+
+    if( ( xPayloadLen > 0 ) && ( xPayloadLen <= SENSOR_PUBLISH_SLOT_LEN ) )
+    {
+        pucPayload = pvMqttPayloadAlloc( xPayloadLen );
+    }
+
+    if( pucPayload != NULL )
+    {
+        ( void ) memcpy( pucPayload, pvPayload, xPayloadLen );
+        xResult = xSensorPublishSubmitPooled( pcTopic, pucPayload, xPayloadLen, xQoS );
+    }
+    else if( ( xPayloadLen == 0 ) || ( xPayloadLen > SENSOR_PUBLISH_SLOT_LEN ) )
+    {
+        LogError( "Payload length %u is out of range.", xPayloadLen );
+
+        taskENTER_CRITICAL();
+        xStats.ulSubmitted++;
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            xStats.ulSubmitted++;
+            xStats.ulDroppedFull++;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSensorPublishIsAccepting( void )
+{
+    #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+        return pdTRUE;
+    #else
+        return( ( xIsMqttAgentConnected() == true ) ? pdTRUE : pdFALSE );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+void vSensorPublishGetStats( SensorPublishStats_t * pxStats )
+{
+    taskENTER_CRITICAL();
+    *pxStats = xStats;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublish( MQTTAgentHandle_t xAgentHandle,
+                        MQTTAgentCommandContext_t * pxSlot )
+{
+    MQTTStatus_t xStatus;
+
+    MQTTPublishInfo_t xPublishInfo =
+    {
+        .qos             = pxSlot->xQoS,
+        .retain          = 0,
+        .dup             = 0,
+        .pTopicName      = pxSlot->pcTopic,
+        .topicNameLength = ( uint16_t ) strnlen( pxSlot->pcTopic, UINT16_MAX ),
+        .pPayload        = pxSlot->pucPayload,
+        .payloadLength   = pxSlot->xPayloadLen
+    };
+
+    MQTTAgentCommandInfo_t xCommandParams =
+    {
+        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
+        .cmdCompleteCallback         = prvPublishCommandCallback,
+        .pCmdCompleteCallbackContext = pxSlot,
+    };
+
+    /* Counted before the command is queued, the callback may run before MQTTAgent_Publish returns */
+    taskENTER_CRITICAL();
+    {
+        xStats.ulInFlight++;
+
+        if( xStats.ulInFlight > xStats.ulPeakInFlight )
+        {
+            xStats.ulPeakInFlight = xStats.ulInFlight;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    xStatus = MQTTAgent_Publish( xAgentHandle,
+                                 &xPublishInfo,
+                                 &xCommandParams );
+
+    if( xStatus != MQTTSuccess )
+    {
+        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+
+        taskENTER_CRITICAL();
+        {
+            xStats.ulInFlight--;
+            xStats.ulFailed++;
+        }
+        taskEXIT_CRITICAL();
+
+        prvSlotFree( pxSlot );
+        ( void ) xSemaphoreGive( xInFlight );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( TELEMETRY_SPOOL_ENABLED == 1 )
+
+/* Publish one spooled record from a free slot, refused while no slot or in flight publish is free */
+    static BaseType_t prvDrainRecord( void * pvCtx,
+                                      const char * pcTopic,
+                                      size_t uxTopicLen,
+                                      const uint8_t * pucPayload,
+                                      size_t uxPayloadLen,
+                                      MQTTQoS_t xQoS )
+    {
+        MQTTAgentCommandContext_t * pxSlot = NULL;
+        BaseType_t xResult = pdFALSE;
+
+        if( ( uxPayloadLen > SENSOR_PUBLISH_SLOT_LEN ) || ( uxTopicLen > TELEMETRY_SPOOL_TOPIC_LEN ) )
+        {
+            /* Consumed and dropped, a smaller build wrote it */
+            xResult = pdTRUE;
+        }
+        else if( xQueueReceive( xFreeSlots, &pxSlot, 0 ) != pdTRUE )
+        {
+            /* Live publishes have the slots */
+        }
+        else if( xSemaphoreTake( xInFlight, 0 ) != pdTRUE )
+        {
+            prvSlotFree( pxSlot );
+        }
+        else if( ( pxSlot->pucPayload = pvMqttPayloadAlloc( uxPayloadLen ) ) == NULL )
+        {
+            /* Live publishes have the payload buffers */
+            prvSlotFree( pxSlot );
+            ( void ) xSemaphoreGive( xInFlight );
+        }
+        else
+        {
+            ( void ) memcpy( pxSlot->pcSpoolTopic, pcTopic, uxTopicLen );
+            pxSlot->pcSpoolTopic[ uxTopicLen ] = '\0';
+            pxSlot->pcTopic = pxSlot->pcSpoolTopic;
+            pxSlot->xPayloadLen = uxPayloadLen;
+            pxSlot->xQoS = xQoS;
+            pxSlot->xSubmitted = xTaskGetTickCount();
+            ( void ) memcpy( pxSlot->pucPayload, pucPayload, uxPayloadLen );
+
+            prvPublish( ( MQTTAgentHandle_t ) pvCtx, pxSlot );
+            xResult = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+#endif /* TELEMETRY_SPOOL_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Publish a ready slot, or spool it while the agent is not connected */
+static void prvHandleReady( MQTTAgentHandle_t xAgentHandle,
+                            MQTTAgentCommandContext_t * pxSlot )
+{
+    /* Returned by the completion callback of an earlier publish */
+    ( void ) xSemaphoreTake( xInFlight, portMAX_DELAY );
+
+    if( xIsMqttAgentConnected() == pdTRUE )
+    {
+        prvPublish( xAgentHandle, pxSlot );
+    }
+    else
+    {
+        #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+            BaseType_t xSpooled = xTelemetrySpoolAppend( pxSlot->pcTopic, pxSlot->pucPayload,
+                                                         pxSlot->xPayloadLen, pxSlot->xQoS );
+        #else
+            BaseType_t xSpooled = pdFALSE;
+        #endif
+
+        taskENTER_CRITICAL();
+        {
+            if( xSpooled == pdTRUE )
+            {
+                xStats.ulSpooled++;
+            }
+            else
+            {
+                xStats.ulDroppedOffline++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        prvSlotFree( pxSlot );
+        ( void ) xSemaphoreGive( xInFlight );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vSensorPublishTask( void * pvParameters )
+{
+    MQTTAgentHandle_t xAgentHandle = NULL;
+    QueueHandle_t xFree = NULL;
+
+    /* Ready slots held back while the link is poor, oldest first */
+    MQTTAgentCommandContext_t * pxHeld[ SENSOR_PUBLISH_SLOTS ];
+    size_t uxHeld = 0;
+
+    #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+        TickType_t xLastDrain = 0;
+    #endif
+
+    ( void ) pvParameters;
+
+    xInFlight = xAppSemaphoreCreateCounting( SENSOR_PUBLISH_MAX_IN_FLIGHT, SENSOR_PUBLISH_MAX_IN_FLIGHT );
+    xReadySlots = xAppQueueCreate( SENSOR_PUBLISH_SLOTS, sizeof( MQTTAgentCommandContext_t * ) );
+    xFree = xAppQueueCreate( SENSOR_PUBLISH_SLOTS, sizeof( MQTTAgentCommandContext_t * ) );
+
+    if( ( xInFlight == NULL ) || ( xReadySlots == NULL ) || ( xFree == NULL ) )
+    {
+        LogError( "Failed to allocate the sensor publish queues." );
+        vTaskDelete( NULL );
+    }
+
+    for( uint32_t i = 0; i < SENSOR_PUBLISH_SLOTS; i++ )
+    {
+        MQTTAgentCommandContext_t * pxSlot = &xSlots[ i ];
+
+        ( void ) xQueueSendToBack( xFree, &pxSlot, 0 );
+    }
+
+    #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+        /* Without the spool, offline payloads are dropped as before */
+        ( void ) xTelemetrySpoolInit();
+    #endif
+
+    /* Submitting starts once the free slot queue is visible */
+    xFreeSlots = xFree;
+
+    vSleepUntilMQTTAgentReady();
+
+    xAgentHandle = xGetMqttAgentHandle();
+
+    for( ; ; )
+    {
+        MQTTAgentCommandContext_t * pxSlot = NULL;
+        TickType_t xWait = portMAX_DELAY;
+
+        #if ( TELEMETRY_SPOOL_ENABLED == 1 )
+            if( ( xIsMqttAgentConnected() == true ) && ( xTelemetrySpoolIsEmpty() == pdFALSE ) )
+            {
+                TickType_t xElapsed = xTaskGetTickCount() - xLastDrain;
+
+                if( xElapsed >= pdMS_TO_TICKS( TELEMETRY_SPOOL_DRAIN_PERIOD_MS ) )
+                {
+                    /* Handed to the agent back to back, so their packets share TLS records */
+                    ( void ) uxTelemetrySpoolDrain( TELEMETRY_SPOOL_DRAIN_BATCH, prvDrainRecord, xAgentHandle );
+                    xLastDrain = xTaskGetTickCount();
+                    xElapsed = 0;
+                }
+
+                xWait = pdMS_TO_TICKS( TELEMETRY_SPOOL_DRAIN_PERIOD_MS ) - xElapsed;
+            }
+            else if( xTelemetrySpoolIsEmpty() == pdFALSE )
+            {
+                /* Offline, wakes up to start draining soon after the agent reconnects */
+                xWait = pdMS_TO_TICKS( TELEMETRY_SPOOL_DRAIN_PERIOD_MS * 5 );
+            }
+        #endif /* TELEMETRY_SPOOL_ENABLED == 1 */
+
+        if( uxHeld > 0 )
+        {
+            TickType_t xHeldFor = xTaskGetTickCount() - pxHeld[ 0 ]->xSubmitted;
+            TickType_t xHoldLeft = ( xHeldFor < pdMS_TO_TICKS( SENSOR_PUBLISH_POOR_LINK_HOLD_MS ) ) ?
+                                   ( pdMS_TO_TICKS( SENSOR_PUBLISH_POOR_LINK_HOLD_MS ) - xHeldFor ) : 0;
+
+            if( xHoldLeft < xWait )
+            {
+                xWait = xHoldLeft;
+            }
+        }
+
+        if( xQueueReceive( xReadySlots, &pxSlot, xWait ) == pdTRUE )
+        {
+            if( xSysEventIsUp( SYS_EVT_LINK_POOR ) == pdTRUE )
+            {
+                pxHeld[ uxHeld++ ] = pxSlot;
+            }
+            else
+            {
+                prvHandleReady( xAgentHandle, pxSlot );
+            }
+        }
+
+        if( ( uxHeld > 0 ) &&
+            ( ( uxHeld >= SENSOR_PUBLISH_POOR_LINK_BATCH ) ||
+              ( xSysEventIsUp( SYS_EVT_LINK_POOR ) == pdFALSE ) ||
+              ( ( xTaskGetTickCount() - pxHeld[ 0 ]->xSubmitted ) >= pdMS_TO_TICKS( SENSOR_PUBLISH_POOR_LINK_HOLD_MS ) ) ) )
+        {
+            /* Handed to the agent back to back, so their packets share TLS records */
+            for( size_t i = 0; i < uxHeld; i++ )
+            {
+                prvHandleReady( xAgentHandle, pxHeld[ i ] );
+            }
+
+            uxHeld = 0;
+
+            taskENTER_CRITICAL();
+            xStats.ulPoorLinkBatches++;
+            taskEXIT_CRITICAL();
+        }
+    }
+}
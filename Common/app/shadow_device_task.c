@@ -30,19 +30,24 @@
  * strings, and for determining whether an incoming MQTT message is related to the
  * device shadow.
  *
- * This example assumes there is a powerOn state in the device shadow. It does the
- * following operations:
- * 1. Assemble strings for the MQTT topics of device shadow, by using macros defined by the Device Shadow library.
- * 2. Subscribe to those MQTT topics using the MQTT Agent.
+ * The device state is kept in a registry of shadows, the classic one and named ones, each with
+ * a table of properties (see shadow_props.h). It does the following operations:
+ * 1. Assemble strings for the MQTT topics of each shadow, by using the Device Shadow library.
+ * 2. Subscribe to the delta, accepted and rejected topics of all shadows using the MQTT Agent.
  * 3. Register callbacks for incoming shadow topic publishes with the subscription_manager.
- * 3. Publish to report the current state of powerOn.
- * 5. Check if powerOn has been changed and send an update if so.
- * 6. If a publish to update reported state was sent, wait until either prvIncomingPublishUpdateAcceptedCallback
- *    or prvIncomingPublishUpdateRejectedCallback handle the response.
- * 7. Wait until time for next check and repeat from step 5.
+ * 4. Report the properties of each shadow once.
+ * 5. Periodically publish a report holding only the properties that changed, to each shadow
+ *    with such properties.
+ * 6. For each report sent, wait until either prvIncomingPublishUpdateAcceptedCallback or
+ *    prvIncomingPublishUpdateRejectedCallback handle the response with the same client token.
+ *    The properties of a rejected or unanswered report are sent again.
  *
- * Meanwhile, when prvIncomingPublishUpdateDeltaCallback receives changes to the shadow state,
- * it will apply them on the device.
+ * Meanwhile, when prvIncomingPublishUpdateDeltaCallback receives changes to the state of a
+ * shadow, it applies them on the device and marks the properties to be reported.
+ *
+ * The latest delta version applied and the last reported state accepted by each shadow are kept
+ * in the shadow_cache kvstore key. After a reset, older deltas delivered again are still
+ * discarded, and step 4 only reports the properties whose value differs from the cached one.
  */
 
 #include "logging_levels.h"
@@ -67,61 +72,30 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_policy.h"
 
 /* JSON library includes. */
 #include "core_json.h"
 
 /* Shadow API header. */
 #include "shadow.h"
+#include "shadow_props.h"
 
 #include "kvstore.h"
 
 #include "hw_defs.h"
+#include "periodic_work.h"
 
 /**
- * @brief Format string representing a Shadow document with a "reported" state.
- *
- * The real json document will look like this:
- * {
- *   "state": {
- *     "reported": {
- *       "powerOn": 1
- *     }
- *   },
- *   "clientToken": "021909"
- * }
- *
- * Note the client token, which is optional. The token is used to identify the
- * response to an update. The client token must be unique at any given time,
- * but may be reused once the update is completed. For this demo, a timestamp
- * is used for a client token.
+ * @brief Size of the buffer for the reported documents. A report only holds the
+ * properties which changed, and is sent to one shadow at a time.
  */
-#define shadowexampleSHADOW_REPORTED_JSON \
-    "{"                                   \
-    "\"state\":{"                         \
-    "\"reported\":{"                      \
-    "\"powerOn\":%1u"                     \
-    "}"                                   \
-    "},"                                  \
-    "\"clientToken\":\"%06lu\""           \
-    "}"
+#define shadowREPORT_MAX_LEN                           ( 256U )
 
 /**
- * @brief The expected size of #SHADOW_REPORTED_JSON.
- *
- * Since all of the format specifiers in #SHADOW_REPORTED_JSON include a length,
- * its actual size can be calculated at compile time from the difference between
- * the lengths of the format strings and their formatted output. We must subtract 2
- * from the length as according the following formula:
- * 1. The length of the format string "%1u" is 3.
- * 2. The length of the format string "%06lu" is 5.
- * 3. The formatted length in case 1. is 1 ( for the state of powerOn ).
- * 4. The formatted length in case 2. is 6 ( for the clientToken length ).
- * 5. Thus the additional size of our format is 2 = 3 + 5 - 1 - 6 + 1 (termination character).
- *
- * Custom applications may calculate the length of the JSON document with the same method.
+ * @brief Longest env_publish policy, the environmental telemetry policy kvstore key.
  */
-#define shadowexampleSHADOW_REPORTED_JSON_LENGTH       ( sizeof( shadowexampleSHADOW_REPORTED_JSON ) - 2 )
+#define shadowENV_PUBLISH_LEN                          ( 64 )
 
 /**
  * @brief Time in ms to wait between checking for updates to report.
@@ -135,6 +109,12 @@
  */
 #define shadow_SIGNAL_TIMEOUT                          ( 30 * 1000 )
 
+/**
+ * @brief Notification values sent by the accepted and rejected callbacks.
+ */
+#define shadowRESPONSE_ACCEPTED                        ( 1UL )
+#define shadowRESPONSE_REJECTED                        ( 2UL )
+
 /**
  * @brief The maximum amount of time in milliseconds to wait for the commands
  * to be posted to the MQTT agent should the MQTT agent's command queue be full.
@@ -143,11 +123,10 @@
 #define shadowexampleMAX_COMMAND_SEND_BLOCK_TIME_MS    ( 60 * 1000 )
 
 /**
- * @brief An invalid value for the powerOn state. This is used to set the last
- * reported state to a value that will not match the current state. As we only
- * set the powerOn state to 0 or 1, any other value will suffice.
+ * @brief Size of the shadow_cache value: a layout hash, then the version of each shadow and the
+ * last reported value of each property, strings padded to their buffer size.
  */
-#define shadowexampleINVALID_POWERON_STATE             ( 2 )
+#define shadowCACHE_MAX_LEN                            ( 256U )
 
 /**
  * @brief Defines structure passed to callbacks and local functions.
@@ -156,6 +135,25 @@ typedef struct MQTTAgentCommandContext
 {
     char * pcDeviceName;
     uint8_t ucDeviceNameLen;
+
+    /**
+     * @brief The handle of this task. It is used by callbacks to notify this task.
+     */
+    TaskHandle_t xShadowDeviceTaskHandle;
+
+    MQTTAgentHandle_t xAgentHandle;
+} ShadowDeviceCtx_t;
+
+/**
+ * @brief One shadow of the thing, the classic one or a named one, and its properties.
+ * This is the context of the callbacks of its topics.
+ */
+typedef struct
+{
+    const char * pcShadowName; /* SHADOW_NAME_CLASSIC for the classic shadow */
+    ShadowProp_t * pxProps;
+    size_t xPropCount;
+
     char * pcTopicUpdate;
     uint16_t usTopicUpdateLen;
     char * pcTopicUpdateDelta;
@@ -164,19 +162,16 @@ typedef struct MQTTAgentCommandContext
     uint16_t usTopicUpdateAcceptedLen;
     char * pcTopicUpdateRejected;
     uint16_t usTopicUpdateRejectedLen;
-    char * pcTopicDelete;
-    uint16_t usTopicDeleteLen;
 
     /**
-     * @brief The simulated device current power on state.
+     * @brief Latest delta version received, older deltas are discarded.
      */
-    uint32_t ulCurrentPowerOnState;
+    uint32_t ulVersion;
 
     /**
-     * @brief The last reported state. It is initialized to an invalid value so that
-     * an update is initially sent.
+     * @brief Version of the document in the last accepted response.
      */
-    uint32_t ulReportedPowerOnState;
+    uint32_t ulAcceptedVersion;
 
     /**
      * @brief Match the received clientToken with the one sent in a device shadow
@@ -184,13 +179,13 @@ typedef struct MQTTAgentCommandContext
      */
     uint32_t ulClientToken;
 
-    /**
-     * @brief The handle of this task. It is used by callbacks to notify this task.
-     */
-    TaskHandle_t xShadowDeviceTaskHandle;
+    ShadowDeviceCtx_t * pxDeviceCtx;
 
-    MQTTAgentHandle_t xAgentHandle;
-} ShadowDeviceCtx_t;
+    /* Delta, accepted and rejected callbacks, run by the MQTT dispatch workers */
+    MqttAgentDeferredCallback_t xDeltaCallback;
+    MqttAgentDeferredCallback_t xAcceptedCallback;
+    MqttAgentDeferredCallback_t xRejectedCallback;
+} ShadowDoc_t;
 
 extern MQTTAgentContext_t xGlobalMqttAgentContext;
 
@@ -206,8 +201,8 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx );
 
 /**
  * @brief The callback to execute when there is an incoming publish on the
- * topic for delta updates. It verifies the document and sets the
- * powerOn state accordingly.
+ * topic for delta updates of a shadow. It verifies the document and applies
+ * the properties it holds.
  */
 static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
                                                    MQTTPublishInfo_t * pxPublishInfo );
@@ -215,8 +210,7 @@ static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
 /**
  * @brief The callback to execute when there is an incoming publish on the
  * topic for accepted requests. It verifies the document is valid and is being waited on.
- * If so it updates the last reported state and notifies the task to inform completion
- * of the update request.
+ * If so it notifies the task to inform completion of the update request.
  */
 static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo );
@@ -230,23 +224,272 @@ static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
 static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo );
 
+static void prvPowerOnChanged( ShadowProp_t * pxProp,
+                               void * pvCtx );
+
+static void prvEnvPublishChanged( ShadowProp_t * pxProp,
+                                  void * pvCtx );
+
+static void prvMqttPolicyChanged( ShadowProp_t * pxProp,
+                                  void * pvCtx );
+
 /**
  * @brief Entry point of shadow demo.
  *
- * This main function demonstrates how to use the macros provided by the
- * Device Shadow library to assemble strings for the MQTT topics defined
- * by AWS IoT Device Shadow. It uses these macros for topics to subscribe
+ * This main function demonstrates how to use the Device Shadow library to
+ * assemble strings for the MQTT topics defined by AWS IoT Device Shadow, for
+ * the classic shadow and for named shadows. It uses these topics to subscribe
  * to:
- * - SHADOW_TOPIC_STRING_UPDATE_DELTA for "$aws/things/thingName/shadow/update/delta"
- * - SHADOW_TOPIC_STRING_UPDATE_ACCEPTED for "$aws/things/thingName/shadow/update/accepted"
- * - SHADOW_TOPIC_STRING_UPDATE_REJECTED for "$aws/things/thingName/shadow/update/rejected"
+ * - "$aws/things/thingName/shadow[/name/shadowName]/update/delta"
+ * - "$aws/things/thingName/shadow[/name/shadowName]/update/accepted"
+ * - "$aws/things/thingName/shadow[/name/shadowName]/update/rejected"
  *
- * It also uses these macros for topics to publish to:
- * - SHADOW_TOPIC_STIRNG_DELETE for "$aws/things/thingName/shadow/delete"
- * - SHADOW_TOPIC_STRING_UPDATE for "$aws/things/thingName/shadow/update"
+ * It also uses this topic to publish to:
+ * - "$aws/things/thingName/shadow[/name/shadowName]/update"
  */
 void vShadowDeviceTask( void * pvParameters );
 
+/*-----------------------------------------------------------*/
+
+/* Updated from the MQTT dispatch worker by the delta callback */
+static char pcEnvPublish[ shadowENV_PUBLISH_LEN ] = { 0 };
+static char pcMqttPolicy[ MQTT_POLICY_LEN ] = { 0 };
+
+/* Device state in the classic shadow */
+static ShadowProp_t xDeviceProps[] =
+{
+    { "powerOn",     eShadowPropBool,   0, NULL,         0,                      prvPowerOnChanged    },
+    { "mqtt_policy", eShadowPropString, 0, pcMqttPolicy, sizeof( pcMqttPolicy ), prvMqttPolicyChanged },
+};
+
+/* Telemetry configuration in the "sensor_config" named shadow */
+static ShadowProp_t xSensorConfigProps[] =
+{
+    { "env_publish", eShadowPropString, 0, pcEnvPublish, sizeof( pcEnvPublish ), prvEnvPublishChanged },
+};
+
+static ShadowDoc_t xShadows[] =
+{
+    { SHADOW_NAME_CLASSIC, xDeviceProps,       sizeof( xDeviceProps ) / sizeof( xDeviceProps[ 0 ] )             },
+    { "sensor_config",     xSensorConfigProps, sizeof( xSensorConfigProps ) / sizeof( xSensorConfigProps[ 0 ] ) },
+};
+
+#define shadowDOC_COUNT    ( sizeof( xShadows ) / sizeof( xShadows[ 0 ] ) )
+
+/* Content of the shadow_cache key, and the same with the report waiting for a response applied */
+static uint8_t pucCache[ shadowCACHE_MAX_LEN ];
+static uint8_t pucCachePending[ shadowCACHE_MAX_LEN ];
+static size_t xCacheLen = 0;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t ulCacheHash( uint32_t ulHash,
+                             const void * pvData,
+                             size_t xLen )
+{
+    const uint8_t * pucData = ( const uint8_t * ) pvData;
+
+    /* FNV-1a */
+    for( size_t i = 0; i < xLen; i++ )
+    {
+        ulHash = ( ulHash ^ pucData[ i ] ) * 16777619UL;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t xCachePropLen( const ShadowProp_t * pxProp )
+{
+    return( pxProp->xType == eShadowPropString ) ? pxProp->xStringSize : sizeof( uint32_t );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Offset of the version of pxDoc, followed by its properties */
+static size_t xCacheDocOffset( const ShadowDoc_t * pxDoc )
+{
+    size_t xOffset = sizeof( uint32_t );
+
+    for( size_t i = 0; &xShadows[ i ] != pxDoc; i++ )
+    {
+        xOffset += sizeof( uint32_t );
+
+        for( size_t j = 0; j < xShadows[ i ].xPropCount; j++ )
+        {
+            xOffset += xCachePropLen( &( xShadows[ i ].pxProps[ j ] ) );
+        }
+    }
+
+    return xOffset;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Write the current value of pxProp in its cache format */
+static void prvCachePropValue( const ShadowProp_t * pxProp,
+                               uint8_t * pucDest )
+{
+    if( pxProp->xType == eShadowPropString )
+    {
+        ( void ) memset( pucDest, 0, pxProp->xStringSize );
+        ( void ) strncpy( ( char * ) pucDest, pxProp->pcString, pxProp->xStringSize - 1 );
+    }
+    else
+    {
+        ( void ) memcpy( pucDest, &( pxProp->ulValue ), sizeof( uint32_t ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Restore the shadow versions from the shadow_cache key and mark dirty the properties which
+ * differ from their last accepted report. Everything is reported when the key is missing, or was
+ * written for another thing name or another property table.
+ */
+static void prvCacheLoad( const ShadowDeviceCtx_t * pxCtx )
+{
+    uint32_t ulLayout = ulCacheHash( 2166136261UL, pxCtx->pcDeviceName, pxCtx->ucDeviceNameLen );
+    size_t xLen = sizeof( uint32_t );
+    size_t xOffset = sizeof( uint32_t );
+    BaseType_t xValid = pdFALSE;
+
+    for( size_t i = 0; i < shadowDOC_COUNT; i++ )
+    {
+        ulLayout = ulCacheHash( ulLayout, xShadows[ i ].pcShadowName, strlen( xShadows[ i ].pcShadowName ) + 1 );
+        xLen += sizeof( uint32_t );
+
+        for( size_t j = 0; j < xShadows[ i ].xPropCount; j++ )
+        {
+            const ShadowProp_t * pxProp = &( xShadows[ i ].pxProps[ j ] );
+            uint8_t ucType = ( uint8_t ) pxProp->xType;
+
+            ulLayout = ulCacheHash( ulLayout, pxProp->pcKey, strlen( pxProp->pcKey ) + 1 );
+            ulLayout = ulCacheHash( ulLayout, &ucType, sizeof( ucType ) );
+            ulLayout = ulCacheHash( ulLayout, &( pxProp->xStringSize ), sizeof( pxProp->xStringSize ) );
+            xLen += xCachePropLen( pxProp );
+        }
+    }
+
+    configASSERT( xLen <= shadowCACHE_MAX_LEN );
+
+    if( ( KVStore_getBlob( CS_SHADOW_CACHE, pucCache, sizeof( pucCache ) ) == xLen ) &&
+        ( memcmp( pucCache, &ulLayout, sizeof( uint32_t ) ) == 0 ) )
+    {
+        xValid = pdTRUE;
+    }
+    else
+    {
+        ( void ) memset( pucCache, 0, sizeof( pucCache ) );
+        ( void ) memcpy( pucCache, &ulLayout, sizeof( uint32_t ) );
+    }
+
+    xCacheLen = xLen;
+
+    for( size_t i = 0; i < shadowDOC_COUNT; i++ )
+    {
+        ShadowDoc_t * pxDoc = &xShadows[ i ];
+
+        ( void ) memcpy( &( pxDoc->ulVersion ), &pucCache[ xOffset ], sizeof( uint32_t ) );
+        xOffset += sizeof( uint32_t );
+
+        for( size_t j = 0; j < pxDoc->xPropCount; j++ )
+        {
+            ShadowProp_t * pxProp = &( pxDoc->pxProps[ j ] );
+            size_t xPropLen = xCachePropLen( pxProp );
+
+            /* No report is staged yet */
+            prvCachePropValue( pxProp, pucCachePending );
+
+            if( ( xValid == pdFALSE ) || ( memcmp( pucCachePending, &pucCache[ xOffset ], xPropLen ) != 0 ) )
+            {
+                pxProp->ucDirty = 1;
+            }
+
+            xOffset += xPropLen;
+        }
+
+        LogInfo( "Shadow \"%s\" restored at version %u.", pxDoc->pcShadowName, ( unsigned int ) pxDoc->ulVersion );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Record the values of the report of pxDoc just built, to be cached once it is accepted */
+static void prvCacheStage( const ShadowDoc_t * pxDoc )
+{
+    size_t xOffset = xCacheDocOffset( pxDoc );
+
+    ( void ) memcpy( pucCachePending, pucCache, xCacheLen );
+    ( void ) memcpy( &pucCachePending[ xOffset ], &( pxDoc->ulVersion ), sizeof( uint32_t ) );
+    xOffset += sizeof( uint32_t );
+
+    for( size_t j = 0; j < pxDoc->xPropCount; j++ )
+    {
+        const ShadowProp_t * pxProp = &( pxDoc->pxProps[ j ] );
+
+        if( pxProp->ucInFlight != 0 )
+        {
+            prvCachePropValue( pxProp, &pucCachePending[ xOffset ] );
+        }
+
+        xOffset += xCachePropLen( pxProp );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Keep the staged report, written to flash later from the timer task if anything changed */
+static void prvCacheCommit( void )
+{
+    if( memcmp( pucCache, pucCachePending, xCacheLen ) == 0 )
+    {
+        /* Same values reported again */
+    }
+    else if( KVStore_setBlob( CS_SHADOW_CACHE, xCacheLen, pucCachePending ) == pdTRUE )
+    {
+        ( void ) memcpy( pucCache, pucCachePending, xCacheLen );
+        KVStore_commitDeferred();
+    }
+    else
+    {
+        LogError( "Failed to store the shadow cache." );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Assemble one topic string of pxDoc, allocated from the heap */
+static ShadowStatus_t xAssembleTopic( const ShadowDeviceCtx_t * pxCtx,
+                                      const ShadowDoc_t * pxDoc,
+                                      ShadowTopicStringType_t xType,
+                                      uint16_t usLen,
+                                      char ** ppcTopic,
+                                      uint16_t * pusTopicLen )
+{
+    ShadowStatus_t xStatus = SHADOW_FAIL;
+
+    *ppcTopic = pvPortMalloc( usLen );
+
+    if( *ppcTopic != NULL )
+    {
+        xStatus = Shadow_AssembleTopicString( xType,
+                                              pxCtx->pcDeviceName,
+                                              pxCtx->ucDeviceNameLen,
+                                              pxDoc->pcShadowName,
+                                              ( uint8_t ) strlen( pxDoc->pcShadowName ),
+                                              *ppcTopic,
+                                              usLen,
+                                              pusTopicLen );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 static bool prvInitializeCtx( ShadowDeviceCtx_t * pxCtx )
 {
     bool xSuccess = true;
@@ -275,60 +518,35 @@ static bool prvInitializeCtx( ShadowDeviceCtx_t * pxCtx )
     if( ( pxCtx->pcDeviceName != NULL ) &&
         ( pxCtx->ucDeviceNameLen > 0 ) )
     {
-        ShadowStatus_t xStatus = SHADOW_SUCCESS;
-
-        pxCtx->usTopicUpdateLen = SHADOW_TOPIC_LENGTH_UPDATE( pxCtx->ucDeviceNameLen );
-        pxCtx->pcTopicUpdate = pvPortMalloc( pxCtx->usTopicUpdateLen );
-
-        xStatus |= Shadow_GetTopicString( ShadowTopicStringTypeUpdate,
-                                          pxCtx->pcDeviceName,
-                                          pxCtx->ucDeviceNameLen,
-                                          pxCtx->pcTopicUpdate,
-                                          pxCtx->usTopicUpdateLen,
-                                          &( pxCtx->usTopicUpdateLen ) );
-
-        pxCtx->usTopicUpdateDeltaLen = SHADOW_TOPIC_LENGTH_UPDATE_DELTA( pxCtx->ucDeviceNameLen );
-        pxCtx->pcTopicUpdateDelta = pvPortMalloc( pxCtx->usTopicUpdateDeltaLen );
-
-        xStatus |= Shadow_GetTopicString( ShadowTopicStringTypeUpdateDelta,
-                                          pxCtx->pcDeviceName,
-                                          pxCtx->ucDeviceNameLen,
-                                          pxCtx->pcTopicUpdateDelta,
-                                          pxCtx->usTopicUpdateDeltaLen,
-                                          &( pxCtx->usTopicUpdateDeltaLen ) );
-
-        pxCtx->usTopicUpdateAcceptedLen = SHADOW_TOPIC_LENGTH_UPDATE_ACCEPTED( pxCtx->ucDeviceNameLen );
-        pxCtx->pcTopicUpdateAccepted = pvPortMalloc( pxCtx->usTopicUpdateAcceptedLen );
+        for( size_t i = 0; i < shadowDOC_COUNT; i++ )
+        {
+            ShadowDoc_t * pxDoc = &xShadows[ i ];
+            uint8_t ucNameLen = ( uint8_t ) strlen( pxDoc->pcShadowName );
+            ShadowStatus_t xStatus = SHADOW_SUCCESS;
 
-        xStatus |= Shadow_GetTopicString( ShadowTopicStringTypeUpdateAccepted,
-                                          pxCtx->pcDeviceName,
-                                          pxCtx->ucDeviceNameLen,
-                                          pxCtx->pcTopicUpdateAccepted,
-                                          pxCtx->usTopicUpdateAcceptedLen,
-                                          &( pxCtx->usTopicUpdateAcceptedLen ) );
+            pxDoc->pxDeviceCtx = pxCtx;
 
-        pxCtx->usTopicUpdateRejectedLen = SHADOW_TOPIC_LENGTH_UPDATE_REJECTED( pxCtx->ucDeviceNameLen );
-        pxCtx->pcTopicUpdateRejected = pvPortMalloc( pxCtx->usTopicUpdateRejectedLen );
+            xStatus |= xAssembleTopic( pxCtx, pxDoc, ShadowTopicStringTypeUpdate,
+                                       SHADOW_TOPIC_LEN_UPDATE( pxCtx->ucDeviceNameLen, ucNameLen ),
+                                       &( pxDoc->pcTopicUpdate ), &( pxDoc->usTopicUpdateLen ) );
 
-        xStatus |= Shadow_GetTopicString( ShadowTopicStringTypeUpdateRejected,
-                                          pxCtx->pcDeviceName,
-                                          pxCtx->ucDeviceNameLen,
-                                          pxCtx->pcTopicUpdateRejected,
-                                          pxCtx->usTopicUpdateRejectedLen,
-                                          &( pxCtx->usTopicUpdateRejectedLen ) );
+            xStatus |= xAssembleTopic( pxCtx, pxDoc, ShadowTopicStringTypeUpdateDelta,
+                                       SHADOW_TOPIC_LEN_UPDATE_DELTA( pxCtx->ucDeviceNameLen, ucNameLen ),
+                                       &( pxDoc->pcTopicUpdateDelta ), &( pxDoc->usTopicUpdateDeltaLen ) );
 
+            xStatus |= xAssembleTopic( pxCtx, pxDoc, ShadowTopicStringTypeUpdateAccepted,
+                                       SHADOW_TOPIC_LEN_UPDATE_ACC( pxCtx->ucDeviceNameLen, ucNameLen ),
+                                       &( pxDoc->pcTopicUpdateAccepted ), &( pxDoc->usTopicUpdateAcceptedLen ) );
 
-        pxCtx->usTopicDeleteLen = SHADOW_TOPIC_LENGTH_DELETE( pxCtx->ucDeviceNameLen );
-        pxCtx->pcTopicDelete = pvPortMalloc( pxCtx->usTopicDeleteLen );
+            xStatus |= xAssembleTopic( pxCtx, pxDoc, ShadowTopicStringTypeUpdateRejected,
+                                       SHADOW_TOPIC_LEN_UPDATE_REJ( pxCtx->ucDeviceNameLen, ucNameLen ),
+                                       &( pxDoc->pcTopicUpdateRejected ), &( pxDoc->usTopicUpdateRejectedLen ) );
 
-        xStatus |= Shadow_GetTopicString( ShadowTopicStringTypeDelete,
-                                          pxCtx->pcDeviceName,
-                                          pxCtx->ucDeviceNameLen,
-                                          pxCtx->pcTopicDelete,
-                                          pxCtx->usTopicDeleteLen,
-                                          &( pxCtx->usTopicDeleteLen ) );
+            xSuccess &= ( xStatus == SHADOW_SUCCESS );
+        }
 
-        xSuccess &= ( xStatus == SHADOW_SUCCESS );
+        /* What differs from the last accepted reports is reported once */
+        prvCacheLoad( pxCtx );
     }
     else
     {
@@ -343,46 +561,87 @@ static bool prvInitializeCtx( ShadowDeviceCtx_t * pxCtx )
 static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
+    MQTTSubAckStatus_t pxSubAckStatus[ 3 * shadowDOC_COUNT ];
+    MqttAgentSubscription_t pxSubscriptions[ 3 * shadowDOC_COUNT ];
 
-    xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                       pxCtx->pcTopicUpdateDelta,
-                                       MQTTQoS1,
-                                       prvIncomingPublishUpdateDeltaCallback,
-                                       pxCtx );
-
-    if( xStatus != MQTTSuccess )
+    for( size_t i = 0; i < shadowDOC_COUNT; i++ )
     {
-        LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateDelta );
+        ShadowDoc_t * pxDoc = &xShadows[ i ];
+
+        pxDoc->xDeltaCallback = ( MqttAgentDeferredCallback_t ) { prvIncomingPublishUpdateDeltaCallback, pxDoc };
+        pxDoc->xAcceptedCallback = ( MqttAgentDeferredCallback_t ) { prvIncomingPublishUpdateAcceptedCallback, pxDoc };
+        pxDoc->xRejectedCallback = ( MqttAgentDeferredCallback_t ) { prvIncomingPublishUpdateRejectedCallback, pxDoc };
+
+        pxSubscriptions[ 3 * i ] = ( MqttAgentSubscription_t ) { pxDoc->pcTopicUpdateDelta, MQTTQoS1, MqttAgent_DeferredCallback, &( pxDoc->xDeltaCallback ) };
+        pxSubscriptions[ 3 * i + 1 ] = ( MqttAgentSubscription_t ) { pxDoc->pcTopicUpdateAccepted, MQTTQoS1, MqttAgent_DeferredCallback, &( pxDoc->xAcceptedCallback ) };
+        pxSubscriptions[ 3 * i + 2 ] = ( MqttAgentSubscription_t ) { pxDoc->pcTopicUpdateRejected, MQTTQoS1, MqttAgent_DeferredCallback, &( pxDoc->xRejectedCallback ) };
     }
-    else
-    {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateAccepted,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateAcceptedCallback,
-                                           pxCtx );
 
-        if( xStatus != MQTTSuccess )
+    /* Subscribe to the topics of all shadows with a single SUBSCRIBE packet */
+    xStatus = MqttAgent_SubscribeMultiSync( pxCtx->xAgentHandle,
+                                            pxSubscriptions,
+                                            3 * shadowDOC_COUNT,
+                                            pxSubAckStatus );
+
+    for( uint32_t ulIdx = 0; ulIdx < ( 3 * shadowDOC_COUNT ); ulIdx++ )
+    {
+        if( ( xStatus != MQTTSuccess ) ||
+            ( pxSubAckStatus[ ulIdx ] == MQTTSubAckFailure ) )
         {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateAccepted );
+            LogError( "Failed to subscribe to topic: %s", pxSubscriptions[ ulIdx ].pcTopicFilter );
+            xStatus = MQTTServerRefused;
         }
     }
 
-    if( xStatus == MQTTSuccess )
+    return( xStatus == MQTTSuccess );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPowerOnChanged( ShadowProp_t * pxProp,
+                               void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    LogInfo( "Setting powerOn state to %u.", ( unsigned int ) pxProp->ulValue );
+
+    if( pxProp->ulValue == 1 )
+    {
+        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_RESET ); /* Turn the LED ON */
+    }
+    else
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateRejected,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateRejectedCallback,
-                                           pxCtx );
+        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET ); /* Turn the LED off */
+    }
+}
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateRejected );
-        }
+/* Save a desired env_publish policy, the environmental sensor task reloads it once committed */
+static void prvEnvPublishChanged( ShadowProp_t * pxProp,
+                                  void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    LogInfo( "Setting env_publish to \"%s\".", pxProp->pcString );
+
+    /* Flushed later from the timer task, not from the MQTT agent */
+    if( KVStore_setString( CS_ENV_PUBLISH_POLICY, pxProp->pcString ) == pdTRUE )
+    {
+        KVStore_commitDeferred();
     }
+}
 
-    return( xStatus == MQTTSuccess );
+/* Save a desired publish policy, the MQTT agent applies it to the following publishes once committed */
+static void prvMqttPolicyChanged( ShadowProp_t * pxProp,
+                                  void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    LogInfo( "Setting mqtt_policy to \"%s\".", pxProp->pcString );
+
+    if( KVStore_setString( CS_MQTT_PUBLISH_POLICY, pxProp->pcString ) == pdTRUE )
+    {
+        KVStore_commitDeferred();
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -390,14 +649,10 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
 static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
                                                    MQTTPublishInfo_t * pxPublishInfo )
 {
-    static uint32_t ulCurrentVersion = 0; /* Remember the latest version number we've received */
-    uint32_t ulVersion = 0UL;
-    uint32_t ulNewState = 0UL;
-    char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
+    ShadowPropsDelta_t xDelta;
     JSONStatus_t result = JSONSuccess;
 
-    ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
+    ShadowDoc_t * pxDoc = ( ShadowDoc_t * ) pvCtx;
 
     configASSERT( pxPublishInfo != NULL );
     configASSERT( pxPublishInfo->pPayload != NULL );
@@ -422,87 +677,73 @@ static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
      *  }
      */
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
+    /* One walk over the document for the version and every property, instead of a search each */
+    result = xShadowPropsParse( ( const char * ) pxPublishInfo->pPayload,
+                                pxPublishInfo->payloadLength,
+                                pxDoc->pxProps,
+                                pxDoc->xPropCount,
+                                &xDelta );
 
     if( result != JSONSuccess )
     {
         LogError( "Invalid JSON document received!" );
     }
+    else if( xDelta.ucHasVersion == 0 )
+    {
+        LogError( "Version field not found in JSON document!" );
+    }
+    else if( xDelta.ulVersion <= pxDoc->ulVersion )
+    {
+        /* In this demo, we discard the incoming message
+         * if the version number is not newer than the latest
+         * that we've received before. Your application may use a
+         * different approach.
+         */
+        LogWarn( ( "Received unexpected delta update with version %u. Current version is %u",
+                   ( unsigned int ) xDelta.ulVersion,
+                   ( unsigned int ) pxDoc->ulVersion ) );
+    }
     else
     {
-        /* Obtain the version value. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "version",
-                              sizeof( "version" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
+        LogInfo( "Received delta update of shadow \"%s\" with version %u.",
+                 pxDoc->pcShadowName,
+                 ( unsigned int ) xDelta.ulVersion );
 
-        if( result != JSONSuccess )
-        {
-            LogError( "Version field not found in JSON document!" );
-        }
-        else
-        {
-            /* Convert the extracted value to an unsigned integer value. */
-            ulVersion = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
+        /* Set received version as the current version. */
+        pxDoc->ulVersion = xDelta.ulVersion;
 
-            /* Make sure the version is newer than the last one we received. */
-            if( ulVersion <= ulCurrentVersion )
-            {
-                /* In this demo, we discard the incoming message
-                 * if the version number is not newer than the latest
-                 * that we've received before. Your application may use a
-                 * different approach.
-                 */
-                LogWarn( ( "Received unexpected delta update with version %u. Current version is %u",
-                           ( unsigned int ) ulVersion,
-                           ( unsigned int ) ulCurrentVersion ) );
-            }
-            else
-            {
-                LogInfo( "Received delta update with version %.*s.",
-                         ulOutValueLength,
-                         pcOutValue );
-
-                /* Set received version as the current version. */
-                ulCurrentVersion = ulVersion;
-
-                /* Get powerOn state from json documents. */
-                result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                      pxPublishInfo->payloadLength,
-                                      "state.powerOn",
-                                      sizeof( "state.powerOn" ) - 1,
-                                      &pcOutValue,
-                                      ( size_t * ) &ulOutValueLength );
-
-                if( result != JSONSuccess )
-                {
-                    LogWarn( "powerOn field not found in JSON document!" );
-                }
-                else
-                {
-                    /* Convert the powerOn state value to an unsigned integer value. */
-                    ulNewState = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-
-                    LogInfo( "Setting powerOn state to %u.", ( unsigned int ) ulNewState );
-                    /* Set the new powerOn state. */
-                    pxCtx->ulCurrentPowerOnState = ulNewState;
-
-                    if( ulNewState == 1 )
-                    {
-                        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_RESET ); /* Turn the LED ON */
-                    }
-                    else
-                    {
-                        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET ); /* Turn the LED off */
-                    }
-                }
-            }
-        }
+        /* The properties received are reported back by the task */
+        ( void ) ulShadowPropsApply( pxDoc->pxProps, pxDoc->xPropCount, &xDelta, pxDoc );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Returns the clientToken of a response, or 0 if it has none */
+static uint32_t ulGetClientToken( MQTTPublishInfo_t * pxPublishInfo )
+{
+    char * pcOutValue = NULL;
+    size_t xOutValueLength = 0;
+    uint32_t ulToken = 0;
+
+    /* Make sure the payload is a valid json document. */
+    if( JSON_Validate( pxPublishInfo->pPayload,
+                       pxPublishInfo->payloadLength ) != JSONSuccess )
+    {
+        LogError( "Invalid JSON document received!" );
     }
+    else if( JSON_Search( ( char * ) pxPublishInfo->pPayload,
+                          pxPublishInfo->payloadLength,
+                          "clientToken",
+                          sizeof( "clientToken" ) - 1,
+                          &pcOutValue,
+                          &xOutValueLength ) == JSONSuccess )
+    {
+        /* Convert the code to an unsigned integer value. */
+        ulToken = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
+    }
+
+    return ulToken;
 }
 
 /*-----------------------------------------------------------*/
@@ -510,12 +751,9 @@ static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
 static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo )
 {
-    char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
     uint32_t ulReceivedToken = 0UL;
-    JSONStatus_t result = JSONSuccess;
 
-    ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
+    ShadowDoc_t * pxDoc = ( ShadowDoc_t * ) pvCtx;
 
     configASSERT( pvCtx != NULL );
     configASSERT( pxPublishInfo != NULL );
@@ -547,70 +785,37 @@ static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
      *      "clientToken": "022485"
      *  }
      */
+    ulReceivedToken = ulGetClientToken( pxPublishInfo );
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
-
-    if( result != JSONSuccess )
-    {
-        LogError( "Invalid JSON document received!" );
-    }
-    else
-    {
-        /* Get clientToken from json documents. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "clientToken",
-                              sizeof( "clientToken" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
-    }
-
-    if( result != JSONSuccess )
+    /* If we are waiting for a response, ulClientToken will be the token for the response
+     * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
+     * not for us or if it is is a response that arrived after we timed out
+     * waiting for it.
+     */
+    if( ( ulReceivedToken == 0 ) || ( ulReceivedToken != pxDoc->ulClientToken ) )
     {
-        LogDebug( "Ignoring publish on /update/accepted with no clientToken field." );
+        LogDebug( "Ignoring publish on /update/accepted with clientToken %lu.", ( unsigned long ) ulReceivedToken );
     }
     else
     {
-        /* Convert the code to an unsigned integer value. */
-        ulReceivedToken = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-
-        /* If we are waiting for a response, ulClientToken will be the token for the response
-         * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
-         * not for us or if it is is a response that arrived after we timed out
-         * waiting for it.
-         */
-        if( ulReceivedToken != pxCtx->ulClientToken )
+        char * pcVersion = NULL;
+        size_t xVersionLen = 0;
+
+        LogInfo( "Received accepted response for update with token %lu. ", ( unsigned long ) pxDoc->ulClientToken );
+
+        /* Validated by ulGetClientToken */
+        if( JSON_Search( ( char * ) pxPublishInfo->pPayload,
+                         pxPublishInfo->payloadLength,
+                         "version",
+                         sizeof( "version" ) - 1,
+                         &pcVersion,
+                         &xVersionLen ) == JSONSuccess )
         {
-            LogDebug( "Ignoring publish on /update/accepted with clientToken %lu.", ( unsigned long ) ulReceivedToken );
+            pxDoc->ulAcceptedVersion = ( uint32_t ) strtoul( pcVersion, NULL, 10 );
         }
-        else
-        {
-            LogInfo( "Received accepted response for update with token %lu. ", ( unsigned long ) pxCtx->ulClientToken );
 
-            /*  Obtain the accepted state from the response and update our last sent state. */
-            result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                  pxPublishInfo->payloadLength,
-                                  "state.reported.powerOn",
-                                  sizeof( "state.reported.powerOn" ) - 1,
-                                  &pcOutValue,
-                                  ( size_t * ) &ulOutValueLength );
-
-            if( result != JSONSuccess )
-            {
-                LogError( "powerOn field not found in JSON document!" );
-            }
-            else
-            {
-                /* Convert the powerOn state value to an unsigned integer value and
-                 * save the new last reported value*/
-                pxCtx->ulReportedPowerOnState = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-            }
-
-            /* Wake up the shadow task which is waiting for this response. */
-            xTaskNotifyGive( pxCtx->xShadowDeviceTaskHandle );
-        }
+        /* Wake up the shadow task which is waiting for this response. */
+        ( void ) xTaskNotify( pxDoc->pxDeviceCtx->xShadowDeviceTaskHandle, shadowRESPONSE_ACCEPTED, eSetValueWithOverwrite );
     }
 }
 
@@ -619,12 +824,11 @@ static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
 static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo )
 {
-    JSONStatus_t result = JSONSuccess;
     char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
+    size_t xOutValueLength = 0;
     uint32_t ulReceivedToken = 0UL;
 
-    ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
+    ShadowDoc_t * pxDoc = ( ShadowDoc_t * ) pvCtx;
 
     configASSERT( pvCtx != NULL );
     configASSERT( pxPublishInfo != NULL );
@@ -642,68 +846,120 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
      *    "clientToken": "token"
      * }
      */
+    ulReceivedToken = ulGetClientToken( pxPublishInfo );
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
-
-    if( result != JSONSuccess )
+    /* If we are waiting for a response, ulClientToken will be the token for the response
+     * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
+     * not for us or if it is is a response that arrived after we timed out
+     * waiting for it.
+     */
+    if( ( ulReceivedToken == 0 ) || ( ulReceivedToken != pxDoc->ulClientToken ) )
     {
-        LogError( "Invalid JSON document received!" );
+        LogDebug( "Ignoring publish on /update/rejected with clientToken %lu.", ( unsigned long ) ulReceivedToken );
     }
     else
     {
-        /* Get clientToken from json documents. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "clientToken",
-                              sizeof( "clientToken" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
-    }
+        /*  Obtain the error code. */
+        if( JSON_Search( ( char * ) pxPublishInfo->pPayload,
+                         pxPublishInfo->payloadLength,
+                         "code",
+                         sizeof( "code" ) - 1,
+                         &pcOutValue,
+                         &xOutValueLength ) != JSONSuccess )
+        {
+            LogWarn( "Received rejected response for update with token %lu and no error code.", ( unsigned long ) pxDoc->ulClientToken );
+        }
+        else
+        {
+            LogWarn( "Received rejected response for update with token %lu and error code %.*s.", ( unsigned long ) pxDoc->ulClientToken,
+                     xOutValueLength,
+                     pcOutValue );
+        }
 
-    if( result != JSONSuccess )
-    {
-        LogDebug( "Ignoring publish on /update/rejected with clientToken %lu.", ( unsigned long ) ulReceivedToken );
+        /* Wake up the shadow task which is waiting for this response. */
+        ( void ) xTaskNotify( pxDoc->pxDeviceCtx->xShadowDeviceTaskHandle, shadowRESPONSE_REJECTED, eSetValueWithOverwrite );
     }
-    else
-    {
-        /* Convert the code to an unsigned integer value. */
-        ulReceivedToken = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
+}
 
-        /* If we are waiting for a response, ulClientToken will be the token for the response
-         * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
-         * not for us or if it is is a response that arrived after we timed out
-         * waiting for it.
-         */
-        if( ulReceivedToken != pxCtx->ulClientToken )
+/*-----------------------------------------------------------*/
+
+/* Send the dirty properties of pxDoc, if any, and wait for the response */
+static void prvReportShadow( ShadowDeviceCtx_t * pxCtx,
+                             ShadowDoc_t * pxDoc )
+{
+    /* The agent may still refer to the report after the publish command returns */
+    static char pcReportDocument[ shadowREPORT_MAX_LEN ] = { 0 };
+    static MQTTPublishInfo_t xPublishInfo = { 0 };
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    uint32_t ulClientToken = ( xTaskGetTickCount() % 999999UL ) + 1UL;
+    uint32_t ulResponse = 0;
+    size_t xReportLen;
+
+    xReportLen = xShadowPropsBuildReport( pxDoc->pxProps,
+                                          pxDoc->xPropCount,
+                                          ulClientToken,
+                                          pcReportDocument,
+                                          sizeof( pcReportDocument ) );
+
+    if( xReportLen > 0 )
+    {
+        /* We do not need a completion callback here since for publishes, we expect to get a
+         * response on the appropriate topics for accepted or rejected reports. */
+        xCommandParams.blockTimeMs = shadowexampleMAX_COMMAND_SEND_BLOCK_TIME_MS;
+        xCommandParams.cmdCompleteCallback = NULL;
+
+        xPublishInfo.qos = MQTTQoS1;
+        xPublishInfo.pTopicName = pxDoc->pcTopicUpdate;
+        xPublishInfo.topicNameLength = pxDoc->usTopicUpdateLen;
+        xPublishInfo.pPayload = pcReportDocument;
+        xPublishInfo.payloadLength = xReportLen;
+
+        prvCacheStage( pxDoc );
+
+        /* Save the client token for use in the update accepted and rejected callbacks. */
+        ( void ) xTaskNotifyStateClear( NULL );
+        pxDoc->ulAcceptedVersion = UINT32_MAX;
+        pxDoc->ulClientToken = ulClientToken;
+
+        LogInfo( "Publishing to %.*s with client token %lu.",
+                 pxDoc->usTopicUpdateLen, pxDoc->pcTopicUpdate,
+                 ( long unsigned ) ulClientToken );
+        LogDebug( "Publish content: %.*s", xReportLen, pcReportDocument );
+
+        if( MQTTAgent_Publish( pxCtx->xAgentHandle,
+                               &xPublishInfo,
+                               &xCommandParams ) != MQTTSuccess )
         {
-            LogDebug( "Ignoring publish on /update/rejected with clientToken %lu.", ( unsigned long ) ulReceivedToken );
+            LogError( "Failed to publish report to shadow." );
         }
-        else
+        /* Wait for the response to our report. When the Device shadow service receives the request it will
+         * publish a response to  the /update/accepted or update/rejected */
+        else if( xTaskNotifyWait( 0, UINT32_MAX, &ulResponse, pdMS_TO_TICKS( shadow_SIGNAL_TIMEOUT ) ) == pdFALSE )
         {
-            /*  Obtain the error code. */
-            result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                  pxPublishInfo->payloadLength,
-                                  "code",
-                                  sizeof( "code" ) - 1,
-                                  &pcOutValue,
-                                  ( size_t * ) &ulOutValueLength );
-
-            if( result != JSONSuccess )
-            {
-                LogWarn( "Received rejected response for update with token %lu and no error code.", ( unsigned long ) pxCtx->ulClientToken );
-            }
-            else
+            LogError( "Timed out waiting for response to report." );
+        }
+
+        /* Clear the client token */
+        pxDoc->ulClientToken = 0;
+
+        if( ulResponse == shadowRESPONSE_ACCEPTED )
+        {
+            /* Every update takes a new version, a lower one means the shadow was deleted and
+             * created again, so that its deltas start over */
+            if( pxDoc->ulAcceptedVersion < pxDoc->ulVersion )
             {
-                LogWarn( "Received rejected response for update with token %lu and error code %.*s.", ( unsigned long ) pxCtx->ulClientToken,
-                         ulOutValueLength,
-                         pcOutValue );
+                LogWarn( "Shadow \"%s\" went back to version %u.", pxDoc->pcShadowName, ( unsigned int ) pxDoc->ulAcceptedVersion );
+                pxDoc->ulVersion = pxDoc->ulAcceptedVersion;
+                ( void ) memcpy( &pucCachePending[ xCacheDocOffset( pxDoc ) ], &( pxDoc->ulVersion ), sizeof( uint32_t ) );
             }
 
-            /* Wake up the shadow task which is waiting for this response. */
-            xTaskNotifyGive( pxCtx->xShadowDeviceTaskHandle );
+            prvCacheCommit();
         }
+
+        /* The properties of a report rejected or unanswered are sent again the next time */
+        vShadowPropsReportDone( pxDoc->pxProps,
+                                pxDoc->xPropCount,
+                                ( ulResponse == shadowRESPONSE_ACCEPTED ) ? pdTRUE : pdFALSE );
     }
 }
 
@@ -712,22 +968,18 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
 void vShadowDeviceTask( void * pvParameters )
 {
     bool xStatus = true;
-    uint32_t ulNotificationValue;
-    static MQTTPublishInfo_t xPublishInfo = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-    MQTTStatus_t xCommandAdded;
     ShadowDeviceCtx_t xShadowCtx = { 0 };
 
-    /* A buffer containing the update document. It has static duration to prevent
-     * it from being placed on the call stack. */
-    static char pcUpdateDocument[ shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1 ] = { 0 };
-
     /* Remove compiler warnings about unused parameters. */
     ( void ) pvParameters;
 
     /* Record the handle of this task so that the callbacks can send a notification to this task. */
     xShadowCtx.xShadowDeviceTaskHandle = xTaskGetCurrentTaskHandle();
 
+    /* Changes are relative to the stored policy */
+    ( void ) KVStore_getString( CS_ENV_PUBLISH_POLICY, pcEnvPublish, sizeof( pcEnvPublish ) );
+    ( void ) KVStore_getString( CS_MQTT_PUBLISH_POLICY, pcMqttPolicy, sizeof( pcMqttPolicy ) );
+
     /* Wait for MqttAgent to be ready. */
     vSleepUntilMQTTAgentReady();
 
@@ -735,20 +987,6 @@ void vShadowDeviceTask( void * pvParameters )
 
     xStatus = prvInitializeCtx( &xShadowCtx );
 
-    /* Set up the MQTTAgentCommandInfo_t for the demo loop.
-     * We do not need a completion callback here since for publishes, we expect to get a
-     * response on the appropriate topics for accepted or rejected reports, and for pings
-     * we do not care about the completion. */
-    xCommandParams.blockTimeMs = shadowexampleMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = NULL;
-
-    /* Set up MQTTPublishInfo_t for the update reports. */
-    xPublishInfo.qos = MQTTQoS1;
-    xPublishInfo.pTopicName = xShadowCtx.pcTopicUpdate;
-    xPublishInfo.topicNameLength = xShadowCtx.usTopicUpdateLen;
-    xPublishInfo.pPayload = pcUpdateDocument;
-    xPublishInfo.payloadLength = ( shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1 );
-
     /* Wait for first mqtt connection */
     ( void ) xEventGroupWaitBits( xSystemEvents,
                                   EVT_MASK_MQTT_CONNECTED,
@@ -764,65 +1002,20 @@ void vShadowDeviceTask( void * pvParameters )
 
     if( xStatus == true )
     {
+        static PeriodicWork_t xReportWork;
+
+        vPeriodicWorkStart( &xReportWork, pdMS_TO_TICKS( shadowMS_BETWEEN_REPORTS ),
+                            pdMS_TO_TICKS( shadowMS_BETWEEN_REPORTS / 10 ) );
+
         for( ; ; )
         {
-            if( xShadowCtx.ulCurrentPowerOnState == xShadowCtx.ulReportedPowerOnState )
-            {
-                LogDebug( "No change in powerOn state since last report. Current state is %u.", xShadowCtx.ulCurrentPowerOnState );
-            }
-            else
+            for( size_t i = 0; i < shadowDOC_COUNT; i++ )
             {
-                LogInfo( "PowerOn state is now %u. Sending new report.", ( unsigned int ) xShadowCtx.ulCurrentPowerOnState );
-
-                /* Create a new client token and save it for use in the update accepted and rejected callbacks. */
-                xShadowCtx.ulClientToken = ( xTaskGetTickCount() % 1000000 );
-
-                /* Generate update report. */
-                ( void ) memset( pcUpdateDocument,
-                                 0x00,
-                                 sizeof( pcUpdateDocument ) );
-
-                snprintf( pcUpdateDocument,
-                          shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1,
-                          shadowexampleSHADOW_REPORTED_JSON,
-                          ( unsigned int ) xShadowCtx.ulCurrentPowerOnState,
-                          ( long unsigned ) xShadowCtx.ulClientToken );
-
-                /* Send update. */
-                LogInfo( "Publishing to /update with following client token %lu.", ( long unsigned ) xShadowCtx.ulClientToken );
-                LogDebug( "Publish content: %.*s", shadowexampleSHADOW_REPORTED_JSON_LENGTH, pcUpdateDocument );
-
-                xCommandAdded = MQTTAgent_Publish( xShadowCtx.xAgentHandle,
-                                                   &xPublishInfo,
-                                                   &xCommandParams );
-
-                if( xCommandAdded != MQTTSuccess )
-                {
-                    LogError( "Failed to publish report to shadow." );
-                }
-                else
-                {
-                    /* Wait for the response to our report. When the Device shadow service receives the request it will
-                     * publish a response to  the /update/accepted or update/rejected */
-                    ulNotificationValue = ulTaskNotifyTake( pdFALSE, pdMS_TO_TICKS( shadow_SIGNAL_TIMEOUT ) );
-
-                    if( ulNotificationValue == 0 )
-                    {
-                        LogError( "Timed out waiting for response to report." );
-
-                        /* If we time out waiting for a response and then the report is accepted, the
-                         * state may be out of sync. Set the reported state as to ensure we resend the
-                         * report. */
-                        xShadowCtx.ulReportedPowerOnState = shadowexampleINVALID_POWERON_STATE;
-                    }
-                }
-
-                /* Clear the client token */
-                xShadowCtx.ulClientToken = 0;
+                prvReportShadow( &xShadowCtx, &xShadows[ i ] );
             }
 
             LogDebug( "Sleeping until next update check." );
-            vTaskDelay( pdMS_TO_TICKS( shadowMS_BETWEEN_REPORTS ) );
+            vPeriodicWorkWait( &xReportWork );
         }
     }
     else
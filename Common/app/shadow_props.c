@@ -0,0 +1,500 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "shadow_props.h"
+#include "json_writer.h"
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xKeyIs( const JSONPair_t * pxPair,
+                          const char * pcKey )
+{
+    size_t xKeyLen = strlen( pcKey );
+
+    return( ( pxPair->keyLength == xKeyLen ) && ( memcmp( pxPair->key, pcKey, xKeyLen ) == 0 ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lHexDigit( char cDigit )
+{
+    int32_t lValue = -1;
+
+    if( ( cDigit >= '0' ) && ( cDigit <= '9' ) )
+    {
+        lValue = cDigit - '0';
+    }
+    else if( ( cDigit >= 'a' ) && ( cDigit <= 'f' ) )
+    {
+        lValue = cDigit - 'a' + 10;
+    }
+    else if( ( cDigit >= 'A' ) && ( cDigit <= 'F' ) )
+    {
+        lValue = cDigit - 'A' + 10;
+    }
+
+    return lValue;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Decode the character of the JSON string pcValue at *pxPos to pucOut, in UTF-8, and move *pxPos
+ * past it. Returns the number of bytes decoded, or 0 for an escape which is not supported: NUL and
+ * surrogate pairs, outside of the basic multilingual plane.
+ */
+static size_t xDecodeChar( const char * pcValue,
+                           size_t xLen,
+                           size_t * pxPos,
+                           uint8_t pucOut[ 3 ] )
+{
+    size_t xPos = *pxPos;
+    size_t xOutLen = 1;
+    uint32_t ulCode = 0;
+
+    /* core_json validated the escapes, so that they are complete */
+    if( pcValue[ xPos ] != '\\' )
+    {
+        pucOut[ 0 ] = ( uint8_t ) pcValue[ xPos ];
+        xPos++;
+    }
+    else if( pcValue[ xPos + 1 ] != 'u' )
+    {
+        static const char pcFrom[] = "\"\\/bfnrt";
+        static const char pcTo[] = "\"\\/\b\f\n\r\t";
+        const char * pcFound = strchr( pcFrom, pcValue[ xPos + 1 ] );
+
+        pucOut[ 0 ] = ( pcFound != NULL ) ? ( uint8_t ) pcTo[ pcFound - pcFrom ] : ( uint8_t ) pcValue[ xPos + 1 ];
+        xPos += 2;
+    }
+    else if( ( xPos + 6 ) <= xLen )
+    {
+        for( size_t i = 2; i < 6; i++ )
+        {
+            ulCode = ( ulCode << 4 ) | ( uint32_t ) lHexDigit( pcValue[ xPos + i ] );
+        }
+
+        if( ( ulCode == 0 ) || ( ( ulCode >= 0xD800U ) && ( ulCode <= 0xDFFFU ) ) )
+        {
+            xOutLen = 0;
+        }
+        else if( ulCode < 0x80U )
+        {
+            pucOut[ 0 ] = ( uint8_t ) ulCode;
+        }
+        else if( ulCode < 0x800U )
+        {
+            pucOut[ 0 ] = ( uint8_t ) ( 0xC0U | ( ulCode >> 6 ) );
+            pucOut[ 1 ] = ( uint8_t ) ( 0x80U | ( ulCode & 0x3FU ) );
+            xOutLen = 2;
+        }
+        else
+        {
+            pucOut[ 0 ] = ( uint8_t ) ( 0xE0U | ( ulCode >> 12 ) );
+            pucOut[ 1 ] = ( uint8_t ) ( 0x80U | ( ( ulCode >> 6 ) & 0x3FU ) );
+            pucOut[ 2 ] = ( uint8_t ) ( 0x80U | ( ulCode & 0x3FU ) );
+            xOutLen = 3;
+        }
+
+        xPos += 6;
+    }
+    else
+    {
+        xOutLen = 0;
+    }
+
+    *pxPos = xPos;
+
+    return xOutLen;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Store the JSON string pcValue in pxProp, decoded, without a copy on the side: a first pass checks
+ * that it fits and whether it differs from the current value. Returns pdFALSE, leaving pxProp
+ * unchanged, if it does not fit or cannot be decoded, otherwise pdTRUE and in *pxChanged whether
+ * the value changed.
+ */
+static BaseType_t xStoreString( ShadowProp_t * pxProp,
+                                const char * pcValue,
+                                size_t xLen,
+                                BaseType_t * pxChanged )
+{
+    size_t xOldLen = strlen( pxProp->pcString );
+    size_t xOutLen = 0;
+    size_t xPos = 0;
+    BaseType_t xSame = pdTRUE;
+    BaseType_t xValid = pdTRUE;
+    uint8_t pucChar[ 3 ];
+
+    while( ( xValid == pdTRUE ) && ( xPos < xLen ) )
+    {
+        size_t xCharLen = xDecodeChar( pcValue, xLen, &xPos, pucChar );
+
+        if( ( xCharLen == 0 ) || ( ( xOutLen + xCharLen ) >= pxProp->xStringSize ) )
+        {
+            xValid = pdFALSE;
+        }
+        else
+        {
+            if( ( ( xOutLen + xCharLen ) > xOldLen ) ||
+                ( memcmp( &pxProp->pcString[ xOutLen ], pucChar, xCharLen ) != 0 ) )
+            {
+                xSame = pdFALSE;
+            }
+
+            xOutLen += xCharLen;
+        }
+    }
+
+    if( xValid == pdTRUE )
+    {
+        *pxChanged = ( ( xSame == pdTRUE ) && ( xOutLen == xOldLen ) ) ? pdFALSE : pdTRUE;
+
+        for( xPos = 0, xOutLen = 0; xPos < xLen; )
+        {
+            size_t xCharLen = xDecodeChar( pcValue, xLen, &xPos, pucChar );
+
+            ( void ) memcpy( &pxProp->pcString[ xOutLen ], pucChar, xCharLen );
+            xOutLen += xCharLen;
+        }
+
+        pxProp->pcString[ xOutLen ] = '\0';
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Members of "state", each looked up in the table */
+static JSONStatus_t xParseState( const char * pcState,
+                                 size_t xStateLen,
+                                 const ShadowProp_t * pxProps,
+                                 size_t xCount,
+                                 ShadowPropsDelta_t * pxDelta )
+{
+    size_t xStart = 0;
+    size_t xNext = 0;
+    JSONPair_t xPair = { 0 };
+    JSONStatus_t xStatus = JSONSuccess;
+
+    while( xStatus == JSONSuccess )
+    {
+        xStatus = JSON_Iterate( pcState, xStateLen, &xStart, &xNext, &xPair );
+
+        for( size_t i = 0; ( xStatus == JSONSuccess ) && ( i < xCount ); i++ )
+        {
+            if( xKeyIs( &xPair, pxProps[ i ].pcKey ) == pdTRUE )
+            {
+                pxDelta->ulFound |= ( 1UL << i );
+                pxDelta->pcValue[ i ] = xPair.value;
+                pxDelta->xValueLen[ i ] = xPair.valueLength;
+                pxDelta->xValueType[ i ] = xPair.jsonType;
+            }
+        }
+    }
+
+    return( xStatus == JSONNotFound ) ? JSONSuccess : xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+JSONStatus_t xShadowPropsParse( const char * pcDoc,
+                                size_t xDocLen,
+                                const ShadowProp_t * pxProps,
+                                size_t xCount,
+                                ShadowPropsDelta_t * pxDelta )
+{
+    size_t xStart = 0;
+    size_t xNext = 0;
+    JSONPair_t xPair = { 0 };
+    JSONStatus_t xStatus = JSONSuccess;
+
+    configASSERT( xCount <= SHADOW_PROPS_MAX );
+
+    ( void ) memset( pxDelta, 0, sizeof( ShadowPropsDelta_t ) );
+
+    /* "metadata" and any other collection are skipped over, not searched */
+    while( xStatus == JSONSuccess )
+    {
+        xStatus = JSON_Iterate( pcDoc, xDocLen, &xStart, &xNext, &xPair );
+
+        if( xStatus != JSONSuccess )
+        {
+            /* End of the document, or malformed */
+        }
+        else if( ( xPair.jsonType == JSONNumber ) && ( xKeyIs( &xPair, "version" ) == pdTRUE ) )
+        {
+            /* Followed by a delimiter, so strtoul stops within the document */
+            pxDelta->ulVersion = ( uint32_t ) strtoul( xPair.value, NULL, 10 );
+            pxDelta->ucHasVersion = 1;
+        }
+        else if( ( xPair.jsonType == JSONObject ) && ( xKeyIs( &xPair, "state" ) == pdTRUE ) )
+        {
+            xStatus = xParseState( xPair.value, xPair.valueLength, pxProps, xCount, pxDelta );
+        }
+    }
+
+    if( xStatus == JSONNotFound )
+    {
+        xStatus = JSONSuccess;
+    }
+    else
+    {
+        /* Nothing gets applied from a document which is not complete */
+        pxDelta->ulFound = 0;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulShadowPropsApply( ShadowProp_t * pxProps,
+                             size_t xCount,
+                             const ShadowPropsDelta_t * pxDelta,
+                             void * pvCtx )
+{
+    uint32_t ulChanges = 0;
+
+    for( size_t i = 0; i < xCount; i++ )
+    {
+        ShadowProp_t * pxProp = &pxProps[ i ];
+        const char * pcValue = pxDelta->pcValue[ i ];
+        size_t xLen = pxDelta->xValueLen[ i ];
+        JSONTypes_t xType = pxDelta->xValueType[ i ];
+        BaseType_t xReceived = ( pxDelta->ulFound & ( 1UL << i ) ) != 0 ? pdTRUE : pdFALSE;
+        BaseType_t xChanged = pdFALSE;
+
+        if( xReceived == pdFALSE )
+        {
+            /* Not in this delta */
+        }
+        else if( ( pxProp->xType == eShadowPropBool ) && ( ( xType == JSONTrue ) || ( xType == JSONFalse ) ) )
+        {
+            uint32_t ulValue = ( xType == JSONTrue ) ? 1 : 0;
+
+            xChanged = ( ulValue != pxProp->ulValue ) ? pdTRUE : pdFALSE;
+            pxProp->ulValue = ulValue;
+        }
+        else if( ( ( pxProp->xType == eShadowPropUint ) || ( pxProp->xType == eShadowPropBool ) ) && ( xType == JSONNumber ) )
+        {
+            uint32_t ulValue = ( uint32_t ) strtoul( pcValue, NULL, 10 );
+
+            xChanged = ( ulValue != pxProp->ulValue ) ? pdTRUE : pdFALSE;
+            pxProp->ulValue = ulValue;
+        }
+        else if( ( pxProp->xType == eShadowPropString ) && ( xType == JSONString ) &&
+                 ( xStoreString( pxProp, pcValue, xLen, &xChanged ) == pdTRUE ) )
+        {
+            /* Stored */
+        }
+        else
+        {
+            LogError( "Ignored shadow property %s, unexpected type, length or escape.", pxProp->pcKey );
+            xReceived = pdFALSE;
+        }
+
+        if( xReceived == pdTRUE )
+        {
+            pxProp->ucDirty = 1;
+        }
+
+        if( xChanged == pdTRUE )
+        {
+            ulChanges++;
+
+            if( pxProp->vOnChange != NULL )
+            {
+                pxProp->vOnChange( pxProp, pvCtx );
+            }
+        }
+    }
+
+    return ulChanges;
+}
+
+/*-----------------------------------------------------------*/
+
+/* One "key":value member of the reported object */
+static void prvWriteProp( JsonWriter_t * pxWriter,
+                          const ShadowProp_t * pxProp )
+{
+    if( pxProp->xType == eShadowPropString )
+    {
+        vJsonWriterString( pxWriter, pxProp->pcKey, pxProp->pcString );
+    }
+    else
+    {
+        vJsonWriterUint( pxWriter, pxProp->pcKey, pxProp->ulValue );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Length of the member of pxProp, without its separator */
+static size_t xPropLen( const ShadowProp_t * pxProp )
+{
+    JsonWriter_t xWriter;
+    size_t xStart;
+
+    vJsonWriterInit( &xWriter, NULL, 0 );
+    vJsonWriterObjectOpen( &xWriter, NULL );
+    xStart = xJsonWriterLen( &xWriter );
+    prvWriteProp( &xWriter, pxProp );
+
+    return xJsonWriterLen( &xWriter ) - xStart;
+}
+
+/*-----------------------------------------------------------*/
+
+/* The report of the properties in ulMask. Returns its length as xJsonWriterEnd */
+static size_t xWriteReport( JsonWriter_t * pxWriter,
+                            const ShadowProp_t * pxProps,
+                            size_t xCount,
+                            uint32_t ulMask,
+                            uint32_t ulClientToken )
+{
+    vJsonWriterObjectOpen( pxWriter, NULL );
+    vJsonWriterObjectOpen( pxWriter, "state" );
+    vJsonWriterObjectOpen( pxWriter, "reported" );
+
+    for( size_t i = 0; i < xCount; i++ )
+    {
+        if( ( ulMask & ( 1UL << i ) ) != 0 )
+        {
+            prvWriteProp( pxWriter, &pxProps[ i ] );
+        }
+    }
+
+    vJsonWriterObjectClose( pxWriter );
+    vJsonWriterObjectClose( pxWriter );
+    vJsonWriterDecimalString( pxWriter, "clientToken", ulClientToken, 6 );
+    vJsonWriterObjectClose( pxWriter );
+
+    return xJsonWriterEnd( pxWriter );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xShadowPropsBuildReport( ShadowProp_t * pxProps,
+                                size_t xCount,
+                                uint32_t ulClientToken,
+                                char * pcBuffer,
+                                size_t xBufferLen )
+{
+    JsonWriter_t xWriter;
+    uint32_t ulMask = 0;
+    size_t xLen;
+    size_t xEmptyLen;
+
+    configASSERT( xCount <= SHADOW_PROPS_MAX );
+
+    /* Exact length of the report without properties, then of each dirty one with its separator */
+    vJsonWriterInit( &xWriter, NULL, 0 );
+    xEmptyLen = xWriteReport( &xWriter, pxProps, xCount, 0, ulClientToken );
+    xLen = xEmptyLen;
+
+    for( size_t i = 0; i < xCount; i++ )
+    {
+        if( pxProps[ i ].ucDirty != 0 )
+        {
+            size_t xMemberLen = xPropLen( &pxProps[ i ] );
+            size_t xNeeded = xMemberLen + ( ( ulMask != 0 ) ? 1 : 0 );
+
+            /* Properties which do not fit are left dirty for the next report */
+            if( ( xLen + xNeeded ) < xBufferLen )
+            {
+                ulMask |= ( 1UL << i );
+                xLen += xNeeded;
+            }
+            else if( ( xEmptyLen + xMemberLen ) >= xBufferLen )
+            {
+                LogError( "Shadow property %s does not fit in a report of %u bytes.", pxProps[ i ].pcKey, ( unsigned int ) xBufferLen );
+            }
+        }
+    }
+
+    if( ulMask != 0 )
+    {
+        for( size_t i = 0; i < xCount; i++ )
+        {
+            if( ( ulMask & ( 1UL << i ) ) != 0 )
+            {
+                /* Cleared before the value is read, so a change made meanwhile is reported next time */
+                pxProps[ i ].ucDirty = 0;
+                pxProps[ i ].ucInFlight = 1;
+            }
+        }
+
+        vJsonWriterInit( &xWriter, pcBuffer, xBufferLen );
+        xLen = xWriteReport( &xWriter, pxProps, xCount, ulMask, ulClientToken );
+
+        if( xLen == 0 )
+        {
+            /* A string grew since it was measured, it is sent again with its new value */
+            LogError( "Shadow report changed while it was built." );
+            vShadowPropsReportDone( pxProps, xCount, pdFALSE );
+        }
+    }
+    else
+    {
+        xLen = 0;
+    }
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowPropsReportDone( ShadowProp_t * pxProps,
+                             size_t xCount,
+                             BaseType_t xAccepted )
+{
+    for( size_t i = 0; i < xCount; i++ )
+    {
+        if( ( pxProps[ i ].ucInFlight != 0 ) && ( xAccepted == pdFALSE ) )
+        {
+            pxProps[ i ].ucDirty = 1;
+        }
+
+        pxProps[ i ].ucInFlight = 0;
+    }
+}
@@ -0,0 +1,319 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "telemetry_encode.h"
+
+#define TELEMETRY_MAX_DECIMALS    6
+
+static const uint32_t ulPow10[ TELEMETRY_MAX_DECIMALS + 1 ] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+/*-----------------------------------------------------------*/
+
+static void prvCborCheck( TelemetryEncoder_t * pxEncoder,
+                          CborError xCborError )
+{
+    if( xCborError != CborNoError )
+    {
+        pxEncoder->xError = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* One byte is always kept for the NUL terminator */
+static void prvJsonAppend( TelemetryEncoder_t * pxEncoder,
+                           const char * pcData,
+                           size_t xDataLen )
+{
+    if( ( pxEncoder->xError == pdFALSE ) &&
+        ( ( pxEncoder->xLen + xDataLen ) < pxEncoder->xBufferLen ) )
+    {
+        ( void ) memcpy( &pxEncoder->pucBuffer[ pxEncoder->xLen ], pcData, xDataLen );
+        pxEncoder->xLen += xDataLen;
+    }
+    else
+    {
+        pxEncoder->xError = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Unsigned decimal of ullValue, padded with zeros to at least ulMinDigits digits */
+static void prvJsonAppendDecimal( TelemetryEncoder_t * pxEncoder,
+                                  uint64_t ullValue,
+                                  uint32_t ulMinDigits )
+{
+    char pcDigits[ 20 ];
+    size_t xDigits = 0;
+
+    do
+    {
+        pcDigits[ sizeof( pcDigits ) - 1 - xDigits ] = ( char ) ( '0' + ( ullValue % 10 ) );
+        ullValue /= 10;
+        xDigits++;
+    } while( ( ullValue > 0 ) || ( xDigits < ulMinDigits ) );
+
+    prvJsonAppend( pxEncoder, &pcDigits[ sizeof( pcDigits ) - xDigits ], xDigits );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvJsonKey( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey )
+{
+    if( pxEncoder->xFirst[ pxEncoder->ulDepth ] == pdFALSE )
+    {
+        prvJsonAppend( pxEncoder, ",", 1 );
+    }
+
+    pxEncoder->xFirst[ pxEncoder->ulDepth ] = pdFALSE;
+
+    prvJsonAppend( pxEncoder, "\"", 1 );
+    prvJsonAppend( pxEncoder, pcKey, strlen( pcKey ) );
+    prvJsonAppend( pxEncoder, "\":", 2 );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCborKey( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey )
+{
+    prvCborCheck( pxEncoder, cbor_encode_text_stringz( &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ], pcKey ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryBegin( TelemetryEncoder_t * pxEncoder,
+                      BaseType_t xFormat,
+                      uint8_t * pucBuffer,
+                      size_t xBufferLen )
+{
+    configASSERT( pxEncoder != NULL );
+    configASSERT( pucBuffer != NULL );
+
+    pxEncoder->xFormat = xFormat;
+    pxEncoder->xError = pdFALSE;
+    pxEncoder->pucBuffer = pucBuffer;
+    pxEncoder->xBufferLen = xBufferLen;
+    pxEncoder->xLen = 0;
+    pxEncoder->ulDepth = 0;
+    pxEncoder->xFirst[ 0 ] = pdTRUE;
+
+    if( xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        cbor_encoder_init( &pxEncoder->xCbor[ 0 ], pucBuffer, xBufferLen, 0 );
+        prvCborCheck( pxEncoder, cbor_encoder_create_map( &pxEncoder->xCbor[ 0 ], &pxEncoder->xCbor[ 1 ], CborIndefiniteLength ) );
+    }
+    else
+    {
+        prvJsonAppend( pxEncoder, "{", 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryOpenMap( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey )
+{
+    if( pxEncoder->ulDepth >= TELEMETRY_MAX_DEPTH )
+    {
+        pxEncoder->xError = pdTRUE;
+    }
+    else if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborKey( pxEncoder, pcKey );
+        prvCborCheck( pxEncoder, cbor_encoder_create_map( &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ],
+                                                          &pxEncoder->xCbor[ pxEncoder->ulDepth + 2 ],
+                                                          CborIndefiniteLength ) );
+        pxEncoder->ulDepth++;
+    }
+    else
+    {
+        prvJsonKey( pxEncoder, pcKey );
+        prvJsonAppend( pxEncoder, "{", 1 );
+        pxEncoder->ulDepth++;
+        pxEncoder->xFirst[ pxEncoder->ulDepth ] = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryCloseMap( TelemetryEncoder_t * pxEncoder )
+{
+    if( pxEncoder->ulDepth == 0 )
+    {
+        pxEncoder->xError = pdTRUE;
+    }
+    else if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborCheck( pxEncoder, cbor_encoder_close_container( &pxEncoder->xCbor[ pxEncoder->ulDepth ],
+                                                               &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ] ) );
+        pxEncoder->ulDepth--;
+    }
+    else
+    {
+        prvJsonAppend( pxEncoder, "}", 1 );
+        pxEncoder->ulDepth--;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryAddInt( TelemetryEncoder_t * pxEncoder,
+                       const char * pcKey,
+                       int32_t lValue )
+{
+    if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborKey( pxEncoder, pcKey );
+        prvCborCheck( pxEncoder, cbor_encode_int( &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ], lValue ) );
+    }
+    else
+    {
+        prvJsonKey( pxEncoder, pcKey );
+
+        if( lValue < 0 )
+        {
+            prvJsonAppend( pxEncoder, "-", 1 );
+        }
+
+        prvJsonAppendDecimal( pxEncoder, ( lValue < 0 ) ? ( uint64_t ) -( int64_t ) lValue : ( uint64_t ) lValue, 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryAddUint( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey,
+                        uint32_t ulValue )
+{
+    if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborKey( pxEncoder, pcKey );
+        prvCborCheck( pxEncoder, cbor_encode_uint( &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ], ulValue ) );
+    }
+    else
+    {
+        prvJsonKey( pxEncoder, pcKey );
+        prvJsonAppendDecimal( pxEncoder, ulValue, 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryAddFloat( TelemetryEncoder_t * pxEncoder,
+                         const char * pcKey,
+                         float fValue,
+                         uint32_t ulDecimals )
+{
+    if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborKey( pxEncoder, pcKey );
+        prvCborCheck( pxEncoder, cbor_encode_float( &pxEncoder->xCbor[ pxEncoder->ulDepth + 1 ], fValue ) );
+    }
+    else
+    {
+        prvJsonKey( pxEncoder, pcKey );
+
+        if( ulDecimals > TELEMETRY_MAX_DECIMALS )
+        {
+            ulDecimals = TELEMETRY_MAX_DECIMALS;
+        }
+
+        /* JSON has no NaN or infinity, and values beyond 1e12 are not expected from a sensor */
+        if( ( __builtin_isfinite( fValue ) == 0 ) || ( fValue > 1e12f ) || ( fValue < -1e12f ) )
+        {
+            prvJsonAppend( pxEncoder, "null", 4 );
+        }
+        else
+        {
+            float fScaled = fValue * ( float ) ulPow10[ ulDecimals ];
+            uint64_t ullScaled;
+
+            if( fScaled < 0.0f )
+            {
+                ullScaled = ( uint64_t ) ( 0.5f - fScaled );
+            }
+            else
+            {
+                ullScaled = ( uint64_t ) ( fScaled + 0.5f );
+            }
+
+            /* No "-0" for small negative values rounded to 0 */
+            if( ( fScaled < 0.0f ) && ( ullScaled > 0 ) )
+            {
+                prvJsonAppend( pxEncoder, "-", 1 );
+            }
+
+            prvJsonAppendDecimal( pxEncoder, ullScaled / ulPow10[ ulDecimals ], 1 );
+
+            if( ulDecimals > 0 )
+            {
+                prvJsonAppend( pxEncoder, ".", 1 );
+                prvJsonAppendDecimal( pxEncoder, ullScaled % ulPow10[ ulDecimals ], ulDecimals );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xTelemetryEnd( TelemetryEncoder_t * pxEncoder )
+{
+    size_t xLen = 0;
+
+    if( pxEncoder->ulDepth != 0 )
+    {
+        pxEncoder->xError = pdTRUE;
+    }
+    else if( pxEncoder->xFormat == TELEMETRY_FORMAT_CBOR )
+    {
+        prvCborCheck( pxEncoder, cbor_encoder_close_container( &pxEncoder->xCbor[ 0 ], &pxEncoder->xCbor[ 1 ] ) );
+        xLen = cbor_encoder_get_buffer_size( &pxEncoder->xCbor[ 0 ], pxEncoder->pucBuffer );
+    }
+    else
+    {
+        prvJsonAppend( pxEncoder, "}", 1 );
+        xLen = pxEncoder->xLen;
+
+        if( pxEncoder->xError == pdFALSE )
+        {
+            pxEncoder->pucBuffer[ xLen ] = '\0';
+        }
+    }
+
+    if( pxEncoder->xError != pdFALSE )
+    {
+        xLen = 0;
+    }
+
+    return xLen;
+}
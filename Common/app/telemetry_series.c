@@ -0,0 +1,253 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+#include <math.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "telemetry_series.h"
+
+#define TELEMETRY_SERIES_MAX_DECIMALS    6
+#define TELEMETRY_SERIES_MAX_SAMPLES     0xFFFFU
+
+static const uint32_t ulPow10[ TELEMETRY_SERIES_MAX_DECIMALS + 1 ] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+/*-----------------------------------------------------------*/
+
+static void prvPutLe( uint8_t * pucDest,
+                      uint32_t ulValue,
+                      size_t xLen )
+{
+    for( size_t i = 0; i < xLen; i++ )
+    {
+        pucDest[ i ] = ( uint8_t ) ( ulValue >> ( 8 * i ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Write the low ulCount bits of ulBits, or set xError if they do not fit */
+static void prvPutBits( TelemetrySeries_t * pxSeries,
+                        uint32_t ulBits,
+                        uint32_t ulCount )
+{
+    size_t xHeaderLen = TELEMETRY_SERIES_HEADER_LEN( pxSeries->ulChannels );
+    uint8_t * pucStream = &pxSeries->pucBuffer[ xHeaderLen ];
+
+    if( ( pxSeries->xError == pdFALSE ) &&
+        ( ( pxSeries->xBitLen + ulCount ) <= ( ( pxSeries->xBufferLen - xHeaderLen ) * 8 ) ) )
+    {
+        for( uint32_t i = ulCount; i > 0; i-- )
+        {
+            size_t xByte = pxSeries->xBitLen / 8;
+            uint32_t ulShift = 7 - ( uint32_t ) ( pxSeries->xBitLen % 8 );
+
+            if( ulShift == 7 )
+            {
+                pucStream[ xByte ] = 0;
+            }
+
+            pucStream[ xByte ] |= ( uint8_t ) ( ( ( ulBits >> ( i - 1 ) ) & 1U ) << ulShift );
+            pxSeries->xBitLen++;
+        }
+    }
+    else
+    {
+        pxSeries->xError = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Zigzag the difference ulDiff, taken modulo 2^32, and write it with its prefix */
+static void prvPutDiff( TelemetrySeries_t * pxSeries,
+                        uint32_t ulDiff )
+{
+    uint32_t ulZigzag = ( ulDiff << 1 ) ^ ( 0U - ( ulDiff >> 31 ) );
+
+    if( ulZigzag == 0 )
+    {
+        prvPutBits( pxSeries, 0x0, 1 );
+    }
+    else if( ulZigzag < ( 1UL << 7 ) )
+    {
+        prvPutBits( pxSeries, 0x2, 2 );
+        prvPutBits( pxSeries, ulZigzag, 7 );
+    }
+    else if( ulZigzag < ( 1UL << 12 ) )
+    {
+        prvPutBits( pxSeries, 0x6, 3 );
+        prvPutBits( pxSeries, ulZigzag, 12 );
+    }
+    else if( ulZigzag < ( 1UL << 20 ) )
+    {
+        prvPutBits( pxSeries, 0xE, 4 );
+        prvPutBits( pxSeries, ulZigzag, 20 );
+    }
+    else
+    {
+        prvPutBits( pxSeries, 0xF, 4 );
+        prvPutBits( pxSeries, ulZigzag, 32 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetrySeriesBegin( TelemetrySeries_t * pxSeries,
+                            uint8_t * pucBuffer,
+                            size_t xBufferLen,
+                            uint32_t ulChannels,
+                            const uint8_t * pucDecimals,
+                            uint32_t ulTimeUnitMs )
+{
+    configASSERT( pxSeries != NULL );
+    configASSERT( pucBuffer != NULL );
+    configASSERT( pucDecimals != NULL );
+    configASSERT( ( ulChannels > 0 ) && ( ulChannels <= TELEMETRY_SERIES_MAX_CHANNELS ) );
+    configASSERT( xBufferLen > TELEMETRY_SERIES_HEADER_LEN( ulChannels ) );
+    configASSERT( ( ulTimeUnitMs > 0 ) && ( ulTimeUnitMs <= UINT16_MAX ) );
+
+    ( void ) memset( pxSeries, 0, sizeof( TelemetrySeries_t ) );
+
+    pxSeries->pucBuffer = pucBuffer;
+    pxSeries->xBufferLen = xBufferLen;
+    pxSeries->ulChannels = ulChannels;
+    pxSeries->ulTimeUnitMs = ulTimeUnitMs;
+
+    pucBuffer[ 0 ] = TELEMETRY_SERIES_VERSION;
+    pucBuffer[ 1 ] = ( uint8_t ) ulChannels;
+    prvPutLe( &pucBuffer[ 2 ], 0, 2 );
+    prvPutLe( &pucBuffer[ 4 ], ulTimeUnitMs, 2 );
+    prvPutLe( &pucBuffer[ 6 ], 0, 4 );
+
+    for( uint32_t i = 0; i < ulChannels; i++ )
+    {
+        configASSERT( pucDecimals[ i ] <= TELEMETRY_SERIES_MAX_DECIMALS );
+        pucBuffer[ 10 + i ] = pucDecimals[ i ];
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTelemetrySeriesAdd( TelemetrySeries_t * pxSeries,
+                                uint32_t ulTimeMs,
+                                const int32_t * plValues )
+{
+    uint32_t ulTime = ( ulTimeMs + ( pxSeries->ulTimeUnitMs / 2 ) ) / pxSeries->ulTimeUnitMs;
+    uint32_t ulDelta = ulTime - pxSeries->ulLastTime;
+    size_t xBitLen = pxSeries->xBitLen;
+
+    configASSERT( plValues != NULL );
+
+    pxSeries->xError = ( pxSeries->ulSamples < TELEMETRY_SERIES_MAX_SAMPLES ) ? pdFALSE : pdTRUE;
+
+    if( pxSeries->ulSamples > 0 )
+    {
+        prvPutDiff( pxSeries, ulDelta - pxSeries->ulLastDelta );
+    }
+
+    for( uint32_t i = 0; i < pxSeries->ulChannels; i++ )
+    {
+        prvPutDiff( pxSeries, ( uint32_t ) plValues[ i ] - ( uint32_t ) pxSeries->lLast[ i ] );
+    }
+
+    if( pxSeries->xError == pdFALSE )
+    {
+        if( pxSeries->ulSamples == 0 )
+        {
+            prvPutLe( &pxSeries->pucBuffer[ 6 ], ulTime, 4 );
+        }
+        else
+        {
+            pxSeries->ulLastDelta = ulDelta;
+        }
+
+        pxSeries->ulLastTime = ulTime;
+        ( void ) memcpy( pxSeries->lLast, plValues, pxSeries->ulChannels * sizeof( int32_t ) );
+        pxSeries->ulSamples++;
+    }
+    else
+    {
+        /* Drop the bits of the sample, the bytes after the last full one are zeroed when reused */
+        uint8_t * pucStream = &pxSeries->pucBuffer[ TELEMETRY_SERIES_HEADER_LEN( pxSeries->ulChannels ) ];
+
+        pxSeries->xBitLen = xBitLen;
+
+        if( ( xBitLen % 8 ) != 0 )
+        {
+            pucStream[ xBitLen / 8 ] &= ( uint8_t ) ( 0xFFU << ( 8 - ( xBitLen % 8 ) ) );
+        }
+    }
+
+    return( ( pxSeries->xError == pdFALSE ) ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xTelemetrySeriesEnd( TelemetrySeries_t * pxSeries )
+{
+    size_t xLen = 0;
+
+    if( pxSeries->ulSamples > 0 )
+    {
+        prvPutLe( &pxSeries->pucBuffer[ 2 ], pxSeries->ulSamples, 2 );
+        xLen = TELEMETRY_SERIES_HEADER_LEN( pxSeries->ulChannels ) + ( ( pxSeries->xBitLen + 7 ) / 8 );
+    }
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lTelemetrySeriesScale( float fValue,
+                               uint32_t ulDecimals )
+{
+    float fScaled = 0.0f;
+    int32_t lValue = 0;
+
+    configASSERT( ulDecimals <= TELEMETRY_SERIES_MAX_DECIMALS );
+
+    fScaled = fValue * ( float ) ulPow10[ ulDecimals ];
+
+    if( isnan( fScaled ) )
+    {
+        lValue = 0;
+    }
+    else if( fScaled >= 2147483648.0f )
+    {
+        lValue = INT32_MAX;
+    }
+    else if( fScaled <= -2147483648.0f )
+    {
+        lValue = INT32_MIN;
+    }
+    else
+    {
+        lValue = ( int32_t ) lroundf( fScaled );
+    }
+
+    return lValue;
+}
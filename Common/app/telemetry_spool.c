@@ -0,0 +1,393 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include "telemetry_spool.h"
+
+#if ( TELEMETRY_SPOOL_ENABLED == 1 )
+
+/* Standard includes. */
+    #include <string.h>
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <assert.h>
+
+/* Kernel includes. */
+    #include "FreeRTOS.h"
+    #include "task.h"
+
+    #include "lfs.h"
+    #include "fs/lfs_port.h"
+
+    #define SPOOL_RECORD_MAGIC    ( 0x5354U )
+    #define SPOOL_PATH_LEN        ( sizeof( TELEMETRY_SPOOL_DIR ) + 10 )
+
+/* Followed by ucTopicLen bytes of topic name and usPayloadLen bytes of payload */
+    typedef struct
+    {
+        uint16_t usMagic;
+        uint8_t ucQoS;
+        uint8_t ucTopicLen;
+        uint16_t usPayloadLen;
+    } SpoolRecordHeader_t;
+
+    #define SPOOL_RECORD_MAX_LEN    ( sizeof( SpoolRecordHeader_t ) + TELEMETRY_SPOOL_TOPIC_LEN + TELEMETRY_SPOOL_PAYLOAD_LEN )
+
+    static_assert( TELEMETRY_SPOOL_TOPIC_LEN <= UINT8_MAX, "TELEMETRY_SPOOL_TOPIC_LEN must fit in ucTopicLen" );
+    static_assert( TELEMETRY_SPOOL_WRITE_BUF_LEN >= SPOOL_RECORD_MAX_LEN, "The staging buffer must hold the largest record" );
+    static_assert( TELEMETRY_SPOOL_SEGMENT_SIZE >= TELEMETRY_SPOOL_WRITE_BUF_LEN, "A segment must hold the staging buffer" );
+
+/* Segments from ulHeadSeq to ulTailSeq exist, those in between are full */
+    static uint32_t ulHeadSeq = 0;
+    static uint32_t ulTailSeq = 0;
+    static lfs_soff_t xHeadOffset = 0; /* Read position in the head segment */
+    static lfs_soff_t xTailSize = 0;
+
+    static uint8_t pucStage[ TELEMETRY_SPOOL_WRITE_BUF_LEN ];
+    static size_t uxStageLen = 0;
+
+    static uint8_t pucRecord[ SPOOL_RECORD_MAX_LEN ];
+
+    static BaseType_t xSpoolReady = pdFALSE;
+
+    static TelemetrySpoolStats_t xSpoolStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+    static void prvSegmentPath( char * pcPath,
+                                uint32_t ulSeq )
+    {
+        ( void ) snprintf( pcPath, SPOOL_PATH_LEN, TELEMETRY_SPOOL_DIR "/%08lx", ( unsigned long ) ulSeq );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvRemoveSegment( lfs_t * pLfsCtx,
+                                  uint32_t ulSeq )
+    {
+        char pcPath[ SPOOL_PATH_LEN ];
+
+        prvSegmentPath( pcPath, ulSeq );
+
+        if( lfs_remove( pLfsCtx, pcPath ) != LFS_ERR_OK )
+        {
+            xSpoolStats.ulErrors++;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Drop the head segment, keeping the tail segment number once the spool is empty */
+    static void prvAdvanceHead( lfs_t * pLfsCtx )
+    {
+        prvRemoveSegment( pLfsCtx, ulHeadSeq );
+
+        if( ulHeadSeq == ulTailSeq )
+        {
+            xTailSize = 0;
+        }
+        else
+        {
+            ulHeadSeq++;
+        }
+
+        xHeadOffset = 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Write the staging buffer to the tail segment in one file commit */
+    static void prvFlushStage( lfs_t * pLfsCtx )
+    {
+        char pcPath[ SPOOL_PATH_LEN ];
+        lfs_file_t xFile = { 0 };
+        lfs_ssize_t lReturn;
+
+        if( ( xTailSize + ( lfs_soff_t ) uxStageLen ) > TELEMETRY_SPOOL_SEGMENT_SIZE )
+        {
+            ulTailSeq++;
+            xTailSize = 0;
+
+            if( ( ulTailSeq - ulHeadSeq ) >= TELEMETRY_SPOOL_SEGMENTS )
+            {
+                LogWarn( "Telemetry spool full, dropping segment %lu.", ulHeadSeq );
+                prvAdvanceHead( pLfsCtx );
+                xSpoolStats.ulDroppedSegments++;
+            }
+        }
+
+        prvSegmentPath( pcPath, ulTailSeq );
+
+        lReturn = lfs_file_open( pLfsCtx, &xFile, pcPath, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_file_write( pLfsCtx, &xFile, pucStage, uxStageLen );
+
+            if( lfs_file_close( pLfsCtx, &xFile ) != LFS_ERR_OK )
+            {
+                lReturn = LFS_ERR_IO;
+            }
+        }
+
+        if( lReturn == ( lfs_ssize_t ) uxStageLen )
+        {
+            xTailSize += ( lfs_soff_t ) uxStageLen;
+            xSpoolStats.ulFlashWrites++;
+        }
+        else
+        {
+            LogError( "Failed to write %u bytes to %s: %d.", uxStageLen, pcPath, lReturn );
+            xSpoolStats.ulErrors++;
+        }
+
+        /* Records which could not be written are lost rather than retried forever */
+        uxStageLen = 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t xTelemetrySpoolInit( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        lfs_dir_t xDir = { 0 };
+        struct lfs_info xInfo = { 0 };
+        BaseType_t xFound = pdFALSE;
+        int lError;
+
+        lError = lfs_mkdir( pLfsCtx, TELEMETRY_SPOOL_DIR );
+
+        if( ( lError == LFS_ERR_OK ) || ( lError == LFS_ERR_EXIST ) )
+        {
+            lError = lfs_dir_open( pLfsCtx, &xDir, TELEMETRY_SPOOL_DIR );
+        }
+
+        if( lError == LFS_ERR_OK )
+        {
+            while( lfs_dir_read( pLfsCtx, &xDir, &xInfo ) > 0 )
+            {
+                char * pcEnd = NULL;
+                uint32_t ulSeq = ( uint32_t ) strtoul( xInfo.name, &pcEnd, 16 );
+
+                if( ( xInfo.type == LFS_TYPE_REG ) && ( pcEnd != xInfo.name ) && ( *pcEnd == '\0' ) )
+                {
+                    if( ( xFound == pdFALSE ) || ( ulSeq < ulHeadSeq ) )
+                    {
+                        ulHeadSeq = ulSeq;
+                    }
+
+                    if( ( xFound == pdFALSE ) || ( ulSeq >= ulTailSeq ) )
+                    {
+                        ulTailSeq = ulSeq;
+                        xTailSize = ( lfs_soff_t ) xInfo.size;
+                    }
+
+                    xFound = pdTRUE;
+                }
+            }
+
+            ( void ) lfs_dir_close( pLfsCtx, &xDir );
+
+            xHeadOffset = 0;
+            xSpoolReady = pdTRUE;
+
+            if( xFound == pdTRUE )
+            {
+                LogInfo( "Telemetry spool holds segments %lu to %lu.", ulHeadSeq, ulTailSeq );
+            }
+        }
+        else
+        {
+            LogError( "Failed to open the telemetry spool directory: %d.", lError );
+        }
+
+        return xSpoolReady;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t xTelemetrySpoolAppend( const char * pcTopic,
+                                      const void * pvPayload,
+                                      size_t uxPayloadLen,
+                                      MQTTQoS_t xQoS )
+    {
+        size_t uxTopicLen = strnlen( pcTopic, TELEMETRY_SPOOL_TOPIC_LEN + 1U );
+        SpoolRecordHeader_t xHeader =
+        {
+            .usMagic      = SPOOL_RECORD_MAGIC,
+            .ucQoS        = ( uint8_t ) xQoS,
+            .ucTopicLen   = ( uint8_t ) uxTopicLen,
+            .usPayloadLen = ( uint16_t ) uxPayloadLen
+        };
+        size_t uxRecordLen = sizeof( xHeader ) + uxTopicLen + uxPayloadLen;
+        BaseType_t xResult = pdFALSE;
+
+        if( xSpoolReady == pdFALSE )
+        {
+            /* Not initialized, or the directory could not be opened */
+        }
+        else if( ( uxTopicLen > TELEMETRY_SPOOL_TOPIC_LEN ) || ( uxPayloadLen > TELEMETRY_SPOOL_PAYLOAD_LEN ) )
+        {
+            xSpoolStats.ulRejected++;
+        }
+        else
+        {
+            if( ( uxStageLen + uxRecordLen ) > sizeof( pucStage ) )
+            {
+                prvFlushStage( pxGetDefaultFsCtx() );
+            }
+
+            ( void ) memcpy( &( pucStage[ uxStageLen ] ), &xHeader, sizeof( xHeader ) );
+            ( void ) memcpy( &( pucStage[ uxStageLen + sizeof( xHeader ) ] ), pcTopic, uxTopicLen );
+            ( void ) memcpy( &( pucStage[ uxStageLen + sizeof( xHeader ) + uxTopicLen ] ), pvPayload, uxPayloadLen );
+            uxStageLen += uxRecordLen;
+
+            xSpoolStats.ulAppended++;
+            xResult = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t xTelemetrySpoolIsEmpty( void )
+    {
+        return( ( ulHeadSeq == ulTailSeq ) && ( xHeadOffset >= xTailSize ) && ( uxStageLen == 0U ) ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t uxTelemetrySpoolDrain( size_t uxMaxRecords,
+                                  TelemetrySpoolDrainCallback_t pxCallback,
+                                  void * pvCtx )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        size_t uxCount = 0;
+        BaseType_t xStop = ( xSpoolReady == pdTRUE ) ? pdFALSE : pdTRUE;
+
+        if( ( xStop == pdFALSE ) && ( uxStageLen > 0U ) )
+        {
+            prvFlushStage( pLfsCtx );
+        }
+
+        while( ( xStop == pdFALSE ) && ( uxCount < uxMaxRecords ) && ( xTelemetrySpoolIsEmpty() == pdFALSE ) )
+        {
+            char pcPath[ SPOOL_PATH_LEN ];
+            lfs_file_t xFile = { 0 };
+            BaseType_t xSegmentDone = pdFALSE;
+
+            prvSegmentPath( pcPath, ulHeadSeq );
+
+            if( lfs_file_open( pLfsCtx, &xFile, pcPath, LFS_O_RDONLY ) != LFS_ERR_OK )
+            {
+                /* Skip a segment which cannot be read */
+                xSpoolStats.ulErrors++;
+                prvAdvanceHead( pLfsCtx );
+                continue;
+            }
+
+            if( lfs_file_seek( pLfsCtx, &xFile, xHeadOffset, LFS_SEEK_SET ) != xHeadOffset )
+            {
+                xSpoolStats.ulErrors++;
+                xSegmentDone = pdTRUE;
+            }
+
+            while( ( xStop == pdFALSE ) && ( xSegmentDone == pdFALSE ) && ( uxCount < uxMaxRecords ) )
+            {
+                SpoolRecordHeader_t * pxHeader = ( SpoolRecordHeader_t * ) pucRecord;
+                size_t uxBodyLen = 0;
+                lfs_ssize_t lRead = lfs_file_read( pLfsCtx, &xFile, pxHeader, sizeof( SpoolRecordHeader_t ) );
+
+                if( ( lRead == ( lfs_ssize_t ) sizeof( SpoolRecordHeader_t ) ) &&
+                    ( pxHeader->usMagic == SPOOL_RECORD_MAGIC ) &&
+                    ( pxHeader->ucTopicLen <= TELEMETRY_SPOOL_TOPIC_LEN ) &&
+                    ( pxHeader->usPayloadLen <= TELEMETRY_SPOOL_PAYLOAD_LEN ) )
+                {
+                    uxBodyLen = ( size_t ) pxHeader->ucTopicLen + pxHeader->usPayloadLen;
+                    lRead = lfs_file_read( pLfsCtx, &xFile, &( pucRecord[ sizeof( SpoolRecordHeader_t ) ] ), uxBodyLen );
+                }
+                else
+                {
+                    /* End of the segment, or a record which does not parse and ends it */
+                    if( lRead != 0 )
+                    {
+                        LogError( "Discarding the rest of telemetry spool segment %lu.", ulHeadSeq );
+                        xSpoolStats.ulErrors++;
+                    }
+
+                    lRead = -1;
+                }
+
+                if( lRead != ( lfs_ssize_t ) uxBodyLen )
+                {
+                    xSegmentDone = pdTRUE;
+                }
+                else if( pxCallback( pvCtx,
+                                     ( const char * ) &( pucRecord[ sizeof( SpoolRecordHeader_t ) ] ),
+                                     pxHeader->ucTopicLen,
+                                     &( pucRecord[ sizeof( SpoolRecordHeader_t ) + pxHeader->ucTopicLen ] ),
+                                     pxHeader->usPayloadLen,
+                                     ( MQTTQoS_t ) pxHeader->ucQoS ) == pdTRUE )
+                {
+                    xHeadOffset += ( lfs_soff_t ) ( sizeof( SpoolRecordHeader_t ) + uxBodyLen );
+                    xSpoolStats.ulDrained++;
+                    uxCount++;
+                }
+                else
+                {
+                    xStop = pdTRUE;
+                }
+            }
+
+            ( void ) lfs_file_close( pLfsCtx, &xFile );
+
+            if( xSegmentDone == pdTRUE )
+            {
+                prvAdvanceHead( pLfsCtx );
+            }
+        }
+
+        return uxCount;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vTelemetrySpoolGetStats( TelemetrySpoolStats_t * pxStats )
+    {
+        taskENTER_CRITICAL();
+        *pxStats = xSpoolStats;
+        taskEXIT_CRITICAL();
+    }
+
+#endif /* TELEMETRY_SPOOL_ENABLED == 1 */
@@ -0,0 +1,1957 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "stm32u5xx.h"
+#include "hw_defs.h"
+
+#include "kvstore.h"
+#include "mqtt_metrics.h"
+#include "mbedtls_transport.h"
+#include "mqtt_bench.h"
+#include "micro_bench.h"
+#include "printf_lite.h"
+#include "telemetry_encode.h"
+
+#include "lwip/inet_chksum.h"
+#include "mx_ipc.h"
+
+#include "mbedtls/gcm.h"
+#include "mbedtls/sha256.h"
+
+#ifdef MBEDTLS_TRANSPORT_PSA
+#include "psa/crypto.h"
+#endif
+
+#if defined( MBEDTLS_ECDSA_SIGN_ALT ) && defined( MBEDTLS_ECDSA_VERIFY_ALT ) && \
+    defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT ) && defined( MBEDTLS_ECDH_COMPUTE_SHARED_ALT )
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "pka_stm32.h"
+#define BENCH_CLI_ECC    1
+#endif
+
+#if ( KV_STORE_NVIMPL_LITTLEFS == 1 ) || ( KV_STORE_NVIMPL_LITTLEFS_LOG == 1 )
+/* Reflected CRC-32 of the littlefs port, computed by the CRC unit unless LFS_CRC_USE_HW is 0 */
+uint32_t lfs_crc( uint32_t crc,
+                  const void * buffer,
+                  size_t size );
+#define BENCH_CLI_LFS_CRC    1
+#endif
+
+/* Names of the paths taken by mbedtls_gcm_* and mbedtls_sha256_* in this build */
+#if defined( MBEDTLS_GCM_ALT )
+#define BENCH_CLI_GCM_PATH       "cryp"
+#else
+#define BENCH_CLI_GCM_PATH       "software"
+#endif
+
+#if defined( MBEDTLS_SHA256_ALT )
+#define BENCH_CLI_SHA256_PATH    "hash"
+#else
+#define BENCH_CLI_SHA256_PATH    "software"
+#endif
+
+/* Default and maximum payload length and iteration count of the "bench crypto" throughput tests */
+#define BENCH_CLI_LEN               4096U
+#define BENCH_CLI_MAX_LEN           32768U
+#define BENCH_CLI_ITER              8U
+
+/* Default and maximum number of public key operations of each kind run by "bench crypto" */
+#define BENCH_CLI_ECC_ITER          4U
+#define BENCH_CLI_ECC_MAX_ITER      64U
+
+/* Default and maximum number of connections made by "bench handshake" for each path */
+#define BENCH_CLI_HS_ITER           2U
+#define BENCH_CLI_HS_MAX_ITER       16U
+
+/* Default number of messages sent by "bench mqtt" for each payload length */
+#define BENCH_CLI_MQTT_MESSAGES     200U
+
+/* Default and maximum amount of data streamed by "bench tcp", in KiB */
+#define BENCH_CLI_TCP_KBYTES        256U
+#define BENCH_CLI_TCP_MAX_KBYTES    16384U
+
+/* Default and maximum length of each "bench tcp" write, at most one TLS record */
+#define BENCH_CLI_TCP_CHUNK         1024U
+#define BENCH_CLI_TCP_MAX_CHUNK     4096U
+
+/* Chunks written ahead of the data read back in "bench tcp" echo mode. Must fit in TCP_WND. */
+#define BENCH_CLI_TCP_WINDOW        2U
+
+/* Send and receive timeout of "bench tcp", a stalled server ends the run */
+#define BENCH_CLI_TCP_TIMEOUT_MS    5000U
+
+/* Input length of the "bench micro" throughput kernels, and the default warm-up and timed calls */
+#define BENCH_CLI_MICRO_LEN         1024U
+#define BENCH_CLI_MICRO_WARMUP      4U
+#define BENCH_CLI_MICRO_RUNS        32U
+
+#define BENCH_CLI_GCM_TAG_LEN       16U
+
+/* Default and maximum number of runs of each kernel by "bench cache", for each cache profile */
+#define BENCH_CLI_CACHE_ITER        4U
+#define BENCH_CLI_CACHE_MAX_ITER    64U
+
+/* Size of the "bench cache" list and matrix kernels, which must fit in BENCH_CLI_LEN bytes */
+#define BENCH_CLI_LIST_LEN          64U
+#define BENCH_CLI_MATRIX_N          16U
+
+/* Common shape of the functions timed by the throughput tests */
+typedef int (* BenchFunc_t)( void * pvCtx,
+                             const uint8_t * pucIn,
+                             uint8_t * pucOut,
+                             size_t uxLen );
+
+/* Send and receive functions of a "bench tcp" path, with the transport return convention */
+typedef int32_t (* BenchStreamSend_t)( void * pvCtx,
+                                       const void * pvBuf,
+                                       size_t uxLen );
+
+typedef int32_t (* BenchStreamRecv_t)( void * pvCtx,
+                                       void * pvBuf,
+                                       size_t uxLen );
+
+typedef struct BenchStreamResult
+{
+    uint32_t ulTxBytes;
+    uint32_t ulRxBytes;
+    uint64_t ullTxUs;       /* From the first write to the end of the last one */
+    uint64_t ullRxUs;       /* From the first write to the end of the last read */
+    uint32_t ulRunTime;     /* Run time counter ticks elapsed, and those spent in the idle task */
+    uint32_t ulIdleTime;
+} BenchStreamResult_t;
+
+/* A throughput test function run by a micro-benchmark kernel over BENCH_CLI_MICRO_LEN bytes */
+typedef struct BenchMicroFunc
+{
+    BenchFunc_t xFunc;
+    void * pvFuncCtx;
+} BenchMicroFunc_t;
+
+typedef struct BenchMicroRun
+{
+    ConsoleIO_t * pxCIO;
+    const char * pcName; /* NULL to run every kernel */
+    uint32_t ulRuns;
+    uint32_t ulMatches;
+} BenchMicroRun_t;
+
+static void vBenchCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_bench =
+{
+    "bench",
+    "bench\r\n"
+    "    bench crypto [LENGTH] [ITERATIONS]\r\n"
+    "        Report the cycles per byte of AES-128-GCM, SHA-256 and CRC-32 over LENGTH\r\n"
+    "        bytes (default 4096) and the P-256 ECDSA and ECDH operations per second\r\n"
+    "        (default 4 iterations), for each path available in this build.\r\n"
+    "    bench handshake [ITERATIONS]\r\n"
+    "        Connect ITERATIONS times (default 2) to the configured MQTT endpoint and\r\n"
+    "        report the TLS connection time, with the PKA and with the software ECC.\r\n"
+    "    bench mqtt [MESSAGES] [QOS] [LENGTH]\r\n"
+    "        Publish MESSAGES messages (default 200) with QOS 0 or 1 (default 0) to a\r\n"
+    "        loopback topic and report the messages per second, the goodput and the round\r\n"
+    "        trip percentiles. Without LENGTH, sweep the payload length up to the MQTT agent\r\n"
+    "        network buffer size.\r\n"
+    "    bench tcp plain|tls HOST PORT [sink|echo] [KBYTES] [CHUNK]\r\n"
+    "        Stream KBYTES KiB (default 256) in CHUNK byte writes (default 1024, at most\r\n"
+    "        4096) to a sink server, or to an echo server and read it back, over a plain\r\n"
+    "        TCP socket or a TLS connection. Report the TX and RX Mbps and the busy CPU\r\n"
+    "        cycles per record. The TLS server certificate must chain to the root CA. In an\r\n"
+    "        MX_NET_OFFLOAD build, plain runs on the sockets of the WiFi module's stack.\r\n"
+    "    bench micro [NAME|all] [RUNS]\r\n"
+    "        Time RUNS calls (default 32, at most 64) of each registered micro-benchmark\r\n"
+    "        kernel, or of kernel NAME, after a warm-up, and print the minimum, median and\r\n"
+    "        maximum DWT cycles as CSV.\r\n"
+    "    bench cache [ITERATIONS]\r\n"
+    "        Run CoreMark style kernels and the crypto functions ITERATIONS times (default 4)\r\n"
+    "        with each ICACHE / DCACHE1 profile and report the cycles and the cache monitor\r\n"
+    "        hit rates, then restore the current profile. DCACHE1 only sees OCTOSPI reads.\r\n\n",
+    vBenchCommand
+};
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Run xFunc BENCH_CLI_ITER times on uxLength bytes and print the average number
+ * of DWT cycles per byte and the resulting throughput.
+ */
+static int prvBenchThroughput( ConsoleIO_t * const pxCIO,
+                               const char * pcAlgorithm,
+                               const char * pcPath,
+                               BenchFunc_t xFunc,
+                               void * pvCtx,
+                               const uint8_t * pucIn,
+                               uint8_t * pucOut,
+                               size_t uxLength )
+{
+    uint64_t ullTotal = 0;
+    int lRslt = 0;
+
+    for( uint32_t i = 0; ( i < BENCH_CLI_ITER ) && ( lRslt == 0 ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lRslt = xFunc( pvCtx, pucIn, pucOut, uxLength );
+
+        ullTotal += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+    }
+
+    if( lRslt != 0 )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %-10s failed: -0x%04lx\r\n",
+                           pcAlgorithm, pcPath, ( uint32_t ) -lRslt );
+    }
+    else
+    {
+        uint32_t ulCpbX100 = ( uint32_t ) ( ( ullTotal * 100U ) / ( ( uint64_t ) uxLength * BENCH_CLI_ITER ) );
+        uint32_t ulKBps = ( ullTotal == 0 ) ? 0 :
+                          ( uint32_t ) ( ( ( uint64_t ) SystemCoreClock * uxLength * BENCH_CLI_ITER ) /
+                                         ( ullTotal * 1024U ) );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %-10s %6lu.%02lu %8lu\r\n",
+                           pcAlgorithm, pcPath,
+                           ulCpbX100 / 100U, ulCpbX100 % 100U, ulKBps );
+    }
+
+    pxCIO->print( pcCliScratchBuffer );
+
+    return lRslt;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvGcmEncrypt( void * pvCtx,
+                          const uint8_t * pucIn,
+                          uint8_t * pucOut,
+                          size_t uxLen )
+{
+    static const uint8_t ucIv[ 12 ] = { 0 };
+
+    return mbedtls_gcm_crypt_and_tag( ( mbedtls_gcm_context * ) pvCtx, MBEDTLS_GCM_ENCRYPT, uxLen,
+                                      ucIv, sizeof( ucIv ), NULL, 0,
+                                      pucIn, pucOut, BENCH_CLI_GCM_TAG_LEN, &( pucOut[ uxLen ] ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvSha256( void * pvCtx,
+                      const uint8_t * pucIn,
+                      uint8_t * pucOut,
+                      size_t uxLen )
+{
+    ( void ) pvCtx;
+
+    return mbedtls_sha256( pucIn, uxLen, pucOut, 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reflected CRC-32 (polynomial 0xEDB88320), four bits at a time */
+static int prvCrc32Software( void * pvCtx,
+                             const uint8_t * pucIn,
+                             uint8_t * pucOut,
+                             size_t uxLen )
+{
+    static const uint32_t ulCrcNibbleTable[ 16 ] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t ulCrc = 0xFFFFFFFF;
+
+    ( void ) pvCtx;
+
+    for( size_t i = 0; i < uxLen; i++ )
+    {
+        ulCrc ^= pucIn[ i ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulCrcNibbleTable[ ulCrc & 0xF ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulCrcNibbleTable[ ulCrc & 0xF ];
+    }
+
+    ( void ) memcpy( pucOut, &ulCrc, sizeof( ulCrc ) );
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef BENCH_CLI_LFS_CRC
+    static int prvCrc32Lfs( void * pvCtx,
+                            const uint8_t * pucIn,
+                            uint8_t * pucOut,
+                            size_t uxLen )
+    {
+        uint32_t ulCrc = lfs_crc( 0xFFFFFFFF, pucIn, uxLen );
+
+        ( void ) pvCtx;
+
+        ( void ) memcpy( pucOut, &ulCrc, sizeof( ulCrc ) );
+
+        return 0;
+    }
+#endif /* BENCH_CLI_LFS_CRC */
+
+/*-----------------------------------------------------------*/
+
+#ifdef MBEDTLS_TRANSPORT_PSA
+
+/* AES-GCM and SHA-256 of the TF-M crypto service, including the secure call */
+    static int prvPsaGcmEncrypt( void * pvCtx,
+                                 const uint8_t * pucIn,
+                                 uint8_t * pucOut,
+                                 size_t uxLen )
+    {
+        static const uint8_t ucIv[ 12 ] = { 0 };
+        size_t uxOutLen = 0;
+
+        return ( int ) psa_aead_encrypt( *( ( psa_key_id_t * ) pvCtx ), PSA_ALG_GCM,
+                                         ucIv, sizeof( ucIv ), NULL, 0,
+                                         pucIn, uxLen,
+                                         pucOut, uxLen + BENCH_CLI_GCM_TAG_LEN, &uxOutLen );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int prvPsaSha256( void * pvCtx,
+                             const uint8_t * pucIn,
+                             uint8_t * pucOut,
+                             size_t uxLen )
+    {
+        size_t uxHashLen = 0;
+
+        ( void ) pvCtx;
+
+        return ( int ) psa_hash_compute( PSA_ALG_SHA_256, pucIn, uxLen, pucOut, 32, &uxHashLen );
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_TRANSPORT_PSA */
+
+static void vBenchSymmetric( ConsoleIO_t * const pxCIO,
+                             size_t uxLength )
+{
+    static const uint8_t ucKey[ 16 ] = { 0 };
+    mbedtls_gcm_context xGcmCtx;
+    uint8_t * pucIn = pvPortMalloc( uxLength );
+    uint8_t * pucOut = pvPortMalloc( uxLength + BENCH_CLI_GCM_TAG_LEN );
+    uint8_t * pucRef = pvPortMalloc( uxLength + BENCH_CLI_GCM_TAG_LEN );
+    int lRslt = 0;
+
+    if( ( pucIn == NULL ) || ( pucOut == NULL ) || ( pucRef == NULL ) )
+    {
+        pxCIO->print( "Error: Not enough heap for the benchmark buffers.\r\n" );
+    }
+    else
+    {
+        for( size_t i = 0; i < uxLength; i++ )
+        {
+            pucIn[ i ] = ( uint8_t ) i;
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "length: %lu bytes, iterations: %lu, core clock: %lu Hz\r\n"
+                           "%-8s %-10s %9s %8s\r\n",
+                           ( uint32_t ) uxLength, ( uint32_t ) BENCH_CLI_ITER, SystemCoreClock,
+                           "alg", "path", "cyc/byte", "KB/s" );
+        pxCIO->print( pcCliScratchBuffer );
+
+        mbedtls_gcm_init( &xGcmCtx );
+
+        lRslt = mbedtls_gcm_setkey( &xGcmCtx, MBEDTLS_CIPHER_ID_AES, ucKey, 128 );
+
+        if( lRslt == 0 )
+        {
+            lRslt = prvBenchThroughput( pxCIO, "aes-gcm", BENCH_CLI_GCM_PATH, prvGcmEncrypt, &xGcmCtx,
+                                        pucIn, pucRef, uxLength );
+        }
+
+        mbedtls_gcm_free( &xGcmCtx );
+
+        #ifdef MBEDTLS_TRANSPORT_PSA
+            if( lRslt == 0 )
+            {
+                psa_key_attributes_t xAttributes = PSA_KEY_ATTRIBUTES_INIT;
+                psa_key_id_t xKeyId = PSA_KEY_ID_NULL;
+
+                psa_set_key_usage_flags( &xAttributes, PSA_KEY_USAGE_ENCRYPT );
+                psa_set_key_algorithm( &xAttributes, PSA_ALG_GCM );
+                psa_set_key_type( &xAttributes, PSA_KEY_TYPE_AES );
+                psa_set_key_bits( &xAttributes, 128 );
+
+                lRslt = ( int ) psa_import_key( &xAttributes, ucKey, sizeof( ucKey ), &xKeyId );
+
+                if( lRslt == 0 )
+                {
+                    lRslt = prvBenchThroughput( pxCIO, "aes-gcm", "psa", prvPsaGcmEncrypt, &xKeyId,
+                                                pucIn, pucOut, uxLength );
+
+                    ( void ) psa_destroy_key( xKeyId );
+                }
+
+                if( ( lRslt == 0 ) &&
+                    ( memcmp( pucOut, pucRef, uxLength + BENCH_CLI_GCM_TAG_LEN ) != 0 ) )
+                {
+                    pxCIO->print( "Error: aes-gcm output of the paths differs.\r\n" );
+                }
+            }
+        #endif /* MBEDTLS_TRANSPORT_PSA */
+
+        if( lRslt == 0 )
+        {
+            lRslt = prvBenchThroughput( pxCIO, "sha-256", BENCH_CLI_SHA256_PATH, prvSha256, NULL,
+                                        pucIn, pucRef, uxLength );
+        }
+
+        #ifdef MBEDTLS_TRANSPORT_PSA
+            if( lRslt == 0 )
+            {
+                lRslt = prvBenchThroughput( pxCIO, "sha-256", "psa", prvPsaSha256, NULL,
+                                            pucIn, pucOut, uxLength );
+
+                if( ( lRslt == 0 ) &&
+                    ( memcmp( pucOut, pucRef, 32 ) != 0 ) )
+                {
+                    pxCIO->print( "Error: sha-256 output of the paths differs.\r\n" );
+                }
+            }
+        #endif /* MBEDTLS_TRANSPORT_PSA */
+
+        if( lRslt == 0 )
+        {
+            lRslt = prvBenchThroughput( pxCIO, "crc-32", "software", prvCrc32Software, NULL,
+                                        pucIn, pucRef, uxLength );
+        }
+
+        #ifdef BENCH_CLI_LFS_CRC
+            if( lRslt == 0 )
+            {
+                lRslt = prvBenchThroughput( pxCIO, "crc-32", "lfs_crc", prvCrc32Lfs, NULL,
+                                            pucIn, pucOut, uxLength );
+
+                if( ( lRslt == 0 ) &&
+                    ( memcmp( pucOut, pucRef, sizeof( uint32_t ) ) != 0 ) )
+                {
+                    pxCIO->print( "Error: crc-32 output of the paths differs.\r\n" );
+                }
+            }
+        #endif /* BENCH_CLI_LFS_CRC */
+    }
+
+    vPortFree( pucIn );
+    vPortFree( pucOut );
+    vPortFree( pucRef );
+}
+
+/*-----------------------------------------------------------*/
+
+#ifndef TFM_PSA_API
+
+/*
+ * CoreMark style kernels: a linked list insertion sort, a 16 bit matrix multiply and a
+ * parser state machine over the input. They reproduce the kind of code and data access
+ * CoreMark exercises, their cycle counts are not CoreMark scores.
+ */
+    typedef struct
+    {
+        uint16_t usNext;
+        uint16_t usValue;
+    } BenchListNode_t;
+
+    static int prvKernelList( void * pvCtx,
+                              const uint8_t * pucIn,
+                              uint8_t * pucOut,
+                              size_t uxLen )
+    {
+        BenchListNode_t * pxNodes = ( BenchListNode_t * ) pucOut;
+        uint16_t usHead = UINT16_MAX;
+        uint32_t ulSum = 0;
+
+        ( void ) pvCtx;
+
+        for( uint16_t i = 0; i < BENCH_CLI_LIST_LEN; i++ )
+        {
+            uint16_t * pusLink = &usHead;
+
+            pxNodes[ i ].usValue = ( uint16_t ) ( ( i * 40503U ) ^ pucIn[ i % uxLen ] );
+
+            while( ( *pusLink != UINT16_MAX ) &&
+                   ( pxNodes[ *pusLink ].usValue < pxNodes[ i ].usValue ) )
+            {
+                pusLink = &( pxNodes[ *pusLink ].usNext );
+            }
+
+            pxNodes[ i ].usNext = *pusLink;
+            *pusLink = i;
+        }
+
+        for( uint16_t usIdx = usHead; usIdx != UINT16_MAX; usIdx = pxNodes[ usIdx ].usNext )
+        {
+            ulSum = ( ulSum * 31U ) + pxNodes[ usIdx ].usValue;
+        }
+
+        ( void ) memcpy( &( pucOut[ BENCH_CLI_LIST_LEN * sizeof( BenchListNode_t ) ] ), &ulSum, sizeof( ulSum ) );
+
+        return 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* C = A * B, A and B taken from the input and C written to the output */
+    static int prvKernelMatrix( void * pvCtx,
+                                const uint8_t * pucIn,
+                                uint8_t * pucOut,
+                                size_t uxLen )
+    {
+        const int16_t * psA = ( const int16_t * ) pucIn;
+        const int16_t * psB = &( psA[ BENCH_CLI_MATRIX_N * BENCH_CLI_MATRIX_N ] );
+        int32_t * plC = ( int32_t * ) pucOut;
+
+        ( void ) pvCtx;
+        ( void ) uxLen;
+
+        for( uint32_t i = 0; i < BENCH_CLI_MATRIX_N; i++ )
+        {
+            for( uint32_t j = 0; j < BENCH_CLI_MATRIX_N; j++ )
+            {
+                int32_t lSum = 0;
+
+                for( uint32_t k = 0; k < BENCH_CLI_MATRIX_N; k++ )
+                {
+                    lSum += ( int32_t ) psA[ ( i * BENCH_CLI_MATRIX_N ) + k ] * psB[ ( k * BENCH_CLI_MATRIX_N ) + j ];
+                }
+
+                plC[ ( i * BENCH_CLI_MATRIX_N ) + j ] = lSum;
+            }
+        }
+
+        return 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Classify the comma separated fields of the input as integer, float, exponent or invalid */
+    static int prvKernelState( void * pvCtx,
+                               const uint8_t * pucIn,
+                               uint8_t * pucOut,
+                               size_t uxLen )
+    {
+        static const char pcAlphabet[ 16 ] = "0123456789.e,,-x";
+        enum { STATE_START, STATE_INT, STATE_FLOAT, STATE_EXP, STATE_INVALID, STATE_COUNT } xState = STATE_START;
+        uint32_t pulCounts[ STATE_COUNT ] = { 0 };
+
+        ( void ) pvCtx;
+
+        for( size_t i = 0; i < uxLen; i++ )
+        {
+            char cChar = pcAlphabet[ ( pucIn[ i ] ^ ( i >> 3 ) ) & 0xFU ];
+            BaseType_t xDigit = ( ( cChar >= '0' ) && ( cChar <= '9' ) );
+
+            if( cChar == ',' )
+            {
+                pulCounts[ xState ]++;
+                xState = STATE_START;
+            }
+            else
+            {
+                switch( xState )
+                {
+                    case STATE_START:
+                        xState = ( xDigit || ( cChar == '-' ) ) ? STATE_INT :
+                                 ( cChar == '.' ) ? STATE_FLOAT : STATE_INVALID;
+                        break;
+
+                    case STATE_INT:
+                        xState = xDigit ? STATE_INT : ( cChar == '.' ) ? STATE_FLOAT : STATE_INVALID;
+                        break;
+
+                    case STATE_FLOAT:
+                        xState = xDigit ? STATE_FLOAT : ( cChar == 'e' ) ? STATE_EXP : STATE_INVALID;
+                        break;
+
+                    case STATE_EXP:
+                        xState = ( xDigit || ( cChar == '-' ) ) ? STATE_EXP : STATE_INVALID;
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+        }
+
+        ( void ) memcpy( pucOut, pulCounts, sizeof( pulCounts ) );
+
+        return 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Hit rate in percent, times 100. Prints "-" when the cache saw no access. */
+    static void prvFormatHitRate( char * pcBuf,
+                                  size_t uxBufLen,
+                                  uint32_t ulHits,
+                                  uint32_t ulMisses )
+    {
+        uint64_t ullTotal = ( uint64_t ) ulHits + ulMisses;
+
+        if( ullTotal == 0 )
+        {
+            ( void ) snprintf( pcBuf, uxBufLen, "%7s", "-" );
+        }
+        else
+        {
+            uint32_t ulRateX100 = ( uint32_t ) ( ( ( uint64_t ) ulHits * 10000U ) / ullTotal );
+
+            ( void ) snprintf( pcBuf, uxBufLen, "%4lu.%02lu", ulRateX100 / 100U, ulRateX100 % 100U );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Run each kernel ulIterations times under each cache profile and print the cycles per
+ * iteration and the hit rates counted by the cache monitors, then restore the profile.
+ */
+    static void vBenchCache( ConsoleIO_t * const pxCIO,
+                             uint32_t ulIterations )
+    {
+        static const uint8_t ucKey[ 16 ] = { 0 };
+        mbedtls_gcm_context xGcmCtx;
+        const struct
+        {
+            const char * pcName;
+            BenchFunc_t xFunc;
+            void * pvCtx;
+        } xKernels[] =
+        {
+            { "list",    prvKernelList,    NULL     },
+            { "matrix",  prvKernelMatrix,  NULL     },
+            { "state",   prvKernelState,   NULL     },
+            { "crc-32",  prvCrc32Software, NULL     },
+            { "sha-256", prvSha256,        NULL     },
+            { "aes-gcm", prvGcmEncrypt,    &xGcmCtx },
+        };
+        HwCacheProfile_t xSavedProfile = hw_cache_get_profile();
+        uint8_t * pucIn = pvPortMalloc( BENCH_CLI_LEN );
+        uint8_t * pucOut = pvPortMalloc( BENCH_CLI_LEN + BENCH_CLI_GCM_TAG_LEN );
+        int lRslt = 0;
+
+        mbedtls_gcm_init( &xGcmCtx );
+
+        if( ( pucIn == NULL ) || ( pucOut == NULL ) )
+        {
+            pxCIO->print( "Error: Not enough heap for the benchmark buffers.\r\n" );
+            lRslt = -1;
+        }
+        else
+        {
+            for( size_t i = 0; i < BENCH_CLI_LEN; i++ )
+            {
+                pucIn[ i ] = ( uint8_t ) ( i * 167U );
+            }
+
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "length: %lu bytes, iterations: %lu, core clock: %lu Hz\r\n"
+                               "%-7s %-8s %10s %7s %7s\r\n",
+                               ( uint32_t ) BENCH_CLI_LEN, ulIterations, SystemCoreClock,
+                               "profile", "kernel", "cyc/iter", "i$ hit%", "d$ hit%" );
+            pxCIO->print( pcCliScratchBuffer );
+
+            lRslt = mbedtls_gcm_setkey( &xGcmCtx, MBEDTLS_CIPHER_ID_AES, ucKey, 128 );
+        }
+
+        for( uint32_t ulProfile = 0; ( ulProfile < HW_CACHE_PROFILE_MAX ) && ( lRslt == 0 ); ulProfile++ )
+        {
+            if( hw_cache_set_profile( ( HwCacheProfile_t ) ulProfile ) != HAL_OK )
+            {
+                lRslt = -1;
+            }
+
+            for( size_t k = 0; ( k < ( sizeof( xKernels ) / sizeof( xKernels[ 0 ] ) ) ) && ( lRslt == 0 ); k++ )
+            {
+                HwCacheStats_t xStats;
+                char pcICache[ 12 ];
+                char pcDCache[ 12 ];
+                uint64_t ullTotal = 0;
+
+                hw_cache_monitor_start();
+
+                for( uint32_t i = 0; ( i < ulIterations ) && ( lRslt == 0 ); i++ )
+                {
+                    uint32_t ulStart = DWT->CYCCNT;
+
+                    lRslt = xKernels[ k ].xFunc( xKernels[ k ].pvCtx, pucIn, pucOut, BENCH_CLI_LEN );
+
+                    ullTotal += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+                }
+
+                hw_cache_monitor_stop( &xStats );
+
+                prvFormatHitRate( pcICache, sizeof( pcICache ), xStats.ulICacheHits, xStats.ulICacheMisses );
+                prvFormatHitRate( pcDCache, sizeof( pcDCache ), xStats.ulDCacheReadHits, xStats.ulDCacheReadMisses );
+
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "%-7s %-8s %10lu %7s %7s\r\n",
+                                   hw_cache_profile_name( ( HwCacheProfile_t ) ulProfile ),
+                                   xKernels[ k ].pcName,
+                                   ( uint32_t ) ( ullTotal / ulIterations ),
+                                   pcICache, pcDCache );
+                pxCIO->print( pcCliScratchBuffer );
+            }
+        }
+
+        if( hw_cache_set_profile( xSavedProfile ) != HAL_OK )
+        {
+            pxCIO->print( "Error: Failed to restore the cache profile.\r\n" );
+        }
+        else if( lRslt != 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Error: cache benchmark failed: -0x%04lx\r\n", ( uint32_t ) -lRslt );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            /* Nothing to report */
+        }
+
+        mbedtls_gcm_free( &xGcmCtx );
+        vPortFree( pucIn );
+        vPortFree( pucOut );
+    }
+
+#endif /* ! defined( TFM_PSA_API ) */
+
+/*-----------------------------------------------------------*/
+
+#ifdef BENCH_CLI_ECC
+
+/* Average DWT cycles of one operation of each kind */
+    typedef struct
+    {
+        uint32_t ulSignCycles;
+        uint32_t ulVerifyCycles;
+        uint32_t ulEcdhCycles;
+    } EccBenchResult_t;
+
+/*
+ * Sign and verify a fixed hash with the key pair pxD / pxQ and run an ECDH
+ * exchange (ephemeral key generation and shared secret) ulIterations times on
+ * the currently selected PKA or software path. The other side of each
+ * exchange is computed as well, untimed, to check that both secrets match.
+ */
+    static int32_t lEccBenchRun( mbedtls_ecp_group * pxGrp,
+                                 const mbedtls_mpi * pxD,
+                                 const mbedtls_ecp_point * pxQ,
+                                 mbedtls_ctr_drbg_context * pxDrbg,
+                                 uint32_t ulIterations,
+                                 EccBenchResult_t * pxResult )
+    {
+        static const uint8_t ucHash[ 32 ] =
+        {
+            0x9F, 0x86, 0xD0, 0x81, 0x88, 0x4C, 0x7D, 0x65, 0x9A, 0x2F, 0xEA, 0xA0, 0xC5, 0x5A, 0xD0, 0x15,
+            0xA3, 0xBF, 0x4F, 0x1B, 0x2B, 0x0B, 0x82, 0x2C, 0xD1, 0x5D, 0x6C, 0x15, 0xB0, 0xF0, 0x0A, 0x08
+        };
+        mbedtls_mpi xR, xS, xEphD, xZ, xPeerZ;
+        mbedtls_ecp_point xEphQ;
+        uint64_t ullSign = 0, ullVerify = 0, ullEcdh = 0;
+        int32_t lRslt = 0;
+
+        mbedtls_mpi_init( &xR );
+        mbedtls_mpi_init( &xS );
+        mbedtls_mpi_init( &xEphD );
+        mbedtls_mpi_init( &xZ );
+        mbedtls_mpi_init( &xPeerZ );
+        mbedtls_ecp_point_init( &xEphQ );
+
+        for( uint32_t i = 0; ( i < ulIterations ) && ( lRslt == 0 ); i++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lRslt = mbedtls_ecdsa_sign( pxGrp, &xR, &xS, pxD, ucHash, sizeof( ucHash ),
+                                        mbedtls_ctr_drbg_random, pxDrbg );
+
+            ullSign += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+
+            if( lRslt == 0 )
+            {
+                ulStart = DWT->CYCCNT;
+
+                lRslt = mbedtls_ecdsa_verify( pxGrp, ucHash, sizeof( ucHash ), pxQ, &xR, &xS );
+
+                ullVerify += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+            }
+
+            if( lRslt == 0 )
+            {
+                ulStart = DWT->CYCCNT;
+
+                lRslt = mbedtls_ecdh_gen_public( pxGrp, &xEphD, &xEphQ,
+                                                 mbedtls_ctr_drbg_random, pxDrbg );
+
+                if( lRslt == 0 )
+                {
+                    lRslt = mbedtls_ecdh_compute_shared( pxGrp, &xZ, pxQ, &xEphD,
+                                                         mbedtls_ctr_drbg_random, pxDrbg );
+                }
+
+                ullEcdh += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+            }
+
+            if( lRslt == 0 )
+            {
+                lRslt = mbedtls_ecdh_compute_shared( pxGrp, &xPeerZ, &xEphQ, pxD,
+                                                     mbedtls_ctr_drbg_random, pxDrbg );
+
+                if( ( lRslt == 0 ) && ( mbedtls_mpi_cmp_mpi( &xZ, &xPeerZ ) != 0 ) )
+                {
+                    lRslt = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+                }
+            }
+        }
+
+        pxResult->ulSignCycles = ( uint32_t ) ( ullSign / ulIterations );
+        pxResult->ulVerifyCycles = ( uint32_t ) ( ullVerify / ulIterations );
+        pxResult->ulEcdhCycles = ( uint32_t ) ( ullEcdh / ulIterations );
+
+        mbedtls_mpi_free( &xR );
+        mbedtls_mpi_free( &xS );
+        mbedtls_mpi_free( &xEphD );
+        mbedtls_mpi_free( &xZ );
+        mbedtls_mpi_free( &xPeerZ );
+        mbedtls_ecp_point_free( &xEphQ );
+
+        return lRslt;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Operations per second, times 100 */
+    static uint32_t ulEccOpsPerSecX100( uint32_t ulCycles )
+    {
+        return ( ulCycles == 0 ) ? 0 :
+               ( uint32_t ) ( ( ( uint64_t ) SystemCoreClock * 100U ) / ulCycles );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vPrintEccBenchResult( ConsoleIO_t * const pxCIO,
+                                      const char * pcPath,
+                                      const EccBenchResult_t * pxResult )
+    {
+        uint32_t ulSign = ulEccOpsPerSecX100( pxResult->ulSignCycles );
+        uint32_t ulVerify = ulEccOpsPerSecX100( pxResult->ulVerifyCycles );
+        uint32_t ulEcdh = ulEccOpsPerSecX100( pxResult->ulEcdhCycles );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %7lu.%02lu %7lu.%02lu %7lu.%02lu\r\n",
+                           pcPath,
+                           ulSign / 100U, ulSign % 100U,
+                           ulVerify / 100U, ulVerify % 100U,
+                           ulEcdh / 100U, ulEcdh % 100U );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vEccBench( ConsoleIO_t * const pxCIO,
+                           uint32_t ulIterations )
+    {
+        static const char pcPers[] = "bench crypto";
+        mbedtls_entropy_context xEntropy;
+        mbedtls_ctr_drbg_context xDrbg;
+        mbedtls_ecp_group xGrp;
+        mbedtls_mpi xD;
+        mbedtls_ecp_point xQ;
+        EccBenchResult_t xPkaResult = { 0 };
+        EccBenchResult_t xSwResult = { 0 };
+        int lPkaEnabled = pka_is_enabled();
+        int32_t lRslt;
+
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+        mbedtls_entropy_init( &xEntropy );
+        mbedtls_ctr_drbg_init( &xDrbg );
+        mbedtls_ecp_group_init( &xGrp );
+        mbedtls_mpi_init( &xD );
+        mbedtls_ecp_point_init( &xQ );
+
+        lRslt = mbedtls_ctr_drbg_seed( &xDrbg, mbedtls_entropy_func, &xEntropy,
+                                       ( const unsigned char * ) pcPers, sizeof( pcPers ) - 1 );
+
+        if( lRslt == 0 )
+        {
+            lRslt = mbedtls_ecp_group_load( &xGrp, MBEDTLS_ECP_DP_SECP256R1 );
+        }
+
+        if( lRslt == 0 )
+        {
+            lRslt = mbedtls_ecp_gen_keypair( &xGrp, &xD, &xQ, mbedtls_ctr_drbg_random, &xDrbg );
+        }
+
+        if( lRslt == 0 )
+        {
+            pka_set_enabled( 1 );
+            lRslt = lEccBenchRun( &xGrp, &xD, &xQ, &xDrbg, ulIterations, &xPkaResult );
+        }
+
+        if( lRslt == 0 )
+        {
+            pka_set_enabled( 0 );
+            lRslt = lEccBenchRun( &xGrp, &xD, &xQ, &xDrbg, ulIterations, &xSwResult );
+        }
+
+        pka_set_enabled( lPkaEnabled );
+
+        if( lRslt != 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Error: ECC benchmark failed with -0x%04lx.\r\n",
+                               ( uint32_t ) -lRslt );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "curve: secp256r1, iterations: %lu, core clock: %lu Hz\r\n"
+                               "path      sign/s  verify/s    ecdh/s\r\n",
+                               ulIterations, SystemCoreClock );
+            pxCIO->print( pcCliScratchBuffer );
+
+            vPrintEccBenchResult( pxCIO, "pka", &xPkaResult );
+            vPrintEccBenchResult( pxCIO, "software", &xSwResult );
+        }
+
+        mbedtls_ecp_point_free( &xQ );
+        mbedtls_mpi_free( &xD );
+        mbedtls_ecp_group_free( &xGrp );
+        mbedtls_ctr_drbg_free( &xDrbg );
+        mbedtls_entropy_free( &xEntropy );
+    }
+
+#endif /* BENCH_CLI_ECC */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Connect to the endpoint used by the MQTT agent ulIterations times and print the
+ * average and worst case connection time. The timing includes DNS and TCP setup;
+ * "tls stats" lists the phases of the most recent attempts.
+ */
+static void vBenchHandshakePath( ConsoleIO_t * const pxCIO,
+                                 const char * pcPath,
+                                 const char * pcHostName,
+                                 uint16_t usPort,
+                                 uint32_t ulIterations )
+{
+    static const char * pcAlpnProtocols[] = { AWS_IOT_MQTT_ALPN, NULL };
+    PkiObject_t xPrivateKey = xPkiObjectFromLabel( TLS_KEY_PRV_LABEL );
+    PkiObject_t xClientCertificate = xPkiObjectFromLabel( TLS_CERT_LABEL );
+    PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    TickType_t xTotal = 0;
+    TickType_t xMax = 0;
+
+    for( uint32_t i = 0; ( i < ulIterations ) && ( xStatus == TLS_TRANSPORT_SUCCESS ); i++ )
+    {
+        NetworkContext_t * pxNetworkContext = mbedtls_transport_allocate();
+
+        if( pxNetworkContext == NULL )
+        {
+            xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+        }
+        else
+        {
+            xStatus = mbedtls_transport_configure( pxNetworkContext, pcAlpnProtocols,
+                                                   &xPrivateKey, &xClientCertificate,
+                                                   pxRootCaChain, 1 );
+        }
+
+        if( xStatus == TLS_TRANSPORT_SUCCESS )
+        {
+            TickType_t xStart = xTaskGetTickCount();
+            TickType_t xElapsed;
+
+            xStatus = mbedtls_transport_connect( pxNetworkContext, pcHostName, usPort, 0, 0 );
+
+            xElapsed = xTaskGetTickCount() - xStart;
+            xTotal += xElapsed;
+
+            if( xElapsed > xMax )
+            {
+                xMax = xElapsed;
+            }
+
+            mbedtls_transport_disconnect( pxNetworkContext );
+        }
+
+        if( pxNetworkContext != NULL )
+        {
+            mbedtls_transport_free( pxNetworkContext );
+        }
+    }
+
+    if( xStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s failed: %ld\r\n", pcPath, ( int32_t ) xStatus );
+    }
+    else
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %8lu %8lu\r\n", pcPath,
+                           ( uint32_t ) ( ( xTotal * portTICK_PERIOD_MS ) / ulIterations ),
+                           ( uint32_t ) ( xMax * portTICK_PERIOD_MS ) );
+    }
+
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vBenchHandshake( ConsoleIO_t * const pxCIO,
+                             uint32_t ulIterations )
+{
+    BaseType_t xSuccess = pdFALSE;
+    size_t uxEndpointLen = 0;
+    char * pcEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT, &uxEndpointLen );
+    uint32_t ulPort = KVStore_getUInt32( CS_CORE_MQTT_PORT, &( xSuccess ) );
+
+    if( ( pcEndpoint == NULL ) ||
+        ( uxEndpointLen == 0 ) ||
+        ( xSuccess == pdFALSE ) ||
+        ( ulPort == 0 ) ||
+        ( ulPort > UINT16_MAX ) )
+    {
+        pxCIO->print( "Error: mqtt_endpoint and mqtt_port must be configured.\r\n" );
+    }
+    else
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "endpoint: %s:%lu, connections: %lu\r\n%-8s %8s %8s\r\n",
+                           pcEndpoint, ulPort, ulIterations, "path", "avg ms", "max ms" );
+        pxCIO->print( pcCliScratchBuffer );
+
+        #ifdef BENCH_CLI_ECC
+        {
+            int lPkaEnabled = pka_is_enabled();
+
+            pka_set_enabled( 1 );
+            vBenchHandshakePath( pxCIO, "pka", pcEndpoint, ( uint16_t ) ulPort, ulIterations );
+
+            pka_set_enabled( 0 );
+            vBenchHandshakePath( pxCIO, "software", pcEndpoint, ( uint16_t ) ulPort, ulIterations );
+
+            pka_set_enabled( lPkaEnabled );
+        }
+        #else
+            vBenchHandshakePath( pxCIO, "default", pcEndpoint, ( uint16_t ) ulPort, ulIterations );
+        #endif /* BENCH_CLI_ECC */
+    }
+
+    if( pcEndpoint != NULL )
+    {
+        vPortFree( pcEndpoint );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vBenchMqtt( ConsoleIO_t * const pxCIO,
+                        const MqttBenchConfig_t * pxConfig )
+{
+    MqttBenchResult_t xResults[ MQTT_BENCH_MAX_RESULTS ];
+    size_t uxResults = 0;
+    BaseType_t xStatus;
+
+    pxCIO->print( "Running, this takes a while...\r\n" );
+
+    xStatus = xMqttBenchRun( pxConfig, xResults, MQTT_BENCH_MAX_RESULTS, &uxResults );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "qos: %u, window: %lu\r\n%-7s %6s %6s %7s %11s %8s %8s %8s %8s\r\n",
+                       pxConfig->ucQoS, ( uint32_t ) MQTT_BENCH_WINDOW,
+                       "length", "sent", "recv", "msg/s", "goodput B/s",
+                       "p50 us", "p99 us", "p999 us", "max us" );
+    pxCIO->print( pcCliScratchBuffer );
+
+    for( size_t i = 0; i < uxResults; i++ )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-7lu %6lu %6lu %7lu %11lu %8lu %8lu %8lu %8lu\r\n",
+                           xResults[ i ].ulPayloadLen,
+                           xResults[ i ].ulSent,
+                           xResults[ i ].ulReceived,
+                           xResults[ i ].ulMsgsPerSec,
+                           xResults[ i ].ulGoodputBytesPerSec,
+                           xResults[ i ].ulRttP50Us,
+                           xResults[ i ].ulRttP99Us,
+                           xResults[ i ].ulRttP999Us,
+                           xResults[ i ].ulRttMaxUs );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    if( xStatus != pdPASS )
+    {
+        pxCIO->print( "Error: the benchmark did not complete, see the log for details.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* In offload mode the plain path runs on the sockets of the WiFi module's own stack */
+#if ( MX_NET_OFFLOAD == 1 )
+    #define BENCH_PLAIN_PATH    "offload"
+    #define prvPlainClose( xSock )    mx_close( xSock )
+#else
+    #define BENCH_PLAIN_PATH    "plain"
+    #define prvPlainClose( xSock )    sock_close( xSock )
+#endif
+
+static int32_t prvPlainSend( void * pvCtx,
+                             const void * pvBuf,
+                             size_t uxLen )
+{
+    #if ( MX_NET_OFFLOAD == 1 )
+        return mx_send( *( ( SockHandle_t * ) pvCtx ), pvBuf, uxLen, 0 );
+    #else
+        return ( int32_t ) sock_send( *( ( SockHandle_t * ) pvCtx ), pvBuf, uxLen, 0 );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvPlainRecv( void * pvCtx,
+                             void * pvBuf,
+                             size_t uxLen )
+{
+    #if ( MX_NET_OFFLOAD == 1 )
+        return mx_recv( *( ( SockHandle_t * ) pvCtx ), pvBuf, uxLen, 0 );
+    #else
+        return ( int32_t ) sock_recv( *( ( SockHandle_t * ) pvCtx ), pvBuf, uxLen, 0 );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvTlsSend( void * pvCtx,
+                           const void * pvBuf,
+                           size_t uxLen )
+{
+    return mbedtls_transport_send( ( NetworkContext_t * ) pvCtx, pvBuf, uxLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvTlsRecv( void * pvCtx,
+                           void * pvBuf,
+                           size_t uxLen )
+{
+    return mbedtls_transport_recv( ( NetworkContext_t * ) pvCtx, pvBuf, uxLen );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Write ulBytes in uxChunk byte writes. In echo mode, read the data back while at most
+ * BENCH_CLI_TCP_WINDOW chunks are outstanding, so neither side blocks on a full window.
+ * The buffer content is not checked.
+ */
+static BaseType_t prvBenchStream( void * pvCtx,
+                                  BenchStreamSend_t xSend,
+                                  BenchStreamRecv_t xRecv,
+                                  uint8_t * pucBuf,
+                                  size_t uxChunk,
+                                  uint32_t ulBytes,
+                                  BaseType_t xEcho,
+                                  BenchStreamResult_t * pxResult )
+{
+    const uint32_t ulWindow = BENCH_CLI_TCP_WINDOW * ( uint32_t ) uxChunk;
+    uint32_t ulStartRunTime = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE();
+    uint32_t ulStartIdleTime = ( uint32_t ) ulTaskGetIdleRunTimeCounter();
+    uint64_t ullStartUs = ullGetMonotonicUs();
+    BaseType_t xSuccess = pdTRUE;
+
+    memset( pxResult, 0, sizeof( BenchStreamResult_t ) );
+
+    while( ( xSuccess == pdTRUE ) &&
+           ( ( pxResult->ulTxBytes < ulBytes ) ||
+             ( ( xEcho == pdTRUE ) && ( pxResult->ulRxBytes < ulBytes ) ) ) )
+    {
+        int32_t lRslt;
+
+        if( ( pxResult->ulTxBytes < ulBytes ) &&
+            ( ( xEcho == pdFALSE ) || ( ( pxResult->ulTxBytes - pxResult->ulRxBytes ) < ulWindow ) ) )
+        {
+            size_t uxLen = ( ( ulBytes - pxResult->ulTxBytes ) < uxChunk ) ?
+                           ( size_t ) ( ulBytes - pxResult->ulTxBytes ) : uxChunk;
+
+            lRslt = xSend( pvCtx, pucBuf, uxLen );
+
+            if( lRslt > 0 )
+            {
+                pxResult->ulTxBytes += ( uint32_t ) lRslt;
+                pxResult->ullTxUs = ullGetMonotonicUs() - ullStartUs;
+            }
+        }
+        else
+        {
+            uint32_t ulPending = pxResult->ulTxBytes - pxResult->ulRxBytes;
+            size_t uxLen = ( ulPending < uxChunk ) ? ( size_t ) ulPending : uxChunk;
+
+            lRslt = xRecv( pvCtx, pucBuf, uxLen );
+
+            if( lRslt > 0 )
+            {
+                pxResult->ulRxBytes += ( uint32_t ) lRslt;
+                pxResult->ullRxUs = ullGetMonotonicUs() - ullStartUs;
+            }
+        }
+
+        /* A timeout counts as a failure as well */
+        if( lRslt <= 0 )
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+
+    pxResult->ulRunTime = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE() - ulStartRunTime;
+    pxResult->ulIdleTime = ( uint32_t ) ulTaskGetIdleRunTimeCounter() - ulStartIdleTime;
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Connect a plain TCP socket to the first IPv4 address of pcHostName */
+#if ( MX_NET_OFFLOAD == 1 )
+    static SockHandle_t xBenchPlainConnect( const char * pcHostName,
+                                            uint16_t usPort )
+    {
+        struct sockaddr_in xAddr = { 0 };
+        uint32_t ulTimeoutMs = BENCH_CLI_TCP_TIMEOUT_MS;
+        SockHandle_t xSock = -1;
+
+        if( mx_gethostbyname( pcHostName, &( xAddr.sin_addr.s_addr ) ) == 0 )
+        {
+            xAddr.sin_len = sizeof( xAddr );
+            xAddr.sin_family = AF_INET;
+            xAddr.sin_port = htons( usPort );
+
+            xSock = mx_socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+
+            if( ( xSock >= 0 ) &&
+                ( ( mx_setsockopt( xSock, SOL_SOCKET, SO_RCVTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) ) != 0 ) ||
+                  ( mx_setsockopt( xSock, SOL_SOCKET, SO_SNDTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) ) != 0 ) ||
+                  ( mx_connect( xSock, ( struct sockaddr * ) &xAddr, sizeof( xAddr ) ) != 0 ) ) )
+            {
+                ( void ) mx_close( xSock );
+                xSock = -1;
+            }
+        }
+
+        return xSock;
+    }
+#else /* MX_NET_OFFLOAD == 1 */
+static SockHandle_t xBenchPlainConnect( const char * pcHostName,
+                                        uint16_t usPort )
+{
+    const struct addrinfo xAddrInfoHint =
+    {
+        .ai_family   = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP,
+    };
+    struct addrinfo * pxAddrInfo = NULL;
+    uint32_t ulTimeoutMs = BENCH_CLI_TCP_TIMEOUT_MS;
+    SockHandle_t xSock = -1;
+
+    if( ( dns_getaddrinfo( pcHostName, NULL, &xAddrInfoHint, &pxAddrInfo ) == 0 ) &&
+        ( pxAddrInfo != NULL ) )
+    {
+        ( ( struct sockaddr_in * ) pxAddrInfo->ai_addr )->sin_port = htons( usPort );
+
+        xSock = sock_socket( pxAddrInfo->ai_family, pxAddrInfo->ai_socktype, pxAddrInfo->ai_protocol );
+
+        if( ( xSock >= 0 ) &&
+            ( ( sock_setsockopt( xSock, SOL_SOCKET, SO_RCVTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) ) != 0 ) ||
+              ( sock_setsockopt( xSock, SOL_SOCKET, SO_SNDTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) ) != 0 ) ||
+              ( sock_connect( xSock, pxAddrInfo->ai_addr, pxAddrInfo->ai_addrlen ) != 0 ) ) )
+        {
+            ( void ) sock_close( xSock );
+            xSock = -1;
+        }
+    }
+
+    if( pxAddrInfo != NULL )
+    {
+        dns_freeaddrinfo( pxAddrInfo );
+    }
+
+    return xSock;
+}
+#endif /* MX_NET_OFFLOAD == 1 */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Stream data over a plain TCP socket or a TLS connection to a sink or echo server.
+ * Comparing both paths separates the TLS record cost from the lwIP and network
+ * interface cost. Busy cycles are the share of the run not spent in the idle task,
+ * other tasks included, divided by the number of CHUNK byte records in both directions.
+ */
+static void vBenchTcp( ConsoleIO_t * const pxCIO,
+                       BaseType_t xTls,
+                       const char * pcHostName,
+                       uint16_t usPort,
+                       BaseType_t xEcho,
+                       uint32_t ulBytes,
+                       size_t uxChunk )
+{
+    static const char * pcPath[] = { BENCH_PLAIN_PATH, "tls" };
+    BenchStreamResult_t xResult = { 0 };
+    BaseType_t xSuccess = pdFALSE;
+    uint8_t * pucBuf = pvPortMalloc( uxChunk );
+
+    if( pucBuf == NULL )
+    {
+        pxCIO->print( "Error: failed to allocate the transfer buffer.\r\n" );
+    }
+    else if( xTls == pdFALSE )
+    {
+        SockHandle_t xSock = xBenchPlainConnect( pcHostName, usPort );
+
+        if( xSock < 0 )
+        {
+            pxCIO->print( "Error: failed to connect to the server.\r\n" );
+        }
+        else
+        {
+            memset( pucBuf, 0xA5, uxChunk );
+
+            xSuccess = prvBenchStream( &xSock, prvPlainSend, prvPlainRecv, pucBuf,
+                                       uxChunk, ulBytes, xEcho, &xResult );
+
+            ( void ) prvPlainClose( xSock );
+        }
+    }
+    else
+    {
+        PkiObject_t xPrivateKey = xPkiObjectFromLabel( TLS_KEY_PRV_LABEL );
+        PkiObject_t xClientCertificate = xPkiObjectFromLabel( TLS_CERT_LABEL );
+        PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+        NetworkContext_t * pxNetworkContext = mbedtls_transport_allocate();
+        TlsTransportStatus_t xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+
+        if( pxNetworkContext != NULL )
+        {
+            xStatus = mbedtls_transport_configure( pxNetworkContext, NULL,
+                                                   &xPrivateKey, &xClientCertificate,
+                                                   pxRootCaChain, 1 );
+        }
+
+        if( xStatus == TLS_TRANSPORT_SUCCESS )
+        {
+            xStatus = mbedtls_transport_connect( pxNetworkContext, pcHostName, usPort,
+                                                 BENCH_CLI_TCP_TIMEOUT_MS, BENCH_CLI_TCP_TIMEOUT_MS );
+        }
+
+        if( xStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Error: TLS connection failed: %ld\r\n", ( int32_t ) xStatus );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            memset( pucBuf, 0xA5, uxChunk );
+
+            xSuccess = prvBenchStream( pxNetworkContext, prvTlsSend, prvTlsRecv, pucBuf,
+                                       uxChunk, ulBytes, xEcho, &xResult );
+
+            mbedtls_transport_disconnect( pxNetworkContext );
+        }
+
+        if( pxNetworkContext != NULL )
+        {
+            mbedtls_transport_free( pxNetworkContext );
+        }
+    }
+
+    if( ( xResult.ulTxBytes > 0 ) && ( xResult.ullTxUs > 0 ) )
+    {
+        uint64_t ullElapsedUs = ( xResult.ullRxUs > xResult.ullTxUs ) ? xResult.ullRxUs : xResult.ullTxUs;
+        uint32_t ulBusyTime = ( xResult.ulRunTime > xResult.ulIdleTime ) ? ( xResult.ulRunTime - xResult.ulIdleTime ) : 0;
+        uint32_t ulRecords = ( xResult.ulTxBytes + ( uint32_t ) uxChunk - 1 ) / ( uint32_t ) uxChunk +
+                             ( xResult.ulRxBytes + ( uint32_t ) uxChunk - 1 ) / ( uint32_t ) uxChunk;
+        uint32_t ulTxMbps100 = ( uint32_t ) ( ( ( uint64_t ) xResult.ulTxBytes * 800U ) / xResult.ullTxUs );
+        uint32_t ulRxMbps100 = 0;
+        uint32_t ulCpuPercent = 100;
+        uint32_t ulCyclesPerRecord = 0;
+
+        if( xResult.ullRxUs > 0 )
+        {
+            ulRxMbps100 = ( uint32_t ) ( ( ( uint64_t ) xResult.ulRxBytes * 800U ) / xResult.ullRxUs );
+        }
+
+        if( xResult.ulRunTime > 0 )
+        {
+            ulCpuPercent = ( uint32_t ) ( ( ( uint64_t ) ulBusyTime * 100U ) / xResult.ulRunTime );
+            ulCyclesPerRecord = ( uint32_t ) ( ( ullElapsedUs * ( SystemCoreClock / 1000000UL ) * ulBusyTime ) /
+                                               ( ( uint64_t ) xResult.ulRunTime * ulRecords ) );
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "server: %s:%u, mode: %s, chunk: %lu\r\n"
+                           "%-6s %10s %10s %9s %9s %6s %10s\r\n"
+                           "%-6s %10lu %10lu %6lu.%02lu %6lu.%02lu %6lu %10lu\r\n",
+                           pcHostName, usPort, ( xEcho == pdTRUE ) ? "echo" : "sink", ( uint32_t ) uxChunk,
+                           "path", "tx bytes", "rx bytes", "tx Mbps", "rx Mbps", "cpu %", "cyc/record",
+                           pcPath[ ( xTls == pdFALSE ) ? 0 : 1 ], xResult.ulTxBytes, xResult.ulRxBytes,
+                           ulTxMbps100 / 100U, ulTxMbps100 % 100U,
+                           ulRxMbps100 / 100U, ulRxMbps100 % 100U,
+                           ulCpuPercent, ulCyclesPerRecord );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    if( ( pucBuf != NULL ) && ( xSuccess == pdFALSE ) && ( xResult.ulTxBytes > 0 ) )
+    {
+        pxCIO->print( "Error: the transfer stopped early, the server closed the connection or timed out.\r\n" );
+    }
+
+    vPortFree( pucBuf );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Input and output of the "bench micro" kernels, only allocated while the command runs */
+static uint8_t * pucMicroIn = NULL;
+static uint8_t * pucMicroOut = NULL;
+
+static int prvMicroThroughput( void * pvCtx )
+{
+    BenchMicroFunc_t * pxFunc = ( BenchMicroFunc_t * ) pvCtx;
+
+    return pxFunc->xFunc( pxFunc->pvFuncCtx, pucMicroIn, pucMicroOut, BENCH_CLI_MICRO_LEN );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvInetChksum( void * pvCtx,
+                          const uint8_t * pucIn,
+                          uint8_t * pucOut,
+                          size_t uxLen )
+{
+    uint16_t usChksum = inet_chksum( pucIn, ( uint16_t ) uxLen );
+
+    ( void ) pvCtx;
+
+    ( void ) memcpy( pucOut, &usChksum, sizeof( usChksum ) );
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/* The environment sensor payload, with the encoder of the format pointed to by pvCtx */
+static int prvMicroTelemetry( void * pvCtx )
+{
+    TelemetryEncoder_t xEncoder;
+
+    vTelemetryBegin( &xEncoder, *( ( BaseType_t * ) pvCtx ), pucMicroOut, BENCH_CLI_MICRO_LEN );
+    vTelemetryAddFloat( &xEncoder, "temp_0_c", 23.25f, 2 );
+    vTelemetryAddFloat( &xEncoder, "rh_pct", 41.5f, 2 );
+    vTelemetryAddFloat( &xEncoder, "temp_1_c", 23.75f, 2 );
+    vTelemetryAddFloat( &xEncoder, "baro_mbar", 1013.25f, 2 );
+
+    return ( xTelemetryEnd( &xEncoder ) > 0 ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+/* The same payload written with snprintf, which is printf_lite unless PRINTF_LITE_REPLACE_NEWLIB is 0 */
+static int prvMicroJsonSnprintf( void * pvCtx )
+{
+    int lLen;
+
+    ( void ) pvCtx;
+
+    lLen = snprintf( ( char * ) pucMicroOut, BENCH_CLI_MICRO_LEN,
+                     "{\"temp_0_c\":%.2f,\"rh_pct\":%.2f,\"temp_1_c\":%.2f,\"baro_mbar\":%.2f}",
+                     23.25, 41.5, 23.75, 1013.25 );
+
+    return ( ( lLen > 0 ) && ( lLen < ( int ) BENCH_CLI_MICRO_LEN ) ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * The fmt_* kernels run the same formats through printf_lite and through the newlib formatter,
+ * reached by vsniprintf which newlib-nano builds on the same code as vsnprintf, floats included.
+ */
+typedef int ( * BenchVFormat_t )( char * pcBuffer,
+                                  size_t uxLen,
+                                  const char * pcFormat,
+                                  va_list xArgs );
+
+static BenchVFormat_t xMicroFmtLite = lPrintfLiteV;
+static BenchVFormat_t xMicroFmtNewlib = vsniprintf;
+
+static int prvMicroFormat( const BenchVFormat_t * pxFormat,
+                           const char * pcFormat,
+                           ... )
+{
+    va_list xArgs;
+    int lLen;
+
+    va_start( xArgs, pcFormat );
+    lLen = ( *pxFormat )( ( char * ) pucMicroOut, BENCH_CLI_MICRO_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    return ( ( lLen > 0 ) && ( lLen < ( int ) BENCH_CLI_MICRO_LEN ) ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvMicroFmtJson( void * pvCtx )
+{
+    return prvMicroFormat( ( const BenchVFormat_t * ) pvCtx,
+                           "{\"temp_0_c\":%.2f,\"rh_pct\":%.2f,\"temp_1_c\":%.2f,\"baro_mbar\":%.2f}",
+                           23.25, 41.5, 23.75, 1013.25 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* A log line with the header written by the logging task */
+static int prvMicroFmtLog( void * pvCtx )
+{
+    return prvMicroFormat( ( const BenchVFormat_t * ) pvCtx,
+                           "<%-3.3s> %8lu [%-10.10s] %s:%d Published %lu bytes to %.*s, packet id %u, status 0x%08lX\r\n",
+                           "INF", 1234567UL, "MQTTAgent", "mqtt_agent_task.c", 412,
+                           152UL, 24, "thing-0123456789/env_sensor_data", 17U, 0x1000UL );
+}
+
+/*-----------------------------------------------------------*/
+
+static BenchMicroFunc_t xMicroCrc32 = { .xFunc = prvCrc32Software };
+static BenchMicroFunc_t xMicroInetChksum = { .xFunc = prvInetChksum };
+static BenchMicroFunc_t xMicroSha256 = { .xFunc = prvSha256 };
+static BenchMicroFunc_t xMicroGcm = { .xFunc = prvGcmEncrypt };
+
+static BaseType_t xMicroFormatJson = TELEMETRY_FORMAT_JSON;
+static BaseType_t xMicroFormatCbor = TELEMETRY_FORMAT_CBOR;
+
+static MICRO_BENCH( xBenchCrc32, "crc32_sw", prvMicroThroughput, &xMicroCrc32,
+                    BENCH_CLI_MICRO_LEN, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchInetChksum, "inet_chksum", prvMicroThroughput, &xMicroInetChksum,
+                    BENCH_CLI_MICRO_LEN, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchSha256, "sha256", prvMicroThroughput, &xMicroSha256,
+                    BENCH_CLI_MICRO_LEN, 0 );
+static MICRO_BENCH( xBenchGcm, "aes_gcm", prvMicroThroughput, &xMicroGcm,
+                    BENCH_CLI_MICRO_LEN, 0 );
+static MICRO_BENCH( xBenchTelemetryJson, "telemetry_json", prvMicroTelemetry, &xMicroFormatJson,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchTelemetryCbor, "telemetry_cbor", prvMicroTelemetry, &xMicroFormatCbor,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchJsonSnprintf, "json_snprintf", prvMicroJsonSnprintf, NULL,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtJsonLite, "fmt_json_lite", prvMicroFmtJson, &xMicroFmtLite,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtJsonNewlib, "fmt_json_newlib", prvMicroFmtJson, &xMicroFmtNewlib,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtLogLite, "fmt_log_lite", prvMicroFmtLog, &xMicroFmtLite,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtLogNewlib, "fmt_log_newlib", prvMicroFmtLog, &xMicroFmtNewlib,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+
+#ifdef BENCH_CLI_LFS_CRC
+    static BenchMicroFunc_t xMicroLfsCrc = { .xFunc = prvCrc32Lfs };
+
+    static MICRO_BENCH( xBenchLfsCrc, "lfs_crc", prvMicroThroughput, &xMicroLfsCrc,
+                        BENCH_CLI_MICRO_LEN, 0 );
+#endif /* BENCH_CLI_LFS_CRC */
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xBenchMicroVisitor( MicroBench_t * pxBench,
+                                      void * pvCtx )
+{
+    BenchMicroRun_t * pxRun = ( BenchMicroRun_t * ) pvCtx;
+
+    if( ( pxRun->pcName == NULL ) || ( strcmp( pxRun->pcName, pxBench->pcName ) == 0 ) )
+    {
+        MicroBenchStats_t xStats;
+
+        pxRun->ulMatches++;
+
+        if( xMicroBenchRun( pxBench, BENCH_CLI_MICRO_WARMUP, pxRun->ulRuns, &xStats ) == pdFALSE )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Error: %s failed: %d\r\n", pxBench->pcName, xStats.lError );
+            pxRun->pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            ( void ) lMicroBenchFormatCsv( pxBench, &xStats, pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN );
+            pxRun->pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Run the registered micro-benchmark kernels. The kernels of this file are registered on
+ * first use, other modules register theirs with vMicroBenchRegister.
+ */
+static void vBenchMicro( ConsoleIO_t * const pxCIO,
+                         const char * pcName,
+                         uint32_t ulRuns )
+{
+    static const uint8_t ucKey[ 16 ] = { 0 };
+    mbedtls_gcm_context * pxGcmCtx = pvPortMalloc( sizeof( mbedtls_gcm_context ) );
+    BenchMicroRun_t xRun =
+    {
+        .pxCIO     = pxCIO,
+        .pcName    = pcName,
+        .ulRuns    = ulRuns,
+        .ulMatches = 0,
+    };
+
+    vMicroBenchRegister( &xBenchCrc32 );
+    #ifdef BENCH_CLI_LFS_CRC
+        vMicroBenchRegister( &xBenchLfsCrc );
+    #endif
+    vMicroBenchRegister( &xBenchInetChksum );
+    vMicroBenchRegister( &xBenchSha256 );
+    vMicroBenchRegister( &xBenchGcm );
+    vMicroBenchRegister( &xBenchTelemetryJson );
+    vMicroBenchRegister( &xBenchTelemetryCbor );
+    vMicroBenchRegister( &xBenchJsonSnprintf );
+    vMicroBenchRegister( &xBenchFmtJsonLite );
+    vMicroBenchRegister( &xBenchFmtJsonNewlib );
+    vMicroBenchRegister( &xBenchFmtLogLite );
+    vMicroBenchRegister( &xBenchFmtLogNewlib );
+
+    pucMicroIn = pvPortMalloc( BENCH_CLI_MICRO_LEN );
+    pucMicroOut = pvPortMalloc( BENCH_CLI_MICRO_LEN + BENCH_CLI_GCM_TAG_LEN );
+
+    if( ( pucMicroIn == NULL ) || ( pucMicroOut == NULL ) || ( pxGcmCtx == NULL ) )
+    {
+        pxCIO->print( "Error: Not enough heap for the benchmark buffers.\r\n" );
+    }
+    else
+    {
+        for( size_t i = 0; i < BENCH_CLI_MICRO_LEN; i++ )
+        {
+            pucMicroIn[ i ] = ( uint8_t ) i;
+        }
+
+        mbedtls_gcm_init( pxGcmCtx );
+
+        if( mbedtls_gcm_setkey( pxGcmCtx, MBEDTLS_CIPHER_ID_AES, ucKey, 128 ) != 0 )
+        {
+            pxCIO->print( "Error: failed to set the AES-GCM key.\r\n" );
+        }
+        else
+        {
+            xMicroGcm.pvFuncCtx = pxGcmCtx;
+
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "core clock: %lu Hz, warm-up: %lu, runs: %lu\r\n" MICRO_BENCH_CSV_HEADER,
+                               SystemCoreClock, ( uint32_t ) BENCH_CLI_MICRO_WARMUP, ulRuns );
+            pxCIO->print( pcCliScratchBuffer );
+
+            vMicroBenchForEach( xBenchMicroVisitor, &xRun );
+
+            if( xRun.ulMatches == 0 )
+            {
+                pxCIO->print( "Error: no kernel registered with that name.\r\n" );
+            }
+
+            xMicroGcm.pvFuncCtx = NULL;
+        }
+
+        mbedtls_gcm_free( pxGcmCtx );
+    }
+
+    vPortFree( pxGcmCtx );
+    vPortFree( pucMicroIn );
+    vPortFree( pucMicroOut );
+    pucMicroIn = NULL;
+    pucMicroOut = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xParseBenchArg( ConsoleIO_t * const pxCIO,
+                                  const char * pcArg,
+                                  const char * pcName,
+                                  uint32_t ulMax,
+                                  uint32_t * pulValue )
+{
+    BaseType_t xValid = pdTRUE;
+
+    *pulValue = ( uint32_t ) strtoul( pcArg, NULL, 10 );
+
+    if( ( *pulValue == 0 ) || ( *pulValue > ulMax ) )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "Error: %s must be between 1 and %lu.\r\n", pcName, ulMax );
+        pxCIO->print( pcCliScratchBuffer );
+        xValid = pdFALSE;
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vBenchCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] )
+{
+    BaseType_t xValid = pdTRUE;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if( ( ulArgc >= 2 ) &&
+        ( ulArgc <= 4 ) &&
+        ( strcmp( "crypto", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        uint32_t ulLength = BENCH_CLI_LEN;
+        uint32_t ulIterations = BENCH_CLI_ECC_ITER;
+
+        if( ulArgc >= 3 )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 2 ], "LENGTH", BENCH_CLI_MAX_LEN, &ulLength );
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc == 4 ) )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 3 ], "ITERATIONS", BENCH_CLI_ECC_MAX_ITER, &ulIterations );
+        }
+
+        if( xValid == pdTRUE )
+        {
+            vBenchSymmetric( pxCIO, ( size_t ) ulLength );
+
+            #ifdef BENCH_CLI_ECC
+                vEccBench( pxCIO, ulIterations );
+            #else
+                ( void ) ulIterations;
+            #endif
+        }
+    }
+    else if( ( ulArgc >= 2 ) &&
+             ( ulArgc <= 3 ) &&
+             ( strcmp( "handshake", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        uint32_t ulIterations = BENCH_CLI_HS_ITER;
+
+        if( ulArgc == 3 )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 2 ], "ITERATIONS", BENCH_CLI_HS_MAX_ITER, &ulIterations );
+        }
+
+        if( xValid == pdTRUE )
+        {
+            vBenchHandshake( pxCIO, ulIterations );
+        }
+    }
+    else if( ( ulArgc >= 2 ) &&
+             ( ulArgc <= 5 ) &&
+             ( strcmp( "mqtt", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        MqttBenchConfig_t xConfig =
+        {
+            .ulMessages   = BENCH_CLI_MQTT_MESSAGES,
+            .ulPayloadLen = 0,
+            .ucQoS        = 0,
+        };
+
+        if( ulArgc >= 3 )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 2 ], "MESSAGES", MQTT_BENCH_MAX_MESSAGES, &( xConfig.ulMessages ) );
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc >= 4 ) )
+        {
+            if( strcmp( "1", ppcArgv[ 3 ] ) == 0 )
+            {
+                xConfig.ucQoS = 1;
+            }
+            else if( strcmp( "0", ppcArgv[ 3 ] ) != 0 )
+            {
+                pxCIO->print( "Error: QOS must be 0 or 1.\r\n" );
+                xValid = pdFALSE;
+            }
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc == 5 ) )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 4 ], "LENGTH", MQTT_AGENT_NETWORK_BUFFER_SIZE, &( xConfig.ulPayloadLen ) );
+
+            if( ( xValid == pdTRUE ) && ( xConfig.ulPayloadLen < MQTT_BENCH_MIN_PAYLOAD ) )
+            {
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "Error: LENGTH must be at least %lu.\r\n", ( uint32_t ) MQTT_BENCH_MIN_PAYLOAD );
+                pxCIO->print( pcCliScratchBuffer );
+                xValid = pdFALSE;
+            }
+        }
+
+        if( xValid == pdTRUE )
+        {
+            vBenchMqtt( pxCIO, &xConfig );
+        }
+    }
+    else if( ( ulArgc >= 5 ) &&
+             ( ulArgc <= 8 ) &&
+             ( strcmp( "tcp", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        BaseType_t xTls = pdFALSE;
+        BaseType_t xEcho = pdFALSE;
+        uint32_t ulPort = 0;
+        uint32_t ulKBytes = BENCH_CLI_TCP_KBYTES;
+        uint32_t ulChunk = BENCH_CLI_TCP_CHUNK;
+
+        if( strcmp( "tls", ppcArgv[ 2 ] ) == 0 )
+        {
+            xTls = pdTRUE;
+        }
+        else if( strcmp( "plain", ppcArgv[ 2 ] ) != 0 )
+        {
+            pxCIO->print( "Error: the path must be plain or tls.\r\n" );
+            xValid = pdFALSE;
+        }
+
+        if( xValid == pdTRUE )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 4 ], "PORT", UINT16_MAX, &ulPort );
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc >= 6 ) )
+        {
+            if( strcmp( "echo", ppcArgv[ 5 ] ) == 0 )
+            {
+                xEcho = pdTRUE;
+            }
+            else if( strcmp( "sink", ppcArgv[ 5 ] ) != 0 )
+            {
+                pxCIO->print( "Error: the mode must be sink or echo.\r\n" );
+                xValid = pdFALSE;
+            }
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc >= 7 ) )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 6 ], "KBYTES", BENCH_CLI_TCP_MAX_KBYTES, &ulKBytes );
+        }
+
+        if( ( xValid == pdTRUE ) && ( ulArgc == 8 ) )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 7 ], "CHUNK", BENCH_CLI_TCP_MAX_CHUNK, &ulChunk );
+        }
+
+        if( xValid == pdTRUE )
+        {
+            vBenchTcp( pxCIO, xTls, ppcArgv[ 3 ], ( uint16_t ) ulPort, xEcho,
+                       ulKBytes * 1024U, ( size_t ) ulChunk );
+        }
+    }
+
+    else if( ( ulArgc >= 2 ) &&
+             ( ulArgc <= 4 ) &&
+             ( strcmp( "micro", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        const char * pcName = NULL;
+        uint32_t ulRuns = BENCH_CLI_MICRO_RUNS;
+
+        if( ( ulArgc >= 3 ) && ( strcmp( "all", ppcArgv[ 2 ] ) != 0 ) )
+        {
+            pcName = ppcArgv[ 2 ];
+        }
+
+        if( ulArgc == 4 )
+        {
+            xValid = xParseBenchArg( pxCIO, ppcArgv[ 3 ], "RUNS", MICRO_BENCH_MAX_RUNS, &ulRuns );
+        }
+
+        if( xValid == pdTRUE )
+        {
+            vBenchMicro( pxCIO, pcName, ulRuns );
+        }
+    }
+
+    #ifndef TFM_PSA_API
+        else if( ( ulArgc >= 2 ) &&
+                 ( ulArgc <= 3 ) &&
+                 ( strcmp( "cache", ppcArgv[ 1 ] ) == 0 ) )
+        {
+            uint32_t ulIterations = BENCH_CLI_CACHE_ITER;
+
+            if( ulArgc == 3 )
+            {
+                xValid = xParseBenchArg( pxCIO, ppcArgv[ 2 ], "ITERATIONS", BENCH_CLI_CACHE_MAX_ITER, &ulIterations );
+            }
+
+            if( xValid == pdTRUE )
+            {
+                vBenchCache( pxCIO, ulIterations );
+            }
+        }
+    #endif /* ! defined( TFM_PSA_API ) */
+    else
+    {
+        pxCIO->print( xCommandDef_bench.pcHelpString );
+    }
+}
@@ -172,7 +172,7 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
             break;
     }
 
-    if( ( xKey == CS_NUM_KEYS ) ||
+    if( ( xKey == KVSTORE_KEY_INVALID ) ||
         ( xKvType == KV_TYPE_LAST ) )
     {
     }
@@ -194,7 +194,7 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
     }
     else
     {
-        if( ( xKey == CS_NUM_KEYS ) ||
+        if( ( xKey == KVSTORE_KEY_INVALID ) ||
             ( xKvType == KV_TYPE_NONE ) )
         {
             lResponseLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
@@ -213,9 +213,9 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
 
 static void vSubCommand_GetConfigAll( ConsoleIO_t * pxCIO )
 {
-    for( KVStoreKey_t key = 0; key < CS_NUM_KEYS; key++ )
+    for( KVStoreKey_t key = 0; key < KVStore_getNumKeys(); key++ )
     {
-        vSubCommand_GetConfig( pxCIO, kvStoreKeyMap[ key ] );
+        vSubCommand_GetConfig( pxCIO, kvKeyToString( key ) );
     }
 }
 
@@ -327,7 +327,7 @@ static void vSubCommand_SetConfig( ConsoleIO_t * pxCIO,
 
         if( xParseResult == pdFALSE )
         {
-            if( xKey == CS_NUM_KEYS )
+            if( xKey == KVSTORE_KEY_INVALID )
             {
                 lCharsPrinted = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
                                           "Error: key: %s was not recognized.\r\n",
@@ -0,0 +1,175 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "logging.h"
+#include "kvstore.h"
+
+/* Longest value of the log_levels key, every override set at its longest name */
+#define LOG_CLI_LEVELS_LEN    ( dlLOG_LEVEL_OVERRIDES * ( dlLOG_MODULE_NAME_LENGTH + 8 ) )
+
+static void vLogCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_log =
+{
+    "log",
+    "log level\r\n"
+    "    List the modules which have logged so far with their runtime level,\r\n"
+    "    and the levels stored in the log_levels key.\r\n"
+    "log level <module> <none|error|warn|info|debug|default>\r\n"
+    "    Set the runtime level of a source file, such as mqtt_agent_task, and\r\n"
+    "    save it to NVM. \"default\" restores the LOG_LEVEL of the file.\r\n"
+    "    Levels above LOG_LEVEL_MAX are compiled out.\r\n"
+    "log stats\r\n"
+    "    Report the messages and bytes queued for output and dropped since boot.\r\n\n",
+    vLogCommand
+};
+
+/*-----------------------------------------------------------*/
+
+void vLoggingLoadModuleLevels( void )
+{
+    char pcLevels[ LOG_CLI_LEVELS_LEN ];
+
+    ( void ) KVStore_getString( CS_LOG_LEVELS, pcLevels, sizeof( pcLevels ) );
+
+    if( lLoggingSetModuleLevels( pcLevels ) != 0 )
+    {
+        LogError( "Ignored invalid entries of the log_levels key: %s", pcLevels );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLogLevelList( ConsoleIO_t * const pxCIO )
+{
+    char pcLevels[ LOG_CLI_LEVELS_LEN ];
+
+    for( LogModule_t * pxModule = pxLoggingGetModules(); pxModule != NULL; pxModule = pxModule->pxNext )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "%-32s %-6s (default %s)\r\n",
+                           pxModule->pcName,
+                           pcLoggingLevelToString( pxModule->ucLevel ),
+                           pcLoggingLevelToString( pxModule->ucDefaultLevel ) );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    ( void ) xLoggingGetModuleLevels( pcLevels, sizeof( pcLevels ) );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "log_levels=\"%s\"\r\n", pcLevels );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLogLevelSet( ConsoleIO_t * const pxCIO,
+                          const char * pcModule,
+                          const char * pcLevel )
+{
+    char pcLevels[ LOG_CLI_LEVELS_LEN ];
+    BaseType_t xDefault = ( strcmp( pcLevel, "default" ) == 0 ) ? pdTRUE : pdFALSE;
+    int32_t lLevel = ( xDefault == pdTRUE ) ? -1 : lLoggingLevelFromString( pcLevel );
+
+    if( ( lLevel < 0 ) && ( xDefault == pdFALSE ) )
+    {
+        pxCIO->print( "Error: Invalid log level.\r\n" );
+    }
+    else if( lLoggingSetModuleLevel( pcModule, lLevel ) != 0 )
+    {
+        pxCIO->print( "Error: Invalid module name or too many log level overrides.\r\n" );
+    }
+    else
+    {
+        ( void ) xLoggingGetModuleLevels( pcLevels, sizeof( pcLevels ) );
+
+        if( ( KVStore_setString( CS_LOG_LEVELS, pcLevels ) == pdTRUE ) &&
+            ( KVStore_xCommitChanges() == pdTRUE ) )
+        {
+            pxCIO->print( "Log level saved to NVM.\r\n" );
+        }
+        else
+        {
+            pxCIO->print( "Error: Could not save the log level to NVM.\r\n" );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLogStats( ConsoleIO_t * const pxCIO )
+{
+    LoggingStats_t xStats;
+
+    vLoggingGetStats( &xStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "Queued:  %lu messages, %lu bytes\r\n"
+                       "Dropped: %lu messages, %lu bytes\r\n",
+                       ( unsigned long ) xStats.ulMessages,
+                       ( unsigned long ) xStats.ulBytes,
+                       ( unsigned long ) xStats.ulDroppedMessages,
+                       ( unsigned long ) xStats.ulDroppedBytes );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLogCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] )
+{
+    if( ( ulArgc == 2 ) &&
+        ( strcmp( "level", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vLogLevelList( pxCIO );
+    }
+    else if( ( ulArgc == 4 ) &&
+             ( strcmp( "level", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vLogLevelSet( pxCIO, ppcArgv[ 2 ], ppcArgv[ 3 ] );
+    }
+    else if( ( ulArgc == 2 ) &&
+             ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vLogStats( pxCIO );
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_log.pcHelpString );
+    }
+}
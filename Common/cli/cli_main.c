@@ -343,10 +343,29 @@ void Task_CLI( void * pvParameters )
     FreeRTOS_CLIRegisterCommand( &xCommandDef_kill );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_killAll );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_heapStat );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_stack );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_metrics );
+#if ( TRACE_REC_ENABLED == 1 )
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_trace );
+#endif
+#if ( SRAM_BANKS_ENABLED == 1 )
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_sram );
+#endif
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_boot );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_reset );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_uptime );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_top );
+#if ( SNTP_TIME_ENABLED == 1 )
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_time );
+#endif
     FreeRTOS_CLIRegisterCommand( &xCommandDef_rngtest );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_bench );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_assert );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_log );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_net );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_tls );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_mqtt );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_prov );
 
     char * pcCommandBuffer = NULL;
 
@@ -0,0 +1,311 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "stm32u5xx.h"
+
+#include "mqtt_agent_stats.h"
+#include "freertos_command_pool.h"
+#include "mqtt_outbox.h"
+#include "mqtt_payload_pool.h"
+#include "mqtt_dispatch.h"
+#include "mqtt_policy.h"
+#include "mqtt_stream.h"
+#include "subscription_manager.h"
+
+static const char * const pcCommandNames[ NUM_COMMANDS ] =
+{
+    "none",
+    "processloop",
+    "publish",
+    "subscribe",
+    "unsubscribe",
+    "ping",
+    "connect",
+    "disconnect",
+    "terminate",
+};
+
+static void vMqttCommand( ConsoleIO_t * const pxCIO,
+                          uint32_t ulArgc,
+                          char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_mqtt =
+{
+    "mqtt",
+    "mqtt\r\n"
+    "    mqtt stats\r\n"
+    "        Display the MQTT agent queue high-water mark, command pool and outbox\r\n"
+    "        usage and, per command type, log2 histograms of queue wait, dispatch and\r\n"
+    "        completion time.\r\n"
+    "        Bucket n counts events in [ 2^(n-1), 2^n ) us.\r\n"
+    "    mqtt stats reset\r\n"
+    "        Reset the MQTT agent statistics.\r\n"
+    "    mqtt topics\r\n"
+    "        Display the messages, payload bytes and callback time of each subscribed\r\n"
+    "        topic filter, per connection.\r\n"
+    "    mqtt topics reset\r\n"
+    "        Reset the topic filter statistics.\r\n\n",
+    vMqttCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void vPrintHistogram( ConsoleIO_t * const pxCIO,
+                             const char * pcName,
+                             const MqttAgentHistogram_t * pxHist )
+{
+    uint32_t ulAvgUs = 0;
+    size_t uxLen;
+
+    if( pxHist->ulCount > 0 )
+    {
+        ulAvgUs = ( uint32_t ) ( pxHist->ullTotalUs / pxHist->ulCount );
+    }
+
+    uxLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "    %-10s count: %lu, avg: %lu us, max: %lu us\r\n        buckets:",
+                      pcName, pxHist->ulCount, ulAvgUs, pxHist->ulMaxUs );
+
+    for( uint32_t ulBucket = 0; ( ulBucket < MQTT_AGENT_STATS_HIST_BUCKETS ) && ( uxLen < CLI_OUTPUT_SCRATCH_BUF_LEN ); ulBucket++ )
+    {
+        if( pxHist->ulBuckets[ ulBucket ] > 0 )
+        {
+            uxLen += snprintf( &( pcCliScratchBuffer[ uxLen ] ), CLI_OUTPUT_SCRATCH_BUF_LEN - uxLen,
+                               " %lu:%lu", ulBucket, pxHist->ulBuckets[ ulBucket ] );
+        }
+    }
+
+    pxCIO->print( pcCliScratchBuffer );
+    pxCIO->print( "\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vPrintMqttStats( ConsoleIO_t * const pxCIO )
+{
+    static MqttAgentCommandStats_t xCmdStats;
+    MqttAgentQueueStats_t xQueueStats;
+    AgentCommandPoolStats_t xPoolStats;
+    MqttOutboxStats_t xOutboxStats;
+    MqttPayloadPoolStats_t xPayloadStats;
+    MqttDispatchStats_t xDispatchStats;
+    MqttPolicyStats_t xPolicyStats = { 0 };
+    MqttStreamStats_t xStreamStats;
+
+    MqttAgent_GetQueueStats( &xQueueStats );
+    Agent_GetPoolStats( &xPoolStats );
+    vMqttOutboxGetStats( &xOutboxStats );
+    vMqttPayloadGetStats( &xPayloadStats );
+    vMqttDispatchGetStats( &xDispatchStats );
+    vMqttPolicyGetStats( &xPolicyStats );
+    vMqttStreamGetStats( &xStreamStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "commands: %lu, queue high-water mark: %lu / %lu\r\n"
+                       "command pool in use: %lu, peak: %lu, failed gets: %lu, max wait: %lu ms\r\n"
+                       "outbox bytes in use: %lu / %lu, peak: %lu, stored: %lu, full: %lu, referenced: %lu\r\n"
+                       "deferred publishes: %lu (lent: %lu, copied: %lu), inline: %lu, peak queued: %lu / %lu\r\n"
+                       "policy rate limited: %lu, refused: %lu, qos changed: %lu, high priority: %lu\r\n",
+                       xQueueStats.ulCommandsProcessed,
+                       xQueueStats.ulQueueHighWaterMark,
+                       ( uint32_t ) MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                       xPoolStats.ulInUse,
+                       xPoolStats.ulPeakInUse,
+                       xPoolStats.ulFailedGets,
+                       xPoolStats.ulMaxWaitMs,
+                       xOutboxStats.ulBytesInUse,
+                       ( uint32_t ) MQTT_OUTBOX_SIZE,
+                       xOutboxStats.ulPeakBytesInUse,
+                       xOutboxStats.ulStored,
+                       xOutboxStats.ulFull,
+                       xOutboxStats.ulReferenced,
+                       xDispatchStats.ulDeferred,
+                       xDispatchStats.ulLent,
+                       xDispatchStats.ulCopied,
+                       xDispatchStats.ulInline,
+                       xDispatchStats.ulPeakQueued,
+                       ( uint32_t ) MQTT_DISPATCH_QUEUE_LENGTH,
+                       xPolicyStats.ulLimited,
+                       xPolicyStats.ulRejected,
+                       xPolicyStats.ulQoSChanged,
+                       xPolicyStats.ulHighPriority );
+    pxCIO->print( pcCliScratchBuffer );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "payload buffers in use: %lu, peak: %lu, allocs: %lu, larger class: %lu, failed: %lu\r\n"
+                       "streamed publishes: %lu, chunks: %lu, bytes: %lu, discarded: %lu, aborted: %lu\r\n",
+                       xPayloadStats.ulInUse,
+                       xPayloadStats.ulPeakInUse,
+                       xPayloadStats.ulAllocs,
+                       xPayloadStats.ulFallbacks,
+                       xPayloadStats.ulFailed,
+                       xStreamStats.ulStreamed,
+                       xStreamStats.ulChunks,
+                       xStreamStats.ulBytes,
+                       xStreamStats.ulDiscarded,
+                       xStreamStats.ulAborted );
+    pxCIO->print( pcCliScratchBuffer );
+
+    for( uint32_t ulType = 0; ulType < NUM_COMMANDS; ulType++ )
+    {
+        MqttAgent_GetCommandStats( ( MQTTAgentCommandType_t ) ulType, &xCmdStats );
+
+        if( xCmdStats.xQueueWait.ulCount > 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "\r\n%s:\r\n", pcCommandNames[ ulType ] );
+            pxCIO->print( pcCliScratchBuffer );
+
+            vPrintHistogram( pxCIO, "queue", &( xCmdStats.xQueueWait ) );
+            vPrintHistogram( pxCIO, "dispatch", &( xCmdStats.xDispatch ) );
+            vPrintHistogram( pxCIO, "complete", &( xCmdStats.xComplete ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Each agent instance once, a missing bulk connection falls back to the control one */
+static MQTTAgentHandle_t xTopicStatsHandle( MqttAgentConnection_t xConnection )
+{
+    MQTTAgentHandle_t xHandle = xGetMqttAgentConnectionHandle( xConnection );
+
+    if( ( xConnection != MQTT_AGENT_CONN_CONTROL ) &&
+        ( xHandle == xGetMqttAgentConnectionHandle( MQTT_AGENT_CONN_CONTROL ) ) )
+    {
+        xHandle = NULL;
+    }
+
+    return xHandle;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vPrintTopicStats( ConsoleIO_t * const pxCIO )
+{
+    static MqttAgentTopicStats_t xStats[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    static const char * const pcConnectionNames[ MQTT_AGENT_CONN_MAX ] = { "control", "bulk" };
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+
+    if( ulCyclesPerUs == 0 )
+    {
+        ulCyclesPerUs = 1;
+    }
+
+    for( uint32_t ulConn = 0; ulConn < MQTT_AGENT_CONN_MAX; ulConn++ )
+    {
+        MQTTAgentHandle_t xHandle = xTopicStatsHandle( ( MqttAgentConnection_t ) ulConn );
+        size_t uxCount = 0;
+
+        if( xHandle == NULL )
+        {
+            continue;
+        }
+
+        uxCount = MqttAgent_GetTopicStats( xHandle, xStats, MQTT_AGENT_MAX_SUBSCRIPTIONS );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%s connection, %u topic filters:\r\n"
+                           "%-40s %3s %8s %10s %10s %8s %8s\r\n",
+                           pcConnectionNames[ ulConn ], ( unsigned int ) uxCount,
+                           "filter", "cbs", "messages", "bytes", "cb ms", "avg us", "max us" );
+        pxCIO->print( pcCliScratchBuffer );
+
+        for( size_t uxIdx = 0; uxIdx < uxCount; uxIdx++ )
+        {
+            const MqttAgentTopicStats_t * pxEntry = &( xStats[ uxIdx ] );
+            uint32_t ulAvgUs = 0;
+
+            if( pxEntry->ulMessages > 0 )
+            {
+                ulAvgUs = ( uint32_t ) ( pxEntry->ullCallbackCycles / pxEntry->ulMessages / ulCyclesPerUs );
+            }
+
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "%-40.40s %3lu %8lu %10lu %10lu %8lu %8lu\r\n",
+                               pxEntry->pcTopicFilter,
+                               pxEntry->ulCallbacks,
+                               pxEntry->ulMessages,
+                               ( uint32_t ) pxEntry->ullBytes,
+                               ( uint32_t ) ( pxEntry->ullCallbackCycles / ulCyclesPerUs / 1000U ),
+                               ulAvgUs,
+                               pxEntry->ulMaxCallbackCycles / ulCyclesPerUs );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vMqttCommand( ConsoleIO_t * const pxCIO,
+                          uint32_t ulArgc,
+                          char * ppcArgv[] )
+{
+    if( ( ulArgc == 2 ) &&
+        ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vPrintMqttStats( pxCIO );
+    }
+    else if( ( ulArgc == 3 ) &&
+             ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) &&
+             ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+    {
+        MqttAgent_ResetStats();
+        pxCIO->print( "MQTT agent statistics reset.\r\n" );
+    }
+    else if( ( ulArgc == 2 ) &&
+             ( strcmp( "topics", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vPrintTopicStats( pxCIO );
+    }
+    else if( ( ulArgc == 3 ) &&
+             ( strcmp( "topics", ppcArgv[ 1 ] ) == 0 ) &&
+             ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+    {
+        for( uint32_t ulConn = 0; ulConn < MQTT_AGENT_CONN_MAX; ulConn++ )
+        {
+            MqttAgent_ResetTopicStats( xTopicStatsHandle( ( MqttAgentConnection_t ) ulConn ) );
+        }
+
+        pxCIO->print( "Topic filter statistics reset.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_mqtt.pcHelpString );
+    }
+}
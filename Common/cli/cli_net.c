@@ -0,0 +1,460 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "stm32u5xx.h"
+
+#include "mx_stats.h"
+#include "lwip/sys.h"
+
+/* Maximum number of lwIP mailboxes listed by "net mbox" */
+#define NET_CLI_MAX_MBOX               16
+
+/* Buffer length and default iteration count used by "net chksum" */
+#define NET_CLI_CHKSUM_LEN             1500
+#define NET_CLI_CHKSUM_ITERATIONS      1000
+
+#if LWIP_SYS_ARCH_STATS
+    static uint32_t ulTimingAvg( const sys_arch_timing_t * pxTiming )
+    {
+        return ( pxTiming->ulCount > 0 ) ? ( uint32_t ) ( pxTiming->ullTotal / pxTiming->ulCount ) : 0;
+    }
+
+    static void vPrintTiming( ConsoleIO_t * const pxCIO,
+                              const char * pcLabel,
+                              const sys_arch_timing_t * pxTiming )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-18s count: %lu, avg: %lu, max: %lu\r\n",
+                           pcLabel,
+                           pxTiming->ulCount,
+                           ulTimingAvg( pxTiming ),
+                           pxTiming->ulMax );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+#endif /* LWIP_SYS_ARCH_STATS */
+
+static void vPrintLwipStats( ConsoleIO_t * const pxCIO )
+{
+    #if LWIP_SYS_ARCH_STATS
+        static sys_arch_stats_t xSysStats;
+        UBaseType_t uxNumTasks = uxTaskGetNumberOfTasks();
+        TaskStatus_t * pxTaskStatusArray = ( TaskStatus_t * ) pvPortMalloc( sizeof( TaskStatus_t ) * uxNumTasks );
+
+        if( pxTaskStatusArray != NULL )
+        {
+            uxNumTasks = uxTaskGetSystemState( pxTaskStatusArray, uxNumTasks, NULL );
+        }
+        else
+        {
+            uxNumTasks = 0;
+        }
+
+        sys_arch_get_stats( &xSysStats );
+
+        vPrintTiming( pxCIO, "Semaphore wait:", &( xSysStats.xSemWait ) );
+        vPrintTiming( pxCIO, "Mutex wait:", &( xSysStats.xMutexWait ) );
+        vPrintTiming( pxCIO, "Core lock wait:", &( xSysStats.xCoreLockWait ) );
+        vPrintTiming( pxCIO, "Core lock hold:", &( xSysStats.xCoreLockHold ) );
+
+        pxCIO->print( "Task             Locks      Wait avg  Wait max  Hold avg  Hold max  Stack HWM\r\n" );
+
+        for( uint32_t i = 0; i < xSysStats.ulTaskCount; i++ )
+        {
+            const sys_arch_task_lock_stats_t * pxEntry = &( xSysStats.xTasks[ i ] );
+            long lStackHwm = -1;
+
+            /* Only report the stack high water mark of tasks which still exist */
+            for( UBaseType_t j = 0; j < uxNumTasks; j++ )
+            {
+                if( pxTaskStatusArray[ j ].xHandle == pxEntry->xTask )
+                {
+                    lStackHwm = ( long ) pxTaskStatusArray[ j ].usStackHighWaterMark;
+                    break;
+                }
+            }
+
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "%-16s %-10lu %-9lu %-9lu %-9lu %-9lu %ld\r\n",
+                               pxEntry->pcTaskName,
+                               pxEntry->xLockHold.ulCount,
+                               ulTimingAvg( &( pxEntry->xLockWait ) ),
+                               pxEntry->xLockWait.ulMax,
+                               ulTimingAvg( &( pxEntry->xLockHold ) ),
+                               pxEntry->xLockHold.ulMax,
+                               lStackHwm );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        if( xSysStats.ulTasksDropped > 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Core lock acquisitions by untracked tasks: %lu\r\n",
+                               xSysStats.ulTasksDropped );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        pxCIO->print( "Times are in run time counter ticks, stack HWM in words (-1: task deleted).\r\n" );
+
+        if( pxTaskStatusArray != NULL )
+        {
+            vPortFree( pxTaskStatusArray );
+        }
+    #else /* if LWIP_SYS_ARCH_STATS */
+        pxCIO->print( "lwIP port statistics are disabled (LWIP_SYS_ARCH_STATS).\r\n" );
+    #endif /* LWIP_SYS_ARCH_STATS */
+}
+
+static void vResetLwipStats( ConsoleIO_t * const pxCIO )
+{
+    #if LWIP_SYS_ARCH_STATS
+        sys_arch_reset_stats();
+        pxCIO->print( "lwIP port statistics reset.\r\n" );
+    #else
+        pxCIO->print( "lwIP port statistics are disabled (LWIP_SYS_ARCH_STATS).\r\n" );
+    #endif /* LWIP_SYS_ARCH_STATS */
+}
+
+static void vNetCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_net =
+{
+    "net",
+    "net\r\n"
+    "    net stats\r\n"
+    "        Display wifi module SPI dataplane counters and timing histograms.\r\n\n"
+    "    net stats reset\r\n"
+    "        Reset wifi module SPI dataplane counters and timing histograms.\r\n\n"
+    "    net mbox [reset]\r\n"
+    "        Display or reset lwIP mailbox depth and latency statistics.\r\n\n"
+    "    net lwip [reset]\r\n"
+    "        Display or reset lwIP lock and semaphore contention statistics.\r\n\n"
+    "    net chksum [iterations]\r\n"
+    "        Compare the port's LWIP_CHKSUM against the stock lwIP algorithm on MTU sized buffers.\r\n\n",
+    vNetCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void vPrintHistogram( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             const MxStatsHistogram_t * pxHist )
+{
+    uint32_t ulAvgUs = 0;
+
+    if( pxHist->ulCount > 0 )
+    {
+        ulAvgUs = ( uint32_t ) ( pxHist->ullTotalUs / pxHist->ulCount );
+    }
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%s: count: %lu, avg: %lu us, max: %lu us\r\n",
+                       pcLabel,
+                       pxHist->ulCount,
+                       ulAvgUs,
+                       pxHist->ulMaxUs );
+    pxCIO->print( pcCliScratchBuffer );
+
+    for( uint32_t i = 0; i < MX_STATS_HIST_BUCKETS; i++ )
+    {
+        if( pxHist->ulBuckets[ i ] == 0 )
+        {
+            continue;
+        }
+
+        if( i == 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    %10s < %-7lu : %lu\r\n", "", 1UL, pxHist->ulBuckets[ i ] );
+        }
+        else if( i == ( MX_STATS_HIST_BUCKETS - 1 ) )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    %10lu <= %-7s: %lu\r\n", ( 1UL << ( i - 1 ) ), "", pxHist->ulBuckets[ i ] );
+        }
+        else
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    %10lu - %-7lu : %lu\r\n", ( 1UL << ( i - 1 ) ), ( 1UL << i ), pxHist->ulBuckets[ i ] );
+        }
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+static void vPrintDataplaneStats( ConsoleIO_t * const pxCIO )
+{
+    MxDataplaneStats_t xStats;
+
+    /* newlib-nano printf does not support 64 bit integers, so byte counts are printed in KiB */
+    mx_GetDataplaneStats( &xStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "Transactions:     %lu (errors: %lu, flow timeouts: %lu)\r\n"
+                       "Flow wait:        spin: %lu, blocking: %lu, spin budget: %lu cycles\r\n"
+                       "TX:               %lu frames, %lu KiB\r\n"
+                       "RX:               %lu frames, %lu KiB\r\n"
+                       "RX buffer pool:   high water mark: %lu, exhausted: %lu\r\n"
+                       "TX queue:         high water mark: %lu, full: %lu\r\n",
+                       xStats.ulTransactions,
+                       xStats.ulTransactionErrors,
+                       xStats.ulFlowTimeouts,
+                       xStats.ulFlowSpinHits,
+                       xStats.ulFlowBlockingWaits,
+                       xStats.ulFlowSpinBudget,
+                       xStats.ulTxFrames,
+                       ( uint32_t ) ( xStats.ullTxBytes / 1024 ),
+                       xStats.ulRxFrames,
+                       ( uint32_t ) ( xStats.ullRxBytes / 1024 ),
+                       xStats.ulRxPoolHighWaterMark,
+                       xStats.ulRxPoolExhausted,
+                       xStats.ulTxQueueHighWaterMark,
+                       xStats.ulTxQueueFull );
+    pxCIO->print( pcCliScratchBuffer );
+
+    pxCIO->print( "Timing histograms (us):\r\n" );
+    vPrintHistogram( pxCIO, "Flow wait", &( xStats.xFlowWait ) );
+    vPrintHistogram( pxCIO, "Header exchange", &( xStats.xHeaderExchange ) );
+    vPrintHistogram( pxCIO, "Payload transfer", &( xStats.xPayloadTransfer ) );
+    vPrintHistogram( pxCIO, "Notify IRQ to task", &( xStats.xNotifyLatency ) );
+    vPrintHistogram( pxCIO, "Flow IRQ to task", &( xStats.xFlowLatency ) );
+}
+
+static void vPrintMboxStats( ConsoleIO_t * const pxCIO )
+{
+    #if LWIP_MBOX_STATS
+        static sys_mbox_stats_t xMboxStats[ NET_CLI_MAX_MBOX ];
+        uint32_t ulEntries = sys_arch_mbox_get_stats( xMboxStats, NET_CLI_MAX_MBOX );
+
+        pxCIO->print( "Consumer         Size  Depth  HWM    Posts      Full   Lat avg  Lat max\r\n" );
+
+        for( uint32_t i = 0; i < ulEntries; i++ )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "%-16s %-5lu %-6lu %-6lu %-10lu %-6lu %-8lu %lu\r\n",
+                               ( xMboxStats[ i ].pcConsumerName[ 0 ] != '\0' ) ? xMboxStats[ i ].pcConsumerName : "-",
+                               xMboxStats[ i ].ulSize,
+                               xMboxStats[ i ].ulDepth,
+                               xMboxStats[ i ].ulHighWaterMark,
+                               xMboxStats[ i ].ulPosts,
+                               xMboxStats[ i ].ulFullCount,
+                               xMboxStats[ i ].ulLatencyAvg,
+                               xMboxStats[ i ].ulLatencyMax );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        pxCIO->print( "Latencies are in run time counter ticks.\r\n" );
+    #else
+        pxCIO->print( "Mailbox statistics are disabled (LWIP_MBOX_STATS).\r\n" );
+    #endif /* LWIP_MBOX_STATS */
+}
+
+static void vResetMboxStats( ConsoleIO_t * const pxCIO )
+{
+    #if LWIP_MBOX_STATS
+        sys_arch_mbox_reset_stats();
+        pxCIO->print( "Mailbox statistics reset.\r\n" );
+    #else
+        pxCIO->print( "Mailbox statistics are disabled (LWIP_MBOX_STATS).\r\n" );
+    #endif /* LWIP_MBOX_STATS */
+}
+
+#if LWIP_CHKSUM_BENCHMARK
+    typedef u16_t ( * ChksumFunction_t )( const void * pvData,
+                                          int lLen );
+
+    /* Return the number of CPU cycles taken by ulIterations calls of xChksum */
+    static uint32_t ulTimeChksum( ChksumFunction_t xChksum,
+                                  const uint8_t * pucData,
+                                  int lLen,
+                                  uint32_t ulIterations )
+    {
+        volatile u16_t usResult = 0;
+        uint32_t ulStart = DWT->CYCCNT;
+
+        for( uint32_t i = 0; i < ulIterations; i++ )
+        {
+            usResult += xChksum( pucData, lLen );
+        }
+
+        ( void ) usResult;
+
+        return DWT->CYCCNT - ulStart;
+    }
+#endif /* LWIP_CHKSUM_BENCHMARK */
+
+static void vChksumBenchmark( ConsoleIO_t * const pxCIO,
+                              uint32_t ulIterations )
+{
+    #if LWIP_CHKSUM_BENCHMARK
+        /* Extra bytes allow every start alignment to be exercised */
+        static uint8_t ucBuffer[ NET_CLI_CHKSUM_LEN + sizeof( uint32_t ) ] __attribute__( ( aligned( 4 ) ) );
+        BaseType_t xMatch = pdTRUE;
+
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+        for( uint32_t i = 0; i < sizeof( ucBuffer ); i++ )
+        {
+            ucBuffer[ i ] = ( uint8_t ) ( ( i * 131U ) ^ ( i >> 3 ) );
+        }
+
+        /* Check that both implementations agree on every alignment and a range of lengths */
+        for( uint32_t ulOffset = 0; ulOffset < sizeof( uint32_t ); ulOffset++ )
+        {
+            for( int lLen = 0; lLen <= NET_CLI_CHKSUM_LEN; lLen += ( lLen < 64 ) ? 1 : 61 )
+            {
+                if( lwip_arch_chksum( &ucBuffer[ ulOffset ], lLen ) !=
+                    lwip_reference_chksum( &ucBuffer[ ulOffset ], lLen ) )
+                {
+                    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                       "Mismatch at offset %lu, length %d\r\n",
+                                       ulOffset, lLen );
+                    pxCIO->print( pcCliScratchBuffer );
+                    xMatch = pdFALSE;
+                }
+            }
+        }
+
+        if( xMatch == pdTRUE )
+        {
+            pxCIO->print( "offset  reference cycles/call  port cycles/call\r\n" );
+
+            for( uint32_t ulOffset = 0; ulOffset < sizeof( uint32_t ); ulOffset++ )
+            {
+                uint32_t ulReference = ulTimeChksum( lwip_reference_chksum, &ucBuffer[ ulOffset ],
+                                                     NET_CLI_CHKSUM_LEN, ulIterations );
+                uint32_t ulPort = ulTimeChksum( lwip_arch_chksum, &ucBuffer[ ulOffset ],
+                                                NET_CLI_CHKSUM_LEN, ulIterations );
+
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "%6lu  %22lu  %16lu\r\n",
+                                   ulOffset,
+                                   ulReference / ulIterations,
+                                   ulPort / ulIterations );
+                pxCIO->print( pcCliScratchBuffer );
+            }
+        }
+    #else
+        ( void ) ulIterations;
+        pxCIO->print( "Checksum benchmark is disabled (LWIP_CHKSUM_BENCHMARK).\r\n" );
+    #endif /* LWIP_CHKSUM_BENCHMARK */
+}
+
+static void vNetCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] )
+{
+    if( ( ulArgc >= 2 ) &&
+        ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( ulArgc == 2 )
+        {
+            vPrintDataplaneStats( pxCIO );
+        }
+        else if( ( ulArgc == 3 ) &&
+                 ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+        {
+            mx_ResetDataplaneStats();
+            pxCIO->print( "Dataplane statistics reset.\r\n" );
+        }
+        else
+        {
+            pxCIO->print( xCommandDef_net.pcHelpString );
+        }
+    }
+    else if( ( ulArgc >= 2 ) &&
+             ( strcmp( "mbox", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( ulArgc == 2 )
+        {
+            vPrintMboxStats( pxCIO );
+        }
+        else if( ( ulArgc == 3 ) &&
+                 ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+        {
+            vResetMboxStats( pxCIO );
+        }
+        else
+        {
+            pxCIO->print( xCommandDef_net.pcHelpString );
+        }
+    }
+    else if( ( ulArgc >= 2 ) &&
+             ( strcmp( "lwip", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( ulArgc == 2 )
+        {
+            vPrintLwipStats( pxCIO );
+        }
+        else if( ( ulArgc == 3 ) &&
+                 ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+        {
+            vResetLwipStats( pxCIO );
+        }
+        else
+        {
+            pxCIO->print( xCommandDef_net.pcHelpString );
+        }
+    }
+    else if( ( ulArgc >= 2 ) &&
+             ( strcmp( "chksum", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        uint32_t ulIterations = NET_CLI_CHKSUM_ITERATIONS;
+
+        if( ulArgc == 3 )
+        {
+            ulIterations = ( uint32_t ) strtoul( ppcArgv[ 2 ], NULL, 0 );
+        }
+
+        if( ( ulArgc > 3 ) || ( ulIterations == 0 ) )
+        {
+            pxCIO->print( xCommandDef_net.pcHelpString );
+        }
+        else
+        {
+            vChksumBenchmark( pxCIO, ulIterations );
+        }
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_net.pcHelpString );
+    }
+}
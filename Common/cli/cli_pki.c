@@ -171,13 +171,12 @@ static void vPrintDer( ConsoleIO_t * pxCIO,
 
 #define CSR_BUFFER_LEN    2048
 
-static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
-                                     uint32_t ulArgc,
-                                     char * ppcArgv[] )
+BaseType_t xCliGenerateCsrDer( const char * pcPrvKeyLabel,
+                               unsigned char * pucCsrDer,
+                               size_t uxBufferLen,
+                               size_t * puxCsrDerLen )
 {
     PkiStatus_t xStatus = PKI_SUCCESS;
-    char * pcPrvKeyLabel = NULL;
-    unsigned char * pucCsrDer = NULL;
     size_t uxCsrDerLen = 0;
     mbedtls_pk_context xPkCtx;
     mbedtls_entropy_context xEntropyCtx;
@@ -185,17 +184,12 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
 
     int lError = -1;
 
-    pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
-
-    if( ( ulArgc > LABEL_IDX ) &&
-        ( ppcArgv[ LABEL_IDX ] != NULL ) )
-    {
-        pcPrvKeyLabel = ppcArgv[ LABEL_IDX ];
-    }
+    configASSERT( pcPrvKeyLabel != NULL );
+    configASSERT( pucCsrDer != NULL );
+    configASSERT( puxCsrDerLen != NULL );
 
     xPrvKeyObj = xPkiObjectFromLabel( pcPrvKeyLabel );
 
-    pucCsrDer = pvPortMalloc( CSR_BUFFER_LEN );
     mbedtls_pk_init( &xPkCtx );
     mbedtls_entropy_init( &xEntropyCtx );
 
@@ -241,16 +235,16 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
 
             lError = mbedtls_x509write_csr_der( &xCsr,
                                                 pucCsrDer,
-                                                CSR_BUFFER_LEN,
+                                                uxBufferLen,
                                                 mbedtls_entropy_func, &xEntropyCtx );
 
             /* mbedtls_x509write_csr_der returns the length of data written to the end of the buffer. */
             if( lError > 0 )
             {
-                configASSERT( CSR_BUFFER_LEN > lError );
+                configASSERT( uxBufferLen > ( size_t ) lError );
                 uxCsrDerLen = ( size_t ) lError;
 
-                ( void ) memmove( pucCsrDer, &( pucCsrDer[ CSR_BUFFER_LEN - lError ] ), uxCsrDerLen );
+                ( void ) memmove( pucCsrDer, &( pucCsrDer[ uxBufferLen - lError ] ), uxCsrDerLen );
                 lError = 0;
             }
 
@@ -267,9 +261,37 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
         }
     }
 
-    if( ( lError >= 0 ) &&
-        ( uxCsrDerLen > 0 ) &&
-        ( pucCsrDer != NULL ) )
+    mbedtls_entropy_free( &xEntropyCtx );
+
+    #ifdef MBEDTLS_TRANSPORT_PKCS11
+        ( void ) lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
+    #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+
+    *puxCsrDerLen = uxCsrDerLen;
+
+    return ( ( lError >= 0 ) && ( uxCsrDerLen > 0 ) ) ? pdTRUE : pdFALSE;
+}
+
+static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
+                                     uint32_t ulArgc,
+                                     char * ppcArgv[] )
+{
+    char * pcPrvKeyLabel = NULL;
+    unsigned char * pucCsrDer = NULL;
+    size_t uxCsrDerLen = 0;
+
+    pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
+
+    if( ( ulArgc > LABEL_IDX ) &&
+        ( ppcArgv[ LABEL_IDX ] != NULL ) )
+    {
+        pcPrvKeyLabel = ppcArgv[ LABEL_IDX ];
+    }
+
+    pucCsrDer = pvPortMalloc( CSR_BUFFER_LEN );
+
+    if( ( pucCsrDer != NULL ) &&
+        ( xCliGenerateCsrDer( pcPrvKeyLabel, pucCsrDer, CSR_BUFFER_LEN, &uxCsrDerLen ) == pdTRUE ) )
     {
         vPrintDer( pxCIO,
                    "-----BEGIN CERTIFICATE REQUEST-----\r\n",
@@ -281,12 +303,6 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
     {
         vPortFree( pucCsrDer );
     }
-
-    mbedtls_entropy_free( &xEntropyCtx );
-
-    #ifdef MBEDTLS_TRANSPORT_PKCS11
-        lError = lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
-    #endif /* MBEDTLS_TRANSPORT_PKCS11 */
 }
 
 static void vSubCommand_GenerateCertificate( ConsoleIO_t * pxCIO,
@@ -0,0 +1,868 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "logging.h"
+#include "kvstore.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "tls_transport_config.h"
+#include "mbedtls_transport.h"
+
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/*
+ * Binary provisioning mode of the console.
+ *
+ * Each frame is the COBS encoding of [ payload ][ CRC-32 of payload, little endian ] followed
+ * by a 0x00 delimiter. A request payload is [ type ][ seq ][ body ], the response to it is
+ * [ type | 0x80 ][ seq ][ status ][ body ]. Requests are answered one at a time, in order.
+ *
+ * The whole session runs inside one KVStore transaction, so any number of KV_SET requests
+ * cost a single write of the store, at KV_COMMIT or at the end of the session.
+ */
+
+#define PROV_VERSION               1
+
+/* Largest request or response payload, the CSR and certificate DER must fit */
+#ifndef PROV_PAYLOAD_MAX
+    #define PROV_PAYLOAD_MAX       ( 4096U )
+#endif
+
+/* Leave the mode when no byte was received for this long */
+#ifndef PROV_IDLE_TIMEOUT_MS
+    #define PROV_IDLE_TIMEOUT_MS    ( 30000U )
+#endif
+
+#define PROV_CRC_LEN               ( 4U )
+#define PROV_REQ_HDR_LEN           ( 2U )
+#define PROV_RESP_HDR_LEN          ( 3U )
+#define PROV_FRAME_MAX             ( PROV_RESP_HDR_LEN + PROV_PAYLOAD_MAX + PROV_CRC_LEN )
+
+/* COBS adds one byte per 254 and one overhead byte, plus the delimiter */
+#define PROV_ENCODED_MAX           ( PROV_FRAME_MAX + ( PROV_FRAME_MAX / 254U ) + 2U )
+
+#define PROV_RESP_FLAG             ( 0x80U )
+
+typedef enum
+{
+    PROV_HELLO = 0x01,
+    PROV_KV_SET = 0x02,
+    PROV_KV_COMMIT = 0x03,
+    PROV_CERT_IMPORT = 0x04,
+    PROV_PUBKEY_IMPORT = 0x05,
+    PROV_KEY_GENERATE = 0x06,
+    PROV_CSR = 0x07,
+    PROV_CERT_EXPORT = 0x08,
+    PROV_PUBKEY_EXPORT = 0x09,
+    PROV_END = 0x0F
+} ProvType_t;
+
+typedef enum
+{
+    PROV_STATUS_OK = 0,
+    PROV_STATUS_BAD_FRAME = 1,
+    PROV_STATUS_UNKNOWN_TYPE = 2,
+    PROV_STATUS_BAD_ARG = 3,
+    PROV_STATUS_FAILED = 4,
+    PROV_STATUS_TOO_LONG = 5
+} ProvStatus_t;
+
+typedef struct
+{
+    ConsoleIO_t * pxCIO;
+    uint8_t * pucRx;   /* Encoded bytes received */
+    uint8_t * pucReq;  /* Decoded request, then the encoded response */
+    uint8_t * pucResp; /* Response payload */
+    size_t uxRxLen;
+    size_t uxRespBodyLen;
+    BaseType_t xDone;
+} ProvSession_t;
+
+static void vCommand_Prov( ConsoleIO_t * pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_prov =
+{
+    "prov",
+    "prov:\r\n"
+    "    Switch the console to the binary provisioning protocol. Frames are COBS encoded\r\n"
+    "    [ payload ][ crc32 le ] followed by 0x00. Requests are [ type ][ seq ][ body ],\r\n"
+    "    responses [ type | 0x80 ][ seq ][ status ][ body ].\r\n"
+    "    Labels are [ len ][ label ], a zero length selects the default label.\r\n\n"
+    "        0x01 hello          -> [ version ][ max payload u16 ]\r\n"
+    "        0x02 kv set         [ keylen ][ key ][ len u16 ][ value ] ... -> [ count u16 ]\r\n"
+    "                            integers are given in decimal, as for conf set\r\n"
+    "        0x03 kv commit\r\n"
+    "        0x04 cert import    [ label ][ der ]\r\n"
+    "        0x05 pubkey import  [ label ][ der ]\r\n"
+    "        0x06 key generate   [ prv label ][ pub label ] -> [ public key der ]\r\n"
+    "        0x07 csr            [ prv label ] -> [ csr der ]\r\n"
+    "        0x08 cert export    [ label ] -> [ der ]\r\n"
+    "        0x09 pubkey export  [ label ] -> [ der ]\r\n"
+    "        0x0f end            commit and return to the text console\r\n\n"
+    "    Status: 0 ok, 1 bad frame, 2 unknown type, 3 bad argument, 4 failed, 5 too long.\r\n"
+    "    Staged configuration is also written when the mode ends on its idle timeout.\r\n\n",
+    vCommand_Prov
+};
+
+/*-----------------------------------------------------------*/
+
+/* littlefs, and with it the port's lfs_crc, is only built by the projects which define LFS_CONFIG */
+#ifdef LFS_CONFIG
+/* Reflected CRC-32 of the littlefs port, computed by the CRC unit unless LFS_CRC_USE_HW is 0 */
+uint32_t lfs_crc( uint32_t crc,
+                  const void * buffer,
+                  size_t size );
+
+static uint32_t prvCrc32( const uint8_t * pucData,
+                          size_t uxLen )
+{
+    return lfs_crc( 0xFFFFFFFF, pucData, uxLen ) ^ 0xFFFFFFFF;
+}
+#else
+static uint32_t prvCrc32( const uint8_t * pucData,
+                          size_t uxLen )
+{
+    static const uint32_t ulCrcNibbleTable[ 16 ] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t ulCrc = 0xFFFFFFFF;
+
+    for( size_t i = 0; i < uxLen; i++ )
+    {
+        ulCrc ^= pucData[ i ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulCrcNibbleTable[ ulCrc & 0xF ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulCrcNibbleTable[ ulCrc & 0xF ];
+    }
+
+    return ulCrc ^ 0xFFFFFFFF;
+}
+#endif /* LFS_CONFIG */
+
+/*-----------------------------------------------------------*/
+
+/* Decode a COBS frame without its delimiter. Returns the decoded length, 0 if malformed */
+static size_t prvCobsDecode( const uint8_t * pucIn,
+                             size_t uxInLen,
+                             uint8_t * pucOut,
+                             size_t uxOutMax )
+{
+    size_t uxIn = 0;
+    size_t uxOut = 0;
+    BaseType_t xValid = pdTRUE;
+
+    while( ( uxIn < uxInLen ) && ( xValid == pdTRUE ) )
+    {
+        uint8_t ucCode = pucIn[ uxIn++ ];
+
+        if( ( ucCode == 0 ) ||
+            ( ( uxIn + ucCode - 1 ) > uxInLen ) ||
+            ( ( uxOut + ucCode ) > uxOutMax ) )
+        {
+            xValid = pdFALSE;
+        }
+        else
+        {
+            ( void ) memcpy( &( pucOut[ uxOut ] ), &( pucIn[ uxIn ] ), ucCode - 1 );
+            uxIn += ucCode - 1;
+            uxOut += ucCode - 1;
+
+            /* A zero followed every group but a full one, and the last group */
+            if( ( ucCode < 0xFF ) && ( uxIn < uxInLen ) )
+            {
+                pucOut[ uxOut++ ] = 0;
+            }
+        }
+    }
+
+    return ( xValid == pdTRUE ) ? uxOut : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Encode uxInLen bytes and append the delimiter. pucOut must hold the COBS worst case */
+static size_t prvCobsEncode( const uint8_t * pucIn,
+                             size_t uxInLen,
+                             uint8_t * pucOut )
+{
+    size_t uxCodeIdx = 0;
+    size_t uxOut = 1;
+    uint8_t ucCode = 1;
+
+    for( size_t uxIn = 0; uxIn < uxInLen; uxIn++ )
+    {
+        if( pucIn[ uxIn ] == 0 )
+        {
+            pucOut[ uxCodeIdx ] = ucCode;
+            uxCodeIdx = uxOut++;
+            ucCode = 1;
+        }
+        else
+        {
+            pucOut[ uxOut++ ] = pucIn[ uxIn ];
+            ucCode++;
+
+            if( ( ucCode == 0xFF ) && ( ( uxIn + 1 ) < uxInLen ) )
+            {
+                pucOut[ uxCodeIdx ] = ucCode;
+                uxCodeIdx = uxOut++;
+                ucCode = 1;
+            }
+        }
+    }
+
+    pucOut[ uxCodeIdx ] = ucCode;
+    pucOut[ uxOut++ ] = 0;
+
+    return uxOut;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSendResponse( ProvSession_t * pxSession,
+                             uint8_t ucType,
+                             uint8_t ucSeq,
+                             ProvStatus_t xStatus )
+{
+    uint8_t * pucResp = pxSession->pucResp;
+    size_t uxLen = PROV_RESP_HDR_LEN + pxSession->uxRespBodyLen;
+    uint32_t ulCrc;
+
+    configASSERT( uxLen <= ( PROV_FRAME_MAX - PROV_CRC_LEN ) );
+
+    pucResp[ 0 ] = ucType | PROV_RESP_FLAG;
+    pucResp[ 1 ] = ucSeq;
+    pucResp[ 2 ] = ( uint8_t ) xStatus;
+
+    ulCrc = prvCrc32( pucResp, uxLen );
+
+    for( size_t i = 0; i < PROV_CRC_LEN; i++ )
+    {
+        pucResp[ uxLen++ ] = ( uint8_t ) ( ulCrc >> ( 8 * i ) );
+    }
+
+    uxLen = prvCobsEncode( pucResp, uxLen, pxSession->pucReq );
+
+    pxSession->pxCIO->write( pxSession->pucReq, uxLen );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Copy a [ len ][ label ] field, or pcDefault when the length is zero. Returns the bytes consumed */
+static size_t prvGetLabel( const uint8_t * pucBody,
+                           size_t uxBodyLen,
+                           const char * pcDefault,
+                           char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ] )
+{
+    size_t uxUsed = 0;
+
+    if( ( uxBodyLen == 0 ) || ( pucBody[ 0 ] == 0 ) )
+    {
+        ( void ) strncpy( pcLabel, pcDefault, configTLS_MAX_LABEL_LEN + 1 );
+        pcLabel[ configTLS_MAX_LABEL_LEN ] = '\0';
+        uxUsed = ( uxBodyLen == 0 ) ? 0 : 1;
+    }
+    else if( ( pucBody[ 0 ] <= configTLS_MAX_LABEL_LEN ) &&
+             ( ( size_t ) pucBody[ 0 ] + 1 <= uxBodyLen ) )
+    {
+        ( void ) memcpy( pcLabel, &( pucBody[ 1 ] ), pucBody[ 0 ] );
+        pcLabel[ pucBody[ 0 ] ] = '\0';
+        uxUsed = pucBody[ 0 ] + 1;
+    }
+    else
+    {
+        pcLabel[ 0 ] = '\0';
+    }
+
+    return uxUsed;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvKvSetOne( KVStoreKey_t xKey,
+                               const char * pcValue,
+                               size_t uxValueLen )
+{
+    BaseType_t xResult = pdFALSE;
+    char * pcEndPtr = NULL;
+
+    switch( KVStore_getType( xKey ) )
+    {
+        case KV_TYPE_BASE_T:
+           {
+               BaseType_t xValue = strtol( pcValue, &pcEndPtr, 10 );
+
+               if( ( uxValueLen > 0 ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setBase( xKey, xValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_INT32:
+           {
+               int32_t lValue = strtol( pcValue, &pcEndPtr, 10 );
+
+               if( ( uxValueLen > 0 ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setInt32( xKey, lValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_UBASE_T:
+           {
+               UBaseType_t uxValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+               if( ( uxValueLen > 0 ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setUBase( xKey, uxValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_UINT32:
+           {
+               uint32_t ulValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+               if( ( uxValueLen > 0 ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setUInt32( xKey, ulValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_STRING:
+
+            if( strlen( pcValue ) == uxValueLen )
+            {
+                xResult = KVStore_setString( xKey, pcValue );
+            }
+
+            break;
+
+        case KV_TYPE_BLOB:
+            xResult = KVStore_setBlob( xKey, uxValueLen, pcValue );
+            break;
+
+        default:
+            break;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Stage each [ keylen ][ key ][ len u16 ][ value ] record. The byte following the key and the
+ * value is replaced by a terminator while the record is applied, then restored.
+ */
+static ProvStatus_t prvKvSet( ProvSession_t * pxSession,
+                              uint8_t * pucBody,
+                              size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_OK;
+    size_t uxIdx = 0;
+    uint16_t usCount = 0;
+
+    while( ( uxIdx < uxBodyLen ) && ( xStatus == PROV_STATUS_OK ) )
+    {
+        size_t uxKeyLen = pucBody[ uxIdx ];
+        size_t uxValueLen = 0;
+        char * pcKey = ( char * ) &( pucBody[ uxIdx + 1 ] );
+        char * pcValue = NULL;
+        uint8_t ucSaved;
+        KVStoreKey_t xKey;
+
+        if( ( uxKeyLen == 0 ) ||
+            ( ( uxIdx + 1 + uxKeyLen + 2 ) > uxBodyLen ) )
+        {
+            xStatus = PROV_STATUS_BAD_ARG;
+            break;
+        }
+
+        uxValueLen = pucBody[ uxIdx + 1 + uxKeyLen ] |
+                     ( ( size_t ) pucBody[ uxIdx + 2 + uxKeyLen ] << 8 );
+        pcValue = ( char * ) &( pucBody[ uxIdx + 3 + uxKeyLen ] );
+
+        if( ( uxIdx + 3 + uxKeyLen + uxValueLen ) > uxBodyLen )
+        {
+            xStatus = PROV_STATUS_BAD_ARG;
+            break;
+        }
+
+        /* The first length byte follows the key */
+        ucSaved = ( uint8_t ) pcKey[ uxKeyLen ];
+        pcKey[ uxKeyLen ] = '\0';
+        xKey = kvStringToKey( pcKey );
+        pcKey[ uxKeyLen ] = ( char ) ucSaved;
+
+        /* The request buffer has room for the CRC after the last value */
+        ucSaved = ( uint8_t ) pcValue[ uxValueLen ];
+        pcValue[ uxValueLen ] = '\0';
+
+        if( ( xKey == KVSTORE_KEY_INVALID ) ||
+            ( prvKvSetOne( xKey, pcValue, uxValueLen ) != pdTRUE ) )
+        {
+            xStatus = PROV_STATUS_BAD_ARG;
+        }
+        else
+        {
+            usCount++;
+        }
+
+        pcValue[ uxValueLen ] = ( char ) ucSaved;
+
+        uxIdx += 3 + uxKeyLen + uxValueLen;
+    }
+
+    /* On error the count is the index of the record which was refused */
+    pxSession->pucResp[ PROV_RESP_HDR_LEN ] = ( uint8_t ) usCount;
+    pxSession->pucResp[ PROV_RESP_HDR_LEN + 1 ] = ( uint8_t ) ( usCount >> 8 );
+    pxSession->uxRespBodyLen = 2;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvCertImport( const uint8_t * pucBody,
+                                   size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_BAD_ARG;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    size_t uxUsed = prvGetLabel( pucBody, uxBodyLen, TLS_CERT_LABEL, pcLabel );
+
+    if( ( uxUsed > 0 ) && ( uxUsed < uxBodyLen ) )
+    {
+        mbedtls_x509_crt xCertContext;
+
+        mbedtls_x509_crt_init( &xCertContext );
+
+        if( mbedtls_x509_crt_parse_der( &xCertContext, &( pucBody[ uxUsed ] ), uxBodyLen - uxUsed ) == 0 )
+        {
+            xStatus = ( xPkiWriteCertificate( pcLabel, &xCertContext ) == PKI_SUCCESS ) ?
+                      PROV_STATUS_OK : PROV_STATUS_FAILED;
+        }
+
+        mbedtls_x509_crt_free( &xCertContext );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvPubKeyImport( const uint8_t * pucBody,
+                                     size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_BAD_ARG;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    size_t uxUsed = prvGetLabel( pucBody, uxBodyLen, OTA_SIGNING_KEY_LABEL, pcLabel );
+
+    if( ( uxUsed > 0 ) && ( uxUsed < uxBodyLen ) )
+    {
+        mbedtls_pk_context xPkContext;
+
+        mbedtls_pk_init( &xPkContext );
+
+        if( mbedtls_pk_parse_public_key( &xPkContext, &( pucBody[ uxUsed ] ), uxBodyLen - uxUsed ) == 0 )
+        {
+            xStatus = ( xPkiWritePubKey( pcLabel, &( pucBody[ uxUsed ] ), uxBodyLen - uxUsed,
+                                         &xPkContext ) == PKI_SUCCESS ) ?
+                      PROV_STATUS_OK : PROV_STATUS_FAILED;
+        }
+
+        mbedtls_pk_free( &xPkContext );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Move a heap allocated DER into the response body and free it */
+static ProvStatus_t prvRespondDer( ProvSession_t * pxSession,
+                                   unsigned char * pucDer,
+                                   size_t uxDerLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_TOO_LONG;
+
+    if( uxDerLen <= PROV_PAYLOAD_MAX )
+    {
+        ( void ) memcpy( &( pxSession->pucResp[ PROV_RESP_HDR_LEN ] ), pucDer, uxDerLen );
+        pxSession->uxRespBodyLen = uxDerLen;
+        xStatus = PROV_STATUS_OK;
+    }
+
+    vPortFree( pucDer );
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvKeyGenerate( ProvSession_t * pxSession,
+                                    const uint8_t * pucBody,
+                                    size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_FAILED;
+    char pcPrvLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    char pcPubLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    unsigned char * pucPubKeyDer = NULL;
+    size_t uxPubKeyDerLen = 0;
+    size_t uxUsed = prvGetLabel( pucBody, uxBodyLen, TLS_KEY_PRV_LABEL, pcPrvLabel );
+
+    uxUsed += prvGetLabel( &( pucBody[ uxUsed ] ), uxBodyLen - uxUsed, TLS_KEY_PUB_LABEL, pcPubLabel );
+
+    if( ( pcPrvLabel[ 0 ] == '\0' ) || ( pcPubLabel[ 0 ] == '\0' ) )
+    {
+        xStatus = PROV_STATUS_BAD_ARG;
+    }
+    else if( xPkiGenerateECKeypair( pcPrvLabel, pcPubLabel, &pucPubKeyDer, &uxPubKeyDerLen ) == PKI_SUCCESS )
+    {
+        xStatus = prvRespondDer( pxSession, pucPubKeyDer, uxPubKeyDerLen );
+    }
+    else if( pucPubKeyDer != NULL )
+    {
+        vPortFree( pucPubKeyDer );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvCsr( ProvSession_t * pxSession,
+                            const uint8_t * pucBody,
+                            size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_BAD_ARG;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    size_t uxCsrDerLen = 0;
+
+    ( void ) prvGetLabel( pucBody, uxBodyLen, TLS_KEY_PRV_LABEL, pcLabel );
+
+    if( pcLabel[ 0 ] != '\0' )
+    {
+        /* Written straight into the response body */
+        if( xCliGenerateCsrDer( pcLabel, &( pxSession->pucResp[ PROV_RESP_HDR_LEN ] ),
+                                PROV_PAYLOAD_MAX, &uxCsrDerLen ) == pdTRUE )
+        {
+            pxSession->uxRespBodyLen = uxCsrDerLen;
+            xStatus = PROV_STATUS_OK;
+        }
+        else
+        {
+            xStatus = PROV_STATUS_FAILED;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvCertExport( ProvSession_t * pxSession,
+                                   const uint8_t * pucBody,
+                                   size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_BAD_ARG;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+
+    ( void ) prvGetLabel( pucBody, uxBodyLen, TLS_CERT_LABEL, pcLabel );
+
+    if( pcLabel[ 0 ] != '\0' )
+    {
+        mbedtls_x509_crt xCertContext;
+        PkiObject_t xCert = xPkiObjectFromLabel( pcLabel );
+
+        mbedtls_x509_crt_init( &xCertContext );
+
+        xStatus = PROV_STATUS_FAILED;
+
+        if( xPkiReadCertificate( &xCertContext, &xCert ) == PKI_SUCCESS )
+        {
+            if( xCertContext.raw.len <= PROV_PAYLOAD_MAX )
+            {
+                ( void ) memcpy( &( pxSession->pucResp[ PROV_RESP_HDR_LEN ] ),
+                                 xCertContext.raw.p, xCertContext.raw.len );
+                pxSession->uxRespBodyLen = xCertContext.raw.len;
+                xStatus = PROV_STATUS_OK;
+            }
+            else
+            {
+                xStatus = PROV_STATUS_TOO_LONG;
+            }
+        }
+
+        mbedtls_x509_crt_free( &xCertContext );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvPubKeyExport( ProvSession_t * pxSession,
+                                     const uint8_t * pucBody,
+                                     size_t uxBodyLen )
+{
+    ProvStatus_t xStatus = PROV_STATUS_BAD_ARG;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+
+    ( void ) prvGetLabel( pucBody, uxBodyLen, TLS_KEY_PUB_LABEL, pcLabel );
+
+    if( pcLabel[ 0 ] != '\0' )
+    {
+        unsigned char * pucPubKeyDer = NULL;
+        size_t uxPubKeyDerLen = 0;
+        PkiObject_t xPubKey = xPkiObjectFromLabel( pcLabel );
+
+        xStatus = PROV_STATUS_FAILED;
+
+        if( xPkiReadPublicKeyDer( &pucPubKeyDer, &uxPubKeyDerLen, &xPubKey ) == PKI_SUCCESS )
+        {
+            xStatus = prvRespondDer( pxSession, pucPubKeyDer, uxPubKeyDerLen );
+        }
+        else if( pucPubKeyDer != NULL )
+        {
+            vPortFree( pucPubKeyDer );
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Decode, check and run one frame of uxLen encoded bytes at the start of pucRx */
+static void prvHandleFrame( ProvSession_t * pxSession,
+                            size_t uxLen )
+{
+    uint8_t * pucReq = pxSession->pucReq;
+    size_t uxReqLen = prvCobsDecode( pxSession->pucRx, uxLen, pucReq, PROV_FRAME_MAX );
+    ProvStatus_t xStatus = PROV_STATUS_OK;
+    uint8_t ucType = 0;
+    uint8_t ucSeq = 0;
+
+    pxSession->uxRespBodyLen = 0;
+
+    if( uxReqLen < ( PROV_REQ_HDR_LEN + PROV_CRC_LEN ) )
+    {
+        xStatus = PROV_STATUS_BAD_FRAME;
+    }
+    else
+    {
+        uint32_t ulCrc = 0;
+
+        uxReqLen -= PROV_CRC_LEN;
+
+        for( size_t i = 0; i < PROV_CRC_LEN; i++ )
+        {
+            ulCrc |= ( uint32_t ) pucReq[ uxReqLen + i ] << ( 8 * i );
+        }
+
+        if( ulCrc != prvCrc32( pucReq, uxReqLen ) )
+        {
+            xStatus = PROV_STATUS_BAD_FRAME;
+        }
+    }
+
+    if( xStatus == PROV_STATUS_OK )
+    {
+        uint8_t * pucBody = &( pucReq[ PROV_REQ_HDR_LEN ] );
+        size_t uxBodyLen = uxReqLen - PROV_REQ_HDR_LEN;
+
+        ucType = pucReq[ 0 ];
+        ucSeq = pucReq[ 1 ];
+
+        switch( ucType )
+        {
+            case PROV_HELLO:
+                pxSession->pucResp[ PROV_RESP_HDR_LEN ] = PROV_VERSION;
+                pxSession->pucResp[ PROV_RESP_HDR_LEN + 1 ] = ( uint8_t ) PROV_PAYLOAD_MAX;
+                pxSession->pucResp[ PROV_RESP_HDR_LEN + 2 ] = ( uint8_t ) ( PROV_PAYLOAD_MAX >> 8 );
+                pxSession->uxRespBodyLen = 3;
+                break;
+
+            case PROV_KV_SET:
+                xStatus = prvKvSet( pxSession, pucBody, uxBodyLen );
+                break;
+
+            case PROV_KV_COMMIT:
+                xStatus = ( KVStore_commit() == pdTRUE ) ? PROV_STATUS_OK : PROV_STATUS_FAILED;
+                KVStore_begin();
+                break;
+
+            case PROV_CERT_IMPORT:
+                xStatus = prvCertImport( pucBody, uxBodyLen );
+                break;
+
+            case PROV_PUBKEY_IMPORT:
+                xStatus = prvPubKeyImport( pucBody, uxBodyLen );
+                break;
+
+            case PROV_KEY_GENERATE:
+                xStatus = prvKeyGenerate( pxSession, pucBody, uxBodyLen );
+                break;
+
+            case PROV_CSR:
+                xStatus = prvCsr( pxSession, pucBody, uxBodyLen );
+                break;
+
+            case PROV_CERT_EXPORT:
+                xStatus = prvCertExport( pxSession, pucBody, uxBodyLen );
+                break;
+
+            case PROV_PUBKEY_EXPORT:
+                xStatus = prvPubKeyExport( pxSession, pucBody, uxBodyLen );
+                break;
+
+            case PROV_END:
+                xStatus = ( KVStore_commit() == pdTRUE ) ? PROV_STATUS_OK : PROV_STATUS_FAILED;
+                pxSession->xDone = pdTRUE;
+                break;
+
+            default:
+                xStatus = PROV_STATUS_UNKNOWN_TYPE;
+                break;
+        }
+    }
+
+    prvSendResponse( pxSession, ucType, ucSeq, xStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRunSession( ProvSession_t * pxSession )
+{
+    BaseType_t xDiscard = pdFALSE;
+    size_t uxScanned = 0;
+
+    KVStore_begin();
+
+    while( pxSession->xDone == pdFALSE )
+    {
+        int32_t lBytes = pxSession->pxCIO->read_timeout( ( char * ) &( pxSession->pucRx[ pxSession->uxRxLen ] ),
+                                                         PROV_ENCODED_MAX - pxSession->uxRxLen,
+                                                         pdMS_TO_TICKS( PROV_IDLE_TIMEOUT_MS ) );
+
+        if( lBytes <= 0 )
+        {
+            LogWarn( "Binary provisioning idle for %u ms, leaving.", PROV_IDLE_TIMEOUT_MS );
+            ( void ) KVStore_commit();
+            break;
+        }
+
+        pxSession->uxRxLen += lBytes;
+
+        /* A read may end inside a frame or hold the start of the next one */
+        while( ( uxScanned < pxSession->uxRxLen ) && ( pxSession->xDone == pdFALSE ) )
+        {
+            if( pxSession->pucRx[ uxScanned ] == 0 )
+            {
+                size_t uxRest = pxSession->uxRxLen - uxScanned - 1;
+
+                if( xDiscard == pdTRUE )
+                {
+                    pxSession->uxRespBodyLen = 0;
+                    prvSendResponse( pxSession, 0, 0, PROV_STATUS_TOO_LONG );
+                    xDiscard = pdFALSE;
+                }
+                else if( uxScanned > 0 )
+                {
+                    prvHandleFrame( pxSession, uxScanned );
+                }
+
+                ( void ) memmove( pxSession->pucRx, &( pxSession->pucRx[ uxScanned + 1 ] ), uxRest );
+                pxSession->uxRxLen = uxRest;
+                uxScanned = 0;
+            }
+            else
+            {
+                uxScanned++;
+            }
+        }
+
+        if( pxSession->uxRxLen == PROV_ENCODED_MAX )
+        {
+            /* No delimiter in a full buffer, drop bytes until the next one */
+            xDiscard = pdTRUE;
+            pxSession->uxRxLen = 0;
+            uxScanned = 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCommand_Prov( ConsoleIO_t * pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] )
+{
+    ProvSession_t xSession = { 0 };
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    xSession.pxCIO = pxCIO;
+    xSession.pucRx = pvPortMalloc( PROV_ENCODED_MAX );
+    xSession.pucReq = pvPortMalloc( PROV_ENCODED_MAX );
+    xSession.pucResp = pvPortMalloc( PROV_FRAME_MAX );
+
+    if( ( xSession.pucRx == NULL ) ||
+        ( xSession.pucReq == NULL ) ||
+        ( xSession.pucResp == NULL ) )
+    {
+        pxCIO->print( "Error: not enough memory for the provisioning buffers.\r\n" );
+    }
+    else
+    {
+        /* Keep log output off the wire for the whole session */
+        pxCIO->lock();
+        prvRunSession( &xSession );
+        pxCIO->unlock();
+    }
+
+    vPortFree( xSession.pucRx );
+    vPortFree( xSession.pucReq );
+    vPortFree( xSession.pucResp );
+}
@@ -25,6 +25,8 @@
 
 #include "semphr.h"
 #include "cli.h"
+#include "sram_banks.h"
+#include "sntp_time.h"
 
 /**
  * Defines the interface for different console implementations. Interface
@@ -129,9 +131,37 @@ extern const CLI_Command_Definition_t xCommandDef_ps;
 extern const CLI_Command_Definition_t xCommandDef_kill;
 extern const CLI_Command_Definition_t xCommandDef_killAll;
 extern const CLI_Command_Definition_t xCommandDef_heapStat;
+extern const CLI_Command_Definition_t xCommandDef_stack;
+extern const CLI_Command_Definition_t xCommandDef_metrics;
+#if ( TRACE_REC_ENABLED == 1 )
+    extern const CLI_Command_Definition_t xCommandDef_trace;
+#endif
+#if ( SRAM_BANKS_ENABLED == 1 )
+    extern const CLI_Command_Definition_t xCommandDef_sram;
+#endif
+extern const CLI_Command_Definition_t xCommandDef_boot;
 extern const CLI_Command_Definition_t xCommandDef_reset;
 extern const CLI_Command_Definition_t xCommandDef_uptime;
+extern const CLI_Command_Definition_t xCommandDef_top;
+#if ( SNTP_TIME_ENABLED == 1 )
+    extern const CLI_Command_Definition_t xCommandDef_time;
+#endif
 extern const CLI_Command_Definition_t xCommandDef_rngtest;
+extern const CLI_Command_Definition_t xCommandDef_bench;
 extern const CLI_Command_Definition_t xCommandDef_assert;
+extern const CLI_Command_Definition_t xCommandDef_log;
+extern const CLI_Command_Definition_t xCommandDef_net;
+extern const CLI_Command_Definition_t xCommandDef_tls;
+extern const CLI_Command_Definition_t xCommandDef_mqtt;
+extern const CLI_Command_Definition_t xCommandDef_prov;
+
+/*
+ * @brief Write a DER certificate signing request for the key at pcPrvKeyLabel and the configured
+ * thing name to the start of pucCsrDer. Shared by "pki generate csr" and the provisioning mode.
+ */
+BaseType_t xCliGenerateCsrDer( const char * pcPrvKeyLabel,
+                               unsigned char * pucCsrDer,
+                               size_t uxBufferLen,
+                               size_t * puxCsrDerLen );
 
 #endif /* _CLI_PRIV */
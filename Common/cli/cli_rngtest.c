@@ -1,7 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
 #include "mbedtls/base64.h"
+#include "mbedtls/platform_util.h"
+#include "entropy_poll.h"
 #include "cli.h"
 #include "cli_prv.h"
+#include "stm32u5xx.h"
+
+/* Request length, default and maximum iteration count of "rngtest bench" */
+#define RNGTEST_BENCH_REQ_LEN     32U
+#define RNGTEST_BENCH_ITER        256U
+#define RNGTEST_BENCH_MAX_ITER    4096U
+
+typedef int (* RngBenchFunc_t)( void * pvCtx,
+                                unsigned char * pucOutput,
+                                size_t uxLen );
 
 static void prvRngTestCommand( ConsoleIO_t * const pxCIO,
                                uint32_t ulArgc,
@@ -11,10 +28,133 @@ const CLI_Command_Definition_t xCommandDef_rngtest =
 {
     "rngtest",
     "rngtest <number of bytes>\r\n"
-    "    Read the specified number of bytes from the rng and output them base64 encoded.\r\n\n",
+    "    Read the specified number of bytes from the rng and output them base64 encoded.\r\n"
+    "rngtest bench [ITERATIONS]\r\n"
+    "    Report the latency and throughput of 32 byte requests served by\r\n"
+    "    mbedtls_hardware_poll, mbedtls_entropy_func and a CTR-DRBG.\r\n\n",
     prvRngTestCommand
 };
 
+/*-----------------------------------------------------------*/
+
+static int prvHardwarePoll( void * pvCtx,
+                            unsigned char * pucOutput,
+                            size_t uxLen )
+{
+    size_t uxBytesWritten = 0;
+    int lRslt = mbedtls_hardware_poll( pvCtx, pucOutput, uxLen, &uxBytesWritten );
+
+    if( ( lRslt == 0 ) && ( uxBytesWritten != uxLen ) )
+    {
+        lRslt = MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
+    }
+
+    return lRslt;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Time ulIterations requests of RNGTEST_BENCH_REQ_LEN bytes from xFunc and
+ * print the average and worst case latency and the resulting throughput.
+ */
+static void prvRngBenchPath( ConsoleIO_t * const pxCIO,
+                             const char * pcPath,
+                             RngBenchFunc_t xFunc,
+                             void * pvCtx,
+                             uint32_t ulIterations )
+{
+    unsigned char ucBuffer[ RNGTEST_BENCH_REQ_LEN ];
+    uint64_t ullTotal = 0;
+    uint32_t ulMax = 0;
+    int lRslt = 0;
+    uint32_t ulAvgUs;
+    uint32_t ulMaxUs;
+    uint32_t ulKBps;
+
+    for( uint32_t i = 0; ( i < ulIterations ) && ( lRslt == 0 ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+        uint32_t ulCycles;
+
+        lRslt = xFunc( pvCtx, ucBuffer, sizeof( ucBuffer ) );
+
+        ulCycles = DWT->CYCCNT - ulStart;
+        ullTotal += ulCycles;
+
+        if( ulCycles > ulMax )
+        {
+            ulMax = ulCycles;
+        }
+    }
+
+    mbedtls_platform_zeroize( ucBuffer, sizeof( ucBuffer ) );
+
+    if( lRslt != 0 )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-16s failed: -0x%04lx\r\n", pcPath, ( uint32_t ) -lRslt );
+    }
+    else
+    {
+        ulAvgUs = ( uint32_t ) ( ( ullTotal * 1000000U ) / ( ( uint64_t ) SystemCoreClock * ulIterations ) );
+        ulMaxUs = ( uint32_t ) ( ( ( uint64_t ) ulMax * 1000000U ) / SystemCoreClock );
+        ulKBps = ( ullTotal == 0 ) ? 0 :
+                 ( uint32_t ) ( ( ( uint64_t ) SystemCoreClock * RNGTEST_BENCH_REQ_LEN * ulIterations ) /
+                                ( ullTotal * 1024U ) );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-16s %8lu %8lu %8lu\r\n", pcPath, ulAvgUs, ulMaxUs, ulKBps );
+    }
+
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRngBench( ConsoleIO_t * const pxCIO,
+                         uint32_t ulIterations )
+{
+    static const char pcPers[] = "rngtest bench";
+    mbedtls_entropy_context xEntropyCtx;
+    mbedtls_ctr_drbg_context xDrbgCtx;
+    int lRslt;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    mbedtls_entropy_init( &xEntropyCtx );
+    mbedtls_ctr_drbg_init( &xDrbgCtx );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%lu requests of %u bytes\r\n%-16s %8s %8s %8s\r\n",
+                       ulIterations, RNGTEST_BENCH_REQ_LEN,
+                       "path", "avg us", "max us", "KB/s" );
+    pxCIO->print( pcCliScratchBuffer );
+
+    prvRngBenchPath( pxCIO, "hardware_poll", prvHardwarePoll, NULL, ulIterations );
+    prvRngBenchPath( pxCIO, "entropy_func", mbedtls_entropy_func, &xEntropyCtx, ulIterations );
+
+    lRslt = mbedtls_ctr_drbg_seed( &xDrbgCtx, mbedtls_entropy_func, &xEntropyCtx,
+                                   ( const unsigned char * ) pcPers, sizeof( pcPers ) - 1 );
+
+    if( lRslt == 0 )
+    {
+        prvRngBenchPath( pxCIO, "ctr_drbg", mbedtls_ctr_drbg_random, &xDrbgCtx, ulIterations );
+    }
+    else
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-16s seed failed: -0x%04lx\r\n", "ctr_drbg", ( uint32_t ) -lRslt );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    mbedtls_ctr_drbg_free( &xDrbgCtx );
+    mbedtls_entropy_free( &xEntropyCtx );
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvRngTestCommand( ConsoleIO_t * const pxCIO,
                                uint32_t ulArgc,
                                char * ppcArgv[] )
@@ -26,6 +166,29 @@ static void prvRngTestCommand( ConsoleIO_t * const pxCIO,
     unsigned char pcBuffer[ 2 * MBEDTLS_ENTROPY_BLOCK_SIZE ];
     unsigned char pucEntropyBuffer[ MBEDTLS_ENTROPY_BLOCK_SIZE ] = { 0 };
 
+    if( ( ulArgc > 1 ) &&
+        ( strcmp( ppcArgv[ 1 ], "bench" ) == 0 ) )
+    {
+        uint32_t ulIterations = RNGTEST_BENCH_ITER;
+
+        if( ulArgc > 2 )
+        {
+            ulIterations = ( uint32_t ) strtoul( ppcArgv[ 2 ], NULL, 0 );
+        }
+
+        if( ( ulIterations == 0 ) ||
+            ( ulIterations > RNGTEST_BENCH_MAX_ITER ) )
+        {
+            pxCIO->print( "Error: ITERATIONS must be between 1 and 4096.\r\n" );
+        }
+        else
+        {
+            prvRngBench( pxCIO, ulIterations );
+        }
+
+        return;
+    }
+
     if( ulArgc > 1 )
     {
         char * pcArg = ppcArgv[ 1 ];
@@ -0,0 +1,499 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "mbedtls_transport.h"
+#include "heap_regions.h"
+
+#include "mbedtls/gcm.h"
+
+#ifdef MBEDTLS_TRANSPORT_PSA
+#include "stm32u5xx.h"
+#include "tfm_ns_interface_freertos.h"
+#endif
+
+#if defined( MBEDTLS_GCM_ALT ) && ( ST_GCM_DMA_THRESHOLD > 0 )
+#include "stm32u5xx.h"
+#define TLS_CLI_GCM_BENCH    1
+#endif
+
+#if defined( MBEDTLS_ECDSA_SIGN_ALT ) || defined( MBEDTLS_ECDSA_VERIFY_ALT ) || \
+    defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT ) || defined( MBEDTLS_ECDH_COMPUTE_SHARED_ALT ) || \
+    defined( MBEDTLS_RSA_ALT )
+#include "pka_stm32.h"
+#define TLS_CLI_SELF_TEST    1
+#endif
+
+#if defined( MBEDTLS_AES_ALT ) || defined( MBEDTLS_GCM_ALT )
+#include "cryp_stm32.h"
+#define TLS_CLI_SELF_TEST    1
+#endif
+
+#if defined( MBEDTLS_SHA256_ALT )
+#include "hash_stm32.h"
+#define TLS_CLI_SELF_TEST    1
+#endif
+
+/* Number of connection attempts listed by "tls stats" */
+#define TLS_CLI_MAX_TIMINGS    4
+
+#ifdef TLS_CLI_GCM_BENCH
+/* Default payload length, upper limit and iteration count of "tls gcm-bench" */
+#define TLS_CLI_GCM_BENCH_LEN        16384U
+#define TLS_CLI_GCM_BENCH_MAX_LEN    49152U
+#define TLS_CLI_GCM_BENCH_ITER       8U
+#endif
+
+static const char * const pcPhaseNames[ TLS_PHASE_MAX ] =
+{
+    "dns",
+    "tcp connect",
+    "ca chain",
+    "client cert",
+    "hello",
+    "server cert",
+    "server kex",
+    "client kex",
+    "client sign",
+    "finish",
+};
+
+#ifdef TLS_CLI_SELF_TEST
+typedef struct
+{
+    const char * pcName;
+    int ( * pxTest )( void ); /* 0 if the results match the test vectors */
+} TlsSelfTest_t;
+
+/* Known answer tests of the hardware alternates enabled in the mbedtls config */
+static const TlsSelfTest_t xSelfTests[] =
+{
+#if defined( MBEDTLS_AES_ALT )
+    { "aes", cryp_aes_self_test },
+#endif
+#if defined( MBEDTLS_GCM_ALT )
+    { "gcm", cryp_gcm_self_test },
+#endif
+#if defined( MBEDTLS_SHA256_ALT )
+    { "sha256", hash_sha256_self_test },
+#endif
+#if defined( MBEDTLS_ECDSA_SIGN_ALT ) || defined( MBEDTLS_ECDSA_VERIFY_ALT )
+    { "ecdsa", pka_ecdsa_self_test },
+#endif
+#if defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT ) || defined( MBEDTLS_ECDH_COMPUTE_SHARED_ALT )
+    { "ecdh", pka_ecdh_self_test },
+#endif
+#if defined( MBEDTLS_RSA_ALT )
+    { "rsa", pka_rsa_self_test },
+#endif
+};
+#endif /* TLS_CLI_SELF_TEST */
+
+static void vTlsCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_tls =
+{
+    "tls",
+    "tls\r\n"
+    "    tls stats\r\n"
+    "        Display send stall and session resumption counters and the phase timing\r\n"
+    "        of the most recent TLS connection attempts, newest first.\r\n"
+#ifdef MBEDTLS_TRANSPORT_PSA
+    "        Also lists the secure call count and wait / run time of each TF-M veneer.\r\n"
+    "    tls stats reset\r\n"
+    "        Clear the TF-M veneer counters.\r\n"
+#endif
+#ifdef TLS_CLI_SELF_TEST
+    "    tls selftest\r\n"
+    "        Run the known answer tests of the crypto hardware alternates.\r\n"
+#endif
+#ifdef TLS_CLI_GCM_BENCH
+    "    tls gcm-bench [LENGTH]\r\n"
+    "        Compare the cycles per byte of AES-GCM encryption of LENGTH bytes\r\n"
+    "        (default 16384) through the polling and the DMA CRYP path.\r\n"
+#endif
+    "\n",
+    vTlsCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void vPrintTlsStats( ConsoleIO_t * const pxCIO )
+{
+    static TlsHandshakeTiming_t xTimings[ TLS_CLI_MAX_TIMINGS ];
+    TlsTransportStats_t xStats;
+    size_t uxCount;
+
+    mbedtls_transport_get_stats( &xStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "handshakes: %lu, resumed: %lu, tls 1.3: %lu\r\n"
+                       "address cache hits: %lu, fallbacks: %lu\r\n"
+                       "verify cache hits: %lu, misses: %lu\r\n"
+                       "send stalls: %lu, timeouts: %lu, max: %lu ms, total: %lu ms\r\n",
+                       xStats.ulHandshakes,
+                       xStats.ulResumedHandshakes,
+                       xStats.ulTls13Handshakes,
+                       xStats.ulAddrCacheHits,
+                       xStats.ulAddrCacheFallbacks,
+                       xStats.ulVerifyCacheHits,
+                       xStats.ulVerifyCacheMisses,
+                       xStats.ulSendStalls,
+                       xStats.ulSendStallTimeouts,
+                       xStats.ulSendStallMaxMs,
+                       ( uint32_t ) xStats.ullSendStallTotalMs );
+    pxCIO->print( pcCliScratchBuffer );
+
+    #if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+    {
+        MbedtlsArenaStats_t xArena;
+
+        mbedtls_platform_arena_get_stats( &xArena );
+
+        pxCIO->print( "mbedtls arena (block size: in use / peak since last handshake / blocks):\r\n" );
+
+        for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    %4lu: %4lu / %4lu / %4lu\r\n",
+                               ( uint32_t ) xArena.uxClassSize[ i ],
+                               ( uint32_t ) xArena.uxInUse[ i ],
+                               ( uint32_t ) xArena.uxPeak[ i ],
+                               ( uint32_t ) xArena.uxBlocks[ i ] );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "    heap fallbacks: %lu\r\n", xArena.ulFallbacks );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+    #endif /* MBEDTLS_FREERTOS_SLAB_ARENA */
+
+    uxCount = mbedtls_transport_get_handshake_timing( xTimings, TLS_CLI_MAX_TIMINGS );
+
+    for( size_t i = 0; i < uxCount; i++ )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "\r\n%s: status: %ld, total: %lu us\r\n",
+                           xTimings[ i ].pcHostName,
+                           xTimings[ i ].lStatus,
+                           xTimings[ i ].ulTotalUs );
+        pxCIO->print( pcCliScratchBuffer );
+
+        for( uint32_t ulPhase = 0; ulPhase < TLS_PHASE_MAX; ulPhase++ )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    %-12s %10lu us\r\n",
+                               pcPhaseNames[ ulPhase ],
+                               xTimings[ i ].pulPhaseUs[ ulPhase ] );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+
+    #ifdef MBEDTLS_TRANSPORT_PSA
+    {
+        static NsInterfaceVeneerStats_t xVeneers[ NS_INTF_STATS_MAX_VENEERS ];
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+
+        uxCount = ns_interface_get_stats( xVeneers, NS_INTF_STATS_MAX_VENEERS );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "\r\n%-10s %8s %8s %10s %10s %10s\r\n",
+                           "veneer", "calls", "waited", "wait us", "max us", "run us" );
+        pxCIO->print( pcCliScratchBuffer );
+
+        for( size_t i = 0; i < uxCount; i++ )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "0x%08lx %8lu %8lu %10lu %10lu %10lu\r\n",
+                               ( uint32_t ) xVeneers[ i ].uxVeneer,
+                               xVeneers[ i ].ulCalls,
+                               xVeneers[ i ].ulContended,
+                               ( uint32_t ) ( xVeneers[ i ].ullWaitCycles / ulCyclesPerUs ),
+                               xVeneers[ i ].ulMaxWaitCycles / ulCyclesPerUs,
+                               ( uint32_t ) ( xVeneers[ i ].ullRunCycles / ulCyclesPerUs ) );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+    #endif /* MBEDTLS_TRANSPORT_PSA */
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef TLS_CLI_GCM_BENCH
+
+/*
+ * Encrypt uxLength bytes TLS_CLI_GCM_BENCH_ITER times with the given DMA
+ * threshold and return the average number of DWT cycles per call in pulCycles.
+ * The DMA figure is wall clock time and includes the time the CPU was free to
+ * run other tasks while blocked on the transfer.
+ */
+    static int32_t lGcmBenchRun( mbedtls_gcm_context * pxCtx,
+                                 size_t uxDmaThreshold,
+                                 const uint8_t * pucIn,
+                                 uint8_t * pucOut,
+                                 size_t uxLength,
+                                 uint8_t * pucTag,
+                                 uint32_t * pulCycles )
+    {
+        static const uint8_t ucIv[ 12 ] = { 0 };
+        int32_t lRslt = 0;
+        uint64_t ullTotal = 0;
+
+        mbedtls_gcm_alt_set_dma_threshold( uxDmaThreshold );
+
+        for( uint32_t i = 0; ( i < TLS_CLI_GCM_BENCH_ITER ) && ( lRslt == 0 ); i++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lRslt = mbedtls_gcm_crypt_and_tag( pxCtx, MBEDTLS_GCM_ENCRYPT, uxLength,
+                                               ucIv, sizeof( ucIv ), NULL, 0,
+                                               pucIn, pucOut, 16, pucTag );
+
+            ullTotal += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+        }
+
+        *pulCycles = ( uint32_t ) ( ullTotal / TLS_CLI_GCM_BENCH_ITER );
+
+        return lRslt;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vPrintGcmBenchResult( ConsoleIO_t * const pxCIO,
+                                      const char * pcPath,
+                                      uint32_t ulCycles,
+                                      size_t uxLength )
+    {
+        uint32_t ulCpbX100 = ( uint32_t ) ( ( ( uint64_t ) ulCycles * 100U ) / uxLength );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %10lu cycles, %lu.%02lu cycles/byte\r\n",
+                           pcPath, ulCycles,
+                           ulCpbX100 / 100U, ulCpbX100 % 100U );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vGcmBench( ConsoleIO_t * const pxCIO,
+                           size_t uxLength )
+    {
+        static const uint8_t ucKey[ 16 ] = { 0 };
+        mbedtls_gcm_context xCtx;
+        size_t uxThreshold = mbedtls_gcm_alt_get_dma_threshold();
+        uint8_t ucPollTag[ 16 ];
+        uint8_t ucDmaTag[ 16 ];
+        uint32_t ulPollCycles = 0;
+        uint32_t ulDmaCycles = 0;
+        int32_t lRslt;
+
+        /* Heap buffers are word aligned, as required by the DMA path */
+        uint8_t * pucIn = pvPortMallocPolicy( uxLength, HEAP_POLICY_DMA );
+        uint8_t * pucPollOut = pvPortMallocPolicy( uxLength, HEAP_POLICY_DMA );
+        uint8_t * pucDmaOut = pvPortMallocPolicy( uxLength, HEAP_POLICY_DMA );
+
+        if( ( pucIn == NULL ) || ( pucPollOut == NULL ) || ( pucDmaOut == NULL ) )
+        {
+            pxCIO->print( "Error: Not enough heap for the benchmark buffers.\r\n" );
+        }
+        else
+        {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+            for( size_t i = 0; i < uxLength; i++ )
+            {
+                pucIn[ i ] = ( uint8_t ) i;
+            }
+
+            mbedtls_gcm_init( &xCtx );
+
+            lRslt = mbedtls_gcm_setkey( &xCtx, MBEDTLS_CIPHER_ID_AES, ucKey, 128 );
+
+            if( lRslt == 0 )
+            {
+                lRslt = lGcmBenchRun( &xCtx, SIZE_MAX, pucIn, pucPollOut,
+                                      uxLength, ucPollTag, &ulPollCycles );
+            }
+
+            if( lRslt == 0 )
+            {
+                lRslt = lGcmBenchRun( &xCtx, 16, pucIn, pucDmaOut,
+                                      uxLength, ucDmaTag, &ulDmaCycles );
+            }
+
+            mbedtls_gcm_alt_set_dma_threshold( uxThreshold );
+            mbedtls_gcm_free( &xCtx );
+
+            if( lRslt != 0 )
+            {
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "Error: mbedtls_gcm_crypt_and_tag returned -0x%04lx.\r\n",
+                                   ( uint32_t ) -lRslt );
+                pxCIO->print( pcCliScratchBuffer );
+            }
+            else
+            {
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "length: %lu bytes, iterations: %lu, dma threshold: %lu\r\n",
+                                   ( uint32_t ) uxLength,
+                                   ( uint32_t ) TLS_CLI_GCM_BENCH_ITER,
+                                   ( uint32_t ) uxThreshold );
+                pxCIO->print( pcCliScratchBuffer );
+
+                vPrintGcmBenchResult( pxCIO, "polling", ulPollCycles, uxLength );
+                vPrintGcmBenchResult( pxCIO, "dma", ulDmaCycles, uxLength );
+
+                if( ( memcmp( pucPollOut, pucDmaOut, uxLength ) != 0 ) ||
+                    ( memcmp( ucPollTag, ucDmaTag, sizeof( ucPollTag ) ) != 0 ) )
+                {
+                    pxCIO->print( "Error: DMA and polling output differ.\r\n" );
+                }
+            }
+        }
+
+        vPortFree( pucIn );
+        vPortFree( pucPollOut );
+        vPortFree( pucDmaOut );
+    }
+
+#endif /* TLS_CLI_GCM_BENCH */
+
+/*-----------------------------------------------------------*/
+
+#ifdef TLS_CLI_SELF_TEST
+    static void vSelfTest( ConsoleIO_t * const pxCIO )
+    {
+        uint32_t ulFailed = 0;
+
+        #if defined( ST_PKA_ECC_ALT )
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "ecc path: %s\r\n", pka_is_enabled() ? "pka" : "software" );
+            pxCIO->print( pcCliScratchBuffer );
+        #endif
+
+        for( size_t i = 0; i < ( sizeof( xSelfTests ) / sizeof( xSelfTests[ 0 ] ) ); i++ )
+        {
+            int32_t lRslt = xSelfTests[ i ].pxTest();
+
+            if( lRslt == 0 )
+            {
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "%-8s pass\r\n", xSelfTests[ i ].pcName );
+            }
+            else
+            {
+                ulFailed++;
+                ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                   "%-8s FAIL -0x%04lx\r\n", xSelfTests[ i ].pcName,
+                                   ( uint32_t ) -lRslt );
+            }
+
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%lu of %lu tests failed.\r\n", ulFailed,
+                           ( uint32_t ) ( sizeof( xSelfTests ) / sizeof( xSelfTests[ 0 ] ) ) );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+#endif /* TLS_CLI_SELF_TEST */
+
+/*-----------------------------------------------------------*/
+
+static void vTlsCommand( ConsoleIO_t * const pxCIO,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] )
+{
+    if( ( ulArgc == 2 ) &&
+        ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vPrintTlsStats( pxCIO );
+    }
+
+#ifdef MBEDTLS_TRANSPORT_PSA
+    else if( ( ulArgc == 3 ) &&
+             ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) &&
+             ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+    {
+        ns_interface_reset_stats();
+        pxCIO->print( "TF-M veneer counters cleared.\r\n" );
+    }
+#endif
+
+#ifdef TLS_CLI_SELF_TEST
+    else if( ( ulArgc == 2 ) &&
+             ( strcmp( "selftest", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vSelfTest( pxCIO );
+    }
+#endif /* TLS_CLI_SELF_TEST */
+
+#ifdef TLS_CLI_GCM_BENCH
+    else if( ( ulArgc >= 2 ) &&
+             ( ulArgc <= 3 ) &&
+             ( strcmp( "gcm-bench", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        size_t uxLength = TLS_CLI_GCM_BENCH_LEN;
+
+        if( ulArgc == 3 )
+        {
+            uxLength = ( size_t ) strtoul( ppcArgv[ 2 ], NULL, 10 );
+        }
+
+        if( ( uxLength == 0 ) || ( uxLength > TLS_CLI_GCM_BENCH_MAX_LEN ) )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Error: LENGTH must be between 1 and %lu.\r\n",
+                               ( uint32_t ) TLS_CLI_GCM_BENCH_MAX_LEN );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            vGcmBench( pxCIO, uxLength );
+        }
+    }
+#endif /* TLS_CLI_GCM_BENCH */
+    else
+    {
+        pxCIO->print( xCommandDef_tls.pcHelpString );
+    }
+}
@@ -0,0 +1,479 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/*
+ * "top": a dashboard of the task, heap, network, MQTT and TLS statistics which is redrawn in
+ * place until a key is pressed. Each frame moves the cursor home and clears each line after
+ * writing it, so a terminal of any size shows the top of the frame without scrolling.
+ * Rates are over the refresh interval. Log output is held back while the dashboard runs.
+ */
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "cpu_load.h"
+#include "stack_watch.h"
+#include "heap_regions.h"
+#include "metrics.h"
+#include "mx_stats.h"
+#include "mbedtls_transport.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_agent_stats.h"
+
+#define TOP_DEFAULT_INTERVAL_S    2U
+#define TOP_MAX_INTERVAL_S        60U
+
+/* Room for tasks created while the dashboard runs */
+#define TOP_SPARE_TASKS           4U
+
+/* Counters of the metrics registry whose rate is shown, later ones are listed without a rate */
+#define TOP_MAX_METRICS           32U
+
+/* Clear the screen once, then redraw from the home position */
+#define TOP_ESC_CLEAR             "\033[2J"
+#define TOP_ESC_HOME              "\033[H"
+#define TOP_ESC_EOL               "\033[K\r\n"
+#define TOP_ESC_EOS               "\033[J"
+#define TOP_ESC_HIDE_CURSOR       "\033[?25l"
+#define TOP_ESC_SHOW_CURSOR       "\033[?25h"
+
+/* Values of the previous frame, rates are computed from them */
+typedef struct
+{
+    TickType_t xTicks;
+    uint64_t ullTxBytes;
+    uint64_t ullRxBytes;
+    uint32_t ulTxFrames;
+    uint32_t ulRxFrames;
+    uint32_t ulMqttCommands;
+    uint32_t ulPublishWaitCount;
+    uint64_t ullPublishWaitUs;
+    uint32_t ulPublishCompleteCount;
+    uint64_t ullPublishCompleteUs;
+    uint32_t ulMetrics[ TOP_MAX_METRICS ];
+} TopSample_t;
+
+typedef struct
+{
+    const TaskStatus_t * pxTask;
+    uint16_t usLoad[ CPU_LOAD_WINDOWS ];
+} TopRow_t;
+
+typedef struct
+{
+    ConsoleIO_t * pxCIO;
+    uint32_t ulIntervalMs;
+    uint32_t ulMetricIdx;
+    TopSample_t xPrev;
+    TopSample_t xNow;
+} TopCtx_t;
+
+static void prvTopCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_top =
+{
+    "top",
+    "top [-d <seconds>] [-n <frames>]\r\n"
+    "    Redraw the task, heap, network, MQTT and TLS statistics in place every 2 s, or every\r\n"
+    "    <seconds>, until a key is pressed or <frames> frames have been drawn.\r\n\n",
+    prvTopCommand
+};
+
+/*-----------------------------------------------------------*/
+
+/* Write one line of the frame, clearing what the previous frame left after it */
+static void prvTopLine( TopCtx_t * pxCtx,
+                        const char * pcFormat,
+                        ... )
+{
+    va_list xArgs;
+    int lLen;
+
+    va_start( xArgs, pcFormat );
+    lLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( lLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        lLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    if( lLen > 0 )
+    {
+        pxCtx->pxCIO->write( pcCliScratchBuffer, ( uint32_t ) lLen );
+    }
+
+    pxCtx->pxCIO->print( TOP_ESC_EOL );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Per second rate of a counter which grew by ullDelta since the previous frame */
+static uint32_t ulTopRate( const TopCtx_t * pxCtx,
+                           uint64_t ullDelta )
+{
+    uint32_t ulMs = pdTICKS_TO_MS( pxCtx->xNow.xTicks - pxCtx->xPrev.xTicks );
+
+    return ( ulMs > 0 ) ? ( uint32_t ) ( ( ullDelta * 1000U ) / ulMs ) : 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+static char cTopTaskState( eTaskState xState )
+{
+    static const char cStates[] = { 'R', 'r', 'B', 'S', 'D' };
+
+    return ( ( uint32_t ) xState < sizeof( cStates ) ) ? cStates[ xState ] : '?';
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTopSummary( TopCtx_t * pxCtx )
+{
+    uint32_t ulSecs = pdTICKS_TO_MS( pxCtx->xNow.xTicks ) / 1000U;
+    uint16_t usBusy[ CPU_LOAD_WINDOWS ] = { 0 };
+    HeapStats_t xHeapStats;
+
+    ( void ) uxCpuLoadGet( NULL, 0, usBusy );
+    vPortGetHeapStats( &xHeapStats );
+
+    prvTopLine( pxCtx, "top - up %lu day(s) %02lu:%02lu:%02lu, %lu tasks, CPU busy 1 s: %u.%u%%, 10 s: %u.%u%%, 60 s: %u.%u%%",
+                ulSecs / 86400U, ( ulSecs % 86400U ) / 3600U, ( ulSecs % 3600U ) / 60U, ulSecs % 60U,
+                ( uint32_t ) uxTaskGetNumberOfTasks(),
+                usBusy[ 0 ] / 10, usBusy[ 0 ] % 10,
+                usBusy[ 1 ] / 10, usBusy[ 1 ] % 10,
+                usBusy[ 2 ] / 10, usBusy[ 2 ] % 10 );
+
+    prvTopLine( pxCtx, "Heap: %u of %u bytes free, min free %u, largest block %u, %u free blocks",
+                ( unsigned int ) xHeapStats.xAvailableHeapSpaceInBytes,
+                ( unsigned int ) xHeapRegionTotalSize(),
+                ( unsigned int ) xHeapStats.xMinimumEverFreeBytesRemaining,
+                ( unsigned int ) xHeapStats.xSizeOfLargestFreeBlockInBytes,
+                ( unsigned int ) xHeapStats.xNumberOfFreeBlocks );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTopNetwork( TopCtx_t * pxCtx )
+{
+    static MxDataplaneStats_t xStats;
+
+    mx_GetDataplaneStats( &xStats );
+
+    pxCtx->xNow.ullTxBytes = xStats.ullTxBytes;
+    pxCtx->xNow.ullRxBytes = xStats.ullRxBytes;
+    pxCtx->xNow.ulTxFrames = xStats.ulTxFrames;
+    pxCtx->xNow.ulRxFrames = xStats.ulRxFrames;
+
+    prvTopLine( pxCtx, "Net:  TX %lu B/s %lu frames/s, RX %lu B/s %lu frames/s, TX queue peak %lu full %lu, RX pool exhausted %lu",
+                ulTopRate( pxCtx, pxCtx->xNow.ullTxBytes - pxCtx->xPrev.ullTxBytes ),
+                ulTopRate( pxCtx, pxCtx->xNow.ulTxFrames - pxCtx->xPrev.ulTxFrames ),
+                ulTopRate( pxCtx, pxCtx->xNow.ullRxBytes - pxCtx->xPrev.ullRxBytes ),
+                ulTopRate( pxCtx, pxCtx->xNow.ulRxFrames - pxCtx->xPrev.ulRxFrames ),
+                xStats.ulTxQueueHighWaterMark,
+                xStats.ulTxQueueFull,
+                xStats.ulRxPoolExhausted );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTopMqtt( TopCtx_t * pxCtx )
+{
+    static MqttAgentCommandStats_t xPublishStats;
+    MqttAgentQueueStats_t xQueueStats;
+    uint32_t ulWaitCount;
+    uint32_t ulCompleteCount;
+
+    MqttAgent_GetQueueStats( &xQueueStats );
+    MqttAgent_GetCommandStats( PUBLISH, &xPublishStats );
+
+    pxCtx->xNow.ulMqttCommands = xQueueStats.ulCommandsProcessed;
+    pxCtx->xNow.ulPublishWaitCount = xPublishStats.xQueueWait.ulCount;
+    pxCtx->xNow.ullPublishWaitUs = xPublishStats.xQueueWait.ullTotalUs;
+    pxCtx->xNow.ulPublishCompleteCount = xPublishStats.xComplete.ulCount;
+    pxCtx->xNow.ullPublishCompleteUs = xPublishStats.xComplete.ullTotalUs;
+
+    ulWaitCount = pxCtx->xNow.ulPublishWaitCount - pxCtx->xPrev.ulPublishWaitCount;
+    ulCompleteCount = pxCtx->xNow.ulPublishCompleteCount - pxCtx->xPrev.ulPublishCompleteCount;
+
+    prvTopLine( pxCtx, "MQTT: queue %lu (peak %lu of %lu), %lu commands/s, %lu publishes/s",
+                ( uint32_t ) MqttAgent_GetQueueDepth( xGetMqttAgentHandle() ),
+                xQueueStats.ulQueueHighWaterMark,
+                ( uint32_t ) MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                ulTopRate( pxCtx, pxCtx->xNow.ulMqttCommands - pxCtx->xPrev.ulMqttCommands ),
+                ulTopRate( pxCtx, ulWaitCount ) );
+
+    /* Averages over the publishes of the last interval, the maximums since the last reset */
+    prvTopLine( pxCtx, "      publish queue wait avg %lu max %lu us, complete avg %lu max %lu us",
+                ( ulWaitCount > 0 ) ? ( uint32_t ) ( ( pxCtx->xNow.ullPublishWaitUs - pxCtx->xPrev.ullPublishWaitUs ) / ulWaitCount ) : 0U,
+                xPublishStats.xQueueWait.ulMaxUs,
+                ( ulCompleteCount > 0 ) ? ( uint32_t ) ( ( pxCtx->xNow.ullPublishCompleteUs - pxCtx->xPrev.ullPublishCompleteUs ) / ulCompleteCount ) : 0U,
+                xPublishStats.xComplete.ulMaxUs );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTopTls( TopCtx_t * pxCtx )
+{
+    TlsHandshakeTiming_t xTiming;
+
+    if( mbedtls_transport_get_handshake_timing( &xTiming, 1 ) > 0 )
+    {
+        prvTopLine( pxCtx, "TLS:  last handshake %lu ms to %s, status %ld",
+                    xTiming.ulTotalUs / 1000U,
+                    xTiming.pcHostName,
+                    xTiming.lStatus );
+    }
+    else
+    {
+        prvTopLine( pxCtx, "TLS:  no handshake yet" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Upper bound of the bucket which holds the ulPct percentile of a histogram */
+static uint32_t ulTopPercentile( const MetricSnapshot_t * pxMetric,
+                                 uint32_t ulPct )
+{
+    uint32_t ulRank = ( uint32_t ) ( ( ( ( uint64_t ) pxMetric->ulValue * ulPct ) + 99U ) / 100U );
+    uint32_t ulSeen = 0;
+    size_t uxIdx = 0;
+
+    for( ; uxIdx < pxMetric->uxBuckets; uxIdx++ )
+    {
+        ulSeen += pxMetric->pulBuckets[ uxIdx ];
+
+        if( ulSeen >= ulRank )
+        {
+            break;
+        }
+    }
+
+    return ( uxIdx == 0 ) ? 0U : ( ( 1UL << uxIdx ) - 1U );
+}
+
+static BaseType_t prvTopMetric( const MetricSnapshot_t * pxMetric,
+                                void * pvCtx )
+{
+    TopCtx_t * pxCtx = ( TopCtx_t * ) pvCtx;
+    uint32_t ulIdx = pxCtx->ulMetricIdx++;
+
+    if( ulIdx < TOP_MAX_METRICS )
+    {
+        pxCtx->xNow.ulMetrics[ ulIdx ] = pxMetric->ulValue;
+    }
+
+    switch( pxMetric->xType )
+    {
+        case MetricTypeCounter:
+
+            if( ulIdx < TOP_MAX_METRICS )
+            {
+                prvTopLine( pxCtx, "  %-28s %10lu %8lu/s", pxMetric->pcName, pxMetric->ulValue,
+                            ulTopRate( pxCtx, pxMetric->ulValue - pxCtx->xPrev.ulMetrics[ ulIdx ] ) );
+            }
+            else
+            {
+                prvTopLine( pxCtx, "  %-28s %10lu", pxMetric->pcName, pxMetric->ulValue );
+            }
+
+            break;
+
+        case MetricTypeGauge:
+            prvTopLine( pxCtx, "  %-28s %10lu", pxMetric->pcName, pxMetric->ulValue );
+            break;
+
+        case MetricTypeHistogram:
+        default:
+            prvTopLine( pxCtx, "  %-28s %10lu   p50 <= %lu, p99 <= %lu", pxMetric->pcName, pxMetric->ulValue,
+                        ulTopPercentile( pxMetric, 50 ), ulTopPercentile( pxMetric, 99 ) );
+            break;
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Tasks by decreasing load over the last second */
+static void prvTopTasks( TopCtx_t * pxCtx,
+                         const TaskStatus_t * pxTasks,
+                         TopRow_t * pxRows,
+                         UBaseType_t uxNumTasks )
+{
+    prvTopLine( pxCtx, "" );
+    prvTopLine( pxCtx, "  ID Name             S Prio  CPU 1 s  10 s  60 s  Stack free/depth" );
+
+    for( UBaseType_t i = 0; i < uxNumTasks; i++ )
+    {
+        TopRow_t xRow = { .pxTask = &( pxTasks[ i ] ) };
+        UBaseType_t j = i;
+
+        /* Tasks created since the last sample show no load yet */
+        ( void ) xCpuLoadGetTask( pxTasks[ i ].xHandle, xRow.usLoad );
+
+        for( ; ( j > 0 ) && ( pxRows[ j - 1 ].usLoad[ 0 ] < xRow.usLoad[ 0 ] ); j-- )
+        {
+            pxRows[ j ] = pxRows[ j - 1 ];
+        }
+
+        pxRows[ j ] = xRow;
+    }
+
+    for( UBaseType_t i = 0; i < uxNumTasks; i++ )
+    {
+        const TaskStatus_t * pxTask = pxRows[ i ].pxTask;
+        const uint16_t * pusLoad = pxRows[ i ].usLoad;
+
+        prvTopLine( pxCtx, "%4lu %-16.16s %c %4lu   %3u.%u %3u.%u %3u.%u  %5u/%-5lu",
+                    ( uint32_t ) pxTask->xTaskNumber,
+                    pxTask->pcTaskName,
+                    cTopTaskState( pxTask->eCurrentState ),
+                    ( uint32_t ) pxTask->uxCurrentPriority,
+                    pusLoad[ 0 ] / 10, pusLoad[ 0 ] % 10,
+                    pusLoad[ 1 ] / 10, pusLoad[ 1 ] % 10,
+                    pusLoad[ 2 ] / 10, pusLoad[ 2 ] % 10,
+                    ( unsigned int ) pxTask->usStackHighWaterMark,
+                    ulStackWatchGetDepth( pxTask->xHandle ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTopCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] )
+{
+    static TopCtx_t xCtx;
+    uint32_t ulIntervalS = TOP_DEFAULT_INTERVAL_S;
+    uint32_t ulFrames = 0;
+    BaseType_t xArgsValid = pdTRUE;
+    UBaseType_t uxMaxTasks = uxTaskGetNumberOfTasks() + TOP_SPARE_TASKS;
+    TaskStatus_t * pxTasks = NULL;
+    TopRow_t * pxRows = NULL;
+
+    for( uint32_t i = 1; i < ulArgc; i++ )
+    {
+        if( ( strcmp( "-d", ppcArgv[ i ] ) == 0 ) && ( ( i + 1 ) < ulArgc ) )
+        {
+            ulIntervalS = ( uint32_t ) strtoul( ppcArgv[ ++i ], NULL, 10 );
+            xArgsValid = xArgsValid && ( ulIntervalS > 0 ) && ( ulIntervalS <= TOP_MAX_INTERVAL_S );
+        }
+        else if( ( strcmp( "-n", ppcArgv[ i ] ) == 0 ) && ( ( i + 1 ) < ulArgc ) )
+        {
+            ulFrames = ( uint32_t ) strtoul( ppcArgv[ ++i ], NULL, 10 );
+        }
+        else
+        {
+            xArgsValid = pdFALSE;
+        }
+    }
+
+    if( xArgsValid == pdFALSE )
+    {
+        pxCIO->print( xCommandDef_top.pcHelpString );
+        return;
+    }
+
+    pxTasks = ( TaskStatus_t * ) pvPortMalloc( sizeof( TaskStatus_t ) * uxMaxTasks );
+    pxRows = ( TopRow_t * ) pvPortMalloc( sizeof( TopRow_t ) * uxMaxTasks );
+
+    if( ( pxTasks == NULL ) || ( pxRows == NULL ) )
+    {
+        pxCIO->print( "Error: Not enough memory to complete the operation\r\n" );
+    }
+    else
+    {
+        char cKey = 0;
+
+        ( void ) memset( &xCtx, 0, sizeof( xCtx ) );
+        xCtx.pxCIO = pxCIO;
+        xCtx.ulIntervalMs = ulIntervalS * 1000U;
+        xCtx.xPrev.xTicks = xTaskGetTickCount();
+
+        pxCIO->lock();
+        pxCIO->print( TOP_ESC_HIDE_CURSOR TOP_ESC_CLEAR );
+
+        for( uint32_t ulFrame = 0; ( ulFrames == 0 ) || ( ulFrame < ulFrames ); ulFrame++ )
+        {
+            UBaseType_t uxNumTasks = uxTaskGetSystemState( pxTasks, uxMaxTasks, NULL );
+
+            xCtx.xNow.xTicks = xTaskGetTickCount();
+            xCtx.ulMetricIdx = 0;
+
+            pxCIO->print( TOP_ESC_HOME );
+
+            prvTopSummary( &xCtx );
+            prvTopNetwork( &xCtx );
+            prvTopMqtt( &xCtx );
+            prvTopTls( &xCtx );
+
+            prvTopLine( &xCtx, "" );
+            prvTopLine( &xCtx, "Metrics:" );
+            vMetricsSnapshot( prvTopMetric, &xCtx );
+
+            if( uxNumTasks > 0 )
+            {
+                prvTopTasks( &xCtx, pxTasks, pxRows, uxNumTasks );
+            }
+            else
+            {
+                prvTopLine( &xCtx, "More than %lu tasks, restart top to list them.", ( uint32_t ) uxMaxTasks );
+            }
+
+            pxCIO->print( TOP_ESC_EOS );
+
+            xCtx.xPrev = xCtx.xNow;
+
+            if( pxCIO->read_timeout( &cKey, 1, pdMS_TO_TICKS( xCtx.ulIntervalMs ) ) > 0 )
+            {
+                break;
+            }
+        }
+
+        pxCIO->print( TOP_ESC_SHOW_CURSOR "\r\n" );
+        pxCIO->unlock();
+    }
+
+    vPortFree( pxTasks );
+    vPortFree( pxRows );
+}
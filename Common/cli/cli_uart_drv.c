@@ -27,24 +27,43 @@
 #include "cli_prv.h"
 #include "logging.h"
 #include "stream_buffer.h"
-#include "message_buffer.h"
+#include "static_alloc.h"
+#include "lowpower.h"
+#include "dvfs.h"
+#include "sram_banks.h"
 
 #include <string.h>
 
-#define HW_FIFO_LEN    8
+/* Room for the "\r\033[K" sequence which clears a partially typed command before a log line */
+#define LOG_LINE_PREFIX_LEN    4
 
-extern volatile StreamBufferHandle_t xLogMBuf;
+/* Notification indexes of the transmit thread, and of a writer waiting for room in the ring */
+#define TX_DONE_NOTIFY_IDX     1
+#define TX_KICK_NOTIFY_IDX     dlLOG_READER_NOTIFY_IDX /* Also ends a wait in xLoggingReceive */
+#define TX_SPACE_NOTIFY_IDX    2
 
-static char ucLogLineTxBuff[ dlMAX_PRINT_STRING_LENGTH ];
+/* Notification index of the receive thread */
+#define RX_NOTIFY_IDX          1
+
+/* A log line is sent straight out of this buffer, followed by the prompt and the command being typed */
+static char ucLogLineTxBuff[ LOG_LINE_PREFIX_LEN + dlMAX_LOG_LINE_LENGTH + CLI_PROMPT_LEN + CLI_INPUT_LINE_LEN_MAX ];
 static SemaphoreHandle_t xUartTxSem = NULL;
 
+/*
+ * Console output ring, written by uart_write and sent out by DMA from where it lies.
+ * ulTxHead is only advanced by the writer and ulTxTail by the transmit thread, one byte stays free.
+ */
+static uint8_t pucTxRing[ CLI_UART_TX_STREAM_LEN ];
+static volatile uint32_t ulTxHead = 0;
+static volatile uint32_t ulTxTail = 0;
+static volatile TaskHandle_t xTxWriterTask = NULL;
+
 static volatile BaseType_t xPartialCommand = pdFALSE;
 /*static volatile BaseType_t xCliStreamInterrupted = pdFALSE; */
 
 #define BUFFER_READ_TIMEOUT_MS    pdMS_TO_TICKS( 5 )
 
 StreamBufferHandle_t xUartRxStream = NULL;
-StreamBufferHandle_t xUartTxStream = NULL;
 
 static char pcInputBuffer[ CLI_INPUT_LINE_LEN_MAX ] = { 0 };
 static volatile uint32_t ulInBufferIdx = 0;
@@ -58,17 +77,107 @@ static UART_HandleTypeDef xConsoleHandle =
     .Init.Parity                 = UART_PARITY_NONE,
     .Init.Mode                   = UART_MODE_TX_RX,
     .Init.HwFlowCtl              = UART_HWCONTROL_NONE,
-    .Init.OverSampling           = UART_OVERSAMPLING_16,
+    .Init.OverSampling           = UART_OVERSAMPLING_8, /* 0.8 % baud error at 921600 from the 16 MHz HSI */
     .Init.OneBitSampling         = UART_ONE_BIT_SAMPLE_DISABLE,
     .Init.ClockPrescaler         = UART_PRESCALER_DIV1,
-    .AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT,
+    .AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_RXOVERRUNDISABLE_INIT,
+    .AdvancedInit.OverrunDisable = UART_ADVFEATURE_OVERRUN_DISABLE, /* See prvRxStart */
+};
+
+static DMA_HandleTypeDef xConsoleTxDma =
+{
+    .Instance                  = GPDMA1_Channel6,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_USART1_TX,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+/*
+ * Console input ring, written by the receive DMA in a one node circular list. HAL_UART reports the
+ * DMA write offset at half ring, at the end of the ring and when the line goes idle, and the
+ * receive thread moves the new bytes from the ring to xUartRxStream.
+ */
+static uint8_t pucRxRing[ CLI_UART_RX_RING_LEN ] SRAM_BANK_DMA;
+static volatile uint32_t ulRxItStart = 0; /* Ring offset of the current interrupt driven reception */
+
+static DMA_HandleTypeDef xConsoleRxDma =
+{
+    .Instance                           = GPDMA1_Channel7,
+    .InitLinkedList                     =
+    {
+        .Priority                       = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .LinkStepMode                   = DMA_LSM_FULL_EXECUTION,
+        .LinkAllocatedPort              = DMA_LINK_ALLOCATED_PORT1,
+        .TransferEventMode              = DMA_TCEM_BLOCK_TRANSFER,
+        .LinkedListMode                 = DMA_LINKEDLIST_CIRCULAR,
+    },
 };
 
+static DMA_QListTypeDef xConsoleRxQueue = { 0 };
+static DMA_NodeTypeDef xConsoleRxNode = { 0 };
+
 static BaseType_t xExitFlag = pdFALSE;
 
 static TaskHandle_t xRxThreadHandle = NULL;
 static TaskHandle_t xTxThreadHandle = NULL;
 
+/* The one node circular list over pucRxRing, built once and linked to the channel at each MSP init */
+static HAL_StatusTypeDef prvRxQueueBuild( void )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    DMA_NodeConfTypeDef xNodeConf = { 0 };
+
+    if( xConsoleRxQueue.NodeNumber == 0 )
+    {
+        xNodeConf.NodeType = DMA_GPDMA_LINEAR_NODE;
+        xNodeConf.Init.Request = GPDMA1_REQUEST_USART1_RX;
+        xNodeConf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+        xNodeConf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        xNodeConf.Init.SrcInc = DMA_SINC_FIXED;
+        xNodeConf.Init.DestInc = DMA_DINC_INCREMENTED;
+        xNodeConf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+        xNodeConf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+        xNodeConf.Init.SrcBurstLength = 1;
+        xNodeConf.Init.DestBurstLength = 1;
+        xNodeConf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+        xNodeConf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        xNodeConf.Init.Mode = DMA_NORMAL;
+        xNodeConf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+        xNodeConf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+        xNodeConf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+        xNodeConf.SrcAddress = ( uint32_t ) &( USART1->RDR );
+        xNodeConf.DstAddress = ( uint32_t ) pucRxRing;
+        xNodeConf.DataSize = CLI_UART_RX_RING_LEN;
+
+        xHalStatus = HAL_DMAEx_List_BuildNode( &xNodeConf, &xConsoleRxNode );
+
+        if( xHalStatus == HAL_OK )
+        {
+            xHalStatus = HAL_DMAEx_List_InsertNode_Tail( &xConsoleRxQueue, &xConsoleRxNode );
+        }
+
+        if( xHalStatus == HAL_OK )
+        {
+            xHalStatus = HAL_DMAEx_List_SetCircularMode( &xConsoleRxQueue );
+        }
+    }
+
+    return xHalStatus;
+}
+
 static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
@@ -80,7 +189,13 @@ static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
         __HAL_RCC_USART1_CLK_DISABLE();
 
         xClockInit.PeriphClockSelection = RCC_PERIPHCLK_USART1;
-        xClockInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK2;
+
+        #if ( DVFS_ENABLED == 1 )
+            /* Independent of the system clock level, started by SystemClock_Config */
+            xClockInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
+        #else
+            xClockInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK2;
+        #endif
 
         xHalStatus = HAL_RCCEx_PeriphCLKConfig( &xClockInit );
 
@@ -107,6 +222,30 @@ static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
 
         HAL_NVIC_SetPriority( USART1_IRQn, 5, 1 );
         HAL_NVIC_EnableIRQ( USART1_IRQn );
+
+        /* Transmit DMA, the UART is still usable in blocking mode if this fails */
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        if( ( HAL_DMA_Init( &xConsoleTxDma ) == HAL_OK ) &&
+            ( HAL_DMA_ConfigChannelAttributes( &xConsoleTxDma, DMA_CHANNEL_NPRIV ) == HAL_OK ) )
+        {
+            __HAL_LINKDMA( huart, hdmatx, xConsoleTxDma );
+
+            HAL_NVIC_SetPriority( GPDMA1_Channel6_IRQn, 5, 1 );
+            HAL_NVIC_EnableIRQ( GPDMA1_Channel6_IRQn );
+        }
+
+        /* Receive DMA, input is received by interrupt into the same ring if this fails */
+        if( ( prvRxQueueBuild() == HAL_OK ) &&
+            ( HAL_DMAEx_List_Init( &xConsoleRxDma ) == HAL_OK ) &&
+            ( HAL_DMAEx_List_LinkQ( &xConsoleRxDma, &xConsoleRxQueue ) == HAL_OK ) &&
+            ( HAL_DMA_ConfigChannelAttributes( &xConsoleRxDma, DMA_CHANNEL_NPRIV ) == HAL_OK ) )
+        {
+            __HAL_LINKDMA( huart, hdmarx, xConsoleRxDma );
+
+            HAL_NVIC_SetPriority( GPDMA1_Channel7_IRQn, 5, 1 );
+            HAL_NVIC_EnableIRQ( GPDMA1_Channel7_IRQn );
+        }
     }
 }
 
@@ -115,11 +254,30 @@ void USART1_IRQHandler( void )
     HAL_UART_IRQHandler( &xConsoleHandle );
 }
 
+void GPDMA1_Channel6_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xConsoleTxDma );
+}
+
+void GPDMA1_Channel7_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xConsoleRxDma );
+}
+
 static void vUart1MspDeInitCallback( UART_HandleTypeDef * huart )
 {
     if( huart == &xConsoleHandle )
     {
         HAL_NVIC_DisableIRQ( USART1_IRQn );
+        HAL_NVIC_DisableIRQ( GPDMA1_Channel6_IRQn );
+        ( void ) HAL_DMA_DeInit( &xConsoleTxDma );
+        huart->hdmatx = NULL;
+
+        HAL_NVIC_DisableIRQ( GPDMA1_Channel7_IRQn );
+        ( void ) HAL_DMAEx_List_UnLinkQ( &xConsoleRxDma );
+        ( void ) HAL_DMAEx_List_DeInit( &xConsoleRxDma );
+        huart->hdmarx = NULL;
+
         /* De-initialize GPIOs */
         HAL_GPIO_DeInit( GPIOA, GPIO_PIN_10 | GPIO_PIN_9 );
         __HAL_RCC_USART1_CLK_DISABLE();
@@ -151,12 +309,11 @@ BaseType_t xInitConsoleUart( void )
 {
     HAL_StatusTypeDef xHalRslt = HAL_OK;
 
-    xUartTxSem = xSemaphoreCreateBinary();
+    xUartTxSem = xAppSemaphoreCreateBinary();
 
     ( void ) HAL_UART_DeInit( &xConsoleHandle );
 
-    xUartRxStream = xStreamBufferCreate( CLI_UART_RX_STREAM_LEN, 1 );
-    xUartTxStream = xStreamBufferCreate( CLI_UART_TX_STREAM_LEN, HW_FIFO_LEN ); /*TODO maybe increase this */
+    xUartRxStream = xAppStreamBufferCreate( CLI_UART_RX_STREAM_LEN, 1 );
 
     xHalRslt |= HAL_UART_RegisterCallback( &xConsoleHandle, HAL_UART_MSPINIT_CB_ID, vUart1MspInitCallback );
     xHalRslt |= HAL_UART_RegisterCallback( &xConsoleHandle, HAL_UART_MSPDEINIT_CB_ID, vUart1MspDeInitCallback );
@@ -194,8 +351,8 @@ BaseType_t xInitConsoleUart( void )
     }
 
     /* Start TX and RX tasks */
-    xTaskCreate( vRxThread, "uartRx", 1024, NULL, 30, &xRxThreadHandle );
-    xTaskCreate( vTxThread, "uartTx", 1024, NULL, 24, &xTxThreadHandle );
+    ( void ) xAppTaskCreateCpuBank( vRxThread, "uartRx", 1024, NULL, 30, &xRxThreadHandle );
+    ( void ) xAppTaskCreateCpuBank( vTxThread, "uartTx", 1024, NULL, 24, &xTxThreadHandle );
 
     ( void ) xSemaphoreGive( xUartTxSem );
 
@@ -203,114 +360,125 @@ BaseType_t xInitConsoleUart( void )
 }
 
 
-/* Receive buffer A/B */
-static uint8_t puxRxBufferA[ CLI_UART_RX_READ_SZ_10MS ] = { 0 };
-static uint8_t puxRxBufferB[ CLI_UART_RX_READ_SZ_10MS ] = { 0 };
+#define RX_ERROR_FLAG    ( 1U << 31 )
+#define RX_POS_MASK      ( ~RX_ERROR_FLAG )
 
-static uint8_t * pucNextBuffer = NULL;
+/*
+ * Start receiving into pucRxRing. HAL_UART aborts the reception on a receive error, so the line
+ * error interrupts are disabled and overruns are not detected: a byte the DMA did not read in time
+ * is lost and the ones around it are kept.
+ */
+static HAL_StatusTypeDef prvRxStart( uint32_t ulOffset )
+{
+    HAL_StatusTypeDef xHalStatus;
 
-#define ERROR_FLAG       ( 1U << 31 )
-#define BUFFER_A_FLAG    ( 1U << 30 )
-#define BUFFER_B_FLAG    ( 1U << 29 )
-#define FLAGS_MASK       ( ERROR_FLAG | BUFFER_A_FLAG | BUFFER_B_FLAG )
-#define READ_LEN_MASK    ( ~FLAGS_MASK )
+    ulRxItStart = ulOffset;
 
-/* */
+    if( xConsoleHandle.hdmarx != NULL )
+    {
+        xHalStatus = HAL_UARTEx_ReceiveToIdle_DMA( &xConsoleHandle, pucRxRing, CLI_UART_RX_RING_LEN );
+    }
+    else
+    {
+        xHalStatus = HAL_UARTEx_ReceiveToIdle_IT( &xConsoleHandle, &pucRxRing[ ulOffset ],
+                                                  ( uint16_t ) ( CLI_UART_RX_RING_LEN - ulOffset ) );
+    }
+
+    if( xHalStatus == HAL_OK )
+    {
+        ATOMIC_CLEAR_BIT( xConsoleHandle.Instance->CR3, USART_CR3_EIE );
+        ATOMIC_CLEAR_BIT( xConsoleHandle.Instance->CR1, USART_CR1_PEIE );
+    }
+
+    return xHalStatus;
+}
+
+/* A DMA transfer error */
 static void rxErrorCallback( UART_HandleTypeDef * pxUartHandle )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
+    ( void ) pxUartHandle;
+
     ( void ) xTaskNotifyIndexedFromISR( xRxThreadHandle,
-                                        1,
-                                        ERROR_FLAG,
-                                        eSetValueWithOverwrite,
+                                        RX_NOTIFY_IDX,
+                                        RX_ERROR_FLAG,
+                                        eSetBits,
                                         &xHigherPriorityTaskWoken );
 
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
-
+/* usBytesRead is the write offset in the ring for DMA, or the length received by interrupt */
 static void rxEventCallback( UART_HandleTypeDef * pxUartHandle,
                              uint16_t usBytesRead )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    uint32_t ulPos = ( ulRxItStart + usBytesRead ) % CLI_UART_RX_RING_LEN;
 
-    /* Check if we read some data or timed out */
-    if( usBytesRead > 0 )
-    {
-        uint32_t ulNotifyValue = usBytesRead;
-
-        /* Determine next buffer to write to */
-        configASSERT( pucNextBuffer != NULL );
+    vLowPowerConsoleActivity();
 
-        if( pucNextBuffer == puxRxBufferA )
-        {
-            ulNotifyValue |= BUFFER_A_FLAG;
-            pucNextBuffer = puxRxBufferB;
-        }
-        else if( pucNextBuffer == puxRxBufferB )
-        {
-            ulNotifyValue |= BUFFER_B_FLAG;
-            pucNextBuffer = puxRxBufferA;
-        }
-        else
-        {
-            /* pxUartHandle->pRxBuffPtr contents unrecognized */
-            configASSERT( 0 );
-        }
-
-        ( void ) xTaskNotifyIndexedFromISR( xRxThreadHandle,
-                                            1,
-                                            ulNotifyValue,
-                                            eSetValueWithOverwrite,
-                                            &xHigherPriorityTaskWoken );
-    }
-    else /* Otherwise IDLE timeout event, continue using the same buffer */
+    /* An interrupt driven reception ends at each event, it continues where the last one stopped */
+    if( pxUartHandle->hdmarx == NULL )
     {
-        configASSERT( pucNextBuffer != NULL );
-    }
+        HAL_StatusTypeDef xHalStatus = prvRxStart( ulPos );
 
-    xHalStatus = HAL_UARTEx_ReceiveToIdle_IT( pxUartHandle,
-                                              pucNextBuffer,
-                                              CLI_UART_RX_READ_SZ_10MS );
+        configASSERT( xHalStatus == HAL_OK );
+    }
 
-    configASSERT( xHalStatus == HAL_OK );
+    ( void ) xTaskNotifyIndexedFromISR( xRxThreadHandle,
+                                        RX_NOTIFY_IDX,
+                                        ulPos,
+                                        eSetValueWithOverwrite,
+                                        &xHigherPriorityTaskWoken );
 
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
 static void vRxThread( void * pvParameters )
 {
-    /* Start the initial receive into buffer A */
-    pucNextBuffer = puxRxBufferA;
-    rxEventCallback( &xConsoleHandle, 0 );
+    uint32_t ulReadPos = 0;
+
+    ( void ) pvParameters;
+
+    ( void ) prvRxStart( 0 );
 
     while( !xExitFlag )
     {
         uint32_t ulNotifyValue = 0;
 
-        /* Wait for completion event */
-        if( xTaskNotifyWaitIndexed( 1, 0, 0xFFFFFFFF, &ulNotifyValue, pdMS_TO_TICKS( 30 ) ) == pdTRUE )
+        /* Wait for a receive event */
+        if( xTaskNotifyWaitIndexed( RX_NOTIFY_IDX, 0, 0xFFFFFFFF, &ulNotifyValue, portMAX_DELAY ) == pdTRUE )
         {
-            size_t xBytes = ( ulNotifyValue & READ_LEN_MASK );
+            uint32_t ulWritePos = ( ulNotifyValue & RX_POS_MASK );
+            size_t xBytes = 0;
             size_t xBytesPushed = 0;
 
-            if( ( xBytes > 0 ) &&
-                ( ( ulNotifyValue & BUFFER_A_FLAG ) > 0 ) )
+            if( ( ulNotifyValue & RX_ERROR_FLAG ) != 0 )
             {
-                xBytesPushed = xStreamBufferSend( xUartRxStream, puxRxBufferA, xBytes, 0 );
+                LogWarn( "Console receive error, restarting the reception." );
+
+                ( void ) HAL_UART_AbortReceive( &xConsoleHandle );
+                ( void ) prvRxStart( 0 );
+                ulWritePos = 0;
             }
-            else if( ( xBytes > 0 ) &&
-                     ( ( ulNotifyValue & BUFFER_B_FLAG ) > 0 ) )
+            else if( ulWritePos < ulReadPos )
             {
-                xBytesPushed = xStreamBufferSend( xUartRxStream, puxRxBufferB, xBytes, 0 );
+                /* Wrapped around the end of the ring */
+                xBytes = CLI_UART_RX_RING_LEN - ulReadPos;
+                xBytesPushed = xStreamBufferSend( xUartRxStream, &pucRxRing[ ulReadPos ], xBytes, 0 );
+
+                xBytes += ulWritePos;
+                xBytesPushed += xStreamBufferSend( xUartRxStream, pucRxRing, ulWritePos, 0 );
             }
-            else /* Zero bytes or error case */
+            else
             {
-                xBytesPushed = 0;
+                xBytes = ulWritePos - ulReadPos;
+                xBytesPushed = xStreamBufferSend( xUartRxStream, &pucRxRing[ ulReadPos ], xBytes, 0 );
             }
 
+            ulReadPos = ulWritePos;
+
             /* Log warning if failed to add data */
             if( xBytesPushed != xBytes )
             {
@@ -325,95 +493,196 @@ static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, 1, &xHigherPriorityTaskWoken );
+    ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, TX_DONE_NOTIFY_IDX, &xHigherPriorityTaskWoken );
 
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
+/* Send xLength bytes by DMA and wait for the UART to complete the transfer */
+static void prvTransmit( uint8_t * pucData,
+                         size_t xLength )
+{
+    HAL_StatusTypeDef xHalStatus;
 
-/* Uart transmit thread */
-static void vTxThread( void * pvParameters )
+    /* Twice the time the frames take on the line */
+    TickType_t xTimeout = pdMS_TO_TICKS( ( 2000 * xLength ) / CLI_UART_FRAMES_PER_SEC ) + 2;
+
+    ( void ) xTaskNotifyStateClearIndexed( NULL, TX_DONE_NOTIFY_IDX );
+
+    vLowPowerInhibit();
+
+    if( xConsoleHandle.hdmatx != NULL )
+    {
+        xHalStatus = HAL_UART_Transmit_DMA( &xConsoleHandle, pucData, ( uint16_t ) xLength );
+    }
+    else
+    {
+        xHalStatus = HAL_UART_Transmit_IT( &xConsoleHandle, pucData, ( uint16_t ) xLength );
+    }
+
+    if( ( xHalStatus == HAL_OK ) &&
+        ( ulTaskNotifyTakeIndexed( TX_DONE_NOTIFY_IDX, pdTRUE, xTimeout ) == 0 ) )
+    {
+        /* A transfer error does not call txCompleteCallback */
+        ( void ) HAL_UART_AbortTransmit( &xConsoleHandle );
+    }
+
+    vLowPowerRelease();
+}
+
+/* Wake the transmit thread after console output was added to the ring, also while it waits for a log message */
+static void prvTxKick( void )
 {
-    uint8_t pucTxBuffer[ CLI_UART_TX_WRITE_SZ_5MS ] = { 0 };
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    ( void ) xTaskNotifyGiveIndexed( xTxThreadHandle, TX_KICK_NOTIFY_IDX );
+}
 
-    size_t xBytes = 0;
+/*
+ * Add the line clear, EOL and restored command line around the message which starts at
+ * LOG_LINE_PREFIX_LEN in ucLogLineTxBuff. Returns the line length and its offset in *pxStart.
+ */
+static size_t prvLogLineCompose( size_t xMessageLen,
+                                 size_t * pxStart )
+{
+    size_t xStart = LOG_LINE_PREFIX_LEN;
+    size_t xEnd = LOG_LINE_PREFIX_LEN + xMessageLen;
 
-    while( !xExitFlag )
+    if( xPartialCommand == pdTRUE )
+    {
+        /* Overwrite existing line contents */
+        xStart = 0;
+        ( void ) memcpy( ucLogLineTxBuff, "\r\033[K", LOG_LINE_PREFIX_LEN );
+    }
+
+    ( void ) memcpy( &ucLogLineTxBuff[ xEnd ], CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN );
+    xEnd += CLI_OUTPUT_EOL_LEN;
+
+    if( xPartialCommand == pdTRUE )
     {
-        /* Read up to 64 bytes
-         * wait up to BUFFER_READ_TIMEOUT before getting less than 64 */
-        xBytes = xStreamBufferReceive( xUartTxStream,
-                                       pucTxBuffer,
-                                       CLI_UART_TX_WRITE_SZ_5MS,
-                                       BUFFER_READ_TIMEOUT_MS );
-
-        /* If tx buffer is empty */
-        if( xBytes == 0 )
+        ( void ) memcpy( &ucLogLineTxBuff[ xEnd ], CLI_PROMPT_STR, CLI_PROMPT_LEN );
+        xEnd += CLI_PROMPT_LEN;
+
+        /* Restore current command line contents */
+        if( ulInBufferIdx > 0 )
         {
-            /* Take the uart write semaphore (non-blocking) */
-            if( xSemaphoreTake( xUartTxSem, 0 ) == pdTRUE )
-            {
-                xBytes = xMessageBufferReceive( xLogMBuf, ucLogLineTxBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+            ( void ) memcpy( &ucLogLineTxBuff[ xEnd ], pcInputBuffer, ulInBufferIdx );
+            xEnd += ulInBufferIdx;
+        }
+    }
 
-                /* All log messages should be less than the maximum length */
-                configASSERT( ( xBytes + CLI_OUTPUT_EOL_LEN + CLI_INPUT_LINE_LEN_MAX ) <= CLI_UART_TX_STREAM_LEN );
+    /* Log messages are dlMAX_PRINT_STRING_LENGTH at most */
+    configASSERT( xEnd <= sizeof( ucLogLineTxBuff ) );
 
-                /* If we got a log message to output, add it to the stream buffer to be processed */
-                if( xBytes > 0 )
-                {
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        /* Overwrite existing line contents */
-                        ( void ) xStreamBufferSend( xUartTxStream, "\r\033[K", 4, 0 );
-                    }
+    *pxStart = xStart;
 
-                    /* enqueue the log message */
-                    ( void ) xStreamBufferSend( xUartTxStream, ucLogLineTxBuff, xBytes, 0 );
+    return xEnd - xStart;
+}
 
-                    /* Add CRLF */
-                    ( void ) xStreamBufferSend( xUartTxStream, CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN, 0 );
+/*
+ * Uart transmit thread. Console output is sent straight out of the ring in the longest
+ * contiguous run, log lines straight out of ucLogLineTxBuff once the console is free.
+ */
+static void vTxThread( void * pvParameters )
+{
+    size_t xLogLen = 0;
 
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        ( void ) xStreamBufferSend( xUartTxStream, CLI_PROMPT_STR, CLI_PROMPT_LEN, 0 );
+    ( void ) pvParameters;
 
-                        /* Restore current command line contents */
-                        if( ulInBufferIdx > 0 )
-                        {
-                            ( void ) xStreamBufferSend( xUartTxStream, pcInputBuffer, ulInBufferIdx, 0 );
-                        }
-                    }
+    while( !xExitFlag )
+    {
+        uint32_t ulTail = ulTxTail;
+        uint32_t ulHead = __atomic_load_n( &ulTxHead, __ATOMIC_ACQUIRE );
+
+        if( ulHead != ulTail )
+        {
+            size_t xBytes = ( ulHead > ulTail ) ? ( ulHead - ulTail ) : ( CLI_UART_TX_STREAM_LEN - ulTail );
+            TaskHandle_t xWriter;
+
+            prvTransmit( &pucTxRing[ ulTail ], xBytes );
+
+            __atomic_store_n( &ulTxTail, ( ulTail + xBytes ) % CLI_UART_TX_STREAM_LEN, __ATOMIC_RELEASE );
 
-                    ( void ) xSemaphoreGive( xUartTxSem );
-                    xBytes = xStreamBufferReceive( xUartTxStream,
-                                                   pucTxBuffer,
-                                                   CLI_UART_TX_WRITE_SZ_5MS,
-                                                   0 );
-                }
-                else
-                {
-                    ( void ) xSemaphoreGive( xUartTxSem );
-                }
+            xWriter = xTxWriterTask;
+
+            if( xWriter != NULL )
+            {
+                ( void ) xTaskNotifyGiveIndexed( xWriter, TX_SPACE_NOTIFY_IDX );
             }
         }
+        else if( xLogLen == 0 )
+        {
+            /* Also woken by prvTxKick when console output is queued */
+            xLogLen = xLoggingReceive( &ucLogLineTxBuff[ LOG_LINE_PREFIX_LEN ],
+                                       dlMAX_LOG_LINE_LENGTH, BUFFER_READ_TIMEOUT_MS );
+
+            /* Format deferred records in this thread rather than in the logging task */
+            xLogLen = xLoggingFormatRecord( &ucLogLineTxBuff[ LOG_LINE_PREFIX_LEN ], xLogLen, dlMAX_LOG_LINE_LENGTH );
+
+            if( xLogLen > dlMAX_PRINT_STRING_LENGTH )
+            {
+                xLogLen = dlMAX_PRINT_STRING_LENGTH;
+            }
 
-        /* Transmit if bytes available to transmit */
-        if( xBytes > 0 )
+            vLoggingSinkPut( &ucLogLineTxBuff[ LOG_LINE_PREFIX_LEN ], xLogLen );
+        }
+        else if( xSemaphoreTake( xUartTxSem, 0 ) == pdTRUE )
         {
-            ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
-            xHalStatus = HAL_UART_Transmit_IT( &xConsoleHandle, pucTxBuffer, ( uint16_t ) xBytes );
-/*			configASSERT( xHalStatus == HAL_OK ); */
+            size_t xStart = 0;
+            size_t xLineLen = 0;
 
-            if( xHalStatus == HAL_OK )
+            /* Console output queued since the ring was checked goes out first */
+            if( __atomic_load_n( &ulTxHead, __ATOMIC_ACQUIRE ) == ulTxTail )
             {
-                /* Wait for completion event (should be within 1 or 2 ms) */
-                ( void ) ulTaskNotifyTakeIndexed( 1, pdTRUE, portMAX_DELAY );
+                xLineLen = prvLogLineCompose( xLogLen, &xStart );
+            }
+
+            ( void ) xSemaphoreGive( xUartTxSem );
+
+            if( xLineLen > 0 )
+            {
+                prvTransmit( ( uint8_t * ) &ucLogLineTxBuff[ xStart ], xLineLen );
+                xLogLen = 0;
             }
         }
+        else
+        {
+            /* A command holds the console, keep sending its output */
+            ( void ) ulTaskNotifyTakeIndexed( TX_KICK_NOTIFY_IDX, pdTRUE, BUFFER_READ_TIMEOUT_MS );
+        }
     }
 }
 
+/* Copy up to xLength bytes to the ring, returns the number of bytes copied */
+static size_t prvTxRingWrite( const uint8_t * pucData,
+                              size_t xLength )
+{
+    uint32_t ulHead = ulTxHead;
+    uint32_t ulTail = __atomic_load_n( &ulTxTail, __ATOMIC_ACQUIRE );
+    size_t xBytes;
+
+    if( ulHead >= ulTail )
+    {
+        /* Up to the end of the ring, or to one byte before the tail if it is at the start */
+        xBytes = CLI_UART_TX_STREAM_LEN - ulHead - ( ( ulTail == 0 ) ? 1 : 0 );
+    }
+    else
+    {
+        xBytes = ulTail - ulHead - 1;
+    }
+
+    if( xBytes > xLength )
+    {
+        xBytes = xLength;
+    }
+
+    if( xBytes > 0 )
+    {
+        ( void ) memcpy( &pucTxRing[ ulHead ], pucData, xBytes );
+        __atomic_store_n( &ulTxHead, ( ulHead + xBytes ) % CLI_UART_TX_STREAM_LEN, __ATOMIC_RELEASE );
+    }
+
+    return xBytes;
+}
+
 static void uart_write( const void * const pvOutputBuffer,
                         uint32_t xOutputBufferLen )
 {
@@ -424,13 +693,25 @@ static void uart_write( const void * const pvOutputBuffer,
     if( ( pvOutputBuffer != NULL ) &&
         ( xOutputBufferLen > 0 ) )
     {
+        /* Set before the ring is checked so that room made after the check is notified */
+        xTxWriterTask = xTaskGetCurrentTaskHandle();
+
         while( xBytesSent < xOutputBufferLen )
         {
-            xBytesSent += xStreamBufferSend( xUartTxStream,
-                                             ( const void * ) &( pcBuffer[ xBytesSent ] ),
-                                             xOutputBufferLen - xBytesSent,
-                                             portMAX_DELAY );
+            size_t xBytes = prvTxRingWrite( &( pcBuffer[ xBytesSent ] ), xOutputBufferLen - xBytesSent );
+
+            if( xBytes > 0 )
+            {
+                xBytesSent += xBytes;
+                prvTxKick();
+            }
+            else
+            {
+                ( void ) ulTaskNotifyTakeIndexed( TX_SPACE_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+            }
         }
+
+        xTxWriterTask = NULL;
     }
 
     configASSERT( xBytesSent == xOutputBufferLen );
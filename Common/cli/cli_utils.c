@@ -35,6 +35,16 @@
 
 #include "cli.h"
 #include "cli_prv.h"
+#include "cpu_load.h"
+#include "heap_trace.h"
+#include "heap_regions.h"
+#include "stack_watch.h"
+#include "metrics.h"
+#include "trace_rec.h"
+#include "sram_banks.h"
+#include "boot_prof.h"
+#include "sntp_time.h"
+#include "hw_defs.h"
 
 #include "core_cm33.h"
 
@@ -54,6 +64,30 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                               uint32_t ulArgc,
                               char * ppcArgv[] );
 
+static void prvStackCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] );
+
+static void prvMetricsCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+#if ( TRACE_REC_ENABLED == 1 )
+    static void prvTraceCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] );
+#endif
+
+#if ( SRAM_BANKS_ENABLED == 1 )
+    static void prvSramCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+#endif
+
+static void prvBootCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] );
+
 static void vResetCommand( ConsoleIO_t * const pxCIO,
                            uint32_t ulArgc,
                            char * ppcArgv[] );
@@ -62,6 +96,12 @@ static void vUptimeCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] );
 
+#if ( SNTP_TIME_ENABLED == 1 )
+    static void vTimeCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] );
+#endif
+
 static void vAssertCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] );
@@ -111,10 +151,74 @@ const CLI_Command_Definition_t xCommandDef_heapStat =
     "    heapstat --kilo\r\n"
     "        Display heap statistics in Kilobytes (KB).\r\n\n"
     "    heapstat --mega\r\n"
-    "        Display heap statistics in Megabytes (MB).\r\n\n",
+    "        Display heap statistics in Megabytes (MB).\r\n\n"
+    "    heapstat regions\r\n"
+    "        Display the size, free space and allocations of each heap region.\r\n\n"
+    "    heapstat tasks\r\n"
+    "        Display the bytes currently allocated by each task and their peak.\r\n\n"
+    "    heapstat sizes\r\n"
+    "        Display the allocations per size class.\r\n\n"
+    "    heapstat frag\r\n"
+    "        Display the largest free block over the last samples.\r\n\n"
+    "    heapstat snapshot\r\n"
+    "        Mark the blocks allocated so far.\r\n\n"
+    "    heapstat diff\r\n"
+    "        Display the blocks allocated since the last snapshot which are still live.\r\n\n",
     vHeapStatCommand
 };
 
+const CLI_Command_Definition_t xCommandDef_stack =
+{
+    "stack",
+    "stack\r\n"
+    "    List the stack depth, high water mark and recommended depth of each task, in words.\r\n\n",
+    prvStackCommand
+};
+
+const CLI_Command_Definition_t xCommandDef_metrics =
+{
+    "metrics",
+    "metrics\r\n"
+    "    List the counters, gauges and histograms of the metrics registry.\r\n"
+    "    Histogram buckets are shown with the smallest value they count.\r\n\n",
+    prvMetricsCommand
+};
+
+#if ( TRACE_REC_ENABLED == 1 )
+    const CLI_Command_Definition_t xCommandDef_trace =
+    {
+        "trace",
+        "trace\r\n"
+        "    trace start [sched | queue | slice]...\r\n"
+        "        Clear the event trace and record the given event classes, all of them by default.\r\n\n"
+        "    trace stop\r\n"
+        "        Stop recording.\r\n\n"
+        "    trace dump\r\n"
+        "        Stop recording and print the trace as Chrome trace JSON, to open with ui.perfetto.dev.\r\n\n",
+        prvTraceCommand
+    };
+#endif /* TRACE_REC_ENABLED == 1 */
+
+#if ( SRAM_BANKS_ENABLED == 1 )
+    const CLI_Command_Definition_t xCommandDef_sram =
+    {
+        "sram",
+        "sram\r\n"
+        "    List the bytes of each SRAM bank used by the DMA buffers, .data, .bss (FreeRTOS heap included),\r\n"
+        "    the CPU bank stacks and the main stack.\r\n\n",
+        prvSramCommand
+    };
+#endif /* SRAM_BANKS_ENABLED == 1 */
+
+const CLI_Command_Definition_t xCommandDef_boot =
+{
+    "boot",
+    "boot\r\n"
+    "    List the time since reset at which each boot phase was first reached, in ms.\r\n"
+    "    Storage and network phases run in parallel, so the times do not add up.\r\n\n",
+    prvBootCommand
+};
+
 const CLI_Command_Definition_t xCommandDef_reset =
 {
     "reset",
@@ -131,6 +235,16 @@ const CLI_Command_Definition_t xCommandDef_uptime =
     vUptimeCommand
 };
 
+#if ( SNTP_TIME_ENABLED == 1 )
+    const CLI_Command_Definition_t xCommandDef_time =
+    {
+        "time",
+        "time\r\n"
+        "    Display the UTC time and the state of its SNTP discipline.\r\n\n",
+        vTimeCommand
+    };
+#endif
+
 const CLI_Command_Definition_t xCommandDef_assert =
 {
     "assert",
@@ -179,30 +293,6 @@ static inline const char * pceTaskStateToString( eTaskState xState )
 
 /*-----------------------------------------------------------*/
 
-static uint32_t ulGetStackDepth( TaskHandle_t xTask )
-{
-    struct tskTaskControlBlockRedef
-    {
-        volatile StackType_t * pxDontCare0;
-
-        #if ( portUSING_MPU_WRAPPERS == 1 )
-            xMPU_SETTINGS xDontCare1;
-        #endif
-        ListItem_t xDontCare2;
-        ListItem_t xDontCare3;
-        UBaseType_t uxDontCare4;
-        StackType_t * pxStack;
-        char pcDontCare5[ configMAX_TASK_NAME_LEN ];
-
-        #if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
-            StackType_t * pxEndOfStack;
-        #endif
-    };
-    struct tskTaskControlBlockRedef * pxTCB = ( struct tskTaskControlBlockRedef * ) xTask;
-
-    return( ( ( ( uintptr_t ) pxTCB->pxEndOfStack - ( uintptr_t ) pxTCB->pxStack ) / sizeof( StackType_t ) ) + 2 );
-}
-
 static void prvPSCommand( ConsoleIO_t * const pxCIO,
                           uint32_t ulArgc,
                           char * ppcArgv[] )
@@ -218,34 +308,48 @@ static void prvPSCommand( ConsoleIO_t * const pxCIO,
     else
     {
         unsigned long ulTotalRuntime = 0;
+        uint16_t usBusy[ CPU_LOAD_WINDOWS ] = { 0 };
+
         uxNumTasks = uxTaskGetSystemState( pxTaskStatusArray,
                                            uxNumTasks,
                                            &ulTotalRuntime );
 
-        ulTotalRuntime /= 100;
+        ( void ) uxCpuLoadGet( NULL, 0, usBusy );
 
-        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "Total Runtime: %lu\r\n", ulTotalRuntime );
+        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                  "Total Runtime: %lu s, CPU busy 1 s: %u.%u%%, 10 s: %u.%u%%, 60 s: %u.%u%%\r\n",
+                  ulTotalRuntime / ( 1000000UL >> 5 ),
+                  usBusy[ 0 ] / 10, usBusy[ 0 ] % 10,
+                  usBusy[ 1 ] / 10, usBusy[ 1 ] % 10,
+                  usBusy[ 2 ] / 10, usBusy[ 2 ] % 10 );
 
         pxCIO->print( pcCliScratchBuffer );
 
-        pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
-        pxCIO->print( "| Task |   State   |    Task Name     |___Priority__| %CPU | Stack | Stack | Stack |\r\n" );
-        pxCIO->print( "|  ID  |           |                  | Base | Cur. |      | Alloc |  HWM  | Usage |\r\n" );
-        pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
-        /* "| 1234 | AAAAAAAAA | AAAAAAAAAAAAAAAA |  00  |  00  | 000% | 00000 | 00000 | 000%  |" */
+        pxCIO->print( "+---------------------------------------------------------------------------------------------------+\r\n" );
+        pxCIO->print( "| Task |   State   |    Task Name     |___Priority__|________CPU %__________| Stack | Stack | Stack |\r\n" );
+        pxCIO->print( "|  ID  |           |                  | Base | Cur. |  1 s  | 10 s  | 60 s  | Alloc |  HWM  | Usage |\r\n" );
+        pxCIO->print( "+---------------------------------------------------------------------------------------------------+\r\n" );
+        /* "| 1234 | AAAAAAAAA | AAAAAAAAAAAAAAAA |  00  |  00  | 100.0 | 100.0 | 100.0 | 00000 | 00000 | 000%  |" */
 
         for( uint32_t i = 0; i < uxNumTasks; i++ )
         {
-            uint32_t ulStackSize = ulGetStackDepth( pxTaskStatusArray[ i ].xHandle );
+            uint32_t ulStackSize = ulStackWatchGetDepth( pxTaskStatusArray[ i ].xHandle );
             uint32_t ucStackUsagePct = ( 100 * ( ulStackSize - pxTaskStatusArray[ i ].usStackHighWaterMark ) / ulStackSize );
+            uint16_t usLoad[ CPU_LOAD_WINDOWS ] = { 0 };
+
+            /* Tasks created since the last sample show no load yet */
+            ( void ) xCpuLoadGetTask( pxTaskStatusArray[ i ].xHandle, usLoad );
+
             snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
-                      "| %4lu | %-9s | %-16s |  %2lu  |  %2lu  | %3lu%% | %5lu | %5lu | %3lu%%  |\r\n",
+                      "| %4lu | %-9s | %-16s |  %2lu  |  %2lu  | %3u.%u | %3u.%u | %3u.%u | %5lu | %5lu | %3lu%%  |\r\n",
                       pxTaskStatusArray[ i ].xTaskNumber,
                       pceTaskStateToString( pxTaskStatusArray[ i ].eCurrentState ),
                       pxTaskStatusArray[ i ].pcTaskName,
                       pxTaskStatusArray[ i ].uxBasePriority,
                       pxTaskStatusArray[ i ].uxCurrentPriority,
-                      pxTaskStatusArray[ i ].ulRunTimeCounter / ulTotalRuntime,
+                      usLoad[ 0 ] / 10, usLoad[ 0 ] % 10,
+                      usLoad[ 1 ] / 10, usLoad[ 1 ] % 10,
+                      usLoad[ 2 ] / 10, usLoad[ 2 ] % 10,
                       ulStackSize,
                       ( uint32_t ) pxTaskStatusArray[ i ].usStackHighWaterMark,
                       ucStackUsagePct );
@@ -257,6 +361,248 @@ static void prvPSCommand( ConsoleIO_t * const pxCIO,
     }
 }
 
+static void prvStackCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] )
+{
+    UBaseType_t uxNumTasks = uxTaskGetNumberOfTasks();
+    StackWatchTask_t * pxTasks = ( StackWatchTask_t * ) pvPortMalloc( sizeof( StackWatchTask_t ) * uxNumTasks );
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    if( pxTasks == NULL )
+    {
+        pxCIO->print( "Error: Not enough memory to complete the operation" );
+    }
+    else
+    {
+        uint32_t ulSpare = 0;
+
+        uxNumTasks = uxStackWatchGet( pxTasks, uxNumTasks );
+
+        pxCIO->print( "+------------------+-------+-------+-------+-------+\r\n" );
+        pxCIO->print( "|    Task Name     | Depth | Used  |  HWM  | Rec.  |\r\n" );
+        pxCIO->print( "+------------------+-------+-------+-------+-------+\r\n" );
+
+        for( UBaseType_t i = 0; i < uxNumTasks; i++ )
+        {
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "| %-16s | %5lu | %5lu | %5lu | %5lu |%s\r\n",
+                      pxTasks[ i ].pcName,
+                      pxTasks[ i ].ulDepth,
+                      pxTasks[ i ].ulDepth - pxTasks[ i ].ulFree,
+                      pxTasks[ i ].ulFree,
+                      pxTasks[ i ].ulRecommended,
+                      ( pxTasks[ i ].ulRecommended > pxTasks[ i ].ulDepth ) ? " !" : "" );
+
+            pxCIO->print( pcCliScratchBuffer );
+
+            if( pxTasks[ i ].ulDepth > pxTasks[ i ].ulRecommended )
+            {
+                ulSpare += pxTasks[ i ].ulDepth - pxTasks[ i ].ulRecommended;
+            }
+        }
+
+        pxCIO->print( "+------------------+-------+-------+-------+-------+\r\n" );
+
+        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                  "Stack above the recommended depths: %lu bytes. The high water marks only cover the code run so far.\r\n",
+                  ( uint32_t ) ( ulSpare * sizeof( StackType_t ) ) );
+
+        pxCIO->print( pcCliScratchBuffer );
+
+        vPortFree( pxTasks );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvPrintMetric( const MetricSnapshot_t * pxMetric,
+                                  void * pvCtx )
+{
+    ConsoleIO_t * const pxCIO = ( ConsoleIO_t * ) pvCtx;
+    static const char * const pcTypes[] = { "counter", "gauge", "histogram" };
+
+    snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+              "%-28s %-9s %10lu\r\n",
+              pxMetric->pcName,
+              pcTypes[ pxMetric->xType ],
+              pxMetric->ulValue );
+
+    pxCIO->print( pcCliScratchBuffer );
+
+    for( size_t uxIdx = 0; uxIdx < pxMetric->uxBuckets; uxIdx++ )
+    {
+        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                  "    >= %-10lu %10lu\r\n",
+                  ( uxIdx == 0 ) ? 0UL : ( 1UL << ( uxIdx - 1 ) ),
+                  pxMetric->pulBuckets[ uxIdx ] );
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvMetricsCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    vMetricsSnapshot( prvPrintMetric, pxCIO );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( SRAM_BANKS_ENABLED == 1 )
+    static void prvSramCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+    {
+        SramBankUsage_t xBanks[ SRAM_BANK_COUNT ];
+
+        ( void ) ulArgc;
+        ( void ) ppcArgv;
+
+        vSramBankUsage( xBanks );
+
+        pxCIO->print( "+-------+------------+--------+--------+--------+--------+--------+--------+--------+--------+\r\n" );
+        pxCIO->print( "| Bank  |   Start    |  Size  |  DMA   |  Data  |  BSS   |  CPU   |  Code  | Stack  |  Free  |\r\n" );
+        pxCIO->print( "+-------+------------+--------+--------+--------+--------+--------+--------+--------+--------+\r\n" );
+
+        for( uint32_t i = 0; i < SRAM_BANK_COUNT; i++ )
+        {
+            uint32_t ulUsed = xBanks[ i ].ulDma + xBanks[ i ].ulData + xBanks[ i ].ulBss +
+                              xBanks[ i ].ulCpu + xBanks[ i ].ulCode + xBanks[ i ].ulMainStack;
+
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "| %-5s | 0x%08lx | %6lu | %6lu | %6lu | %6lu | %6lu | %6lu | %6lu | %6lu |\r\n",
+                      xBanks[ i ].pcName,
+                      xBanks[ i ].ulStart,
+                      xBanks[ i ].ulSize,
+                      xBanks[ i ].ulDma,
+                      xBanks[ i ].ulData,
+                      xBanks[ i ].ulBss,
+                      xBanks[ i ].ulCpu,
+                      xBanks[ i ].ulCode,
+                      xBanks[ i ].ulMainStack,
+                      ( ulUsed < xBanks[ i ].ulSize ) ? ( xBanks[ i ].ulSize - ulUsed ) : 0UL );
+
+            pxCIO->print( pcCliScratchBuffer );
+        }
+
+        pxCIO->print( "+-------+------------+--------+--------+--------+--------+--------+--------+--------+--------+\r\n" );
+    }
+#endif /* SRAM_BANKS_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+static void prvBootCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] )
+{
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    for( uint32_t i = 0; i < BOOT_PHASE_COUNT; i++ )
+    {
+        uint64_t ullUs = ullBootPhaseGetUs( ( BootPhase_t ) i );
+
+        if( ullUs == 0 )
+        {
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "%-16s %10s\r\n", pcBootPhaseName( ( BootPhase_t ) i ), "-" );
+        }
+        else
+        {
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "%-16s %6lu.%03lu\r\n", pcBootPhaseName( ( BootPhase_t ) i ),
+                      ( uint32_t ) ( ullUs / 1000 ),
+                      ( uint32_t ) ( ullUs % 1000 ) );
+        }
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( TRACE_REC_ENABLED == 1 )
+    static void prvTraceWrite( const char * pcText,
+                               void * pvCtx )
+    {
+        ConsoleIO_t * const pxCIO = ( ConsoleIO_t * ) pvCtx;
+
+        pxCIO->print( pcText );
+    }
+
+    static void prvTraceCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+    {
+        BaseType_t xSuccess = pdTRUE;
+
+        if( ( ulArgc >= 2 ) && ( strcmp( "start", ppcArgv[ 1 ] ) == 0 ) )
+        {
+            uint32_t ulMask = ( ulArgc == 2 ) ? TRACE_REC_MASK_ALL : 0;
+
+            for( uint32_t i = 2; ( i < ulArgc ) && ( xSuccess == pdTRUE ); i++ )
+            {
+                if( strcmp( "sched", ppcArgv[ i ] ) == 0 )
+                {
+                    ulMask |= TRACE_REC_MASK_SCHED;
+                }
+                else if( strcmp( "queue", ppcArgv[ i ] ) == 0 )
+                {
+                    ulMask |= TRACE_REC_MASK_QUEUE;
+                }
+                else if( strcmp( "slice", ppcArgv[ i ] ) == 0 )
+                {
+                    ulMask |= TRACE_REC_MASK_SLICE;
+                }
+                else
+                {
+                    xSuccess = pdFALSE;
+                }
+            }
+
+            if( xSuccess == pdTRUE )
+            {
+                vTraceRecStart( ulMask );
+                pxCIO->print( "Trace started.\r\n" );
+            }
+        }
+        else if( ( ulArgc == 2 ) && ( strcmp( "stop", ppcArgv[ 1 ] ) == 0 ) )
+        {
+            vTraceRecStop();
+
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "Trace stopped, %lu events recorded, the last %lu are kept.\r\n",
+                      ulTraceRecCount(), ( uint32_t ) TRACE_REC_ENTRIES );
+
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else if( ( ulArgc == 2 ) && ( strcmp( "dump", ppcArgv[ 1 ] ) == 0 ) )
+        {
+            vTraceRecDump( prvTraceWrite, pxCIO );
+        }
+        else
+        {
+            xSuccess = pdFALSE;
+        }
+
+        if( xSuccess == pdFALSE )
+        {
+            pxCIO->print( xCommandDef_trace.pcHelpString );
+        }
+    }
+#endif /* TRACE_REC_ENABLED == 1 */
+
 typedef enum
 {
     SIGHUP = 1,
@@ -426,14 +772,200 @@ static void vKillAllCommand( ConsoleIO_t * const pxCIO,
     }
 }
 
+#if ( HEAP_TRACE_ENABLED == 1 ) || ( HEAP_REGIONS_ENABLED == 1 )
+    static void prvHeapStatWrite( ConsoleIO_t * const pxCIO,
+                                  int lLen )
+    {
+        if( lLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            lLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        if( lLen > 0 )
+        {
+            pxCIO->write( pcCliScratchBuffer, lLen );
+        }
+    }
+#endif /* ( HEAP_TRACE_ENABLED == 1 ) || ( HEAP_REGIONS_ENABLED == 1 ) */
+
+#if ( HEAP_TRACE_ENABLED == 1 )
+
+/* Number of blocks listed by heapstat diff */
+    #define HEAPSTAT_DIFF_MAX_BLOCKS    32
+
+    static void prvHeapStatTasks( ConsoleIO_t * const pxCIO )
+    {
+        /* Static since the cli runs a single command at a time */
+        static HeapTraceOwner_t xOwners[ HEAP_TRACE_MAX_OWNERS ];
+        UBaseType_t uxOwners = uxHeapTraceGetOwners( xOwners, HEAP_TRACE_MAX_OWNERS );
+
+        pxCIO->print( "+------------------+-----------+-----------+-----------+-----------+\r\n" );
+        pxCIO->print( "| Task             | Current   | Peak      | Allocs    | Frees     |\r\n" );
+        pxCIO->print( "|------------------|-----------|-----------|-----------|-----------|\r\n" );
+
+        for( UBaseType_t i = 0; i < uxOwners; i++ )
+        {
+            prvHeapStatWrite( pxCIO,
+                              snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                        "| %-16.16s | %9lu | %9lu | %9lu | %9lu |\r\n",
+                                        xOwners[ i ].pcName,
+                                        xOwners[ i ].ulCurrentBytes,
+                                        xOwners[ i ].ulPeakBytes,
+                                        xOwners[ i ].ulAllocs,
+                                        xOwners[ i ].ulFrees ) );
+        }
+
+        pxCIO->print( "+------------------+-----------+-----------+-----------+-----------+\r\n" );
+    }
+
+    static void prvHeapStatSizes( ConsoleIO_t * const pxCIO )
+    {
+        HeapTraceStats_t xStats;
+
+        vHeapTraceGetStats( &xStats );
+
+        pxCIO->print( "+------------------+-----------+-----------+\r\n" );
+        pxCIO->print( "| Size (Bytes)     | Allocs    | Live      |\r\n" );
+        pxCIO->print( "|------------------|-----------|-----------|\r\n" );
+
+        for( uint32_t i = 0; i < HEAP_TRACE_SIZE_CLASSES; i++ )
+        {
+            uint32_t ulLimit = 1UL << ( HEAP_TRACE_SIZE_CLASS_MIN_LOG2 + i );
+            const char * pcFormat = "| <= %-13lu | %9lu | %9lu |\r\n";
+
+            /* The last class holds every larger block */
+            if( i == ( HEAP_TRACE_SIZE_CLASSES - 1 ) )
+            {
+                pcFormat = "| >  %-13lu | %9lu | %9lu |\r\n";
+                ulLimit >>= 1;
+            }
+
+            prvHeapStatWrite( pxCIO,
+                              snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat,
+                                        ulLimit, xStats.ulClassAllocs[ i ], xStats.ulClassLive[ i ] ) );
+        }
+
+        pxCIO->print( "+------------------+-----------+-----------+\r\n" );
+
+        prvHeapStatWrite( pxCIO,
+                          snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                    "Allocs: %lu, frees: %lu, failed: %lu, not charged to a task: %lu\r\n",
+                                    xStats.ulAllocs, xStats.ulFrees, xStats.ulFailed, xStats.ulUntracked ) );
+    }
+
+    static void prvHeapStatFrag( ConsoleIO_t * const pxCIO )
+    {
+        HeapTraceStats_t xStats;
+
+        vHeapTraceGetStats( &xStats );
+
+        prvHeapStatWrite( pxCIO,
+                          snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                    "Largest free block: %u bytes, lowest: %u bytes, free blocks: %u\r\n",
+                                    xStats.xLargestFree, xStats.xMinLargestFree, xStats.xFreeBlocks ) );
+
+        prvHeapStatWrite( pxCIO,
+                          snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                    "Largest free block (KiB) every %u s, oldest first:\r\n",
+                                    HEAP_TRACE_SAMPLE_PERIOD_S ) );
+
+        for( uint32_t i = 0; i < xStats.ulHistoryCount; i++ )
+        {
+            prvHeapStatWrite( pxCIO,
+                              snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                        ( ( i % 10 ) == 9 ) ? " %5lu\r\n" : " %5lu",
+                                        xStats.ulLargestFreeHistory[ i ] / 1024 ) );
+        }
+
+        if( ( xStats.ulHistoryCount % 10 ) != 0 )
+        {
+            pxCIO->print( "\r\n" );
+        }
+    }
+
+    static void prvHeapStatDiff( ConsoleIO_t * const pxCIO )
+    {
+        static HeapTraceOwner_t xOwners[ HEAP_TRACE_MAX_OWNERS ];
+        static HeapTraceBlock_t xBlocks[ HEAPSTAT_DIFF_MAX_BLOCKS ];
+        UBaseType_t uxOwners = uxHeapTraceGetOwners( xOwners, HEAP_TRACE_MAX_OWNERS );
+        size_t xBlocksNew = xHeapTraceGetNewBlocks( xBlocks, HEAPSTAT_DIFF_MAX_BLOCKS );
+
+        pxCIO->print( "Bytes allocated since the snapshot, by task:\r\n" );
+
+        for( UBaseType_t i = 0; i < uxOwners; i++ )
+        {
+            int32_t lDelta = ( int32_t ) ( xOwners[ i ].ulCurrentBytes - xOwners[ i ].ulSnapshotBytes );
+
+            if( lDelta != 0 )
+            {
+                prvHeapStatWrite( pxCIO,
+                                  snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                            "    %-16.16s %+ld\r\n", xOwners[ i ].pcName, lDelta ) );
+            }
+        }
+
+        prvHeapStatWrite( pxCIO,
+                          snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                    "Live blocks allocated since the snapshot: %u\r\n", xBlocksNew ) );
+
+        for( size_t i = 0; ( i < xBlocksNew ) && ( i < HEAPSTAT_DIFF_MAX_BLOCKS ); i++ )
+        {
+            prvHeapStatWrite( pxCIO,
+                              snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                        "    0x%08lX %6u %s\r\n",
+                                        ( uint32_t ) xBlocks[ i ].pvAddress,
+                                        xBlocks[ i ].xSize,
+                                        xBlocks[ i ].pcOwner ) );
+        }
+
+        if( xBlocksNew > HEAPSTAT_DIFF_MAX_BLOCKS )
+        {
+            pxCIO->print( "    ...\r\n" );
+        }
+    }
+
+#endif /* HEAP_TRACE_ENABLED == 1 */
+
+#if ( HEAP_REGIONS_ENABLED == 1 )
+    static void prvHeapStatRegions( ConsoleIO_t * const pxCIO )
+    {
+        HeapRegionStats_t xRegions[ HEAP_REGION_COUNT ];
+
+        vHeapRegionGetStats( xRegions );
+
+        pxCIO->print( "+--------+------------+--------+--------+----------+---------+--------+---------+---------+-----------+\r\n" );
+        pxCIO->print( "| Region |   Start    |  Size  |  Free  | Min Free | Largest | Blocks | Allocs  |  Frees  | Fallbacks |\r\n" );
+        pxCIO->print( "+--------+------------+--------+--------+----------+---------+--------+---------+---------+-----------+\r\n" );
+
+        for( uint32_t i = 0; i < HEAP_REGION_COUNT; i++ )
+        {
+            prvHeapStatWrite( pxCIO,
+                              snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                        "| %-6s | 0x%08lx | %6u | %6u | %8u | %7u | %6u | %7lu | %7lu | %9lu |\r\n",
+                                        xRegions[ i ].pcName,
+                                        xRegions[ i ].ulStart,
+                                        xRegions[ i ].xTotalBytes,
+                                        xRegions[ i ].xFreeBytes,
+                                        xRegions[ i ].xMinFreeBytes,
+                                        xRegions[ i ].xLargestFreeBlock,
+                                        xRegions[ i ].xFreeBlocks,
+                                        xRegions[ i ].ulAllocs,
+                                        xRegions[ i ].ulFrees,
+                                        xRegions[ i ].ulFallbacks ) );
+        }
+
+        pxCIO->print( "+--------+------------+--------+--------+----------+---------+--------+---------+---------+-----------+\r\n" );
+    }
+#endif /* HEAP_REGIONS_ENABLED == 1 */
 
-/* only implemented for heap_4.c */
+/* only implemented for heap_4.c and heap_regions.c */
 static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                               uint32_t ulArgc,
                               char * ppcArgv[] )
 {
     size_t xDivisor = 1;
     const char * cDivSymbol = NULL;
+    const char * pcReport = NULL;
 
     for( uint32_t i = 1; i < ulArgc; i++ )
     {
@@ -494,6 +1026,23 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                     break;
             }
         }
+
+        #if ( HEAP_REGIONS_ENABLED == 1 )
+            else if( strcmp( "regions", ppcArgv[ i ] ) == 0 )
+            {
+                pcReport = ppcArgv[ i ];
+            }
+        #endif
+        #if ( HEAP_TRACE_ENABLED == 1 )
+            else if( ( strcmp( "tasks", ppcArgv[ i ] ) == 0 ) ||
+                     ( strcmp( "sizes", ppcArgv[ i ] ) == 0 ) ||
+                     ( strcmp( "frag", ppcArgv[ i ] ) == 0 ) ||
+                     ( strcmp( "snapshot", ppcArgv[ i ] ) == 0 ) ||
+                     ( strcmp( "diff", ppcArgv[ i ] ) == 0 ) )
+            {
+                pcReport = ppcArgv[ i ];
+            }
+        #endif
         else
         {
             pxCIO->print( "Error: Unrecognized argument: " );
@@ -502,7 +1051,40 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
         }
     }
 
-    if( xDivisor != 0 )
+    if( pcReport != NULL )
+    {
+        if( strcmp( "regions", pcReport ) == 0 )
+        {
+            #if ( HEAP_REGIONS_ENABLED == 1 )
+                prvHeapStatRegions( pxCIO );
+            #endif
+        }
+
+        #if ( HEAP_TRACE_ENABLED == 1 )
+            else if( strcmp( "tasks", pcReport ) == 0 )
+            {
+                prvHeapStatTasks( pxCIO );
+            }
+            else if( strcmp( "sizes", pcReport ) == 0 )
+            {
+                prvHeapStatSizes( pxCIO );
+            }
+            else if( strcmp( "frag", pcReport ) == 0 )
+            {
+                prvHeapStatFrag( pxCIO );
+            }
+            else if( strcmp( "snapshot", pcReport ) == 0 )
+            {
+                vHeapTraceSnapshot();
+                pxCIO->print( "Snapshot taken, heapstat diff lists the blocks allocated from now on.\r\n" );
+            }
+            else
+            {
+                prvHeapStatDiff( pxCIO );
+            }
+        #endif /* HEAP_TRACE_ENABLED == 1 */
+    }
+    else if( xDivisor != 0 )
     {
         switch( xDivisor )
         {
@@ -530,22 +1112,29 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
 
         configASSERT( cDivSymbol != NULL );
 
-        size_t xHeapSize = configTOTAL_HEAP_SIZE;
+        size_t xHeapSize = xHeapRegionTotalSize();
         size_t xHeapFree = xPortGetFreeHeapSize();
         size_t xMinHeapFree = xPortGetMinimumEverFreeHeapSize();
         size_t xHeapAlloc = xHeapSize - xHeapFree;
         size_t xMaxHeapAlloc = xHeapSize - xMinHeapFree;
+        HeapStats_t xHeapStats;
+
+        vPortGetHeapStats( &xHeapStats );
+
+        size_t xLargestFree = xHeapStats.xSizeOfLargestFreeBlockInBytes;
 
         size_t xHeapSizeDiv = xHeapSize / xDivisor;
         size_t xHeapFreeDiv = xHeapFree / xDivisor;
         size_t xMinHeapFreeDiv = xMinHeapFree / xDivisor;
         size_t xHeapAllocDiv = xHeapAlloc / xDivisor;
         size_t xMaxHeapAllocDiv = xMaxHeapAlloc / xDivisor;
+        size_t xLargestFreeDiv = xLargestFree / xDivisor;
 
         size_t xHeapFreePct = ( 100 * xHeapFree ) / xHeapSize;
         size_t xMinHeapFreePct = ( 100 * xMinHeapFree ) / xHeapSize;
         size_t xHeapAllocPct = ( 100 * xHeapAlloc ) / xHeapSize;
         size_t xMaxHeapAllocPct = ( 100 * xMaxHeapAlloc ) / xHeapSize;
+        size_t xLargestFreePct = ( 100 * xLargestFree ) / xHeapSize;
 
         size_t xLen = 0;
 
@@ -616,8 +1205,31 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
             xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
         }
 
+        pxCIO->write( pcCliScratchBuffer, xLen );
+
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormatString,
+                         "Largest Free Blk", xLargestFreeDiv, xLargestFree, xLargestFreePct );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
         pxCIO->write( pcCliScratchBuffer, xLen );
         pxCIO->print( "+--------------------------------------------------------+\r\n" );
+
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "Free blocks: %u, allocations: %u, frees: %u\r\n",
+                         xHeapStats.xNumberOfFreeBlocks,
+                         xHeapStats.xNumberOfSuccessfulAllocations,
+                         xHeapStats.xNumberOfSuccessfulFrees );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        pxCIO->write( pcCliScratchBuffer, xLen );
     }
 }
 
@@ -662,6 +1274,46 @@ static void vUptimeCommand( ConsoleIO_t * const pxCIO,
     }
 }
 
+#if ( SNTP_TIME_ENABLED == 1 )
+    static void vTimeCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] )
+    {
+        static const char * const pcSources[] = { "unknown", "rtc", "sntp" };
+        SntpTimeStatus_t xStatus;
+        uint64_t ullNowUs = ullSntpTimeNowUs();
+        char pcUtc[ 32 ] = "-";
+        int lRslt;
+
+        ( void ) ulArgc;
+        ( void ) ppcArgv;
+
+        vSntpTimeGetStatus( &xStatus );
+
+        if( ullNowUs != 0 )
+        {
+            ( void ) xSntpTimeFormat( ullNowUs, pcUtc, sizeof( pcUtc ) );
+        }
+
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "utc       %s (%s)\r\n"
+                          "syncs     %lu, steps %lu, failures %lu, last %lu s ago\r\n"
+                          "offset    %ld us, delay %lu us, stratum %u\r\n"
+                          "frequency %ld ppb, rtc calibration %ld ppb\r\n",
+                          pcUtc, pcSources[ xStatus.xSource ],
+                          ( unsigned long ) xStatus.ulSyncs, ( unsigned long ) xStatus.ulSteps, ( unsigned long ) xStatus.ulFailures,
+                          ( xStatus.ullLastSyncUs == 0 ) ? 0UL : ( unsigned long ) ( ( ullGetMonotonicUs() - xStatus.ullLastSyncUs ) / 1000000ULL ),
+                          ( long ) xStatus.lLastOffsetUs, ( unsigned long ) xStatus.ulLastDelayUs, ( unsigned int ) xStatus.ucStratum,
+                          ( long ) xStatus.lFreqPpb, ( long ) xStatus.lRtcCalibPpb );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+    }
+#endif /* SNTP_TIME_ENABLED == 1 */
+
 static void vAssertCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] )
@@ -28,6 +28,8 @@
 /* Standard includes. */
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -35,17 +37,18 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "message_buffer.h"
+#include "static_alloc.h"
 #include "cli_prv.h"
 
 /* Project Includes */
 #include "logging.h"
 #include "hw_defs.h"
 
+/* Seconds and microseconds since hw_init started TIM5 */
+#define LOG_TIME_FORMAT          "%6lu.%06lu"
+#define LOG_TIME_ARGS( ullUs )    ( unsigned long ) ( ( ullUs ) / 1000000 ), ( unsigned long ) ( ( ullUs ) % 1000000 )
+
 /*-----------------------------------------------------------*/
-/* todo take into account maximum cli line length */
-#if ( CLI_UART_TX_STREAM_LEN < dlMAX_LOG_LINE_LENGTH )
-    #error "CLI_UART_TX_STREAM_LEN must be >= dlMAX_LOG_LINE_LENGTH"
-#endif
 
 volatile StreamBufferHandle_t xLogMBuf = NULL;
 
@@ -53,6 +56,102 @@ UART_HandleTypeDef * pxEarlyUart = NULL;
 
 static char pcPrintBuff[ dlMAX_LOG_LINE_LENGTH ];
 
+/* Short lines are formatted into one of these, bit n of ulFormatSlotsInUse is set while slot n is in use */
+static char pcFormatSlots[ dlLOG_FORMAT_SLOTS ][ dlLOG_FORMAT_SLOT_LENGTH ];
+static uint32_t ulFormatSlotsInUse = 0;
+
+/* Queued and dropped messages, updated with xLogMBuf locked */
+static LoggingStats_t xLogStats = { 0 };
+
+/* Messages dropped since the last "messages dropped" marker */
+static uint32_t ulLogDropsUnreported = 0;
+static TickType_t xLastDropMarker = 0;
+
+/* Task reading xLogMBuf through xLoggingReceive, notified when a message is queued */
+static volatile TaskHandle_t xLogReaderTask = NULL;
+
+/* Set by vLoggingSetSink, NULL while no sink is registered */
+static volatile LoggingSink_t xLogSink = NULL;
+
+#if ( LOGGING_OVERFLOW_POLICY == LOGGING_DROP_OLDEST )
+    /* Queued messages dropped to make room are read into this buffer, with xLogMBuf locked */
+    static char pcLogDiscardBuff[ dlMAX_LOG_LINE_LENGTH ];
+#endif
+
+/* Modules which have logged at least once, new ones are added at the head */
+static LogModule_t * pxLogModules = NULL;
+
+/* Runtime level set for a module name without extension, free if pcModule is empty */
+typedef struct
+{
+    char pcModule[ dlLOG_MODULE_NAME_LENGTH ];
+    uint8_t ucLevel;
+} LogLevelOverride_t;
+
+static LogLevelOverride_t xLevelOverrides[ dlLOG_LEVEL_OVERRIDES ] = { 0 };
+
+static const char * const pcLogLevelNames[] = { "none", "error", "warn", "info", "debug" };
+
+#if ( LOGGING_DEFERRED_FORMAT == 1 )
+
+/* First byte of a deferred record, formatted lines start with '<' */
+    #define LOG_RECORD_MAGIC      ( ( char ) 0xA5 )
+
+/* Width of the task name column */
+    #define LOG_TASK_NAME_LEN     10
+
+/* Longest conversion specification formatted from a record, such as "%-08.3lx" */
+    #define LOG_SPEC_MAX_LEN      24
+
+/* Pointers into the ARMv8-M code region (flash) outlive the call, unlike RAM buffers */
+    #define LOG_IS_CONSTANT( p )    ( ( uintptr_t ) ( p ) < 0x20000000UL )
+
+    typedef enum
+    {
+        LOG_ARG_NONE = 0,
+        LOG_ARG_INT,
+        LOG_ARG_LONG,
+        LOG_ARG_LLONG,
+        LOG_ARG_SIZE,
+        LOG_ARG_PTRDIFF,
+        LOG_ARG_INTMAX,
+        LOG_ARG_DOUBLE,
+        LOG_ARG_LDOUBLE,
+        LOG_ARG_PTR,
+        LOG_ARG_STR,
+        LOG_ARG_UNSUPPORTED
+    } LogArgType_t;
+
+/*
+ * A deferred record is this header followed by one entry per argument: the
+ * LogArgType_t in one byte, then the raw value, or the characters of a %s
+ * argument up to and including a terminating NUL.
+ */
+    typedef struct
+    {
+        char cMagic;
+        char pcTaskName[ LOG_TASK_NAME_LEN + 1 ];
+        uint64_t ullTimeUs;
+        uint32_t ulLineNumber;
+        const char * pcLogLevel;
+        const char * pcFileName;
+        const char * pcFormat;
+    } LogRecordHeader_t;
+
+/* One printf conversion specification */
+    typedef struct
+    {
+        const char * pcEnd;        /* Character following the conversion */
+        BaseType_t xWidthStar;     /* Width taken from an int argument */
+        BaseType_t xPrecisionStar; /* Precision taken from an int argument */
+        int32_t lPrecision;        /* Literal precision, -1 if none */
+        LogArgType_t xType;
+    } LogConversion_t;
+
+/* Copy of the record being formatted, as the line is written over the record */
+    static char pcRecordBuff[ dlMAX_LOG_RECORD_LENGTH ];
+#endif /* LOGGING_DEFERRED_FORMAT == 1 */
+
 /* Should only be called during an assert with the scheduler suspended. */
 void vDyingGasp( void )
 {
@@ -66,6 +165,7 @@ void vDyingGasp( void )
     do
     {
         xNumBytes = xMessageBufferReceiveFromISR( xLogMBuf, pcPrintBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+        xNumBytes = xLoggingFormatRecord( pcPrintBuff, xNumBytes, dlMAX_PRINT_STRING_LENGTH );
         ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) pcPrintBuff, xNumBytes, 10 * 1000 );
         ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) "\r\n", 2, 10 * 1000 );
 
@@ -110,178 +210,1415 @@ void vInitLoggingEarly( void )
     vSendLogMessageEarly( "\r\n", 2 );
 }
 
-static void vSendLogMessage( const char * buffer,
-                             unsigned int count )
+/* Queue a message with xLogMBuf locked. Returns pdTRUE if there was room for it, maybe after dropping older ones. */
+static BaseType_t xLogQueueLocked( const char * pcMessage,
+                                   size_t xLen,
+                                   BaseType_t * pxHigherPriorityTaskWoken )
 {
-    if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
-    {
-        vSendLogMessageEarly( buffer, count );
-    }
-    else if( xPortIsInsideInterrupt() == pdTRUE )
-    {
-        UBaseType_t uxContext;
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        configASSERT( xLogMBuf != NULL );
-
-        /* Enter critical section to preserve ordering of log messages */
-        uxContext = taskENTER_CRITICAL_FROM_ISR();
-        size_t xSpaceAvailable = xMessageBufferSpaceAvailable( xLogMBuf );
+    BaseType_t xQueued = pdFALSE;
 
-        if( xSpaceAvailable > sizeof( size_t ) )
+    #if ( LOGGING_OVERFLOW_POLICY == LOGGING_DROP_OLDEST )
+        while( ( xMessageBufferSpaceAvailable( xLogMBuf ) < ( xLen + sizeof( size_t ) ) ) &&
+               ( xMessageBufferIsEmpty( xLogMBuf ) == pdFALSE ) )
         {
-            xSpaceAvailable -= sizeof( size_t );
+            size_t xDropped = xMessageBufferReceiveFromISR( xLogMBuf, pcLogDiscardBuff, sizeof( pcLogDiscardBuff ), NULL );
 
-            if( xSpaceAvailable < ( count + sizeof( size_t ) ) )
-            {
-                ( void ) xMessageBufferSendFromISR( xLogMBuf, buffer, xSpaceAvailable - sizeof( size_t ), &xHigherPriorityTaskWoken );
-            }
-            else
+            if( xDropped == 0 )
             {
-                ( void ) xMessageBufferSendFromISR( xLogMBuf, buffer, count, &xHigherPriorityTaskWoken );
+                break;
             }
+
+            xLogStats.ulDroppedMessages++;
+            xLogStats.ulDroppedBytes += xDropped;
+            ulLogDropsUnreported++;
         }
+    #endif /* LOGGING_OVERFLOW_POLICY == LOGGING_DROP_OLDEST */
 
-        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+    /* Messages are dropped as a whole rather than truncated */
+    if( xMessageBufferSpaceAvailable( xLogMBuf ) >= ( xLen + sizeof( size_t ) ) )
+    {
+        xQueued = ( xMessageBufferSendFromISR( xLogMBuf, pcMessage, xLen, pxHigherPriorityTaskWoken ) == xLen ) ? pdTRUE : pdFALSE;
+    }
 
-        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    if( xQueued == pdTRUE )
+    {
+        xLogStats.ulMessages++;
+        xLogStats.ulBytes += xLen;
+
+        if( xLogReaderTask != NULL )
+        {
+            vTaskNotifyGiveIndexedFromISR( xLogReaderTask, dlLOG_READER_NOTIFY_IDX, pxHigherPriorityTaskWoken );
+        }
     }
-    else
+
+    return xQueued;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Queue a "messages dropped" marker ahead of the next message, at most once per dlLOG_DROP_MARKER_PERIOD_MS */
+static void vLogQueueDropMarker( void )
+{
+    uint32_t ulUnreported = __atomic_load_n( &ulLogDropsUnreported, __ATOMIC_RELAXED );
+    TickType_t xNow = xTaskGetTickCount();
+
+    if( ( ulUnreported > 0 ) &&
+        ( ( xNow - xLastDropMarker ) >= pdMS_TO_TICKS( dlLOG_DROP_MARKER_PERIOD_MS ) ) )
     {
-        configASSERT( xLogMBuf != NULL );
-        size_t xSpaceAvailable = xMessageBufferSpaceAvailable( xLogMBuf );
+        char pcMarker[ 96 ];
+        UBaseType_t uxContext;
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        int lLen = snprintf( pcMarker, sizeof( pcMarker ),
+                             "<WRN> " LOG_TIME_FORMAT " [%-10.10s] %lu log messages dropped, %lu since boot",
+                             LOG_TIME_ARGS( ullGetMonotonicUs() ), "Logging",
+                             ( unsigned long ) ulUnreported,
+                             ( unsigned long ) xLogStats.ulDroppedMessages );
 
-        if( xSpaceAvailable > sizeof( size_t ) )
+        if( ( lLen > 0 ) && ( ( size_t ) lLen < sizeof( pcMarker ) ) )
         {
-            xSpaceAvailable -= sizeof( size_t );
+            uxContext = taskENTER_CRITICAL_FROM_ISR();
 
-            if( xSpaceAvailable < count )
+            /* Another caller may have reported the same drops in the meantime */
+            if( ( ulLogDropsUnreported >= ulUnreported ) &&
+                ( ( xNow - xLastDropMarker ) >= pdMS_TO_TICKS( dlLOG_DROP_MARKER_PERIOD_MS ) ) &&
+                ( xLogQueueLocked( pcMarker, ( size_t ) lLen, &xHigherPriorityTaskWoken ) == pdTRUE ) )
             {
-                ( void ) xMessageBufferSend( xLogMBuf, buffer, xSpaceAvailable, 0 );
-            }
-            else
-            {
-                ( void ) xMessageBufferSend( xLogMBuf, buffer, count, 0 );
+                ulLogDropsUnreported -= ulUnreported;
+                xLastDropMarker = xNow;
             }
+
+            taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
         }
     }
 }
 
-void vLoggingInit( void )
+/*-----------------------------------------------------------*/
+
+/*
+ * Queue a formatted line or a deferred record according to LOGGING_OVERFLOW_POLICY.
+ * Interrupts are masked for the copy only, instead of suspending the scheduler.
+ */
+static void vLogQueue( const char * pcMessage,
+                       size_t xLen )
 {
-    xLogMBuf = xMessageBufferCreate( dlLOGGING_STREAM_LENGTH );
+    BaseType_t xQueued = pdFALSE;
+
+    #if ( LOGGING_OVERFLOW_POLICY == LOGGING_BLOCK )
+        TickType_t xStart = xTaskGetTickCount();
+
+        /* Interrupts and callers which suspended the scheduler drop the message instead */
+        BaseType_t xMayBlock = ( ( xPortIsInsideInterrupt() == pdFALSE ) &&
+                                 ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) ) ? pdTRUE : pdFALSE;
+    #endif
+
+    configASSERT( xLogMBuf != NULL );
+
+    vLogQueueDropMarker();
+
+    for( ; ; )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        UBaseType_t uxContext = taskENTER_CRITICAL_FROM_ISR();
+
+        xQueued = xLogQueueLocked( pcMessage, xLen, &xHigherPriorityTaskWoken );
+
+        #if ( LOGGING_OVERFLOW_POLICY == LOGGING_BLOCK )
+            if( ( xQueued == pdFALSE ) &&
+                ( xMayBlock == pdTRUE ) &&
+                ( ( xTaskGetTickCount() - xStart ) < pdMS_TO_TICKS( LOGGING_BLOCK_TIME_MS ) ) )
+            {
+                taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+                /* Wait for the reader to make room */
+                vTaskDelay( 1 );
+                continue;
+            }
+        #endif /* LOGGING_OVERFLOW_POLICY == LOGGING_BLOCK */
+
+        if( xQueued == pdFALSE )
+        {
+            xLogStats.ulDroppedMessages++;
+            xLogStats.ulDroppedBytes += xLen;
+            ulLogDropsUnreported++;
+        }
+
+        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        break;
+    }
 }
 
 /*-----------------------------------------------------------*/
 
-void vLoggingPrintf( const char * const pcLogLevel,
-                     const char * const pcFileName,
-                     const unsigned long ulLineNumber,
-                     const char * const pcFormat,
-                     ... )
+static void vSendLogMessage( const char * buffer,
+                             unsigned int count )
 {
-    uint32_t ulLenTotal = 0;
-    int32_t lLenPart = -1;
-    va_list args;
-    const char * pcTaskName = NULL;
-    BaseType_t xSchedulerWasSuspended = pdFALSE;
-
-    /* Additional info to place at the start of the log line */
-    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
     {
-        pcTaskName = pcTaskGetName( NULL );
+        vSendLogMessageEarly( buffer, count );
     }
     else
     {
-        pcTaskName = "None";
+        vLogQueue( buffer, count );
     }
+}
 
-    if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
-    {
-        xSchedulerWasSuspended = pdTRUE;
-        /* Suspend the scheduler to access pcPrintBuff */
-        vTaskSuspendAll();
-    }
+/*-----------------------------------------------------------*/
 
-    pcPrintBuff[ 0 ] = '\0';
-    lLenPart = snprintf( pcPrintBuff,
-                         dlMAX_PRINT_STRING_LENGTH,
-                         "<%-3.3s> %8lu [%-10.10s] ",
-                         pcLogLevel,
-                         ( ( unsigned long ) xTaskGetTickCount() / portTICK_PERIOD_MS ) & 0xFFFFFF,
-                         pcTaskName );
+/* Writers may drop queued messages as well, so every access to xLogMBuf is locked */
+static size_t xLogReceiveLocked( char * pcBuffer,
+                                 size_t xBufferLength )
+{
+    UBaseType_t uxContext = taskENTER_CRITICAL_FROM_ISR();
+    size_t xLen = xMessageBufferReceiveFromISR( xLogMBuf, pcBuffer, xBufferLength, NULL );
 
-    configASSERT( lLenPart > 0 );
+    taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xLoggingReceive( char * pcBuffer,
+                        size_t xBufferLength,
+                        uint32_t ulTicksToWait )
+{
+    size_t xLen;
+
+    /* Set before the buffer is checked so that a message queued after the check is notified */
+    xLogReaderTask = xTaskGetCurrentTaskHandle();
 
-    if( lLenPart < dlMAX_PRINT_STRING_LENGTH )
+    xLen = xLogReceiveLocked( pcBuffer, xBufferLength );
+
+    if( ( xLen == 0 ) && ( ulTicksToWait > 0 ) )
     {
-        ulLenTotal = lLenPart;
+        /* Also returns early on other notifications of the same index, which then read nothing */
+        ( void ) ulTaskNotifyTakeIndexed( dlLOG_READER_NOTIFY_IDX, pdTRUE, ( TickType_t ) ulTicksToWait );
+
+        xLen = xLogReceiveLocked( pcBuffer, xBufferLength );
     }
-    else
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingGetStats( LoggingStats_t * pxStats )
+{
+    UBaseType_t uxContext = taskENTER_CRITICAL_FROM_ISR();
+
+    *pxStats = xLogStats;
+
+    taskEXIT_CRITICAL_FROM_ISR( uxContext );
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingSetSink( LoggingSink_t xSink )
+{
+    xLogSink = xSink;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingSinkPut( const char * pcLine,
+                      size_t xLineLen )
+{
+    LoggingSink_t xSink = xLogSink;
+
+    if( ( xSink != NULL ) && ( xLineLen > 0 ) )
     {
-        ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
+        xSink( pcLine, xLineLen );
     }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingInit( void )
+{
+    xLogMBuf = xAppMessageBufferCreate( dlLOGGING_STREAM_LENGTH );
+}
+
+/*-----------------------------------------------------------*/
 
-    if( ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
+#if ( LOGGING_DEFERRED_FORMAT == 1 )
+
+/* Parse the conversion specification starting at the '%' pointed to by pcSpec */
+    static void prvParseConversion( const char * pcSpec,
+                                    LogConversion_t * pxConv )
     {
-        /* There are a variable number of parameters. */
-        va_start( args, pcFormat );
-        lLenPart = vsnprintf( &pcPrintBuff[ ulLenTotal ],
-                              ( dlMAX_PRINT_STRING_LENGTH - ulLenTotal ),
-                              pcFormat,
-                              args );
-        va_end( args );
+        const char * pc = pcSpec + 1;
+        char cLength = '\0';
 
-        configASSERT( lLenPart > 0 );
+        pxConv->xWidthStar = pdFALSE;
+        pxConv->xPrecisionStar = pdFALSE;
+        pxConv->lPrecision = -1;
 
-        if( lLenPart + ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
+        while( ( *pc == '-' ) || ( *pc == '+' ) || ( *pc == ' ' ) || ( *pc == '#' ) || ( *pc == '0' ) )
         {
-            ulLenTotal += lLenPart;
+            pc++;
+        }
+
+        if( *pc == '*' )
+        {
+            pxConv->xWidthStar = pdTRUE;
+            pc++;
         }
         else
         {
-            ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
+            while( isdigit( ( unsigned char ) *pc ) )
+            {
+                pc++;
+            }
         }
-    }
 
-    /* remove any \r\n\0 characters at the end of the message */
-    while( ulLenTotal > 0 &&
-           ( pcPrintBuff[ ulLenTotal - 1 ] == '\r' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\n' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\0' ) )
-    {
-        pcPrintBuff[ ulLenTotal - 1 ] = '\0';
-        ulLenTotal--;
+        if( *pc == '.' )
+        {
+            pc++;
+
+            if( *pc == '*' )
+            {
+                pxConv->xPrecisionStar = pdTRUE;
+                pc++;
+            }
+            else
+            {
+                pxConv->lPrecision = 0;
+
+                while( isdigit( ( unsigned char ) *pc ) )
+                {
+                    pxConv->lPrecision = ( pxConv->lPrecision * 10 ) + ( *pc - '0' );
+                    pc++;
+                }
+            }
+        }
+
+        /* hh and h arguments are promoted to int, ll is noted as 'q' */
+        switch( *pc )
+        {
+            case 'h':
+                pc += ( pc[ 1 ] == 'h' ) ? 2 : 1;
+                break;
+
+            case 'l':
+
+                if( pc[ 1 ] == 'l' )
+                {
+                    cLength = 'q';
+                    pc++;
+                }
+                else
+                {
+                    cLength = 'l';
+                }
+
+                pc++;
+                break;
+
+            case 'j':
+            case 'z':
+            case 't':
+            case 'L':
+                cLength = *pc;
+                pc++;
+                break;
+
+            default:
+                break;
+        }
+
+        switch( *pc )
+        {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                pxConv->xType = ( cLength == 'l' ) ? LOG_ARG_LONG :
+                                ( cLength == 'q' ) ? LOG_ARG_LLONG :
+                                ( cLength == 'z' ) ? LOG_ARG_SIZE :
+                                ( cLength == 't' ) ? LOG_ARG_PTRDIFF :
+                                ( cLength == 'j' ) ? LOG_ARG_INTMAX : LOG_ARG_INT;
+                break;
+
+            case 'c':
+                pxConv->xType = ( cLength == '\0' ) ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+                break;
+
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                pxConv->xType = ( cLength == 'L' ) ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+                break;
+
+            case 's':
+                pxConv->xType = ( cLength == '\0' ) ? LOG_ARG_STR : LOG_ARG_UNSUPPORTED;
+                break;
+
+            case 'p':
+                pxConv->xType = LOG_ARG_PTR;
+                break;
+
+            case '%':
+                pxConv->xType = LOG_ARG_NONE;
+                break;
+
+            default:
+                /* %n, wide characters and truncated specifications are formatted immediately */
+                pxConv->xType = LOG_ARG_UNSUPPORTED;
+                break;
+        }
+
+        pxConv->pcEnd = ( *pc != '\0' ) ? ( pc + 1 ) : pc;
     }
 
-    if( ( pcFileName != NULL ) &&
-        ( ulLineNumber > 0 ) &&
-        ( ulLenTotal < dlMAX_LOG_LINE_LENGTH ) )
+/*-----------------------------------------------------------*/
+
+/* Append one argument to pcRecord. Returns the new record length, or 0 if it does not fit. */
+    static size_t prvRecordPutArg( char * pcRecord,
+                                   size_t xLen,
+                                   LogArgType_t xType,
+                                   const void * pvValue,
+                                   size_t xValueLen )
     {
-        /* Add the trailer including file name and line number */
-        lLenPart = snprintf( &pcPrintBuff[ ulLenTotal ],
-                             ( dlMAX_LOG_LINE_LENGTH - ulLenTotal ),
-                             " (%s:%lu)",
-                             pcFileName,
-                             ulLineNumber );
+        if( ( xLen == 0 ) ||
+            ( ( xLen + 1 + xValueLen ) > dlMAX_LOG_RECORD_LENGTH ) )
+        {
+            xLen = 0;
+        }
+        else
+        {
+            pcRecord[ xLen ] = ( char ) xType;
+            ( void ) memcpy( &pcRecord[ xLen + 1 ], pvValue, xValueLen );
+            xLen += 1 + xValueLen;
+        }
 
-        configASSERT( lLenPart > 0 );
+        return xLen;
+    }
 
-        if( lLenPart + ulLenTotal < dlMAX_LOG_LINE_LENGTH )
+/*-----------------------------------------------------------*/
+
+/* Read the next argument of pcRecord, which must have type xType. Returns the offset of the following one, or 0. */
+    static size_t prvRecordGetArg( const char * pcRecord,
+                                   size_t xOffset,
+                                   size_t xRecordLen,
+                                   LogArgType_t xType,
+                                   void * pvValue,
+                                   size_t xValueLen )
+    {
+        if( ( xOffset == 0 ) ||
+            ( ( xOffset + 1 + xValueLen ) > xRecordLen ) ||
+            ( pcRecord[ xOffset ] != ( char ) xType ) )
         {
-            ulLenTotal += lLenPart;
+            xOffset = 0;
         }
         else
         {
-            ulLenTotal = dlMAX_LOG_LINE_LENGTH;
+            ( void ) memcpy( pvValue, &pcRecord[ xOffset + 1 ], xValueLen );
+            xOffset += 1 + xValueLen;
         }
+
+        return xOffset;
     }
 
-    vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+/*-----------------------------------------------------------*/
 
-    if( xSchedulerWasSuspended == pdTRUE )
+/* Build the record of a log call in pcRecord. Returns its length, or 0 if the call can not be deferred. */
+    static size_t prvRecordEncode( char * pcRecord,
+                                   const char * pcLogLevel,
+                                   const char * pcFileName,
+                                   unsigned long ulLineNumber,
+                                   const char * pcFormat,
+                                   va_list args )
     {
-        xTaskResumeAll();
-    }
+        LogRecordHeader_t xHeader = { 0 };
+        size_t xLen = sizeof( LogRecordHeader_t );
+        const char * pc = pcFormat;
+
+        xHeader.cMagic = LOG_RECORD_MAGIC;
+        ( void ) strncpy( xHeader.pcTaskName, pcTaskGetName( NULL ), LOG_TASK_NAME_LEN );
+        xHeader.ullTimeUs = ullGetMonotonicUs();
+        xHeader.ulLineNumber = ( uint32_t ) ulLineNumber;
+        xHeader.pcLogLevel = pcLogLevel;
+        xHeader.pcFileName = pcFileName;
+        xHeader.pcFormat = pcFormat;
+
+        ( void ) memcpy( pcRecord, &xHeader, sizeof( xHeader ) );
+
+        while( ( *pc != '\0' ) && ( xLen > 0 ) )
+        {
+            LogConversion_t xConv;
+            int32_t lPrecision;
+
+            if( *pc != '%' )
+            {
+                pc++;
+                continue;
+            }
+
+            prvParseConversion( pc, &xConv );
+            lPrecision = xConv.lPrecision;
+
+            if( xConv.xWidthStar == pdTRUE )
+            {
+                int lWidth = va_arg( args, int );
+                xLen = prvRecordPutArg( pcRecord, xLen, LOG_ARG_INT, &lWidth, sizeof( lWidth ) );
+            }
+
+            if( xConv.xPrecisionStar == pdTRUE )
+            {
+                int lStarPrecision = va_arg( args, int );
+                xLen = prvRecordPutArg( pcRecord, xLen, LOG_ARG_INT, &lStarPrecision, sizeof( lStarPrecision ) );
+                lPrecision = lStarPrecision;
+            }
+
+            switch( xConv.xType )
+            {
+                case LOG_ARG_NONE:
+                    break;
+
+                case LOG_ARG_INT:
+                   {
+                       int lValue = va_arg( args, int );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &lValue, sizeof( lValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_LONG:
+                   {
+                       long lValue = va_arg( args, long );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &lValue, sizeof( lValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_LLONG:
+                   {
+                       long long llValue = va_arg( args, long long );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &llValue, sizeof( llValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_SIZE:
+                   {
+                       size_t xValue = va_arg( args, size_t );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &xValue, sizeof( xValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_PTRDIFF:
+                   {
+                       ptrdiff_t xValue = va_arg( args, ptrdiff_t );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &xValue, sizeof( xValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_INTMAX:
+                   {
+                       intmax_t xValue = va_arg( args, intmax_t );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &xValue, sizeof( xValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_DOUBLE:
+                   {
+                       double xValue = va_arg( args, double );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &xValue, sizeof( xValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_LDOUBLE:
+                   {
+                       long double xValue = va_arg( args, long double );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &xValue, sizeof( xValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_PTR:
+                   {
+                       void * pvValue = va_arg( args, void * );
+                       xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, &pvValue, sizeof( pvValue ) );
+                       break;
+                   }
+
+                case LOG_ARG_STR:
+                   {
+                       const char * pcStr = va_arg( args, const char * );
+                       size_t xMaxLen = dlMAX_LOG_RECORD_LENGTH;
+                       size_t xStrLen;
+
+                       if( pcStr == NULL )
+                       {
+                           pcStr = "(null)";
+                       }
+
+                       /* "%.*s" arguments are not necessarily terminated */
+                       if( ( lPrecision >= 0 ) && ( ( size_t ) lPrecision < xMaxLen ) )
+                       {
+                           xMaxLen = ( size_t ) lPrecision;
+                       }
+
+                       xStrLen = strnlen( pcStr, xMaxLen );
+
+                       if( ( xLen > 0 ) &&
+                           ( ( xLen + 1 + xStrLen + 1 ) <= dlMAX_LOG_RECORD_LENGTH ) )
+                       {
+                           xLen = prvRecordPutArg( pcRecord, xLen, xConv.xType, pcStr, xStrLen );
+                           pcRecord[ xLen++ ] = '\0';
+                       }
+                       else
+                       {
+                           xLen = 0;
+                       }
+
+                       break;
+                   }
+
+                default:
+                    xLen = 0;
+                    break;
+            }
+
+            pc = xConv.pcEnd;
+        }
+
+        return xLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Advance the output length by the return value of snprintf, keeping room for the terminator */
+    static size_t prvOutputAdvance( size_t xOutLen,
+                                    int lLenPart,
+                                    size_t xBufferLength )
+    {
+        if( lLenPart > 0 )
+        {
+            xOutLen += ( size_t ) lLenPart;
+
+            if( xOutLen >= xBufferLength )
+            {
+                xOutLen = xBufferLength - 1;
+            }
+        }
+
+        return xOutLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Format the conversion of pxConv, which starts at pcSpec, with the arguments read from the record */
+    static size_t prvFormatConversion( char * pcOut,
+                                       size_t xOutLen,
+                                       size_t xBufferLength,
+                                       const char * pcSpec,
+                                       const LogConversion_t * pxConv,
+                                       size_t * pxOffset,
+                                       size_t xRecordLen )
+    {
+        char pcSubFormat[ LOG_SPEC_MAX_LEN + 24 ];
+        size_t xSubLen = 0;
+        int lWidth = 0;
+        int lPrecision = -1;
+        int lLenPart = 0;
+        size_t xOffset = *pxOffset;
+        const char * pc = pcSpec;
+
+        if( pxConv->xWidthStar == pdTRUE )
+        {
+            xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, LOG_ARG_INT, &lWidth, sizeof( lWidth ) );
+        }
+
+        if( pxConv->xPrecisionStar == pdTRUE )
+        {
+            xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, LOG_ARG_INT, &lPrecision, sizeof( lPrecision ) );
+        }
+
+        /* Copy the specification with the '*' replaced by the recorded values */
+        while( ( pc < pxConv->pcEnd ) &&
+               ( ( pxConv->pcEnd - pcSpec ) <= LOG_SPEC_MAX_LEN ) )
+        {
+            if( ( pc[ 0 ] == '.' ) && ( pc[ 1 ] == '*' ) && ( lPrecision < 0 ) )
+            {
+                /* A negative precision is taken as if omitted */
+                pc += 2;
+            }
+            else if( pc[ 0 ] == '*' )
+            {
+                int lStar = ( ( pc > pcSpec ) && ( pc[ -1 ] == '.' ) ) ? lPrecision : lWidth;
+
+                xSubLen += ( size_t ) snprintf( &pcSubFormat[ xSubLen ], sizeof( pcSubFormat ) - xSubLen, "%d", lStar );
+                pc++;
+            }
+            else
+            {
+                pcSubFormat[ xSubLen++ ] = *pc++;
+            }
+        }
+
+        pcSubFormat[ xSubLen ] = '\0';
+
+        if( ( xOffset != 0 ) && ( xSubLen == 0 ) )
+        {
+            /* Too long to be rewritten, output it as is */
+            lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, "%.*s",
+                                 ( int ) ( pxConv->pcEnd - pcSpec ), pcSpec );
+        }
+        else if( xOffset != 0 )
+        {
+            switch( pxConv->xType )
+            {
+                case LOG_ARG_NONE:
+                    lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, "%%" );
+                    break;
+
+                case LOG_ARG_INT:
+                   {
+                       int lValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &lValue, sizeof( lValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, lValue );
+                       break;
+                   }
+
+                case LOG_ARG_LONG:
+                   {
+                       long lValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &lValue, sizeof( lValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, lValue );
+                       break;
+                   }
+
+                case LOG_ARG_LLONG:
+                   {
+                       long long llValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &llValue, sizeof( llValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, llValue );
+                       break;
+                   }
+
+                case LOG_ARG_SIZE:
+                   {
+                       size_t xValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &xValue, sizeof( xValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, xValue );
+                       break;
+                   }
+
+                case LOG_ARG_PTRDIFF:
+                   {
+                       ptrdiff_t xValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &xValue, sizeof( xValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, xValue );
+                       break;
+                   }
+
+                case LOG_ARG_INTMAX:
+                   {
+                       intmax_t xValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &xValue, sizeof( xValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, xValue );
+                       break;
+                   }
+
+                case LOG_ARG_DOUBLE:
+                   {
+                       double xValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &xValue, sizeof( xValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, xValue );
+                       break;
+                   }
+
+                case LOG_ARG_LDOUBLE:
+                   {
+                       long double xValue = 0;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &xValue, sizeof( xValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, xValue );
+                       break;
+                   }
+
+                case LOG_ARG_PTR:
+                   {
+                       void * pvValue = NULL;
+                       xOffset = prvRecordGetArg( pcRecordBuff, xOffset, xRecordLen, pxConv->xType, &pvValue, sizeof( pvValue ) );
+                       lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, pvValue );
+                       break;
+                   }
+
+                case LOG_ARG_STR:
+                   {
+                       const char * pcStr = NULL;
+                       size_t xStrLen = 0;
+
+                       if( ( xOffset < xRecordLen ) &&
+                           ( pcRecordBuff[ xOffset ] == ( char ) LOG_ARG_STR ) )
+                       {
+                           pcStr = &pcRecordBuff[ xOffset + 1 ];
+                           xStrLen = strnlen( pcStr, xRecordLen - xOffset - 1 );
+                       }
+
+                       /* The copy must be terminated within the record */
+                       if( ( pcStr == NULL ) ||
+                           ( ( xOffset + 1 + xStrLen ) >= xRecordLen ) )
+                       {
+                           xOffset = 0;
+                       }
+                       else
+                       {
+                           xOffset += 1 + xStrLen + 1;
+                           lLenPart = snprintf( &pcOut[ xOutLen ], xBufferLength - xOutLen, pcSubFormat, pcStr );
+                       }
+
+                       break;
+                   }
+
+                default:
+                    xOffset = 0;
+                    break;
+            }
+        }
+
+        *pxOffset = xOffset;
+
+        return prvOutputAdvance( xOutLen, lLenPart, xBufferLength );
+    }
+#endif /* LOGGING_DEFERRED_FORMAT == 1 */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Turn a deferred record received from xLogMBuf into the log line, in place.
+ * Lines which were formatted by vLoggingPrintf are returned unchanged.
+ * Returns the length of the line.
+ */
+size_t xLoggingFormatRecord( char * pcBuffer,
+                             size_t xLength,
+                             size_t xBufferLength )
+{
+    #if ( LOGGING_DEFERRED_FORMAT == 1 )
+        if( ( xLength >= sizeof( LogRecordHeader_t ) ) &&
+            ( xLength <= sizeof( pcRecordBuff ) ) &&
+            ( xBufferLength > 0 ) &&
+            ( pcBuffer[ 0 ] == LOG_RECORD_MAGIC ) )
+        {
+            LogRecordHeader_t xHeader;
+            size_t xOffset = sizeof( LogRecordHeader_t );
+            const char * pc;
+            size_t xOutLen = 0;
+
+            ( void ) memcpy( pcRecordBuff, pcBuffer, xLength );
+            ( void ) memcpy( &xHeader, pcRecordBuff, sizeof( xHeader ) );
+
+            xOutLen = prvOutputAdvance( 0,
+                                        snprintf( pcBuffer,
+                                                  xBufferLength,
+                                                  "<%-3.3s> " LOG_TIME_FORMAT " [%-10.10s] ",
+                                                  xHeader.pcLogLevel,
+                                                  LOG_TIME_ARGS( xHeader.ullTimeUs ),
+                                                  xHeader.pcTaskName ),
+                                        xBufferLength );
+
+            pc = xHeader.pcFormat;
+
+            while( ( *pc != '\0' ) &&
+                   ( xOffset != 0 ) &&
+                   ( xOutLen < ( xBufferLength - 1 ) ) )
+            {
+                if( *pc != '%' )
+                {
+                    pcBuffer[ xOutLen++ ] = *pc++;
+                }
+                else
+                {
+                    LogConversion_t xConv;
+
+                    prvParseConversion( pc, &xConv );
+                    xOutLen = prvFormatConversion( pcBuffer, xOutLen, xBufferLength, pc, &xConv, &xOffset, xLength );
+                    pc = xConv.pcEnd;
+                }
+            }
+
+            pcBuffer[ xOutLen ] = '\0';
+
+            /* remove any \r\n characters at the end of the message */
+            while( ( xOutLen > 0 ) &&
+                   ( ( pcBuffer[ xOutLen - 1 ] == '\r' ) ||
+                     ( pcBuffer[ xOutLen - 1 ] == '\n' ) ) )
+            {
+                pcBuffer[ --xOutLen ] = '\0';
+            }
+
+            if( ( xHeader.pcFileName != NULL ) &&
+                ( xHeader.ulLineNumber > 0 ) )
+            {
+                xOutLen = prvOutputAdvance( xOutLen,
+                                            snprintf( &pcBuffer[ xOutLen ],
+                                                      xBufferLength - xOutLen,
+                                                      " (%s:%lu)",
+                                                      xHeader.pcFileName,
+                                                      ( unsigned long ) xHeader.ulLineNumber ),
+                                            xBufferLength );
+            }
+
+            xLength = xOutLen;
+        }
+    #else /* LOGGING_DEFERRED_FORMAT == 1 */
+        ( void ) pcBuffer;
+        ( void ) xBufferLength;
+    #endif /* LOGGING_DEFERRED_FORMAT == 1 */
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Claim a free format slot, returns -1 if all of them are in use */
+static int32_t lFormatSlotClaim( void )
+{
+    uint32_t ulInUse = __atomic_load_n( &ulFormatSlotsInUse, __ATOMIC_RELAXED );
+    int32_t lSlot;
+
+    do
+    {
+        lSlot = -1;
+
+        for( int32_t i = 0; ( i < dlLOG_FORMAT_SLOTS ) && ( lSlot < 0 ); i++ )
+        {
+            if( ( ulInUse & ( 1UL << i ) ) == 0 )
+            {
+                lSlot = i;
+            }
+        }
+    } while( ( lSlot >= 0 ) &&
+             !__atomic_compare_exchange_n( &ulFormatSlotsInUse, &ulInUse, ulInUse | ( 1UL << lSlot ), pdTRUE,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) );
+
+    return lSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vFormatSlotRelease( int32_t lSlot )
+{
+    ( void ) __atomic_fetch_and( &ulFormatSlotsInUse, ~( 1UL << lSlot ), __ATOMIC_RELEASE );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Format a log line into pcBuffer, with ulMaxPrintLen bytes for the header and message and
+ * ulMaxLineLen for the line including the file name trailer. Returns the line length and sets
+ * *pxTruncated if a part did not fit.
+ */
+static uint32_t ulLoggingFormatLine( char * pcBuffer,
+                                     uint32_t ulMaxPrintLen,
+                                     uint32_t ulMaxLineLen,
+                                     const char * const pcLogLevel,
+                                     const char * const pcFileName,
+                                     const unsigned long ulLineNumber,
+                                     const char * const pcFormat,
+                                     va_list args,
+                                     BaseType_t * pxTruncated )
+{
+    uint32_t ulLenTotal = 0;
+    int32_t lLenPart = -1;
+    const char * pcTaskName = NULL;
+
+    *pxTruncated = pdFALSE;
+
+    /* Additional info to place at the start of the log line */
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pcTaskName = pcTaskGetName( NULL );
+    }
+    else
+    {
+        pcTaskName = "None";
+    }
+
+    pcBuffer[ 0 ] = '\0';
+    lLenPart = snprintf( pcBuffer,
+                         ulMaxPrintLen,
+                         "<%-3.3s> " LOG_TIME_FORMAT " [%-10.10s] ",
+                         pcLogLevel,
+                         LOG_TIME_ARGS( ullGetMonotonicUs() ),
+                         pcTaskName );
+
+    configASSERT( lLenPart > 0 );
+
+    if( ( uint32_t ) lLenPart < ulMaxPrintLen )
+    {
+        ulLenTotal = lLenPart;
+    }
+    else
+    {
+        ulLenTotal = ulMaxPrintLen;
+        *pxTruncated = pdTRUE;
+    }
+
+    if( ulLenTotal < ulMaxPrintLen )
+    {
+        /* There are a variable number of parameters. */
+        lLenPart = vsnprintf( &pcBuffer[ ulLenTotal ],
+                              ( ulMaxPrintLen - ulLenTotal ),
+                              pcFormat,
+                              args );
+
+        configASSERT( lLenPart > 0 );
+
+        if( lLenPart + ulLenTotal < ulMaxPrintLen )
+        {
+            ulLenTotal += lLenPart;
+        }
+        else
+        {
+            ulLenTotal = ulMaxPrintLen;
+            *pxTruncated = pdTRUE;
+        }
+    }
+
+    /* remove any \r\n\0 characters at the end of the message */
+    while( ulLenTotal > 0 &&
+           ( pcBuffer[ ulLenTotal - 1 ] == '\r' ||
+             pcBuffer[ ulLenTotal - 1 ] == '\n' ||
+             pcBuffer[ ulLenTotal - 1 ] == '\0' ) )
+    {
+        pcBuffer[ ulLenTotal - 1 ] = '\0';
+        ulLenTotal--;
+    }
+
+    if( ( pcFileName != NULL ) &&
+        ( ulLineNumber > 0 ) &&
+        ( ulLenTotal < ulMaxLineLen ) )
+    {
+        /* Add the trailer including file name and line number */
+        lLenPart = snprintf( &pcBuffer[ ulLenTotal ],
+                             ( ulMaxLineLen - ulLenTotal ),
+                             " (%s:%lu)",
+                             pcFileName,
+                             ulLineNumber );
+
+        configASSERT( lLenPart > 0 );
+
+        if( lLenPart + ulLenTotal < ulMaxLineLen )
+        {
+            ulLenTotal += lLenPart;
+        }
+        else
+        {
+            ulLenTotal = ulMaxLineLen;
+            *pxTruncated = pdTRUE;
+        }
+    }
+
+    return ulLenTotal;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Format the log line in a slot of the calling task, so that tasks do not wait for each other.
+ * Lines longer than a slot, or logged while every slot is in use, are formatted into pcPrintBuff
+ * with the scheduler suspended.
+ */
+static void vLoggingPrintfNow( const char * const pcLogLevel,
+                               const char * const pcFileName,
+                               const unsigned long ulLineNumber,
+                               const char * const pcFormat,
+                               va_list args )
+{
+    uint32_t ulLenTotal = 0;
+    int32_t lSlot = -1;
+    BaseType_t xTruncated = pdTRUE;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        lSlot = lFormatSlotClaim();
+    }
+
+    if( lSlot >= 0 )
+    {
+        va_list xArgsCopy;
+
+        va_copy( xArgsCopy, args );
+        ulLenTotal = ulLoggingFormatLine( pcFormatSlots[ lSlot ],
+                                          dlLOG_FORMAT_SLOT_LENGTH - CLI_OUTPUT_EOL_LEN,
+                                          dlLOG_FORMAT_SLOT_LENGTH,
+                                          pcLogLevel, pcFileName, ulLineNumber,
+                                          pcFormat, xArgsCopy, &xTruncated );
+        va_end( xArgsCopy );
+
+        if( xTruncated == pdFALSE )
+        {
+            vSendLogMessage( pcFormatSlots[ lSlot ], ulLenTotal );
+        }
+
+        vFormatSlotRelease( lSlot );
+    }
+
+    if( xTruncated == pdTRUE )
+    {
+        BaseType_t xSchedulerWasSuspended = pdFALSE;
+
+        if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+        {
+            xSchedulerWasSuspended = pdTRUE;
+            /* Suspend the scheduler to access pcPrintBuff */
+            vTaskSuspendAll();
+        }
+
+        ulLenTotal = ulLoggingFormatLine( pcPrintBuff,
+                                          dlMAX_PRINT_STRING_LENGTH,
+                                          dlMAX_LOG_LINE_LENGTH,
+                                          pcLogLevel, pcFileName, ulLineNumber,
+                                          pcFormat, args, &xTruncated );
+
+        vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+
+        if( xSchedulerWasSuspended == pdTRUE )
+        {
+            xTaskResumeAll();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLoggingPrintfV( const char * const pcLogLevel,
+                             const char * const pcFileName,
+                             const unsigned long ulLineNumber,
+                             const char * const pcFormat,
+                             va_list args )
+{
+    BaseType_t xDeferred = pdFALSE;
+
+    #if ( LOGGING_DEFERRED_FORMAT == 1 )
+        /* The record keeps pointers to the level, file name and format strings */
+        if( ( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED ) &&
+            LOG_IS_CONSTANT( pcLogLevel ) &&
+            LOG_IS_CONSTANT( pcFormat ) &&
+            LOG_IS_CONSTANT( pcFileName ) )
+        {
+            char pcRecord[ dlMAX_LOG_RECORD_LENGTH ];
+            size_t xRecordLen;
+            va_list xArgsCopy;
+
+            va_copy( xArgsCopy, args );
+            xRecordLen = prvRecordEncode( pcRecord, pcLogLevel, pcFileName, ulLineNumber, pcFormat, xArgsCopy );
+            va_end( xArgsCopy );
+
+            if( xRecordLen > 0 )
+            {
+                vLogQueue( pcRecord, xRecordLen );
+                xDeferred = pdTRUE;
+            }
+        }
+    #endif /* LOGGING_DEFERRED_FORMAT == 1 */
+
+    if( xDeferred == pdFALSE )
+    {
+        vLoggingPrintfNow( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintf( const char * const pcLogLevel,
+                     const char * const pcFileName,
+                     const unsigned long ulLineNumber,
+                     const char * const pcFormat,
+                     ... )
+{
+    va_list args;
+
+    va_start( args, pcFormat );
+    vLoggingPrintfV( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+    va_end( args );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Length of a module name or tag without its extension */
+static size_t xModuleNameLength( const char * pcName )
+{
+    const char * pcDot = strchr( pcName, '.' );
+
+    return ( pcDot != NULL ) ? ( size_t ) ( pcDot - pcName ) : strlen( pcName );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xModuleNameMatch( const char * pcName,
+                                    const char * pcModule )
+{
+    size_t xLen = xModuleNameLength( pcName );
+
+    return ( ( xLen == xModuleNameLength( pcModule ) ) &&
+             ( strncmp( pcName, pcModule, xLen ) == 0 ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runtime level of pxModule, must be called in a critical section */
+static uint8_t ucModuleLevel( const LogModule_t * pxModule )
+{
+    uint8_t ucLevel = pxModule->ucDefaultLevel;
+
+    for( uint32_t i = 0; i < dlLOG_LEVEL_OVERRIDES; i++ )
+    {
+        if( ( xLevelOverrides[ i ].pcModule[ 0 ] != '\0' ) &&
+            ( xModuleNameMatch( pxModule->pcName, xLevelOverrides[ i ].pcModule ) == pdTRUE ) )
+        {
+            ucLevel = xLevelOverrides[ i ].ucLevel;
+        }
+    }
+
+    return ucLevel;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Add pxModule to the module list on its first log call and resolve its runtime level */
+static void vModuleRegister( LogModule_t * pxModule,
+                             const char * const pcFileName )
+{
+    UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    if( pxModule->ucLevel == LOG_LEVEL_UNRESOLVED )
+    {
+        pxModule->pcName = pcFileName;
+        pxModule->pxNext = pxLogModules;
+        pxModule->ucLevel = ucModuleLevel( pxModule );
+        pxLogModules = pxModule;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintfModule( LogModule_t * pxModule,
+                           const uint8_t ucLevel,
+                           const char * const pcLogLevel,
+                           const char * const pcFileName,
+                           const unsigned long ulLineNumber,
+                           const char * const pcFormat,
+                           ... )
+{
+    if( pxModule->ucLevel == LOG_LEVEL_UNRESOLVED )
+    {
+        vModuleRegister( pxModule, pcFileName );
+    }
+
+    if( pxModule->ucLevel >= ucLevel )
+    {
+        va_list args;
+
+        va_start( args, pcFormat );
+        vLoggingPrintfV( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+        va_end( args );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+LogModule_t * pxLoggingGetModules( void )
+{
+    /* Modules are only ever added at the head, with pxNext set beforehand */
+    return pxLogModules;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcLoggingLevelToString( uint32_t ulLevel )
+{
+    return ( ulLevel <= LOG_DEBUG ) ? pcLogLevelNames[ ulLevel ] : "unknown";
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lLoggingLevelFromString( const char * pcLevel )
+{
+    int32_t lLevel = -1;
+
+    for( int32_t i = 0; ( i <= LOG_DEBUG ) && ( lLevel < 0 ); i++ )
+    {
+        if( strcmp( pcLevel, pcLogLevelNames[ i ] ) == 0 )
+        {
+            lLevel = i;
+        }
+    }
+
+    if( ( lLevel < 0 ) &&
+        ( pcLevel[ 0 ] >= '0' ) &&
+        ( pcLevel[ 0 ] <= ( '0' + LOG_DEBUG ) ) &&
+        ( pcLevel[ 1 ] == '\0' ) )
+    {
+        lLevel = pcLevel[ 0 ] - '0';
+    }
+
+    return lLevel;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lLoggingSetModuleLevel( const char * pcModule,
+                                int32_t lLevel )
+{
+    size_t xLen = xModuleNameLength( pcModule );
+    int32_t lEntry = -1;
+    int32_t lFree = -1;
+    int32_t lRslt = 0;
+
+    if( ( xLen == 0 ) ||
+        ( xLen >= dlLOG_MODULE_NAME_LENGTH ) ||
+        ( lLevel > LOG_DEBUG ) )
+    {
+        lRslt = -1;
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+
+        for( int32_t i = 0; i < dlLOG_LEVEL_OVERRIDES; i++ )
+        {
+            if( xLevelOverrides[ i ].pcModule[ 0 ] == '\0' )
+            {
+                lFree = ( lFree < 0 ) ? i : lFree;
+            }
+            else if( xModuleNameMatch( xLevelOverrides[ i ].pcModule, pcModule ) == pdTRUE )
+            {
+                lEntry = i;
+            }
+        }
+
+        if( lLevel < 0 )
+        {
+            if( lEntry >= 0 )
+            {
+                xLevelOverrides[ lEntry ].pcModule[ 0 ] = '\0';
+            }
+        }
+        else if( ( lEntry < 0 ) && ( lFree < 0 ) )
+        {
+            lRslt = -1;
+        }
+        else
+        {
+            if( lEntry < 0 )
+            {
+                lEntry = lFree;
+                ( void ) memcpy( xLevelOverrides[ lEntry ].pcModule, pcModule, xLen );
+                xLevelOverrides[ lEntry ].pcModule[ xLen ] = '\0';
+            }
+
+            xLevelOverrides[ lEntry ].ucLevel = ( uint8_t ) lLevel;
+        }
+
+        /* Modules which have not logged yet pick the level up when they register */
+        for( LogModule_t * pxModule = pxLogModules; ( pxModule != NULL ) && ( lRslt == 0 ); pxModule = pxModule->pxNext )
+        {
+            if( xModuleNameMatch( pxModule->pcName, pcModule ) == pdTRUE )
+            {
+                pxModule->ucLevel = ucModuleLevel( pxModule );
+            }
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    return lRslt;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xLoggingGetModuleLevels( char * pcBuffer,
+                                size_t xBufferLength )
+{
+    LogLevelOverride_t xOverrides[ dlLOG_LEVEL_OVERRIDES ];
+    size_t xLen = 0;
+
+    configASSERT( xBufferLength > 0 );
+
+    pcBuffer[ 0 ] = '\0';
+
+    taskENTER_CRITICAL();
+    ( void ) memcpy( xOverrides, xLevelOverrides, sizeof( xOverrides ) );
+    taskEXIT_CRITICAL();
+
+    for( uint32_t i = 0; i < dlLOG_LEVEL_OVERRIDES; i++ )
+    {
+        if( xOverrides[ i ].pcModule[ 0 ] != '\0' )
+        {
+            int lLen = snprintf( &pcBuffer[ xLen ], xBufferLength - xLen, "%s%s=%s",
+                                 ( xLen > 0 ) ? "," : "",
+                                 xOverrides[ i ].pcModule,
+                                 pcLogLevelNames[ xOverrides[ i ].ucLevel ] );
+
+            if( ( lLen > 0 ) && ( ( size_t ) lLen < ( xBufferLength - xLen ) ) )
+            {
+                xLen += ( size_t ) lLen;
+            }
+            else
+            {
+                /* Drop the entry which did not fit */
+                pcBuffer[ xLen ] = '\0';
+            }
+        }
+    }
+
+    return xLen;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lLoggingSetModuleLevels( const char * pcLevels )
+{
+    int32_t lRslt = 0;
+
+    while( ( pcLevels != NULL ) && ( *pcLevels != '\0' ) )
+    {
+        char pcEntry[ dlLOG_MODULE_NAME_LENGTH + 8 ];
+        const char * pcEnd = strchr( pcLevels, ',' );
+        size_t xLen = ( pcEnd != NULL ) ? ( size_t ) ( pcEnd - pcLevels ) : strlen( pcLevels );
+        char * pcValue = NULL;
+
+        if( xLen < sizeof( pcEntry ) )
+        {
+            ( void ) memcpy( pcEntry, pcLevels, xLen );
+            pcEntry[ xLen ] = '\0';
+            pcValue = strchr( pcEntry, '=' );
+        }
+
+        if( pcValue != NULL )
+        {
+            int32_t lLevel;
+
+            *pcValue = '\0';
+            lLevel = lLoggingLevelFromString( &pcValue[ 1 ] );
+
+            if( ( lLevel < 0 ) ||
+                ( lLoggingSetModuleLevel( pcEntry, lLevel ) != 0 ) )
+            {
+                lRslt = -1;
+            }
+        }
+        else if( xLen > 0 )
+        {
+            lRslt = -1;
+        }
+
+        pcLevels = ( pcEnd != NULL ) ? &pcEnd[ 1 ] : NULL;
+    }
+
+    return lRslt;
 }
 
 /*-----------------------------------------------------------*/
@@ -29,6 +29,7 @@
 
 /* Standard Include. */
 #include <stdio.h>
+#include <stdint.h>
 
 /* Include header for logging level macros. */
 #include "logging_levels.h"
@@ -39,6 +40,40 @@
 #define dlLOGGING_STREAM_LENGTH      4096
 #define dlMAX_LOG_LINE_LENGTH        ( dlMAX_PRINT_STRING_LENGTH + CLI_OUTPUT_EOL_LEN )
 
+/* When set, vLoggingPrintf only records the format string pointer and the raw arguments without
+ * suspending the scheduler. The line is formatted later on by the thread draining the log buffer. */
+#ifndef LOGGING_DEFERRED_FORMAT
+    #define LOGGING_DEFERRED_FORMAT    1
+#endif
+
+/* Largest deferred log record including copies of %s arguments. Longer messages are formatted immediately. */
+#define dlMAX_LOG_RECORD_LENGTH      192
+
+/* Lines which are not deferred are formatted into one of these buffers, claimed without a lock.
+ * Longer lines are formatted into a shared buffer with the scheduler suspended. */
+#define dlLOG_FORMAT_SLOTS           4
+#define dlLOG_FORMAT_SLOT_LENGTH     256
+
+/* What a log call does when xLogMBuf has no room for its message */
+#define LOGGING_DROP_NEWEST    0 /* Drop the new message */
+#define LOGGING_DROP_OLDEST    1 /* Drop queued messages until the new one fits */
+#define LOGGING_BLOCK          2 /* Wait up to LOGGING_BLOCK_TIME_MS, then drop the new message. Interrupts and
+                                  * callers with the scheduler suspended do not wait. */
+
+#ifndef LOGGING_OVERFLOW_POLICY
+    #define LOGGING_OVERFLOW_POLICY    LOGGING_DROP_NEWEST
+#endif
+
+#ifndef LOGGING_BLOCK_TIME_MS
+    #define LOGGING_BLOCK_TIME_MS    20
+#endif
+
+/* Shortest interval between two "log messages dropped" markers in the log stream */
+#define dlLOG_DROP_MARKER_PERIOD_MS    1000
+
+/* Notification index given to the task blocked in xLoggingReceive when a message is queued */
+#define dlLOG_READER_NOTIFY_IDX        3
+
 /* Default logging config */
 #if ( !defined( LOGGING_OUTPUT_UART ) && !defined( LOGGING_OUTPUT_ITM ) && !defined( LOGGING_OUTPUT_NONE ) )
     #define LOGGING_OUTPUT_UART
@@ -50,6 +85,45 @@
     #define LOG_LEVEL         LOG_INFO
 #endif
 
+/* Log calls above LOG_LEVEL_MAX are compiled out. The others are compared against the runtime level
+ * of their module, which starts at the LOG_LEVEL of the file and can be changed with "log level". */
+#ifndef LOG_LEVEL_MAX
+    #define LOG_LEVEL_MAX    LOG_DEBUG
+#endif
+
+/* Runtime level of a module which has not logged yet, passes every check until it is registered */
+#define LOG_LEVEL_UNRESOLVED          0xFFU
+
+/* Number of runtime level overrides and longest module name they can refer to */
+#define dlLOG_LEVEL_OVERRIDES         8
+#define dlLOG_MODULE_NAME_LENGTH      24
+
+/* Counters of the messages queued to and dropped from xLogMBuf since boot */
+typedef struct
+{
+    uint32_t ulMessages;
+    uint32_t ulBytes;
+    uint32_t ulDroppedMessages;
+    uint32_t ulDroppedBytes;
+} LoggingStats_t;
+
+/* Runtime log level of one source file. Registered under the file name on its first log call. */
+typedef struct LogModule
+{
+    volatile uint8_t ucLevel;
+    uint8_t ucDefaultLevel;
+    const char * pcName;
+    struct LogModule * pxNext;
+} LogModule_t;
+
+static LogModule_t xLogModule __attribute__( ( unused ) ) =
+{
+    .ucLevel        = LOG_LEVEL_UNRESOLVED,
+    .ucDefaultLevel = LOG_LEVEL,
+    .pcName         = NULL,
+    .pxNext         = NULL
+};
+
 /* Get rid of extra C89 style parentheses generated by core FreeRTOS libraries */
 
 #define REMOVE_PARENS( ... )    STR( OVE __VA_ARGS__ )
@@ -64,10 +138,46 @@ void vLoggingPrintf( const char * const pcLogLevel,
                      const unsigned long ulLineNumber,
                      const char * const pcFormat,
                      ... );
+void vLoggingPrintfModule( LogModule_t * pxModule,
+                           const uint8_t ucLevel,
+                           const char * const pcLogLevel,
+                           const char * const pcFileName,
+                           const unsigned long ulLineNumber,
+                           const char * const pcFormat,
+                           ... );
 void vLoggingInit( void );
 void vLoggingDeInit( void );
 void vDyingGasp( void );
 void vInitLoggingEarly( void );
+size_t xLoggingFormatRecord( char * pcBuffer,
+                             size_t xLength,
+                             size_t xBufferLength );
+
+/* Read the next message for output, waiting up to ulTicksToWait. Only one task may call this. */
+size_t xLoggingReceive( char * pcBuffer,
+                        size_t xBufferLength,
+                        uint32_t ulTicksToWait );
+void vLoggingGetStats( LoggingStats_t * pxStats );
+
+/* Optional second output, called by the reader of xLoggingReceive with each formatted line. */
+typedef void ( * LoggingSink_t )( const char * pcLine,
+                                  size_t xLineLen );
+void vLoggingSetSink( LoggingSink_t xSink );
+void vLoggingSinkPut( const char * pcLine,
+                      size_t xLineLen );
+
+/* Runtime module levels. lLevel -1 restores the LOG_LEVEL of the module. Returns 0, or -1 on error. */
+int32_t lLoggingSetModuleLevel( const char * pcModule,
+                                int32_t lLevel );
+LogModule_t * pxLoggingGetModules( void );
+const char * pcLoggingLevelToString( uint32_t ulLevel );
+int32_t lLoggingLevelFromString( const char * pcLevel );
+
+/* Overrides as "module=level,...", as stored in the log_levels key */
+size_t xLoggingGetModuleLevels( char * pcBuffer,
+                                size_t xBufferLength );
+int32_t lLoggingSetModuleLevels( const char * pcLevels );
+void vLoggingLoadModuleLevels( void );
 
 /* task.h cannot be included here because this file is included by FreeRTOSConfig.h */
 extern void vTaskSuspendAll( void );
@@ -88,6 +198,15 @@ extern void vTaskSuspendAll( void );
 
 #define LogKernel( ... )        SdkLog( "KRN", __VA_ARGS__ )
 
+/* A single load and compare guards the argument evaluation and formatting of a log call */
+#define ModuleLog( level, levelStr, ... )                                                                 \
+    do {                                                                                                   \
+        if( xLogModule.ucLevel >= ( level ) )                                                              \
+        {                                                                                                  \
+            vLoggingPrintfModule( &xLogModule, ( level ), levelStr, __NAME_ARG__, __LINE__, __VA_ARGS__ ); \
+        }                                                                                                  \
+    } while( 0 )
+
 #if !defined( LOG_LEVEL ) ||       \
     ( ( LOG_LEVEL != LOG_NONE ) && \
     ( LOG_LEVEL != LOG_ERROR ) &&  \
@@ -96,28 +215,31 @@ extern void vTaskSuspendAll( void );
     ( LOG_LEVEL != LOG_DEBUG ) )
 
     #error "Please define LOG_LEVEL as either LOG_NONE, LOG_ERROR, LOG_WARN, LOG_INFO, or LOG_DEBUG."
+#elif ( LOG_LEVEL_MAX < LOG_NONE ) || ( LOG_LEVEL_MAX > LOG_DEBUG )
+
+    #error "Please define LOG_LEVEL_MAX as either LOG_NONE, LOG_ERROR, LOG_WARN, LOG_INFO, or LOG_DEBUG."
 #else
 
-    #if ( LOG_LEVEL >= LOG_ERROR )
-        #define LogError( ... )    SdkLog( "ERR", REMOVE_PARENS( __VA_ARGS__ ) )
+    #if ( LOG_LEVEL_MAX >= LOG_ERROR )
+        #define LogError( ... )    ModuleLog( LOG_ERROR, "ERR", REMOVE_PARENS( __VA_ARGS__ ) )
     #else
         #define LogError( ... )
     #endif
 
-    #if ( LOG_LEVEL >= LOG_WARN )
-        #define LogWarn( ... )    SdkLog( "WRN", REMOVE_PARENS( __VA_ARGS__ ) )
+    #if ( LOG_LEVEL_MAX >= LOG_WARN )
+        #define LogWarn( ... )    ModuleLog( LOG_WARN, "WRN", REMOVE_PARENS( __VA_ARGS__ ) )
     #else
         #define LogWarn( ... )
     #endif
 
-    #if ( LOG_LEVEL >= LOG_INFO )
-        #define LogInfo( ... )    SdkLog( "INF", REMOVE_PARENS( __VA_ARGS__ ) )
+    #if ( LOG_LEVEL_MAX >= LOG_INFO )
+        #define LogInfo( ... )    ModuleLog( LOG_INFO, "INF", REMOVE_PARENS( __VA_ARGS__ ) )
     #else
         #define LogInfo( ... )
     #endif
 
-    #if ( LOG_LEVEL >= LOG_DEBUG )
-        #define LogDebug( ... )    SdkLog( "DBG", REMOVE_PARENS( __VA_ARGS__ ) )
+    #if ( LOG_LEVEL_MAX >= LOG_DEBUG )
+        #define LogDebug( ... )    ModuleLog( LOG_DEBUG, "DBG", REMOVE_PARENS( __VA_ARGS__ ) )
     #else
         #define LogDebug( ... )
     #endif
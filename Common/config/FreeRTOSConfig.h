@@ -46,6 +46,7 @@
 #if defined( __ICCARM__ ) || defined( __CC_ARM ) || defined( __GNUC__ )
     #include <stdint.h>
     extern uint32_t SystemCoreClock;
+    #include "postmortem.h"
 #endif
 
 #ifndef CMSIS_device_header
@@ -69,6 +70,7 @@
 #define configTICK_RATE_HZ                         ( ( TickType_t ) 1000 )
 #define configMAX_PRIORITIES                       ( 56 )
 #define configMINIMAL_STACK_SIZE                   ( ( uint16_t ) 1024 )
+/* Size of the heap_4 heap of the TF-M build. The ntz build uses all free SRAM, see heap_regions.h */
 #define configTOTAL_HEAP_SIZE                      ( ( size_t ) 300 * 1024 )
 #define configMAX_TASK_NAME_LEN                    ( 32 )
 #define configUSE_TRACE_FACILITY                   1
@@ -124,6 +126,7 @@
 #define INCLUDE_xTaskGetSchedulerState             1
 #define INCLUDE_xTaskResumeFromISR                 0
 #define INCLUDE_xTaskGetHandle                     1
+#define INCLUDE_xTaskGetIdleTaskHandle             1
 
 #define INCLUDE_xTimerPendFunctionCall             1
 #define INCLUDE_xQueueGetMutexHolder               1
@@ -168,6 +171,8 @@
 #define configASSERT( x )                     \
     do {                                      \
         if( ( x ) == 0 ) {                    \
+            vPostMortemAssert( __NAME_ARG__,  \
+                               __LINE__ );    \
             vDyingGasp();                     \
             LogAssert( "Assertion failed." ); \
             vDyingGasp();                     \
@@ -191,7 +196,63 @@
 #define configCOMMAND_INT_MAX_OUTPUT_SIZE           128
 
 #include "hw_defs.h"
+/* TIM5 is started by hw_init, before the scheduler */
 #define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
-#define portGET_RUN_TIME_COUNTER_VALUE()    ( timer_get_count( pxHndlTim5 ) )
+/* 32 us units, the 32 bit counter wraps after 38 hours */
+#define portGET_RUN_TIME_COUNTER_VALUE()    ( ( uint32_t ) ( ullGetMonotonicUs() >> 5 ) )
+
+/* Allocation profile shown by the heapstat command, see heap_trace.h */
+#ifndef HEAP_TRACE_ENABLED
+    #define HEAP_TRACE_ENABLED    1
+#endif
+
+#if ( HEAP_TRACE_ENABLED == 1 ) && ( defined( __ICCARM__ ) || defined( __CC_ARM ) || defined( __GNUC__ ) )
+    #include <stddef.h>
+    void vHeapTraceMalloc( void * pvAddress,
+                           size_t xSize );
+    void vHeapTraceFree( void * pvAddress,
+                         size_t xSize );
+
+    #define traceMALLOC( pvAddress, uiSize )    vHeapTraceMalloc( pvAddress, uiSize )
+    #define traceFREE( pvAddress, uiSize )      vHeapTraceFree( pvAddress, uiSize )
+#endif
+
+/* Tickless idle in STOP2, see lowpower.h. Under TF-M the secure image would have to allow deep sleep */
+#ifndef LOW_POWER_ENABLED
+    #ifdef TFM_PSA_API
+        #define LOW_POWER_ENABLED    0
+    #else
+        #define LOW_POWER_ENABLED    1
+    #endif
+#endif
+
+#if ( LOW_POWER_ENABLED == 1 )
+    #define configUSE_TICKLESS_IDLE                  2
+    #define configEXPECTED_IDLE_TIME_BEFORE_SLEEP    4
+#endif
+
+/* Static storage for the application tasks and kernel objects, see static_alloc.h.
+ * The task stacks then move out of the heap, which can be shrunk by as much. */
+#ifndef STATIC_ALLOC_ENABLED
+    #define STATIC_ALLOC_ENABLED    0
+#endif
+
+/* Event trace recorder of the trace command, see trace_rec.h */
+#ifndef TRACE_REC_ENABLED
+    #define TRACE_REC_ENABLED    1
+#endif
+
+#if ( TRACE_REC_ENABLED == 1 ) && ( defined( __ICCARM__ ) || defined( __CC_ARM ) || defined( __GNUC__ ) )
+    #include <stdint.h>
+    void vTraceRecTaskSwitchedIn( uint32_t ulTaskNumber );
+    void vTraceRecQueueEvent( void * pvQueue,
+                              uint32_t ulSend );
+
+    #define traceTASK_SWITCHED_IN()                vTraceRecTaskSwitchedIn( pxCurrentTCB->uxTCBNumber )
+    #define traceQUEUE_SEND( pxQueue )             vTraceRecQueueEvent( pxQueue, 1 )
+    #define traceQUEUE_SEND_FROM_ISR( pxQueue )    vTraceRecQueueEvent( pxQueue, 1 )
+    #define traceQUEUE_RECEIVE( pxQueue )          vTraceRecQueueEvent( pxQueue, 0 )
+    #define traceQUEUE_RECEIVE_FROM_ISR( pxQueue ) vTraceRecQueueEvent( pxQueue, 0 )
+#endif
 
 #endif /* FREERTOS_CONFIG_H */
@@ -79,9 +79,17 @@
  * @note Specified in bytes.  Must be large enough to hold the maximum
  * anticipated MQTT payload.
  */
-#define MQTT_AGENT_NETWORK_BUFFER_SIZE               ( 6 * 1024 )
+#ifndef MQTT_AGENT_NETWORK_BUFFER_SIZE
+    #define MQTT_AGENT_NETWORK_BUFFER_SIZE           ( 6 * 1024 )
+#endif
 
 
-#define MQTT_AGENT_MAX_EVENT_QUEUE_WAIT_TIME         ( 1 )
+/**
+ * @brief Longest time the agent waits for a command or for received data before
+ * running the process loop anyway. The keep alive is driven by a periodic work
+ * item of the agent task, this is only a backstop.
+ * @note Specified in milliseconds.
+ */
+#define MQTT_AGENT_MAX_EVENT_QUEUE_WAIT_TIME         ( 30000 )
 
 #endif /* ifndef CORE_MQTT_CONFIG_H */
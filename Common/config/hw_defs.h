@@ -23,6 +23,10 @@
 #define MXCHIP_RESET_Pin           GPIO_PIN_15
 #define MXCHIP_RESET_GPIO_Port     GPIOF
 
+#define GYRO_ACC_INT_Pin           GPIO_PIN_11
+#define GYRO_ACC_INT_GPIO_Port     GPIOE
+#define GYRO_ACC_INT_EXTI_IRQn     EXTI11_IRQn
+
 extern RTC_HandleTypeDef * pxHndlRtc;
 extern SPI_HandleTypeDef * pxHndlSpi2;
 extern TIM_HandleTypeDef * pxHndlTim5;
@@ -46,12 +50,89 @@ static inline uint32_t timer_get_count( TIM_HandleTypeDef * pxHndl )
 
 void hw_init( void );
 
+/* Microseconds since TIM5 was started in hw_init, 0 before. Not for interrupts above configMAX_SYSCALL_INTERRUPT_PRIORITY. */
+uint64_t ullGetMonotonicUs( void );
+
+/* Restore the clocks after STOP2 and add the time stopped to the microsecond time */
+void hw_stop_resume( uint32_t ulStoppedUs );
+
+/* System clock levels, switched by the DVFS governor, see dvfs.h */
+typedef enum
+{
+    HW_CLOCK_LEVEL_LOW = 0, /* 48 MHz from the MSI, PLL off, voltage range 3 */
+    HW_CLOCK_LEVEL_HIGH,    /* 160 MHz from the PLL, voltage range 1, the level hw_init sets */
+    HW_CLOCK_LEVEL_MAX
+} HwClockLevel_t;
+
+/*
+ * Change the system clock and the voltage range, the SysTick and TIM5 keep their rates.
+ * Called with interrupts disabled. On failure the level returned by hw_clock_get_level is
+ * still valid, with the voltage range at least as high as it needs.
+ */
+HAL_StatusTypeDef hw_clock_set_level( HwClockLevel_t xLevel );
+
+HwClockLevel_t hw_clock_get_level( void );
+
+#ifndef TFM_PSA_API
+
+/*
+ * ICACHE / DCACHE1 configurations. DCACHE1 only caches the external memories, the OCTOSPI
+ * memory mapped window included. HW_CACHE_PROFILE selects the one applied by hw_init.
+ */
+    typedef enum
+    {
+        HW_CACHE_PROFILE_OFF = 0,            /* Both caches disabled */
+        HW_CACHE_PROFILE_ICACHE_1WAY,        /* Direct mapped ICACHE, DCACHE1 disabled */
+        HW_CACHE_PROFILE_ICACHE_2WAY,        /* 2-way set associative ICACHE, DCACHE1 disabled */
+        HW_CACHE_PROFILE_ICACHE_1WAY_DCACHE, /* Direct mapped ICACHE and DCACHE1 */
+        HW_CACHE_PROFILE_ICACHE_2WAY_DCACHE, /* 2-way set associative ICACHE and DCACHE1 */
+        HW_CACHE_PROFILE_MAX
+    } HwCacheProfile_t;
+
+/* Cache monitor counts. The miss counters are 16 bits wide and saturate at 0xFFFF. */
+    typedef struct
+    {
+        uint32_t ulICacheHits;
+        uint32_t ulICacheMisses;
+        uint32_t ulDCacheReadHits;
+        uint32_t ulDCacheReadMisses;
+    } HwCacheStats_t;
+
+/* Invalidate both caches and apply xProfile, also at run time */
+    HAL_StatusTypeDef hw_cache_set_profile( HwCacheProfile_t xProfile );
+
+    HwCacheProfile_t hw_cache_get_profile( void );
+
+    const char * hw_cache_profile_name( HwCacheProfile_t xProfile );
+
+/* Reset and start the hit / miss monitors of both caches */
+    void hw_cache_monitor_start( void );
+
+/* Stop the monitors and read their counts */
+    void hw_cache_monitor_stop( HwCacheStats_t * pxStats );
+
+#endif /* ! defined( TFM_PSA_API ) */
+
 typedef void ( * GPIOInterruptCallback_t ) ( void * pvContext );
 
 void GPIO_EXTI_Register_Callback( uint16_t usGpioPinMask,
                                   GPIOInterruptCallback_t pvCallback,
                                   void * pvContext );
 
+/*
+ * Notify xTask directly from the EXTI interrupt of a gpio, bypassing its callback.
+ * xTask is a TaskHandle_t, spelled out since this header is included by FreeRTOSConfig.h.
+ */
+struct tskTaskControlBlock;
+
+void GPIO_EXTI_Register_Notify( uint16_t usGpioPinMask,
+                                struct tskTaskControlBlock * xTask,
+                                uint32_t ulIndex,
+                                uint32_t ulBits );
+
+/* DWT cycle count at the last rising edge of a gpio, for interrupt latency measurements */
+uint32_t GPIO_EXTI_Get_Edge_Cycles( uint16_t usGpioPinMask );
+
 void vDoSystemReset( void );
 
 static inline void vPetWatchdog( void )
@@ -39,6 +39,13 @@ typedef enum KvStoreEnum
     CS_WIFI_SSID,
     CS_WIFI_CREDENTIAL,
     CS_TIME_HWM_S_1970,
+    CS_LOG_LEVELS,
+    CS_ENV_PUBLISH_POLICY,
+    CS_MQTT_PUBLISH_POLICY,
+    CS_WIFI_CACHE,
+    CS_SHADOW_CACHE,
+    CS_MQTT_KEEPALIVE,
+    CS_SNTP_SERVER,
     CS_NUM_KEYS
 } KVStoreKey_t;
 
@@ -106,17 +113,31 @@ typedef enum KvStoreEnum
         "mqtt_port",       \
         "wifi_ssid",       \
         "wifi_credential", \
-        "time_hwm"         \
+        "time_hwm",        \
+        "log_levels",      \
+        "env_publish",     \
+        "mqtt_policy",     \
+        "wifi_cache",      \
+        "shadow_cache",    \
+        "mqtt_keepalive",  \
+        "sntp_server"      \
     }
 
-#define KV_STORE_DEFAULTS                                                          \
-    {                                                                              \
-        KV_DFLT( KV_TYPE_STRING, THING_NAME_DFLT ),    /* CS_CORE_THING_NAME */    \
-        KV_DFLT( KV_TYPE_STRING, MQTT_ENDPOINT_DFLT ), /* CS_CORE_MQTT_ENDPOINT */ \
-        KV_DFLT( KV_TYPE_UINT32, MQTT_PORT_DFLT ),     /* CS_CORE_MQTT_PORT */     \
-        KV_DFLT( KV_TYPE_STRING, WIFI_SSID_DFLT ),     /* CS_WIFI_SSID */          \
-        KV_DFLT( KV_TYPE_STRING, WIFI_PASSWORD_DFLT ), /* CS_WIFI_CREDENTIAL */    \
-        KV_DFLT( KV_TYPE_UINT32, 0 ),                  /* CS_TIME_HWM_S_1970 */    \
+#define KV_STORE_DEFAULTS                                                           \
+    {                                                                               \
+        KV_DFLT( KV_TYPE_STRING, THING_NAME_DFLT ),    /* CS_CORE_THING_NAME */     \
+        KV_DFLT( KV_TYPE_STRING, MQTT_ENDPOINT_DFLT ), /* CS_CORE_MQTT_ENDPOINT */  \
+        KV_DFLT( KV_TYPE_UINT32, MQTT_PORT_DFLT ),     /* CS_CORE_MQTT_PORT */      \
+        KV_DFLT( KV_TYPE_STRING, WIFI_SSID_DFLT ),     /* CS_WIFI_SSID */           \
+        KV_DFLT( KV_TYPE_STRING, WIFI_PASSWORD_DFLT ), /* CS_WIFI_CREDENTIAL */     \
+        KV_DFLT( KV_TYPE_UINT32, 0 ),                  /* CS_TIME_HWM_S_1970 */     \
+        KV_DFLT( KV_TYPE_STRING, "" ),                 /* CS_LOG_LEVELS */          \
+        KV_DFLT( KV_TYPE_STRING, "" ),                 /* CS_ENV_PUBLISH_POLICY */  \
+        KV_DFLT( KV_TYPE_STRING, "" ),                 /* CS_MQTT_PUBLISH_POLICY */ \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                   /* CS_WIFI_CACHE */          \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                   /* CS_SHADOW_CACHE */        \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                   /* CS_MQTT_KEEPALIVE */      \
+        KV_DFLT( KV_TYPE_STRING, "" ),                 /* CS_SNTP_SERVER */         \
     }
 
 #endif /* _KVSTORE_CONFIG_H */
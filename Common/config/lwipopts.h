@@ -20,7 +20,53 @@
 #ifndef LWIP_HDR_LWIPOPTS_H
 #define LWIP_HDR_LWIPOPTS_H
 
+/*
+ * ---------- Network memory profiles ----------
+ *
+ * LWIP_NET_PROFILE selects how much RAM is dedicated to lwIP buffers. Approximate
+ * static RAM budgets (pbuf pool + lwIP heap, excluding per-task stacks):
+ *
+ * LWIP_NET_PROFILE_DEFAULT:    ~144 KB  (40 pool pbufs, 78 KB heap, 24 KB windows)
+ * LWIP_NET_PROFILE_THROUGHPUT: ~214 KB  (72 pool pbufs, 96 KB heap, 69 KB receive window, 32 KB send buffer)
+ * LWIP_NET_PROFILE_LOW_MEMORY:  ~50 KB  (16 pool pbufs, 24 KB heap, 11 KB receive window, 8 KB send buffer)
+ *
+ * See Common/net/ReadMe.md for how to measure TCP goodput with each profile.
+ */
+#define LWIP_NET_PROFILE_DEFAULT       0
+#define LWIP_NET_PROFILE_THROUGHPUT    1
+#define LWIP_NET_PROFILE_LOW_MEMORY    2
+
+#ifndef LWIP_NET_PROFILE
+    #define LWIP_NET_PROFILE    LWIP_NET_PROFILE_DEFAULT
+#endif
+
+#if LWIP_NET_PROFILE == LWIP_NET_PROFILE_THROUGHPUT
+
+/* Window scaling lets the receive window exceed 64 KB for OTA-class bulk transfers */
+    #define TCP_RCV_SCALE          1
+    #define TCP_WND                ( 48 * TCP_MSS )
+    #define TCP_SND_BUF            ( 32 * 1024 )
+    #define PBUF_POOL_SIZE         72
+    #define MEM_SIZE               ( 96 * 1024 )
+    #define MEMP_NUM_TCP_SEG       255
+#elif LWIP_NET_PROFILE == LWIP_NET_PROFILE_LOW_MEMORY
+    #define TCP_RCV_SCALE          0
+    #define TCP_WND                ( 8 * TCP_MSS )
+    #define TCP_SND_BUF            ( 6 * TCP_MSS )
+    #define PBUF_POOL_SIZE         16
+    #define MEM_SIZE               ( 24 * 1024 )
+    #define MEMP_NUM_TCP_SEG       64
+    #define MEMP_NUM_TCP_PCB       8
+    #define MEMP_NUM_NETCONN       8
+    #define TCP_OOSEQ_MAX_PBUFS    4
+#elif LWIP_NET_PROFILE == LWIP_NET_PROFILE_DEFAULT
+    #define PBUF_POOL_SIZE         40
+#else
+    #error "Unknown LWIP_NET_PROFILE"
+#endif /* LWIP_NET_PROFILE */
+
 #include "lwipopts_freertos.h"
+#include "sram_banks.h"
 
 /*#define LWIP_DEBUG        1 */
 /* #define DHCP_DEBUG     LWIP_DBG_ON */
@@ -81,6 +127,17 @@
 /* Change next define to support socket interface */
 #define LWIP_SOCKET    1
 
+/*
+ * getsockopt( s, SOL_SOCKET, SO_NETCONN, &pxConn, &xLen ) returns the netconn behind a socket,
+ * used by the netconn receive path of mbedtls_transport.c. The hook is expanded in sockets.c.
+ */
+#define SO_NETCONN    0x7001
+#define LWIP_HOOK_SOCKETS_GETSOCKOPT( s, sock, level, optname, optval, optlen, err ) \
+    ( ( ( ( level ) == SOL_SOCKET ) &&                                                 \
+        ( ( optname ) == SO_NETCONN ) &&                                               \
+        ( *( optlen ) == sizeof( struct netconn * ) ) ) ?                              \
+      ( *( ( struct netconn ** ) ( optval ) ) = ( sock )->conn, *( err ) = 0, 1 ) : 0 )
+
 /*#define MEMP_NUM_TCP_PCB                5 */
 
 /*
@@ -109,7 +166,9 @@
 
 #define MEM_ALIGNMENT               8
 /*#define MIN_SIZE        8 */
-/*#define LWIP_DECLARE_MEMORY_ALIGNED(variable_name, size) u32_t variable_name[(size + sizeof(u32_t) - 1) / sizeof(u32_t)] */
+/* The lwIP heap and the memp pools, pbuf pool included, go to the DMA bank, see sram_banks.h */
+#define LWIP_DECLARE_MEMORY_ALIGNED( variable_name, size ) \
+    SRAM_BANK_DMA u8_t variable_name[ LWIP_MEM_ALIGN_BUFFER( size ) ]
 /* ---------- Memory options ---------- */
 
 #define MEM_LIBC_MALLOC    ( 0 )
@@ -130,8 +189,6 @@
 
 #define TCP_SND_QUEUELEN    ( 4 * TCP_SND_BUF / TCP_MSS )
 
-/* TCP receive window. */
-#define PBUF_POOL_SIZE      40
 
 
 #define TCP_MSL             20 * 1000UL /* The maximum segment lifetime in milliseconds */
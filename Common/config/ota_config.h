@@ -92,9 +92,17 @@
 /**
  * @brief Log base 2 of the size of the file data block message (excluding the header).
  *
- * 10 bits yields a data block size of 1KB.
+ * 12 bits yields a data block size of 4KB. Larger blocks need fewer broker round trips per
+ * image. The upper limit is 14 bits (16KB), the maximum TLS record size. A block and its
+ * stream message header must also fit in MQTT_AGENT_NETWORK_BUFFER_SIZE.
  */
-#define otaconfigLOG2_FILE_BLOCK_SIZE           11UL
+#ifndef otaconfigLOG2_FILE_BLOCK_SIZE
+    #define otaconfigLOG2_FILE_BLOCK_SIZE       12UL
+#endif
+
+#if ( otaconfigLOG2_FILE_BLOCK_SIZE < 8UL ) || ( otaconfigLOG2_FILE_BLOCK_SIZE > 14UL )
+    #error "otaconfigLOG2_FILE_BLOCK_SIZE must be between 8 (256 B) and 14 (16 KB)."
+#endif
 
 /**
  * @brief Size of the file data block message (excluding the header).
@@ -137,7 +145,14 @@
  *  Please note that this must be set larger than zero.
  *
  */
-#define otaconfigMAX_NUM_BLOCKS_REQUEST         2U
+#ifndef otaconfigMAX_NUM_BLOCKS_REQUEST
+    #define otaconfigMAX_NUM_BLOCKS_REQUEST     4U
+#endif
+
+#if ( otaconfigMAX_NUM_BLOCKS_REQUEST == 0U ) || \
+    ( ( otaconfigMAX_NUM_BLOCKS_REQUEST << otaconfigLOG2_FILE_BLOCK_SIZE ) > ( 128UL * 1024UL ) )
+    #error "otaconfigMAX_NUM_BLOCKS_REQUEST must be non zero and request at most 128 KB per response."
+#endif
 
 /**
  * @brief The maximum number of requests allowed to send without a response before we abort.
@@ -152,7 +167,8 @@
  * @brief The number of data buffers reserved by the OTA agent.
  *
  * This configurations parameter sets the maximum number of static data buffers used by
- * the OTA agent for job and file data blocks received.
+ * the OTA agent for job and file data blocks received. One buffer is reserved for each
+ * block in flight, plus one for control messages.
  */
 #define otaconfigMAX_NUM_OTA_DATA_BUFFERS       ( otaconfigMAX_NUM_BLOCKS_REQUEST + 1 )
 
@@ -186,6 +202,37 @@
 
 #endif
 
+/**
+ * @brief Bandwidth shaping of OTA downloads.
+ *
+ * File block requests draw from a token bucket which fills at otaconfigSHAPER_SHARE_PERCENT
+ * percent of otaconfigSHAPER_LINK_CAPACITY_BPS, in bytes per second. The fill rate halves
+ * while the MQTT agent command queue holds more than otaconfigSHAPER_QUEUE_HIGH commands
+ * and recovers step by step once it holds otaconfigSHAPER_QUEUE_LOW or fewer, so that
+ * telemetry and keep alive packets are not held up behind the download.
+ *
+ * Set otaconfigSHAPER_SHARE_PERCENT to 100 to disable shaping.
+ */
+#ifndef otaconfigSHAPER_LINK_CAPACITY_BPS
+    #define otaconfigSHAPER_LINK_CAPACITY_BPS    ( 256U * 1024U )
+#endif
+
+#ifndef otaconfigSHAPER_SHARE_PERCENT
+    #define otaconfigSHAPER_SHARE_PERCENT        ( 50U )
+#endif
+
+#ifndef otaconfigSHAPER_QUEUE_HIGH
+    #define otaconfigSHAPER_QUEUE_HIGH           ( 8U )
+#endif
+
+#ifndef otaconfigSHAPER_QUEUE_LOW
+    #define otaconfigSHAPER_QUEUE_LOW            ( 2U )
+#endif
+
+#if ( otaconfigSHAPER_SHARE_PERCENT == 0U ) || ( otaconfigSHAPER_SHARE_PERCENT > 100U )
+    #error "otaconfigSHAPER_SHARE_PERCENT must be between 1 and 100."
+#endif
+
 /**
  * @brief The protocol selected for OTA control operations.
  *
@@ -208,7 +255,7 @@
  * Enable data over HTTP - ( OTA_DATA_OVER_HTTP)
  * Enable data over both MQTT & HTTP ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
  */
-#define configENABLED_DATA_PROTOCOLS      ( OTA_DATA_OVER_MQTT )
+#define configENABLED_DATA_PROTOCOLS      ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
 
 /**
  * @brief The preferred protocol selected for OTA data operations.
@@ -218,8 +265,11 @@
  * and following update here to switch to HTTP as primary.
  *
  * Note - use OTA_DATA_OVER_HTTP for HTTP as primary data protocol.
+ *
+ * HTTP is preferred so that image downloads do not share the MQTT connection with
+ * telemetry. Jobs created for MQTT only still download over MQTT.
  */
 
-#define configOTA_PRIMARY_DATA_PROTOCOL    OTA_DATA_OVER_MQTT
+#define configOTA_PRIMARY_DATA_PROTOCOL    OTA_DATA_OVER_HTTP
 
 #endif /* OTA_CONFIG_H_ */
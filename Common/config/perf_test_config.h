@@ -0,0 +1,118 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file perf_test_config.h
+ * @brief Baselines and tolerances of the performance regression test.
+ */
+
+#ifndef PERF_TEST_CONFIG_H
+#define PERF_TEST_CONFIG_H
+
+/*
+ * Each metric of the performance test is compared against its baseline here. A metric
+ * fails when it is worse than its baseline by more than its tolerance, in percent.
+ * A baseline of 0 has not been captured yet: the metric is reported but always passes.
+ *
+ * To capture the baselines, run the test on a reference board and copy the value of
+ * each "PERF," line of the output into the matching define below.
+ */
+
+/* Tolerance of the metrics timed on the board alone: crypto, SPI and littlefs */
+#ifndef PERF_TEST_TOLERANCE_PCT
+    #define PERF_TEST_TOLERANCE_PCT        ( 10 )
+#endif
+
+/* Tolerance of the metrics which include the network and the broker */
+#ifndef PERF_TEST_NET_TOLERANCE_PCT
+    #define PERF_TEST_NET_TOLERANCE_PCT    ( 30 )
+#endif
+
+/* Median cycles to hash and to encrypt and tag 1 KiB, lower is better */
+#ifndef PERF_BASELINE_SHA256_CYCLES
+    #define PERF_BASELINE_SHA256_CYCLES    ( 0 )
+#endif
+
+#ifndef PERF_BASELINE_AES_GCM_CYCLES
+    #define PERF_BASELINE_AES_GCM_CYCLES    ( 0 )
+#endif
+
+/* Average time to connect to the MQTT endpoint, DNS and TCP setup included, lower is better */
+#ifndef PERF_BASELINE_TLS_HANDSHAKE_MS
+    #define PERF_BASELINE_TLS_HANDSHAKE_MS    ( 0 )
+#endif
+
+/* MQTT loopback round trip percentiles, lower is better, and message rate, higher is better */
+#ifndef PERF_BASELINE_MQTT_RTT_P50_US
+    #define PERF_BASELINE_MQTT_RTT_P50_US    ( 0 )
+#endif
+
+#ifndef PERF_BASELINE_MQTT_RTT_P99_US
+    #define PERF_BASELINE_MQTT_RTT_P99_US    ( 0 )
+#endif
+
+#ifndef PERF_BASELINE_MQTT_MSGS_PER_SEC
+    #define PERF_BASELINE_MQTT_MSGS_PER_SEC    ( 0 )
+#endif
+
+/* SPI data plane during the MQTT test: average header exchange, lower is better, and
+ * payload transfer rate, higher is better */
+#ifndef PERF_BASELINE_SPI_HEADER_US
+    #define PERF_BASELINE_SPI_HEADER_US    ( 0 )
+#endif
+
+#ifndef PERF_BASELINE_SPI_PAYLOAD_KBPS
+    #define PERF_BASELINE_SPI_PAYLOAD_KBPS    ( 0 )
+#endif
+
+/* littlefs write, sync included, and read rates in KiB/s, higher is better */
+#ifndef PERF_BASELINE_LFS_WRITE_KBPS
+    #define PERF_BASELINE_LFS_WRITE_KBPS    ( 0 )
+#endif
+
+#ifndef PERF_BASELINE_LFS_READ_KBPS
+    #define PERF_BASELINE_LFS_READ_KBPS    ( 0 )
+#endif
+
+/* Amount of work of each measurement */
+#ifndef PERF_TEST_HANDSHAKE_ITER
+    #define PERF_TEST_HANDSHAKE_ITER    ( 4 )
+#endif
+
+#ifndef PERF_TEST_MQTT_MESSAGES
+    #define PERF_TEST_MQTT_MESSAGES    ( 200 )
+#endif
+
+#ifndef PERF_TEST_MQTT_PAYLOAD_LEN
+    #define PERF_TEST_MQTT_PAYLOAD_LEN    ( 256 )
+#endif
+
+#ifndef PERF_TEST_LFS_FILE_LEN
+    #define PERF_TEST_LFS_FILE_LEN    ( 32 * 1024 )
+#endif
+
+#endif /* PERF_TEST_CONFIG_H */
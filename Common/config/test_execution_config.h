@@ -71,4 +71,13 @@
  */
 #define CORE_PKCS11_TEST_ENABLED            ( 0 )
 
+/**
+ * @brief Configuration to enable the performance regression test.
+ *
+ * Baselines and tolerances are set in perf_test_config.h.
+ *
+ * #define PERFORMANCE_TEST_ENABLED  (0)
+ */
+#define PERFORMANCE_TEST_ENABLED            ( 0 )
+
 #endif /* TEST_EXECUTION_CONFIG_H */
@@ -31,8 +31,12 @@
 #define sock_recv           lwip_recv
 #define sock_close          lwip_close
 #define sock_setsockopt     lwip_setsockopt
+#define sock_getsockopt     lwip_getsockopt
 #define sock_fcntl          lwip_fcntl
 #define sock_select         lwip_select
+#define sock_bind           lwip_bind
+#define sock_sendto         lwip_sendto
+#define sock_getsockname    lwip_getsockname
 
 #define dns_getaddrinfo     lwip_getaddrinfo
 #define dns_freeaddrinfo    lwip_freeaddrinfo
@@ -34,6 +34,9 @@
 
 #include "ota_config.h"
 
+/* Incremented whenever a certificate is written. See ulPkiGetCertificateGeneration */
+static volatile uint32_t ulCertificateGeneration = 0;
+
 /*-----------------------------------------------------------*/
 
 PkiStatus_t xPrvMbedtlsErrToPkiStatus( int lError )
@@ -211,9 +214,10 @@ PkiStatus_t xPkiReadCertificate( mbedtls_x509_crt * pxMbedtlsCertCtx,
 
         case OBJ_FORM_DER:
            {
-               int lError = mbedtls_x509_crt_parse_der( pxMbedtlsCertCtx,
-                                                        pxCertificate->pucBuffer,
-                                                        pxCertificate->uxLen );
+               /* Borrow the caller's buffer rather than copy it to the heap */
+               int lError = mbedtls_x509_crt_parse_der_nocopy( pxMbedtlsCertCtx,
+                                                               pxCertificate->pucBuffer,
+                                                               pxCertificate->uxLen );
 
                MBEDTLS_LOG_IF_ERROR( lError, "Failed to parse certificate from buffer: 0x%08X, length: %ld,",
                                      pxCertificate->pucBuffer, pxCertificate->uxLen );
@@ -285,6 +289,37 @@ PkiStatus_t xPkiReadCertificate( mbedtls_x509_crt * pxMbedtlsCertCtx,
 
 /*-----------------------------------------------------------*/
 
+int32_t lPkiParseCertificateDerOwned( mbedtls_x509_crt * pxCertificateContext,
+                                      unsigned char * pucDer,
+                                      size_t uxDerLen )
+{
+    int32_t lError;
+
+    configASSERT( pxCertificateContext != NULL );
+    configASSERT( pucDer != NULL );
+
+    lError = mbedtls_x509_crt_parse_der_nocopy( pxCertificateContext, pucDer, uxDerLen );
+
+    if( lError == 0 )
+    {
+        mbedtls_x509_crt * pxCert = pxCertificateContext;
+
+        /* The new certificate is the last one in the chain */
+        while( pxCert->next != NULL )
+        {
+            pxCert = pxCert->next;
+        }
+
+        configASSERT( pxCert->raw.p == pucDer );
+
+        /* Let mbedtls_x509_crt_free zeroize and free the buffer */
+        pxCert->MBEDTLS_PRIVATE( own_buffer ) = 1;
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
 
 PkiStatus_t xPkiWriteCertificate( const char * pcCertLabel,
                                   const mbedtls_x509_crt * pxMbedtlsCertCtx )
@@ -352,11 +387,72 @@ PkiStatus_t xPkiWriteCertificate( const char * pcCertLabel,
             break;
     }
 
+    /* Invalidate any parsed copies of the previous certificate */
+    if( xStatus == PKI_SUCCESS )
+    {
+        ulCertificateGeneration++;
+    }
+
     return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
+uint32_t ulPkiGetCertificateGeneration( void )
+{
+    return ulCertificateGeneration;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xPkiObjectIsEqual( const PkiObject_t * pxObjectA,
+                              const PkiObject_t * pxObjectB )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxObjectA != NULL );
+    configASSERT( pxObjectB != NULL );
+
+    if( pxObjectA->xForm == pxObjectB->xForm )
+    {
+        switch( pxObjectA->xForm )
+        {
+            case OBJ_FORM_PEM:
+            case OBJ_FORM_DER:
+                xResult = ( pxObjectA->pucBuffer == pxObjectB->pucBuffer ) &&
+                          ( pxObjectA->uxLen == pxObjectB->uxLen );
+                break;
+
+                #ifdef MBEDTLS_TRANSPORT_PKCS11
+                    case OBJ_FORM_PKCS11_LABEL:
+                        xResult = ( pxObjectA->uxLen == pxObjectB->uxLen ) &&
+                                  ( strncmp( pxObjectA->pcPkcs11Label, pxObjectB->pcPkcs11Label,
+                                             pxObjectA->uxLen ) == 0 );
+                        break;
+                #endif /* ifdef MBEDTLS_TRANSPORT_PKCS11 */
+                #ifdef MBEDTLS_TRANSPORT_PSA
+                    case OBJ_FORM_PSA_CRYPTO:
+                        xResult = ( pxObjectA->xPsaCryptoId == pxObjectB->xPsaCryptoId );
+                        break;
+
+                    case OBJ_FORM_PSA_ITS:
+                    case OBJ_FORM_PSA_PS:
+                        xResult = ( pxObjectA->xPsaStorageId == pxObjectB->xPsaStorageId );
+                        break;
+                #endif /* ifdef MBEDTLS_TRANSPORT_PSA */
+            case OBJ_FORM_NONE:
+            /* Intentional fall through */
+            default:
+                xResult = pdFALSE;
+                break;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
 PkiStatus_t xPkiWritePubKey( const char * pcPubKeyLabel,
                              const unsigned char * pucPubKeyDer,
                              const size_t uxPubKeyDerLen,
@@ -576,12 +672,29 @@ PkiStatus_t xPkiReadPublicKey( mbedtls_pk_context * pxPkCtx,
     PkiStatus_t xStatus = PKI_SUCCESS;
     unsigned char * pucPubKeyDer = NULL;
     size_t uxPubKeyLen = 0;
+    BaseType_t xBorrowed = pdFALSE;
 
     if( ( pxPkCtx == NULL ) ||
         ( pxPublicKey == NULL ) )
     {
         xStatus = PKI_ERR_ARG_INVALID;
     }
+    else if( ( pxPublicKey->xForm == OBJ_FORM_PEM ) ||
+             ( pxPublicKey->xForm == OBJ_FORM_DER ) )
+    {
+        /* The parsers only read the key, so parse it from the caller's buffer */
+        if( ( pxPublicKey->uxLen == 0 ) ||
+            ( pxPublicKey->pucBuffer == NULL ) )
+        {
+            xStatus = PKI_ERR_ARG_INVALID;
+        }
+        else
+        {
+            pucPubKeyDer = ( unsigned char * ) pxPublicKey->pucBuffer;
+            uxPubKeyLen = pxPublicKey->uxLen;
+            xBorrowed = pdTRUE;
+        }
+    }
     else
     {
         xStatus = xPkiReadPublicKeyDer( &pucPubKeyDer, &uxPubKeyLen, pxPublicKey );
@@ -609,7 +722,8 @@ PkiStatus_t xPkiReadPublicKey( mbedtls_pk_context * pxPkCtx,
         xStatus = xPrvMbedtlsErrToPkiStatus( lError );
     }
 
-    if( pucPubKeyDer != NULL )
+    if( ( pucPubKeyDer != NULL ) &&
+        ( xBorrowed == pdFALSE ) )
     {
         configASSERT( uxPubKeyLen > 0 );
         mbedtls_platform_zeroize( pucPubKeyDer, uxPubKeyLen );
@@ -649,10 +763,18 @@ PkiStatus_t xPkiReadPublicKeyDer( unsigned char ** ppucPubKeyDer,
                 else
                 {
                     void * pvBuf = pvPortMalloc( pxPublicKey->uxLen );
-                    memcpy( pvBuf, pxPublicKey->pucBuffer, pxPublicKey->uxLen );
 
-                    *ppucPubKeyDer = ( unsigned char * ) pvBuf;
-                    *puxPubKeyDerLen = pxPublicKey->uxLen;
+                    if( pvBuf == NULL )
+                    {
+                        xStatus = PKI_ERR_NOMEM;
+                    }
+                    else
+                    {
+                        ( void ) memcpy( pvBuf, pxPublicKey->pucBuffer, pxPublicKey->uxLen );
+
+                        *ppucPubKeyDer = ( unsigned char * ) pvBuf;
+                        *puxPubKeyDerLen = pxPublicKey->uxLen;
+                    }
                 }
 
                 break;
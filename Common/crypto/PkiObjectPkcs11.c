@@ -26,6 +26,7 @@
 #include "logging.h"
 
 #include "FreeRTOS.h"
+#include "task.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -192,6 +193,243 @@
         return xResult;
     }
 
+/*-----------------------------------------------------------*/
+
+/*
+ * Sessions are kept open in a small pool and object handles are remembered
+ * by label and class. A TLS connect then reuses an open session and skips
+ * the C_FindObjects lookups for the client key and certificate. Handles are
+ * dropped whenever an object is rewritten through this file, or when an
+ * operation on a cached handle fails.
+ */
+    #ifndef PKCS11_SESSION_POOL_SIZE
+        #define PKCS11_SESSION_POOL_SIZE    3
+    #endif
+
+    #ifndef PKCS11_HANDLE_CACHE_SIZE
+        #define PKCS11_HANDLE_CACHE_SIZE    4
+    #endif
+
+    typedef struct Pkcs11PooledSession
+    {
+        CK_SESSION_HANDLE xSession;
+        BaseType_t xInUse;
+    } Pkcs11PooledSession_t;
+
+    typedef struct Pkcs11HandleCacheEntry
+    {
+        CK_OBJECT_HANDLE xHandle; /* CK_INVALID_HANDLE if the entry is free */
+        CK_OBJECT_CLASS xClass;
+        size_t uxLabelLen;
+        char pcLabel[ pkcs11configMAX_LABEL_LENGTH + 1 ];
+    } Pkcs11HandleCacheEntry_t;
+
+    static Pkcs11PooledSession_t xSessionPool[ PKCS11_SESSION_POOL_SIZE ] = { 0 };
+    static Pkcs11HandleCacheEntry_t xHandleCache[ PKCS11_HANDLE_CACHE_SIZE ] = { 0 };
+    static size_t uxHandleCacheNext = 0;
+
+/*-----------------------------------------------------------*/
+
+    CK_RV xPkcs11SessionAcquire( CK_SESSION_HANDLE_PTR pxSession )
+    {
+        CK_RV xResult = CKR_OK;
+        Pkcs11PooledSession_t * pxSlot = NULL;
+
+        configASSERT( pxSession );
+
+        *pxSession = CK_INVALID_HANDLE;
+
+        taskENTER_CRITICAL();
+
+        for( size_t i = 0; i < PKCS11_SESSION_POOL_SIZE; i++ )
+        {
+            if( xSessionPool[ i ].xInUse == pdFALSE )
+            {
+                xSessionPool[ i ].xInUse = pdTRUE;
+                pxSlot = &( xSessionPool[ i ] );
+                break;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( pxSlot == NULL )
+        {
+            /* Pool exhausted, hand out a session that is closed on release */
+            xResult = xInitializePkcs11Session( pxSession );
+        }
+        else
+        {
+            if( pxSlot->xSession == CK_INVALID_HANDLE )
+            {
+                xResult = xInitializePkcs11Session( &( pxSlot->xSession ) );
+            }
+
+            if( xResult == CKR_OK )
+            {
+                *pxSession = pxSlot->xSession;
+            }
+            else
+            {
+                pxSlot->xSession = CK_INVALID_HANDLE;
+                pxSlot->xInUse = pdFALSE;
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    CK_RV xPkcs11SessionRelease( CK_SESSION_HANDLE xSession )
+    {
+        CK_RV xResult = CKR_OK;
+        BaseType_t xPooled = pdFALSE;
+
+        if( xSession != CK_INVALID_HANDLE )
+        {
+            taskENTER_CRITICAL();
+
+            for( size_t i = 0; i < PKCS11_SESSION_POOL_SIZE; i++ )
+            {
+                if( xSessionPool[ i ].xSession == xSession )
+                {
+                    xSessionPool[ i ].xInUse = pdFALSE;
+                    xPooled = pdTRUE;
+                    break;
+                }
+            }
+
+            taskEXIT_CRITICAL();
+
+            if( xPooled == pdFALSE )
+            {
+                CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
+
+                xResult = C_GetFunctionList( &pxFunctionList );
+
+                if( xResult == CKR_OK )
+                {
+                    xResult = pxFunctionList->C_CloseSession( xSession );
+                }
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static Pkcs11HandleCacheEntry_t * pxHandleCacheFind( const char * pcLabel,
+                                                         size_t uxLabelLen,
+                                                         CK_OBJECT_CLASS xClass )
+    {
+        Pkcs11HandleCacheEntry_t * pxEntry = NULL;
+
+        for( size_t i = 0; i < PKCS11_HANDLE_CACHE_SIZE; i++ )
+        {
+            if( ( xHandleCache[ i ].xHandle != CK_INVALID_HANDLE ) &&
+                ( xHandleCache[ i ].xClass == xClass ) &&
+                ( xHandleCache[ i ].uxLabelLen == uxLabelLen ) &&
+                ( memcmp( xHandleCache[ i ].pcLabel, pcLabel, uxLabelLen ) == 0 ) )
+            {
+                pxEntry = &( xHandleCache[ i ] );
+                break;
+            }
+        }
+
+        return pxEntry;
+    }
+
+/*-----------------------------------------------------------*/
+
+    CK_RV xPkcs11FindObjectCached( CK_SESSION_HANDLE xSession,
+                                   const char * pcLabel,
+                                   size_t uxLabelLen,
+                                   CK_OBJECT_CLASS xClass,
+                                   CK_OBJECT_HANDLE_PTR pxHandle )
+    {
+        CK_RV xResult = CKR_OK;
+        Pkcs11HandleCacheEntry_t * pxEntry;
+
+        configASSERT( pcLabel );
+        configASSERT( pxHandle );
+
+        *pxHandle = CK_INVALID_HANDLE;
+
+        if( ( uxLabelLen == 0 ) ||
+            ( uxLabelLen > pkcs11configMAX_LABEL_LENGTH ) )
+        {
+            xResult = CKR_ARGUMENTS_BAD;
+        }
+        else
+        {
+            taskENTER_CRITICAL();
+
+            pxEntry = pxHandleCacheFind( pcLabel, uxLabelLen, xClass );
+
+            if( pxEntry != NULL )
+            {
+                *pxHandle = pxEntry->xHandle;
+            }
+
+            taskEXIT_CRITICAL();
+        }
+
+        if( ( xResult == CKR_OK ) &&
+            ( *pxHandle == CK_INVALID_HANDLE ) )
+        {
+            char pcLabelBuffer[ pkcs11configMAX_LABEL_LENGTH + 1 ] = { 0 };
+
+            ( void ) memcpy( pcLabelBuffer, pcLabel, uxLabelLen );
+
+            xResult = xFindObjectWithLabelAndClass( xSession,
+                                                    pcLabelBuffer, uxLabelLen,
+                                                    xClass, pxHandle );
+
+            if( ( xResult == CKR_OK ) &&
+                ( *pxHandle != CK_INVALID_HANDLE ) )
+            {
+                taskENTER_CRITICAL();
+
+                if( pxHandleCacheFind( pcLabel, uxLabelLen, xClass ) == NULL )
+                {
+                    pxEntry = &( xHandleCache[ uxHandleCacheNext ] );
+                    uxHandleCacheNext = ( uxHandleCacheNext + 1 ) % PKCS11_HANDLE_CACHE_SIZE;
+
+                    pxEntry->xHandle = *pxHandle;
+                    pxEntry->xClass = xClass;
+                    pxEntry->uxLabelLen = uxLabelLen;
+                    ( void ) memcpy( pxEntry->pcLabel, pcLabelBuffer, sizeof( pxEntry->pcLabel ) );
+                }
+
+                taskEXIT_CRITICAL();
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPkcs11InvalidateObject( const char * pcLabel,
+                                  size_t uxLabelLen,
+                                  CK_OBJECT_CLASS xClass )
+    {
+        Pkcs11HandleCacheEntry_t * pxEntry;
+
+        taskENTER_CRITICAL();
+
+        pxEntry = pxHandleCacheFind( pcLabel, uxLabelLen, xClass );
+
+        if( pxEntry != NULL )
+        {
+            pxEntry->xHandle = CK_INVALID_HANDLE;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
 /*-----------------------------------------------------------*/
 
     PkiStatus_t xPrvCkRvToPkiStatus( CK_RV xError )
@@ -261,7 +499,7 @@
             CK_OBJECT_HANDLE xPkHandle = CK_INVALID_HANDLE;
             CK_RV xResult;
 
-            xResult = xInitializePkcs11Session( &xSession );
+            xResult = xPkcs11SessionAcquire( &xSession );
 
             if( xResult != CKR_OK )
             {
@@ -273,9 +511,9 @@
 
             if( xStatus == PKI_SUCCESS )
             {
-                xResult = xFindObjectWithLabelAndClass( xSession,
-                                                        pcLabelBuffer, uxLabelLen,
-                                                        CKO_PRIVATE_KEY, &xPkHandle );
+                xResult = xPkcs11FindObjectCached( xSession,
+                                                   pcLabelBuffer, uxLabelLen,
+                                                   CKO_PRIVATE_KEY, &xPkHandle );
 
                 if( ( xResult != CKR_OK ) ||
                     ( xPkHandle == CK_INVALID_HANDLE ) )
@@ -290,10 +528,20 @@
             {
                 xResult = xPKCS11_initMbedtlsPkContext( pxPkCtx, xSession, xPkHandle );
                 xStatus = xPrvCkRvToPkiStatus( xResult );
+
+                /* Look the key up again next time in case the cached handle went stale */
+                if( xStatus != PKI_SUCCESS )
+                {
+                    vPkcs11InvalidateObject( pcLabelBuffer, uxLabelLen, CKO_PRIVATE_KEY );
+                }
             }
 
-            if( ( xStatus == PKI_SUCCESS ) &&
-                ( pxSessionHandle != NULL ) )
+            /* On success the session stays with the pk context until it is freed */
+            if( xStatus != PKI_SUCCESS )
+            {
+                ( void ) xPkcs11SessionRelease( xSession );
+            }
+            else if( pxSessionHandle != NULL )
             {
                 *pxSessionHandle = xSession;
             }
@@ -351,7 +599,7 @@
 
         if( xStatus == PKI_SUCCESS )
         {
-            xResult = xInitializePkcs11Session( &xSession );
+            xResult = xPkcs11SessionAcquire( &xSession );
 
             if( xResult != CKR_OK )
             {
@@ -364,6 +612,8 @@
 
         if( xStatus == PKI_SUCCESS )
         {
+            vPkcs11InvalidateObject( pcLabelBuffer, uxLabelLen, CKO_CERTIFICATE );
+
             xResult = xPrvDestoryObject( xSession, CKO_CERTIFICATE, pcLabelBuffer, uxLabelLen );
 
             if( xResult != CKR_OK )
@@ -386,7 +636,7 @@
 
         if( xSession )
         {
-            pxFunctionList->C_CloseSession( xSession );
+            ( void ) xPkcs11SessionRelease( xSession );
             xSession = 0;
         }
 
@@ -439,7 +689,7 @@
 
         if( xStatus == PKI_SUCCESS )
         {
-            CK_RV xResult = xInitializePkcs11Session( &xSession );
+            CK_RV xResult = xPkcs11SessionAcquire( &xSession );
 
             if( xResult != CKR_OK )
             {
@@ -462,12 +712,17 @@
             MBEDTLS_LOG_IF_ERROR( lRslt, "Failed to parse certificate(s) from pkcs11 label: %.*s,",
                                   uxLabelLen, pcLabel );
 
+            if( lRslt != 0 )
+            {
+                vPkcs11InvalidateObject( pcLabel, uxLabelLen, CKO_CERTIFICATE );
+            }
+
             xStatus = xPrvMbedtlsErrToPkiStatus( lRslt );
         }
 
         if( pxFunctionList && xSession )
         {
-            pxFunctionList->C_CloseSession( xSession );
+            ( void ) xPkcs11SessionRelease( xSession );
         }
 
         return xStatus;
@@ -512,11 +767,14 @@
 
         if( xResult == CKR_OK )
         {
-            xResult = xInitializePkcs11Session( &xSession );
+            xResult = xPkcs11SessionAcquire( &xSession );
         }
 
         if( xResult == CKR_OK )
         {
+            vPkcs11InvalidateObject( pcPrivateKeyLabel, uxPrivateKeyLabelLen, CKO_PRIVATE_KEY );
+            vPkcs11InvalidateObject( pcPublicKeyLabel, uxPublicKeyLabelLen, CKO_PUBLIC_KEY );
+
             xResult = xPrvDestoryObject( xSession, CKO_PRIVATE_KEY, pcPrivateKeyLabel, uxPrivateKeyLabelLen );
         }
 
@@ -572,7 +830,7 @@
         if( pxFunctionList &&
             xSession )
         {
-            pxFunctionList->C_CloseSession( xSession );
+            ( void ) xPkcs11SessionRelease( xSession );
         }
 
         return xPrvCkRvToPkiStatus( xResult );
@@ -622,17 +880,17 @@
 
         if( xStatus == PKI_SUCCESS )
         {
-            CK_RV xResult = xInitializePkcs11Session( &xSession );
+            CK_RV xResult = xPkcs11SessionAcquire( &xSession );
             xStatus = xPrvCkRvToPkiStatus( xResult );
         }
 
         if( xStatus == PKI_SUCCESS )
         {
-            CK_RV xResult = xFindObjectWithLabelAndClass( xSession,
-                                                          pcPubKeyLabelBuf,
-                                                          uxPubKeyLabelLen,
-                                                          CKO_PUBLIC_KEY,
-                                                          &xPubKeyHandle );
+            CK_RV xResult = xPkcs11FindObjectCached( xSession,
+                                                     pcPubKeyLabelBuf,
+                                                     uxPubKeyLabelLen,
+                                                     CKO_PUBLIC_KEY,
+                                                     &xPubKeyHandle );
             xStatus = xPrvCkRvToPkiStatus( xResult );
         }
 
@@ -642,6 +900,11 @@
                                                  xPubKeyHandle,
                                                  ppucPublicKeyDer, &ulPubKeyLen );
             xStatus = xPrvCkRvToPkiStatus( xResult );
+
+            if( xStatus != PKI_SUCCESS )
+            {
+                vPkcs11InvalidateObject( pcPubKeyLabelBuf, uxPubKeyLabelLen, CKO_PUBLIC_KEY );
+            }
         }
 
         if( xStatus == PKI_SUCCESS )
@@ -651,8 +914,12 @@
 
         if( xSession )
         {
-            CK_RV xResult = pxFunctionList->C_CloseSession( xSession );
-            xStatus = xPrvCkRvToPkiStatus( xResult );
+            CK_RV xResult = xPkcs11SessionRelease( xSession );
+
+            if( xStatus == PKI_SUCCESS )
+            {
+                xStatus = xPrvCkRvToPkiStatus( xResult );
+            }
         }
 
         return xStatus;
@@ -707,7 +974,7 @@
 
         if( xStatus == PKI_SUCCESS )
         {
-            xResult = xInitializePkcs11Session( &xSession );
+            xResult = xPkcs11SessionAcquire( &xSession );
 
             if( xResult != CKR_OK )
             {
@@ -720,6 +987,8 @@
 
         if( xStatus == PKI_SUCCESS )
         {
+            vPkcs11InvalidateObject( pcLabelBuffer, uxLabelLen, CKO_PUBLIC_KEY );
+
             xResult = xPrvDestoryObject( xSession, CKO_PUBLIC_KEY, pcLabelBuffer, uxLabelLen );
 
             if( xResult != CKR_OK )
@@ -742,7 +1011,7 @@
 
         if( xSession )
         {
-            pxFunctionList->C_CloseSession( xSession );
+            ( void ) xPkcs11SessionRelease( xSession );
             xSession = 0;
         }
 
@@ -448,6 +448,8 @@
 
         if( xStatus == PSA_SUCCESS )
         {
+            vPsa_invalidatePkCache( xPubKeyId );
+
             xStatus = psa_destroy_key( xPubKeyId );
 
             /* Mask invalid handle error since key may not exist */
@@ -539,9 +541,9 @@
 
         if( xStatus == PSA_SUCCESS )
         {
-            xStatus = mbedtls_x509_crt_parse_der_nocopy( pxCertificateContext,
-                                                         pucCertBuffer,
-                                                         uxCertLen );
+            xStatus = lPkiParseCertificateDerOwned( pxCertificateContext,
+                                                    pucCertBuffer,
+                                                    uxCertLen );
         }
 
         /* Free memory on error. */
@@ -608,9 +610,9 @@
             /* Handle DER format */
             else
             {
-                lError = mbedtls_x509_crt_parse_der_nocopy( pxCertificateContext,
-                                                            pucCertBuffer,
-                                                            uxCertLen );
+                lError = lPkiParseCertificateDerOwned( pxCertificateContext,
+                                                       pucCertBuffer,
+                                                       uxCertLen );
 
                 /*
                  * pxCertificateContext takes ownership of allocated buffer in this case.
@@ -685,9 +687,9 @@
             /* Handle DER format */
             else
             {
-                lError = mbedtls_x509_crt_parse_der_nocopy( pxCertificateContext,
-                                                            pucCertBuffer,
-                                                            uxCertLen );
+                lError = lPkiParseCertificateDerOwned( pxCertificateContext,
+                                                       pucCertBuffer,
+                                                       uxCertLen );
 
                 /*
                  * pxCertificateContext takes ownership of allocated buffer in this case.
@@ -735,6 +737,9 @@
             *ppucPubKeyDer = NULL;
             *puxPubKeyDerLen = 0;
 
+            vPsa_invalidatePkCache( xPrvKeyId );
+            vPsa_invalidatePkCache( xPubKeyId );
+
             xStatus = psa_destroy_key( xPrvKeyId );
 
             /* Mask invalid handle error since key may not exist */
@@ -46,6 +46,7 @@
 
     #include "core_pkcs11_config.h"
     #include "core_pkcs11.h"
+    #include "mbedtls_transport.h"
 
 
     typedef struct P11PkCtx
@@ -230,11 +231,11 @@
         if( xResult == CKR_OK )
         {
             /* Get the handle of the certificate. */
-            xResult = xFindObjectWithLabelAndClass( xP11SessionHandle,
-                                                    pcCertLabelCopy,
-                                                    xLabelLen,
-                                                    CKO_CERTIFICATE,
-                                                    &xCertObj );
+            xResult = xPkcs11FindObjectCached( xP11SessionHandle,
+                                               pcCertLabelCopy,
+                                               xLabelLen,
+                                               CKO_CERTIFICATE,
+                                               &xCertObj );
 
             if( xCertObj == CK_INVALID_HANDLE )
             {
@@ -275,12 +276,17 @@
                                                            1 );
         }
 
-        /* Decode the certificate. */
+        /* Decode the DER certificate in place. The context takes ownership of the buffer on success. */
         if( CKR_OK == xResult )
         {
-            lResult = mbedtls_x509_crt_parse( pxCertificateContext,
-                                              ( unsigned char * ) xTemplate.pValue,
-                                              xTemplate.ulValueLen );
+            lResult = lPkiParseCertificateDerOwned( pxCertificateContext,
+                                                    ( unsigned char * ) xTemplate.pValue,
+                                                    xTemplate.ulValueLen );
+
+            if( lResult == 0 )
+            {
+                xTemplate.pValue = NULL;
+            }
         }
         else
         {
@@ -912,6 +918,12 @@
                     }
                     else
                     {
+                        if( pxMbedtlsPkCtx->pk_ctx != NULL )
+                        {
+                            /* The session stays with the caller */
+                            ( ( P11EcDsaCtx_t * ) pxMbedtlsPkCtx->pk_ctx )->xP11PkCtx.xSessionHandle = CK_INVALID_HANDLE;
+                        }
+
                         p11_ecdsa_ctx_free( pxMbedtlsPkCtx->pk_ctx );
                         pxMbedtlsPkCtx->pk_ctx = NULL;
                         pxMbedtlsPkCtx->pk_info = NULL;
@@ -934,6 +946,12 @@
                     }
                     else
                     {
+                        if( pxMbedtlsPkCtx->pk_ctx != NULL )
+                        {
+                            /* The session stays with the caller */
+                            ( ( P11RsaCtx_t * ) pxMbedtlsPkCtx->pk_ctx )->xP11PkCtx.xSessionHandle = CK_INVALID_HANDLE;
+                        }
+
                         p11_rsa_ctx_free( pxMbedtlsPkCtx->pk_ctx );
                         pxMbedtlsPkCtx->pk_ctx = NULL;
                         pxMbedtlsPkCtx->pk_info = NULL;
@@ -955,7 +973,6 @@
     {
         CK_RV xResult = CKR_OK;
         P11PkCtx_t * pxP11Ctx = NULL;
-        CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
 
         configASSERT( pxMbedtlsPkCtx );
 
@@ -970,13 +987,7 @@
 
         if( xResult == CKR_OK )
         {
-            xResult = C_GetFunctionList( &pxFunctionList );
-        }
-
-        if( xResult == CKR_OK )
-        {
-            configASSERT( pxFunctionList );
-            xResult = pxFunctionList->C_CloseSession( pxP11Ctx->xSessionHandle );
+            xResult = xPkcs11SessionRelease( pxP11Ctx->xSessionHandle );
         }
 
         if( xResult == CKR_OK )
@@ -1052,6 +1063,9 @@
 
             mbedtls_ecdsa_free( &( pxP11EcDsa->xMbedEcDsaCtx ) );
 
+            /* Hand the session opened by xPkcs11InitMbedtlsPkContext back to the pool */
+            ( void ) xPkcs11SessionRelease( pxP11EcDsa->xP11PkCtx.xSessionHandle );
+
             mbedtls_free( pvCtx );
         }
     }
@@ -1605,6 +1619,9 @@
 
             mbedtls_rsa_free( &( pxP11Rsa->xMbedRsaCtx ) );
 
+            /* Hand the session opened by xPkcs11InitMbedtlsPkContext back to the pool */
+            ( void ) xPkcs11SessionRelease( pxP11Rsa->xP11PkCtx.xSessionHandle );
+
             mbedtls_free( pvCtx );
         }
     }
@@ -32,6 +32,9 @@
 
     #include <string.h>
 
+    #include "FreeRTOS.h"
+    #include "semphr.h"
+
     #define MBEDTLS_ALLOW_PRIVATE_ACCESS
 
     #include "psa/crypto.h"
@@ -50,6 +53,7 @@
 
     #include "psa/internal_trusted_storage.h"
     #include "psa/protected_storage.h"
+    #include "tfm_ns_interface_freertos.h"
 
     #include "psa_util.h"
 
@@ -86,9 +90,30 @@
         psa_key_id_t xKeyId;
     } PsaPkCtx_t;
 
+/* Number of private keys whose public part is kept by lPsa_initMbedtlsPkContext */
+    #ifndef PSA_PK_CACHE_SIZE
+        #define PSA_PK_CACHE_SIZE    2
+    #endif
+
+/*
+ * Public key of a PSA private key, in DER form, so that creating a pk context
+ * for the same key on the next connection does not query the key attributes
+ * and export the public key again.
+ */
+    typedef struct PsaPkCacheEntry_t
+    {
+        psa_key_id_t xKeyId;   /* 0 if the entry is free */
+        unsigned char * pucPubKeyDer;
+        size_t uxPubKeyDerLen;
+    } PsaPkCacheEntry_t;
+
 
 /* Globals */
 
+    static PsaPkCacheEntry_t xPkCache[ PSA_PK_CACHE_SIZE ] = { 0 };
+    static size_t uxPkCacheNext = 0;
+    static SemaphoreHandle_t xPkCacheMutex = NULL;
+
     const mbedtls_pk_info_t mbedtls_pk_psa_ecdsa =
     {
         MBEDTLS_PK_ECKEY,
@@ -213,6 +238,7 @@
         struct psa_storage_info_t xStorageInfo = { 0 };
         void * pvDataBuffer = NULL;
         size_t uxDataLen = 0;
+        BaseType_t xBatch = pdFALSE;
 
         configASSERT( xObjectUid > 0 );
 
@@ -220,6 +246,11 @@
         {
             xStatus = PSA_ERROR_INVALID_ARGUMENT;
         }
+        else
+        {
+            /* Keep the info and data reads in one hold of the secure interface */
+            xBatch = ( ns_interface_batch_begin() == 0 ) ? pdTRUE : pdFALSE;
+        }
 
         if( xStatus == PSA_SUCCESS )
         {
@@ -246,6 +277,11 @@
                                    &uxDataLen );
         }
 
+        if( xBatch == pdTRUE )
+        {
+            ns_interface_batch_end();
+        }
+
         if( xStatus == PSA_SUCCESS )
         {
             *ppucData = ( unsigned char * ) pvDataBuffer;
@@ -328,6 +364,120 @@
         return mbedtls_psa_err_translate_pk( xStatus );
     }
 
+/*-----------------------------------------------------------*/
+
+    static BaseType_t xPkCacheLock( void )
+    {
+        if( xPkCacheMutex == NULL )
+        {
+            taskENTER_CRITICAL();
+
+            if( xPkCacheMutex == NULL )
+            {
+                xPkCacheMutex = xSemaphoreCreateMutex();
+            }
+
+            taskEXIT_CRITICAL();
+        }
+
+        return ( ( xPkCacheMutex != NULL ) &&
+                 ( xSemaphoreTake( xPkCacheMutex, portMAX_DELAY ) == pdTRUE ) ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Return a copy of the DER public key of xKeyId, from the cache or exported
+ * from PSA Crypto and then added to the cache. The caller frees the copy.
+ */
+    static psa_status_t xPkCacheGetPublicKey( unsigned char ** ppucPubKeyDer,
+                                              size_t * puxPubKeyDerLen,
+                                              psa_key_id_t xKeyId )
+    {
+        psa_status_t xStatus = PSA_ERROR_DOES_NOT_EXIST;
+        BaseType_t xLocked = xPkCacheLock();
+
+        *ppucPubKeyDer = NULL;
+        *puxPubKeyDerLen = 0;
+
+        if( xLocked == pdTRUE )
+        {
+            for( size_t i = 0; i < PSA_PK_CACHE_SIZE; i++ )
+            {
+                if( xPkCache[ i ].xKeyId == xKeyId )
+                {
+                    *ppucPubKeyDer = mbedtls_calloc( 1, xPkCache[ i ].uxPubKeyDerLen );
+
+                    if( *ppucPubKeyDer == NULL )
+                    {
+                        xStatus = PSA_ERROR_INSUFFICIENT_MEMORY;
+                    }
+                    else
+                    {
+                        ( void ) memcpy( *ppucPubKeyDer, xPkCache[ i ].pucPubKeyDer, xPkCache[ i ].uxPubKeyDerLen );
+                        *puxPubKeyDerLen = xPkCache[ i ].uxPubKeyDerLen;
+                        xStatus = PSA_SUCCESS;
+                    }
+
+                    break;
+                }
+            }
+        }
+
+        if( xStatus == PSA_ERROR_DOES_NOT_EXIST )
+        {
+            xStatus = xReadPublicKeyFromPSACrypto( ppucPubKeyDer, puxPubKeyDerLen, xKeyId );
+
+            if( ( xStatus == PSA_SUCCESS ) &&
+                ( xLocked == pdTRUE ) )
+            {
+                PsaPkCacheEntry_t * pxEntry = &( xPkCache[ uxPkCacheNext ] );
+                unsigned char * pucCopy = mbedtls_calloc( 1, *puxPubKeyDerLen );
+
+                /* Keep the entry unchanged if the copy cannot be made, the caller still gets the key */
+                if( pucCopy != NULL )
+                {
+                    ( void ) memcpy( pucCopy, *ppucPubKeyDer, *puxPubKeyDerLen );
+
+                    mbedtls_free( pxEntry->pucPubKeyDer );
+                    pxEntry->pucPubKeyDer = pucCopy;
+                    pxEntry->uxPubKeyDerLen = *puxPubKeyDerLen;
+                    pxEntry->xKeyId = xKeyId;
+
+                    uxPkCacheNext = ( uxPkCacheNext + 1 ) % PSA_PK_CACHE_SIZE;
+                }
+            }
+        }
+
+        if( xLocked == pdTRUE )
+        {
+            ( void ) xSemaphoreGive( xPkCacheMutex );
+        }
+
+        return xStatus;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPsa_invalidatePkCache( psa_key_id_t xKeyId )
+    {
+        if( xPkCacheLock() == pdTRUE )
+        {
+            for( size_t i = 0; i < PSA_PK_CACHE_SIZE; i++ )
+            {
+                if( xPkCache[ i ].xKeyId == xKeyId )
+                {
+                    mbedtls_free( xPkCache[ i ].pucPubKeyDer );
+                    xPkCache[ i ].pucPubKeyDer = NULL;
+                    xPkCache[ i ].uxPubKeyDerLen = 0;
+                    xPkCache[ i ].xKeyId = 0;
+                }
+            }
+
+            ( void ) xSemaphoreGive( xPkCacheMutex );
+        }
+    }
+
 /*-----------------------------------------------------------*/
 
     int32_t lPsa_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
@@ -363,7 +513,7 @@
             size_t uxPubKeyLen = 0;
             psa_status_t xPsaStatus = PSA_SUCCESS;
 
-            xPsaStatus = xReadPublicKeyFromPSACrypto( &pucPubKeyDer, &uxPubKeyLen, pxPsaPk->xKeyId );
+            xPsaStatus = xPkCacheGetPublicKey( &pucPubKeyDer, &uxPubKeyLen, pxPsaPk->xKeyId );
 
             if( xPsaStatus != PSA_SUCCESS )
             {
@@ -503,7 +653,12 @@
 
         configASSERT( pvCtx );
 
-        if( psa_get_key_attributes( pxPsaCtx->xKeyId, &attributes ) == PSA_SUCCESS )
+        /* The public key loaded by lPsa_initMbedtlsPkContext gives the size without a secure call */
+        if( pxPsaCtx->xEcdsaCtx.grp.id != MBEDTLS_ECP_DP_NONE )
+        {
+            bits = pxPsaCtx->xEcdsaCtx.grp.pbits;
+        }
+        else if( psa_get_key_attributes( pxPsaCtx->xKeyId, &attributes ) == PSA_SUCCESS )
         {
             bits = psa_get_key_bits( &attributes );
             psa_reset_key_attributes( &attributes );
@@ -24,6 +24,7 @@
 #define _PKI_OBJECT_H_
 
 #include "tls_transport_config.h"
+#include "FreeRTOS.h"
 
 #if defined( MBEDTLS_TRANSPORT_PSA )
     #include "psa/crypto.h"
@@ -83,7 +84,8 @@ typedef struct PkiObject
     };
 } PkiObject_t;
 
-/* Convenience initializers */
+/* Convenience initializers. DER certificates are parsed in place, so their buffer must stay
+ * valid for as long as the parsed certificate is in use. */
 #define PKI_OBJ_PEM( buffer, len )     { .xForm = OBJ_FORM_PEM, .uxLen = len, .pucBuffer = buffer }
 #define PKI_OBJ_DER( buffer, len )     { .xForm = OBJ_FORM_DER, .uxLen = len, .pucBuffer = buffer }
 
@@ -113,6 +115,26 @@ PkiStatus_t xPkiReadCertificate( mbedtls_x509_crt * pxMbedtlsCertCtx,
 PkiStatus_t xPkiWriteCertificate( const char * pcCertLabel,
                                   const mbedtls_x509_crt * pxMbedtlsCertCtx );
 
+/**
+ * @brief Get the certificate store generation.
+ *
+ * The value changes each time xPkiWriteCertificate stores a certificate. Callers which cache
+ * parsed certificates compare it against the value seen when the cache entry was built.
+ *
+ * @return Current certificate generation.
+ */
+uint32_t ulPkiGetCertificateGeneration( void );
+
+/**
+ * @brief Check whether two PkiObject_t refer to the same object.
+ * @param[in] pxObjectA First object.
+ * @param[in] pxObjectB Second object.
+ *
+ * @return pdTRUE when both objects have the same form and location; otherwise, pdFALSE.
+ */
+BaseType_t xPkiObjectIsEqual( const PkiObject_t * pxObjectA,
+                              const PkiObject_t * pxObjectB );
+
 /**
  * @brief Initialize the private key object
  *
@@ -178,6 +200,9 @@ PkiStatus_t xPkiGenerateECKeypair( const char * pcPrvKeyLabel,
     int32_t lPsa_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
                                        psa_key_id_t xKeyId );
 
+/* Drop the public key cached by lPsa_initMbedtlsPkContext for xKeyId, call before the key is replaced */
+    void vPsa_invalidatePkCache( psa_key_id_t xKeyId );
+
     int32_t lGenerateKeyPairECPsaCrypto( psa_key_id_t xPrvKeyId,
                                          psa_key_id_t xPubKeyId,
                                          unsigned char ** ppucPubKeyDer,
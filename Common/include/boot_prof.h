@@ -0,0 +1,73 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _BOOT_PROF_H
+#define _BOOT_PROF_H
+
+#include <stdint.h>
+
+/*
+ * Boot phase recorder. Each phase keeps the time it was first reached, in microseconds
+ * since TIM5 was started by hw_init, shortly after reset. Later marks of the same phase,
+ * after a reconnect for instance, are ignored. Several phases run concurrently, so their
+ * times are not cumulative: see the "boot" cli command.
+ */
+typedef enum
+{
+    BOOT_PHASE_HW_INIT = 0,     /* hw_init returned */
+    BOOT_PHASE_SCHEDULER,       /* vInitTask started */
+    BOOT_PHASE_FS_MOUNTED,      /* littlefs mounted */
+    BOOT_PHASE_KV_READY,        /* KVStore_init returned */
+    BOOT_PHASE_LWIP_READY,      /* tcpip thread started */
+    BOOT_PHASE_MX_RESET,        /* wifi module out of reset */
+    BOOT_PHASE_MX_READY,        /* wifi module firmware revision and mac address read */
+    BOOT_PHASE_TLS_CONFIGURED,  /* client certificate, key and root CA loaded */
+    BOOT_PHASE_WIFI_UP,         /* associated with the access point */
+    BOOT_PHASE_DHCP_BOUND,      /* IP address assigned */
+    BOOT_PHASE_TLS_CONNECTED,   /* TLS handshake with the broker done */
+    BOOT_PHASE_MQTT_CONNECTED,  /* CONNACK received */
+    BOOT_PHASE_FIRST_PUBLISH,   /* first PUBLISH handed to the agent loop */
+    BOOT_PHASE_COUNT
+} BootPhase_t;
+
+/*
+ * @brief Record the current time for xPhase if it has not been reached before.
+ * Each phase is marked from a single task. Not for use from interrupts.
+ */
+void vBootPhaseMark( BootPhase_t xPhase );
+
+/*
+ * @brief Return the time xPhase was reached in microseconds, 0 if it has not been reached.
+ */
+uint64_t ullBootPhaseGetUs( BootPhase_t xPhase );
+
+/*
+ * @brief Return the name of xPhase as shown by the "boot" command.
+ */
+const char * pcBootPhaseName( BootPhase_t xPhase );
+
+#endif /* _BOOT_PROF_H */
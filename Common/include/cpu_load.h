@@ -0,0 +1,76 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _CPU_LOAD_H
+#define _CPU_LOAD_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Per task CPU load over the last 1 s, 10 s and 60 s, from the FreeRTOS run time counters.
+ *
+ * A timer samples the counters every second. The loads are in permille of the window, and the
+ * 60 s window ends at the latest sample but may start up to 9 s early.
+ */
+
+#define CPU_LOAD_WINDOWS    3
+
+/* Tasks tracked at once, a sample is skipped while more tasks exist */
+#ifndef CPU_LOAD_MAX_TASKS
+    #define CPU_LOAD_MAX_TASKS    32
+#endif
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    char pcName[ configMAX_TASK_NAME_LEN ];
+    uint16_t usPermille[ CPU_LOAD_WINDOWS ];
+} CpuLoadTask_t;
+
+/*
+ * @brief Start sampling the run time counters.
+ */
+void vCpuLoadInit( void );
+
+/*
+ * @brief Copy the loads of up to uxMaxTasks tasks to pxTasks, and the load of every task but the
+ * idle task to pusBusyPermille if it is not NULL. Returns the number of tasks copied.
+ */
+UBaseType_t uxCpuLoadGet( CpuLoadTask_t * pxTasks,
+                          UBaseType_t uxMaxTasks,
+                          uint16_t pusBusyPermille[ CPU_LOAD_WINDOWS ] );
+
+/*
+ * @brief Loads of xTask. Returns pdFALSE if the task has not been sampled yet.
+ */
+BaseType_t xCpuLoadGetTask( TaskHandle_t xTask,
+                            uint16_t pusPermille[ CPU_LOAD_WINDOWS ] );
+
+#endif /* _CPU_LOAD_H */
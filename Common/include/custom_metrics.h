@@ -0,0 +1,64 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _CUSTOM_METRICS_H
+#define _CUSTOM_METRICS_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Registry of numeric Device Defender custom metrics, read by the defender task each time it
+ * builds a report and encoded into the "cmet" section.
+ *
+ * Names must be static strings, and the metrics must be created with the same names and the
+ * number type in the AWS IoT account for the service to keep them.
+ */
+
+#ifndef CUSTOM_METRICS_MAX
+    #define CUSTOM_METRICS_MAX    16
+#endif
+
+/* Returns the current value of a gauge, called from the defender task */
+typedef uint64_t ( * CustomMetricRead_t )( void * pvCtx );
+
+/*
+ * @brief Register a gauge read by xRead. Registering a name again replaces its reader.
+ * Returns pdFALSE if CUSTOM_METRICS_MAX metrics are already registered.
+ */
+BaseType_t xCustomMetricRegister( const char * pcName,
+                                  CustomMetricRead_t xRead,
+                                  void * pvCtx );
+
+/*
+ * @brief Register a counter kept by its subsystem in *pulCounter.
+ */
+BaseType_t xCustomMetricRegisterCounter( const char * pcName,
+                                         const volatile uint32_t * pulCounter );
+
+#endif /* _CUSTOM_METRICS_H */
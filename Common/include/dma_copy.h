@@ -0,0 +1,163 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _DMA_COPY_H
+#define _DMA_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "stm32u5xx_hal.h"
+
+/*
+ * Memory to memory copies on GPDMA1 channels 14 and 15.
+ *
+ * xDmaCopyStart hands a copy of at least DMA_COPY_THRESHOLD bytes to a free channel and returns,
+ * the completion interrupt then notifies the task which started it. Each started copy must be
+ * ended with xDmaCopyWait, which also gives the channel back. Blocks longer than one GPDMA block
+ * are restarted from the completion interrupt.
+ *
+ * pvDmaCopy is a memcpy replacement for task code: it sleeps until the copy is done, so other tasks
+ * run while the bytes move, and falls back to memcpy for short copies or when both channels are busy.
+ *
+ * The source and destination must have the same alignment modulo 4 for a DMA copy, the transfer
+ * width follows that alignment and the last bytes which do not fill a whole transfer are copied
+ * by the CPU.
+ *
+ * The same two channels feed the CRYP when the GCM accelerator uses DMA (gcm_alt.c). It borrows
+ * both with xDmaCopyLend for each request and gives them back with vDmaCopyReturn, copies started
+ * in between find no free channel. This file owns the channel interrupt handlers and passes the
+ * interrupts to the handles of the borrower while the channels are lent.
+ */
+
+#ifndef DMA_COPY_ENABLED
+    #define DMA_COPY_ENABLED    1
+#endif
+
+/* Below this many bytes memcpy is done before a transfer could be set up and its interrupt taken */
+#ifndef DMA_COPY_THRESHOLD
+    #define DMA_COPY_THRESHOLD    ( 1024U )
+#endif
+
+/* Task notification index used to wait for the end of a copy */
+#ifndef DMA_COPY_NOTIFY_IDX
+    #define DMA_COPY_NOTIFY_IDX    6
+#endif
+
+typedef struct
+{
+    uint32_t ulChannel; /* Index of the channel running the copy */
+} DmaCopy_t;
+
+typedef struct
+{
+    uint32_t ulCopies;    /* Copies run by DMA */
+    uint32_t ulBytes;     /* Bytes moved by DMA */
+    uint32_t ulCpuCopies; /* pvDmaCopy calls above the threshold which fell back to memcpy */
+    uint32_t ulBusy;      /* xDmaCopyStart calls which found both channels in use */
+    uint32_t ulErrors;
+} DmaCopyStats_t;
+
+#if ( DMA_COPY_ENABLED == 1 )
+
+/*
+ * @brief Configure the copy channels and their interrupts. Called once from hw_init, after
+ * the GPDMA1 clock is enabled.
+ */
+    BaseType_t xDmaCopyInit( void );
+
+/*
+ * @brief Start copying xLen bytes from pvSrc to pvDst. Returns pdTRUE if a channel took the copy,
+ * the buffers must then stay valid until xDmaCopyWait. Returns pdFALSE if the copy is shorter
+ * than DMA_COPY_THRESHOLD, the buffers are not equally aligned, or no channel is free. Nothing was
+ * copied in that case. Not callable from an interrupt.
+ */
+    BaseType_t xDmaCopyStart( void * pvDst,
+                              const void * pvSrc,
+                              size_t xLen,
+                              DmaCopy_t * pxCopy );
+
+/*
+ * @brief Wait for a copy started by the calling task. Returns pdTRUE once every byte was copied,
+ * pdFALSE on a transfer error, or after xTimeout, in which case the copy is aborted. The
+ * channel is free again in all cases.
+ */
+    BaseType_t xDmaCopyWait( DmaCopy_t * pxCopy,
+                             TickType_t xTimeout );
+
+/*
+ * @brief memcpy for large buffers, by DMA when xDmaCopyStart accepts the copy. Returns pvDst.
+ */
+    void * pvDmaCopy( void * pvDst,
+                      const void * pvSrc,
+                      size_t xLen );
+
+/*
+ * DCACHE1 only caches the external memories, buffers in internal SRAM need none of this.
+ * Before a DMA transfer both buffers are cleaned, so that no dirty line is evicted on top of the
+ * data the DMA writes. After the transfer the lines of the destination are invalidated.
+ */
+
+/*
+ * @brief Write back the DCACHE1 lines covering a buffer.
+ */
+    void vDmaCacheClean( const void * pvBuffer,
+                         size_t xLen );
+
+/*
+ * @brief Discard the DCACHE1 lines covering a buffer written by a DMA master.
+ */
+    void vDmaCacheInvalidate( void * pvBuffer,
+                              size_t xLen );
+
+    void vDmaCopyGetStats( DmaCopyStats_t * pxStats );
+
+/*
+ * @brief Lend both channels to a peripheral driver, pxHandle0 runs on channel 14 and pxHandle1 on
+ * channel 15. Returns pdFALSE without waiting if a copy or another borrower holds either channel.
+ * The borrower configures the channels itself, their interrupts are passed to its handles until
+ * vDmaCopyReturn. Not callable from an interrupt.
+ */
+    BaseType_t xDmaCopyLend( DMA_HandleTypeDef * pxHandle0,
+                             DMA_HandleTypeDef * pxHandle1 );
+
+/*
+ * @brief Give back the channels of xDmaCopyLend once the transfers of the borrower ended or were
+ * aborted. The channels are set up for copies again.
+ */
+    void vDmaCopyReturn( void );
+
+#else /* DMA_COPY_ENABLED == 1 */
+
+    #include <string.h>
+
+    #define pvDmaCopy( pvDst, pvSrc, xLen )    memcpy( ( pvDst ), ( pvSrc ), ( xLen ) )
+
+#endif /* DMA_COPY_ENABLED == 1 */
+
+#endif /* _DMA_COPY_H */
@@ -0,0 +1,128 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _DVFS_H
+#define _DVFS_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Dynamic voltage and frequency scaling.
+ *
+ * The board runs at HW_CLOCK_LEVEL_LOW, 48 MHz from the MSI in voltage range 3, while it only
+ * keeps its connection alive and samples the sensors. Subsystems which need the CPU for a while,
+ * TLS handshakes, OTA downloads and bulk transfers, hold a performance request with
+ * vDvfsRequest / vDvfsRelease. The first request switches to HW_CLOCK_LEVEL_HIGH, 160 MHz from the
+ * PLL in range 1, before vDvfsRequest returns.
+ *
+ * Every DVFS_SAMPLE_MS the governor also looks at the CPU load of the last second. A load above
+ * DVFS_UP_PERMILLE at the low level holds a request of its own until the load stayed below
+ * DVFS_DOWN_PERMILLE for DVFS_DOWN_SAMPLES samples. The clock goes back down once no request was
+ * held for DVFS_HOLD_MS.
+ *
+ * TIM5 and the SysTick are rescaled on each switch, so the microsecond time and the tick rate do
+ * not change. The console UART runs from the HSI16 and keeps its baud rate. SPI2, I2C2 and the
+ * OCTOSPI keep their prescalers, which are within limits at both levels, and run slower at the
+ * low level. Durations measured in DWT cycles across a switch are not accurate.
+ */
+
+#ifndef DVFS_ENABLED
+    #define DVFS_ENABLED    0
+#endif
+
+#if ( DVFS_ENABLED == 1 )
+
+    #ifndef DVFS_SAMPLE_MS
+        #define DVFS_SAMPLE_MS    1000
+    #endif
+
+/* Load at the low level, in permille of the CPU time, above which the governor raises the clock */
+    #ifndef DVFS_UP_PERMILLE
+        #define DVFS_UP_PERMILLE    700
+    #endif
+
+/* Load at the high level below which the governor drops its own request, 900 permille at 48 MHz */
+    #ifndef DVFS_DOWN_PERMILLE
+        #define DVFS_DOWN_PERMILLE    270
+    #endif
+
+    #ifndef DVFS_DOWN_SAMPLES
+        #define DVFS_DOWN_SAMPLES    5
+    #endif
+
+/* Time without any request before the clock goes down, so that back to back requests do not toggle it */
+    #ifndef DVFS_HOLD_MS
+        #define DVFS_HOLD_MS    3000
+    #endif
+
+    typedef enum
+    {
+        DVFS_CLIENT_LOAD = 0, /* The governor itself */
+        DVFS_CLIENT_TLS,      /* TLS handshakes */
+        DVFS_CLIENT_OTA,      /* OTA download and image verification */
+        DVFS_CLIENT_BULK,     /* Benchmarks and bulk transfers */
+        DVFS_CLIENT_MAX
+    } DvfsClient_t;
+
+    typedef struct
+    {
+        uint32_t ulLevel;                         /* Current HwClockLevel_t */
+        uint32_t ulSwitches;                      /* Level changes since vDvfsInit */
+        uint32_t ulErrors;                        /* Level changes which did not complete */
+        uint32_t ulHighMs;                        /* Time spent at the high level */
+        uint32_t ulLowMs;                         /* Time spent at the low level */
+        uint16_t pusRequests[ DVFS_CLIENT_MAX ]; /* Requests held by each client */
+    } DvfsStats_t;
+
+/*
+ * @brief Start the governor. Called once from a task, after vPeriodicWorkInit and vCpuLoadInit.
+ * The board boots at the high level, which is kept for DVFS_HOLD_MS after this call.
+ */
+    void vDvfsInit( void );
+
+/*
+ * @brief Hold the high level until the matching vDvfsRelease. Calls nest. Switches the clock
+ * before returning if needed, with interrupts disabled for the time the PLL takes to lock.
+ * Not callable from an interrupt.
+ */
+    void vDvfsRequest( DvfsClient_t xClient );
+
+    void vDvfsRelease( DvfsClient_t xClient );
+
+    void vDvfsGetStats( DvfsStats_t * pxStats );
+
+#else /* DVFS_ENABLED == 1 */
+
+    #define vDvfsRequest( xClient )
+    #define vDvfsRelease( xClient )
+
+#endif /* DVFS_ENABLED == 1 */
+
+#endif /* _DVFS_H */
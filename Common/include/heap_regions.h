@@ -0,0 +1,132 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _HEAP_REGIONS_H
+#define _HEAP_REGIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "sram_banks.h"
+
+/*
+ * FreeRTOS heap spread over several SRAM regions, replacing heap_4.
+ *
+ * The allocator is heap_5 with one free list per region, so that an allocation can be steered to
+ * a region with pvPortMallocPolicy:
+ *
+ * HEAP_REGION_DMA: HEAP_REGION_DMA_SIZE bytes in SRAM_BANK_DMA (SRAM1), next to the lwIP pools,
+ *     for buffers moved by the GPDMA.
+ * HEAP_REGION_CRYPTO: HEAP_REGION_CRYPTO_SIZE bytes in SRAM_BANK_CPU (SRAM3), for the mbedTLS
+ *     arena and record buffers, so that the churn of a handshake does not fragment the bulk heap.
+ * HEAP_REGION_MAIN: all of the RAM between the end of the image and the main stack, which used
+ *     to be left unused.
+ * HEAP_REGION_SRAM4: SRAM4, which the linker script does not use.
+ *
+ * pvPortMalloc, and so malloc, uses HEAP_POLICY_ANY: the best fit of the main and SRAM4 regions.
+ * The DMA and crypto policies try their own region first and fall back to HEAP_POLICY_ANY.
+ * The dedicated regions are never used by HEAP_POLICY_ANY, so bulk allocations cannot take the
+ * space reserved for them. vPortFree returns a block to whichever region it came from.
+ *
+ * Blocks have the heap_4 header, so malloc_usable_size in newlibc_stubs.c and the traceMALLOC
+ * and traceFREE hooks of heap_trace.h work as before. The ntz project links this file instead of
+ * heap_4.c. Builds without SRAM_BANKS_ENABLED (TF-M) keep heap_4, and pvPortMallocPolicy maps to
+ * pvPortMalloc.
+ */
+
+#ifndef HEAP_REGIONS_ENABLED
+    #define HEAP_REGIONS_ENABLED    SRAM_BANKS_ENABLED
+#endif
+
+typedef enum
+{
+    HEAP_POLICY_ANY = 0, /* Best fit among the general regions */
+    HEAP_POLICY_DMA,     /* HEAP_REGION_DMA first */
+    HEAP_POLICY_CRYPTO,  /* HEAP_REGION_CRYPTO first */
+    HEAP_POLICY_MAX
+} HeapPolicy_t;
+
+#if ( HEAP_REGIONS_ENABLED == 1 )
+
+    #ifndef HEAP_REGION_DMA_SIZE
+        #define HEAP_REGION_DMA_SIZE       ( 32U * 1024U )
+    #endif
+
+    #ifndef HEAP_REGION_CRYPTO_SIZE
+        #define HEAP_REGION_CRYPTO_SIZE    ( 64U * 1024U )
+    #endif
+
+    typedef enum
+    {
+        HEAP_REGION_DMA = 0,
+        HEAP_REGION_CRYPTO,
+        HEAP_REGION_MAIN,
+        HEAP_REGION_SRAM4,
+        HEAP_REGION_COUNT
+    } HeapRegionId_t;
+
+    typedef struct
+    {
+        const char * pcName;
+        uint32_t ulStart;           /* Address of the first byte of the region */
+        size_t xTotalBytes;         /* Usable bytes, 0 if the region could not be set up */
+        size_t xFreeBytes;
+        size_t xMinFreeBytes;       /* Lowest xFreeBytes since boot */
+        size_t xLargestFreeBlock;
+        size_t xFreeBlocks;
+        uint32_t ulAllocs;          /* Successful allocations */
+        uint32_t ulFrees;
+        uint32_t ulFallbacks;       /* Allocations of this region's policy served by the general regions */
+    } HeapRegionStats_t;
+
+/*
+ * @brief Allocate xWantedSize bytes according to xPolicy.
+ *
+ * Same semantics as pvPortMalloc, including the malloc failed hook. Free with vPortFree.
+ */
+    void * pvPortMallocPolicy( size_t xWantedSize,
+                               HeapPolicy_t xPolicy );
+
+/*
+ * @brief Fill pxStats with the HEAP_REGION_COUNT regions in HeapRegionId_t order.
+ */
+    void vHeapRegionGetStats( HeapRegionStats_t pxStats[ HEAP_REGION_COUNT ] );
+
+/*
+ * @brief Total usable bytes of all regions, the counterpart of configTOTAL_HEAP_SIZE.
+ */
+    size_t xHeapRegionTotalSize( void );
+
+#else /* HEAP_REGIONS_ENABLED == 1 */
+
+    #define pvPortMallocPolicy( xWantedSize, xPolicy )    ( ( void ) ( xPolicy ), pvPortMalloc( xWantedSize ) )
+    #define xHeapRegionTotalSize()                        ( ( size_t ) configTOTAL_HEAP_SIZE )
+
+#endif /* HEAP_REGIONS_ENABLED == 1 */
+
+#endif /* _HEAP_REGIONS_H */
@@ -0,0 +1,136 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _HEAP_TRACE_H
+#define _HEAP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Allocation profile of the FreeRTOS heap, fed by the traceMALLOC and traceFREE hooks of heap_4.
+ *
+ * Live blocks are kept in a table of HEAP_TRACE_MAX_BLOCKS entries so that a free is charged to
+ * the task which made the allocation. Blocks allocated while the table is 3/4 full are counted
+ * but not charged to a task. A timer samples the largest free block every
+ * HEAP_TRACE_SAMPLE_PERIOD_S seconds.
+ */
+
+#if ( HEAP_TRACE_ENABLED == 1 )
+
+/* Power of 2 */
+    #ifndef HEAP_TRACE_MAX_BLOCKS
+        #define HEAP_TRACE_MAX_BLOCKS    1024
+    #endif
+
+/* Tasks charged separately, allocations of further tasks go to the last owner */
+    #ifndef HEAP_TRACE_MAX_OWNERS
+        #define HEAP_TRACE_MAX_OWNERS    32
+    #endif
+
+    #ifndef HEAP_TRACE_SAMPLE_PERIOD_S
+        #define HEAP_TRACE_SAMPLE_PERIOD_S    10
+    #endif
+
+    #define HEAP_TRACE_NAME_LEN               16
+
+/* Block sizes up to 16 bytes, up to 32, ... up to 16 KiB, then larger */
+    #define HEAP_TRACE_SIZE_CLASSES           12
+    #define HEAP_TRACE_SIZE_CLASS_MIN_LOG2    4
+
+    #define HEAP_TRACE_FRAG_SAMPLES           30
+
+    typedef struct
+    {
+        char pcName[ HEAP_TRACE_NAME_LEN ];
+        uint32_t ulCurrentBytes;
+        uint32_t ulPeakBytes;
+        uint32_t ulAllocs;
+        uint32_t ulFrees;
+        uint32_t ulSnapshotBytes; /* ulCurrentBytes at the last vHeapTraceSnapshot */
+    } HeapTraceOwner_t;
+
+    typedef struct
+    {
+        uint32_t ulAllocs;
+        uint32_t ulFrees;
+        uint32_t ulFailed;
+        uint32_t ulUntracked;
+        uint32_t ulClassAllocs[ HEAP_TRACE_SIZE_CLASSES ];
+        uint32_t ulClassLive[ HEAP_TRACE_SIZE_CLASSES ]; /* Live blocks charged to a task */
+        size_t xLargestFree;
+        size_t xMinLargestFree;
+        size_t xFreeBlocks;
+        /* Largest free block of the HEAP_TRACE_FRAG_SAMPLES latest samples, oldest first */
+        uint32_t ulLargestFreeHistory[ HEAP_TRACE_FRAG_SAMPLES ];
+        uint32_t ulHistoryCount;
+    } HeapTraceStats_t;
+
+    typedef struct
+    {
+        void * pvAddress;
+        size_t xSize;
+        const char * pcOwner;
+    } HeapTraceBlock_t;
+
+/* Called from pvPortMalloc and vPortFree with the scheduler suspended */
+    void vHeapTraceMalloc( void * pvAddress,
+                           size_t xSize );
+    void vHeapTraceFree( void * pvAddress,
+                         size_t xSize );
+
+/*
+ * @brief Start sampling the largest free block.
+ */
+    void vHeapTraceInit( void );
+
+    void vHeapTraceGetStats( HeapTraceStats_t * pxStats );
+
+/*
+ * @brief Copy up to uxMaxOwners owners to pxOwners. Returns the number copied.
+ */
+    UBaseType_t uxHeapTraceGetOwners( HeapTraceOwner_t * pxOwners,
+                                      UBaseType_t uxMaxOwners );
+
+/*
+ * @brief Mark the live blocks, so that a later xHeapTraceGetNewBlocks only returns the blocks
+ * allocated since, and record the current bytes of every owner.
+ */
+    void vHeapTraceSnapshot( void );
+
+/*
+ * @brief Copy up to xMaxBlocks live blocks allocated since the last snapshot, or since boot.
+ * Returns the number of such blocks, which may be more than xMaxBlocks.
+ */
+    size_t xHeapTraceGetNewBlocks( HeapTraceBlock_t * pxBlocks,
+                                   size_t xMaxBlocks );
+
+#endif /* HEAP_TRACE_ENABLED == 1 */
+
+#endif /* _HEAP_TRACE_H */
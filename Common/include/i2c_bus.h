@@ -0,0 +1,93 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _I2C_BUS_H
+#define _I2C_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Arbitration of the I2C2 board sensor bus.
+ *
+ * The BSP sensor drivers use blocking transfers on I2C2. Tasks bracket those calls with
+ * xI2cBusLock and vI2cBusUnlock. The lock is a recursive mutex, so waiters are served by priority
+ * and a low priority holder inherits the priority of a waiter.
+ *
+ * xI2cBusTransfer runs a list of register reads and writes back to back: each transfer is started
+ * from the completion interrupt of the previous one, reads by DMA on GPDMA1 channel 3, and the
+ * calling task sleeps until the whole list is done.
+ */
+
+/* Task notification index used to wait for the end of a transfer list */
+#ifndef I2C_BUS_NOTIFY_IDX
+    #define I2C_BUS_NOTIFY_IDX    4
+#endif
+
+typedef struct
+{
+    uint16_t usDevAddr; /* 8 bit address, as used by the HAL */
+    uint16_t usReg;
+    uint8_t * pucData;
+    uint16_t usLen;
+    uint8_t ucRead;     /* 1 to read usLen bytes from usReg, 0 to write them */
+} I2cBusXfer_t;
+
+typedef struct
+{
+    uint32_t ulLists;
+    uint32_t ulTransfers;
+    uint32_t ulErrors;
+    uint32_t ulTimeouts;
+    uint32_t ulContended;   /* Locks which had to wait for another task */
+    uint32_t ulMaxWaitMs;   /* Longest wait for the lock */
+} I2cBusStats_t;
+
+/*
+ * @brief Set up the lock, the receive DMA and the I2C2 interrupts. Called once from hw_init,
+ * after BSP_I2C2_Init.
+ */
+BaseType_t xI2cBusInit( void );
+
+BaseType_t xI2cBusLock( TickType_t xTimeout );
+
+void vI2cBusUnlock( void );
+
+/*
+ * @brief Run xCount transfers in order, taking the lock for the whole list. Returns pdTRUE once
+ * all of them completed, pdFALSE on a bus error, or if the lock or the list took longer than
+ * xTimeout. The list stops at the first error.
+ */
+BaseType_t xI2cBusTransfer( const I2cBusXfer_t * pxXfers,
+                            size_t xCount,
+                            TickType_t xTimeout );
+
+void vI2cBusGetStats( I2cBusStats_t * pxStats );
+
+#endif /* _I2C_BUS_H */
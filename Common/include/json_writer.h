@@ -0,0 +1,121 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _JSON_WRITER_H
+#define _JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Streaming JSON writer.
+ *
+ * Members are written in one pass straight into the caller's buffer. Keys and strings are escaped
+ * and numbers are written without printf. xLen counts every byte of the document, including those
+ * which did not fit. A writer given no buffer therefore only counts, which gives the exact size of
+ * a document before it is written. The same code builds it in both modes.
+ *
+ * The key of a member is ignored at the top level and in arrays, where values have no key.
+ */
+
+/* Nested objects and arrays below the top level value */
+#ifndef JSON_WRITER_MAX_DEPTH
+    #define JSON_WRITER_MAX_DEPTH    4
+#endif
+
+typedef struct
+{
+    char * pcBuffer;                             /* NULL to only count */
+    size_t xBufferLen;
+    size_t xLen;                                 /* Length of the document so far, written or not */
+    uint32_t ulDepth;
+    BaseType_t xError;                           /* Nesting error */
+    uint8_t ucFirst[ JSON_WRITER_MAX_DEPTH + 1 ]; /* No value written yet at each level */
+    uint8_t ucArray[ JSON_WRITER_MAX_DEPTH + 1 ]; /* Level is an array, its values have no key */
+} JsonWriter_t;
+
+/*
+ * @brief Start a document in pcBuffer, or only count its length if pcBuffer is NULL.
+ */
+void vJsonWriterInit( JsonWriter_t * pxWriter,
+                      char * pcBuffer,
+                      size_t xBufferLen );
+
+void vJsonWriterObjectOpen( JsonWriter_t * pxWriter,
+                            const char * pcKey );
+
+void vJsonWriterObjectClose( JsonWriter_t * pxWriter );
+
+void vJsonWriterArrayOpen( JsonWriter_t * pxWriter,
+                           const char * pcKey );
+
+void vJsonWriterArrayClose( JsonWriter_t * pxWriter );
+
+void vJsonWriterUint( JsonWriter_t * pxWriter,
+                      const char * pcKey,
+                      uint32_t ulValue );
+
+void vJsonWriterInt( JsonWriter_t * pxWriter,
+                     const char * pcKey,
+                     int32_t lValue );
+
+void vJsonWriterBool( JsonWriter_t * pxWriter,
+                      const char * pcKey,
+                      BaseType_t xValue );
+
+/*
+ * @brief Write the NUL terminated pcValue as a string, escaped.
+ */
+void vJsonWriterString( JsonWriter_t * pxWriter,
+                        const char * pcKey,
+                        const char * pcValue );
+
+/*
+ * @brief Write ulValue as a string of decimal digits, zero padded to at least ulMinDigits, as
+ * the client tokens of the shadow service.
+ */
+void vJsonWriterDecimalString( JsonWriter_t * pxWriter,
+                               const char * pcKey,
+                               uint32_t ulValue,
+                               uint32_t ulMinDigits );
+
+/*
+ * @brief Length of the document written so far, including the bytes which did not fit.
+ */
+size_t xJsonWriterLen( const JsonWriter_t * pxWriter );
+
+/*
+ * @brief End the document. With a buffer, it is NUL terminated and its length returned, or 0 if
+ * it did not fit with its terminator or was not closed. When only counting, return the length of
+ * the document, without the terminator, or 0 if it was not closed.
+ */
+size_t xJsonWriterEnd( JsonWriter_t * pxWriter );
+
+#endif /* _JSON_WRITER_H */
@@ -0,0 +1,98 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _LOWPOWER_H
+#define _LOWPOWER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Tickless idle in STOP2.
+ *
+ * When every task is blocked for at least configEXPECTED_IDLE_TIME_BEFORE_SLEEP ticks, the idle
+ * task stops the SysTick and enters STOP2 until the next timeout. LPTIM1, clocked by the LSE,
+ * wakes it at that timeout and measures the time spent stopped, which is added to the tick count
+ * and to the TIM5 microsecond time. The PLL is restarted on wakeup.
+ *
+ * Other wake sources are the EXTI lines which have an interrupt enabled, among them the EMW3080
+ * notify line, and the console RX pin. USART1 does not run in STOP2, so the first character typed
+ * on the console only wakes the board and is lost. The console then keeps the board out of STOP2
+ * for LOW_POWER_CONSOLE_AWAKE_MS after each character received.
+ *
+ * Drivers which wait for a DMA transfer or a peripheral interrupt hold an inhibit with
+ * vLowPowerInhibit / vLowPowerRelease, the idle task then only sleeps until the next tick.
+ */
+
+#ifndef LOW_POWER_ENABLED
+    #define LOW_POWER_ENABLED    0
+#endif
+
+#if ( LOW_POWER_ENABLED == 1 )
+
+/* Longest stop, below the 10 s watchdog timeout. The watchdog supervisor wakes up more often anyway. */
+    #ifndef LOW_POWER_MAX_STOP_MS
+        #define LOW_POWER_MAX_STOP_MS    8000
+    #endif
+
+    #ifndef LOW_POWER_CONSOLE_AWAKE_MS
+        #define LOW_POWER_CONSOLE_AWAKE_MS    30000
+    #endif
+
+/* Period of the heartbeat LED flash */
+    #ifndef LOW_POWER_HEARTBEAT_MS
+        #define LOW_POWER_HEARTBEAT_MS    5000
+    #endif
+
+/*
+ * @brief Start the LSE and LPTIM1, STOP2 is not used before. Called once from a task.
+ */
+    void vLowPowerInit( void );
+
+/*
+ * @brief Keep the board out of STOP2 until the matching vLowPowerRelease. Calls nest.
+ */
+    void vLowPowerInhibit( void );
+
+    void vLowPowerRelease( void );
+
+/*
+ * @brief Console input was received, safe to call from an interrupt.
+ */
+    void vLowPowerConsoleActivity( void );
+
+#else /* LOW_POWER_ENABLED == 1 */
+
+    #define vLowPowerInhibit()
+    #define vLowPowerRelease()
+    #define vLowPowerConsoleActivity()
+
+#endif /* LOW_POWER_ENABLED == 1 */
+
+#endif /* _LOWPOWER_H */
@@ -45,4 +45,29 @@ typedef struct mbedtls_threading_mutex
     int mbedtls_platform_threading_init( void );
 #endif
 
+#if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+
+/* Number of size classes of the mbed TLS arena: 16, 32, 64, 128, 256 and 512 bytes */
+    #define MBEDTLS_ARENA_CLASSES    6
+
+/**
+ * @brief Usage of the mbed TLS allocation arena.
+ */
+    typedef struct MbedtlsArenaStats
+    {
+        size_t uxClassSize[ MBEDTLS_ARENA_CLASSES ]; /**< Block size of each class. */
+        size_t uxBlocks[ MBEDTLS_ARENA_CLASSES ];    /**< Blocks in each class. */
+        size_t uxInUse[ MBEDTLS_ARENA_CLASSES ];     /**< Blocks currently allocated. */
+        size_t uxPeak[ MBEDTLS_ARENA_CLASSES ];      /**< Most blocks allocated since the last peak reset. */
+        uint32_t ulFallbacks;                        /**< Requests sent to the heap because their class was empty. */
+    } MbedtlsArenaStats_t;
+
+    void mbedtls_platform_arena_get_stats( MbedtlsArenaStats_t * pxStats );
+
+/**
+ * @brief Restart the peak and fallback counters, e.g. at the start of a handshake.
+ */
+    void mbedtls_platform_arena_reset_peak( void );
+#endif /* MBEDTLS_FREERTOS_SLAB_ARENA */
+
 #endif /* ifndef MBEDTLS_FREERTOS_PORT_H_ */
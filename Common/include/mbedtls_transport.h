@@ -97,6 +97,56 @@ typedef enum TlsTransportStatus
 
 typedef void ( * GenericCallback_t )( void * );
 
+typedef struct
+{
+    uint32_t ulSendStalls;         /* Number of times a send waited for the socket to become writable */
+    uint32_t ulSendStallTimeouts;  /* Waits which hit MBEDTLS_TRANSPORT_SEND_STALL_TIMEOUT_MS */
+    uint32_t ulSendStallMaxMs;     /* Longest single wait */
+    uint64_t ullSendStallTotalMs;  /* Total time spent waiting */
+    uint32_t ulHandshakes;         /* Successful TLS handshakes */
+    uint32_t ulResumedHandshakes;  /* Handshakes which resumed a cached session */
+    uint32_t ulTls13Handshakes;    /* Handshakes which negotiated TLS 1.3 */
+    uint32_t ulAddrCacheHits;      /* Connections made to the cached address without a DNS lookup */
+    uint32_t ulAddrCacheFallbacks; /* Cached addresses which failed to connect and were resolved again */
+    uint32_t ulVerifyCacheHits;    /* Server chains accepted from the verify cache */
+    uint32_t ulVerifyCacheMisses;  /* Server chains verified in full */
+} TlsTransportStats_t;
+
+/* Phases of connection setup timed by the transport */
+typedef enum
+{
+    TLS_PHASE_DNS = 0,     /* Host name resolution */
+    TLS_PHASE_TCP_CONNECT, /* TCP connection establishment */
+    TLS_PHASE_CA_CHAIN,    /* Root CA load, parse and profile check (mbedtls_transport_configure) */
+    TLS_PHASE_CLIENT_CERT, /* Client certificate and key setup (mbedtls_transport_configure) */
+    TLS_PHASE_HELLO,       /* ClientHello / ServerHello exchange */
+    TLS_PHASE_SERVER_CERT, /* Server certificate parsing and chain verification */
+    TLS_PHASE_SERVER_KEX,  /* ServerKeyExchange: ECDHE parameter signature check */
+    TLS_PHASE_CLIENT_KEX,  /* ClientKeyExchange: ECDHE key generation and shared secret */
+    TLS_PHASE_CLIENT_SIGN, /* CertificateVerify: client key signature through PKCS#11 or PSA */
+    TLS_PHASE_FINISH,      /* ChangeCipherSpec, Finished and any remaining messages */
+    TLS_PHASE_MAX
+} TlsHandshakePhase_t;
+
+/* Socket options applied by mbedtls_transport_connect, see mbedtls_transport_set_socket_profile */
+typedef enum
+{
+    TLS_SOCKET_PROFILE_DEFAULT = 0, /* lwIP defaults, no TCP keepalive */
+    TLS_SOCKET_PROFILE_INTERACTIVE, /* TCP_NODELAY, small receive buffer, short keepalive */
+    TLS_SOCKET_PROFILE_BULK,        /* Nagle, large receive buffer, long keepalive */
+    TLS_SOCKET_PROFILE_MAX
+} TlsSocketProfile_t;
+
+#define TLS_TIMING_HOST_LEN    32
+
+typedef struct
+{
+    char pcHostName[ TLS_TIMING_HOST_LEN ];
+    int32_t lStatus;                     /* TlsTransportStatus_t of the attempt */
+    uint32_t ulTotalUs;                  /* Duration of mbedtls_transport_connect */
+    uint32_t pulPhaseUs[ TLS_PHASE_MAX ];
+} TlsHandshakeTiming_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -125,6 +175,76 @@ int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
                                            GenericCallback_t pxCallback,
                                            void * pvCtx );
 
+/**
+ * @brief Select the maximum fragment length (RFC 6066) requested by a connection.
+ *
+ * @param[in] uxMaxFragLen One of 512, 1024, 2048 or 4096, or 0 to not request a limit.
+ * Takes effect at the next mbedtls_transport_connect.
+ *
+ * @return 0 on success, -1 on an invalid length or when MBEDTLS_SSL_MAX_FRAGMENT_LENGTH is disabled.
+ */
+int32_t mbedtls_transport_set_max_frag_len( NetworkContext_t * pxNetworkContext,
+                                            size_t uxMaxFragLen );
+
+/**
+ * @brief Offer ChaCha20-Poly1305 ciphersuites ahead of AES-GCM.
+ *
+ * ChaCha20-Poly1305 runs in software and does not touch the AES peripheral, so
+ * a connection using it does not contend with other TLS connections for the
+ * CRYP. The server makes the final choice of ciphersuite.
+ * Takes effect at the next mbedtls_transport_connect.
+ *
+ * @param[in] xPrefer pdTRUE to offer ChaCha20-Poly1305 first, pdFALSE for the mbedtls default list.
+ *
+ * @return 0 on success, -1 when MBEDTLS_CHACHAPOLY_C is disabled.
+ */
+int32_t mbedtls_transport_prefer_chachapoly( NetworkContext_t * pxNetworkContext,
+                                             BaseType_t xPrefer );
+
+/**
+ * @brief Select the socket option profile of a connection.
+ *
+ * The options of TLS_SOCKET_PROFILE_INTERACTIVE suit small messages which should
+ * leave at once, such as MQTT, those of TLS_SOCKET_PROFILE_BULK large transfers
+ * such as OTA downloads. The TCP window and send buffer are sized for all
+ * connections by LWIP_NET_PROFILE in lwipopts.h.
+ * Takes effect at the next mbedtls_transport_connect.
+ *
+ * @return 0 on success, -1 on an invalid profile.
+ */
+int32_t mbedtls_transport_set_socket_profile( NetworkContext_t * pxNetworkContext,
+                                              TlsSocketProfile_t xProfile );
+
+/**
+ * @brief Hold back writes so that consecutive small messages share one TLS record.
+ *
+ * While corked, mbedtls_transport_send appends data to a staging buffer of
+ * MBEDTLS_TRANSPORT_CORK_BUFFER_LEN bytes. The buffer is written with a single
+ * mbedtls_ssl_write when it fills or when the connection is uncorked.
+ * Pending data is discarded by mbedtls_transport_disconnect.
+ * After a failed flush, mbedtls_transport_send and mbedtls_transport_recv
+ * return the error until mbedtls_transport_disconnect.
+ *
+ * @param[in] xCork pdTRUE to start coalescing, pdFALSE to flush and stop.
+ *
+ * @return 0 on success, a negative value if flushing the pending data failed.
+ */
+int32_t mbedtls_transport_cork( NetworkContext_t * pxNetworkContext,
+                                BaseType_t xCork );
+
+/**
+ * @brief Copy a snapshot of the send stall statistics shared by all TLS connections.
+ */
+void mbedtls_transport_get_stats( TlsTransportStats_t * pxStats );
+
+/**
+ * @brief Copy the phase timing of the most recent connection attempts, newest first.
+ *
+ * @return Number of entries written to pxTimings.
+ */
+size_t mbedtls_transport_get_handshake_timing( TlsHandshakeTiming_t * pxTimings,
+                                               size_t uxMaxTimings );
+
 
 /**
  * @brief Create a TLS connection
@@ -196,6 +316,16 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
                                 const void * pBuffer,
                                 size_t uxBytesToSend );
 
+/**
+ * @brief Parse a DER certificate in place and append it to pxCertificateContext.
+ *
+ * On success the certificate references pucDer instead of a copy and releases it in
+ * mbedtls_x509_crt_free, so pucDer must come from mbedtls_calloc. On failure pucDer
+ * still belongs to the caller.
+ */
+int32_t lPkiParseCertificateDerOwned( mbedtls_x509_crt * pxCertificateContext,
+                                      unsigned char * pucDer,
+                                      size_t uxDerLen );
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
     extern mbedtls_pk_info_t mbedtls_pkcs11_pk_ecdsa;
@@ -228,6 +358,24 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
 
     int lPKCS11PkMbedtlsCloseSessionAndFree( mbedtls_pk_context * pxMbedtlsPkCtx );
 
+/* Take a session from the pool of open sessions, or open a new one if the pool is in use */
+    CK_RV xPkcs11SessionAcquire( CK_SESSION_HANDLE_PTR pxSession );
+
+/* Return a session to the pool, or close it if it was opened outside the pool */
+    CK_RV xPkcs11SessionRelease( CK_SESSION_HANDLE xSession );
+
+/* xFindObjectWithLabelAndClass, answered from the object handle cache when possible */
+    CK_RV xPkcs11FindObjectCached( CK_SESSION_HANDLE xSession,
+                                   const char * pcLabel,
+                                   size_t uxLabelLen,
+                                   CK_OBJECT_CLASS xClass,
+                                   CK_OBJECT_HANDLE_PTR pxHandle );
+
+/* Drop the cached handle of an object that is about to be rewritten or destroyed */
+    void vPkcs11InvalidateObject( const char * pcLabel,
+                                  size_t uxLabelLen,
+                                  CK_OBJECT_CLASS xClass );
+
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
 
 #ifdef MBEDTLS_TRANSPORT_PSA
@@ -284,6 +432,8 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
     int32_t lPsa_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
                                        psa_key_id_t xKeyId );
 
+    void vPsa_invalidatePkCache( psa_key_id_t xKeyId );
+
 #endif /* MBEDTLS_TRANSPORT_PSA */
 
 #endif /* _MBEDTLS_TRANSPORT_H */
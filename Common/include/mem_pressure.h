@@ -0,0 +1,133 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _MEM_PRESSURE_H
+#define _MEM_PRESSURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Low memory notification for the FreeRTOS heap.
+ *
+ * Subsystems which keep memory they can give back (parsed certificate chains, read caches,
+ * batches not yet sent) register a shrink handler. When the free heap drops below
+ * MEM_PRESSURE_LOW_WATERMARK, the monitor calls the handlers in priority order until the free
+ * heap is back above the high watermark. An allocation which fails on heap_regions.c first runs
+ * every handler at MEM_PRESSURE_CRITICAL and retries once before the malloc failed hook.
+ *
+ * Handlers run from the timer task or from the task whose allocation failed, possibly with
+ * locks of their own subsystem held by that task. They must not block: locks are taken with a
+ * zero timeout and the handler gives up if one is busy.
+ */
+
+#ifndef MEM_PRESSURE_ENABLED
+    #define MEM_PRESSURE_ENABLED    1
+#endif
+
+/* Free heap below which the handlers are called */
+#ifndef MEM_PRESSURE_LOW_WATERMARK
+    #define MEM_PRESSURE_LOW_WATERMARK    ( 24U * 1024U )
+#endif
+
+/* Free heap below which the handlers are called at MEM_PRESSURE_CRITICAL */
+#ifndef MEM_PRESSURE_CRITICAL_WATERMARK
+    #define MEM_PRESSURE_CRITICAL_WATERMARK    ( 8U * 1024U )
+#endif
+
+/* Free heap the monitor tries to get back to, above the low watermark so that it does not run every period */
+#ifndef MEM_PRESSURE_HIGH_WATERMARK
+    #define MEM_PRESSURE_HIGH_WATERMARK    ( 32U * 1024U )
+#endif
+
+#ifndef MEM_PRESSURE_CHECK_MS
+    #define MEM_PRESSURE_CHECK_MS    ( 1000U )
+#endif
+
+/* Conventional priorities, lower values are shrunk first */
+#define MEM_PRESSURE_PRIO_CACHE    ( 10U ) /* Rebuilt on demand at some CPU cost */
+#define MEM_PRESSURE_PRIO_BATCH    ( 20U ) /* Sent early or in smaller pieces */
+#define MEM_PRESSURE_PRIO_BUFFER   ( 30U ) /* Shrinking costs throughput */
+
+typedef enum
+{
+    MEM_PRESSURE_LOW = 0, /* Give back what is cheap to rebuild */
+    MEM_PRESSURE_CRITICAL /* An allocation failed, give back everything that is not in use */
+} MemPressureLevel_t;
+
+/* Returns an estimate of the number of bytes given back to the heap */
+typedef size_t ( * MemPressureCallback_t )( MemPressureLevel_t xLevel,
+                                            void * pvCtx );
+
+typedef struct MemPressureHandler
+{
+    const char * pcName;
+    MemPressureCallback_t pxCallback;
+    void * pvCtx;
+    uint32_t ulPriority;
+    uint32_t ulCalls;
+    size_t xReleasedBytes;
+    struct MemPressureHandler * pxNext;
+} MemPressureHandler_t;
+
+#if ( MEM_PRESSURE_ENABLED == 1 )
+
+/*
+ * @brief Start the periodic check of the free heap. Called once after vPeriodicWorkInit.
+ */
+    void vMemPressureInit( void );
+
+/*
+ * @brief Add a shrink handler. pxHandler must stay valid from then on, handlers of equal
+ * priority are called in registration order. Registering a handler again has no effect.
+ */
+    void vMemPressureRegister( MemPressureHandler_t * pxHandler,
+                               const char * pcName,
+                               MemPressureCallback_t pxCallback,
+                               void * pvCtx,
+                               uint32_t ulPriority );
+
+/*
+ * @brief Call the handlers in priority order until xWantedBytes have been given back, or all of
+ * them at MEM_PRESSURE_CRITICAL. Returns the bytes given back, 0 if another task is already
+ * shrinking the heap.
+ */
+    size_t xMemPressureReclaim( MemPressureLevel_t xLevel,
+                                size_t xWantedBytes );
+
+#else /* MEM_PRESSURE_ENABLED == 1 */
+
+    #define vMemPressureInit()
+    #define vMemPressureRegister( pxHandler, pcName, pxCallback, pvCtx, ulPriority )    ( ( void ) ( pxHandler ) )
+    #define xMemPressureReclaim( xLevel, xWantedBytes )                               ( ( size_t ) 0 )
+
+#endif /* MEM_PRESSURE_ENABLED == 1 */
+
+#endif /* _MEM_PRESSURE_H */
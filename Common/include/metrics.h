@@ -0,0 +1,143 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Registry of on-device counters, gauges and log2 histograms.
+ *
+ * Each subsystem allocates its metrics statically with METRIC_COUNTER, METRIC_GAUGE or
+ * METRIC_HISTOGRAM and adds them once with vMetricRegister. Updates are single atomic operations
+ * on the metric and never take a lock, so they can be made from any task or interrupt.
+ * vMetricsSnapshot hands a copy of every metric to the CLI, the Device Defender report and the
+ * metrics publisher.
+ *
+ * Bucket 0 of a histogram counts the value 0 and bucket i the values from 2^(i-1) to 2^i - 1.
+ * The last bucket also counts every larger value.
+ */
+
+#ifndef METRICS_HISTOGRAM_BUCKETS
+    #define METRICS_HISTOGRAM_BUCKETS    16
+#endif
+
+typedef enum
+{
+    MetricTypeCounter = 0,
+    MetricTypeGauge = 1,
+    MetricTypeHistogram = 2
+} MetricType_t;
+
+typedef struct Metric
+{
+    const char * pcName;
+    MetricType_t xType;
+    uint32_t ulValue;      /* Count of the values observed for a histogram */
+    uint32_t * pulBuckets; /* METRICS_HISTOGRAM_BUCKETS buckets for a histogram, NULL otherwise */
+    struct Metric * pxNext;
+} Metric_t;
+
+typedef struct
+{
+    const char * pcName;
+    MetricType_t xType;
+    uint32_t ulValue;
+    size_t uxBuckets; /* Up to the last non-empty bucket */
+    uint32_t pulBuckets[ METRICS_HISTOGRAM_BUCKETS ];
+} MetricSnapshot_t;
+
+/* Called for each metric in registration order, returns pdFALSE to stop */
+typedef BaseType_t ( * MetricsVisitor_t )( const MetricSnapshot_t * pxMetric,
+                                           void * pvCtx );
+
+#define METRIC_COUNTER( xName, pcMetricName ) \
+    Metric_t xName = { .pcName = ( pcMetricName ), .xType = MetricTypeCounter }
+
+#define METRIC_GAUGE( xName, pcMetricName ) \
+    Metric_t xName = { .pcName = ( pcMetricName ), .xType = MetricTypeGauge }
+
+#define METRIC_HISTOGRAM( xName, pcMetricName )                   \
+    uint32_t xName ## Buckets[ METRICS_HISTOGRAM_BUCKETS ] = { 0 }; \
+    Metric_t xName = { .pcName = ( pcMetricName ), .xType = MetricTypeHistogram, .pulBuckets = xName ## Buckets }
+
+/*
+ * @brief Add pxMetric to the registry. Registering a metric again has no effect.
+ * The name must be a static string.
+ */
+void vMetricRegister( Metric_t * pxMetric );
+
+/*
+ * @brief Copy each registered metric and pass it to xVisitor. The values of a histogram are
+ * read one bucket at a time, so they may not add up to the count while it is being updated.
+ */
+void vMetricsSnapshot( MetricsVisitor_t xVisitor,
+                       void * pvCtx );
+
+/*-----------------------------------------------------------*/
+
+static inline void vMetricAdd( Metric_t * pxMetric,
+                               uint32_t ulDelta )
+{
+    ( void ) __atomic_fetch_add( &( pxMetric->ulValue ), ulDelta, __ATOMIC_RELAXED );
+}
+
+static inline void vMetricIncrement( Metric_t * pxMetric )
+{
+    vMetricAdd( pxMetric, 1 );
+}
+
+static inline void vMetricDecrement( Metric_t * pxMetric )
+{
+    ( void ) __atomic_fetch_sub( &( pxMetric->ulValue ), 1, __ATOMIC_RELAXED );
+}
+
+static inline void vMetricSet( Metric_t * pxMetric,
+                               uint32_t ulValue )
+{
+    __atomic_store_n( &( pxMetric->ulValue ), ulValue, __ATOMIC_RELAXED );
+}
+
+static inline void vMetricObserve( Metric_t * pxMetric,
+                                   uint32_t ulValue )
+{
+    uint32_t ulBucket = ( ulValue == 0 ) ? 0 : ( 32 - ( uint32_t ) __builtin_clz( ulValue ) );
+
+    if( ulBucket >= METRICS_HISTOGRAM_BUCKETS )
+    {
+        ulBucket = METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    ( void ) __atomic_fetch_add( &( pxMetric->pulBuckets[ ulBucket ] ), 1, __ATOMIC_RELAXED );
+    vMetricIncrement( pxMetric );
+}
+
+#endif /* _METRICS_H */
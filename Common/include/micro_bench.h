@@ -0,0 +1,136 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MICRO_BENCH_H
+#define _MICRO_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Registry of micro-benchmark kernels, timed with the DWT cycle counter.
+ *
+ * Each module allocates its kernels statically with MICRO_BENCH and adds them once with
+ * vMicroBenchRegister. xMicroBenchRun calls a kernel a number of times to warm up the caches and
+ * branch predictor, then times each further call on its own and reports the minimum, median and
+ * maximum cycle counts, less the cost of timing an empty kernel. The median is not affected by the
+ * occasional interrupt or preemption. Kernels flagged MICRO_BENCH_FLAG_NO_PREEMPT are timed with
+ * the scheduler suspended, so they must not block.
+ *
+ * The stack below the runner is painted before the timed calls and scanned after them: stack_bytes
+ * is the deepest stack use of the kernel, less that of timing an empty one. It may include an
+ * exception frame stacked by an interrupt, and is capped at MICRO_BENCH_STACK_PROBE. It is 0 when
+ * the calling task has too little stack left to paint that much.
+ *
+ * xMicroBenchFormatCsv writes one line per result in the format of MICRO_BENCH_CSV_HEADER, so
+ * results from the CLI and from the test applications can be compared with the same tools.
+ */
+
+#ifndef MICRO_BENCH_MAX_RUNS
+    #define MICRO_BENCH_MAX_RUNS    64U
+#endif
+
+#ifndef MICRO_BENCH_STACK_PROBE
+    #define MICRO_BENCH_STACK_PROBE    1024U
+#endif
+
+#define MICRO_BENCH_FLAG_NO_PREEMPT    ( 1U << 0 )
+
+#define MICRO_BENCH_CSV_HEADER         "UBENCH,name,bytes,runs,min_cycles,median_cycles,max_cycles,median_cycles_per_byte,stack_bytes\r\n"
+
+/* Returns 0 on success, a failing kernel stops the run */
+typedef int ( * MicroBenchKernel_t )( void * pvCtx );
+
+typedef struct MicroBench
+{
+    const char * pcName;
+    MicroBenchKernel_t pxKernel;
+    void * pvCtx;
+    uint32_t ulBytes; /* Bytes processed by each call, 0 if the cost per byte does not apply */
+    uint32_t ulFlags;
+    struct MicroBench * pxNext;
+} MicroBench_t;
+
+typedef struct
+{
+    uint32_t ulRuns;
+    uint32_t ulMinCycles;
+    uint32_t ulMedianCycles;
+    uint32_t ulMaxCycles;
+    uint32_t ulStackBytes;
+    int lError; /* Return value of the kernel call which failed, 0 otherwise */
+} MicroBenchStats_t;
+
+/* Called for each kernel in registration order, returns pdFALSE to stop */
+typedef BaseType_t ( * MicroBenchVisitor_t )( MicroBench_t * pxBench,
+                                              void * pvCtx );
+
+#define MICRO_BENCH( xName, pcBenchName, pxBenchKernel, pvBenchCtx, ulBenchBytes, ulBenchFlags ) \
+    MicroBench_t xName =                                                                         \
+    {                                                                                            \
+        .pcName = ( pcBenchName ), .pxKernel = ( pxBenchKernel ), .pvCtx = ( pvBenchCtx ),       \
+        .ulBytes = ( ulBenchBytes ), .ulFlags = ( ulBenchFlags )                                 \
+    }
+
+/*
+ * @brief Add pxBench to the registry. Registering a kernel again has no effect.
+ * The name must be a static string.
+ */
+void vMicroBenchRegister( MicroBench_t * pxBench );
+
+/*
+ * @brief Pass each registered kernel to xVisitor.
+ */
+void vMicroBenchForEach( MicroBenchVisitor_t xVisitor,
+                         void * pvCtx );
+
+/*
+ * @brief Return the kernel registered as pcName, or NULL.
+ */
+MicroBench_t * pxMicroBenchFind( const char * pcName );
+
+/*
+ * @brief Call the kernel ulWarmup times, then time ulRuns calls (at most MICRO_BENCH_MAX_RUNS).
+ * Returns pdFALSE if a call failed, pxStats then covers the calls timed before it.
+ */
+BaseType_t xMicroBenchRun( const MicroBench_t * pxBench,
+                           uint32_t ulWarmup,
+                           uint32_t ulRuns,
+                           MicroBenchStats_t * pxStats );
+
+/*
+ * @brief Write the CSV line of a result to pcBuffer, NUL terminated.
+ * Returns the length written, as snprintf does.
+ */
+int lMicroBenchFormatCsv( const MicroBench_t * pxBench,
+                          const MicroBenchStats_t * pxStats,
+                          char * pcBuffer,
+                          size_t uxBufferLen );
+
+#endif /* _MICRO_BENCH_H */
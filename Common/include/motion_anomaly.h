@@ -0,0 +1,89 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MOTION_ANOMALY_H
+#define _MOTION_ANOMALY_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "motion_fifo.h"
+
+/*
+ * Anomaly score of the accelerometer and gyroscope FIFO windows.
+ *
+ * Every window is reduced to the mean and standard deviation of each of the six axes. The first
+ * MOTION_ANOMALY_TRAIN_WINDOWS windows set the mean and variance of every feature, the score of
+ * a later window is the largest distance of one of its features to that mean, in standard
+ * deviations. Windows scoring below MOTION_ANOMALY_THRESHOLD are folded into the baseline with
+ * weight MOTION_ANOMALY_ALPHA, so that it follows slow changes of orientation or vibration.
+ */
+
+/* Mean and standard deviation of the accelerometer then the gyroscope x, y and z axes */
+#define MOTION_ANOMALY_FEATURES    12
+
+/* Windows averaged into the baseline before any window is scored */
+#ifndef MOTION_ANOMALY_TRAIN_WINDOWS
+    #define MOTION_ANOMALY_TRAIN_WINDOWS    20
+#endif
+
+/* Score, in standard deviations, from which a window is anomalous */
+#ifndef MOTION_ANOMALY_THRESHOLD
+    #define MOTION_ANOMALY_THRESHOLD    ( 6.0f )
+#endif
+
+/* Weight of a normal window in the baseline after training */
+#ifndef MOTION_ANOMALY_ALPHA
+    #define MOTION_ANOMALY_ALPHA    ( 0.02f )
+#endif
+
+/* Smallest standard deviation of a feature, in mg or mdps, keeps a still sensor from making any
+ * noise an anomaly */
+#ifndef MOTION_ANOMALY_MIN_STDDEV
+    #define MOTION_ANOMALY_MIN_STDDEV    ( 20.0f )
+#endif
+
+typedef struct
+{
+    float fMean[ MOTION_ANOMALY_FEATURES ];
+    float fVar[ MOTION_ANOMALY_FEATURES ]; /* Sum of squared deviations while training */
+    uint32_t ulTrained;                    /* Windows in the baseline, up to MOTION_ANOMALY_TRAIN_WINDOWS */
+} MotionAnomaly_t;
+
+void vMotionAnomalyInit( MotionAnomaly_t * pxModel );
+
+/*
+ * @brief Score the window pair pxAccel and pxGyro, and update the baseline with it unless it is
+ * anomalous. Returns pdTRUE if the window is anomalous. *pfScore is set to the score, or to 0
+ * while the baseline is trained or if the windows hold no samples.
+ */
+BaseType_t xMotionAnomalyUpdate( MotionAnomaly_t * pxModel,
+                                 const MotionFifoWindow_t * pxAccel,
+                                 const MotionFifoWindow_t * pxGyro,
+                                 float * pfScore );
+
+#endif /* _MOTION_ANOMALY_H */
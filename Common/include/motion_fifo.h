@@ -0,0 +1,103 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MOTION_FIFO_H
+#define _MOTION_FIFO_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Accelerometer and gyroscope samples read from the ISM330DHCX FIFO.
+ *
+ * Both sensors are batched in the FIFO at MOTION_FIFO_ODR_HZ. The FIFO threshold is routed to
+ * INT1, and the task which called xMotionFifoStart reads the FIFO by DMA over I2C2 when the
+ * threshold is reached, or at the latest when vMotionFifoService times out. Samples are folded
+ * into the windows given to xMotionFifoService, converted to mg and mdps.
+ */
+
+/* 26, 52, 104, 208, 417, 833 or 1667 */
+#ifndef MOTION_FIFO_ODR_HZ
+    #define MOTION_FIFO_ODR_HZ    417
+#endif
+
+/* FIFO words (one sample of one sensor each) before INT1 is raised */
+#ifndef MOTION_FIFO_WATERMARK
+    #define MOTION_FIFO_WATERMARK    64
+#endif
+
+/* Task notification index for the FIFO threshold, the reads wait on I2C_BUS_NOTIFY_IDX */
+#ifndef MOTION_FIFO_NOTIFY_IDX
+    #define MOTION_FIFO_NOTIFY_IDX    2
+#endif
+
+/* FIFO words read per DMA transfer */
+#ifndef MOTION_FIFO_BURST_WORDS
+    #define MOTION_FIFO_BURST_WORDS    128
+#endif
+
+typedef struct
+{
+    int32_t lMin;
+    int32_t lMax;
+    int64_t llSum;
+    uint64_t ullSumSquares;
+} MotionFifoAxis_t;
+
+typedef struct
+{
+    uint32_t ulSamples;
+    MotionFifoAxis_t xAxis[ 3 ];
+} MotionFifoWindow_t;
+
+typedef struct
+{
+    uint32_t ulSamples;   /* FIFO words read */
+    uint32_t ulOverruns;  /* Times the FIFO was found full */
+    uint32_t ulBusErrors; /* I2C transfers which failed or were refused */
+} MotionFifoStats_t;
+
+/*
+ * @brief Set up the FIFO and INT1, once the sensors and the I2C bus manager were initialized
+ * through the BSP. Returns pdTRUE on success. Only the calling task may call vMotionFifoService.
+ */
+BaseType_t xMotionFifoStart( void );
+
+/*
+ * @brief Wait up to xTimeout for the FIFO threshold, then read the FIFO into pxAccel (mg) and
+ * pxGyro (mdps).
+ */
+void vMotionFifoService( TickType_t xTimeout,
+                         MotionFifoWindow_t * pxAccel,
+                         MotionFifoWindow_t * pxGyro );
+
+void vMotionFifoWindowReset( MotionFifoWindow_t * pxWindow );
+
+void vMotionFifoGetStats( MotionFifoStats_t * pxStats );
+
+#endif /* _MOTION_FIFO_H */
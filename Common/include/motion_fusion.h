@@ -0,0 +1,61 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MOTION_FUSION_H
+#define _MOTION_FUSION_H
+
+/*
+ * Orientation estimate from the accelerometer, gyroscope and magnetometer, after
+ * S. Madgwick's gradient descent filter. The gyroscope rate is integrated and corrected by one
+ * gradient step towards the orientation that matches gravity and the earth field.
+ */
+
+/* Gain of the correction step, larger converges faster and lets more noise through */
+#ifndef MOTION_FUSION_BETA
+    #define MOTION_FUSION_BETA    ( 0.1f )
+#endif
+
+typedef struct
+{
+    float fQ[ 4 ]; /* w, x, y, z of the sensor to earth rotation */
+    float fBeta;
+} MotionFusion_t;
+
+void vMotionFusionInit( MotionFusion_t * pxFusion,
+                        float fBeta );
+
+/*
+ * @brief Advance the estimate by fDt seconds. pfGyro is in rad/s, pfAccel and pfMag in any unit.
+ * pfMag may be NULL, or all zero, to use the accelerometer and gyroscope only.
+ */
+void vMotionFusionUpdate( MotionFusion_t * pxFusion,
+                          const float pfGyro[ 3 ],
+                          const float pfAccel[ 3 ],
+                          const float pfMag[ 3 ],
+                          float fDt );
+
+#endif /* _MOTION_FUSION_H */
@@ -0,0 +1,92 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MQTT_BENCH_H
+#define _MQTT_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * End to end MQTT benchmark: publishes messages to <thing name>/bench/loopback while
+ * subscribed to it, and times each message until the broker sends it back.
+ *
+ * Up to MQTT_BENCH_WINDOW messages are in flight at once. Each payload starts with its
+ * sequence number and send time, the rest is filler, so the payload length must be at least
+ * MQTT_BENCH_MIN_PAYLOAD.
+ */
+
+#ifndef MQTT_BENCH_WINDOW
+    #define MQTT_BENCH_WINDOW    4U
+#endif
+
+#ifndef MQTT_BENCH_MAX_MESSAGES
+    #define MQTT_BENCH_MAX_MESSAGES    2000U
+#endif
+
+#define MQTT_BENCH_MIN_PAYLOAD     12U
+
+/* Sizes of a sweep, the largest payload which fits in MQTT_AGENT_NETWORK_BUFFER_SIZE included */
+#define MQTT_BENCH_MAX_RESULTS     6U
+
+typedef struct
+{
+    uint32_t ulMessages;   /* Messages published for each payload length */
+    uint32_t ulPayloadLen; /* 0 to sweep the payload lengths */
+    uint8_t ucQoS;         /* 0 or 1 */
+} MqttBenchConfig_t;
+
+typedef struct
+{
+    uint32_t ulPayloadLen;
+    uint32_t ulSent;
+    uint32_t ulReceived;
+    uint32_t ulElapsedUs;          /* First publish to last message received */
+    uint32_t ulMsgsPerSec;
+    uint32_t ulGoodputBytesPerSec; /* Payload bytes received back */
+    uint32_t ulRttP50Us;
+    uint32_t ulRttP99Us;
+    uint32_t ulRttP999Us;
+    uint32_t ulRttMaxUs;
+} MqttBenchResult_t;
+
+/*
+ * @brief Run the benchmark in a task of its own and wait for it to complete.
+ *
+ * Fills up to uxMaxResults entries of pxResults, one per payload length, and sets *puxResults
+ * to their number. Returns pdFAIL if the agent is not connected, the benchmark is already
+ * running or the resources could not be allocated. Lengths longer than the agent network
+ * buffer allows are reduced.
+ */
+BaseType_t xMqttBenchRun( const MqttBenchConfig_t * pxConfig,
+                          MqttBenchResult_t * pxResults,
+                          size_t uxMaxResults,
+                          size_t * puxResults );
+
+#endif /* _MQTT_BENCH_H */
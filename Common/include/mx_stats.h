@@ -0,0 +1,80 @@
+/*
+ * FreeRTOS STM32U5 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MX_STATS_H
+#define _MX_STATS_H
+
+#include <stdint.h>
+
+/*
+ * Number of histogram buckets. Bucket 0 counts events shorter than 1 us and
+ * bucket n counts events in the range [ 2^(n-1), 2^n ) us. The last bucket
+ * also counts any longer events.
+ */
+#define MX_STATS_HIST_BUCKETS    16
+
+typedef struct
+{
+    uint32_t ulCount;
+    uint32_t ulMaxUs;
+    uint64_t ullTotalUs;
+    uint32_t ulBuckets[ MX_STATS_HIST_BUCKETS ];
+} MxStatsHistogram_t;
+
+typedef struct
+{
+    uint32_t ulTransactions;
+    uint32_t ulTransactionErrors;
+    uint32_t ulFlowTimeouts;
+    uint32_t ulFlowSpinHits;      /* Flow events caught by the busy-spin fast path */
+    uint32_t ulFlowBlockingWaits; /* Flow waits which fell back to a blocking notification wait */
+    uint32_t ulFlowSpinBudget;    /* Current busy-spin limit in CPU cycles */
+    uint32_t ulTxFrames;
+    uint32_t ulRxFrames;
+    uint64_t ullTxBytes;
+    uint64_t ullRxBytes;
+    uint32_t ulRxPoolHighWaterMark;
+    uint32_t ulRxPoolExhausted;
+    uint32_t ulTxQueueHighWaterMark; /* Largest number of TX frames waiting at once */
+    uint32_t ulTxQueueFull;          /* TX frames refused by link output because the queue was full */
+    MxStatsHistogram_t xFlowWait;        /* Time spent waiting for the flow pin */
+    MxStatsHistogram_t xHeaderExchange;  /* Duration of the SPIHeader_t exchange */
+    MxStatsHistogram_t xPayloadTransfer; /* Duration of the payload transfer */
+    MxStatsHistogram_t xNotifyLatency;   /* Notify pin edge to dataplane task wakeup */
+    MxStatsHistogram_t xFlowLatency;     /* Flow pin edge to dataplane task wakeup, blocking waits only */
+} MxDataplaneStats_t;
+
+/*
+ * @brief Copy a snapshot of the SPI dataplane statistics into pxStats.
+ */
+void mx_GetDataplaneStats( MxDataplaneStats_t * pxStats );
+
+/*
+ * @brief Reset all SPI dataplane statistics to zero.
+ */
+void mx_ResetDataplaneStats( void );
+
+#endif /* _MX_STATS_H */
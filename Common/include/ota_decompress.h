@@ -0,0 +1,119 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+#ifndef _OTA_DECOMPRESS_H
+#define _OTA_DECOMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Streaming decoder for heatshrink (LZSS) compressed OTA files.
+ *
+ * The stream must be produced with the same window and lookahead sizes as
+ * configured below, e.g. "heatshrink -e -w 10 -l 4 in.bin out.bin.hs".
+ * RAM use is one window of history plus a small output buffer.
+ */
+
+/* log2 of the history window size, heatshrink -w */
+#ifndef OTA_DECOMPRESS_WINDOW_BITS
+    #define OTA_DECOMPRESS_WINDOW_BITS    10U
+#endif
+
+/* log2 of the longest back-reference, heatshrink -l */
+#ifndef OTA_DECOMPRESS_LOOKAHEAD_BITS
+    #define OTA_DECOMPRESS_LOOKAHEAD_BITS    4U
+#endif
+
+/* Decompressed data is passed on in chunks of this size. Keep it a multiple of 16 for flash programming. */
+#ifndef OTA_DECOMPRESS_OUT_CHUNK_SIZE
+    #define OTA_DECOMPRESS_OUT_CHUNK_SIZE    256U
+#endif
+
+typedef enum
+{
+    OTA_DECOMPRESS_OK = 0,
+    OTA_DECOMPRESS_ERR_OUTPUT, /* The output callback failed */
+} OtaDecompressStatus_t;
+
+/*
+ * @brief Consume the next ulLength bytes of decompressed data.
+ *
+ * @return pdTRUE on success.
+ */
+typedef BaseType_t ( * OtaDecompressOutput_t )( void * pvCtx,
+                                                const uint8_t * pucData,
+                                                uint32_t ulLength );
+
+typedef struct
+{
+    OtaDecompressStatus_t xStatus;
+    uint8_t ucState;
+
+    /* Input bits not yet consumed, most significant bit first */
+    uint32_t ulBits;
+    uint32_t ulBitCount;
+
+    /* Back-reference being decoded */
+    uint32_t ulOffset;
+
+    /* History of the most recent output */
+    uint8_t pucWindow[ 1U << OTA_DECOMPRESS_WINDOW_BITS ];
+    uint32_t ulHead;
+
+    uint8_t pucOut[ OTA_DECOMPRESS_OUT_CHUNK_SIZE ];
+    uint32_t ulOutLen;
+    uint32_t ulTotalOut;
+
+    OtaDecompressOutput_t xOutput;
+    void * pvOutputCtx;
+} OtaDecompressCtx_t;
+
+/*
+ * @brief Prepare pxCtx for a new compressed stream.
+ */
+void vOtaDecompressInit( OtaDecompressCtx_t * pxCtx,
+                         OtaDecompressOutput_t xOutput,
+                         void * pvOutputCtx );
+
+/*
+ * @brief Decompress the next uxLength bytes of the stream. Errors are sticky.
+ */
+OtaDecompressStatus_t xOtaDecompressProcess( OtaDecompressCtx_t * pxCtx,
+                                             const uint8_t * pucInput,
+                                             size_t uxLength );
+
+/*
+ * @brief Pass on any buffered output at the end of the stream.
+ *
+ * @param[out] pulTotalOut Total number of decompressed bytes.
+ */
+OtaDecompressStatus_t xOtaDecompressFinish( OtaDecompressCtx_t * pxCtx,
+                                            uint32_t * pulTotalOut );
+
+#endif /* _OTA_DECOMPRESS_H */
@@ -0,0 +1,154 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+#ifndef _OTA_DELTA_H
+#define _OTA_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Streaming decoder for delta (patch) OTA updates.
+ *
+ * A patch rebuilds a new image from the image which is currently running.
+ * All fields are little endian. The patch starts with a header:
+ *
+ *   uint32_t magic     OTA_DELTA_MAGIC
+ *   uint32_t new_size  Size of the reconstructed image
+ *   uint32_t old_size  Size of the image the patch was generated against
+ *
+ * followed by a sequence of operations, each starting with a one byte opcode:
+ *
+ *   OTA_DELTA_OP_COPY    uint32_t old_offset, uint32_t length
+ *                        Copy length bytes of the old image.
+ *   OTA_DELTA_OP_ADD     uint32_t old_offset, uint32_t length, uint8_t data[ length ]
+ *                        Output old[ old_offset + i ] + data[ i ] (modulo 256), as in bsdiff.
+ *   OTA_DELTA_OP_INSERT  uint32_t length, uint8_t data[ length ]
+ *                        Output data verbatim.
+ *
+ * The patch is complete once new_size bytes have been produced. The patch may be
+ * fed in pieces of any size, the output is handed to the write callback in
+ * sequential chunks of up to OTA_DELTA_WINDOW_SIZE bytes.
+ */
+
+#define OTA_DELTA_MAGIC         ( 0x31544C44UL ) /* "DLT1" */
+
+#define OTA_DELTA_OP_COPY       ( 0x01U )
+#define OTA_DELTA_OP_ADD        ( 0x02U )
+#define OTA_DELTA_OP_INSERT     ( 0x03U )
+
+/* Size of the output window. A multiple of the flash burst size keeps programming aligned. */
+#ifndef OTA_DELTA_WINDOW_SIZE
+    #define OTA_DELTA_WINDOW_SIZE    ( 512U )
+#endif
+
+typedef enum
+{
+    OTA_DELTA_OK = 0,         /* More patch data expected */
+    OTA_DELTA_COMPLETE,       /* The whole image has been produced */
+    OTA_DELTA_ERR_FORMAT,     /* Malformed patch or unknown opcode */
+    OTA_DELTA_ERR_BOUNDS,     /* Patch references data outside of the old or new image */
+    OTA_DELTA_ERR_WRITE,      /* The write callback failed */
+} OtaDeltaStatus_t;
+
+/*
+ * @brief Store ulLength bytes of reconstructed image at ulOffset.
+ *
+ * @return pdTRUE on success.
+ */
+typedef BaseType_t ( * OtaDeltaWrite_t )( void * pvCtx,
+                                          uint32_t ulOffset,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength );
+
+typedef enum
+{
+    OTA_DELTA_STATE_HEADER = 0,
+    OTA_DELTA_STATE_OPCODE,
+    OTA_DELTA_STATE_ARGS,
+    OTA_DELTA_STATE_DATA,
+    OTA_DELTA_STATE_DONE,
+    OTA_DELTA_STATE_ERROR
+} OtaDeltaState_t;
+
+typedef struct
+{
+    OtaDeltaState_t xState;
+    OtaDeltaStatus_t xError;
+
+    /* Image the patch is applied to */
+    const uint8_t * pucOldImage;
+    uint32_t ulOldImageLen;
+
+    /* Values from the patch header */
+    uint32_t ulNewSize;
+    uint32_t ulOldSize;
+
+    /* Header and operation arguments being accumulated */
+    uint8_t pucFields[ 12 ];
+    uint32_t ulFieldsLen;
+    uint32_t ulFieldsNeeded;
+
+    /* Operation in progress */
+    uint8_t ucOpcode;
+    uint32_t ulOldOffset;
+    uint32_t ulRemaining;
+
+    /* Output */
+    uint32_t ulNewOffset;
+    uint8_t pucWindow[ OTA_DELTA_WINDOW_SIZE ];
+    uint32_t ulWindowLen;
+    OtaDeltaWrite_t xWrite;
+    void * pvWriteCtx;
+} OtaDeltaCtx_t;
+
+/*
+ * @brief Prepare pxCtx to apply a patch against the uxOldImageLen bytes at pucOldImage.
+ */
+void vOtaDeltaInit( OtaDeltaCtx_t * pxCtx,
+                    const uint8_t * pucOldImage,
+                    size_t uxOldImageLen,
+                    OtaDeltaWrite_t xWrite,
+                    void * pvWriteCtx );
+
+/*
+ * @brief Feed the next uxLength bytes of the patch.
+ *
+ * @return OTA_DELTA_OK while more data is expected, OTA_DELTA_COMPLETE once the
+ * image is complete and written out, or an error. Errors are sticky.
+ */
+OtaDeltaStatus_t xOtaDeltaProcess( OtaDeltaCtx_t * pxCtx,
+                                   const uint8_t * pucPatch,
+                                   size_t uxLength );
+
+/*
+ * @brief Size of the image the patch produces, or 0 until the header has been processed.
+ */
+uint32_t ulOtaDeltaNewSize( const OtaDeltaCtx_t * pxCtx );
+
+#endif /* _OTA_DELTA_H */
@@ -0,0 +1,169 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _OTA_MANIFEST_H
+#define _OTA_MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Signed manifest of the SHA-256 hash of each block of an OTA image.
+ *
+ * The manifest takes the first blocks of the file and the image follows from the next block
+ * boundary, so every block of the image can be checked before it is programmed. All fields are
+ * little endian. The manifest starts with a header:
+ *
+ *   uint32_t magic          OTA_MANIFEST_MAGIC
+ *   uint8_t  version        OTA_MANIFEST_VERSION
+ *   uint8_t  log2_block     log2 of the block size, that of the OTA file blocks
+ *   uint16_t sig_len        Length of the signature
+ *   uint32_t image_size     Size of the image which follows the manifest
+ *   uint32_t manifest_size  Bytes of the file taken by the manifest, a multiple of the block size
+ *
+ * followed by the SHA-256 of each block of the image, the last block possibly short, and by
+ * the signature of the SHA-256 of the header and hashes with the OTA signing key. The rest of
+ * manifest_size is padding.
+ *
+ * The header is taken from the first block of the file only. Other blocks received before it
+ * can not be placed and are refused, the caller requests them again.
+ */
+
+#define OTA_MANIFEST_MAGIC          ( 0x314D4842UL ) /* "BHM1" */
+#define OTA_MANIFEST_VERSION        ( 1U )
+
+#define OTA_MANIFEST_HEADER_LEN     ( 16U )
+#define OTA_MANIFEST_HASH_LEN       ( 32U )
+
+/* Longest signature accepted, an RSA-4096 signature or a DER encoded ECDSA one */
+#ifndef OTA_MANIFEST_MAX_SIG_LEN
+    #define OTA_MANIFEST_MAX_SIG_LEN    ( 512U )
+#endif
+
+/* Most blocks the manifest itself may take */
+#ifndef OTA_MANIFEST_MAX_BLOCKS
+    #define OTA_MANIFEST_MAX_BLOCKS     ( 64U )
+#endif
+
+typedef enum
+{
+    OTA_MANIFEST_OK = 0,        /* Block taken, more of the manifest expected */
+    OTA_MANIFEST_COMPLETE,      /* The whole manifest is in, its signature can be checked */
+    OTA_MANIFEST_SKIP,          /* Not a block of the manifest, or received before the header */
+    OTA_MANIFEST_ERR_FORMAT,    /* Malformed header, or a manifest which does not fit */
+    OTA_MANIFEST_ERR_HASH,      /* Image block does not match its hash */
+    OTA_MANIFEST_ERR_STATE,     /* Block checked before the manifest was verified */
+} OtaManifestStatus_t;
+
+typedef struct
+{
+    uint8_t * pucBuffer;
+    size_t uxBufferLen;
+    uint32_t ulFileSize;
+    uint32_t ulLog2BlockSize;
+
+    /* Values from the header, 0 until it is in */
+    uint32_t ulManifestSize;
+    uint32_t ulImageSize;
+    uint32_t ulSigLen;
+    uint32_t ulBlocks;
+
+    uint32_t ulMissing;
+    uint8_t pucReceived[ ( OTA_MANIFEST_MAX_BLOCKS + 7U ) / 8U ];
+    BaseType_t xVerified;
+} OtaManifestCtx_t;
+
+/*
+ * @brief Size of the buffer needed for the manifest of a file of ulFileSize bytes, or 0 if it
+ * could take more than OTA_MANIFEST_MAX_BLOCKS blocks.
+ */
+size_t uxOtaManifestBufferSize( uint32_t ulFileSize,
+                                uint32_t ulLog2BlockSize );
+
+/*
+ * @brief Prepare pxCtx to receive the manifest of a file of ulFileSize bytes into pucBuffer.
+ */
+void vOtaManifestInit( OtaManifestCtx_t * pxCtx,
+                       uint8_t * pucBuffer,
+                       size_t uxBufferLen,
+                       uint32_t ulFileSize,
+                       uint32_t ulLog2BlockSize );
+
+/*
+ * @brief Feed the block of the file at ulOffset.
+ *
+ * @return OTA_MANIFEST_OK or OTA_MANIFEST_COMPLETE if the block was taken, OTA_MANIFEST_SKIP if
+ * it is not part of the manifest or came before the header, or OTA_MANIFEST_ERR_FORMAT.
+ */
+OtaManifestStatus_t xOtaManifestFeed( OtaManifestCtx_t * pxCtx,
+                                      uint32_t ulOffset,
+                                      const uint8_t * pucData,
+                                      uint32_t ulLength );
+
+/*
+ * @brief Hash the signed part of a complete manifest into pucDigest and point to its signature.
+ *
+ * @return pdTRUE on success.
+ */
+BaseType_t xOtaManifestDigest( const OtaManifestCtx_t * pxCtx,
+                               uint8_t pucDigest[ OTA_MANIFEST_HASH_LEN ],
+                               const uint8_t ** ppucSignature,
+                               size_t * puxSignatureLen );
+
+/*
+ * @brief Mark the manifest as verified once its signature has been checked.
+ */
+void vOtaManifestSetVerified( OtaManifestCtx_t * pxCtx );
+
+BaseType_t xOtaManifestIsVerified( const OtaManifestCtx_t * pxCtx );
+
+/*
+ * @brief Check the image block at ulImageOffset, from the start of the image, against its hash.
+ *
+ * @return OTA_MANIFEST_OK if it matches, OTA_MANIFEST_ERR_HASH if its contents or length do not,
+ * or OTA_MANIFEST_ERR_STATE before the manifest was verified.
+ */
+OtaManifestStatus_t xOtaManifestCheckBlock( const OtaManifestCtx_t * pxCtx,
+                                            uint32_t ulImageOffset,
+                                            const uint8_t * pucData,
+                                            uint32_t ulLength );
+
+/*
+ * @brief Bytes of the file taken by the manifest, the offset of the image, or 0 until the
+ * header is in.
+ */
+uint32_t ulOtaManifestSize( const OtaManifestCtx_t * pxCtx );
+
+/*
+ * @brief Size of the image which follows the manifest, or 0 until the header is in.
+ */
+uint32_t ulOtaManifestImageSize( const OtaManifestCtx_t * pxCtx );
+
+#endif /* _OTA_MANIFEST_H */
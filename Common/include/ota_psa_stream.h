@@ -0,0 +1,115 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+
+#ifndef _OTA_PSA_STREAM_H
+#define _OTA_PSA_STREAM_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "ota.h"
+
+/*
+ * Write-behind staging of OTA file blocks for the PSA Firmware Update PAL.
+ *
+ * Each otaPal_WriteBlock call of the PSA PAL is one psa_fwu_write, a call into the secure world.
+ * Consecutive blocks are gathered into chunks of OTA_PSA_STREAM_CHUNK_SIZE bytes, each handed to
+ * the PAL in a single write by a separate task. Two chunk buffers are used, so the next chunk is
+ * filled from the network while the previous one is written.
+ *
+ * A write error is reported by the next write or by the close. The stream functions have the
+ * signatures of the PAL functions they replace in OtaInterfaces_t.
+ */
+
+#ifndef OTA_PSA_STREAM_ENABLED
+    #ifdef TFM_PSA_API
+        #define OTA_PSA_STREAM_ENABLED    1
+    #else
+        #define OTA_PSA_STREAM_ENABLED    0
+    #endif
+#endif
+
+/* Bytes per psa_fwu_write, a multiple of the OTA block size. The PAL returns the length as int16_t */
+#ifndef OTA_PSA_STREAM_CHUNK_SIZE
+    #define OTA_PSA_STREAM_CHUNK_SIZE    ( 16U * 1024U )
+#endif
+
+/* The writer runs at the OTA agent priority, so neither starves the other */
+#ifndef OTA_PSA_STREAM_TASK_PRIORITY
+    #define OTA_PSA_STREAM_TASK_PRIORITY    ( tskIDLE_PRIORITY + 3 )
+#endif
+
+#ifndef OTA_PSA_STREAM_TASK_STACK_SIZE
+    #define OTA_PSA_STREAM_TASK_STACK_SIZE    ( 1024 )
+#endif
+
+/* Counters of the file being received, reset when a file is created */
+typedef struct
+{
+    uint32_t ulChunks;    /* Chunks passed to otaPal_WriteBlock */
+    uint32_t ulBytes;     /* Bytes in those chunks */
+    uint32_t ulWaits;     /* Writes which waited for a chunk buffer to be free */
+    uint32_t ulSplits;    /* Chunks written early because a block was not contiguous */
+    uint32_t ulErrors;
+} OtaPsaStreamStats_t;
+
+#if ( OTA_PSA_STREAM_ENABLED == 1 )
+
+/*
+ * @brief Start the writer task. Called once before OTA_Init.
+ */
+    BaseType_t xOtaPsaStreamInit( void );
+
+/*
+ * @brief Allocate the chunk buffers, then otaPal_CreateFileForRx.
+ */
+    OtaPalStatus_t xOtaPsaStreamCreateFile( OtaFileContext_t * const pFileContext );
+
+/*
+ * @brief Stage a block. Returns ulBlockSize once the block is copied, or -1 after a failed write.
+ */
+    int16_t sOtaPsaStreamWriteBlock( OtaFileContext_t * const pFileContext,
+                                     uint32_t ulOffset,
+                                     uint8_t * const pData,
+                                     uint32_t ulBlockSize );
+
+/*
+ * @brief Write out the staged blocks, wait for the writer, then otaPal_CloseFile.
+ */
+    OtaPalStatus_t xOtaPsaStreamCloseFile( OtaFileContext_t * const pFileContext );
+
+/*
+ * @brief Drop the staged blocks, wait for the writer, then otaPal_Abort.
+ */
+    OtaPalStatus_t xOtaPsaStreamAbort( OtaFileContext_t * const pFileContext );
+
+    void vOtaPsaStreamGetStats( OtaPsaStreamStats_t * pxStats );
+
+#endif /* OTA_PSA_STREAM_ENABLED == 1 */
+
+#endif /* _OTA_PSA_STREAM_H */
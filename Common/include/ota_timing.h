@@ -0,0 +1,111 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+#ifndef _OTA_TIMING_H
+#define _OTA_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Timing report of the most recent OTA update.
+ *
+ * Phases are recorded by the OTA task and the OTA PAL as the update progresses.
+ * The report is kept across the reset which activates the new image by the PAL and
+ * published by the OTA task once the job completes, after which it is cleared.
+ */
+
+#define OTA_TIMING_MAGIC    ( 0x314D4954UL ) /* "TIM1" */
+
+typedef enum
+{
+    OTA_TIMING_JOB_FETCH = 0, /* Job document request until the document is received */
+    OTA_TIMING_ERASE,         /* Erase of the target flash area when the file is created */
+    OTA_TIMING_DOWNLOAD,      /* File creation until the file is closed */
+    OTA_TIMING_HASH,          /* Image hash on close, including decoding staged files */
+    OTA_TIMING_SIGNATURE,     /* Signature verification */
+    OTA_TIMING_BANK_SWAP,     /* Programming of the bank swap option bytes */
+    OTA_TIMING_SELF_TEST,     /* First boot of the new image until it is accepted */
+    OTA_TIMING_PHASE_MAX
+} OtaTimingPhase_t;
+
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t pulPhaseMs[ OTA_TIMING_PHASE_MAX ];
+    uint32_t ulBlocks;           /* File blocks written */
+    uint32_t ulBytes;            /* File bytes written */
+    uint32_t ulBlockWriteMaxUs;  /* Slowest block write */
+    uint64_t ullBlockWriteTotalUs;
+} OtaTimingReport_t;
+
+/*
+ * @brief Mark the start of a phase.
+ */
+void vOtaTimingStart( OtaTimingPhase_t xPhase );
+
+/*
+ * @brief Mark the end of a phase started with vOtaTimingStart and record its duration.
+ */
+void vOtaTimingStop( OtaTimingPhase_t xPhase );
+
+/*
+ * @brief Record the write of one file block of ulBytes which took ulWriteUs.
+ */
+void vOtaTimingRecordBlock( uint32_t ulBytes,
+                            uint32_t ulWriteUs );
+
+/*
+ * @brief Copy the current report into pxReport.
+ */
+void vOtaTimingGetReport( OtaTimingReport_t * pxReport );
+
+/*
+ * @brief Replace the current report, for example with one saved before a reset.
+ *
+ * @return pdTRUE if pxReport was valid and has been restored.
+ */
+BaseType_t xOtaTimingRestore( const OtaTimingReport_t * pxReport );
+
+/*
+ * @brief Clear the report.
+ */
+void vOtaTimingReset( void );
+
+/*
+ * @brief Format the report as a JSON object.
+ *
+ * @param[in] pcResult Outcome of the update included in the report, such as "succeeded".
+ *
+ * @return Length of the JSON string, or 0 if it did not fit in pcBuffer.
+ */
+size_t uxOtaTimingFormat( const char * pcResult,
+                          char * pcBuffer,
+                          size_t uxBufferLen );
+
+#endif /* _OTA_TIMING_H */
@@ -0,0 +1,111 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _PERIODIC_WORK_H
+#define _PERIODIC_WORK_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Shared scheduler for periodic work, driven by one FreeRTOS software timer.
+ *
+ * Each item is due on multiples of its period and may be delayed by up to its slack. The timer
+ * fires at the earliest due time plus slack among the items, and signals every item due by
+ * then, so nearby deadlines take a single wakeup. Items with commensurate periods start in
+ * phase, as the first due time is the next multiple of the period.
+ *
+ * An item signals the task which started it on PERIODIC_WORK_NOTIFY_IDX, which the task waits
+ * for with vPeriodicWorkWait, or calls a function from the timer task.
+ */
+
+#ifndef PERIODIC_WORK_NOTIFY_IDX
+    #define PERIODIC_WORK_NOTIFY_IDX    5
+#endif
+
+/* Called from the timer task, must not block */
+typedef void ( * PeriodicWorkCallback_t )( void * pvCtx );
+
+typedef struct PeriodicWork
+{
+    TickType_t xPeriod;
+    TickType_t xSlack;
+    TickType_t xDue;
+    TaskHandle_t xTask;
+    PeriodicWorkCallback_t pxCallback;
+    void * pvCtx;
+    BaseType_t xActive;
+    BaseType_t xLinked;
+    struct PeriodicWork * pxNext;
+} PeriodicWork_t;
+
+/*
+ * @brief Create the scheduler timer. Called once before any item is started.
+ */
+void vPeriodicWorkInit( void );
+
+/*
+ * @brief Signal the calling task every xPeriod ticks, up to xSlack ticks late.
+ * pxWork is zero initialized before the first start, usually by being static, and must stay
+ * valid from then on. Starting it again restarts it.
+ */
+void vPeriodicWorkStart( PeriodicWork_t * pxWork,
+                         TickType_t xPeriod,
+                         TickType_t xSlack );
+
+/*
+ * @brief Same as vPeriodicWorkStart, but call pxCallback instead of signalling a task.
+ */
+void vPeriodicWorkStartCallback( PeriodicWork_t * pxWork,
+                                 PeriodicWorkCallback_t pxCallback,
+                                 void * pvCtx,
+                                 TickType_t xPeriod,
+                                 TickType_t xSlack );
+
+/*
+ * @brief Change the period, the next due time is the next multiple of the new period.
+ */
+void vPeriodicWorkSetPeriod( PeriodicWork_t * pxWork,
+                             TickType_t xPeriod );
+
+void vPeriodicWorkStop( PeriodicWork_t * pxWork );
+
+/*
+ * @brief Block the calling task until pxWork is due. Signals which came in since the last call
+ * are folded into one.
+ */
+static inline void vPeriodicWorkWait( PeriodicWork_t * pxWork )
+{
+    ( void ) pxWork;
+    configASSERT( pxWork->xTask == xTaskGetCurrentTaskHandle() );
+
+    ( void ) ulTaskNotifyTakeIndexed( PERIODIC_WORK_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+}
+
+#endif /* _PERIODIC_WORK_H */
@@ -0,0 +1,139 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _POSTMORTEM_H
+#define _POSTMORTEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sram_banks.h"
+
+/*
+ * Post-mortem snapshot.
+ *
+ * On a failed assert, a fault, a failed allocation, a stack overflow or a missed watchdog deadline,
+ * the state of the system is written to a SRAM_NOINIT region which survives the reset that
+ * follows: the faulting registers and fault status registers, the assert location, the heap
+ * levels, the state of each task, the value of each metric and the last trace recorder events.
+ * Nothing is recorded until one of these happens, the normal path does not pay for it.
+ *
+ * vPostMortemInit checks the region at boot. A valid snapshot is published once MQTT is connected,
+ * to <thing name>/postmortem, and cleared. The first capture after a boot replaces a snapshot
+ * left from an earlier boot which was never published.
+ *
+ * The task table is only filled in task context, uxTaskGetSystemState cannot run from a fault
+ * or interrupt handler. This header is included by FreeRTOSConfig.h for configASSERT and does not
+ * include any FreeRTOS header.
+ *
+ * Needs the SRAM_NOINIT section of the ntz linker script, so it is off under TF-M.
+ */
+
+#ifndef POSTMORTEM_ENABLED
+    #define POSTMORTEM_ENABLED    SRAM_BANKS_ENABLED
+#endif
+
+typedef enum
+{
+    PostMortemNone = 0,
+    PostMortemAssert,
+    PostMortemHardFault,
+    PostMortemMemManage,
+    PostMortemBusFault,
+    PostMortemUsageFault,
+    PostMortemMallocFailed,
+    PostMortemStackOverflow,
+    PostMortemWatchdog, /* A watchdog client missed its deadline, or an IWDG reset without a capture */
+    PostMortemMax
+} PostMortemReason_t;
+
+#if ( POSTMORTEM_ENABLED == 1 )
+
+    #ifndef POSTMORTEM_MAX_TASKS
+        #define POSTMORTEM_MAX_TASKS    32
+    #endif
+
+    #ifndef POSTMORTEM_MAX_METRICS
+        #define POSTMORTEM_MAX_METRICS    40
+    #endif
+
+/* Trace recorder events kept, when TRACE_REC_ENABLED is set */
+    #ifndef POSTMORTEM_TRACE_EVENTS
+        #define POSTMORTEM_TRACE_EVENTS    64
+    #endif
+
+/* Upper bound of the JSON text written by uxPostMortemFormat */
+    #define POSTMORTEM_JSON_MAX    ( 8192 )
+
+/*
+ * @brief Check the snapshot kept across the reset, called once from main before the scheduler
+ * starts. ulResetFlags is the content of RCC->CSR: an IWDG or WWDG reset without a valid snapshot
+ * records one with only the reset flags.
+ */
+    void vPostMortemInit( uint32_t ulResetFlags );
+
+/*
+ * @brief Record a snapshot of the current state. pcDetail is the source file of an assert, the
+ * task of a stack overflow or the late watchdog client, ulLine the line of an assert.
+ * Callable from any context, including with interrupts masked.
+ */
+    void vPostMortemCapture( PostMortemReason_t xReason,
+                             const char * pcDetail,
+                             uint32_t ulLine );
+
+/*
+ * @brief Record a snapshot from a fault handler. pulFrame is the exception frame stacked on entry,
+ * ulExcReturn the EXC_RETURN value found in lr.
+ */
+    void vPostMortemFault( PostMortemReason_t xReason,
+                           const uint32_t * pulFrame,
+                           uint32_t ulExcReturn );
+
+    #define vPostMortemAssert( pcFile, ulLine )    vPostMortemCapture( PostMortemAssert, ( pcFile ), ( ulLine ) )
+
+/*
+ * @brief Write the pending snapshot as JSON to pcBuffer. Returns the length written, or 0 if there
+ * is no snapshot or it does not fit in uxLen bytes.
+ */
+    size_t uxPostMortemFormat( char * pcBuffer,
+                               size_t uxLen );
+
+/*
+ * @brief Drop the pending snapshot once it was published.
+ */
+    void vPostMortemClear( void );
+
+#else /* POSTMORTEM_ENABLED == 1 */
+
+    #define vPostMortemInit( ulResetFlags )                 do { ( void ) ( ulResetFlags ); } while( 0 )
+    #define vPostMortemCapture( xReason, pcDetail, ulLine ) do { ( void ) ( xReason ); ( void ) ( pcDetail ); ( void ) ( ulLine ); } while( 0 )
+    #define vPostMortemFault( xReason, pulFrame, ulExcReturn ) do { ( void ) ( xReason ); ( void ) ( pulFrame ); ( void ) ( ulExcReturn ); } while( 0 )
+    #define vPostMortemAssert( pcFile, ulLine )             do { ( void ) ( pcFile ); ( void ) ( ulLine ); } while( 0 )
+
+#endif /* POSTMORTEM_ENABLED == 1 */
+
+#endif /* _POSTMORTEM_H */
@@ -0,0 +1,90 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _PRINTF_LITE_H
+#define _PRINTF_LITE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/*
+ * Small snprintf for the logging, the payload builders and the CLI.
+ *
+ * The newlib formatter goes through a FILE and the struct _reent of the calling task, and formats
+ * floats with its arbitrary precision code. This one writes straight into the buffer, allocates
+ * nothing, does not touch errno or the reent struct and takes a fixed, small amount of stack.
+ * Integers that fit 32 bits are converted with 32 bit divisions, two digits at a time. %f with
+ * up to 18 decimals is formatted in fixed point from the integer and fractional parts.
+ *
+ * Supported: the flags "-+ #0", width and precision including "*", the length modifiers
+ * hh h l ll z j t L, and the conversions d i u o x X c s p n % f F e E g G. Floats are rounded
+ * half up rather than to nearest even, digits past the 17th significant one are printed as 0.
+ *
+ * With PRINTF_LITE_REPLACE_NEWLIB set, snprintf and vsnprintf are defined here and take the place
+ * of the newlib ones for the whole image, including the libraries. sniprintf still reaches the
+ * newlib formatter, which the "bench micro" fmt_*_newlib kernels compare against.
+ */
+
+#ifndef PRINTF_LITE_ENABLED
+    #define PRINTF_LITE_ENABLED    1
+#endif
+
+#ifndef PRINTF_LITE_REPLACE_NEWLIB
+    #define PRINTF_LITE_REPLACE_NEWLIB    PRINTF_LITE_ENABLED
+#endif
+
+/* Set to 0 to leave the float conversions out, they then print nothing and consume their argument */
+#ifndef PRINTF_LITE_FLOAT
+    #define PRINTF_LITE_FLOAT    1
+#endif
+
+#if ( PRINTF_LITE_ENABLED == 1 )
+
+/*
+ * @brief vsnprintf: write at most uxLen - 1 characters and a terminator to pcBuffer. Returns the
+ * length of the whole output, which is uxLen or more if it was truncated.
+ */
+    int lPrintfLiteV( char * pcBuffer,
+                      size_t uxLen,
+                      const char * pcFormat,
+                      va_list xArgs );
+
+    int lPrintfLite( char * pcBuffer,
+                     size_t uxLen,
+                     const char * pcFormat,
+                     ... ) __attribute__( ( format( printf, 3, 4 ) ) );
+
+#else /* PRINTF_LITE_ENABLED == 1 */
+
+    #include <stdio.h>
+
+    #define lPrintfLiteV    vsnprintf
+    #define lPrintfLite     snprintf
+
+#endif /* PRINTF_LITE_ENABLED == 1 */
+
+#endif /* _PRINTF_LITE_H */
@@ -0,0 +1,120 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _SENSOR_PUBLISH_H
+#define _SENSOR_PUBLISH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt.h"
+
+/*
+ * Publisher stage shared by the sensor tasks.
+ *
+ * xSensorPublishSubmitPooled queues a payload built in a buffer from mqtt_payload_pool.h in one
+ * of SENSOR_PUBLISH_SLOTS slots and returns at once, xSensorPublishSubmit first copies the payload
+ * into such a buffer. vSensorPublishTask hands the slots to the MQTT agent, with at most
+ * SENSOR_PUBLISH_MAX_IN_FLIGHT publishes not yet completed (sent for QoS0, acknowledged for QoS1),
+ * and frees each slot and its payload reference from its completion callback. A sampling loop therefore never waits on the
+ * broker. Payloads submitted while every slot is in use are dropped and counted. Payloads
+ * submitted while the agent is not connected are written to the telemetry spool when
+ * TELEMETRY_SPOOL_ENABLED is set, and published again after reconnecting, otherwise they are
+ * dropped and counted.
+ *
+ * While the network reports SYS_EVT_LINK_POOR, ready payloads are held until
+ * SENSOR_PUBLISH_POOR_LINK_BATCH of them are waiting or the oldest one waited
+ * SENSOR_PUBLISH_POOR_LINK_HOLD_MS, then handed to the agent back to back so that they share
+ * frames. On a good link each payload is handed over at once.
+ */
+
+#ifndef SENSOR_PUBLISH_SLOTS
+    #define SENSOR_PUBLISH_SLOTS    6
+#endif
+
+/* Longest payload accepted, must fit the largest payload pool class */
+#ifndef SENSOR_PUBLISH_SLOT_LEN
+    #define SENSOR_PUBLISH_SLOT_LEN    768
+#endif
+
+#ifndef SENSOR_PUBLISH_MAX_IN_FLIGHT
+    #define SENSOR_PUBLISH_MAX_IN_FLIGHT    4
+#endif
+
+#ifndef SENSOR_PUBLISH_POOR_LINK_BATCH
+    #define SENSOR_PUBLISH_POOR_LINK_BATCH    4
+#endif
+
+#ifndef SENSOR_PUBLISH_POOR_LINK_HOLD_MS
+    #define SENSOR_PUBLISH_POOR_LINK_HOLD_MS    2000
+#endif
+
+typedef struct
+{
+    uint32_t ulSubmitted;
+    uint32_t ulDroppedFull;    /* No free slot or payload buffer, or the publisher task is not running yet */
+    uint32_t ulDroppedOffline; /* The agent was not connected and the payload could not be spooled */
+    uint32_t ulSpooled;        /* Written to the telemetry spool while the agent was not connected */
+    uint32_t ulCompleted;
+    uint32_t ulFailed;         /* Refused by the agent, or completed with an error */
+    uint32_t ulInFlight;
+    uint32_t ulPeakInFlight;
+    uint32_t ulMaxLatencyMs;   /* Longest time from submit to completion */
+    uint32_t ulPoorLinkBatches; /* Groups of payloads held back while the link was poor */
+} SensorPublishStats_t;
+
+/*
+ * @brief Queue a copy of pvPayload for publishing on pcTopic. pcTopic is not copied and must
+ * stay valid until the publish completes. Returns pdFALSE if the payload was dropped.
+ */
+BaseType_t xSensorPublishSubmit( const char * pcTopic,
+                                 const void * pvPayload,
+                                 size_t xPayloadLen,
+                                 MQTTQoS_t xQoS );
+
+/*
+ * @brief Queue pucPayload, a buffer from pvMqttPayloadAlloc, for publishing on pcTopic without
+ * copying it. Takes over the caller's reference to the buffer, also when the payload is dropped.
+ * Returns pdFALSE if the payload was dropped.
+ */
+BaseType_t xSensorPublishSubmitPooled( const char * pcTopic,
+                                       uint8_t * pucPayload,
+                                       size_t xPayloadLen,
+                                       MQTTQoS_t xQoS );
+
+/*
+ * @brief pdTRUE if a payload submitted now would not be dropped for being offline: the agent is
+ * connected, or offline payloads are spooled.
+ */
+BaseType_t xSensorPublishIsAccepting( void );
+
+void vSensorPublishGetStats( SensorPublishStats_t * pxStats );
+
+void vSensorPublishTask( void * pvParameters );
+
+#endif /* _SENSOR_PUBLISH_H */
@@ -0,0 +1,130 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _SHADOW_PROPS_H
+#define _SHADOW_PROPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_json.h"
+
+/*
+ * Property table for shadow delta documents.
+ *
+ * xShadowPropsParse walks the delta once with JSON_Iterate: the top level members, then the
+ * members of "state", matched against the table. Nothing is applied until the whole document
+ * was walked, so the caller can check the version first and then call ulShadowPropsApply, which
+ * converts the values found and calls the change callback of each property which changed.
+ *
+ * Properties are reported back sparsely: xShadowPropsBuildReport writes a "reported" document
+ * holding only the properties marked dirty, the ones received in a delta or changed on the
+ * device, and vShadowPropsReportDone clears them once the update was accepted. The report is
+ * written with json_writer.h, sized exactly beforehand so that dirty properties which do not fit
+ * wait for the next report instead of failing the whole one.
+ *
+ * Strings are stored decoded, the escapes of a delta resolved, and escaped again when reported.
+ */
+
+/* Largest property table */
+#ifndef SHADOW_PROPS_MAX
+    #define SHADOW_PROPS_MAX    16
+#endif
+
+typedef enum
+{
+    eShadowPropUint,   /* Number, to ulValue */
+    eShadowPropBool,   /* true / false, or a number for devices reporting 0 / 1, to ulValue */
+    eShadowPropString  /* String, to pcString */
+} ShadowPropType_t;
+
+typedef struct ShadowProp
+{
+    const char * pcKey; /* Member of "state" */
+    ShadowPropType_t xType;
+    uint32_t ulValue;
+    char * pcString;    /* NUL terminated, longer strings are ignored */
+    size_t xStringSize;
+    void ( * vOnChange )( struct ShadowProp * pxProp,
+                          void * pvCtx );
+    volatile uint8_t ucDirty; /* Set to have the property in the next report */
+    uint8_t ucInFlight;       /* In the report waiting for a response */
+} ShadowProp_t;
+
+typedef struct
+{
+    uint32_t ulVersion;
+    uint8_t ucHasVersion;
+    uint32_t ulFound;                             /* Bit i set if pxProps[ i ] was in the delta */
+    const char * pcValue[ SHADOW_PROPS_MAX ];
+    size_t xValueLen[ SHADOW_PROPS_MAX ];
+    JSONTypes_t xValueType[ SHADOW_PROPS_MAX ];
+} ShadowPropsDelta_t;
+
+/*
+ * @brief Walk a delta document, recording "version" and the values of the xCount properties of
+ * pxProps found in "state". The values point into pcDoc. Returns JSONSuccess, or the error of
+ * the first malformed member.
+ */
+JSONStatus_t xShadowPropsParse( const char * pcDoc,
+                                size_t xDocLen,
+                                const ShadowProp_t * pxProps,
+                                size_t xCount,
+                                ShadowPropsDelta_t * pxDelta );
+
+/*
+ * @brief Store the values of pxDelta in pxProps and call vOnChange( pxProp, pvCtx ) for those
+ * which changed. Every property received is marked dirty, a delta meaning that the reported value
+ * differs from the desired one. Values of the wrong type, strings too long or with a \u0000 or
+ * surrogate pair escape, are logged and skipped. Returns the number of changes.
+ */
+uint32_t ulShadowPropsApply( ShadowProp_t * pxProps,
+                             size_t xCount,
+                             const ShadowPropsDelta_t * pxDelta,
+                             void * pvCtx );
+
+/*
+ * @brief Write {"state":{"reported":{...}},"clientToken":"<ulClientToken>"} with the dirty
+ * properties to pcBuffer, NUL terminated, and move them in flight. Properties are taken in table
+ * order as long as the report fits, the others stay dirty. Bools are reported as 0 / 1. Returns
+ * the document length, or 0 if nothing dirty fits.
+ */
+size_t xShadowPropsBuildReport( ShadowProp_t * pxProps,
+                                size_t xCount,
+                                uint32_t ulClientToken,
+                                char * pcBuffer,
+                                size_t xBufferLen );
+
+/*
+ * @brief End the report in flight: accepted, or rejected / timed out to be sent again.
+ */
+void vShadowPropsReportDone( ShadowProp_t * pxProps,
+                             size_t xCount,
+                             BaseType_t xAccepted );
+
+#endif /* _SHADOW_PROPS_H */
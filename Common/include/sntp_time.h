@@ -0,0 +1,152 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _SNTP_TIME_H
+#define _SNTP_TIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * UTC time, disciplined by SNTP, on the TIM5 microsecond time of ullGetMonotonicUs.
+ *
+ * The SNTP task polls the server named by the sntp_server kvstore key. Each poll sends
+ * SNTP_TIME_SAMPLES requests and keeps the answer with the shortest round trip. The first answer,
+ * and any later offset above SNTP_TIME_STEP_US, steps the time. Smaller offsets are slewed out
+ * until the next poll, and the rate of TIM5 against UTC is learned from what is left at each poll.
+ * UTC therefore never goes backwards between steps.
+ *
+ * Samples only need to record ullGetMonotonicUs when they are taken: ullSntpTimeFromMonotonicUs
+ * converts them later, when a batch is uploaded, also if they were taken before the first sync.
+ *
+ * Outside TrustZone builds the RTC keeps the time across resets, and the time it gives at boot is
+ * used until the first sync. It is set again whenever it is SNTP_TIME_RTC_MAX_ERROR_US off, and its
+ * smooth calibration is adjusted from its drift between syncs at least SNTP_TIME_RTC_CALIB_MIN_S
+ * apart. Each sync also raises the time high water mark, see time_hwm.h.
+ */
+
+#ifndef SNTP_TIME_ENABLED
+    #define SNTP_TIME_ENABLED    1
+#endif
+
+/* Server used when the sntp_server key is empty */
+#ifndef SNTP_TIME_SERVER_DFLT
+    #define SNTP_TIME_SERVER_DFLT    "pool.ntp.org"
+#endif
+
+/* Requests sent per poll */
+#ifndef SNTP_TIME_SAMPLES
+    #define SNTP_TIME_SAMPLES    4
+#endif
+
+/* Time between polls, after the first SNTP_TIME_FAST_SYNCS syncs which are SNTP_TIME_FAST_POLL_S apart */
+#ifndef SNTP_TIME_POLL_S
+    #define SNTP_TIME_POLL_S    1024
+#endif
+
+#ifndef SNTP_TIME_FAST_POLL_S
+    #define SNTP_TIME_FAST_POLL_S    64
+#endif
+
+#ifndef SNTP_TIME_FAST_SYNCS
+    #define SNTP_TIME_FAST_SYNCS    4
+#endif
+
+/* Offsets at least this large are stepped rather than slewed */
+#ifndef SNTP_TIME_STEP_US
+    #define SNTP_TIME_STEP_US    ( 128000 )
+#endif
+
+/* Largest rate correction, frequency and slew together, in parts per billion */
+#ifndef SNTP_TIME_MAX_RATE_PPB
+    #define SNTP_TIME_MAX_RATE_PPB    ( 500000 )
+#endif
+
+#ifndef SNTP_TIME_RTC_MAX_ERROR_US
+    #define SNTP_TIME_RTC_MAX_ERROR_US    ( 20000 )
+#endif
+
+#ifndef SNTP_TIME_RTC_CALIB_MIN_S
+    #define SNTP_TIME_RTC_CALIB_MIN_S    ( 4 * 3600 )
+#endif
+
+typedef enum
+{
+    eSntpTimeSourceNone = 0, /* UTC is not known */
+    eSntpTimeSourceRtc,      /* From the RTC at boot */
+    eSntpTimeSourceSntp      /* Synced at least once since boot */
+} SntpTimeSource_t;
+
+typedef struct
+{
+    SntpTimeSource_t xSource;
+    uint32_t ulSyncs;
+    uint32_t ulSteps;
+    uint32_t ulFailures;     /* Polls without a valid answer */
+    uint64_t ullLastSyncUs;  /* Monotonic time of the last sync, 0 before */
+    int32_t lLastOffsetUs;   /* Offset corrected by the last sync */
+    uint32_t ulLastDelayUs;  /* Round trip of the answer used */
+    uint8_t ucStratum;
+    int32_t lFreqPpb;        /* Rate of UTC against TIM5, less 1 */
+    int32_t lRtcCalibPpb;    /* RTC smooth calibration, 0 without an RTC */
+} SntpTimeStatus_t;
+
+#if ( SNTP_TIME_ENABLED == 1 )
+
+/*
+ * @brief Load the time from the RTC, if it was set, then poll the SNTP server whenever the network
+ * is connected. Started once the kvstore is ready.
+ */
+    void vSntpTimeTask( void * pvParameters );
+
+/*
+ * @brief Current UTC time in microseconds since 1970, or 0 while it is not known.
+ */
+    uint64_t ullSntpTimeNowUs( void );
+
+/*
+ * @brief UTC time in microseconds since 1970 of the monotonic time ullMonotonicUs, or 0 while UTC
+ * is not known. Times before the last step are converted with the current estimate.
+ */
+    uint64_t ullSntpTimeFromMonotonicUs( uint64_t ullMonotonicUs );
+
+    void vSntpTimeGetStatus( SntpTimeStatus_t * pxStatus );
+
+/*
+ * @brief Write ullUtcUs as YYYY-MM-DDThh:mm:ss.uuuuuuZ to pcBuffer, of at least 28 bytes. Returns
+ * the length written, or 0 if it did not fit.
+ */
+    size_t xSntpTimeFormat( uint64_t ullUtcUs,
+                            char * pcBuffer,
+                            size_t xBufferLen );
+
+#endif /* SNTP_TIME_ENABLED == 1 */
+
+#endif /* _SNTP_TIME_H */
@@ -0,0 +1,118 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _SRAM_BANKS_H
+#define _SRAM_BANKS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Placement of buffers and stacks in the SRAM banks.
+ *
+ * SRAM1 (192 KB at 0x20000000), SRAM2 (64 KB) and SRAM3 (512 KB) each have their own port on the
+ * AHB bus matrix, so the GPDMA and the CPU only wait for each other when they access the same bank.
+ * The ntz linker script places:
+ *
+ * SRAM_BANK_DMA first, from the start of SRAM1: memory the GPDMA reads and writes. These are the
+ *     lwIP pools and heap, which hold the pbufs moved over SPI to and from the EMW3080, and the
+ *     SPI headers.
+ * .data and .bss next, as before. They include the FreeRTOS heap with the mbedTLS record buffers.
+ * SRAM_BANK_CPU last, after .bss, which puts it in SRAM3 next to the main stack: the stacks of the
+ *     high priority tasks when STATIC_ALLOC_ENABLED is set.
+ * RAMFUNC code after it, copied from flash by the startup.
+ * SRAM_NOINIT after the code: memory the startup leaves alone, so it keeps its content across a
+ *     reset. Used by the post-mortem snapshot (postmortem.h).
+ *
+ * Variables in these sections must not have an initializer, the startup code zeroes them, except
+ * for SRAM_NOINIT which holds whatever was there after a power on.
+ * The sram command shows how much of each bank is used by each section.
+ *
+ * Under TF-M the non-secure linker script comes from the TF-M build, so the attributes are empty.
+ */
+
+#ifndef SRAM_BANKS_ENABLED
+    #ifdef TFM_PSA_API
+        #define SRAM_BANKS_ENABLED    0
+    #else
+        #define SRAM_BANKS_ENABLED    1
+    #endif
+#endif
+
+#if ( SRAM_BANKS_ENABLED == 1 )
+
+    #define SRAM_BANK_DMA    __attribute__( ( section( ".sram_dma" ), aligned( 4 ) ) )
+    #define SRAM_BANK_CPU    __attribute__( ( section( ".sram_cpu" ), aligned( 8 ) ) )
+    #define SRAM_NOINIT      __attribute__( ( section( ".noinit" ), aligned( 4 ) ) )
+
+    #define SRAM_BANK_COUNT    4
+
+/* Bytes of one bank used by each part of the image, sizes in bytes */
+    typedef struct
+    {
+        const char * pcName;
+        uint32_t ulStart;
+        uint32_t ulSize;
+        uint32_t ulDma;
+        uint32_t ulData;
+        uint32_t ulBss;
+        uint32_t ulCpu;
+        uint32_t ulCode;
+        uint32_t ulMainStack;
+    } SramBankUsage_t;
+
+/*
+ * @brief Fill pxBanks with the usage of the SRAM_BANK_COUNT banks, computed from the linker symbols.
+ */
+    void vSramBankUsage( SramBankUsage_t pxBanks[ SRAM_BANK_COUNT ] );
+
+#else /* SRAM_BANKS_ENABLED == 1 */
+
+    #define SRAM_BANK_DMA
+    #define SRAM_BANK_CPU
+    #define SRAM_NOINIT
+
+#endif /* SRAM_BANKS_ENABLED == 1 */
+
+/*
+ * RAMFUNC runs a function from SRAM: no flash wait states or ICACHE misses, and no stall while the
+ * flash is busy with an OTA erase or program. Calls between flash and SRAM code go through linker
+ * veneers, so it is meant for interrupt handlers and loops rather than short helpers. Set
+ * RAMFUNC_ENABLED to 0 to run the same functions from flash, for instance to compare the
+ * "bench micro" cycle counts.
+ */
+#ifndef RAMFUNC_ENABLED
+    #define RAMFUNC_ENABLED    SRAM_BANKS_ENABLED
+#endif
+
+#if ( RAMFUNC_ENABLED == 1 )
+    #define RAMFUNC    __attribute__( ( section( ".RamFunc" ) ) )
+#else
+    #define RAMFUNC
+#endif
+
+#endif /* _SRAM_BANKS_H */
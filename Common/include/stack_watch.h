@@ -0,0 +1,112 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _STACK_WATCH_H
+#define _STACK_WATCH_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Stack high water mark monitor.
+ *
+ * A timer reads the high water mark of every task each STACK_WATCH_PERIOD_MS and logs a warning
+ * the first time a task has less than STACK_WATCH_WARN_PCT percent, or STACK_WATCH_WARN_WORDS
+ * words, of its stack left. STACK_WATCH_REPORT_S after boot the recommended size of every stack
+ * is logged once. The high water mark only covers the code paths run so far, so the report is
+ * more accurate after the device went through a connection, an OTA update and so on.
+ */
+
+#ifndef STACK_WATCH_PERIOD_MS
+    #define STACK_WATCH_PERIOD_MS    ( 5000 )
+#endif
+
+#ifndef STACK_WATCH_WARN_PCT
+    #define STACK_WATCH_WARN_PCT    ( 10 )
+#endif
+
+#ifndef STACK_WATCH_WARN_WORDS
+    #define STACK_WATCH_WARN_WORDS    ( 64 )
+#endif
+
+/* 0 to disable the report */
+#ifndef STACK_WATCH_REPORT_S
+    #define STACK_WATCH_REPORT_S    ( 600 )
+#endif
+
+/* Recommended size: the words used plus STACK_WATCH_MARGIN_PCT percent, at least
+ * STACK_WATCH_MARGIN_MIN_WORDS, rounded up to STACK_WATCH_ROUND_WORDS */
+#ifndef STACK_WATCH_MARGIN_PCT
+    #define STACK_WATCH_MARGIN_PCT    ( 25 )
+#endif
+
+#ifndef STACK_WATCH_MARGIN_MIN_WORDS
+    #define STACK_WATCH_MARGIN_MIN_WORDS    ( 128 )
+#endif
+
+#define STACK_WATCH_ROUND_WORDS    ( 64 )
+
+/* Tasks tracked at once, a sample is skipped while more tasks exist */
+#ifndef STACK_WATCH_MAX_TASKS
+    #define STACK_WATCH_MAX_TASKS    32
+#endif
+
+/* Sizes in words of StackType_t, as given to xTaskCreate */
+typedef struct
+{
+    TaskHandle_t xHandle;
+    char pcName[ configMAX_TASK_NAME_LEN ];
+    uint32_t ulDepth;
+    uint32_t ulFree;        /* High water mark, the fewest words left so far */
+    uint32_t ulRecommended;
+} StackWatchTask_t;
+
+/*
+ * @brief Start the monitor timer.
+ */
+void vStackWatchInit( void );
+
+/*
+ * @brief Stack depth xTask was created with.
+ */
+uint32_t ulStackWatchGetDepth( TaskHandle_t xTask );
+
+/*
+ * @brief Recommended stack depth for a task which used ulUsed words so far.
+ */
+uint32_t ulStackWatchRecommend( uint32_t ulUsed );
+
+/*
+ * @brief Read the stacks of up to uxMaxTasks tasks to pxTasks. Returns the number of tasks read,
+ * or 0 when the task status array could not be allocated.
+ */
+UBaseType_t uxStackWatchGet( StackWatchTask_t * pxTasks,
+                             UBaseType_t uxMaxTasks );
+
+#endif /* _STACK_WATCH_H */
@@ -0,0 +1,180 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _STATIC_ALLOC_H
+#define _STATIC_ALLOC_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "event_groups.h"
+#include "message_buffer.h"
+#include "stream_buffer.h"
+#include "sram_banks.h"
+
+/*
+ * Allocation of the long-lived kernel objects: application tasks, their queues, message and
+ * stream buffers, semaphores and event groups.
+ *
+ * With STATIC_ALLOC_ENABLED set to 1 the xApp*Create macros below use the Static FreeRTOS APIs,
+ * with the control blocks in STATIC_ALLOC_DATA_SECTION and the task stacks in
+ * STATIC_ALLOC_STACK_SECTION. Both default to .bss subsections, so they end up in RAM with the
+ * rest of .bss unless the linker script places them elsewhere. Otherwise the macros use the
+ * heap like the plain APIs.
+ *
+ * Each macro expansion owns the storage of one object, so it must run once, or again only after
+ * the previous object was deleted. Sizes must be compile time constants. The static variant is
+ * built on GCC statement expressions.
+ */
+
+#ifndef STATIC_ALLOC_ENABLED
+    #define STATIC_ALLOC_ENABLED    0
+#endif
+
+#if ( STATIC_ALLOC_ENABLED == 1 )
+
+    #if ( configSUPPORT_STATIC_ALLOCATION != 1 )
+        #error "STATIC_ALLOC_ENABLED requires configSUPPORT_STATIC_ALLOCATION"
+    #endif
+
+    #ifndef STATIC_ALLOC_DATA_SECTION
+        #define STATIC_ALLOC_DATA_SECTION    ".bss.static_alloc.data"
+    #endif
+
+    #ifndef STATIC_ALLOC_STACK_SECTION
+        #define STATIC_ALLOC_STACK_SECTION    ".bss.static_alloc.stack"
+    #endif
+
+    #define STATIC_ALLOC_DATA     __attribute__( ( section( STATIC_ALLOC_DATA_SECTION ) ) )
+    #define STATIC_ALLOC_STACK    __attribute__( ( section( STATIC_ALLOC_STACK_SECTION ) ) )
+
+/* Stacks of the high priority tasks, kept in the CPU bank if there is one, see sram_banks.h */
+    #if ( SRAM_BANKS_ENABLED == 1 )
+        #define STATIC_ALLOC_CPU_STACK    SRAM_BANK_CPU
+    #else
+        #define STATIC_ALLOC_CPU_STACK    STATIC_ALLOC_STACK
+    #endif
+
+    #define STATIC_ALLOC_TASK( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask, xStackSection ) \
+    ( {                                                                                                     \
+        static StackType_t puxAppStack[ uxStackDepth ] xStackSection;                                       \
+        static StaticTask_t xAppTaskBuffer STATIC_ALLOC_DATA;                                               \
+        TaskHandle_t * pxAppHandle = ( pxCreatedTask );                                                     \
+        TaskHandle_t xAppTask = xTaskCreateStatic( ( pxTaskCode ), ( pcName ), ( uxStackDepth ),            \
+                                                   ( pvParameters ), ( uxPriority ),                        \
+                                                   puxAppStack, &xAppTaskBuffer );                          \
+        if( pxAppHandle != NULL )                                                                           \
+        {                                                                                                   \
+            *pxAppHandle = xAppTask;                                                                        \
+        }                                                                                                   \
+        ( xAppTask != NULL ) ? pdPASS : errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY;                              \
+    } )
+
+/* Return pdPASS like xTaskCreate */
+    #define xAppTaskCreate( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask ) \
+    STATIC_ALLOC_TASK( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask, STATIC_ALLOC_STACK )
+
+    #define xAppTaskCreateCpuBank( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask ) \
+    STATIC_ALLOC_TASK( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask, STATIC_ALLOC_CPU_STACK )
+
+    #define xAppQueueCreate( uxQueueLength, uxItemSize )                                                    \
+    ( {                                                                                                     \
+        static uint8_t pucAppQueueStorage[ ( uxQueueLength ) * ( uxItemSize ) ] STATIC_ALLOC_DATA;          \
+        static StaticQueue_t xAppQueueBuffer STATIC_ALLOC_DATA;                                             \
+        xQueueCreateStatic( ( uxQueueLength ), ( uxItemSize ), pucAppQueueStorage, &xAppQueueBuffer );      \
+    } )
+
+/* The storage of message and stream buffers is one byte longer than their capacity */
+    #define xAppMessageBufferCreate( xBufferSizeBytes )                                                     \
+    ( {                                                                                                     \
+        static uint8_t pucAppMBufStorage[ ( xBufferSizeBytes ) + 1 ] STATIC_ALLOC_DATA;                     \
+        static StaticMessageBuffer_t xAppMBufBuffer STATIC_ALLOC_DATA;                                      \
+        xMessageBufferCreateStatic( ( xBufferSizeBytes ), pucAppMBufStorage, &xAppMBufBuffer );             \
+    } )
+
+    #define xAppStreamBufferCreate( xBufferSizeBytes, xTriggerLevelBytes )                                  \
+    ( {                                                                                                     \
+        static uint8_t pucAppSBufStorage[ ( xBufferSizeBytes ) + 1 ] STATIC_ALLOC_DATA;                     \
+        static StaticStreamBuffer_t xAppSBufBuffer STATIC_ALLOC_DATA;                                       \
+        xStreamBufferCreateStatic( ( xBufferSizeBytes ), ( xTriggerLevelBytes ),                            \
+                                   pucAppSBufStorage, &xAppSBufBuffer );                                    \
+    } )
+
+    #define xAppSemaphoreCreateMutex()                                                                      \
+    ( {                                                                                                     \
+        static StaticSemaphore_t xAppSemBuffer STATIC_ALLOC_DATA;                                           \
+        xSemaphoreCreateMutexStatic( &xAppSemBuffer );                                                      \
+    } )
+
+    #define xAppSemaphoreCreateRecursiveMutex()                                                             \
+    ( {                                                                                                     \
+        static StaticSemaphore_t xAppSemBuffer STATIC_ALLOC_DATA;                                           \
+        xSemaphoreCreateRecursiveMutexStatic( &xAppSemBuffer );                                             \
+    } )
+
+    #define xAppSemaphoreCreateBinary()                                                                     \
+    ( {                                                                                                     \
+        static StaticSemaphore_t xAppSemBuffer STATIC_ALLOC_DATA;                                           \
+        xSemaphoreCreateBinaryStatic( &xAppSemBuffer );                                                     \
+    } )
+
+    #define xAppSemaphoreCreateCounting( uxMaxCount, uxInitialCount )                                       \
+    ( {                                                                                                     \
+        static StaticSemaphore_t xAppSemBuffer STATIC_ALLOC_DATA;                                           \
+        xSemaphoreCreateCountingStatic( ( uxMaxCount ), ( uxInitialCount ), &xAppSemBuffer );               \
+    } )
+
+    #define xAppEventGroupCreate()                                                                          \
+    ( {                                                                                                     \
+        static StaticEventGroup_t xAppEventGroupBuffer STATIC_ALLOC_DATA;                                   \
+        xEventGroupCreateStatic( &xAppEventGroupBuffer );                                                   \
+    } )
+
+#else /* STATIC_ALLOC_ENABLED == 1 */
+
+    #define STATIC_ALLOC_DATA
+    #define STATIC_ALLOC_STACK
+
+    #define xAppTaskCreate( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask )     \
+    xTaskCreate( ( pxTaskCode ), ( pcName ), ( uxStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ) )
+
+    #define xAppTaskCreateCpuBank( pxTaskCode, pcName, uxStackDepth, pvParameters, uxPriority, pxCreatedTask ) \
+    xTaskCreate( ( pxTaskCode ), ( pcName ), ( uxStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ) )
+
+    #define xAppQueueCreate( uxQueueLength, uxItemSize )                       xQueueCreate( ( uxQueueLength ), ( uxItemSize ) )
+    #define xAppMessageBufferCreate( xBufferSizeBytes )                        xMessageBufferCreate( ( xBufferSizeBytes ) )
+    #define xAppStreamBufferCreate( xBufferSizeBytes, xTriggerLevelBytes )     xStreamBufferCreate( ( xBufferSizeBytes ), ( xTriggerLevelBytes ) )
+    #define xAppSemaphoreCreateMutex()                                         xSemaphoreCreateMutex()
+    #define xAppSemaphoreCreateRecursiveMutex()                                xSemaphoreCreateRecursiveMutex()
+    #define xAppSemaphoreCreateBinary()                                        xSemaphoreCreateBinary()
+    #define xAppSemaphoreCreateCounting( uxMaxCount, uxInitialCount )          xSemaphoreCreateCounting( ( uxMaxCount ), ( uxInitialCount ) )
+    #define xAppEventGroupCreate()                                             xEventGroupCreate()
+
+#endif /* STATIC_ALLOC_ENABLED == 1 */
+
+#endif /* _STATIC_ALLOC_H */
@@ -35,7 +35,62 @@
 #define EVT_MASK_NET_CONNECTED     0x04
 #define EVT_MASK_MQTT_INIT         0x08
 #define EVT_MASK_MQTT_CONNECTED    0x10
+#define EVT_MASK_KV_READY          0x20
 
 extern EventGroupHandle_t xSystemEvents;
 
+/*
+ * Network and MQTT state changes published on the system event bus. Publishing
+ * SYS_EVT_IP_UP / SYS_EVT_IP_DOWN and SYS_EVT_MQTT_CONNECTED / SYS_EVT_MQTT_DISCONNECTED
+ * also sets or clears EVT_MASK_NET_CONNECTED and EVT_MASK_MQTT_CONNECTED, so tasks may
+ * either block on xSystemEvents or subscribe to the events. Each "up" event has an even
+ * value and is followed by its "down" event.
+ */
+typedef enum
+{
+    SYS_EVT_LINK_UP = 0,
+    SYS_EVT_LINK_DOWN,
+    SYS_EVT_IP_UP,
+    SYS_EVT_IP_DOWN,
+    SYS_EVT_MQTT_CONNECTED,
+    SYS_EVT_MQTT_DISCONNECTED,
+    SYS_EVT_LINK_POOR, /* Signal strength of the associated access point fell below the poor threshold */
+    SYS_EVT_LINK_GOOD, /* and rose back above the good threshold, or the link went down */
+    SYS_EVT_MAX
+} SysEvent_t;
+
+#define SYS_EVT_BIT( xEvent )    ( 1UL << ( xEvent ) )
+
+/*
+ * Called in the context of the publishing task (the network or MQTT agent task),
+ * so it must not block. Signal the subscribing task instead.
+ */
+typedef void ( * SysEventCallback_t )( SysEvent_t xEvent,
+                                       void * pvCtx );
+
+/*
+ * @brief Call xCallback with pvCtx for each published event in ulEventMask (SYS_EVT_BIT).
+ * @return pdTRUE on success, pdFALSE if all SYS_EVT_SUBSCRIBERS_MAX slots are used.
+ */
+BaseType_t xSysEventSubscribe( uint32_t ulEventMask,
+                               SysEventCallback_t xCallback,
+                               void * pvCtx );
+
+void vSysEventUnsubscribe( SysEventCallback_t xCallback,
+                           void * pvCtx );
+
+/*
+ * @brief Publish xEvent. Events which do not change the state, such as a second
+ * SYS_EVT_IP_DOWN, are dropped.
+ */
+void vSysEventPublish( SysEvent_t xEvent );
+
+/*
+ * @brief pdTRUE if the last published event of the pair of xEvent was its "up" event, such as
+ * SYS_EVT_LINK_POOR for either SYS_EVT_LINK_POOR or SYS_EVT_LINK_GOOD.
+ */
+BaseType_t xSysEventIsUp( SysEvent_t xEvent );
+
+const char * pcSysEventToString( SysEvent_t xEvent );
+
 #endif /* _SYS_EVT_H */
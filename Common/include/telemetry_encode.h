@@ -0,0 +1,105 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _TELEMETRY_ENCODE_H
+#define _TELEMETRY_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "cbor.h"
+
+/*
+ * Encoder for the sensor telemetry payloads.
+ *
+ * TELEMETRY_FORMAT_JSON writes the same JSON objects as before, with the numbers written in fixed
+ * point, so neither printf nor float formatting is involved. TELEMETRY_FORMAT_CBOR writes a CBOR
+ * map with the same keys, integers in their shortest form and floats as single precision. The
+ * format is chosen per publishing task, and CBOR payloads go to the task's topic followed by
+ * TELEMETRY_CBOR_TOPIC_SUFFIX so that subscribers can tell them apart.
+ */
+
+#define TELEMETRY_FORMAT_JSON          0
+#define TELEMETRY_FORMAT_CBOR          1
+
+#define TELEMETRY_CBOR_TOPIC_SUFFIX    "/cbor"
+
+/* Nested maps below the top level one */
+#define TELEMETRY_MAX_DEPTH            2
+
+typedef struct
+{
+    BaseType_t xFormat;
+    BaseType_t xError;
+    uint8_t * pucBuffer;
+    size_t xBufferLen;
+    size_t xLen;                                     /* JSON bytes written */
+    uint32_t ulDepth;
+    BaseType_t xFirst[ TELEMETRY_MAX_DEPTH + 1 ];    /* No member written yet at each JSON level */
+    CborEncoder xCbor[ TELEMETRY_MAX_DEPTH + 2 ];    /* The buffer, then one encoder per map */
+} TelemetryEncoder_t;
+
+/*
+ * @brief Start a payload of format xFormat, made of a top level map, in pucBuffer.
+ */
+void vTelemetryBegin( TelemetryEncoder_t * pxEncoder,
+                      BaseType_t xFormat,
+                      uint8_t * pucBuffer,
+                      size_t xBufferLen );
+
+/*
+ * @brief Add a member pcKey holding a map. Members added until vTelemetryCloseMap go to this map.
+ */
+void vTelemetryOpenMap( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey );
+
+void vTelemetryCloseMap( TelemetryEncoder_t * pxEncoder );
+
+void vTelemetryAddInt( TelemetryEncoder_t * pxEncoder,
+                       const char * pcKey,
+                       int32_t lValue );
+
+void vTelemetryAddUint( TelemetryEncoder_t * pxEncoder,
+                        const char * pcKey,
+                        uint32_t ulValue );
+
+/*
+ * @brief Add fValue, written in JSON with ulDecimals digits after the decimal point (at most 6).
+ */
+void vTelemetryAddFloat( TelemetryEncoder_t * pxEncoder,
+                         const char * pcKey,
+                         float fValue,
+                         uint32_t ulDecimals );
+
+/*
+ * @brief Close the top level map. Returns the payload length, or 0 if it did not fit in the
+ * buffer or the maps were not closed. A JSON payload is also NUL terminated.
+ */
+size_t xTelemetryEnd( TelemetryEncoder_t * pxEncoder );
+
+#endif /* _TELEMETRY_ENCODE_H */
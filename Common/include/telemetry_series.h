@@ -0,0 +1,122 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+#ifndef _TELEMETRY_SERIES_H
+#define _TELEMETRY_SERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Block encoder for batches of sensor samples, in the style of the Gorilla time series
+ * compression. Each sample is a time and up to TELEMETRY_SERIES_MAX_CHANNELS values, the values
+ * are scaled integers: a reading of 23.47 C kept with 2 decimals is the integer 2347. Times are
+ * rounded to the block's time unit, so the usual jitter of a periodic sampling loop encodes as a
+ * delta of delta of 0. Blocks go to the task's topic followed by TELEMETRY_SERIES_TOPIC_SUFFIX.
+ *
+ * Block layout, integers little endian:
+ *
+ *   offset 0   u8    version, TELEMETRY_SERIES_VERSION
+ *   offset 1   u8    number of channels N, 1 to TELEMETRY_SERIES_MAX_CHANNELS
+ *   offset 2   u16   number of samples S
+ *   offset 4   u16   time unit in ms
+ *   offset 6   u32   time of the first sample, in time units since boot
+ *   offset 10  N x u8  decimals of each channel: value = integer / 10^decimals
+ *   offset 10+N      bit stream, most significant bit of each byte first, padded with 0 bits
+ *
+ * The bit stream holds S samples. Sample 0 has no time field, sample k > 0 starts with the
+ * delta of delta of its time: D(k) - D(k-1), where D(k) = t(k) - t(k-1) and D(0) = 0. Then each
+ * channel in order holds v(k) - v(k-1), with v(-1) = 0. All differences are computed modulo 2^32.
+ * Every field is the zigzag mapping z = ( d << 1 ) ^ ( d >> 31 ) of the difference d, written as:
+ *
+ *   '0'                  z = 0
+ *   '10'   + 7 bits      z < 2^7
+ *   '110'  + 12 bits     z < 2^12
+ *   '1110' + 20 bits     z < 2^20
+ *   '1111' + 32 bits     any other z
+ *
+ * and decoded with d = ( z >> 1 ) ^ -( z & 1 ).
+ */
+
+#define TELEMETRY_SERIES_VERSION         1
+
+#define TELEMETRY_SERIES_TOPIC_SUFFIX    "/ts"
+
+#ifndef TELEMETRY_SERIES_MAX_CHANNELS
+    #define TELEMETRY_SERIES_MAX_CHANNELS    9
+#endif
+
+#define TELEMETRY_SERIES_HEADER_LEN( channels )    ( 10 + ( channels ) )
+
+typedef struct
+{
+    uint8_t * pucBuffer;
+    size_t xBufferLen;
+    size_t xBitLen;                                    /* Bits written after the header */
+    uint32_t ulChannels;
+    uint32_t ulSamples;
+    uint32_t ulTimeUnitMs;
+    uint32_t ulLastTime;                               /* In time units */
+    uint32_t ulLastDelta;
+    int32_t lLast[ TELEMETRY_SERIES_MAX_CHANNELS ];
+    BaseType_t xError;
+} TelemetrySeries_t;
+
+/*
+ * @brief Start an empty block in pucBuffer, of ulChannels channels whose decimals are listed in
+ * pucDecimals, with times rounded to ulTimeUnitMs.
+ */
+void vTelemetrySeriesBegin( TelemetrySeries_t * pxSeries,
+                            uint8_t * pucBuffer,
+                            size_t xBufferLen,
+                            uint32_t ulChannels,
+                            const uint8_t * pucDecimals,
+                            uint32_t ulTimeUnitMs );
+
+/*
+ * @brief Append a sample taken at ulTimeMs, in ms since boot, with one scaled value per channel.
+ * Returns pdFALSE and leaves the block as it was if the sample does not fit.
+ */
+BaseType_t xTelemetrySeriesAdd( TelemetrySeries_t * pxSeries,
+                                uint32_t ulTimeMs,
+                                const int32_t * plValues );
+
+/*
+ * @brief Write the sample count and return the block length, or 0 if the block holds no sample.
+ * The block can be started again with vTelemetrySeriesBegin.
+ */
+size_t xTelemetrySeriesEnd( TelemetrySeries_t * pxSeries );
+
+/*
+ * @brief Scale fValue to an integer with ulDecimals digits after the decimal point, saturated to
+ * the int32_t range.
+ */
+int32_t lTelemetrySeriesScale( float fValue,
+                               uint32_t ulDecimals );
+
+#endif /* _TELEMETRY_SERIES_H */
@@ -0,0 +1,140 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _TELEMETRY_SPOOL_H
+#define _TELEMETRY_SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt.h"
+
+/*
+ * Store-and-forward spool for telemetry submitted while the MQTT agent is offline.
+ *
+ * Records are appended to a log of numbered segment files in TELEMETRY_SPOOL_DIR on the
+ * default littlefs volume. Appends are staged in RAM and written TELEMETRY_SPOOL_WRITE_BUF_LEN
+ * bytes at a time, so that flash is programmed in whole pages and each file commit covers
+ * several records. At most TELEMETRY_SPOOL_SEGMENTS segments are kept, the oldest is removed
+ * to make room. Segments are read back oldest first and removed once fully drained.
+ *
+ * A power loss discards the records still staged in RAM. A reset while a segment is being
+ * drained sends that segment again from its start.
+ *
+ * Not thread safe, all calls are made from the sensor publisher task.
+ */
+
+/* 1 on projects with a littlefs volume */
+#ifndef TELEMETRY_SPOOL_ENABLED
+    #define TELEMETRY_SPOOL_ENABLED    0
+#endif
+
+#ifndef TELEMETRY_SPOOL_DIR
+    #define TELEMETRY_SPOOL_DIR    "/spool"
+#endif
+
+#ifndef TELEMETRY_SPOOL_SEGMENT_SIZE
+    #define TELEMETRY_SPOOL_SEGMENT_SIZE    ( 16 * 1024 )
+#endif
+
+#ifndef TELEMETRY_SPOOL_SEGMENTS
+    #define TELEMETRY_SPOOL_SEGMENTS    8
+#endif
+
+/* Staging buffer, a multiple of the flash page size. Must hold the largest record. */
+#ifndef TELEMETRY_SPOOL_WRITE_BUF_LEN
+    #define TELEMETRY_SPOOL_WRITE_BUF_LEN    1024
+#endif
+
+/* Longest topic name and payload of a spooled record */
+#ifndef TELEMETRY_SPOOL_TOPIC_LEN
+    #define TELEMETRY_SPOOL_TOPIC_LEN    128
+#endif
+
+#ifndef TELEMETRY_SPOOL_PAYLOAD_LEN
+    #define TELEMETRY_SPOOL_PAYLOAD_LEN    768
+#endif
+
+/* Records handed to the agent every TELEMETRY_SPOOL_DRAIN_PERIOD_MS once reconnected */
+#ifndef TELEMETRY_SPOOL_DRAIN_BATCH
+    #define TELEMETRY_SPOOL_DRAIN_BATCH    4
+#endif
+
+#ifndef TELEMETRY_SPOOL_DRAIN_PERIOD_MS
+    #define TELEMETRY_SPOOL_DRAIN_PERIOD_MS    200
+#endif
+
+typedef struct
+{
+    uint32_t ulAppended;
+    uint32_t ulDrained;
+    uint32_t ulRejected;        /* Records too large for the spool */
+    uint32_t ulDroppedSegments; /* Oldest segments removed to stay within TELEMETRY_SPOOL_SEGMENTS */
+    uint32_t ulFlashWrites;     /* Staging buffer writes, each one file commit */
+    uint32_t ulErrors;          /* littlefs errors */
+} TelemetrySpoolStats_t;
+
+/*
+ * @brief Called by uxTelemetrySpoolDrain for each record, oldest first. The buffers are only
+ * valid during the call. Returns pdFALSE to stop draining, the record is then kept for the
+ * next call.
+ */
+typedef BaseType_t ( * TelemetrySpoolDrainCallback_t )( void * pvCtx,
+                                                         const char * pcTopic,
+                                                         size_t uxTopicLen,
+                                                         const uint8_t * pucPayload,
+                                                         size_t uxPayloadLen,
+                                                         MQTTQoS_t xQoS );
+
+#if ( TELEMETRY_SPOOL_ENABLED == 1 )
+
+/*
+ * @brief Find the segments left by a previous run. Called once the filesystem is mounted.
+ */
+    BaseType_t xTelemetrySpoolInit( void );
+
+    BaseType_t xTelemetrySpoolAppend( const char * pcTopic,
+                                      const void * pvPayload,
+                                      size_t uxPayloadLen,
+                                      MQTTQoS_t xQoS );
+
+/*
+ * @brief Hand up to uxMaxRecords records to pxCallback, writing out the staged records first.
+ * Returns the number of records the callback accepted.
+ */
+    size_t uxTelemetrySpoolDrain( size_t uxMaxRecords,
+                                  TelemetrySpoolDrainCallback_t pxCallback,
+                                  void * pvCtx );
+
+    BaseType_t xTelemetrySpoolIsEmpty( void );
+
+    void vTelemetrySpoolGetStats( TelemetrySpoolStats_t * pxStats );
+
+#endif /* TELEMETRY_SPOOL_ENABLED == 1 */
+
+#endif /* _TELEMETRY_SPOOL_H */
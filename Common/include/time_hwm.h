@@ -0,0 +1,58 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _TIME_HWM_H
+#define _TIME_HWM_H
+
+#include <stdint.h>
+
+/*
+ * Time high water mark, the latest known time in seconds since 1970.
+ *
+ * Every update is stored in a ring of slots in the RTC backup registers, which survive a
+ * reset but not a loss of power without VBAT. CS_TIME_HWM_S_1970 in the kvstore is only
+ * updated once the mark has advanced TIME_HWM_KV_INTERVAL_S past the stored value, which
+ * bounds how far the mark can fall back after a power loss.
+ */
+
+/*
+ * @brief Recover the high water mark from the backup registers and the kvstore.
+ * Must be called after KVStore_init.
+ */
+void vTimeHwmInit( void );
+
+/*
+ * @brief Return the current high water mark in seconds since 1970.
+ */
+uint32_t ulTimeHwmGet( void );
+
+/*
+ * @brief Raise the high water mark to ulTimeS1970. Earlier times are ignored.
+ */
+void vTimeHwmUpdate( uint32_t ulTimeS1970 );
+
+#endif /* _TIME_HWM_H */
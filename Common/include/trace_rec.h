@@ -0,0 +1,135 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _TRACE_REC_H
+#define _TRACE_REC_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Event trace recorder.
+ *
+ * Context switches and queue sends and receives are recorded by the FreeRTOS trace hooks set
+ * in FreeRTOSConfig.h. Begin and end events are recorded around SPI transactions with the wifi
+ * module, MQTT agent commands, TLS record encryption and decryption, and flash program and
+ * erase operations. Each event takes 8 bytes in a ring of TRACE_REC_ENTRIES entries. Once the
+ * ring is full, new events overwrite the oldest ones. A slot is claimed with a single atomic
+ * add, so events can be recorded from any task or interrupt.
+ *
+ * Recording is off at boot and starts with vTraceRecStart ("trace start" on the CLI).
+ * vTraceRecDump stops the recording and writes the ring in the Chrome JSON trace format,
+ * which the Perfetto UI (ui.perfetto.dev) opens. Running tasks are shown as slices on a "cpu"
+ * track. The other events appear on the track of the task which was running.
+ */
+
+#ifndef TRACE_REC_ENABLED
+    #define TRACE_REC_ENABLED    0
+#endif
+
+/* Event classes recorded, for vTraceRecStart */
+#define TRACE_REC_MASK_SCHED     ( 1UL << 0 )
+#define TRACE_REC_MASK_QUEUE     ( 1UL << 1 )
+#define TRACE_REC_MASK_SLICE     ( 1UL << 2 )
+#define TRACE_REC_MASK_ALL       ( TRACE_REC_MASK_SCHED | TRACE_REC_MASK_QUEUE | TRACE_REC_MASK_SLICE )
+
+typedef enum
+{
+    TraceRecSliceSpi = 0,    /* Argument: payload bytes moved */
+    TraceRecSliceMqttCmd,    /* Argument: MQTT agent command type */
+    TraceRecSliceTlsEncrypt, /* Argument: bytes written */
+    TraceRecSliceTlsDecrypt, /* Argument: bytes read */
+    TraceRecSliceFlashProg,  /* Argument: bytes programmed */
+    TraceRecSliceFlashErase, /* Argument: page */
+    TraceRecSliceMax
+} TraceRecSlice_t;
+
+/* One recorded event */
+typedef struct
+{
+    uint32_t ulTimeUs;
+    uint8_t ucEvent;
+    uint8_t ucTask; /* Task number of the running task, or the task switched in */
+    uint16_t usArg;
+} TraceRecEvent_t;
+
+/* Called with each line of a dump */
+typedef void ( * TraceRecWrite_t )( const char * pcText,
+                                    void * pvCtx );
+
+#if ( TRACE_REC_ENABLED == 1 )
+
+/* Power of 2 */
+    #ifndef TRACE_REC_ENTRIES
+        #define TRACE_REC_ENTRIES    1024
+    #endif
+
+/* Queues named in a dump, further queues are shown by number */
+    #ifndef TRACE_REC_MAX_QUEUES
+        #define TRACE_REC_MAX_QUEUES    32
+    #endif
+
+/*
+ * @brief Clear the ring and record the event classes in ulMask.
+ */
+    void vTraceRecStart( uint32_t ulMask );
+
+    void vTraceRecStop( void );
+
+/*
+ * @brief Stop the recording and write the recorded events with xWrite.
+ */
+    void vTraceRecDump( TraceRecWrite_t xWrite,
+                        void * pvCtx );
+
+/*
+ * @brief Events recorded so far, including the ones which were overwritten.
+ */
+    uint32_t ulTraceRecCount( void );
+
+/*
+ * @brief Copy the last ulMax recorded events, oldest first, without stopping the recording.
+ * Returns the number of events copied. Callable from an interrupt or a fault handler.
+ */
+    uint32_t ulTraceRecCopyLast( TraceRecEvent_t * pxDst,
+                                 uint32_t ulMax );
+
+    void vTraceRecBegin( TraceRecSlice_t xSlice,
+                         uint32_t ulArg );
+
+    void vTraceRecEnd( TraceRecSlice_t xSlice,
+                       uint32_t ulArg );
+
+#else /* TRACE_REC_ENABLED == 1 */
+
+    #define vTraceRecBegin( xSlice, ulArg )    do { ( void ) ( xSlice ); ( void ) ( ulArg ); } while( 0 )
+    #define vTraceRecEnd( xSlice, ulArg )      do { ( void ) ( xSlice ); ( void ) ( ulArg ); } while( 0 )
+
+#endif /* TRACE_REC_ENABLED == 1 */
+
+#endif /* _TRACE_REC_H */
@@ -0,0 +1,104 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Watchdog supervisor.
+ *
+ * A high priority task owns the IWDG and refreshes it every WATCHDOG_PET_MS, but only while each
+ * started client checked in within its deadline. A task which stalls, or a low priority task
+ * starved for longer than its deadline, thus resets the board at most one IWDG timeout, 10 s,
+ * after the deadline passed. The name of the first late client is logged.
+ *
+ * A check-in is a single store, cheap enough for the body of a long flash or hash loop. Code with
+ * such a loop starts a client around it, tasks which wake up periodically start one once. The
+ * idle task checks in from its hook with a deadline of WATCHDOG_IDLE_DEADLINE_MS.
+ *
+ * vPetWatchdog in hw_defs.h remains for the code which runs with the scheduler suspended.
+ */
+
+#ifndef WATCHDOG_PET_MS
+    #define WATCHDOG_PET_MS    ( 4000 )
+#endif
+
+#ifndef WATCHDOG_IDLE_DEADLINE_MS
+    #define WATCHDOG_IDLE_DEADLINE_MS    ( 30000 )
+#endif
+
+#ifndef WATCHDOG_TASK_PRIORITY
+    #define WATCHDOG_TASK_PRIORITY    ( configMAX_PRIORITIES - 1 )
+#endif
+
+typedef struct WatchdogClient
+{
+    const char * pcName;
+    TickType_t xDeadline;
+    volatile TickType_t xLastCheckIn;
+    volatile BaseType_t xActive;
+    BaseType_t xLinked;
+    struct WatchdogClient * pxNext;
+} WatchdogClient_t;
+
+/*
+ * @brief Start the supervisor task. Called once from a task, after vPeriodicWorkInit.
+ * The IWDG started by hw_init is only refreshed by the idle hook and vPetWatchdog before that.
+ */
+void vWatchdogInit( void );
+
+/*
+ * @brief Expect a check-in at least every xDeadline ticks from now on, the start counts as the first.
+ * pxClient is zero initialized before the first start, usually by being static, and must stay
+ * valid from then on. pcName must be a static string.
+ */
+void vWatchdogStart( WatchdogClient_t * pxClient,
+                     const char * pcName,
+                     TickType_t xDeadline );
+
+void vWatchdogStop( WatchdogClient_t * pxClient );
+
+/*
+ * @brief Not callable from an interrupt.
+ */
+static inline void vWatchdogCheckIn( WatchdogClient_t * pxClient )
+{
+    pxClient->xLastCheckIn = xTaskGetTickCount();
+}
+
+/*
+ * @brief Called from the idle hook, refreshes the IWDG until the supervisor runs.
+ */
+void vWatchdogIdleCheckIn( void );
+
+#endif /* _WATCHDOG_H */
@@ -23,11 +23,17 @@
  *
  */
 
+#include "logging_levels.h"
+#include "logging.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
+#include "timers.h"
+#include "static_alloc.h"
 #include "kvstore.h"
 #include "kvstore_prv.h"
 #include <string.h>
+#include <assert.h>
 
 static SemaphoreHandle_t xKvMutex = NULL;
 
@@ -39,42 +45,232 @@ static SemaphoreHandle_t xKvMutex = NULL;
     #define WRITE_ENTRY    xprvWriteValueToImpl
 #endif
 
+#if KV_STORE_CACHE_ENABLE
+
+/* Delay after the last deferred commit request before staged changes are flushed */
+    #ifndef KVSTORE_DEFERRED_COMMIT_MS
+        #define KVSTORE_DEFERRED_COMMIT_MS    ( 5000 )
+    #endif
+
+/* The timer only wakes this task, littlefs writes block for too long to run in the timer task */
+    #ifndef KVSTORE_COMMIT_TASK_STACK_DEPTH
+        #define KVSTORE_COMMIT_TASK_STACK_DEPTH    ( 1024 )
+    #endif
+
+    #ifndef KVSTORE_COMMIT_TASK_PRIORITY
+        #define KVSTORE_COMMIT_TASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+    #endif
+
+    static UBaseType_t uxTransactionDepth = 0;
+    static TimerHandle_t xCommitTimer = NULL;
+    static StaticTimer_t xCommitTimerBuffer;
+    static TaskHandle_t xCommitTaskHandle = NULL;
+
+    static void vCommitTimerCallback( TimerHandle_t xTimer );
+    static void vCommitTask( void * pvParameters );
+#endif /* KV_STORE_CACHE_ENABLE */
+
+/* Maximum number of change subscriptions registered with KVStore_subscribe */
+#ifndef KVSTORE_SUBSCRIBERS_MAX
+    #define KVSTORE_SUBSCRIBERS_MAX    ( 8 )
+#endif
+
+typedef struct
+{
+    KVStoreKey_t xKey;
+    KVStoreChangeCallback_t xCallback;
+    void * pvCtx;
+} KVStoreSubscriber_t;
+
+static KVStoreSubscriber_t xSubscribers[ KVSTORE_SUBSCRIBERS_MAX ] = { 0 };
+
 const char * const kvStoreKeyMap[ CS_NUM_KEYS ] = KV_STORE_STRINGS;
 
 const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ] = KV_STORE_DEFAULTS;
 
+/* Number of valid keys, the static keys followed by any registered at runtime */
+static KVStoreKey_t xKeyCount = CS_NUM_KEYS;
+
+#if ( KVSTORE_DYNAMIC_KEYS_MAX > 0 )
+    typedef struct
+    {
+        char pcName[ KVSTORE_KEY_MAX_LEN + 1 ];
+        KVStoreValueType_t type;
+    } KVStoreDynamicKey_t;
+
+    static KVStoreDynamicKey_t xDynamicKeys[ KVSTORE_DYNAMIC_KEYS_MAX ] = { 0 };
+
+/* Runtime keys have no default value, only a type */
+    static const KVStoreDefaultEntry_t xDynamicDefaults[ KV_TYPE_LAST ] =
+    {
+        { .type = KV_TYPE_NONE,    .length = 0 },
+        { .type = KV_TYPE_BASE_T,  .length = 0 },
+        { .type = KV_TYPE_UBASE_T, .length = 0 },
+        { .type = KV_TYPE_INT32,   .length = 0 },
+        { .type = KV_TYPE_UINT32,  .length = 0 },
+        { .type = KV_TYPE_STRING,  .length = 0 },
+        { .type = KV_TYPE_BLOB,    .length = 0 },
+    };
+#endif /* KVSTORE_DYNAMIC_KEYS_MAX > 0 */
+
+/*
+ * String to key lookups go through an open addressing hash table. The seed is chosen when
+ * the key set changes so that no two keys share a slot, making most lookups a single probe.
+ *
+ * Lookups take no lock. A new key set is hashed into the table not in use, which is then
+ * published by switching pxKeyHash. A lookup which misses while a new table was published
+ * is repeated, and every match is checked against the key name, so a lookup never returns
+ * the wrong key.
+ */
+#ifndef KVSTORE_HASH_SLOTS
+    #define KVSTORE_HASH_SLOTS    ( 128U )
+#endif
+
+#define KVSTORE_HASH_SEED_TRIES    ( 64U )
+
+static_assert( ( KVSTORE_HASH_SLOTS & ( KVSTORE_HASH_SLOTS - 1U ) ) == 0, "KVSTORE_HASH_SLOTS must be a power of two." );
+static_assert( KVSTORE_HASH_SLOTS >= ( 2U * KVSTORE_NUM_KEYS ), "KVSTORE_HASH_SLOTS must be at least twice the number of keys." );
+static_assert( KVSTORE_NUM_KEYS < UINT8_MAX, "Too many keys for the key hash table." );
+
+typedef struct
+{
+    uint32_t ulSeed;
+    uint8_t pucSlots[ KVSTORE_HASH_SLOTS ]; /* Key + 1 for each slot, 0 when empty */
+} KVStoreKeyHash_t;
+
+static KVStoreKeyHash_t xKeyHashTables[ 2 ] = { 0 };
+
+/* NULL until KVStore_init, both only changed in critical sections */
+static KVStoreKeyHash_t * pxKeyHash = NULL;
+static uint32_t ulKeyHashGeneration = 0;
+
+static inline const KVStoreDefaultEntry_t * pxGetDefault( KVStoreKey_t xKey )
+{
+    const KVStoreDefaultEntry_t * pxDefault = &( kvStoreDefaults[ 0 ] );
+
+    #if ( KVSTORE_DYNAMIC_KEYS_MAX > 0 )
+        if( xKey >= CS_NUM_KEYS )
+        {
+            pxDefault = &( xDynamicDefaults[ xDynamicKeys[ xKey - CS_NUM_KEYS ].type ] );
+        }
+        else
+    #endif
+    {
+        pxDefault = &( kvStoreDefaults[ xKey ] );
+    }
+
+    return pxDefault;
+}
+
+static uint32_t ulKeyHash( const char * pcKey,
+                           uint32_t ulSeed )
+{
+    /* FNV-1a */
+    uint32_t ulHash = 2166136261UL ^ ulSeed;
+
+    while( *pcKey != '\0' )
+    {
+        ulHash ^= ( uint8_t ) *pcKey;
+        ulHash *= 16777619UL;
+        pcKey++;
+    }
+
+    return ulHash;
+}
+
+/* Must be called with the kvstore mutex held or during initialization */
+static void vBuildKeyHash( void )
+{
+    KVStoreKeyHash_t * pxTable = ( pxKeyHash == &( xKeyHashTables[ 0 ] ) ) ? &( xKeyHashTables[ 1 ] ) : &( xKeyHashTables[ 0 ] );
+    uint32_t ulCollisions = 1;
+
+    for( uint32_t ulSeed = 0; ( ulCollisions > 0 ) && ( ulSeed < KVSTORE_HASH_SEED_TRIES ); ulSeed++ )
+    {
+        ulCollisions = 0;
+        pxTable->ulSeed = ulSeed;
+        ( void ) memset( pxTable->pucSlots, 0, sizeof( pxTable->pucSlots ) );
+
+        for( KVStoreKey_t xKey = 0; xKey < xKeyCount; xKey++ )
+        {
+            uint32_t ulSlot = ulKeyHash( kvKeyToString( xKey ), ulSeed ) & ( KVSTORE_HASH_SLOTS - 1U );
+
+            /* Linear probing keeps the table correct if no collision free seed is found */
+            while( pxTable->pucSlots[ ulSlot ] != 0 )
+            {
+                ulCollisions++;
+                ulSlot = ( ulSlot + 1U ) & ( KVSTORE_HASH_SLOTS - 1U );
+            }
+
+            pxTable->pucSlots[ ulSlot ] = ( uint8_t ) ( xKey + 1 );
+        }
+    }
+
+    if( ulCollisions > 0 )
+    {
+        LogWarn( "No collision free kvstore key hash found, %lu keys need extra probes.", ulCollisions );
+    }
+
+    taskENTER_CRITICAL();
+    pxKeyHash = pxTable;
+    ulKeyHashGeneration++;
+    taskEXIT_CRITICAL();
+}
+
+static KVStoreKey_t xLookupKey( const KVStoreKeyHash_t * pxTable,
+                                const char * pcKey )
+{
+    KVStoreKey_t xKey = KVSTORE_KEY_INVALID;
+    uint32_t ulSlot = ulKeyHash( pcKey, pxTable->ulSeed ) & ( KVSTORE_HASH_SLOTS - 1U );
+
+    for( uint32_t ulProbes = 0; ( ulProbes < KVSTORE_HASH_SLOTS ) && ( pxTable->pucSlots[ ulSlot ] != 0 ); ulProbes++ )
+    {
+        /* Slots only ever hold registered keys, which are never removed */
+        KVStoreKey_t xSlotKey = ( KVStoreKey_t ) ( pxTable->pucSlots[ ulSlot ] - 1 );
+
+        if( 0 == strcmp( kvKeyToString( xSlotKey ), pcKey ) )
+        {
+            xKey = xSlotKey;
+            break;
+        }
+
+        ulSlot = ( ulSlot + 1U ) & ( KVSTORE_HASH_SLOTS - 1U );
+    }
+
+    return xKey;
+}
+
 static size_t xReadEntryOrDefault( KVStoreKey_t xKey,
                                    void * pvBuffer,
                                    size_t xBufferSize )
 {
     size_t xLength = 0;
 
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( xKey < xKeyCount );
     configASSERT( pvBuffer != NULL );
 
     ( void ) READ_ENTRY( xKey, NULL, &xLength, pvBuffer, xBufferSize );
 
     if( xLength == 0 )
     {
-        size_t xDataLen = kvStoreDefaults[ xKey ].length;
+        size_t xDataLen = pxGetDefault( xKey )->length;
 
         if( xBufferSize < xDataLen )
         {
             LogWarn( "Read from key: %s was truncated from %d bytes to %d bytes.",
-                     kvStoreKeyMap[ xKey ], xDataLen, xBufferSize );
+                     kvKeyToString( xKey ), xDataLen, xBufferSize );
             xDataLen = xBufferSize;
         }
 
         if( xDataLen > sizeof( void * ) )
         {
-            ( void ) memcpy( pvBuffer, kvStoreDefaults[ xKey ].blob, xDataLen );
+            ( void ) memcpy( pvBuffer, pxGetDefault( xKey )->blob, xDataLen );
         }
         else
         {
-            ( void ) memcpy( pvBuffer, &( kvStoreDefaults[ xKey ].u32 ), xDataLen );
+            ( void ) memcpy( pvBuffer, &( pxGetDefault( xKey )->u32 ), xDataLen );
         }
 
-        xLength = kvStoreDefaults[ xKey ].length;
+        xLength = pxGetDefault( xKey )->length;
     }
 
 /* TEST_AUTOMATION_INTEGRATION is set in ota_config.h, help us to set attributes easily. */
@@ -118,32 +314,276 @@ void KVStore_init( void )
 {
     if( xKvMutex == NULL )
     {
-        xKvMutex = xSemaphoreCreateMutex();
+        xKvMutex = xAppSemaphoreCreateMutex();
     }
 
     ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
-    #if KV_STORE_CACHE_ENABLE
-        vprvCacheInit();
-    #endif
+    if( pxKeyHash == NULL )
+    {
+        vBuildKeyHash();
+    }
 
+    /* Loading the store may register runtime keys found in it */
     #if KV_STORE_NVIMPL_ENABLE
         vprvNvImplInit();
     #endif
 
+    #if KV_STORE_CACHE_ENABLE
+        vprvCacheInit();
+
+        if( xCommitTaskHandle == NULL )
+        {
+            if( xAppTaskCreate( vCommitTask, "KVCommit", KVSTORE_COMMIT_TASK_STACK_DEPTH,
+                                NULL, KVSTORE_COMMIT_TASK_PRIORITY, &xCommitTaskHandle ) != pdPASS )
+            {
+                LogError( "Failed to create the kvstore commit task, deferred changes wait for KVStore_commit." );
+            }
+        }
+
+        if( ( xCommitTimer == NULL ) &&
+            ( xCommitTaskHandle != NULL ) )
+        {
+            xCommitTimer = xTimerCreateStatic( "kvcommit", pdMS_TO_TICKS( KVSTORE_DEFERRED_COMMIT_MS ),
+                                               pdFALSE, NULL, vCommitTimerCallback, &xCommitTimerBuffer );
+        }
+    #endif
+
+    ( void ) xSemaphoreGive( xKvMutex );
+}
+
+/*
+ * @brief Call the subscribers of each key set in the pucCommitted bitmap.
+ * Must be called without xKvMutex held so that callbacks may read the new values.
+ */
+static void vNotifySubscribers( const uint8_t * pucCommitted )
+{
+    KVStoreSubscriber_t xSnapshot[ KVSTORE_SUBSCRIBERS_MAX ];
+
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+    ( void ) memcpy( xSnapshot, xSubscribers, sizeof( xSnapshot ) );
     ( void ) xSemaphoreGive( xKvMutex );
+
+    for( UBaseType_t i = 0; i < KVSTORE_SUBSCRIBERS_MAX; i++ )
+    {
+        KVStoreKey_t xKey = xSnapshot[ i ].xKey;
+
+        if( ( xSnapshot[ i ].xCallback != NULL ) &&
+            ( ( pucCommitted[ xKey / 8 ] & ( 1U << ( xKey % 8 ) ) ) != 0 ) )
+        {
+            xSnapshot[ i ].xCallback( xKey, xSnapshot[ i ].pvCtx );
+        }
+    }
 }
 
+/*
+ * @brief Register xCallback to be called with pvCtx each time a new value of key is committed.
+ * @return pdTRUE on success, pdFALSE if key is invalid or all KVSTORE_SUBSCRIBERS_MAX slots are used.
+ */
+BaseType_t KVStore_subscribe( KVStoreKey_t key,
+                              KVStoreChangeCallback_t xCallback,
+                              void * pvCtx )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( ( key < xKeyCount ) && ( xCallback != NULL ) )
+    {
+        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+        for( UBaseType_t i = 0; i < KVSTORE_SUBSCRIBERS_MAX; i++ )
+        {
+            if( xSubscribers[ i ].xCallback == NULL )
+            {
+                xSubscribers[ i ].xKey = key;
+                xSubscribers[ i ].xCallback = xCallback;
+                xSubscribers[ i ].pvCtx = pvCtx;
+                xSuccess = pdTRUE;
+                break;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xKvMutex );
+
+        if( xSuccess == pdFALSE )
+        {
+            LogError( "No room to subscribe to key: %s, increase KVSTORE_SUBSCRIBERS_MAX.", kvKeyToString( key ) );
+        }
+    }
+
+    return xSuccess;
+}
+
+/*
+ * @brief Remove a subscription added with KVStore_subscribe.
+ */
+void KVStore_unsubscribe( KVStoreKey_t key,
+                          KVStoreChangeCallback_t xCallback,
+                          void * pvCtx )
+{
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+    for( UBaseType_t i = 0; i < KVSTORE_SUBSCRIBERS_MAX; i++ )
+    {
+        if( ( xSubscribers[ i ].xKey == key ) &&
+            ( xSubscribers[ i ].xCallback == xCallback ) &&
+            ( xSubscribers[ i ].pvCtx == pvCtx ) )
+        {
+            xSubscribers[ i ].xCallback = NULL;
+            xSubscribers[ i ].pvCtx = NULL;
+        }
+    }
+
+    ( void ) xSemaphoreGive( xKvMutex );
+}
+
+static BaseType_t xWriteEntry( KVStoreKey_t xKey,
+                               KVStoreValueType_t xType,
+                               size_t xLength,
+                               const void * pvNewValue )
+{
+    BaseType_t xReturn = pdFALSE;
+
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+    xReturn = WRITE_ENTRY( xKey, xType, xLength, pvNewValue );
+
+    ( void ) xSemaphoreGive( xKvMutex );
+
+    /* Without the cache every write is committed immediately */
+    #if !KV_STORE_CACHE_ENABLE
+        if( xReturn == pdTRUE )
+        {
+            uint8_t pucCommitted[ KVSTORE_KEY_BITMAP_LEN ] = { 0 };
+
+            pucCommitted[ xKey / 8 ] = ( uint8_t ) ( 1U << ( xKey % 8 ) );
+            vNotifySubscribers( pucCommitted );
+        }
+    #endif
+
+    return xReturn;
+}
+
+#if KV_STORE_CACHE_ENABLE
+
+/*
+ * @brief Write all staged changes to non-volatile memory in a single batch.
+ */
+    BaseType_t KVStore_xCommitChanges( void )
+    {
+        BaseType_t xSuccess = pdFALSE;
+        uint8_t pucCommitted[ KVSTORE_KEY_BITMAP_LEN ] = { 0 };
+
+        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+        if( xCommitTimer != NULL )
+        {
+            ( void ) xTimerStop( xCommitTimer, 0 );
+        }
+
+        xSuccess = xprvCommitCache( pucCommitted );
+
+        ( void ) xSemaphoreGive( xKvMutex );
+
+        vNotifySubscribers( pucCommitted );
+
+        return xSuccess;
+    }
+
+/*
+ * @brief Start a transaction. Staged changes are not flushed by KVStore_commitDeferred
+ * until the matching call to KVStore_commit. Transactions may be nested.
+ */
+    void KVStore_begin( void )
+    {
+        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+        uxTransactionDepth++;
+        ( void ) xSemaphoreGive( xKvMutex );
+    }
+
+/*
+ * @brief End a transaction, flushing all staged changes once the outermost one ends.
+ * @return pdTRUE if the transaction is still open or all changes were written.
+ */
+    BaseType_t KVStore_commit( void )
+    {
+        BaseType_t xFlush = pdFALSE;
+        BaseType_t xSuccess = pdTRUE;
+
+        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+        configASSERT( uxTransactionDepth > 0 );
+
+        if( uxTransactionDepth > 0 )
+        {
+            uxTransactionDepth--;
+            xFlush = ( uxTransactionDepth == 0 ) ? pdTRUE : pdFALSE;
+        }
+
+        ( void ) xSemaphoreGive( xKvMutex );
+
+        if( xFlush == pdTRUE )
+        {
+            xSuccess = KVStore_xCommitChanges();
+        }
+
+        return xSuccess;
+    }
+
+/*
+ * @brief Request that staged changes are flushed after KVSTORE_DEFERRED_COMMIT_MS.
+ * Further requests within that time restart the delay, so that they share one flush.
+ */
+    void KVStore_commitDeferred( void )
+    {
+        if( xCommitTimer != NULL )
+        {
+            ( void ) xTimerReset( xCommitTimer, 0 );
+        }
+    }
+
+    static void vCommitTimerCallback( TimerHandle_t xTimer )
+    {
+        ( void ) xTimer;
+
+        ( void ) xTaskNotifyGive( xCommitTaskHandle );
+    }
+
+    static void vCommitTask( void * pvParameters )
+    {
+        ( void ) pvParameters;
+
+        for( ;; )
+        {
+            BaseType_t xInTransaction = pdFALSE;
+
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+            ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+            xInTransaction = ( uxTransactionDepth > 0 ) ? pdTRUE : pdFALSE;
+            ( void ) xSemaphoreGive( xKvMutex );
+
+            /* An open transaction flushes everything when it is committed */
+            if( xInTransaction == pdFALSE )
+            {
+                if( KVStore_xCommitChanges() != pdTRUE )
+                {
+                    LogError( "Failed to write deferred configuration changes to NVM." );
+                }
+            }
+        }
+    }
+#endif /* KV_STORE_CACHE_ENABLE */
+
 BaseType_t KVStore_setBlob( KVStoreKey_t key,
                             size_t xLength,
                             const void * pvNewValue )
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( pvNewValue != NULL ) && ( xLength > 0 ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_BLOB ) )
+    if( ( key < xKeyCount ) && ( pvNewValue != NULL ) && ( xLength > 0 ) &&
+        ( pxGetDefault( key )->type == KV_TYPE_BLOB ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_BLOB, xLength, pvNewValue );
+        xReturn = xWriteEntry( key, KV_TYPE_BLOB, xLength, pvNewValue );
     }
 
     return xReturn;
@@ -154,11 +594,11 @@ BaseType_t KVStore_setString( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) &&
+    if( ( key < xKeyCount ) &&
         ( pcNewValue != NULL ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_STRING ) )
+        ( pxGetDefault( key )->type == KV_TYPE_STRING ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_STRING, strlen( pcNewValue ) + 1, ( const void * ) pcNewValue );
+        xReturn = xWriteEntry( key, KV_TYPE_STRING, strlen( pcNewValue ) + 1, ( const void * ) pcNewValue );
     }
 
     return xReturn;
@@ -169,9 +609,9 @@ BaseType_t KVStore_setUInt32( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_UINT32 ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_UINT32 ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_UINT32, sizeof( uint32_t ), ( const void * ) &ulNewVal );
+        xReturn = xWriteEntry( key, KV_TYPE_UINT32, sizeof( uint32_t ), ( const void * ) &ulNewVal );
     }
 
     return xReturn;
@@ -182,9 +622,9 @@ BaseType_t KVStore_setInt32( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_INT32 ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_INT32 ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_INT32, sizeof( int32_t ), ( const void * ) &lNewVal );
+        xReturn = xWriteEntry( key, KV_TYPE_INT32, sizeof( int32_t ), ( const void * ) &lNewVal );
     }
 
     return xReturn;
@@ -195,9 +635,9 @@ BaseType_t KVStore_setUBase( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_UBASE_T ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_UBASE_T ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_UBASE_T, sizeof( UBaseType_t ),
+        xReturn = xWriteEntry( key, KV_TYPE_UBASE_T, sizeof( UBaseType_t ),
                                ( const void * ) &uxNewVal );
     }
 
@@ -209,9 +649,9 @@ BaseType_t KVStore_setBase( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
-        xReturn = WRITE_ENTRY( key, KV_TYPE_BASE_T, sizeof( BaseType_t ), ( const void * ) &xNewVal );
+        xReturn = xWriteEntry( key, KV_TYPE_BASE_T, sizeof( BaseType_t ), ( const void * ) &xNewVal );
     }
 
     return xReturn;
@@ -221,7 +661,7 @@ size_t KVStore_getSize( KVStoreKey_t xKey )
 {
     size_t xDataLen = 0;
 
-    if( xKey < CS_NUM_KEYS )
+    if( xKey < xKeyCount )
     {
         /* First check cache if available */
         #if KV_STORE_CACHE_ENABLE
@@ -234,7 +674,7 @@ size_t KVStore_getSize( KVStoreKey_t xKey )
         if( xDataLen == 0 )
         {
             /* Otherwise read default value */
-            xDataLen = kvStoreDefaults[ xKey ].length;
+            xDataLen = pxGetDefault( xKey )->length;
         }
     }
 
@@ -271,7 +711,7 @@ size_t KVStore_getBlob( KVStoreKey_t key,
 {
     size_t xLength = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( pvBuffer != NULL ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BLOB ) )
+    if( ( key < xKeyCount ) && ( pvBuffer != NULL ) && ( pxGetDefault( key )->type == KV_TYPE_BLOB ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -321,9 +761,9 @@ KVStoreValueType_t KVStore_getType( KVStoreKey_t key )
 {
     KVStoreValueType_t xKvType = KV_TYPE_NONE;
 
-    if( key < CS_NUM_KEYS )
+    if( key < xKeyCount )
     {
-        xKvType = kvStoreDefaults[ key ].type;
+        xKvType = pxGetDefault( key )->type;
     }
 
     return( xKvType );
@@ -335,9 +775,9 @@ size_t KVStore_getString( KVStoreKey_t key,
 {
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) &&
+    if( ( key < xKeyCount ) &&
         ( pcBuffer != NULL ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_STRING ) )
+        ( pxGetDefault( key )->type == KV_TYPE_STRING ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -392,6 +832,137 @@ char * KVStore_getStringHeap( KVStoreKey_t key,
     return pcBuffer;
 }
 
+#if KV_STORE_CACHE_ENABLE
+
+/*
+ * @brief Return a pointer to the cached value of xKey or to its default value.
+ * Must be called with xKvMutex held.
+ */
+    static const void * pvPeekEntryOrDefault( KVStoreKey_t xKey,
+                                              size_t * pxLength )
+    {
+        size_t xLength = 0;
+        const void * pvData = pvprvPeekCacheEntry( xKey, &xLength );
+
+        if( pvData == NULL )
+        {
+            xLength = pxGetDefault( xKey )->length;
+            pvData = pxGetDefault( xKey )->blob;
+        }
+
+/* TEST_AUTOMATION_INTEGRATION is set in ota_config.h, help us to set attributes easily. */
+        #if ( TEST_AUTOMATION_INTEGRATION == 1 )
+            if( ( xKey == CS_CORE_THING_NAME ) && ( strlen( THING_NAME_DFLT ) > 0 ) )
+            {
+                pvData = THING_NAME_DFLT;
+                xLength = strlen( THING_NAME_DFLT ) + 1;
+            }
+            else if( ( xKey == CS_CORE_MQTT_ENDPOINT ) && ( strlen( MQTT_ENDPOINT_DFLT ) > 0 ) )
+            {
+                pvData = MQTT_ENDPOINT_DFLT;
+                xLength = strlen( MQTT_ENDPOINT_DFLT ) + 1;
+            }
+            else if( ( xKey == CS_WIFI_SSID ) && ( strlen( WIFI_SSID_DFLT ) > 0 ) )
+            {
+                pvData = WIFI_SSID_DFLT;
+                xLength = strlen( WIFI_SSID_DFLT ) + 1;
+            }
+            else if( ( xKey == CS_WIFI_CREDENTIAL ) && ( strlen( WIFI_PASSWORD_DFLT ) > 0 ) )
+            {
+                pvData = WIFI_PASSWORD_DFLT;
+                xLength = strlen( WIFI_PASSWORD_DFLT ) + 1;
+            }
+        #endif /* if ( TEST_AUTOMATION_INTEGRATION == 1 ) */
+
+        *pxLength = xLength;
+
+        return pvData;
+    }
+
+/*
+ * @brief Borrow a pointer to the value of a string key without copying it.
+ * On success the kvstore lock is held until KVStore_peekEnd is called. No other kvstore
+ * function may be called by the task in between and the string must not be used afterwards.
+ * @param[out] pxLength Optional, set to the length of the string excluding the null terminator.
+ * @return The null terminated string or NULL if key is not a string key. The lock is not held
+ * when NULL is returned.
+ */
+    const char * KVStore_peekString( KVStoreKey_t key,
+                                     size_t * pxLength )
+    {
+        const char * pcValue = NULL;
+        size_t xLength = 0;
+
+        if( ( key < xKeyCount ) &&
+            ( pxGetDefault( key )->type == KV_TYPE_STRING ) )
+        {
+            ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+            pcValue = ( const char * ) pvPeekEntryOrDefault( key, &xLength );
+
+            /* Registered keys have no default value */
+            if( ( pcValue == NULL ) || ( xLength == 0 ) )
+            {
+                pcValue = "";
+                xLength = 1;
+            }
+
+            configASSERT( pcValue[ xLength - 1 ] == '\0' );
+        }
+
+        if( pxLength != NULL )
+        {
+            *pxLength = ( xLength > 0 ) ? ( xLength - 1 ) : 0;
+        }
+
+        return pcValue;
+    }
+
+/*
+ * @brief Borrow a pointer to the value of a blob key without copying it.
+ * On success the kvstore lock is held until KVStore_peekEnd is called, see KVStore_peekString.
+ * @param[out] pxLength Optional, set to the length of the blob in bytes.
+ * @return The blob or NULL if key is not a blob key or has no value. The lock is not held
+ * when NULL is returned.
+ */
+    const void * KVStore_peekBlob( KVStoreKey_t key,
+                                   size_t * pxLength )
+    {
+        const void * pvValue = NULL;
+        size_t xLength = 0;
+
+        if( ( key < xKeyCount ) &&
+            ( pxGetDefault( key )->type == KV_TYPE_BLOB ) )
+        {
+            ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+            pvValue = pvPeekEntryOrDefault( key, &xLength );
+
+            if( ( pvValue == NULL ) || ( xLength == 0 ) )
+            {
+                pvValue = NULL;
+                xLength = 0;
+                ( void ) xSemaphoreGive( xKvMutex );
+            }
+        }
+
+        if( pxLength != NULL )
+        {
+            *pxLength = xLength;
+        }
+
+        return pvValue;
+    }
+
+/*
+ * @brief Release the value borrowed by a successful KVStore_peekString or KVStore_peekBlob call.
+ */
+    void KVStore_peekEnd( void )
+    {
+        ( void ) xSemaphoreGive( xKvMutex );
+    }
+#endif /* KV_STORE_CACHE_ENABLE */
+
 uint32_t KVStore_getUInt32( KVStoreKey_t key,
                             BaseType_t * pxSuccess )
 {
@@ -399,8 +970,8 @@ uint32_t KVStore_getUInt32( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_UINT32 ) )
+    if( ( key < xKeyCount ) &&
+        ( pxGetDefault( key )->type == KV_TYPE_UINT32 ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -425,7 +996,7 @@ int32_t KVStore_getInt32( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_INT32 ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_INT32 ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -449,7 +1020,7 @@ BaseType_t KVStore_getBase( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -473,7 +1044,7 @@ UBaseType_t KVStore_getUBase( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( key < xKeyCount ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
         ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
 
@@ -499,21 +1070,122 @@ const char * kvKeyToString( KVStoreKey_t xKey )
         retVal = kvStoreKeyMap[ xKey ];
     }
 
+    #if ( KVSTORE_DYNAMIC_KEYS_MAX > 0 )
+        else if( xKey < xKeyCount )
+        {
+            retVal = xDynamicKeys[ xKey - CS_NUM_KEYS ].pcName;
+        }
+    #endif
+
     return retVal;
 }
 
 KVStoreKey_t kvStringToKey( const char * pcKey )
 {
-    KVStoreKey_t xKey = CS_NUM_KEYS;
+    KVStoreKey_t xKey = KVSTORE_KEY_INVALID;
+    const KVStoreKeyHash_t * pxTable = NULL;
+    uint32_t ulGeneration = 0;
+    BaseType_t xRetry = pdFALSE;
 
-    for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+    /* No key is found before KVStore_init */
+    do
     {
-        if( 0 == strcmp( kvStoreKeyMap[ i ], pcKey ) )
+        taskENTER_CRITICAL();
+        pxTable = pxKeyHash;
+        ulGeneration = ulKeyHashGeneration;
+        taskEXIT_CRITICAL();
+
+        if( ( pcKey != NULL ) &&
+            ( pxTable != NULL ) )
         {
-            xKey = i;
-            break;
+            xKey = xLookupKey( pxTable, pcKey );
         }
+
+        /* The table may have been rebuilt in place of the one read */
+        taskENTER_CRITICAL();
+        xRetry = ( ( xKey == KVSTORE_KEY_INVALID ) && ( ulGeneration != ulKeyHashGeneration ) ) ? pdTRUE : pdFALSE;
+        taskEXIT_CRITICAL();
     }
+    while( xRetry == pdTRUE );
+
+    return xKey;
+}
+
+UBaseType_t KVStore_getNumKeys( void )
+{
+    return ( UBaseType_t ) xKeyCount;
+}
+
+/*
+ * @brief Add a key at runtime, or look up an existing key of the same name and type.
+ * Must be called with the kvstore mutex held or during initialization.
+ */
+KVStoreKey_t xprvRegisterKey( const char * pcKey,
+                              KVStoreValueType_t xType )
+{
+    KVStoreKey_t xKey = kvStringToKey( pcKey );
+
+    if( xKey != KVSTORE_KEY_INVALID )
+    {
+        if( pxGetDefault( xKey )->type != xType )
+        {
+            LogError( "Key: %s is already registered with a different type.", pcKey );
+            xKey = KVSTORE_KEY_INVALID;
+        }
+    }
+    else if( ( pcKey == NULL ) ||
+             ( xType <= KV_TYPE_NONE ) ||
+             ( xType >= KV_TYPE_LAST ) ||
+             ( strnlen( pcKey, KVSTORE_KEY_MAX_LEN + 1 ) > KVSTORE_KEY_MAX_LEN ) )
+    {
+        LogError( "Invalid key name or type." );
+    }
+
+    #if ( KVSTORE_DYNAMIC_KEYS_MAX > 0 )
+        else if( xKeyCount < KVSTORE_NUM_KEYS )
+        {
+            KVStoreDynamicKey_t * pxDynamicKey = &( xDynamicKeys[ xKeyCount - CS_NUM_KEYS ] );
+
+            ( void ) strncpy( pxDynamicKey->pcName, pcKey, KVSTORE_KEY_MAX_LEN );
+            pxDynamicKey->pcName[ KVSTORE_KEY_MAX_LEN ] = '\0';
+            pxDynamicKey->type = xType;
+
+            xKey = xKeyCount;
+            xKeyCount++;
+
+            vBuildKeyHash();
+        }
+    #endif
+    else
+    {
+        LogError( "No room to register key: %s, increase KVSTORE_DYNAMIC_KEYS_MAX.", pcKey );
+    }
+
+    return xKey;
+}
+
+KVStoreKey_t KVStore_registerKey( const char * pcKey,
+                                  KVStoreValueType_t xType )
+{
+    KVStoreKey_t xKey = KVSTORE_KEY_INVALID;
+    KVStoreKey_t xPrevCount = 0;
+
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+    xPrevCount = xKeyCount;
+    xKey = xprvRegisterKey( pcKey, xType );
+
+    #if KV_STORE_CACHE_ENABLE
+        /* Pick up any value stored by a previous boot */
+        if( xKeyCount != xPrevCount )
+        {
+            vprvCacheLoadEntry( xKey );
+        }
+    #else
+        ( void ) xPrevCount;
+    #endif
+
+    ( void ) xSemaphoreGive( xKvMutex );
 
     return xKey;
 }
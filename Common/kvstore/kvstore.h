@@ -67,6 +67,22 @@ extern const char * const kvStoreKeyMap[ CS_NUM_KEYS ];
 
 typedef enum KvStoreEnum KVStoreKey_t;
 
+/* Number of keys which may be added at runtime with KVStore_registerKey */
+#ifndef KVSTORE_DYNAMIC_KEYS_MAX
+    #define KVSTORE_DYNAMIC_KEYS_MAX    0
+#endif
+
+/* Keys registered at runtime are numbered after the static keys of KVStoreKey_t */
+#define KVSTORE_NUM_KEYS       ( CS_NUM_KEYS + KVSTORE_DYNAMIC_KEYS_MAX )
+#define KVSTORE_KEY_INVALID    ( ( KVStoreKey_t ) KVSTORE_NUM_KEYS )
+
+/*
+ * Called after a new value of xKey has been committed to non-volatile memory. Runs in the
+ * context of the committing task, which may be the kvstore commit task, so it must not block.
+ */
+typedef void ( * KVStoreChangeCallback_t )( KVStoreKey_t xKey,
+                                            void * pvCtx );
+
 /* Public function definitions */
 void KVStore_init( void );
 
@@ -91,6 +107,16 @@ char * KVStore_getStringHeap( KVStoreKey_t key,
 BaseType_t KVStore_setString( KVStoreKey_t key,
                               const char * pcNewValue );
 
+#if KV_STORE_CACHE_ENABLE
+
+/* Borrow a value from the cache without copying it. Release it with KVStore_peekEnd */
+    const char * KVStore_peekString( KVStoreKey_t key,
+                                     size_t * pxLength );
+    const void * KVStore_peekBlob( KVStoreKey_t key,
+                                   size_t * pxLength );
+    void KVStore_peekEnd( void );
+#endif /* KV_STORE_CACHE_ENABLE */
+
 uint32_t KVStore_getUInt32( KVStoreKey_t key,
                             BaseType_t * pxSuccess );
 BaseType_t KVStore_setUInt32( KVStoreKey_t key,
@@ -114,6 +140,21 @@ BaseType_t KVStore_setBase( KVStoreKey_t key,
 const char * kvKeyToString( KVStoreKey_t xKey );
 KVStoreKey_t kvStringToKey( const char * pcKey );
 
+KVStoreKey_t KVStore_registerKey( const char * pcKey,
+                                  KVStoreValueType_t xType );
+UBaseType_t KVStore_getNumKeys( void );
+
 BaseType_t KVStore_xCommitChanges( void );
 
+void KVStore_begin( void );
+BaseType_t KVStore_commit( void );
+void KVStore_commitDeferred( void );
+
+BaseType_t KVStore_subscribe( KVStoreKey_t key,
+                              KVStoreChangeCallback_t xCallback,
+                              void * pvCtx );
+void KVStore_unsubscribe( KVStoreKey_t key,
+                          KVStoreChangeCallback_t xCallback,
+                          void * pvCtx );
+
 #endif /* _KVSTORE_H */
@@ -45,7 +45,7 @@
         BaseType_t xChangePending;
     } KVStoreCacheEntry_t;
 
-    static KVStoreCacheEntry_t kvStoreCache[ CS_NUM_KEYS ] = { 0 };
+    static KVStoreCacheEntry_t kvStoreCache[ KVSTORE_NUM_KEYS ] = { 0 };
 
 
     static inline void * pvGetDataWritePtr( KVStoreKey_t key )
@@ -132,36 +132,49 @@
     }
 
 /*
- * @brief Initialize the Key Value Store Cache by reading each entry from the storage nvm store.
+ * @brief Load a single cache entry from the storage nvm store.
+ * @param[in] xKey The key to load.
  */
-    void vprvCacheInit( void )
+    void vprvCacheLoadEntry( KVStoreKey_t xKey )
     {
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
+
         #if KV_STORE_NVIMPL_ENABLE
-            /* Read from file system into ram */
-            for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
-            {
-                /* pvData pointer should be NULL on startup */
-                configASSERT_CONTINUE( kvStoreCache[ i ].pvData == NULL );
+            /* pvData pointer should be NULL on startup */
+            configASSERT_CONTINUE( kvStoreCache[ xKey ].pvData == NULL );
 
 
-                kvStoreCache[ i ].xChangePending = pdFALSE;
-                kvStoreCache[ i ].type = KV_TYPE_NONE;
+            kvStoreCache[ xKey ].xChangePending = pdFALSE;
+            kvStoreCache[ xKey ].type = KV_TYPE_NONE;
 
-                size_t xNvLength = xprvGetValueLengthFromImpl( i );
+            size_t xNvLength = xprvGetValueLengthFromImpl( xKey );
 
-                if( xNvLength > 0 )
-                {
-                    vAllocateDataBuffer( i, xNvLength );
+            if( xNvLength > 0 )
+            {
+                vAllocateDataBuffer( xKey, xNvLength );
 
-                    KVStoreValueType_t * pxType = &( kvStoreCache[ i ].type );
-                    size_t * pxLength = &( kvStoreCache[ i ].length );
+                KVStoreValueType_t * pxType = &( kvStoreCache[ xKey ].type );
+                size_t * pxLength = &( kvStoreCache[ xKey ].length );
 
-                    ( void ) xprvReadValueFromImpl( i, pxType, pxLength, pvGetDataWritePtr( i ), *pxLength );
-                }
+                ( void ) xprvReadValueFromImpl( xKey, pxType, pxLength, pvGetDataWritePtr( xKey ), *pxLength );
             }
+        #else
+            ( void ) xKey;
         #endif /* KV_STORE_NVIMPL_ENABLE */
     }
 
+/*
+ * @brief Initialize the Key Value Store Cache by reading each entry from the storage nvm store.
+ */
+    void vprvCacheInit( void )
+    {
+        /* Read from file system into ram, including runtime keys found while loading */
+        for( uint32_t i = 0; i < KVStore_getNumKeys(); i++ )
+        {
+            vprvCacheLoadEntry( i );
+        }
+    }
+
 /*
  * @brief Get the length of the value stored in the cache corresponding to a given key.
  * @param[in] xKey The key to lookup.
@@ -169,7 +182,7 @@
  */
     size_t prvGetCacheEntryLength( KVStoreKey_t xKey )
     {
-        configASSERT( xKey < CS_NUM_KEYS );
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
         return kvStoreCache[ xKey ].length;
     }
 
@@ -180,7 +193,7 @@
  */
     KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey )
     {
-        configASSERT( xKey < CS_NUM_KEYS );
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
         return kvStoreCache[ xKey ].type;
     }
 
@@ -197,7 +210,7 @@
                                     size_t xLength,
                                     const void * pvNewValue )
     {
-        configASSERT( xKey < CS_NUM_KEYS );
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
         configASSERT( xNewType < KV_TYPE_LAST );
         configASSERT( xLength > 0 );
         configASSERT( pvNewValue != NULL );
@@ -257,7 +270,7 @@
         const void * pvDataPtr = NULL;
         size_t xDataLen = 0;
 
-        configASSERT( xKey < CS_NUM_KEYS );
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
         configASSERT( pvBuffer != NULL );
 
         pvDataPtr = pvGetDataReadPtr( xKey );
@@ -269,7 +282,7 @@
             if( xBufferSize < xDataLen )
             {
                 LogWarn( "Read from key: %s was truncated from %d bytes to %d bytes.",
-                         kvStoreKeyMap[ xKey ], xDataLen, xBufferSize );
+                         kvKeyToString( xKey ), xDataLen, xBufferSize );
                 xDataLen = xBufferSize;
             }
 
@@ -289,21 +302,75 @@
         return( xDataLen > 0 );
     }
 
-    BaseType_t KVStore_xCommitChanges( void )
+/*
+ * @brief Return a pointer to the cached value of xKey without copying it.
+ * @return NULL if the key has no cached value.
+ */
+    const void * pvprvPeekCacheEntry( KVStoreKey_t xKey,
+                                      size_t * pxLength )
+    {
+        const void * pvDataPtr = NULL;
+
+        configASSERT( xKey < KVSTORE_NUM_KEYS );
+
+        pvDataPtr = pvGetDataReadPtr( xKey );
+
+        if( pxLength != NULL )
+        {
+            *pxLength = ( pvDataPtr != NULL ) ? kvStoreCache[ xKey ].length : 0;
+        }
+
+        return pvDataPtr;
+    }
+
+/*
+ * @brief Write every cache entry with a pending change to non-volatile storage as one batch.
+ * @param[out] pucCommitted Bitmap of KVSTORE_KEY_BITMAP_LEN bytes, the bit of each key
+ * written is set.
+ * @return pdTRUE if all pending changes were written.
+ */
+    BaseType_t xprvCommitCache( uint8_t * pucCommitted )
     {
         BaseType_t xSuccess = pdTRUE;
 
         #if KV_STORE_NVIMPL_ENABLE
-            for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+            vprvNvImplBeginBatch();
+
+            for( uint32_t i = 0; i < KVSTORE_NUM_KEYS; i++ )
             {
                 if( kvStoreCache[ i ].xChangePending == pdTRUE )
                 {
-                    xSuccess &= xprvWriteValueToImpl( i,
-                                                      kvStoreCache[ i ].type,
-                                                      kvStoreCache[ i ].length,
-                                                      pvGetDataReadPtr( i ) );
+                    if( xprvWriteValueToImpl( i,
+                                              kvStoreCache[ i ].type,
+                                              kvStoreCache[ i ].length,
+                                              pvGetDataReadPtr( i ) ) == pdTRUE )
+                    {
+                        kvStoreCache[ i ].xChangePending = pdFALSE;
+                        pucCommitted[ i / 8 ] |= ( uint8_t ) ( 1U << ( i % 8 ) );
+                    }
+                    else
+                    {
+                        xSuccess = pdFALSE;
+                    }
                 }
             }
+
+            if( xprvNvImplEndBatch() != pdTRUE )
+            {
+                /* The batch was not committed, write every value again next time */
+                for( uint32_t i = 0; i < KVSTORE_NUM_KEYS; i++ )
+                {
+                    if( kvStoreCache[ i ].type != KV_TYPE_NONE )
+                    {
+                        kvStoreCache[ i ].xChangePending = pdTRUE;
+                    }
+                }
+
+                ( void ) memset( pucCommitted, 0, KVSTORE_KEY_BITMAP_LEN );
+                xSuccess = pdFALSE;
+            }
+        #else
+            ( void ) pucCommitted;
         #endif /* if KV_STORE_NVIMPL_ENABLE */
         return xSuccess;
     }
@@ -30,7 +30,7 @@
 #include <string.h>
 #include "semphr.h"
 
-#ifdef KV_STORE_NVIMPL_LITTLEFS
+#if KV_STORE_NVIMPL_LITTLEFS
     #include "lfs.h"
     #include "fs/lfs_port.h"
 
@@ -89,7 +89,7 @@
         size_t xLength = 0;
 
         ( void ) strncpy( pcFileName, KVSTORE_PREFIX, KVSTORE_MAX_FNANME );
-        ( void ) strncat( pcFileName, kvStoreKeyMap[ xKey ], KVSTORE_MAX_FNANME );
+        ( void ) strncat( pcFileName, kvKeyToString( xKey ), KVSTORE_MAX_FNANME );
 
         if( lfs_stat( pLfsCtx, pcFileName, &xFileInfo ) == LFS_ERR_OK )
         {
@@ -112,7 +112,7 @@
         BaseType_t xFileOpenFlag = pdFALSE;
 
         ( void ) strncpy( pcFileName, KVSTORE_PREFIX, KVSTORE_MAX_FNANME );
-        ( void ) strncat( pcFileName, kvStoreKeyMap[ xKey ], KVSTORE_MAX_FNANME );
+        ( void ) strncat( pcFileName, kvKeyToString( xKey ), KVSTORE_MAX_FNANME );
 
         if( xValidateFile( pLfsCtx, pcFileName ) == pdTRUE )
         {
@@ -206,7 +206,7 @@
         {
             /* Construct file name */
             ( void ) strncpy( pcFileName, KVSTORE_PREFIX, KVSTORE_MAX_FNANME );
-            ( void ) strncat( pcFileName, kvStoreKeyMap[ xKey ], KVSTORE_MAX_FNANME );
+            ( void ) strncat( pcFileName, kvKeyToString( xKey ), KVSTORE_MAX_FNANME );
 
             /* Open the file */
             lReturn = lfs_file_open( pLfsCtx, &xFile, pcFileName, LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT );
@@ -265,4 +265,14 @@
     {
         /*TODO: Wait for filesystem initialization */
     }
+
+/* Each file is committed as it is written, so there is nothing to batch */
+    void vprvNvImplBeginBatch( void )
+    {
+    }
+
+    BaseType_t xprvNvImplEndBatch( void )
+    {
+        return pdTRUE;
+    }
 #endif /* KV_STORE_NVIMPL_LITTLEFS */
@@ -0,0 +1,734 @@
+/*
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+
+#include "logging_levels.h"
+#include "logging.h"
+#include "kvstore_prv.h"
+#include <string.h>
+
+#if KV_STORE_NVIMPL_LITTLEFS_LOG
+    #include "lfs.h"
+    #include "fs/lfs_port.h"
+
+/*
+ * All keys are kept in one append-only log of records. The latest record for a key wins.
+ * Once the superseded records add up to more than KVSTORE_LOG_COMPACT_SIZE and to more than
+ * the live records, the log is rewritten with only the live records and atomically renamed
+ * over the old log.
+ */
+    #define KVSTORE_LOG_FILE            "/cfg.log"
+    #define KVSTORE_LOG_TMP_FILE        "/cfg.log.tmp"
+    #define KVSTORE_LOG_MAGIC           ( 0x474F4C4BUL )
+    #define KVSTORE_LOG_VERSION         ( 1UL )
+
+    #ifndef KVSTORE_LOG_COMPACT_SIZE
+        #define KVSTORE_LOG_COMPACT_SIZE    ( 4096 )
+    #endif
+
+/* Directory and header of the one file per key layout, imported when no log exists yet */
+    #define KVSTORE_LEGACY_PREFIX        "/cfg/"
+    #define KVSTORE_LEGACY_MAX_FNAME     ( sizeof( KVSTORE_LEGACY_PREFIX ) + KVSTORE_KEY_MAX_LEN )
+
+    typedef struct
+    {
+        KVStoreValueType_t type;
+        size_t length;
+    } KVStoreLegacyHeader_t;
+
+    typedef struct
+    {
+        uint32_t ulMagic;
+        uint32_t ulVersion;
+    } KVStoreLogHeader_t;
+
+/* Followed by ucKeyLen bytes of key name and usLength bytes of value */
+    typedef struct
+    {
+        uint8_t ucKeyLen;
+        uint8_t ucType;
+        uint16_t usLength;
+    } KVStoreLogRecord_t;
+
+    typedef struct
+    {
+        KVStoreValueType_t type;
+        size_t xLength;
+        void * pvData;
+    } KVStoreLogEntry_t;
+
+    static KVStoreLogEntry_t xLogEntries[ KVSTORE_NUM_KEYS ] = { 0 };
+    static BaseType_t xLogLoaded = pdFALSE;
+    static BaseType_t xLogCompactPending = pdFALSE;
+    static lfs_soff_t xLogSize = 0;
+    static size_t xLogDeadSize = 0; /* Bytes of superseded records in the log */
+
+/* Appends made during a batch share one open file and are committed together when it closes */
+    static BaseType_t xBatchActive = pdFALSE;
+    static BaseType_t xBatchFileOpen = pdFALSE;
+    static lfs_file_t xBatchFile = { 0 };
+
+    static inline void vLfsSSizeToErr( lfs_ssize_t * pxReturnValue,
+                                       size_t xExpectedLength )
+    {
+        if( *pxReturnValue == xExpectedLength )
+        {
+            *pxReturnValue = LFS_ERR_OK;
+        }
+        else if( *pxReturnValue >= 0 )
+        {
+            *pxReturnValue = LFS_ERR_CORRUPT;
+        }
+        else
+        {
+            /* Pass through the error code otherwise */
+        }
+    }
+
+    static inline size_t xRecordSize( KVStoreKey_t xKey,
+                                      size_t xLength )
+    {
+        return( sizeof( KVStoreLogRecord_t ) + strnlen( kvKeyToString( xKey ), KVSTORE_KEY_MAX_LEN ) + xLength );
+    }
+
+/* Size of the record holding the current value of xKey, 0 if it has none */
+    static inline size_t xEntryRecordSize( KVStoreKey_t xKey )
+    {
+        return( ( xLogEntries[ xKey ].type != KV_TYPE_NONE ) ? xRecordSize( xKey, xLogEntries[ xKey ].xLength ) : 0 );
+    }
+
+/*
+ * @brief Replace the in memory value of a key, taking ownership of the heap buffer pvData.
+ */
+    static void vSetEntry( KVStoreKey_t xKey,
+                           KVStoreValueType_t xType,
+                           size_t xLength,
+                           void * pvData )
+    {
+        if( xLogEntries[ xKey ].pvData != NULL )
+        {
+            vPortFree( xLogEntries[ xKey ].pvData );
+        }
+
+        xLogEntries[ xKey ].type = xType;
+        xLogEntries[ xKey ].xLength = xLength;
+        xLogEntries[ xKey ].pvData = pvData;
+    }
+
+    static lfs_ssize_t lWriteRecord( lfs_t * pLfsCtx,
+                                     lfs_file_t * pxFile,
+                                     KVStoreKey_t xKey,
+                                     KVStoreValueType_t xType,
+                                     size_t xLength,
+                                     const void * pvData )
+    {
+        size_t xKeyLen = strnlen( kvKeyToString( xKey ), KVSTORE_KEY_MAX_LEN );
+        KVStoreLogRecord_t xRecord =
+        {
+            .ucKeyLen = ( uint8_t ) xKeyLen,
+            .ucType   = ( uint8_t ) xType,
+            .usLength = ( uint16_t ) xLength
+        };
+        lfs_ssize_t lReturn = lfs_file_write( pLfsCtx, pxFile, &xRecord, sizeof( KVStoreLogRecord_t ) );
+
+        vLfsSSizeToErr( &lReturn, sizeof( KVStoreLogRecord_t ) );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_file_write( pLfsCtx, pxFile, kvKeyToString( xKey ), xKeyLen );
+            vLfsSSizeToErr( &lReturn, xKeyLen );
+        }
+
+        if( ( lReturn == LFS_ERR_OK ) && ( xLength > 0 ) )
+        {
+            lReturn = lfs_file_write( pLfsCtx, pxFile, pvData, xLength );
+            vLfsSSizeToErr( &lReturn, xLength );
+        }
+
+        return lReturn;
+    }
+
+/*
+ * @brief Rewrite the log with one record per key, using the given value for xKey if it is valid.
+ */
+    static lfs_ssize_t lCompactLog( lfs_t * pLfsCtx,
+                                    KVStoreKey_t xKey,
+                                    KVStoreValueType_t xType,
+                                    size_t xLength,
+                                    const void * pvData )
+    {
+        lfs_file_t xFile = { 0 };
+        lfs_ssize_t lReturn = lfs_file_open( pLfsCtx, &xFile, KVSTORE_LOG_TMP_FILE, LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            KVStoreLogHeader_t xHeader =
+            {
+                .ulMagic   = KVSTORE_LOG_MAGIC,
+                .ulVersion = KVSTORE_LOG_VERSION
+            };
+
+            lReturn = lfs_file_write( pLfsCtx, &xFile, &xHeader, sizeof( KVStoreLogHeader_t ) );
+            vLfsSSizeToErr( &lReturn, sizeof( KVStoreLogHeader_t ) );
+
+            for( uint32_t i = 0; ( lReturn == LFS_ERR_OK ) && ( i < KVSTORE_NUM_KEYS ); i++ )
+            {
+                if( i == xKey )
+                {
+                    lReturn = lWriteRecord( pLfsCtx, &xFile, i, xType, xLength, pvData );
+                }
+                else if( xLogEntries[ i ].type != KV_TYPE_NONE )
+                {
+                    lReturn = lWriteRecord( pLfsCtx, &xFile, i, xLogEntries[ i ].type,
+                                            xLogEntries[ i ].xLength, xLogEntries[ i ].pvData );
+                }
+                else
+                {
+                    /* Empty */
+                }
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                xLogSize = lfs_file_size( pLfsCtx, &xFile );
+                xLogDeadSize = 0;
+            }
+
+            ( void ) lfs_file_close( pLfsCtx, &xFile );
+        }
+
+        /* The rename replaces the old log atomically */
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_rename( pLfsCtx, KVSTORE_LOG_TMP_FILE, KVSTORE_LOG_FILE );
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            xLogCompactPending = pdFALSE;
+        }
+        else
+        {
+            LogError( "Failed to compact the kvstore log, error: %d.", lReturn );
+            xLogCompactPending = pdTRUE;
+            ( void ) lfs_remove( pLfsCtx, KVSTORE_LOG_TMP_FILE );
+        }
+
+        return lReturn;
+    }
+
+    static lfs_ssize_t lBatchClose( lfs_t * pLfsCtx )
+    {
+        lfs_ssize_t lReturn = LFS_ERR_OK;
+
+        if( xBatchFileOpen == pdTRUE )
+        {
+            xBatchFileOpen = pdFALSE;
+            lReturn = lfs_file_close( pLfsCtx, &xBatchFile );
+
+            if( lReturn != LFS_ERR_OK )
+            {
+                /* The appended records were lost, the in memory values are rewritten next time */
+                LogError( "Failed to commit kvstore log batch, error: %d.", lReturn );
+                xLogCompactPending = pdTRUE;
+            }
+        }
+
+        return lReturn;
+    }
+
+/*
+ * @brief Read the values of the one file per key layout, sets *pxImported if there was any.
+ * Returns an error, other than for a missing or unreadable file, if the import has to be retried.
+ */
+    static lfs_ssize_t lImportLegacyFiles( lfs_t * pLfsCtx,
+                                           BaseType_t * pxImported )
+    {
+        lfs_ssize_t lError = LFS_ERR_OK;
+
+        *pxImported = pdFALSE;
+
+        for( uint32_t i = 0; ( lError == LFS_ERR_OK ) && ( i < CS_NUM_KEYS ); i++ )
+        {
+            char pcFileName[ KVSTORE_LEGACY_MAX_FNAME ] = { 0 };
+            lfs_file_t xFile = { 0 };
+            lfs_ssize_t lReturn = LFS_ERR_CORRUPT;
+
+            ( void ) strncpy( pcFileName, KVSTORE_LEGACY_PREFIX, KVSTORE_LEGACY_MAX_FNAME );
+            ( void ) strncat( pcFileName, kvKeyToString( i ), KVSTORE_LEGACY_MAX_FNAME - sizeof( KVSTORE_LEGACY_PREFIX ) );
+
+            lReturn = lfs_file_open( pLfsCtx, &xFile, pcFileName, LFS_O_RDONLY );
+
+            if( ( lReturn != LFS_ERR_OK ) &&
+                ( lReturn != LFS_ERR_NOENT ) )
+            {
+                lError = lReturn;
+            }
+            else if( lReturn == LFS_ERR_OK )
+            {
+                KVStoreLegacyHeader_t xHeader = { 0 };
+                void * pvData = NULL;
+
+                lReturn = lfs_file_read( pLfsCtx, &xFile, &xHeader, sizeof( KVStoreLegacyHeader_t ) );
+                vLfsSSizeToErr( &lReturn, sizeof( KVStoreLegacyHeader_t ) );
+
+                if( ( lReturn == LFS_ERR_OK ) &&
+                    ( xHeader.type > KV_TYPE_NONE ) &&
+                    ( xHeader.type < KV_TYPE_LAST ) &&
+                    ( xHeader.length > 0 ) &&
+                    ( xHeader.length <= KVSTORE_VAL_MAX_LEN ) )
+                {
+                    pvData = pvPortMalloc( xHeader.length );
+                    lReturn = ( pvData != NULL ) ? lfs_file_read( pLfsCtx, &xFile, pvData, xHeader.length ) : LFS_ERR_NOMEM;
+                    vLfsSSizeToErr( &lReturn, xHeader.length );
+                }
+
+                if( ( lReturn == LFS_ERR_OK ) && ( pvData != NULL ) )
+                {
+                    vSetEntry( i, xHeader.type, xHeader.length, pvData );
+                    *pxImported = pdTRUE;
+                }
+                else if( pvData != NULL )
+                {
+                    vPortFree( pvData );
+                }
+                else
+                {
+                    /* Empty */
+                }
+
+                /* A file with a bad header or length is skipped, a failed read is retried */
+                if( ( lReturn != LFS_ERR_OK ) &&
+                    ( lReturn != LFS_ERR_CORRUPT ) )
+                {
+                    lError = lReturn;
+                }
+
+                ( void ) lfs_file_close( pLfsCtx, &xFile );
+            }
+            else
+            {
+                /* No value for this key */
+            }
+        }
+
+        return lError;
+    }
+
+/*
+ * @brief Load every key from the log with a single sequential read.
+ *
+ * Only a missing log starts an empty store, and a record which does not parse ends the log. Any
+ * other error, such as a flash read or allocation failure, leaves the log unloaded so that the
+ * next call tries again instead of rewriting the stored values.
+ */
+    static BaseType_t xLoadLog( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+
+        if( ( xLogLoaded == pdFALSE ) && ( pLfsCtx != NULL ) )
+        {
+            lfs_file_t xFile = { 0 };
+            lfs_ssize_t lReturn = lfs_file_open( pLfsCtx, &xFile, KVSTORE_LOG_FILE, LFS_O_RDONLY );
+
+            xLogSize = 0;
+            xLogDeadSize = 0;
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                KVStoreLogHeader_t xHeader = { 0 };
+                lfs_soff_t xFileSize = lfs_file_size( pLfsCtx, &xFile );
+
+                lReturn = ( xFileSize < 0 ) ? ( lfs_ssize_t ) xFileSize :
+                          lfs_file_read( pLfsCtx, &xFile, &xHeader, sizeof( KVStoreLogHeader_t ) );
+                vLfsSSizeToErr( &lReturn, sizeof( KVStoreLogHeader_t ) );
+
+                if( ( lReturn == LFS_ERR_OK ) &&
+                    ( xHeader.ulMagic == KVSTORE_LOG_MAGIC ) &&
+                    ( xHeader.ulVersion == KVSTORE_LOG_VERSION ) )
+                {
+                    xLogSize = sizeof( KVStoreLogHeader_t );
+                }
+
+                /* Stop at the first record which does not parse, anything after it is dropped */
+                while( ( xLogSize > 0 ) && ( xLogSize < xFileSize ) )
+                {
+                    KVStoreLogRecord_t xRecord = { 0 };
+                    char pcKeyName[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+                    KVStoreKey_t xKey = KVSTORE_KEY_INVALID;
+                    void * pvData = NULL;
+                    size_t xSize = 0;
+
+                    lReturn = lfs_file_read( pLfsCtx, &xFile, &xRecord, sizeof( KVStoreLogRecord_t ) );
+                    vLfsSSizeToErr( &lReturn, sizeof( KVStoreLogRecord_t ) );
+
+                    if( ( lReturn == LFS_ERR_OK ) &&
+                        ( ( xRecord.ucKeyLen > KVSTORE_KEY_MAX_LEN ) ||
+                          ( xRecord.usLength > KVSTORE_VAL_MAX_LEN ) ) )
+                    {
+                        lReturn = LFS_ERR_CORRUPT;
+                    }
+
+                    if( lReturn == LFS_ERR_OK )
+                    {
+                        lReturn = lfs_file_read( pLfsCtx, &xFile, pcKeyName, xRecord.ucKeyLen );
+                        vLfsSSizeToErr( &lReturn, xRecord.ucKeyLen );
+                    }
+
+                    if( ( lReturn == LFS_ERR_OK ) && ( xRecord.usLength > 0 ) )
+                    {
+                        pvData = pvPortMalloc( xRecord.usLength );
+                        lReturn = ( pvData != NULL ) ? lfs_file_read( pLfsCtx, &xFile, pvData, xRecord.usLength ) : LFS_ERR_NOMEM;
+                        vLfsSSizeToErr( &lReturn, xRecord.usLength );
+                    }
+
+                    if( lReturn != LFS_ERR_OK )
+                    {
+                        if( pvData != NULL )
+                        {
+                            vPortFree( pvData );
+                        }
+
+                        if( lReturn == LFS_ERR_CORRUPT )
+                        {
+                            LogWarn( "Discarding %ld bytes of the kvstore log after offset %ld.",
+                                     ( long ) ( xFileSize - xLogSize ), ( long ) xLogSize );
+                            xLogCompactPending = pdTRUE;
+                        }
+
+                        break;
+                    }
+
+                    xKey = kvStringToKey( pcKeyName );
+
+                    /* Runtime keys are registered again from the log, before the application asks for them */
+                    if( ( xKey == KVSTORE_KEY_INVALID ) &&
+                        ( xRecord.ucType > KV_TYPE_NONE ) &&
+                        ( xRecord.ucType < KV_TYPE_LAST ) )
+                    {
+                        xKey = xprvRegisterKey( pcKeyName, ( KVStoreValueType_t ) xRecord.ucType );
+                    }
+
+                    xSize = sizeof( KVStoreLogRecord_t ) + xRecord.ucKeyLen + xRecord.usLength;
+                    xLogSize += xSize;
+
+                    /* Records of keys which can not be registered are dropped on the next compaction */
+                    if( ( xKey < KVSTORE_NUM_KEYS ) &&
+                        ( xRecord.ucType < KV_TYPE_LAST ) )
+                    {
+                        xLogDeadSize += xEntryRecordSize( xKey );
+                        vSetEntry( xKey, ( KVStoreValueType_t ) xRecord.ucType, xRecord.usLength, pvData );
+                    }
+                    else
+                    {
+                        xLogDeadSize += xSize;
+
+                        if( pvData != NULL )
+                        {
+                            vPortFree( pvData );
+                        }
+                    }
+                }
+
+                ( void ) lfs_file_close( pLfsCtx, &xFile );
+
+                if( ( lReturn != LFS_ERR_OK ) &&
+                    ( lReturn != LFS_ERR_CORRUPT ) )
+                {
+                    LogError( "Failed to read the kvstore log, error: %d.", lReturn );
+                }
+                else if( xLogSize == 0 )
+                {
+                    LogError( "Invalid kvstore log header, the log will be rewritten." );
+                    xLogCompactPending = pdTRUE;
+                    xLogLoaded = pdTRUE;
+                }
+                else
+                {
+                    xLogLoaded = pdTRUE;
+                }
+            }
+            else if( lReturn != LFS_ERR_NOENT )
+            {
+                LogError( "Failed to open the kvstore log, error: %d.", lReturn );
+            }
+            else
+            {
+                BaseType_t xImported = pdFALSE;
+
+                lReturn = lImportLegacyFiles( pLfsCtx, &xImported );
+
+                if( lReturn != LFS_ERR_OK )
+                {
+                    LogError( "Failed to import the kvstore values from " KVSTORE_LEGACY_PREFIX ", error: %d.", lReturn );
+                }
+                else if( xImported == pdTRUE )
+                {
+                    LogInfo( "Importing kvstore values from " KVSTORE_LEGACY_PREFIX " into " KVSTORE_LOG_FILE "." );
+                    ( void ) lCompactLog( pLfsCtx, KVSTORE_KEY_INVALID, KV_TYPE_NONE, 0, NULL );
+                    xLogLoaded = pdTRUE;
+                }
+                else
+                {
+                    /* The log is created by the first write */
+                    xLogLoaded = pdTRUE;
+                }
+            }
+
+            if( xLogLoaded == pdFALSE )
+            {
+                /* The next call replays the log from the start */
+                for( uint32_t i = 0; i < KVSTORE_NUM_KEYS; i++ )
+                {
+                    vSetEntry( i, KV_TYPE_NONE, 0, NULL );
+                }
+
+                xLogSize = 0;
+                xLogDeadSize = 0;
+            }
+        }
+
+        return xLogLoaded;
+    }
+
+/*
+ * @brief Get the length of a value stored in the KVStore implementation
+ * @param[in] xKey Key to lookup
+ * @return length of the value stored in the KVStore or 0 if not found.
+ */
+    size_t xprvGetValueLengthFromImpl( KVStoreKey_t xKey )
+    {
+        size_t xLength = 0;
+
+        if( ( xLoadLog() == pdTRUE ) &&
+            ( xLogEntries[ xKey ].type != KV_TYPE_NONE ) )
+        {
+            xLength = xLogEntries[ xKey ].xLength;
+        }
+
+        return xLength;
+    }
+
+    BaseType_t xprvReadValueFromImpl( KVStoreKey_t xKey,
+                                      KVStoreValueType_t * pxType,
+                                      size_t * pxLength,
+                                      void * pvBuffer,
+                                      size_t xBufferSize )
+    {
+        BaseType_t xSuccess = pdFALSE;
+
+        if( ( xLoadLog() == pdTRUE ) &&
+            ( xLogEntries[ xKey ].type != KV_TYPE_NONE ) &&
+            ( xLogEntries[ xKey ].xLength <= xBufferSize ) )
+        {
+            ( void ) memcpy( pvBuffer, xLogEntries[ xKey ].pvData, xLogEntries[ xKey ].xLength );
+            xSuccess = pdTRUE;
+        }
+
+        if( pxType != NULL )
+        {
+            *pxType = ( xSuccess == pdTRUE ) ? xLogEntries[ xKey ].type : KV_TYPE_NONE;
+        }
+
+        if( pxLength != NULL )
+        {
+            *pxLength = ( xSuccess == pdTRUE ) ? xLogEntries[ xKey ].xLength : 0;
+        }
+
+        return xSuccess;
+    }
+
+    BaseType_t xprvReadValueFromImplStatic( KVStoreKey_t xKey,
+                                            KVStoreValueType_t * pxType,
+                                            size_t * pxLength,
+                                            void * pvBuffer,
+                                            size_t xBufferSize )
+    {
+        return xprvReadValueFromImpl( xKey, pxType, pxLength, pvBuffer, xBufferSize );
+    }
+
+/*
+ * @brief Write a value for a given key to non-volatile storage.
+ * @param[in] xKey Key to store the given value in.
+ * @param[in] xType Type of value to record.
+ * @param[in] xLength length of the value given in pxDataUnion.
+ * @param[in] pxData Pointer to a buffer containing the value to be stored.
+ * The caller must free any heap allocated buffers passed into this function.
+ */
+    BaseType_t xprvWriteValueToImpl( KVStoreKey_t xKey,
+                                     KVStoreValueType_t xType,
+                                     size_t xLength,
+                                     const void * pvData )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        lfs_ssize_t lReturn = LFS_ERR_INVAL;
+        void * pvCopy = NULL;
+        size_t xDeadSize = 0;
+
+        if( ( pvData != NULL ) &&
+            ( xLength > 0 ) &&
+            ( xLength <= KVSTORE_VAL_MAX_LEN ) &&
+            ( xLoadLog() == pdTRUE ) )
+        {
+            pvCopy = pvPortMalloc( xLength );
+            lReturn = ( pvCopy != NULL ) ? LFS_ERR_OK : LFS_ERR_NOMEM;
+
+            /* The record of the current value is superseded by this write */
+            xDeadSize = xLogDeadSize + xEntryRecordSize( xKey );
+        }
+
+        if( lReturn != LFS_ERR_OK )
+        {
+            /* Empty */
+        }
+        else if( ( xLogCompactPending == pdTRUE ) ||
+                 ( xLogSize == 0 ) ||
+                 ( ( xDeadSize > KVSTORE_LOG_COMPACT_SIZE ) &&
+                   ( xDeadSize > ( ( size_t ) xLogSize - xLogDeadSize ) ) ) )
+        {
+            lReturn = lBatchClose( pLfsCtx );
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = lCompactLog( pLfsCtx, xKey, xType, xLength, pvData );
+            }
+        }
+        else
+        {
+            lfs_file_t * pxFile = &xBatchFile;
+
+            /* A single append, committed when the file is closed */
+            if( xBatchFileOpen == pdFALSE )
+            {
+                lReturn = lfs_file_open( pLfsCtx, pxFile, KVSTORE_LOG_FILE, LFS_O_WRONLY | LFS_O_APPEND );
+                xBatchFileOpen = ( lReturn == LFS_ERR_OK ) ? pdTRUE : pdFALSE;
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = lWriteRecord( pLfsCtx, pxFile, xKey, xType, xLength, pvData );
+
+                if( lReturn == LFS_ERR_OK )
+                {
+                    xLogSize += xRecordSize( xKey, xLength );
+                    xLogDeadSize = xDeadSize;
+                }
+                else
+                {
+                    /* Do not leave a partial record behind */
+                    ( void ) lfs_file_truncate( pLfsCtx, pxFile, xLogSize );
+                }
+            }
+
+            if( ( lReturn == LFS_ERR_OK ) &&
+                ( xBatchActive == pdFALSE ) )
+            {
+                lReturn = lBatchClose( pLfsCtx );
+            }
+            else if( lReturn != LFS_ERR_OK )
+            {
+                ( void ) lBatchClose( pLfsCtx );
+            }
+            else
+            {
+                /* Committed by xprvNvImplEndBatch */
+            }
+
+            if( lReturn != LFS_ERR_OK )
+            {
+                LogError( "Error while appending %lu bytes for key %s to the kvstore log.",
+                          ( unsigned long ) xLength, kvKeyToString( xKey ) );
+            }
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            ( void ) memcpy( pvCopy, pvData, xLength );
+            vSetEntry( xKey, xType, xLength, pvCopy );
+        }
+        else if( pvCopy != NULL )
+        {
+            vPortFree( pvCopy );
+        }
+        else
+        {
+            /* Empty */
+        }
+
+        return( lReturn == LFS_ERR_OK );
+    }
+
+    void vprvNvImplInit( void )
+    {
+        ( void ) xLoadLog();
+    }
+
+/*
+ * @brief Close the log and drop the values read from it, as on a reset, so that the next access
+ * replays the log from flash. Used by the host self test.
+ */
+    void vprvNvImplDeinit( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+
+        if( pLfsCtx != NULL )
+        {
+            ( void ) lBatchClose( pLfsCtx );
+        }
+
+        for( uint32_t i = 0; i < KVSTORE_NUM_KEYS; i++ )
+        {
+            vSetEntry( i, KV_TYPE_NONE, 0, NULL );
+        }
+
+        xBatchActive = pdFALSE;
+        xLogLoaded = pdFALSE;
+        xLogCompactPending = pdFALSE;
+        xLogSize = 0;
+        xLogDeadSize = 0;
+    }
+
+    void vprvNvImplBeginBatch( void )
+    {
+        xBatchActive = pdTRUE;
+    }
+
+    BaseType_t xprvNvImplEndBatch( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        BaseType_t xSuccess = pdTRUE;
+
+        xBatchActive = pdFALSE;
+
+        if( ( pLfsCtx != NULL ) &&
+            ( lBatchClose( pLfsCtx ) != LFS_ERR_OK ) )
+        {
+            xSuccess = pdFALSE;
+        }
+
+        return xSuccess;
+    }
+#endif /* KV_STORE_NVIMPL_LITTLEFS_LOG */
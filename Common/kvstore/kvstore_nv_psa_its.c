@@ -31,6 +31,12 @@
 
 #if KV_STORE_NVIMPL_ARM_PSA
     #include "psa/internal_trusted_storage.h"
+    #include "tfm_ns_interface_freertos.h"
+
+/* Define KVSTORE_PSA_PACKED to 1 to store all values in a single ITS object */
+    #ifndef KVSTORE_PSA_PACKED
+        #define KVSTORE_PSA_PACKED    0
+    #endif
 
     #define KVSTORE_UID_OFFSET    0x1234
 
@@ -40,9 +46,30 @@
         size_t length; /* Length of value portion (excludes type and length fields */
     } KVStoreHeader_t;
 
+/* Runtime keys are numbered in registration order, so their UID is derived from the name */
+    #define KVSTORE_UID_DYNAMIC_BASE    ( 0x4B56000000000000ULL )
+
     static inline psa_storage_uid_t xKeyToUID( KVStoreKey_t xKey )
     {
-        return( KVSTORE_UID_OFFSET + xKey );
+        psa_storage_uid_t xUid = KVSTORE_UID_OFFSET + xKey;
+
+        if( xKey >= CS_NUM_KEYS )
+        {
+            const char * pcKey = kvKeyToString( xKey );
+            uint32_t ulHash = 2166136261UL;
+
+            /* FNV-1a */
+            while( ( pcKey != NULL ) && ( *pcKey != '\0' ) )
+            {
+                ulHash ^= ( uint8_t ) *pcKey;
+                ulHash *= 16777619UL;
+                pcKey++;
+            }
+
+            xUid = KVSTORE_UID_DYNAMIC_BASE | ulHash;
+        }
+
+        return xUid;
     }
 
     static inline BaseType_t xPSAStatusToBool( psa_status_t xStatus )
@@ -51,11 +78,11 @@
     }
 
 /*
- * @brief Get the length of a value stored in the KVStore implementation
+ * @brief Get the length of a value stored in the ITS object of a single key
  * @param[in] xKey Key to lookup
  * @return length of the value stored in the KVStore or 0 if not found.
  */
-    size_t xprvGetValueLengthFromImpl( const KVStoreKey_t xKey )
+    static size_t xKeyObjectLength( const KVStoreKey_t xKey )
     {
         size_t xLength = 0;
         struct psa_storage_info_t xStorageInfo = { 0 };
@@ -69,7 +96,7 @@
     }
 
 /*
- * @brief Read the value for the given key into a given buffer.
+ * @brief Read the value for the given key from its own ITS object into a given buffer.
  * @param[in] xKey The key to lookup
  * @param[out] pxType The type of the value returned.
  * @param[out] pxLength Pointer to store the length of the read value in.
@@ -77,7 +104,7 @@
  * @param[in] xBufferSize The length of the provided buffer.
  * @return pdTRUE on success, otherwise pdFALSE.
  */
-    BaseType_t xprvReadValueFromImpl( const KVStoreKey_t xKey,
+    static BaseType_t xReadKeyObject( const KVStoreKey_t xKey,
                                       KVStoreValueType_t * pxType,
                                       size_t * pxLength,
                                       void * pvBuffer,
@@ -86,6 +113,7 @@
         size_t uxDataLength = 0;
         psa_status_t xResult = PSA_SUCCESS;
         KVStoreHeader_t xHeader = { 0 };
+        BaseType_t xBatch = pdFALSE;
 
         xHeader.length = 0;
         xHeader.type = KV_TYPE_NONE;
@@ -95,6 +123,12 @@
             xResult = -1;
         }
 
+        /* Read the header and the value in one hold of the secure interface */
+        if( xResult == PSA_SUCCESS )
+        {
+            xBatch = ( ns_interface_batch_begin() == 0 ) ? pdTRUE : pdFALSE;
+        }
+
         /* Read header */
         if( xResult == PSA_SUCCESS )
         {
@@ -134,6 +168,11 @@
             }
         }
 
+        if( xBatch == pdTRUE )
+        {
+            ns_interface_batch_end();
+        }
+
         /* Set type if input is not null */
         if( pxType != NULL )
         {
@@ -150,22 +189,22 @@
     }
 
 /*
- * @brief Write a value for a given key to non-volatile storage.
+ * @brief Write a value for a given key to its own ITS object.
  * @param[in] xKey Key to store the given value in.
  * @param[in] xType Type of value to record.
  * @param[in] xLength length of the value given in pxDataUnion.
  * @param[in] pxData Pointer to a buffer containing the value to be stored.
  * The caller must free any heap allocated buffers passed into this function.
  */
-    BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
-                                     const KVStoreValueType_t xType,
-                                     const size_t xLength,
-                                     const void * pvData )
+    static BaseType_t xWriteKeyObject( const KVStoreKey_t xKey,
+                                       const KVStoreValueType_t xType,
+                                       const size_t xLength,
+                                       const void * pvData )
     {
         psa_status_t xResult = PSA_SUCCESS;
         void * pvBuffer = NULL;
 
-        if( ( xKey > CS_NUM_KEYS ) ||
+        if( ( xKey >= KVSTORE_NUM_KEYS ) ||
             ( xType == KV_TYPE_NONE ) ||
             ( xLength < 0 ) ||
             ( pvData == NULL ) )
@@ -215,9 +254,537 @@
         return xPSAStatusToBool( xResult );
     }
 
-    void vprvNvImplInit( void )
-    {
+    #if ( KVSTORE_PSA_PACKED == 0 )
+
+/*
+ * @brief Get the length of a value stored in the KVStore implementation
+ * @param[in] xKey Key to lookup
+ * @return length of the value stored in the KVStore or 0 if not found.
+ */
+        size_t xprvGetValueLengthFromImpl( const KVStoreKey_t xKey )
+        {
+            return xKeyObjectLength( xKey );
+        }
+
+        BaseType_t xprvReadValueFromImpl( const KVStoreKey_t xKey,
+                                          KVStoreValueType_t * pxType,
+                                          size_t * pxLength,
+                                          void * pvBuffer,
+                                          size_t xBufferSize )
+        {
+            return xReadKeyObject( xKey, pxType, pxLength, pvBuffer, xBufferSize );
+        }
+
+        BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
+                                         const KVStoreValueType_t xType,
+                                         const size_t xLength,
+                                         const void * pvData )
+        {
+            return xWriteKeyObject( xKey, xType, xLength, pvData );
+        }
+
+        void vprvNvImplInit( void )
+        {
 /*	tfm_its_init(); */
-    }
+        }
+
+/* Each psa_its_set() is committed on its own, so there is nothing to batch */
+        void vprvNvImplBeginBatch( void )
+        {
+        }
+
+        BaseType_t xprvNvImplEndBatch( void )
+        {
+            return pdTRUE;
+        }
+
+    #else /* KVSTORE_PSA_PACKED */
+
+/*
+ * All values are packed into a single ITS object which is read once at init and written
+ * back once per batch, instead of one secure call per key. A value which does not fit in
+ * KVSTORE_PSA_PACKED_MAX_SIZE is kept in its own object as in the unpacked layout, and its
+ * record only holds the key name and type.
+ */
+        #define KVSTORE_UID_PACKED         ( KVSTORE_UID_OFFSET - 1 )
+        #define KVSTORE_PACKED_MAGIC       ( 0x53504B4BUL )
+        #define KVSTORE_PACKED_VERSION     ( 1UL )
+        #define KVSTORE_PACKED_EXTERNAL    ( UINT16_MAX )
+
+/* Must not exceed ITS_MAX_ASSET_SIZE of the secure image */
+        #ifndef KVSTORE_PSA_PACKED_MAX_SIZE
+            #define KVSTORE_PSA_PACKED_MAX_SIZE    ( 512 )
+        #endif
+
+        typedef struct
+        {
+            uint32_t ulMagic;
+            uint32_t ulVersion;
+        } KVStorePackedHeader_t;
+
+/* Followed by ucKeyLen bytes of key name and usLength bytes of value */
+        typedef struct
+        {
+            uint8_t ucKeyLen;
+            uint8_t ucType;
+            uint16_t usLength;
+        } KVStorePackedRecord_t;
+
+        typedef struct
+        {
+            KVStoreValueType_t type;
+            size_t xLength;
+            void * pvData;
+            BaseType_t xExternal; /* The value is stored in its own ITS object */
+            BaseType_t xDirty;    /* The value changed since the last flush */
+        } KVStorePackedEntry_t;
+
+        static KVStorePackedEntry_t xPackedEntries[ KVSTORE_NUM_KEYS ] = { 0 };
+        static BaseType_t xPackedLoaded = pdFALSE;
+        static BaseType_t xFlushPending = pdFALSE;
+        static BaseType_t xBatchActive = pdFALSE;
+
+/*
+ * @brief Replace the in memory value of a key, taking ownership of the heap buffer pvData.
+ */
+        static void vSetEntry( KVStoreKey_t xKey,
+                               KVStoreValueType_t xType,
+                               size_t xLength,
+                               void * pvData )
+        {
+            if( xPackedEntries[ xKey ].pvData != NULL )
+            {
+                explicit_bzero( xPackedEntries[ xKey ].pvData, xPackedEntries[ xKey ].xLength );
+                vPortFree( xPackedEntries[ xKey ].pvData );
+            }
+
+            xPackedEntries[ xKey ].type = xType;
+            xPackedEntries[ xKey ].xLength = xLength;
+            xPackedEntries[ xKey ].pvData = pvData;
+        }
+
+/*
+ * @brief Write the packed object, preceded by the own objects of values which do not fit in it.
+ */
+        static BaseType_t xFlushPacked( void )
+        {
+            uint8_t * pucImage = pvPortMalloc( KVSTORE_PSA_PACKED_MAX_SIZE );
+            uint8_t pucExternal[ KVSTORE_KEY_BITMAP_LEN ] = { 0 };
+            size_t xOffset = sizeof( KVStorePackedHeader_t );
+            psa_status_t xResult = ( pucImage != NULL ) ? PSA_SUCCESS : PSA_ERROR_INSUFFICIENT_MEMORY;
+
+            if( xResult == PSA_SUCCESS )
+            {
+                KVStorePackedHeader_t xHeader =
+                {
+                    .ulMagic   = KVSTORE_PACKED_MAGIC,
+                    .ulVersion = KVSTORE_PACKED_VERSION
+                };
+
+                ( void ) memcpy( pucImage, &xHeader, sizeof( KVStorePackedHeader_t ) );
+            }
+
+            for( uint32_t i = 0; ( xResult == PSA_SUCCESS ) && ( i < KVSTORE_NUM_KEYS ); i++ )
+            {
+                KVStorePackedEntry_t * pxEntry = &( xPackedEntries[ i ] );
+
+                if( pxEntry->type != KV_TYPE_NONE )
+                {
+                    size_t xKeyLen = strnlen( kvKeyToString( i ), KVSTORE_KEY_MAX_LEN );
+                    KVStorePackedRecord_t xRecord =
+                    {
+                        .ucKeyLen = ( uint8_t ) xKeyLen,
+                        .ucType   = ( uint8_t ) pxEntry->type,
+                        .usLength = ( uint16_t ) pxEntry->xLength
+                    };
+
+                    if( ( xOffset + sizeof( KVStorePackedRecord_t ) + xKeyLen + pxEntry->xLength ) > KVSTORE_PSA_PACKED_MAX_SIZE )
+                    {
+                        xRecord.usLength = KVSTORE_PACKED_EXTERNAL;
+                        pucExternal[ i / 8 ] |= ( uint8_t ) ( 1U << ( i % 8 ) );
+
+                        if( ( pxEntry->xDirty == pdTRUE ) || ( pxEntry->xExternal == pdFALSE ) )
+                        {
+                            xResult = ( xWriteKeyObject( i, pxEntry->type, pxEntry->xLength, pxEntry->pvData ) == pdTRUE ) ?
+                                      PSA_SUCCESS : PSA_ERROR_GENERIC_ERROR;
+                        }
+                    }
+
+                    if( xResult != PSA_SUCCESS )
+                    {
+                        /* Empty */
+                    }
+                    else if( ( xOffset + sizeof( KVStorePackedRecord_t ) + xKeyLen ) > KVSTORE_PSA_PACKED_MAX_SIZE )
+                    {
+                        LogError( "Too many keys for KVSTORE_PSA_PACKED_MAX_SIZE: %ld bytes.", KVSTORE_PSA_PACKED_MAX_SIZE );
+                        xResult = PSA_ERROR_INSUFFICIENT_STORAGE;
+                    }
+                    else
+                    {
+                        ( void ) memcpy( &( pucImage[ xOffset ] ), &xRecord, sizeof( KVStorePackedRecord_t ) );
+                        xOffset += sizeof( KVStorePackedRecord_t );
+
+                        ( void ) memcpy( &( pucImage[ xOffset ] ), kvKeyToString( i ), xKeyLen );
+                        xOffset += xKeyLen;
+
+                        if( xRecord.usLength != KVSTORE_PACKED_EXTERNAL )
+                        {
+                            ( void ) memcpy( &( pucImage[ xOffset ] ), pxEntry->pvData, pxEntry->xLength );
+                            xOffset += pxEntry->xLength;
+                        }
+                    }
+                }
+            }
+
+            if( xResult == PSA_SUCCESS )
+            {
+                xResult = psa_its_set( KVSTORE_UID_PACKED, xOffset, pucImage, 0 );
+            }
+
+            if( xResult == PSA_SUCCESS )
+            {
+                for( uint32_t i = 0; i < KVSTORE_NUM_KEYS; i++ )
+                {
+                    BaseType_t xExternal = ( ( pucExternal[ i / 8 ] & ( 1U << ( i % 8 ) ) ) != 0 ) ? pdTRUE : pdFALSE;
+
+                    /* The packed object no longer refers to the old object of this key */
+                    if( ( xPackedEntries[ i ].xExternal == pdTRUE ) && ( xExternal == pdFALSE ) )
+                    {
+                        ( void ) psa_its_remove( xKeyToUID( i ) );
+                    }
+
+                    xPackedEntries[ i ].xExternal = xExternal;
+                    xPackedEntries[ i ].xDirty = pdFALSE;
+                }
+
+                xFlushPending = pdFALSE;
+            }
+            else
+            {
+                LogError( "Failed to write the packed kvstore object, error: %ld.", xResult );
+            }
+
+            if( pucImage != NULL )
+            {
+                explicit_bzero( pucImage, KVSTORE_PSA_PACKED_MAX_SIZE );
+                vPortFree( pucImage );
+            }
+
+            return xPSAStatusToBool( xResult );
+        }
+
+/*
+ * @brief Load a value from its own ITS object into memory.
+ */
+        static BaseType_t xLoadKeyObject( KVStoreKey_t xKey )
+        {
+            size_t xLength = xKeyObjectLength( xKey );
+            KVStoreValueType_t xType = KV_TYPE_NONE;
+            void * pvData = NULL;
+            BaseType_t xSuccess = pdFALSE;
+
+            if( ( xLength > 0 ) && ( xLength <= KVSTORE_VAL_MAX_LEN ) )
+            {
+                pvData = pvPortMalloc( xLength );
+            }
+
+            if( pvData != NULL )
+            {
+                xSuccess = xReadKeyObject( xKey, &xType, NULL, pvData, xLength );
+            }
 
+            if( ( xSuccess == pdTRUE ) &&
+                ( xType > KV_TYPE_NONE ) &&
+                ( xType < KV_TYPE_LAST ) )
+            {
+                vSetEntry( xKey, xType, xLength, pvData );
+                xPackedEntries[ xKey ].xExternal = pdTRUE;
+            }
+            else if( pvData != NULL )
+            {
+                vPortFree( pvData );
+                xSuccess = pdFALSE;
+            }
+            else
+            {
+                xSuccess = pdFALSE;
+            }
+
+            return xSuccess;
+        }
+
+/*
+ * @brief Parse the records of the packed object read into pucImage.
+ */
+        static void vParsePacked( const uint8_t * pucImage,
+                                  size_t xImageLen )
+        {
+            KVStorePackedHeader_t xHeader = { 0 };
+            size_t xOffset = sizeof( KVStorePackedHeader_t );
+
+            if( xImageLen >= sizeof( KVStorePackedHeader_t ) )
+            {
+                ( void ) memcpy( &xHeader, pucImage, sizeof( KVStorePackedHeader_t ) );
+            }
+
+            if( ( xHeader.ulMagic != KVSTORE_PACKED_MAGIC ) ||
+                ( xHeader.ulVersion != KVSTORE_PACKED_VERSION ) )
+            {
+                LogError( "Invalid packed kvstore object header, it will be rewritten." );
+                xFlushPending = pdTRUE;
+                xOffset = xImageLen;
+            }
+
+            while( ( xOffset + sizeof( KVStorePackedRecord_t ) ) <= xImageLen )
+            {
+                KVStorePackedRecord_t xRecord = { 0 };
+                char pcKeyName[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+                KVStoreKey_t xKey = KVSTORE_KEY_INVALID;
+                size_t xValueLen = 0;
+
+                ( void ) memcpy( &xRecord, &( pucImage[ xOffset ] ), sizeof( KVStorePackedRecord_t ) );
+                xOffset += sizeof( KVStorePackedRecord_t );
+
+                xValueLen = ( xRecord.usLength == KVSTORE_PACKED_EXTERNAL ) ? 0 : xRecord.usLength;
+
+                if( ( xRecord.ucKeyLen > KVSTORE_KEY_MAX_LEN ) ||
+                    ( xRecord.ucType <= KV_TYPE_NONE ) ||
+                    ( xRecord.ucType >= KV_TYPE_LAST ) ||
+                    ( xValueLen > KVSTORE_VAL_MAX_LEN ) ||
+                    ( ( xOffset + xRecord.ucKeyLen + xValueLen ) > xImageLen ) )
+                {
+                    LogError( "Corrupt record at offset %ld of the packed kvstore object.",
+                              xOffset - sizeof( KVStorePackedRecord_t ) );
+                    xFlushPending = pdTRUE;
+                    break;
+                }
+
+                ( void ) memcpy( pcKeyName, &( pucImage[ xOffset ] ), xRecord.ucKeyLen );
+                xOffset += xRecord.ucKeyLen;
+
+                xKey = kvStringToKey( pcKeyName );
+
+                /* Runtime keys are registered again from the stored records */
+                if( xKey == KVSTORE_KEY_INVALID )
+                {
+                    xKey = xprvRegisterKey( pcKeyName, ( KVStoreValueType_t ) xRecord.ucType );
+                }
+
+                if( xKey == KVSTORE_KEY_INVALID )
+                {
+                    /* Dropped on the next flush */
+                }
+                else if( xRecord.usLength == KVSTORE_PACKED_EXTERNAL )
+                {
+                    ( void ) xLoadKeyObject( xKey );
+                }
+                else
+                {
+                    void * pvData = pvPortMalloc( xValueLen );
+
+                    if( pvData != NULL )
+                    {
+                        ( void ) memcpy( pvData, &( pucImage[ xOffset ] ), xValueLen );
+                        vSetEntry( xKey, ( KVStoreValueType_t ) xRecord.ucType, xValueLen, pvData );
+                    }
+                }
+
+                xOffset += xValueLen;
+            }
+        }
+
+/*
+ * @brief Load every key from the packed object, or import the one object per key layout
+ * when the packed object does not exist yet.
+ */
+        static void vLoadPacked( void )
+        {
+            struct psa_storage_info_t xStorageInfo = { 0 };
+            psa_status_t xResult = psa_its_get_info( KVSTORE_UID_PACKED, &xStorageInfo );
+
+            xPackedLoaded = pdTRUE;
+
+            if( xResult == PSA_SUCCESS )
+            {
+                uint8_t * pucImage = pvPortMalloc( xStorageInfo.size );
+                size_t xImageLen = 0;
+
+                xResult = ( pucImage != NULL ) ? PSA_SUCCESS : PSA_ERROR_INSUFFICIENT_MEMORY;
+
+                if( xResult == PSA_SUCCESS )
+                {
+                    xResult = psa_its_get( KVSTORE_UID_PACKED, 0, xStorageInfo.size, pucImage, &xImageLen );
+                }
+
+                if( xResult == PSA_SUCCESS )
+                {
+                    vParsePacked( pucImage, xImageLen );
+                }
+                else
+                {
+                    LogError( "Failed to read the packed kvstore object, error: %ld.", xResult );
+                }
+
+                if( pucImage != NULL )
+                {
+                    explicit_bzero( pucImage, xStorageInfo.size );
+                    vPortFree( pucImage );
+                }
+            }
+            else if( xResult == PSA_ERROR_DOES_NOT_EXIST )
+            {
+                BaseType_t xImported = pdFALSE;
+
+                for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+                {
+                    if( xLoadKeyObject( i ) == pdTRUE )
+                    {
+                        xImported = pdTRUE;
+                    }
+                }
+
+                if( xImported == pdTRUE )
+                {
+                    LogInfo( "Packing kvstore values into a single ITS object." );
+                    ( void ) xFlushPacked();
+                }
+            }
+            else
+            {
+                LogError( "Failed to query the packed kvstore object, error: %ld.", xResult );
+            }
+        }
+
+/*
+ * @brief Get the length of a value stored in the KVStore implementation
+ * @param[in] xKey Key to lookup
+ * @return length of the value stored in the KVStore or 0 if not found.
+ */
+        size_t xprvGetValueLengthFromImpl( const KVStoreKey_t xKey )
+        {
+            size_t xLength = 0;
+
+            if( xPackedLoaded == pdFALSE )
+            {
+                vLoadPacked();
+            }
+
+            if( xPackedEntries[ xKey ].type != KV_TYPE_NONE )
+            {
+                xLength = xPackedEntries[ xKey ].xLength;
+            }
+
+            return xLength;
+        }
+
+        BaseType_t xprvReadValueFromImpl( const KVStoreKey_t xKey,
+                                          KVStoreValueType_t * pxType,
+                                          size_t * pxLength,
+                                          void * pvBuffer,
+                                          size_t xBufferSize )
+        {
+            BaseType_t xSuccess = pdFALSE;
+
+            if( xPackedLoaded == pdFALSE )
+            {
+                vLoadPacked();
+            }
+
+            if( ( pvBuffer != NULL ) &&
+                ( xPackedEntries[ xKey ].type != KV_TYPE_NONE ) &&
+                ( xPackedEntries[ xKey ].xLength <= xBufferSize ) )
+            {
+                ( void ) memcpy( pvBuffer, xPackedEntries[ xKey ].pvData, xPackedEntries[ xKey ].xLength );
+                xSuccess = pdTRUE;
+            }
+
+            if( pxType != NULL )
+            {
+                *pxType = ( xSuccess == pdTRUE ) ? xPackedEntries[ xKey ].type : KV_TYPE_NONE;
+            }
+
+            if( pxLength != NULL )
+            {
+                *pxLength = ( xSuccess == pdTRUE ) ? xPackedEntries[ xKey ].xLength : 0;
+            }
+
+            return xSuccess;
+        }
+
+/*
+ * @brief Write a value for a given key to non-volatile storage.
+ * Within a batch the value is only staged in memory and written by xprvNvImplEndBatch.
+ * If the write fails the value is kept in memory and written again by the next flush.
+ */
+        BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
+                                         const KVStoreValueType_t xType,
+                                         const size_t xLength,
+                                         const void * pvData )
+        {
+            BaseType_t xSuccess = pdFALSE;
+
+            if( xPackedLoaded == pdFALSE )
+            {
+                vLoadPacked();
+            }
+
+            if( ( xKey < KVSTORE_NUM_KEYS ) &&
+                ( xType > KV_TYPE_NONE ) &&
+                ( xType < KV_TYPE_LAST ) &&
+                ( xLength > 0 ) &&
+                ( xLength <= KVSTORE_VAL_MAX_LEN ) &&
+                ( pvData != NULL ) )
+            {
+                void * pvCopy = pvPortMalloc( xLength );
+
+                if( pvCopy != NULL )
+                {
+                    ( void ) memcpy( pvCopy, pvData, xLength );
+                    vSetEntry( xKey, xType, xLength, pvCopy );
+                    xPackedEntries[ xKey ].xDirty = pdTRUE;
+                    xFlushPending = pdTRUE;
+                    xSuccess = pdTRUE;
+                }
+                else
+                {
+                    configASSERT_CONTINUE( pvCopy != NULL );
+                }
+            }
+
+            if( ( xSuccess == pdTRUE ) &&
+                ( xBatchActive == pdFALSE ) )
+            {
+                xSuccess = xFlushPacked();
+            }
+
+            return xSuccess;
+        }
+
+        void vprvNvImplInit( void )
+        {
+            if( xPackedLoaded == pdFALSE )
+            {
+                vLoadPacked();
+            }
+        }
+
+        void vprvNvImplBeginBatch( void )
+        {
+            xBatchActive = pdTRUE;
+        }
+
+        BaseType_t xprvNvImplEndBatch( void )
+        {
+            BaseType_t xSuccess = pdTRUE;
+
+            xBatchActive = pdFALSE;
+
+            if( xFlushPending == pdTRUE )
+            {
+                xSuccess = xFlushPacked();
+            }
+
+            return xSuccess;
+        }
+    #endif /* KVSTORE_PSA_PACKED */
 #endif /* KV_STORE_NVIMPL_ARM_PSA */
@@ -48,6 +48,12 @@ typedef struct
 
 extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
+/* Length of a bitmap with one bit per key */
+#define KVSTORE_KEY_BITMAP_LEN    ( ( KVSTORE_NUM_KEYS + 7 ) / 8 )
+
+KVStoreKey_t xprvRegisterKey( const char * pcKey,
+                              KVStoreValueType_t xType );
+
 /* Private functions for NVM implementation */
 
 #if KV_STORE_NVIMPL_ENABLE
@@ -72,6 +78,16 @@ extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
     void vprvNvImplInit( void );
 
+    /* Writes between these calls may be committed together by the NV implementation */
+    void vprvNvImplBeginBatch( void );
+
+    BaseType_t xprvNvImplEndBatch( void );
+
+    #if KV_STORE_NVIMPL_LITTLEFS_LOG
+        /* Forget the loaded log, as on a reset, so that the next access replays it */
+        void vprvNvImplDeinit( void );
+    #endif
+
 #endif /* KV_STORE_NVIMPL_ENABLE */
 
 
@@ -83,6 +99,9 @@ extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
                                        void * pvBuffer,
                                        size_t xBufferSize );
 
+    const void * pvprvPeekCacheEntry( KVStoreKey_t xKey,
+                                      size_t * pxLength );
+
     BaseType_t xprvWriteCacheEntry( KVStoreKey_t xKey,
                                     KVStoreValueType_t xNewType,
                                     size_t xLength,
@@ -90,6 +109,10 @@ extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
     void vprvCacheInit( void );
 
+    void vprvCacheLoadEntry( KVStoreKey_t xKey );
+
+    BaseType_t xprvCommitCache( uint8_t * pucCommitted );
+
     size_t prvGetCacheEntryLength( KVStoreKey_t xKey );
     KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey );
 
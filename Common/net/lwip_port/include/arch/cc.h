@@ -93,6 +93,24 @@ typedef u32_t      sys_prot_t;
 #define X32_F                 "lx"
 #define SZT_F                 U32_F
 
+/* Word-at-a-time checksum tuned for the Cortex-M33 (see lwip_chksum.c) */
+#ifndef LWIP_CHKSUM
+    #define LWIP_CHKSUM    lwip_arch_chksum
+#endif
+
+u16_t lwip_arch_chksum( const void * pvData,
+                        int lLen );
+
+/* Build the stock algorithm alongside for the "net chksum" benchmark */
+#ifndef LWIP_CHKSUM_BENCHMARK
+    #define LWIP_CHKSUM_BENCHMARK    1
+#endif
+
+#if LWIP_CHKSUM_BENCHMARK
+    u16_t lwip_reference_chksum( const void * pvData,
+                                 int lLen );
+#endif
+
 /* Compiler hints for packing structures */
 #define PACK_STRUCT_STRUCT    __attribute__( ( packed ) )
 
@@ -37,23 +37,49 @@
 #include "queue.h"
 #include "semphr.h"
 
-#define SYS_MBOX_NULL                     ( ( QueueHandle_t ) NULL )
+#define SYS_MBOX_NULL                     ( ( sys_mbox_t ) NULL )
 #define SYS_SEM_NULL                      ( ( SemaphoreHandle_t ) NULL )
 #define SYS_DEFAULT_THREAD_STACK_DEPTH    configMINIMAL_STACK_SIZE
 
+/*
+ * Task notification index used to wake a task blocked in sys_arch_mbox_fetch.
+ * Any task that receives from an lwIP mailbox (the tcpip_thread and socket / netconn users)
+ * must not use this index for anything else.
+ */
+#ifndef LWIP_MBOX_NOTIFY_IDX
+    #define LWIP_MBOX_NOTIFY_IDX    ( configTASK_NOTIFICATION_ARRAY_ENTRIES - 1 )
+#endif
+
+/* Collect per mailbox depth and fetch latency statistics */
+#ifndef LWIP_MBOX_STATS
+    #define LWIP_MBOX_STATS    1
+#endif
+
+/* Collect semaphore / mutex wait times and tcpip core lock hold times */
+#ifndef LWIP_SYS_ARCH_STATS
+    #define LWIP_SYS_ARCH_STATS    1
+#endif
+
+/* Number of tasks for which tcpip core lock usage is tracked individually */
+#ifndef LWIP_SYS_ARCH_STATS_MAX_TASKS
+    #define LWIP_SYS_ARCH_STATS_MAX_TASKS    12
+#endif
+
+/* Timestamp source for port statistics, in run time counter ticks */
+#ifndef sys_arch_stats_timestamp
+    #define sys_arch_stats_timestamp()    ( ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE() )
+#endif
+
 typedef SemaphoreHandle_t   sys_sem_t;
 typedef SemaphoreHandle_t   sys_mutex_t;
 typedef TaskHandle_t        sys_thread_t;
 
-struct sys_mbox
-{
-    QueueHandle_t xMbox;
-    TaskHandle_t xTask;
-};
-typedef struct sys_mbox sys_mbox_t;
+/* Mailboxes are ring buffers of message pointers, see sys_arch.c */
+struct sys_mbox;
+typedef struct sys_mbox * sys_mbox_t;
 
-#define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( ( x )->xMbox == NULL ) ) ? pdFALSE : pdTRUE )
-#define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { ( x )->xMbox = NULL; ( x )->xTask = NULL; } } while( 0 )
+#define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( *( x ) == NULL ) ) ? pdFALSE : pdTRUE )
+#define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { *( x ) = NULL; } } while( 0 )
 #define sys_sem_valid( x )           ( ( ( * x ) == NULL ) ? pdFALSE : pdTRUE )
 #define sys_sem_set_invalid( x )     ( ( * x ) = NULL )
 
@@ -71,6 +97,75 @@ typedef struct sys_mbox sys_mbox_t;
 
 
 
+#if LWIP_MBOX_STATS
+    typedef struct
+    {
+        char pcConsumerName[ configMAX_TASK_NAME_LEN ]; /* Name of the last task to fetch from the mailbox */
+        uint32_t ulSize;                                /* Capacity of the mailbox */
+        uint32_t ulDepth;                               /* Number of messages currently waiting */
+        uint32_t ulHighWaterMark;                       /* Largest number of messages waiting at once */
+        uint32_t ulPosts;                               /* Number of messages posted */
+        uint32_t ulFullCount;                           /* Number of posts that found the mailbox full */
+        uint32_t ulLatencyMax;                          /* Longest post to fetch latency */
+        uint32_t ulLatencyAvg;                          /* Average post to fetch latency */
+    } sys_mbox_stats_t;
+
+/*
+ * @brief Copy statistics for up to ulMaxEntries live mailboxes into pxStats.
+ *
+ * Latencies are reported in sys_arch_stats_timestamp() ticks.
+ *
+ * @return The number of entries written.
+ */
+    uint32_t sys_arch_mbox_get_stats( sys_mbox_stats_t * pxStats,
+                                      uint32_t ulMaxEntries );
+
+/*
+ * @brief Reset the statistics of all live mailboxes.
+ */
+    void sys_arch_mbox_reset_stats( void );
+#endif /* LWIP_MBOX_STATS */
+
+#if LWIP_SYS_ARCH_STATS
+    typedef struct
+    {
+        uint32_t ulCount;
+        uint32_t ulMax;
+        uint64_t ullTotal;
+    } sys_arch_timing_t;
+
+    typedef struct
+    {
+        char pcTaskName[ configMAX_TASK_NAME_LEN ];
+        TaskHandle_t xTask;          /* Only used for comparison, the task may no longer exist */
+        sys_arch_timing_t xLockWait; /* Time spent waiting for the tcpip core lock */
+        sys_arch_timing_t xLockHold; /* Time the tcpip core lock was held */
+    } sys_arch_task_lock_stats_t;
+
+    typedef struct
+    {
+        sys_arch_timing_t xSemWait;                /* sys_arch_sem_wait */
+        sys_arch_timing_t xMutexWait;              /* sys_mutex_lock on any mutex */
+        sys_arch_timing_t xCoreLockWait;           /* LOCK_TCPIP_CORE wait time */
+        sys_arch_timing_t xCoreLockHold;           /* LOCK_TCPIP_CORE hold time */
+        uint32_t ulTaskCount;                      /* Number of valid entries in xTasks */
+        uint32_t ulTasksDropped;                   /* Core lock users that did not fit in xTasks */
+        sys_arch_task_lock_stats_t xTasks[ LWIP_SYS_ARCH_STATS_MAX_TASKS ];
+    } sys_arch_stats_t;
+
+/*
+ * @brief Copy a snapshot of the port semaphore, mutex and core lock statistics.
+ *
+ * Times are reported in sys_arch_stats_timestamp() ticks.
+ */
+    void sys_arch_get_stats( sys_arch_stats_t * pxStats );
+
+/*
+ * @brief Reset the port semaphore, mutex and core lock statistics.
+ */
+    void sys_arch_reset_stats( void );
+#endif /* LWIP_SYS_ARCH_STATS */
+
 #if LWIP_NETCONN_SEM_PER_THREAD
     sys_sem_t * sys_arch_netconn_sem_get( void );
     #define LWIP_NETCONN_THREAD_SEM_GET()    sys_arch_netconn_sem_get()
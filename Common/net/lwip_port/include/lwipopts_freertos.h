@@ -49,7 +49,9 @@
 
 /*fix http IOT issue */
 #define LWIP_WND_SCALE                1
-#define TCP_RCV_SCALE                 1
+#ifndef TCP_RCV_SCALE
+    #define TCP_RCV_SCALE             1
+#endif
 #define MEMP_NUM_NETDB                4
 
 /*
@@ -91,7 +93,9 @@
  * MEM_SIZE: the size of the heap memory. If the application will send
  * a lot of data that needs to be copied, this should be set high.
  */
-#define MEM_SIZE    ( 50 * 1600 )
+#ifndef MEM_SIZE
+    #define MEM_SIZE    ( 50 * 1600 )
+#endif
 
 /*
  * ------------------------------------------------
@@ -105,7 +109,9 @@
 
 /* MEMP_NUM_TCP_PCB: the number of simultaneously active TCP
  * connections. */
-#define MEMP_NUM_TCP_PCB           32
+#ifndef MEMP_NUM_TCP_PCB
+    #define MEMP_NUM_TCP_PCB       32
+#endif
 
 /* MEMP_NUM_TCP_PCB_LISTEN: the number of listening TCP
  * connections. */
@@ -113,7 +119,9 @@
 
 /* MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP
  * segments. */
-#define MEMP_NUM_TCP_SEG           255
+#ifndef MEMP_NUM_TCP_SEG
+    #define MEMP_NUM_TCP_SEG       255
+#endif
 
 /* MEMP_NUM_ARP_QUEUE: the number of simultaneously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
@@ -124,7 +132,9 @@
  * MEMP_NUM_NETCONN: the number of struct netconns.
  * (only needed if you use the sequential API, like api_lib.c)
  */
-#define MEMP_NUM_NETCONN           32
+#ifndef MEMP_NUM_NETCONN
+    #define MEMP_NUM_NETCONN       32
+#endif
 
 /*
  * ----------------------------------
@@ -148,10 +158,14 @@
 #define TCP_MSS        1476
 
 /* TCP sender buffer space (bytes). */
-#define TCP_SND_BUF    ( 24 * 1024 )        /*(12 * 1024) */
+#ifndef TCP_SND_BUF
+    #define TCP_SND_BUF    ( 24 * 1024 )    /*(12 * 1024) */
+#endif
 
 /* TCP receive window. */
-#define TCP_WND        ( 24 * 1024 )
+#ifndef TCP_WND
+    #define TCP_WND        ( 24 * 1024 )
+#endif
 
 /*
  * ---------------------------------
@@ -0,0 +1,179 @@
+/*
+ * FreeRTOS STM32U5 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Internet checksum (RFC 1071) tuned for the Cortex-M33 */
+
+#include "lwip/opt.h"
+#include "lwip/arch.h"
+#include "lwip/def.h"
+
+#include <stdint.h>
+
+#include "sram_banks.h"
+
+/*
+ * Number of 32 bit words summed per iteration of the unrolled loop.
+ * 8 words (32 bytes) lets the compiler use a pair of LDM instructions and
+ * keeps the loop overhead below one cycle per word.
+ */
+#define CHKSUM_UNROLL_WORDS    8
+
+/*
+ * @brief Compute the unfolded, uncomplemented one's complement sum of a buffer.
+ *
+ * The sum is accumulated 32 bits at a time into a 64 bit accumulator so
+ * that the compiler emits an ADDS / ADC pair per word and the carries are
+ * folded once at the end rather than on every addition. The result matches
+ * lwip_standard_chksum() for any alignment and length.
+ */
+u16_t RAMFUNC lwip_arch_chksum( const void * pvData,
+                                int lLen )
+{
+    const uint8_t * pucData = ( const uint8_t * ) pvData;
+    const uint32_t * pulData;
+    uint64_t ullSum = 0;
+    uint32_t ulSum;
+    int lOdd = ( int ) ( ( uintptr_t ) pucData & 1U );
+
+    /* Sum the leading byte in the high half so the following words line up */
+    if( ( lOdd != 0 ) && ( lLen > 0 ) )
+    {
+        ullSum = ( uint32_t ) ( *pucData ) << 8;
+        pucData++;
+        lLen--;
+    }
+
+    /* Reach 32 bit alignment */
+    if( ( ( ( uintptr_t ) pucData & 2U ) != 0 ) && ( lLen >= 2 ) )
+    {
+        ullSum += *( const uint16_t * ) pucData;
+        pucData += 2;
+        lLen -= 2;
+    }
+
+    pulData = ( const uint32_t * ) pucData;
+
+    while( lLen >= ( int ) ( CHKSUM_UNROLL_WORDS * sizeof( uint32_t ) ) )
+    {
+        ullSum += pulData[ 0 ];
+        ullSum += pulData[ 1 ];
+        ullSum += pulData[ 2 ];
+        ullSum += pulData[ 3 ];
+        ullSum += pulData[ 4 ];
+        ullSum += pulData[ 5 ];
+        ullSum += pulData[ 6 ];
+        ullSum += pulData[ 7 ];
+        pulData += CHKSUM_UNROLL_WORDS;
+        lLen -= ( int ) ( CHKSUM_UNROLL_WORDS * sizeof( uint32_t ) );
+    }
+
+    while( lLen >= ( int ) sizeof( uint32_t ) )
+    {
+        ullSum += *pulData;
+        pulData++;
+        lLen -= ( int ) sizeof( uint32_t );
+    }
+
+    pucData = ( const uint8_t * ) pulData;
+
+    if( lLen >= 2 )
+    {
+        ullSum += *( const uint16_t * ) pucData;
+        pucData += 2;
+        lLen -= 2;
+    }
+
+    /* A trailing byte occupies the low half on a little endian target */
+    if( lLen > 0 )
+    {
+        ullSum += *pucData;
+    }
+
+    /* Fold 64 -> 32 -> 16 bits, adding the end around carries back in */
+    ullSum = ( ullSum & 0xFFFFFFFFULL ) + ( ullSum >> 32 );
+    ulSum = ( uint32_t ) ( ullSum & 0xFFFFFFFFULL ) + ( uint32_t ) ( ullSum >> 32 );
+
+    ulSum = ( ulSum & 0xFFFFUL ) + ( ulSum >> 16 );
+    ulSum = ( ulSum & 0xFFFFUL ) + ( ulSum >> 16 );
+
+    /* Undo the byte offset introduced by an odd start address */
+    if( lOdd != 0 )
+    {
+        ulSum = ( ( ulSum & 0xFFUL ) << 8 ) | ( ( ulSum >> 8 ) & 0xFFUL );
+    }
+
+    return ( u16_t ) ulSum;
+}
+
+#if LWIP_CHKSUM_BENCHMARK
+
+/*
+ * @brief Reference implementation equivalent to lwIP's default
+ * LWIP_CHKSUM_ALGORITHM 2, which is not built when the port provides
+ * LWIP_CHKSUM. Used by "net chksum" to validate and time lwip_arch_chksum.
+ */
+    u16_t lwip_reference_chksum( const void * pvData,
+                                 int lLen )
+    {
+        const uint8_t * pucData = ( const uint8_t * ) pvData;
+        const uint16_t * pusData;
+        uint32_t ulSum = 0;
+        uint16_t usTemp = 0;
+        int lOdd = ( int ) ( ( uintptr_t ) pucData & 1U );
+
+        if( ( lOdd != 0 ) && ( lLen > 0 ) )
+        {
+            ( ( uint8_t * ) &usTemp )[ 1 ] = *pucData++;
+            lLen--;
+        }
+
+        pusData = ( const uint16_t * ) pucData;
+
+        while( lLen > 1 )
+        {
+            ulSum += *pusData++;
+            lLen -= 2;
+        }
+
+        if( lLen > 0 )
+        {
+            ( ( uint8_t * ) &usTemp )[ 0 ] = *( const uint8_t * ) pusData;
+        }
+
+        ulSum += usTemp;
+
+        ulSum = ( ulSum & 0xFFFFUL ) + ( ulSum >> 16 );
+        ulSum = ( ulSum & 0xFFFFUL ) + ( ulSum >> 16 );
+
+        if( lOdd != 0 )
+        {
+            ulSum = ( ( ulSum & 0xFFUL ) << 8 ) | ( ( ulSum >> 8 ) & 0xFFUL );
+        }
+
+        return ( u16_t ) ulSum;
+    }
+
+#endif /* LWIP_CHKSUM_BENCHMARK */
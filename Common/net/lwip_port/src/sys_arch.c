@@ -48,6 +48,9 @@
 #include "lwip/sys.h"
 #include "lwip/mem.h"
 #include "lwip/stats.h"
+#include "lwip/tcpip.h"
+
+#include <string.h>
 
 #if !INCLUDE_xTaskAbortDelay
     #error "lwIP FreeRTOS port requires INCLUDE_xTaskAbortDelay"
@@ -61,6 +64,151 @@
  * the interrupt handler setting this variable manually. */
 portBASE_TYPE xInsideISR = pdFALSE;
 
+/*
+ * Mailboxes are a ring of message pointers. Posting only takes a short critical
+ * section (no queue locking or scheduler suspension) and the first task waiting in
+ * sys_arch_mbox_fetch is woken with a direct to task notification. A waiter which
+ * leaves while messages remain passes the wakeup on to the next one. Producers only
+ * touch the xSpaceAvailable semaphore when the ring is full.
+ */
+typedef struct MboxWaiter
+{
+    TaskHandle_t xTask;
+    struct MboxWaiter * pxNext;
+} MboxWaiter_t;
+
+struct sys_mbox
+{
+    struct sys_mbox * pxNext;          /* List of live mailboxes, used for statistics */
+    uint32_t ulSize;
+    uint32_t ulHead;                   /* Index of the next message to fetch */
+    uint32_t ulCount;                  /* Number of messages in the ring */
+    MboxWaiter_t * pxWaiters;          /* Tasks waiting in sys_arch_mbox_fetch, oldest first */
+    BaseType_t xFreed;                 /* Set by sys_mbox_free, the last waiter to leave frees the mailbox */
+    uint32_t ulProducersWaiting;       /* Number of tasks blocked in sys_mbox_post */
+    SemaphoreHandle_t xSpaceAvailable; /* Given by the consumer when producers are waiting */
+    #if LWIP_MBOX_STATS
+        sys_mbox_stats_t xStats;
+        uint64_t ullLatencyTotal;
+        uint32_t ulFetches;
+        TaskHandle_t xLastConsumer;
+        uint32_t * pulPostTime;
+    #endif
+    void ** ppvRing;
+};
+
+#if LWIP_MBOX_STATS
+    static struct sys_mbox * pxMboxList = NULL;
+#endif
+
+/* Add a message to the ring. Must be called from within a critical section. */
+static inline BaseType_t prvMboxPush( struct sys_mbox * pxMbox,
+                                      void * pvMessage )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( pxMbox->ulCount < pxMbox->ulSize )
+    {
+        uint32_t ulTail = pxMbox->ulHead + pxMbox->ulCount;
+
+        if( ulTail >= pxMbox->ulSize )
+        {
+            ulTail -= pxMbox->ulSize;
+        }
+
+        pxMbox->ppvRing[ ulTail ] = pvMessage;
+        pxMbox->ulCount++;
+
+        #if LWIP_MBOX_STATS
+        {
+            pxMbox->pulPostTime[ ulTail ] = sys_arch_stats_timestamp();
+            pxMbox->xStats.ulPosts++;
+
+            if( pxMbox->ulCount > pxMbox->xStats.ulHighWaterMark )
+            {
+                pxMbox->xStats.ulHighWaterMark = pxMbox->ulCount;
+            }
+        }
+        #endif /* LWIP_MBOX_STATS */
+
+        xResult = pdTRUE;
+    }
+    else
+    {
+        #if LWIP_MBOX_STATS
+            pxMbox->xStats.ulFullCount++;
+        #endif
+    }
+
+    return xResult;
+}
+
+/* Remove a message from the ring. Must be called from within a critical section. */
+static inline BaseType_t prvMboxPop( struct sys_mbox * pxMbox,
+                                     void ** ppvMessage )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( pxMbox->ulCount > 0 )
+    {
+        *ppvMessage = pxMbox->ppvRing[ pxMbox->ulHead ];
+
+        #if LWIP_MBOX_STATS
+        {
+            uint32_t ulLatency = sys_arch_stats_timestamp() - pxMbox->pulPostTime[ pxMbox->ulHead ];
+
+            pxMbox->ullLatencyTotal += ulLatency;
+            pxMbox->ulFetches++;
+
+            if( ulLatency > pxMbox->xStats.ulLatencyMax )
+            {
+                pxMbox->xStats.ulLatencyMax = ulLatency;
+            }
+        }
+        #endif /* LWIP_MBOX_STATS */
+
+        pxMbox->ulHead++;
+
+        if( pxMbox->ulHead >= pxMbox->ulSize )
+        {
+            pxMbox->ulHead = 0;
+        }
+
+        pxMbox->ulCount--;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/* First task waiting for a message, NULL if there is none. Must be called from within a critical section. */
+static inline TaskHandle_t prvMboxWaiter( const struct sys_mbox * pxMbox )
+{
+    return( ( pxMbox->pxWaiters != NULL ) ? pxMbox->pxWaiters->xTask : NULL );
+}
+
+static void prvMboxDelete( struct sys_mbox * pxMbox )
+{
+    vSemaphoreDelete( pxMbox->xSpaceAvailable );
+    vPortFree( pxMbox );
+}
+
+/* Wake a producer blocked on a full mailbox, if there is one */
+static inline void prvMboxSignalSpace( struct sys_mbox * pxMbox )
+{
+    if( pxMbox->ulProducersWaiting > 0 )
+    {
+        if( xInsideISR != pdFALSE )
+        {
+            ( void ) xSemaphoreGiveFromISR( pxMbox->xSpaceAvailable, NULL );
+        }
+        else
+        {
+            ( void ) xSemaphoreGive( pxMbox->xSpaceAvailable );
+        }
+    }
+}
+
 /*---------------------------------------------------------------------------*
 * Routine:  sys_mbox_new
 *---------------------------------------------------------------------------*
@@ -75,17 +223,55 @@ err_t sys_mbox_new( sys_mbox_t * pxMailBox,
                     int iSize )
 {
     err_t xReturn = ERR_MEM;
-    sys_mbox_t pxTempMbox;
+    struct sys_mbox * pxMbox = NULL;
+    size_t xAllocSize = sizeof( struct sys_mbox ) + ( iSize * sizeof( void * ) );
+
+    #if LWIP_MBOX_STATS
+        xAllocSize += iSize * sizeof( uint32_t );
+    #endif
+
+    if( iSize > 0 )
+    {
+        pxMbox = pvPortMalloc( xAllocSize );
+    }
+
+    if( pxMbox != NULL )
+    {
+        ( void ) memset( pxMbox, 0, sizeof( struct sys_mbox ) );
+
+        pxMbox->ulSize = ( uint32_t ) iSize;
+        pxMbox->ppvRing = ( void ** ) &( pxMbox[ 1 ] );
+        pxMbox->xSpaceAvailable = xSemaphoreCreateCounting( iSize, 0 );
 
-    pxTempMbox.xMbox = xQueueCreate( iSize, sizeof( void * ) );
+        if( pxMbox->xSpaceAvailable == NULL )
+        {
+            vPortFree( pxMbox );
+            pxMbox = NULL;
+        }
+    }
 
-    if( pxTempMbox.xMbox != NULL )
+    if( pxMbox != NULL )
     {
-        pxTempMbox.xTask = NULL;
-        *pxMailBox = pxTempMbox;
+        #if LWIP_MBOX_STATS
+        {
+            pxMbox->pulPostTime = ( uint32_t * ) &( pxMbox->ppvRing[ iSize ] );
+            pxMbox->xStats.ulSize = pxMbox->ulSize;
+
+            taskENTER_CRITICAL();
+            pxMbox->pxNext = pxMboxList;
+            pxMboxList = pxMbox;
+            taskEXIT_CRITICAL();
+        }
+        #endif /* LWIP_MBOX_STATS */
+
+        *pxMailBox = pxMbox;
         xReturn = ERR_OK;
         SYS_STATS_INC_USED( mbox );
     }
+    else
+    {
+        SYS_STATS_INC( mbox.err );
+    }
 
     return xReturn;
 }
@@ -105,14 +291,48 @@ err_t sys_mbox_new( sys_mbox_t * pxMailBox,
 *---------------------------------------------------------------------------*/
 void sys_mbox_free( sys_mbox_t * pxMailBox )
 {
-    unsigned long ulMessagesWaiting;
-    QueueHandle_t xMbox;
-    TaskHandle_t xTask;
-    sys_mbox_t volatile * pvxMailBox = pxMailBox;
+    uint32_t ulMessagesWaiting = 0;
+    struct sys_mbox * pxMbox = NULL;
+    BaseType_t xDelete = pdFALSE;
 
-    if( pvxMailBox != NULL )
+    if( ( pxMailBox != NULL ) &&
+        ( *pxMailBox != NULL ) )
     {
-        ulMessagesWaiting = uxQueueMessagesWaiting( pvxMailBox->xMbox );
+        taskENTER_CRITICAL();
+        {
+            pxMbox = *pxMailBox;
+            *pxMailBox = NULL;
+
+            ulMessagesWaiting = pxMbox->ulCount;
+            pxMbox->xFreed = pdTRUE;
+
+            /* Tasks still waiting return SYS_ARCH_TIMEOUT, the last one to leave deletes the mailbox */
+            for( MboxWaiter_t * pxWaiter = pxMbox->pxWaiters; pxWaiter != NULL; pxWaiter = pxWaiter->pxNext )
+            {
+                ( void ) xTaskNotifyGiveIndexed( pxWaiter->xTask, LWIP_MBOX_NOTIFY_IDX );
+            }
+
+            xDelete = ( pxMbox->pxWaiters == NULL ) ? pdTRUE : pdFALSE;
+
+            #if LWIP_MBOX_STATS
+            {
+                struct sys_mbox ** ppxIter = &pxMboxList;
+
+                while( ( *ppxIter != NULL ) &&
+                       ( *ppxIter != pxMbox ) )
+                {
+                    ppxIter = &( ( *ppxIter )->pxNext );
+                }
+
+                if( *ppxIter != NULL )
+                {
+                    *ppxIter = pxMbox->pxNext;
+                }
+            }
+            #endif /* LWIP_MBOX_STATS */
+        }
+        taskEXIT_CRITICAL();
+
         configASSERT( ( ulMessagesWaiting == 0 ) );
 
         #if SYS_STATS
@@ -126,18 +346,10 @@ void sys_mbox_free( sys_mbox_t * pxMailBox )
         }
         #endif /* SYS_STATS */
 
-        taskENTER_CRITICAL();
-        xMbox = pvxMailBox->xMbox;
-        xTask = pvxMailBox->xTask;
-        pvxMailBox->xMbox = NULL;
-        taskEXIT_CRITICAL();
-
-        if( xTask != NULL )
+        if( xDelete == pdTRUE )
         {
-            xTaskAbortDelay( xTask );
+            prvMboxDelete( pxMbox );
         }
-
-        vQueueDelete( xMbox );
     }
 }
 
@@ -153,8 +365,46 @@ void sys_mbox_free( sys_mbox_t * pxMailBox )
 void sys_mbox_post( sys_mbox_t * pxMailBox,
                     void * pxMessageToPost )
 {
-    while( xQueueSendToBack( pxMailBox->xMbox, &pxMessageToPost, portMAX_DELAY ) != pdTRUE )
+    struct sys_mbox * pxMbox = *pxMailBox;
+    BaseType_t xPosted = pdFALSE;
+
+    configASSERT( pxMbox != NULL );
+
+    while( xPosted == pdFALSE )
     {
+        TaskHandle_t xTask = NULL;
+
+        taskENTER_CRITICAL();
+        {
+            xPosted = prvMboxPush( pxMbox, pxMessageToPost );
+
+            if( xPosted == pdTRUE )
+            {
+                xTask = prvMboxWaiter( pxMbox );
+            }
+            else
+            {
+                pxMbox->ulProducersWaiting++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xPosted == pdTRUE )
+        {
+            if( xTask != NULL )
+            {
+                ( void ) xTaskNotifyGiveIndexed( xTask, LWIP_MBOX_NOTIFY_IDX );
+            }
+        }
+        else
+        {
+            /* Mailbox is full, wait for the consumer to make room */
+            ( void ) xSemaphoreTake( pxMbox->xSpaceAvailable, portMAX_DELAY );
+
+            taskENTER_CRITICAL();
+            pxMbox->ulProducersWaiting--;
+            taskEXIT_CRITICAL();
+        }
     }
 }
 
@@ -175,24 +425,50 @@ err_t sys_mbox_trypost( sys_mbox_t * pxMailBox,
                         void * pxMessageToPost )
 {
     err_t xReturn;
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    struct sys_mbox * pxMbox = *pxMailBox;
+    TaskHandle_t xTask = NULL;
+    BaseType_t xPosted = pdFALSE;
+
+    configASSERT( pxMbox != NULL );
 
     if( xInsideISR != pdFALSE )
     {
-        xReturn = xQueueSendFromISR( pxMailBox->xMbox, &pxMessageToPost, &xHigherPriorityTaskWoken );
+        portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+        UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+        xPosted = prvMboxPush( pxMbox, pxMessageToPost );
+        xTask = prvMboxWaiter( pxMbox );
+
+        taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+
+        if( ( xPosted == pdTRUE ) &&
+            ( xTask != NULL ) )
+        {
+            vTaskNotifyGiveIndexedFromISR( xTask, LWIP_MBOX_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
     }
     else
     {
-        xReturn = xQueueSend( pxMailBox->xMbox, &pxMessageToPost, ( TickType_t ) 0 );
+        taskENTER_CRITICAL();
+        xPosted = prvMboxPush( pxMbox, pxMessageToPost );
+        xTask = prvMboxWaiter( pxMbox );
+        taskEXIT_CRITICAL();
+
+        if( ( xPosted == pdTRUE ) &&
+            ( xTask != NULL ) )
+        {
+            ( void ) xTaskNotifyGiveIndexed( xTask, LWIP_MBOX_NOTIFY_IDX );
+        }
     }
 
-    if( xReturn == pdPASS )
+    if( xPosted == pdTRUE )
     {
         xReturn = ERR_OK;
     }
     else
     {
-        /* The queue was already full. */
+        /* The mailbox was already full. */
         xReturn = ERR_MEM;
         SYS_STATS_INC( mbox.err );
     }
@@ -242,70 +518,146 @@ u32_t sys_arch_mbox_fetch( sys_mbox_t * pxMailBox,
 {
     void * pvDummy;
     unsigned long ulReturn = SYS_ARCH_TIMEOUT;
-    QueueHandle_t xMbox;
-    TaskHandle_t xTask;
-    BaseType_t xResult;
-    sys_mbox_t volatile * pvxMailBox = pxMailBox;
-
-    if( pvxMailBox == NULL )
+    struct sys_mbox * pxMbox = NULL;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    BaseType_t xReceived = pdFALSE;
+    TickType_t xTicksToWait = portMAX_DELAY;
+    TimeOut_t xTimeOut;
+    MboxWaiter_t xWaiter = { .xTask = xTask, .pxNext = NULL };
+    MboxWaiter_t ** ppxIter = NULL;
+    TaskHandle_t xNext = NULL;
+    BaseType_t xDelete = pdFALSE;
+
+    configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
+
+    if( ( pxMailBox == NULL ) ||
+        ( xTask == NULL ) )
     {
         goto exit;
     }
 
-    taskENTER_CRITICAL();
-    xMbox = pvxMailBox->xMbox;
-    xTask = xTaskGetCurrentTaskHandle();
-
-    if( ( xMbox != NULL ) && ( xTask != NULL ) && ( pvxMailBox->xTask == NULL ) )
+    if( NULL == ppvBuffer )
     {
-        pvxMailBox->xTask = xTask;
+        ppvBuffer = &pvDummy;
     }
-    else
+
+    /* Register as a waiter before checking the ring so that no post can be missed.
+     * The mailbox is not deleted while the waiter is registered. */
+    taskENTER_CRITICAL();
+    pxMbox = *pxMailBox;
+
+    if( pxMbox != NULL )
     {
-        xMbox = NULL;
+        ppxIter = &( pxMbox->pxWaiters );
+
+        while( *ppxIter != NULL )
+        {
+            ppxIter = &( ( *ppxIter )->pxNext );
+        }
+
+        *ppxIter = &xWaiter;
     }
 
     taskEXIT_CRITICAL();
 
-    if( xMbox == NULL )
+    if( pxMbox == NULL )
     {
         goto exit;
     }
 
-    if( NULL == ppvBuffer )
+    if( ulTimeOut != 0UL )
     {
-        ppvBuffer = &pvDummy;
+        xTicksToWait = ulTimeOut / portTICK_PERIOD_MS;
     }
 
-    if( ulTimeOut != 0UL )
+    vTaskSetTimeOutState( &xTimeOut );
+
+    for( ; ; )
     {
-        configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
+        BaseType_t xValid = pdFALSE;
 
-        if( pdTRUE == xQueueReceive( xMbox, &( *ppvBuffer ), ulTimeOut / portTICK_PERIOD_MS ) )
+        taskENTER_CRITICAL();
         {
-            ulReturn = 1UL;
+            xValid = ( pxMbox->xFreed == pdFALSE ) ? pdTRUE : pdFALSE;
+
+            if( xValid == pdTRUE )
+            {
+                xReceived = prvMboxPop( pxMbox, ppvBuffer );
+            }
         }
-        else
+        taskEXIT_CRITICAL();
+
+        if( ( xReceived == pdTRUE ) ||
+            ( xValid == pdFALSE ) )
+        {
+            break;
+        }
+
+        if( ( ulTimeOut != 0UL ) &&
+            ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE ) )
         {
-            /* Timed out. */
-            *ppvBuffer = NULL;
+            break;
+        }
+
+        /* Stale notifications only cause another pass around the loop */
+        ( void ) ulTaskNotifyTakeIndexed( LWIP_MBOX_NOTIFY_IDX, pdTRUE, xTicksToWait );
+    }
+
+    if( xReceived == pdTRUE )
+    {
+        ulReturn = 1UL;
+
+        #if LWIP_MBOX_STATS
+        {
+            /* Copy the name so that statistics remain valid if the consumer task is deleted */
+            if( pxMbox->xLastConsumer != xTask )
+            {
+                pxMbox->xLastConsumer = xTask;
+                ( void ) strncpy( pxMbox->xStats.pcConsumerName, pcTaskGetName( xTask ), configMAX_TASK_NAME_LEN );
+                pxMbox->xStats.pcConsumerName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+            }
         }
+        #endif /* LWIP_MBOX_STATS */
+
+        prvMboxSignalSpace( pxMbox );
     }
     else
     {
-        for( xResult = pdFALSE; ( xMbox != NULL ) && ( xResult != pdTRUE ); )
+        /* Timed out. */
+        *ppvBuffer = NULL;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        ppxIter = &( pxMbox->pxWaiters );
+
+        while( *ppxIter != &xWaiter )
         {
-            xResult = xQueueReceive( xMbox, &( *ppvBuffer ), portMAX_DELAY );
-            xMbox = pvxMailBox->xMbox;
+            ppxIter = &( ( *ppxIter )->pxNext );
         }
 
-        if( xResult == pdTRUE )
+        *ppxIter = xWaiter.pxNext;
+
+        /* A post may have woken this task rather than one which is still waiting */
+        if( ( pxMbox->xFreed == pdFALSE ) &&
+            ( pxMbox->ulCount > 0 ) )
         {
-            ulReturn = 1UL;
+            xNext = prvMboxWaiter( pxMbox );
         }
+
+        xDelete = ( ( pxMbox->xFreed == pdTRUE ) && ( pxMbox->pxWaiters == NULL ) ) ? pdTRUE : pdFALSE;
     }
+    taskEXIT_CRITICAL();
 
-    pvxMailBox->xTask = NULL;
+    if( xNext != NULL )
+    {
+        ( void ) xTaskNotifyGiveIndexed( xNext, LWIP_MBOX_NOTIFY_IDX );
+    }
+
+    if( xDelete == pdTRUE )
+    {
+        prvMboxDelete( pxMbox );
+    }
 
 exit:
     return ulReturn;
@@ -329,9 +681,11 @@ u32_t sys_arch_mbox_tryfetch( sys_mbox_t * pxMailBox,
                               void ** ppvBuffer )
 {
     void * pvDummy;
-    unsigned long ulReturn;
-    long lResult;
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    unsigned long ulReturn = SYS_MBOX_EMPTY;
+    struct sys_mbox * pxMbox = *pxMailBox;
+    BaseType_t xReceived = pdFALSE;
+
+    configASSERT( pxMbox != NULL );
 
     if( ppvBuffer == NULL )
     {
@@ -340,25 +694,172 @@ u32_t sys_arch_mbox_tryfetch( sys_mbox_t * pxMailBox,
 
     if( xInsideISR != pdFALSE )
     {
-        lResult = xQueueReceiveFromISR( pxMailBox->xMbox, &( *ppvBuffer ), &xHigherPriorityTaskWoken );
+        UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+        xReceived = prvMboxPop( pxMbox, ppvBuffer );
+        taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
     }
     else
     {
-        lResult = xQueueReceive( pxMailBox->xMbox, &( *ppvBuffer ), 0UL );
+        taskENTER_CRITICAL();
+        xReceived = prvMboxPop( pxMbox, ppvBuffer );
+        taskEXIT_CRITICAL();
     }
 
-    if( lResult == pdPASS )
+    if( xReceived == pdTRUE )
     {
+        prvMboxSignalSpace( pxMbox );
         ulReturn = ERR_OK;
     }
-    else
-    {
-        ulReturn = SYS_MBOX_EMPTY;
-    }
 
     return ulReturn;
 }
 
+#if LWIP_MBOX_STATS
+    uint32_t sys_arch_mbox_get_stats( sys_mbox_stats_t * pxStats,
+                                      uint32_t ulMaxEntries )
+    {
+        uint32_t ulEntries = 0;
+
+        configASSERT( ( pxStats != NULL ) || ( ulMaxEntries == 0 ) );
+
+        taskENTER_CRITICAL();
+        {
+            for( struct sys_mbox * pxMbox = pxMboxList;
+                 ( pxMbox != NULL ) && ( ulEntries < ulMaxEntries );
+                 pxMbox = pxMbox->pxNext )
+            {
+                sys_mbox_stats_t * pxEntry = &( pxStats[ ulEntries ] );
+
+                *pxEntry = pxMbox->xStats;
+                pxEntry->ulDepth = pxMbox->ulCount;
+                pxEntry->ulLatencyAvg = ( pxMbox->ulFetches > 0 ) ?
+                                        ( uint32_t ) ( pxMbox->ullLatencyTotal / pxMbox->ulFetches ) : 0;
+
+                ulEntries++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        return ulEntries;
+    }
+
+    void sys_arch_mbox_reset_stats( void )
+    {
+        taskENTER_CRITICAL();
+        {
+            for( struct sys_mbox * pxMbox = pxMboxList; pxMbox != NULL; pxMbox = pxMbox->pxNext )
+            {
+                pxMbox->xStats.ulPosts = 0;
+                pxMbox->xStats.ulFullCount = 0;
+                pxMbox->xStats.ulLatencyMax = 0;
+                pxMbox->xStats.ulHighWaterMark = pxMbox->ulCount;
+                pxMbox->ullLatencyTotal = 0;
+                pxMbox->ulFetches = 0;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+#endif /* LWIP_MBOX_STATS */
+
+#if LWIP_SYS_ARCH_STATS
+    static sys_arch_stats_t xSysArchStats = { 0 };
+
+/* Owner and start time of the current tcpip core lock hold. Only modified while holding the lock. */
+    static sys_arch_task_lock_stats_t * pxCoreLockOwner = NULL;
+    static uint32_t ulCoreLockStart = 0;
+
+    static inline void prvTimingRecord( sys_arch_timing_t * pxTiming,
+                                        uint32_t ulElapsed )
+    {
+        pxTiming->ulCount++;
+        pxTiming->ullTotal += ulElapsed;
+
+        if( ulElapsed > pxTiming->ulMax )
+        {
+            pxTiming->ulMax = ulElapsed;
+        }
+    }
+
+/* Find or allocate the core lock statistics entry for the calling task. Called with the core lock held. */
+    static sys_arch_task_lock_stats_t * prvGetTaskLockStats( void )
+    {
+        TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+        sys_arch_task_lock_stats_t * pxEntry = NULL;
+
+        for( uint32_t i = 0; i < xSysArchStats.ulTaskCount; i++ )
+        {
+            if( xSysArchStats.xTasks[ i ].xTask == xTask )
+            {
+                pxEntry = &( xSysArchStats.xTasks[ i ] );
+                break;
+            }
+        }
+
+        if( pxEntry != NULL )
+        {
+            /* Found */
+        }
+        else if( xSysArchStats.ulTaskCount < LWIP_SYS_ARCH_STATS_MAX_TASKS )
+        {
+            pxEntry = &( xSysArchStats.xTasks[ xSysArchStats.ulTaskCount ] );
+
+            ( void ) memset( pxEntry, 0, sizeof( sys_arch_task_lock_stats_t ) );
+            pxEntry->xTask = xTask;
+            ( void ) strncpy( pxEntry->pcTaskName, pcTaskGetName( xTask ), configMAX_TASK_NAME_LEN );
+            pxEntry->pcTaskName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+
+            taskENTER_CRITICAL();
+            xSysArchStats.ulTaskCount++;
+            taskEXIT_CRITICAL();
+        }
+        else
+        {
+            xSysArchStats.ulTasksDropped++;
+        }
+
+        return pxEntry;
+    }
+
+    void sys_arch_get_stats( sys_arch_stats_t * pxStats )
+    {
+        configASSERT( pxStats != NULL );
+
+        taskENTER_CRITICAL();
+        ( void ) memcpy( pxStats, &xSysArchStats, sizeof( sys_arch_stats_t ) );
+        taskEXIT_CRITICAL();
+    }
+
+    void sys_arch_reset_stats( void )
+    {
+        #if LWIP_TCPIP_CORE_LOCKING
+            /* Hold the core lock so that no owner entry is in use while the table is cleared */
+            LOCK_TCPIP_CORE();
+        #endif
+
+        taskENTER_CRITICAL();
+        {
+            sys_arch_task_lock_stats_t * pxOwner = pxCoreLockOwner;
+
+            ( void ) memset( &xSysArchStats, 0, sizeof( sys_arch_stats_t ) );
+
+            /* Keep an entry for the caller, which currently owns the core lock */
+            if( pxOwner != NULL )
+            {
+                xSysArchStats.xTasks[ 0 ].xTask = xTaskGetCurrentTaskHandle();
+                ( void ) strncpy( xSysArchStats.xTasks[ 0 ].pcTaskName, pcTaskGetName( NULL ), configMAX_TASK_NAME_LEN );
+                xSysArchStats.xTasks[ 0 ].pcTaskName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+                xSysArchStats.ulTaskCount = 1;
+                pxCoreLockOwner = &( xSysArchStats.xTasks[ 0 ] );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        #if LWIP_TCPIP_CORE_LOCKING
+            UNLOCK_TCPIP_CORE();
+        #endif
+    }
+#endif /* LWIP_SYS_ARCH_STATS */
+
 /*---------------------------------------------------------------------------*
 * Routine:  sys_sem_new
 *---------------------------------------------------------------------------*
@@ -426,6 +927,10 @@ u32_t sys_arch_sem_wait( sys_sem_t * pxSemaphore,
     TickType_t xStartTime, xEndTime, xElapsed;
     unsigned long ulReturn;
 
+    #if LWIP_SYS_ARCH_STATS
+        uint32_t ulStatsStart = sys_arch_stats_timestamp();
+    #endif
+
     xStartTime = xTaskGetTickCount();
 
     if( ulTimeout != 0UL )
@@ -458,6 +963,16 @@ u32_t sys_arch_sem_wait( sys_sem_t * pxSemaphore,
         ulReturn = xElapsed;
     }
 
+    #if LWIP_SYS_ARCH_STATS
+    {
+        uint32_t ulWait = sys_arch_stats_timestamp() - ulStatsStart;
+
+        taskENTER_CRITICAL();
+        prvTimingRecord( &( xSysArchStats.xSemWait ), ulWait );
+        taskEXIT_CRITICAL();
+    }
+    #endif /* LWIP_SYS_ARCH_STATS */
+
     return ulReturn;
 }
 
@@ -487,15 +1002,71 @@ err_t sys_mutex_new( sys_mutex_t * pxMutex )
  * @param mutex the mutex to lock */
 void sys_mutex_lock( sys_mutex_t * pxMutex )
 {
+    #if LWIP_SYS_ARCH_STATS
+        uint32_t ulStart = sys_arch_stats_timestamp();
+        uint32_t ulWait = 0;
+    #endif
+
     while( xSemaphoreTake( *pxMutex, portMAX_DELAY ) != pdPASS )
     {
     }
+
+    #if LWIP_SYS_ARCH_STATS
+    {
+        uint32_t ulNow = sys_arch_stats_timestamp();
+
+        ulWait = ulNow - ulStart;
+
+        taskENTER_CRITICAL();
+        prvTimingRecord( &( xSysArchStats.xMutexWait ), ulWait );
+        taskEXIT_CRITICAL();
+
+        #if LWIP_TCPIP_CORE_LOCKING
+            if( pxMutex == &lock_tcpip_core )
+            {
+                /* The owner fields are only modified by the task holding the core lock */
+                ulCoreLockStart = ulNow;
+                pxCoreLockOwner = prvGetTaskLockStats();
+
+                taskENTER_CRITICAL();
+                {
+                    prvTimingRecord( &( xSysArchStats.xCoreLockWait ), ulWait );
+
+                    if( pxCoreLockOwner != NULL )
+                    {
+                        prvTimingRecord( &( pxCoreLockOwner->xLockWait ), ulWait );
+                    }
+                }
+                taskEXIT_CRITICAL();
+            }
+        #endif /* LWIP_TCPIP_CORE_LOCKING */
+    }
+    #endif /* LWIP_SYS_ARCH_STATS */
 }
 
 /** Unlock a mutex
  * @param mutex the mutex to unlock */
 void sys_mutex_unlock( sys_mutex_t * pxMutex )
 {
+    #if LWIP_SYS_ARCH_STATS && LWIP_TCPIP_CORE_LOCKING
+        if( pxMutex == &lock_tcpip_core )
+        {
+            uint32_t ulHold = sys_arch_stats_timestamp() - ulCoreLockStart;
+
+            taskENTER_CRITICAL();
+            {
+                prvTimingRecord( &( xSysArchStats.xCoreLockHold ), ulHold );
+
+                if( pxCoreLockOwner != NULL )
+                {
+                    prvTimingRecord( &( pxCoreLockOwner->xLockHold ), ulHold );
+                    pxCoreLockOwner = NULL;
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+    #endif /* LWIP_SYS_ARCH_STATS && LWIP_TCPIP_CORE_LOCKING */
+
     xSemaphoreGive( *pxMutex );
 }
 
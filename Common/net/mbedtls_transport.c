@@ -37,6 +37,11 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/* DWT cycle counter used for handshake phase timing */
+#include "stm32u5xx.h"
 
 
 /* mbedTLS includes. */
@@ -47,12 +52,26 @@
 #include "mbedtls/pk.h"
 #include "mbedtls/pem.h"
 #include "mbedtls/platform.h"
+#include "mbedtls/platform_util.h"
 #include "mbedtls/ssl.h"
 #include "mbedtls/asn1.h"
 #include "mbedtls/oid.h"
+#include "mbedtls/sha256.h"
 #include "pk_wrap.h"
 
+#if defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT )
+    #include "pka_stm32.h"
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT */
+
 #include "errno.h"
+#include "trace_rec.h"
+#include "dvfs.h"
+#include "mem_pressure.h"
+
+#ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+    #include "lwip/api.h"
+    #include "lwip/pbuf.h"
+#endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
 
 #define MBEDTLS_DEBUG_THRESHOLD    1
 
@@ -61,15 +80,277 @@
     #include "core_pkcs11.h"
 #endif
 
+/* Maximum number of connections which may have a receive ready callback at once */
+#ifndef MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS
+    #define MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS    4
+#endif
+
+#define SOCK_DISPATCH_STACK_DEPTH    256
+#define SOCK_DISPATCH_PRIORITY       tskIDLE_PRIORITY
+
 typedef struct
 {
-    TaskHandle_t xTaskHandle;
     void * pvRecvReadyCallbackCtx;
     GenericCallback_t pxRecvReadyCallback;
-    StackType_t puxStackBuffer[ 128 ];
+    SockHandle_t xSockHandle; /* Socket watched by the dispatcher, -1 when not registered */
+    BaseType_t xArmed;        /* Cleared when the callback fires, set again by mbedtls_transport_recv */
+} SocketNotifyCtx_t;
+
+/*
+ * A single task waits for receive readiness on every connection with a
+ * registered callback. The wake socket is a loopback UDP socket in the
+ * select set which is written to whenever the set of armed sockets changes.
+ */
+typedef struct
+{
+    TaskHandle_t xTaskHandle;
+    SemaphoreHandle_t xMutex;
+    SockHandle_t xWakeSock;
+    struct sockaddr_in xWakeAddr;
+    SocketNotifyCtx_t * pxCtxList[ MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS ];
+    StaticSemaphore_t xMutexBuffer;
     StaticTask_t xTaskBuffer;
-    SockHandle_t xSockHandle;
-} NotifyThreadCtx_t;
+    StackType_t puxStackBuffer[ SOCK_DISPATCH_STACK_DEPTH ];
+} SocketDispatcher_t;
+
+static SocketDispatcher_t xDispatcher = { .xWakeSock = -1 };
+
+#if defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT ) && ( ST_PKA_ECDH_POOL_SIZE > 0 )
+    #define TRANSPORT_ECDHE_POOL
+
+/* Room for the mbedtls software ECP path, used while the PKA is disabled */
+    #define ECDHE_POOL_STACK_DEPTH    768
+    #define ECDHE_POOL_PRIORITY       tskIDLE_PRIORITY
+
+/*
+ * A task running at idle priority keeps the ECDH driver pool of ephemeral
+ * key pairs full, so that a reconnect does not generate one on the handshake path.
+ */
+    typedef struct
+    {
+        TaskHandle_t xTaskHandle;
+        BaseType_t xStarted;
+        mbedtls_entropy_context xEntropyCtx;
+        StaticTask_t xTaskBuffer;
+        StackType_t puxStackBuffer[ ECDHE_POOL_STACK_DEPTH ];
+    } EcdhePool_t;
+
+    static EcdhePool_t xEcdhePool = { 0 };
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT && ST_PKA_ECDH_POOL_SIZE > 0 */
+
+/* Upper bound on a single wait for the socket to become writable in mbedtls_ssl_send */
+#ifndef MBEDTLS_TRANSPORT_SEND_STALL_TIMEOUT_MS
+    #define MBEDTLS_TRANSPORT_SEND_STALL_TIMEOUT_MS    1000U
+#endif
+
+static TlsTransportStats_t xTransportStats = { 0 };
+
+/* Number of connection attempts kept for "tls stats" */
+#ifndef MBEDTLS_TRANSPORT_TIMING_HISTORY
+    #define MBEDTLS_TRANSPORT_TIMING_HISTORY    4
+#endif
+
+static TlsHandshakeTiming_t xTimingHistory[ MBEDTLS_TRANSPORT_TIMING_HISTORY ] = { 0 };
+static uint32_t ulTimingHistoryCount = 0;
+
+typedef struct
+{
+    uint32_t ulCycles;
+    TickType_t xTicks;
+} PhaseTimer_t;
+
+/* Maximum fragment length requested unless mbedtls_transport_set_max_frag_len is called */
+#ifndef MBEDTLS_TRANSPORT_DEFAULT_MAX_FRAG_LEN
+    #define MBEDTLS_TRANSPORT_DEFAULT_MAX_FRAG_LEN    4096U
+#endif
+
+/* TCP keepalive of TLS_SOCKET_PROFILE_INTERACTIVE: idle time, then probe interval and count, in seconds */
+#ifndef MBEDTLS_TRANSPORT_INTERACTIVE_KEEPIDLE_S
+    #define MBEDTLS_TRANSPORT_INTERACTIVE_KEEPIDLE_S    30
+#endif
+#ifndef MBEDTLS_TRANSPORT_INTERACTIVE_KEEPINTVL_S
+    #define MBEDTLS_TRANSPORT_INTERACTIVE_KEEPINTVL_S    5
+#endif
+#ifndef MBEDTLS_TRANSPORT_INTERACTIVE_KEEPCNT
+    #define MBEDTLS_TRANSPORT_INTERACTIVE_KEEPCNT    3
+#endif
+
+/* TCP keepalive of TLS_SOCKET_PROFILE_BULK */
+#ifndef MBEDTLS_TRANSPORT_BULK_KEEPIDLE_S
+    #define MBEDTLS_TRANSPORT_BULK_KEEPIDLE_S    120
+#endif
+#ifndef MBEDTLS_TRANSPORT_BULK_KEEPINTVL_S
+    #define MBEDTLS_TRANSPORT_BULK_KEEPINTVL_S    20
+#endif
+#ifndef MBEDTLS_TRANSPORT_BULK_KEEPCNT
+    #define MBEDTLS_TRANSPORT_BULK_KEEPCNT    4
+#endif
+
+/* Bytes the socket may hold unread, used when lwIP is built with LWIP_SO_RCVBUF */
+#ifndef MBEDTLS_TRANSPORT_INTERACTIVE_RCVBUF
+    #define MBEDTLS_TRANSPORT_INTERACTIVE_RCVBUF    ( 4 * 1024 )
+#endif
+#ifndef MBEDTLS_TRANSPORT_BULK_RCVBUF
+    #define MBEDTLS_TRANSPORT_BULK_RCVBUF    TCP_WND
+#endif
+
+typedef struct
+{
+    int lNoDelay;
+    int lKeepIdleS; /* 0 leaves TCP keepalive off */
+    int lKeepIntvlS;
+    int lKeepCnt;
+    int lRcvBuf;
+} SocketProfile_t;
+
+/* Indexed by TlsSocketProfile_t, TLS_SOCKET_PROFILE_DEFAULT sets nothing */
+static const SocketProfile_t xSocketProfiles[ TLS_SOCKET_PROFILE_MAX ] =
+{
+    [ TLS_SOCKET_PROFILE_INTERACTIVE ] =
+    {
+        .lNoDelay    = 1,
+        .lKeepIdleS  = MBEDTLS_TRANSPORT_INTERACTIVE_KEEPIDLE_S,
+        .lKeepIntvlS = MBEDTLS_TRANSPORT_INTERACTIVE_KEEPINTVL_S,
+        .lKeepCnt    = MBEDTLS_TRANSPORT_INTERACTIVE_KEEPCNT,
+        .lRcvBuf     = MBEDTLS_TRANSPORT_INTERACTIVE_RCVBUF,
+    },
+    [ TLS_SOCKET_PROFILE_BULK ] =
+    {
+        .lNoDelay    = 0,
+        .lKeepIdleS  = MBEDTLS_TRANSPORT_BULK_KEEPIDLE_S,
+        .lKeepIntvlS = MBEDTLS_TRANSPORT_BULK_KEEPINTVL_S,
+        .lKeepCnt    = MBEDTLS_TRANSPORT_BULK_KEEPCNT,
+        .lRcvBuf     = MBEDTLS_TRANSPORT_BULK_RCVBUF,
+    },
+};
+
+#ifdef MBEDTLS_CHACHAPOLY_C
+
+/*
+ * Ciphersuites offered by connections which prefer ChaCha20-Poly1305, most
+ * preferred first. AES-GCM is kept as a fallback for servers without
+ * ChaCha20-Poly1305. Suites disabled in the mbedtls config are skipped by
+ * mbedtls when building the ClientHello.
+ */
+    static const int pxChaChaPolyFirstCiphersuites[] =
+    {
+        #if defined( MBEDTLS_SSL_PROTO_TLS1_3 ) || defined( MBEDTLS_SSL_PROTO_TLS1_3_EXPERIMENTAL )
+            MBEDTLS_TLS1_3_CHACHA20_POLY1305_SHA256,
+            MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+            MBEDTLS_TLS1_3_AES_256_GCM_SHA384,
+        #endif
+        MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+        MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+        MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+        MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+        MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+        MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+        0
+    };
+#endif /* MBEDTLS_CHACHAPOLY_C */
+
+/* Size of the staging buffer used while a connection is corked */
+#ifndef MBEDTLS_TRANSPORT_CORK_BUFFER_LEN
+    #define MBEDTLS_TRANSPORT_CORK_BUFFER_LEN    2048U
+#endif
+
+/* Size of the decrypted read-ahead buffer. Reads shorter than this are served from a single
+ * mbedtls_ssl_read of up to this many bytes, so the MQTT header reads which follow do not go
+ * back through mbedtls. Set to 0 to pass every read straight to mbedtls_ssl_read. */
+#ifndef MBEDTLS_TRANSPORT_RECV_AHEAD_LEN
+    #define MBEDTLS_TRANSPORT_RECV_AHEAD_LEN    256U
+#endif
+
+/* Number of consecutive zero length writes tolerated while flushing the staging buffer */
+#ifndef MBEDTLS_TRANSPORT_CORK_FLUSH_RETRIES
+    #define MBEDTLS_TRANSPORT_CORK_FLUSH_RETRIES    3U
+#endif
+
+/* Lifetime of the cached broker address. lwIP getaddrinfo does not report the record TTL,
+ * so this bounds the reuse of an address on top of the TTL applied by the lwIP DNS table.
+ * Set to 0 to resolve the host name on every connection. */
+#ifndef MBEDTLS_TRANSPORT_ADDR_CACHE_TTL_MS
+    #define MBEDTLS_TRANSPORT_ADDR_CACHE_TTL_MS    ( 5U * 60U * 1000U )
+#endif
+
+/* 1 to offer TLS 1.3 as well as TLS 1.2. Requires MBEDTLS_SSL_PROTO_TLS1_3, and an mbedtls
+ * release whose TLS 1.3 client sends a client certificate for brokers which require one. */
+#ifndef MBEDTLS_TRANSPORT_TLS1_3
+    #define MBEDTLS_TRANSPORT_TLS1_3    0
+#endif
+
+#if ( MBEDTLS_TRANSPORT_TLS1_3 == 1 ) && !defined( MBEDTLS_SSL_PROTO_TLS1_3 )
+    #error "MBEDTLS_TRANSPORT_TLS1_3 requires MBEDTLS_SSL_PROTO_TLS1_3"
+#endif
+
+/* Number of distinct parsed CA chains kept between connections */
+#ifndef MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES
+    #define MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES    2
+#endif
+
+/* Largest number of root CA objects in a cacheable chain. Longer lists are parsed per connection. */
+#ifndef MBEDTLS_TRANSPORT_CA_CACHE_MAX_CERTS
+    #define MBEDTLS_TRANSPORT_CA_CACHE_MAX_CERTS    4
+#endif
+
+/* Number of verified server chains remembered across connections. Set to 0 to have mbedtls verify every chain. */
+#ifndef MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES
+    #define MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES    4
+#endif
+
+/* Lifetime of a verified chain. The device has no calendar time (MBEDTLS_HAVE_TIME_DATE is not set),
+ * so this bounds how long a result is reused without checking the chain again. */
+#ifndef MBEDTLS_TRANSPORT_VERIFY_CACHE_TTL_MS
+    #define MBEDTLS_TRANSPORT_VERIFY_CACHE_TTL_MS    ( 60U * 60U * 1000U )
+#endif
+
+/**
+ * @brief Parsed CA chain shared by every connection configured with the same root CA objects.
+ */
+typedef struct CaChainCacheEntry
+{
+    PkiObject_t pxRootCaCerts[ MBEDTLS_TRANSPORT_CA_CACHE_MAX_CERTS ];
+    size_t uxNumRootCA;
+    #ifdef MBEDTLS_TRANSPORT_PKCS11
+        /* Private copy of the labels referenced by pxRootCaCerts */
+        char pcLabels[ MBEDTLS_TRANSPORT_CA_CACHE_MAX_CERTS ][ configTLS_MAX_LABEL_LEN + 1 ];
+    #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+    uint32_t ulGeneration;
+    uint32_t ulRefCount;
+
+    /* Set once the entry is no longer in the cache. Freed when the last reference is released. */
+    BaseType_t xStale;
+    mbedtls_x509_crt xRootCaChain;
+} CaChainCacheEntry_t;
+
+typedef struct
+{
+    SemaphoreHandle_t xMutex;
+    StaticSemaphore_t xMutexBuffer;
+    CaChainCacheEntry_t * pxEntries[ MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES ];
+} CaChainCache_t;
+
+static CaChainCache_t xCaChainCache = { 0 };
+
+static MemPressureHandler_t xCaChainCacheShrinker;
+
+#if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Server chain which passed verification, identified by the SHA-256 of the presented
+ * certificates, the trusted root CAs and the host name.
+ */
+    typedef struct VerifyCacheEntry
+    {
+        unsigned char pucDigest[ 32 ];
+        uint32_t ulGeneration;
+        TickType_t xVerifiedTime;
+        BaseType_t xValid;
+    } VerifyCacheEntry_t;
+
+    static VerifyCacheEntry_t xVerifyCache[ MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES ] = { 0 };
+    static uint32_t ulVerifyCacheNext = 0;
+#endif /* MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 */
 
 /**
  * @brief Secured connection context.
@@ -79,14 +360,61 @@ typedef struct TLSContext
     ConnectionState_t xConnectionState;
     SockHandle_t xSockHandle;
 
-    NotifyThreadCtx_t * pxNotifyThreadCtx;
+    /* Phase timing of the connection being established */
+    TlsHandshakeTiming_t xTiming;
+
+    #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+        /* MBEDTLS_SSL_MAX_FRAG_LEN_* code requested in the ClientHello */
+        unsigned char ucMaxFragLenCode;
+    #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+    #ifdef MBEDTLS_CHACHAPOLY_C
+        /* Offer pxChaChaPolyFirstCiphersuites instead of the mbedtls default list */
+        BaseType_t xPreferChaChaPoly;
+    #endif /* MBEDTLS_CHACHAPOLY_C */
+
+    /* Socket options applied at connect, see mbedtls_transport_set_socket_profile */
+    TlsSocketProfile_t xSocketProfile;
+
+    SocketNotifyCtx_t * pxSocketNotifyCtx;
+
+    #ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+        /* Netconn of the socket, see SO_NETCONN in lwipopts.h. NULL to receive through the socket */
+        struct netconn * pxNetconn;
+
+        /* Partially consumed pbuf chain taken from the netconn receive mailbox */
+        struct pbuf * pxRxPbuf;
+        uint16_t usRxOffset;
+    #endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
+
+    /* Address of the last successful connection, tried before a fresh DNS lookup */
+    BaseType_t xAddrCacheValid;
+    TickType_t xAddrCacheTime;
+    struct sockaddr_storage xAddrCache;
+    socklen_t xAddrCacheLen;
+    int lAddrCacheSockType;
+    int lAddrCacheProtocol;
+    char pcAddrCacheHost[ MBEDTLS_SSL_MAX_HOST_NAME_LEN + 1 ];
+
+    /* Write coalescing, see mbedtls_transport_cork */
+    BaseType_t xCorked;
+    uint8_t * pucCorkBuffer;
+    size_t uxCorkLen;
+    int32_t lCorkError; /* Failed flush of mbedtls_transport_cork, returned by send and recv until disconnect */
+
+    #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+        /* Plaintext read by mbedtls_ssl_read but not yet returned, see lTransportRead */
+        size_t uxRecvAheadOffset;
+        size_t uxRecvAheadLen;
+        uint8_t pucRecvAhead[ MBEDTLS_TRANSPORT_RECV_AHEAD_LEN ];
+    #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
 
     /* TLS connection */
     mbedtls_ssl_config xSslConfig;
     mbedtls_ssl_context xSslCtx;
 
     /* Certificates */
-    mbedtls_x509_crt xRootCaChain;
+    CaChainCacheEntry_t * pxCaChain;
     mbedtls_x509_crt xClientCert;
 
     /* Private Key */
@@ -102,6 +430,15 @@ typedef struct TLSContext
     #ifdef TRANSPORT_USE_CTR_DRBG
         mbedtls_ctr_drbg_context xCtrDrbgCtx;
     #endif /* TRANSPORT_USE_CTR_DRBG */
+
+    #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+        /* Session from the last successful handshake, offered on reconnect */
+        mbedtls_ssl_session xSession;
+        BaseType_t xSessionValid;
+        BaseType_t xSessionOffered;
+        uint16_t usSessionPort;
+        char pcSessionHost[ MBEDTLS_SSL_MAX_HOST_NAME_LEN + 1 ];
+    #endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
 } TLSContext_t;
 
 
@@ -115,14 +452,44 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
                                                const PkiObject_t * pxRootCaCerts,
                                                const size_t uxNumRootCA );
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vCaChainCacheEntryRelease( CaChainCacheEntry_t * pxEntry );
+
+static void vCaChainCacheRelease( TLSContext_t * pxTLSCtx );
+
+static size_t xCaChainCacheShrink( MemPressureLevel_t xLevel,
+                                   void * pvCtx );
+
+#if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+    static int lVerifyServerChain( TLSContext_t * pxTLSCtx,
+                                   const char * pcHostName );
+#endif /* MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 */
+
+static BaseType_t xSocketNotifyRegister( SocketNotifyCtx_t * pxSocketNotifyCtx,
+                                         SockHandle_t xSockHandle );
+
+static void vSocketNotifyUnregister( SocketNotifyCtx_t * pxSocketNotifyCtx );
+
+static void vSocketNotifyRearm( SocketNotifyCtx_t * pxSocketNotifyCtx );
+
+static void vRecvReadyRearm( TLSContext_t * pxTLSCtx );
 
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle );
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vTransportSocketClose( TLSContext_t * pxTLSCtx );
 
+#ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+    static void vNetconnRecvRelease( TLSContext_t * pxTLSCtx );
+#endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
 
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+#ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+    static void vSessionCacheClear( TLSContext_t * pxTLSCtx );
+
+    static void vSessionCacheOffer( TLSContext_t * pxTLSCtx,
+                                    const char * pcHostName,
+                                    uint16_t usPort );
+
+    static void vSessionCacheStore( TLSContext_t * pxTLSCtx,
+                                    const char * pcHostName,
+                                    uint16_t usPort );
+#endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
 
 #ifdef MBEDTLS_DEBUG_C
 /* Used to print mbedTLS log output. */
@@ -135,699 +502,1892 @@ static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
 
 /*-----------------------------------------------------------*/
 
-static void vSocketNotifyThread( void * pvParameters )
+static void vPhaseTimerStart( PhaseTimer_t * pxTimer )
 {
-    NotifyThreadCtx_t * pxCtx = ( NotifyThreadCtx_t * ) pvParameters;
-    SockHandle_t xSockHandle = pxCtx->xSockHandle;
-    BaseType_t xExitFlag = pdFALSE;
-    fd_set xReadSet;
-    fd_set xErrorSet;
-    int lRslt;
-    uint32_t ulNotifyValue = 0;
-
-    ( void ) xTaskNotifyStateClear( NULL );
-
-    if( pxCtx->pxRecvReadyCallback == NULL )
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
     {
-        xExitFlag = pdTRUE;
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
     }
 
-    while( !xExitFlag )
-    {
-        FD_ZERO( &xReadSet );
-        FD_ZERO( &xErrorSet );
-        FD_SET( xSockHandle, &xReadSet );
-        FD_SET( xSockHandle, &xErrorSet );
-
-        lRslt = sock_select( xSockHandle + 1, &xReadSet, NULL, &xErrorSet, NULL );
+    pxTimer->ulCycles = DWT->CYCCNT;
+    pxTimer->xTicks = xTaskGetTickCount();
+}
 
-        xExitFlag |= ( lRslt == 0 );
+/*-----------------------------------------------------------*/
 
-        if( ( lRslt == 0 ) ||
-            FD_ISSET( xSockHandle, &xErrorSet ) )
-        {
-            xExitFlag = pdTRUE;
-        }
-        else
-        {
-            if( FD_ISSET( xSockHandle, &xReadSet ) &&
-                pxCtx->pxRecvReadyCallback )
-            {
-                pxCtx->pxRecvReadyCallback( pxCtx->pvRecvReadyCallbackCtx );
-            }
-        }
+/* Microseconds since vPhaseTimerStart. Falls back to the tick count once the cycle counter may have wrapped. */
+static uint32_t ulPhaseTimerElapsedUs( const PhaseTimer_t * pxTimer )
+{
+    uint32_t ulElapsedMs = ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() - pxTimer->xTicks );
+    uint32_t ulElapsedUs;
 
-        if( xTaskNotifyWait( 0x0, 0xFFFFFFFF, &ulNotifyValue, portMAX_DELAY ) )
-        {
-            if( ulNotifyValue == 0xFFFFFFFF )
-            {
-                xExitFlag = pdTRUE;
-            }
-        }
+    if( ulElapsedMs >= 10000U )
+    {
+        ulElapsedUs = ulElapsedMs * 1000U;
+    }
+    else
+    {
+        ulElapsedUs = ( DWT->CYCCNT - pxTimer->ulCycles ) / ( SystemCoreClock / 1000000U );
     }
 
-    /* Delete thread error */
-    pxCtx->xTaskHandle = NULL;
-    vTaskDelete( NULL );
+    return ulElapsedUs;
 }
 
 /*-----------------------------------------------------------*/
 
-static int32_t lMbedtlsErrToTransportError( int32_t lError )
+static TlsHandshakePhase_t xHandshakeStateToPhase( int lState )
 {
-    switch( lError )
+    TlsHandshakePhase_t xPhase;
+
+    switch( lState )
     {
-        case 0:
-            lError = TLS_TRANSPORT_SUCCESS;
+        case MBEDTLS_SSL_HELLO_REQUEST:
+        case MBEDTLS_SSL_CLIENT_HELLO:
+        case MBEDTLS_SSL_SERVER_HELLO:
+            xPhase = TLS_PHASE_HELLO;
             break;
 
-        case MBEDTLS_ERR_X509_ALLOC_FAILED:
-            lError = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+        case MBEDTLS_SSL_SERVER_CERTIFICATE:
+            xPhase = TLS_PHASE_SERVER_CERT;
             break;
 
-        case MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED:
-            lError = TLS_TRANSPORT_INTERNAL_ERROR;
+        case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
+            xPhase = TLS_PHASE_SERVER_KEX;
             break;
 
-        case MBEDTLS_ERR_SSL_BAD_INPUT_DATA:
-            lError = TLS_TRANSPORT_INVALID_PARAMETER;
+        case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+            xPhase = TLS_PHASE_CLIENT_KEX;
             break;
 
-        case MBEDTLS_ERR_X509_CERT_UNKNOWN_FORMAT:
-        case MBEDTLS_ERR_X509_BAD_INPUT_DATA:
-        case MBEDTLS_ERR_PEM_BAD_INPUT_DATA:
-        case MBEDTLS_ERR_PEM_NO_HEADER_FOOTER_PRESENT:
-            lError = TLS_TRANSPORT_PKI_OBJECT_PARSE_FAIL;
+        case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+            xPhase = TLS_PHASE_CLIENT_SIGN;
             break;
 
         default:
-            lError = lError < 0 ? TLS_TRANSPORT_UNKNOWN_ERROR : TLS_TRANSPORT_SUCCESS;
+            xPhase = TLS_PHASE_FINISH;
             break;
     }
 
-    return lError;
+    return xPhase;
 }
 
 /*-----------------------------------------------------------*/
-#ifndef MBEDTLS_X509_REMOVE_INFO
-    #ifdef X509_CRT_ERROR_INFO
-        #undef X509_CRT_ERROR_INFO
-    #endif /* X509_CRT_ERROR_INFO */
-    #define X509_CRT_ERROR_INFO( err, err_str, info ) \
-    case err:                                         \
-        pcVerifyInfo = info; break;
-    static const char * pcGetVerifyInfoString( unsigned int flag )
-    {
-        const char * pcVerifyInfo = "Unknown Failure reason.";
-
-        switch( flag )
-        {
-            MBEDTLS_X509_CRT_ERROR_INFO_LIST
-            default:
-                break;
-        }
 
-        return pcVerifyInfo;
+static void vRecordHandshakeTiming( const TlsHandshakeTiming_t * pxTiming )
+{
+    taskENTER_CRITICAL();
+    {
+        xTimingHistory[ ulTimingHistoryCount % MBEDTLS_TRANSPORT_TIMING_HISTORY ] = *pxTiming;
+        ulTimingHistoryCount++;
     }
-#endif /* MBEDTLS_X509_REMOVE_INFO */
+    taskEXIT_CRITICAL();
+}
 
 /*-----------------------------------------------------------*/
 
-
-static void vLogCertificateVerifyResult( unsigned int flags )
+size_t mbedtls_transport_get_handshake_timing( TlsHandshakeTiming_t * pxTimings,
+                                               size_t uxMaxTimings )
 {
-    #ifndef MBEDTLS_X509_REMOVE_INFO
-        for( unsigned int mask = 1; mask != ( 1U << 31 ); mask = mask << 1 )
+    size_t uxCount = 0;
+
+    configASSERT( pxTimings != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        while( ( uxCount < uxMaxTimings ) &&
+               ( uxCount < MBEDTLS_TRANSPORT_TIMING_HISTORY ) &&
+               ( uxCount < ulTimingHistoryCount ) )
         {
-            if( ( flags & mask ) > 0 )
-            {
-                LogError( "Certificate Verification Failure: %s", pcGetVerifyInfoString( flags & mask ) );
-            }
+            pxTimings[ uxCount ] = xTimingHistory[ ( ulTimingHistoryCount - 1 - uxCount ) % MBEDTLS_TRANSPORT_TIMING_HISTORY ];
+            uxCount++;
         }
-    #endif /* !MBEDTLS_X509_REMOVE_INFO */
+    }
+    taskEXIT_CRITICAL();
+
+    return uxCount;
 }
 
 /*-----------------------------------------------------------*/
 
-static size_t uxGetCertCNFromName( unsigned char ** ppucCommonName,
-                                   mbedtls_x509_name * pxCertName )
+static void vSocketDispatcherWake( void )
 {
-    size_t uxCommonNameLen = 0;
-
-    configASSERT( ppucCommonName != NULL );
-    configASSERT( pxCertName != NULL );
-
-    *ppucCommonName = NULL;
+    uint8_t ucWake = 0;
 
-    for( ; pxCertName != NULL; pxCertName = pxCertName->next )
+    if( xDispatcher.xWakeSock >= 0 )
     {
-        if( MBEDTLS_OID_CMP( MBEDTLS_OID_AT_CN, &( pxCertName->oid ) ) == 0 )
-        {
-            *ppucCommonName = pxCertName->MBEDTLS_PRIVATE( val ).p;
-            uxCommonNameLen = pxCertName->MBEDTLS_PRIVATE( val ).len;
-            break;
-        }
+        ( void ) sock_sendto( xDispatcher.xWakeSock, &ucWake, sizeof( ucWake ), MSG_DONTWAIT,
+                              ( struct sockaddr * ) &( xDispatcher.xWakeAddr ),
+                              sizeof( xDispatcher.xWakeAddr ) );
     }
-
-    return( uxCommonNameLen );
 }
 
 /*-----------------------------------------------------------*/
 
-static void vLogCertInfo( mbedtls_x509_crt * pxCert,
-                          const char * pcMessage )
+static void vSocketDispatcherTask( void * pvParameters )
 {
-    /* Iterate over added certs and print information */
-    unsigned char * pucSubjectCN = NULL;
-    unsigned char * pucIssuerCN = NULL;
-    unsigned char * pucSerialNumber = NULL;
-    char pcSerialNumberHex[ 41 ] = { 0 };
-    size_t uxSubjectCNLen = 0;
-    size_t uxIssuerCNLen = 0;
-    size_t uxSerialNumberLen = 0;
-    mbedtls_x509_time * pxValidFrom = NULL;
-    mbedtls_x509_time * pxValidTo = NULL;
+    ( void ) pvParameters;
 
-    uxSubjectCNLen = uxGetCertCNFromName( &pucSubjectCN,
-                                          &( pxCert->subject ) );
+    for( ; ; )
+    {
+        fd_set xReadSet;
+        fd_set xErrorSet;
+        SockHandle_t xMaxSock = xDispatcher.xWakeSock;
+        int lRslt;
 
-    uxIssuerCNLen = uxGetCertCNFromName( &pucIssuerCN,
-                                         &( pxCert->issuer ) );
+        FD_ZERO( &xReadSet );
+        FD_ZERO( &xErrorSet );
+        FD_SET( xDispatcher.xWakeSock, &xReadSet );
 
-    uxSerialNumberLen = pxCert->serial.len;
-    pucSerialNumber = pxCert->serial.p;
+        ( void ) xSemaphoreTake( xDispatcher.xMutex, portMAX_DELAY );
 
-    for( uint32_t i = 0; i < uxSerialNumberLen; i++ )
-    {
-        if( i == 21 )
+        for( uint32_t i = 0; i < MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS; i++ )
         {
-            break;
-        }
+            SocketNotifyCtx_t * pxCtx = xDispatcher.pxCtxList[ i ];
 
-        snprintf( &( pcSerialNumberHex[ i * 2 ] ), 3, "%.02X", pucSerialNumber[ i ] );
-    }
+            if( ( pxCtx != NULL ) &&
+                ( pxCtx->xArmed == pdTRUE ) )
+            {
+                FD_SET( pxCtx->xSockHandle, &xReadSet );
+                FD_SET( pxCtx->xSockHandle, &xErrorSet );
 
-    pxValidFrom = &( pxCert->valid_from );
-    pxValidTo = &( pxCert->valid_to );
+                if( pxCtx->xSockHandle > xMaxSock )
+                {
+                    xMaxSock = pxCtx->xSockHandle;
+                }
+            }
+        }
 
-    if( pcMessage && pucSubjectCN && pucIssuerCN && pucSerialNumber && pxValidFrom && pxValidTo )
-    {
-        LogInfo( "%s CN=%.*s, SN:0x%s", pcMessage, uxSubjectCNLen, pucSubjectCN, pcSerialNumberHex );
-        LogInfo( "Issuer: CN=%.*s", uxIssuerCNLen, pucIssuerCN );
-        LogInfo( "Valid From: %04d-%02d-%02d, Expires: %04d-%02d-%02d",
-                 pxValidFrom->year, pxValidFrom->mon, pxValidFrom->day,
-                 pxValidTo->year, pxValidTo->mon, pxValidTo->day );
-    }
-}
+        ( void ) xSemaphoreGive( xDispatcher.xMutex );
 
-/*-----------------------------------------------------------*/
-/*TODO add proper timeout */
-static int mbedtls_ssl_send( void * pvCtx,
-                             const unsigned char * pcBuf,
-                             size_t uxLen )
-{
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
-    int lError = 0;
-    size_t uxBytesSent = 0;
-    uint32_t ulBackofftimeMs = 1;
+        lRslt = sock_select( xMaxSock + 1, &xReadSet, NULL, &xErrorSet, NULL );
 
-    if( ( pxSockHandle == NULL ) ||
-        ( *pxSockHandle < 0 ) )
-    {
-        lError = MBEDTLS_ERR_NET_SOCKET_FAILED;
-    }
-    else
-    {
-        while( uxBytesSent < uxLen && lError == 0 )
+        if( lRslt > 0 )
         {
-            ssize_t xRslt = sock_send( *pxSockHandle,
-                                       ( void * const ) pcBuf,
-                                       uxLen,
-                                       0 );
-
-            if( xRslt > 0 )
-            {
-                uxBytesSent += ( size_t ) xRslt;
-            }
-            else
+            if( FD_ISSET( xDispatcher.xWakeSock, &xReadSet ) )
             {
-                lError = *__errno();
+                uint8_t pucDrain[ 8 ];
 
-                if( lError != EWOULDBLOCK )
+                while( sock_recv( xDispatcher.xWakeSock, pucDrain, sizeof( pucDrain ), MSG_DONTWAIT ) > 0 )
                 {
-                    LogError( "Got Error code: %ld", lError );
                 }
+            }
 
-                switch( lError )
-                {
-                    #if EAGAIN != EWOULDBLOCK
-                        case EAGAIN:
-                    #endif
-                    case EINTR:
-                    case EWOULDBLOCK:
-                        break;
-
-                    case EPIPE:
-                    case ECONNRESET:
-                        lError = MBEDTLS_ERR_NET_CONN_RESET;
-                        break;
+            /* Callbacks run with the mutex held so that a context can not be unregistered while in use */
+            ( void ) xSemaphoreTake( xDispatcher.xMutex, portMAX_DELAY );
 
-                    default:
-                        lError = MBEDTLS_ERR_NET_SEND_FAILED;
-                        break;
-                }
+            for( uint32_t i = 0; i < MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS; i++ )
+            {
+                SocketNotifyCtx_t * pxCtx = xDispatcher.pxCtxList[ i ];
 
-                if( lError == EWOULDBLOCK )
+                if( ( pxCtx != NULL ) &&
+                    ( pxCtx->xArmed == pdTRUE ) &&
+                    ( FD_ISSET( pxCtx->xSockHandle, &xReadSet ) ||
+                      FD_ISSET( pxCtx->xSockHandle, &xErrorSet ) ) )
                 {
-                    vTaskDelay( ulBackofftimeMs );
-                    ulBackofftimeMs = ulBackofftimeMs * 2;
-                    lError = 0;
+                    pxCtx->xArmed = pdFALSE;
+                    pxCtx->pxRecvReadyCallback( pxCtx->pvRecvReadyCallbackCtx );
                 }
             }
+
+            ( void ) xSemaphoreGive( xDispatcher.xMutex );
+        }
+        else
+        {
+            /* A socket was closed while in the select set, rebuild the set */
+            vTaskDelay( 1 );
         }
     }
-
-    return ( int ) lError < 0 ? lError : uxBytesSent;
 }
 
 /*-----------------------------------------------------------*/
 
-static int mbedtls_ssl_recv( void * pvCtx,
-                             unsigned char * pcBuf,
-                             size_t xLen )
+/* Create the dispatcher task and its wake socket. Called with xDispatcher.xMutex held. */
+static BaseType_t xSocketDispatcherStart( void )
 {
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
-    int lError = -1;
+    BaseType_t xResult = pdPASS;
+
+    if( xDispatcher.xWakeSock < 0 )
+    {
+        socklen_t xAddrLen = sizeof( xDispatcher.xWakeAddr );
+
+        xDispatcher.xWakeSock = sock_socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+        if( xDispatcher.xWakeSock >= 0 )
+        {
+            memset( &( xDispatcher.xWakeAddr ), 0, sizeof( xDispatcher.xWakeAddr ) );
+            xDispatcher.xWakeAddr.sin_family = AF_INET;
+            xDispatcher.xWakeAddr.sin_addr.s_addr = PP_HTONL( INADDR_LOOPBACK );
+            xDispatcher.xWakeAddr.sin_port = 0;
+
+            if( ( sock_bind( xDispatcher.xWakeSock, ( struct sockaddr * ) &( xDispatcher.xWakeAddr ),
+                             sizeof( xDispatcher.xWakeAddr ) ) != 0 ) ||
+                ( sock_getsockname( xDispatcher.xWakeSock, ( struct sockaddr * ) &( xDispatcher.xWakeAddr ),
+                                    &xAddrLen ) != 0 ) )
+            {
+                ( void ) sock_close( xDispatcher.xWakeSock );
+                xDispatcher.xWakeSock = -1;
+            }
+        }
+
+        if( xDispatcher.xWakeSock < 0 )
+        {
+            LogError( "Failed to create the socket dispatcher wake socket." );
+            xResult = pdFAIL;
+        }
+    }
 
-    if( ( pxSockHandle != NULL ) &&
-        ( *pxSockHandle >= 0 ) )
+    if( ( xResult == pdPASS ) &&
+        ( xDispatcher.xTaskHandle == NULL ) )
     {
-        lError = sock_recv( *pxSockHandle,
-                            ( void * ) pcBuf,
-                            xLen,
-                            0 );
+        xDispatcher.xTaskHandle = xTaskCreateStatic( vSocketDispatcherTask,
+                                                     "SockDispatch",
+                                                     SOCK_DISPATCH_STACK_DEPTH,
+                                                     NULL,
+                                                     SOCK_DISPATCH_PRIORITY,
+                                                     xDispatcher.puxStackBuffer,
+                                                     &( xDispatcher.xTaskBuffer ) );
     }
 
-    if( lError < 0 )
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef TRANSPORT_ECDHE_POOL
+    static void vEcdhePoolTask( void * pvParameters )
     {
-        lError = *__errno();
+        ( void ) pvParameters;
 
-        /* force use of newlibc errno */
-        switch( *__errno() )
+        mbedtls_entropy_init( &( xEcdhePool.xEntropyCtx ) );
+
+        for( ; ; )
         {
-            #if EAGAIN != EWOULDBLOCK
-                case EAGAIN:
-            #endif
-            case EINTR:
-            case EWOULDBLOCK:
-                lError = MBEDTLS_ERR_SSL_WANT_READ;
-                break;
+            int lRslt;
 
-            case EPIPE:
-            case ECONNRESET:
-                lError = MBEDTLS_ERR_NET_CONN_RESET;
-                break;
+            do
+            {
+                lRslt = pka_ecdh_pool_fill( mbedtls_entropy_func, &( xEcdhePool.xEntropyCtx ) );
+            }
+            while( lRslt > 0 );
 
-            default:
-                lError = MBEDTLS_ERR_NET_RECV_FAILED;
-                break;
+            if( lRslt < 0 )
+            {
+                LogWarn( "Failed to generate an ECDHE key pair ahead of time: Error: %s : %s.",
+                         mbedtlsHighLevelCodeOrDefault( lRslt ),
+                         mbedtlsLowLevelCodeOrDefault( lRslt ) );
+            }
+
+            /* Woken up by mbedtls_transport_connect once a handshake may have used a key pair */
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
         }
     }
 
-    return lError;
-}
+/*-----------------------------------------------------------*/
+
+/* Create the pool task on the first connection, wake it up on the following ones */
+    static void vEcdhePoolKick( void )
+    {
+        BaseType_t xCreate = pdFALSE;
+
+        taskENTER_CRITICAL();
+
+        if( xEcdhePool.xStarted == pdFALSE )
+        {
+            xEcdhePool.xStarted = pdTRUE;
+            xCreate = pdTRUE;
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( xCreate == pdTRUE )
+        {
+            xEcdhePool.xTaskHandle = xTaskCreateStatic( vEcdhePoolTask,
+                                                        "EcdhePool",
+                                                        ECDHE_POOL_STACK_DEPTH,
+                                                        NULL,
+                                                        ECDHE_POOL_PRIORITY,
+                                                        xEcdhePool.puxStackBuffer,
+                                                        &( xEcdhePool.xTaskBuffer ) );
+        }
+        else if( xEcdhePool.xTaskHandle != NULL )
+        {
+            ( void ) xTaskNotifyGive( xEcdhePool.xTaskHandle );
+        }
+    }
+#endif /* TRANSPORT_ECDHE_POOL */
 
 /*-----------------------------------------------------------*/
 
-NetworkContext_t * mbedtls_transport_allocate( void )
+static BaseType_t xSocketNotifyRegister( SocketNotifyCtx_t * pxSocketNotifyCtx,
+                                         SockHandle_t xSockHandle )
 {
-    TLSContext_t * pxTLSCtx = NULL;
+    BaseType_t xResult = pdFAIL;
 
-    pxTLSCtx = ( TLSContext_t * ) pvPortMalloc( sizeof( TLSContext_t ) );
+    configASSERT( pxSocketNotifyCtx );
 
-    if( pxTLSCtx == NULL )
+    if( xDispatcher.xMutex == NULL )
     {
-        LogError( "Failed to allocate memory for TLSContext_t." );
+        vTaskSuspendAll();
+
+        if( xDispatcher.xMutex == NULL )
+        {
+            xDispatcher.xMutex = xSemaphoreCreateMutexStatic( &( xDispatcher.xMutexBuffer ) );
+        }
+
+        ( void ) xTaskResumeAll();
     }
-    else
-    {
-        memset( pxTLSCtx, 0, sizeof( TLSContext_t ) );
-        pxTLSCtx->xConnectionState = STATE_ALLOCATED;
-        pxTLSCtx->xSockHandle = -1;
-        mbedtls_ssl_config_init( &( pxTLSCtx->xSslConfig ) );
-        mbedtls_ssl_init( &( pxTLSCtx->xSslCtx ) );
 
-        mbedtls_x509_crt_init( &( pxTLSCtx->xClientCert ) );
-        mbedtls_x509_crt_init( &( pxTLSCtx->xRootCaChain ) );
-        mbedtls_pk_init( &( pxTLSCtx->xPkCtx ) );
+    ( void ) xSemaphoreTake( xDispatcher.xMutex, portMAX_DELAY );
 
-        #ifdef MBEDTLS_TRANSPORT_PKCS11
-            pxTLSCtx->xP11SessionHandle = CK_INVALID_HANDLE;
-        #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+    if( xSocketDispatcherStart() == pdPASS )
+    {
+        SocketNotifyCtx_t ** ppxSlot = NULL;
 
-        mbedtls_entropy_init( &( pxTLSCtx->xEntropyCtx ) );
+        for( uint32_t i = 0; i < MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS; i++ )
+        {
+            if( xDispatcher.pxCtxList[ i ] == pxSocketNotifyCtx )
+            {
+                ppxSlot = &( xDispatcher.pxCtxList[ i ] );
+                break;
+            }
+            else if( ( ppxSlot == NULL ) &&
+                     ( xDispatcher.pxCtxList[ i ] == NULL ) )
+            {
+                ppxSlot = &( xDispatcher.pxCtxList[ i ] );
+            }
+            else
+            {
+                /* Empty */
+            }
+        }
 
-        #ifdef TRANSPORT_USE_CTR_DRBG
-            mbedtls_ctr_drbg_init( &( pxTLSCtx->xCtrDrbgCtx ) );
-        #endif /* TRANSPORT_USE_CTR_DRBG */
+        if( ppxSlot != NULL )
+        {
+            pxSocketNotifyCtx->xSockHandle = xSockHandle;
+            pxSocketNotifyCtx->xArmed = pdTRUE;
+            *ppxSlot = pxSocketNotifyCtx;
+            xResult = pdPASS;
+        }
+        else
+        {
+            LogError( "No free socket dispatcher slot. Increase MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS." );
+        }
+    }
 
-        #ifdef MBEDTLS_THREADING_ALT
-            mbedtls_platform_threading_init();
-        #endif /* MBEDTLS_THREADING_ALT */
+    ( void ) xSemaphoreGive( xDispatcher.xMutex );
+
+    if( xResult == pdPASS )
+    {
+        vSocketDispatcherWake();
     }
 
-    return ( NetworkContext_t * ) pxTLSCtx;
+    return xResult;
 }
 
 /*-----------------------------------------------------------*/
 
-void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
+static void vSocketNotifyUnregister( SocketNotifyCtx_t * pxSocketNotifyCtx )
 {
-    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    configASSERT( pxSocketNotifyCtx );
 
-    if( pxNetworkContext != NULL )
+    if( ( xDispatcher.xMutex != NULL ) &&
+        ( pxSocketNotifyCtx->xSockHandle >= 0 ) )
     {
-        vFreeNotifyThreadCtx( pxTLSCtx->pxNotifyThreadCtx );
+        ( void ) xSemaphoreTake( xDispatcher.xMutex, portMAX_DELAY );
 
-        if( pxTLSCtx->xSockHandle >= 0 )
+        for( uint32_t i = 0; i < MBEDTLS_TRANSPORT_MAX_RECV_CALLBACKS; i++ )
         {
-            ( void ) sock_close( pxTLSCtx->xSockHandle );
-        }
-
-        mbedtls_ssl_config_free( &( pxTLSCtx->xSslConfig ) );
-        mbedtls_ssl_free( &( pxTLSCtx->xSslCtx ) );
-        mbedtls_x509_crt_free( &( pxTLSCtx->xRootCaChain ) );
-        mbedtls_x509_crt_free( &( pxTLSCtx->xClientCert ) );
-        mbedtls_pk_free( &( pxTLSCtx->xPkCtx ) );
-
-        #ifdef MBEDTLS_TRANSPORT_PKCS11
-            if( pxTLSCtx->xP11SessionHandle != CK_INVALID_HANDLE )
+            if( xDispatcher.pxCtxList[ i ] == pxSocketNotifyCtx )
             {
-                CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
-
-                if( ( C_GetFunctionList( &pxFunctionList ) == CKR_OK ) &&
-                    ( pxFunctionList->C_CloseSession != NULL ) )
-                {
-                    pxFunctionList->C_CloseSession( pxTLSCtx->xP11SessionHandle );
-                }
+                xDispatcher.pxCtxList[ i ] = NULL;
             }
-        #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+        }
 
-        #ifdef TRANSPORT_USE_CTR_DRBG
-            mbedtls_entropy_free( &( pxTLSCtx->xEntropyCtx ) );
-            mbedtls_ctr_drbg_free( &( pxTLSCtx->xCtrDrbgCtx ) );
-        #endif /* TRANSPORT_USE_CTR_DRBG */
+        pxSocketNotifyCtx->xSockHandle = -1;
+        pxSocketNotifyCtx->xArmed = pdFALSE;
 
-        vPortFree( ( void * ) pxTLSCtx );
+        ( void ) xSemaphoreGive( xDispatcher.xMutex );
+
+        /* Drop the socket from a pending select before it is closed */
+        vSocketDispatcherWake();
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static int lValidateCertByProfile( TLSContext_t * pxTLSCtx,
-                                   mbedtls_x509_crt * pxCert )
+static void vSocketNotifyRearm( SocketNotifyCtx_t * pxSocketNotifyCtx )
 {
-    int lFlags = 0;
-    const mbedtls_x509_crt_profile * pxCertProfile = NULL;
+    BaseType_t xWake = pdFALSE;
 
-    if( ( pxTLSCtx == NULL ) || ( pxCert == NULL ) )
+    configASSERT( pxSocketNotifyCtx );
+
+    if( ( pxSocketNotifyCtx->xSockHandle >= 0 ) &&
+        ( pxSocketNotifyCtx->xArmed == pdFALSE ) )
     {
-        lFlags = -1;
+        ( void ) xSemaphoreTake( xDispatcher.xMutex, portMAX_DELAY );
+
+        if( pxSocketNotifyCtx->xSockHandle >= 0 )
+        {
+            pxSocketNotifyCtx->xArmed = pdTRUE;
+            xWake = pdTRUE;
+        }
+
+        ( void ) xSemaphoreGive( xDispatcher.xMutex );
     }
-    else
+
+    if( xWake == pdTRUE )
     {
-        pxCertProfile = pxTLSCtx->xSslConfig.MBEDTLS_PRIVATE( cert_profile );
+        vSocketDispatcherWake();
     }
+}
 
-    if( pxCertProfile != NULL )
-    {
-        mbedtls_pk_context * pxPkCtx = &( pxCert->MBEDTLS_PRIVATE( pk ) );
+/*-----------------------------------------------------------*/
 
-        /* Check hashing algorithm */
-        if( ( pxCertProfile->allowed_mds & MBEDTLS_X509_ID_FLAG( pxCert->MBEDTLS_PRIVATE( sig_md ) ) ) == 0 )
+/* Wait for the next record after a successful read */
+static void vRecvReadyRearm( TLSContext_t * pxTLSCtx )
+{
+    SocketNotifyCtx_t * pxCtx = pxTLSCtx->pxSocketNotifyCtx;
+    /* Neither is the rest of a record already decrypted by mbedtls */
+    BaseType_t xDataPending = ( mbedtls_ssl_get_bytes_avail( &( pxTLSCtx->xSslCtx ) ) > 0 ) ? pdTRUE : pdFALSE;
+
+    #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+        if( pxTLSCtx->uxRecvAheadLen > 0 )
         {
-            lFlags |= MBEDTLS_X509_BADCERT_BAD_MD;
+            xDataPending = pdTRUE;
         }
+    #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
 
-        if( ( pxCertProfile->allowed_pks & MBEDTLS_X509_ID_FLAG( pxCert->MBEDTLS_PRIVATE( sig_pk ) ) ) == 0 )
+    #ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+        /* Data left in the held pbuf is not visible to select, so report it directly */
+        if( pxTLSCtx->pxRxPbuf != NULL )
         {
-            lFlags |= MBEDTLS_X509_BADCERT_BAD_PK;
+            xDataPending = pdTRUE;
         }
+    #endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
 
-        /* Validate public key of cert */
-        #if defined( MBEDTLS_RSA_C )
-            if( ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_RSA ) ||
-                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_RSASSA_PSS ) )
-            {
-                if( mbedtls_pk_get_bitlen( pxPkCtx ) < pxCertProfile->rsa_min_bitlen )
-                {
-                    lFlags |= MBEDTLS_X509_BADCERT_BAD_KEY;
-                }
-            }
-        #endif /* MBEDTLS_RSA_C */
-
-        #if defined( MBEDTLS_ECP_C )
-            if( ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECDSA ) ||
-                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECKEY ) ||
-                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECKEY_DH ) )
-            {
-                mbedtls_ecp_group_id xECGroupId = mbedtls_pk_ec( *pxPkCtx )->MBEDTLS_PRIVATE( grp ).id;
-
-                if( ( pxCertProfile->allowed_curves & MBEDTLS_X509_ID_FLAG( xECGroupId ) ) == 0 )
-                {
-                    lFlags |= MBEDTLS_X509_BADCERT_BAD_KEY;
-                }
-            }
-        #endif /* MBEDTLS_ECP_C */
+    if( pxCtx == NULL )
+    {
+        /* No receive ready callback registered */
+    }
+    else if( xDataPending == pdTRUE )
+    {
+        pxCtx->pxRecvReadyCallback( pxCtx->pvRecvReadyCallbackCtx );
+    }
+    else
+    {
+        vSocketNotifyRearm( pxCtx );
     }
-
-    return lFlags;
 }
 
 /*-----------------------------------------------------------*/
 
-static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
-                                                       const PkiObject_t * pxPrivateKey,
-                                                       const PkiObject_t * pxClientCert )
+static void vTransportSocketClose( TLSContext_t * pxTLSCtx )
 {
-    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
-    mbedtls_pk_context * pxPkCtx = NULL;
-    mbedtls_x509_crt * pxCertCtx = NULL;
-    mbedtls_pk_context * pxCertPkCtx = NULL;
+    #ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+        vNetconnRecvRelease( pxTLSCtx );
+    #endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
 
-    configASSERT( pxTLSCtx );
-    configASSERT( pxPrivateKey );
-    configASSERT( pxClientCert );
+    ( void ) sock_close( pxTLSCtx->xSockHandle );
+    pxTLSCtx->xSockHandle = -1;
+}
 
-    pxCertCtx = &( pxTLSCtx->xClientCert );
-    pxPkCtx = &( pxTLSCtx->xPkCtx );
+/*-----------------------------------------------------------*/
 
-    /* Reset pk and certificate contexts if this is a reconfiguration */
-    if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
+static int32_t lMbedtlsErrToTransportError( int32_t lError )
+{
+    switch( lError )
     {
-        mbedtls_pk_free( pxPkCtx );
+        case 0:
+            lError = TLS_TRANSPORT_SUCCESS;
+            break;
+
+        case MBEDTLS_ERR_X509_ALLOC_FAILED:
+            lError = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+            break;
+
+        case MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED:
+            lError = TLS_TRANSPORT_INTERNAL_ERROR;
+            break;
+
+        case MBEDTLS_ERR_SSL_BAD_INPUT_DATA:
+            lError = TLS_TRANSPORT_INVALID_PARAMETER;
+            break;
+
+        case MBEDTLS_ERR_X509_CERT_UNKNOWN_FORMAT:
+        case MBEDTLS_ERR_X509_BAD_INPUT_DATA:
+        case MBEDTLS_ERR_PEM_BAD_INPUT_DATA:
+        case MBEDTLS_ERR_PEM_NO_HEADER_FOOTER_PRESENT:
+            lError = TLS_TRANSPORT_PKI_OBJECT_PARSE_FAIL;
+            break;
+
+        default:
+            lError = lError < 0 ? TLS_TRANSPORT_UNKNOWN_ERROR : TLS_TRANSPORT_SUCCESS;
+            break;
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+#ifndef MBEDTLS_X509_REMOVE_INFO
+    #ifdef X509_CRT_ERROR_INFO
+        #undef X509_CRT_ERROR_INFO
+    #endif /* X509_CRT_ERROR_INFO */
+    #define X509_CRT_ERROR_INFO( err, err_str, info ) \
+    case err:                                         \
+        pcVerifyInfo = info; break;
+    static const char * pcGetVerifyInfoString( unsigned int flag )
+    {
+        const char * pcVerifyInfo = "Unknown Failure reason.";
+
+        switch( flag )
+        {
+            MBEDTLS_X509_CRT_ERROR_INFO_LIST
+            default:
+                break;
+        }
+
+        return pcVerifyInfo;
+    }
+#endif /* MBEDTLS_X509_REMOVE_INFO */
+
+/*-----------------------------------------------------------*/
+
+
+static void vLogCertificateVerifyResult( unsigned int flags )
+{
+    #ifndef MBEDTLS_X509_REMOVE_INFO
+        for( unsigned int mask = 1; mask != ( 1U << 31 ); mask = mask << 1 )
+        {
+            if( ( flags & mask ) > 0 )
+            {
+                LogError( "Certificate Verification Failure: %s", pcGetVerifyInfoString( flags & mask ) );
+            }
+        }
+    #endif /* !MBEDTLS_X509_REMOVE_INFO */
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t uxGetCertCNFromName( unsigned char ** ppucCommonName,
+                                   mbedtls_x509_name * pxCertName )
+{
+    size_t uxCommonNameLen = 0;
+
+    configASSERT( ppucCommonName != NULL );
+    configASSERT( pxCertName != NULL );
+
+    *ppucCommonName = NULL;
+
+    for( ; pxCertName != NULL; pxCertName = pxCertName->next )
+    {
+        if( MBEDTLS_OID_CMP( MBEDTLS_OID_AT_CN, &( pxCertName->oid ) ) == 0 )
+        {
+            *ppucCommonName = pxCertName->MBEDTLS_PRIVATE( val ).p;
+            uxCommonNameLen = pxCertName->MBEDTLS_PRIVATE( val ).len;
+            break;
+        }
+    }
+
+    return( uxCommonNameLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLogCertInfo( mbedtls_x509_crt * pxCert,
+                          const char * pcMessage )
+{
+    /* Iterate over added certs and print information */
+    unsigned char * pucSubjectCN = NULL;
+    unsigned char * pucIssuerCN = NULL;
+    unsigned char * pucSerialNumber = NULL;
+    char pcSerialNumberHex[ 41 ] = { 0 };
+    size_t uxSubjectCNLen = 0;
+    size_t uxIssuerCNLen = 0;
+    size_t uxSerialNumberLen = 0;
+    mbedtls_x509_time * pxValidFrom = NULL;
+    mbedtls_x509_time * pxValidTo = NULL;
+
+    uxSubjectCNLen = uxGetCertCNFromName( &pucSubjectCN,
+                                          &( pxCert->subject ) );
+
+    uxIssuerCNLen = uxGetCertCNFromName( &pucIssuerCN,
+                                         &( pxCert->issuer ) );
+
+    uxSerialNumberLen = pxCert->serial.len;
+    pucSerialNumber = pxCert->serial.p;
+
+    for( uint32_t i = 0; i < uxSerialNumberLen; i++ )
+    {
+        if( i == 21 )
+        {
+            break;
+        }
+
+        snprintf( &( pcSerialNumberHex[ i * 2 ] ), 3, "%.02X", pucSerialNumber[ i ] );
+    }
+
+    pxValidFrom = &( pxCert->valid_from );
+    pxValidTo = &( pxCert->valid_to );
+
+    if( pcMessage && pucSubjectCN && pucIssuerCN && pucSerialNumber && pxValidFrom && pxValidTo )
+    {
+        LogInfo( "%s CN=%.*s, SN:0x%s", pcMessage, uxSubjectCNLen, pucSubjectCN, pcSerialNumberHex );
+        LogInfo( "Issuer: CN=%.*s", uxIssuerCNLen, pucIssuerCN );
+        LogInfo( "Valid From: %04d-%02d-%02d, Expires: %04d-%02d-%02d",
+                 pxValidFrom->year, pxValidFrom->mon, pxValidFrom->day,
+                 pxValidTo->year, pxValidTo->mon, pxValidTo->day );
+    }
+}
+
+/*-----------------------------------------------------------*/
+/* Wait up to ulTimeoutMs for xSockHandle to accept more data. Returns the result of sock_select. */
+static int lWaitForWritable( SockHandle_t xSockHandle,
+                             uint32_t ulTimeoutMs )
+{
+    fd_set xWriteSet;
+    fd_set xErrorSet;
+    struct timeval xTimeout =
+    {
+        .tv_sec  = ( long ) ( ulTimeoutMs / 1000U ),
+        .tv_usec = ( long ) ( ( ulTimeoutMs % 1000U ) * 1000U )
+    };
+
+    FD_ZERO( &xWriteSet );
+    FD_ZERO( &xErrorSet );
+    FD_SET( xSockHandle, &xWriteSet );
+    FD_SET( xSockHandle, &xErrorSet );
+
+    return sock_select( xSockHandle + 1, NULL, &xWriteSet, &xErrorSet, &xTimeout );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vRecordSendStall( TickType_t xStallTicks,
+                              BaseType_t xTimedOut )
+{
+    uint32_t ulStallMs = ( uint32_t ) pdTICKS_TO_MS( xStallTicks );
+
+    taskENTER_CRITICAL();
+    {
+        xTransportStats.ulSendStalls++;
+        xTransportStats.ullSendStallTotalMs += ulStallMs;
+
+        if( ulStallMs > xTransportStats.ulSendStallMaxMs )
+        {
+            xTransportStats.ulSendStallMaxMs = ulStallMs;
+        }
+
+        if( xTimedOut == pdTRUE )
+        {
+            xTransportStats.ulSendStallTimeouts++;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_get_stats( TlsTransportStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        *pxStats = xTransportStats;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static int mbedtls_ssl_send( void * pvCtx,
+                             const unsigned char * pcBuf,
+                             size_t uxLen )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
+    SockHandle_t * pxSockHandle = ( pxTLSCtx != NULL ) ? &( pxTLSCtx->xSockHandle ) : NULL;
+    int lError = 0;
+    size_t uxBytesSent = 0;
+
+    if( ( pxSockHandle == NULL ) ||
+        ( *pxSockHandle < 0 ) )
+    {
+        lError = MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    else
+    {
+        while( uxBytesSent < uxLen && lError == 0 )
+        {
+            ssize_t xRslt = sock_send( *pxSockHandle,
+                                       ( const void * ) &( pcBuf[ uxBytesSent ] ),
+                                       uxLen - uxBytesSent,
+                                       0 );
+
+            if( xRslt > 0 )
+            {
+                uxBytesSent += ( size_t ) xRslt;
+            }
+            else
+            {
+                lError = *__errno();
+
+                switch( lError )
+                {
+                    #if EAGAIN != EWOULDBLOCK
+                        case EAGAIN:
+                    #endif
+                    case EINTR:
+                    case EWOULDBLOCK:
+                        lError = EWOULDBLOCK;
+                        break;
+
+                    case EPIPE:
+                    case ECONNRESET:
+                        LogError( "Got Error code: %ld", lError );
+                        lError = MBEDTLS_ERR_NET_CONN_RESET;
+                        break;
+
+                    default:
+                        LogError( "Got Error code: %ld", lError );
+                        lError = MBEDTLS_ERR_NET_SEND_FAILED;
+                        break;
+                }
+
+                if( lError == EWOULDBLOCK )
+                {
+                    TickType_t xStallStart = xTaskGetTickCount();
+                    int lSelectRslt = lWaitForWritable( *pxSockHandle, MBEDTLS_TRANSPORT_SEND_STALL_TIMEOUT_MS );
+
+                    vRecordSendStall( xTaskGetTickCount() - xStallStart,
+                                      ( lSelectRslt == 0 ) ? pdTRUE : pdFALSE );
+
+                    if( lSelectRslt > 0 )
+                    {
+                        /* Writable or in error, let the next sock_send report which */
+                        lError = 0;
+                    }
+                    else if( uxBytesSent == 0 )
+                    {
+                        /* Nothing sent yet, let mbedtls retry the whole record later */
+                        lError = MBEDTLS_ERR_SSL_WANT_WRITE;
+                    }
+                    else
+                    {
+                        /* Report the partial write, mbedtls resumes from the offset */
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return ( int ) lError < 0 ? lError : uxBytesSent;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+
+/*
+ * Copy received data from the pbuf chain held by the netconn straight into the mbedtls input buffer.
+ * This bypasses lwip_recv and keeps the remainder of a chain between the header and body reads
+ * mbedtls makes for each record.
+ */
+    static int lNetconnRecv( TLSContext_t * pxTLSCtx,
+                             unsigned char * pcBuf,
+                             size_t xLen )
+    {
+        size_t uxCopied = 0;
+        int lResult = 0;
+        err_t xError = ERR_OK;
+
+        while( ( xError == ERR_OK ) &&
+               ( uxCopied < xLen ) )
+        {
+            if( pxTLSCtx->pxRxPbuf == NULL )
+            {
+                /*
+                 * Only block (subject to SO_RCVTIMEO and O_NONBLOCK) when nothing has been copied yet.
+                 * A FIN behind the copied bytes is left pending, the next call then returns it.
+                 */
+                xError = netconn_recv_tcp_pbuf_flags( pxTLSCtx->pxNetconn, &( pxTLSCtx->pxRxPbuf ),
+                                                      ( uxCopied > 0 ) ? ( NETCONN_DONTBLOCK | NETCONN_NOFIN ) : 0 );
+                pxTLSCtx->usRxOffset = 0;
+            }
+
+            if( xError == ERR_OK )
+            {
+                struct pbuf * pxPbuf = pxTLSCtx->pxRxPbuf;
+                size_t uxChunk = pxPbuf->tot_len - pxTLSCtx->usRxOffset;
+
+                if( uxChunk > ( xLen - uxCopied ) )
+                {
+                    uxChunk = xLen - uxCopied;
+                }
+
+                ( void ) pbuf_copy_partial( pxPbuf, &( pcBuf[ uxCopied ] ), ( u16_t ) uxChunk, pxTLSCtx->usRxOffset );
+
+                uxCopied += uxChunk;
+                pxTLSCtx->usRxOffset += ( uint16_t ) uxChunk;
+
+                if( pxTLSCtx->usRxOffset >= pxPbuf->tot_len )
+                {
+                    ( void ) pbuf_free( pxPbuf );
+                    pxTLSCtx->pxRxPbuf = NULL;
+                    pxTLSCtx->usRxOffset = 0;
+                }
+            }
+        }
+
+        if( uxCopied > 0 )
+        {
+            lResult = ( int ) uxCopied;
+        }
+        else
+        {
+            switch( xError )
+            {
+                case ERR_CLSD:
+                    /* Orderly shutdown by the peer, mbedtls reads 0 as end of stream */
+                    lResult = 0;
+                    break;
+
+                case ERR_WOULDBLOCK:
+                case ERR_TIMEOUT:
+                    *__errno() = EWOULDBLOCK;
+                    lResult = -1;
+                    break;
+
+                case ERR_RST:
+                case ERR_ABRT:
+                    *__errno() = ECONNRESET;
+                    lResult = -1;
+                    break;
+
+                default:
+                    *__errno() = EIO;
+                    lResult = -1;
+                    break;
+            }
+        }
+
+        return lResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vNetconnRecvRelease( TLSContext_t * pxTLSCtx )
+    {
+        pxTLSCtx->pxNetconn = NULL;
+
+        if( pxTLSCtx->pxRxPbuf != NULL )
+        {
+            ( void ) pbuf_free( pxTLSCtx->pxRxPbuf );
+            pxTLSCtx->pxRxPbuf = NULL;
+            pxTLSCtx->usRxOffset = 0;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
+
+static int mbedtls_ssl_recv( void * pvCtx,
+                             unsigned char * pcBuf,
+                             size_t xLen )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
+    int lError = -1;
+
+    if( ( pxTLSCtx != NULL ) &&
+        ( pxTLSCtx->xSockHandle >= 0 ) )
+    {
+        #ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+            if( pxTLSCtx->pxNetconn != NULL )
+            {
+                lError = lNetconnRecv( pxTLSCtx, pcBuf, xLen );
+            }
+            else
+        #endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
+        {
+            lError = sock_recv( pxTLSCtx->xSockHandle,
+                                ( void * ) pcBuf,
+                                xLen,
+                                0 );
+        }
+    }
+
+    if( lError < 0 )
+    {
+        lError = *__errno();
+
+        /* force use of newlibc errno */
+        switch( *__errno() )
+        {
+            #if EAGAIN != EWOULDBLOCK
+                case EAGAIN:
+            #endif
+            case EINTR:
+            case EWOULDBLOCK:
+                lError = MBEDTLS_ERR_SSL_WANT_READ;
+                break;
+
+            case EPIPE:
+            case ECONNRESET:
+                lError = MBEDTLS_ERR_NET_CONN_RESET;
+                break;
+
+            default:
+                lError = MBEDTLS_ERR_NET_RECV_FAILED;
+                break;
+        }
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+NetworkContext_t * mbedtls_transport_allocate( void )
+{
+    TLSContext_t * pxTLSCtx = NULL;
+
+    pxTLSCtx = ( TLSContext_t * ) pvPortMalloc( sizeof( TLSContext_t ) );
+
+    if( pxTLSCtx == NULL )
+    {
+        LogError( "Failed to allocate memory for TLSContext_t." );
+    }
+    else
+    {
+        memset( pxTLSCtx, 0, sizeof( TLSContext_t ) );
+        pxTLSCtx->xConnectionState = STATE_ALLOCATED;
+        pxTLSCtx->xSockHandle = -1;
+
+        #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+            ( void ) mbedtls_transport_set_max_frag_len( ( NetworkContext_t * ) pxTLSCtx,
+                                                         MBEDTLS_TRANSPORT_DEFAULT_MAX_FRAG_LEN );
+        #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+        mbedtls_ssl_config_init( &( pxTLSCtx->xSslConfig ) );
+        mbedtls_ssl_init( &( pxTLSCtx->xSslCtx ) );
+
+        mbedtls_x509_crt_init( &( pxTLSCtx->xClientCert ) );
+        mbedtls_pk_init( &( pxTLSCtx->xPkCtx ) );
+
+        #ifdef MBEDTLS_TRANSPORT_PKCS11
+            pxTLSCtx->xP11SessionHandle = CK_INVALID_HANDLE;
+        #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+
+        mbedtls_entropy_init( &( pxTLSCtx->xEntropyCtx ) );
+
+        #ifdef TRANSPORT_USE_CTR_DRBG
+            mbedtls_ctr_drbg_init( &( pxTLSCtx->xCtrDrbgCtx ) );
+        #endif /* TRANSPORT_USE_CTR_DRBG */
+
+        #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+            mbedtls_ssl_session_init( &( pxTLSCtx->xSession ) );
+        #endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
+
+        #ifdef MBEDTLS_THREADING_ALT
+            mbedtls_platform_threading_init();
+        #endif /* MBEDTLS_THREADING_ALT */
+    }
+
+    return ( NetworkContext_t * ) pxTLSCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+
+    if( pxNetworkContext != NULL )
+    {
+        if( pxTLSCtx->pxSocketNotifyCtx )
+        {
+            vSocketNotifyUnregister( pxTLSCtx->pxSocketNotifyCtx );
+            vPortFree( pxTLSCtx->pxSocketNotifyCtx );
+            pxTLSCtx->pxSocketNotifyCtx = NULL;
+        }
+
+        if( pxTLSCtx->xSockHandle >= 0 )
+        {
+            vTransportSocketClose( pxTLSCtx );
+        }
+
+        if( pxTLSCtx->pucCorkBuffer != NULL )
+        {
+            vPortFree( pxTLSCtx->pucCorkBuffer );
+            pxTLSCtx->pucCorkBuffer = NULL;
+        }
+
+        mbedtls_ssl_config_free( &( pxTLSCtx->xSslConfig ) );
+        mbedtls_ssl_free( &( pxTLSCtx->xSslCtx ) );
+        vCaChainCacheRelease( pxTLSCtx );
+        mbedtls_x509_crt_free( &( pxTLSCtx->xClientCert ) );
+        mbedtls_pk_free( &( pxTLSCtx->xPkCtx ) );
+
+        #ifdef MBEDTLS_TRANSPORT_PKCS11
+            if( pxTLSCtx->xP11SessionHandle != CK_INVALID_HANDLE )
+            {
+                CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
+
+                if( ( C_GetFunctionList( &pxFunctionList ) == CKR_OK ) &&
+                    ( pxFunctionList->C_CloseSession != NULL ) )
+                {
+                    pxFunctionList->C_CloseSession( pxTLSCtx->xP11SessionHandle );
+                }
+            }
+        #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+
+        #ifdef TRANSPORT_USE_CTR_DRBG
+            mbedtls_entropy_free( &( pxTLSCtx->xEntropyCtx ) );
+            mbedtls_ctr_drbg_free( &( pxTLSCtx->xCtrDrbgCtx ) );
+        #endif /* TRANSPORT_USE_CTR_DRBG */
+
+        #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+            mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+        #endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
+
+        vPortFree( ( void * ) pxTLSCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int lValidateCertByProfile( TLSContext_t * pxTLSCtx,
+                                   mbedtls_x509_crt * pxCert )
+{
+    int lFlags = 0;
+    const mbedtls_x509_crt_profile * pxCertProfile = NULL;
+
+    if( ( pxTLSCtx == NULL ) || ( pxCert == NULL ) )
+    {
+        lFlags = -1;
+    }
+    else
+    {
+        pxCertProfile = pxTLSCtx->xSslConfig.MBEDTLS_PRIVATE( cert_profile );
+    }
+
+    if( pxCertProfile != NULL )
+    {
+        mbedtls_pk_context * pxPkCtx = &( pxCert->MBEDTLS_PRIVATE( pk ) );
+
+        /* Check hashing algorithm */
+        if( ( pxCertProfile->allowed_mds & MBEDTLS_X509_ID_FLAG( pxCert->MBEDTLS_PRIVATE( sig_md ) ) ) == 0 )
+        {
+            lFlags |= MBEDTLS_X509_BADCERT_BAD_MD;
+        }
+
+        if( ( pxCertProfile->allowed_pks & MBEDTLS_X509_ID_FLAG( pxCert->MBEDTLS_PRIVATE( sig_pk ) ) ) == 0 )
+        {
+            lFlags |= MBEDTLS_X509_BADCERT_BAD_PK;
+        }
+
+        /* Validate public key of cert */
+        #if defined( MBEDTLS_RSA_C )
+            if( ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_RSA ) ||
+                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_RSASSA_PSS ) )
+            {
+                if( mbedtls_pk_get_bitlen( pxPkCtx ) < pxCertProfile->rsa_min_bitlen )
+                {
+                    lFlags |= MBEDTLS_X509_BADCERT_BAD_KEY;
+                }
+            }
+        #endif /* MBEDTLS_RSA_C */
+
+        #if defined( MBEDTLS_ECP_C )
+            if( ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECDSA ) ||
+                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECKEY ) ||
+                ( mbedtls_pk_get_type( pxPkCtx ) == MBEDTLS_PK_ECKEY_DH ) )
+            {
+                mbedtls_ecp_group_id xECGroupId = mbedtls_pk_ec( *pxPkCtx )->MBEDTLS_PRIVATE( grp ).id;
+
+                if( ( pxCertProfile->allowed_curves & MBEDTLS_X509_ID_FLAG( xECGroupId ) ) == 0 )
+                {
+                    lFlags |= MBEDTLS_X509_BADCERT_BAD_KEY;
+                }
+            }
+        #endif /* MBEDTLS_ECP_C */
+    }
+
+    return lFlags;
+}
+
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
+                                                       const PkiObject_t * pxPrivateKey,
+                                                       const PkiObject_t * pxClientCert )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    mbedtls_pk_context * pxPkCtx = NULL;
+    mbedtls_x509_crt * pxCertCtx = NULL;
+    mbedtls_pk_context * pxCertPkCtx = NULL;
+
+    configASSERT( pxTLSCtx );
+    configASSERT( pxPrivateKey );
+    configASSERT( pxClientCert );
+
+    pxCertCtx = &( pxTLSCtx->xClientCert );
+    pxPkCtx = &( pxTLSCtx->xPkCtx );
+
+    /* Reset pk and certificate contexts if this is a reconfiguration */
+    if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
+    {
+        mbedtls_pk_free( pxPkCtx );
         mbedtls_x509_crt_free( pxCertCtx );
 
-        mbedtls_pk_init( pxPkCtx );
-        mbedtls_x509_crt_init( pxCertCtx );
+        mbedtls_pk_init( pxPkCtx );
+        mbedtls_x509_crt_init( pxCertCtx );
+    }
+
+    configASSERT( pxTLSCtx->xSslConfig.f_rng );
+
+    xStatus = xPkiReadPrivateKey( pxPkCtx, pxPrivateKey,
+                                  pxTLSCtx->xSslConfig.f_rng,
+                                  pxTLSCtx->xSslConfig.p_rng );
+
+    if( xStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogError( "Failed to add private key to TLS context." );
+    }
+    else
+    {
+        xStatus = xPkiReadCertificate( pxCertCtx, pxClientCert );
+
+        if( xStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            LogError( "Failed to add client certificate to TLS context." );
+        }
+        else
+        {
+            pxCertPkCtx = &( pxCertCtx->MBEDTLS_PRIVATE( pk ) );
+        }
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        int lRslt = lValidateCertByProfile( pxTLSCtx, pxCertCtx );
+
+        if( lRslt != 0 )
+        {
+            vLogCertificateVerifyResult( lRslt );
+
+            xStatus = TLS_TRANSPORT_CLIENT_CERT_INVALID;
+        }
+        else
+        {
+            vLogCertInfo( pxCertCtx, "Client Certificate:" );
+        }
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        configASSERT( pxCertPkCtx );
+        configASSERT( pxPkCtx );
+
+        if( !( mbedtls_pk_can_do( pxCertPkCtx, MBEDTLS_PK_ECDSA ) &&
+               mbedtls_pk_can_do( pxPkCtx, MBEDTLS_PK_ECDSA ) ) &&
+            !( mbedtls_pk_can_do( pxCertPkCtx, MBEDTLS_PK_RSA ) &&
+               mbedtls_pk_can_do( pxPkCtx, MBEDTLS_PK_RSA ) ) )
+        {
+            LogError( "Private key and client certificate have mismatched key types." );
+            xStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+        }
+    }
+
+    /* Validate that the cert and pk match. */
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        mbedtls_pk_context xTempPubKeyCtx;
+
+        xTempPubKeyCtx.pk_ctx = pxCertPkCtx->pk_ctx;
+        xTempPubKeyCtx.pk_info = pxPkCtx->pk_info;
+
+        int lError = mbedtls_pk_check_pair( &xTempPubKeyCtx, pxPkCtx,
+                                            pxTLSCtx->xSslConfig.f_rng,
+                                            pxTLSCtx->xSslConfig.p_rng );
+
+        MBEDTLS_MSG_IF_ERROR( lError, "Public-Private keypair does not match the provided certificate." );
+
+        xStatus = ( lError == 0 ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_CREDENTIALS;
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        int lError = mbedtls_ssl_conf_own_cert( &( pxTLSCtx->xSslConfig ),
+                                                pxCertCtx, pxPkCtx );
+
+        MBEDTLS_MSG_IF_ERROR( lError, "Failed to configure TLS client certificate " );
+
+        xStatus = ( lError == 0 ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_CREDENTIALS;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t xParseCAChain( TLSContext_t * pxTLSCtx,
+                                           mbedtls_x509_crt * pxRootCaChain,
+                                           const PkiObject_t * pxRootCaCerts,
+                                           const size_t uxNumRootCA )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+
+    mbedtls_x509_crt * pxRootCertIterator = NULL;
+    size_t uxValidCertCount = 0;
+    int lError = 0;
+
+    configASSERT( pxTLSCtx );
+    configASSERT( pxRootCaChain );
+    configASSERT( pxRootCaCerts );
+    configASSERT( uxNumRootCA );
+
+    for( size_t uxIdx = 0; uxIdx < uxNumRootCA; uxIdx++ )
+    {
+        const PkiObject_t * pxRootCert = &( pxRootCaCerts[ uxIdx ] );
+        mbedtls_x509_crt * pxTempCaCert = NULL;
+
+        /* Heap allocate all but the first mbedtls_x509_crt object */
+        if( pxRootCertIterator == NULL )
+        {
+            pxTempCaCert = pxRootCaChain;
+        }
+        else
+        {
+            pxTempCaCert = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+        }
+
+        /* If heap allocation failed, break out of loop */
+        if( pxTempCaCert == NULL )
+        {
+            LogError( "Failed to allocate memory for mbedtls_x509_crt object." );
+            lError = MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+        else
+        {
+            mbedtls_x509_crt_init( pxTempCaCert );
+
+            /* load the certificate onto the heap */
+            lError = xPkiReadCertificate( pxTempCaCert, pxRootCert );
+
+            MBEDTLS_LOG_IF_ERROR( lError, "Failed to load the CA Certificate at index: %ld, Error: ", uxIdx );
+        }
+
+        if( lError == 0 )
+        {
+            lError = lValidateCertByProfile( pxTLSCtx, pxTempCaCert );
+
+            if( lError != 0 )
+            {
+                #if !defined( MBEDTLS_X509_REMOVE_INFO )
+                    LogError( "Failed to validate the CA Certificate at index: %ld. Reason: %s", uxIdx,
+                              pcGetVerifyInfoString( lError ) );
+                #else /* !defined( MBEDTLS_X509_REMOVE_INFO ) */
+                    LogError( "Failed to validate the CA Certificate at index: %ld.", uxIdx );
+                #endif
+            }
+        }
+
+        if( lError == 0 )
+        {
+            vLogCertInfo( pxTempCaCert, "CA Certificate: " );
+
+            /* Append to the list */
+            if( pxRootCertIterator != NULL )
+            {
+                pxRootCertIterator->MBEDTLS_PRIVATE( next ) = pxTempCaCert;
+            }
+
+            pxRootCertIterator = pxTempCaCert;
+            uxValidCertCount++;
+        }
+        /* Otherwise, handle the error */
+        else if( pxTempCaCert != NULL )
+        {
+            /* Free any allocated data */
+            mbedtls_x509_crt_free( pxTempCaCert );
+
+            /* Free pxTempCaCert if it is heap allocated (not first in list) */
+            if( pxRootCertIterator != NULL )
+            {
+                mbedtls_free( pxTempCaCert );
+            }
+        }
+
+        /* Break on memory allocation failure */
+        if( lError == MBEDTLS_ERR_X509_ALLOC_FAILED )
+        {
+            break;
+        }
     }
 
-    configASSERT( pxTLSCtx->xSslConfig.f_rng );
+    xStatus = lMbedtlsErrToTransportError( lError );
 
-    xStatus = xPkiReadPrivateKey( pxPkCtx, pxPrivateKey,
-                                  pxTLSCtx->xSslConfig.f_rng,
-                                  pxTLSCtx->xSslConfig.p_rng );
+    if( ( uxValidCertCount == 0 ) &&
+        ( lError != MBEDTLS_ERR_X509_ALLOC_FAILED ) )
+    {
+        LogError( "Failed to load any valid Root CA Certificates." );
+        xStatus = TLS_TRANSPORT_NO_VALID_CA_CERT;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCaChainCacheLock( void )
+{
+    if( xCaChainCache.xMutex == NULL )
+    {
+        vTaskSuspendAll();
+
+        if( xCaChainCache.xMutex == NULL )
+        {
+            xCaChainCache.xMutex = xSemaphoreCreateMutexStatic( &( xCaChainCache.xMutexBuffer ) );
+            vMemPressureRegister( &xCaChainCacheShrinker, "ca_chain_cache", xCaChainCacheShrink,
+                                  NULL, MEM_PRESSURE_PRIO_CACHE );
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+    ( void ) xSemaphoreTake( xCaChainCache.xMutex, portMAX_DELAY );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCaChainCacheUnlock( void )
+{
+    ( void ) xSemaphoreGive( xCaChainCache.xMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCaChainCacheEntryFree( CaChainCacheEntry_t * pxEntry )
+{
+    mbedtls_x509_crt_free( &( pxEntry->xRootCaChain ) );
+    vPortFree( pxEntry );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Remove an entry from the cache. Called with the cache mutex held. */
+static void vCaChainCacheEvict( uint32_t ulSlot )
+{
+    CaChainCacheEntry_t * pxEntry = xCaChainCache.pxEntries[ ulSlot ];
+
+    xCaChainCache.pxEntries[ ulSlot ] = NULL;
+    pxEntry->xStale = pdTRUE;
+
+    if( pxEntry->ulRefCount == 0 )
+    {
+        vCaChainCacheEntryFree( pxEntry );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Drop the chains no connection is using, they are parsed again by the next connect */
+static size_t xCaChainCacheShrink( MemPressureLevel_t xLevel,
+                                   void * pvCtx )
+{
+    size_t xReleased = 0;
+
+    ( void ) xLevel;
+    ( void ) pvCtx;
+
+    /* The task which ran out of memory may be in the middle of a connect with the cache locked */
+    if( xSemaphoreTake( xCaChainCache.xMutex, 0 ) == pdTRUE )
+    {
+        for( uint32_t ulSlot = 0; ulSlot < MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES; ulSlot++ )
+        {
+            CaChainCacheEntry_t * pxEntry = xCaChainCache.pxEntries[ ulSlot ];
+
+            if( ( pxEntry != NULL ) && ( pxEntry->ulRefCount == 0 ) )
+            {
+                /* The DER copy of each certificate is most of what mbedtls keeps for it */
+                xReleased += sizeof( CaChainCacheEntry_t );
+
+                for( const mbedtls_x509_crt * pxCrt = &( pxEntry->xRootCaChain ); pxCrt != NULL; pxCrt = pxCrt->next )
+                {
+                    xReleased += pxCrt->raw.len + ( ( pxCrt != &( pxEntry->xRootCaChain ) ) ? sizeof( mbedtls_x509_crt ) : 0U );
+                }
+
+                vCaChainCacheEvict( ulSlot );
+            }
+        }
+
+        ( void ) xSemaphoreGive( xCaChainCache.xMutex );
+    }
+
+    return xReleased;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Find a current entry for the given root CA objects. Called with the cache mutex held. */
+static CaChainCacheEntry_t * pxCaChainCacheLookup( const PkiObject_t * pxRootCaCerts,
+                                                   const size_t uxNumRootCA )
+{
+    CaChainCacheEntry_t * pxMatch = NULL;
+    uint32_t ulGeneration = ulPkiGetCertificateGeneration();
+
+    for( uint32_t ulSlot = 0; ulSlot < MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES; ulSlot++ )
+    {
+        CaChainCacheEntry_t * pxEntry = xCaChainCache.pxEntries[ ulSlot ];
+
+        if( pxEntry == NULL )
+        {
+            continue;
+        }
+
+        /* A certificate has been written since this entry was parsed */
+        if( pxEntry->ulGeneration != ulGeneration )
+        {
+            vCaChainCacheEvict( ulSlot );
+        }
+        else if( ( pxMatch == NULL ) &&
+                 ( pxEntry->uxNumRootCA == uxNumRootCA ) )
+        {
+            BaseType_t xIsEqual = pdTRUE;
+
+            for( size_t uxIdx = 0; ( uxIdx < uxNumRootCA ) && xIsEqual; uxIdx++ )
+            {
+                xIsEqual = xPkiObjectIsEqual( &( pxEntry->pxRootCaCerts[ uxIdx ] ), &( pxRootCaCerts[ uxIdx ] ) );
+            }
+
+            if( xIsEqual )
+            {
+                pxMatch = pxEntry;
+            }
+        }
+    }
+
+    return pxMatch;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Add a newly parsed entry, replacing an unreferenced one if the cache is full. Called with the cache mutex held. */
+static void vCaChainCacheInsert( CaChainCacheEntry_t * pxNewEntry )
+{
+    int32_t lFreeSlot = -1;
+
+    for( uint32_t ulSlot = 0; ulSlot < MBEDTLS_TRANSPORT_CA_CACHE_ENTRIES; ulSlot++ )
+    {
+        CaChainCacheEntry_t * pxEntry = xCaChainCache.pxEntries[ ulSlot ];
+
+        if( pxEntry == NULL )
+        {
+            lFreeSlot = ( int32_t ) ulSlot;
+            break;
+        }
+        else if( ( lFreeSlot < 0 ) &&
+                 ( pxEntry->ulRefCount == 0 ) )
+        {
+            lFreeSlot = ( int32_t ) ulSlot;
+        }
+    }
+
+    if( lFreeSlot >= 0 )
+    {
+        if( xCaChainCache.pxEntries[ lFreeSlot ] != NULL )
+        {
+            vCaChainCacheEvict( ( uint32_t ) lFreeSlot );
+        }
+
+        xCaChainCache.pxEntries[ lFreeSlot ] = pxNewEntry;
+    }
+    else
+    {
+        /* Every slot is in use. Keep the chain for this connection only. */
+        pxNewEntry->xStale = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
+                                               const PkiObject_t * pxRootCaCerts,
+                                               const size_t uxNumRootCA )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    CaChainCacheEntry_t * pxEntry = NULL;
+    CaChainCacheEntry_t * pxPrevEntry = NULL;
+
+    configASSERT( pxTLSCtx );
+    configASSERT( pxRootCaCerts );
+    configASSERT( uxNumRootCA );
+
+    /* The chain of a previous configuration stays referenced by the ssl config until
+     * the new one is in place, so a failed parse leaves a valid chain behind. */
+    pxPrevEntry = pxTLSCtx->pxCaChain;
+
+    /* Parsing is done with the mutex held so that concurrent connections wait for one copy. */
+    vCaChainCacheLock();
+
+    pxEntry = pxCaChainCacheLookup( pxRootCaCerts, uxNumRootCA );
+
+    if( pxEntry != NULL )
+    {
+        LogDebug( "Using cached CA chain." );
+    }
+    else
+    {
+        pxEntry = ( CaChainCacheEntry_t * ) pvPortMalloc( sizeof( CaChainCacheEntry_t ) );
+
+        if( pxEntry == NULL )
+        {
+            LogError( "Failed to allocate memory for CaChainCacheEntry_t." );
+            xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+        }
+        else
+        {
+            memset( pxEntry, 0, sizeof( CaChainCacheEntry_t ) );
+            mbedtls_x509_crt_init( &( pxEntry->xRootCaChain ) );
+            pxEntry->ulGeneration = ulPkiGetCertificateGeneration();
+
+            xStatus = xParseCAChain( pxTLSCtx, &( pxEntry->xRootCaChain ), pxRootCaCerts, uxNumRootCA );
+        }
+
+        if( xStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            if( pxEntry != NULL )
+            {
+                vCaChainCacheEntryFree( pxEntry );
+                pxEntry = NULL;
+            }
+        }
+        else if( uxNumRootCA > MBEDTLS_TRANSPORT_CA_CACHE_MAX_CERTS )
+        {
+            pxEntry->xStale = pdTRUE;
+        }
+        else
+        {
+            pxEntry->uxNumRootCA = uxNumRootCA;
+
+            for( size_t uxIdx = 0; uxIdx < uxNumRootCA; uxIdx++ )
+            {
+                pxEntry->pxRootCaCerts[ uxIdx ] = pxRootCaCerts[ uxIdx ];
+
+                #ifdef MBEDTLS_TRANSPORT_PKCS11
+                    if( pxRootCaCerts[ uxIdx ].xForm == OBJ_FORM_PKCS11_LABEL )
+                    {
+                        ( void ) strncpy( pxEntry->pcLabels[ uxIdx ], pxRootCaCerts[ uxIdx ].pcPkcs11Label,
+                                          configTLS_MAX_LABEL_LEN );
+                        pxEntry->pxRootCaCerts[ uxIdx ].pcPkcs11Label = pxEntry->pcLabels[ uxIdx ];
+                    }
+                #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+            }
+
+            vCaChainCacheInsert( pxEntry );
+        }
+    }
+
+    if( pxEntry != NULL )
+    {
+        pxEntry->ulRefCount++;
+        pxTLSCtx->pxCaChain = pxEntry;
+    }
+
+    vCaChainCacheUnlock();
+
+    /* Drop the chain from a previous configuration once the new one replaced it */
+    if( ( pxEntry != NULL ) &&
+        ( pxPrevEntry != NULL ) )
+    {
+        vCaChainCacheEntryRelease( pxPrevEntry );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCaChainCacheEntryRelease( CaChainCacheEntry_t * pxEntry )
+{
+    vCaChainCacheLock();
+
+    configASSERT( pxEntry->ulRefCount > 0 );
+    pxEntry->ulRefCount--;
+
+    /* Entries still in the cache stay parsed for the next connection */
+    if( ( pxEntry->ulRefCount == 0 ) &&
+        ( pxEntry->xStale == pdTRUE ) )
+    {
+        vCaChainCacheEntryFree( pxEntry );
+    }
+
+    vCaChainCacheUnlock();
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCaChainCacheRelease( TLSContext_t * pxTLSCtx )
+{
+    CaChainCacheEntry_t * pxEntry = pxTLSCtx->pxCaChain;
 
-    if( xStatus != TLS_TRANSPORT_SUCCESS )
+    if( pxEntry != NULL )
     {
-        LogError( "Failed to add private key to TLS context." );
+        vCaChainCacheEntryRelease( pxEntry );
+
+        pxTLSCtx->pxCaChain = NULL;
     }
-    else
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+
+/* Digest of everything a verification result depends on */
+    static int lVerifyCacheDigest( const mbedtls_x509_crt * pxPeerChain,
+                                   const mbedtls_x509_crt * pxRootCaChain,
+                                   const char * pcHostName,
+                                   unsigned char * pucDigest )
     {
-        xStatus = xPkiReadCertificate( pxCertCtx, pxClientCert );
+        int lError = 0;
+        mbedtls_sha256_context xSha256Ctx;
 
-        if( xStatus != TLS_TRANSPORT_SUCCESS )
+        mbedtls_sha256_init( &xSha256Ctx );
+
+        lError = mbedtls_sha256_starts( &xSha256Ctx, 0 );
+
+        for( const mbedtls_x509_crt * pxCert = pxPeerChain; ( lError == 0 ) && ( pxCert != NULL ); pxCert = pxCert->next )
         {
-            LogError( "Failed to add client certificate to TLS context." );
+            lError = mbedtls_sha256_update( &xSha256Ctx, pxCert->raw.p, pxCert->raw.len );
         }
-        else
+
+        for( const mbedtls_x509_crt * pxCert = pxRootCaChain; ( lError == 0 ) && ( pxCert != NULL ); pxCert = pxCert->next )
         {
-            pxCertPkCtx = &( pxCertCtx->MBEDTLS_PRIVATE( pk ) );
+            lError = mbedtls_sha256_update( &xSha256Ctx, pxCert->raw.p, pxCert->raw.len );
         }
-    }
-
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        int lRslt = lValidateCertByProfile( pxTLSCtx, pxCertCtx );
 
-        if( lRslt != 0 )
+        if( lError == 0 )
         {
-            vLogCertificateVerifyResult( lRslt );
-
-            xStatus = TLS_TRANSPORT_CLIENT_CERT_INVALID;
+            lError = mbedtls_sha256_update( &xSha256Ctx, ( const unsigned char * ) pcHostName, strlen( pcHostName ) );
         }
-        else
+
+        if( lError == 0 )
         {
-            vLogCertInfo( pxCertCtx, "Client Certificate:" );
+            lError = mbedtls_sha256_finish( &xSha256Ctx, pucDigest );
         }
-    }
 
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        configASSERT( pxCertPkCtx );
-        configASSERT( pxPkCtx );
+        mbedtls_sha256_free( &xSha256Ctx );
 
-        if( !( mbedtls_pk_can_do( pxCertPkCtx, MBEDTLS_PK_ECDSA ) &&
-               mbedtls_pk_can_do( pxPkCtx, MBEDTLS_PK_ECDSA ) ) &&
-            !( mbedtls_pk_can_do( pxCertPkCtx, MBEDTLS_PK_RSA ) &&
-               mbedtls_pk_can_do( pxPkCtx, MBEDTLS_PK_RSA ) ) )
-        {
-            LogError( "Private key and client certificate have mismatched key types." );
-            xStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
-        }
+        return lError;
     }
 
-    /* Validate that the cert and pk match. */
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        mbedtls_pk_context xTempPubKeyCtx;
+/*-----------------------------------------------------------*/
 
-        xTempPubKeyCtx.pk_ctx = pxCertPkCtx->pk_ctx;
-        xTempPubKeyCtx.pk_info = pxPkCtx->pk_info;
+    static BaseType_t xVerifyCacheLookup( const unsigned char * pucDigest )
+    {
+        BaseType_t xFound = pdFALSE;
+        uint32_t ulGeneration = ulPkiGetCertificateGeneration();
+        TickType_t xNow = xTaskGetTickCount();
 
-        int lError = mbedtls_pk_check_pair( &xTempPubKeyCtx, pxPkCtx,
-                                            pxTLSCtx->xSslConfig.f_rng,
-                                            pxTLSCtx->xSslConfig.p_rng );
+        taskENTER_CRITICAL();
 
-        MBEDTLS_MSG_IF_ERROR( lError, "Public-Private keypair does not match the provided certificate." );
+        for( uint32_t ulSlot = 0; ulSlot < MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES; ulSlot++ )
+        {
+            VerifyCacheEntry_t * pxEntry = &( xVerifyCache[ ulSlot ] );
 
-        xStatus = ( lError == 0 ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_CREDENTIALS;
-    }
+            if( pxEntry->xValid == pdFALSE )
+            {
+                continue;
+            }
 
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        int lError = mbedtls_ssl_conf_own_cert( &( pxTLSCtx->xSslConfig ),
-                                                pxCertCtx, pxPkCtx );
+            /* Drop results which are too old or predate a certificate update */
+            if( ( pxEntry->ulGeneration != ulGeneration ) ||
+                ( ( xNow - pxEntry->xVerifiedTime ) >= pdMS_TO_TICKS( MBEDTLS_TRANSPORT_VERIFY_CACHE_TTL_MS ) ) )
+            {
+                pxEntry->xValid = pdFALSE;
+            }
+            else if( memcmp( pxEntry->pucDigest, pucDigest, sizeof( pxEntry->pucDigest ) ) == 0 )
+            {
+                xFound = pdTRUE;
+            }
+        }
 
-        MBEDTLS_MSG_IF_ERROR( lError, "Failed to configure TLS client certificate " );
+        taskEXIT_CRITICAL();
 
-        xStatus = ( lError == 0 ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_CREDENTIALS;
+        return xFound;
     }
 
-    return xStatus;
-}
-
 /*-----------------------------------------------------------*/
 
-static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
-                                               const PkiObject_t * pxRootCaCerts,
-                                               const size_t uxNumRootCA )
-{
-    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    static void vVerifyCacheStore( const unsigned char * pucDigest )
+    {
+        uint32_t ulGeneration = ulPkiGetCertificateGeneration();
+        VerifyCacheEntry_t * pxEntry = NULL;
 
-    mbedtls_x509_crt * pxRootCertIterator = NULL;
-    mbedtls_x509_crt * pxRootCaChain = NULL;
-    size_t uxValidCertCount = 0;
-    int lError = 0;
+        taskENTER_CRITICAL();
 
-    configASSERT( pxTLSCtx );
-    configASSERT( pxRootCaCerts );
-    configASSERT( uxNumRootCA );
+        /* Replace the oldest result */
+        pxEntry = &( xVerifyCache[ ulVerifyCacheNext ] );
+        ulVerifyCacheNext = ( ulVerifyCacheNext + 1 ) % MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES;
 
-    pxRootCaChain = &( pxTLSCtx->xRootCaChain );
+        ( void ) memcpy( pxEntry->pucDigest, pucDigest, sizeof( pxEntry->pucDigest ) );
+        pxEntry->ulGeneration = ulGeneration;
+        pxEntry->xVerifiedTime = xTaskGetTickCount();
+        pxEntry->xValid = pdTRUE;
 
-    for( size_t uxIdx = 0; uxIdx < uxNumRootCA; uxIdx++ )
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Flags for any certificate in the chain which is outside its validity period */
+    static uint32_t ulCheckValidityPeriod( const mbedtls_x509_crt * pxChain )
     {
-        const PkiObject_t * pxRootCert = &( pxRootCaCerts[ uxIdx ] );
-        mbedtls_x509_crt * pxTempCaCert = NULL;
+        uint32_t ulFlags = 0;
 
-        /* Heap allocate all but the first mbedtls_x509_crt object */
-        if( pxRootCertIterator == NULL )
+        for( const mbedtls_x509_crt * pxCert = pxChain; pxCert != NULL; pxCert = pxCert->next )
         {
-            pxTempCaCert = pxRootCaChain;
-        }
-        else
-        {
-            pxTempCaCert = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+            if( mbedtls_x509_time_is_past( &( pxCert->valid_to ) ) != 0 )
+            {
+                ulFlags |= MBEDTLS_X509_BADCERT_EXPIRED;
+            }
+
+            if( mbedtls_x509_time_is_future( &( pxCert->valid_from ) ) != 0 )
+            {
+                ulFlags |= MBEDTLS_X509_BADCERT_FUTURE;
+            }
         }
 
-        /* If heap allocation failed, break out of loop */
-        if( pxTempCaCert == NULL )
+        return ulFlags;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Verify the chain received in the server Certificate message. Called from the handshake loop
+ * right after that message has been parsed, since mbedtls is configured with
+ * MBEDTLS_SSL_VERIFY_NONE. A chain identical to one verified earlier is accepted without
+ * checking its signatures again, but the validity period of every certificate is checked on
+ * each connection. The ServerKeyExchange / CertificateVerify signature is still checked by
+ * mbedtls with the public key of the presented leaf.
+ */
+    static int lVerifyServerChain( TLSContext_t * pxTLSCtx,
+                                   const char * pcHostName )
+    {
+        int lError = 0;
+        uint32_t ulFlags = 0;
+        unsigned char pucDigest[ 32 ] = { 0 };
+        mbedtls_ssl_session * pxSession = pxTLSCtx->xSslCtx.MBEDTLS_PRIVATE( session_negotiate );
+        mbedtls_x509_crt * pxPeerChain = pxSession->MBEDTLS_PRIVATE( peer_cert );
+        BaseType_t xCacheHit = pdFALSE;
+
+        if( ( pxPeerChain == NULL ) ||
+            ( pxTLSCtx->pxCaChain == NULL ) )
         {
-            LogError( "Failed to allocate memory for mbedtls_x509_crt object." );
-            lError = MBEDTLS_ERR_X509_ALLOC_FAILED;
+            LogError( "No server certificate to verify." );
+            ulFlags = MBEDTLS_X509_BADCERT_MISSING;
+            lError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
         }
         else
         {
-            mbedtls_x509_crt_init( pxTempCaCert );
-
-            /* load the certificate onto the heap */
-            lError = xPkiReadCertificate( pxTempCaCert, pxRootCert );
+            lError = lVerifyCacheDigest( pxPeerChain, &( pxTLSCtx->pxCaChain->xRootCaChain ),
+                                         pcHostName, pucDigest );
 
-            MBEDTLS_LOG_IF_ERROR( lError, "Failed to load the CA Certificate at index: %ld, Error: ", uxIdx );
+            MBEDTLS_MSG_IF_ERROR( lError, "Failed to hash the server certificate chain: " );
         }
 
         if( lError == 0 )
         {
-            lError = lValidateCertByProfile( pxTLSCtx, pxTempCaCert );
+            xCacheHit = xVerifyCacheLookup( pucDigest );
+        }
 
-            if( lError != 0 )
+        if( ( lError == 0 ) &&
+            ( xCacheHit == pdTRUE ) )
+        {
+            ulFlags = ulCheckValidityPeriod( pxPeerChain ) |
+                      ulCheckValidityPeriod( &( pxTLSCtx->pxCaChain->xRootCaChain ) );
+
+            if( ulFlags != 0 )
             {
-                #if !defined( MBEDTLS_X509_REMOVE_INFO )
-                    LogError( "Failed to validate the CA Certificate at index: %ld. Reason: %s", uxIdx,
-                              pcGetVerifyInfoString( lError ) );
-                #else /* !defined( MBEDTLS_X509_REMOVE_INFO ) */
-                    LogError( "Failed to validate the CA Certificate at index: %ld.", uxIdx );
-                #endif
+                vLogCertificateVerifyResult( ulFlags );
+                lError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
             }
         }
 
-        if( lError == 0 )
+        if( ( lError == 0 ) &&
+            ( xCacheHit == pdFALSE ) )
         {
-            vLogCertInfo( pxTempCaCert, "CA Certificate: " );
-
-            /* Append to the list */
-            if( pxRootCertIterator != NULL )
+            lError = mbedtls_x509_crt_verify_with_profile( pxPeerChain,
+                                                           &( pxTLSCtx->pxCaChain->xRootCaChain ),
+                                                           NULL,
+                                                           pxTLSCtx->xSslConfig.MBEDTLS_PRIVATE( cert_profile ),
+                                                           pcHostName,
+                                                           &ulFlags,
+                                                           NULL,
+                                                           NULL );
+
+            /* Every offered cipher suite signs the key exchange with the server key */
+            if( ( lError == 0 ) &&
+                ( mbedtls_x509_crt_check_key_usage( pxPeerChain, MBEDTLS_X509_KU_DIGITAL_SIGNATURE ) != 0 ) )
             {
-                pxRootCertIterator->MBEDTLS_PRIVATE( next ) = pxTempCaCert;
+                ulFlags |= MBEDTLS_X509_BADCERT_KEY_USAGE;
+                lError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
             }
 
-            pxRootCertIterator = pxTempCaCert;
-            uxValidCertCount++;
-        }
-        /* Otherwise, handle the error */
-        else if( pxTempCaCert != NULL )
-        {
-            /* Free any allocated data */
-            mbedtls_x509_crt_free( pxTempCaCert );
+            if( ( lError == 0 ) &&
+                ( mbedtls_x509_crt_check_extended_key_usage( pxPeerChain, MBEDTLS_OID_SERVER_AUTH,
+                                                             MBEDTLS_OID_SIZE( MBEDTLS_OID_SERVER_AUTH ) ) != 0 ) )
+            {
+                ulFlags |= MBEDTLS_X509_BADCERT_EXT_KEY_USAGE;
+                lError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+            }
 
-            /* Free pxTempCaCert if it is heap allocated (not first in list) */
-            if( pxRootCertIterator != NULL )
+            if( lError == 0 )
             {
-                mbedtls_free( pxTempCaCert );
+                vVerifyCacheStore( pucDigest );
+            }
+            else
+            {
+                vLogCertificateVerifyResult( ulFlags );
             }
         }
 
-        /* Break on memory allocation failure */
-        if( lError == MBEDTLS_ERR_X509_ALLOC_FAILED )
+        taskENTER_CRITICAL();
+
+        if( xCacheHit == pdTRUE )
         {
-            break;
+            xTransportStats.ulVerifyCacheHits++;
+        }
+        else
+        {
+            xTransportStats.ulVerifyCacheMisses++;
         }
-    }
 
-    xStatus = lMbedtlsErrToTransportError( lError );
+        taskEXIT_CRITICAL();
 
-    if( ( uxValidCertCount == 0 ) &&
-        ( lError != MBEDTLS_ERR_X509_ALLOC_FAILED ) )
-    {
-        LogError( "Failed to load any valid Root CA Certificates." );
-        xStatus = TLS_TRANSPORT_NO_VALID_CA_CERT;
-    }
+        pxSession->MBEDTLS_PRIVATE( verify_result ) = ulFlags;
 
-    return xStatus;
-}
+        if( lError != 0 )
+        {
+            ( void ) mbedtls_ssl_send_alert_message( &( pxTLSCtx->xSslCtx ),
+                                                     MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                                     MBEDTLS_SSL_ALERT_MSG_BAD_CERT );
+        }
+        else if( xCacheHit == pdTRUE )
+        {
+            LogDebug( "Server certificate chain found in the verify cache." );
+        }
+
+        return lError;
+    }
 
 /*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 */
 TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkContext,
                                                   const char ** ppcAlpnProtos,
                                                   const PkiObject_t * pxPrivateKey,
@@ -974,16 +2534,31 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
                                       MBEDTLS_SSL_MAJOR_VERSION_3,
                                       MBEDTLS_SSL_MINOR_VERSION_3 );
 
+        #if ( MBEDTLS_TRANSPORT_TLS1_3 == 1 )
+            mbedtls_ssl_conf_max_version( pxSslConfig,
+                                          MBEDTLS_SSL_MAJOR_VERSION_3,
+                                          MBEDTLS_SSL_MINOR_VERSION_4 );
+        #endif
+
         mbedtls_ssl_conf_cert_profile( pxSslConfig, &mbedtls_x509_crt_profile_default );
 
-        mbedtls_ssl_conf_authmode( pxSslConfig, MBEDTLS_SSL_VERIFY_REQUIRED );
+        #if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+            /* The server chain is verified by lVerifyServerChain during the handshake */
+            mbedtls_ssl_conf_authmode( pxSslConfig, MBEDTLS_SSL_VERIFY_NONE );
+        #else
+            mbedtls_ssl_conf_authmode( pxSslConfig, MBEDTLS_SSL_VERIFY_REQUIRED );
+        #endif
     }
 
     /* Configure certificate auth if a cert and key were provided */
     if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
         pxPrivateKey && pxClientCert )
     {
+        PhaseTimer_t xTimer;
+
+        vPhaseTimerStart( &xTimer );
         xStatus = xConfigureCertificateAuth( pxTLSCtx, pxPrivateKey, pxClientCert );
+        pxTLSCtx->xTiming.pulPhaseUs[ TLS_PHASE_CLIENT_CERT ] = ulPhaseTimerElapsedUs( &xTimer );
     }
 
     /* Configure ALPN Protocols */
@@ -1006,29 +2581,37 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
             /* Enable the max fragment extension. 4096 bytes is currently the largest fragment size permitted.
              * See RFC 8449 https://tools.ietf.org/html/rfc8449 for more information.
              *
-             * Smaller values can be found in "mbedtls/include/ssl.h".
+             * The requested size is selected per connection with mbedtls_transport_set_max_frag_len.
+             * With MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH the I/O buffers shrink to the negotiated size
+             * once the handshake completes.
              */
-            lError = mbedtls_ssl_conf_max_frag_len( pxSslConfig, MBEDTLS_SSL_MAX_FRAG_LEN_4096 );
+            lError = mbedtls_ssl_conf_max_frag_len( pxSslConfig, pxTLSCtx->ucMaxFragLenCode );
 
             MBEDTLS_MSG_IF_ERROR( lError, "Failed to configure maximum fragment length extension, " );
             xStatus = lMbedtlsErrToTransportError( lError );
         }
     #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
 
+    #ifdef MBEDTLS_CHACHAPOLY_C
+        if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+            ( pxTLSCtx->xPreferChaChaPoly == pdTRUE ) )
+        {
+            mbedtls_ssl_conf_ciphersuites( pxSslConfig, pxChaChaPolyFirstCiphersuites );
+        }
+    #endif /* MBEDTLS_CHACHAPOLY_C */
+
     /* Load CA certificate chain. */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
-        if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
-        {
-            mbedtls_x509_crt_free( &( pxTLSCtx->xRootCaChain ) );
-            mbedtls_x509_crt_init( &( pxTLSCtx->xRootCaChain ) );
-        }
+        PhaseTimer_t xTimer;
 
+        vPhaseTimerStart( &xTimer );
         xStatus = xConfigureCAChain( pxTLSCtx, pxRootCaCerts, uxNumRootCA );
+        pxTLSCtx->xTiming.pulPhaseUs[ TLS_PHASE_CA_CHAIN ] = ulPhaseTimerElapsedUs( &xTimer );
 
         if( xStatus == TLS_TRANSPORT_SUCCESS )
         {
-            mbedtls_ssl_conf_ca_chain( pxSslConfig, &( pxTLSCtx->xRootCaChain ), NULL );
+            mbedtls_ssl_conf_ca_chain( pxSslConfig, &( pxTLSCtx->pxCaChain->xRootCaChain ), NULL );
         }
     }
 
@@ -1037,35 +2620,238 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
     {
         mbedtls_ssl_context * pxSslCtx = &( pxTLSCtx->xSslCtx );
 
-        /* Clear the ssl connection context if we're reconfiguring */
-        if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
+        /* Clear the ssl connection context if we're reconfiguring */
+        if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
+        {
+            mbedtls_ssl_free( pxSslCtx );
+            mbedtls_ssl_init( pxSslCtx );
+        }
+
+        /* Setup tls connection context and associate it with the tls config. */
+        lError = mbedtls_ssl_setup( pxSslCtx, pxSslConfig );
+
+        MBEDTLS_MSG_IF_ERROR( lError, "Call to mbedtls_ssl_setup failed, " );
+
+        if( lError != 0 )
+        {
+            xStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+        }
+        else
+        {
+            /* Setup mbedtls IO callbacks */
+            mbedtls_ssl_set_bio( pxSslCtx, pxTLSCtx,
+                                 mbedtls_ssl_send, mbedtls_ssl_recv, NULL );
+
+            pxTLSCtx->xConnectionState = STATE_CONFIGURED;
+        }
+    }
+
+    return xStatus;
+}
+
+static BaseType_t xAddrCacheLookup( TLSContext_t * pxTLSCtx,
+                                    const char * pcHostName )
+{
+    BaseType_t xHit = pdFALSE;
+
+    if( pxTLSCtx->xAddrCacheValid == pdTRUE )
+    {
+        if( ( ( xTaskGetTickCount() - pxTLSCtx->xAddrCacheTime ) >= pdMS_TO_TICKS( MBEDTLS_TRANSPORT_ADDR_CACHE_TTL_MS ) ) ||
+            ( strncmp( pxTLSCtx->pcAddrCacheHost, pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN ) != 0 ) )
+        {
+            pxTLSCtx->xAddrCacheValid = pdFALSE;
+        }
+        else
+        {
+            xHit = pdTRUE;
+        }
+    }
+
+    return xHit;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vAddrCacheStore( TLSContext_t * pxTLSCtx,
+                             const char * pcHostName,
+                             const struct addrinfo * pxAddrInfo )
+{
+    if( ( MBEDTLS_TRANSPORT_ADDR_CACHE_TTL_MS > 0 ) &&
+        ( pxAddrInfo->ai_addrlen <= sizeof( pxTLSCtx->xAddrCache ) ) )
+    {
+        ( void ) memcpy( &( pxTLSCtx->xAddrCache ), pxAddrInfo->ai_addr, pxAddrInfo->ai_addrlen );
+        pxTLSCtx->xAddrCacheLen = pxAddrInfo->ai_addrlen;
+        pxTLSCtx->lAddrCacheSockType = pxAddrInfo->ai_socktype;
+        pxTLSCtx->lAddrCacheProtocol = pxAddrInfo->ai_protocol;
+
+        ( void ) strncpy( pxTLSCtx->pcAddrCacheHost, pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN );
+        pxTLSCtx->pcAddrCacheHost[ MBEDTLS_SSL_MAX_HOST_NAME_LEN ] = '\0';
+
+        pxTLSCtx->xAddrCacheTime = xTaskGetTickCount();
+        pxTLSCtx->xAddrCacheValid = pdTRUE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xSetAddrPort( struct addrinfo * pxAddr,
+                                uint16_t usPort )
+{
+    BaseType_t xSupported = pdTRUE;
+
+    switch( pxAddr->ai_family )
+    {
+        #if LWIP_IPV4 == 1
+            case AF_INET:
+                ( ( struct sockaddr_in * ) pxAddr->ai_addr )->sin_port = htons( usPort );
+                break;
+        #endif
+        #if LWIP_IPV6 == 1
+            case AF_INET6:
+                ( ( struct sockaddr_in6 * ) pxAddr->ai_addr )->sin6_port = htons( usPort );
+                break;
+        #endif
+        default:
+            xSupported = pdFALSE;
+            break;
+    }
+
+    return xSupported;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Connect a new socket to pxAddr, which must already carry the destination port */
+static TlsTransportStatus_t xSocketConnectAddress( TLSContext_t * pxTLSCtx,
+                                                   const char * pcHostName,
+                                                   uint16_t usPort,
+                                                   struct addrinfo * pxAddr )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    int lError = 0;
+
+    #if LWIP_IPV4 == 1
+        if( pxAddr->ai_family == AF_INET )
         {
-            mbedtls_ssl_free( pxSslCtx );
-            mbedtls_ssl_init( pxSslCtx );
+            char ipAddrBuff[ IP4ADDR_STRLEN_MAX ] = { 0 };
+            ( void ) inet_ntoa_r( ( ( struct sockaddr_in * ) pxAddr->ai_addr )->sin_addr, ipAddrBuff, IP4ADDR_STRLEN_MAX );
+            LogInfo( "Trying address: %.*s, port: %uh for host: %s.",
+                     IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort, pcHostName );
+        }
+    #endif
+    #if LWIP_IPV6 == 1
+        if( pxAddr->ai_family == AF_INET6 )
+        {
+            char ipAddrBuff[ IP6ADDR_STRLEN_MAX ] = { 0 };
+            ( void ) inet6_ntoa_r( ( ( struct sockaddr_in6 * ) pxAddr->ai_addr )->sin_addr, ipAddrBuff, IP6ADDR_STRLEN_MAX );
+            LogInfo( "Trying address: %.*s, port: %uh for host: %s.",
+                     IP6ADDR_STRLEN_MAX, ipAddrBuff, usPort, pcHostName );
         }
+    #endif
 
-        /* Setup tls connection context and associate it with the tls config. */
-        lError = mbedtls_ssl_setup( pxSslCtx, pxSslConfig );
+    /* Allocate socket */
+    pxTLSCtx->xSockHandle = sock_socket( pxAddr->ai_family,
+                                         pxAddr->ai_socktype,
+                                         pxAddr->ai_protocol );
 
-        MBEDTLS_MSG_IF_ERROR( lError, "Call to mbedtls_ssl_setup failed, " );
+    if( pxTLSCtx->xSockHandle < 0 )
+    {
+        LogError( "Failed to allocate socket." );
+        xStatus = TLS_TRANSPORT_INSUFFICIENT_SOCKETS;
+    }
+    else
+    {
+        lError = sock_connect( pxTLSCtx->xSockHandle,
+                               pxAddr->ai_addr,
+                               pxAddr->ai_addrlen );
 
+        /* Upon connection error, the caller moves on to the next address */
         if( lError != 0 )
         {
-            xStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+            vTransportSocketClose( pxTLSCtx );
         }
         else
         {
-            /* Setup mbedtls IO callbacks */
-            mbedtls_ssl_set_bio( pxSslCtx, &( pxTLSCtx->xSockHandle ),
-                                 mbedtls_ssl_send, mbedtls_ssl_recv, NULL );
+            #ifdef MBEDTLS_TRANSPORT_NETCONN_RECV
+            {
+                socklen_t xOptLen = sizeof( pxTLSCtx->pxNetconn );
 
-            pxTLSCtx->xConnectionState = STATE_CONFIGURED;
+                if( sock_getsockopt( pxTLSCtx->xSockHandle, SOL_SOCKET, SO_NETCONN,
+                                     &( pxTLSCtx->pxNetconn ), &xOptLen ) != 0 )
+                {
+                    LogWarn( "No netconn for socket %ld, receiving through the socket.", pxTLSCtx->xSockHandle );
+                    pxTLSCtx->pxNetconn = NULL;
+                }
+            }
+            #endif /* MBEDTLS_TRANSPORT_NETCONN_RECV */
+
+            #if LWIP_IPV4 == 1
+                if( pxAddr->ai_family == AF_INET )
+                {
+                    char ipAddrBuff[ IP4ADDR_STRLEN_MAX ] = { 0 };
+
+                    ( void ) inet_ntoa_r( ( ( struct sockaddr_in * ) pxAddr->ai_addr )->sin_addr, ipAddrBuff, IP4ADDR_STRLEN_MAX );
+
+                    LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
+                             pxTLSCtx->xSockHandle, pcHostName,
+                             IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort );
+                }
+            #endif /* if LWIP_IPV4 == 1 */
+            #if LWIP_IPV6 == 1
+                if( pxAddr->ai_family == AF_INET6 )
+                {
+                    char ipAddrBuff[ IP6ADDR_STRLEN_MAX ] = { 0 };
+                    ( void ) inet6_ntoa_r( ( ( struct sockaddr_in6 * ) pxAddr->ai_addr )->sin_addr, ipAddrBuff, IP6ADDR_STRLEN_MAX );
+                    LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
+                             pxTLSCtx->xSockHandle, pcHostName,
+                             IP6ADDR_STRLEN_MAX, ipAddrBuff, usPort );
+                }
+            #endif
         }
     }
 
     return xStatus;
 }
 
+/*-----------------------------------------------------------*/
+
+/* Returns SOCK_OK if every option of the connection's profile was set */
+static int lApplySocketProfile( TLSContext_t * pxTLSCtx )
+{
+    int lError = SOCK_OK;
+
+    if( pxTLSCtx->xSocketProfile != TLS_SOCKET_PROFILE_DEFAULT )
+    {
+        const SocketProfile_t * pxProfile = &( xSocketProfiles[ pxTLSCtx->xSocketProfile ] );
+        int lKeepAlive = ( pxProfile->lKeepIdleS > 0 ) ? 1 : 0;
+
+        lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_NODELAY,
+                                   &( pxProfile->lNoDelay ), sizeof( pxProfile->lNoDelay ) );
+
+        lError |= sock_setsockopt( pxTLSCtx->xSockHandle, SOL_SOCKET, SO_KEEPALIVE,
+                                   &lKeepAlive, sizeof( lKeepAlive ) );
+
+        if( lKeepAlive == 1 )
+        {
+            lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPIDLE,
+                                       &( pxProfile->lKeepIdleS ), sizeof( pxProfile->lKeepIdleS ) );
+            lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPINTVL,
+                                       &( pxProfile->lKeepIntvlS ), sizeof( pxProfile->lKeepIntvlS ) );
+            lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPCNT,
+                                       &( pxProfile->lKeepCnt ), sizeof( pxProfile->lKeepCnt ) );
+        }
+
+        #if LWIP_SO_RCVBUF
+            lError |= sock_setsockopt( pxTLSCtx->xSockHandle, SOL_SOCKET, SO_RCVBUF,
+                                       &( pxProfile->lRcvBuf ), sizeof( pxProfile->lRcvBuf ) );
+        #endif
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
 static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
                                             const char * pcHostName,
                                             uint16_t usPort )
@@ -1073,6 +2859,7 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
     TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
     int lError = 0;
     struct addrinfo * pxAddrInfo = NULL;
+    PhaseTimer_t xTimer;
 
     configASSERT( pxTLSCtx != NULL );
     configASSERT( pcHostName != NULL );
@@ -1081,12 +2868,54 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
     /* Close socket if already allocated */
     if( pxTLSCtx->xSockHandle >= 0 )
     {
-        ( void ) sock_close( pxTLSCtx->xSockHandle );
-        pxTLSCtx->xSockHandle = -1;
+        vTransportSocketClose( pxTLSCtx );
+    }
+
+    /* Reconnect fast path: skip DNS and try the address which worked last time */
+    if( xAddrCacheLookup( pxTLSCtx, pcHostName ) == pdTRUE )
+    {
+        struct addrinfo xCachedAddr =
+        {
+            .ai_family   = pxTLSCtx->xAddrCache.ss_family,
+            .ai_socktype = pxTLSCtx->lAddrCacheSockType,
+            .ai_protocol = pxTLSCtx->lAddrCacheProtocol,
+            .ai_addrlen  = pxTLSCtx->xAddrCacheLen,
+            .ai_addr     = ( struct sockaddr * ) &( pxTLSCtx->xAddrCache ),
+        };
+
+        vPhaseTimerStart( &xTimer );
+
+        if( xSetAddrPort( &xCachedAddr, usPort ) == pdTRUE )
+        {
+            xStatus = xSocketConnectAddress( pxTLSCtx, pcHostName, usPort, &xCachedAddr );
+        }
+
+        pxTLSCtx->xTiming.pulPhaseUs[ TLS_PHASE_TCP_CONNECT ] = ulPhaseTimerElapsedUs( &xTimer );
+
+        taskENTER_CRITICAL();
+
+        if( pxTLSCtx->xSockHandle >= 0 )
+        {
+            xTransportStats.ulAddrCacheHits++;
+        }
+        else
+        {
+            xTransportStats.ulAddrCacheFallbacks++;
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+            ( pxTLSCtx->xSockHandle < 0 ) )
+        {
+            LogWarn( "Cached address for host: %s is unreachable, resolving it again.", pcHostName );
+            pxTLSCtx->xAddrCacheValid = pdFALSE;
+        }
     }
 
     /* Perform address (DNS) lookup */
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxTLSCtx->xSockHandle < 0 ) )
     {
         const struct addrinfo xAddrInfoHint =
         {
@@ -1095,9 +2924,13 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
             .ai_protocol = IPPROTO_TCP,
         };
 
+        vPhaseTimerStart( &xTimer );
+
         lError = dns_getaddrinfo( pcHostName, NULL,
                                   &xAddrInfoHint, &pxAddrInfo );
 
+        pxTLSCtx->xTiming.pulPhaseUs[ TLS_PHASE_DNS ] = ulPhaseTimerElapsedUs( &xTimer );
+
         if( ( lError != 0 ) || ( pxAddrInfo == NULL ) )
         {
             LogError( "Failed to resolve hostname: %s to IP address.", pcHostName );
@@ -1111,122 +2944,302 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
         }
     }
 
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    if( pxAddrInfo != NULL )
     {
         struct addrinfo * pxAddrIter = NULL;
 
+        vPhaseTimerStart( &xTimer );
+
         /* Try all of the addresses returned by getaddrinfo */
         for( pxAddrIter = pxAddrInfo; pxAddrIter != NULL; pxAddrIter = pxAddrIter->ai_next )
         {
-            /* Set port number */
-            switch( pxAddrIter->ai_family )
+            if( xSetAddrPort( pxAddrIter, usPort ) == pdFALSE )
             {
-                #if LWIP_IPV4 == 1
-                    case AF_INET:
-                        ( ( struct sockaddr_in * ) pxAddrIter->ai_addr )->sin_port = htons( usPort );
-                        break;
-                #endif
-                #if LWIP_IPV6 == 1
-                    case AF_INET6:
-                        ( ( struct sockaddr_in6 * ) pxAddrIter->ai_addr )->sin6_port = htons( usPort );
-                        break;
-                #endif
-                default:
-                    continue;
-                    break;
+                continue;
             }
 
-            #if LWIP_IPV4 == 1
-                if( pxAddrIter->ai_family == AF_INET )
-                {
-                    char ipAddrBuff[ IP4ADDR_STRLEN_MAX ] = { 0 };
-                    ( void ) inet_ntoa_r( ( ( struct sockaddr_in * ) pxAddrIter->ai_addr )->sin_addr, ipAddrBuff, IP4ADDR_STRLEN_MAX );
-                    LogInfo( "Trying address: %.*s, port: %uh for host: %s.",
-                             IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort, pcHostName );
-                }
-            #endif
-            #if LWIP_IPV6 == 1
-                if( pxAddrIter->ai_family == AF_INET6 )
+            xStatus = xSocketConnectAddress( pxTLSCtx, pcHostName, usPort, pxAddrIter );
+
+            if( pxTLSCtx->xSockHandle >= 0 )
+            {
+                vAddrCacheStore( pxTLSCtx, pcHostName, pxAddrIter );
+            }
+
+            /* Exit loop on an irrecoverable error or successful connection. */
+            if( ( xStatus != TLS_TRANSPORT_SUCCESS ) ||
+                ( pxTLSCtx->xSockHandle >= 0 ) )
+            {
+                break;
+            }
+        }
+
+        pxTLSCtx->xTiming.pulPhaseUs[ TLS_PHASE_TCP_CONNECT ] += ulPhaseTimerElapsedUs( &xTimer );
+
+        dns_freeaddrinfo( pxAddrInfo );
+        pxAddrInfo = NULL;
+    }
+
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxTLSCtx->xSockHandle < 0 ) )
+    {
+        xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+
+    #if defined( MBEDTLS_TRANSPORT_PERSIST_SESSION ) && defined( MBEDTLS_TRANSPORT_PSA )
+
+/*
+ * Persisted layout: port (2 bytes), host name length (1 byte), host name,
+ * followed by the output of mbedtls_ssl_session_save.
+ */
+        #define SESSION_HEADER_LEN    3U
+
+/*
+ * Each endpoint has its own ITS entry, so that the MQTT and the OTA / HTTP
+ * connections do not evict each other's session. The uid is PSA_TLS_SESSION_ID
+ * with a FNV-1a hash of the host name and port in bits 16 to 47. The header
+ * stored in the entry is still compared on load, a hash collision just misses.
+ */
+        static psa_storage_uid_t xSessionPersistUid( const char * pcHostName,
+                                                     uint16_t usPort )
+        {
+            uint32_t ulHash = 2166136261UL;
+            size_t uxHostLen = strnlen( pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN );
+
+            for( size_t i = 0; i < uxHostLen; i++ )
+            {
+                ulHash = ( ulHash ^ ( uint8_t ) pcHostName[ i ] ) * 16777619UL;
+            }
+
+            ulHash = ( ulHash ^ ( uint8_t ) ( usPort >> 8 ) ) * 16777619UL;
+            ulHash = ( ulHash ^ ( uint8_t ) ( usPort & 0xFF ) ) * 16777619UL;
+
+            return ( psa_storage_uid_t ) ( PSA_TLS_SESSION_ID | ( ( uint64_t ) ulHash << 16 ) );
+        }
+
+/*-----------------------------------------------------------*/
+
+        static void vSessionPersistSave( TLSContext_t * pxTLSCtx )
+        {
+            size_t uxHostLen = strnlen( pxTLSCtx->pcSessionHost, MBEDTLS_SSL_MAX_HOST_NAME_LEN );
+            size_t uxSessionLen = 0;
+            unsigned char * pucBuffer = NULL;
+
+            ( void ) mbedtls_ssl_session_save( &( pxTLSCtx->xSession ), NULL, 0, &uxSessionLen );
+
+            if( uxSessionLen > 0 )
+            {
+                pucBuffer = pvPortMalloc( SESSION_HEADER_LEN + uxHostLen + uxSessionLen );
+            }
+
+            if( pucBuffer != NULL )
+            {
+                pucBuffer[ 0 ] = ( unsigned char ) ( pxTLSCtx->usSessionPort >> 8 );
+                pucBuffer[ 1 ] = ( unsigned char ) ( pxTLSCtx->usSessionPort & 0xFF );
+                pucBuffer[ 2 ] = ( unsigned char ) uxHostLen;
+                ( void ) memcpy( &( pucBuffer[ SESSION_HEADER_LEN ] ), pxTLSCtx->pcSessionHost, uxHostLen );
+
+                if( ( mbedtls_ssl_session_save( &( pxTLSCtx->xSession ),
+                                                &( pucBuffer[ SESSION_HEADER_LEN + uxHostLen ] ),
+                                                uxSessionLen, &uxSessionLen ) != 0 ) ||
+                    ( psa_its_set( xSessionPersistUid( pxTLSCtx->pcSessionHost, pxTLSCtx->usSessionPort ),
+                                   SESSION_HEADER_LEN + uxHostLen + uxSessionLen,
+                                   pucBuffer, PSA_STORAGE_FLAG_NONE ) != PSA_SUCCESS ) )
                 {
-                    char ipAddrBuff[ IP6ADDR_STRLEN_MAX ] = { 0 };
-                    ( void ) inet6_ntoa_r( ( ( struct sockaddr_in6 * ) pxAddrIter->ai_addr )->sin_addr, ipAddrBuff, IP6ADDR_STRLEN_MAX );
-                    LogInfo( "Trying address: %.*s, port: %uh for host: %s.",
-                             IP6ADDR_STRLEN_MAX, ipAddrBuff, usPort, pcHostName );
+                    LogWarn( "Failed to persist TLS session." );
                 }
-            #endif
 
-            /* Allocate socket */
-            pxTLSCtx->xSockHandle = sock_socket( pxAddrIter->ai_family,
-                                                 pxAddrIter->ai_socktype,
-                                                 pxAddrIter->ai_protocol );
+                mbedtls_platform_zeroize( pucBuffer, SESSION_HEADER_LEN + uxHostLen + uxSessionLen );
+                vPortFree( pucBuffer );
+            }
+        }
+
+/*-----------------------------------------------------------*/
 
-            if( pxTLSCtx->xSockHandle < 0 )
+        static void vSessionPersistLoad( TLSContext_t * pxTLSCtx,
+                                         const char * pcHostName,
+                                         uint16_t usPort )
+        {
+            psa_storage_uid_t xUid = xSessionPersistUid( pcHostName, usPort );
+            struct psa_storage_info_t xInfo = { 0 };
+            unsigned char * pucBuffer = NULL;
+            size_t uxDataLen = 0;
+            size_t uxHostLen = strnlen( pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN );
+
+            if( ( psa_its_get_info( xUid, &xInfo ) == PSA_SUCCESS ) &&
+                ( xInfo.size > SESSION_HEADER_LEN ) )
             {
-                LogError( "Failed to allocate socket." );
-                xStatus = TLS_TRANSPORT_INSUFFICIENT_SOCKETS;
+                pucBuffer = pvPortMalloc( xInfo.size );
             }
-            else
-            {
-                lError = sock_connect( pxTLSCtx->xSockHandle,
-                                       pxAddrIter->ai_addr,
-                                       pxAddrIter->ai_addrlen );
 
-                /* Upon connection error, continue to next address */
-                if( lError != 0 )
+            if( ( pucBuffer != NULL ) &&
+                ( psa_its_get( xUid, 0, xInfo.size, pucBuffer, &uxDataLen ) == PSA_SUCCESS ) &&
+                ( uxDataLen > ( SESSION_HEADER_LEN + uxHostLen ) ) &&
+                ( pucBuffer[ 0 ] == ( unsigned char ) ( usPort >> 8 ) ) &&
+                ( pucBuffer[ 1 ] == ( unsigned char ) ( usPort & 0xFF ) ) &&
+                ( pucBuffer[ 2 ] == ( unsigned char ) uxHostLen ) &&
+                ( memcmp( &( pucBuffer[ SESSION_HEADER_LEN ] ), pcHostName, uxHostLen ) == 0 ) )
+            {
+                if( mbedtls_ssl_session_load( &( pxTLSCtx->xSession ),
+                                              &( pucBuffer[ SESSION_HEADER_LEN + uxHostLen ] ),
+                                              uxDataLen - SESSION_HEADER_LEN - uxHostLen ) == 0 )
                 {
-                    ( void ) sock_close( pxTLSCtx->xSockHandle );
-                    pxTLSCtx->xSockHandle = -1;
+                    pxTLSCtx->usSessionPort = usPort;
+                    ( void ) memcpy( pxTLSCtx->pcSessionHost, pcHostName, uxHostLen );
+                    pxTLSCtx->pcSessionHost[ uxHostLen ] = '\0';
+                    pxTLSCtx->xSessionValid = pdTRUE;
                 }
                 else
                 {
-                    #if LWIP_IPV4 == 1
-                        if( pxAddrIter->ai_family == AF_INET )
-                        {
-                            char ipAddrBuff[ IP4ADDR_STRLEN_MAX ] = { 0 };
-
-                            ( void ) inet_ntoa_r( ( ( struct sockaddr_in * ) pxAddrIter->ai_addr )->sin_addr, ipAddrBuff, IP4ADDR_STRLEN_MAX );
-
-                            LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
-                                     pxTLSCtx->xSockHandle, pcHostName,
-                                     IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort );
-                        }
-                    #endif /* if LWIP_IPV4 == 1 */
-                    #if LWIP_IPV6 == 1
-                        if( pxAddrIter->ai_family == AF_INET6 )
-                        {
-                            char ipAddrBuff[ IP6ADDR_STRLEN_MAX ] = { 0 };
-                            ( void ) inet6_ntoa_r( ( ( struct sockaddr_in6 * ) pxAddrIter->ai_addr )->sin_addr, ipAddrBuff, IP6ADDR_STRLEN_MAX );
-                            LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
-                                     pxTLSCtx->xSockHandle, pcHostName,
-                                     IP6ADDR_STRLEN_MAX, ipAddrBuff, usPort );
-                        }
-                    #endif
+                    /* Saved by another mbedtls version or configuration */
+                    mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+                    mbedtls_ssl_session_init( &( pxTLSCtx->xSession ) );
+                    ( void ) psa_its_remove( xUid );
                 }
             }
 
-            /* Exit loop on an irrecoverable error or successful connection. */
-            if( ( xStatus != TLS_TRANSPORT_SUCCESS ) ||
-                ( pxTLSCtx->xSockHandle >= 0 ) )
+            if( pucBuffer != NULL )
             {
-                break;
+                mbedtls_platform_zeroize( pucBuffer, xInfo.size );
+                vPortFree( pucBuffer );
             }
         }
+
+    #endif /* MBEDTLS_TRANSPORT_PERSIST_SESSION && MBEDTLS_TRANSPORT_PSA */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Forget the session cached in RAM. The persisted copy of its endpoint, if
+ * any, is only removed when xForget is pdTRUE, i.e. when the session must not
+ * be offered again.
+ */
+    static void vSessionCacheDrop( TLSContext_t * pxTLSCtx,
+                                   BaseType_t xForget )
+    {
+        #if defined( MBEDTLS_TRANSPORT_PERSIST_SESSION ) && defined( MBEDTLS_TRANSPORT_PSA )
+            if( ( xForget == pdTRUE ) &&
+                ( pxTLSCtx->xSessionValid == pdTRUE ) )
+            {
+                ( void ) psa_its_remove( xSessionPersistUid( pxTLSCtx->pcSessionHost,
+                                                             pxTLSCtx->usSessionPort ) );
+            }
+        #else
+            ( void ) xForget;
+        #endif
+
+        mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+        mbedtls_ssl_session_init( &( pxTLSCtx->xSession ) );
+        pxTLSCtx->xSessionValid = pdFALSE;
+        pxTLSCtx->xSessionOffered = pdFALSE;
     }
 
-    if( pxAddrInfo != NULL )
+/*-----------------------------------------------------------*/
+
+    static void vSessionCacheClear( TLSContext_t * pxTLSCtx )
     {
-        dns_freeaddrinfo( pxAddrInfo );
-        pxAddrInfo = NULL;
+        vSessionCacheDrop( pxTLSCtx, pdTRUE );
     }
 
-    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
-        ( pxTLSCtx->xSockHandle < 0 ) )
+/*-----------------------------------------------------------*/
+
+    static void vSessionCacheOffer( TLSContext_t * pxTLSCtx,
+                                    const char * pcHostName,
+                                    uint16_t usPort )
     {
-        xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+        pxTLSCtx->xSessionOffered = pdFALSE;
+
+        /* A session of another endpoint stays persisted for its next connect */
+        if( ( pxTLSCtx->xSessionValid == pdTRUE ) &&
+            ( ( pxTLSCtx->usSessionPort != usPort ) ||
+              ( strncmp( pxTLSCtx->pcSessionHost, pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN ) != 0 ) ) )
+        {
+            vSessionCacheDrop( pxTLSCtx, pdFALSE );
+        }
+
+        #if defined( MBEDTLS_TRANSPORT_PERSIST_SESSION ) && defined( MBEDTLS_TRANSPORT_PSA )
+            if( pxTLSCtx->xSessionValid == pdFALSE )
+            {
+                vSessionPersistLoad( pxTLSCtx, pcHostName, usPort );
+            }
+        #endif
+
+        if( pxTLSCtx->xSessionValid == pdTRUE )
+        {
+            if( mbedtls_ssl_set_session( &( pxTLSCtx->xSslCtx ), &( pxTLSCtx->xSession ) ) != 0 )
+            {
+                LogWarn( "Network connection %p: Failed to offer cached TLS session.", pxTLSCtx );
+                vSessionCacheClear( pxTLSCtx );
+            }
+            else
+            {
+                pxTLSCtx->xSessionOffered = pdTRUE;
+            }
+        }
     }
 
-    return xStatus;
-}
+/*-----------------------------------------------------------*/
+
+    static void vSessionCacheStore( TLSContext_t * pxTLSCtx,
+                                    const char * pcHostName,
+                                    uint16_t usPort )
+    {
+        mbedtls_ssl_session xNewSession;
+        BaseType_t xResumed = pdFALSE;
+
+        mbedtls_ssl_session_init( &xNewSession );
+
+        if( mbedtls_ssl_get_session( &( pxTLSCtx->xSslCtx ), &xNewSession ) != 0 )
+        {
+            mbedtls_ssl_session_free( &xNewSession );
+            vSessionCacheClear( pxTLSCtx );
+        }
+        else
+        {
+            /* The server echoes the offered session id when it accepts the resumption */
+            if( ( pxTLSCtx->xSessionOffered == pdTRUE ) &&
+                ( xNewSession.MBEDTLS_PRIVATE( id_len ) > 0 ) &&
+                ( xNewSession.MBEDTLS_PRIVATE( id_len ) == pxTLSCtx->xSession.MBEDTLS_PRIVATE( id_len ) ) &&
+                ( memcmp( xNewSession.MBEDTLS_PRIVATE( id ), pxTLSCtx->xSession.MBEDTLS_PRIVATE( id ),
+                          xNewSession.MBEDTLS_PRIVATE( id_len ) ) == 0 ) )
+            {
+                xResumed = pdTRUE;
+            }
+
+            mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+            pxTLSCtx->xSession = xNewSession;
+            pxTLSCtx->xSessionValid = pdTRUE;
+            pxTLSCtx->usSessionPort = usPort;
+            ( void ) strncpy( pxTLSCtx->pcSessionHost, pcHostName, MBEDTLS_SSL_MAX_HOST_NAME_LEN );
+            pxTLSCtx->pcSessionHost[ MBEDTLS_SSL_MAX_HOST_NAME_LEN ] = '\0';
+
+            #if defined( MBEDTLS_TRANSPORT_PERSIST_SESSION ) && defined( MBEDTLS_TRANSPORT_PSA )
+                if( xResumed == pdFALSE )
+                {
+                    vSessionPersistSave( pxTLSCtx );
+                }
+            #endif
+        }
+
+        pxTLSCtx->xSessionOffered = pdFALSE;
+
+        if( xResumed == pdTRUE )
+        {
+            LogInfo( "Network connection %p: TLS session resumed.", pxTLSCtx );
+
+            taskENTER_CRITICAL();
+            xTransportStats.ulResumedHandshakes++;
+            taskEXIT_CRITICAL();
+        }
+    }
+
+#endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
 
 /*-----------------------------------------------------------*/
 
@@ -1240,9 +3253,12 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
     TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
     mbedtls_ssl_context * pxSslCtx = NULL;
     int lError = 0;
+    PhaseTimer_t xConnectTimer;
 
     configASSERT( pxTLSCtx != NULL );
 
+    vPhaseTimerStart( &xConnectTimer );
+
     if( pxNetworkContext == NULL )
     {
         LogError( "Invalid input parameter: Arguments cannot be NULL. pxNetworkContext=%p.",
@@ -1267,6 +3283,19 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
     else
     {
         pxSslCtx = &( pxTLSCtx->xSslCtx );
+
+        /* Keep the configure phases, start the connection phases from zero */
+        for( uint32_t ulPhase = TLS_PHASE_DNS; ulPhase < TLS_PHASE_MAX; ulPhase++ )
+        {
+            if( ( ulPhase != TLS_PHASE_CA_CHAIN ) &&
+                ( ulPhase != TLS_PHASE_CLIENT_CERT ) )
+            {
+                pxTLSCtx->xTiming.pulPhaseUs[ ulPhase ] = 0;
+            }
+        }
+
+        ( void ) strncpy( pxTLSCtx->xTiming.pcHostName, pcHostName, TLS_TIMING_HOST_LEN - 1 );
+        pxTLSCtx->xTiming.pcHostName[ TLS_TIMING_HOST_LEN - 1 ] = '\0';
     }
 
     /* Set hostname for SNI and server certificate verification */
@@ -1321,6 +3350,13 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         }
     }
 
+    /* The connection still works with the lwIP defaults */
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( lApplySocketProfile( pxTLSCtx ) != SOCK_OK ) )
+    {
+        LogWarn( "Failed to apply socket profile %d.", ( int ) pxTLSCtx->xSocketProfile );
+    }
+
     if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
         ( ulRecvTimeoutMs == 0 ) )
     {
@@ -1343,17 +3379,70 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         }
     }
 
+    #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+        if( xStatus == TLS_TRANSPORT_SUCCESS )
+        {
+            vSessionCacheOffer( pxTLSCtx, pcHostName, usPort );
+        }
+    #endif /* MBEDTLS_TRANSPORT_SESSION_RESUMPTION */
+
     /* Perform TLS handshake. */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
-        /* Perform the TLS handshake. */
+        #if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+            /* Report the arena peak of this handshake in "tls stats" */
+            mbedtls_platform_arena_reset_peak();
+        #endif
+
+        /* The signature and key exchange dominate the handshake time */
+        vDvfsRequest( DVFS_CLIENT_TLS );
+
+        /* Perform the TLS handshake one state at a time, attributing the time spent to each phase */
         do
         {
-            lError = mbedtls_ssl_handshake( pxSslCtx );
+            PhaseTimer_t xTimer;
+            int lState = pxSslCtx->MBEDTLS_PRIVATE( state );
+            TlsHandshakePhase_t xPhase = xHandshakeStateToPhase( lState );
+
+            vPhaseTimerStart( &xTimer );
+            lError = mbedtls_ssl_handshake_step( pxSslCtx );
+
+            #if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+                /* The server Certificate message has just been parsed */
+                if( ( lError == 0 ) &&
+                    ( lState == MBEDTLS_SSL_SERVER_CERTIFICATE ) &&
+                    ( pxSslCtx->MBEDTLS_PRIVATE( state ) != MBEDTLS_SSL_SERVER_CERTIFICATE ) )
+                {
+                    lError = lVerifyServerChain( pxTLSCtx, pcHostName );
+                }
+            #endif /* MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 */
+
+            pxTLSCtx->xTiming.pulPhaseUs[ xPhase ] += ulPhaseTimerElapsedUs( &xTimer );
         }
-        while( ( lError == MBEDTLS_ERR_SSL_WANT_READ ) ||
+        while( ( ( lError == 0 ) && ( pxSslCtx->MBEDTLS_PRIVATE( state ) != MBEDTLS_SSL_HANDSHAKE_OVER ) ) ||
+               ( lError == MBEDTLS_ERR_SSL_WANT_READ ) ||
                ( lError == MBEDTLS_ERR_SSL_WANT_WRITE ) );
 
+        vDvfsRelease( DVFS_CLIENT_TLS );
+
+        #if ( MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 )
+            /* mbedtls does not verify the chain itself, so never accept a handshake which reached the end
+             * without a verified peer certificate. A resumed session carries the result of the handshake
+             * which created it. */
+            if( ( lError == 0 ) &&
+                ( ( mbedtls_ssl_get_peer_cert( pxSslCtx ) == NULL ) ||
+                  ( mbedtls_ssl_get_verify_result( pxSslCtx ) != 0 ) ) )
+            {
+                LogError( "Handshake completed without a verified server certificate." );
+                lError = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+            }
+        #endif /* MBEDTLS_TRANSPORT_VERIFY_CACHE_ENTRIES > 0 */
+
+        #ifdef TRANSPORT_ECDHE_POOL
+            /* Replace the ephemeral key pair taken by this handshake */
+            vEcdhePoolKick();
+        #endif /* TRANSPORT_ECDHE_POOL */
+
         if( lError != 0 )
         {
             LogError( "Failed to perform TLS handshake: Error: %s : %s.",
@@ -1361,11 +3450,43 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                       mbedtlsLowLevelCodeOrDefault( lError ) );
 
             xStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
+
+            /* The cached address may now belong to a different server */
+            pxTLSCtx->xAddrCacheValid = pdFALSE;
+
+            #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+                /* Do not offer a session which may have caused the failure again */
+                vSessionCacheClear( pxTLSCtx );
+            #endif
         }
         else
         {
-            LogInfo( "Network connection %p: TLS handshake successful.",
-                     pxTLSCtx );
+            const char * pcVersion = mbedtls_ssl_get_version( pxSslCtx );
+            BaseType_t xTls13 = ( strcmp( pcVersion, "TLSv1.3" ) == 0 ) ? pdTRUE : pdFALSE;
+
+            LogInfo( "Network connection %p: %s handshake successful.",
+                     pxTLSCtx, pcVersion );
+
+            #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+                LogInfo( "Network connection %p: Record size in: %lu, out: %lu.",
+                         pxTLSCtx,
+                         ( unsigned long ) mbedtls_ssl_get_input_max_frag_len( pxSslCtx ),
+                         ( unsigned long ) mbedtls_ssl_get_output_max_frag_len( pxSslCtx ) );
+            #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+            taskENTER_CRITICAL();
+            xTransportStats.ulHandshakes++;
+
+            if( xTls13 == pdTRUE )
+            {
+                xTransportStats.ulTls13Handshakes++;
+            }
+
+            taskEXIT_CRITICAL();
+
+            #ifdef MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+                vSessionCacheStore( pxTLSCtx, pcHostName, usPort );
+            #endif
         }
     }
 
@@ -1375,11 +3496,16 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                  pxNetworkContext, pcHostName, usPort );
 
         if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
-            pxTLSCtx->pxNotifyThreadCtx )
+            pxTLSCtx->pxSocketNotifyCtx )
         {
-            vCreateSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
+            ( void ) xSocketNotifyRegister( pxTLSCtx->pxSocketNotifyCtx, pxTLSCtx->xSockHandle );
         }
 
+        #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+            pxTLSCtx->uxRecvAheadOffset = 0;
+            pxTLSCtx->uxRecvAheadLen = 0;
+        #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
+
         pxTLSCtx->xConnectionState = STATE_CONNECTED;
     }
     else
@@ -1389,8 +3515,7 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
             ( pxTLSCtx->xSockHandle >= 0 ) )
         {
             /* Deallocate the open socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
+            vTransportSocketClose( pxTLSCtx );
         }
 
         /* Reset SSL session context for reconnect attempt */
@@ -1401,119 +3526,192 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                  pcHostName, usPort );
     }
 
+    if( pxTLSCtx != NULL )
+    {
+        pxTLSCtx->xTiming.lStatus = ( int32_t ) xStatus;
+        pxTLSCtx->xTiming.ulTotalUs = ulPhaseTimerElapsedUs( &xConnectTimer );
+        vRecordHandshakeTiming( &( pxTLSCtx->xTiming ) );
+    }
+
     return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx )
+int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
+                                           GenericCallback_t pxCallback,
+                                           void * pvCtx )
 {
-    configASSERT( pxNotifyThreadCtx );
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    SocketNotifyCtx_t * pxSocketNotifyCtx = NULL;
+    int32_t lError = 0;
+
+    if( ( pxTLSCtx == NULL ) ||
+        ( pxCallback == NULL ) )
+    {
+        lError = -1;
+    }
+    else
+    {
+        pxSocketNotifyCtx = pxTLSCtx->pxSocketNotifyCtx;
+
+        if( pxSocketNotifyCtx == NULL )
+        {
+            pxSocketNotifyCtx = pvPortMalloc( sizeof( SocketNotifyCtx_t ) );
+
+            if( pxSocketNotifyCtx == NULL )
+            {
+                LogError( "Failed to allocate memory for a SocketNotifyCtx_t." );
+                lError = -1;
+            }
+            else
+            {
+                pxTLSCtx->pxSocketNotifyCtx = pxSocketNotifyCtx;
+                pxSocketNotifyCtx->xSockHandle = -1;
+                pxSocketNotifyCtx->xArmed = pdFALSE;
+            }
+        }
+        else
+        {
+            /* Stop dispatching to the old callback before replacing it */
+            vSocketNotifyUnregister( pxSocketNotifyCtx );
+        }
+    }
 
-    while( ( pxNotifyThreadCtx->xTaskHandle != NULL ) &&
-           ( eTaskGetState( pxNotifyThreadCtx->xTaskHandle ) != eDeleted ) )
+    if( lError == 0 )
     {
-        ( void ) xTaskNotify( pxNotifyThreadCtx->xTaskHandle, 0xFFFFFFFF, eSetValueWithOverwrite );
-        vTaskDelay( 1 );
+        pxSocketNotifyCtx->pxRecvReadyCallback = pxCallback;
+        pxSocketNotifyCtx->pvRecvReadyCallbackCtx = pvCtx;
+
+        if( ( pxTLSCtx->xConnectionState == STATE_CONNECTED ) &&
+            ( xSocketNotifyRegister( pxSocketNotifyCtx, pxTLSCtx->xSockHandle ) != pdPASS ) )
+        {
+            lError = -1;
+        }
     }
+
+    return lError;
 }
 
 /*-----------------------------------------------------------*/
 
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle )
+int32_t mbedtls_transport_set_max_frag_len( NetworkContext_t * pxNetworkContext,
+                                            size_t uxMaxFragLen )
 {
-    TaskHandle_t xTaskHandle = NULL;
+    int32_t lError = 0;
+
+    #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+        TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+        unsigned char ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
 
-    configASSERT_CONTINUE( pxNotifyThreadCtx );
+        switch( uxMaxFragLen )
+        {
+            case 0:
+                ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+                break;
 
-    vStopSocketNotifyTask( pxNotifyThreadCtx );
+            case 512:
+                ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+                break;
 
-    if( pxNotifyThreadCtx &&
-        pxNotifyThreadCtx->pxRecvReadyCallback )
-    {
-        pxNotifyThreadCtx->xSockHandle = xSockHandle;
+            case 1024:
+                ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+                break;
 
-        xTaskHandle = xTaskCreateStatic( vSocketNotifyThread,
-                                         "SockNotify",
-                                         128,
-                                         ( void * ) pxNotifyThreadCtx,
-                                         tskIDLE_PRIORITY,
-                                         pxNotifyThreadCtx->puxStackBuffer,
-                                         &( pxNotifyThreadCtx->xTaskBuffer ) );
+            case 2048:
+                ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+                break;
 
-        pxNotifyThreadCtx->xTaskHandle = xTaskHandle;
-    }
-}
-/*-----------------------------------------------------------*/
+            case 4096:
+                ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+                break;
 
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx )
-{
-    if( pxNotifyThreadCtx )
-    {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
+            default:
+                LogError( "Unsupported maximum fragment length: %lu.", ( unsigned long ) uxMaxFragLen );
+                lError = -1;
+                break;
+        }
 
-        vPortFree( pxNotifyThreadCtx );
-    }
+        if( pxTLSCtx == NULL )
+        {
+            lError = -1;
+        }
+        else if( lError == 0 )
+        {
+            pxTLSCtx->ucMaxFragLenCode = ucCode;
+
+            /* Already configured: update the config used by the next handshake */
+            if( pxTLSCtx->xConnectionState != STATE_ALLOCATED )
+            {
+                lError = mbedtls_ssl_conf_max_frag_len( &( pxTLSCtx->xSslConfig ), ucCode );
+            }
+        }
+        else
+        {
+            /* Empty */
+        }
+    #else /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+        ( void ) pxNetworkContext;
+        ( void ) uxMaxFragLen;
+        lError = -1;
+    #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+    return lError;
 }
 
 /*-----------------------------------------------------------*/
 
-int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
-                                           GenericCallback_t pxCallback,
-                                           void * pvCtx )
+int32_t mbedtls_transport_set_socket_profile( NetworkContext_t * pxNetworkContext,
+                                              TlsSocketProfile_t xProfile )
 {
     TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
-    NotifyThreadCtx_t * pxNotifyThreadCtx = NULL;
     int32_t lError = 0;
 
     if( ( pxTLSCtx == NULL ) ||
-        ( pxCallback == NULL ) )
+        ( ( uint32_t ) xProfile >= ( uint32_t ) TLS_SOCKET_PROFILE_MAX ) )
     {
         lError = -1;
     }
     else
     {
-        pxNotifyThreadCtx = pxTLSCtx->pxNotifyThreadCtx;
+        pxTLSCtx->xSocketProfile = xProfile;
     }
 
-    if( pxNotifyThreadCtx == NULL )
-    {
-        pxNotifyThreadCtx = pvPortMalloc( sizeof( NotifyThreadCtx_t ) );
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_prefer_chachapoly( NetworkContext_t * pxNetworkContext,
+                                             BaseType_t xPrefer )
+{
+    int32_t lError = 0;
+
+    #ifdef MBEDTLS_CHACHAPOLY_C
+        TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
 
-        if( pxNotifyThreadCtx == NULL )
+        if( pxTLSCtx == NULL )
         {
-            LogError( "Failed to allocate memory for a NotifyThreadCtx_t." );
             lError = -1;
         }
         else
         {
-            pxTLSCtx->pxNotifyThreadCtx = pxNotifyThreadCtx;
-            pxNotifyThreadCtx->xSockHandle = -1;
-            pxNotifyThreadCtx->xTaskHandle = 0;
-        }
-    }
-    /* Connected and pxNotifyThreadCtx already exists */
-    else if( ( pxTLSCtx->xConnectionState == STATE_CONNECTED ) &&
-             pxNotifyThreadCtx->xTaskHandle )
-    {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
-    }
-    else
-    {
-        /* Empty */
-    }
-
-    if( lError == 0 )
-    {
-        pxNotifyThreadCtx->pxRecvReadyCallback = pxCallback;
-        pxNotifyThreadCtx->pvRecvReadyCallbackCtx = pvCtx;
+            pxTLSCtx->xPreferChaChaPoly = ( xPrefer == pdTRUE ) ? pdTRUE : pdFALSE;
 
-        if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
-        {
-            vCreateSocketNotifyTask( pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
+            /* Already configured: update the config used by the next handshake */
+            if( pxTLSCtx->xConnectionState != STATE_ALLOCATED )
+            {
+                mbedtls_ssl_conf_ciphersuites( &( pxTLSCtx->xSslConfig ),
+                                               ( pxTLSCtx->xPreferChaChaPoly == pdTRUE ) ?
+                                               pxChaChaPolyFirstCiphersuites :
+                                               mbedtls_ssl_list_ciphersuites() );
+            }
         }
-    }
+    #else /* MBEDTLS_CHACHAPOLY_C */
+        ( void ) pxNetworkContext;
+        ( void ) xPrefer;
+        lError = -1;
+    #endif /* MBEDTLS_CHACHAPOLY_C */
 
     return lError;
 }
@@ -1554,6 +3752,16 @@ void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
 
     if( pxNetworkContext != NULL )
     {
+        /* Drop any coalesced writes which were never sent */
+        pxTLSCtx->xCorked = pdFALSE;
+        pxTLSCtx->uxCorkLen = 0;
+        pxTLSCtx->lCorkError = 0;
+
+        #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+            pxTLSCtx->uxRecvAheadOffset = 0;
+            pxTLSCtx->uxRecvAheadLen = 0;
+        #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
+
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
             /* Notify the server to close */
@@ -1580,16 +3788,15 @@ void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
         }
 
-        if( pxTLSCtx->pxNotifyThreadCtx )
+        if( pxTLSCtx->pxSocketNotifyCtx )
         {
-            vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
+            vSocketNotifyUnregister( pxTLSCtx->pxSocketNotifyCtx );
         }
 
         if( pxTLSCtx->xSockHandle >= 0 )
         {
             /* Call socket close function to deallocate the socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
+            vTransportSocketClose( pxTLSCtx );
         }
 
         /* Clear SSL connection context for re-use */
@@ -1602,6 +3809,90 @@ void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
 
 /*-----------------------------------------------------------*/
 
+static int32_t lTransportRead( TLSContext_t * pxTLSCtx,
+                               uint8_t * pucBuffer,
+                               size_t uxBytesToRecv )
+{
+    int32_t tlsStatus = 0;
+
+    #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+        size_t uxCopied = 0;
+
+        if( pxTLSCtx->uxRecvAheadLen == 0 )
+        {
+            /* Nothing buffered */
+        }
+        else if( uxBytesToRecv < pxTLSCtx->uxRecvAheadLen )
+        {
+            ( void ) memcpy( pucBuffer, &( pxTLSCtx->pucRecvAhead[ pxTLSCtx->uxRecvAheadOffset ] ), uxBytesToRecv );
+            pxTLSCtx->uxRecvAheadOffset += uxBytesToRecv;
+            pxTLSCtx->uxRecvAheadLen -= uxBytesToRecv;
+            uxCopied = uxBytesToRecv;
+        }
+        else
+        {
+            uxCopied = pxTLSCtx->uxRecvAheadLen;
+            ( void ) memcpy( pucBuffer, &( pxTLSCtx->pucRecvAhead[ pxTLSCtx->uxRecvAheadOffset ] ), uxCopied );
+            pxTLSCtx->uxRecvAheadOffset = 0;
+            pxTLSCtx->uxRecvAheadLen = 0;
+        }
+
+        pucBuffer = &( pucBuffer[ uxCopied ] );
+        uxBytesToRecv -= uxCopied;
+
+        if( uxBytesToRecv == 0 )
+        {
+            /* Served entirely from the read-ahead buffer */
+        }
+        else if( ( uxCopied > 0 ) &&
+                 ( mbedtls_ssl_get_bytes_avail( &( pxTLSCtx->xSslCtx ) ) == 0 ) )
+        {
+            /* Return what was buffered rather than wait for the next record */
+        }
+        else if( uxBytesToRecv < MBEDTLS_TRANSPORT_RECV_AHEAD_LEN )
+        {
+            vTraceRecBegin( TraceRecSliceTlsDecrypt, 0 );
+            tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pxTLSCtx->xSslCtx ),
+                                                      pxTLSCtx->pucRecvAhead,
+                                                      MBEDTLS_TRANSPORT_RECV_AHEAD_LEN );
+            vTraceRecEnd( TraceRecSliceTlsDecrypt, ( tlsStatus > 0 ) ? ( uint32_t ) tlsStatus : 0 );
+
+            if( tlsStatus > ( int32_t ) uxBytesToRecv )
+            {
+                pxTLSCtx->uxRecvAheadOffset = uxBytesToRecv;
+                pxTLSCtx->uxRecvAheadLen = ( size_t ) tlsStatus - uxBytesToRecv;
+                tlsStatus = ( int32_t ) uxBytesToRecv;
+            }
+
+            if( tlsStatus > 0 )
+            {
+                ( void ) memcpy( pucBuffer, pxTLSCtx->pucRecvAhead, ( size_t ) tlsStatus );
+            }
+        }
+        else
+    #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
+    {
+        vTraceRecBegin( TraceRecSliceTlsDecrypt, 0 );
+        tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pxTLSCtx->xSslCtx ),
+                                                  pucBuffer,
+                                                  uxBytesToRecv );
+        vTraceRecEnd( TraceRecSliceTlsDecrypt, ( tlsStatus > 0 ) ? ( uint32_t ) tlsStatus : 0 );
+    }
+
+    #if MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0
+        /* Bytes already copied are returned even if the read which followed failed or would
+         * block; the error is reported again by the next call. */
+        if( uxCopied > 0 )
+        {
+            tlsStatus = ( int32_t ) uxCopied + ( ( tlsStatus > 0 ) ? tlsStatus : 0 );
+        }
+    #endif /* MBEDTLS_TRANSPORT_RECV_AHEAD_LEN > 0 */
+
+    return tlsStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
                                 void * pBuffer,
                                 size_t uxBytesToRecv )
@@ -1624,13 +3915,16 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
         LogWarn( ( "mbedtls_transport_recv: uxBytesToRecv(%d) <= 0", uxBytesToRecv ) );
         tlsStatus = -1;
     }
+    else if( pxTLSCtx->lCorkError < 0 )
+    {
+        /* Coalesced writes were lost, the connection can not continue */
+        tlsStatus = pxTLSCtx->lCorkError;
+    }
     else
     {
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
-            tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pxTLSCtx->xSslCtx ),
-                                                      pBuffer,
-                                                      uxBytesToRecv );
+            tlsStatus = lTransportRead( pxTLSCtx, ( uint8_t * ) pBuffer, uxBytesToRecv );
         }
         else
         {
@@ -1644,6 +3938,12 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
             /* Mark these set of errors as a timeout. The libraries may retry read
              * on these errors. */
             tlsStatus = 0;
+
+            /* The socket has been drained, wait for the next record */
+            if( pxTLSCtx->pxSocketNotifyCtx )
+            {
+                vSocketNotifyRearm( pxTLSCtx->pxSocketNotifyCtx );
+            }
         }
         /* Close the Socket if needed. */
         else if( ( tlsStatus == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ) ||
@@ -1654,13 +3954,12 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
 
             if( pxTLSCtx->xSockHandle >= 0 )
             {
-                if( pxTLSCtx->pxNotifyThreadCtx )
+                if( pxTLSCtx->pxSocketNotifyCtx )
                 {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
+                    vSocketNotifyUnregister( pxTLSCtx->pxSocketNotifyCtx );
                 }
 
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
+                vTransportSocketClose( pxTLSCtx );
             }
         }
         else if( tlsStatus < 0 )
@@ -1671,16 +3970,145 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
         }
         else
         {
-            if( pxTLSCtx->pxNotifyThreadCtx &&
-                pxTLSCtx->pxNotifyThreadCtx->xTaskHandle )
+            vRecvReadyRearm( pxTLSCtx );
+        }
+    }
+
+    return tlsStatus;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t lTransportWrite( TLSContext_t * pxTLSCtx,
+                                const void * pBuffer,
+                                size_t uxBytesToSend )
+{
+    int32_t tlsStatus = 0;
+
+    if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
+    {
+        vTraceRecBegin( TraceRecSliceTlsEncrypt, 0 );
+        tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pxTLSCtx->xSslCtx ),
+                                                   pBuffer,
+                                                   uxBytesToSend );
+        vTraceRecEnd( TraceRecSliceTlsEncrypt, ( tlsStatus > 0 ) ? ( uint32_t ) tlsStatus : 0 );
+    }
+    else
+    {
+        tlsStatus = 0;
+    }
+
+    if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
+        ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
+        ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
+    {
+        /* Mark these set of errors as a timeout. The libraries may retry send
+         * on these errors. */
+        tlsStatus = 0;
+    }
+    /* Close the Socket if needed. */
+    else if( ( tlsStatus == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ) ||
+             ( tlsStatus == MBEDTLS_ERR_NET_CONN_RESET ) )
+    {
+        tlsStatus = -1;
+        pxTLSCtx->xConnectionState = STATE_CONFIGURED;
+
+        if( pxTLSCtx->xSockHandle >= 0 )
+        {
+            if( pxTLSCtx->pxSocketNotifyCtx )
             {
-                ( void ) xTaskNotify( pxTLSCtx->pxNotifyThreadCtx->xTaskHandle, 0x0, eSetValueWithOverwrite );
+                vSocketNotifyUnregister( pxTLSCtx->pxSocketNotifyCtx );
             }
+
+            vTransportSocketClose( pxTLSCtx );
         }
     }
+    else if( tlsStatus < 0 )
+    {
+        LogError( "Failed to send data:  Error: %s : %s.",
+                  mbedtlsHighLevelCodeOrDefault( tlsStatus ),
+                  mbedtlsLowLevelCodeOrDefault( tlsStatus ) );
+    }
+    else
+    {
+        /* Empty else marker. */
+    }
 
     return tlsStatus;
 }
+
+/*-----------------------------------------------------------*/
+
+/* Write out everything staged while corked */
+static int32_t lCorkFlush( TLSContext_t * pxTLSCtx )
+{
+    int32_t tlsStatus = 0;
+    size_t uxOffset = 0;
+    uint32_t ulRetries = 0;
+
+    while( ( tlsStatus >= 0 ) &&
+           ( uxOffset < pxTLSCtx->uxCorkLen ) )
+    {
+        tlsStatus = lTransportWrite( pxTLSCtx,
+                                     &( pxTLSCtx->pucCorkBuffer[ uxOffset ] ),
+                                     pxTLSCtx->uxCorkLen - uxOffset );
+
+        if( tlsStatus > 0 )
+        {
+            uxOffset += ( size_t ) tlsStatus;
+            ulRetries = 0;
+        }
+        else if( ( tlsStatus == 0 ) &&
+                 ( ++ulRetries > MBEDTLS_TRANSPORT_CORK_FLUSH_RETRIES ) )
+        {
+            LogError( "Timed out while flushing %lu coalesced bytes.",
+                      pxTLSCtx->uxCorkLen - uxOffset );
+            tlsStatus = -1;
+        }
+    }
+
+    pxTLSCtx->uxCorkLen = 0;
+
+    return ( tlsStatus < 0 ) ? tlsStatus : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_cork( NetworkContext_t * pxNetworkContext,
+                                BaseType_t xCork )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    int32_t lResult = 0;
+
+    configASSERT( pxTLSCtx );
+
+    if( xCork == pdTRUE )
+    {
+        if( pxTLSCtx->pucCorkBuffer == NULL )
+        {
+            pxTLSCtx->pucCorkBuffer = ( uint8_t * ) pvPortMalloc( MBEDTLS_TRANSPORT_CORK_BUFFER_LEN );
+        }
+
+        /* Without a staging buffer, writes are simply not coalesced */
+        pxTLSCtx->xCorked = ( pxTLSCtx->pucCorkBuffer != NULL ) ? pdTRUE : pdFALSE;
+    }
+    else if( pxTLSCtx->xCorked == pdTRUE )
+    {
+        pxTLSCtx->xCorked = pdFALSE;
+        lResult = lCorkFlush( pxTLSCtx );
+
+        if( lResult < 0 )
+        {
+            pxTLSCtx->lCorkError = lResult;
+        }
+    }
+    else
+    {
+        /* Not corked */
+    }
+
+    return lResult;
+}
+
 /*-----------------------------------------------------------*/
 
 int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
@@ -1705,56 +4133,38 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
         LogWarn( ( "mbedtls_transport_send: uxBytesToSend(%d) <= 0", uxBytesToSend ) );
         tlsStatus = -1;
     }
-    else
+    else if( pxTLSCtx->lCorkError < 0 )
     {
-        if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
-        {
-            tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pxTLSCtx->xSslCtx ),
-                                                       pBuffer,
-                                                       uxBytesToSend );
-        }
-        else
+        tlsStatus = pxTLSCtx->lCorkError;
+    }
+    else if( ( pxTLSCtx->xCorked == pdTRUE ) &&
+             ( pxTLSCtx->xConnectionState == STATE_CONNECTED ) )
+    {
+        if( uxBytesToSend > ( MBEDTLS_TRANSPORT_CORK_BUFFER_LEN - pxTLSCtx->uxCorkLen ) )
         {
-            tlsStatus = 0;
+            tlsStatus = lCorkFlush( pxTLSCtx );
         }
 
-        if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
-            ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
-            ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
-        {
-            /* Mark these set of errors as a timeout. The libraries may retry send
-             * on these errors. */
-            tlsStatus = 0;
-        }
-        /* Close the Socket if needed. */
-        else if( ( tlsStatus == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ) ||
-                 ( tlsStatus == MBEDTLS_ERR_NET_CONN_RESET ) )
+        if( tlsStatus < 0 )
         {
-            tlsStatus = -1;
-            pxTLSCtx->xConnectionState = STATE_CONFIGURED;
-
-            if( pxTLSCtx->xSockHandle >= 0 )
-            {
-                if( pxTLSCtx->pxNotifyThreadCtx )
-                {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-                }
-
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
-            }
+            /* Flush failed */
         }
-        else if( tlsStatus < 0 )
+        else if( uxBytesToSend <= MBEDTLS_TRANSPORT_CORK_BUFFER_LEN - pxTLSCtx->uxCorkLen )
         {
-            LogError( "Failed to send data:  Error: %s : %s.",
-                      mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                      mbedtlsLowLevelCodeOrDefault( tlsStatus ) );
+            ( void ) memcpy( &( pxTLSCtx->pucCorkBuffer[ pxTLSCtx->uxCorkLen ] ), pBuffer, uxBytesToSend );
+            pxTLSCtx->uxCorkLen += uxBytesToSend;
+            tlsStatus = ( int32_t ) uxBytesToSend;
         }
         else
         {
-            /* Empty else marker. */
+            /* Too large to stage, write it directly */
+            tlsStatus = lTransportWrite( pxTLSCtx, pBuffer, uxBytesToSend );
         }
     }
+    else
+    {
+        tlsStatus = lTransportWrite( pxTLSCtx, pBuffer, uxBytesToSend );
+    }
 
     return tlsStatus;
 }
@@ -33,12 +33,18 @@
 #include "semphr.h"
 #include "event_groups.h"
 #include "stdbool.h"
+#include "string.h"
 #include "stm32u5xx_hal.h"
 #include "message_buffer.h"
 #include "atomic.h"
 
 #include "mx_ipc.h"
 #include "mx_prv.h"
+#include "mx_stats.h"
+#include "trace_rec.h"
+#include "lowpower.h"
+#include "sram_banks.h"
+#include "boot_prof.h"
 
 #define EVT_SPI_DONE        0x8
 #define EVT_SPI_ERROR       0x10
@@ -50,6 +56,104 @@
 
 static MxDataplaneCtx_t * volatile pxSpiCtx = NULL;
 
+static MxDataplaneStats_t xStats = { 0 };
+
+/* Enable the DWT cycle counter used to time dataplane operations */
+static inline void vStatsInitCycleCounter( void )
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t ulStatsGetCycles( void )
+{
+    return DWT->CYCCNT;
+}
+
+/* Record the time elapsed since ulStartCycles in a histogram */
+static void vStatsRecord( MxStatsHistogram_t * pxHist,
+                          uint32_t ulStartCycles )
+{
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000;
+    uint32_t ulElapsedUs = ( ulStatsGetCycles() - ulStartCycles ) / ( ulCyclesPerUs > 0 ? ulCyclesPerUs : 1 );
+    uint32_t ulBucket = 0;
+
+    /* Find the bucket number: the number of significant bits in ulElapsedUs */
+    if( ulElapsedUs > 0 )
+    {
+        ulBucket = 32 - __CLZ( ulElapsedUs );
+    }
+
+    if( ulBucket >= MX_STATS_HIST_BUCKETS )
+    {
+        ulBucket = MX_STATS_HIST_BUCKETS - 1;
+    }
+
+    pxHist->ulBuckets[ ulBucket ]++;
+    pxHist->ulCount++;
+    pxHist->ullTotalUs += ulElapsedUs;
+
+    if( ulElapsedUs > pxHist->ulMaxUs )
+    {
+        pxHist->ulMaxUs = ulElapsedUs;
+    }
+}
+
+/*
+ * Record the delay between the last edge of a gpio and now, provided that edge happened
+ * after ulWaitStartCycles. Older edges were already pending when the wait began and would
+ * only measure how long the task was busy elsewhere.
+ */
+static void vStatsRecordEdgeLatency( MxStatsHistogram_t * pxHist,
+                                     uint16_t usPinMask,
+                                     uint32_t ulWaitStartCycles )
+{
+    uint32_t ulEdgeCycles = GPIO_EXTI_Get_Edge_Cycles( usPinMask );
+
+    if( ( int32_t ) ( ulEdgeCycles - ulWaitStartCycles ) > 0 )
+    {
+        vStatsRecord( pxHist, ulEdgeCycles );
+    }
+}
+
+void mx_GetDataplaneStats( MxDataplaneStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &xStats, sizeof( MxDataplaneStats_t ) );
+
+            if( pxSpiCtx != NULL )
+            {
+                pxStats->ulRxPoolHighWaterMark = pxSpiCtx->xRxPool.ulHighWaterMark;
+                pxStats->ulRxPoolExhausted = pxSpiCtx->xRxPool.ulExhaustedCount;
+                pxStats->ulFlowSpinBudget = pxSpiCtx->ulFlowSpinBudget;
+                pxStats->ulTxQueueHighWaterMark = pxSpiCtx->xTxBackpressure.ulHighWaterMark;
+                pxStats->ulTxQueueFull = pxSpiCtx->xTxBackpressure.ulQueueFullCount;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+void mx_ResetDataplaneStats( void )
+{
+    taskENTER_CRITICAL();
+    {
+        ( void ) memset( &xStats, 0, sizeof( MxDataplaneStats_t ) );
+
+        if( pxSpiCtx != NULL )
+        {
+            pxSpiCtx->xRxPool.ulHighWaterMark = 0;
+            pxSpiCtx->xRxPool.ulExhaustedCount = 0;
+            pxSpiCtx->xTxBackpressure.ulHighWaterMark = 0;
+            pxSpiCtx->xTxBackpressure.ulQueueFullCount = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
 uint32_t prvGetNextRequestID( void )
 {
     uint32_t ulRequestId = 0;
@@ -70,7 +174,7 @@ uint32_t prvGetNextRequestID( void )
 
 
 /* Callback functions */
-static void spi_transfer_done_callback( SPI_HandleTypeDef * hspi )
+static void RAMFUNC spi_transfer_done_callback( SPI_HandleTypeDef * hspi )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     BaseType_t rslt = pdFALSE;
@@ -108,22 +212,24 @@ static void spi_transfer_error_callback( SPI_HandleTypeDef * hspi )
 }
 
 /* Notify / IRQ pin transition means data is ready */
-static void spi_notify_callback( void * pvContext )
+static void RAMFUNC spi_notify_callback( void * pvContext )
 {
     MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvContext;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     if( pxSpiCtx != NULL )
     {
-        vTaskNotifyGiveIndexedFromISR( pxCtx->xDataPlaneTaskHandle,
-                                       DATA_WAITING_IDX,
-                                       &xHigherPriorityTaskWoken );
+        ( void ) xTaskNotifyIndexedFromISR( pxCtx->xDataPlaneTaskHandle,
+                                            DATA_WAITING_IDX,
+                                            DATA_WAITING_SNOTIFY,
+                                            eSetBits,
+                                            &xHigherPriorityTaskWoken );
 
         portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
     }
 }
 
-static void spi_flow_callback( void * pvContext )
+static void RAMFUNC spi_flow_callback( void * pvContext )
 {
     MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvContext;
 
@@ -164,6 +270,83 @@ static inline void vDoHardReset( MxDataplaneCtx_t * pxCtx )
     vTaskDelay( 2000 );
 }
 
+/*
+ * DCACHE1 only caches the external memory regions (OCTOSPI / FMC). Buffers in internal
+ * SRAM are always coherent with GPDMA, so cache maintenance is only needed for buffers
+ * that live in the cacheable external memory window.
+ */
+#define MX_DCACHE_LINE_SIZE       32
+#define MX_DCACHE_REGION_START    0x60000000UL
+#define MX_DCACHE_REGION_END      0xA0000000UL
+
+static inline BaseType_t xIsCacheableBuffer( const uint8_t * pucBuffer )
+{
+    uint32_t ulAddr = ( uint32_t ) pucBuffer;
+
+    return( ( pxHndlDCache != NULL ) &&
+            ( ulAddr >= MX_DCACHE_REGION_START ) &&
+            ( ulAddr < MX_DCACHE_REGION_END ) );
+}
+
+/*
+ * @brief Align a buffer range to whole DCACHE lines.
+ */
+static inline void vAlignToCacheLines( const uint8_t * pucBuffer,
+                                       uint32_t ulLen,
+                                       uint32_t ** ppulAlignedAddr,
+                                       uint32_t * pulAlignedLen )
+{
+    uint32_t ulStart = ( ( uint32_t ) pucBuffer ) & ~( MX_DCACHE_LINE_SIZE - 1 );
+    uint32_t ulEnd = ( ( uint32_t ) pucBuffer + ulLen + MX_DCACHE_LINE_SIZE - 1 ) & ~( MX_DCACHE_LINE_SIZE - 1 );
+
+    *ppulAlignedAddr = ( uint32_t * ) ulStart;
+    *pulAlignedLen = ulEnd - ulStart;
+}
+
+/*
+ * @brief Make tx and rx buffers coherent before starting a DMA transfer.
+ */
+static inline void vDmaCachePrepare( const uint8_t * pucTxBuffer,
+                                     uint32_t ulTxLen,
+                                     const uint8_t * pucRxBuffer,
+                                     uint32_t ulRxLen )
+{
+    uint32_t * pulAddr = NULL;
+    uint32_t ulLen = 0;
+
+    if( ( pucTxBuffer != NULL ) &&
+        ( xIsCacheableBuffer( pucTxBuffer ) == pdTRUE ) )
+    {
+        vAlignToCacheLines( pucTxBuffer, ulTxLen, &pulAddr, &ulLen );
+        ( void ) HAL_DCACHE_CleanByAddr( pxHndlDCache, pulAddr, ulLen );
+    }
+
+    /* Write back dirty lines so that they are not evicted on top of the received data */
+    if( ( pucRxBuffer != NULL ) &&
+        ( xIsCacheableBuffer( pucRxBuffer ) == pdTRUE ) )
+    {
+        vAlignToCacheLines( pucRxBuffer, ulRxLen, &pulAddr, &ulLen );
+        ( void ) HAL_DCACHE_CleanInvalidByAddr( pxHndlDCache, pulAddr, ulLen );
+    }
+}
+
+/*
+ * @brief Discard any stale cache lines covering a buffer written by DMA.
+ */
+static inline void vDmaCacheComplete( const uint8_t * pucRxBuffer,
+                                      uint32_t ulRxLen )
+{
+    uint32_t * pulAddr = NULL;
+    uint32_t ulLen = 0;
+
+    if( ( pucRxBuffer != NULL ) &&
+        ( xIsCacheableBuffer( pucRxBuffer ) == pdTRUE ) )
+    {
+        vAlignToCacheLines( pucRxBuffer, ulRxLen, &pulAddr, &ulLen );
+        ( void ) HAL_DCACHE_InvalidateByAddr( pxHndlDCache, pulAddr, ulLen );
+    }
+}
+
 /* SPI protocol definitions */
 #define MX_SPI_WRITE    ( 0x0A )
 #define MX_SPI_READ     ( 0x0B )
@@ -211,8 +394,14 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
 {
     HAL_StatusTypeDef xHalStatus = HAL_ERROR;
 
-    SPIHeader_t xRxHeader = { 0 };
-    SPIHeader_t xTxHeader = { 0 };
+    /* Only the data plane task exchanges headers, keep them in the DMA bank */
+    static SPIHeader_t xRxHeader SRAM_BANK_DMA;
+    static SPIHeader_t xTxHeader SRAM_BANK_DMA;
+
+    ( void ) memset( &xRxHeader, 0, sizeof( SPIHeader_t ) );
+    ( void ) memset( &xTxHeader, 0, sizeof( SPIHeader_t ) );
+
+    uint32_t ulStartCycles = ulStatsGetCycles();
 
     xTxHeader.type = MX_SPI_WRITE;
     xTxHeader.len = *psTxLen;
@@ -235,6 +424,8 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
         xHalStatus = ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
     }
 
+    vStatsRecord( &( xStats.xHeaderExchange ), ulStartCycles );
+
     if( ( xHalStatus == HAL_OK ) &&
         ( xRxHeader.len < MX_MAX_MESSAGE_LEN ) &&
         ( xRxHeader.type == MX_SPI_READ ) &&
@@ -270,12 +461,16 @@ static inline BaseType_t xReceiveMessage( MxDataplaneCtx_t * pxCtx,
 
     ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
+    vDmaCachePrepare( NULL, 0, pucRxBuffer, ulRxDataLen );
+
     xHalStatus = HAL_SPI_Receive_DMA( pxCtx->pxSpiHandle,
                                       pucRxBuffer,
                                       ulRxDataLen );
 
     xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
 
+    vDmaCacheComplete( pucRxBuffer, ulRxDataLen );
+
     return xHalStatus == HAL_OK;
 }
 
@@ -292,6 +487,8 @@ static inline BaseType_t xTransmitMessage( MxDataplaneCtx_t * pxCtx,
 
     ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
+    vDmaCachePrepare( pucTxBuffer, usTxDataLen, NULL, 0 );
+
     xHalStatus = HAL_SPI_Transmit_DMA( pxCtx->pxSpiHandle,
                                        pucTxBuffer,
                                        usTxDataLen );
@@ -320,6 +517,8 @@ static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
     {
         ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
+        vDmaCachePrepare( pucTxBuffer, usRxDataLen, pucRxBuffer, usRxDataLen );
+
         xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
                                                   pucTxBuffer,
                                                   pucRxBuffer,
@@ -327,14 +526,18 @@ static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
 
         xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
 
-        xHalStatus |= xTransmitMessage( pxCtx,
-                                        &pucTxBuffer[ usRxDataLen ],
-                                        usTxDataLen - usRxDataLen );
+        vDmaCacheComplete( pucRxBuffer, usRxDataLen );
+
+        xHalStatus |= ( xTransmitMessage( pxCtx,
+                                          &pucTxBuffer[ usRxDataLen ],
+                                          usTxDataLen - usRxDataLen ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
     }
     else if( usTxDataLen < usRxDataLen )
     {
         ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
+        vDmaCachePrepare( pucTxBuffer, usTxDataLen, pucRxBuffer, usTxDataLen );
+
         xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
                                                   pucTxBuffer,
                                                   pucRxBuffer,
@@ -342,27 +545,98 @@ static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
 
         xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
 
-        xHalStatus |= xReceiveMessage( pxCtx,
-                                       &pucRxBuffer[ usTxDataLen ],
-                                       usRxDataLen - usTxDataLen );
+        vDmaCacheComplete( pucRxBuffer, usTxDataLen );
+
+        xHalStatus |= ( xReceiveMessage( pxCtx,
+                                         &pucRxBuffer[ usTxDataLen ],
+                                         usRxDataLen - usTxDataLen ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
     }
     else /* usTxDataLen == usRxDataLen */
     {
+        ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
+
+        vDmaCachePrepare( pucTxBuffer, usTxDataLen, pucRxBuffer, usTxDataLen );
+
         xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
                                                   pucTxBuffer,
                                                   pucRxBuffer,
                                                   usTxDataLen );
 
         xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+
+        vDmaCacheComplete( pucRxBuffer, usTxDataLen );
     }
 
     return xHalStatus == HAL_OK;
 }
 
+/*
+ * @brief Transmit a (possibly chained) pbuf while optionally receiving ulRxDataLen bytes.
+ *
+ * Each segment of the chain is streamed directly from its own payload so that chained
+ * frames handed down by lwIP never need to be flattened into a contiguous buffer.
+ */
+static BaseType_t RAMFUNC xTransmitPbufChain( MxDataplaneCtx_t * pxCtx,
+                                              PacketBuffer_t * pxTxBuff,
+                                              uint32_t ulTxDataLen,
+                                              uint8_t * pucRxBuffer,
+                                              uint32_t ulRxDataLen )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulRxOffset = 0;
+
+    configASSERT( pxTxBuff != NULL );
+    configASSERT( ( pucRxBuffer != NULL ) || ( ulRxDataLen == 0 ) );
+
+    for( PacketBuffer_t * pxSegment = pxTxBuff;
+         ( pxSegment != NULL ) && ( ulTxDataLen > 0 ) && ( xResult == pdTRUE );
+         pxSegment = pxSegment->next )
+    {
+        uint32_t ulSegmentLen = ( pxSegment->len < ulTxDataLen ) ? pxSegment->len : ulTxDataLen;
+        uint32_t ulRxChunkLen = ulRxDataLen - ulRxOffset;
 
-static void vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
-                              NetInterface_t * pxNetif,
-                              PacketBuffer_t ** ppxRxPacket )
+        if( ulRxChunkLen > ulSegmentLen )
+        {
+            ulRxChunkLen = ulSegmentLen;
+        }
+
+        if( ulSegmentLen == 0 )
+        {
+            /* Skip empty segments */
+        }
+        else if( ulRxChunkLen > 0 )
+        {
+            xResult = xTransmitReceiveMessage( pxCtx,
+                                               pxSegment->payload,
+                                               ulSegmentLen,
+                                               &pucRxBuffer[ ulRxOffset ],
+                                               ulRxChunkLen );
+            ulRxOffset += ulRxChunkLen;
+        }
+        else
+        {
+            xResult = xTransmitMessage( pxCtx, pxSegment->payload, ulSegmentLen );
+        }
+
+        ulTxDataLen -= ulSegmentLen;
+    }
+
+    /* Receive any remaining data once the tx chain has been exhausted */
+    if( ( xResult == pdTRUE ) &&
+        ( ulRxOffset < ulRxDataLen ) )
+    {
+        xResult = xReceiveMessage( pxCtx,
+                                   &pucRxBuffer[ ulRxOffset ],
+                                   ulRxDataLen - ulRxOffset );
+    }
+
+    return xResult;
+}
+
+
+static void RAMFUNC vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
+                                      NetInterface_t * pxNetif,
+                                      PacketBuffer_t ** ppxRxPacket )
 {
     BaseType_t xResult = pdFALSE;
 
@@ -406,7 +680,19 @@ static void vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
         ( *ppxRxPacket ) = NULL;
         pxRxPktHeader = NULL;
     }
-    /* forward to control plane handler */
+    /* Hand responses directly to the waiting IPC request context */
+    else if( pxRxPktHeader->ulIPCRequestId != 0 )
+    {
+        if( prvxDeliverIPCResponse( *ppxRxPacket ) != pdTRUE )
+        {
+            PBUF_FREE( *ppxRxPacket );
+        }
+
+        /* Clear pointer. Ownership was passed to the request context or the packet was freed. */
+        ( *ppxRxPacket ) = NULL;
+        pxRxPktHeader = NULL;
+    }
+    /* forward events to control plane handler */
     else
     {
         xResult = xMessageBufferSend( xControlPlaneResponseBuff,
@@ -444,6 +730,19 @@ void vInitCallbacks( MxDataplaneCtx_t * pxCtx )
                                  spi_flow_callback,
                                  pxCtx );
 
+    #if MX_GPIO_DIRECT_NOTIFY == 1
+        /* Same notifications as the callbacks above, sent straight from the EXTI handlers */
+        GPIO_EXTI_Register_Notify( pxCtx->gpio_notify->xPinMask,
+                                   pxCtx->xDataPlaneTaskHandle,
+                                   DATA_WAITING_IDX,
+                                   DATA_WAITING_SNOTIFY );
+
+        GPIO_EXTI_Register_Notify( pxCtx->gpio_flow->xPinMask,
+                                   pxCtx->xDataPlaneTaskHandle,
+                                   SPI_EVT_FLOW_IDX,
+                                   0 );
+    #endif /* MX_GPIO_DIRECT_NOTIFY == 1 */
+
 
 
     xHalResult = HAL_SPI_RegisterCallback( pxCtx->pxSpiHandle,
@@ -471,16 +770,100 @@ void vInitCallbacks( MxDataplaneCtx_t * pxCtx )
     configASSERT( xHalResult == HAL_OK );
 }
 
-/* Wait for the flow pin go high signifying that the module is ready for more data. */
+/*
+ * @brief Adjust the flow pin busy-spin budget after a wait.
+ *
+ * A hit pulls the budget towards twice the observed latency, a miss halves it so that
+ * slow responses quickly stop burning CPU time.
+ */
+static inline void vFlowSpinUpdate( MxDataplaneCtx_t * pxCtx,
+                                    BaseType_t xSpinHit,
+                                    uint32_t ulSpinCycles )
+{
+    uint32_t ulBudget = pxCtx->ulFlowSpinBudget;
+
+    if( xSpinHit == pdTRUE )
+    {
+        uint32_t ulTarget = 2 * ulSpinCycles;
+
+        if( ulTarget > ulBudget )
+        {
+            ulBudget += ( ulTarget - ulBudget ) / 8;
+        }
+        else
+        {
+            ulBudget -= ( ulBudget - ulTarget ) / 8;
+        }
+    }
+    else
+    {
+        ulBudget /= 2;
+    }
+
+    if( ulBudget < MX_FLOW_SPIN_MIN_CYCLES )
+    {
+        ulBudget = MX_FLOW_SPIN_MIN_CYCLES;
+    }
+    else if( ulBudget > MX_FLOW_SPIN_MAX_CYCLES )
+    {
+        ulBudget = MX_FLOW_SPIN_MAX_CYCLES;
+    }
+
+    pxCtx->ulFlowSpinBudget = ulBudget;
+}
+
+/*
+ * Wait for the flow pin to go high, signifying that the module is ready for more data. Spins up to
+ * the adaptive budget before blocking on the flow notification, returns pdFALSE on timeout.
+ */
 static inline BaseType_t xWaitForFlow( MxDataplaneCtx_t * pxCtx )
 {
     uint32_t ulFlowValue = 0;
+    uint32_t ulStartCycles = ulStatsGetCycles();
 
-    /* Wait for flow pin to go high to signal that the module is ready */
-    ulFlowValue = ulTaskNotifyTakeIndexed( SPI_EVT_FLOW_IDX, pdTRUE, MX_SPI_FLOW_TIMEOUT );
+    #if MX_FLOW_SPIN_MAX_CYCLES > 0
+        uint32_t ulSpinCycles = 0;
+
+        /*
+         * Fast path: poll for the flow event without blocking. The flow EXTI callback still
+         * delivers the notification, so polling its count keeps the edge semantics of the
+         * blocking path while avoiding a context switch for short waits.
+         */
+        do
+        {
+            ulFlowValue = ulTaskNotifyTakeIndexed( SPI_EVT_FLOW_IDX, pdTRUE, 0 );
+            ulSpinCycles = ulStatsGetCycles() - ulStartCycles;
+        } while( ( ulFlowValue == 0 ) &&
+                 ( ulSpinCycles < pxCtx->ulFlowSpinBudget ) );
+
+        vFlowSpinUpdate( pxCtx, ( BaseType_t ) ( ulFlowValue != 0 ), ulSpinCycles );
+    #endif /* MX_FLOW_SPIN_MAX_CYCLES > 0 */
+
+    if( ulFlowValue != 0 )
+    {
+        xStats.ulFlowSpinHits++;
+    }
+    else
+    {
+        uint32_t ulBlockCycles = ulStatsGetCycles();
+
+        xStats.ulFlowBlockingWaits++;
+
+        /* Wait for flow pin to go high to signal that the module is ready */
+        ulFlowValue = ulTaskNotifyTakeIndexed( SPI_EVT_FLOW_IDX, pdTRUE, MX_SPI_FLOW_TIMEOUT );
+
+        if( ulFlowValue != 0 )
+        {
+            vStatsRecordEdgeLatency( &( xStats.xFlowLatency ), pxCtx->gpio_flow->xPinMask, ulBlockCycles );
+        }
+    }
+
+    vStatsRecord( &( xStats.xFlowWait ), ulStartCycles );
 
     if( ulFlowValue == 0 )
     {
+        xStats.ulFlowTimeouts++;
+
         LogDebug( "Timed out while waiting for EVT_SPI_FLOW. ulFlowValue: %d, xTimeout: %d",
                   ulFlowValue, MX_SPI_FLOW_TIMEOUT );
     }
@@ -488,183 +871,416 @@ static inline BaseType_t xWaitForFlow( MxDataplaneCtx_t * pxCtx )
     return( ( BaseType_t ) ( ulFlowValue != 0 ) );
 }
 
-void vDataplaneThread( void * pvParameters )
+/*
+ * @brief Top up the pre-allocated rx buffer pool.
+ *
+ * Called while NSS is idle so that pbuf allocation happens outside of the SPI transaction.
+ */
+static void vRxPoolRefill( MxDataplaneCtx_t * pxCtx )
 {
-    /* Get context struct (contains instance parameters) */
-    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
+    MxRxPbufPool_t * pxPool = &( pxCtx->xRxPool );
+    uint32_t ulConsumed = MX_RX_POOL_LEN - pxPool->ulCount;
 
-    BaseType_t exitFlag = pdFALSE;
+    if( ulConsumed > pxPool->ulHighWaterMark )
+    {
+        pxPool->ulHighWaterMark = ulConsumed;
+    }
 
-    /* Export context for callbacks */
-    pxSpiCtx = pxCtx;
+    while( pxPool->ulCount < MX_RX_POOL_LEN )
+    {
+        PacketBuffer_t * pxBuff = PBUF_ALLOC_RX( MX_RX_BUFF_SZ );
 
-    vInitCallbacks( pxCtx );
+        if( pxBuff == NULL )
+        {
+            break;
+        }
+        else if( PBUF_VALID( pxBuff ) )
+        {
+            pxPool->pxBuffers[ pxPool->ulCount ] = pxBuff;
+            pxPool->ulCount++;
+        }
+        else
+        {
+            /* PBUF_POOL_BUFSIZE is too small to hold a full frame in a single pbuf */
+            LogError( "Unable to allocate a contiguous rx buffer of length %d.", MX_RX_BUFF_SZ );
+            PBUF_FREE( pxBuff );
+            break;
+        }
+    }
+}
 
-    /* set CS/NSS high */
-    vGpioSet( pxCtx->gpio_nss );
+/*
+ * @brief Get an rx buffer of length usRxLen, using the pre-allocated pool when possible.
+ */
+static PacketBuffer_t * pxRxPoolTake( MxDataplaneCtx_t * pxCtx,
+                                      uint16_t usRxLen )
+{
+    MxRxPbufPool_t * pxPool = &( pxCtx->xRxPool );
+    PacketBuffer_t * pxBuff = NULL;
 
-    /* Do hardware reset */
-    vDoHardReset( pxCtx );
+    if( ( usRxLen <= MX_RX_BUFF_SZ ) &&
+        ( pxPool->ulCount > 0 ) )
+    {
+        pxPool->ulCount--;
+        pxBuff = pxPool->pxBuffers[ pxPool->ulCount ];
+        pxPool->pxBuffers[ pxPool->ulCount ] = NULL;
 
-    while( exitFlag == pdFALSE )
+        /* Trim the buffer to the length of the incoming message */
+        pbuf_realloc( pxBuff, usRxLen );
+    }
+    else if( usRxLen <= MX_RX_BUFF_SZ )
+    {
+        pxPool->ulExhaustedCount++;
+
+        pxBuff = PBUF_ALLOC_RX( usRxLen );
+    }
+    else
+    {
+        /* PBUF_POOL buffers would be chained, so receive large messages into a contiguous buffer */
+        pxBuff = PBUF_ALLOC_RX_LARGE( usRxLen );
+    }
+
+    return pxBuff;
+}
+
+/*
+ * @brief Select the queue to transmit the next message from and peek at its head.
+ *
+ * Control plane messages are always sent first. Latency sensitive dataplane frames
+ * are preferred over bulk frames, but at most MX_TX_PRIORITY_WEIGHT of them are sent
+ * in a row while bulk frames are waiting so that neither class starves.
+ *
+ * @return The queue handle to receive from, or NULL when there is nothing to send.
+ */
+static QueueHandle_t xSelectTxQueue( MxDataplaneCtx_t * pxCtx,
+                                     PacketBuffer_t ** ppxTxBuff )
+{
+    QueueHandle_t xSourceQueue = NULL;
+
+    if( xQueuePeek( pxCtx->xControlPlaneSendQueue, ppxTxBuff, 0 ) == pdTRUE )
+    {
+        xSourceQueue = pxCtx->xControlPlaneSendQueue;
+        LogDebug( "Preparing controlplane message for transmission" );
+    }
+    else
     {
-        PacketBuffer_t * pxTxBuff = NULL;
-        PacketBuffer_t * pxRxBuff = NULL;
+        BaseType_t xBulkWaiting = ( uxQueueMessagesWaiting( pxCtx->xDataPlaneSendQueue ) > 0 );
 
-        if( pxCtx->ulTxPacketsWaiting == 0 )
+        if( ( ( xBulkWaiting == pdFALSE ) ||
+              ( pxCtx->ulPriorityFramesInRow < MX_TX_PRIORITY_WEIGHT ) ) &&
+            ( xQueuePeek( pxCtx->xDataPlanePrioritySendQueue, ppxTxBuff, 0 ) == pdTRUE ) )
         {
-            LogDebug( "Starting wait for DATA_WAITING_IDX event" );
-            ulTaskNotifyTakeIndexed( DATA_WAITING_IDX,
-                                     pdFALSE,
-                                     500 );
-        }
+            xSourceQueue = pxCtx->xDataPlanePrioritySendQueue;
+
+            if( xBulkWaiting == pdTRUE )
+            {
+                pxCtx->ulPriorityFramesInRow++;
+            }
 
-        /* Skip this transaction if IRQ pin is low and there are no pending tx packets */
-        if( ( xGpioGet( pxCtx->gpio_notify ) == pdFALSE ) &&
-            ( pxCtx->ulTxPacketsWaiting == 0 ) )
+            LogDebug( "Preparing priority dataplane message for transmission" );
+        }
+        else if( xQueuePeek( pxCtx->xDataPlaneSendQueue, ppxTxBuff, 0 ) == pdTRUE )
+        {
+            xSourceQueue = pxCtx->xDataPlaneSendQueue;
+            pxCtx->ulPriorityFramesInRow = 0;
+            LogDebug( "Preparing dataplane message for transmission" );
+        }
+        else
         {
-            continue;
+            /* Empty, no TX packets */
         }
+    }
 
-        /* Clear flow state */
-        xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
+    return xSourceQueue;
+}
 
-        /* Set CS low to initiate transaction */
-        vGpioClear( pxCtx->gpio_nss );
+/* Returns pdTRUE if there is a pending TX packet or the module has signaled that RX data is waiting */
+static inline BaseType_t xDataPending( MxDataplaneCtx_t * pxCtx )
+{
+    return( ( pxCtx->ulTxPacketsWaiting != 0 ) ||
+            ( xGpioGet( pxCtx->gpio_notify ) != pdFALSE ) );
+}
 
-        BaseType_t xResult = pdTRUE;
+/*
+ * @brief Perform a single NSS / flow handshake with the module, exchanging at most one
+ * frame in each direction.
+ *
+ * @param[in] pxCtx Dataplane context
+ * @param[out] pulBytesMoved Number of payload bytes transmitted and received.
+ *
+ * @return pdTRUE if the transaction completed successfully.
+ */
+static BaseType_t RAMFUNC xDoTransaction( MxDataplaneCtx_t * pxCtx,
+                                          uint32_t * pulBytesMoved )
+{
+    PacketBuffer_t * pxTxBuff = NULL;
+    PacketBuffer_t * pxRxBuff = NULL;
+    BaseType_t xResult = pdTRUE;
+
+    *pulBytesMoved = 0;
+
+    /* Clear flow state */
+    xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
+
+    /* SPI2 and its DMA channels stop in STOP2 */
+    vLowPowerInhibit();
+    vTraceRecBegin( TraceRecSliceSpi, 0 );
+
+    /* Set CS low to initiate transaction */
+    vGpioClear( pxCtx->gpio_nss );
 
-        /* Wait for the module to be ready */
-        if( xWaitForFlow( pxCtx ) == pdTRUE )
+    /* Wait for the module to be ready */
+    if( xWaitForFlow( pxCtx ) == pdTRUE )
+    {
+        uint16_t usTxLen = 0;
+        uint16_t usRxLen = 0;
+
+        QueueHandle_t xSourceQueue = NULL;
+
+        /* Pick the next message for TX */
+        xSourceQueue = xSelectTxQueue( pxCtx, &pxTxBuff );
+
+        if( xSourceQueue != NULL )
         {
-            uint16_t usTxLen = 0;
-            uint16_t usRxLen = 0;
+            configASSERT( pxTxBuff != NULL );
+            configASSERT( pxTxBuff->ref > 0 );
+            usTxLen = pxTxBuff->tot_len;
+        }
 
-            QueueHandle_t xSourceQueue = NULL;
+        /*
+         * Senders count a packet before queueing it, so ulTxPacketsWaiting may briefly be ahead of
+         * the queues. It is not reset here, the next transaction picks the packet up.
+         */
 
-            /* Prepare a control plane messages for TX */
-            if( xQueuePeek( pxCtx->xControlPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+        if( xResult == pdTRUE )
+        {
+            /* Transfer the header */
+            xResult = xDoSpiHeaderTransfer( pxCtx, &usTxLen, &usRxLen );
+        }
+
+        if( xResult == pdTRUE )
+        {
+            /* Get an RX buffer */
+            if( usRxLen > 0 )
             {
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( pxTxBuff->ref > 0 );
-                usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xControlPlaneSendQueue;
-                LogDebug( "Preparing controlplane message for transmission" );
+                pxRxBuff = pxRxPoolTake( pxCtx, usRxLen );
             }
-            else if( xQueuePeek( pxCtx->xDataPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+
+            /* Wait for flow pin to go high */
+            xResult = xWaitForFlow( pxCtx );
+        }
+
+        /* Read from the queue */
+        if( ( xResult == pdTRUE ) &&
+            ( xSourceQueue != NULL ) )
+        {
+            xResult = xQueueReceive( xSourceQueue, &pxTxBuff, 0 );
+            configASSERT( pxTxBuff != NULL );
+            configASSERT( xResult == pdTRUE );
+        }
+        else if( pxTxBuff != NULL )
+        {
+            pxTxBuff = NULL;
+        }
+
+        /* Transmit / receive packet data */
+        if( ( xResult == pdTRUE ) &&
+            ( ( usTxLen > 0 ) || ( usRxLen > 0 ) ) )
+        {
+            uint32_t ulStartCycles = ulStatsGetCycles();
+
+            /* Transmit case */
+            if( ( usTxLen > 0 ) &&
+                ( usRxLen == 0 ) )
             {
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( pxTxBuff->ref > 0 );
-                usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xDataPlaneSendQueue;
-                LogDebug( "Preparing dataplane message for transmission" );
+                configASSERT( pxTxBuff );
+                xResult = xTransmitPbufChain( pxCtx, pxTxBuff, usTxLen, NULL, 0 );
             }
-            else
+            else if( ( usRxLen > 0 ) &&
+                     ( usTxLen == 0 ) )
             {
-                /* Empty, no TX packets */
+                configASSERT( pxRxBuff );
+                xResult = xReceiveMessage( pxCtx, pxRxBuff->payload, usRxLen );
             }
-
-            if( ( pxTxBuff == NULL ) &&
-                ( pxCtx->ulTxPacketsWaiting != 0 ) )
+            else if( ( usRxLen > 0 ) &&
+                     ( usTxLen > 0 ) )
             {
-                LogWarn( "Mismatch between ulTxPacketsWaiting and queue contents. Resetting ulTxPacketsWaiting" );
-                pxSpiCtx->ulTxPacketsWaiting = 0;
+                configASSERT( pxRxBuff );
+                configASSERT( pxTxBuff );
+
+                xResult = xTransmitPbufChain( pxCtx,
+                                              pxTxBuff,
+                                              usTxLen,
+                                              pxRxBuff->payload,
+                                              usRxLen );
             }
 
-            if( xResult == pdTRUE )
-            {
-                /* Transfer the header */
-                xResult = xDoSpiHeaderTransfer( pxCtx, &usTxLen, &usRxLen );
-            }
+            vStatsRecord( &( xStats.xPayloadTransfer ), ulStartCycles );
+        }
 
-            if( xResult == pdTRUE )
-            {
-                /* Allocate RX buffer */
-                if( usRxLen > 0 )
-                {
-                    pxRxBuff = PBUF_ALLOC_RX( usRxLen );
-                }
-
-                /* Wait for flow pin to go high */
-                xResult = xWaitForFlow( pxCtx );
-            }
+        if( xResult == pdTRUE )
+        {
+            *pulBytesMoved = ( uint32_t ) usTxLen + ( uint32_t ) usRxLen;
 
-            /* Read from the queue */
-            if( ( xResult == pdTRUE ) &&
-                ( xSourceQueue != NULL ) )
+            if( usTxLen > 0 )
             {
-                xResult = xQueueReceive( xSourceQueue, &pxTxBuff, 0 );
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( xResult == pdTRUE );
-            }
-            else if( pxTxBuff != NULL )
-            {
-                pxTxBuff = NULL;
+                xStats.ulTxFrames++;
+                xStats.ullTxBytes += usTxLen;
             }
 
-            /* Transmit / receive packet data */
-            if( xResult == pdTRUE )
+            if( usRxLen > 0 )
             {
-                /* Transmit case */
-                if( ( usTxLen > 0 ) &&
-                    ( usRxLen == 0 ) )
-                {
-                    configASSERT( pxTxBuff );
-                    xResult = xTransmitMessage( pxCtx, pxTxBuff->payload, usTxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen == 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    xResult = xReceiveMessage( pxCtx, pxRxBuff->payload, usRxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen > 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    configASSERT( pxTxBuff );
-
-                    xResult = xTransmitReceiveMessage( pxCtx,
-                                                       pxTxBuff->payload,
-                                                       usTxLen,
-                                                       pxRxBuff->payload,
-                                                       usRxLen );
-                }
+                xStats.ulRxFrames++;
+                xStats.ullRxBytes += usRxLen;
             }
         }
-        else
-        {
-            LogDebug( "Timed out while waiting for flow event." );
-            xResult = pdFALSE;
-        }
+    }
+    else
+    {
+        LogDebug( "Timed out while waiting for flow event." );
+        xResult = pdFALSE;
+    }
+
+    /* Set CS / NSS high (idle) */
+    vGpioSet( pxCtx->gpio_nss );
 
-        /* Set CS / NSS high (idle) */
-        vGpioSet( pxCtx->gpio_nss );
+    vTraceRecEnd( TraceRecSliceSpi, *pulBytesMoved );
+    vLowPowerRelease();
 
-        if( pxTxBuff != NULL )
+    xStats.ulTransactions++;
+
+    if( xResult != pdTRUE )
+    {
+        xStats.ulTransactionErrors++;
+    }
+
+    if( pxTxBuff != NULL )
+    {
+        /* Decrement TX packets waiting counter */
+        uint32_t ulTxPacketsWaiting = Atomic_Decrement_u32( &( pxCtx->ulTxPacketsWaiting ) ) - 1;
+
+        /* Let lwIP retry any segment refused while the queue was full */
+        prvLinkOutputResume( &( pxCtx->xTxBackpressure ), ulTxPacketsWaiting );
+
+        /* Free the TX buffer */
+        LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
+        PBUF_FREE( pxTxBuff );
+        pxTxBuff = NULL;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( pxRxBuff != NULL ) )
+    {
+        vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
+    }
+    else if( pxRxBuff != NULL )
+    {
+        LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
+        PBUF_FREE( pxRxBuff );
+        pxRxBuff = NULL;
+    }
+
+    configASSERT( pxTxBuff == NULL );
+    configASSERT( pxRxBuff == NULL );
+
+    return xResult;
+}
+
+void RAMFUNC vDataplaneThread( void * pvParameters )
+{
+    /* Get context struct (contains instance parameters) */
+    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
+
+    BaseType_t exitFlag = pdFALSE;
+
+    /* Export context for callbacks */
+    pxSpiCtx = pxCtx;
+
+    vStatsInitCycleCounter();
+
+    vInitCallbacks( pxCtx );
+
+    /* set CS/NSS high */
+    vGpioSet( pxCtx->gpio_nss );
+
+    /* Do hardware reset */
+    vDoHardReset( pxCtx );
+
+    vBootPhaseMark( BOOT_PHASE_MX_RESET );
+
+    if( pxCtx->xNetTaskHandle != NULL )
+    {
+        ( void ) xTaskNotifyIndexed( pxCtx->xNetTaskHandle, NET_EVT_IDX, NET_MX_READY_BIT, eSetBits );
+    }
+
+    ( void ) memset( &( pxCtx->xRxPool ), 0, sizeof( MxRxPbufPool_t ) );
+    vRxPoolRefill( pxCtx );
+
+    while( exitFlag == pdFALSE )
+    {
+        uint32_t ulBurstFrames = 0;
+        uint32_t ulBurstBytes = 0;
+
+        if( xDataPending( pxCtx ) == pdFALSE )
         {
-            /* Decrement TX packets waiting counter */
-            ( void ) Atomic_Decrement_u32( &( pxSpiCtx->ulTxPacketsWaiting ) );
+            uint32_t ulWaitingBits = 0;
+            uint32_t ulWaitCycles;
 
-            /* Free the TX buffer */
-            LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
-            PBUF_FREE( pxTxBuff );
-            pxTxBuff = NULL;
+            /* Retry any refill that failed earlier due to pool pressure */
+            vRxPoolRefill( pxCtx );
+
+            LogDebug( "Starting wait for DATA_WAITING_IDX event" );
+
+            /*
+             * Block until the notify pin interrupt, a dataplane enqueue or a control plane enqueue
+             * sets one of the DATA_WAITING_* bits. Any bits set while the previous burst was in
+             * progress cause this wait to return immediately, so no event can be missed.
+             */
+            ulWaitCycles = ulStatsGetCycles();
+
+            ( void ) xTaskNotifyWaitIndexed( DATA_WAITING_IDX,
+                                             0x0,
+                                             0xFFFFFFFF,
+                                             &ulWaitingBits,
+                                             portMAX_DELAY );
+
+            if( ( ulWaitingBits & DATA_WAITING_SNOTIFY ) != 0 )
+            {
+                vStatsRecordEdgeLatency( &( xStats.xNotifyLatency ), pxCtx->gpio_notify->xPinMask, ulWaitCycles );
+            }
+
+            LogDebug( "Dataplane wakeup. Notify: %d, Control: %d, Data: %d",
+                      ( ulWaitingBits & DATA_WAITING_SNOTIFY ) != 0,
+                      ( ulWaitingBits & DATA_WAITING_CONTROL ) != 0,
+                      ( ulWaitingBits & DATA_WAITING_DATA ) != 0 );
         }
 
-        if( ( xResult == pdTRUE ) &&
-            ( pxRxBuff != NULL ) )
+        /*
+         * Run back-to-back transactions while the module or the TX queues have data waiting.
+         * Bound the burst so that a continuous stream of traffic cannot starve the idle-time
+         * bookkeeping above.
+         */
+        while( ( ulBurstFrames < MX_DATAPLANE_BURST_MAX_FRAMES ) &&
+               ( ulBurstBytes < MX_DATAPLANE_BURST_MAX_BYTES ) &&
+               ( xDataPending( pxCtx ) == pdTRUE ) )
         {
-            vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
+            uint32_t ulBytesMoved = 0;
+
+            if( xDoTransaction( pxCtx, &ulBytesMoved ) == pdFALSE )
+            {
+                break;
+            }
+
+            ulBurstFrames++;
+            ulBurstBytes += ulBytesMoved;
+
+            /* Replace any consumed rx buffers while NSS is idle */
+            vRxPoolRefill( pxCtx );
         }
-        else if( pxRxBuff != NULL )
+
+        if( ulBurstFrames > 1 )
         {
-            LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
-            PBUF_FREE( pxRxBuff );
-            pxRxBuff = NULL;
+            LogDebug( "Completed burst of %d frames, %d bytes.", ulBurstFrames, ulBurstBytes );
         }
-
-        configASSERT( pxTxBuff == NULL );
-        configASSERT( pxRxBuff == NULL );
     }
 }
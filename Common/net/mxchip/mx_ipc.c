@@ -32,6 +32,7 @@
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "message_buffer.h"
+#include "static_alloc.h"
 #include "netif/ethernet.h"
 #include "string.h"
 #include "atomic.h"
@@ -109,13 +110,13 @@ static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
     /* Wait for a context to become available, then take a token from xContextCountSemaphore */
     xResult = xSemaphoreTake( xContextCountSemaphore, xTimeout );
 
-    configASSERT( xResult == pdTRUE );
-
     configASSERT( xContextArrayMutex != NULL );
 
-    xResult = xSemaphoreTake( xContextArrayMutex, xTimeout );
-
-    if( xResult == pdTRUE )
+    if( xResult != pdTRUE )
+    {
+        LogError( "Timed out while waiting for an available IPCRequestCtx." );
+    }
+    else if( xSemaphoreTake( xContextArrayMutex, xTimeout ) == pdTRUE )
     {
         for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
         {
@@ -128,12 +129,14 @@ static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
                 if( pxRequestCtx->pxRxPbuf != NULL )
                 {
                     PBUF_FREE( pxRequestCtx->pxRxPbuf );
+                    pxRequestCtx->pxRxPbuf = NULL;
                     LogWarn( "pxRxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
                 }
 
                 if( pxRequestCtx->pxTxPbuf != NULL )
                 {
                     PBUF_FREE( pxRequestCtx->pxTxPbuf );
+                    pxRequestCtx->pxTxPbuf = NULL;
                     LogWarn( "pxTxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
                 }
 
@@ -153,10 +156,16 @@ static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
         xResult = xSemaphoreGive( xContextArrayMutex );
 
         configASSERT( xResult == pdTRUE );
+
+        /* A token was available so at least one context must have been free */
+        configASSERT( pxRequestCtx != NULL );
     }
     else
     {
         LogError( "Timed out while acquiring xContextArrayMutex." );
+
+        /* Return the token taken above */
+        ( void ) xSemaphoreGive( xContextCountSemaphore );
     }
 
     return pxRequestCtx;
@@ -173,7 +182,14 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     /* Validate inputs */
     configASSERT( pxTxPkt != NULL );
 
-    configASSERT( ulTxPacketDataLen <= sizeof( IPCPacketData_t ) );
+    #if ( MX_NET_OFFLOAD == 1 )
+        /* Socket sends are followed by their data */
+        configASSERT( ( ulTxPacketDataLen <= sizeof( IPCPacketData_t ) ) ||
+                      ( ( pxTxPkt->xHeader.usIPCApiId == IPC_SOCKET_SEND ) &&
+                        ( ulTxPacketDataLen <= sizeof( IPCRequestSocketSend_t ) + MX_SOCKET_IO_MAX ) ) );
+    #else
+        configASSERT( ulTxPacketDataLen <= sizeof( IPCPacketData_t ) );
+    #endif
 
     configASSERT( ( pxResponse != NULL && ulResponseLength > 0 ) ||
                   ( pxResponse == NULL && ulResponseLength == 0 ) );
@@ -184,19 +200,27 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     /* Allocate a request context */
     IPCRequestCtx_t * pxRequestCtx = pxFindAvailableCtx( xTimeout, ulTxPacketLen );
 
-    LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, pktdatalen: %d, total_len: %d",
-              pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketDataLen, ulTxPacketLen );
-
     if( pxRequestCtx == NULL )
     {
         LogError( "Timed out while finding a request context." );
         xReturnValue = IPC_ERROR_INTERNAL;
     }
+    else if( pxRequestCtx->pxTxPbuf == NULL )
+    {
+        LogError( "Failed to allocate a pbuf for IPC request." );
+        xReturnValue = IPC_NO_MEMORY;
+    }
     else
     {
+        LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, pktdatalen: %d, total_len: %d",
+                  pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketDataLen, ulTxPacketLen );
+
         /* Set request ID */
         pxTxPkt->xHeader.ulIPCRequestId = pxRequestCtx->ulRequestID;
 
+        /* Discard any stale response notification left over from an earlier timed out request */
+        ( void ) xTaskNotifyStateClearIndexed( NULL, IPC_RESPONSE_IDX );
+
         /* Set task handle */
         pxRequestCtx->xWaitingTask = xTaskGetCurrentTaskHandle();
 
@@ -205,15 +229,17 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
 
         configASSERT( pxControlPlaneCtx->xControlPlaneSendQueue != NULL );
 
+        /* Counted first, the dataplane thread may take the packet as soon as it is queued */
+        ( void ) Atomic_Increment_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
+
         /* Send to dataplane thread for transmission */
         xResult = xQueueSend( pxControlPlaneCtx->xControlPlaneSendQueue,
                               &( pxRequestCtx->pxTxPbuf ),
                               xTimeout );
 
-        Atomic_Increment_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
-
         if( xResult != pdTRUE )
         {
+            ( void ) Atomic_Decrement_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
             LogError( "Error when sending message with request id=%d", pxRequestCtx->ulRequestID );
             xReturnValue = IPC_ERROR_INTERNAL;
         }
@@ -225,7 +251,10 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
             configASSERT( pxControlPlaneCtx->xDataPlaneTaskHandle != NULL );
 
             /* Notify dataplane thread of a waiting message */
-            xTaskNotifyGiveIndexed( pxControlPlaneCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
+            ( void ) xTaskNotifyIndexed( pxControlPlaneCtx->xDataPlaneTaskHandle,
+                                         DATA_WAITING_IDX,
+                                         DATA_WAITING_CONTROL,
+                                         eSetBits );
         }
     }
 
@@ -235,9 +264,15 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     if( xResult == pdTRUE )
     {
         /* Wait for notification */
-        xResult = xTaskNotifyWait( 0, 0, NULL, xTimeout );
+        xResult = xTaskNotifyWaitIndexed( IPC_RESPONSE_IDX, 0, 0, NULL, xTimeout );
+
+        /* Detach from the context so that a late response is dropped by the router */
+        ( void ) xSemaphoreTake( xContextArrayMutex, portMAX_DELAY );
+        pxRequestCtx->xWaitingTask = NULL;
+        ( void ) xSemaphoreGive( xContextArrayMutex );
 
-        if( xResult == pdTRUE )
+        if( ( xResult == pdTRUE ) &&
+            ( pxRequestCtx->pxRxPbuf != NULL ) )
         {
             pxResponsePacket = ( IPCPacket_t * ) pxRequestCtx->pxRxPbuf->payload;
         }
@@ -245,14 +280,30 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
         {
             xReturnValue = IPC_TIMEOUT;
         }
-
-        pxRequestCtx->xWaitingTask = NULL;
     }
 
     if( ( pxResponsePacket != NULL ) &&
         ( ulResponseLength > 0 ) &&
         ( pxResponse != NULL ) )
     {
+        uint32_t ulRxDataLen = 0;
+
+        if( pxRequestCtx->pxRxPbuf->tot_len > sizeof( IPCHeader_t ) )
+        {
+            ulRxDataLen = pxRequestCtx->pxRxPbuf->tot_len - sizeof( IPCHeader_t );
+        }
+
+        /* Do not read past the end of a short response, socket receives are as long as the data received */
+        if( ulResponseLength > ulRxDataLen )
+        {
+            if( pxResponsePacket->xHeader.usIPCApiId != IPC_SOCKET_RECV )
+            {
+                LogWarn( "Response length %d is shorter than the expected length %d.", ulRxDataLen, ulResponseLength );
+            }
+
+            ulResponseLength = ulRxDataLen;
+        }
+
         ( void ) memcpy( pxResponse, &( pxResponsePacket->xData ), ulResponseLength );
     }
 
@@ -326,9 +377,12 @@ IPCError_t mx_GetMacAddress( MacAddress_t * pxMacAddress,
     return xReturnValue;
 }
 
-IPCError_t mx_Connect( const char * pcSSID,
-                       const char * pcPSK,
-                       TickType_t xTimeout )
+static IPCError_t prvConnect( const char * pcSSID,
+                              const char * pcPSK,
+                              const struct eth_addr * pxBssid,
+                              uint8_t ucChannel,
+                              uint8_t ucSecurity,
+                              TickType_t xTimeout )
 {
     IPCError_t xReturnValue = IPC_SUCCESS;
 
@@ -365,13 +419,21 @@ IPCError_t mx_Connect( const char * pcSSID,
 
         xTxPkt.xHeader.usIPCApiId = IPC_WIFI_CONNECT;
 
-        xTxPkt.xData.xRequestWifiConnect.ucUseAttr = pdFALSE;
+        xTxPkt.xData.xRequestWifiConnect.ucUseAttr = ( pxBssid != NULL ) ? pdTRUE : pdFALSE;
         xTxPkt.xData.xRequestWifiConnect.ucUseStaticIp = pdFALSE;
-        xTxPkt.xData.xRequestWifiConnect.ucAccessPointChannel = 0;
-        xTxPkt.xData.xRequestWifiConnect.ucSecurityType = 0;
+        xTxPkt.xData.xRequestWifiConnect.ucAccessPointChannel = ucChannel;
+        xTxPkt.xData.xRequestWifiConnect.ucSecurityType = ucSecurity;
 
-        ( void ) memset( &( xTxPkt.xData.xRequestWifiConnect.ucAccessPointBssid ),
-                         0, MX_BSSID_LEN );
+        if( pxBssid != NULL )
+        {
+            ( void ) memcpy( &( xTxPkt.xData.xRequestWifiConnect.ucAccessPointBssid ),
+                             pxBssid, MX_BSSID_LEN );
+        }
+        else
+        {
+            ( void ) memset( &( xTxPkt.xData.xRequestWifiConnect.ucAccessPointBssid ),
+                             0, MX_BSSID_LEN );
+        }
         ( void ) memset( &( xTxPkt.xData.xRequestWifiConnect.xStaticIpInfo ),
                          0, sizeof( IPInfoType_t ) );
 
@@ -401,6 +463,69 @@ IPCError_t mx_Connect( const char * pcSSID,
     return xReturnValue;
 }
 
+IPCError_t mx_Connect( const char * pcSSID,
+                       const char * pcPSK,
+                       TickType_t xTimeout )
+{
+    return prvConnect( pcSSID, pcPSK, NULL, 0, 0, xTimeout );
+}
+
+IPCError_t mx_ConnectBssid( const char * pcSSID,
+                            const char * pcPSK,
+                            const struct eth_addr * pxBssid,
+                            uint8_t ucChannel,
+                            uint8_t ucSecurity,
+                            TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_PARAMETER_ERROR;
+
+    if( pxBssid != NULL )
+    {
+        xReturnValue = prvConnect( pcSSID, pcPSK, pxBssid, ucChannel, ucSecurity, xTimeout );
+    }
+
+    return xReturnValue;
+}
+
+IPCError_t mx_GetLinkInfo( MxLinkInfo_t * pxLinkInfo,
+                           TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_PARAMETER_ERROR;
+
+    if( pxLinkInfo != NULL )
+    {
+        IPCPacket_t xTxPkt;
+        IPCResponseWifiGetLinkInfo_t xResponse;
+
+        ( void ) memset( &xResponse, 0, sizeof( IPCResponseWifiGetLinkInfo_t ) );
+
+        xTxPkt.xHeader.usIPCApiId = IPC_WIFI_GET_LINKINFO;
+
+        xReturnValue = xSendIPCRequest( &xTxPkt,
+                                        0,
+                                        ( IPCPacketData_t * ) &xResponse,
+                                        sizeof( IPCResponseWifiGetLinkInfo_t ),
+                                        xTimeout );
+
+        /* A short response leaves the remaining fields zeroed */
+        if( ( xReturnValue == IPC_SUCCESS ) &&
+            ( ( xResponse.lStatus != 0 ) || ( xResponse.lIsConnected == 0 ) ) )
+        {
+            xReturnValue = IPC_ERROR;
+        }
+
+        if( xReturnValue == IPC_SUCCESS )
+        {
+            ( void ) memcpy( &( pxLinkInfo->xBssid ), xResponse.ucBssid, MX_BSSID_LEN );
+            pxLinkInfo->ucChannel = xResponse.ucChannel;
+            pxLinkInfo->ucSecurity = ( uint8_t ) xResponse.lSecurity;
+            pxLinkInfo->lRssi = xResponse.lRssi;
+        }
+    }
+
+    return xReturnValue;
+}
+
 IPCError_t mx_Disconnect( TickType_t xTimeout )
 {
     IPCError_t xReturnValue = IPC_SUCCESS;
@@ -460,10 +585,265 @@ IPCError_t mx_RegisterEventCallback( MxEventCallback_t xCallback,
     return xError;
 }
 
+#if ( MX_NET_OFFLOAD == 1 )
+
+/* Send a socket request without trailing data and return the result or -1 */
+    static int32_t prvSocketRequest( IPCPacket_t * pxTxPkt,
+                                     uint32_t ulTxPacketDataLen )
+    {
+        IPCResponseSocketResult_t xResponse = { .lResult = -1 };
+
+        if( xSendIPCRequest( pxTxPkt, ulTxPacketDataLen,
+                             &xResponse, sizeof( IPCResponseSocketResult_t ),
+                             pdMS_TO_TICKS( MX_SOCKET_REQUEST_TIMEOUT_MS ) ) != IPC_SUCCESS )
+        {
+            xResponse.lResult = -1;
+        }
+
+        return xResponse.lResult;
+    }
+
+    int32_t mx_socket( int32_t lDomain,
+                       int32_t lType,
+                       int32_t lProtocol )
+    {
+        IPCPacket_t xTxPkt;
+
+        xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_CREATE;
+        xTxPkt.xData.xRequestSocketCreate.lDomain = lDomain;
+        xTxPkt.xData.xRequestSocketCreate.lType = lType;
+        xTxPkt.xData.xRequestSocketCreate.lProtocol = lProtocol;
+
+        return prvSocketRequest( &xTxPkt, sizeof( IPCRequestSocketCreate_t ) );
+    }
+
+    int32_t mx_connect( int32_t lSocket,
+                        const struct sockaddr * pxAddr,
+                        uint32_t ulAddrLen )
+    {
+        IPCPacket_t xTxPkt;
+        int32_t lResult = -1;
+
+        if( ( pxAddr != NULL ) && ( ulAddrLen <= MX_SOCKADDR_LEN ) )
+        {
+            xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_CONNECT;
+            xTxPkt.xData.xRequestSocketConnect.lSocket = lSocket;
+            ( void ) memset( xTxPkt.xData.xRequestSocketConnect.ucAddr, 0, MX_SOCKADDR_LEN );
+            ( void ) memcpy( xTxPkt.xData.xRequestSocketConnect.ucAddr, pxAddr, ulAddrLen );
+            xTxPkt.xData.xRequestSocketConnect.ulAddrLen = ulAddrLen;
+
+            lResult = prvSocketRequest( &xTxPkt, sizeof( IPCRequestSocketConnect_t ) );
+        }
+
+        return lResult;
+    }
+
+    int32_t mx_setsockopt( int32_t lSocket,
+                           int32_t lLevel,
+                           int32_t lName,
+                           const void * pvValue,
+                           uint32_t ulLen )
+    {
+        IPCPacket_t xTxPkt;
+        int32_t lResult = -1;
+
+        if( ( pvValue != NULL ) && ( ulLen <= MX_SOCKOPT_MAX_LEN ) )
+        {
+            xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_SETSOCKOPT;
+            xTxPkt.xData.xRequestSocketSetOpt.lSocket = lSocket;
+            xTxPkt.xData.xRequestSocketSetOpt.lLevel = lLevel;
+            xTxPkt.xData.xRequestSocketSetOpt.lName = lName;
+            xTxPkt.xData.xRequestSocketSetOpt.ulLen = ulLen;
+            ( void ) memcpy( xTxPkt.xData.xRequestSocketSetOpt.ucValue, pvValue, ulLen );
+
+            lResult = prvSocketRequest( &xTxPkt, sizeof( IPCRequestSocketSetOpt_t ) );
+        }
+
+        return lResult;
+    }
+
+    int32_t mx_send( int32_t lSocket,
+                     const void * pvBuffer,
+                     size_t uxLen,
+                     int32_t lFlags )
+    {
+        const size_t uxChunk = ( uxLen < MX_SOCKET_IO_MAX ) ? uxLen : MX_SOCKET_IO_MAX;
+        const size_t uxPktLen = sizeof( IPCHeader_t ) + sizeof( IPCRequestSocketSend_t ) + uxChunk;
+        IPCPacket_t * pxTxPkt = NULL;
+        int32_t lResult = -1;
+
+        /* Larger than IPCPacket_t, the request is built on the heap */
+        if( ( pvBuffer != NULL ) &&
+            ( ( pxTxPkt = pvPortMalloc( ( uxPktLen > sizeof( IPCPacket_t ) ) ? uxPktLen : sizeof( IPCPacket_t ) ) ) != NULL ) )
+        {
+            IPCRequestSocketSend_t * pxRequest = ( IPCRequestSocketSend_t * ) &( pxTxPkt->xData );
+
+            pxTxPkt->xHeader.usIPCApiId = IPC_SOCKET_SEND;
+            pxRequest->lSocket = lSocket;
+            pxRequest->ulLen = ( uint32_t ) uxChunk;
+            pxRequest->lFlags = lFlags;
+            ( void ) memcpy( &( pxRequest[ 1 ] ), pvBuffer, uxChunk );
+
+            lResult = prvSocketRequest( pxTxPkt, ( uint32_t ) ( sizeof( IPCRequestSocketSend_t ) + uxChunk ) );
+
+            vPortFree( pxTxPkt );
+        }
+
+        return lResult;
+    }
+
+    int32_t mx_recv( int32_t lSocket,
+                     void * pvBuffer,
+                     size_t uxLen,
+                     int32_t lFlags )
+    {
+        const size_t uxChunk = ( uxLen < MX_SOCKET_IO_MAX ) ? uxLen : MX_SOCKET_IO_MAX;
+        IPCResponseSocketRecv_t * pxResponse = NULL;
+        IPCPacket_t xTxPkt;
+        int32_t lResult = -1;
+
+        if( ( pvBuffer != NULL ) &&
+            ( ( pxResponse = pvPortMalloc( sizeof( IPCResponseSocketRecv_t ) + uxChunk ) ) != NULL ) )
+        {
+            xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_RECV;
+            xTxPkt.xData.xRequestSocketRecv.lSocket = lSocket;
+            xTxPkt.xData.xRequestSocketRecv.ulLen = ( uint32_t ) uxChunk;
+            xTxPkt.xData.xRequestSocketRecv.lFlags = lFlags;
+
+            pxResponse->lResult = -1;
+
+            if( xSendIPCRequest( &xTxPkt, sizeof( IPCRequestSocketRecv_t ),
+                                 pxResponse, ( uint32_t ) ( sizeof( IPCResponseSocketRecv_t ) + uxChunk ),
+                                 pdMS_TO_TICKS( MX_SOCKET_REQUEST_TIMEOUT_MS ) ) == IPC_SUCCESS )
+            {
+                lResult = pxResponse->lResult;
+            }
+
+            if( lResult > ( int32_t ) uxChunk )
+            {
+                lResult = -1;
+            }
+            else if( lResult > 0 )
+            {
+                ( void ) memcpy( pvBuffer, &( pxResponse[ 1 ] ), ( size_t ) lResult );
+            }
+            else
+            {
+                /* Closed by the peer, timed out or failed */
+            }
+
+            vPortFree( pxResponse );
+        }
+
+        return lResult;
+    }
+
+    int32_t mx_close( int32_t lSocket )
+    {
+        IPCPacket_t xTxPkt;
+
+        xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_CLOSE;
+        xTxPkt.xData.xRequestSocketClose.lSocket = lSocket;
+
+        return prvSocketRequest( &xTxPkt, sizeof( IPCRequestSocketClose_t ) );
+    }
+
+    int32_t mx_gethostbyname( const char * pcHostName,
+                              uint32_t * pulAddr )
+    {
+        IPCPacket_t xTxPkt;
+        IPCResponseSocketGetHostByName_t xResponse = { .lStatus = -1 };
+        int32_t lResult = -1;
+
+        if( ( pcHostName != NULL ) && ( pulAddr != NULL ) &&
+            ( strnlen( pcHostName, MX_HOSTNAME_LEN ) < MX_HOSTNAME_LEN ) )
+        {
+            xTxPkt.xHeader.usIPCApiId = IPC_SOCKET_GETHOSTBYNAME;
+            ( void ) strncpy( xTxPkt.xData.xRequestSocketGetHostByName.cName, pcHostName, MX_HOSTNAME_LEN );
+
+            if( ( xSendIPCRequest( &xTxPkt, sizeof( IPCRequestSocketGetHostByName_t ),
+                                   &xResponse, sizeof( IPCResponseSocketGetHostByName_t ),
+                                   pdMS_TO_TICKS( MX_SOCKET_REQUEST_TIMEOUT_MS ) ) == IPC_SUCCESS ) &&
+                ( xResponse.lStatus == 0 ) &&
+                ( xResponse.ulAddr != 0 ) )
+            {
+                *pulAddr = xResponse.ulAddr;
+                lResult = 0;
+            }
+        }
+
+        return lResult;
+    }
+
+#endif /* MX_NET_OFFLOAD == 1 */
+
+/*
+ * @brief Hand a control plane response directly to the IPCRequestCtx_t waiting for it.
+ *
+ * Ownership of pxRxPbuf is transferred to the request context on success, so the
+ * response is neither copied nor reference counted on its way to the waiting task.
+ *
+ * @return pdTRUE if the response was delivered, pdFALSE if the caller still owns pxRxPbuf.
+ */
+BaseType_t prvxDeliverIPCResponse( PacketBuffer_t * pxRxPbuf )
+{
+    BaseType_t xDelivered = pdFALSE;
+    IPCPacket_t * pxRxPacket = NULL;
+
+    configASSERT( pxRxPbuf != NULL );
+
+    pxRxPacket = ( IPCPacket_t * ) pxRxPbuf->payload;
+
+    if( xContextArrayMutex == NULL )
+    {
+        LogError( "Received a response before the ControlPlaneRouter task was started." );
+    }
+    else if( xSemaphoreTake( xContextArrayMutex, MX_DEFAULT_TIMEOUT_TICK ) != pdTRUE )
+    {
+        LogError( "Timed out while acquiring xContextArrayMutex." );
+    }
+    else
+    {
+        IPCRequestCtx_t * pxTargetCtx = NULL;
+
+        for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
+        {
+            if( xIPCRequestCtxArray[ i ].ulRequestID == pxRxPacket->xHeader.ulIPCRequestId )
+            {
+                pxTargetCtx = &xIPCRequestCtxArray[ i ];
+                break;
+            }
+        }
+
+        /* Send packet to waiting thread */
+        if( ( pxTargetCtx != NULL ) &&
+            ( pxTargetCtx->pxRxPbuf == NULL ) &&
+            ( pxTargetCtx->xWaitingTask != NULL ) )
+        {
+            LogDebug( "Notifying waiting task %d of RX packet.", pxTargetCtx->xWaitingTask );
+            pxTargetCtx->pxRxPbuf = pxRxPbuf;
+
+            ( void ) xTaskNotifyIndexed( pxTargetCtx->xWaitingTask, IPC_RESPONSE_IDX, 0, eNoAction );
+
+            xDelivered = pdTRUE;
+        }
+        else
+        {
+            LogWarn( "Dropping response packet with AppId: %d and RequestId: %d",
+                     pxRxPacket->xHeader.usIPCApiId,
+                     pxRxPacket->xHeader.ulIPCRequestId );
+        }
+
+        /* Return the mutex */
+        ( void ) xSemaphoreGive( xContextArrayMutex );
+    }
+
+    return xDelivered;
+}
+
 /*
- * Serialize and pack control plane requests to module.
- * Block until callback has succeeded and is done with buffer
- * Needed for multiple concurrent control plane messages to be outstanding.
+ * Dispatch asynchronous event messages from the module to the registered MxEventCallback_t.
+ * Responses to IPC requests are handed to the waiting task by prvxDeliverIPCResponse.
  */
 void prvControlPlaneRouter( void * pvParameters )
 {
@@ -473,9 +853,9 @@ void prvControlPlaneRouter( void * pvParameters )
     /* Export context to other functions in this file */
     pxControlPlaneCtx = pxCtx;
 
-    xContextArrayMutex = xSemaphoreCreateMutex();
+    xContextArrayMutex = xAppSemaphoreCreateMutex();
 
-    xContextCountSemaphore = xSemaphoreCreateCounting( NUM_IPC_REQUEST_CTX, NUM_IPC_REQUEST_CTX );
+    xContextCountSemaphore = xAppSemaphoreCreateCounting( NUM_IPC_REQUEST_CTX, NUM_IPC_REQUEST_CTX );
 
     /* lock mutex, non-blocking */
     BaseType_t xResult = xSemaphoreTake( xContextArrayMutex, 0 );
@@ -508,15 +888,10 @@ void prvControlPlaneRouter( void * pvParameters )
         {
             IPCPacket_t * pxRxPacket = ( IPCPacket_t * ) pxRxPbuf->payload;
 
-            char ucPrintBuf[ pxRxPbuf->tot_len * 2 + 1 ];
-
-            for( uint32_t i = 0; i < pxRxPbuf->tot_len; i++ )
-            {
-                snprintf( &ucPrintBuf[ 2 * i ], 3, "%02X", ( ( uint8_t * ) pxRxPbuf->payload )[ i ] );
-            }
-
-            ucPrintBuf[ pxRxPbuf->tot_len * 2 ] = 0;
-            LogDebug( "%s", ucPrintBuf );
+            LogDebug( "Received control plane message. AppId: %d, RequestId: %d, len: %d",
+                      pxRxPacket->xHeader.usIPCApiId,
+                      pxRxPacket->xHeader.ulIPCRequestId,
+                      pxRxPbuf->tot_len );
 
             /* Check if message is a notification */
             if( pxRxPacket->xHeader.ulIPCRequestId == 0 )
@@ -531,61 +906,21 @@ void prvControlPlaneRouter( void * pvParameters )
                              pxRxPacket->xHeader.usIPCApiId );
                 }
             }
-            /* Otherwise, message is a response, find the relevant IPCRequestCtx to send the packet to */
+            /* Responses are normally delivered by the dataplane thread, handle any stragglers here */
+            else if( prvxDeliverIPCResponse( pxRxPbuf ) == pdTRUE )
+            {
+                pxRxPbuf = NULL;
+            }
             else
             {
-                /* Wait for xContextArrayMutex */
-                xResult = xSemaphoreTake( xContextArrayMutex, portMAX_DELAY );
-
-                configASSERT( xResult == pdTRUE );
-
-                IPCRequestCtx_t * pxTargetCtx = NULL;
-
-                for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
-                {
-                    if( xIPCRequestCtxArray[ i ].ulRequestID == pxRxPacket->xHeader.ulIPCRequestId )
-                    {
-                        pxTargetCtx = &xIPCRequestCtxArray[ i ];
-                        break;
-                    }
-                }
-
-                /* Send packet to waiting thread */
-                if( ( pxTargetCtx != NULL ) &&
-                    ( pxTargetCtx->pxRxPbuf == NULL ) &&
-                    ( pxTargetCtx->xWaitingTask != NULL ) )
-                {
-                    LogDebug( "Notifying waiting task %d of RX packet.", pxTargetCtx->xWaitingTask );
-                    pxTargetCtx->pxRxPbuf = pxRxPbuf;
-                    xResult = xTaskNotify( pxTargetCtx->xWaitingTask, 0, eNoAction );
-
-                    if( xResult == pdTRUE )
-                    {
-                        /* Increase pbuf reference count */
-                        pbuf_ref( pxRxPbuf );
-                    }
-                    else
-                    {
-                        pxTargetCtx->pxRxPbuf = NULL;
-                        LogError( "Error delivering response message with AppId: %d and RequestId: %d",
-                                  pxRxPacket->xHeader.usIPCApiId,
-                                  pxRxPacket->xHeader.ulIPCRequestId );
-                    }
-                }
-                else
-                {
-                    LogWarn( "Dropping response packet with AppId: %d and RequestId: %d",
-                             pxRxPacket->xHeader.usIPCApiId,
-                             pxRxPacket->xHeader.ulIPCRequestId );
-                }
-
-                /* Return the mutex */
-                xResult = xSemaphoreGive( xContextArrayMutex );
-                configASSERT( xResult == pdTRUE );
+                /* Empty */
             }
 
-            LogDebug( "Decreasing reference count of pxRxPbuf %p from %d to %d", pxRxPbuf, pxRxPbuf->ref, ( pxRxPbuf->ref - 1 ) );
-            PBUF_FREE( pxRxPbuf );
+            if( pxRxPbuf != NULL )
+            {
+                LogDebug( "Decreasing reference count of pxRxPbuf %p from %d to %d", pxRxPbuf, pxRxPbuf->ref, ( pxRxPbuf->ref - 1 ) );
+                PBUF_FREE( pxRxPbuf );
+            }
         }
         else
         {
@@ -59,6 +59,15 @@ typedef enum
 typedef void ( * MxEventCallback_t )( MxStatus_t,
                                       void * );
 
+/* Access point the module is associated with */
+typedef struct
+{
+    struct eth_addr xBssid;
+    uint8_t ucChannel;
+    uint8_t ucSecurity;
+    int32_t lRssi;
+} MxLinkInfo_t;
+
 IPCError_t mx_RequestVersion( char * pcVersionBuffer,
                               uint32_t ulVersionLength,
                               TickType_t xTimeout );
@@ -72,6 +81,17 @@ IPCError_t mx_Connect( const char * pcSSID,
                        const char * pcPSK,
                        TickType_t xTimeout );
 
+/* Associate with the access point pxBssid on ucChannel without scanning for pcSSID */
+IPCError_t mx_ConnectBssid( const char * pcSSID,
+                            const char * pcPSK,
+                            const struct eth_addr * pxBssid,
+                            uint8_t ucChannel,
+                            uint8_t ucSecurity,
+                            TickType_t xTimeout );
+
+IPCError_t mx_GetLinkInfo( MxLinkInfo_t * pxLinkInfo,
+                           TickType_t xTimeout );
+
 IPCError_t mx_Disconnect( TickType_t xTimeout );
 
 IPCError_t mx_SetBypassMode( BaseType_t xEnable,
@@ -80,4 +100,63 @@ IPCError_t mx_SetBypassMode( BaseType_t xEnable,
 IPCError_t mx_RegisterEventCallback( MxEventCallback_t pvCallback,
                                      void * pxCallbackContext );
 
+/*
+ * 1 to leave the module out of bypass mode and use the sockets of its own TCP/IP stack through
+ * the mx_socket calls below, instead of bridging its frames to lwIP.
+ */
+#ifndef MX_NET_OFFLOAD
+    #define MX_NET_OFFLOAD    0
+#endif
+
+#if ( MX_NET_OFFLOAD == 1 )
+    #include <stddef.h>
+    #include "lwip/sockets.h"
+
+/* Largest send or receive of a single request, longer calls return a partial count */
+    #ifndef MX_SOCKET_IO_MAX
+        #define MX_SOCKET_IO_MAX    1460
+    #endif
+
+/* Time a request waits for the module, longer than any socket timeout set with mx_setsockopt */
+    #ifndef MX_SOCKET_REQUEST_TIMEOUT_MS
+        #define MX_SOCKET_REQUEST_TIMEOUT_MS    ( 60 * 1000 )
+    #endif
+
+/*
+ * Sockets of the module's stack. The arguments and return values follow the BSD calls, with
+ * the lwIP constants and address layout, and -1 on failure. Only blocking TCP client sockets
+ * are supported.
+ */
+    int32_t mx_socket( int32_t lDomain,
+                       int32_t lType,
+                       int32_t lProtocol );
+
+    int32_t mx_connect( int32_t lSocket,
+                        const struct sockaddr * pxAddr,
+                        uint32_t ulAddrLen );
+
+    int32_t mx_setsockopt( int32_t lSocket,
+                           int32_t lLevel,
+                           int32_t lName,
+                           const void * pvValue,
+                           uint32_t ulLen );
+
+    int32_t mx_send( int32_t lSocket,
+                     const void * pvBuffer,
+                     size_t uxLen,
+                     int32_t lFlags );
+
+    int32_t mx_recv( int32_t lSocket,
+                     void * pvBuffer,
+                     size_t uxLen,
+                     int32_t lFlags );
+
+    int32_t mx_close( int32_t lSocket );
+
+/* Resolve pcHostName with the module's DNS client, *pulAddr is in network byte order */
+    int32_t mx_gethostbyname( const char * pcHostName,
+                              uint32_t * pulAddr );
+
+#endif /* MX_NET_OFFLOAD == 1 */
+
 #endif /* _MXFREE_IPC_ */
@@ -33,34 +33,100 @@
 #include "atomic.h"
 #include "mx_prv.h"
 
-static void vAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
+#include "lwip/prot/ip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcp_priv.h"
+
+/*
+ * @brief Determine if an outgoing ethernet frame may be sent ahead of bulk traffic.
+ *
+ * Only ARP frames and pure TCP ACKs are prioritized. Frames carrying a TCP payload are never
+ * reordered so that the segments of a given connection are always transmitted in sequence.
+ */
+static BaseType_t xIsPriorityFrame( const PacketBuffer_t * pxPbuf )
 {
+    BaseType_t xPriority = pdFALSE;
+    const uint8_t * pucFrame = ( const uint8_t * ) pxPbuf->payload;
+
+    if( pxPbuf->len >= SIZEOF_ETH_HDR )
+    {
+        const struct eth_hdr * pxEthHeader = ( const struct eth_hdr * ) pucFrame;
+        uint16_t usEthertype = lwip_htons( pxEthHeader->type );
+
+        if( usEthertype == ETHTYPE_ARP )
+        {
+            xPriority = pdTRUE;
+        }
+        else if( ( usEthertype == ETHTYPE_IP ) &&
+                 ( pxPbuf->len >= ( SIZEOF_ETH_HDR + IP_HLEN ) ) )
+        {
+            const struct ip_hdr * pxIpHeader = ( const struct ip_hdr * ) &( pucFrame[ SIZEOF_ETH_HDR ] );
+            uint16_t usIpHeaderLen = IPH_HL_BYTES( pxIpHeader );
+            uint16_t usIpTotalLen = lwip_ntohs( IPH_LEN( pxIpHeader ) );
+
+            if( ( IPH_PROTO( pxIpHeader ) == IP_PROTO_TCP ) &&
+                ( pxPbuf->len >= ( SIZEOF_ETH_HDR + usIpHeaderLen + TCP_HLEN ) ) )
+            {
+                const struct tcp_hdr * pxTcpHeader = ( const struct tcp_hdr * ) &( pucFrame[ SIZEOF_ETH_HDR + usIpHeaderLen ] );
+                uint16_t usTcpHeaderLen = TCPH_HDRLEN_BYTES( pxTcpHeader );
+
+                /* ACK flag only and no payload */
+                if( ( TCPH_FLAGS( pxTcpHeader ) == TCP_ACK ) &&
+                    ( usIpTotalLen == ( usIpHeaderLen + usTcpHeaderLen ) ) )
+                {
+                    xPriority = pdTRUE;
+                }
+            }
+        }
+        else
+        {
+            /* Everything else is treated as bulk traffic */
+        }
+    }
+
+    return xPriority;
+}
+
+/*
+ * @brief Prepend a BypassInOut_t header to the head of an (optionally chained) ethernet frame.
+ *
+ * @return pdTRUE on success, pdFALSE if the head pbuf does not have enough headroom.
+ */
+static BaseType_t xAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
+{
+    BaseType_t xReturn = pdFALSE;
+
     configASSERT( pxTxPacket != NULL );
 
     /* Store length of ethernet frame for BypassInOut_t header */
     uint16_t ulEthPacketLen = pxTxPacket->tot_len;
 
     /* Adjust pbuf size to include BypassInOut_t header */
-    uint8_t cErr = pbuf_header( pxTxPacket, sizeof( BypassInOut_t ) );
-
-    configASSERT( cErr == 0 );
+    if( pbuf_add_header( pxTxPacket, sizeof( BypassInOut_t ) ) == 0 )
+    {
+        /* Add on bypass header */
+        BypassInOut_t * pxBypassHeader = ( BypassInOut_t * ) pxTxPacket->payload;
 
-    /* Add on bypass header */
-    BypassInOut_t * pxBypassHeader = ( BypassInOut_t * ) pxTxPacket->payload;
+        pxBypassHeader->xHeader.usIPCApiId = IPC_WIFI_BYPASS_OUT;
+        pxBypassHeader->xHeader.ulIPCRequestId = prvGetNextRequestID();
 
-    pxBypassHeader->xHeader.usIPCApiId = IPC_WIFI_BYPASS_OUT;
-    pxBypassHeader->xHeader.ulIPCRequestId = prvGetNextRequestID();
+        /* Send to station interface */
+        pxBypassHeader->lIndex = WIFI_BYPASS_MODE_STATION;
 
-    /* Send to station interface */
-    pxBypassHeader->lIndex = WIFI_BYPASS_MODE_STATION;
+        /* Fill pad region with zeros */
+        ( void ) memset( pxBypassHeader->ucPad, 0, MX_BYPASS_PAD_LEN );
 
-    /* Fill pad region with zeros */
-    ( void ) memset( pxBypassHeader->ucPad, 0, MX_BYPASS_PAD_LEN );
+        /* Set length field */
+        pxBypassHeader->usDataLen = ulEthPacketLen;
 
-    /* Set length field */
-    pxBypassHeader->usDataLen = ulEthPacketLen;
+        xReturn = pdTRUE;
+    }
 
     configASSERT( pxTxPacket->ref >= 1 );
+
+    return xReturn;
 }
 
 /* Callback for lwip netif events
@@ -124,29 +190,46 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
     err_t xError = ERR_OK;
     BaseType_t xReturn = pdFALSE;
     struct pbuf * pxPbufToSend = pxPbuf;
+    BaseType_t xPriority = pdFALSE;
 
     if( ( pxPbuf == NULL ) || ( pxNetif == NULL ) )
     {
         xError = ERR_VAL;
     }
-    /* Handle any chained packets */
-    else if( ( pxPbuf->len != pxPbuf->tot_len ) ||
-             ( pxPbuf->next != NULL ) )
+    else
     {
-        pxPbufToSend = pbuf_clone( PBUF_RAW, PBUF_RAM, pxPbuf );
+        /* Classify the frame before the bypass header is prepended */
+        xPriority = xIsPriorityFrame( pxPbuf );
+
+        /*
+         * Chained pbufs are queued as-is and streamed segment by segment by the dataplane thread.
+         * Increment the reference counter so the chain outlives the current function.
+         */
+        pbuf_ref( pxPbufToSend );
 
-        if( pxPbufToSend == NULL )
+        if( xAddMXHeaderToEthernetFrame( pxPbufToSend ) != pdTRUE )
         {
-            xError = ERR_MEM;
-        }
+            /* No headroom in the head pbuf (ie. PBUF_REF or PBUF_ROM). Fall back to a copy. */
+            PBUF_FREE( pxPbufToSend );
 
-        /* Input buffer will be freed by lwip after the current function returns */
-        /* pbuf_clone sets the refcount = 1 upon creation */
-    }
-    else
-    {
-        /* Increment reference counter */
-        pbuf_ref( pxPbufToSend );
+            /* pbuf_clone sets the refcount = 1 upon creation */
+            pxPbufToSend = pbuf_clone( PBUF_RAW_TX, PBUF_RAM, pxPbuf );
+
+            if( pxPbufToSend == NULL )
+            {
+                xError = ERR_MEM;
+            }
+            else if( xAddMXHeaderToEthernetFrame( pxPbufToSend ) != pdTRUE )
+            {
+                PBUF_FREE( pxPbufToSend );
+                pxPbufToSend = NULL;
+                xError = ERR_BUF;
+            }
+            else
+            {
+                /* Input buffer will be freed by lwip after the current function returns */
+            }
+        }
     }
 
 /*    vPrintBuffer("ETH_TX", pxPbuf->payload, pxPbuf->tot_len ); */
@@ -154,42 +237,99 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
     /* Get context from netif struct */
     MxNetConnectCtx_t * pxCtx = ( MxNetConnectCtx_t * ) pxNetif->state;
 
-    if( xError == ERR_OK )
-    {
-        vAddMXHeaderToEthernetFrame( pxPbuf );
-    }
-
     configASSERT( pxCtx->xDataPlaneSendQueue != NULL );
+    configASSERT( pxCtx->xDataPlanePrioritySendQueue != NULL );
     configASSERT( pxCtx->pulTxPacketsWaiting != NULL );
+    configASSERT( pxCtx->pxTxBackpressure != NULL );
     configASSERT( pxCtx->xDataPlaneTaskHandle != NULL );
 
     if( xError == ERR_OK )
     {
+        QueueHandle_t xTargetQueue = ( xPriority == pdTRUE ) ? pxCtx->xDataPlanePrioritySendQueue : pxCtx->xDataPlaneSendQueue;
+        uint32_t ulWaiting;
+
         configASSERT( pxPbufToSend != NULL );
-        xReturn = xQueueSend( pxCtx->xDataPlaneSendQueue,
+
+        /* Counted first, the dataplane thread may take the packet as soon as it is queued */
+        ulWaiting = Atomic_Increment_u32( pxCtx->pulTxPacketsWaiting ) + 1;
+
+        /* Never block the tcpip thread on a slow or stalled module */
+        xReturn = xQueueSend( xTargetQueue,
                               &pxPbufToSend,
-                              MX_ETH_PACKET_ENQUEUE_TIMEOUT );
+                              0 );
 
         if( xReturn == pdTRUE )
         {
-            xError = ERR_OK;
-            LogDebug( "Packet enqueued into xDataPlaneSendQueue addr: %p, len: %d, refs: %d, remaining space: %d",
-                      pxPbufToSend, pxPbufToSend->tot_len, pxPbufToSend->ref, uxQueueSpacesAvailable( pxCtx->xDataPlaneSendQueue ) );
+            MxTxBackpressure_t * pxBackpressure = pxCtx->pxTxBackpressure;
 
-            ( void ) Atomic_Increment_u32( pxCtx->pulTxPacketsWaiting );
-
-            ( void ) xTaskNotifyGiveIndexed( pxCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
+            xError = ERR_OK;
+            LogDebug( "Packet enqueued into %s addr: %p, len: %d, refs: %d, remaining space: %d",
+                      ( xPriority == pdTRUE ) ? "xDataPlanePrioritySendQueue" : "xDataPlaneSendQueue",
+                      pxPbufToSend, pxPbufToSend->tot_len, pxPbufToSend->ref, uxQueueSpacesAvailable( xTargetQueue ) );
+
+            /* Only the tcpip thread raises the high water mark */
+            if( ulWaiting > pxBackpressure->ulHighWaterMark )
+            {
+                pxBackpressure->ulHighWaterMark = ulWaiting;
+            }
+
+            ( void ) xTaskNotifyIndexed( pxCtx->xDataPlaneTaskHandle,
+                                         DATA_WAITING_IDX,
+                                         DATA_WAITING_DATA,
+                                         eSetBits );
         }
         else
         {
-            xError = ERR_TIMEOUT;
+            /*
+             * Refuse the frame. TCP keeps the segment on its unsent queue and retries it from
+             * prvLinkOutputResume once the dataplane thread has drained the queue, other
+             * protocols see the error.
+             */
+            ( void ) Atomic_Decrement_u32( pxCtx->pulTxPacketsWaiting );
+            ( void ) Atomic_Increment_u32( &( pxCtx->pxTxBackpressure->ulQueueFullCount ) );
+            pxCtx->pxTxBackpressure->ulBlocked = 1;
+            xError = ERR_WOULDBLOCK;
             PBUF_FREE( pxPbufToSend );
+
+            /* The dataplane thread may have drained the queue before ulBlocked was set */
+            prvLinkOutputResume( pxCtx->pxTxBackpressure, *( pxCtx->pulTxPacketsWaiting ) );
         }
     }
 
     return xError;
 }
 
+/* Runs on the tcpip thread: retry output on the connections whose last segment was refused */
+static void vLinkOutputResumeCallback( void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    for( struct tcp_pcb * pxPcb = tcp_active_pcbs; pxPcb != NULL; pxPcb = pxPcb->next )
+    {
+        if( ( pxPcb->flags & TF_NAGLEMEMERR ) != 0 )
+        {
+            ( void ) tcp_output( pxPcb );
+        }
+    }
+}
+
+void prvLinkOutputResume( MxTxBackpressure_t * pxBackpressure,
+                          uint32_t ulTxPacketsWaiting )
+{
+    configASSERT( pxBackpressure != NULL );
+
+    if( ( pxBackpressure->ulBlocked != 0 ) &&
+        ( ulTxPacketsWaiting <= MX_TX_RESUME_THRESHOLD ) &&
+        ( Atomic_CompareAndSwap_u32( &( pxBackpressure->ulBlocked ), 0, 1 ) == ATOMIC_COMPARE_AND_SWAP_SUCCESS ) )
+    {
+        /* With the tcpip mbox full, the segment waits for the next ACK or lwIP timer instead */
+        if( tcpip_try_callback( vLinkOutputResumeCallback, NULL ) != ERR_OK )
+        {
+            LogDebug( "Failed to schedule link output resume." );
+        }
+    }
+}
+
 BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
                           PacketBuffer_t * pxPbufIn )
 {
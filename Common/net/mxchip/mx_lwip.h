@@ -47,6 +47,9 @@ typedef struct eth_addr   MacAddress_t;
 #define PBUF_ALLOC_TX( len )    pbuf_alloc( PBUF_RAW, len, PBUF_RAM )
 #define PBUF_FREE( pbuf )       pbuf_free( pbuf )
 
+/* Messages larger than an ethernet frame (scan results, etc) are received into a contiguous buffer */
+#define PBUF_ALLOC_RX_LARGE( len )    pbuf_alloc( PBUF_RAW, len, PBUF_RAM )
+
 /* helper functions */
 static inline void vLogAddress( const char * pucLabel,
                                 ip_addr_t xAddress )
@@ -30,8 +30,10 @@
 #include "logging.h"
 
 /* Standard includes */
+#include <assert.h>
 #include <stdint.h>
 #include <limits.h>
+#include <string.h>
 
 #include "mx_netconn.h"
 #include "mx_lwip.h"
@@ -40,26 +42,34 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "event_groups.h"
+#include "static_alloc.h"
 #include "kvstore.h"
 #include "hw_defs.h"
 
 /* lwip includes */
 #include "lwip/tcpip.h"
 #include "lwip/netifapi.h"
+#include "lwip/dhcp.h"
 #include "lwip/prot/dhcp.h"
 #include "lwip/apps/lwiperf.h"
 
 #include "sys_evt.h"
+#include "boot_prof.h"
 
 #include "stm32u5_iot_board.h"
 
 #define MACADDR_RETRY_WAIT_TIME_TICKS    pdMS_TO_TICKS( 10 * 1000 )
 
+/* The module may still be booting after the reset delay, retry sooner during the first few seconds */
+#define MX_READY_TIMEOUT_TICKS           pdMS_TO_TICKS( 10 * 1000 )
+#define MX_READY_RETRY_WAIT_TIME_TICKS   pdMS_TO_TICKS( 500 )
+#define MX_READY_FAST_RETRIES            6
+
 static TaskHandle_t xNetTaskHandle = NULL;
 static MxDataplaneCtx_t xDataPlaneCtx;
 static ControlPlaneCtx_t xControlPlaneCtx;
 
-#if LOG_LEVEL == LOG_DEBUG
+#if LOG_LEVEL_MAX >= LOG_DEBUG
 
 /*
  * @brief Converts from a MxEvent_t to a C string.
@@ -101,7 +111,7 @@ static ControlPlaneCtx_t xControlPlaneCtx;
 
         return pcReturn;
     }
-#endif /* if LOG_LEVEL == LOG_DEBUG */
+#endif /* if LOG_LEVEL_MAX >= LOG_DEBUG */
 
 /* Wait for all bits in ulTargetBits */
 static uint32_t ulWaitForNotifyBits( BaseType_t uxIndexToWaitOn,
@@ -153,30 +163,35 @@ static uint32_t ulWaitForNotifyBits( BaseType_t uxIndexToWaitOn,
 
 static void vHandleMxStatusUpdate( MxNetConnectCtx_t * pxCtx )
 {
-    if( pxCtx->xStatus != pxCtx->xStatusPrevious )
-    {
-        switch( pxCtx->xStatus )
+    #if ( MX_NET_OFFLOAD == 1 )
+        /* The module's own stack owns the link, the lwIP netif stays down */
+        ( void ) pxCtx;
+    #else
+        if( pxCtx->xStatus != pxCtx->xStatusPrevious )
         {
-            case MX_STATUS_STA_UP:
-            case MX_STATUS_STA_GOT_IP:
-            case MX_STATUS_AP_UP:
-                /* Set link up */
-                vSetLinkUp( &( pxCtx->xNetif ) );
-                break;
-
-            case MX_STATUS_NONE:
-            case MX_STATUS_STA_DOWN:
-            case MX_STATUS_AP_DOWN:
-                vSetLinkDown( &( pxCtx->xNetif ) );
-                break;
-
-            default:
-                LogWarn( "Unknown mxchip status indication: %d", pxCtx->xStatus );
-                /* Fail safe to setting link up */
-                vSetLinkUp( &( pxCtx->xNetif ) );
-                break;
+            switch( pxCtx->xStatus )
+            {
+                case MX_STATUS_STA_UP:
+                case MX_STATUS_STA_GOT_IP:
+                case MX_STATUS_AP_UP:
+                    /* Set link up */
+                    vSetLinkUp( &( pxCtx->xNetif ) );
+                    break;
+
+                case MX_STATUS_NONE:
+                case MX_STATUS_STA_DOWN:
+                case MX_STATUS_AP_DOWN:
+                    vSetLinkDown( &( pxCtx->xNetif ) );
+                    break;
+
+                default:
+                    LogWarn( "Unknown mxchip status indication: %d", pxCtx->xStatus );
+                    /* Fail safe to setting link up */
+                    vSetLinkUp( &( pxCtx->xNetif ) );
+                    break;
+            }
         }
-    }
+    #endif /* MX_NET_OFFLOAD == 1 */
 }
 
 static BaseType_t xWaitForMxStatus( MxNetConnectCtx_t * pxCtx,
@@ -266,9 +281,246 @@ static void vLwipReadyCallback( void * pvCtx )
     }
 }
 
+/* Reconnect with the new settings when the WiFi configuration is committed */
+static void vWifiConfigChangedCallback( KVStoreKey_t xKey,
+                                        void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    LogInfo( "Configuration key %s changed, reconnecting.", kvKeyToString( xKey ) );
+
+    ( void ) net_request_reconnect();
+}
+
 static char pcSSID[ MX_SSID_BUF_LEN ] = { 0 };
 static char pcPSK[ MX_PSK_BUF_LEN ] = { 0 };
 
+#ifndef MX_FAST_RECONNECT_ENABLED
+    #define MX_FAST_RECONNECT_ENABLED    1
+#endif
+
+#if MX_FAST_RECONNECT_ENABLED
+
+/* A directed connect which has not associated by then falls back to a full scan */
+    #define MX_TIMEOUT_CONNECT_BSSID    pdMS_TO_TICKS( 3 * 1000 )
+
+/*
+ * Access point and DHCP lease of the last connection, kept in the wifi_cache key.
+ * The next connection to the same SSID associates with that BSSID without a scan,
+ * and DHCP asks for the same address (INIT-REBOOT) instead of starting with DISCOVER.
+ */
+    typedef struct
+    {
+        char cSSID[ MX_SSID_BUF_LEN ];
+        struct eth_addr xBssid;
+        uint8_t ucChannel;
+        uint8_t ucSecurity;
+        uint32_t ulIpAddr;
+        uint32_t ulNetmask;
+        uint32_t ulGateway;
+    } MxNetCache_t;
+
+    static MxNetCache_t xNetCache = { 0 };
+    static BaseType_t xNetCacheValid = pdFALSE;
+
+    static void vNetCacheLoad( void )
+    {
+        size_t xLength = KVStore_getBlob( CS_WIFI_CACHE, &xNetCache, sizeof( MxNetCache_t ) );
+
+        xNetCacheValid = ( ( xLength == sizeof( MxNetCache_t ) ) &&
+                           ( xNetCache.ulIpAddr != 0 ) ) ? pdTRUE : pdFALSE;
+    }
+
+/* Store the current access point and lease if either changed since the last connection */
+    static void vNetCacheUpdate( const NetInterface_t * pxNetif )
+    {
+        MxNetCache_t xNew;
+        MxLinkInfo_t xLink;
+
+        /* Zero the padding as well, the entries are compared with memcmp */
+        ( void ) memset( &xNew, 0, sizeof( MxNetCache_t ) );
+
+        if( mx_GetLinkInfo( &xLink, pdMS_TO_TICKS( 1000 ) ) != IPC_SUCCESS )
+        {
+            LogWarn( "Failed to read the access point link information." );
+        }
+        else
+        {
+            ( void ) KVStore_getString( CS_WIFI_SSID, xNew.cSSID, MX_SSID_BUF_LEN );
+
+            xNew.xBssid = xLink.xBssid;
+            xNew.ucChannel = xLink.ucChannel;
+            xNew.ucSecurity = xLink.ucSecurity;
+            xNew.ulIpAddr = pxNetif->ip_addr.addr;
+            xNew.ulNetmask = pxNetif->netmask.addr;
+            xNew.ulGateway = pxNetif->gw.addr;
+
+            if( ( xNetCacheValid == pdFALSE ) ||
+                ( memcmp( &xNew, &xNetCache, sizeof( MxNetCache_t ) ) != 0 ) )
+            {
+                if( KVStore_setBlob( CS_WIFI_CACHE, sizeof( MxNetCache_t ), &xNew ) == pdTRUE )
+                {
+                    #if KV_STORE_CACHE_ENABLE
+                        KVStore_commitDeferred();
+                    #endif
+                }
+                else
+                {
+                    LogError( "Failed to store the access point and lease cache." );
+                }
+
+                xNetCache = xNew;
+                xNetCacheValid = pdTRUE;
+            }
+        }
+    }
+
+/*
+ * Runs in the tcpip thread. dhcp_start() resets the client, which is then moved to the
+ * REBOOTING state with the cached lease so that dhcp_network_changed() sends a REQUEST for
+ * it. lwIP falls back to DISCOVER on a NAK or when REBOOT_TRIES requests went unanswered.
+ */
+    static err_t xDhcpRebootFn( struct netif * pxNetif )
+    {
+        err_t xLwipError = dhcp_start( pxNetif );
+        struct dhcp * pxDHCP = netif_dhcp_data( pxNetif );
+
+        if( ( xLwipError == ERR_OK ) &&
+            ( pxDHCP != NULL ) &&
+            netif_is_link_up( pxNetif ) )
+        {
+            ip4_addr_set_u32( &( pxDHCP->offered_ip_addr ), xNetCache.ulIpAddr );
+            ip4_addr_set_u32( &( pxDHCP->offered_sn_mask ), xNetCache.ulNetmask );
+            ip4_addr_set_u32( &( pxDHCP->offered_gw_addr ), xNetCache.ulGateway );
+            pxDHCP->state = DHCP_STATE_REBOOTING;
+
+            dhcp_network_changed( pxNetif );
+        }
+
+        return xLwipError;
+    }
+#endif /* MX_FAST_RECONNECT_ENABLED */
+
+/*
+ * Period of the link quality poll while associated, 0 to disable it. The module reports the
+ * signal strength of the access point only, not its retry count or PHY rate.
+ */
+#ifndef MX_LINK_QUALITY_PERIOD_MS
+    #define MX_LINK_QUALITY_PERIOD_MS    ( 10 * 1000 )
+#endif
+
+/* SYS_EVT_LINK_POOR below MX_LINK_POOR_RSSI_DBM, SYS_EVT_LINK_GOOD again above MX_LINK_GOOD_RSSI_DBM */
+#ifndef MX_LINK_POOR_RSSI_DBM
+    #define MX_LINK_POOR_RSSI_DBM    ( -75 )
+#endif
+
+#ifndef MX_LINK_GOOD_RSSI_DBM
+    #define MX_LINK_GOOD_RSSI_DBM    ( -68 )
+#endif
+
+static_assert( MX_LINK_GOOD_RSSI_DBM > MX_LINK_POOR_RSSI_DBM, "The thresholds must leave some hysteresis" );
+
+/* Last signal strength read, 0 while not associated */
+static volatile int32_t lLinkRssi = 0;
+
+int32_t net_get_link_rssi( void )
+{
+    return lLinkRssi;
+}
+
+/* Read the signal strength and publish SYS_EVT_LINK_POOR or SYS_EVT_LINK_GOOD when it crossed a threshold */
+static void vLinkQualityPoll( void )
+{
+    MxLinkInfo_t xLink;
+
+    if( mx_GetLinkInfo( &xLink, pdMS_TO_TICKS( 1000 ) ) == IPC_SUCCESS )
+    {
+        lLinkRssi = xLink.lRssi;
+
+        if( xLink.lRssi < MX_LINK_POOR_RSSI_DBM )
+        {
+            if( xSysEventIsUp( SYS_EVT_LINK_POOR ) == pdFALSE )
+            {
+                LogSys( "Poor link, RSSI: %ld dBm.", ( long ) xLink.lRssi );
+            }
+
+            vSysEventPublish( SYS_EVT_LINK_POOR );
+        }
+        else if( xLink.lRssi > MX_LINK_GOOD_RSSI_DBM )
+        {
+            vSysEventPublish( SYS_EVT_LINK_GOOD );
+        }
+        else
+        {
+            /* Between the thresholds, the state is kept */
+        }
+    }
+}
+
+/* Start DHCP, from the cached lease when there is one */
+static void vStartDhcpFast( NetInterface_t * pxNetif )
+{
+    BaseType_t xStarted = pdFALSE;
+
+    #if MX_FAST_RECONNECT_ENABLED
+        if( ( xNetCacheValid == pdTRUE ) &&
+            ( pxNetif->ip_addr.addr == 0 ) &&
+            netif_is_link_up( pxNetif ) )
+        {
+            LogInfo( "Starting DHCP with the cached lease." );
+
+            err_t xLwipError = netifapi_netif_common( pxNetif, NULL, xDhcpRebootFn );
+
+            if( xLwipError != ERR_OK )
+            {
+                LogError( "Failed to start DHCP on link rc: %d", xLwipError );
+            }
+
+            xStarted = pdTRUE;
+        }
+    #endif /* MX_FAST_RECONNECT_ENABLED */
+
+    if( xStarted == pdFALSE )
+    {
+        vStartDhcp( pxNetif );
+    }
+}
+
+#if ( MX_NET_OFFLOAD == 1 )
+
+/*
+ * Publish the link and IP events lwIP would otherwise drive, from the status of the module,
+ * which runs DHCP itself while bypass mode is off.
+ */
+    static void vHandleOffloadStatus( MxNetConnectCtx_t * pxCtx )
+    {
+        static BaseType_t xIpUp = pdFALSE;
+
+        if( ( pxCtx->xStatus == MX_STATUS_STA_GOT_IP ) && ( xIpUp == pdFALSE ) )
+        {
+            LogSys( "Network Link Up, the module's stack has an address." );
+            xIpUp = pdTRUE;
+            vBootPhaseMark( BOOT_PHASE_DHCP_BOUND );
+            vSysEventPublish( SYS_EVT_LINK_UP );
+            vSysEventPublish( SYS_EVT_IP_UP );
+        }
+        else if( ( pxCtx->xStatus != MX_STATUS_STA_GOT_IP ) && ( xIpUp == pdTRUE ) )
+        {
+            LogSys( "Network Link Down." );
+            xIpUp = pdFALSE;
+            lLinkRssi = 0;
+            vSysEventPublish( SYS_EVT_IP_DOWN );
+            vSysEventPublish( SYS_EVT_LINK_GOOD );
+            vSysEventPublish( SYS_EVT_LINK_DOWN );
+        }
+        else
+        {
+            /* No change */
+        }
+    }
+
+#endif /* MX_NET_OFFLOAD == 1 */
+
 static BaseType_t xConnectToAP( MxNetConnectCtx_t * pxCtx )
 {
     IPCError_t xErr = IPC_SUCCESS;
@@ -277,13 +529,49 @@ static BaseType_t xConnectToAP( MxNetConnectCtx_t * pxCtx )
     if( ( pxCtx->xStatus == MX_STATUS_NONE ) ||
         ( pxCtx->xStatus == MX_STATUS_STA_DOWN ) )
     {
-        xErr |= mx_SetBypassMode( pdTRUE,
-                                  pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS ) );
+        #if ( MX_NET_OFFLOAD == 1 )
+            xErr |= mx_SetBypassMode( pdFALSE,
+                                      pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS ) );
+        #else
+            xErr |= mx_SetBypassMode( pdTRUE,
+                                      pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS ) );
+        #endif
 
         ( void ) KVStore_getString( CS_WIFI_SSID, pcSSID, MX_SSID_BUF_LEN );
         ( void ) KVStore_getString( CS_WIFI_CREDENTIAL, pcPSK, MX_PSK_BUF_LEN );
 
-        xErr = mx_Connect( pcSSID, pcPSK, MX_TIMEOUT_CONNECT );
+        xErr = IPC_ERROR;
+
+        #if MX_FAST_RECONNECT_ENABLED
+            if( ( xNetCacheValid == pdTRUE ) &&
+                ( strncmp( xNetCache.cSSID, pcSSID, MX_SSID_BUF_LEN ) == 0 ) )
+            {
+                LogInfo( "Connecting to the cached access point on channel %u.", xNetCache.ucChannel );
+
+                xErr = mx_ConnectBssid( pcSSID, pcPSK,
+                                        &( xNetCache.xBssid ),
+                                        xNetCache.ucChannel,
+                                        xNetCache.ucSecurity,
+                                        MX_TIMEOUT_CONNECT_BSSID );
+
+                if( ( xErr == IPC_SUCCESS ) &&
+                    ( xWaitForMxStatus( pxCtx, MX_STATUS_STA_UP, MX_TIMEOUT_CONNECT_BSSID ) == pdFALSE ) )
+                {
+                    xErr = IPC_TIMEOUT;
+                }
+
+                if( xErr != IPC_SUCCESS )
+                {
+                    LogWarn( "Cached access point not found, scanning for %s.", pcSSID );
+                    ( void ) mx_Disconnect( pdMS_TO_TICKS( 1000 ) );
+                }
+            }
+        #endif /* MX_FAST_RECONNECT_ENABLED */
+
+        if( xErr != IPC_SUCCESS )
+        {
+            xErr = mx_Connect( pcSSID, pcPSK, MX_TIMEOUT_CONNECT );
+        }
 
         /* Clear sensitive data */
         memset( pcSSID, 0, MX_SSID_BUF_LEN );
@@ -299,14 +587,23 @@ static BaseType_t xConnectToAP( MxNetConnectCtx_t * pxCtx )
         }
     }
 
+    if( pxCtx->xStatus >= MX_STATUS_STA_UP )
+    {
+        vBootPhaseMark( BOOT_PHASE_WIFI_UP );
+    }
+
     return( pxCtx->xStatus >= MX_STATUS_STA_UP );
 }
 
 static void vInitializeWifiModule( MxNetConnectCtx_t * pxCtx )
 {
     IPCError_t xErr = IPC_ERROR_INTERNAL;
+    uint32_t ulAttempts = 0;
 
-    vTaskDelay( 5000 );
+    /* Requests sent before the data plane has reset the module would only time out */
+    ( void ) ulWaitForNotifyBits( NET_EVT_IDX,
+                                  NET_MX_READY_BIT,
+                                  MX_READY_TIMEOUT_TICKS );
 
     while( xErr != IPC_SUCCESS )
     {
@@ -334,10 +631,14 @@ static void vInitializeWifiModule( MxNetConnectCtx_t * pxCtx )
 
         if( xErr != IPC_SUCCESS )
         {
-            vTaskDelay( MACADDR_RETRY_WAIT_TIME_TICKS );
+            ulAttempts++;
+            vTaskDelay( ( ulAttempts < MX_READY_FAST_RETRIES ) ?
+                        MX_READY_RETRY_WAIT_TIME_TICKS : MACADDR_RETRY_WAIT_TIME_TICKS );
         }
         else
         {
+            vBootPhaseMark( BOOT_PHASE_MX_READY );
+
             LogInfo( "Firmware Version:   %s", pxCtx->pcFirmwareRevision );
             LogInfo( "HW Address:         %02X:%02X:%02X:%02X:%02X:%02X",
                      pxCtx->xMacAddress.addr[ 0 ], pxCtx->xMacAddress.addr[ 1 ],
@@ -352,15 +653,19 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     MessageBufferHandle_t xControlPlaneResponseBuff;
     QueueHandle_t xControlPlaneSendQueue;
     QueueHandle_t xDataPlaneSendQueue;
+    QueueHandle_t xDataPlanePrioritySendQueue;
 
     /* Construct queues */
-    xDataPlaneSendQueue = xQueueCreate( DATA_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    xDataPlaneSendQueue = xAppQueueCreate( DATA_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
     configASSERT( xDataPlaneSendQueue != NULL );
 
-    xControlPlaneResponseBuff = xMessageBufferCreate( CONTROL_PLANE_BUFFER_SZ );
+    xDataPlanePrioritySendQueue = xAppQueueCreate( DATA_PLANE_PRIORITY_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    configASSERT( xDataPlanePrioritySendQueue != NULL );
+
+    xControlPlaneResponseBuff = xAppMessageBufferCreate( CONTROL_PLANE_BUFFER_SZ );
     configASSERT( xControlPlaneResponseBuff != NULL );
 
-    xControlPlaneSendQueue = xQueueCreate( CONTROL_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    xControlPlaneSendQueue = xAppQueueCreate( CONTROL_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
     configASSERT( xControlPlaneSendQueue != NULL );
 
 
@@ -371,8 +676,11 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     ( void ) memset( &( pxCtx->xMacAddress ), 0, sizeof( MacAddress_t ) );
 
     pxCtx->xDataPlaneSendQueue = xDataPlaneSendQueue;
+    pxCtx->xDataPlanePrioritySendQueue = xDataPlanePrioritySendQueue;
     pxCtx->pulTxPacketsWaiting = &( xDataPlaneCtx.ulTxPacketsWaiting );
+    pxCtx->pxTxBackpressure = &( xDataPlaneCtx.xTxBackpressure );
     pxCtx->xNetTaskHandle = xTaskGetCurrentTaskHandle();
+    xDataPlaneCtx.xNetTaskHandle = pxCtx->xNetTaskHandle;
 
     /* Construct dataplane context */
 
@@ -386,11 +694,15 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
 
     /* Initialize waiting packet counters */
     xDataPlaneCtx.ulTxPacketsWaiting = 0;
+    ( void ) memset( &( xDataPlaneCtx.xTxBackpressure ), 0, sizeof( MxTxBackpressure_t ) );
 
     /* Set queue handles */
     xDataPlaneCtx.xControlPlaneSendQueue = xControlPlaneSendQueue;
     xDataPlaneCtx.xControlPlaneResponseBuff = xControlPlaneResponseBuff;
     xDataPlaneCtx.xDataPlaneSendQueue = xDataPlaneSendQueue;
+    xDataPlaneCtx.xDataPlanePrioritySendQueue = xDataPlanePrioritySendQueue;
+    xDataPlaneCtx.ulPriorityFramesInRow = 0;
+    xDataPlaneCtx.ulFlowSpinBudget = MX_FLOW_SPIN_MAX_CYCLES;
     xDataPlaneCtx.pxNetif = &( pxCtx->xNetif );
 
     /* Construct controlplane context */
@@ -428,25 +740,27 @@ void net_main( void * pvParameters )
                                    NET_LWIP_READY_BIT,
                                    portMAX_DELAY );
 
+    vBootPhaseMark( BOOT_PHASE_LWIP_READY );
+
     /* Start dataplane thread (does hw reset on initialization) */
-    xResult = xTaskCreate( &vDataplaneThread,
-                           "MxData",
-                           4096,
-                           &xDataPlaneCtx,
-                           25,
-                           &xDataPlaneCtx.xDataPlaneTaskHandle );
+    xResult = xAppTaskCreateCpuBank( &vDataplaneThread,
+                                     "MxData",
+                                     4096,
+                                     &xDataPlaneCtx,
+                                     25,
+                                     &xDataPlaneCtx.xDataPlaneTaskHandle );
 
     configASSERT( xResult == pdTRUE );
     xControlPlaneCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
     xCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
 
     /* Start control plane thread */
-    xResult = xTaskCreate( &prvControlPlaneRouter,
-                           "MxCtrl",
-                           4096,
-                           &xControlPlaneCtx,
-                           24,
-                           NULL );
+    xResult = xAppTaskCreateCpuBank( &prvControlPlaneRouter,
+                                     "MxCtrl",
+                                     4096,
+                                     &xControlPlaneCtx,
+                                     24,
+                                     NULL );
 
     configASSERT( xResult == pdTRUE );
 
@@ -471,12 +785,34 @@ void net_main( void * pvParameters )
 
     ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_INIT );
 
-    /* If already connected to the AP, bring interface up */
-    if( xCtx.xStatus >= MX_STATUS_STA_UP )
-    {
-        vSetAdminUp( pxNetif );
-        vStartDhcp( pxNetif );
-    }
+    /* The access point credentials are in the kvstore, which vInitTask loads concurrently */
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_KV_READY,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    #if MX_FAST_RECONNECT_ENABLED
+        vNetCacheLoad();
+    #endif
+
+    ( void ) KVStore_subscribe( CS_WIFI_SSID, vWifiConfigChangedCallback, NULL );
+    ( void ) KVStore_subscribe( CS_WIFI_CREDENTIAL, vWifiConfigChangedCallback, NULL );
+
+    #if ( MX_NET_OFFLOAD == 1 )
+        LogSys( "Network offload mode, sockets run on the module's TCP/IP stack." );
+    #else
+        /* If already connected to the AP, bring interface up */
+        if( xCtx.xStatus >= MX_STATUS_STA_UP )
+        {
+            vSetAdminUp( pxNetif );
+            vStartDhcpFast( pxNetif );
+        }
+    #endif
+
+    #if ( MX_LINK_QUALITY_PERIOD_MS > 0 )
+        TickType_t xLastLinkPoll = xTaskGetTickCount();
+    #endif
 
     /* Outer loop. Reinitializing */
     for( ; ; )
@@ -489,14 +825,36 @@ void net_main( void * pvParameters )
         }
 
         /*
-         * Wait for any event or timeout after 30 seconds
+         * Wait for any event or timeout after 30 seconds, or the link quality poll period
+         * while associated
          */
         uint32_t ulNotificationValue = 0x0;
+        TickType_t xWait = pdMS_TO_TICKS( 30 * 1000 );
+
+        #if ( MX_LINK_QUALITY_PERIOD_MS > 0 )
+            if( xCtx.xStatus == MX_STATUS_STA_GOT_IP )
+            {
+                TickType_t xElapsed = xTaskGetTickCount() - xLastLinkPoll;
+
+                xWait = ( xElapsed < pdMS_TO_TICKS( MX_LINK_QUALITY_PERIOD_MS ) ) ?
+                        ( pdMS_TO_TICKS( MX_LINK_QUALITY_PERIOD_MS ) - xElapsed ) : 0;
+            }
+        #endif
+
         xResult = xTaskNotifyWaitIndexed( NET_EVT_IDX,
                                           0x0,
                                           0xFFFFFFFF,
                                           &ulNotificationValue,
-                                          pdMS_TO_TICKS( 30 * 1000 ) );
+                                          xWait );
+
+        #if ( MX_LINK_QUALITY_PERIOD_MS > 0 )
+            if( ( xCtx.xStatus == MX_STATUS_STA_GOT_IP ) &&
+                ( ( xTaskGetTickCount() - xLastLinkPoll ) >= pdMS_TO_TICKS( MX_LINK_QUALITY_PERIOD_MS ) ) )
+            {
+                vLinkQualityPoll();
+                xLastLinkPoll = xTaskGetTickCount();
+            }
+        #endif
 
         if( ulNotificationValue != 0 )
         {
@@ -507,6 +865,10 @@ void net_main( void * pvParameters )
             if( ( ulNotificationValue & MX_STATUS_UPDATE_BIT ) )
             {
                 vHandleMxStatusUpdate( &xCtx );
+
+                #if ( MX_NET_OFFLOAD == 1 )
+                    vHandleOffloadStatus( &xCtx );
+                #endif
             }
 
             if( ulNotificationValue & NET_LWIP_IP_CHANGE_BIT )
@@ -519,14 +881,28 @@ void net_main( void * pvParameters )
                 lwiperf_start_tcp_server_default( NULL, NULL );
                 LogSys( "Started Iperf server" );
 
-                ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                /* The address is also changed to 0 when it is cleared on link loss */
+                if( pxNetif->ip_addr.addr != 0 )
+                {
+                    vBootPhaseMark( BOOT_PHASE_DHCP_BOUND );
+
+                    #if MX_FAST_RECONNECT_ENABLED
+                        vNetCacheUpdate( pxNetif );
+                    #endif
+
+                    vSysEventPublish( SYS_EVT_IP_UP );
+                }
+                else
+                {
+                    vSysEventPublish( SYS_EVT_IP_DOWN );
+                }
             }
 
             if( ulNotificationValue & NET_LWIP_IFUP_BIT )
             {
                 LogInfo( "Administrative UP event." );
 
-                vStartDhcp( pxNetif );
+                vStartDhcpFast( pxNetif );
             }
             else if( ( ulNotificationValue & NET_LWIP_LINK_UP_BIT ) &&
                      ( ucNetifFlags & NETIF_FLAG_LINK_UP ) )
@@ -534,8 +910,9 @@ void net_main( void * pvParameters )
                 LogInfo( "Link UP event." );
 
                 vSetAdminUp( pxNetif );
-                vStartDhcp( pxNetif );
+                vStartDhcpFast( pxNetif );
                 LogSys( "Network Link Up." );
+                vSysEventPublish( SYS_EVT_LINK_UP );
             }
             else if( ulNotificationValue & NET_LWIP_IFDOWN_BIT )
             {
@@ -543,7 +920,7 @@ void net_main( void * pvParameters )
 
                 vStopDhcp( pxNetif );
                 vClearAddress( pxNetif );
-                ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                vSysEventPublish( SYS_EVT_IP_DOWN );
             }
             else if( ( ulNotificationValue & NET_LWIP_LINK_DOWN_BIT ) &&
                      ( ( ucNetifFlags & NETIF_FLAG_LINK_UP ) == 0 ) )
@@ -552,13 +929,16 @@ void net_main( void * pvParameters )
                 vStopDhcp( pxNetif );
                 vClearAddress( pxNetif );
                 LogSys( "Network Link Down." );
-                ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                lLinkRssi = 0;
+                vSysEventPublish( SYS_EVT_IP_DOWN );
+                vSysEventPublish( SYS_EVT_LINK_GOOD );
+                vSysEventPublish( SYS_EVT_LINK_DOWN );
             }
 
             /* Reconnect requested by configStore or cli process */
             if( ulNotificationValue & ASYNC_REQUEST_RECONNECT_BIT )
             {
-                ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                vSysEventPublish( SYS_EVT_IP_DOWN );
                 ( void ) mx_SetBypassMode( pdFALSE, pdMS_TO_TICKS( 1000 ) );
                 ( void ) mx_Disconnect( pdMS_TO_TICKS( 1000 ) );
                 xConnectToAP( &xCtx );
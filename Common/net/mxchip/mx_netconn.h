@@ -33,4 +33,7 @@
 void net_main( void * pvParameters );
 BaseType_t net_request_reconnect( void );
 
+/* Signal strength of the access point in dBm at the last link quality poll, 0 while not associated */
+int32_t net_get_link_rssi( void );
+
 #endif /* MX_NETCONN_H */
@@ -49,6 +49,8 @@ extern "C"
 #define DATA_WAITING_CONTROL             0x10
 #define DATA_WAITING_DATA                0x8
 
+#define IPC_RESPONSE_IDX                 4
+
 #define NET_EVT_IDX                      0x1
 #define NET_LWIP_READY_BIT               0x1
 #define NET_LWIP_IP_CHANGE_BIT           0x2
@@ -58,9 +60,10 @@ extern "C"
 #define NET_LWIP_LINK_DOWN_BIT           0x20
 #define MX_STATUS_UPDATE_BIT             0x40
 #define ASYNC_REQUEST_RECONNECT_BIT      0x80
+#define NET_MX_READY_BIT                 0x100
 
 /* Constants */
-#define NUM_IPC_REQUEST_CTX              1
+#define NUM_IPC_REQUEST_CTX              4
 #define MX_DEFAULT_TIMEOUT_MS            100
 #define MX_DEFAULT_TIMEOUT_TICK          pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS )
 #define MX_TIMEOUT_CONNECT               pdMS_TO_TICKS( 120 * 1000 )
@@ -72,14 +75,64 @@ extern "C"
 #define MX_BSSID_LEN                     MX_MACADDR_LEN
 #define MX_SPI_TRANSACTION_TIMEOUT       MX_DEFAULT_TIMEOUT_TICK
 #define MX_MAX_MESSAGE_LEN               4096
-#define MX_ETH_PACKET_ENQUEUE_TIMEOUT    pdMS_TO_TICKS( 5 * 10000 )
 #define MX_SPI_EVENT_TIMEOUT             pdMS_TO_TICKS( 10000 )
 #define MX_SPI_FLOW_TIMEOUT              pdMS_TO_TICKS( 10 )
 
+/*
+ * Bounds (in CPU cycles) on the self-tuning busy-spin performed before blocking on the
+ * flow pin event. Set MX_FLOW_SPIN_MAX_CYCLES to 0 to always block.
+ */
+#ifndef MX_FLOW_SPIN_MAX_CYCLES
+    #define MX_FLOW_SPIN_MAX_CYCLES      4000
+#endif
+#define MX_FLOW_SPIN_MIN_CYCLES          400
+
+/*
+ * Set to 1 to have the notify and flow pin interrupts notify the dataplane task directly,
+ * or 0 to go through the registered gpio callbacks.
+ */
+#ifndef MX_GPIO_DIRECT_NOTIFY
+    #define MX_GPIO_DIRECT_NOTIFY        1
+#endif
+
+/* Upper bounds on the number of back-to-back transactions in a single dataplane burst */
+#define MX_DATAPLANE_BURST_MAX_FRAMES    ( DATA_PLANE_QUEUE_LEN + CONTROL_PLANE_QUEUE_LEN )
+#define MX_DATAPLANE_BURST_MAX_BYTES     ( 4 * MX_MAX_MESSAGE_LEN )
+
 #define CONTROL_PLANE_QUEUE_LEN          10
 #define DATA_PLANE_QUEUE_LEN             10
+#define DATA_PLANE_PRIORITY_QUEUE_LEN    10
+
+/*
+ * Number of frames left waiting below which lwIP is told to retry output after a frame was
+ * refused on a full dataplane queue.
+ */
+#define MX_TX_RESUME_THRESHOLD           ( DATA_PLANE_QUEUE_LEN / 2 )
+
+/* Maximum number of consecutive priority frames sent while bulk frames are waiting */
+#define MX_TX_PRIORITY_WEIGHT            4
+/* Only asynchronous event messages pass through the control plane message buffer */
 #define CONTROL_PLANE_BUFFER_SZ          ( 25 * sizeof( void * ) + sizeof( size_t ) )
 
+#define MX_RX_POOL_LEN                   4
+
+/* Pre-allocated MTU sized rx buffers owned by the dataplane thread */
+typedef struct
+{
+    PacketBuffer_t * pxBuffers[ MX_RX_POOL_LEN ];
+    uint32_t ulCount;          /* Number of buffers currently available in pxBuffers */
+    uint32_t ulHighWaterMark;  /* Largest number of buffers consumed between refills */
+    uint32_t ulExhaustedCount; /* Number of frames which arrived while the pool was empty */
+} MxRxPbufPool_t;
+
+/* Transmit queue occupancy, updated by prvxLinkOutput and the dataplane thread */
+typedef struct
+{
+    volatile uint32_t ulBlocked;   /* 1 from a refused frame until lwIP has been told to retry */
+    uint32_t ulQueueFullCount;     /* Number of frames refused because their queue was full */
+    uint32_t ulHighWaterMark;      /* Largest number of frames waiting at once */
+} MxTxBackpressure_t;
+
 typedef struct
 {
     const IotMappedPin_t * gpio_flow;
@@ -88,12 +141,18 @@ typedef struct
     const IotMappedPin_t * gpio_notify;
     SPI_HandleTypeDef * pxSpiHandle;
     TaskHandle_t xDataPlaneTaskHandle;
+    TaskHandle_t xNetTaskHandle; /* Notified with NET_MX_READY_BIT once the module is out of reset */
     volatile uint32_t ulTxPacketsWaiting;
     volatile uint32_t ulLastRequestId;
     NetInterface_t * pxNetif;
     MessageBufferHandle_t xControlPlaneResponseBuff;
     QueueHandle_t xDataPlaneSendQueue;
+    QueueHandle_t xDataPlanePrioritySendQueue;
     QueueHandle_t xControlPlaneSendQueue;
+    uint32_t ulPriorityFramesInRow;
+    uint32_t ulFlowSpinBudget; /* Current busy-spin limit for xWaitForFlow, in CPU cycles */
+    MxRxPbufPool_t xRxPool;
+    MxTxBackpressure_t xTxBackpressure;
 } MxDataplaneCtx_t;
 
 typedef struct
@@ -114,7 +173,9 @@ typedef struct
     volatile MxStatus_t xStatus;
     volatile MxStatus_t xStatusPrevious;
     QueueHandle_t xDataPlaneSendQueue;
+    QueueHandle_t xDataPlanePrioritySendQueue;
     volatile uint32_t * pulTxPacketsWaiting;
+    MxTxBackpressure_t * pxTxBackpressure;
     TaskHandle_t xNetTaskHandle;
     TaskHandle_t xDataPlaneTaskHandle;
 } MxNetConnectCtx_t;
@@ -135,13 +196,31 @@ typedef enum
     IPC_WIFI_SOFTAP_START, /* Not used by this implementation */
     IPC_WIFI_SOFTAP_STOP,  /* Not used by this implementation */
     IPC_WIFI_GET_IP,       /* Not used by this implementation */
-    IPC_WIFI_GET_LINKINFO, /* Not used by this implementation */
+    IPC_WIFI_GET_LINKINFO,
     IPC_WIFI_PS_ON,        /* Not used by this implementation */
     IPC_WIFI_PS_OFF,       /* Not used by this implementation */
     IPC_WIFI_PING,         /* Not used by this implementation */
     IPC_WIFI_BYPASS_SET,
     IPC_WIFI_BYPASS_GET,
     IPC_WIFI_BYPASS_OUT,
+    IPC_SOCKET_OFFSET = 0x200, /* Sockets of the module's own TCP/IP stack, used when MX_NET_OFFLOAD is set */
+    IPC_SOCKET_CREATE,
+    IPC_SOCKET_CONNECT,
+    IPC_SOCKET_SEND,
+    IPC_SOCKET_SENDTO,        /* Not used by this implementation */
+    IPC_SOCKET_RECV,
+    IPC_SOCKET_RECVFROM,      /* Not used by this implementation */
+    IPC_SOCKET_SHUTDOWN,      /* Not used by this implementation */
+    IPC_SOCKET_CLOSE,
+    IPC_SOCKET_GETSOCKOPT,    /* Not used by this implementation */
+    IPC_SOCKET_SETSOCKOPT,
+    IPC_SOCKET_BIND,          /* Not used by this implementation */
+    IPC_SOCKET_LISTEN,        /* Not used by this implementation */
+    IPC_SOCKET_ACCEPT,        /* Not used by this implementation */
+    IPC_SOCKET_SELECT,        /* Not used by this implementation */
+    IPC_SOCKET_GETSOCKNAME,   /* Not used by this implementation */
+    IPC_SOCKET_GETPEERNAME,   /* Not used by this implementation */
+    IPC_SOCKET_GETHOSTBYNAME,
 
     /* Asynchronous Events */
     IPC_SYS_EVT_OFFSET = 0x8000,
@@ -204,6 +283,19 @@ typedef struct IPCRequestWifiConnect
 } IPCRequestWifiConnect_t;
 
 
+/* IPC_WIFI_GET_LINKINFO */
+typedef struct IPCResponseWifiGetLinkInfo
+{
+    int32_t lStatus;
+    int32_t lIsConnected;
+    int32_t lRssi;
+    char cSSID[ MX_SSID_BUF_LEN ];
+    uint8_t ucBssid[ MX_BSSID_LEN ];
+    uint8_t ucChannel;
+    int32_t lSecurity;
+} IPCResponseWifiGetLinkInfo_t;
+
+
 /* IPC_WIFI_DISCONNECT */
 /* IPC_WIFI_EVT_STATUS */
 struct IPCResponseStatus
@@ -228,16 +320,101 @@ typedef struct IPCResponseStatus  IPCResponsBypassOut_t;
 /* IPC_WIFI_EVT_STATUS */
 typedef struct IPCResponseStatus  IPCEventStatus_t;
 
+/* IPC_SOCKET_CREATE */
+typedef struct IPCRequestSocketCreate
+{
+    int32_t lDomain;
+    int32_t lType;
+    int32_t lProtocol;
+} IPCRequestSocketCreate_t;
+
+/* IPC_SOCKET_CONNECT, the address has the layout of the lwIP struct sockaddr */
+#define MX_SOCKADDR_LEN    16
+
+typedef struct IPCRequestSocketConnect
+{
+    int32_t lSocket;
+    uint8_t ucAddr[ MX_SOCKADDR_LEN ];
+    uint32_t ulAddrLen;
+} IPCRequestSocketConnect_t;
+
+/* IPC_SOCKET_SETSOCKOPT */
+#define MX_SOCKOPT_MAX_LEN    16
+
+typedef struct IPCRequestSocketSetOpt
+{
+    int32_t lSocket;
+    int32_t lLevel;
+    int32_t lName;
+    uint32_t ulLen;
+    uint8_t ucValue[ MX_SOCKOPT_MAX_LEN ];
+} IPCRequestSocketSetOpt_t;
+
+/* IPC_SOCKET_SEND, followed by ulLen bytes of data */
+typedef struct IPCRequestSocketSend
+{
+    int32_t lSocket;
+    uint32_t ulLen;
+    int32_t lFlags;
+} IPCRequestSocketSend_t;
+
+/* IPC_SOCKET_RECV */
+typedef struct IPCRequestSocketRecv
+{
+    int32_t lSocket;
+    uint32_t ulLen;
+    int32_t lFlags;
+} IPCRequestSocketRecv_t;
+
+/* IPC_SOCKET_RECV response, followed by the lResult bytes received */
+typedef struct IPCResponseSocketRecv
+{
+    int32_t lResult;
+} IPCResponseSocketRecv_t;
+
+/* IPC_SOCKET_CLOSE */
+typedef struct IPCRequestSocketClose
+{
+    int32_t lSocket;
+} IPCRequestSocketClose_t;
+
+/* IPC_SOCKET_GETHOSTBYNAME */
+#define MX_HOSTNAME_LEN    253
+
+typedef struct IPCRequestSocketGetHostByName
+{
+    char cName[ MX_HOSTNAME_LEN ];
+} IPCRequestSocketGetHostByName_t;
+
+typedef struct IPCResponseSocketGetHostByName
+{
+    int32_t lStatus;
+    uint32_t ulAddr; /* Network byte order */
+} IPCResponseSocketGetHostByName_t;
+
+/* Response of the other socket requests: file descriptor, byte count or status, -1 on failure */
+typedef struct IPCResponseSocketResult
+{
+    int32_t lResult;
+} IPCResponseSocketResult_t;
+
 /* Union representing all possible packet data contents */
 typedef union
 {
     IPCResponseSysVersion_t xResponseSysVersion;
     IPCResponseWifiGetMac_t xResponseWifiGetMac;
     IPCRequestWifiConnect_t xRequestWifiConnect;
+    IPCResponseWifiGetLinkInfo_t xResponseWifiGetLinkInfo;
     IPCResponseWifiDisconnect_t xRequestWifiDisconnect;
     IPCRequestWifiBypassSet_t xRequestWifiBypassSet;
     IPCRequestWifiBypassGet_t xRequestWifiBypassGet;
     IPCEventStatus_t xEventStatus;
+    IPCRequestSocketCreate_t xRequestSocketCreate;
+    IPCRequestSocketConnect_t xRequestSocketConnect;
+    IPCRequestSocketSetOpt_t xRequestSocketSetOpt;
+    IPCRequestSocketRecv_t xRequestSocketRecv;
+    IPCRequestSocketClose_t xRequestSocketClose;
+    IPCRequestSocketGetHostByName_t xRequestSocketGetHostByName;
 } IPCPacketData_t;
 
 /* Struct representing packet header (without SPI-specific header) */
@@ -307,7 +484,10 @@ typedef struct
 
 BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
                           PacketBuffer_t * pxPbufIn );
+void prvLinkOutputResume( MxTxBackpressure_t * pxBackpressure,
+                          uint32_t ulTxPacketsWaiting );
 void prvControlPlaneRouter( void * pvParameters );
+BaseType_t prvxDeliverIPCResponse( PacketBuffer_t * pxRxPbuf );
 uint32_t prvGetNextRequestID( void );
 void vDataplaneThread( void * pvParameters );
 
@@ -0,0 +1,712 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include "hw_defs.h"
+#include "kvstore.h"
+#include "sys_evt.h"
+#include "metrics.h"
+#include "time_hwm.h"
+#include "sntp_time.h"
+
+#if ( SNTP_TIME_ENABLED == 1 )
+
+/* The RTC belongs to the secure side in TrustZone builds, as the backup registers */
+    #ifndef TFM_PSA_API
+        #define SNTP_TIME_USE_RTC    1
+    #else
+        #define SNTP_TIME_USE_RTC    0
+    #endif
+
+    #define SNTP_PORT                   123
+    #define SNTP_PACKET_LEN             48
+    #define SNTP_TIMEOUT_MS             1000
+    #define SNTP_RETRY_MIN_S            16
+
+/* Seconds from 1900, the NTP era 0, to 1970 */
+    #define SNTP_UNIX_OFFSET_S          2208988800ULL
+
+    #define SNTP_US_PER_S               1000000ULL
+
+/* Answers below this round trip are not worth waiting for another request */
+    #define SNTP_GOOD_DELAY_US          10000U
+
+/* RTC smooth calibration: one CALM pulse masks one of 2^20 clock cycles, CALP adds 512 pulses */
+    #define SNTP_RTC_PPB_PER_PULSE      954U
+    #define SNTP_RTC_MAX_PULSES         511
+
+/* Earliest time accepted from an RTC, rather than one left at its reset value */
+    #define SNTP_RTC_MIN_UTC_S          1735689600ULL /* 2025-01-01 */
+
+/*
+ * UTC of a monotonic time m, with d = m - ullBaseMonoUs:
+ *
+ *   ullBaseUtcUs + d + d * lFreqPpb / 10^9 + min( d, ullSlewUs ) * lSlewPpb / 10^9
+ *
+ * lSlewPpb makes up for the offset found by the last sync over ullSlewUs, the time until the
+ * next one, so that a missed poll does not keep slewing.
+ */
+    typedef struct
+    {
+        uint64_t ullBaseMonoUs;
+        uint64_t ullBaseUtcUs;
+        uint64_t ullSlewUs;
+        int32_t lFreqPpb;
+        int32_t lSlewPpb;
+    } SntpTimebase_t;
+
+    typedef struct
+    {
+        uint64_t ullMonoUs; /* Middle of the round trip */
+        uint64_t ullUtcUs;  /* Server time at that point */
+        uint32_t ulDelayUs;
+        uint8_t ucStratum;
+    } SntpSample_t;
+
+    static SntpTimebase_t xTimebase = { 0 };
+    static SntpTimeStatus_t xStatus = { 0 };
+
+    static METRIC_COUNTER( xSyncMetric, "sntp_syncs" );
+    static METRIC_COUNTER( xStepMetric, "sntp_steps" );
+    static METRIC_COUNTER( xFailureMetric, "sntp_failures" );
+    static METRIC_HISTOGRAM( xOffsetMetric, "sntp_offset_us" );
+    static METRIC_HISTOGRAM( xDelayMetric, "sntp_delay_us" );
+
+/*-----------------------------------------------------------*/
+
+/* ullValue * lPpb / 10^9, in ms steps so that it does not overflow for centuries */
+    static int64_t llScalePpb( int64_t llValueUs,
+                               int32_t lPpb )
+    {
+        return ( ( llValueUs / 1000 ) * ( int64_t ) lPpb ) / 1000000;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Called within a critical section, or by the SNTP task which alone writes the timebase */
+    static uint64_t ullToUtc( const SntpTimebase_t * pxBase,
+                              uint64_t ullMonoUs )
+    {
+        int64_t llDelta = ( int64_t ) ( ullMonoUs - pxBase->ullBaseMonoUs );
+        int64_t llSlew = ( llDelta < ( int64_t ) pxBase->ullSlewUs ) ? llDelta : ( int64_t ) pxBase->ullSlewUs;
+
+        return pxBase->ullBaseUtcUs + ( uint64_t ) ( llDelta +
+                                                     llScalePpb( llDelta, pxBase->lFreqPpb ) +
+                                                     llScalePpb( llSlew, pxBase->lSlewPpb ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvSetTimebase( const SntpTimebase_t * pxBase )
+    {
+        taskENTER_CRITICAL();
+        xTimebase = *pxBase;
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    uint64_t ullSntpTimeFromMonotonicUs( uint64_t ullMonotonicUs )
+    {
+        SntpTimebase_t xBase;
+
+        taskENTER_CRITICAL();
+        xBase = xTimebase;
+        taskEXIT_CRITICAL();
+
+        return ( xBase.ullBaseUtcUs == 0 ) ? 0 : ullToUtc( &xBase, ullMonotonicUs );
+    }
+
+/*-----------------------------------------------------------*/
+
+    uint64_t ullSntpTimeNowUs( void )
+    {
+        return ullSntpTimeFromMonotonicUs( ullGetMonotonicUs() );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vSntpTimeGetStatus( SntpTimeStatus_t * pxStatus )
+    {
+        taskENTER_CRITICAL();
+        *pxStatus = xStatus;
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Proleptic Gregorian date of lDays since 1970-01-01 */
+    static void prvCivilFromDays( int32_t lDays,
+                                  int32_t * plYear,
+                                  uint32_t * pulMonth,
+                                  uint32_t * pulDay )
+    {
+        int32_t lEra;
+        uint32_t ulDoe;
+        uint32_t ulYoe;
+        uint32_t ulDoy;
+        uint32_t ulMp;
+
+        lDays += 719468;
+        lEra = ( lDays >= 0 ? lDays : lDays - 146096 ) / 146097;
+        ulDoe = ( uint32_t ) ( lDays - lEra * 146097 );
+        ulYoe = ( ulDoe - ulDoe / 1460 + ulDoe / 36524 - ulDoe / 146096 ) / 365;
+        ulDoy = ulDoe - ( 365 * ulYoe + ulYoe / 4 - ulYoe / 100 );
+        ulMp = ( 5 * ulDoy + 2 ) / 153;
+
+        *pulDay = ulDoy - ( 153 * ulMp + 2 ) / 5 + 1;
+        *pulMonth = ( ulMp < 10 ) ? ulMp + 3 : ulMp - 9;
+        *plYear = ( int32_t ) ulYoe + lEra * 400 + ( ( *pulMonth <= 2 ) ? 1 : 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xSntpTimeFormat( uint64_t ullUtcUs,
+                            char * pcBuffer,
+                            size_t xBufferLen )
+    {
+        uint64_t ullSeconds = ullUtcUs / SNTP_US_PER_S;
+        uint32_t ulSecondOfDay = ( uint32_t ) ( ullSeconds % 86400ULL );
+        int32_t lYear;
+        uint32_t ulMonth;
+        uint32_t ulDay;
+        int lLen;
+
+        prvCivilFromDays( ( int32_t ) ( ullSeconds / 86400ULL ), &lYear, &ulMonth, &ulDay );
+
+        lLen = snprintf( pcBuffer, xBufferLen, "%04ld-%02lu-%02luT%02lu:%02lu:%02lu.%06luZ",
+                         ( long ) lYear, ( unsigned long ) ulMonth, ( unsigned long ) ulDay,
+                         ( unsigned long ) ( ulSecondOfDay / 3600U ), ( unsigned long ) ( ( ulSecondOfDay % 3600U ) / 60U ),
+                         ( unsigned long ) ( ulSecondOfDay % 60U ), ( unsigned long ) ( ullUtcUs % SNTP_US_PER_S ) );
+
+        return ( ( lLen < 0 ) || ( ( size_t ) lLen >= xBufferLen ) ) ? 0 : ( size_t ) lLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+    #if ( SNTP_TIME_USE_RTC == 1 )
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+        static int32_t lDaysFromCivil( int32_t lYear,
+                                       uint32_t ulMonth,
+                                       uint32_t ulDay )
+        {
+            int32_t lEra;
+            uint32_t ulYoe;
+            uint32_t ulDoy;
+
+            lYear -= ( ulMonth <= 2 ) ? 1 : 0;
+            lEra = ( lYear >= 0 ? lYear : lYear - 399 ) / 400;
+            ulYoe = ( uint32_t ) ( lYear - lEra * 400 );
+            ulDoy = ( ( 153 * ( ulMonth > 2 ? ulMonth - 3 : ulMonth + 9 ) ) + 2 ) / 5 + ulDay - 1;
+
+            return lEra * 146097 + ( int32_t ) ( ulYoe * 365 + ulYoe / 4 - ulYoe / 100 + ulDoy ) - 719468;
+        }
+
+/*-----------------------------------------------------------*/
+
+/* RTC time in us since 1970, with the monotonic time it was read at, or 0 if the RTC was never set */
+        static uint64_t ullRtcRead( uint64_t * pullMonoUs )
+        {
+            RTC_TimeTypeDef xTime = { 0 };
+            RTC_DateTypeDef xDate = { 0 };
+            uint64_t ullUtcUs = 0;
+
+            if( ( pxHndlRtc != NULL ) && ( ( RTC->ICSR & RTC_ICSR_INITS ) != 0 ) &&
+                ( HAL_RTC_GetTime( pxHndlRtc, &xTime, RTC_FORMAT_BIN ) == HAL_OK ) &&
+                ( HAL_RTC_GetDate( pxHndlRtc, &xDate, RTC_FORMAT_BIN ) == HAL_OK ) ) /* Unlocks the shadow registers */
+            {
+                int32_t lDays = lDaysFromCivil( 2000 + xDate.Year, xDate.Month, xDate.Date );
+                uint64_t ullSeconds = ( ( uint64_t ) lDays * 86400ULL ) + ( xTime.Hours * 3600U ) +
+                                      ( xTime.Minutes * 60U ) + xTime.Seconds;
+
+                *pullMonoUs = ullGetMonotonicUs();
+
+                /* The sub second register counts down from SecondFraction */
+                ullUtcUs = ( ullSeconds * SNTP_US_PER_S ) +
+                           ( ( uint64_t ) ( xTime.SecondFraction - xTime.SubSeconds ) * SNTP_US_PER_S ) /
+                           ( xTime.SecondFraction + 1U );
+            }
+
+            return ( ullUtcUs >= ( SNTP_RTC_MIN_UTC_S * SNTP_US_PER_S ) ) ? ullUtcUs : 0;
+        }
+
+/*-----------------------------------------------------------*/
+
+/* Set the RTC on the next second boundary, as writing the time restarts its sub second counter */
+        static void prvRtcSet( void )
+        {
+            uint64_t ullUtcUs = ullSntpTimeNowUs();
+            uint32_t ulWaitUs = ( uint32_t ) ( SNTP_US_PER_S - ( ullUtcUs % SNTP_US_PER_S ) );
+            RTC_TimeTypeDef xTime = { 0 };
+            RTC_DateTypeDef xDate = { 0 };
+            uint64_t ullSeconds;
+            int32_t lDays;
+            int32_t lYear;
+            uint32_t ulMonth;
+            uint32_t ulDay;
+
+            vTaskDelay( pdMS_TO_TICKS( ulWaitUs / 1000U ) );
+
+            /* Within a tick of the boundary, sooner or later */
+            ullSeconds = ( ullSntpTimeNowUs() + ( SNTP_US_PER_S / 2 ) ) / SNTP_US_PER_S;
+            lDays = ( int32_t ) ( ullSeconds / 86400ULL );
+            prvCivilFromDays( lDays, &lYear, &ulMonth, &ulDay );
+
+            xTime.Hours = ( uint8_t ) ( ( ullSeconds % 86400ULL ) / 3600U );
+            xTime.Minutes = ( uint8_t ) ( ( ullSeconds % 3600U ) / 60U );
+            xTime.Seconds = ( uint8_t ) ( ullSeconds % 60U );
+            xTime.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+            xTime.StoreOperation = RTC_STOREOPERATION_RESET;
+
+            xDate.Year = ( uint8_t ) ( lYear - 2000 );
+            xDate.Month = ( uint8_t ) ulMonth;
+            xDate.Date = ( uint8_t ) ulDay;
+            xDate.WeekDay = ( uint8_t ) ( ( ( lDays + 3 ) % 7 ) + 1 ); /* 1970-01-01 was a Thursday */
+
+            if( ( HAL_RTC_SetTime( pxHndlRtc, &xTime, RTC_FORMAT_BIN ) != HAL_OK ) ||
+                ( HAL_RTC_SetDate( pxHndlRtc, &xDate, RTC_FORMAT_BIN ) != HAL_OK ) )
+            {
+                LogError( "Failed to set the RTC." );
+            }
+        }
+
+/*-----------------------------------------------------------*/
+
+/* Current smooth calibration in ppb, positive when the RTC is sped up */
+        static int32_t lRtcCalibGet( void )
+        {
+            int32_t lPulses = ( ( RTC->CALR & RTC_CALR_CALP ) != 0 ) ? 512 : 0;
+
+            lPulses -= ( int32_t ) ( RTC->CALR & RTC_CALR_CALM );
+
+            return lPulses * ( int32_t ) SNTP_RTC_PPB_PER_PULSE;
+        }
+
+        static void prvRtcCalibSet( int32_t lPpb )
+        {
+            int32_t lPulses = ( lPpb >= 0 ) ? ( lPpb + ( int32_t ) SNTP_RTC_PPB_PER_PULSE / 2 ) / ( int32_t ) SNTP_RTC_PPB_PER_PULSE
+                              : ( lPpb - ( int32_t ) SNTP_RTC_PPB_PER_PULSE / 2 ) / ( int32_t ) SNTP_RTC_PPB_PER_PULSE;
+            uint32_t ulPlus = RTC_SMOOTHCALIB_PLUSPULSES_RESET;
+
+            if( lPulses > 0 )
+            {
+                ulPlus = RTC_SMOOTHCALIB_PLUSPULSES_SET;
+                lPulses = 512 - ( ( lPulses > 512 ) ? 512 : lPulses );
+            }
+            else
+            {
+                lPulses = ( -lPulses > SNTP_RTC_MAX_PULSES ) ? SNTP_RTC_MAX_PULSES : -lPulses;
+            }
+
+            if( HAL_RTCEx_SetSmoothCalib( pxHndlRtc, RTC_SMOOTHCALIB_PERIOD_32SEC, ulPlus, ( uint32_t ) lPulses ) != HAL_OK )
+            {
+                LogError( "Failed to set the RTC calibration." );
+            }
+        }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Compare the RTC with UTC after a sync. Its drift is measured from the first comparison after it
+ * was set or calibrated, and corrected once that is SNTP_TIME_RTC_CALIB_MIN_S old.
+ */
+        static void prvRtcDiscipline( void )
+        {
+            static uint64_t ullRefUtcUs = 0;
+            static int64_t llRefErrorUs = 0;
+            static BaseType_t xRefValid = pdFALSE;
+            uint64_t ullMonoUs = 0;
+            uint64_t ullRtcUs = ullRtcRead( &ullMonoUs );
+            uint64_t ullUtcUs = ullSntpTimeFromMonotonicUs( ullMonoUs );
+            int64_t llErrorUs = ( int64_t ) ( ullRtcUs - ullUtcUs );
+
+            if( pxHndlRtc == NULL )
+            {
+                /* No RTC */
+            }
+            else if( ( ullRtcUs == 0 ) || ( llErrorUs > SNTP_TIME_RTC_MAX_ERROR_US ) || ( llErrorUs < -SNTP_TIME_RTC_MAX_ERROR_US ) )
+            {
+                LogInfo( "Setting the RTC, %lld ms off.", ( ullRtcUs == 0 ) ? 0LL : ( long long ) ( llErrorUs / 1000 ) );
+                prvRtcSet();
+                xRefValid = pdFALSE;
+            }
+            else if( xRefValid == pdFALSE )
+            {
+                ullRefUtcUs = ullUtcUs;
+                llRefErrorUs = llErrorUs;
+                xRefValid = pdTRUE;
+            }
+            else if( ( ullUtcUs - ullRefUtcUs ) >= ( SNTP_TIME_RTC_CALIB_MIN_S * SNTP_US_PER_S ) )
+            {
+                /* Running fast by lDriftPpb, within the 4 ms steps of the RTC sub seconds */
+                int32_t lDriftPpb = ( int32_t ) ( ( ( llErrorUs - llRefErrorUs ) * 1000000LL ) /
+                                                  ( int64_t ) ( ( ullUtcUs - ullRefUtcUs ) / 1000U ) );
+
+                prvRtcCalibSet( lRtcCalibGet() - lDriftPpb );
+                LogInfo( "RTC drift %ld ppb, calibration %ld ppb.", ( long ) lDriftPpb, ( long ) lRtcCalibGet() );
+                xRefValid = pdFALSE;
+            }
+
+            taskENTER_CRITICAL();
+            xStatus.lRtcCalibPpb = ( pxHndlRtc != NULL ) ? lRtcCalibGet() : 0;
+            taskEXIT_CRITICAL();
+        }
+
+    #endif /* SNTP_TIME_USE_RTC == 1 */
+
+/*-----------------------------------------------------------*/
+
+    static void prvWriteTimestamp( uint8_t * pucDest,
+                                   uint64_t ullUnixUs )
+    {
+        uint32_t ulSeconds = ( uint32_t ) ( ( ullUnixUs / SNTP_US_PER_S ) + SNTP_UNIX_OFFSET_S );
+        uint32_t ulFraction = ( uint32_t ) ( ( ( ullUnixUs % SNTP_US_PER_S ) << 32 ) / SNTP_US_PER_S );
+
+        for( size_t i = 0; i < 4; i++ )
+        {
+            pucDest[ i ] = ( uint8_t ) ( ulSeconds >> ( 24 - 8 * i ) );
+            pucDest[ 4 + i ] = ( uint8_t ) ( ulFraction >> ( 24 - 8 * i ) );
+        }
+    }
+
+/* Seconds below 2^31 are taken from era 1, which starts in 2036 */
+    static uint64_t ullReadTimestamp( const uint8_t * pucSrc )
+    {
+        uint32_t ulSeconds = ( ( uint32_t ) pucSrc[ 0 ] << 24 ) | ( ( uint32_t ) pucSrc[ 1 ] << 16 ) |
+                             ( ( uint32_t ) pucSrc[ 2 ] << 8 ) | pucSrc[ 3 ];
+        uint32_t ulFraction = ( ( uint32_t ) pucSrc[ 4 ] << 24 ) | ( ( uint32_t ) pucSrc[ 5 ] << 16 ) |
+                              ( ( uint32_t ) pucSrc[ 6 ] << 8 ) | pucSrc[ 7 ];
+        uint64_t ullSeconds = ulSeconds + ( ( ( ulSeconds & 0x80000000UL ) == 0 ) ? ( 1ULL << 32 ) : 0 );
+
+        return ( ( ullSeconds - SNTP_UNIX_OFFSET_S ) * SNTP_US_PER_S ) +
+               ( ( ( uint64_t ) ulFraction * SNTP_US_PER_S ) >> 32 );
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * One request and its answer. The transmit timestamp of the request is the monotonic time it was
+ * sent at, which the server echoes as the originate timestamp. Answers which do not echo it, from
+ * an unsynchronized server or of a kiss-o'-death are discarded.
+ */
+    static BaseType_t xSntpExchange( int lSock,
+                                     SntpSample_t * pxSample )
+    {
+        uint8_t pucPacket[ SNTP_PACKET_LEN ] = { 0 };
+        uint8_t pucOrigin[ 8 ];
+        uint64_t ullSentUs;
+        uint64_t ullRecvUs;
+        uint64_t ullRxUs;
+        uint64_t ullTxUs;
+        int lLen;
+        BaseType_t xValid = pdFALSE;
+
+        pucPacket[ 0 ] = ( 0 << 6 ) | ( 4 << 3 ) | 3; /* No leap warning, version 4, client */
+
+        ullSentUs = ullGetMonotonicUs();
+        prvWriteTimestamp( pucOrigin, ullSentUs );
+        ( void ) memcpy( &pucPacket[ 40 ], pucOrigin, sizeof( pucOrigin ) );
+
+        if( lwip_send( lSock, pucPacket, sizeof( pucPacket ), 0 ) == ( int ) sizeof( pucPacket ) )
+        {
+            do
+            {
+                lLen = lwip_recv( lSock, pucPacket, sizeof( pucPacket ), 0 );
+                ullRecvUs = ullGetMonotonicUs();
+            } while( ( lLen == ( int ) sizeof( pucPacket ) ) &&
+                     ( memcmp( &pucPacket[ 24 ], pucOrigin, sizeof( pucOrigin ) ) != 0 ) );
+
+            if( ( lLen == ( int ) sizeof( pucPacket ) ) &&
+                ( ( pucPacket[ 0 ] & 0x7U ) == 4U ) &&    /* Server */
+                ( ( pucPacket[ 0 ] >> 6 ) != 3U ) &&      /* Synchronized */
+                ( pucPacket[ 1 ] > 0U ) && ( pucPacket[ 1 ] < 16U ) )
+            {
+                ullRxUs = ullReadTimestamp( &pucPacket[ 32 ] );
+                ullTxUs = ullReadTimestamp( &pucPacket[ 40 ] );
+
+                if( ( ullTxUs >= ullRxUs ) && ( ( ullTxUs - ullRxUs ) <= ( ullRecvUs - ullSentUs ) ) )
+                {
+                    pxSample->ulDelayUs = ( uint32_t ) ( ( ullRecvUs - ullSentUs ) - ( ullTxUs - ullRxUs ) );
+                    pxSample->ullMonoUs = ullSentUs + ( ( ullRecvUs - ullSentUs ) / 2 );
+                    pxSample->ullUtcUs = ullRxUs + ( ( ullTxUs - ullRxUs ) / 2 );
+                    pxSample->ucStratum = pucPacket[ 1 ];
+                    xValid = pdTRUE;
+                }
+            }
+        }
+
+        return xValid;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Best of SNTP_TIME_SAMPLES exchanges with pcServer */
+    static BaseType_t xSntpPoll( const char * pcServer,
+                                 SntpSample_t * pxBest )
+    {
+        const struct addrinfo xHint =
+        {
+            .ai_family   = AF_INET,
+            .ai_socktype = SOCK_DGRAM,
+            .ai_protocol = IPPROTO_UDP,
+        };
+        struct addrinfo * pxAddrInfo = NULL;
+        BaseType_t xValid = pdFALSE;
+        int lSock = -1;
+
+        if( ( lwip_getaddrinfo( pcServer, NULL, &xHint, &pxAddrInfo ) == 0 ) && ( pxAddrInfo != NULL ) )
+        {
+            uint32_t ulTimeoutMs = SNTP_TIMEOUT_MS;
+
+            ( ( struct sockaddr_in * ) pxAddrInfo->ai_addr )->sin_port = lwip_htons( SNTP_PORT );
+
+            lSock = lwip_socket( pxAddrInfo->ai_family, pxAddrInfo->ai_socktype, pxAddrInfo->ai_protocol );
+
+            /* Connected, so that only answers of the server are received */
+            if( ( lSock >= 0 ) &&
+                ( ( lwip_setsockopt( lSock, SOL_SOCKET, SO_RCVTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) ) != 0 ) ||
+                  ( lwip_connect( lSock, pxAddrInfo->ai_addr, pxAddrInfo->ai_addrlen ) != 0 ) ) )
+            {
+                ( void ) lwip_close( lSock );
+                lSock = -1;
+            }
+        }
+        else
+        {
+            LogWarn( "Failed to resolve SNTP server %s.", pcServer );
+        }
+
+        if( pxAddrInfo != NULL )
+        {
+            lwip_freeaddrinfo( pxAddrInfo );
+        }
+
+        for( uint32_t i = 0; ( lSock >= 0 ) && ( i < SNTP_TIME_SAMPLES ); i++ )
+        {
+            SntpSample_t xSample;
+
+            if( xSntpExchange( lSock, &xSample ) == pdTRUE )
+            {
+                vMetricObserve( &xDelayMetric, xSample.ulDelayUs );
+
+                if( ( xValid == pdFALSE ) || ( xSample.ulDelayUs < pxBest->ulDelayUs ) )
+                {
+                    *pxBest = xSample;
+                    xValid = pdTRUE;
+                }
+
+                if( pxBest->ulDelayUs < SNTP_GOOD_DELAY_US )
+                {
+                    break;
+                }
+            }
+        }
+
+        if( lSock >= 0 )
+        {
+            ( void ) lwip_close( lSock );
+        }
+
+        return xValid;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int32_t lClampPpb( int64_t llPpb )
+    {
+        if( llPpb > SNTP_TIME_MAX_RATE_PPB )
+        {
+            llPpb = SNTP_TIME_MAX_RATE_PPB;
+        }
+        else if( llPpb < -SNTP_TIME_MAX_RATE_PPB )
+        {
+            llPpb = -SNTP_TIME_MAX_RATE_PPB;
+        }
+
+        return ( int32_t ) llPpb;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Step or slew to pxSample. ulNextPollS is the time until the next sync, over which the offset is slewed */
+    static void prvSntpApply( const SntpSample_t * pxSample,
+                              uint32_t ulNextPollS )
+    {
+        SntpTimebase_t xBase = xTimebase;
+        uint64_t ullEstimateUs = ( xBase.ullBaseUtcUs == 0 ) ? 0 : ullToUtc( &xBase, pxSample->ullMonoUs );
+        int64_t llOffsetUs = ( ullEstimateUs == 0 ) ? 0 : ( int64_t ) ( pxSample->ullUtcUs - ullEstimateUs );
+        BaseType_t xStep = ( ( xStatus.xSource != eSntpTimeSourceSntp ) ||
+                             ( llOffsetUs >= SNTP_TIME_STEP_US ) || ( llOffsetUs <= -SNTP_TIME_STEP_US ) ) ? pdTRUE : pdFALSE;
+
+        if( xStep == pdTRUE )
+        {
+            LogInfo( "Stepping UTC by %lld ms.", ( long long ) ( llOffsetUs / 1000 ) );
+            xBase.ullBaseUtcUs = pxSample->ullUtcUs;
+            xBase.lSlewPpb = 0;
+            xBase.ullSlewUs = 0;
+            vMetricIncrement( &xStepMetric );
+        }
+        else
+        {
+            uint64_t ullSinceUs = pxSample->ullMonoUs - xStatus.ullLastSyncUs;
+
+            /* What is left once the last offset was slewed out is a frequency error */
+            if( ullSinceUs >= ( SNTP_RETRY_MIN_S * SNTP_US_PER_S ) )
+            {
+                xBase.lFreqPpb = lClampPpb( xBase.lFreqPpb + ( ( llOffsetUs * 1000000LL ) / ( int64_t ) ( ullSinceUs / 1000U ) ) / 2 );
+            }
+
+            xBase.ullBaseUtcUs = ullEstimateUs;
+            xBase.ullSlewUs = ( uint64_t ) ulNextPollS * SNTP_US_PER_S;
+            xBase.lSlewPpb = lClampPpb( ( llOffsetUs * 1000LL ) / ( int64_t ) ulNextPollS );
+        }
+
+        xBase.ullBaseMonoUs = pxSample->ullMonoUs;
+
+        prvSetTimebase( &xBase );
+
+        taskENTER_CRITICAL();
+        xStatus.xSource = eSntpTimeSourceSntp;
+        xStatus.ulSyncs++;
+        xStatus.ulSteps += ( xStep == pdTRUE ) ? 1 : 0;
+        xStatus.ullLastSyncUs = pxSample->ullMonoUs;
+        xStatus.lLastOffsetUs = ( int32_t ) ( ( llOffsetUs > INT32_MAX ) ? INT32_MAX : ( llOffsetUs < -INT32_MAX ) ? -INT32_MAX : llOffsetUs );
+        xStatus.ulLastDelayUs = pxSample->ulDelayUs;
+        xStatus.ucStratum = pxSample->ucStratum;
+        xStatus.lFreqPpb = xBase.lFreqPpb;
+        taskEXIT_CRITICAL();
+
+        if( xStep == pdFALSE )
+        {
+            vMetricObserve( &xOffsetMetric, ( uint32_t ) ( ( llOffsetUs < 0 ) ? -llOffsetUs : llOffsetUs ) );
+        }
+
+        vMetricIncrement( &xSyncMetric );
+
+        vTimeHwmUpdate( ( uint32_t ) ( pxSample->ullUtcUs / SNTP_US_PER_S ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vSntpTimeTask( void * pvParameters )
+    {
+        char pcServer[ 64 ];
+        uint32_t ulRetryS = SNTP_RETRY_MIN_S;
+
+        ( void ) pvParameters;
+
+        vMetricRegister( &xSyncMetric );
+        vMetricRegister( &xStepMetric );
+        vMetricRegister( &xFailureMetric );
+        vMetricRegister( &xOffsetMetric );
+        vMetricRegister( &xDelayMetric );
+
+        #if ( SNTP_TIME_USE_RTC == 1 )
+        {
+            uint64_t ullMonoUs = 0;
+            uint64_t ullRtcUs = ullRtcRead( &ullMonoUs );
+
+            if( ullRtcUs != 0 )
+            {
+                SntpTimebase_t xBase = { .ullBaseMonoUs = ullMonoUs, .ullBaseUtcUs = ullRtcUs };
+
+                prvSetTimebase( &xBase );
+
+                taskENTER_CRITICAL();
+                xStatus.xSource = eSntpTimeSourceRtc;
+                taskEXIT_CRITICAL();
+
+                vTimeHwmUpdate( ( uint32_t ) ( ullRtcUs / SNTP_US_PER_S ) );
+                LogInfo( "UTC from the RTC: %lu s.", ( unsigned long ) ( ullRtcUs / SNTP_US_PER_S ) );
+            }
+
+            xStatus.lRtcCalibPpb = ( pxHndlRtc != NULL ) ? lRtcCalibGet() : 0;
+        }
+        #endif /* SNTP_TIME_USE_RTC == 1 */
+
+        for( ; ; )
+        {
+            SntpSample_t xSample = { 0 };
+            uint32_t ulNextPollS;
+
+            ( void ) xEventGroupWaitBits( xSystemEvents, EVT_MASK_NET_CONNECTED, pdFALSE, pdTRUE, portMAX_DELAY );
+
+            if( ( KVStore_getString( CS_SNTP_SERVER, pcServer, sizeof( pcServer ) ) == 0 ) || ( pcServer[ 0 ] == '\0' ) )
+            {
+                ( void ) strncpy( pcServer, SNTP_TIME_SERVER_DFLT, sizeof( pcServer ) - 1 );
+                pcServer[ sizeof( pcServer ) - 1 ] = '\0';
+            }
+
+            ulNextPollS = ( xStatus.ulSyncs < SNTP_TIME_FAST_SYNCS ) ? SNTP_TIME_FAST_POLL_S : SNTP_TIME_POLL_S;
+
+            if( xSntpPoll( pcServer, &xSample ) == pdTRUE )
+            {
+                prvSntpApply( &xSample, ulNextPollS );
+
+                #if ( SNTP_TIME_USE_RTC == 1 )
+                    prvRtcDiscipline();
+                #endif
+
+                LogDebug( "SNTP offset %ld us, delay %lu us, stratum %u.", ( long ) xStatus.lLastOffsetUs,
+                          ( unsigned long ) xStatus.ulLastDelayUs, ( unsigned int ) xStatus.ucStratum );
+                ulRetryS = SNTP_RETRY_MIN_S;
+            }
+            else
+            {
+                taskENTER_CRITICAL();
+                xStatus.ulFailures++;
+                taskEXIT_CRITICAL();
+
+                vMetricIncrement( &xFailureMetric );
+                LogWarn( "No valid answer from SNTP server %s.", pcServer );
+
+                /* Sooner than a poll, backing off */
+                ulNextPollS = ulRetryS;
+                ulRetryS = ( ulRetryS < ( SNTP_TIME_POLL_S / 2 ) ) ? ulRetryS * 2 : SNTP_TIME_POLL_S;
+            }
+
+            vTaskDelay( pdMS_TO_TICKS( ulNextPollS * 1000U ) );
+        }
+    }
+
+#endif /* SNTP_TIME_ENABLED == 1 */
@@ -0,0 +1,94 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "hw_defs.h"
+#include "metrics.h"
+#include "boot_prof.h"
+
+static uint64_t ullPhaseUs[ BOOT_PHASE_COUNT ] = { 0 };
+
+static METRIC_GAUGE( xFirstPublishMetric, "boot_first_publish_ms" );
+
+/*-----------------------------------------------------------*/
+
+void vBootPhaseMark( BootPhase_t xPhase )
+{
+    if( ( xPhase < BOOT_PHASE_COUNT ) &&
+        ( ullPhaseUs[ xPhase ] == 0 ) )
+    {
+        uint64_t ullNow = ullGetMonotonicUs();
+
+        /* 0 marks a phase not reached yet */
+        ullPhaseUs[ xPhase ] = ( ullNow > 0 ) ? ullNow : 1;
+
+        if( xPhase == BOOT_PHASE_FIRST_PUBLISH )
+        {
+            vMetricRegister( &xFirstPublishMetric );
+            vMetricSet( &xFirstPublishMetric, ( uint32_t ) ( ullNow / 1000U ) );
+
+            LogSys( "First publish %lu ms after reset.", ( uint32_t ) ( ullNow / 1000U ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t ullBootPhaseGetUs( BootPhase_t xPhase )
+{
+    return ( xPhase < BOOT_PHASE_COUNT ) ? ullPhaseUs[ xPhase ] : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcBootPhaseName( BootPhase_t xPhase )
+{
+    static const char * const pcNames[ BOOT_PHASE_COUNT ] =
+    {
+        "hw_init",
+        "scheduler",
+        "fs_mounted",
+        "kv_ready",
+        "lwip_ready",
+        "mx_reset",
+        "mx_ready",
+        "tls_configured",
+        "wifi_up",
+        "dhcp_bound",
+        "tls_connected",
+        "mqtt_connected",
+        "first_publish",
+    };
+
+    return ( xPhase < BOOT_PHASE_COUNT ) ? pcNames[ xPhase ] : "?";
+}
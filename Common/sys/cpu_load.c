@@ -0,0 +1,317 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cpu_load.h"
+#include "periodic_work.h"
+
+#define CPU_LOAD_SAMPLE_MS        ( 1000 )
+
+/* One sample per second for the 1 s and 10 s windows, one every 10 s for the 60 s window */
+#define CPU_LOAD_SHORT_SAMPLES    ( 11 )
+#define CPU_LOAD_LONG_EVERY       ( 10 )
+#define CPU_LOAD_LONG_SAMPLES     ( 7 )
+
+/* Run time counters of one task, or of the whole system, at the latest samples */
+typedef struct
+{
+    uint32_t ulShort[ CPU_LOAD_SHORT_SAMPLES ];
+    uint32_t ulLong[ CPU_LOAD_LONG_SAMPLES ];
+} CpuLoadHistory_t;
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    UBaseType_t uxTaskNumber;
+    BaseType_t xSeen;
+    CpuLoadHistory_t xHistory;
+} CpuLoadSlot_t;
+
+/* Only used by the timer task */
+static TaskStatus_t xTaskStatus[ CPU_LOAD_MAX_TASKS ];
+static CpuLoadSlot_t xSlots[ CPU_LOAD_MAX_TASKS ];
+static CpuLoadHistory_t xTotalHistory;
+static uint32_t ulSamples = 0;
+static BaseType_t xTooManyTasks = pdFALSE;
+
+/* Loads of the sample being taken */
+static CpuLoadTask_t xLoadsNext[ CPU_LOAD_MAX_TASKS ];
+
+/* Loads of the latest sample, copied in critical sections */
+static CpuLoadTask_t xLoads[ CPU_LOAD_MAX_TASKS ];
+static UBaseType_t uxLoadCount = 0;
+static uint16_t usBusyPermille[ CPU_LOAD_WINDOWS ] = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static void prvHistoryFill( CpuLoadHistory_t * pxHistory,
+                            uint32_t ulValue )
+{
+    for( uint32_t i = 0; i < CPU_LOAD_SHORT_SAMPLES; i++ )
+    {
+        pxHistory->ulShort[ i ] = ulValue;
+    }
+
+    for( uint32_t i = 0; i < CPU_LOAD_LONG_SAMPLES; i++ )
+    {
+        pxHistory->ulLong[ i ] = ulValue;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Store ulValue as sample ulSample, and write the counter increase over each window to pulDelta */
+static void prvHistoryUpdate( CpuLoadHistory_t * pxHistory,
+                              uint32_t ulSample,
+                              uint32_t ulValue,
+                              uint32_t pulDelta[ CPU_LOAD_WINDOWS ] )
+{
+    uint32_t ulLong = ulSample / CPU_LOAD_LONG_EVERY;
+
+    pxHistory->ulShort[ ulSample % CPU_LOAD_SHORT_SAMPLES ] = ulValue;
+
+    if( ( ulSample % CPU_LOAD_LONG_EVERY ) == 0 )
+    {
+        pxHistory->ulLong[ ulLong % CPU_LOAD_LONG_SAMPLES ] = ulValue;
+    }
+
+    /* The oldest entry of each ring is the start of its window, the counters wrap */
+    pulDelta[ 0 ] = ulValue - pxHistory->ulShort[ ( ulSample + CPU_LOAD_SHORT_SAMPLES - 1 ) % CPU_LOAD_SHORT_SAMPLES ];
+    pulDelta[ 1 ] = ulValue - pxHistory->ulShort[ ( ulSample + 1 ) % CPU_LOAD_SHORT_SAMPLES ];
+    pulDelta[ 2 ] = ulValue - pxHistory->ulLong[ ( ulLong + 1 ) % CPU_LOAD_LONG_SAMPLES ];
+}
+
+/*-----------------------------------------------------------*/
+
+static CpuLoadSlot_t * pxSlotGet( const TaskStatus_t * pxStatus,
+                                  uint32_t ulRunTime )
+{
+    CpuLoadSlot_t * pxSlot = NULL;
+    CpuLoadSlot_t * pxFree = NULL;
+
+    for( uint32_t i = 0; ( i < CPU_LOAD_MAX_TASKS ) && ( pxSlot == NULL ); i++ )
+    {
+        /* The task number tells a new task apart from a deleted one with the same handle */
+        if( ( xSlots[ i ].xHandle == pxStatus->xHandle ) &&
+            ( xSlots[ i ].uxTaskNumber == pxStatus->xTaskNumber ) )
+        {
+            pxSlot = &xSlots[ i ];
+        }
+        else if( ( xSlots[ i ].xHandle == NULL ) && ( pxFree == NULL ) )
+        {
+            pxFree = &xSlots[ i ];
+        }
+    }
+
+    if( ( pxSlot == NULL ) && ( pxFree != NULL ) )
+    {
+        /* The load of a new task is counted from its first sample */
+        pxSlot = pxFree;
+        pxSlot->xHandle = pxStatus->xHandle;
+        pxSlot->uxTaskNumber = pxStatus->xTaskNumber;
+        prvHistoryFill( &pxSlot->xHistory, ulRunTime );
+    }
+
+    return pxSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t usPermille( uint32_t ulPart,
+                            uint32_t ulTotal )
+{
+    uint16_t usResult = 0;
+
+    if( ulTotal > 0 )
+    {
+        uint64_t ullPermille = ( ( uint64_t ) ulPart * 1000 ) / ulTotal;
+
+        usResult = ( ullPermille > 1000 ) ? 1000 : ( uint16_t ) ullPermille;
+    }
+
+    return usResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCpuLoadSample( void * pvCtx )
+{
+    uint32_t ulTotal = 0;
+    uint32_t ulTotalDelta[ CPU_LOAD_WINDOWS ];
+    UBaseType_t uxTasks;
+    UBaseType_t uxLoads = 0;
+    uint16_t usBusy[ CPU_LOAD_WINDOWS ] = { 1000, 1000, 1000 };
+
+    ( void ) pvCtx;
+
+    uxTasks = uxTaskGetSystemState( xTaskStatus, CPU_LOAD_MAX_TASKS, &ulTotal );
+
+    if( uxTasks == 0 )
+    {
+        if( xTooManyTasks == pdFALSE )
+        {
+            LogWarn( "More than %d tasks, CPU load is not sampled.", CPU_LOAD_MAX_TASKS );
+            xTooManyTasks = pdTRUE;
+        }
+    }
+    else
+    {
+        TaskHandle_t xIdleTask = xTaskGetIdleTaskHandle();
+
+        xTooManyTasks = pdFALSE;
+
+        if( ulSamples == 0 )
+        {
+            prvHistoryFill( &xTotalHistory, ulTotal );
+        }
+
+        prvHistoryUpdate( &xTotalHistory, ulSamples, ulTotal, ulTotalDelta );
+
+        for( uint32_t i = 0; i < CPU_LOAD_MAX_TASKS; i++ )
+        {
+            xSlots[ i ].xSeen = pdFALSE;
+        }
+
+        for( UBaseType_t i = 0; i < uxTasks; i++ )
+        {
+            CpuLoadSlot_t * pxSlot = pxSlotGet( &xTaskStatus[ i ], xTaskStatus[ i ].ulRunTimeCounter );
+
+            if( pxSlot != NULL )
+            {
+                uint32_t ulDelta[ CPU_LOAD_WINDOWS ];
+                CpuLoadTask_t * pxLoad = &xLoadsNext[ uxLoads ];
+
+                pxSlot->xSeen = pdTRUE;
+
+                prvHistoryUpdate( &pxSlot->xHistory, ulSamples, xTaskStatus[ i ].ulRunTimeCounter, ulDelta );
+
+                pxLoad->xHandle = xTaskStatus[ i ].xHandle;
+                ( void ) strncpy( pxLoad->pcName, xTaskStatus[ i ].pcTaskName, configMAX_TASK_NAME_LEN - 1 );
+                pxLoad->pcName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+
+                for( uint32_t ulWindow = 0; ulWindow < CPU_LOAD_WINDOWS; ulWindow++ )
+                {
+                    pxLoad->usPermille[ ulWindow ] = usPermille( ulDelta[ ulWindow ], ulTotalDelta[ ulWindow ] );
+
+                    if( xTaskStatus[ i ].xHandle == xIdleTask )
+                    {
+                        usBusy[ ulWindow ] -= pxLoad->usPermille[ ulWindow ];
+                    }
+                }
+
+                uxLoads++;
+            }
+        }
+
+        /* Slots of deleted tasks are reused */
+        for( uint32_t i = 0; i < CPU_LOAD_MAX_TASKS; i++ )
+        {
+            if( xSlots[ i ].xSeen == pdFALSE )
+            {
+                xSlots[ i ].xHandle = NULL;
+            }
+        }
+
+        taskENTER_CRITICAL();
+        ( void ) memcpy( xLoads, xLoadsNext, uxLoads * sizeof( CpuLoadTask_t ) );
+        uxLoadCount = uxLoads;
+        ( void ) memcpy( usBusyPermille, usBusy, sizeof( usBusyPermille ) );
+        taskEXIT_CRITICAL();
+
+        ulSamples++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vCpuLoadInit( void )
+{
+    static PeriodicWork_t xSampleWork;
+
+    /* The load is computed from run time counter deltas, so a late sample only widens its window */
+    vPeriodicWorkStartCallback( &xSampleWork, prvCpuLoadSample, NULL,
+                                pdMS_TO_TICKS( CPU_LOAD_SAMPLE_MS ), pdMS_TO_TICKS( CPU_LOAD_SAMPLE_MS / 10 ) );
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxCpuLoadGet( CpuLoadTask_t * pxTasks,
+                          UBaseType_t uxMaxTasks,
+                          uint16_t pusBusyPermille[ CPU_LOAD_WINDOWS ] )
+{
+    UBaseType_t uxCount;
+
+    taskENTER_CRITICAL();
+
+    uxCount = ( uxLoadCount < uxMaxTasks ) ? uxLoadCount : uxMaxTasks;
+
+    if( uxCount > 0 )
+    {
+        ( void ) memcpy( pxTasks, xLoads, uxCount * sizeof( CpuLoadTask_t ) );
+    }
+
+    if( pusBusyPermille != NULL )
+    {
+        ( void ) memcpy( pusBusyPermille, usBusyPermille, sizeof( usBusyPermille ) );
+    }
+
+    taskEXIT_CRITICAL();
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCpuLoadGetTask( TaskHandle_t xTask,
+                            uint16_t pusPermille[ CPU_LOAD_WINDOWS ] )
+{
+    BaseType_t xFound = pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    for( UBaseType_t i = 0; ( i < uxLoadCount ) && ( xFound == pdFALSE ); i++ )
+    {
+        if( xLoads[ i ].xHandle == xTask )
+        {
+            ( void ) memcpy( pusPermille, xLoads[ i ].usPermille, sizeof( xLoads[ i ].usPermille ) );
+            xFound = pdTRUE;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    return xFound;
+}
@@ -0,0 +1,583 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include "dma_copy.h"
+
+#if ( DMA_COPY_ENABLED == 1 )
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "lowpower.h"
+
+#define DMA_COPY_CHANNELS          ( 2U )
+
+#define DMA_COPY_RESULT_BUSY       ( 0UL )
+#define DMA_COPY_RESULT_DONE       ( 1UL )
+#define DMA_COPY_RESULT_ERROR      ( 2UL )
+
+/* Largest GPDMA block, a multiple of every transfer width */
+#define DMA_COPY_BLOCK_MAX         ( 0xFFFCU )
+
+/* Same values as in mx_dataplane.c, DCACHE1 covers the OCTOSPI / FMC regions */
+#define DMA_CACHE_LINE_SIZE        ( 32UL )
+#define DMA_CACHE_REGION_START     ( 0x60000000UL )
+#define DMA_CACHE_REGION_END       ( 0xA0000000UL )
+
+typedef struct
+{
+    DMA_HandleTypeDef xHandle;       /* First, so that a HAL callback can find its channel */
+    uint32_t ulIndex;
+    TaskHandle_t xOwner;             /* NULL while the channel is free */
+    uint8_t * volatile pucDst;       /* Next block, only changed by the completion interrupt once started */
+    const uint8_t * volatile pucSrc;
+    volatile size_t xRemaining;      /* Bytes left for DMA after the block in progress */
+    volatile uint32_t ulResult;
+    uint8_t * pucCopyDst;            /* Whole copy, for the cache maintenance and the stats */
+    size_t xCopyLen;
+} DmaCopyChannel_t;
+
+static DmaCopyChannel_t xChannels[ DMA_COPY_CHANNELS ] =
+{
+    { .xHandle = { .Instance = GPDMA1_Channel14 }, .ulIndex = 0 },
+    { .xHandle = { .Instance = GPDMA1_Channel15 }, .ulIndex = 1 },
+};
+
+static const IRQn_Type xChannelIrqs[ DMA_COPY_CHANNELS ] =
+{
+    GPDMA1_Channel14_IRQn,
+    GPDMA1_Channel15_IRQn,
+};
+
+static BaseType_t xCopyReady = pdFALSE;
+
+/* Handles of the driver the channels are lent to, NULL while the copies own them */
+static DMA_HandleTypeDef * volatile pxLentHandles[ DMA_COPY_CHANNELS ] = { NULL };
+
+/* Only changed in critical sections */
+static DmaCopyStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static inline void vChannelIRQHandler( uint32_t ulIndex )
+{
+    DMA_HandleTypeDef * pxHandle = pxLentHandles[ ulIndex ];
+
+    if( pxHandle == NULL )
+    {
+        pxHandle = &( xChannels[ ulIndex ].xHandle );
+    }
+
+    HAL_DMA_IRQHandler( pxHandle );
+}
+
+void GPDMA1_Channel14_IRQHandler( void )
+{
+    vChannelIRQHandler( 0 );
+}
+
+void GPDMA1_Channel15_IRQHandler( void )
+{
+    vChannelIRQHandler( 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline BaseType_t xIsCacheableBuffer( const void * pvBuffer )
+{
+    uint32_t ulAddr = ( uint32_t ) pvBuffer;
+
+    return( ( pxHndlDCache != NULL ) &&
+            ( ulAddr >= DMA_CACHE_REGION_START ) &&
+            ( ulAddr < DMA_CACHE_REGION_END ) );
+}
+
+static inline void vAlignToCacheLines( const void * pvBuffer,
+                                       size_t xLen,
+                                       uint32_t ** ppulAlignedAddr,
+                                       uint32_t * pulAlignedLen )
+{
+    uint32_t ulStart = ( ( uint32_t ) pvBuffer ) & ~( DMA_CACHE_LINE_SIZE - 1 );
+    uint32_t ulEnd = ( ( uint32_t ) pvBuffer + xLen + DMA_CACHE_LINE_SIZE - 1 ) & ~( DMA_CACHE_LINE_SIZE - 1 );
+
+    *ppulAlignedAddr = ( uint32_t * ) ulStart;
+    *pulAlignedLen = ulEnd - ulStart;
+}
+
+void vDmaCacheClean( const void * pvBuffer,
+                     size_t xLen )
+{
+    uint32_t * pulAddr = NULL;
+    uint32_t ulLen = 0;
+
+    if( ( pvBuffer != NULL ) &&
+        ( xLen > 0 ) &&
+        ( xIsCacheableBuffer( pvBuffer ) == pdTRUE ) )
+    {
+        vAlignToCacheLines( pvBuffer, xLen, &pulAddr, &ulLen );
+        ( void ) HAL_DCACHE_CleanByAddr( pxHndlDCache, pulAddr, ulLen );
+    }
+}
+
+void vDmaCacheInvalidate( void * pvBuffer,
+                          size_t xLen )
+{
+    uint32_t * pulAddr = NULL;
+    uint32_t ulLen = 0;
+
+    if( ( pvBuffer != NULL ) &&
+        ( xLen > 0 ) &&
+        ( xIsCacheableBuffer( pvBuffer ) == pdTRUE ) )
+    {
+        vAlignToCacheLines( pvBuffer, xLen, &pulAddr, &ulLen );
+        ( void ) HAL_DCACHE_InvalidateByAddr( pxHndlDCache, pulAddr, ulLen );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef xStartBlock( DmaCopyChannel_t * pxChannel )
+{
+    size_t xBlockLen = ( pxChannel->xRemaining > DMA_COPY_BLOCK_MAX ) ? DMA_COPY_BLOCK_MAX : pxChannel->xRemaining;
+    HAL_StatusTypeDef xStatus;
+
+    xStatus = HAL_DMA_Start_IT( &( pxChannel->xHandle ), ( uint32_t ) pxChannel->pucSrc,
+                                ( uint32_t ) pxChannel->pucDst, ( uint32_t ) xBlockLen );
+
+    if( xStatus == HAL_OK )
+    {
+        pxChannel->pucSrc += xBlockLen;
+        pxChannel->pucDst += xBlockLen;
+        pxChannel->xRemaining -= xBlockLen;
+    }
+
+    return xStatus;
+}
+
+static void prvCopyEndFromISR( DmaCopyChannel_t * pxChannel,
+                               uint32_t ulResult )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    pxChannel->ulResult = ulResult;
+
+    ( void ) xTaskNotifyIndexedFromISR( pxChannel->xOwner, DMA_COPY_NOTIFY_IDX, ( 1UL << pxChannel->ulIndex ),
+                                        eSetBits, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+/* Start the next block of the copy straight from the completion interrupt */
+static void prvCopyCompleteCallback( DMA_HandleTypeDef * pxHdma )
+{
+    DmaCopyChannel_t * pxChannel = ( DmaCopyChannel_t * ) pxHdma;
+
+    if( pxChannel->xRemaining == 0 )
+    {
+        prvCopyEndFromISR( pxChannel, DMA_COPY_RESULT_DONE );
+    }
+    else if( xStartBlock( pxChannel ) != HAL_OK )
+    {
+        prvCopyEndFromISR( pxChannel, DMA_COPY_RESULT_ERROR );
+    }
+}
+
+static void prvCopyErrorCallback( DMA_HandleTypeDef * pxHdma )
+{
+    prvCopyEndFromISR( ( DmaCopyChannel_t * ) pxHdma, DMA_COPY_RESULT_ERROR );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyInit( void )
+{
+    BaseType_t xResult = pdTRUE;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    for( uint32_t i = 0; ( i < DMA_COPY_CHANNELS ) && ( xResult == pdTRUE ); i++ )
+    {
+        DMA_HandleTypeDef * pxHandle = &( xChannels[ i ].xHandle );
+
+        pxHandle->Init.Request = DMA_REQUEST_SW;
+        pxHandle->Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+        pxHandle->Init.Direction = DMA_MEMORY_TO_MEMORY;
+        pxHandle->Init.SrcInc = DMA_SINC_INCREMENTED;
+        pxHandle->Init.DestInc = DMA_DINC_INCREMENTED;
+        pxHandle->Init.SrcDataWidth = DMA_SRC_DATAWIDTH_WORD;
+        pxHandle->Init.DestDataWidth = DMA_DEST_DATAWIDTH_WORD;
+        pxHandle->Init.Priority = DMA_LOW_PRIORITY_LOW_WEIGHT;
+        pxHandle->Init.SrcBurstLength = 1;
+        pxHandle->Init.DestBurstLength = 1;
+        pxHandle->Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+        pxHandle->Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        pxHandle->Init.Mode = DMA_NORMAL;
+
+        if( ( HAL_DMA_Init( pxHandle ) != HAL_OK ) ||
+            ( HAL_DMA_ConfigChannelAttributes( pxHandle, DMA_CHANNEL_NPRIV ) != HAL_OK ) ||
+            ( HAL_DMA_RegisterCallback( pxHandle, HAL_DMA_XFER_CPLT_CB_ID, prvCopyCompleteCallback ) != HAL_OK ) ||
+            ( HAL_DMA_RegisterCallback( pxHandle, HAL_DMA_XFER_ERROR_CB_ID, prvCopyErrorCallback ) != HAL_OK ) )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            HAL_NVIC_SetPriority( xChannelIrqs[ i ], 5, 3 );
+            HAL_NVIC_EnableIRQ( xChannelIrqs[ i ] );
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xCopyReady = pdTRUE;
+    }
+    else
+    {
+        LogError( "Failed to set up the GPDMA copy channels." );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Widest transfer, in bytes, for which pvDst and pvSrc have the same alignment */
+static uint32_t ulCopyWidth( const void * pvDst,
+                             const void * pvSrc )
+{
+    uint32_t ulDst = ( uint32_t ) pvDst;
+    uint32_t ulSrc = ( uint32_t ) pvSrc;
+    uint32_t ulWidth = 0;
+
+    /* With the same misalignment the CPU copies the first bytes, up to an aligned address */
+    if( ( ( ulDst ^ ulSrc ) & 0x3U ) == 0 )
+    {
+        ulWidth = 4;
+    }
+    else if( ( ( ulDst ^ ulSrc ) & 0x1U ) == 0 )
+    {
+        ulWidth = 2;
+    }
+    else
+    {
+        ulWidth = 1;
+    }
+
+    return ulWidth;
+}
+
+static void vSetCopyWidth( DmaCopyChannel_t * pxChannel,
+                           uint32_t ulWidth )
+{
+    uint32_t ulSrcWidth = DMA_SRC_DATAWIDTH_BYTE;
+    uint32_t ulDstWidth = DMA_DEST_DATAWIDTH_BYTE;
+
+    if( ulWidth == 4 )
+    {
+        ulSrcWidth = DMA_SRC_DATAWIDTH_WORD;
+        ulDstWidth = DMA_DEST_DATAWIDTH_WORD;
+    }
+    else if( ulWidth == 2 )
+    {
+        ulSrcWidth = DMA_SRC_DATAWIDTH_HALFWORD;
+        ulDstWidth = DMA_DEST_DATAWIDTH_HALFWORD;
+    }
+
+    /* The channel is disabled between copies, CTR1 is only read when a block starts */
+    MODIFY_REG( pxChannel->xHandle.Instance->CTR1,
+                ( DMA_CTR1_SDW_LOG2 | DMA_CTR1_DDW_LOG2 ),
+                ( ulSrcWidth | ulDstWidth ) );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyStart( void * pvDst,
+                          const void * pvSrc,
+                          size_t xLen,
+                          DmaCopy_t * pxCopy )
+{
+    DmaCopyChannel_t * pxChannel = NULL;
+    uint8_t * pucDst = ( uint8_t * ) pvDst;
+    const uint8_t * pucSrc = ( const uint8_t * ) pvSrc;
+    uint32_t ulWidth = 0;
+    size_t xHead = 0;
+    size_t xDmaLen = 0;
+
+    configASSERT( pxCopy != NULL );
+    configASSERT( ( pvDst != NULL ) && ( pvSrc != NULL ) );
+
+    if( ( xCopyReady != pdTRUE ) ||
+        ( xLen < DMA_COPY_THRESHOLD ) )
+    {
+        return pdFALSE;
+    }
+
+    ulWidth = ulCopyWidth( pvDst, pvSrc );
+
+    if( ulWidth == 1 )
+    {
+        /* Byte transfers move no more data per bus access than the CPU would */
+        return pdFALSE;
+    }
+
+    xHead = ( ulWidth - ( ( ( uint32_t ) pucDst ) & ( ulWidth - 1 ) ) ) & ( ulWidth - 1 );
+    xDmaLen = ( xLen - xHead ) & ~( ( size_t ) ulWidth - 1 );
+
+    taskENTER_CRITICAL();
+
+    for( uint32_t i = 0; ( i < DMA_COPY_CHANNELS ) && ( pxChannel == NULL ); i++ )
+    {
+        if( xChannels[ i ].xOwner == NULL )
+        {
+            pxChannel = &( xChannels[ i ] );
+            pxChannel->xOwner = xTaskGetCurrentTaskHandle();
+        }
+    }
+
+    if( pxChannel == NULL )
+    {
+        xStats.ulBusy++;
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( pxChannel == NULL )
+    {
+        return pdFALSE;
+    }
+
+    /* The bytes before the first aligned address and after the last whole transfer */
+    if( xHead > 0 )
+    {
+        ( void ) memcpy( pucDst, pucSrc, xHead );
+    }
+
+    if( ( xHead + xDmaLen ) < xLen )
+    {
+        ( void ) memcpy( &( pucDst[ xHead + xDmaLen ] ), &( pucSrc[ xHead + xDmaLen ] ), xLen - ( xHead + xDmaLen ) );
+    }
+
+    vDmaCacheClean( &( pucSrc[ xHead ] ), xDmaLen );
+    vDmaCacheClean( &( pucDst[ xHead ] ), xDmaLen );
+
+    vSetCopyWidth( pxChannel, ulWidth );
+
+    /* Drop a result left over from an aborted copy */
+    ( void ) ulTaskNotifyValueClearIndexed( NULL, DMA_COPY_NOTIFY_IDX, ( 1UL << pxChannel->ulIndex ) );
+
+    /* GPDMA1 stops in STOP2 */
+    vLowPowerInhibit();
+
+    pxChannel->pucCopyDst = &( pucDst[ xHead ] );
+    pxChannel->xCopyLen = xDmaLen;
+    pxChannel->pucDst = pxChannel->pucCopyDst;
+    pxChannel->pucSrc = &( pucSrc[ xHead ] );
+    pxChannel->xRemaining = xDmaLen;
+    pxChannel->ulResult = DMA_COPY_RESULT_BUSY;
+
+    pxCopy->ulChannel = pxChannel->ulIndex;
+
+    if( xStartBlock( pxChannel ) != HAL_OK )
+    {
+        pxChannel->ulResult = DMA_COPY_RESULT_ERROR;
+        ( void ) xTaskNotifyIndexed( pxChannel->xOwner, DMA_COPY_NOTIFY_IDX, ( 1UL << pxChannel->ulIndex ), eSetBits );
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyWait( DmaCopy_t * pxCopy,
+                         TickType_t xTimeout )
+{
+    BaseType_t xResult = pdFALSE;
+    DmaCopyChannel_t * pxChannel = NULL;
+    uint32_t ulBit = 0;
+    TimeOut_t xTimeOut;
+
+    configASSERT( pxCopy != NULL );
+    configASSERT( pxCopy->ulChannel < DMA_COPY_CHANNELS );
+
+    pxChannel = &( xChannels[ pxCopy->ulChannel ] );
+    ulBit = ( 1UL << pxChannel->ulIndex );
+
+    configASSERT( pxChannel->xOwner == xTaskGetCurrentTaskHandle() );
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    /*
+     * The bits of other copies started by this task stay set. The notification state is only
+     * a wake up, the bit of this channel in the value tells that the copy ended.
+     */
+    while( ( ulTaskNotifyValueClearIndexed( NULL, DMA_COPY_NOTIFY_IDX, ulBit ) & ulBit ) == 0 )
+    {
+        if( ( xTaskCheckForTimeOut( &xTimeOut, &xTimeout ) == pdTRUE ) ||
+            ( xTaskNotifyWaitIndexed( DMA_COPY_NOTIFY_IDX, 0, 0, NULL, xTimeout ) == pdFALSE ) )
+        {
+            /* Stop the channel before the completion interrupt can start another block */
+            HAL_NVIC_DisableIRQ( xChannelIrqs[ pxChannel->ulIndex ] );
+            ( void ) HAL_DMA_Abort( &( pxChannel->xHandle ) );
+            HAL_NVIC_ClearPendingIRQ( xChannelIrqs[ pxChannel->ulIndex ] );
+            HAL_NVIC_EnableIRQ( xChannelIrqs[ pxChannel->ulIndex ] );
+
+            ( void ) ulTaskNotifyValueClearIndexed( NULL, DMA_COPY_NOTIFY_IDX, ulBit );
+
+            LogError( "DMA copy on channel %u timed out, %u bytes left.",
+                      ( unsigned int ) pxChannel->ulIndex, ( unsigned int ) pxChannel->xRemaining );
+
+            pxChannel->ulResult = DMA_COPY_RESULT_ERROR;
+            break;
+        }
+    }
+
+    vDmaCacheInvalidate( pxChannel->pucCopyDst, pxChannel->xCopyLen );
+
+    vLowPowerRelease();
+
+    xResult = ( pxChannel->ulResult == DMA_COPY_RESULT_DONE ) ? pdTRUE : pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    if( xResult == pdTRUE )
+    {
+        xStats.ulCopies++;
+        xStats.ulBytes += pxChannel->xCopyLen;
+    }
+    else
+    {
+        xStats.ulErrors++;
+    }
+
+    pxChannel->xOwner = NULL;
+
+    taskEXIT_CRITICAL();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvDmaCopy( void * pvDst,
+                  const void * pvSrc,
+                  size_t xLen )
+{
+    DmaCopy_t xCopy;
+
+    if( xLen < DMA_COPY_THRESHOLD )
+    {
+        ( void ) memcpy( pvDst, pvSrc, xLen );
+    }
+    else if( xDmaCopyStart( pvDst, pvSrc, xLen, &xCopy ) != pdTRUE )
+    {
+        ( void ) memcpy( pvDst, pvSrc, xLen );
+
+        taskENTER_CRITICAL();
+        xStats.ulCpuCopies++;
+        taskEXIT_CRITICAL();
+    }
+    else if( xDmaCopyWait( &xCopy, portMAX_DELAY ) != pdTRUE )
+    {
+        /* The buffers are still valid, finish with the CPU */
+        ( void ) memcpy( pvDst, pvSrc, xLen );
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+void vDmaCopyGetStats( DmaCopyStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xStats;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyLend( DMA_HandleTypeDef * pxHandle0,
+                         DMA_HandleTypeDef * pxHandle1 )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( ( pxHandle0 != NULL ) && ( pxHandle1 != NULL ) );
+
+    taskENTER_CRITICAL();
+
+    if( ( xChannels[ 0 ].xOwner == NULL ) &&
+        ( xChannels[ 1 ].xOwner == NULL ) )
+    {
+        /* An owner keeps xDmaCopyStart off the channels */
+        xChannels[ 0 ].xOwner = xTaskGetCurrentTaskHandle();
+        xChannels[ 1 ].xOwner = xChannels[ 0 ].xOwner;
+        pxLentHandles[ 0 ] = pxHandle0;
+        pxLentHandles[ 1 ] = pxHandle1;
+        xResult = pdTRUE;
+    }
+
+    taskEXIT_CRITICAL();
+
+    return xResult;
+}
+
+void vDmaCopyReturn( void )
+{
+    configASSERT( xChannels[ 0 ].xOwner == xTaskGetCurrentTaskHandle() );
+
+    taskENTER_CRITICAL();
+    pxLentHandles[ 0 ] = NULL;
+    pxLentHandles[ 1 ] = NULL;
+    taskEXIT_CRITICAL();
+
+    /* The borrower programmed the channels for its peripheral requests */
+    for( uint32_t i = 0; ( i < DMA_COPY_CHANNELS ) && ( xCopyReady == pdTRUE ); i++ )
+    {
+        if( HAL_DMA_Init( &( xChannels[ i ].xHandle ) ) != HAL_OK )
+        {
+            LogError( "Failed to set up GPDMA copy channel %u again, copies use the CPU.", ( unsigned int ) i );
+            xCopyReady = pdFALSE;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    xChannels[ 0 ].xOwner = NULL;
+    xChannels[ 1 ].xOwner = NULL;
+    taskEXIT_CRITICAL();
+}
+
+#endif /* DMA_COPY_ENABLED == 1 */
@@ -0,0 +1,261 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "dvfs.h"
+
+#if ( DVFS_ENABLED == 1 )
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "cpu_load.h"
+#include "metrics.h"
+#include "periodic_work.h"
+
+/* All of the state below is only changed in critical sections */
+static uint16_t pusRequests[ DVFS_CLIENT_MAX ] = { 0 };
+static uint32_t ulRequests = 0;    /* Sum of pusRequests */
+static TickType_t xLastRelease = 0; /* Tick at which the last request was released */
+static uint32_t ulQuietSamples = 0;
+
+static TickType_t xLevelSince = 0;
+static uint32_t ulHighMs = 0;
+static uint32_t ulLowMs = 0;
+static uint32_t ulSwitches = 0;
+static uint32_t ulErrors = 0;
+
+static METRIC_GAUGE( xLevelMetric, "dvfs_level" );
+static METRIC_COUNTER( xSwitchesMetric, "dvfs_switches" );
+
+/*-----------------------------------------------------------*/
+
+/* Called in a critical section */
+static void prvAccountLevel( TickType_t xNow )
+{
+    uint32_t ulMs = ( uint32_t ) ( xNow - xLevelSince ) * portTICK_PERIOD_MS;
+
+    if( hw_clock_get_level() == HW_CLOCK_LEVEL_HIGH )
+    {
+        ulHighMs += ulMs;
+    }
+    else
+    {
+        ulLowMs += ulMs;
+    }
+
+    xLevelSince = xNow;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called in a critical section */
+static void prvSetLevel( HwClockLevel_t xLevel )
+{
+    if( hw_clock_get_level() != xLevel )
+    {
+        TickType_t xNow = xTaskGetTickCount();
+        HAL_StatusTypeDef xResult;
+
+        prvAccountLevel( xNow );
+
+        xResult = hw_clock_set_level( xLevel );
+
+        /* A failed switch may still have changed the level, the next request or sample retries it */
+        if( xResult != HAL_OK )
+        {
+            ulErrors++;
+        }
+
+        if( hw_clock_get_level() == xLevel )
+        {
+            ulSwitches++;
+            vMetricIncrement( &xSwitchesMetric );
+        }
+
+        vMetricSet( &xLevelMetric, ( uint32_t ) hw_clock_get_level() );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDvfsSample( void * pvCtx )
+{
+    uint16_t pusBusy[ CPU_LOAD_WINDOWS ] = { 0 };
+    uint16_t usThreshold;
+
+    ( void ) pvCtx;
+
+    ( void ) uxCpuLoadGet( NULL, 0, pusBusy );
+
+    taskENTER_CRITICAL();
+
+    /* The same work takes more than three times the CPU time at the low level */
+    usThreshold = ( hw_clock_get_level() == HW_CLOCK_LEVEL_LOW ) ? DVFS_UP_PERMILLE : DVFS_DOWN_PERMILLE;
+
+    if( pusBusy[ 0 ] > usThreshold )
+    {
+        ulQuietSamples = 0;
+
+        if( pusRequests[ DVFS_CLIENT_LOAD ] == 0 )
+        {
+            pusRequests[ DVFS_CLIENT_LOAD ] = 1;
+            ulRequests++;
+        }
+    }
+    else if( pusRequests[ DVFS_CLIENT_LOAD ] > 0 )
+    {
+        ulQuietSamples++;
+
+        if( ulQuietSamples >= DVFS_DOWN_SAMPLES )
+        {
+            pusRequests[ DVFS_CLIENT_LOAD ] = 0;
+            ulRequests--;
+
+            if( ulRequests == 0 )
+            {
+                xLastRelease = xTaskGetTickCount();
+            }
+        }
+    }
+    else
+    {
+        /* No request of the governor */
+    }
+
+    if( ulRequests > 0 )
+    {
+        prvSetLevel( HW_CLOCK_LEVEL_HIGH );
+    }
+    else if( ( xTaskGetTickCount() - xLastRelease ) >= pdMS_TO_TICKS( DVFS_HOLD_MS ) )
+    {
+        prvSetLevel( HW_CLOCK_LEVEL_LOW );
+    }
+    else
+    {
+        /* Within the hold time */
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsInit( void )
+{
+    static PeriodicWork_t xSampleWork;
+
+    vMetricRegister( &xLevelMetric );
+    vMetricRegister( &xSwitchesMetric );
+
+    taskENTER_CRITICAL();
+    xLevelSince = xTaskGetTickCount();
+    xLastRelease = xLevelSince;
+    vMetricSet( &xLevelMetric, ( uint32_t ) hw_clock_get_level() );
+    taskEXIT_CRITICAL();
+
+    /* Follows the CPU load samples, a late sample only delays the next decision */
+    vPeriodicWorkStartCallback( &xSampleWork, prvDvfsSample, NULL,
+                                pdMS_TO_TICKS( DVFS_SAMPLE_MS ), pdMS_TO_TICKS( DVFS_SAMPLE_MS / 10 ) );
+
+    LogInfo( "DVFS governor started, low level after %u ms without a request.", ( unsigned int ) DVFS_HOLD_MS );
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsRequest( DvfsClient_t xClient )
+{
+    configASSERT( xClient < DVFS_CLIENT_MAX );
+
+    taskENTER_CRITICAL();
+
+    pusRequests[ xClient ]++;
+    ulRequests++;
+
+    /* Also retries a switch which did not complete */
+    prvSetLevel( HW_CLOCK_LEVEL_HIGH );
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsRelease( DvfsClient_t xClient )
+{
+    configASSERT( xClient < DVFS_CLIENT_MAX );
+
+    taskENTER_CRITICAL();
+
+    configASSERT( pusRequests[ xClient ] > 0 );
+
+    if( pusRequests[ xClient ] > 0 )
+    {
+        pusRequests[ xClient ]--;
+        ulRequests--;
+
+        /* The governor lowers the clock after the hold time */
+        if( ulRequests == 0 )
+        {
+            xLastRelease = xTaskGetTickCount();
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsGetStats( DvfsStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+
+    prvAccountLevel( xTaskGetTickCount() );
+
+    pxStats->ulLevel = ( uint32_t ) hw_clock_get_level();
+    pxStats->ulSwitches = ulSwitches;
+    pxStats->ulErrors = ulErrors;
+    pxStats->ulHighMs = ulHighMs;
+    pxStats->ulLowMs = ulLowMs;
+
+    for( uint32_t i = 0; i < DVFS_CLIENT_MAX; i++ )
+    {
+        pxStats->pusRequests[ i ] = pusRequests[ i ];
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+#endif /* DVFS_ENABLED == 1 */
@@ -31,6 +31,23 @@
 #include "task.h"
 #include "b_u585i_iot02a_bus.h"
 #include "b_u585i_iot02a_errno.h"
+#include "i2c_bus.h"
+#include "dma_copy.h"
+#include "dvfs.h"
+
+/*
+ * SPI2 (EMW3080) clock prescaler. SPI2 is clocked from PCLK1 (160 MHz), so a
+ * prescaler of 4 runs the link at 40 MHz, the maximum supported by the module.
+ * It is kept at the 48 MHz DVFS low level, where the link runs at 12 MHz.
+ */
+#ifndef MX_SPI_BAUDRATE_PRESCALER
+    #define MX_SPI_BAUDRATE_PRESCALER    SPI_BAUDRATEPRESCALER_4
+#endif
+
+/* Cache profile applied by hw_init, see HwCacheProfile_t */
+#ifndef HW_CACHE_PROFILE
+    #define HW_CACHE_PROFILE    HW_CACHE_PROFILE_ICACHE_1WAY_DCACHE
+#endif
 
 /* Global peripheral handles */
 RTC_HandleTypeDef * pxHndlRtc = NULL;
@@ -45,20 +62,69 @@ DMA_HandleTypeDef * pxHndlGpdmaCh5 = NULL;
 TIM_HandleTypeDef * pxHndlTim5 = NULL;
 IWDG_HandleTypeDef * pxHwndIwdg = NULL;
 
+/* Number of TIM5 overflows, the upper 32 bits of the microsecond time */
+static volatile uint32_t ulTim5Wraps = 0;
+
+/* 160 MHz from the MSI, also restored after a wakeup from STOP2 */
+static const RCC_PLLInitTypeDef xPllInit =
+{
+    .PLLState  = RCC_PLL_ON,
+    .PLLSource = RCC_PLLSOURCE_MSI,
+    .PLLMBOOST = RCC_PLLMBOOST_DIV4,
+    .PLLM      = 3,
+    .PLLN      = 10,
+    .PLLP      = 2,
+    .PLLQ      = 2,
+    .PLLR      = 1,
+    .PLLRGE    = RCC_PLLVCIRANGE_1,
+    .PLLFRACN  = 0,
+};
+
+static const RCC_ClkInitTypeDef xRccClkInit =
+{
+    .ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                      RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2 | RCC_CLOCKTYPE_PCLK3,
+    .SYSCLKSource   = RCC_SYSCLKSOURCE_PLLCLK,
+    .AHBCLKDivider  = RCC_SYSCLK_DIV1,
+    .APB1CLKDivider = RCC_HCLK_DIV1,
+    .APB2CLKDivider = RCC_HCLK_DIV1,
+    .APB3CLKDivider = RCC_HCLK_DIV1,
+};
+
+/* HW_CLOCK_LEVEL_LOW, the 48 MHz MSI which also feeds the PLL */
+static const RCC_ClkInitTypeDef xRccClkInitLow =
+{
+    .ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                      RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2 | RCC_CLOCKTYPE_PCLK3,
+    .SYSCLKSource   = RCC_SYSCLKSOURCE_MSI,
+    .AHBCLKDivider  = RCC_SYSCLK_DIV1,
+    .APB1CLKDivider = RCC_HCLK_DIV1,
+    .APB2CLKDivider = RCC_HCLK_DIV1,
+    .APB3CLKDivider = RCC_HCLK_DIV1,
+};
+
+/* Enough for 48 MHz in voltage range 3 */
+#define HW_CLOCK_LOW_FLASH_LATENCY    FLASH_LATENCY_2
+
+static HwClockLevel_t xClockLevel = HW_CLOCK_LEVEL_HIGH;
+
 /* local function prototypes */
 static void SystemClock_Config( void );
 static void hw_gpdma_init( void );
-static void hw_cache_init( void );
 static void hw_cache_deinit( void );
-static void hw_rtc_init( void );
+#ifndef TFM_PSA_API
+    static void hw_rtc_init( void );
+#endif
 static void hw_gpio_init( void );
 static void hw_spi2_msp_init( SPI_HandleTypeDef * pxHndlSpi );
 static void hw_spi2_msp_deinit( SPI_HandleTypeDef * pxHndlSpi );
 static void hw_spi_init( void );
 static void hw_tim5_init( void );
+static void hw_tim5_rescale( void );
 static void hw_watchdog_init( void );
 
 #ifndef TFM_PSA_API
+    static void hw_cache_init( void );
     static void hw_rng_init( void );
 #endif /* ! defined( TFM_PSA_API ) */
 
@@ -79,6 +145,9 @@ void hw_init( void )
     /* Configure the system clock */
     SystemClock_Config();
 
+    /* Started first so that every log line has a timestamp */
+    hw_tim5_init();
+
     #ifndef TFM_PSA_API
         hw_cache_init();
     #endif
@@ -90,7 +159,15 @@ void hw_init( void )
     hw_gpio_init();
 
     hw_gpdma_init();
-/*    hw_rtc_init(); */
+
+    #if ( DMA_COPY_ENABLED == 1 )
+        ( void ) xDmaCopyInit();
+    #endif
+
+    #ifndef TFM_PSA_API
+        hw_rtc_init();
+    #endif
+
     hw_spi_init();
 
     #ifndef TFM_PSA_API
@@ -101,8 +178,10 @@ void hw_init( void )
     {
         LogError( "Failed to initialize BSP I2C interface." );
     }
-
-    hw_tim5_init();
+    else if( xI2cBusInit() != pdTRUE )
+    {
+        LogError( "Failed to initialize the I2C bus manager." );
+    }
 
     hw_watchdog_init();
 }
@@ -123,18 +202,16 @@ static void SystemClock_Config( void )
         .MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT,
         .MSIClockRange       = RCC_MSIRANGE_0,
         .LSIDiv              = RCC_LSI_DIV1,
-        .PLL.PLLState        = RCC_PLL_ON,
-        .PLL.PLLSource       = RCC_PLLSOURCE_MSI,
-        .PLL.PLLMBOOST       = RCC_PLLMBOOST_DIV4,
-        .PLL.PLLM            = 3,
-        .PLL.PLLN            = 10,
-        .PLL.PLLP            = 2,
-        .PLL.PLLQ            = 2,
-        .PLL.PLLR            = 1,
-        .PLL.PLLRGE          = RCC_PLLVCIRANGE_1,
-        .PLL.PLLFRACN        = 0,
+        .PLL                 = xPllInit,
     };
 
+    #if ( DVFS_ENABLED == 1 )
+        /* Kernel clock of the console UART, which keeps its baud rate at both clock levels */
+        xRccOscInit.OscillatorType |= RCC_OSCILLATORTYPE_HSI;
+        xRccOscInit.HSIState = RCC_HSI_ON;
+        xRccOscInit.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    #endif
+
     /* Switching from one PLL configuration to another requires to temporarily restore the default RCC configuration. */
     xResult = HAL_RCC_DeInit();
     configASSERT( xResult == HAL_OK );
@@ -142,19 +219,137 @@ static void SystemClock_Config( void )
     xResult = HAL_RCC_OscConfig( &xRccOscInit );
     configASSERT( xResult == HAL_OK );
 
-    const RCC_ClkInitTypeDef xRccClkInit =
+    xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_4 );
+    configASSERT( xResult == HAL_OK );
+}
+
+/*
+ * The system clock runs from the MSI after a wakeup from STOP2, and the PLL and the HSI16 are off.
+ * Called with interrupts disabled. HAL_RCC_ClockConfig also restarts the SysTick.
+ */
+void hw_stop_resume( uint32_t ulStoppedUs )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+
+    RCC_OscInitTypeDef xRccOscInit =
     {
-        .ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
-                          RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2 | RCC_CLOCKTYPE_PCLK3,
-        .SYSCLKSource   = RCC_SYSCLKSOURCE_PLLCLK,
-        .AHBCLKDivider  = RCC_SYSCLK_DIV1,
-        .APB1CLKDivider = RCC_HCLK_DIV1,
-        .APB2CLKDivider = RCC_HCLK_DIV1,
-        .APB3CLKDivider = RCC_HCLK_DIV1,
+        .OscillatorType = RCC_OSCILLATORTYPE_NONE,
+        .PLL            = xPllInit,
     };
 
-    xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_4 );
+    #if ( DVFS_ENABLED == 1 )
+        xRccOscInit.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+        xRccOscInit.HSIState = RCC_HSI_ON;
+        xRccOscInit.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    #endif
+
+    /* The voltage range is kept in STOP2, the low level only needs the bus prescalers back */
+    if( xClockLevel == HW_CLOCK_LEVEL_LOW )
+    {
+        xRccOscInit.PLL.PLLState = RCC_PLL_NONE;
+    }
+
+    xResult = HAL_RCC_OscConfig( &xRccOscInit );
+    configASSERT( xResult == HAL_OK );
+
+    if( xClockLevel == HW_CLOCK_LEVEL_LOW )
+    {
+        xResult = HAL_RCC_ClockConfig( &xRccClkInitLow, HW_CLOCK_LOW_FLASH_LATENCY );
+    }
+    else
+    {
+        xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_4 );
+    }
+
     configASSERT( xResult == HAL_OK );
+
+    /* TIM5 was stopped with its clock, move it on by the time spent in STOP2 */
+    if( pxHndlTim5 != NULL )
+    {
+        uint32_t ulCount = __HAL_TIM_GET_COUNTER( pxHndlTim5 );
+
+        if( ( ulCount + ulStoppedUs ) < ulCount )
+        {
+            ulTim5Wraps++;
+        }
+
+        __HAL_TIM_SET_COUNTER( pxHndlTim5, ulCount + ulStoppedUs );
+    }
+}
+
+HAL_StatusTypeDef hw_clock_set_level( HwClockLevel_t xLevel )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+
+    if( xLevel >= HW_CLOCK_LEVEL_MAX )
+    {
+        xResult = HAL_ERROR;
+    }
+    else if( xLevel == xClockLevel )
+    {
+        /* Nothing to change */
+    }
+    else if( xLevel == HW_CLOCK_LEVEL_HIGH )
+    {
+        RCC_OscInitTypeDef xRccOscInit =
+        {
+            .OscillatorType = RCC_OSCILLATORTYPE_NONE,
+            .PLL            = xPllInit,
+        };
+
+        /* Voltage first, then the PLL and the system clock, with the wait states raised by the HAL before the switch */
+        xResult = HAL_PWREx_ControlVoltageScaling( PWR_REGULATOR_VOLTAGE_SCALE1 );
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_RCC_OscConfig( &xRccOscInit );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_4 );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xClockLevel = HW_CLOCK_LEVEL_HIGH;
+            hw_tim5_rescale();
+        }
+    }
+    else
+    {
+        RCC_OscInitTypeDef xRccOscInit =
+        {
+            .OscillatorType = RCC_OSCILLATORTYPE_NONE,
+            .PLL.PLLState   = RCC_PLL_OFF,
+        };
+
+        /* The reverse order, the HAL lowers the wait states after the switch */
+        xResult = HAL_RCC_ClockConfig( &xRccClkInitLow, HW_CLOCK_LOW_FLASH_LATENCY );
+
+        if( xResult == HAL_OK )
+        {
+            xClockLevel = HW_CLOCK_LEVEL_LOW;
+            hw_tim5_rescale();
+
+            xResult = HAL_RCC_OscConfig( &xRccOscInit );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            /* The EPOD booster is only allowed in ranges 1 and 2 */
+            CLEAR_BIT( PWR->VOSR, PWR_VOSR_BOOSTEN );
+
+            xResult = HAL_PWREx_ControlVoltageScaling( PWR_REGULATOR_VOLTAGE_SCALE3 );
+        }
+    }
+
+    return xResult;
+}
+
+HwClockLevel_t hw_clock_get_level( void )
+{
+    return xClockLevel;
 }
 
 static void hw_gpdma_init( void )
@@ -168,62 +363,145 @@ static void hw_gpdma_init( void )
     HAL_NVIC_EnableIRQ( GPDMA1_Channel5_IRQn );
 }
 
-static void hw_cache_init( void )
-{
-    HAL_StatusTypeDef xResult = HAL_OK;
-
-    ( void ) HAL_ICACHE_Invalidate();
-    ( void ) HAL_ICACHE_Disable();
+#ifndef TFM_PSA_API
 
-    /* initialize ICACHE (makes flash access faster) */
-    xResult = HAL_ICACHE_ConfigAssociativityMode( ICACHE_1WAY );
+    static HwCacheProfile_t xCacheProfile = HW_CACHE_PROFILE_OFF;
 
-    configASSERT( xResult == HAL_OK );
+    static DCACHE_HandleTypeDef xHndlDCache =
+    {
+        .Instance           = DCACHE1,
+        .Init.ReadBurstType = DCACHE_READ_BURST_WRAP,
+    };
 
-    if( xResult == HAL_OK )
+    static void hw_cache_init( void )
     {
-        xResult = HAL_ICACHE_Invalidate();
+        HAL_StatusTypeDef xResult = hw_cache_set_profile( HW_CACHE_PROFILE );
+
         configASSERT( xResult == HAL_OK );
+        ( void ) xResult;
     }
 
-    if( xResult == HAL_OK )
+    HAL_StatusTypeDef hw_cache_set_profile( HwCacheProfile_t xProfile )
     {
-        xResult = HAL_ICACHE_Enable();
-        configASSERT( xResult == HAL_OK );
-    }
+        HAL_StatusTypeDef xResult = HAL_OK;
+        BaseType_t xICache = ( xProfile != HW_CACHE_PROFILE_OFF );
+        BaseType_t xDCache = ( ( xProfile == HW_CACHE_PROFILE_ICACHE_1WAY_DCACHE ) ||
+                               ( xProfile == HW_CACHE_PROFILE_ICACHE_2WAY_DCACHE ) );
+        uint32_t ulWays = ( ( xProfile == HW_CACHE_PROFILE_ICACHE_2WAY ) ||
+                            ( xProfile == HW_CACHE_PROFILE_ICACHE_2WAY_DCACHE ) ) ? ICACHE_2WAYS : ICACHE_1WAY;
 
-    /* Initialize DCACHE */
+        if( xProfile >= HW_CACHE_PROFILE_MAX )
+        {
+            xResult = HAL_ERROR;
+        }
 
-    static DCACHE_HandleTypeDef xHndlDCache =
-    {
-        .Instance           = DCACHE1,
-        .Init.ReadBurstType = DCACHE_READ_BURST_WRAP,
-    };
+        /* The associativity can only be changed while the ICACHE is disabled */
+        if( xResult == HAL_OK )
+        {
+            ( void ) HAL_ICACHE_Invalidate();
+            ( void ) HAL_ICACHE_Disable();
+        }
 
-    if( xResult == HAL_OK )
+        /* initialize ICACHE (makes flash access faster) */
+        if( ( xResult == HAL_OK ) && ( xICache == pdTRUE ) )
+        {
+            xResult = HAL_ICACHE_ConfigAssociativityMode( ulWays );
+
+            if( xResult == HAL_OK )
+            {
+                xResult = HAL_ICACHE_Invalidate();
+            }
+
+            if( xResult == HAL_OK )
+            {
+                xResult = HAL_ICACHE_Enable();
+            }
+        }
+
+        /* Initialize DCACHE */
+        if( ( xResult == HAL_OK ) && ( pxHndlDCache == NULL ) )
+        {
+            xResult = HAL_DCACHE_Init( &xHndlDCache );
+
+            if( xResult == HAL_OK )
+            {
+                pxHndlDCache = &xHndlDCache;
+            }
+        }
+
+        /*
+         * Nothing writes to the external memories through DCACHE1, so there are no dirty lines to clean.
+         * pxHndlDCache stays set while the cache is disabled, the maintenance done by the drivers is harmless.
+         */
+        if( xResult == HAL_OK )
+        {
+            ( void ) HAL_DCACHE_Disable( pxHndlDCache );
+            xResult = HAL_DCACHE_Invalidate( pxHndlDCache );
+        }
+
+        if( ( xResult == HAL_OK ) && ( xDCache == pdTRUE ) )
+        {
+            xResult = HAL_DCACHE_Enable( pxHndlDCache );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xCacheProfile = xProfile;
+        }
+
+        return xResult;
+    }
+
+    HwCacheProfile_t hw_cache_get_profile( void )
     {
-        xResult = HAL_DCACHE_Init( &xHndlDCache );
-        configASSERT( xResult == HAL_OK );
+        return xCacheProfile;
     }
 
-    if( xResult == HAL_OK )
+    const char * hw_cache_profile_name( HwCacheProfile_t xProfile )
     {
-        ( void ) HAL_DCACHE_Disable( &xHndlDCache );
-        xResult = HAL_DCACHE_Invalidate( &xHndlDCache );
-        configASSERT( xResult == HAL_OK );
+        static const char * const pcNames[ HW_CACHE_PROFILE_MAX ] =
+        {
+            "off",
+            "i1",
+            "i2",
+            "i1+d",
+            "i2+d",
+        };
+
+        return ( xProfile < HW_CACHE_PROFILE_MAX ) ? pcNames[ xProfile ] : "?";
     }
 
-    if( xResult == HAL_OK )
+    void hw_cache_monitor_start( void )
     {
-        xResult = HAL_DCACHE_Enable( &xHndlDCache );
-        configASSERT( xResult == HAL_OK );
+        ( void ) HAL_ICACHE_Monitor_Reset( ICACHE_MONITOR_HIT_MISS );
+        ( void ) HAL_ICACHE_Monitor_Start( ICACHE_MONITOR_HIT_MISS );
+
+        if( pxHndlDCache != NULL )
+        {
+            ( void ) HAL_DCACHE_Monitor_Reset( pxHndlDCache, DCACHE_MONITOR_READ_HIT | DCACHE_MONITOR_READ_MISS );
+            ( void ) HAL_DCACHE_Monitor_Start( pxHndlDCache, DCACHE_MONITOR_READ_HIT | DCACHE_MONITOR_READ_MISS );
+        }
     }
 
-    if( xResult == HAL_OK )
+    void hw_cache_monitor_stop( HwCacheStats_t * pxStats )
     {
-        pxHndlDCache = &xHndlDCache;
+        ( void ) HAL_ICACHE_Monitor_Stop( ICACHE_MONITOR_HIT_MISS );
+
+        pxStats->ulICacheHits = HAL_ICACHE_Monitor_GetHitValue();
+        pxStats->ulICacheMisses = HAL_ICACHE_Monitor_GetMissValue();
+        pxStats->ulDCacheReadHits = 0;
+        pxStats->ulDCacheReadMisses = 0;
+
+        if( pxHndlDCache != NULL )
+        {
+            ( void ) HAL_DCACHE_Monitor_Stop( pxHndlDCache, DCACHE_MONITOR_READ_HIT | DCACHE_MONITOR_READ_MISS );
+
+            pxStats->ulDCacheReadHits = HAL_DCACHE_Monitor_GetReadHitValue( pxHndlDCache );
+            pxStats->ulDCacheReadMisses = HAL_DCACHE_Monitor_GetReadMissValue( pxHndlDCache );
+        }
     }
-}
+
+#endif /* ! defined( TFM_PSA_API ) */
 
 static void hw_cache_deinit( void )
 {
@@ -244,33 +522,71 @@ static void hw_cache_deinit( void )
     configASSERT( xResult == HAL_OK );
 }
 
-static void hw_rtc_init( void )
-{
-    HAL_StatusTypeDef xResult = HAL_OK;
+#ifndef TFM_PSA_API
 
-    static RTC_HandleTypeDef xHndlRtc =
-    {
-        .Instance            = RTC,
-        .Init.HourFormat     = RTC_HOURFORMAT_24,
-        .Init.AsynchPrediv   = 127,
-        .Init.SynchPrediv    = 255,
-        .Init.OutPut         = RTC_OUTPUT_DISABLE,
-        .Init.OutPutRemap    = RTC_OUTPUT_REMAP_NONE,
-        .Init.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH,
-        .Init.OutPutType     = RTC_OUTPUT_TYPE_OPENDRAIN,
-        .Init.OutPutPullUp   = RTC_OUTPUT_PULLUP_NONE,
-        .Init.BinMode        = RTC_BINARY_NONE,
-    };
+/*
+ * The RTC runs from the LSE in the backup domain, so it keeps the time set by sntp_time.c across
+ * resets. Only the first start after a power loss waits for the LSE. Selecting the LSE resets the
+ * backup domain, backup registers included, if the RTC had another clock.
+ */
+    static void hw_rtc_init( void )
+    {
+        HAL_StatusTypeDef xResult = HAL_OK;
+        RCC_OscInitTypeDef xRccOscInit =
+        {
+            .OscillatorType = RCC_OSCILLATORTYPE_LSE,
+            .LSEState       = RCC_LSE_ON,
+            .PLL.PLLState   = RCC_PLL_NONE,
+        };
+        RCC_PeriphCLKInitTypeDef xPeriphClkInit =
+        {
+            .PeriphClockSelection = RCC_PERIPHCLK_RTC,
+            .RTCClockSelection    = RCC_RTCCLKSOURCE_LSE,
+        };
 
-    xResult = HAL_RTC_Init( &xHndlRtc );
-    configASSERT( xResult == HAL_OK );
+        static RTC_HandleTypeDef xHndlRtc =
+        {
+            .Instance            = RTC,
+            .Init.HourFormat     = RTC_HOURFORMAT_24,
+            .Init.AsynchPrediv   = 127,
+            .Init.SynchPrediv    = 255,
+            .Init.OutPut         = RTC_OUTPUT_DISABLE,
+            .Init.OutPutRemap    = RTC_OUTPUT_REMAP_NONE,
+            .Init.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH,
+            .Init.OutPutType     = RTC_OUTPUT_TYPE_OPENDRAIN,
+            .Init.OutPutPullUp   = RTC_OUTPUT_PULLUP_NONE,
+            .Init.BinMode        = RTC_BINARY_NONE,
+        };
 
-    /* Export handle on success */
-    if( xResult == HAL_OK )
-    {
-        pxHndlRtc = &xHndlRtc;
+        __HAL_RCC_PWR_CLK_ENABLE();
+        HAL_PWR_EnableBkUpAccess();
+
+        xResult = HAL_RCC_OscConfig( &xRccOscInit );
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_RCCEx_PeriphCLKConfig( &xPeriphClkInit );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            __HAL_RCC_RTC_ENABLE();
+            __HAL_RCC_RTCAPB_CLK_ENABLE();
+
+            xResult = HAL_RTC_Init( &xHndlRtc );
+        }
+
+        /* The board still runs without a time of day */
+        if( xResult == HAL_OK )
+        {
+            pxHndlRtc = &xHndlRtc;
+        }
+        else
+        {
+            LogError( "Failed to start the RTC." );
+        }
     }
-}
+#endif /* ! defined( TFM_PSA_API ) */
 
 static void hw_gpio_init( void )
 {
@@ -410,7 +726,7 @@ static void hw_spi2_msp_init( SPI_HandleTypeDef * pxHndlSpi )
             .Pin       = GPIO_PIN_4 | GPIO_PIN_3 | GPIO_PIN_1,
             .Mode      = GPIO_MODE_AF_PP,
             .Pull      = GPIO_NOPULL,
-            .Speed     = GPIO_SPEED_FREQ_HIGH,
+            .Speed     = GPIO_SPEED_FREQ_VERY_HIGH,
             .Alternate = GPIO_AF5_SPI2,
         };
 
@@ -523,7 +839,7 @@ static void hw_spi_init( void )
         .Init.CLKPolarity                = SPI_POLARITY_LOW,
         .Init.CLKPhase                   = SPI_PHASE_1EDGE,
         .Init.NSS                        = SPI_NSS_SOFT,
-        .Init.BaudRatePrescaler          = SPI_BAUDRATEPRESCALER_8,
+        .Init.BaudRatePrescaler          = MX_SPI_BAUDRATE_PRESCALER,
         .Init.FirstBit                   = SPI_FIRSTBIT_MSB,
         .Init.TIMode                     = SPI_TIMODE_DISABLE,
         .Init.CRCCalculation             = SPI_CRCCALCULATION_DISABLE,
@@ -626,10 +942,12 @@ static void hw_tim5_init( void )
     static TIM_HandleTypeDef xTim5Handle =
     {
         .Instance       = TIM5,
-        .Init.Prescaler = 4096, /* 160 MHz / 4096 = 39KHz */
         .Init.Period    = 0xFFFFFFFF,
     };
 
+    /* 1 MHz, APB1 is not divided so TIM5 runs from the core clock */
+    xTim5Handle.Init.Prescaler = ( SystemCoreClock / 1000000 ) - 1;
+
     __TIM5_CLK_ENABLE();
 
     xResult = HAL_TIM_Base_Init( &xTim5Handle );
@@ -637,16 +955,72 @@ static void hw_tim5_init( void )
 
     if( xResult == HAL_OK )
     {
-        xResult = HAL_TIM_Base_Start( &xTim5Handle );
+        /* Masked by critical sections, which ullGetMonotonicUs relies on */
+        HAL_NVIC_SetPriority( TIM5_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( TIM5_IRQn );
+
+        /* Init generates an update event to load the prescaler, which is not an overflow */
+        __HAL_TIM_CLEAR_FLAG( &xTim5Handle, TIM_FLAG_UPDATE );
+
+        pxHndlTim5 = &xTim5Handle;
+
+        xResult = HAL_TIM_Base_Start_IT( &xTim5Handle );
         configASSERT( xResult == HAL_OK );
     }
+}
 
-    if( xResult == HAL_OK )
+/* Keep 1 MHz after a system clock change. Called with interrupts disabled. */
+static void hw_tim5_rescale( void )
+{
+    if( pxHndlTim5 != NULL )
     {
-        pxHndlTim5 = &xTim5Handle;
+        uint32_t ulCount = __HAL_TIM_GET_COUNTER( pxHndlTim5 );
+
+        pxHndlTim5->Instance->PSC = ( SystemCoreClock / 1000000 ) - 1;
+        pxHndlTim5->Init.Prescaler = pxHndlTim5->Instance->PSC;
+
+        /* The prescaler is only loaded by an update event, which also clears the count and is not an overflow */
+        pxHndlTim5->Instance->EGR = TIM_EGR_UG;
+        __HAL_TIM_SET_COUNTER( pxHndlTim5, ulCount );
+        __HAL_TIM_CLEAR_FLAG( pxHndlTim5, TIM_FLAG_UPDATE );
+    }
+}
+
+void TIM5_IRQHandler( void )
+{
+    if( ( pxHndlTim5 != NULL ) &&
+        ( __HAL_TIM_GET_FLAG( pxHndlTim5, TIM_FLAG_UPDATE ) != RESET ) )
+    {
+        __HAL_TIM_CLEAR_FLAG( pxHndlTim5, TIM_FLAG_UPDATE );
+        ulTim5Wraps++;
     }
 }
 
+uint64_t ullGetMonotonicUs( void )
+{
+    uint64_t ullUs = 0;
+
+    if( pxHndlTim5 != NULL )
+    {
+        UBaseType_t uxContext = taskENTER_CRITICAL_FROM_ISR();
+        uint32_t ulWraps = ulTim5Wraps;
+        uint32_t ulCount = __HAL_TIM_GET_COUNTER( pxHndlTim5 );
+
+        /* An overflow the interrupt has not counted yet, the count is read again in case it wrapped after the first read */
+        if( __HAL_TIM_GET_FLAG( pxHndlTim5, TIM_FLAG_UPDATE ) != RESET )
+        {
+            ulWraps++;
+            ulCount = __HAL_TIM_GET_COUNTER( pxHndlTim5 );
+        }
+
+        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+        ullUs = ( ( uint64_t ) ulWraps << 32 ) | ulCount;
+    }
+
+    return ullUs;
+}
+
 static void hw_watchdog_init( void )
 {
     HAL_StatusTypeDef xResult = HAL_OK;
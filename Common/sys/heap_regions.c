@@ -0,0 +1,632 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Multi-region FreeRTOS heap, see heap_regions.h.
+ *
+ * Derived from heap_5.c of the FreeRTOS kernel. Each region keeps its own address ordered free
+ * list with heap_4 coalescing, and a free goes back to the region which contains the block.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "heap_regions.h"
+#include "mem_pressure.h"
+
+#if ( HEAP_REGIONS_ENABLED == 1 )
+
+    #include "stm32u5xx_hal.h"
+
+    #if ( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
+        #error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
+    #endif
+
+    #define heapMINIMUM_BLOCK_SIZE    ( ( size_t ) ( xHeapStructSize << 1 ) )
+    #define heapBITS_PER_BYTE         ( ( size_t ) 8 )
+
+    #define HEAP_SRAM4_START          ( 0x28000000UL )
+    #define HEAP_SRAM4_SIZE           ( 16U * 1024U )
+
+/* Same layout as heap_4, malloc_usable_size in newlibc_stubs.c depends on it */
+    typedef struct A_BLOCK_LINK
+    {
+        struct A_BLOCK_LINK * pxNextFreeBlock; /*<< The next free block in the list. */
+        size_t xBlockSize;                     /*<< The size of the free block. */
+    } BlockLink_t;
+
+    typedef struct
+    {
+        const char * pcName;
+        uint8_t * pucStart;  /* First block of the region */
+        BlockLink_t xStart;  /* Head of the free list */
+        BlockLink_t * pxEnd; /* End marker at the top of the region, NULL if the region is unused */
+        size_t xTotalBytes;
+        size_t xFreeBytes;
+        size_t xMinFreeBytes;
+        uint32_t ulAllocs;
+        uint32_t ulFrees;
+        uint32_t ulFallbacks;
+    } HeapRegion_t;
+
+    static const size_t xHeapStructSize = ( sizeof( BlockLink_t ) + ( ( size_t ) ( portBYTE_ALIGNMENT - 1 ) ) ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+
+/* Top bit of xBlockSize, set while the block is allocated */
+    static const size_t xBlockAllocatedBit = ( ( size_t ) 1 ) << ( ( sizeof( size_t ) * heapBITS_PER_BYTE ) - 1 );
+
+    static uint8_t ucDmaHeap[ HEAP_REGION_DMA_SIZE ] SRAM_BANK_DMA;
+    static uint8_t ucCryptoHeap[ HEAP_REGION_CRYPTO_SIZE ] SRAM_BANK_CPU;
+
+/* Defined by the linker script: RAM between the end of the image and the main stack */
+    extern uint8_t _sheap[];
+    extern uint8_t _eheap[];
+
+    static HeapRegion_t xRegions[ HEAP_REGION_COUNT ];
+    static BaseType_t xHeapInitialised = pdFALSE;
+
+    static size_t xFreeBytesRemaining = 0;
+    static size_t xMinimumEverFreeBytesRemaining = 0;
+    static size_t xNumberOfSuccessfulAllocations = 0;
+    static size_t xNumberOfSuccessfulFrees = 0;
+
+/*-----------------------------------------------------------*/
+
+    static void prvRegionInit( HeapRegion_t * pxRegion,
+                               const char * pcName,
+                               uint8_t * pucStart,
+                               size_t xSize )
+    {
+        size_t uxAddress = ( size_t ) pucStart;
+        BlockLink_t * pxFirstFreeBlock;
+
+        ( void ) memset( pxRegion, 0, sizeof( HeapRegion_t ) );
+        pxRegion->pcName = pcName;
+
+        /* Ensure the region starts on a correctly aligned boundary */
+        if( ( uxAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
+        {
+            uxAddress += ( portBYTE_ALIGNMENT - 1 );
+            uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+            xSize = ( xSize > ( uxAddress - ( size_t ) pucStart ) ) ? ( xSize - ( uxAddress - ( size_t ) pucStart ) ) : 0;
+        }
+
+        if( xSize > ( 2 * heapMINIMUM_BLOCK_SIZE ) )
+        {
+            pxRegion->pucStart = ( uint8_t * ) uxAddress;
+            pxRegion->xStart.pxNextFreeBlock = ( BlockLink_t * ) uxAddress;
+            pxRegion->xStart.xBlockSize = 0;
+
+            /* The end marker is inserted at the end of the region */
+            uxAddress = ( ( size_t ) pxRegion->pucStart + xSize ) - xHeapStructSize;
+            uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+            pxRegion->pxEnd = ( BlockLink_t * ) uxAddress;
+            pxRegion->pxEnd->xBlockSize = 0;
+            pxRegion->pxEnd->pxNextFreeBlock = NULL;
+
+            /* One free block spanning the whole region */
+            pxFirstFreeBlock = ( BlockLink_t * ) pxRegion->pucStart;
+            pxFirstFreeBlock->xBlockSize = uxAddress - ( size_t ) pxFirstFreeBlock;
+            pxFirstFreeBlock->pxNextFreeBlock = pxRegion->pxEnd;
+
+            pxRegion->xTotalBytes = pxFirstFreeBlock->xBlockSize;
+            pxRegion->xFreeBytes = pxRegion->xTotalBytes;
+            pxRegion->xMinFreeBytes = pxRegion->xTotalBytes;
+
+            xFreeBytesRemaining += pxRegion->xTotalBytes;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvHeapInit( void )
+    {
+        uintptr_t uxMainStart = ( uintptr_t ) _sheap;
+        uintptr_t uxMainEnd = ( uintptr_t ) _eheap;
+        size_t xMainSize = ( uxMainEnd > uxMainStart ) ? ( size_t ) ( uxMainEnd - uxMainStart ) : 0;
+
+        /* SRAM4 sits on AHB3, its clock is gated separately */
+        __HAL_RCC_SRAM4_CLK_ENABLE();
+
+        prvRegionInit( &( xRegions[ HEAP_REGION_DMA ] ), "dma", ucDmaHeap, sizeof( ucDmaHeap ) );
+        prvRegionInit( &( xRegions[ HEAP_REGION_CRYPTO ] ), "crypto", ucCryptoHeap, sizeof( ucCryptoHeap ) );
+        prvRegionInit( &( xRegions[ HEAP_REGION_MAIN ] ), "main", _sheap, xMainSize );
+        prvRegionInit( &( xRegions[ HEAP_REGION_SRAM4 ] ), "sram4", ( uint8_t * ) HEAP_SRAM4_START, HEAP_SRAM4_SIZE );
+
+        xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+
+        /* Nothing to allocate from at all */
+        configASSERT( xFreeBytesRemaining > 0 );
+
+        xHeapInitialised = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Free list insertion of heap_4, merging with the adjacent free blocks */
+    static void prvInsertBlockIntoFreeList( HeapRegion_t * pxRegion,
+                                            BlockLink_t * pxBlockToInsert )
+    {
+        BlockLink_t * pxIterator;
+        uint8_t * puc;
+
+        /* Iterate through the list until a block is found that has a higher address than the
+         * block being inserted. */
+        for( pxIterator = &( pxRegion->xStart ); pxIterator->pxNextFreeBlock < pxBlockToInsert; pxIterator = pxIterator->pxNextFreeBlock )
+        {
+            /* Nothing to do here, just iterate to the right position. */
+        }
+
+        /* Do the block being inserted, and the block it is being inserted after make a
+         * contiguous block of memory? */
+        puc = ( uint8_t * ) pxIterator;
+
+        if( ( puc + pxIterator->xBlockSize ) == ( uint8_t * ) pxBlockToInsert )
+        {
+            pxIterator->xBlockSize += pxBlockToInsert->xBlockSize;
+            pxBlockToInsert = pxIterator;
+        }
+
+        /* Do the block being inserted, and the block it is being inserted before make a
+         * contiguous block of memory? */
+        puc = ( uint8_t * ) pxBlockToInsert;
+
+        if( ( puc + pxBlockToInsert->xBlockSize ) == ( uint8_t * ) pxIterator->pxNextFreeBlock )
+        {
+            if( pxIterator->pxNextFreeBlock != pxRegion->pxEnd )
+            {
+                /* Form one big block from the two blocks. */
+                pxBlockToInsert->xBlockSize += pxIterator->pxNextFreeBlock->xBlockSize;
+                pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock->pxNextFreeBlock;
+            }
+            else
+            {
+                pxBlockToInsert->pxNextFreeBlock = pxRegion->pxEnd;
+            }
+        }
+        else
+        {
+            pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock;
+        }
+
+        /* If the block being inserted plugged a gap, so was merged with the block before and
+         * the block after, then its pxNextFreeBlock pointer will have already been set. */
+        if( pxIterator != pxBlockToInsert )
+        {
+            pxIterator->pxNextFreeBlock = pxBlockToInsert;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* First free block of the region able to hold xWantedSize bytes, header included */
+    static BlockLink_t * prvFindFirstFit( HeapRegion_t * pxRegion,
+                                          size_t xWantedSize,
+                                          BlockLink_t ** ppxPrevious )
+    {
+        BlockLink_t * pxBlock = NULL;
+
+        if( ( pxRegion->pxEnd != NULL ) &&
+            ( xWantedSize <= pxRegion->xFreeBytes ) )
+        {
+            BlockLink_t * pxPrevious = &( pxRegion->xStart );
+
+            pxBlock = pxRegion->xStart.pxNextFreeBlock;
+
+            while( ( pxBlock->xBlockSize < xWantedSize ) && ( pxBlock->pxNextFreeBlock != NULL ) )
+            {
+                pxPrevious = pxBlock;
+                pxBlock = pxBlock->pxNextFreeBlock;
+            }
+
+            if( pxBlock == pxRegion->pxEnd )
+            {
+                pxBlock = NULL;
+            }
+            else
+            {
+                *ppxPrevious = pxPrevious;
+            }
+        }
+
+        return pxBlock;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Take pxBlock off the free list of the region, splitting off what is not needed */
+    static void * prvAllocateBlock( HeapRegion_t * pxRegion,
+                                    BlockLink_t * pxPrevious,
+                                    BlockLink_t * pxBlock,
+                                    size_t xWantedSize )
+    {
+        void * pvReturn = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xHeapStructSize );
+
+        pxPrevious->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+
+        /* If the block is larger than required it can be split into two. */
+        if( ( pxBlock->xBlockSize - xWantedSize ) > heapMINIMUM_BLOCK_SIZE )
+        {
+            BlockLink_t * pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xWantedSize );
+
+            configASSERT( ( ( ( size_t ) pxNewBlockLink ) & portBYTE_ALIGNMENT_MASK ) == 0 );
+
+            pxNewBlockLink->xBlockSize = pxBlock->xBlockSize - xWantedSize;
+            pxBlock->xBlockSize = xWantedSize;
+
+            prvInsertBlockIntoFreeList( pxRegion, pxNewBlockLink );
+        }
+
+        pxRegion->xFreeBytes -= pxBlock->xBlockSize;
+        xFreeBytesRemaining -= pxBlock->xBlockSize;
+
+        if( pxRegion->xFreeBytes < pxRegion->xMinFreeBytes )
+        {
+            pxRegion->xMinFreeBytes = pxRegion->xFreeBytes;
+        }
+
+        if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+        {
+            xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+        }
+
+        /* The block is being returned - it is allocated and owned by the application and has
+         * no "next" block. */
+        pxBlock->xBlockSize |= xBlockAllocatedBit;
+        pxBlock->pxNextFreeBlock = NULL;
+
+        pxRegion->ulAllocs++;
+        xNumberOfSuccessfulAllocations++;
+
+        return pvReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Requested size plus the block header, rounded up to the alignment, or 0 on overflow */
+    static size_t prvAdjustWantedSize( size_t xWantedSize )
+    {
+        size_t xAdjusted = 0;
+
+        if( ( xWantedSize > 0 ) &&
+            ( ( xWantedSize + xHeapStructSize ) > xWantedSize ) )
+        {
+            xAdjusted = xWantedSize + xHeapStructSize;
+
+            if( ( xAdjusted & portBYTE_ALIGNMENT_MASK ) != 0 )
+            {
+                size_t xPad = portBYTE_ALIGNMENT - ( xAdjusted & portBYTE_ALIGNMENT_MASK );
+
+                xAdjusted = ( ( xAdjusted + xPad ) > xAdjusted ) ? ( xAdjusted + xPad ) : 0;
+            }
+
+            /* The top bit is reserved for the allocated flag */
+            if( ( xAdjusted & xBlockAllocatedBit ) != 0 )
+            {
+                xAdjusted = 0;
+            }
+        }
+
+        return xAdjusted;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void * prvMallocPolicy( size_t xWantedSize,
+                                   HeapPolicy_t xPolicy )
+    {
+        void * pvReturn = NULL;
+
+        vTaskSuspendAll();
+        {
+            HeapRegion_t * pxRegion = NULL;
+            BlockLink_t * pxPrevious = NULL;
+            BlockLink_t * pxBlock = NULL;
+
+            if( xHeapInitialised == pdFALSE )
+            {
+                prvHeapInit();
+            }
+
+            xWantedSize = prvAdjustWantedSize( xWantedSize );
+
+            if( xWantedSize > 0 )
+            {
+                if( ( xPolicy == HEAP_POLICY_DMA ) || ( xPolicy == HEAP_POLICY_CRYPTO ) )
+                {
+                    pxRegion = &( xRegions[ ( xPolicy == HEAP_POLICY_DMA ) ? HEAP_REGION_DMA : HEAP_REGION_CRYPTO ] );
+                    pxBlock = prvFindFirstFit( pxRegion, xWantedSize, &pxPrevious );
+
+                    if( pxBlock == NULL )
+                    {
+                        pxRegion->ulFallbacks++;
+                    }
+                }
+
+                if( pxBlock == NULL )
+                {
+                    BlockLink_t * pxSramPrevious = NULL;
+                    BlockLink_t * pxSramBlock = prvFindFirstFit( &( xRegions[ HEAP_REGION_SRAM4 ] ), xWantedSize, &pxSramPrevious );
+
+                    pxRegion = &( xRegions[ HEAP_REGION_MAIN ] );
+                    pxBlock = prvFindFirstFit( pxRegion, xWantedSize, &pxPrevious );
+
+                    /* Of the two candidates, take the tighter fit */
+                    if( ( pxSramBlock != NULL ) &&
+                        ( ( pxBlock == NULL ) || ( pxSramBlock->xBlockSize < pxBlock->xBlockSize ) ) )
+                    {
+                        pxRegion = &( xRegions[ HEAP_REGION_SRAM4 ] );
+                        pxBlock = pxSramBlock;
+                        pxPrevious = pxSramPrevious;
+                    }
+                }
+
+                if( pxBlock != NULL )
+                {
+                    pvReturn = prvAllocateBlock( pxRegion, pxPrevious, pxBlock, xWantedSize );
+                }
+            }
+
+            traceMALLOC( pvReturn, xWantedSize );
+        }
+        ( void ) xTaskResumeAll();
+
+        return pvReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void * pvPortMallocPolicy( size_t xWantedSize,
+                               HeapPolicy_t xPolicy )
+    {
+        void * pvReturn = prvMallocPolicy( xWantedSize, xPolicy );
+
+        /* Give the shrink handlers one chance before the allocation is reported as failed.
+         * Nothing is done with the scheduler suspended, as the handlers take locks. */
+        if( ( pvReturn == NULL ) &&
+            ( xWantedSize > 0 ) &&
+            ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) &&
+            ( xMemPressureReclaim( MEM_PRESSURE_CRITICAL, xWantedSize ) > 0 ) )
+        {
+            pvReturn = prvMallocPolicy( xWantedSize, xPolicy );
+        }
+
+        #if ( configUSE_MALLOC_FAILED_HOOK == 1 )
+            {
+                if( pvReturn == NULL )
+                {
+                    extern void vApplicationMallocFailedHook( void );
+                    vApplicationMallocFailedHook();
+                }
+            }
+        #endif /* if ( configUSE_MALLOC_FAILED_HOOK == 1 ) */
+
+        configASSERT( ( ( ( size_t ) pvReturn ) & ( size_t ) portBYTE_ALIGNMENT_MASK ) == 0 );
+
+        return pvReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void * pvPortMalloc( size_t xWantedSize )
+    {
+        return pvPortMallocPolicy( xWantedSize, HEAP_POLICY_ANY );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPortFree( void * pv )
+    {
+        uint8_t * puc = ( uint8_t * ) pv;
+
+        if( pv != NULL )
+        {
+            HeapRegion_t * pxRegion = NULL;
+            BlockLink_t * pxLink;
+
+            /* The memory being freed will have an BlockLink_t structure immediately before it. */
+            puc -= xHeapStructSize;
+            pxLink = ( void * ) puc;
+
+            for( uint32_t i = 0; i < HEAP_REGION_COUNT; i++ )
+            {
+                if( ( xRegions[ i ].pxEnd != NULL ) &&
+                    ( puc >= xRegions[ i ].pucStart ) &&
+                    ( puc < ( uint8_t * ) xRegions[ i ].pxEnd ) )
+                {
+                    pxRegion = &( xRegions[ i ] );
+                }
+            }
+
+            configASSERT( pxRegion != NULL );
+            configASSERT( ( pxLink->xBlockSize & xBlockAllocatedBit ) != 0 );
+            configASSERT( pxLink->pxNextFreeBlock == NULL );
+
+            if( ( pxRegion != NULL ) &&
+                ( ( pxLink->xBlockSize & xBlockAllocatedBit ) != 0 ) &&
+                ( pxLink->pxNextFreeBlock == NULL ) )
+            {
+                /* The block is being returned to the heap - it is no longer allocated. */
+                pxLink->xBlockSize &= ~xBlockAllocatedBit;
+
+                vTaskSuspendAll();
+                {
+                    pxRegion->xFreeBytes += pxLink->xBlockSize;
+                    xFreeBytesRemaining += pxLink->xBlockSize;
+                    traceFREE( pv, pxLink->xBlockSize );
+                    prvInsertBlockIntoFreeList( pxRegion, pxLink );
+                    pxRegion->ulFrees++;
+                    xNumberOfSuccessfulFrees++;
+                }
+                ( void ) xTaskResumeAll();
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xPortGetFreeHeapSize( void )
+    {
+        return xFreeBytesRemaining;
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xPortGetMinimumEverFreeHeapSize( void )
+    {
+        return xMinimumEverFreeBytesRemaining;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPortInitialiseBlocks( void )
+    {
+        /* This just exists to keep the linker quiet. */
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Walk the free list of one region, called with the scheduler suspended */
+    static void prvRegionFreeBlocks( const HeapRegion_t * pxRegion,
+                                     size_t * pxBlocks,
+                                     size_t * pxLargest,
+                                     size_t * pxSmallest )
+    {
+        if( pxRegion->pxEnd != NULL )
+        {
+            for( BlockLink_t * pxBlock = pxRegion->xStart.pxNextFreeBlock;
+                 pxBlock != pxRegion->pxEnd;
+                 pxBlock = pxBlock->pxNextFreeBlock )
+            {
+                ( *pxBlocks )++;
+
+                if( pxBlock->xBlockSize > *pxLargest )
+                {
+                    *pxLargest = pxBlock->xBlockSize;
+                }
+
+                if( pxBlock->xBlockSize < *pxSmallest )
+                {
+                    *pxSmallest = pxBlock->xBlockSize;
+                }
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPortGetHeapStats( HeapStats_t * pxHeapStats )
+    {
+        size_t xBlocks = 0;
+        size_t xMaxSize = 0;
+        size_t xMinSize = portMAX_DELAY;
+
+        vTaskSuspendAll();
+        {
+            for( uint32_t i = 0; i < HEAP_REGION_COUNT; i++ )
+            {
+                prvRegionFreeBlocks( &( xRegions[ i ] ), &xBlocks, &xMaxSize, &xMinSize );
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        pxHeapStats->xSizeOfLargestFreeBlockInBytes = xMaxSize;
+        pxHeapStats->xSizeOfSmallestFreeBlockInBytes = ( xBlocks > 0 ) ? xMinSize : 0;
+        pxHeapStats->xNumberOfFreeBlocks = xBlocks;
+
+        taskENTER_CRITICAL();
+        {
+            pxHeapStats->xAvailableHeapSpaceInBytes = xFreeBytesRemaining;
+            pxHeapStats->xNumberOfSuccessfulAllocations = xNumberOfSuccessfulAllocations;
+            pxHeapStats->xNumberOfSuccessfulFrees = xNumberOfSuccessfulFrees;
+            pxHeapStats->xMinimumEverFreeBytesRemaining = xMinimumEverFreeBytesRemaining;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapRegionGetStats( HeapRegionStats_t pxStats[ HEAP_REGION_COUNT ] )
+    {
+        configASSERT( pxStats != NULL );
+
+        vTaskSuspendAll();
+        {
+            if( xHeapInitialised == pdFALSE )
+            {
+                prvHeapInit();
+            }
+
+            for( uint32_t i = 0; i < HEAP_REGION_COUNT; i++ )
+            {
+                const HeapRegion_t * pxRegion = &( xRegions[ i ] );
+                size_t xSmallest = portMAX_DELAY;
+
+                pxStats[ i ].pcName = pxRegion->pcName;
+                pxStats[ i ].ulStart = ( uint32_t ) ( uintptr_t ) pxRegion->pucStart;
+                pxStats[ i ].xTotalBytes = pxRegion->xTotalBytes;
+                pxStats[ i ].xFreeBytes = pxRegion->xFreeBytes;
+                pxStats[ i ].xMinFreeBytes = pxRegion->xMinFreeBytes;
+                pxStats[ i ].xLargestFreeBlock = 0;
+                pxStats[ i ].xFreeBlocks = 0;
+                pxStats[ i ].ulAllocs = pxRegion->ulAllocs;
+                pxStats[ i ].ulFrees = pxRegion->ulFrees;
+                pxStats[ i ].ulFallbacks = pxRegion->ulFallbacks;
+
+                prvRegionFreeBlocks( pxRegion, &( pxStats[ i ].xFreeBlocks ),
+                                     &( pxStats[ i ].xLargestFreeBlock ), &xSmallest );
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xHeapRegionTotalSize( void )
+    {
+        size_t xTotal = 0;
+
+        vTaskSuspendAll();
+        {
+            if( xHeapInitialised == pdFALSE )
+            {
+                prvHeapInit();
+            }
+
+            for( uint32_t i = 0; i < HEAP_REGION_COUNT; i++ )
+            {
+                xTotal += xRegions[ i ].xTotalBytes;
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        return xTotal;
+    }
+
+#endif /* HEAP_REGIONS_ENABLED == 1 */
@@ -0,0 +1,422 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "heap_trace.h"
+
+#include <string.h>
+
+#if ( HEAP_TRACE_ENABLED == 1 )
+
+    #define HEAP_TRACE_BLOCKS_MASK       ( HEAP_TRACE_MAX_BLOCKS - 1 )
+
+/* Blocks are only added while the table is below this, which keeps the probe sequences short */
+    #define HEAP_TRACE_TRACKED_MAX       ( ( HEAP_TRACE_MAX_BLOCKS * 3 ) / 4 )
+
+    #define HEAP_TRACE_OWNER_BOOT        0
+    #define HEAP_TRACE_OWNER_OTHER       ( HEAP_TRACE_MAX_OWNERS - 1 )
+
+    #if ( ( HEAP_TRACE_MAX_BLOCKS & HEAP_TRACE_BLOCKS_MASK ) != 0 )
+        #error "HEAP_TRACE_MAX_BLOCKS must be a power of 2"
+    #endif
+
+    #if ( HEAP_TRACE_MAX_OWNERS > 128 ) || ( HEAP_TRACE_MAX_OWNERS < 3 )
+        #error "HEAP_TRACE_MAX_OWNERS must be within 3 to 128"
+    #endif
+
+/* A live block, pvAddress is NULL in free entries */
+    typedef struct
+    {
+        void * pvAddress;
+        uint32_t ulSize : 24;
+        uint32_t ulOwner : 7;
+        uint32_t ulOld : 1; /* Allocated before the last snapshot */
+    } HeapTraceEntry_t;
+
+/* The task handle an owner was last found with */
+    typedef struct
+    {
+        TaskHandle_t xHandle;
+        HeapTraceOwner_t xOwner;
+    } HeapTraceOwnerSlot_t;
+
+/* Updated with the scheduler suspended */
+    static HeapTraceEntry_t xEntries[ HEAP_TRACE_MAX_BLOCKS ];
+    static uint32_t ulEntriesUsed = 0;
+    static HeapTraceOwnerSlot_t xOwners[ HEAP_TRACE_MAX_OWNERS ] =
+    {
+        [ HEAP_TRACE_OWNER_BOOT ]  = { .xOwner = { .pcName = "(boot)" } },
+        [ HEAP_TRACE_OWNER_OTHER ] = { .xOwner = { .pcName = "(other)" } },
+    };
+    static UBaseType_t uxOwnersUsed = 1;
+    static HeapTraceStats_t xStats = { 0 };
+    static uint32_t ulHistoryNext = 0;
+
+/*-----------------------------------------------------------*/
+
+    static inline uint32_t ulEntryHome( const void * pvAddress )
+    {
+        /* Blocks are 8 byte aligned, Fibonacci hashing spreads the remaining bits */
+        return ( ( ( uint32_t ) ( uintptr_t ) pvAddress >> 3 ) * 2654435761UL ) & HEAP_TRACE_BLOCKS_MASK;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static inline uint32_t ulSizeClass( size_t xSize )
+    {
+        uint32_t ulClass = 0;
+
+        while( ( ulClass < ( HEAP_TRACE_SIZE_CLASSES - 1 ) ) &&
+               ( xSize > ( ( size_t ) 1 << ( HEAP_TRACE_SIZE_CLASS_MIN_LOG2 + ulClass ) ) ) )
+        {
+            ulClass++;
+        }
+
+        return ulClass;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Owner of the running task, found by name so that a task deleted and created again is still charged to the same owner */
+    static uint32_t ulOwnerGet( void )
+    {
+        uint32_t ulOwner = HEAP_TRACE_OWNER_BOOT;
+
+        if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+        {
+            TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+            const char * pcName = pcTaskGetName( xTask );
+            BaseType_t xFound = pdFALSE;
+
+            for( UBaseType_t i = 1; ( i < uxOwnersUsed ) && ( xFound == pdFALSE ); i++ )
+            {
+                if( ( xOwners[ i ].xHandle == xTask ) &&
+                    ( strncmp( xOwners[ i ].xOwner.pcName, pcName, HEAP_TRACE_NAME_LEN - 1 ) == 0 ) )
+                {
+                    ulOwner = i;
+                    xFound = pdTRUE;
+                }
+            }
+
+            for( UBaseType_t i = 1; ( i < uxOwnersUsed ) && ( xFound == pdFALSE ); i++ )
+            {
+                if( strncmp( xOwners[ i ].xOwner.pcName, pcName, HEAP_TRACE_NAME_LEN - 1 ) == 0 )
+                {
+                    xOwners[ i ].xHandle = xTask;
+                    ulOwner = i;
+                    xFound = pdTRUE;
+                }
+            }
+
+            if( xFound == pdFALSE )
+            {
+                if( uxOwnersUsed < HEAP_TRACE_OWNER_OTHER )
+                {
+                    ulOwner = uxOwnersUsed++;
+                    xOwners[ ulOwner ].xHandle = xTask;
+                    ( void ) strncpy( xOwners[ ulOwner ].xOwner.pcName, pcName, HEAP_TRACE_NAME_LEN - 1 );
+                }
+                else
+                {
+                    ulOwner = HEAP_TRACE_OWNER_OTHER;
+                }
+            }
+        }
+
+        return ulOwner;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static HeapTraceEntry_t * pxEntryFind( const void * pvAddress )
+    {
+        HeapTraceEntry_t * pxEntry = NULL;
+        uint32_t ulIdx = ulEntryHome( pvAddress );
+
+        while( ( pxEntry == NULL ) && ( xEntries[ ulIdx ].pvAddress != NULL ) )
+        {
+            if( xEntries[ ulIdx ].pvAddress == pvAddress )
+            {
+                pxEntry = &xEntries[ ulIdx ];
+            }
+            else
+            {
+                ulIdx = ( ulIdx + 1 ) & HEAP_TRACE_BLOCKS_MASK;
+            }
+        }
+
+        return pxEntry;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Remove an entry, moving back the following entries of the probe sequence so that no lookup stops early */
+    static void prvEntryRemove( HeapTraceEntry_t * pxEntry )
+    {
+        uint32_t ulHole = ( uint32_t ) ( pxEntry - xEntries );
+        uint32_t ulIdx = ulHole;
+
+        for( ; ; )
+        {
+            uint32_t ulHome;
+
+            ulIdx = ( ulIdx + 1 ) & HEAP_TRACE_BLOCKS_MASK;
+
+            if( xEntries[ ulIdx ].pvAddress == NULL )
+            {
+                break;
+            }
+
+            ulHome = ulEntryHome( xEntries[ ulIdx ].pvAddress );
+
+            /* The entry can fill the hole unless its home lies cyclically within ( ulHole, ulIdx ] */
+            if( ( ( ulIdx - ulHome ) & HEAP_TRACE_BLOCKS_MASK ) >= ( ( ulIdx - ulHole ) & HEAP_TRACE_BLOCKS_MASK ) )
+            {
+                xEntries[ ulHole ] = xEntries[ ulIdx ];
+                ulHole = ulIdx;
+            }
+        }
+
+        xEntries[ ulHole ].pvAddress = NULL;
+        ulEntriesUsed--;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapTraceMalloc( void * pvAddress,
+                           size_t xSize )
+    {
+        if( pvAddress == NULL )
+        {
+            xStats.ulFailed++;
+        }
+        else
+        {
+            uint32_t ulClass = ulSizeClass( xSize );
+
+            xStats.ulAllocs++;
+            xStats.ulClassAllocs[ ulClass ]++;
+
+            if( ( ulEntriesUsed < HEAP_TRACE_TRACKED_MAX ) && ( xSize < ( 1UL << 24 ) ) )
+            {
+                uint32_t ulOwner = ulOwnerGet();
+                HeapTraceOwner_t * pxOwner = &xOwners[ ulOwner ].xOwner;
+                uint32_t ulIdx = ulEntryHome( pvAddress );
+
+                while( xEntries[ ulIdx ].pvAddress != NULL )
+                {
+                    ulIdx = ( ulIdx + 1 ) & HEAP_TRACE_BLOCKS_MASK;
+                }
+
+                xEntries[ ulIdx ].pvAddress = pvAddress;
+                xEntries[ ulIdx ].ulSize = xSize;
+                xEntries[ ulIdx ].ulOwner = ulOwner;
+                xEntries[ ulIdx ].ulOld = 0;
+                ulEntriesUsed++;
+
+                xStats.ulClassLive[ ulClass ]++;
+                pxOwner->ulAllocs++;
+                pxOwner->ulCurrentBytes += xSize;
+
+                if( pxOwner->ulCurrentBytes > pxOwner->ulPeakBytes )
+                {
+                    pxOwner->ulPeakBytes = pxOwner->ulCurrentBytes;
+                }
+            }
+            else
+            {
+                xStats.ulUntracked++;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapTraceFree( void * pvAddress,
+                         size_t xSize )
+    {
+        ( void ) xSize;
+
+        HeapTraceEntry_t * pxEntry = pxEntryFind( pvAddress );
+
+        xStats.ulFrees++;
+
+        if( pxEntry != NULL )
+        {
+            HeapTraceOwner_t * pxOwner = &xOwners[ pxEntry->ulOwner ].xOwner;
+
+            /* xSize may be larger than the size allocated when the remainder was too small to split */
+            pxOwner->ulFrees++;
+            pxOwner->ulCurrentBytes -= pxEntry->ulSize;
+            xStats.ulClassLive[ ulSizeClass( pxEntry->ulSize ) ]--;
+
+            prvEntryRemove( pxEntry );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvHeapTraceSample( TimerHandle_t xTimer )
+    {
+        HeapStats_t xHeapStats;
+
+        ( void ) xTimer;
+
+        vPortGetHeapStats( &xHeapStats );
+
+        vTaskSuspendAll();
+
+        xStats.xLargestFree = xHeapStats.xSizeOfLargestFreeBlockInBytes;
+        xStats.xFreeBlocks = xHeapStats.xNumberOfFreeBlocks;
+
+        if( ( xStats.ulHistoryCount == 0 ) || ( xStats.xLargestFree < xStats.xMinLargestFree ) )
+        {
+            xStats.xMinLargestFree = xStats.xLargestFree;
+        }
+
+        xStats.ulLargestFreeHistory[ ulHistoryNext ] = xStats.xLargestFree;
+        ulHistoryNext = ( ulHistoryNext + 1 ) % HEAP_TRACE_FRAG_SAMPLES;
+
+        if( xStats.ulHistoryCount < HEAP_TRACE_FRAG_SAMPLES )
+        {
+            xStats.ulHistoryCount++;
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapTraceInit( void )
+    {
+        static StaticTimer_t xTimerBuffer;
+        TimerHandle_t xTimer;
+
+        xTimer = xTimerCreateStatic( "HeapTrace", pdMS_TO_TICKS( HEAP_TRACE_SAMPLE_PERIOD_S * 1000 ), pdTRUE, NULL,
+                                     prvHeapTraceSample, &xTimerBuffer );
+        configASSERT( xTimer != NULL );
+
+        if( xTimer != NULL )
+        {
+            prvHeapTraceSample( xTimer );
+            ( void ) xTimerStart( xTimer, 0 );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapTraceGetStats( HeapTraceStats_t * pxStats )
+    {
+        vTaskSuspendAll();
+
+        *pxStats = xStats;
+
+        /* Oldest sample first */
+        if( xStats.ulHistoryCount == HEAP_TRACE_FRAG_SAMPLES )
+        {
+            for( uint32_t i = 0; i < HEAP_TRACE_FRAG_SAMPLES; i++ )
+            {
+                pxStats->ulLargestFreeHistory[ i ] = xStats.ulLargestFreeHistory[ ( ulHistoryNext + i ) % HEAP_TRACE_FRAG_SAMPLES ];
+            }
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    UBaseType_t uxHeapTraceGetOwners( HeapTraceOwner_t * pxOwners,
+                                      UBaseType_t uxMaxOwners )
+    {
+        UBaseType_t uxCount = 0;
+
+        vTaskSuspendAll();
+
+        for( UBaseType_t i = 0; ( i < HEAP_TRACE_MAX_OWNERS ) && ( uxCount < uxMaxOwners ); i++ )
+        {
+            if( ( i < uxOwnersUsed ) || ( i == HEAP_TRACE_OWNER_OTHER ) )
+            {
+                pxOwners[ uxCount++ ] = xOwners[ i ].xOwner;
+            }
+        }
+
+        ( void ) xTaskResumeAll();
+
+        return uxCount;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vHeapTraceSnapshot( void )
+    {
+        vTaskSuspendAll();
+
+        for( uint32_t i = 0; i < HEAP_TRACE_MAX_BLOCKS; i++ )
+        {
+            xEntries[ i ].ulOld = 1;
+        }
+
+        for( uint32_t i = 0; i < HEAP_TRACE_MAX_OWNERS; i++ )
+        {
+            xOwners[ i ].xOwner.ulSnapshotBytes = xOwners[ i ].xOwner.ulCurrentBytes;
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xHeapTraceGetNewBlocks( HeapTraceBlock_t * pxBlocks,
+                                   size_t xMaxBlocks )
+    {
+        size_t xCount = 0;
+
+        vTaskSuspendAll();
+
+        for( uint32_t i = 0; i < HEAP_TRACE_MAX_BLOCKS; i++ )
+        {
+            if( ( xEntries[ i ].pvAddress != NULL ) && ( xEntries[ i ].ulOld == 0 ) )
+            {
+                if( xCount < xMaxBlocks )
+                {
+                    pxBlocks[ xCount ].pvAddress = xEntries[ i ].pvAddress;
+                    pxBlocks[ xCount ].xSize = xEntries[ i ].ulSize;
+                    pxBlocks[ xCount ].pcOwner = xOwners[ xEntries[ i ].ulOwner ].xOwner.pcName;
+                }
+
+                xCount++;
+            }
+        }
+
+        ( void ) xTaskResumeAll();
+
+        return xCount;
+    }
+
+#endif /* HEAP_TRACE_ENABLED == 1 */
@@ -0,0 +1,321 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "static_alloc.h"
+
+#include "hw_defs.h"
+#include "b_u585i_iot02a_bus.h"
+
+#include "i2c_bus.h"
+#include "lowpower.h"
+
+#define I2C_BUS_NOTIFY_DONE     ( 1UL )
+#define I2C_BUS_NOTIFY_ERROR    ( 2UL )
+
+/* Time given to an aborted transfer to release the bus */
+#define I2C_BUS_ABORT_WAIT_MS   ( 5 )
+
+static DMA_HandleTypeDef xI2c2RxDma =
+{
+    .Instance                  = GPDMA1_Channel3,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_I2C2_RX,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_PERIPH_TO_MEMORY,
+        .SrcInc                = DMA_SINC_FIXED,
+        .DestInc               = DMA_DINC_INCREMENTED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+static SemaphoreHandle_t xBusMutex = NULL;
+
+/* List in progress, only changed with the I2C2 interrupts masked or from them */
+static const I2cBusXfer_t * volatile pxList = NULL;
+static volatile size_t xListLen = 0;
+static volatile size_t xListIdx = 0;
+static TaskHandle_t xListWaiter = NULL;
+
+static I2cBusStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel3_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xI2c2RxDma );
+}
+
+void I2C2_EV_IRQHandler( void )
+{
+    HAL_I2C_EV_IRQHandler( &hbus_i2c2 );
+}
+
+void I2C2_ER_IRQHandler( void )
+{
+    HAL_I2C_ER_IRQHandler( &hbus_i2c2 );
+}
+
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef xStartTransfer( const I2cBusXfer_t * pxXfer )
+{
+    HAL_StatusTypeDef xStatus;
+
+    if( pxXfer->ucRead != 0 )
+    {
+        xStatus = HAL_I2C_Mem_Read_DMA( &hbus_i2c2, pxXfer->usDevAddr, pxXfer->usReg, I2C_MEMADD_SIZE_8BIT,
+                                        pxXfer->pucData, pxXfer->usLen );
+    }
+    else
+    {
+        xStatus = HAL_I2C_Mem_Write_IT( &hbus_i2c2, pxXfer->usDevAddr, pxXfer->usReg, I2C_MEMADD_SIZE_8BIT,
+                                        pxXfer->pucData, pxXfer->usLen );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvListEndFromISR( uint32_t ulResult )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    TaskHandle_t xWaiter = xListWaiter;
+
+    pxList = NULL;
+
+    ( void ) xTaskNotifyIndexedFromISR( xWaiter, I2C_BUS_NOTIFY_IDX, ulResult, eSetValueWithOverwrite, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+/* Start the next transfer of the list straight from the completion interrupt */
+static void prvTransferCompleteCallback( I2C_HandleTypeDef * pxI2c )
+{
+    ( void ) pxI2c;
+
+    if( pxList != NULL )
+    {
+        xListIdx++;
+
+        if( xListIdx >= xListLen )
+        {
+            prvListEndFromISR( I2C_BUS_NOTIFY_DONE );
+        }
+        else if( xStartTransfer( &pxList[ xListIdx ] ) != HAL_OK )
+        {
+            prvListEndFromISR( I2C_BUS_NOTIFY_ERROR );
+        }
+    }
+}
+
+static void prvTransferErrorCallback( I2C_HandleTypeDef * pxI2c )
+{
+    ( void ) pxI2c;
+
+    if( pxList != NULL )
+    {
+        prvListEndFromISR( I2C_BUS_NOTIFY_ERROR );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xI2cBusInit( void )
+{
+    BaseType_t xResult = pdFALSE;
+
+    xBusMutex = xAppSemaphoreCreateRecursiveMutex();
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    if( ( xBusMutex != NULL ) &&
+        ( HAL_DMA_Init( &xI2c2RxDma ) == HAL_OK ) &&
+        ( HAL_DMA_ConfigChannelAttributes( &xI2c2RxDma, DMA_CHANNEL_NPRIV ) == HAL_OK ) &&
+        ( HAL_I2C_RegisterCallback( &hbus_i2c2, HAL_I2C_MEM_RX_COMPLETE_CB_ID, prvTransferCompleteCallback ) == HAL_OK ) &&
+        ( HAL_I2C_RegisterCallback( &hbus_i2c2, HAL_I2C_MEM_TX_COMPLETE_CB_ID, prvTransferCompleteCallback ) == HAL_OK ) &&
+        ( HAL_I2C_RegisterCallback( &hbus_i2c2, HAL_I2C_ERROR_CB_ID, prvTransferErrorCallback ) == HAL_OK ) )
+    {
+        __HAL_LINKDMA( &hbus_i2c2, hdmarx, xI2c2RxDma );
+
+        HAL_NVIC_SetPriority( GPDMA1_Channel3_IRQn, 5, 2 );
+        HAL_NVIC_EnableIRQ( GPDMA1_Channel3_IRQn );
+        HAL_NVIC_SetPriority( I2C2_EV_IRQn, 5, 2 );
+        HAL_NVIC_EnableIRQ( I2C2_EV_IRQn );
+        HAL_NVIC_SetPriority( I2C2_ER_IRQn, 5, 2 );
+        HAL_NVIC_EnableIRQ( I2C2_ER_IRQn );
+
+        xResult = pdTRUE;
+    }
+    else
+    {
+        LogError( "Failed to set up the I2C2 bus manager." );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xI2cBusLock( TickType_t xTimeout )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( xBusMutex != NULL );
+
+    if( xSemaphoreTakeRecursive( xBusMutex, 0 ) == pdTRUE )
+    {
+        xResult = pdTRUE;
+    }
+    else
+    {
+        TickType_t xStart = xTaskGetTickCount();
+
+        xResult = xSemaphoreTakeRecursive( xBusMutex, xTimeout );
+
+        if( xResult == pdTRUE )
+        {
+            uint32_t ulWaitMs = ( uint32_t ) ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS;
+
+            /* Only written with the lock held */
+            xStats.ulContended++;
+
+            if( ulWaitMs > xStats.ulMaxWaitMs )
+            {
+                xStats.ulMaxWaitMs = ulWaitMs;
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vI2cBusUnlock( void )
+{
+    ( void ) xSemaphoreGiveRecursive( xBusMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xI2cBusTransfer( const I2cBusXfer_t * pxXfers,
+                            size_t xCount,
+                            TickType_t xTimeout )
+{
+    BaseType_t xResult = pdFALSE;
+    TimeOut_t xTimeOut;
+
+    configASSERT( ( pxXfers != NULL ) && ( xCount > 0 ) );
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    if( xI2cBusLock( xTimeout ) == pdTRUE )
+    {
+        uint32_t ulResult = 0;
+
+        ( void ) xTaskCheckForTimeOut( &xTimeOut, &xTimeout );
+
+        xStats.ulLists++;
+
+        /* Drop a result left over from an aborted list */
+        ( void ) xTaskNotifyStateClearIndexed( NULL, I2C_BUS_NOTIFY_IDX );
+        ( void ) ulTaskNotifyValueClearIndexed( NULL, I2C_BUS_NOTIFY_IDX, UINT32_MAX );
+
+        /* I2C2 and its DMA channel stop in STOP2 */
+        vLowPowerInhibit();
+
+        xListWaiter = xTaskGetCurrentTaskHandle();
+        xListLen = xCount;
+        xListIdx = 0;
+        pxList = pxXfers;
+
+        if( xStartTransfer( &pxXfers[ 0 ] ) != HAL_OK )
+        {
+            pxList = NULL;
+        }
+        else if( xTaskNotifyWaitIndexed( I2C_BUS_NOTIFY_IDX, 0, UINT32_MAX, &ulResult, xTimeout ) == pdFALSE )
+        {
+            taskENTER_CRITICAL();
+            pxList = NULL;
+            taskEXIT_CRITICAL();
+
+            ( void ) HAL_I2C_Master_Abort_IT( &hbus_i2c2, pxXfers[ xListIdx ].usDevAddr );
+
+            for( uint32_t i = 0; ( i < I2C_BUS_ABORT_WAIT_MS ) && ( HAL_I2C_GetState( &hbus_i2c2 ) != HAL_I2C_STATE_READY ); i++ )
+            {
+                vTaskDelay( 1 );
+            }
+
+            xStats.ulTimeouts++;
+            LogError( "I2C transfer list timed out at %u of %u.", xListIdx, xCount );
+        }
+        else
+        {
+            xResult = ( ulResult == I2C_BUS_NOTIFY_DONE ) ? pdTRUE : pdFALSE;
+        }
+
+        /* Index of the transfer which failed, or xCount once all of them completed */
+        xStats.ulTransfers += xListIdx;
+
+        if( xResult != pdTRUE )
+        {
+            xStats.ulErrors++;
+        }
+
+        vLowPowerRelease();
+
+        vI2cBusUnlock();
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vI2cBusGetStats( I2cBusStats_t * pxStats )
+{
+    ( void ) xI2cBusLock( portMAX_DELAY );
+    *pxStats = xStats;
+    vI2cBusUnlock();
+}
@@ -28,10 +28,27 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "hw_defs.h"
+#include "sram_banks.h"
+#include "postmortem.h"
 
 static GPIOInterruptCallback_t volatile xGpioCallbacks[ 16 ] = { NULL };
 static void * volatile xGpioCallbackContext[ 16 ] = { NULL };
 
+/* Direct task notification targets, checked before the callback table */
+typedef struct
+{
+    TaskHandle_t xTask;
+    uint32_t ulIndex;
+    uint32_t ulBits; /* 0 to give the notification as a counting semaphore */
+} GpioNotifyTarget_t;
+
+static GpioNotifyTarget_t volatile xGpioNotifyTargets[ 16 ] = { 0 };
+
+/* DWT cycle count at the most recent rising edge of each EXTI line */
+static uint32_t volatile ulGpioEdgeCycles[ 16 ] = { 0 };
+
+static void prvExtiDispatch( uint32_t ulIndex );
+
 void NMI_Handler( void )
 {
     while( 1 )
@@ -76,45 +93,59 @@ __attribute__( ( optimize( "O0" ) ) ) void prvGetRegistersFromStack( uint32_t *
     }
 }
 
+/* Called by the fault handlers with the frame stacked on entry and the EXC_RETURN value in lr */
+void prvFaultHandler( uint32_t * pulFaultStackAddress,
+                      uint32_t ulExcReturn,
+                      uint32_t ulReason ) __attribute__( ( used ) );
+
+void prvFaultHandler( uint32_t * pulFaultStackAddress,
+                      uint32_t ulExcReturn,
+                      uint32_t ulReason )
+{
+    vPostMortemFault( ( PostMortemReason_t ) ulReason, pulFaultStackAddress, ulExcReturn );
+
+    prvGetRegistersFromStack( pulFaultStackAddress );
+}
+
+/* The reason is an immediate in the handlers below */
+_Static_assert( ( PostMortemHardFault == 2 ) && ( PostMortemMemManage == 3 ) &&
+                ( PostMortemBusFault == 4 ) && ( PostMortemUsageFault == 5 ), "Fault reasons changed" );
+
+#define FAULT_HANDLER_ASM( ulReason )                               \
+    " tst lr, #4                                                \n" \
+    " ite eq                                                    \n" \
+    " mrseq r0, msp                                             \n" \
+    " mrsne r0, psp                                             \n" \
+    " mov r1, lr                                                \n" \
+    " movs r2, #" #ulReason "                                    \n" \
+    " b prvFaultHandler                                         \n"
+
 void HardFault_Handler( void ) __attribute__( ( naked, aligned( 8 ) ) );
 
 void HardFault_Handler( void )
 {
-    __asm volatile
-    (
-        " tst lr, #4                                                \n"
-        " ite eq                                                    \n"
-        " mrseq r0, msp                                             \n"
-        " mrsne r0, psp                                             \n"
-        " ldr r1, [r0, #24]                                         \n"
-        " ldr r2, handler2_address_const                            \n"
-        " bx r2                                                     \n"
-        " handler2_address_const: .word prvGetRegistersFromStack    \n"
-    );
+    __asm volatile ( FAULT_HANDLER_ASM( 2 ) );
 }
 
+void MemManage_Handler( void ) __attribute__( ( naked, aligned( 8 ) ) );
+
 void MemManage_Handler( void )
 {
-    while( 1 )
-    {
-        __NOP();
-    }
+    __asm volatile ( FAULT_HANDLER_ASM( 3 ) );
 }
 
+void BusFault_Handler( void ) __attribute__( ( naked, aligned( 8 ) ) );
+
 void BusFault_Handler( void )
 {
-    while( 1 )
-    {
-        __NOP();
-    }
+    __asm volatile ( FAULT_HANDLER_ASM( 4 ) );
 }
 
+void UsageFault_Handler( void ) __attribute__( ( naked, aligned( 8 ) ) );
+
 void UsageFault_Handler( void )
 {
-    while( 1 )
-    {
-        __NOP();
-    }
+    __asm volatile ( FAULT_HANDLER_ASM( 5 ) );
 }
 
 void Error_Handler( void )
@@ -132,18 +163,23 @@ void DebugMon_Handler( void )
     __NOP();
 }
 
-/* STM32U5xx Peripheral Interrupt Handlers */
-void EXTI14_IRQHandler( void )
+/* STM32U5xx Peripheral Interrupt Handlers, the EMW3080 and sensor paths run from SRAM */
+void RAMFUNC EXTI11_IRQHandler( void )
 {
-    HAL_GPIO_EXTI_IRQHandler( GPIO_PIN_14 );
+    prvExtiDispatch( 11 );
 }
 
-void EXTI15_IRQHandler( void )
+void RAMFUNC EXTI14_IRQHandler( void )
 {
-    HAL_GPIO_EXTI_IRQHandler( GPIO_PIN_15 );
+    prvExtiDispatch( 14 );
 }
 
-void GPDMA1_Channel4_IRQHandler( void )
+void RAMFUNC EXTI15_IRQHandler( void )
+{
+    prvExtiDispatch( 15 );
+}
+
+void RAMFUNC GPDMA1_Channel4_IRQHandler( void )
 {
     if( pxHndlGpdmaCh4 != NULL )
     {
@@ -151,7 +187,7 @@ void GPDMA1_Channel4_IRQHandler( void )
     }
 }
 
-void GPDMA1_Channel5_IRQHandler( void )
+void RAMFUNC GPDMA1_Channel5_IRQHandler( void )
 {
     if( pxHndlGpdmaCh5 != NULL )
     {
@@ -165,7 +201,7 @@ void TIM6_IRQHandler( void )
 /*    HAL_TIM_IRQHandler(&htim6); */
 }
 
-void SPI2_IRQHandler( void )
+void RAMFUNC SPI2_IRQHandler( void )
 {
     if( pxHndlSpi2 )
     {
@@ -214,8 +250,103 @@ void GPIO_EXTI_Register_Callback( uint16_t usGpioPinMask,
     xGpioCallbackContext[ ulIndex ] = pvContext;
 }
 
+/*
+ * @brief Notify a task directly from the EXTI interrupt of a given gpio.
+ * @param usGpioPinMask The target gpio pin's bitmask
+ * @param xTask Task to notify, NULL to fall back to the registered callback
+ * @param ulIndex Notification index used for xTask
+ * @param ulBits Bits to set in the notification value, or 0 to give the notification
+ */
+void GPIO_EXTI_Register_Notify( uint16_t usGpioPinMask,
+                                TaskHandle_t xTask,
+                                uint32_t ulIndex,
+                                uint32_t ulBits )
+{
+    uint32_t ulLine = POSITION_VAL( usGpioPinMask );
+
+    configASSERT( ulLine < 16 );
+    configASSERT( ulIndex < configTASK_NOTIFICATION_ARRAY_ENTRIES );
+
+    taskENTER_CRITICAL();
+    {
+        xGpioNotifyTargets[ ulLine ].ulIndex = ulIndex;
+        xGpioNotifyTargets[ ulLine ].ulBits = ulBits;
+        xGpioNotifyTargets[ ulLine ].xTask = xTask;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * @brief Return the DWT cycle count latched at the last rising edge of a given gpio.
+ * @param usGpioPinMask The target gpio pin's bitmask
+ */
+uint32_t GPIO_EXTI_Get_Edge_Cycles( uint16_t usGpioPinMask )
+{
+    uint32_t ulIndex = POSITION_VAL( usGpioPinMask );
+
+    configASSERT( ulIndex < 16 );
+
+    return ulGpioEdgeCycles[ ulIndex ];
+}
+
+/* Rising edge on EXTI line ulIndex: notify the registered task, or run the callback */
+static inline void prvExtiRising( uint32_t ulIndex,
+                                  uint32_t ulCycles )
+{
+    TaskHandle_t xTask = xGpioNotifyTargets[ ulIndex ].xTask;
+
+    ulGpioEdgeCycles[ ulIndex ] = ulCycles;
+
+    if( xTask != NULL )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+        if( xGpioNotifyTargets[ ulIndex ].ulBits == 0 )
+        {
+            vTaskNotifyGiveIndexedFromISR( xTask,
+                                           xGpioNotifyTargets[ ulIndex ].ulIndex,
+                                           &xHigherPriorityTaskWoken );
+        }
+        else
+        {
+            ( void ) xTaskNotifyIndexedFromISR( xTask,
+                                                xGpioNotifyTargets[ ulIndex ].ulIndex,
+                                                xGpioNotifyTargets[ ulIndex ].ulBits,
+                                                eSetBits,
+                                                &xHigherPriorityTaskWoken );
+        }
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+    else if( xGpioCallbacks[ ulIndex ] != NULL )
+    {
+        ( *( xGpioCallbacks[ ulIndex ] ) )( xGpioCallbackContext[ ulIndex ] );
+    }
+}
+
+/*
+ * Same flag handling as HAL_GPIO_EXTI_IRQHandler, without the call through the weak
+ * HAL callbacks. Falling edges are acknowledged and ignored.
+ */
+static void RAMFUNC prvExtiDispatch( uint32_t ulIndex )
+{
+    uint32_t ulCycles = DWT->CYCCNT;
+    uint32_t ulLineMask = ( 1UL << ulIndex );
+
+    if( ( EXTI->RPR1 & ulLineMask ) != 0 )
+    {
+        EXTI->RPR1 = ulLineMask;
+        prvExtiRising( ulIndex, ulCycles );
+    }
+
+    if( ( EXTI->FPR1 & ulLineMask ) != 0 )
+    {
+        EXTI->FPR1 = ulLineMask;
+    }
+}
+
 /**
- * @brief  EXTI line rising detection callback.
+ * @brief  EXTI line falling detection callback.
  * @param  GPIO_Pin: Specifies the port pin connected to corresponding EXTI line.
  * @retval None
  */
@@ -225,16 +356,12 @@ void HAL_GPIO_EXTI_Falling_Callback( uint16_t usGpioPinMask )
 }
 
 /**
- * @brief  EXTI line rising detection callback.
+ * @brief  EXTI line rising detection callback, for lines still serviced by
+ *         HAL_GPIO_EXTI_IRQHandler.
  * @param  GPIO_Pin: Specifies the port pin connected to corresponding EXTI line.
  * @retval None
  */
 void HAL_GPIO_EXTI_Rising_Callback( uint16_t usGpioPinMask )
 {
-    uint32_t ulIndex = POSITION_VAL( usGpioPinMask );
-
-    if( xGpioCallbacks[ ulIndex ] != NULL )
-    {
-        ( *( xGpioCallbacks[ ulIndex ] ) )( xGpioCallbackContext[ ulIndex ] );
-    }
+    prvExtiRising( POSITION_VAL( usGpioPinMask ), DWT->CYCCNT );
 }
@@ -0,0 +1,312 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32u5xx_hal.h"
+#include "hw_defs.h"
+#include "metrics.h"
+#include "lowpower.h"
+
+#if ( LOW_POWER_ENABLED == 1 )
+
+/* LSE / 16, the 16 bit counter wraps after 32 s */
+    #define LPTIM_HZ                     2048UL
+    #define LPTIM_PRESC_DIV16            ( 4UL << LPTIM_CFGR_PRESC_Pos )
+
+/* Below, the compare may be missed while it is written, the idle task sleeps until the next tick instead */
+    #define LPTIM_MIN_COUNTS             4UL
+
+    #define LPTIM_COUNTS_TO_US( x )      ( ( ( x ) * 15625UL ) / 32UL )
+    #define LPTIM_US_TO_COUNTS( x )      ( ( ( x ) * 32UL ) / 15625UL )
+
+    #define US_PER_TICK                  ( 1000000UL / configTICK_RATE_HZ )
+
+/* Console RX, PA10 */
+    #define CONSOLE_RX_EXTI_LINE         10
+    #define CONSOLE_RX_EXTI_MASK         ( 1UL << CONSOLE_RX_EXTI_LINE )
+
+    static volatile uint32_t ulInhibit = 0;
+    static volatile TickType_t xConsoleActiveTick = 0;
+    static volatile BaseType_t xConsoleActive = pdFALSE;
+    static BaseType_t xReady = pdFALSE;
+
+/* Part of a tick spent in STOP2 which is not in the tick count yet */
+    static uint32_t ulCarryUs = 0;
+
+    static METRIC_COUNTER( xStopsMetric, "lp_stops" );
+    static METRIC_COUNTER( xStopMsMetric, "lp_stop_ms" );
+    static METRIC_COUNTER( xShallowSleepsMetric, "lp_shallow_sleeps" );
+    static METRIC_HISTOGRAM( xStopDurationMetric, "lp_stop_duration_ms" );
+
+/*-----------------------------------------------------------*/
+
+/* Reads of the counter are not synchronized with the APB clock and are only valid once two agree */
+    static uint32_t prvLptimCount( void )
+    {
+        uint32_t ulCount;
+        uint32_t ulPrev = LPTIM1->CNT;
+
+        while( ( ulCount = LPTIM1->CNT ) != ulPrev )
+        {
+            ulPrev = ulCount;
+        }
+
+        return ulCount & 0xFFFFUL;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vLowPowerInit( void )
+    {
+        HAL_StatusTypeDef xResult = HAL_OK;
+        RCC_OscInitTypeDef xRccOscInit =
+        {
+            .OscillatorType = RCC_OSCILLATORTYPE_LSE,
+            .LSEState       = RCC_LSE_ON,
+            .PLL.PLLState   = RCC_PLL_NONE,
+        };
+        RCC_PeriphCLKInitTypeDef xPeriphClkInit =
+        {
+            .PeriphClockSelection = RCC_PERIPHCLK_LPTIM1,
+            .Lptim1ClockSelection = RCC_LPTIM1CLKSOURCE_LSE,
+        };
+
+        HAL_PWR_EnableBkUpAccess();
+
+        xResult = HAL_RCC_OscConfig( &xRccOscInit );
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_RCCEx_PeriphCLKConfig( &xPeriphClkInit );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            __HAL_RCC_LPTIM1_CLK_ENABLE();
+
+            /* Free running, the compare sets the next wakeup */
+            LPTIM1->CFGR = LPTIM_PRESC_DIV16;
+            LPTIM1->CR = LPTIM_CR_ENABLE;
+
+            LPTIM1->DIER = LPTIM_DIER_CC1IE;
+
+            while( ( LPTIM1->ISR & LPTIM_ISR_DIEROK ) == 0 )
+            {
+            }
+
+            LPTIM1->ARR = 0xFFFFUL;
+
+            while( ( LPTIM1->ISR & LPTIM_ISR_ARROK ) == 0 )
+            {
+            }
+
+            LPTIM1->ICR = LPTIM_ICR_DIEROKCF | LPTIM_ICR_ARROKCF;
+            LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+            /* Only enabled while stopped */
+            HAL_NVIC_SetPriority( LPTIM1_IRQn, 5, 0 );
+            HAL_NVIC_SetPriority( EXTI10_IRQn, 5, 0 );
+
+            /* PA10 stays in its alternate function, the EXTI line only sees the input */
+            MODIFY_REG( EXTI->EXTICR[ CONSOLE_RX_EXTI_LINE / 4 ],
+                        0xFFUL << ( 8 * ( CONSOLE_RX_EXTI_LINE % 4 ) ),
+                        0x00UL << ( 8 * ( CONSOLE_RX_EXTI_LINE % 4 ) ) );
+            EXTI->FTSR1 |= CONSOLE_RX_EXTI_MASK;
+
+            vMetricRegister( &xStopsMetric );
+            vMetricRegister( &xStopMsMetric );
+            vMetricRegister( &xShallowSleepsMetric );
+            vMetricRegister( &xStopDurationMetric );
+
+            xReady = pdTRUE;
+        }
+        else
+        {
+            LogError( "Failed to start the LSE, STOP2 is disabled." );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vLowPowerInhibit( void )
+    {
+        ( void ) __atomic_fetch_add( &ulInhibit, 1, __ATOMIC_RELAXED );
+    }
+
+    void vLowPowerRelease( void )
+    {
+        uint32_t ulPrev = __atomic_fetch_sub( &ulInhibit, 1, __ATOMIC_RELAXED );
+
+        configASSERT( ulPrev > 0 );
+        ( void ) ulPrev;
+    }
+
+    void vLowPowerConsoleActivity( void )
+    {
+        xConsoleActiveTick = xTaskGetTickCountFromISR();
+        xConsoleActive = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void LPTIM1_IRQHandler( void )
+    {
+        LPTIM1->ICR = LPTIM_ICR_CC1CF;
+    }
+
+    void EXTI10_IRQHandler( void )
+    {
+        EXTI->FPR1 = CONSOLE_RX_EXTI_MASK;
+        vLowPowerConsoleActivity();
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvStopAllowed( void )
+    {
+        BaseType_t xAllowed = pdFALSE;
+
+        if( ( xConsoleActive == pdTRUE ) &&
+            ( ( xTaskGetTickCount() - xConsoleActiveTick ) >= pdMS_TO_TICKS( LOW_POWER_CONSOLE_AWAKE_MS ) ) )
+        {
+            xConsoleActive = pdFALSE;
+        }
+
+        if( ( xReady == pdTRUE ) &&
+            ( xConsoleActive == pdFALSE ) &&
+            ( __atomic_load_n( &ulInhibit, __ATOMIC_RELAXED ) == 0 ) )
+        {
+            xAllowed = pdTRUE;
+        }
+
+        return xAllowed;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Called by the idle task with the scheduler suspended, replaces the port implementation (configUSE_TICKLESS_IDLE 2) */
+    void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+    {
+        uint32_t ulTickUs;
+        uint32_t ulWakeUs;
+        uint32_t ulCounts;
+        uint32_t ulStart;
+        uint32_t ulStoppedUs;
+        uint32_t ulTicks;
+
+        if( xExpectedIdleTime > pdMS_TO_TICKS( LOW_POWER_MAX_STOP_MS ) )
+        {
+            xExpectedIdleTime = pdMS_TO_TICKS( LOW_POWER_MAX_STOP_MS );
+        }
+
+        __disable_irq();
+        __DSB();
+        __ISB();
+
+        /* Part of the current tick already elapsed */
+        ulTickUs = ( SysTick->LOAD - SysTick->VAL ) / ( SystemCoreClock / 1000000UL );
+        ulWakeUs = ( xExpectedIdleTime * US_PER_TICK );
+        ulWakeUs = ( ulWakeUs > ( ulTickUs + ulCarryUs ) ) ? ( ulWakeUs - ulTickUs - ulCarryUs ) : 0;
+        ulCounts = LPTIM_US_TO_COUNTS( ulWakeUs );
+
+        if( eTaskConfirmSleepModeStatus() == eAbortSleep )
+        {
+            /* A task was readied or a context switch is pending */
+        }
+        else if( ( prvStopAllowed() == pdFALSE ) ||
+                 ( ulCounts < LPTIM_MIN_COUNTS ) )
+        {
+            /* The SysTick keeps running and ends this sleep at the latest */
+            __DSB();
+            __WFI();
+            __ISB();
+
+            vMetricIncrement( &xShallowSleepsMetric );
+        }
+        else
+        {
+            SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+            ulStart = prvLptimCount();
+
+            LPTIM1->ICR = LPTIM_ICR_CC1CF | LPTIM_ICR_CMP1OKCF;
+            LPTIM1->CCR1 = ( ulStart + ulCounts ) & 0xFFFFUL;
+
+            while( ( LPTIM1->ISR & LPTIM_ISR_CMP1OK ) == 0 )
+            {
+            }
+
+            NVIC_ClearPendingIRQ( LPTIM1_IRQn );
+            NVIC_EnableIRQ( LPTIM1_IRQn );
+
+            EXTI->FPR1 = CONSOLE_RX_EXTI_MASK;
+            EXTI->IMR1 |= CONSOLE_RX_EXTI_MASK;
+            NVIC_ClearPendingIRQ( EXTI10_IRQn );
+            NVIC_EnableIRQ( EXTI10_IRQn );
+
+            /* Any pending interrupt ends the stop, the handlers run once interrupts are enabled again */
+            HAL_PWREx_EnterSTOP2Mode( PWR_STOPENTRY_WFI );
+
+            ulStoppedUs = LPTIM_COUNTS_TO_US( ( prvLptimCount() - ulStart ) & 0xFFFFUL );
+
+            NVIC_DisableIRQ( LPTIM1_IRQn );
+            NVIC_DisableIRQ( EXTI10_IRQn );
+            EXTI->IMR1 &= ~CONSOLE_RX_EXTI_MASK;
+
+            hw_stop_resume( ulStoppedUs );
+
+            ulStoppedUs += ulTickUs + ulCarryUs;
+            ulTicks = ulStoppedUs / US_PER_TICK;
+
+            if( ulTicks > xExpectedIdleTime )
+            {
+                ulTicks = xExpectedIdleTime;
+                ulCarryUs = 0;
+            }
+            else
+            {
+                ulCarryUs = ulStoppedUs - ( ulTicks * US_PER_TICK );
+            }
+
+            vTaskStepTick( ulTicks );
+
+            vMetricIncrement( &xStopsMetric );
+            vMetricAdd( &xStopMsMetric, ulTicks * portTICK_PERIOD_MS );
+            vMetricObserve( &xStopDurationMetric, ulTicks * portTICK_PERIOD_MS );
+        }
+
+        __enable_irq();
+    }
+
+#endif /* LOW_POWER_ENABLED == 1 */
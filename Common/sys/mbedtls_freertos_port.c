@@ -31,6 +31,7 @@
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
 
 /* mbed TLS includes. */
 #if defined( MBEDTLS_CONFIG_FILE )
@@ -41,6 +42,216 @@
 #include "mbedtls/entropy.h"
 
 #include "mbedtls_freertos_port.h"
+#include "heap_regions.h"
+
+/*-----------------------------------------------------------*/
+
+#if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+
+/*
+ * Size class arena for mbed TLS. Requests up to the largest class are served
+ * from fixed size blocks of a region taken from the FreeRTOS heap once, so
+ * the many short lived MPI buffers of a handshake neither fragment the heap
+ * nor pay for a heap_4 walk. Larger requests, and requests made while their
+ * class is empty, fall back to pvPortMalloc.
+ */
+    #ifndef MBEDTLS_ARENA_CLASS_BLOCKS
+        #define MBEDTLS_ARENA_CLASS_BLOCKS    { 64, 128, 64, 32, 32, 8 }
+    #endif
+
+    static const size_t uxArenaClassSize[ MBEDTLS_ARENA_CLASSES ] = { 16, 32, 64, 128, 256, 512 };
+    static const size_t uxArenaClassBlocks[ MBEDTLS_ARENA_CLASSES ] = MBEDTLS_ARENA_CLASS_BLOCKS;
+
+/* Free blocks of each class, linked through their first word */
+    typedef struct ArenaBlock
+    {
+        struct ArenaBlock * pxNext;
+    } ArenaBlock_t;
+
+    static uint8_t * pucArenaStart = NULL;
+    static uint8_t * pucArenaEnd = NULL;
+    static uint8_t * pucClassStart[ MBEDTLS_ARENA_CLASSES ];
+    static ArenaBlock_t * pxClassFree[ MBEDTLS_ARENA_CLASSES ];
+    static MbedtlsArenaStats_t xArenaStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+/* Carve the arena out of the heap once, at the first allocation */
+    static BaseType_t xArenaInit( void )
+    {
+        size_t uxTotal = 0;
+        uint8_t * pucArena;
+
+        for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+        {
+            uxTotal += uxArenaClassSize[ i ] * uxArenaClassBlocks[ i ];
+        }
+
+        pucArena = pvPortMallocPolicy( uxTotal, HEAP_POLICY_CRYPTO );
+
+        if( pucArena != NULL )
+        {
+            ( void ) memset( pucArena, 0, uxTotal );
+
+            taskENTER_CRITICAL();
+
+            if( pucArenaStart == NULL )
+            {
+                uint8_t * pucBlock = pucArena;
+
+                for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+                {
+                    pucClassStart[ i ] = pucBlock;
+                    pxClassFree[ i ] = NULL;
+
+                    for( size_t j = 0; j < uxArenaClassBlocks[ i ]; j++ )
+                    {
+                        ArenaBlock_t * pxBlock = ( ArenaBlock_t * ) pucBlock;
+
+                        pxBlock->pxNext = pxClassFree[ i ];
+                        pxClassFree[ i ] = pxBlock;
+                        pucBlock += uxArenaClassSize[ i ];
+                    }
+                }
+
+                pucArenaEnd = pucBlock;
+                pucArenaStart = pucArena;
+                pucArena = NULL;
+            }
+
+            taskEXIT_CRITICAL();
+
+            /* Another task initialized the arena first */
+            if( pucArena != NULL )
+            {
+                vPortFree( pucArena );
+            }
+        }
+
+        return ( pucArenaStart != NULL ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void * pvArenaAlloc( size_t uxSize )
+    {
+        ArenaBlock_t * pxBlock = NULL;
+
+        if( ( pucArenaStart != NULL ) || ( xArenaInit() == pdTRUE ) )
+        {
+            taskENTER_CRITICAL();
+
+            for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+            {
+                if( uxSize <= uxArenaClassSize[ i ] )
+                {
+                    pxBlock = pxClassFree[ i ];
+
+                    if( pxBlock != NULL )
+                    {
+                        pxClassFree[ i ] = pxBlock->pxNext;
+
+                        xArenaStats.uxInUse[ i ]++;
+
+                        if( xArenaStats.uxInUse[ i ] > xArenaStats.uxPeak[ i ] )
+                        {
+                            xArenaStats.uxPeak[ i ] = xArenaStats.uxInUse[ i ];
+                        }
+                    }
+                    else
+                    {
+                        xArenaStats.ulFallbacks++;
+                    }
+
+                    break;
+                }
+            }
+
+            taskEXIT_CRITICAL();
+        }
+
+        /* Free blocks are kept zeroed except for the link word */
+        if( pxBlock != NULL )
+        {
+            pxBlock->pxNext = NULL;
+        }
+
+        return pxBlock;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Returns pdTRUE if ptr belonged to the arena and has been returned to it */
+    static BaseType_t xArenaFree( void * ptr )
+    {
+        uint8_t * puc = ( uint8_t * ) ptr;
+        BaseType_t xFreed = pdFALSE;
+
+        if( ( pucArenaStart != NULL ) &&
+            ( puc >= pucArenaStart ) &&
+            ( puc < pucArenaEnd ) )
+        {
+            size_t i = MBEDTLS_ARENA_CLASSES - 1;
+
+            while( puc < pucClassStart[ i ] )
+            {
+                i--;
+            }
+
+            configASSERT( ( ( size_t ) ( puc - pucClassStart[ i ] ) % uxArenaClassSize[ i ] ) == 0 );
+
+            /* Only the class size needs clearing, no heap header lookup */
+            explicit_bzero( puc, uxArenaClassSize[ i ] );
+
+            taskENTER_CRITICAL();
+
+            ( ( ArenaBlock_t * ) puc )->pxNext = pxClassFree[ i ];
+            pxClassFree[ i ] = ( ArenaBlock_t * ) puc;
+            configASSERT( xArenaStats.uxInUse[ i ] > 0 );
+            xArenaStats.uxInUse[ i ]--;
+
+            taskEXIT_CRITICAL();
+
+            xFreed = pdTRUE;
+        }
+
+        return xFreed;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void mbedtls_platform_arena_get_stats( MbedtlsArenaStats_t * pxStats )
+    {
+        configASSERT( pxStats != NULL );
+
+        taskENTER_CRITICAL();
+        *pxStats = xArenaStats;
+        taskEXIT_CRITICAL();
+
+        for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+        {
+            pxStats->uxClassSize[ i ] = uxArenaClassSize[ i ];
+            pxStats->uxBlocks[ i ] = uxArenaClassBlocks[ i ];
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void mbedtls_platform_arena_reset_peak( void )
+    {
+        taskENTER_CRITICAL();
+
+        for( size_t i = 0; i < MBEDTLS_ARENA_CLASSES; i++ )
+        {
+            xArenaStats.uxPeak[ i ] = xArenaStats.uxInUse[ i ];
+        }
+
+        xArenaStats.ulFallbacks = 0;
+
+        taskEXIT_CRITICAL();
+    }
+
+#endif /* MBEDTLS_FREERTOS_SLAB_ARENA */
 
 /*-----------------------------------------------------------*/
 
@@ -64,11 +275,18 @@ void * mbedtls_platform_calloc( size_t nmemb,
         /* Overflow check. */
         if( ( totalSize / size ) == nmemb )
         {
-            pBuffer = pvPortMalloc( totalSize );
+            #if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+                pBuffer = pvArenaAlloc( totalSize );
+            #endif
 
-            if( pBuffer != NULL )
+            if( pBuffer == NULL )
             {
-                explicit_bzero( pBuffer, totalSize );
+                pBuffer = pvPortMallocPolicy( totalSize, HEAP_POLICY_CRYPTO );
+
+                if( pBuffer != NULL )
+                {
+                    explicit_bzero( pBuffer, totalSize );
+                }
             }
         }
     }
@@ -85,12 +303,21 @@ void * mbedtls_platform_calloc( size_t nmemb,
  */
 void mbedtls_platform_free( void * ptr )
 {
-    size_t xBlockLen = malloc_usable_size( ptr );
+    BaseType_t xFreed = pdFALSE;
+
+    #if defined( MBEDTLS_FREERTOS_SLAB_ARENA )
+        xFreed = xArenaFree( ptr );
+    #endif
 
-    if( xBlockLen > 0 )
+    if( xFreed == pdFALSE )
     {
-        explicit_bzero( ptr, xBlockLen );
-        vPortFree( ptr );
+        size_t xBlockLen = malloc_usable_size( ptr );
+
+        if( xBlockLen > 0 )
+        {
+            explicit_bzero( ptr, xBlockLen );
+            vPortFree( ptr );
+        }
     }
 }
 
@@ -0,0 +1,187 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "metrics.h"
+#include "periodic_work.h"
+#include "mem_pressure.h"
+
+#if ( MEM_PRESSURE_ENABLED == 1 )
+
+    #if ( MEM_PRESSURE_CRITICAL_WATERMARK >= MEM_PRESSURE_LOW_WATERMARK ) || ( MEM_PRESSURE_LOW_WATERMARK > MEM_PRESSURE_HIGH_WATERMARK )
+        #error MEM_PRESSURE_CRITICAL_WATERMARK, MEM_PRESSURE_LOW_WATERMARK and MEM_PRESSURE_HIGH_WATERMARK must be in increasing order
+    #endif
+
+/* Sorted by priority. Handlers are linked once and never unlinked, so the list is walked without a lock. */
+    static MemPressureHandler_t * pxHandlerHead = NULL;
+
+/* Set while a task runs the handlers */
+    static BaseType_t xReclaiming = pdFALSE;
+
+/* Set from the first check below the low watermark until the free heap is back above the high watermark,
+ * the handlers are called on every check meanwhile */
+    static BaseType_t xUnderPressure = pdFALSE;
+
+    static METRIC_COUNTER( xLowPassesMetric, "mempress_low" );
+    static METRIC_COUNTER( xCriticalPassesMetric, "mempress_critical" );
+    static METRIC_COUNTER( xReleasedMetric, "mempress_released_bytes" );
+
+/*-----------------------------------------------------------*/
+
+    void vMemPressureRegister( MemPressureHandler_t * pxHandler,
+                               const char * pcName,
+                               MemPressureCallback_t pxCallback,
+                               void * pvCtx,
+                               uint32_t ulPriority )
+    {
+        configASSERT( pxHandler != NULL );
+        configASSERT( pxCallback != NULL );
+
+        vTaskSuspendAll();
+        {
+            MemPressureHandler_t ** ppxLink = &pxHandlerHead;
+            BaseType_t xLinked = pdFALSE;
+
+            for( MemPressureHandler_t * pxItem = pxHandlerHead; pxItem != NULL; pxItem = pxItem->pxNext )
+            {
+                xLinked = xLinked || ( pxItem == pxHandler );
+            }
+
+            if( xLinked == pdFALSE )
+            {
+                pxHandler->pcName = pcName;
+                pxHandler->pxCallback = pxCallback;
+                pxHandler->pvCtx = pvCtx;
+                pxHandler->ulPriority = ulPriority;
+                pxHandler->ulCalls = 0;
+                pxHandler->xReleasedBytes = 0;
+
+                while( ( *ppxLink != NULL ) && ( ( *ppxLink )->ulPriority <= ulPriority ) )
+                {
+                    ppxLink = &( ( *ppxLink )->pxNext );
+                }
+
+                pxHandler->pxNext = *ppxLink;
+                *ppxLink = pxHandler;
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t xMemPressureReclaim( MemPressureLevel_t xLevel,
+                                size_t xWantedBytes )
+    {
+        size_t xReleased = 0;
+
+        /* A handler which allocates, or a second task which runs out of memory meanwhile, does not shrink again */
+        if( __atomic_exchange_n( &xReclaiming, pdTRUE, __ATOMIC_ACQUIRE ) == pdFALSE )
+        {
+            vMetricIncrement( ( xLevel == MEM_PRESSURE_CRITICAL ) ? &xCriticalPassesMetric : &xLowPassesMetric );
+
+            for( MemPressureHandler_t * pxHandler = pxHandlerHead;
+                 ( pxHandler != NULL ) && ( ( xLevel == MEM_PRESSURE_CRITICAL ) || ( xReleased < xWantedBytes ) );
+                 pxHandler = pxHandler->pxNext )
+            {
+                size_t xBytes = pxHandler->pxCallback( xLevel, pxHandler->pvCtx );
+
+                pxHandler->ulCalls++;
+                pxHandler->xReleasedBytes += xBytes;
+                xReleased += xBytes;
+            }
+
+            vMetricAdd( &xReleasedMetric, ( uint32_t ) xReleased );
+
+            __atomic_store_n( &xReclaiming, pdFALSE, __ATOMIC_RELEASE );
+        }
+
+        return xReleased;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvMemPressureCheck( void * pvCtx )
+    {
+        size_t xFree = xPortGetFreeHeapSize();
+
+        ( void ) pvCtx;
+
+        if( xFree >= MEM_PRESSURE_HIGH_WATERMARK )
+        {
+            if( xUnderPressure == pdTRUE )
+            {
+                LogInfo( "Free heap back to %u bytes.", ( unsigned int ) xFree );
+                xUnderPressure = pdFALSE;
+            }
+        }
+        else if( ( xFree < MEM_PRESSURE_LOW_WATERMARK ) || ( xUnderPressure == pdTRUE ) )
+        {
+            MemPressureLevel_t xLevel = ( xFree < MEM_PRESSURE_CRITICAL_WATERMARK ) ? MEM_PRESSURE_CRITICAL : MEM_PRESSURE_LOW;
+            size_t xReleased;
+
+            if( xUnderPressure == pdFALSE )
+            {
+                LogWarn( "Free heap down to %u bytes, shrinking caches.", ( unsigned int ) xFree );
+                xUnderPressure = pdTRUE;
+            }
+
+            xReleased = xMemPressureReclaim( xLevel, MEM_PRESSURE_HIGH_WATERMARK - xFree );
+
+            LogDebug( "Shrink handlers gave back %u bytes.", ( unsigned int ) xReleased );
+            ( void ) xReleased;
+        }
+        else
+        {
+            /* Between the watermarks on the way down, nothing to do */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vMemPressureInit( void )
+    {
+        static PeriodicWork_t xCheckWork;
+
+        vMetricRegister( &xLowPassesMetric );
+        vMetricRegister( &xCriticalPassesMetric );
+        vMetricRegister( &xReleasedMetric );
+
+        /* Allocations which fail do not wait for the check, so it can be late by a full period */
+        vPeriodicWorkStartCallback( &xCheckWork, prvMemPressureCheck, NULL,
+                                    pdMS_TO_TICKS( MEM_PRESSURE_CHECK_MS ), pdMS_TO_TICKS( MEM_PRESSURE_CHECK_MS ) );
+    }
+
+#endif /* MEM_PRESSURE_ENABLED == 1 */
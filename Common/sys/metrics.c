@@ -0,0 +1,103 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file metrics.c
+ *
+ * @brief Registry of the on-device counters, gauges and histograms.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "metrics.h"
+
+/* Metrics are only ever appended, so the list is walked without a lock */
+static Metric_t * pxMetricsHead = NULL;
+static Metric_t * pxMetricsTail = NULL;
+
+/*-----------------------------------------------------------*/
+
+void vMetricRegister( Metric_t * pxMetric )
+{
+    configASSERT( pxMetric != NULL );
+    configASSERT( pxMetric->pcName != NULL );
+    configASSERT( ( pxMetric->xType != MetricTypeHistogram ) || ( pxMetric->pulBuckets != NULL ) );
+
+    taskENTER_CRITICAL();
+    {
+        if( ( pxMetric->pxNext == NULL ) && ( pxMetric != pxMetricsTail ) )
+        {
+            if( pxMetricsTail == NULL )
+            {
+                __atomic_store_n( &pxMetricsHead, pxMetric, __ATOMIC_RELEASE );
+            }
+            else
+            {
+                __atomic_store_n( &( pxMetricsTail->pxNext ), pxMetric, __ATOMIC_RELEASE );
+            }
+
+            pxMetricsTail = pxMetric;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vMetricsSnapshot( MetricsVisitor_t xVisitor,
+                       void * pvCtx )
+{
+    MetricSnapshot_t xSnapshot;
+    BaseType_t xContinue = pdTRUE;
+
+    configASSERT( xVisitor != NULL );
+
+    for( const Metric_t * pxMetric = __atomic_load_n( &pxMetricsHead, __ATOMIC_ACQUIRE );
+         ( pxMetric != NULL ) && ( xContinue == pdTRUE );
+         pxMetric = __atomic_load_n( &( pxMetric->pxNext ), __ATOMIC_ACQUIRE ) )
+    {
+        xSnapshot.pcName = pxMetric->pcName;
+        xSnapshot.xType = pxMetric->xType;
+        xSnapshot.ulValue = __atomic_load_n( &( pxMetric->ulValue ), __ATOMIC_RELAXED );
+        xSnapshot.uxBuckets = 0;
+
+        if( pxMetric->xType == MetricTypeHistogram )
+        {
+            for( size_t uxIdx = 0; uxIdx < METRICS_HISTOGRAM_BUCKETS; uxIdx++ )
+            {
+                xSnapshot.pulBuckets[ uxIdx ] = __atomic_load_n( &( pxMetric->pulBuckets[ uxIdx ] ), __ATOMIC_RELAXED );
+
+                if( xSnapshot.pulBuckets[ uxIdx ] != 0 )
+                {
+                    xSnapshot.uxBuckets = uxIdx + 1;
+                }
+            }
+        }
+
+        xContinue = xVisitor( &xSnapshot, pvCtx );
+    }
+}
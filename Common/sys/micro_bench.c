@@ -0,0 +1,309 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file micro_bench.c
+ *
+ * @brief Registry and runner of the DWT timed micro-benchmark kernels.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32u5xx.h"
+#include "micro_bench.h"
+
+/* Calls of an empty kernel timed to measure the cost of the timing itself */
+#define MICRO_BENCH_OVERHEAD_RUNS    8U
+
+/*
+ * The stack below the runner is painted from MICRO_BENCH_STACK_GAP to MICRO_BENCH_STACK_PROBE
+ * bytes under its frame, the gap holds the frames of the painting and scanning helpers.
+ */
+#define MICRO_BENCH_STACK_GAP        64U
+#define MICRO_BENCH_STACK_FILL       0x5AU
+
+/* Kernels are only ever appended, so the list is walked without a lock */
+static MicroBench_t * pxBenchHead = NULL;
+static MicroBench_t * pxBenchTail = NULL;
+
+/*-----------------------------------------------------------*/
+
+void vMicroBenchRegister( MicroBench_t * pxBench )
+{
+    configASSERT( pxBench != NULL );
+    configASSERT( pxBench->pcName != NULL );
+    configASSERT( pxBench->pxKernel != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( ( pxBench->pxNext == NULL ) && ( pxBench != pxBenchTail ) )
+        {
+            if( pxBenchTail == NULL )
+            {
+                __atomic_store_n( &pxBenchHead, pxBench, __ATOMIC_RELEASE );
+            }
+            else
+            {
+                __atomic_store_n( &( pxBenchTail->pxNext ), pxBench, __ATOMIC_RELEASE );
+            }
+
+            pxBenchTail = pxBench;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vMicroBenchForEach( MicroBenchVisitor_t xVisitor,
+                         void * pvCtx )
+{
+    BaseType_t xContinue = pdTRUE;
+
+    configASSERT( xVisitor != NULL );
+
+    for( MicroBench_t * pxBench = __atomic_load_n( &pxBenchHead, __ATOMIC_ACQUIRE );
+         ( pxBench != NULL ) && ( xContinue == pdTRUE );
+         pxBench = __atomic_load_n( &( pxBench->pxNext ), __ATOMIC_ACQUIRE ) )
+    {
+        xContinue = xVisitor( pxBench, pvCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+MicroBench_t * pxMicroBenchFind( const char * pcName )
+{
+    MicroBench_t * pxBench = __atomic_load_n( &pxBenchHead, __ATOMIC_ACQUIRE );
+
+    configASSERT( pcName != NULL );
+
+    while( ( pxBench != NULL ) && ( strcmp( pxBench->pcName, pcName ) != 0 ) )
+    {
+        pxBench = __atomic_load_n( &( pxBench->pxNext ), __ATOMIC_ACQUIRE );
+    }
+
+    return pxBench;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvEmptyKernel( void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Cycles taken by one call of pxKernel, including the timing overhead */
+static uint32_t __attribute__( ( noinline ) ) ulTimeCall( MicroBenchKernel_t pxKernel,
+                                                          void * pvCtx,
+                                                          uint32_t ulFlags,
+                                                          int * plRslt )
+{
+    uint32_t ulStart;
+    uint32_t ulCycles;
+
+    if( ( ulFlags & MICRO_BENCH_FLAG_NO_PREEMPT ) != 0 )
+    {
+        vTaskSuspendAll();
+    }
+
+    ulStart = DWT->CYCCNT;
+    *plRslt = pxKernel( pvCtx );
+    ulCycles = DWT->CYCCNT - ulStart;
+
+    if( ( ulFlags & MICRO_BENCH_FLAG_NO_PREEMPT ) != 0 )
+    {
+        ( void ) xTaskResumeAll();
+    }
+
+    return ulCycles;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Paint the stack below pucTop, if the task has enough of it left */
+static BaseType_t __attribute__( ( noinline ) ) prvStackPaint( uint8_t * pucTop )
+{
+    BaseType_t xPainted = pdFALSE;
+
+    if( ( uxTaskGetStackHighWaterMark( NULL ) * sizeof( StackType_t ) ) > ( MICRO_BENCH_STACK_PROBE + MICRO_BENCH_STACK_GAP ) )
+    {
+        memset( pucTop - MICRO_BENCH_STACK_PROBE, MICRO_BENCH_STACK_FILL, MICRO_BENCH_STACK_PROBE - MICRO_BENCH_STACK_GAP );
+        xPainted = pdTRUE;
+    }
+
+    return xPainted;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Depth below pucTop reached since prvStackPaint, MICRO_BENCH_STACK_PROBE if all of it was used */
+static uint32_t __attribute__( ( noinline ) ) prvStackDepth( const uint8_t * pucTop )
+{
+    const uint8_t * pucLow = pucTop - MICRO_BENCH_STACK_PROBE;
+    uint32_t ulFree = 0;
+
+    while( ( ulFree < ( MICRO_BENCH_STACK_PROBE - MICRO_BENCH_STACK_GAP ) ) && ( pucLow[ ulFree ] == MICRO_BENCH_STACK_FILL ) )
+    {
+        ulFree++;
+    }
+
+    return MICRO_BENCH_STACK_PROBE - ulFree;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vSortCycles( uint32_t * pulCycles,
+                         uint32_t ulCount )
+{
+    for( uint32_t i = 1; i < ulCount; i++ )
+    {
+        uint32_t ulValue = pulCycles[ i ];
+        uint32_t j = i;
+
+        while( ( j > 0 ) && ( pulCycles[ j - 1 ] > ulValue ) )
+        {
+            pulCycles[ j ] = pulCycles[ j - 1 ];
+            j--;
+        }
+
+        pulCycles[ j ] = ulValue;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMicroBenchRun( const MicroBench_t * pxBench,
+                           uint32_t ulWarmup,
+                           uint32_t ulRuns,
+                           MicroBenchStats_t * pxStats )
+{
+    uint32_t pulCycles[ MICRO_BENCH_MAX_RUNS ];
+    uint32_t ulOverhead = UINT32_MAX;
+    uint32_t ulStackBase = 0;
+    uint8_t * pucTop = ( uint8_t * ) __get_PSP();
+    BaseType_t xPainted;
+    int lRslt = 0;
+
+    configASSERT( pxBench != NULL );
+    configASSERT( pxStats != NULL );
+
+    memset( pxStats, 0, sizeof( MicroBenchStats_t ) );
+
+    if( ulRuns > MICRO_BENCH_MAX_RUNS )
+    {
+        ulRuns = MICRO_BENCH_MAX_RUNS;
+    }
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for( uint32_t i = 0; i < MICRO_BENCH_OVERHEAD_RUNS; i++ )
+    {
+        uint32_t ulCycles = ulTimeCall( prvEmptyKernel, NULL, MICRO_BENCH_FLAG_NO_PREEMPT, &lRslt );
+
+        if( ulCycles < ulOverhead )
+        {
+            ulOverhead = ulCycles;
+        }
+    }
+
+    /* Depth of the timing itself, taken off the depth of the kernel */
+    if( prvStackPaint( pucTop ) == pdTRUE )
+    {
+        ( void ) ulTimeCall( prvEmptyKernel, NULL, MICRO_BENCH_FLAG_NO_PREEMPT, &lRslt );
+        ulStackBase = prvStackDepth( pucTop );
+    }
+
+    for( uint32_t i = 0; ( i < ulWarmup ) && ( lRslt == 0 ); i++ )
+    {
+        lRslt = pxBench->pxKernel( pxBench->pvCtx );
+    }
+
+    xPainted = prvStackPaint( pucTop );
+
+    for( uint32_t i = 0; ( i < ulRuns ) && ( lRslt == 0 ); i++ )
+    {
+        uint32_t ulCycles = ulTimeCall( pxBench->pxKernel, pxBench->pvCtx, pxBench->ulFlags, &lRslt );
+
+        if( lRslt == 0 )
+        {
+            pulCycles[ pxStats->ulRuns ] = ( ulCycles > ulOverhead ) ? ( ulCycles - ulOverhead ) : 0;
+            pxStats->ulRuns++;
+        }
+    }
+
+    pxStats->lError = lRslt;
+
+    if( xPainted == pdTRUE )
+    {
+        uint32_t ulDepth = prvStackDepth( pucTop );
+
+        pxStats->ulStackBytes = ( ulDepth > ulStackBase ) ? ( ulDepth - ulStackBase ) : 0;
+    }
+
+    if( pxStats->ulRuns > 0 )
+    {
+        vSortCycles( pulCycles, pxStats->ulRuns );
+
+        pxStats->ulMinCycles = pulCycles[ 0 ];
+        pxStats->ulMedianCycles = pulCycles[ pxStats->ulRuns / 2 ];
+        pxStats->ulMaxCycles = pulCycles[ pxStats->ulRuns - 1 ];
+    }
+
+    return ( lRslt == 0 ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+int lMicroBenchFormatCsv( const MicroBench_t * pxBench,
+                          const MicroBenchStats_t * pxStats,
+                          char * pcBuffer,
+                          size_t uxBufferLen )
+{
+    uint32_t ulCpbX100 = 0;
+
+    configASSERT( pxBench != NULL );
+    configASSERT( pxStats != NULL );
+
+    if( pxBench->ulBytes > 0 )
+    {
+        ulCpbX100 = ( uint32_t ) ( ( ( uint64_t ) pxStats->ulMedianCycles * 100U ) / pxBench->ulBytes );
+    }
+
+    return snprintf( pcBuffer, uxBufferLen, "UBENCH,%s,%lu,%lu,%lu,%lu,%lu,%lu.%02lu,%lu\r\n",
+                     pxBench->pcName, pxBench->ulBytes, pxStats->ulRuns,
+                     pxStats->ulMinCycles, pxStats->ulMedianCycles, pxStats->ulMaxCycles,
+                     ulCpbX100 / 100U, ulCpbX100 % 100U, pxStats->ulStackBytes );
+}
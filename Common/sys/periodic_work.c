@@ -0,0 +1,221 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "metrics.h"
+#include "periodic_work.h"
+
+/* Times before xNow, or equal to it, are at most half the tick range behind */
+#define IS_DUE( xDue, xNow )    ( ( TickType_t ) ( ( xNow ) - ( xDue ) ) <= ( portMAX_DELAY / 2 ) )
+
+static TimerHandle_t xWorkTimer = NULL;
+
+/* Items are linked once and never unlinked, so the timer task can walk the list without a lock */
+static PeriodicWork_t * pxWorkHead = NULL;
+
+static METRIC_COUNTER( xWakeupsMetric, "pwork_wakeups" );
+static METRIC_COUNTER( xSignalsMetric, "pwork_signals" );
+
+/*-----------------------------------------------------------*/
+
+static inline TickType_t prvNextMultiple( TickType_t xNow,
+                                          TickType_t xPeriod )
+{
+    return xNow + xPeriod - ( xNow % xPeriod );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWorkTimerCallback( TimerHandle_t xTimer )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    TickType_t xWait = portMAX_DELAY;
+
+    vMetricIncrement( &xWakeupsMetric );
+
+    for( PeriodicWork_t * pxWork = pxWorkHead; pxWork != NULL; pxWork = pxWork->pxNext )
+    {
+        BaseType_t xSignal = pdFALSE;
+        TaskHandle_t xTask = NULL;
+        PeriodicWorkCallback_t pxCallback = NULL;
+        void * pvCtx = NULL;
+
+        taskENTER_CRITICAL();
+
+        if( pxWork->xActive == pdTRUE )
+        {
+            if( IS_DUE( pxWork->xDue, xNow ) )
+            {
+                xSignal = pdTRUE;
+                xTask = pxWork->xTask;
+                pxCallback = pxWork->pxCallback;
+                pvCtx = pxWork->pvCtx;
+
+                pxWork->xDue += pxWork->xPeriod;
+
+                /* Periods missed altogether are skipped */
+                if( IS_DUE( pxWork->xDue, xNow ) )
+                {
+                    pxWork->xDue = prvNextMultiple( xNow, pxWork->xPeriod );
+                }
+            }
+
+            if( ( pxWork->xDue - xNow + pxWork->xSlack ) < xWait )
+            {
+                xWait = pxWork->xDue - xNow + pxWork->xSlack;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( xSignal == pdFALSE )
+        {
+            /* Not due yet */
+        }
+        else if( pxCallback != NULL )
+        {
+            pxCallback( pvCtx );
+            vMetricIncrement( &xSignalsMetric );
+        }
+        else
+        {
+            ( void ) xTaskNotifyGiveIndexed( xTask, PERIODIC_WORK_NOTIFY_IDX );
+            vMetricIncrement( &xSignalsMetric );
+        }
+    }
+
+    /* The timer stays stopped while no item is active */
+    if( xWait != portMAX_DELAY )
+    {
+        ( void ) xTimerChangePeriod( xTimer, xWait, 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Have the timer task look at the items again on the next tick */
+static void prvReschedule( void )
+{
+    configASSERT( xWorkTimer != NULL );
+
+    ( void ) xTimerChangePeriod( xWorkTimer, 1, portMAX_DELAY );
+}
+
+/*-----------------------------------------------------------*/
+
+void vPeriodicWorkInit( void )
+{
+    static StaticTimer_t xTimerBuffer;
+
+    xWorkTimer = xTimerCreateStatic( "PeriodicWork", 1, pdFALSE, NULL,
+                                     prvWorkTimerCallback, &xTimerBuffer );
+    configASSERT( xWorkTimer != NULL );
+
+    vMetricRegister( &xWakeupsMetric );
+    vMetricRegister( &xSignalsMetric );
+}
+
+/*-----------------------------------------------------------*/
+
+void vPeriodicWorkStartCallback( PeriodicWork_t * pxWork,
+                                 PeriodicWorkCallback_t pxCallback,
+                                 void * pvCtx,
+                                 TickType_t xPeriod,
+                                 TickType_t xSlack )
+{
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+
+    configASSERT( pxWork != NULL );
+    configASSERT( xPeriod > 0 );
+
+    /* A signal left from an earlier start of the item would end the first wait early */
+    if( pxCallback == NULL )
+    {
+        ( void ) ulTaskNotifyValueClearIndexed( xTask, PERIODIC_WORK_NOTIFY_IDX, UINT32_MAX );
+    }
+
+    taskENTER_CRITICAL();
+
+    pxWork->xPeriod = xPeriod;
+    pxWork->xSlack = xSlack;
+    pxWork->xDue = prvNextMultiple( xTaskGetTickCount(), xPeriod );
+    pxWork->xTask = xTask;
+    pxWork->pxCallback = pxCallback;
+    pxWork->pvCtx = pvCtx;
+    pxWork->xActive = pdTRUE;
+
+    if( pxWork->xLinked == pdFALSE )
+    {
+        pxWork->pxNext = pxWorkHead;
+        pxWork->xLinked = pdTRUE;
+        pxWorkHead = pxWork;
+    }
+
+    taskEXIT_CRITICAL();
+
+    prvReschedule();
+}
+
+/*-----------------------------------------------------------*/
+
+void vPeriodicWorkStart( PeriodicWork_t * pxWork,
+                         TickType_t xPeriod,
+                         TickType_t xSlack )
+{
+    vPeriodicWorkStartCallback( pxWork, NULL, NULL, xPeriod, xSlack );
+}
+
+/*-----------------------------------------------------------*/
+
+void vPeriodicWorkSetPeriod( PeriodicWork_t * pxWork,
+                             TickType_t xPeriod )
+{
+    configASSERT( pxWork != NULL );
+    configASSERT( xPeriod > 0 );
+
+    taskENTER_CRITICAL();
+
+    pxWork->xPeriod = xPeriod;
+    pxWork->xDue = prvNextMultiple( xTaskGetTickCount(), xPeriod );
+
+    taskEXIT_CRITICAL();
+
+    prvReschedule();
+}
+
+/*-----------------------------------------------------------*/
+
+void vPeriodicWorkStop( PeriodicWork_t * pxWork )
+{
+    configASSERT( pxWork != NULL );
+
+    taskENTER_CRITICAL();
+    pxWork->xActive = pdFALSE;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,452 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "metrics.h"
+#include "trace_rec.h"
+#include "postmortem.h"
+
+#if ( POSTMORTEM_ENABLED == 1 )
+
+    #define POSTMORTEM_MAGIC          0x504D5254UL /* "PMRT" */
+    #define POSTMORTEM_VERSION        1
+
+    #define POSTMORTEM_NAME_LEN       16
+    #define POSTMORTEM_DETAIL_LEN     32
+    #define POSTMORTEM_METRIC_LEN     24
+
+    #define POSTMORTEM_RESET_WDG      ( RCC_CSR_IWDGRSTF_Msk | RCC_CSR_WWDGRSTF_Msk )
+
+    typedef struct
+    {
+        char pcName[ POSTMORTEM_NAME_LEN ];
+        uint8_t ucState;
+        uint8_t ucPriority;
+        uint16_t usStackFree; /* Words */
+        uint32_t ulRunTime;
+    } PostMortemTask_t;
+
+    typedef struct
+    {
+        char pcName[ POSTMORTEM_METRIC_LEN ];
+        uint32_t ulValue; /* Count of the values observed for a histogram */
+    } PostMortemMetric_t;
+
+    typedef struct
+    {
+        uint32_t ulMagic;
+        uint32_t ulVersion;
+        uint32_t ulSize;
+        uint32_t ulCrc; /* Of the bytes after this field */
+
+        uint32_t ulReason;
+        uint32_t ulUptimeMs;
+        uint32_t ulLine;
+        char pcDetail[ POSTMORTEM_DETAIL_LEN ];
+        char pcTask[ POSTMORTEM_NAME_LEN ];
+        uint32_t ulFreeHeap;
+        uint32_t ulMinFreeHeap;
+
+        /* Fault handlers only: r0, r1, r2, r3, r12, lr, pc, xpsr as stacked on entry */
+        uint32_t pulFrame[ 8 ];
+        uint32_t ulExcReturn;
+        uint32_t ulCfsr;
+        uint32_t ulHfsr;
+        uint32_t ulMmfar;
+        uint32_t ulBfar;
+
+        uint32_t ulTasks;
+        PostMortemTask_t xTasks[ POSTMORTEM_MAX_TASKS ];
+
+        uint32_t ulMetrics;
+        PostMortemMetric_t xMetrics[ POSTMORTEM_MAX_METRICS ];
+
+        #if ( TRACE_REC_ENABLED == 1 )
+            uint32_t ulTraceEvents;
+            TraceRecEvent_t xTrace[ POSTMORTEM_TRACE_EVENTS ];
+        #endif
+    } PostMortem_t;
+
+    typedef struct
+    {
+        char * pcBuffer;
+        size_t uxLen;
+        size_t uxUsed;
+        BaseType_t xOverflow;
+    } PostMortemWriter_t;
+
+    static PostMortem_t xPostMortem SRAM_NOINIT;
+
+/* Too large for the stack of a task which may be the one failing */
+    static TaskStatus_t xTaskStatus[ POSTMORTEM_MAX_TASKS ];
+
+/* Reason of the first capture of this boot, PostMortemNone until then */
+    static volatile uint32_t ulCaptured = PostMortemNone;
+    static uint32_t ulBootResetFlags = 0;
+
+    static const char * const pcReasonNames[ PostMortemMax ] =
+    {
+        [ PostMortemNone ]          = "none",
+        [ PostMortemAssert ]        = "assert",
+        [ PostMortemHardFault ]     = "hardfault",
+        [ PostMortemMemManage ]     = "memmanage",
+        [ PostMortemBusFault ]      = "busfault",
+        [ PostMortemUsageFault ]    = "usagefault",
+        [ PostMortemMallocFailed ]  = "malloc_failed",
+        [ PostMortemStackOverflow ] = "stack_overflow",
+        [ PostMortemWatchdog ]      = "watchdog",
+    };
+
+/*-----------------------------------------------------------*/
+
+/* CRC-32 (IEEE 802.3), with a nibble table to stay small */
+    static uint32_t prvCrc32( const uint8_t * pucData,
+                              size_t uxLen )
+    {
+        static const uint32_t pulTable[ 16 ] =
+        {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+        uint32_t ulCrc = 0xFFFFFFFFUL;
+
+        for( size_t uxIdx = 0; uxIdx < uxLen; uxIdx++ )
+        {
+            ulCrc = pulTable[ ( ulCrc ^ pucData[ uxIdx ] ) & 0x0F ] ^ ( ulCrc >> 4 );
+            ulCrc = pulTable[ ( ulCrc ^ ( pucData[ uxIdx ] >> 4 ) ) & 0x0F ] ^ ( ulCrc >> 4 );
+        }
+
+        return ulCrc ^ 0xFFFFFFFFUL;
+    }
+
+    static uint32_t prvSnapshotCrc( void )
+    {
+        const uint8_t * pucStart = ( const uint8_t * ) &( xPostMortem.ulReason );
+
+        return prvCrc32( pucStart, sizeof( xPostMortem ) - ( size_t ) ( pucStart - ( const uint8_t * ) &xPostMortem ) );
+    }
+
+    static BaseType_t prvSnapshotValid( void )
+    {
+        return( ( xPostMortem.ulMagic == POSTMORTEM_MAGIC ) &&
+                ( xPostMortem.ulVersion == POSTMORTEM_VERSION ) &&
+                ( xPostMortem.ulSize == sizeof( xPostMortem ) ) &&
+                ( xPostMortem.ulReason > PostMortemNone ) &&
+                ( xPostMortem.ulReason < PostMortemMax ) &&
+                ( xPostMortem.ulCrc == prvSnapshotCrc() ) );
+    }
+
+    static void prvSnapshotSeal( void )
+    {
+        xPostMortem.ulMagic = POSTMORTEM_MAGIC;
+        xPostMortem.ulVersion = POSTMORTEM_VERSION;
+        xPostMortem.ulSize = sizeof( xPostMortem );
+        xPostMortem.ulCrc = prvSnapshotCrc();
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Truncated copy, with the characters which would need escaping in JSON replaced */
+    static void prvCopyName( char * pcDst,
+                             const char * pcSrc,
+                             size_t uxLen )
+    {
+        size_t uxIdx = 0;
+
+        if( pcSrc != NULL )
+        {
+            for( ; ( uxIdx < ( uxLen - 1 ) ) && ( pcSrc[ uxIdx ] != '\0' ); uxIdx++ )
+            {
+                char cChar = pcSrc[ uxIdx ];
+
+                pcDst[ uxIdx ] = ( ( cChar < ' ' ) || ( cChar == '"' ) || ( cChar == '\\' ) ) ? '_' : cChar;
+            }
+        }
+
+        pcDst[ uxIdx ] = '\0';
+    }
+
+    static BaseType_t prvCopyMetric( const MetricSnapshot_t * pxMetric,
+                                     void * pvCtx )
+    {
+        ( void ) pvCtx;
+
+        if( xPostMortem.ulMetrics < POSTMORTEM_MAX_METRICS )
+        {
+            PostMortemMetric_t * pxCopy = &( xPostMortem.xMetrics[ xPostMortem.ulMetrics ] );
+
+            prvCopyName( pxCopy->pcName, pxMetric->pcName, sizeof( pxCopy->pcName ) );
+            pxCopy->ulValue = pxMetric->ulValue;
+            xPostMortem.ulMetrics++;
+        }
+
+        return( ( xPostMortem.ulMetrics < POSTMORTEM_MAX_METRICS ) ? pdTRUE : pdFALSE );
+    }
+
+    static void prvCopyTasks( void )
+    {
+        UBaseType_t uxTasks = uxTaskGetSystemState( xTaskStatus, POSTMORTEM_MAX_TASKS, NULL );
+
+        for( UBaseType_t uxIdx = 0; uxIdx < uxTasks; uxIdx++ )
+        {
+            PostMortemTask_t * pxCopy = &( xPostMortem.xTasks[ uxIdx ] );
+
+            prvCopyName( pxCopy->pcName, xTaskStatus[ uxIdx ].pcTaskName, sizeof( pxCopy->pcName ) );
+            pxCopy->ucState = ( uint8_t ) xTaskStatus[ uxIdx ].eCurrentState;
+            pxCopy->ucPriority = ( uint8_t ) xTaskStatus[ uxIdx ].uxCurrentPriority;
+            pxCopy->usStackFree = ( uint16_t ) xTaskStatus[ uxIdx ].usStackHighWaterMark;
+            pxCopy->ulRunTime = ( uint32_t ) xTaskStatus[ uxIdx ].ulRunTimeCounter;
+        }
+
+        xPostMortem.ulTasks = uxTasks;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvCapture( PostMortemReason_t xReason,
+                            const char * pcDetail,
+                            uint32_t ulLine,
+                            const uint32_t * pulFrame,
+                            uint32_t ulExcReturn )
+    {
+        uint32_t ulPrimask = __get_PRIMASK();
+
+        __disable_irq();
+
+        /* A missed watchdog deadline is kept until the reset, unless a fault comes first */
+        if( ( ulCaptured == PostMortemNone ) ||
+            ( ( ulCaptured == PostMortemWatchdog ) && ( xReason != PostMortemWatchdog ) ) )
+        {
+            BaseType_t xSchedulerStarted = ( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED ) ? pdTRUE : pdFALSE;
+
+            ulCaptured = xReason;
+
+            ( void ) memset( &xPostMortem, 0, sizeof( xPostMortem ) );
+
+            xPostMortem.ulReason = xReason;
+            xPostMortem.ulUptimeMs = ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS );
+            xPostMortem.ulLine = ulLine;
+            prvCopyName( xPostMortem.pcDetail, pcDetail, sizeof( xPostMortem.pcDetail ) );
+
+            if( xSchedulerStarted == pdTRUE )
+            {
+                prvCopyName( xPostMortem.pcTask, pcTaskGetName( NULL ), sizeof( xPostMortem.pcTask ) );
+            }
+
+            xPostMortem.ulFreeHeap = ( uint32_t ) xPortGetFreeHeapSize();
+            xPostMortem.ulMinFreeHeap = ( uint32_t ) xPortGetMinimumEverFreeHeapSize();
+
+            if( pulFrame != NULL )
+            {
+                ( void ) memcpy( xPostMortem.pulFrame, pulFrame, sizeof( xPostMortem.pulFrame ) );
+                xPostMortem.ulExcReturn = ulExcReturn;
+            }
+
+            xPostMortem.ulCfsr = SCB->CFSR;
+            xPostMortem.ulHfsr = SCB->HFSR;
+            xPostMortem.ulMmfar = SCB->MMFAR;
+            xPostMortem.ulBfar = SCB->BFAR;
+
+            /* uxTaskGetSystemState suspends the scheduler, which an interrupt handler must not do */
+            if( ( xSchedulerStarted == pdTRUE ) && ( __get_IPSR() == 0 ) )
+            {
+                prvCopyTasks();
+            }
+
+            vMetricsSnapshot( prvCopyMetric, NULL );
+
+            #if ( TRACE_REC_ENABLED == 1 )
+                xPostMortem.ulTraceEvents = ulTraceRecCopyLast( xPostMortem.xTrace, POSTMORTEM_TRACE_EVENTS );
+            #endif
+
+            prvSnapshotSeal();
+        }
+
+        if( ulPrimask == 0 )
+        {
+            __enable_irq();
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPostMortemCapture( PostMortemReason_t xReason,
+                             const char * pcDetail,
+                             uint32_t ulLine )
+    {
+        prvCapture( xReason, pcDetail, ulLine, NULL, 0 );
+    }
+
+    void vPostMortemFault( PostMortemReason_t xReason,
+                           const uint32_t * pulFrame,
+                           uint32_t ulExcReturn )
+    {
+        prvCapture( xReason, NULL, 0, pulFrame, ulExcReturn );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vPostMortemInit( uint32_t ulResetFlags )
+    {
+        ulBootResetFlags = ulResetFlags;
+
+        if( prvSnapshotValid() == pdTRUE )
+        {
+            LogSys( "Post-mortem snapshot from the previous boot: %s in task %s.",
+                    pcReasonNames[ xPostMortem.ulReason ], xPostMortem.pcTask );
+        }
+        else
+        {
+            ( void ) memset( &xPostMortem, 0, sizeof( xPostMortem ) );
+
+            /* Hung with the supervisor unable to notice, for instance with interrupts masked */
+            if( ( ulResetFlags & POSTMORTEM_RESET_WDG ) != 0 )
+            {
+                xPostMortem.ulReason = PostMortemWatchdog;
+                prvSnapshotSeal();
+            }
+        }
+    }
+
+    void vPostMortemClear( void )
+    {
+        __atomic_store_n( &( xPostMortem.ulMagic ), 0, __ATOMIC_RELAXED );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvAppend( PostMortemWriter_t * pxWriter,
+                           const char * pcFormat,
+                           ... )
+    {
+        if( pxWriter->xOverflow == pdFALSE )
+        {
+            va_list xArgs;
+            int lLen;
+
+            va_start( xArgs, pcFormat );
+            lLen = vsnprintf( &( pxWriter->pcBuffer[ pxWriter->uxUsed ] ), pxWriter->uxLen - pxWriter->uxUsed, pcFormat, xArgs );
+            va_end( xArgs );
+
+            if( ( lLen < 0 ) || ( ( size_t ) lLen >= ( pxWriter->uxLen - pxWriter->uxUsed ) ) )
+            {
+                pxWriter->xOverflow = pdTRUE;
+            }
+            else
+            {
+                pxWriter->uxUsed += ( size_t ) lLen;
+            }
+        }
+    }
+
+    size_t uxPostMortemFormat( char * pcBuffer,
+                               size_t uxLen )
+    {
+        PostMortemWriter_t xWriter =
+        {
+            .pcBuffer  = pcBuffer,
+            .uxLen     = uxLen,
+            .uxUsed    = 0,
+            .xOverflow = pdFALSE,
+        };
+
+        if( prvSnapshotValid() == pdFALSE )
+        {
+            return 0;
+        }
+
+        prvAppend( &xWriter, "{\"reason\":\"%s\",\"reset_flags\":%lu,\"uptime_ms\":%lu,\"task\":\"%s\","
+                             "\"detail\":\"%s\",\"line\":%lu,\"heap_free\":%lu,\"heap_min_free\":%lu",
+                   pcReasonNames[ xPostMortem.ulReason ], ulBootResetFlags, xPostMortem.ulUptimeMs,
+                   xPostMortem.pcTask, xPostMortem.pcDetail, xPostMortem.ulLine,
+                   xPostMortem.ulFreeHeap, xPostMortem.ulMinFreeHeap );
+
+        if( ( xPostMortem.ulReason >= PostMortemHardFault ) && ( xPostMortem.ulReason <= PostMortemUsageFault ) )
+        {
+            const uint32_t * pulFrame = xPostMortem.pulFrame;
+
+            prvAppend( &xWriter, ",\"regs\":{\"r0\":%lu,\"r1\":%lu,\"r2\":%lu,\"r3\":%lu,\"r12\":%lu,\"lr\":%lu,\"pc\":%lu,"
+                                 "\"xpsr\":%lu,\"exc_return\":%lu,\"cfsr\":%lu,\"hfsr\":%lu,\"mmfar\":%lu,\"bfar\":%lu}",
+                       pulFrame[ 0 ], pulFrame[ 1 ], pulFrame[ 2 ], pulFrame[ 3 ], pulFrame[ 4 ], pulFrame[ 5 ],
+                       pulFrame[ 6 ], pulFrame[ 7 ], xPostMortem.ulExcReturn, xPostMortem.ulCfsr,
+                       xPostMortem.ulHfsr, xPostMortem.ulMmfar, xPostMortem.ulBfar );
+        }
+
+        prvAppend( &xWriter, ",\"tasks\":[" );
+
+        for( uint32_t ulIdx = 0; ( ulIdx < xPostMortem.ulTasks ) && ( ulIdx < POSTMORTEM_MAX_TASKS ); ulIdx++ )
+        {
+            const PostMortemTask_t * pxTask = &( xPostMortem.xTasks[ ulIdx ] );
+
+            prvAppend( &xWriter, "%s{\"name\":\"%s\",\"state\":%u,\"prio\":%u,\"stack_free\":%u,\"run_time\":%lu}",
+                       ( ulIdx == 0 ) ? "" : ",", pxTask->pcName, pxTask->ucState, pxTask->ucPriority,
+                       pxTask->usStackFree, pxTask->ulRunTime );
+        }
+
+        prvAppend( &xWriter, "],\"metrics\":{" );
+
+        for( uint32_t ulIdx = 0; ( ulIdx < xPostMortem.ulMetrics ) && ( ulIdx < POSTMORTEM_MAX_METRICS ); ulIdx++ )
+        {
+            prvAppend( &xWriter, "%s\"%s\":%lu", ( ulIdx == 0 ) ? "" : ",",
+                       xPostMortem.xMetrics[ ulIdx ].pcName, xPostMortem.xMetrics[ ulIdx ].ulValue );
+        }
+
+        prvAppend( &xWriter, "}" );
+
+        #if ( TRACE_REC_ENABLED == 1 )
+            prvAppend( &xWriter, ",\"trace\":[" );
+
+            /* [ time in us, event, task number, argument ], in the encoding of trace_rec.c */
+            for( uint32_t ulIdx = 0; ( ulIdx < xPostMortem.ulTraceEvents ) && ( ulIdx < POSTMORTEM_TRACE_EVENTS ); ulIdx++ )
+            {
+                const TraceRecEvent_t * pxEvent = &( xPostMortem.xTrace[ ulIdx ] );
+
+                prvAppend( &xWriter, "%s[%lu,%u,%u,%u]", ( ulIdx == 0 ) ? "" : ",",
+                           pxEvent->ulTimeUs, pxEvent->ucEvent, pxEvent->ucTask, pxEvent->usArg );
+            }
+
+            prvAppend( &xWriter, "]" );
+        #endif
+
+        prvAppend( &xWriter, "}" );
+
+        return( ( xWriter.xOverflow == pdFALSE ) ? xWriter.uxUsed : 0 );
+    }
+
+#endif /* POSTMORTEM_ENABLED == 1 */
@@ -0,0 +1,1143 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file printf_lite.c
+ *
+ * @brief Allocation free snprintf, see printf_lite.h.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "printf_lite.h"
+
+#if ( PRINTF_LITE_ENABLED == 1 )
+
+#define FLAG_LEFT        ( 1U << 0 )
+#define FLAG_PLUS        ( 1U << 1 )
+#define FLAG_SPACE       ( 1U << 2 )
+#define FLAG_ALT         ( 1U << 3 )
+#define FLAG_ZERO        ( 1U << 4 )
+#define FLAG_UPPER       ( 1U << 5 )
+#define FLAG_PREC        ( 1U << 6 )
+#define FLAG_PTR         ( 1U << 7 )
+
+/* Digits of a 64 bit value in octal, the longest integer conversion */
+#define INT_DIGITS_MAX   ( 22U )
+
+/* Decimals formatted in fixed point, and significant digits taken from a double */
+#define FLOAT_PREC_MAX   ( 18U )
+#define FLOAT_SIG_MAX    ( 17U )
+
+typedef enum
+{
+    LenDefault = 0,
+    LenChar,
+    LenShort,
+    LenLong,
+    LenLongLong,
+    LenSize,
+    LenMax,
+    LenPtrdiff
+} PrintfLiteLen_t;
+
+typedef struct
+{
+    char * pcBuffer;
+    size_t uxLen;
+    size_t uxPos;
+} PrintfLiteOut_t;
+
+typedef struct
+{
+    uint32_t ulFlags;
+    size_t uxWidth;
+    size_t uxPrec;
+} PrintfLiteSpec_t;
+
+/* Part of a field: uxLen characters from pc, or uxLen times cFill when pc is NULL */
+typedef struct
+{
+    const char * pc;
+    size_t uxLen;
+    char cFill;
+} PrintfLiteSeg_t;
+
+static const char pcDigitsLower[] = "0123456789abcdef";
+static const char pcDigitsUpper[] = "0123456789ABCDEF";
+
+static const char pcDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*-----------------------------------------------------------*/
+
+static inline void prvPutChar( PrintfLiteOut_t * pxOut,
+                               char cChar )
+{
+    if( ( pxOut->uxPos + 1 ) < pxOut->uxLen )
+    {
+        pxOut->pcBuffer[ pxOut->uxPos ] = cChar;
+    }
+
+    pxOut->uxPos++;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPutSeg( PrintfLiteOut_t * pxOut,
+                       const PrintfLiteSeg_t * pxSeg )
+{
+    size_t uxRoom = 0;
+    size_t uxCopy;
+
+    if( ( pxOut->uxPos + 1 ) < pxOut->uxLen )
+    {
+        uxRoom = pxOut->uxLen - 1 - pxOut->uxPos;
+    }
+
+    uxCopy = ( pxSeg->uxLen < uxRoom ) ? pxSeg->uxLen : uxRoom;
+
+    if( uxCopy > 0 )
+    {
+        if( pxSeg->pc != NULL )
+        {
+            memcpy( &( pxOut->pcBuffer[ pxOut->uxPos ] ), pxSeg->pc, uxCopy );
+        }
+        else
+        {
+            memset( &( pxOut->pcBuffer[ pxOut->uxPos ] ), pxSeg->cFill, uxCopy );
+        }
+    }
+
+    pxOut->uxPos += pxSeg->uxLen;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Write the segments padded to the field width. With xZeroPad, the "0" flag pads with zeros after
+ * the first segment, which holds the sign or prefix.
+ */
+static void prvPutField( PrintfLiteOut_t * pxOut,
+                         const PrintfLiteSpec_t * pxSpec,
+                         const PrintfLiteSeg_t * pxSegs,
+                         size_t uxSegs,
+                         int xZeroPad )
+{
+    PrintfLiteSeg_t xPad = { .pc = NULL, .uxLen = 0, .cFill = ' ' };
+    size_t uxTotal = 0;
+
+    for( size_t i = 0; i < uxSegs; i++ )
+    {
+        uxTotal += pxSegs[ i ].uxLen;
+    }
+
+    if( pxSpec->uxWidth > uxTotal )
+    {
+        xPad.uxLen = pxSpec->uxWidth - uxTotal;
+    }
+
+    if( ( pxSpec->ulFlags & FLAG_LEFT ) != 0 )
+    {
+        for( size_t i = 0; i < uxSegs; i++ )
+        {
+            prvPutSeg( pxOut, &( pxSegs[ i ] ) );
+        }
+
+        prvPutSeg( pxOut, &xPad );
+    }
+    else if( ( xZeroPad != 0 ) && ( ( pxSpec->ulFlags & FLAG_ZERO ) != 0 ) && ( uxSegs > 0 ) )
+    {
+        xPad.cFill = '0';
+
+        prvPutSeg( pxOut, &( pxSegs[ 0 ] ) );
+        prvPutSeg( pxOut, &xPad );
+
+        for( size_t i = 1; i < uxSegs; i++ )
+        {
+            prvPutSeg( pxOut, &( pxSegs[ i ] ) );
+        }
+    }
+    else
+    {
+        prvPutSeg( pxOut, &xPad );
+
+        for( size_t i = 0; i < uxSegs; i++ )
+        {
+            prvPutSeg( pxOut, &( pxSegs[ i ] ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Write the digits of ulValue in decimal, ending just before pcEnd. Returns the number of digits */
+static size_t prvU32Dec( char * pcEnd,
+                         uint32_t ulValue )
+{
+    char * pc = pcEnd;
+
+    while( ulValue >= 100 )
+    {
+        uint32_t ulPair = ( ulValue % 100 ) * 2;
+
+        ulValue /= 100;
+        pc -= 2;
+        pc[ 0 ] = pcDigitPairs[ ulPair ];
+        pc[ 1 ] = pcDigitPairs[ ulPair + 1 ];
+    }
+
+    if( ulValue >= 10 )
+    {
+        pc -= 2;
+        pc[ 0 ] = pcDigitPairs[ ulValue * 2 ];
+        pc[ 1 ] = pcDigitPairs[ ulValue * 2 + 1 ];
+    }
+    else
+    {
+        *( --pc ) = ( char ) ( '0' + ulValue );
+    }
+
+    return ( size_t ) ( pcEnd - pc );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Write the digits of ullValue ending just before pcEnd. The 64 bit division only runs while the
+ * value does not fit 32 bits, the powers of two bases only shift.
+ */
+static size_t prvUtoa( char * pcEnd,
+                       uint64_t ullValue,
+                       uint32_t ulBase,
+                       uint32_t ulFlags )
+{
+    const char * pcDigits = ( ( ulFlags & FLAG_UPPER ) != 0 ) ? pcDigitsUpper : pcDigitsLower;
+    char * pc = pcEnd;
+
+    if( ulBase == 10 )
+    {
+        while( ullValue > UINT32_MAX )
+        {
+            uint64_t ullQuot = ullValue / 1000000000U;
+            uint32_t ulRem = ( uint32_t ) ( ullValue - ( ullQuot * 1000000000U ) );
+            size_t uxDigits = prvU32Dec( pc, ulRem );
+
+            /* The lower group always has nine digits */
+            pc -= uxDigits;
+
+            while( uxDigits++ < 9 )
+            {
+                *( --pc ) = '0';
+            }
+
+            ullValue = ullQuot;
+        }
+
+        pc -= prvU32Dec( pc, ( uint32_t ) ullValue );
+    }
+    else
+    {
+        uint32_t ulShift = ( ulBase == 16 ) ? 4U : 3U;
+
+        do
+        {
+            *( --pc ) = pcDigits[ ullValue & ( ulBase - 1 ) ];
+            ullValue >>= ulShift;
+        } while( ullValue != 0 );
+    }
+
+    return ( size_t ) ( pcEnd - pc );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPutInt( PrintfLiteOut_t * pxOut,
+                       const PrintfLiteSpec_t * pxSpec,
+                       uint64_t ullValue,
+                       int xNegative,
+                       uint32_t ulBase )
+{
+    char pcDigits[ INT_DIGITS_MAX ];
+    char pcPrefix[ 2 ];
+    PrintfLiteSeg_t pxSegs[ 3 ];
+    size_t uxDigits = 0;
+    size_t uxPrefix = 0;
+    size_t uxZeros = 0;
+
+    /* An explicit precision of 0 prints nothing for a zero value */
+    if( ( ullValue != 0 ) || ( ( pxSpec->ulFlags & FLAG_PREC ) == 0 ) || ( pxSpec->uxPrec != 0 ) )
+    {
+        uxDigits = prvUtoa( &( pcDigits[ INT_DIGITS_MAX ] ), ullValue, ulBase, pxSpec->ulFlags );
+    }
+
+    if( xNegative != 0 )
+    {
+        pcPrefix[ uxPrefix++ ] = '-';
+    }
+    else if( ( pxSpec->ulFlags & FLAG_PLUS ) != 0 )
+    {
+        pcPrefix[ uxPrefix++ ] = '+';
+    }
+    else if( ( pxSpec->ulFlags & FLAG_SPACE ) != 0 )
+    {
+        pcPrefix[ uxPrefix++ ] = ' ';
+    }
+    else if( ( ( pxSpec->ulFlags & FLAG_ALT ) != 0 ) && ( ulBase == 16 ) &&
+             ( ( ullValue != 0 ) || ( ( pxSpec->ulFlags & FLAG_PTR ) != 0 ) ) )
+    {
+        pcPrefix[ uxPrefix++ ] = '0';
+        pcPrefix[ uxPrefix++ ] = ( ( pxSpec->ulFlags & FLAG_UPPER ) != 0 ) ? 'X' : 'x';
+    }
+
+    if( ( ( pxSpec->ulFlags & FLAG_PREC ) != 0 ) && ( pxSpec->uxPrec > uxDigits ) )
+    {
+        uxZeros = pxSpec->uxPrec - uxDigits;
+    }
+
+    /* "#" for octal makes the first digit a zero */
+    if( ( ( pxSpec->ulFlags & FLAG_ALT ) != 0 ) && ( ulBase == 8 ) && ( uxZeros == 0 ) &&
+        ( ( uxDigits == 0 ) || ( pcDigits[ INT_DIGITS_MAX - uxDigits ] != '0' ) ) )
+    {
+        uxZeros = 1;
+    }
+
+    pxSegs[ 0 ] = ( PrintfLiteSeg_t ) { .pc = pcPrefix, .uxLen = uxPrefix };
+    pxSegs[ 1 ] = ( PrintfLiteSeg_t ) { .pc = NULL, .uxLen = uxZeros, .cFill = '0' };
+    pxSegs[ 2 ] = ( PrintfLiteSeg_t ) { .pc = &( pcDigits[ INT_DIGITS_MAX - uxDigits ] ), .uxLen = uxDigits };
+
+    /* The "0" flag is ignored when a precision is given */
+    prvPutField( pxOut, pxSpec, pxSegs, 3, ( pxSpec->ulFlags & FLAG_PREC ) == 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( PRINTF_LITE_FLOAT == 1 )
+
+    static const uint32_t pulPow10[ 10 ] =
+    {
+        1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, 1000000000U
+    };
+
+    static const double pdPow10Bin[ 9 ] = { 1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256 };
+    static const double pdNegPow10Bin[ 9 ] = { 1e-1, 1e-2, 1e-4, 1e-8, 1e-16, 1e-32, 1e-64, 1e-128, 1e-256 };
+
+/* Scale dValue > 0 to [1, 10), returning the power of ten taken out */
+    static int32_t prvNormalize( double * pdValue )
+    {
+        double dValue = *pdValue;
+        int32_t lExp = 0;
+
+        if( dValue >= 10.0 )
+        {
+            for( int32_t i = 8; i >= 0; i-- )
+            {
+                if( dValue >= pdPow10Bin[ i ] )
+                {
+                    dValue /= pdPow10Bin[ i ];
+                    lExp += ( 1 << i );
+                }
+            }
+        }
+        else if( dValue < 1.0 )
+        {
+            for( int32_t i = 8; i >= 0; i-- )
+            {
+                if( dValue < pdNegPow10Bin[ i ] )
+                {
+                    dValue *= pdPow10Bin[ i ];
+                    lExp -= ( 1 << i );
+                }
+            }
+
+            if( dValue < 1.0 )
+            {
+                dValue *= 10.0;
+                lExp--;
+            }
+        }
+
+        *pdValue = dValue;
+
+        return lExp;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Write the first uxDigits significant digits of dValue > 0, rounded, to pcDigits. Returns the
+ * decimal exponent of the first digit.
+ */
+    static int32_t prvSigDigits( double dValue,
+                                 char * pcDigits,
+                                 size_t uxDigits )
+    {
+        int32_t lExp = prvNormalize( &dValue );
+        double dRound = 5.0;
+
+        for( size_t i = 0; i < uxDigits; i++ )
+        {
+            dRound /= 10.0;
+        }
+
+        dValue += dRound;
+
+        if( dValue >= 10.0 )
+        {
+            dValue /= 10.0;
+            lExp++;
+        }
+
+        for( size_t i = 0; i < uxDigits; i++ )
+        {
+            uint32_t ulDigit = 0;
+
+            if( i < FLOAT_SIG_MAX )
+            {
+                ulDigit = ( uint32_t ) dValue;
+                ulDigit = ( ulDigit > 9 ) ? 9 : ulDigit;
+                dValue = ( dValue - ( double ) ulDigit ) * 10.0;
+            }
+
+            pcDigits[ i ] = ( char ) ( '0' + ulDigit );
+        }
+
+        return lExp;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Fixed notation of 0 <= dValue < 2^64 with up to FLOAT_PREC_MAX decimals, from the integer part
+ * and up to two groups of nine decimals. pcBuffer holds 20 + 1 + FLOAT_PREC_MAX characters.
+ */
+    static size_t prvFixed( char * pcBuffer,
+                            double dValue,
+                            size_t uxPrec,
+                            uint32_t ulFlags )
+    {
+        uint64_t ullInt = ( uint64_t ) dValue;
+        double dFrac = dValue - ( double ) ullInt;
+        size_t uxPrecHi = ( uxPrec > 9 ) ? 9 : uxPrec;
+        size_t uxPrecLo = uxPrec - uxPrecHi;
+        uint32_t ulFracHi;
+        uint32_t ulFracLo = 0;
+        size_t uxLen;
+
+        if( uxPrecLo == 0 )
+        {
+            ulFracHi = ( uint32_t ) ( ( dFrac * ( double ) pulPow10[ uxPrecHi ] ) + 0.5 );
+        }
+        else
+        {
+            double dScaled = dFrac * 1e9;
+
+            ulFracHi = ( uint32_t ) dScaled;
+            ulFracLo = ( uint32_t ) ( ( ( dScaled - ( double ) ulFracHi ) * ( double ) pulPow10[ uxPrecLo ] ) + 0.5 );
+
+            if( ulFracLo >= pulPow10[ uxPrecLo ] )
+            {
+                ulFracLo -= pulPow10[ uxPrecLo ];
+                ulFracHi++;
+            }
+        }
+
+        if( ulFracHi >= pulPow10[ uxPrecHi ] )
+        {
+            ulFracHi -= pulPow10[ uxPrecHi ];
+            ullInt++;
+        }
+
+        uxLen = prvUtoa( &( pcBuffer[ 20 ] ), ullInt, 10, 0 );
+        memmove( pcBuffer, &( pcBuffer[ 20 - uxLen ] ), uxLen );
+
+        if( ( uxPrec > 0 ) || ( ( ulFlags & FLAG_ALT ) != 0 ) )
+        {
+            pcBuffer[ uxLen++ ] = '.';
+        }
+
+        for( size_t i = uxPrecHi; i > 0; i-- )
+        {
+            pcBuffer[ uxLen + i - 1 ] = ( char ) ( '0' + ( ulFracHi % 10 ) );
+            ulFracHi /= 10;
+        }
+
+        uxLen += uxPrecHi;
+
+        for( size_t i = uxPrecLo; i > 0; i-- )
+        {
+            pcBuffer[ uxLen + i - 1 ] = ( char ) ( '0' + ( ulFracLo % 10 ) );
+            ulFracLo /= 10;
+        }
+
+        return uxLen + uxPrecLo;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Exponent notation from uxDigits significant digits */
+    static size_t prvExp( char * pcBuffer,
+                          const char * pcDigits,
+                          size_t uxDigits,
+                          int32_t lExp,
+                          uint32_t ulFlags )
+    {
+        uint32_t ulExp = ( lExp < 0 ) ? ( uint32_t ) -lExp : ( uint32_t ) lExp;
+        size_t uxLen = 0;
+
+        pcBuffer[ uxLen++ ] = pcDigits[ 0 ];
+
+        if( ( uxDigits > 1 ) || ( ( ulFlags & FLAG_ALT ) != 0 ) )
+        {
+            pcBuffer[ uxLen++ ] = '.';
+        }
+
+        memcpy( &( pcBuffer[ uxLen ] ), &( pcDigits[ 1 ] ), uxDigits - 1 );
+        uxLen += uxDigits - 1;
+
+        pcBuffer[ uxLen++ ] = ( ( ulFlags & FLAG_UPPER ) != 0 ) ? 'E' : 'e';
+        pcBuffer[ uxLen++ ] = ( lExp < 0 ) ? '-' : '+';
+
+        if( ulExp >= 100 )
+        {
+            pcBuffer[ uxLen++ ] = ( char ) ( '0' + ( ulExp / 100 ) );
+            ulExp %= 100;
+        }
+
+        pcBuffer[ uxLen++ ] = pcDigitPairs[ ulExp * 2 ];
+        pcBuffer[ uxLen++ ] = pcDigitPairs[ ulExp * 2 + 1 ];
+
+        return uxLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Drop the trailing zeros of the decimals of %g, and the point if nothing is left after it */
+    static size_t prvTrimZeros( char * pcBuffer,
+                                size_t uxLen )
+    {
+        size_t uxPoint = 0;
+        size_t uxEnd = 0;
+        size_t uxNewEnd;
+
+        while( ( uxPoint < uxLen ) && ( pcBuffer[ uxPoint ] != '.' ) )
+        {
+            uxPoint++;
+        }
+
+        if( uxPoint < uxLen )
+        {
+            uxEnd = uxPoint + 1;
+
+            while( ( uxEnd < uxLen ) && ( pcBuffer[ uxEnd ] >= '0' ) && ( pcBuffer[ uxEnd ] <= '9' ) )
+            {
+                uxEnd++;
+            }
+
+            uxNewEnd = uxEnd;
+
+            while( pcBuffer[ uxNewEnd - 1 ] == '0' )
+            {
+                uxNewEnd--;
+            }
+
+            if( uxNewEnd == ( uxPoint + 1 ) )
+            {
+                uxNewEnd--;
+            }
+
+            memmove( &( pcBuffer[ uxNewEnd ] ), &( pcBuffer[ uxEnd ] ), uxLen - uxEnd );
+            uxLen -= ( uxEnd - uxNewEnd );
+        }
+
+        return uxLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvPutFloat( PrintfLiteOut_t * pxOut,
+                             PrintfLiteSpec_t * pxSpec,
+                             double dValue,
+                             char cConv )
+    {
+        /* Sign, then the longest of the fixed and exponent notations */
+        char pcBuffer[ 20 + 1 + FLOAT_PREC_MAX + 8 ];
+        char pcDigits[ FLOAT_PREC_MAX + 1 ];
+        char pcSign[ 1 ];
+        PrintfLiteSeg_t pxSegs[ 4 ];
+        size_t uxSegs = 1;
+        size_t uxLen = 0;
+        size_t uxPrec = ( ( pxSpec->ulFlags & FLAG_PREC ) != 0 ) ? pxSpec->uxPrec : 6;
+        size_t uxExtra = 0;
+        int xZeroPad = 1;
+
+        if( ( cConv == 'F' ) || ( cConv == 'E' ) || ( cConv == 'G' ) )
+        {
+            pxSpec->ulFlags |= FLAG_UPPER;
+        }
+
+        pxSegs[ 0 ] = ( PrintfLiteSeg_t ) { .pc = pcSign, .uxLen = 1 };
+
+        if( __builtin_signbit( dValue ) )
+        {
+            pcSign[ 0 ] = '-';
+            dValue = -dValue;
+        }
+        else if( ( pxSpec->ulFlags & FLAG_PLUS ) != 0 )
+        {
+            pcSign[ 0 ] = '+';
+        }
+        else if( ( pxSpec->ulFlags & FLAG_SPACE ) != 0 )
+        {
+            pcSign[ 0 ] = ' ';
+        }
+        else
+        {
+            pxSegs[ 0 ].uxLen = 0;
+        }
+
+        /* Decimals past FLOAT_PREC_MAX carry no information and are printed as zeros */
+        if( uxPrec > FLOAT_PREC_MAX )
+        {
+            uxExtra = uxPrec - FLOAT_PREC_MAX;
+            uxPrec = FLOAT_PREC_MAX;
+        }
+
+        if( __builtin_isnan( dValue ) )
+        {
+            memcpy( pcBuffer, ( ( pxSpec->ulFlags & FLAG_UPPER ) != 0 ) ? "NAN" : "nan", 3 );
+            uxLen = 3;
+            uxExtra = 0;
+            xZeroPad = 0;
+        }
+        else if( __builtin_isinf( dValue ) )
+        {
+            memcpy( pcBuffer, ( ( pxSpec->ulFlags & FLAG_UPPER ) != 0 ) ? "INF" : "inf", 3 );
+            uxLen = 3;
+            uxExtra = 0;
+            xZeroPad = 0;
+        }
+        else if( ( cConv == 'f' ) || ( cConv == 'F' ) )
+        {
+            if( dValue < 18446744073709549568.0 )
+            {
+                uxLen = prvFixed( pcBuffer, dValue, uxPrec, pxSpec->ulFlags );
+            }
+            else
+            {
+                /* Too large for the integer path: the significant digits, then zeros */
+                int32_t lExp = prvSigDigits( dValue, pcDigits, FLOAT_SIG_MAX );
+
+                pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = pcDigits, .uxLen = FLOAT_SIG_MAX };
+                pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = NULL, .uxLen = ( size_t ) lExp + 1 - FLOAT_SIG_MAX, .cFill = '0' };
+
+                if( ( uxPrec > 0 ) || ( ( pxSpec->ulFlags & FLAG_ALT ) != 0 ) )
+                {
+                    pcBuffer[ uxLen++ ] = '.';
+                }
+
+                memset( &( pcBuffer[ uxLen ] ), '0', uxPrec );
+                uxLen += uxPrec;
+            }
+        }
+        else if( ( cConv == 'e' ) || ( cConv == 'E' ) )
+        {
+            int32_t lExp = 0;
+
+            if( dValue != 0.0 )
+            {
+                lExp = prvSigDigits( dValue, pcDigits, uxPrec + 1 );
+            }
+            else
+            {
+                memset( pcDigits, '0', uxPrec + 1 );
+            }
+
+            uxLen = prvExp( pcBuffer, pcDigits, uxPrec + 1, lExp, pxSpec->ulFlags );
+
+            if( uxExtra > 0 )
+            {
+                /* The zeros go between the decimals and the exponent */
+                size_t uxMantissa = uxLen - ( ( ( lExp <= -100 ) || ( lExp >= 100 ) ) ? 5 : 4 );
+
+                pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = pcBuffer, .uxLen = uxMantissa };
+                pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = NULL, .uxLen = uxExtra, .cFill = '0' };
+                pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = &( pcBuffer[ uxMantissa ] ), .uxLen = uxLen - uxMantissa };
+                uxExtra = 0;
+                uxLen = 0;
+            }
+        }
+        else
+        {
+            /* %g: P significant digits, fixed notation when the exponent X is in [-4, P) */
+            size_t uxSig = ( uxPrec == 0 ) ? 1 : uxPrec;
+            int32_t lExp = 0;
+
+            uxExtra = 0;
+
+            if( dValue != 0.0 )
+            {
+                lExp = prvSigDigits( dValue, pcDigits, uxSig );
+            }
+            else
+            {
+                memset( pcDigits, '0', uxSig );
+            }
+
+            if( ( lExp >= -4 ) && ( lExp < ( int32_t ) uxSig ) )
+            {
+                size_t uxDecimals = ( size_t ) ( ( int32_t ) uxSig - 1 - lExp );
+
+                uxDecimals = ( uxDecimals > FLOAT_PREC_MAX ) ? FLOAT_PREC_MAX : uxDecimals;
+                uxLen = prvFixed( pcBuffer, dValue, uxDecimals, pxSpec->ulFlags );
+            }
+            else
+            {
+                uxLen = prvExp( pcBuffer, pcDigits, uxSig, lExp, pxSpec->ulFlags );
+            }
+
+            if( ( pxSpec->ulFlags & FLAG_ALT ) == 0 )
+            {
+                uxLen = prvTrimZeros( pcBuffer, uxLen );
+            }
+        }
+
+        if( uxLen > 0 )
+        {
+            pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = pcBuffer, .uxLen = uxLen };
+        }
+
+        if( uxExtra > 0 )
+        {
+            pxSegs[ uxSegs++ ] = ( PrintfLiteSeg_t ) { .pc = NULL, .uxLen = uxExtra, .cFill = '0' };
+        }
+
+        prvPutField( pxOut, pxSpec, pxSegs, uxSegs, xZeroPad );
+    }
+
+#endif /* PRINTF_LITE_FLOAT == 1 */
+
+/*-----------------------------------------------------------*/
+
+int lPrintfLiteV( char * pcBuffer,
+                  size_t uxLen,
+                  const char * pcFormat,
+                  va_list xArgs )
+{
+    PrintfLiteOut_t xOut = { .pcBuffer = pcBuffer, .uxLen = uxLen, .uxPos = 0 };
+    const char * pc = pcFormat;
+
+    while( *pc != '\0' )
+    {
+        PrintfLiteSpec_t xSpec = { 0 };
+        PrintfLiteLen_t xLen = LenDefault;
+        const char * pcRun = pc;
+
+        while( ( *pc != '\0' ) && ( *pc != '%' ) )
+        {
+            pc++;
+        }
+
+        if( pc != pcRun )
+        {
+            PrintfLiteSeg_t xSeg = { .pc = pcRun, .uxLen = ( size_t ) ( pc - pcRun ) };
+            prvPutSeg( &xOut, &xSeg );
+        }
+
+        if( *pc == '\0' )
+        {
+            break;
+        }
+
+        pc++;
+
+        for( ; ; pc++ )
+        {
+            if( *pc == '-' )
+            {
+                xSpec.ulFlags |= FLAG_LEFT;
+            }
+            else if( *pc == '+' )
+            {
+                xSpec.ulFlags |= FLAG_PLUS;
+            }
+            else if( *pc == ' ' )
+            {
+                xSpec.ulFlags |= FLAG_SPACE;
+            }
+            else if( *pc == '#' )
+            {
+                xSpec.ulFlags |= FLAG_ALT;
+            }
+            else if( *pc == '0' )
+            {
+                xSpec.ulFlags |= FLAG_ZERO;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if( *pc == '*' )
+        {
+            int lWidth = va_arg( xArgs, int );
+
+            if( lWidth < 0 )
+            {
+                xSpec.ulFlags |= FLAG_LEFT;
+                lWidth = -lWidth;
+            }
+
+            xSpec.uxWidth = ( size_t ) lWidth;
+            pc++;
+        }
+        else
+        {
+            while( ( *pc >= '0' ) && ( *pc <= '9' ) )
+            {
+                xSpec.uxWidth = ( xSpec.uxWidth * 10 ) + ( size_t ) ( *pc++ - '0' );
+            }
+        }
+
+        if( *pc == '.' )
+        {
+            pc++;
+            xSpec.ulFlags |= FLAG_PREC;
+
+            if( *pc == '*' )
+            {
+                int lPrec = va_arg( xArgs, int );
+
+                /* A negative precision is taken as if it were omitted */
+                if( lPrec < 0 )
+                {
+                    xSpec.ulFlags &= ~FLAG_PREC;
+                }
+                else
+                {
+                    xSpec.uxPrec = ( size_t ) lPrec;
+                }
+
+                pc++;
+            }
+            else
+            {
+                while( ( *pc >= '0' ) && ( *pc <= '9' ) )
+                {
+                    xSpec.uxPrec = ( xSpec.uxPrec * 10 ) + ( size_t ) ( *pc++ - '0' );
+                }
+            }
+        }
+
+        switch( *pc )
+        {
+            case 'h':
+                xLen = ( pc[ 1 ] == 'h' ) ? LenChar : LenShort;
+                pc += ( pc[ 1 ] == 'h' ) ? 2 : 1;
+                break;
+
+            case 'l':
+                xLen = ( pc[ 1 ] == 'l' ) ? LenLongLong : LenLong;
+                pc += ( pc[ 1 ] == 'l' ) ? 2 : 1;
+                break;
+
+            case 'z':
+                xLen = LenSize;
+                pc++;
+                break;
+
+            case 'j':
+                xLen = LenMax;
+                pc++;
+                break;
+
+            case 't':
+                xLen = LenPtrdiff;
+                pc++;
+                break;
+
+            case 'L':
+                /* long double is double on this target */
+                pc++;
+                break;
+
+            default:
+                break;
+        }
+
+        switch( *pc )
+        {
+            case 'd':
+            case 'i':
+               {
+                   int64_t llValue;
+
+                   switch( xLen )
+                   {
+                       case LenChar:
+                           llValue = ( signed char ) va_arg( xArgs, int );
+                           break;
+
+                       case LenShort:
+                           llValue = ( short ) va_arg( xArgs, int );
+                           break;
+
+                       case LenLong:
+                           llValue = va_arg( xArgs, long );
+                           break;
+
+                       case LenLongLong:
+                           llValue = va_arg( xArgs, long long );
+                           break;
+
+                       case LenSize:
+                       case LenPtrdiff:
+                           llValue = va_arg( xArgs, ptrdiff_t );
+                           break;
+
+                       case LenMax:
+                           llValue = va_arg( xArgs, intmax_t );
+                           break;
+
+                       default:
+                           llValue = va_arg( xArgs, int );
+                           break;
+                   }
+
+                   if( llValue < 0 )
+                   {
+                       prvPutInt( &xOut, &xSpec, ( uint64_t ) -( llValue + 1 ) + 1U, 1, 10 );
+                   }
+                   else
+                   {
+                       prvPutInt( &xOut, &xSpec, ( uint64_t ) llValue, 0, 10 );
+                   }
+               }
+               break;
+
+            case 'X':
+                xSpec.ulFlags |= FLAG_UPPER;
+            /* Fall through */
+
+            case 'u':
+            case 'o':
+            case 'x':
+               {
+                   uint64_t ullValue;
+
+                   switch( xLen )
+                   {
+                       case LenChar:
+                           ullValue = ( unsigned char ) va_arg( xArgs, unsigned int );
+                           break;
+
+                       case LenShort:
+                           ullValue = ( unsigned short ) va_arg( xArgs, unsigned int );
+                           break;
+
+                       case LenLong:
+                           ullValue = va_arg( xArgs, unsigned long );
+                           break;
+
+                       case LenLongLong:
+                           ullValue = va_arg( xArgs, unsigned long long );
+                           break;
+
+                       case LenSize:
+                       case LenPtrdiff:
+                           ullValue = va_arg( xArgs, size_t );
+                           break;
+
+                       case LenMax:
+                           ullValue = va_arg( xArgs, uintmax_t );
+                           break;
+
+                       default:
+                           ullValue = va_arg( xArgs, unsigned int );
+                           break;
+                   }
+
+                   /* The sign flags only apply to signed conversions */
+                   xSpec.ulFlags &= ~( FLAG_PLUS | FLAG_SPACE );
+                   prvPutInt( &xOut, &xSpec, ullValue, 0, ( *pc == 'u' ) ? 10 : ( ( *pc == 'o' ) ? 8 : 16 ) );
+               }
+               break;
+
+            case 'p':
+                xSpec.ulFlags &= ~( FLAG_PLUS | FLAG_SPACE );
+                xSpec.ulFlags |= FLAG_ALT | FLAG_PTR;
+                prvPutInt( &xOut, &xSpec, ( uintptr_t ) va_arg( xArgs, void * ), 0, 16 );
+                break;
+
+            case 'c':
+               {
+                   char cChar = ( char ) va_arg( xArgs, int );
+                   PrintfLiteSeg_t xSeg = { .pc = &cChar, .uxLen = 1 };
+
+                   prvPutField( &xOut, &xSpec, &xSeg, 1, 0 );
+               }
+               break;
+
+            case 's':
+               {
+                   const char * pcStr = va_arg( xArgs, const char * );
+                   PrintfLiteSeg_t xSeg = { .pc = pcStr, .uxLen = 0 };
+
+                   if( pcStr == NULL )
+                   {
+                       xSeg.pc = "(null)";
+                   }
+
+                   /* Within the precision the string need not be terminated */
+                   while( ( ( ( xSpec.ulFlags & FLAG_PREC ) == 0 ) || ( xSeg.uxLen < xSpec.uxPrec ) ) &&
+                          ( xSeg.pc[ xSeg.uxLen ] != '\0' ) )
+                   {
+                       xSeg.uxLen++;
+                   }
+
+                   prvPutField( &xOut, &xSpec, &xSeg, 1, 0 );
+               }
+               break;
+
+            case 'n':
+               {
+                   int * plCount = va_arg( xArgs, int * );
+
+                   if( plCount != NULL )
+                   {
+                       *plCount = ( int ) xOut.uxPos;
+                   }
+               }
+               break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+               {
+                   double dValue = va_arg( xArgs, double );
+
+#if ( PRINTF_LITE_FLOAT == 1 )
+                   prvPutFloat( &xOut, &xSpec, dValue, *pc );
+#else
+                   ( void ) dValue;
+#endif
+               }
+               break;
+
+            case '%':
+                prvPutChar( &xOut, '%' );
+                break;
+
+            case '\0':
+                /* A lone % at the end of the format */
+                pc--;
+                break;
+
+            default:
+                /* Unknown conversion, printed as it is */
+                prvPutChar( &xOut, '%' );
+                prvPutChar( &xOut, *pc );
+                break;
+        }
+
+        pc++;
+    }
+
+    if( uxLen > 0 )
+    {
+        pcBuffer[ ( xOut.uxPos < uxLen ) ? xOut.uxPos : ( uxLen - 1 ) ] = '\0';
+    }
+
+    return ( int ) xOut.uxPos;
+}
+
+/*-----------------------------------------------------------*/
+
+int lPrintfLite( char * pcBuffer,
+                 size_t uxLen,
+                 const char * pcFormat,
+                 ... )
+{
+    va_list xArgs;
+    int lRslt;
+
+    va_start( xArgs, pcFormat );
+    lRslt = lPrintfLiteV( pcBuffer, uxLen, pcFormat, xArgs );
+    va_end( xArgs );
+
+    return lRslt;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( PRINTF_LITE_REPLACE_NEWLIB == 1 )
+
+/* These take the place of the newlib objects at link time */
+    int vsnprintf( char * pcBuffer,
+                   size_t uxLen,
+                   const char * pcFormat,
+                   va_list xArgs )
+    {
+        return lPrintfLiteV( pcBuffer, uxLen, pcFormat, xArgs );
+    }
+
+/*-----------------------------------------------------------*/
+
+    int snprintf( char * pcBuffer,
+                  size_t uxLen,
+                  const char * pcFormat,
+                  ... )
+    {
+        va_list xArgs;
+        int lRslt;
+
+        va_start( xArgs, pcFormat );
+        lRslt = lPrintfLiteV( pcBuffer, uxLen, pcFormat, xArgs );
+        va_end( xArgs );
+
+        return lRslt;
+    }
+
+#endif /* PRINTF_LITE_REPLACE_NEWLIB == 1 */
+
+#endif /* PRINTF_LITE_ENABLED == 1 */
@@ -0,0 +1,97 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include <stdint.h>
+
+#include "sram_banks.h"
+
+#if ( SRAM_BANKS_ENABLED == 1 )
+
+/* Defined by the linker script */
+    extern uint32_t _ssram_dma[];
+    extern uint32_t _esram_dma[];
+    extern uint32_t _sdata[];
+    extern uint32_t _edata[];
+    extern uint32_t _sbss[];
+    extern uint32_t _ebss[];
+    extern uint32_t _ssram_cpu[];
+    extern uint32_t _esram_cpu[];
+    extern uint32_t _sramfunc[];
+    extern uint32_t _eramfunc[];
+    extern uint32_t _estack[];
+    extern uint32_t _Min_Stack_Size[];
+
+    static const struct
+    {
+        const char * pcName;
+        uint32_t ulStart;
+        uint32_t ulSize;
+    } xBanks[ SRAM_BANK_COUNT ] =
+    {
+        { "SRAM1", 0x20000000UL, 192UL * 1024UL },
+        { "SRAM2", 0x20030000UL, 64UL * 1024UL  },
+        { "SRAM3", 0x20040000UL, 512UL * 1024UL },
+        { "SRAM4", 0x28000000UL, 16UL * 1024UL  },
+    };
+
+/*-----------------------------------------------------------*/
+
+/* Bytes of [ulStart, ulEnd) inside the bank */
+    static uint32_t prvOverlap( uint32_t ulBank,
+                                uint32_t ulStart,
+                                uint32_t ulEnd )
+    {
+        uint32_t ulBankStart = xBanks[ ulBank ].ulStart;
+        uint32_t ulBankEnd = ulBankStart + xBanks[ ulBank ].ulSize;
+        uint32_t ulLow = ( ulStart > ulBankStart ) ? ulStart : ulBankStart;
+        uint32_t ulHigh = ( ulEnd < ulBankEnd ) ? ulEnd : ulBankEnd;
+
+        return ( ulHigh > ulLow ) ? ( ulHigh - ulLow ) : 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vSramBankUsage( SramBankUsage_t pxBanks[ SRAM_BANK_COUNT ] )
+    {
+        uint32_t ulStackTop = ( uint32_t ) _estack;
+        uint32_t ulStackBottom = ulStackTop - ( uint32_t ) _Min_Stack_Size;
+
+        for( uint32_t i = 0; i < SRAM_BANK_COUNT; i++ )
+        {
+            pxBanks[ i ].pcName = xBanks[ i ].pcName;
+            pxBanks[ i ].ulStart = xBanks[ i ].ulStart;
+            pxBanks[ i ].ulSize = xBanks[ i ].ulSize;
+            pxBanks[ i ].ulDma = prvOverlap( i, ( uint32_t ) _ssram_dma, ( uint32_t ) _esram_dma );
+            pxBanks[ i ].ulData = prvOverlap( i, ( uint32_t ) _sdata, ( uint32_t ) _edata );
+            pxBanks[ i ].ulBss = prvOverlap( i, ( uint32_t ) _sbss, ( uint32_t ) _ebss );
+            pxBanks[ i ].ulCpu = prvOverlap( i, ( uint32_t ) _ssram_cpu, ( uint32_t ) _esram_cpu );
+            pxBanks[ i ].ulCode = prvOverlap( i, ( uint32_t ) _sramfunc, ( uint32_t ) _eramfunc );
+            pxBanks[ i ].ulMainStack = prvOverlap( i, ulStackBottom, ulStackTop );
+        }
+    }
+
+#endif /* SRAM_BANKS_ENABLED == 1 */
@@ -0,0 +1,286 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "stack_watch.h"
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    UBaseType_t uxTaskNumber;
+    BaseType_t xSeen;
+    BaseType_t xWarned;
+} StackWatchSlot_t;
+
+/* Only used by the timer task */
+static TaskStatus_t xTaskStatus[ STACK_WATCH_MAX_TASKS ];
+static StackWatchSlot_t xSlots[ STACK_WATCH_MAX_TASKS ];
+static BaseType_t xTooManyTasks = pdFALSE;
+
+#if ( STACK_WATCH_REPORT_S > 0 )
+    static BaseType_t xReported = pdFALSE;
+#endif
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulStackWatchGetDepth( TaskHandle_t xTask )
+{
+    struct tskTaskControlBlockRedef
+    {
+        volatile StackType_t * pxDontCare0;
+
+        #if ( portUSING_MPU_WRAPPERS == 1 )
+            xMPU_SETTINGS xDontCare1;
+        #endif
+        ListItem_t xDontCare2;
+        ListItem_t xDontCare3;
+        UBaseType_t uxDontCare4;
+        StackType_t * pxStack;
+        char pcDontCare5[ configMAX_TASK_NAME_LEN ];
+
+        #if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
+            StackType_t * pxEndOfStack;
+        #endif
+    };
+    struct tskTaskControlBlockRedef * pxTCB = ( struct tskTaskControlBlockRedef * ) xTask;
+
+    return( ( ( ( uintptr_t ) pxTCB->pxEndOfStack - ( uintptr_t ) pxTCB->pxStack ) / sizeof( StackType_t ) ) + 2 );
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulStackWatchRecommend( uint32_t ulUsed )
+{
+    uint32_t ulMargin = ( ulUsed * STACK_WATCH_MARGIN_PCT ) / 100;
+
+    if( ulMargin < STACK_WATCH_MARGIN_MIN_WORDS )
+    {
+        ulMargin = STACK_WATCH_MARGIN_MIN_WORDS;
+    }
+
+    return( ( ( ulUsed + ulMargin + STACK_WATCH_ROUND_WORDS - 1 ) / STACK_WATCH_ROUND_WORDS ) * STACK_WATCH_ROUND_WORDS );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvStackWatchFill( StackWatchTask_t * pxTask,
+                               const TaskStatus_t * pxStatus )
+{
+    pxTask->xHandle = pxStatus->xHandle;
+    ( void ) strncpy( pxTask->pcName, pxStatus->pcTaskName, configMAX_TASK_NAME_LEN - 1 );
+    pxTask->pcName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+    pxTask->ulDepth = ulStackWatchGetDepth( pxStatus->xHandle );
+    pxTask->ulFree = pxStatus->usStackHighWaterMark;
+
+    if( pxTask->ulFree > pxTask->ulDepth )
+    {
+        pxTask->ulFree = pxTask->ulDepth;
+    }
+
+    pxTask->ulRecommended = ulStackWatchRecommend( pxTask->ulDepth - pxTask->ulFree );
+}
+
+/*-----------------------------------------------------------*/
+
+static StackWatchSlot_t * pxSlotGet( const TaskStatus_t * pxStatus )
+{
+    StackWatchSlot_t * pxSlot = NULL;
+    StackWatchSlot_t * pxFree = NULL;
+
+    for( uint32_t i = 0; ( i < STACK_WATCH_MAX_TASKS ) && ( pxSlot == NULL ); i++ )
+    {
+        /* The task number tells a new task apart from a deleted one with the same handle */
+        if( ( xSlots[ i ].xHandle == pxStatus->xHandle ) &&
+            ( xSlots[ i ].uxTaskNumber == pxStatus->xTaskNumber ) )
+        {
+            pxSlot = &xSlots[ i ];
+        }
+        else if( ( xSlots[ i ].xHandle == NULL ) && ( pxFree == NULL ) )
+        {
+            pxFree = &xSlots[ i ];
+        }
+    }
+
+    if( ( pxSlot == NULL ) && ( pxFree != NULL ) )
+    {
+        pxSlot = pxFree;
+        pxSlot->xHandle = pxStatus->xHandle;
+        pxSlot->uxTaskNumber = pxStatus->xTaskNumber;
+        pxSlot->xWarned = pdFALSE;
+    }
+
+    return pxSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( STACK_WATCH_REPORT_S > 0 )
+    static void prvStackWatchReport( UBaseType_t uxTasks )
+    {
+        uint32_t ulSpare = 0;
+
+        LogInfo( "Stack sizes after %d s, in words (task: depth, used, recommended):", STACK_WATCH_REPORT_S );
+
+        for( UBaseType_t i = 0; i < uxTasks; i++ )
+        {
+            StackWatchTask_t xTask;
+
+            prvStackWatchFill( &xTask, &xTaskStatus[ i ] );
+
+            LogInfo( "  %s: %lu, %lu, %lu", xTask.pcName, xTask.ulDepth,
+                     xTask.ulDepth - xTask.ulFree, xTask.ulRecommended );
+
+            if( xTask.ulDepth > xTask.ulRecommended )
+            {
+                ulSpare += xTask.ulDepth - xTask.ulRecommended;
+            }
+        }
+
+        LogInfo( "Stack sizes above the recommendation add up to %lu bytes.", ( uint32_t ) ( ulSpare * sizeof( StackType_t ) ) );
+    }
+#endif /* STACK_WATCH_REPORT_S > 0 */
+
+/*-----------------------------------------------------------*/
+
+static void prvStackWatchSample( TimerHandle_t xTimer )
+{
+    UBaseType_t uxTasks;
+
+    ( void ) xTimer;
+
+    uxTasks = uxTaskGetSystemState( xTaskStatus, STACK_WATCH_MAX_TASKS, NULL );
+
+    if( uxTasks == 0 )
+    {
+        if( xTooManyTasks == pdFALSE )
+        {
+            LogWarn( "More than %d tasks, stacks are not monitored.", STACK_WATCH_MAX_TASKS );
+            xTooManyTasks = pdTRUE;
+        }
+    }
+    else
+    {
+        xTooManyTasks = pdFALSE;
+
+        for( uint32_t i = 0; i < STACK_WATCH_MAX_TASKS; i++ )
+        {
+            xSlots[ i ].xSeen = pdFALSE;
+        }
+
+        for( UBaseType_t i = 0; i < uxTasks; i++ )
+        {
+            StackWatchSlot_t * pxSlot = pxSlotGet( &xTaskStatus[ i ] );
+
+            if( pxSlot != NULL )
+            {
+                uint32_t ulDepth = ulStackWatchGetDepth( xTaskStatus[ i ].xHandle );
+                uint32_t ulFree = xTaskStatus[ i ].usStackHighWaterMark;
+
+                pxSlot->xSeen = pdTRUE;
+
+                if( ( pxSlot->xWarned == pdFALSE ) &&
+                    ( ( ulFree < STACK_WATCH_WARN_WORDS ) ||
+                      ( ( ulFree * 100 ) < ( ulDepth * STACK_WATCH_WARN_PCT ) ) ) )
+                {
+                    LogWarn( "Task %s has %lu of %lu stack words left, %lu recommended.",
+                             xTaskStatus[ i ].pcTaskName, ulFree, ulDepth,
+                             ulStackWatchRecommend( ulDepth - ulFree ) );
+                    pxSlot->xWarned = pdTRUE;
+                }
+            }
+        }
+
+        /* Slots of deleted tasks are reused */
+        for( uint32_t i = 0; i < STACK_WATCH_MAX_TASKS; i++ )
+        {
+            if( xSlots[ i ].xSeen == pdFALSE )
+            {
+                xSlots[ i ].xHandle = NULL;
+            }
+        }
+
+        #if ( STACK_WATCH_REPORT_S > 0 )
+            if( ( xReported == pdFALSE ) &&
+                ( xTaskGetTickCount() >= pdMS_TO_TICKS( STACK_WATCH_REPORT_S * 1000 ) ) )
+            {
+                prvStackWatchReport( uxTasks );
+                xReported = pdTRUE;
+            }
+        #endif
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vStackWatchInit( void )
+{
+    static StaticTimer_t xTimerBuffer;
+    TimerHandle_t xTimer;
+
+    xTimer = xTimerCreateStatic( "StackWatch", pdMS_TO_TICKS( STACK_WATCH_PERIOD_MS ), pdTRUE, NULL,
+                                 prvStackWatchSample, &xTimerBuffer );
+    configASSERT( xTimer != NULL );
+
+    if( xTimer != NULL )
+    {
+        ( void ) xTimerStart( xTimer, 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxStackWatchGet( StackWatchTask_t * pxTasks,
+                             UBaseType_t uxMaxTasks )
+{
+    UBaseType_t uxNumTasks = uxTaskGetNumberOfTasks();
+    UBaseType_t uxCount = 0;
+    TaskStatus_t * pxTaskStatusArray = ( TaskStatus_t * ) pvPortMalloc( sizeof( TaskStatus_t ) * uxNumTasks );
+
+    if( pxTaskStatusArray != NULL )
+    {
+        uxNumTasks = uxTaskGetSystemState( pxTaskStatusArray, uxNumTasks, NULL );
+
+        for( UBaseType_t i = 0; ( i < uxNumTasks ) && ( uxCount < uxMaxTasks ); i++ )
+        {
+            prvStackWatchFill( &pxTasks[ uxCount++ ], &pxTaskStatusArray[ i ] );
+        }
+
+        vPortFree( pxTaskStatusArray );
+    }
+
+    return uxCount;
+}
@@ -0,0 +1,200 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "sys_evt.h"
+
+#include <string.h>
+
+/* Maximum number of subscriptions registered with xSysEventSubscribe */
+#ifndef SYS_EVT_SUBSCRIBERS_MAX
+    #define SYS_EVT_SUBSCRIBERS_MAX    ( 8 )
+#endif
+
+typedef struct
+{
+    uint32_t ulEventMask;
+    SysEventCallback_t xCallback;
+    void * pvCtx;
+} SysEventSubscriber_t;
+
+static SysEventSubscriber_t xSubscribers[ SYS_EVT_SUBSCRIBERS_MAX ] = { 0 };
+
+/* SYS_EVT_BIT of the "up" event of each pair which is currently up */
+static uint32_t ulStateUp = 0;
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSysEventSubscribe( uint32_t ulEventMask,
+                               SysEventCallback_t xCallback,
+                               void * pvCtx )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( xCallback != NULL )
+    {
+        taskENTER_CRITICAL();
+
+        for( UBaseType_t i = 0; i < SYS_EVT_SUBSCRIBERS_MAX; i++ )
+        {
+            if( xSubscribers[ i ].xCallback == NULL )
+            {
+                xSubscribers[ i ].ulEventMask = ulEventMask;
+                xSubscribers[ i ].xCallback = xCallback;
+                xSubscribers[ i ].pvCtx = pvCtx;
+                xSuccess = pdTRUE;
+                break;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( xSuccess == pdFALSE )
+        {
+            LogError( "No room for the event subscription, increase SYS_EVT_SUBSCRIBERS_MAX." );
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+void vSysEventUnsubscribe( SysEventCallback_t xCallback,
+                           void * pvCtx )
+{
+    taskENTER_CRITICAL();
+
+    for( UBaseType_t i = 0; i < SYS_EVT_SUBSCRIBERS_MAX; i++ )
+    {
+        if( ( xSubscribers[ i ].xCallback == xCallback ) &&
+            ( xSubscribers[ i ].pvCtx == pvCtx ) )
+        {
+            xSubscribers[ i ].xCallback = NULL;
+            xSubscribers[ i ].pvCtx = NULL;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vSysEventPublish( SysEvent_t xEvent )
+{
+    SysEventSubscriber_t xSnapshot[ SYS_EVT_SUBSCRIBERS_MAX ];
+    BaseType_t xChanged = pdFALSE;
+    /* Each pair is an even "up" event followed by its "down" event */
+    uint32_t ulUpBit = SYS_EVT_BIT( xEvent & ~1UL );
+    BaseType_t xUp = ( ( xEvent & 1UL ) == 0 ) ? pdTRUE : pdFALSE;
+
+    configASSERT( xEvent < SYS_EVT_MAX );
+
+    taskENTER_CRITICAL();
+
+    if( ( ( ulStateUp & ulUpBit ) != 0 ) != ( xUp == pdTRUE ) )
+    {
+        ulStateUp ^= ulUpBit;
+        xChanged = pdTRUE;
+    }
+
+    ( void ) memcpy( xSnapshot, xSubscribers, sizeof( xSnapshot ) );
+
+    taskEXIT_CRITICAL();
+
+    if( xChanged == pdTRUE )
+    {
+        LogDebug( "Event: %s", pcSysEventToString( xEvent ) );
+
+        switch( xEvent )
+        {
+            case SYS_EVT_IP_UP:
+                ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                break;
+
+            case SYS_EVT_IP_DOWN:
+                ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                break;
+
+            case SYS_EVT_MQTT_CONNECTED:
+                ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+                break;
+
+            case SYS_EVT_MQTT_DISCONNECTED:
+                ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+                break;
+
+            default:
+                break;
+        }
+
+        for( UBaseType_t i = 0; i < SYS_EVT_SUBSCRIBERS_MAX; i++ )
+        {
+            if( ( xSnapshot[ i ].xCallback != NULL ) &&
+                ( ( xSnapshot[ i ].ulEventMask & SYS_EVT_BIT( xEvent ) ) != 0 ) )
+            {
+                xSnapshot[ i ].xCallback( xEvent, xSnapshot[ i ].pvCtx );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSysEventIsUp( SysEvent_t xEvent )
+{
+    configASSERT( xEvent < SYS_EVT_MAX );
+
+    /* A single aligned word, read without a critical section */
+    return( ( ( ulStateUp & SYS_EVT_BIT( xEvent & ~1UL ) ) != 0 ) ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcSysEventToString( SysEvent_t xEvent )
+{
+    static const char * const pcNames[ SYS_EVT_MAX ] =
+    {
+        "link_up",
+        "link_down",
+        "ip_up",
+        "ip_down",
+        "mqtt_connected",
+        "mqtt_disconnected",
+        "link_poor",
+        "link_good",
+    };
+
+    return ( xEvent < SYS_EVT_MAX ) ? pcNames[ xEvent ] : "?";
+}
@@ -0,0 +1,220 @@
+/*
+ * FreeRTOS STM32U5 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <assert.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32u5xx_hal.h"
+#include "kvstore.h"
+#include "time_hwm.h"
+
+/* The kvstore copy is rewritten once the mark has advanced this far past it */
+#ifndef TIME_HWM_KV_INTERVAL_S
+    #define TIME_HWM_KV_INTERVAL_S    ( 24UL * 60UL * 60UL )
+#endif
+
+/*
+ * TrustZone builds leave the backup registers to the secure side, so only the
+ * rate limited kvstore copy is kept there.
+ */
+#ifndef TFM_PSA_API
+    #define TIME_HWM_USE_BKP    1
+#else
+    #define TIME_HWM_USE_BKP    0
+#endif
+
+#if TIME_HWM_USE_BKP
+
+/* First of the 1 + 2 * TIME_HWM_BKP_SLOTS TAMP backup registers used */
+    #ifndef TIME_HWM_BKP_FIRST_REG
+        #define TIME_HWM_BKP_FIRST_REG    ( 16U )
+    #endif
+
+    #ifndef TIME_HWM_BKP_SLOTS
+        #define TIME_HWM_BKP_SLOTS    ( 4U )
+    #endif
+
+    #define TIME_HWM_BKP_MAGIC    ( 0x48574D31UL ) /* "HWM1" */
+
+    static_assert( ( TIME_HWM_BKP_FIRST_REG + 1U + 2U * TIME_HWM_BKP_SLOTS ) <= 32U,
+                   "The time high water mark does not fit in the backup registers." );
+
+/*
+ * Register TIME_HWM_BKP_FIRST_REG holds TIME_HWM_BKP_MAGIC once the ring has been
+ * initialized. Each slot is a value followed by its complement, so a slot left half
+ * written by a reset is ignored and the previous slot still holds a valid mark.
+ */
+    static inline volatile uint32_t * pulBkpReg( uint32_t ulReg )
+    {
+        return &( ( &( TAMP->BKP0R ) )[ TIME_HWM_BKP_FIRST_REG + ulReg ] );
+    }
+
+    static UBaseType_t uxNextSlot = 0;
+#endif /* TIME_HWM_USE_BKP */
+
+static uint32_t ulTimeHwm = 0;
+static uint32_t ulTimeHwmKv = 0;
+
+/*-----------------------------------------------------------*/
+
+#if TIME_HWM_USE_BKP
+    static uint32_t ulReadBkpRing( void )
+    {
+        uint32_t ulMax = 0;
+
+        __HAL_RCC_PWR_CLK_ENABLE();
+        __HAL_RCC_RTCAPB_CLK_ENABLE();
+        HAL_PWR_EnableBkUpAccess();
+
+        if( *pulBkpReg( 0 ) == TIME_HWM_BKP_MAGIC )
+        {
+            for( UBaseType_t uxSlot = 0; uxSlot < TIME_HWM_BKP_SLOTS; uxSlot++ )
+            {
+                uint32_t ulValue = *pulBkpReg( 1U + 2U * uxSlot );
+                uint32_t ulCheck = *pulBkpReg( 2U + 2U * uxSlot );
+
+                if( ( ( ulValue ^ ulCheck ) == UINT32_MAX ) &&
+                    ( ulValue >= ulMax ) )
+                {
+                    ulMax = ulValue;
+                    uxNextSlot = ( uxSlot + 1U ) % TIME_HWM_BKP_SLOTS;
+                }
+            }
+        }
+        else
+        {
+            /* Backup domain was reset, start with an empty ring */
+            for( UBaseType_t uxReg = 1; uxReg <= ( 2U * TIME_HWM_BKP_SLOTS ); uxReg++ )
+            {
+                *pulBkpReg( uxReg ) = 0;
+            }
+
+            *pulBkpReg( 0 ) = TIME_HWM_BKP_MAGIC;
+            uxNextSlot = 0;
+        }
+
+        return ulMax;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Called within a critical section */
+    static void vWriteBkpSlot( uint32_t ulValue )
+    {
+        UBaseType_t uxSlot = uxNextSlot;
+
+        /* Invalidate the slot before writing the new value */
+        *pulBkpReg( 2U + 2U * uxSlot ) = ulValue;
+        *pulBkpReg( 1U + 2U * uxSlot ) = ulValue;
+        *pulBkpReg( 2U + 2U * uxSlot ) = ~ulValue;
+
+        uxNextSlot = ( uxSlot + 1U ) % TIME_HWM_BKP_SLOTS;
+    }
+#endif /* TIME_HWM_USE_BKP */
+
+/*-----------------------------------------------------------*/
+
+void vTimeHwmInit( void )
+{
+    BaseType_t xSuccess = pdFALSE;
+    uint32_t ulBkp = 0;
+
+    ulTimeHwmKv = KVStore_getUInt32( CS_TIME_HWM_S_1970, &xSuccess );
+
+    if( xSuccess == pdFALSE )
+    {
+        ulTimeHwmKv = 0;
+    }
+
+    #if TIME_HWM_USE_BKP
+        ulBkp = ulReadBkpRing();
+    #endif
+
+    taskENTER_CRITICAL();
+    ulTimeHwm = ( ulBkp > ulTimeHwmKv ) ? ulBkp : ulTimeHwmKv;
+    taskEXIT_CRITICAL();
+
+    LogInfo( "Time high water mark: %lu (backup registers: %lu, kvstore: %lu).",
+             ulTimeHwm, ulBkp, ulTimeHwmKv );
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulTimeHwmGet( void )
+{
+    return ulTimeHwm;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTimeHwmUpdate( uint32_t ulTimeS1970 )
+{
+    BaseType_t xPersist = pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    if( ulTimeS1970 > ulTimeHwm )
+    {
+        ulTimeHwm = ulTimeS1970;
+
+        #if TIME_HWM_USE_BKP
+            vWriteBkpSlot( ulTimeS1970 );
+        #endif
+
+        if( ( ulTimeS1970 - ulTimeHwmKv ) >= TIME_HWM_KV_INTERVAL_S )
+        {
+            ulTimeHwmKv = ulTimeS1970;
+            xPersist = pdTRUE;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( xPersist == pdTRUE )
+    {
+        xPersist = KVStore_setUInt32( CS_TIME_HWM_S_1970, ulTimeS1970 );
+
+        if( xPersist != pdTRUE )
+        {
+            LogError( "Failed to store the time high water mark." );
+        }
+
+        #if KV_STORE_CACHE_ENABLE
+            if( xPersist == pdTRUE )
+            {
+                KVStore_commitDeferred();
+            }
+        #endif
+    }
+}
@@ -0,0 +1,353 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "hw_defs.h"
+#include "trace_rec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if ( TRACE_REC_ENABLED == 1 )
+
+    #define TRACE_REC_ENTRIES_MASK      ( TRACE_REC_ENTRIES - 1 )
+
+    #if ( ( TRACE_REC_ENTRIES & TRACE_REC_ENTRIES_MASK ) != 0 )
+        #error "TRACE_REC_ENTRIES must be a power of 2"
+    #endif
+
+    #define TRACE_REC_EVT_SWITCH        0
+    #define TRACE_REC_EVT_QUEUE_SEND    1
+    #define TRACE_REC_EVT_QUEUE_RECV    2
+    #define TRACE_REC_EVT_BEGIN         0x40 /* | TraceRecSlice_t */
+    #define TRACE_REC_EVT_END           0x80 /* | TraceRecSlice_t */
+    #define TRACE_REC_EVT_SLICE_MASK    0x3F
+
+    #define TRACE_REC_LINE_LEN          160
+
+    static TraceRecEvent_t xRing[ TRACE_REC_ENTRIES ];
+    static uint32_t ulHead = 0;
+    static uint32_t ulMask = 0;
+    static uint8_t ucCurrentTask = 0;
+
+/* Queues numbered by the recorder, number n is at index n - 1 */
+    static QueueHandle_t xQueues[ TRACE_REC_MAX_QUEUES ];
+    static UBaseType_t uxQueuesNumbered = 0;
+
+    static const char * const pcSliceNames[ TraceRecSliceMax ] =
+    {
+        [ TraceRecSliceSpi ]        = "spi",
+        [ TraceRecSliceMqttCmd ]    = "mqtt_cmd",
+        [ TraceRecSliceTlsEncrypt ] = "tls_encrypt",
+        [ TraceRecSliceTlsDecrypt ] = "tls_decrypt",
+        [ TraceRecSliceFlashProg ]  = "flash_prog",
+        [ TraceRecSliceFlashErase ] = "flash_erase",
+    };
+
+/*-----------------------------------------------------------*/
+
+    static inline void prvRecord( uint32_t ulClass,
+                                  uint8_t ucEvent,
+                                  uint8_t ucTask,
+                                  uint32_t ulArg )
+    {
+        if( ( __atomic_load_n( &ulMask, __ATOMIC_RELAXED ) & ulClass ) != 0 )
+        {
+            uint32_t ulTimeUs = ( uint32_t ) ullGetMonotonicUs();
+            uint32_t ulIdx = __atomic_fetch_add( &ulHead, 1, __ATOMIC_RELAXED ) & TRACE_REC_ENTRIES_MASK;
+
+            xRing[ ulIdx ].ulTimeUs = ulTimeUs;
+            xRing[ ulIdx ].ucEvent = ucEvent;
+            xRing[ ulIdx ].ucTask = ucTask;
+            xRing[ ulIdx ].usArg = ( ulArg > UINT16_MAX ) ? UINT16_MAX : ( uint16_t ) ulArg;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Called from vTaskSwitchContext */
+    void vTraceRecTaskSwitchedIn( uint32_t ulTaskNumber )
+    {
+        ucCurrentTask = ( ulTaskNumber > UINT8_MAX ) ? UINT8_MAX : ( uint8_t ) ulTaskNumber;
+
+        prvRecord( TRACE_REC_MASK_SCHED, TRACE_REC_EVT_SWITCH, ucCurrentTask, 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Called from the queue functions, in a critical section or with interrupts masked */
+    void vTraceRecQueueEvent( void * pvQueue,
+                              uint32_t ulSend )
+    {
+        if( ( __atomic_load_n( &ulMask, __ATOMIC_RELAXED ) & TRACE_REC_MASK_QUEUE ) != 0 )
+        {
+            QueueHandle_t xQueue = ( QueueHandle_t ) pvQueue;
+            UBaseType_t uxNumber = uxQueueGetQueueNumber( xQueue );
+
+            if( uxNumber == 0 )
+            {
+                uxNumber = ++uxQueuesNumbered;
+                vQueueSetQueueNumber( xQueue, uxNumber );
+
+                if( uxNumber <= TRACE_REC_MAX_QUEUES )
+                {
+                    xQueues[ uxNumber - 1 ] = xQueue;
+                }
+            }
+
+            prvRecord( TRACE_REC_MASK_QUEUE,
+                       ( ulSend != 0 ) ? TRACE_REC_EVT_QUEUE_SEND : TRACE_REC_EVT_QUEUE_RECV,
+                       ucCurrentTask,
+                       uxNumber );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vTraceRecBegin( TraceRecSlice_t xSlice,
+                         uint32_t ulArg )
+    {
+        prvRecord( TRACE_REC_MASK_SLICE, TRACE_REC_EVT_BEGIN | ( uint8_t ) xSlice, ucCurrentTask, ulArg );
+    }
+
+    void vTraceRecEnd( TraceRecSlice_t xSlice,
+                       uint32_t ulArg )
+    {
+        prvRecord( TRACE_REC_MASK_SLICE, TRACE_REC_EVT_END | ( uint8_t ) xSlice, ucCurrentTask, ulArg );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vTraceRecStart( uint32_t ulNewMask )
+    {
+        __atomic_store_n( &ulMask, 0, __ATOMIC_RELAXED );
+        __atomic_store_n( &ulHead, 0, __ATOMIC_RELAXED );
+        __atomic_store_n( &ulMask, ulNewMask & TRACE_REC_MASK_ALL, __ATOMIC_RELEASE );
+    }
+
+    void vTraceRecStop( void )
+    {
+        __atomic_store_n( &ulMask, 0, __ATOMIC_RELEASE );
+    }
+
+    uint32_t ulTraceRecCount( void )
+    {
+        return __atomic_load_n( &ulHead, __ATOMIC_RELAXED );
+    }
+
+    uint32_t ulTraceRecCopyLast( TraceRecEvent_t * pxDst,
+                                 uint32_t ulMax )
+    {
+        uint32_t ulCount = __atomic_load_n( &ulHead, __ATOMIC_ACQUIRE );
+        uint32_t ulCopied = ( ulCount < TRACE_REC_ENTRIES ) ? ulCount : TRACE_REC_ENTRIES;
+
+        if( ulCopied > ulMax )
+        {
+            ulCopied = ulMax;
+        }
+
+        for( uint32_t ulIdx = 0; ulIdx < ulCopied; ulIdx++ )
+        {
+            pxDst[ ulIdx ] = xRing[ ( ulCount - ulCopied + ulIdx ) & TRACE_REC_ENTRIES_MASK ];
+        }
+
+        return ulCopied;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static const char * prvTaskName( const TaskStatus_t * pxTasks,
+                                     UBaseType_t uxTasks,
+                                     uint8_t ucTask )
+    {
+        const char * pcName = NULL;
+
+        for( UBaseType_t uxIdx = 0; ( uxIdx < uxTasks ) && ( pcName == NULL ); uxIdx++ )
+        {
+            if( pxTasks[ uxIdx ].xTaskNumber == ucTask )
+            {
+                pcName = pxTasks[ uxIdx ].pcTaskName;
+            }
+        }
+
+        return pcName;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvQueueName( char * pcBuf,
+                              size_t uxLen,
+                              uint16_t usNumber )
+    {
+        const char * pcName = NULL;
+
+        if( ( usNumber > 0 ) && ( usNumber <= TRACE_REC_MAX_QUEUES ) )
+        {
+            pcName = pcQueueGetName( xQueues[ usNumber - 1 ] );
+        }
+
+        if( pcName != NULL )
+        {
+            ( void ) snprintf( pcBuf, uxLen, "%s", pcName );
+        }
+        else
+        {
+            ( void ) snprintf( pcBuf, uxLen, "q%u", usNumber );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void vTraceRecDump( TraceRecWrite_t xWrite,
+                        void * pvCtx )
+    {
+        char pcLine[ TRACE_REC_LINE_LEN ];
+        UBaseType_t uxTasks = 0;
+        TaskStatus_t * pxTasks = NULL;
+        uint32_t ulCount;
+        uint32_t ulFirst;
+        uint32_t ulStartUs = 0;
+
+        configASSERT( xWrite != NULL );
+
+        vTraceRecStop();
+
+        ulCount = __atomic_load_n( &ulHead, __ATOMIC_ACQUIRE );
+        ulFirst = ( ulCount > TRACE_REC_ENTRIES ) ? ( ulCount - TRACE_REC_ENTRIES ) : 0;
+
+        if( ulCount > ulFirst )
+        {
+            ulStartUs = xRing[ ulFirst & TRACE_REC_ENTRIES_MASK ].ulTimeUs;
+        }
+
+        /* Tasks deleted since they were recorded are shown by number */
+        uxTasks = uxTaskGetNumberOfTasks();
+        pxTasks = pvPortMalloc( uxTasks * sizeof( TaskStatus_t ) );
+
+        if( pxTasks != NULL )
+        {
+            uxTasks = uxTaskGetSystemState( pxTasks, uxTasks, NULL );
+        }
+        else
+        {
+            uxTasks = 0;
+        }
+
+        xWrite( "{\"traceEvents\":[\r\n"
+                "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":\"cpu\"}},\r\n"
+                "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"tasks\"}}", pvCtx );
+
+        for( UBaseType_t uxIdx = 0; uxIdx < uxTasks; uxIdx++ )
+        {
+            ( void ) snprintf( pcLine, sizeof( pcLine ),
+                               ",\r\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                               ( unsigned long ) pxTasks[ uxIdx ].xTaskNumber,
+                               pxTasks[ uxIdx ].pcTaskName );
+            xWrite( pcLine, pvCtx );
+        }
+
+        for( uint32_t ulPos = ulFirst; ulPos < ulCount; ulPos++ )
+        {
+            const TraceRecEvent_t * pxEntry = &( xRing[ ulPos & TRACE_REC_ENTRIES_MASK ] );
+            uint32_t ulTs = pxEntry->ulTimeUs - ulStartUs;
+            uint8_t ucSlice = pxEntry->ucEvent & TRACE_REC_EVT_SLICE_MASK;
+
+            pcLine[ 0 ] = '\0';
+
+            if( pxEntry->ucEvent == TRACE_REC_EVT_SWITCH )
+            {
+                const char * pcName = prvTaskName( pxTasks, uxTasks, pxEntry->ucTask );
+                uint32_t ulDur = 0;
+
+                /* The task ran until the next switch */
+                for( uint32_t ulNext = ulPos + 1; ulNext < ulCount; ulNext++ )
+                {
+                    const TraceRecEvent_t * pxNext = &( xRing[ ulNext & TRACE_REC_ENTRIES_MASK ] );
+
+                    if( pxNext->ucEvent == TRACE_REC_EVT_SWITCH )
+                    {
+                        ulDur = pxNext->ulTimeUs - pxEntry->ulTimeUs;
+                        break;
+                    }
+                }
+
+                if( pcName != NULL )
+                {
+                    ( void ) snprintf( pcLine, sizeof( pcLine ),
+                                       ",\r\n{\"ph\":\"X\",\"pid\":0,\"tid\":0,\"name\":\"%s\",\"ts\":%lu,\"dur\":%lu}",
+                                       pcName, ( unsigned long ) ulTs, ( unsigned long ) ulDur );
+                }
+                else
+                {
+                    ( void ) snprintf( pcLine, sizeof( pcLine ),
+                                       ",\r\n{\"ph\":\"X\",\"pid\":0,\"tid\":0,\"name\":\"task %u\",\"ts\":%lu,\"dur\":%lu}",
+                                       pxEntry->ucTask, ( unsigned long ) ulTs, ( unsigned long ) ulDur );
+                }
+            }
+            else if( ( pxEntry->ucEvent == TRACE_REC_EVT_QUEUE_SEND ) ||
+                     ( pxEntry->ucEvent == TRACE_REC_EVT_QUEUE_RECV ) )
+            {
+                char pcQueue[ configMAX_TASK_NAME_LEN + 8 ];
+
+                prvQueueName( pcQueue, sizeof( pcQueue ), pxEntry->usArg );
+
+                ( void ) snprintf( pcLine, sizeof( pcLine ),
+                                   ",\r\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"name\":\"%s %s\",\"ts\":%lu}",
+                                   pxEntry->ucTask,
+                                   ( pxEntry->ucEvent == TRACE_REC_EVT_QUEUE_SEND ) ? "send" : "recv",
+                                   pcQueue, ( unsigned long ) ulTs );
+            }
+            else if( ucSlice < TraceRecSliceMax )
+            {
+                ( void ) snprintf( pcLine, sizeof( pcLine ),
+                                   ",\r\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"name\":\"%s\",\"ts\":%lu,\"args\":{\"arg\":%u}}",
+                                   ( ( pxEntry->ucEvent & TRACE_REC_EVT_BEGIN ) != 0 ) ? 'B' : 'E',
+                                   pxEntry->ucTask, pcSliceNames[ ucSlice ],
+                                   ( unsigned long ) ulTs, pxEntry->usArg );
+            }
+            else
+            {
+                /* Not an event of this version */
+            }
+
+            if( pcLine[ 0 ] != '\0' )
+            {
+                xWrite( pcLine, pvCtx );
+            }
+        }
+
+        xWrite( "\r\n]}\r\n", pvCtx );
+
+        if( pxTasks != NULL )
+        {
+            vPortFree( pxTasks );
+        }
+    }
+
+#endif /* TRACE_REC_ENABLED == 1 */
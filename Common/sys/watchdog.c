@@ -0,0 +1,171 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "periodic_work.h"
+#include "static_alloc.h"
+#include "watchdog.h"
+#include "postmortem.h"
+
+static WatchdogClient_t * pxClientHead = NULL;
+static WatchdogClient_t xIdleClient;
+static volatile BaseType_t xSupervisorRunning = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+void vWatchdogStart( WatchdogClient_t * pxClient,
+                     const char * pcName,
+                     TickType_t xDeadline )
+{
+    configASSERT( pxClient != NULL );
+
+    taskENTER_CRITICAL();
+
+    pxClient->pcName = pcName;
+    pxClient->xDeadline = xDeadline;
+    pxClient->xLastCheckIn = xTaskGetTickCount();
+    pxClient->xActive = pdTRUE;
+
+    if( pxClient->xLinked == pdFALSE )
+    {
+        pxClient->pxNext = pxClientHead;
+        pxClientHead = pxClient;
+        pxClient->xLinked = pdTRUE;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vWatchdogStop( WatchdogClient_t * pxClient )
+{
+    configASSERT( pxClient != NULL );
+
+    pxClient->xActive = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vWatchdogIdleCheckIn( void )
+{
+    if( xSupervisorRunning == pdTRUE )
+    {
+        vWatchdogCheckIn( &xIdleClient );
+    }
+    else
+    {
+        vPetWatchdog();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* First active client past its deadline, NULL if none */
+static WatchdogClient_t * prvFindLateClient( void )
+{
+    WatchdogClient_t * pxLate = NULL;
+
+    taskENTER_CRITICAL();
+
+    TickType_t xNow = xTaskGetTickCount();
+
+    for( WatchdogClient_t * pxClient = pxClientHead; ( pxClient != NULL ) && ( pxLate == NULL ); pxClient = pxClient->pxNext )
+    {
+        if( ( pxClient->xActive == pdTRUE ) &&
+            ( ( xNow - pxClient->xLastCheckIn ) > pxClient->xDeadline ) )
+        {
+            pxLate = pxClient;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    return pxLate;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSupervisorTask( void * pvParameters )
+{
+    static PeriodicWork_t xPetWork;
+    WatchdogClient_t * pxLate = NULL;
+
+    ( void ) pvParameters;
+
+    vWatchdogStart( &xIdleClient, "IDLE", pdMS_TO_TICKS( WATCHDOG_IDLE_DEADLINE_MS ) );
+    xSupervisorRunning = pdTRUE;
+
+    /* The slack keeps the longest gap between two refreshes at 5 s, half the IWDG timeout */
+    vPeriodicWorkStart( &xPetWork, pdMS_TO_TICKS( WATCHDOG_PET_MS ), pdMS_TO_TICKS( WATCHDOG_PET_MS / 4 ) );
+
+    vPetWatchdog();
+
+    for( ; ; )
+    {
+        vPeriodicWorkWait( &xPetWork );
+
+        /* Once a deadline was missed the IWDG is left to reset the board, even if the client recovers */
+        if( pxLate == NULL )
+        {
+            pxLate = prvFindLateClient();
+
+            if( pxLate == NULL )
+            {
+                vPetWatchdog();
+            }
+            else
+            {
+                LogError( "Watchdog client %s did not check in for %u ms, reset pending.",
+                          pxLate->pcName,
+                          ( unsigned int ) ( ( xTaskGetTickCount() - pxLate->xLastCheckIn ) * portTICK_PERIOD_MS ) );
+
+                vPostMortemCapture( PostMortemWatchdog, pxLate->pcName, 0 );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vWatchdogInit( void )
+{
+    BaseType_t xResult;
+
+    xResult = xAppTaskCreate( prvSupervisorTask, "Watchdog", 512, NULL, WATCHDOG_TASK_PRIORITY, NULL );
+    configASSERT( xResult == pdPASS );
+}
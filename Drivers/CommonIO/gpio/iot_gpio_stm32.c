@@ -329,26 +329,44 @@ static void prvConfigFromPinState( IotGpioDescriptor_t * pxDescriptor )
  */
 static void prvPinEventHandler( uint16_t xPin_STM )
 {
-//    IotGpioHandle_t pxGpio = NULL;
-//    IotMappedPin_t * pxMappedPin = NULL;
-//
-//    for( int i = 0; i < IOT_COMMON_IO_GPIO_NUMBER_OF_PINS; i++ )
-//    {
-//        if( pxGpioMap[ pxGpioDesc[ i ].lGpioNumber ].xPinMask == xPin_STM )
-//        {
-//            pxGpio = &pxGpioDesc[ i ];
-//            pxMappedPin = &pxGpioMap[ pxGpioDesc[ i ].lGpioNumber ];
-//            break;
-//        }
-//    }
-//
-//    if( ( pxGpio != NULL ) && ( pxGpio->xUserCallback != NULL ) && ( pxGpio->xConfig.xInterruptMode != eGpioInterruptNone ) )
-//    {
-//        pxGpio->xUserCallback( (uint8_t)HAL_GPIO_ReadPin( pxMappedPin->xPort, pxMappedPin->xPinMask ), pxGpio->pvUserContext );
-//    }
+    uint32_t ulLine = POSITION_VAL( xPin_STM );
+    IotGpioHandle_t pxGpio = NULL;
+
+    if( ulLine < NUM_GPIO_PER_CONTROLLER )
+    {
+        /* Filled by eSetGpioInterrupt, so no search is needed in interrupt context */
+        pxGpio = interrupt_to_gpio_map[ ulLine ];
+    }
 
+    if( ( pxGpio != NULL ) && ( pxGpio->xUserCallback != NULL ) )
+    {
+        const IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
 
-    // This implementation is horribly broken.
+        pxGpio->xUserCallback( ( uint8_t ) HAL_GPIO_ReadPin( pxMappedPin->xPort, pxMappedPin->xPinMask ), pxGpio->pvUserContext );
+    }
+}
+
+/*
+ * @brief Point the EXTI line of pxGpio at its descriptor while an interrupt mode is set,
+ *        and release the line otherwise. Each EXTI line is shared by the same pin number
+ *        of every port, so it belongs to the last pin configured for it.
+ */
+static void prvUpdateInterruptMap( IotGpioHandle_t const pxGpio )
+{
+    uint32_t ulLine = POSITION_VAL( pxGpioMap[ pxGpio->lGpioNumber ].xPinMask );
+
+    if( ulLine < NUM_GPIO_PER_CONTROLLER )
+    {
+        if( ( pxGpio->ucState != IOT_GPIO_CLOSED ) &&
+            ( pxGpio->xConfig.xInterruptMode != eGpioInterruptNone ) )
+        {
+            interrupt_to_gpio_map[ ulLine ] = pxGpio;
+        }
+        else if( interrupt_to_gpio_map[ ulLine ] == pxGpio )
+        {
+            interrupt_to_gpio_map[ ulLine ] = NULL;
+        }
+    }
 }
 
 static void prvEnablePortClock( IotGpioHandle_t const pxGpio )
@@ -643,6 +661,7 @@ int32_t iot_gpio_close( IotGpioHandle_t const pxGpio )
     	IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
 
         pxGpio->ucState = IOT_GPIO_CLOSED;
+        prvUpdateInterruptMap( pxGpio );
 //        prvDisablePinInterrupt( pxGpio );
 //        HAL_GPIO_DeInit( pxMappedPin->xPort, pxMappedPin->xPinMask );
         pxGpio->xUserCallback = NULL;
@@ -699,7 +718,7 @@ int32_t iot_gpio_ioctl( IotGpioHandle_t const pxGpio,
             case eSetGpioInterrupt:
                 memcpy( &xNewConfig.xInterruptMode, pvBuffer, sizeof( xNewConfig.xInterruptMode ) );
                 lReturnCode = prvConfigurePin( pxGpio, &xNewConfig );
-                /* TODO: Add to interrupt_to_gpio_map */
+                prvUpdateInterruptMap( pxGpio );
                 break;
 
             case eGetGpioInterrupt:
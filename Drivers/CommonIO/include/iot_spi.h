@@ -127,6 +127,39 @@ typedef struct IotSPIDescriptor * IotSPIHandle_t;
 typedef void (* IotSPICallback_t) ( IotSPITransactionStatus_t xStatus,
                                     void * pvSPIparam );
 
+/**
+ * @brief Leave the chip select asserted after the transaction, for a command followed by data.
+ */
+#define IOT_SPI_TRANSACTION_KEEP_CS    ( 0x1UL )
+
+/**
+ * @brief A device on the bus, addressed by queued transactions.
+ */
+typedef struct IotSPIDevice
+{
+    void * pvCsPort;              /*!< GPIO port (GPIO_TypeDef *) of the chip select, NULL if the device has none. */
+    uint16_t usCsPin;             /*!< GPIO pin mask of the chip select. */
+    uint8_t ucCsActiveHigh;       /*!< 1 if the chip select is active high, 0 if it is active low. */
+    IotSPIMasterConfig_t xConfig; /*!< Bus configuration the device needs, applied when it differs from the current one. */
+} IotSPIDevice_t;
+
+/**
+ * @brief A transaction queued with iot_spi_queue_transaction().
+ *
+ * The transaction and its buffers belong to the driver until its callback is invoked.
+ */
+typedef struct IotSPITransaction
+{
+    const IotSPIDevice_t * pxDevice;   /*!< Device to select. */
+    uint8_t * pucTxBuffer;             /*!< Data to send, NULL to only receive. */
+    uint8_t * pucRxBuffer;             /*!< Buffer for the received data, NULL to only send. */
+    size_t xBytes;                     /*!< Number of bytes to transfer. */
+    uint32_t ulFlags;                  /*!< IOT_SPI_TRANSACTION_* flags. */
+    IotSPICallback_t xCallback;        /*!< Called from the SPI interrupt when the transaction ends, may be NULL. */
+    void * pvUserContext;              /*!< Passed to xCallback. */
+    struct IotSPITransaction * pxNext; /*!< Used by the driver while the transaction is queued. */
+} IotSPITransaction_t;
+
 /**
  * @brief Initializes SPI peripheral with default configuration.
  *
@@ -415,9 +448,38 @@ int32_t iot_spi_close( IotSPIHandle_t const pxSPIPeripheral );
  *     - pxSPIPeripheral is not opened yet
  * - IOT_SPI_NOTHING_TO_CANCEL, if there is no on-going operation.
  * - IOT_SPI_FUNCTION_NOT_SUPPORTED, if this board doesn't support this operation.
+ *
+ * @note The queued transactions are dropped, each callback is invoked with eSPITransferError
+ * from the calling task.
  */
 int32_t iot_spi_cancel( IotSPIHandle_t const pxSPIPeripheral );
 
+/**
+ * @brief Queues a transaction on the SPI bus.
+ *
+ * Queued transactions run in order, each one started from the interrupt of the previous one, so
+ * transfers to several devices follow each other without waking a task. Before each transaction
+ * the driver asserts the chip select of its device, after deasserting the one of the previous
+ * device, and applies the device configuration if it differs from the current one. The chip select
+ * is deasserted at the end of the transaction unless IOT_SPI_TRANSACTION_KEEP_CS is set.
+ *
+ * This function can be called from a task or from a transaction callback. The other read, write
+ * and transfer functions return IOT_SPI_BUS_BUSY while queued transactions are pending.
+ *
+ * @param[in] pxSPIPeripheral The peripheral handle returned in the open() call.
+ * @param[in] pxTransaction The transaction, which must stay valid until its callback.
+ *
+ * @return
+ * - IOT_SPI_SUCCESS, on success
+ * - IOT_SPI_INVALID_VALUE, if
+ *     - pxSPIPeripheral is NULL
+ *     - pxSPIPeripheral is not opened yet
+ *     - pxTransaction or its device is NULL, both buffers are NULL or xBytes is 0
+ * - IOT_SPI_BUS_BUSY, if a transfer started by another function is ongoing.
+ */
+int32_t iot_spi_queue_transaction( IotSPIHandle_t const pxSPIPeripheral,
+                                   IotSPITransaction_t * const pxTransaction );
+
 /**
  * @brief This function is used to select spi slave.
  *
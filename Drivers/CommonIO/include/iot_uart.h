@@ -64,6 +64,7 @@ typedef enum
     eUartReadCompleted,   /*!< UART operation read completed successfully. */
     eUartLastWriteFailed, /*!< UART driver returns error when performing write operation. */
     eUartLastReadFailed,  /*!< UART driver returns error when performing read operation. */
+    eUartRxRingData,      /*!< New bytes are in the receive ring started by eUartStartRxRing. */
 } IotUARTOperationStatus_t;
 
 /**
@@ -115,10 +116,13 @@ typedef struct IotUARTDescriptor * IotUARTHandle_t;
  */
 typedef enum
 {
-    eUartSetConfig,  /** Sets the UART configuration according to @IotUARTConfig_t. */
-    eUartGetConfig,  /** Gets the UART configuration according to @IotUARTConfig_t. */
-    eGetTxNoOfbytes, /** Get the number of bytes sent in write operation. */
-    eGetRxNoOfbytes  /** Get the number of bytes received in read operation. */
+    eUartSetConfig,      /** Sets the UART configuration according to @IotUARTConfig_t. */
+    eUartGetConfig,      /** Gets the UART configuration according to @IotUARTConfig_t. */
+    eGetTxNoOfbytes,     /** Get the number of bytes sent in write operation. */
+    eGetRxNoOfbytes,     /** Get the number of bytes received in read operation. */
+    eUartSetTxDma,       /** Send the data of the write functions by DMA (uint8_t 1) or interrupts (uint8_t 0). */
+    eUartStartRxRing,    /** Start the continuous DMA reception into the ring given by @IotUARTRxRing_t. */
+    eUartGetRxRingStats  /** Gets the receive ring counters in @IotUARTRxRingStats_t. */
 } IotUARTIoctlRequest_t;
 
 /**
@@ -136,6 +140,29 @@ typedef struct
     uint8_t ucFlowControl;       /**< The flow control to be set for the UART port: 0 is disabled and 1 is enabled. */
 } IotUARTConfig_t;
 
+/**
+ * @brief Memory of the receive ring, passed with eUartStartRxRing.
+ *
+ * The DMA writes to the buffer until the ring is stopped by iot_uart_cancel or iot_uart_close.
+ * It must be in internal SRAM and stay valid while the ring runs.
+ */
+typedef struct
+{
+    uint8_t * pucBuffer; /**< The ring memory. */
+    size_t xSize;        /**< The ring size in bytes, even and from 2 to 65534. */
+} IotUARTRxRing_t;
+
+/**
+ * @brief Receive ring counters, returned by eUartGetRxRingStats.
+ */
+typedef struct
+{
+    uint32_t ulReceived;   /**< Bytes received since the ring was started. */
+    uint32_t ulPending;    /**< Bytes in the ring not consumed yet. */
+    uint32_t ulLost;       /**< Bytes overwritten by the DMA before they were consumed. */
+    uint32_t ulLineErrors; /**< Receive events which saw a framing, noise or parity error. */
+} IotUARTRxRingStats_t;
+
 /**
  * @brief Initializes the UART peripheral of the board.
  *
@@ -350,6 +377,22 @@ int32_t iot_uart_write_async( IotUARTHandle_t const pxUartPeripheral,
  * - If the last operation was read, this returns the actual number of read bytes which might be smaller than the requested number (partial read).
  * - If the last operation was write, this returns 0.
  *
+ * @note eUartSetTxDma selects how iot_uart_write_async and iot_uart_write_sync send the data.
+ * This request expects a 1 byte buffer (uint8_t): 1 for DMA, 0 for interrupts (the default).
+ * With DMA, iot_uart_write_sync blocks the calling task until the transfer completes.
+ *
+ * @note eUartStartRxRing starts a continuous reception into the ring described by the IotUARTRxRing_t buffer.
+ * The DMA writes the ring and the callback is invoked with eUartRxRingData at half ring, at the
+ * end of the ring and when the line goes idle after new bytes. The data is read in place with
+ * iot_uart_rx_ring_peek and iot_uart_rx_ring_consume. iot_uart_read_sync and iot_uart_read_async
+ * return IOT_UART_BUSY until the ring is stopped by iot_uart_cancel or iot_uart_close.
+ * Bytes not consumed before the DMA comes back to them are lost, so the ring should hold at least
+ * twice the bytes received between two reads. After an error callback the ring has stopped and
+ * has to be cancelled and started again.
+ *
+ * @note eUartGetRxRingStats gets the receive ring counters.
+ * This request expects the buffer with size of IotUARTRxRingStats_t.
+ *
  * @param[in] pxUartPeripheral The peripheral handle returned in the open() call.
  * @param[in] xUartRequest The configuration request. Should be one of the values
  * from IotUARTIoctlRequest_t.
@@ -364,8 +407,12 @@ int32_t iot_uart_write_async( IotUARTHandle_t const pxUartPeripheral,
  *     - pxUartPeripheral is NULL
  *     - pxUartPeripheral is not opened yet
  *     - pucBuffer is NULL with requests which needs buffer
+ * - IOT_UART_BUSY, if
+ *     - eUartSetTxDma: a write is ongoing
+ *     - eUartStartRxRing: a read or the ring is ongoing
  * - IOT_UART_FUNCTION_NOT_SUPPORTED, if this board doesn't support this feature.
  *     - eUartSetConfig: specific configuration is not supported
+ *     - eUartSetTxDma, eUartStartRxRing: the port has no DMA channel for it
  */
 int32_t iot_uart_ioctl( IotUARTHandle_t const pxUartPeripheral,
                         IotUARTIoctlRequest_t xUartRequest,
@@ -403,6 +450,33 @@ int32_t iot_uart_cancel( IotUARTHandle_t const pxUartPeripheral );
  */
 int32_t iot_uart_close( IotUARTHandle_t const pxUartPeripheral );
 
+/**
+ * @brief Returns the oldest received bytes of the receive ring, without copying them.
+ *
+ * The bytes stay in the ring until iot_uart_rx_ring_consume. When the data runs past the end of the
+ * ring, only the bytes up to the end are returned and the next call returns the rest.
+ *
+ * @param[in] pxUartPeripheral The peripheral handle returned in the open() call.
+ * @param[out] ppucData Set to the first byte not consumed yet.
+ *
+ * @return The number of bytes at *ppucData, 0 if the ring is empty or not started.
+ */
+size_t iot_uart_rx_ring_peek( IotUARTHandle_t const pxUartPeripheral,
+                              const uint8_t ** ppucData );
+
+/**
+ * @brief Releases the first xBytes bytes of the receive ring to the DMA.
+ *
+ * @param[in] pxUartPeripheral The peripheral handle returned in the open() call.
+ * @param[in] xBytes The number of bytes processed, at most the bytes returned by iot_uart_rx_ring_peek.
+ *
+ * @return
+ * - IOT_UART_SUCCESS, on success
+ * - IOT_UART_INVALID_VALUE, if pxUartPeripheral is NULL or has no ring started.
+ */
+int32_t iot_uart_rx_ring_consume( IotUARTHandle_t const pxUartPeripheral,
+                                  size_t xBytes );
+
 
 /**
  * @}
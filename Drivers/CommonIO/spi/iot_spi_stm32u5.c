@@ -33,14 +33,23 @@
 #include "stm32u5xx_hal.h"
 #include "stm32u5xx_hal_spi.h"
 
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
 /* Main includes. */
 #include "iot_spi.h"
+#include "lowpower.h"
 
 /* Total number of SPI instances on this ST microcontroller. */
 #define IOT_SPI_BLOCKING_TIMEOUT    ( ( uint32_t ) 3000UL )
 #define IOT_SPI_CLOSED              ( ( uint8_t ) 0 )
 #define IOT_SPI_OPENED              ( ( uint8_t ) 1 )
 
+/* The queue is protected with critical sections, so the SPI interrupts must not be above
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY. */
+#define IOT_SPI_IRQ_PRIORITY        ( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY )
+
 typedef struct STM32_SPI_HalContext
 {
     SPI_HandleTypeDef * pxSpi;
@@ -54,6 +63,11 @@ typedef struct IotSPIDescriptor
     IotSPICallback_t xSpiCallback;               /* Callback function */
     void * pvUserContext;                        /* User context passed in callback */
     uint8_t sOpened;                             /* Bit flags to track different states. */
+    IotSPITransaction_t * pxQueueHead;           /* Queued transactions, not started yet */
+    IotSPITransaction_t * pxQueueTail;
+    IotSPITransaction_t * pxActive;              /* Queued transaction on the bus, NULL if the queue is idle */
+    const IotSPIDevice_t * pxCsDevice;           /* Device with its chip select asserted, NULL if none */
+    uint8_t ucDmaInhibit;                        /* 1 while a DMA transfer holds off STOP2 */
 } IotSPIDescriptor_t;
 /*-----------------------------------------------------------*/
 
@@ -200,6 +214,339 @@ static IotSPIDescriptor_t xSpi3 =
 
 static IotSPIHandle_t const pxSpis[] = { &xSpi1, &xSpi2, &xSpi3 };
 
+static void prvApplyConfig( SPI_HandleTypeDef * pxSpi,
+                            const IotSPIMasterConfig_t * pxConfig )
+{
+    uint32_t sysClkTmp = SystemCoreClock;
+    uint32_t preScaler = 0;
+    uint8_t divisor = 0;
+
+    /* NOTE: HAL API sends dummy data as the same data in the master buffer. So dummy data does not need to be set in config. */
+    if( pxConfig->eSetBitOrder == eSPIMSBFirst )
+    {
+        LL_SPI_SetTransferBitOrder( pxSpi->Instance, SPI_FIRSTBIT_MSB );
+    }
+    else
+    {
+        LL_SPI_SetTransferBitOrder( pxSpi->Instance, SPI_FIRSTBIT_LSB );
+    }
+
+    switch( pxConfig->eMode )
+    {
+        case eSPIMode0:
+            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_LOW );
+            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_1EDGE );
+            break;
+
+        case eSPIMode1:
+            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_LOW );
+            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_2EDGE );
+            break;
+
+        case eSPIMode2:
+            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_HIGH );
+            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_1EDGE );
+            break;
+
+        case eSPIMode3:
+            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_HIGH );
+            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_2EDGE );
+            break;
+
+        default:
+            break;
+    }
+
+    while( ( sysClkTmp > pxConfig->ulFreq ) && ( divisor < 7 ) )
+    {
+        divisor++;
+        sysClkTmp = ( sysClkTmp >> 1 );
+    }
+
+    preScaler = ( ( ( divisor & 0x4 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_2 ) |
+                ( ( ( divisor & 0x2 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_1 ) |
+                ( ( ( divisor & 0x1 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_0 );
+
+    LL_SPI_SetBaudRatePrescaler( pxSpi->Instance, preScaler );
+}
+/*-----------------------------------------------------------*/
+
+static void prvCsRelease( IotSPIHandle_t const pxSPIPeripheral )
+{
+    const IotSPIDevice_t * pxDevice = pxSPIPeripheral->pxCsDevice;
+
+    if( ( pxDevice != NULL ) && ( pxDevice->pvCsPort != NULL ) )
+    {
+        HAL_GPIO_WritePin( ( GPIO_TypeDef * ) pxDevice->pvCsPort, pxDevice->usCsPin,
+                           ( pxDevice->ucCsActiveHigh == 1 ) ? GPIO_PIN_RESET : GPIO_PIN_SET );
+    }
+
+    pxSPIPeripheral->pxCsDevice = NULL;
+}
+/*-----------------------------------------------------------*/
+
+/* GPDMA1 stops in STOP2, keep the board out of it until the DMA transfer ends or is aborted */
+static void prvDmaInhibit( IotSPIHandle_t const pxSPIPeripheral )
+{
+    if( __atomic_exchange_n( &( pxSPIPeripheral->ucDmaInhibit ), 1, __ATOMIC_RELAXED ) == 0 )
+    {
+        vLowPowerInhibit();
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvDmaRelease( IotSPIHandle_t const pxSPIPeripheral )
+{
+    if( __atomic_exchange_n( &( pxSPIPeripheral->ucDmaInhibit ), 0, __ATOMIC_RELAXED ) == 1 )
+    {
+        vLowPowerRelease();
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* Select the device of pxTransaction and start the transfer, by DMA if the handle has channels linked */
+static HAL_StatusTypeDef prvStartTransaction( IotSPIHandle_t const pxSPIPeripheral,
+                                              IotSPITransaction_t * pxTransaction )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
+    const IotSPIDevice_t * pxDevice = pxTransaction->pxDevice;
+
+    if( pxSPIPeripheral->pxCsDevice != pxDevice )
+    {
+        prvCsRelease( pxSPIPeripheral );
+    }
+
+    if( ( pxSPIPeripheral->xConfig.ulFreq != pxDevice->xConfig.ulFreq ) ||
+        ( pxSPIPeripheral->xConfig.eMode != pxDevice->xConfig.eMode ) ||
+        ( pxSPIPeripheral->xConfig.eSetBitOrder != pxDevice->xConfig.eSetBitOrder ) )
+    {
+        prvApplyConfig( pxSpi, &( pxDevice->xConfig ) );
+        pxSPIPeripheral->xConfig = pxDevice->xConfig;
+    }
+
+    if( ( pxSPIPeripheral->pxCsDevice == NULL ) && ( pxDevice->pvCsPort != NULL ) )
+    {
+        HAL_GPIO_WritePin( ( GPIO_TypeDef * ) pxDevice->pvCsPort, pxDevice->usCsPin,
+                           ( pxDevice->ucCsActiveHigh == 1 ) ? GPIO_PIN_SET : GPIO_PIN_RESET );
+    }
+
+    pxSPIPeripheral->pxCsDevice = pxDevice;
+
+    if( ( pxTransaction->pucTxBuffer != NULL ) && ( pxTransaction->pucRxBuffer != NULL ) )
+    {
+        if( ( pxSpi->hdmatx != NULL ) && ( pxSpi->hdmarx != NULL ) )
+        {
+            prvDmaInhibit( pxSPIPeripheral );
+            xHalStatus = HAL_SPI_TransmitReceive_DMA( pxSpi, pxTransaction->pucTxBuffer, pxTransaction->pucRxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+        else
+        {
+            xHalStatus = HAL_SPI_TransmitReceive_IT( pxSpi, pxTransaction->pucTxBuffer, pxTransaction->pucRxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+    }
+    else if( pxTransaction->pucTxBuffer != NULL )
+    {
+        if( pxSpi->hdmatx != NULL )
+        {
+            prvDmaInhibit( pxSPIPeripheral );
+            xHalStatus = HAL_SPI_Transmit_DMA( pxSpi, pxTransaction->pucTxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+        else
+        {
+            xHalStatus = HAL_SPI_Transmit_IT( pxSpi, pxTransaction->pucTxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+    }
+    else
+    {
+        if( pxSpi->hdmarx != NULL )
+        {
+            prvDmaInhibit( pxSPIPeripheral );
+            xHalStatus = HAL_SPI_Receive_DMA( pxSpi, pxTransaction->pucRxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+        else
+        {
+            xHalStatus = HAL_SPI_Receive_IT( pxSpi, pxTransaction->pucRxBuffer, ( uint16_t ) pxTransaction->xBytes );
+        }
+    }
+
+    if( xHalStatus != HAL_OK )
+    {
+        prvDmaRelease( pxSPIPeripheral );
+    }
+
+    return xHalStatus;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Start the next queued transaction if the bus is idle. Called in a critical section, returns the
+ * transactions which could not be started, linked by pxNext, for their callbacks to be invoked
+ * once the critical section is left.
+ */
+static IotSPITransaction_t * prvQueueRun( IotSPIHandle_t const pxSPIPeripheral )
+{
+    IotSPITransaction_t * pxTransaction = NULL;
+    IotSPITransaction_t * pxFailed = NULL;
+    IotSPITransaction_t * pxFailedTail = NULL;
+
+    while( ( pxSPIPeripheral->pxActive == NULL ) && ( pxSPIPeripheral->pxQueueHead != NULL ) )
+    {
+        pxTransaction = pxSPIPeripheral->pxQueueHead;
+        pxSPIPeripheral->pxQueueHead = pxTransaction->pxNext;
+
+        if( pxSPIPeripheral->pxQueueHead == NULL )
+        {
+            pxSPIPeripheral->pxQueueTail = NULL;
+        }
+
+        pxTransaction->pxNext = NULL;
+        pxSPIPeripheral->pxActive = pxTransaction;
+
+        if( prvStartTransaction( pxSPIPeripheral, pxTransaction ) != HAL_OK )
+        {
+            prvCsRelease( pxSPIPeripheral );
+            pxSPIPeripheral->pxActive = NULL;
+
+            if( pxFailedTail == NULL )
+            {
+                pxFailed = pxTransaction;
+            }
+            else
+            {
+                pxFailedTail->pxNext = pxTransaction;
+            }
+
+            pxFailedTail = pxTransaction;
+        }
+    }
+
+    return pxFailed;
+}
+/*-----------------------------------------------------------*/
+
+static void prvNotifyTransactions( IotSPITransaction_t * pxList,
+                                   IotSPITransactionStatus_t xStatus )
+{
+    IotSPITransaction_t * pxNext = NULL;
+
+    while( pxList != NULL )
+    {
+        /* The callback may queue the transaction again */
+        pxNext = pxList->pxNext;
+        pxList->pxNext = NULL;
+
+        if( pxList->xCallback != NULL )
+        {
+            pxList->xCallback( xStatus, pxList->pvUserContext );
+        }
+
+        pxList = pxNext;
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* Stop the queue, returns the active and queued transactions in order, NULL if there were none */
+static IotSPITransaction_t * prvQueueCancel( IotSPIHandle_t const pxSPIPeripheral )
+{
+    IotSPITransaction_t * pxList = NULL;
+    IRQn_Type eIrqNum = pxSPIPeripheral->pxSpiContext->eIrqNum;
+    UBaseType_t uxContext;
+
+    /* No completion can run while the transfer is aborted */
+    HAL_NVIC_DisableIRQ( eIrqNum );
+
+    uxContext = taskENTER_CRITICAL_FROM_ISR();
+
+    if( pxSPIPeripheral->pxActive != NULL )
+    {
+        pxList = pxSPIPeripheral->pxActive;
+        pxList->pxNext = pxSPIPeripheral->pxQueueHead;
+    }
+    else
+    {
+        pxList = pxSPIPeripheral->pxQueueHead;
+    }
+
+    pxSPIPeripheral->pxQueueHead = NULL;
+    pxSPIPeripheral->pxQueueTail = NULL;
+
+    taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+    if( pxSPIPeripheral->pxActive != NULL )
+    {
+        ( void ) HAL_SPI_Abort( pxSPIPeripheral->pxSpiContext->pxSpi );
+    }
+
+    prvDmaRelease( pxSPIPeripheral );
+    prvCsRelease( pxSPIPeripheral );
+    pxSPIPeripheral->pxActive = NULL;
+
+    HAL_NVIC_ClearPendingIRQ( eIrqNum );
+    HAL_NVIC_EnableIRQ( eIrqNum );
+
+    return pxList;
+}
+/*-----------------------------------------------------------*/
+
+/* Completion of a transfer, from the SPI interrupt */
+static void prvTransferDone( IotSPIHandle_t const pxSPIPeripheral,
+                             IotSPITransactionStatus_t xStatus )
+{
+    IotSPITransaction_t * pxDone = pxSPIPeripheral->pxActive;
+    IotSPITransaction_t * pxFailed = NULL;
+    UBaseType_t uxContext;
+
+    prvDmaRelease( pxSPIPeripheral );
+
+    if( pxDone == NULL )
+    {
+        if( pxSPIPeripheral->xSpiCallback != NULL )
+        {
+            pxSPIPeripheral->xSpiCallback( xStatus, pxSPIPeripheral->pvUserContext );
+        }
+    }
+    else
+    {
+        if( ( xStatus != eSPISuccess ) || ( ( pxDone->ulFlags & IOT_SPI_TRANSACTION_KEEP_CS ) == 0 ) )
+        {
+            prvCsRelease( pxSPIPeripheral );
+        }
+
+        /* pxActive stays set during the callback, so a transaction queued by it goes after the
+         * ones already queued. */
+        if( pxDone->xCallback != NULL )
+        {
+            pxDone->xCallback( xStatus, pxDone->pvUserContext );
+        }
+
+        uxContext = taskENTER_CRITICAL_FROM_ISR();
+        pxSPIPeripheral->pxActive = NULL;
+        pxFailed = prvQueueRun( pxSPIPeripheral );
+        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+        prvNotifyTransactions( pxFailed, eSPITransferError );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static IotSPIHandle_t prvGetDescriptor( SPI_HandleTypeDef * hspi )
+{
+    IotSPIHandle_t xHandle = NULL;
+    uint32_t i = 0;
+
+    for( ; i < sizeof( pxSpis ) / sizeof( IotSPIHandle_t ); i++ )
+    {
+        if( pxSpis[ i ]->pxSpiContext->pxSpi == hspi )
+        {
+            xHandle = pxSpis[ i ];
+            break;
+        }
+    }
+
+    return xHandle;
+}
+
 /*--------------------API Implementation---------------------*/
 
 IotSPIHandle_t iot_spi_open( int32_t lSpiInstance )
@@ -259,63 +606,13 @@ int32_t iot_spi_ioctl( IotSPIHandle_t const pxSPIPeripheral,
         {
             case eSPISetMasterConfig:
 
-                if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY )
+                if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY ) || ( pxSPIPeripheral->pxActive != NULL ) )
                 {
                     lError = IOT_SPI_BUS_BUSY;
                 }
                 else
                 {
-                    /* NOTE: HAL API sends dummy data as the same data in the master buffer. So dummy data does not need to be set in config. */
-                    if( ( ( IotSPIMasterConfig_t * ) pvBuffer )->eSetBitOrder == eSPIMSBFirst )
-                    {
-                        LL_SPI_SetTransferBitOrder( pxSpi->Instance, SPI_FIRSTBIT_MSB );
-                    }
-                    else
-                    {
-                        LL_SPI_SetTransferBitOrder( pxSpi->Instance, SPI_FIRSTBIT_LSB );
-                    }
-
-                    switch( ( ( IotSPIMasterConfig_t * ) pvBuffer )->eMode )
-                    {
-                        case eSPIMode0:
-                            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_LOW );
-                            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_1EDGE );
-                            break;
-
-                        case eSPIMode1:
-                            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_LOW );
-                            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_2EDGE );
-                            break;
-
-                        case eSPIMode2:
-                            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_HIGH );
-                            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_1EDGE );
-                            break;
-
-                        case eSPIMode3:
-                            LL_SPI_SetClockPolarity( pxSpi->Instance, SPI_POLARITY_HIGH );
-                            LL_SPI_SetClockPhase( pxSpi->Instance, SPI_PHASE_2EDGE );
-                            break;
-
-                        default:
-                            break;
-                    }
-
-                    uint32_t sysClkTmp = SystemCoreClock;
-                    uint32_t preScaler = 0;
-                    uint8_t divisor = 0;
-
-                    while( ( sysClkTmp > ( ( IotSPIMasterConfig_t * ) pvBuffer )->ulFreq ) && ( divisor < 7 ) )
-                    {
-                        divisor++;
-                        sysClkTmp = ( sysClkTmp >> 1 );
-                    }
-
-                    preScaler = ( ( ( divisor & 0x4 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_2 ) |
-                                ( ( ( divisor & 0x2 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_1 ) |
-                                ( ( ( divisor & 0x1 ) == 0 ) ? 0x0 : SPI_CFG1_MBR_0 );
-
-                    LL_SPI_SetBaudRatePrescaler( pxSpi->Instance, preScaler );
+                    prvApplyConfig( pxSpi, ( IotSPIMasterConfig_t * ) pvBuffer );
                     lError = IOT_SPI_SUCCESS;
                     pxSPIPeripheral->xConfig = *( IotSPIMasterConfig_t * ) pvBuffer;
                 }
@@ -375,7 +672,7 @@ int32_t iot_spi_read_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -408,13 +705,13 @@ int32_t iot_spi_read_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
+            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
             HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
 
             if( HAL_SPI_Receive_IT( pxSpi, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
@@ -447,7 +744,7 @@ int32_t iot_spi_write_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -480,13 +777,13 @@ int32_t iot_spi_write_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
+            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
             HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
 
             if( HAL_SPI_Transmit_IT( pxSpi, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
@@ -520,7 +817,7 @@ int32_t iot_spi_transfer_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -554,13 +851,13 @@ int32_t iot_spi_transfer_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX ) || ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
+            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
             HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
 
             if( HAL_SPI_TransmitReceive_IT( pxSpi, pvTxBuffer, pvRxBuffer, ( uint16_t ) xBytes ) != HAL_OK )
@@ -586,6 +883,8 @@ int32_t iot_spi_close( IotSPIHandle_t const pxSPIPeripheral )
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
+        prvNotifyTransactions( prvQueueCancel( pxSPIPeripheral ), eSPITransferError );
+
         if( HAL_SPI_Abort( pxSpi ) != HAL_OK )
         {
             lError = IOT_SPI_BUS_BUSY;
@@ -610,7 +909,12 @@ int32_t iot_spi_cancel( IotSPIHandle_t const pxSPIPeripheral )
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_READY )
+        if( ( pxSPIPeripheral->pxActive != NULL ) || ( pxSPIPeripheral->pxQueueHead != NULL ) )
+        {
+            prvNotifyTransactions( prvQueueCancel( pxSPIPeripheral ), eSPITransferError );
+            lError = IOT_SPI_SUCCESS;
+        }
+        else if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_READY )
         {
             lError = IOT_SPI_NOTHING_TO_CANCEL;
         }
@@ -624,70 +928,106 @@ int32_t iot_spi_cancel( IotSPIHandle_t const pxSPIPeripheral )
 }
 /*-----------------------------------------------------------*/
 
-void HAL_SPI_TxRxCpltCallback( SPI_HandleTypeDef * hspi )
+int32_t iot_spi_queue_transaction( IotSPIHandle_t const pxSPIPeripheral,
+                                   IotSPITransaction_t * const pxTransaction )
 {
-    if( hspi->Instance == SPI1 )
+    int32_t lError = IOT_SPI_SUCCESS;
+    IotSPITransaction_t * pxFailed = NULL;
+    UBaseType_t uxContext;
+
+    if( ( pxSPIPeripheral == NULL ) || ( pxSPIPeripheral->sOpened == IOT_SPI_CLOSED ) )
     {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
+        lError = IOT_SPI_INVALID_VALUE;
     }
-    else if( hspi->Instance == SPI2 )
+    else if( ( pxTransaction == NULL ) || ( pxTransaction->pxDevice == NULL ) || ( pxTransaction->xBytes == 0 ) ||
+             ( ( pxTransaction->pucTxBuffer == NULL ) && ( pxTransaction->pucRxBuffer == NULL ) ) )
     {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
+        lError = IOT_SPI_INVALID_VALUE;
     }
-    else if( hspi->Instance == SPI3 )
+    else
     {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
+        SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
+
+        pxTransaction->pxNext = NULL;
+
+        /* Also called from transaction callbacks, in the SPI interrupt */
+        uxContext = taskENTER_CRITICAL_FROM_ISR();
+
+        if( ( pxSPIPeripheral->pxActive == NULL ) && ( HAL_SPI_GetState( pxSpi ) != HAL_SPI_STATE_READY ) )
+        {
+            lError = IOT_SPI_BUS_BUSY;
+        }
+        else
+        {
+            if( pxSPIPeripheral->pxQueueTail == NULL )
+            {
+                pxSPIPeripheral->pxQueueHead = pxTransaction;
+            }
+            else
+            {
+                pxSPIPeripheral->pxQueueTail->pxNext = pxTransaction;
+            }
+
+            pxSPIPeripheral->pxQueueTail = pxTransaction;
+
+            if( pxSPIPeripheral->pxActive == NULL )
+            {
+                HAL_NVIC_SetPriority( pxSPIPeripheral->pxSpiContext->eIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
+                HAL_NVIC_EnableIRQ( pxSPIPeripheral->pxSpiContext->eIrqNum );
+
+                pxFailed = prvQueueRun( pxSPIPeripheral );
+            }
+        }
+
+        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+
+        prvNotifyTransactions( pxFailed, eSPITransferError );
     }
+
+    return lError;
 }
 /*-----------------------------------------------------------*/
 
-void HAL_SPI_TxCpltCallback( SPI_HandleTypeDef * hspi )
+void HAL_SPI_TxRxCpltCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
+    IotSPIHandle_t xHandle = prvGetDescriptor( hspi );
+
+    if( xHandle != NULL )
     {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
+        prvTransferDone( xHandle, eSPISuccess );
     }
-    else if( hspi->Instance == SPI3 )
+}
+/*-----------------------------------------------------------*/
+
+void HAL_SPI_TxCpltCallback( SPI_HandleTypeDef * hspi )
+{
+    IotSPIHandle_t xHandle = prvGetDescriptor( hspi );
+
+    if( xHandle != NULL )
     {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
+        prvTransferDone( xHandle, eSPISuccess );
     }
 }
 /*-----------------------------------------------------------*/
 
 void HAL_SPI_RxCpltCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
+    IotSPIHandle_t xHandle = prvGetDescriptor( hspi );
+
+    if( xHandle != NULL )
     {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
+        prvTransferDone( xHandle, eSPISuccess );
     }
 }
 /*-----------------------------------------------------------*/
 
 void HAL_SPI_ErrorCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPITransferError, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPITransferError, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
+    IotSPIHandle_t xHandle = prvGetDescriptor( hspi );
+
+    if( xHandle != NULL )
     {
-        xSpi3.xSpiCallback( eSPITransferError, xSpi3.pvUserContext );
+        prvTransferDone( xHandle, eSPITransferError );
     }
 }
 /*-----------------------------------------------------------*/
@@ -73,4 +73,22 @@ TEST_GROUP_RUNNER( Common_IO )
             RUN_TEST_GROUP( TEST_IOT_SPI );
         }
     #endif
+
+    #if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+        #if IOT_TEST_COMMON_IO_UART_SUPPORTED >= 1
+            for( i = 0; i < IOT_TEST_COMMON_IO_UART_SUPPORTED; i++ )
+            {
+                SET_TEST_IOT_UART_CONFIG( i );
+                RUN_TEST_GROUP( TEST_IOT_UART_BENCH );
+            }
+        #endif
+
+        #if IOT_TEST_COMMON_IO_SPI_SUPPORTED >= 1
+            for( i = 0; i < IOT_TEST_COMMON_IO_SPI_SUPPORTED; i++ )
+            {
+                SET_TEST_IOT_SPI_CONFIG( i );
+                RUN_TEST_GROUP( TEST_IOT_SPI_BENCH );
+            }
+        #endif
+    #endif /* if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
 }
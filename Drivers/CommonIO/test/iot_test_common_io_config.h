@@ -69,4 +69,13 @@ static const uint32_t spiIotSpitBitOrder[ SPI_TEST_SET ] = { eSPIMSBFirst };
 static const uint32_t spiIotFrequency[ SPI_TEST_SET ] = { 500000 };
 static const uint32_t spiIotDummyValue[ SPI_TEST_SET ] = { 0 };
 
+/*------------------------Benchmarks------------------------*/
+
+/* Runs the throughput benchmarks of test_iot_bench.c after the functional
+ * tests, for every UART and SPI test set enabled above.
+ */
+#ifndef IOT_TEST_COMMON_IO_BENCHMARK
+    #define IOT_TEST_COMMON_IO_BENCHMARK    0
+#endif
+
 #endif /* ifndef _TEST_IOT_CONFIG_H_ */
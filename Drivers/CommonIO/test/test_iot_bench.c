@@ -0,0 +1,456 @@
+/*
+ * FreeRTOS Common IO V0.1.3
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/*******************************************************************************
+ * @file test_iot_bench.c
+ * @brief Throughput Benchmarks - SPI and UART
+ *
+ * Each test sweeps the transfer sizes of xBenchSizes over every transfer mode
+ * and prints one line per point:
+ *
+ * BENCH,<bus>,<mode>,<bytes>,<iterations>,<bytes_per_s>,<cpu_pct>,<lat_avg_ns>,<lat_max_ns>
+ *
+ * - bytes_per_s: payload bytes over the elapsed DWT cycles of the point.
+ * - cpu_pct: share of the FreeRTOS run time counter not spent in the idle task.
+ *   The counter has a 32 us resolution, so short points are approximate.
+ * - lat_avg_ns / lat_max_ns: completion interrupt to benchmark task wakeup,
+ *   0 for the synchronous modes.
+ *
+ * The SPI benchmark does not need any connection, the received data is not
+ * checked. The UART benchmark only transmits.
+ *******************************************************************************
+ */
+
+/* Standard includes */
+#include <stdio.h>
+#include <string.h>
+
+/* Test includes */
+#include "unity.h"
+#include "unity_fixture.h"
+
+/* Driver includes */
+#include "iot_spi.h"
+#include "iot_uart.h"
+#include "iot_test_common_io_internal.h"
+
+/* FreeRTOS includes */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/*-----------------------------------------------------------*/
+/* Test Defines */
+#define testIotBENCH_SEMAPHORE_DELAY    pdMS_TO_TICKS( 3000 )
+#define testIotBENCH_MAX_SIZE           ( 4096 )
+#define testIotBENCH_LINE_LENGTH        ( 96 )
+
+/* Payload moved for each point, the iteration count follows from it */
+#ifndef testIotBENCH_BYTES_PER_POINT
+    #define testIotBENCH_BYTES_PER_POINT    ( 8192 )
+#endif
+#define testIotBENCH_MIN_ITERATIONS     ( 4 )
+
+/*-----------------------------------------------------------*/
+/* Static Globals */
+/*-----------------------------------------------------------*/
+static const size_t xBenchSizes[] = { 1, 16, 64, 256, 1024, testIotBENCH_MAX_SIZE };
+
+static uint8_t ucBenchTxBuffer[ testIotBENCH_MAX_SIZE ];
+static uint8_t ucBenchRxBuffer[ testIotBENCH_MAX_SIZE ];
+
+static SemaphoreHandle_t xBenchDoneSemaphore = NULL;
+static StaticSemaphore_t xBenchDoneSemaphoreBuffer;
+
+/* DWT cycle count latched by the completion callbacks */
+static volatile uint32_t ulBenchDoneCycles = 0;
+
+/* Measurements of one point */
+typedef struct
+{
+    uint32_t ulStartCycles;
+    uint32_t ulStartRunTime;
+    uint32_t ulStartIdleTime;
+    uint32_t ulLatencySamples;
+    uint64_t ullLatencyTotalCycles;
+    uint32_t ulLatencyMaxCycles;
+} BenchPoint_t;
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchPointStart( BenchPoint_t * pxPoint )
+{
+    memset( pxPoint, 0, sizeof( BenchPoint_t ) );
+
+    pxPoint->ulStartRunTime = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE();
+    pxPoint->ulStartIdleTime = ( uint32_t ) ulTaskGetIdleRunTimeCounter();
+    pxPoint->ulStartCycles = DWT->CYCCNT;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Wait for the completion callback and account for its wakeup latency */
+static void prvBenchWaitDone( BenchPoint_t * pxPoint )
+{
+    BaseType_t xTaken = xSemaphoreTake( xBenchDoneSemaphore, testIotBENCH_SEMAPHORE_DELAY );
+    uint32_t ulLatencyCycles = DWT->CYCCNT - ulBenchDoneCycles;
+
+    TEST_ASSERT_EQUAL( pdTRUE, xTaken );
+
+    pxPoint->ulLatencySamples++;
+    pxPoint->ullLatencyTotalCycles += ulLatencyCycles;
+
+    if( ulLatencyCycles > pxPoint->ulLatencyMaxCycles )
+    {
+        pxPoint->ulLatencyMaxCycles = ulLatencyCycles;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchPointPrint( const BenchPoint_t * pxPoint,
+                                const char * pcBus,
+                                const char * pcMode,
+                                size_t xBytes,
+                                uint32_t ulIterations )
+{
+    char cLine[ testIotBENCH_LINE_LENGTH ];
+    uint32_t ulCycles = DWT->CYCCNT - pxPoint->ulStartCycles;
+    uint32_t ulRunTime = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE() - pxPoint->ulStartRunTime;
+    uint32_t ulIdleTime = ( uint32_t ) ulTaskGetIdleRunTimeCounter() - pxPoint->ulStartIdleTime;
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000UL;
+    uint32_t ulBytesPerSecond = 0;
+    uint32_t ulCpuPercent = 100;
+    uint32_t ulLatencyAvgNs = 0;
+    uint32_t ulLatencyMaxNs = 0;
+
+    if( ulCycles > 0 )
+    {
+        ulBytesPerSecond = ( uint32_t ) ( ( ( uint64_t ) xBytes * ulIterations * SystemCoreClock ) / ulCycles );
+    }
+
+    if( ( ulRunTime > 0 ) && ( ulIdleTime <= ulRunTime ) )
+    {
+        ulCpuPercent = 100 - ( uint32_t ) ( ( ( uint64_t ) ulIdleTime * 100 ) / ulRunTime );
+    }
+
+    if( ( pxPoint->ulLatencySamples > 0 ) && ( ulCyclesPerUs > 0 ) )
+    {
+        ulLatencyAvgNs = ( uint32_t ) ( ( pxPoint->ullLatencyTotalCycles * 1000 ) /
+                                        ( ( uint64_t ) pxPoint->ulLatencySamples * ulCyclesPerUs ) );
+        ulLatencyMaxNs = ( uint32_t ) ( ( ( uint64_t ) pxPoint->ulLatencyMaxCycles * 1000 ) / ulCyclesPerUs );
+    }
+
+    ( void ) snprintf( cLine, sizeof( cLine ), "BENCH,%s,%s,%u,%lu,%lu,%lu,%lu,%lu",
+                       pcBus, pcMode, ( unsigned int ) xBytes,
+                       ulIterations, ulBytesPerSecond, ulCpuPercent,
+                       ulLatencyAvgNs, ulLatencyMaxNs );
+    UnityPrint( cLine );
+    UNITY_PRINT_EOL();
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvBenchIterations( size_t xBytes )
+{
+    uint32_t ulIterations = testIotBENCH_BYTES_PER_POINT / xBytes;
+
+    return ( ulIterations < testIotBENCH_MIN_ITERATIONS ) ? testIotBENCH_MIN_ITERATIONS : ulIterations;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchPrintHeader( void )
+{
+    char cLine[ testIotBENCH_LINE_LENGTH ];
+
+    ( void ) snprintf( cLine, sizeof( cLine ), "BENCH,core_hz,%lu", SystemCoreClock );
+    UnityPrint( cLine );
+    UNITY_PRINT_EOL();
+    UnityPrint( "BENCH,bus,mode,bytes,iterations,bytes_per_s,cpu_pct,lat_avg_ns,lat_max_ns" );
+    UNITY_PRINT_EOL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchSpiCallback( IotSPITransactionStatus_t xStatus,
+                                 void * pvUserContext )
+{
+    ( void ) xStatus;
+    ( void ) pvUserContext;
+
+    ulBenchDoneCycles = DWT->CYCCNT;
+    xSemaphoreGiveFromISR( xBenchDoneSemaphore, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchUartCallback( IotUARTOperationStatus_t xStatus,
+                                  void * pvUserContext )
+{
+    ( void ) pvUserContext;
+
+    if( xStatus == eUartWriteCompleted )
+    {
+        ulBenchDoneCycles = DWT->CYCCNT;
+        xSemaphoreGiveFromISR( xBenchDoneSemaphore, NULL );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Define Test Groups. */
+TEST_GROUP( TEST_IOT_SPI_BENCH );
+TEST_GROUP( TEST_IOT_UART_BENCH );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Setup function called before each test in this group is executed.
+ */
+TEST_SETUP( TEST_IOT_SPI_BENCH )
+{
+    xBenchDoneSemaphore = xSemaphoreCreateBinaryStatic( &xBenchDoneSemaphoreBuffer );
+    TEST_ASSERT_NOT_EQUAL( NULL, xBenchDoneSemaphore );
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    memset( ucBenchTxBuffer, 0xA5, sizeof( ucBenchTxBuffer ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Tear down function called after each test in this group is executed.
+ */
+TEST_TEAR_DOWN( TEST_IOT_SPI_BENCH )
+{
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Setup function called before each test in this group is executed.
+ */
+TEST_SETUP( TEST_IOT_UART_BENCH )
+{
+    xBenchDoneSemaphore = xSemaphoreCreateBinaryStatic( &xBenchDoneSemaphoreBuffer );
+    TEST_ASSERT_NOT_EQUAL( NULL, xBenchDoneSemaphore );
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    memset( ucBenchTxBuffer, 0x55, sizeof( ucBenchTxBuffer ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Tear down function called after each test in this group is executed.
+ */
+TEST_TEAR_DOWN( TEST_IOT_UART_BENCH )
+{
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Function to define which tests to execute as part of this group.
+ */
+TEST_GROUP_RUNNER( TEST_IOT_SPI_BENCH )
+{
+    RUN_TEST_CASE( TEST_IOT_SPI_BENCH, IotSPI_Bench_Throughput );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Function to define which tests to execute as part of this group.
+ */
+TEST_GROUP_RUNNER( TEST_IOT_UART_BENCH )
+{
+    RUN_TEST_CASE( TEST_IOT_UART_BENCH, IotUART_Bench_Throughput );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Full duplex transfers, with the sync, interrupt driven async and queued
+ * modes. Queued transactions run on DMA when the instance has DMA channels linked.
+ */
+TEST( TEST_IOT_SPI_BENCH, IotSPI_Bench_Throughput )
+{
+    IotSPIHandle_t xSPIHandle;
+    IotSPIDevice_t xDevice = { 0 };
+    IotSPITransaction_t xTransaction;
+    BenchPoint_t xPoint;
+    int32_t lRetVal;
+
+    xSPIHandle = iot_spi_open( ultestIotSpiInstance );
+    TEST_ASSERT_NOT_EQUAL( NULL, xSPIHandle );
+
+    if( TEST_PROTECT() )
+    {
+        /* No chip select, the device only carries the current bus configuration */
+        lRetVal = iot_spi_ioctl( xSPIHandle, eSPIGetMasterConfig, &xDevice.xConfig );
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+
+        iot_spi_set_callback( xSPIHandle, prvBenchSpiCallback, NULL );
+
+        prvBenchPrintHeader();
+
+        for( size_t i = 0; i < ( sizeof( xBenchSizes ) / sizeof( xBenchSizes[ 0 ] ) ); i++ )
+        {
+            size_t xBytes = xBenchSizes[ i ];
+            uint32_t ulIterations = prvBenchIterations( xBytes );
+
+            prvBenchPointStart( &xPoint );
+
+            for( uint32_t j = 0; j < ulIterations; j++ )
+            {
+                lRetVal = iot_spi_transfer_sync( xSPIHandle, ucBenchTxBuffer, ucBenchRxBuffer, xBytes );
+                TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+            }
+
+            prvBenchPointPrint( &xPoint, "spi", "sync", xBytes, ulIterations );
+
+            prvBenchPointStart( &xPoint );
+
+            for( uint32_t j = 0; j < ulIterations; j++ )
+            {
+                lRetVal = iot_spi_transfer_async( xSPIHandle, ucBenchTxBuffer, ucBenchRxBuffer, xBytes );
+                TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                prvBenchWaitDone( &xPoint );
+            }
+
+            prvBenchPointPrint( &xPoint, "spi", "async", xBytes, ulIterations );
+
+            prvBenchPointStart( &xPoint );
+
+            for( uint32_t j = 0; j < ulIterations; j++ )
+            {
+                memset( &xTransaction, 0, sizeof( xTransaction ) );
+                xTransaction.pxDevice = &xDevice;
+                xTransaction.pucTxBuffer = ucBenchTxBuffer;
+                xTransaction.pucRxBuffer = ucBenchRxBuffer;
+                xTransaction.xBytes = xBytes;
+                xTransaction.xCallback = prvBenchSpiCallback;
+
+                lRetVal = iot_spi_queue_transaction( xSPIHandle, &xTransaction );
+                TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                prvBenchWaitDone( &xPoint );
+            }
+
+            prvBenchPointPrint( &xPoint, "spi", "queue", xBytes, ulIterations );
+        }
+    }
+
+    lRetVal = iot_spi_close( xSPIHandle );
+    TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Transmit only, sync and async writes sent by interrupts, then by DMA.
+ * The DMA modes are skipped on ports without a transmit DMA channel.
+ */
+TEST( TEST_IOT_UART_BENCH, IotUART_Bench_Throughput )
+{
+    static const char * const pcSyncModes[] = { "sync_it", "sync_dma" };
+    static const char * const pcAsyncModes[] = { "async_it", "async_dma" };
+    IotUARTHandle_t xUartHandle;
+    BenchPoint_t xPoint;
+    uint8_t ucTxDma;
+    int32_t lRetVal;
+
+    xUartHandle = iot_uart_open( uctestIotUartPort );
+    TEST_ASSERT_NOT_EQUAL( NULL, xUartHandle );
+
+    if( TEST_PROTECT() )
+    {
+        iot_uart_set_callback( xUartHandle, prvBenchUartCallback, NULL );
+
+        prvBenchPrintHeader();
+
+        for( uint8_t ucDma = 0; ucDma < 2; ucDma++ )
+        {
+            lRetVal = iot_uart_ioctl( xUartHandle, eUartSetTxDma, &ucDma );
+
+            /* Ports without a transmit DMA channel always send by interrupts */
+            if( lRetVal == IOT_UART_FUNCTION_NOT_SUPPORTED )
+            {
+                if( ucDma == 1 )
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lRetVal );
+            }
+
+            for( size_t i = 0; i < ( sizeof( xBenchSizes ) / sizeof( xBenchSizes[ 0 ] ) ); i++ )
+            {
+                size_t xBytes = xBenchSizes[ i ];
+                uint32_t ulIterations = prvBenchIterations( xBytes );
+
+                prvBenchPointStart( &xPoint );
+
+                for( uint32_t j = 0; j < ulIterations; j++ )
+                {
+                    lRetVal = iot_uart_write_sync( xUartHandle, ucBenchTxBuffer, xBytes );
+                    TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lRetVal );
+                }
+
+                prvBenchPointPrint( &xPoint, "uart", pcSyncModes[ ucDma ], xBytes, ulIterations );
+
+                /* DMA sync writes complete through the callback as well */
+                ( void ) xSemaphoreTake( xBenchDoneSemaphore, 0 );
+
+                prvBenchPointStart( &xPoint );
+
+                for( uint32_t j = 0; j < ulIterations; j++ )
+                {
+                    lRetVal = iot_uart_write_async( xUartHandle, ucBenchTxBuffer, xBytes );
+                    TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lRetVal );
+                    prvBenchWaitDone( &xPoint );
+                }
+
+                prvBenchPointPrint( &xPoint, "uart", pcAsyncModes[ ucDma ], xBytes, ulIterations );
+            }
+        }
+
+        /* Leave the port in its default mode */
+        ucTxDma = 0;
+        ( void ) iot_uart_ioctl( xUartHandle, eUartSetTxDma, &ucTxDma );
+    }
+
+    lRetVal = iot_uart_close( xUartHandle );
+    TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lRetVal );
+}
+
+/*-----------------------------------------------------------*/
@@ -40,6 +40,10 @@
 #include "FreeRTOS.h"
 #include "semphr.h"
 
+#include "lowpower.h"
+
+#include <string.h>
+
 /**
  * @brief STM UART Descriptor.
  *
@@ -53,6 +57,20 @@ typedef struct IotUARTDescriptor
     SemaphoreHandle_t xSemphr;
     StaticSemaphore_t xSemphrBuffer;
     uint8_t sOpened;
+    DMA_HandleTypeDef xDmaRx;     /**< Receive ring channel, Instance is NULL if the port has none. */
+    DMA_HandleTypeDef xDmaTx;     /**< Transmit channel, Instance is NULL if the port has none. */
+    IRQn_Type eDmaRxIrqNum;
+    IRQn_Type eDmaTxIrqNum;
+    DMA_QListTypeDef xRxQueue;    /**< Circular list of the receive ring, one node. */
+    DMA_NodeTypeDef xRxNode;
+    uint8_t * pucRing;            /**< Receive ring memory, NULL while the ring is stopped. */
+    uint32_t ulRingSize;
+    uint32_t ulRingPos;           /**< DMA write offset at the last receive event. */
+    uint32_t ulRingTail;          /**< Offset of the oldest byte not consumed yet. */
+    uint32_t ulRingCount;         /**< Number of bytes not consumed yet. */
+    IotUARTRxRingStats_t xRingStats;
+    uint8_t ucTxDma;              /**< 1 when writes use xDmaTx. */
+    uint8_t ucTxInhibit;          /**< 1 while a DMA write holds off STOP2, GPDMA1 stops in it. */
 } IotUARTDescriptor_t;
 
 
@@ -63,6 +81,17 @@ typedef struct IotUARTDescriptor
 #define IOT_UART_CLOSED              ( ( uint8_t ) 0 )
 #define IOT_UART_OPENED              ( ( uint8_t ) 1 )
 
+/*
+ * The completion callbacks give a semaphore and the ring functions use critical sections, so the
+ * UART and DMA interrupts must not be above configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ */
+#define IOT_UART_IRQ_PRIORITY        ( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY )
+
+/* Largest ring, the GPDMA block size is 16 bits and the half transfer event needs an even size */
+#define IOT_UART_RING_SIZE_MAX       ( 0xFFFEUL )
+
+#define IOT_UART_LINE_ERROR_FLAGS    ( USART_ISR_FE | USART_ISR_NE | USART_ISR_PE )
+
 /**
  * @brief Statically initialized map of STM UART Handle for all 5 ports.
  *
@@ -209,6 +238,18 @@ static IotUARTDescriptor_t xUart1 =
     .xUartCallback         = NULL,
     .xSemphr               = NULL,
     .sOpened               = IOT_UART_CLOSED,
+    .xDmaRx                =
+    {
+        .Instance     = GPDMA1_Channel0,
+        .Init.Request = GPDMA1_REQUEST_USART2_RX,
+    },
+    .eDmaRxIrqNum          = GPDMA1_Channel0_IRQn,
+    .xDmaTx                =
+    {
+        .Instance     = GPDMA1_Channel1,
+        .Init.Request = GPDMA1_REQUEST_USART2_TX,
+    },
+    .eDmaTxIrqNum          = GPDMA1_Channel1_IRQn,
 };
 
 static IotUARTDescriptor_t xUart2 =
@@ -219,6 +260,12 @@ static IotUARTDescriptor_t xUart2 =
     .xUartCallback         = NULL,
     .xSemphr               = NULL,
     .sOpened               = IOT_UART_CLOSED,
+    .xDmaRx                =
+    {
+        .Instance     = GPDMA1_Channel2,
+        .Init.Request = GPDMA1_REQUEST_USART3_RX,
+    },
+    .eDmaRxIrqNum          = GPDMA1_Channel2_IRQn,
 };
 
 static IotUARTDescriptor_t xUart3 =
@@ -229,6 +276,18 @@ static IotUARTDescriptor_t xUart3 =
     .xUartCallback         = NULL,
     .xSemphr               = NULL,
     .sOpened               = IOT_UART_CLOSED,
+    .xDmaRx                =
+    {
+        .Instance     = GPDMA1_Channel8,
+        .Init.Request = GPDMA1_REQUEST_UART4_RX,
+    },
+    .eDmaRxIrqNum          = GPDMA1_Channel8_IRQn,
+    .xDmaTx                =
+    {
+        .Instance     = GPDMA1_Channel9,
+        .Init.Request = GPDMA1_REQUEST_UART4_TX,
+    },
+    .eDmaTxIrqNum          = GPDMA1_Channel9_IRQn,
 };
 
 static IotUARTDescriptor_t xUart4 =
@@ -239,10 +298,244 @@ static IotUARTDescriptor_t xUart4 =
     .xUartCallback         = NULL,
     .xSemphr               = NULL,
     .sOpened               = IOT_UART_CLOSED,
+    .xDmaRx                =
+    {
+        .Instance     = GPDMA1_Channel10,
+        .Init.Request = GPDMA1_REQUEST_UART5_RX,
+    },
+    .eDmaRxIrqNum          = GPDMA1_Channel10_IRQn,
 };
 
 static IotUARTHandle_t const pxUarts[] = { &xUart0, &xUart1, &xUart2, &xUart3, &xUart4 };
 
+/*
+ * GPDMA1 channels 3 to 7 and 11 to 15 belong to other drivers, the console driver of USART1 has
+ * channels 6 and 7. USART3 and UART5 only get a receive channel.
+ */
+
+static int32_t prvTxDmaEnable( IotUARTHandle_t const pxUart )
+{
+    int32_t lError = IOT_UART_SUCCESS;
+    DMA_HandleTypeDef * pxDma = &( pxUart->xDmaTx );
+
+    pxDma->Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    pxDma->Init.Direction = DMA_MEMORY_TO_PERIPH;
+    pxDma->Init.SrcInc = DMA_SINC_INCREMENTED;
+    pxDma->Init.DestInc = DMA_DINC_FIXED;
+    pxDma->Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+    pxDma->Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+    pxDma->Init.Priority = DMA_LOW_PRIORITY_LOW_WEIGHT;
+    pxDma->Init.SrcBurstLength = 1;
+    pxDma->Init.DestBurstLength = 1;
+    pxDma->Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    pxDma->Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    pxDma->Init.Mode = DMA_NORMAL;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    if( ( HAL_DMA_Init( pxDma ) == HAL_OK ) &&
+        ( HAL_DMA_ConfigChannelAttributes( pxDma, DMA_CHANNEL_NPRIV ) == HAL_OK ) )
+    {
+        __HAL_LINKDMA( pxUart->pxHuart, hdmatx, *pxDma );
+
+        HAL_NVIC_SetPriority( pxUart->eDmaTxIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+        HAL_NVIC_EnableIRQ( pxUart->eDmaTxIrqNum );
+
+        pxUart->ucTxDma = 1;
+    }
+    else
+    {
+        ( void ) HAL_DMA_DeInit( pxDma );
+        lError = IOT_UART_WRITE_FAILED;
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+static void prvTxDmaDisable( IotUARTHandle_t const pxUart )
+{
+    if( pxUart->ucTxDma == 1 )
+    {
+        HAL_NVIC_DisableIRQ( pxUart->eDmaTxIrqNum );
+        ( void ) HAL_DMA_DeInit( &( pxUart->xDmaTx ) );
+        pxUart->pxHuart->hdmatx = NULL;
+        pxUart->ucTxDma = 0;
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* End of a DMA write, completed, failed or aborted, lets the board enter STOP2 again */
+static void prvTxDmaDone( IotUARTHandle_t const pxUart )
+{
+    if( __atomic_exchange_n( &( pxUart->ucTxInhibit ), 0, __ATOMIC_RELAXED ) == 1 )
+    {
+        vLowPowerRelease();
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* OVRDIS can only be changed while the USART is disabled */
+static void prvSetOverrunDetection( UART_HandleTypeDef * pxHuart,
+                                    BaseType_t xEnable )
+{
+    __HAL_UART_DISABLE( pxHuart );
+
+    if( xEnable == pdTRUE )
+    {
+        CLEAR_BIT( pxHuart->Instance->CR3, USART_CR3_OVRDIS );
+    }
+    else
+    {
+        SET_BIT( pxHuart->Instance->CR3, USART_CR3_OVRDIS );
+    }
+
+    __HAL_UART_ENABLE( pxHuart );
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * The receive channel runs a one node circular list over the whole ring. HAL_UART reports the
+ * DMA write offset through HAL_UARTEx_RxEventCallback at half ring, at the end of the ring and
+ * when the line goes idle, and the reception keeps running until prvRxRingStop.
+ */
+static int32_t prvRxRingStart( IotUARTHandle_t const pxUart,
+                               const IotUARTRxRing_t * pxRing )
+{
+    int32_t lError = IOT_UART_SUCCESS;
+    DMA_NodeConfTypeDef xNodeConf = { 0 };
+    DMA_HandleTypeDef * pxDma = &( pxUart->xDmaRx );
+    UART_HandleTypeDef * pxHuart = pxUart->pxHuart;
+
+    if( pxDma->Instance == NULL )
+    {
+        lError = IOT_UART_FUNCTION_NOT_SUPPORTED;
+    }
+    else if( ( pxRing->pucBuffer == NULL ) || ( pxRing->xSize < 2 ) ||
+             ( pxRing->xSize > IOT_UART_RING_SIZE_MAX ) || ( ( pxRing->xSize & 1 ) != 0 ) )
+    {
+        lError = IOT_UART_INVALID_VALUE;
+    }
+    else if( ( pxUart->pucRing != NULL ) || ( pxHuart->RxState != HAL_UART_STATE_READY ) )
+    {
+        lError = IOT_UART_BUSY;
+    }
+    else
+    {
+        xNodeConf.NodeType = DMA_GPDMA_LINEAR_NODE;
+        xNodeConf.Init.Request = pxDma->Init.Request;
+        xNodeConf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+        xNodeConf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        xNodeConf.Init.SrcInc = DMA_SINC_FIXED;
+        xNodeConf.Init.DestInc = DMA_DINC_INCREMENTED;
+        xNodeConf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+        xNodeConf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+        xNodeConf.Init.SrcBurstLength = 1;
+        xNodeConf.Init.DestBurstLength = 1;
+        xNodeConf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+        xNodeConf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        xNodeConf.Init.Mode = DMA_NORMAL;
+        xNodeConf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+        xNodeConf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+        xNodeConf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+        xNodeConf.SrcAddress = ( uint32_t ) &( pxHuart->Instance->RDR );
+        xNodeConf.DstAddress = ( uint32_t ) pxRing->pucBuffer;
+        xNodeConf.DataSize = ( uint32_t ) pxRing->xSize;
+
+        pxDma->InitLinkedList.Priority = DMA_HIGH_PRIORITY;
+        pxDma->InitLinkedList.LinkStepMode = DMA_LSM_FULL_EXECUTION;
+        pxDma->InitLinkedList.LinkAllocatedPort = DMA_LINK_ALLOCATED_PORT1;
+        pxDma->InitLinkedList.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        pxDma->InitLinkedList.LinkedListMode = DMA_LINKEDLIST_CIRCULAR;
+
+        ( void ) memset( &( pxUart->xRxQueue ), 0, sizeof( pxUart->xRxQueue ) );
+        ( void ) memset( &( pxUart->xRingStats ), 0, sizeof( pxUart->xRingStats ) );
+
+        pxUart->pucRing = pxRing->pucBuffer;
+        pxUart->ulRingSize = ( uint32_t ) pxRing->xSize;
+        pxUart->ulRingPos = 0;
+        pxUart->ulRingTail = 0;
+        pxUart->ulRingCount = 0;
+
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        if( ( HAL_DMAEx_List_BuildNode( &xNodeConf, &( pxUart->xRxNode ) ) != HAL_OK ) ||
+            ( HAL_DMAEx_List_InsertNode_Tail( &( pxUart->xRxQueue ), &( pxUart->xRxNode ) ) != HAL_OK ) ||
+            ( HAL_DMAEx_List_SetCircularMode( &( pxUart->xRxQueue ) ) != HAL_OK ) ||
+            ( HAL_DMAEx_List_Init( pxDma ) != HAL_OK ) ||
+            ( HAL_DMAEx_List_LinkQ( pxDma, &( pxUart->xRxQueue ) ) != HAL_OK ) ||
+            ( HAL_DMA_ConfigChannelAttributes( pxDma, DMA_CHANNEL_NPRIV ) != HAL_OK ) )
+        {
+            lError = IOT_UART_READ_FAILED;
+        }
+        else
+        {
+            __HAL_LINKDMA( pxHuart, hdmarx, *pxDma );
+
+            /*
+             * A receive error would make HAL_UART abort the DMA. Overruns are not detected, a byte
+             * the DMA did not read in time is overwritten, and the line error interrupts are
+             * disabled below. Line errors are counted from the flags at each receive event.
+             */
+            prvSetOverrunDetection( pxHuart, pdFALSE );
+
+            HAL_NVIC_SetPriority( pxUart->eIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxUart->eIrqNum );
+            HAL_NVIC_SetPriority( pxUart->eDmaRxIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxUart->eDmaRxIrqNum );
+
+            if( HAL_UARTEx_ReceiveToIdle_DMA( pxHuart, pxUart->pucRing, ( uint16_t ) pxUart->ulRingSize ) == HAL_OK )
+            {
+                ATOMIC_CLEAR_BIT( pxHuart->Instance->CR3, USART_CR3_EIE );
+                ATOMIC_CLEAR_BIT( pxHuart->Instance->CR1, USART_CR1_PEIE );
+
+                /* GPDMA1 stops in STOP2, the ring holds it off until prvRxRingStop */
+                vLowPowerInhibit();
+            }
+            else
+            {
+                lError = IOT_UART_READ_FAILED;
+            }
+        }
+
+        if( lError != IOT_UART_SUCCESS )
+        {
+            HAL_NVIC_DisableIRQ( pxUart->eDmaRxIrqNum );
+            ( void ) HAL_DMAEx_List_DeInit( pxDma );
+            pxHuart->hdmarx = NULL;
+            prvSetOverrunDetection( pxHuart, pdTRUE );
+            pxUart->pucRing = NULL;
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRxRingStop( IotUARTHandle_t const pxUart )
+{
+    if( pxUart->pucRing != NULL )
+    {
+        ( void ) HAL_UART_AbortReceive( pxUart->pxHuart );
+
+        HAL_NVIC_DisableIRQ( pxUart->eDmaRxIrqNum );
+        ( void ) HAL_DMAEx_List_UnLinkQ( &( pxUart->xDmaRx ) );
+        ( void ) HAL_DMAEx_List_DeInit( &( pxUart->xDmaRx ) );
+        pxUart->pxHuart->hdmarx = NULL;
+
+        __HAL_UART_CLEAR_FLAG( pxUart->pxHuart, UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_PEF );
+        prvSetOverrunDetection( pxUart->pxHuart, pdTRUE );
+
+        taskENTER_CRITICAL();
+        pxUart->pucRing = NULL;
+        pxUart->ulRingCount = 0;
+        taskEXIT_CRITICAL();
+
+        vLowPowerRelease();
+    }
+}
+/*-----------------------------------------------------------*/
+
 IotUARTHandle_t iot_uart_open( int32_t lUartInstance )
 {
     IotUARTHandle_t xHandle = NULL;
@@ -312,13 +605,13 @@ int32_t iot_uart_read_async( IotUARTHandle_t const pxUartPeripheral,
     }
     else
     {
-        if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_RX )
+        if( ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) & HAL_UART_STATE_BUSY_RX ) == HAL_UART_STATE_BUSY_RX )
         {
             lError = IOT_UART_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, 1, 0 );
+            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
             HAL_NVIC_EnableIRQ( pxUartPeripheral->eIrqNum );
 
             if( HAL_UART_Receive_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
@@ -344,16 +637,27 @@ int32_t iot_uart_write_async( IotUARTHandle_t const pxUartPeripheral,
     }
     else
     {
-        if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_TX )
+        if( ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) & HAL_UART_STATE_BUSY_TX ) == HAL_UART_STATE_BUSY_TX )
         {
             lError = IOT_UART_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, 1, 0 );
+            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
             HAL_NVIC_EnableIRQ( pxUartPeripheral->eIrqNum );
 
-            if( HAL_UART_Transmit_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
+            if( pxUartPeripheral->ucTxDma == 1 )
+            {
+                vLowPowerInhibit();
+                pxUartPeripheral->ucTxInhibit = 1;
+
+                if( HAL_UART_Transmit_DMA( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
+                {
+                    prvTxDmaDone( pxUartPeripheral );
+                    lError = IOT_UART_WRITE_FAILED;
+                }
+            }
+            else if( HAL_UART_Transmit_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
             {
                 lError = IOT_UART_WRITE_FAILED;
             }
@@ -377,6 +681,7 @@ int32_t iot_uart_read_sync( IotUARTHandle_t const pxUartPeripheral,
         if( xSemaphoreTake( pxUartPeripheral->xSemphr, pdMS_TO_TICKS( IOT_UART_BLOCKING_TIMEOUT ) ) == pdFALSE )
         {
             HAL_UART_Abort( pxUartPeripheral->pxHuart );
+            prvTxDmaDone( pxUartPeripheral );
             lError = IOT_UART_READ_FAILED;
         }
     }
@@ -396,9 +701,24 @@ int32_t iot_uart_write_sync( IotUARTHandle_t const pxUartPeripheral,
     {
         lError = IOT_UART_INVALID_VALUE;
     }
+    else if( pxUartPeripheral->ucTxDma == 1 )
+    {
+        /* The task blocks on the semaphore instead of polling the transmit register */
+        lError = iot_uart_write_async( pxUartPeripheral, pvBuffer, xBytes );
+
+        if( lError == IOT_UART_SUCCESS )
+        {
+            if( xSemaphoreTake( pxUartPeripheral->xSemphr, pdMS_TO_TICKS( IOT_UART_BLOCKING_TIMEOUT ) ) == pdFALSE )
+            {
+                ( void ) HAL_UART_AbortTransmit( pxUartPeripheral->pxHuart );
+                prvTxDmaDone( pxUartPeripheral );
+                lError = IOT_UART_WRITE_FAILED;
+            }
+        }
+    }
     else
     {
-        if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_TX )
+        if( ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) & HAL_UART_STATE_BUSY_TX ) == HAL_UART_STATE_BUSY_TX )
         {
             lError = IOT_UART_BUSY;
         }
@@ -427,6 +747,8 @@ int32_t iot_uart_close( IotUARTHandle_t const pxUartPeripheral )
     }
     else
     {
+        prvRxRingStop( pxUartPeripheral );
+
         if( HAL_UART_Abort( pxUartPeripheral->pxHuart ) != HAL_OK )
         {
             lError = IOT_UART_BUSY;
@@ -437,6 +759,8 @@ int32_t iot_uart_close( IotUARTHandle_t const pxUartPeripheral )
         }
         else
         {
+            prvTxDmaDone( pxUartPeripheral );
+            prvTxDmaDisable( pxUartPeripheral );
             vSemaphoreDelete( pxUartPeripheral->xSemphr );
             lError = IOT_UART_SUCCESS;
             pxUartPeripheral->sOpened = IOT_UART_CLOSED;
@@ -506,6 +830,49 @@ int32_t iot_uart_ioctl( IotUARTHandle_t const pxUartPeripheral,
 
                 break;
 
+            case eUartSetTxDma:
+
+                if( pxUartPeripheral->xDmaTx.Instance == NULL )
+                {
+                    lError = IOT_UART_FUNCTION_NOT_SUPPORTED;
+                }
+                else if( ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) & HAL_UART_STATE_BUSY_TX ) == HAL_UART_STATE_BUSY_TX )
+                {
+                    lError = IOT_UART_BUSY;
+                }
+                else if( *( uint8_t * ) pvBuffer == 0 )
+                {
+                    prvTxDmaDisable( pxUartPeripheral );
+                    lError = IOT_UART_SUCCESS;
+                }
+                else if( pxUartPeripheral->ucTxDma == 0 )
+                {
+                    lError = prvTxDmaEnable( pxUartPeripheral );
+                }
+                else
+                {
+                    lError = IOT_UART_SUCCESS;
+                }
+
+                break;
+
+            case eUartStartRxRing:
+
+                lError = prvRxRingStart( pxUartPeripheral, ( const IotUARTRxRing_t * ) pvBuffer );
+
+                break;
+
+            case eUartGetRxRingStats:
+
+                taskENTER_CRITICAL();
+                *( IotUARTRxRingStats_t * ) pvBuffer = pxUartPeripheral->xRingStats;
+                ( ( IotUARTRxRingStats_t * ) pvBuffer )->ulPending = pxUartPeripheral->ulRingCount;
+                taskEXIT_CRITICAL();
+
+                lError = IOT_UART_SUCCESS;
+
+                break;
+
             default:
                 break;
         }
@@ -521,12 +888,21 @@ int32_t iot_uart_cancel( IotUARTHandle_t const pxUartPeripheral )
 
     if( ( pxUartPeripheral != NULL ) && ( pxUartPeripheral->sOpened == IOT_UART_OPENED ) )
     {
-        if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_READY )
+        if( pxUartPeripheral->pucRing != NULL )
+        {
+            /* Stops the receive ring and any write */
+            prvRxRingStop( pxUartPeripheral );
+            ( void ) HAL_UART_AbortTransmit( pxUartPeripheral->pxHuart );
+            prvTxDmaDone( pxUartPeripheral );
+            lError = IOT_UART_SUCCESS;
+        }
+        else if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_READY )
         {
             lError = IOT_UART_NOTHING_TO_CANCEL;
         }
         else if( HAL_UART_Abort( pxUartPeripheral->pxHuart ) == HAL_OK )
         {
+            prvTxDmaDone( pxUartPeripheral );
             lError = IOT_UART_SUCCESS;
         }
     }
@@ -535,6 +911,57 @@ int32_t iot_uart_cancel( IotUARTHandle_t const pxUartPeripheral )
 }
 /*-----------------------------------------------------------*/
 
+size_t iot_uart_rx_ring_peek( IotUARTHandle_t const pxUartPeripheral,
+                              const uint8_t ** ppucData )
+{
+    size_t xBytes = 0;
+    uint32_t ulTail = 0;
+    uint32_t ulCount = 0;
+
+    if( ( pxUartPeripheral != NULL ) && ( ppucData != NULL ) && ( pxUartPeripheral->pucRing != NULL ) )
+    {
+        taskENTER_CRITICAL();
+        ulTail = pxUartPeripheral->ulRingTail;
+        ulCount = pxUartPeripheral->ulRingCount;
+        taskEXIT_CRITICAL();
+
+        /* Up to the end of the ring, the rest is at the start of the ring */
+        xBytes = ( size_t ) ( ( ulCount < ( pxUartPeripheral->ulRingSize - ulTail ) ) ?
+                              ulCount : ( pxUartPeripheral->ulRingSize - ulTail ) );
+        *ppucData = &( pxUartPeripheral->pucRing[ ulTail ] );
+    }
+
+    return xBytes;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_uart_rx_ring_consume( IotUARTHandle_t const pxUartPeripheral,
+                                  size_t xBytes )
+{
+    int32_t lError = IOT_UART_INVALID_VALUE;
+
+    if( ( pxUartPeripheral != NULL ) && ( pxUartPeripheral->pucRing != NULL ) )
+    {
+        taskENTER_CRITICAL();
+
+        /* Bytes dropped by an overwrite since the peek are already out of the ring */
+        if( xBytes > pxUartPeripheral->ulRingCount )
+        {
+            xBytes = pxUartPeripheral->ulRingCount;
+        }
+
+        pxUartPeripheral->ulRingTail = ( pxUartPeripheral->ulRingTail + ( uint32_t ) xBytes ) % pxUartPeripheral->ulRingSize;
+        pxUartPeripheral->ulRingCount -= ( uint32_t ) xBytes;
+
+        taskEXIT_CRITICAL();
+
+        lError = IOT_UART_SUCCESS;
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
 void HAL_UART_ErrorCallback( UART_HandleTypeDef * huart )
 {
     /* Propagate error message back to user.
@@ -549,6 +976,12 @@ void HAL_UART_ErrorCallback( UART_HandleTypeDef * huart )
     {
         if( huart->Instance == xUartHandleMap[ i ].Instance )
         {
+            /* HAL_UART stopped the write on a transmit DMA error */
+            if( huart->gState != HAL_UART_STATE_BUSY_TX )
+            {
+                prvTxDmaDone( pxUarts[ i ] );
+            }
+
             if( pxUarts[ i ]->xUartCallback != NULL )
             {
                 pxUarts[ i ]->xUartCallback( huart->ErrorCode, pxUarts[ i ]->pvUserCallbackContext );
@@ -603,6 +1036,9 @@ void HAL_UART_TxCpltCallback( UART_HandleTypeDef * huart )
     {
         if( huart->Instance == xUartHandleMap[ i ].Instance )
         {
+            /* Before the callback, which may start the next write */
+            prvTxDmaDone( pxUarts[ i ] );
+
             if( pxUarts[ i ]->xUartCallback != NULL )
             {
                 pxUarts[ i ]->xUartCallback( eUartWriteCompleted, pxUarts[ i ]->pvUserCallbackContext );
@@ -617,6 +1053,55 @@ void HAL_UART_TxCpltCallback( UART_HandleTypeDef * huart )
 
 /*-----------------------------------------------------------*/
 
+void HAL_UARTEx_RxEventCallback( UART_HandleTypeDef * huart,
+                                 uint16_t Size )
+{
+    uint32_t i = 0;
+    uint32_t ulPos = 0;
+    uint32_t ulNew = 0;
+    IotUARTHandle_t pxUart = NULL;
+
+    for( ; i < sizeof( xUartHandleMap ) / sizeof( UART_HandleTypeDef ); i++ )
+    {
+        if( huart->Instance == xUartHandleMap[ i ].Instance )
+        {
+            pxUart = pxUarts[ i ];
+            break;
+        }
+    }
+
+    if( ( pxUart != NULL ) && ( pxUart->pucRing != NULL ) )
+    {
+        /* Size is the DMA write offset, the end of the ring is offset 0 */
+        ulPos = ( Size >= pxUart->ulRingSize ) ? 0 : Size;
+        ulNew = ( ulPos + pxUart->ulRingSize - pxUart->ulRingPos ) % pxUart->ulRingSize;
+        pxUart->ulRingPos = ulPos;
+
+        pxUart->ulRingCount += ulNew;
+        pxUart->xRingStats.ulReceived += ulNew;
+
+        /* The DMA overwrote the oldest bytes, the ring now holds the last ulRingSize bytes */
+        if( pxUart->ulRingCount > pxUart->ulRingSize )
+        {
+            pxUart->xRingStats.ulLost += pxUart->ulRingCount - pxUart->ulRingSize;
+            pxUart->ulRingTail = ulPos;
+            pxUart->ulRingCount = pxUart->ulRingSize;
+        }
+
+        if( ( huart->Instance->ISR & IOT_UART_LINE_ERROR_FLAGS ) != 0 )
+        {
+            pxUart->xRingStats.ulLineErrors++;
+            __HAL_UART_CLEAR_FLAG( huart, UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_PEF );
+        }
+
+        if( ( ulNew > 0 ) && ( pxUart->xUartCallback != NULL ) )
+        {
+            pxUart->xUartCallback( eUartRxRingData, pxUart->pvUserCallbackContext );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 void USART1_IRQHandler( void )
 {
     HAL_UART_IRQHandler( pxUarts[ 0 ]->pxHuart );
@@ -646,3 +1131,39 @@ void UART5_IRQHandler( void )
     HAL_UART_IRQHandler( pxUarts[ 4 ]->pxHuart );
 }
 /*-----------------------------------------------------------*/
+
+void GPDMA1_Channel0_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 1 ]->xDmaRx ) );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel1_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 1 ]->xDmaTx ) );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel2_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 2 ]->xDmaRx ) );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel8_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 3 ]->xDmaRx ) );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel9_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 3 ]->xDmaTx ) );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel10_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &( pxUarts[ 4 ]->xDmaRx ) );
+}
+/*-----------------------------------------------------------*/
@@ -34,6 +34,8 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+#include "cryp_stm32.h"
 
 /* Parameter validation macros based on platform_util.h */
 #define AES_VALIDATE_RET( cond )    \
@@ -165,9 +167,12 @@ void mbedtls_aes_init(mbedtls_aes_context *ctx)
 {
     AES_VALIDATE( ctx != NULL );
 
+    cryp_context_init();
+
     memset(ctx, 0, sizeof(mbedtls_aes_context));
 
     ctx->hcryp_aes.Init.Algorithm  = ST_AES_NO_ALGO;
+    ctx->last_mode = -1;
 }
 
 
@@ -177,9 +182,36 @@ void mbedtls_aes_free(mbedtls_aes_context *ctx)
         return;
     }
 
+    ( void ) cryp_context_free(ctx);
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_aes_context));
 }
 
+/*
+ * Load the key of ctx in the CRYP, the CRYP is shared with the other AES
+ * and GCM contexts
+ */
+static int aes_set_key_locked(mbedtls_aes_context *ctx,
+                              const unsigned char *key,
+                              unsigned int keybits)
+{
+    int ret;
+
+    ret = cryp_lock();
+    if (ret != 0)
+        return (ret);
+
+    /* The CRYP is reinitialized for this context */
+    (void) cryp_claim(ctx);
+    ctx->last_mode = -1;
+
+    ret = aes_set_key(ctx, key, keybits);
+
+    ret = cryp_unlock(ret);
+
+    return (ret);
+}
+
 #if defined(MBEDTLS_CIPHER_MODE_XTS)
 void mbedtls_aes_xts_init( mbedtls_aes_xts_context *ctx )
 {
@@ -205,7 +237,7 @@ void mbedtls_aes_xts_free( mbedtls_aes_xts_context *ctx )
 int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key,
                            unsigned int keybits)
 {
-    return (aes_set_key(ctx, key, keybits));
+    return (aes_set_key_locked(ctx, key, keybits));
 }
 
 /*
@@ -214,7 +246,7 @@ int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key,
 int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key,
                            unsigned int keybits)
 {
-    return (aes_set_key(ctx, key, keybits));
+    return (aes_set_key_locked(ctx, key, keybits));
 }
 
 #if defined(MBEDTLS_CIPHER_MODE_XTS)
@@ -310,32 +342,48 @@ int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx,
     AES_VALIDATE_RET( mode == MBEDTLS_AES_ENCRYPT ||
                       mode == MBEDTLS_AES_DECRYPT );
 
-    /* allow multi-instance of CRYP use: restore context for CRYP hw module */
-    ctx->hcryp_aes.Instance->CR = ctx->ctx_save_cr;
+    ret = cryp_lock();
+    if (ret != 0)
+        return (ret);
+
+    /* Back-to-back blocks of the same context and direction reuse the key  */
+    /* already loaded in the CRYP, otherwise the HAL loads it again         */
+    if (!cryp_claim(ctx) || (ctx->last_mode != mode))
+    {
+        /* allow multi-instance of CRYP use: restore context for CRYP hw module */
+        ctx->hcryp_aes.Instance->CR = ctx->ctx_save_cr;
+        ctx->hcryp_aes.KeyIVConfig = 0U;
+        ctx->last_mode = mode;
+    }
 
     /* Set the Algo if not configured till now */
     if (CRYP_AES_ECB != ctx->hcryp_aes.Init.Algorithm)
     {
         ctx->hcryp_aes.Init.Algorithm  = CRYP_AES_ECB;
+        ctx->hcryp_aes.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ONCE;
 
         /* Configure the CRYP  */
         if (HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init) != HAL_OK)
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+
+        ctx->hcryp_aes.KeyIVConfig = 0U;
     }
 
-    if (mode == MBEDTLS_AES_DECRYPT) { /* AES decryption */
-        ret = mbedtls_internal_aes_decrypt(ctx, input, output);
-        if( ret != 0 )
-            return (ret);
-    } else { /* AES encryption */
-        ret = mbedtls_internal_aes_encrypt(ctx, input, output);
-        if( ret != 0 )
-            return (ret);
+    if (ret == 0)
+    {
+        if (mode == MBEDTLS_AES_DECRYPT) { /* AES decryption */
+            ret = mbedtls_internal_aes_decrypt(ctx, input, output);
+        } else { /* AES encryption */
+            ret = mbedtls_internal_aes_encrypt(ctx, input, output);
+        }
     }
+
     /* allow multi-instance of CRYP use: save context for CRYP HW module CR */
     ctx->ctx_save_cr = ctx->hcryp_aes.Instance->CR;
 
-    return (0);
+    ret = cryp_unlock(ret);
+
+    return (ret);
 }
 
 #if defined(MBEDTLS_CIPHER_MODE_CBC)
@@ -380,16 +428,28 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
         return (MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH);
     }
 
-    ret = st_cbc_restore_context(ctx);
+    ret = cryp_lock();
     if (ret != 0)
         return (ret);
 
+    /* The CRYP only needs to be reinitialized if another context used it */
+    if (!cryp_claim(ctx))
+    {
+        ret = st_cbc_restore_context(ctx);
+        if (ret != 0)
+            goto exit;
+    }
+
     /* Set the Algo if not configured till now */
     if (CRYP_AES_CBC != ctx->hcryp_aes.Init.Algorithm)
     {
         ctx->hcryp_aes.Init.Algorithm  = CRYP_AES_CBC;
     }
 
+    /* Each call brings its own IV, make sure the HAL loads it */
+    ctx->hcryp_aes.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ALWAYS;
+    ctx->last_mode = -1;
+
     /* Set IV with invert endianness */
     SWAP_B8_TO_B32(iv_32B[0],iv,0);
     SWAP_B8_TO_B32(iv_32B[1],iv,4);
@@ -400,12 +460,14 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
 
     /* reconfigure the CRYP */
     if (HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        goto exit;
     }
 
     if (mode == MBEDTLS_AES_DECRYPT) {
         if (HAL_CRYP_Decrypt(&ctx->hcryp_aes, (uint32_t *)input, length, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-            return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            goto exit;
         }
 
         /* Get IV vector for the next call */
@@ -416,7 +478,8 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
 
     } else {
         if (HAL_CRYP_Encrypt(&ctx->hcryp_aes, (uint32_t *)input, length, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-            return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            goto exit;
         }
 
         /* current output is the IV vector for the next call */
@@ -427,7 +490,10 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
     ctx->ctx_save_cr = ctx->hcryp_aes.Instance->CR; // save here before overwritten
     ctx->hcryp_aes.Instance->CR &= ~AES_CR_EN;
 
-    return (0);
+exit:
+    ret = cryp_unlock(ret);
+
+    return (ret);
 }
 #endif /* MBEDTLS_CIPHER_MODE_CBC */
 
@@ -813,20 +879,163 @@ int mbedtls_internal_aes_decrypt(mbedtls_aes_context *ctx,
     return (0);
 }
 
-#if !defined(MBEDTLS_DEPRECATED_REMOVED)
-void mbedtls_aes_encrypt(mbedtls_aes_context *ctx,
-                         const unsigned char input[16],
-                         unsigned char output[16])
+/*
+ * Known answer test: FIPS-197 appendix C.1 and C.3 (ECB, AES-128/256) and
+ * SP 800-38A F.2.1 (CBC-AES128.Encrypt)
+ */
+static const unsigned char aes_test_key[32] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F
+};
+
+static const unsigned char aes_test_pt[16] =
 {
-    mbedtls_internal_aes_encrypt(ctx, input, output);
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF
+};
+
+static const unsigned char aes_test_ct128[16] =
+{
+    0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30,
+    0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A
+};
+
+static const unsigned char aes_test_ct256[16] =
+{
+    0x8E, 0xA2, 0xB7, 0xCA, 0x51, 0x67, 0x45, 0xBF,
+    0xEA, 0xFC, 0x49, 0x90, 0x4B, 0x49, 0x60, 0x89
+};
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+static const unsigned char aes_test_cbc_key[16] =
+{
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+    0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+
+static const unsigned char aes_test_cbc_pt[32] =
+{
+    0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96,
+    0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+    0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C,
+    0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51
+};
+
+static const unsigned char aes_test_cbc_ct[32] =
+{
+    0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46,
+    0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D,
+    0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE,
+    0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2
+};
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+/*
+ * Run one ECB block through ctx and compare it with expected
+ */
+static int aes_test_ecb(mbedtls_aes_context *ctx, int mode,
+                        const unsigned char input[16],
+                        const unsigned char expected[16])
+{
+    __ALIGN_BEGIN unsigned char buf[16] __ALIGN_END;
+    int ret;
+
+    ret = mbedtls_aes_crypt_ecb(ctx, mode, input, buf);
+
+    if ((ret == 0) && (memcmp(buf, expected, sizeof(buf)) != 0))
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+
+    return (ret);
 }
 
-void mbedtls_aes_decrypt(mbedtls_aes_context *ctx,
-                         const unsigned char input[16],
-                         unsigned char output[16])
+int cryp_aes_self_test(void)
 {
-    mbedtls_internal_aes_decrypt(ctx, input, output);
+    mbedtls_aes_context enc128;
+    mbedtls_aes_context enc256;
+    mbedtls_aes_context dec256;
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+    mbedtls_aes_context cbc;
+    unsigned char iv[16];
+    __ALIGN_BEGIN unsigned char buf[sizeof(aes_test_cbc_ct)] __ALIGN_END;
+    unsigned int i;
+#endif
+    int ret;
+
+    mbedtls_aes_init(&enc128);
+    mbedtls_aes_init(&enc256);
+    mbedtls_aes_init(&dec256);
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+    mbedtls_aes_init(&cbc);
+#endif
+
+    ret = mbedtls_aes_setkey_enc(&enc128, aes_test_key, 128);
+    if (ret == 0)
+        ret = mbedtls_aes_setkey_enc(&enc256, aes_test_key, 256);
+    if (ret == 0)
+        ret = mbedtls_aes_setkey_dec(&dec256, aes_test_key, 256);
+    if (ret != 0)
+        goto exit;
+
+    /* The contexts take turns on the CRYP, each switch reloads the key     */
+    /* and the direction of the context using it next                       */
+    if ((ret = aes_test_ecb(&enc128, MBEDTLS_AES_ENCRYPT, aes_test_pt, aes_test_ct128)) != 0)
+        goto exit;
+    if ((ret = aes_test_ecb(&enc256, MBEDTLS_AES_ENCRYPT, aes_test_pt, aes_test_ct256)) != 0)
+        goto exit;
+    if ((ret = aes_test_ecb(&dec256, MBEDTLS_AES_DECRYPT, aes_test_ct256, aes_test_pt)) != 0)
+        goto exit;
+    if ((ret = aes_test_ecb(&enc128, MBEDTLS_AES_ENCRYPT, aes_test_pt, aes_test_ct128)) != 0)
+        goto exit;
+
+    /* The CRYP keeps the raw key of a context, which then serves both      */
+    /* directions: back-to-back blocks switching direction on the CRYP      */
+    if ((ret = aes_test_ecb(&enc128, MBEDTLS_AES_DECRYPT, aes_test_ct128, aes_test_pt)) != 0)
+        goto exit;
+    if ((ret = aes_test_ecb(&enc128, MBEDTLS_AES_ENCRYPT, aes_test_pt, aes_test_ct128)) != 0)
+        goto exit;
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+    if ((ret = mbedtls_aes_setkey_enc(&cbc, aes_test_cbc_key, 128)) != 0)
+        goto exit;
+
+    /* Two blocks in one call, then one block per call with an ECB block of */
+    /* another context in between: the IV must carry over in both cases     */
+    for (i = 0; i < sizeof(iv); i++)
+        iv[i] = (unsigned char) i;
+
+    ret = mbedtls_aes_crypt_cbc(&cbc, MBEDTLS_AES_ENCRYPT, sizeof(aes_test_cbc_pt),
+                                iv, aes_test_cbc_pt, buf);
+    if ((ret == 0) && (memcmp(buf, aes_test_cbc_ct, sizeof(buf)) != 0))
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    if (ret != 0)
+        goto exit;
+
+    for (i = 0; i < sizeof(iv); i++)
+        iv[i] = (unsigned char) i;
+
+    ret = mbedtls_aes_crypt_cbc(&cbc, MBEDTLS_AES_ENCRYPT, 16, iv, aes_test_cbc_pt, buf);
+    if (ret == 0)
+        ret = aes_test_ecb(&enc256, MBEDTLS_AES_ENCRYPT, aes_test_pt, aes_test_ct256);
+    if (ret == 0)
+        ret = mbedtls_aes_crypt_cbc(&cbc, MBEDTLS_AES_ENCRYPT, 16, iv,
+                                    aes_test_cbc_pt + 16, buf + 16);
+    if ((ret == 0) && (memcmp(buf, aes_test_cbc_ct, sizeof(buf)) != 0))
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+exit:
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+    mbedtls_aes_free(&cbc);
+#endif
+    mbedtls_aes_free(&dec256);
+    mbedtls_aes_free(&enc256);
+    mbedtls_aes_free(&enc128);
+
+    return (ret);
 }
-#endif /* MBEDTLS_DEPRECATED_REMOVED */
+
 #endif /* MBEDTLS_AES_ALT */
 #endif /* MBEDTLS_AES_C */
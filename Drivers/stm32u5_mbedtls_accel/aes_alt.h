@@ -56,6 +56,7 @@ typedef struct {
     uint32_t aes_key[8];           /* Decryption key */
     CRYP_HandleTypeDef hcryp_aes;  /* HW driver handle */
     uint32_t ctx_save_cr;          /* Saved HW context for multi-instance */
+    int last_mode;                 /* Direction of the last ECB operation */
 }
 mbedtls_aes_context;
 
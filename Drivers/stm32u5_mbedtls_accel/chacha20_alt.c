@@ -0,0 +1,296 @@
+/**
+ * \file chacha20.c
+ *
+ * \brief ChaCha20 cipher.
+ *
+ * \author Daniel King <damaki.gh@gmail.com>
+ */
+/*
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a ChaCha20 software path tuned for the Cortex-M33
+ *  based on mbed TLS API. It does not use the AES peripheral and so stays
+ *  available while the CRYP is held by other contexts.
+ *
+ *  Compared to the generic mbed TLS implementation:
+ *  - the working state lives in locals so the compiler can keep it in core
+ *    registers, and a double round is written out as 8 quarter rounds;
+ *  - the rotations compile to a single ROR each;
+ *  - whole blocks are XORed word by word straight from the generated state,
+ *    without going through the byte keystream buffer.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mbedtls/chacha20.h"
+
+#if defined(MBEDTLS_CHACHA20_C)
+#if defined(MBEDTLS_CHACHA20_ALT)
+#include <string.h>
+#include "mbedtls/platform_util.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define CHACHA20_CTR_INDEX    ( 12U )
+#define CHACHA20_BLOCK_WORDS  ( 16U )
+
+/* Private macro -------------------------------------------------------------*/
+#define ROTL32( value, amount ) \
+    ( (uint32_t) ( ( value ) << ( amount ) ) | ( ( value ) >> ( 32 - ( amount ) ) ) )
+
+#define QUARTER_ROUND( a, b, c, d )                      \
+    do                                                   \
+    {                                                    \
+        a += b; d ^= a; d = ROTL32( d, 16 );             \
+        c += d; b ^= c; b = ROTL32( b, 12 );             \
+        a += b; d ^= a; d = ROTL32( d,  8 );             \
+        c += d; b ^= c; b = ROTL32( b,  7 );             \
+    } while( 0 )
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static inline uint32_t chacha20_get_le32( const unsigned char *p )
+{
+#if defined(__BYTE_ORDER__) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+    uint32_t w;
+
+    /* Single (unaligned) LDR on the Cortex-M33 */
+    memcpy( &w, p, sizeof( w ) );
+    return( w );
+#else
+    return( (uint32_t) p[0]         |
+            ( (uint32_t) p[1] << 8 )  |
+            ( (uint32_t) p[2] << 16 ) |
+            ( (uint32_t) p[3] << 24 ) );
+#endif
+}
+
+static inline void chacha20_put_le32( unsigned char *p, uint32_t w )
+{
+#if defined(__BYTE_ORDER__) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+    memcpy( p, &w, sizeof( w ) );
+#else
+    p[0] = (unsigned char) w;
+    p[1] = (unsigned char) ( w >> 8 );
+    p[2] = (unsigned char) ( w >> 16 );
+    p[3] = (unsigned char) ( w >> 24 );
+#endif
+}
+
+/**
+ * \brief           Generate one keystream block and advance the block counter.
+ *
+ * \param state     The ChaCha20 state, the counter word is incremented.
+ * \param keystream Where the 16 keystream words are written.
+ */
+static void chacha20_block( uint32_t state[16],
+                            uint32_t keystream[16] )
+{
+    uint32_t x0  = state[0];
+    uint32_t x1  = state[1];
+    uint32_t x2  = state[2];
+    uint32_t x3  = state[3];
+    uint32_t x4  = state[4];
+    uint32_t x5  = state[5];
+    uint32_t x6  = state[6];
+    uint32_t x7  = state[7];
+    uint32_t x8  = state[8];
+    uint32_t x9  = state[9];
+    uint32_t x10 = state[10];
+    uint32_t x11 = state[11];
+    uint32_t x12 = state[12];
+    uint32_t x13 = state[13];
+    uint32_t x14 = state[14];
+    uint32_t x15 = state[15];
+    size_t i;
+
+    for( i = 0U; i < 10U; i++ )
+    {
+        /* Column round */
+        QUARTER_ROUND( x0, x4,  x8, x12 );
+        QUARTER_ROUND( x1, x5,  x9, x13 );
+        QUARTER_ROUND( x2, x6, x10, x14 );
+        QUARTER_ROUND( x3, x7, x11, x15 );
+
+        /* Diagonal round */
+        QUARTER_ROUND( x0, x5, x10, x15 );
+        QUARTER_ROUND( x1, x6, x11, x12 );
+        QUARTER_ROUND( x2, x7,  x8, x13 );
+        QUARTER_ROUND( x3, x4,  x9, x14 );
+    }
+
+    keystream[0]  = x0  + state[0];
+    keystream[1]  = x1  + state[1];
+    keystream[2]  = x2  + state[2];
+    keystream[3]  = x3  + state[3];
+    keystream[4]  = x4  + state[4];
+    keystream[5]  = x5  + state[5];
+    keystream[6]  = x6  + state[6];
+    keystream[7]  = x7  + state[7];
+    keystream[8]  = x8  + state[8];
+    keystream[9]  = x9  + state[9];
+    keystream[10] = x10 + state[10];
+    keystream[11] = x11 + state[11];
+    keystream[12] = x12 + state[12];
+    keystream[13] = x13 + state[13];
+    keystream[14] = x14 + state[14];
+    keystream[15] = x15 + state[15];
+
+    state[CHACHA20_CTR_INDEX]++;
+}
+
+void mbedtls_chacha20_init( mbedtls_chacha20_context *ctx )
+{
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_chacha20_context ) );
+
+    /* Initially, there's no keystream bytes available */
+    ctx->keystream_bytes_used = ST_CHACHA20_BLOCK_SIZE_BYTES;
+}
+
+void mbedtls_chacha20_free( mbedtls_chacha20_context *ctx )
+{
+    if( ctx != NULL )
+    {
+        mbedtls_platform_zeroize( ctx, sizeof( mbedtls_chacha20_context ) );
+    }
+}
+
+int mbedtls_chacha20_setkey( mbedtls_chacha20_context *ctx,
+                             const unsigned char key[32] )
+{
+    size_t i;
+
+    /* ChaCha20 constants - the string "expand 32-byte k" */
+    ctx->state[0] = 0x61707865;
+    ctx->state[1] = 0x3320646e;
+    ctx->state[2] = 0x79622d32;
+    ctx->state[3] = 0x6b206574;
+
+    /* Set key */
+    for( i = 0U; i < 8U; i++ )
+    {
+        ctx->state[4 + i] = chacha20_get_le32( key + 4U * i );
+    }
+
+    return( 0 );
+}
+
+int mbedtls_chacha20_starts( mbedtls_chacha20_context *ctx,
+                             const unsigned char nonce[12],
+                             uint32_t counter )
+{
+    /* Counter */
+    ctx->state[12] = counter;
+
+    /* Nonce */
+    ctx->state[13] = chacha20_get_le32( nonce );
+    ctx->state[14] = chacha20_get_le32( nonce + 4 );
+    ctx->state[15] = chacha20_get_le32( nonce + 8 );
+
+    mbedtls_platform_zeroize( ctx->keystream8, sizeof( ctx->keystream8 ) );
+
+    /* Initially, there's no keystream bytes available */
+    ctx->keystream_bytes_used = ST_CHACHA20_BLOCK_SIZE_BYTES;
+
+    return( 0 );
+}
+
+int mbedtls_chacha20_update( mbedtls_chacha20_context *ctx,
+                             size_t size,
+                             const unsigned char *input,
+                             unsigned char *output )
+{
+    uint32_t keystream[CHACHA20_BLOCK_WORDS];
+    size_t i;
+
+    /* Use leftover keystream bytes, if available */
+    while( ( size > 0U ) && ( ctx->keystream_bytes_used < ST_CHACHA20_BLOCK_SIZE_BYTES ) )
+    {
+        *output++ = *input++ ^ ctx->keystream8[ctx->keystream_bytes_used];
+
+        ctx->keystream_bytes_used++;
+        size--;
+    }
+
+    /* Process full blocks, XOR the keystream words directly */
+    while( size >= ST_CHACHA20_BLOCK_SIZE_BYTES )
+    {
+        chacha20_block( ctx->state, keystream );
+
+        for( i = 0U; i < CHACHA20_BLOCK_WORDS; i++ )
+        {
+            chacha20_put_le32( output + 4U * i,
+                               chacha20_get_le32( input + 4U * i ) ^ keystream[i] );
+        }
+
+        input  += ST_CHACHA20_BLOCK_SIZE_BYTES;
+        output += ST_CHACHA20_BLOCK_SIZE_BYTES;
+        size   -= ST_CHACHA20_BLOCK_SIZE_BYTES;
+    }
+
+    /* Last (partial) block, keep the remaining keystream for the next call */
+    if( size > 0U )
+    {
+        chacha20_block( ctx->state, keystream );
+
+        for( i = 0U; i < CHACHA20_BLOCK_WORDS; i++ )
+        {
+            chacha20_put_le32( &ctx->keystream8[4U * i], keystream[i] );
+        }
+
+        for( i = 0U; i < size; i++ )
+        {
+            output[i] = input[i] ^ ctx->keystream8[i];
+        }
+
+        ctx->keystream_bytes_used = size;
+    }
+
+    mbedtls_platform_zeroize( keystream, sizeof( keystream ) );
+
+    return( 0 );
+}
+
+int mbedtls_chacha20_crypt( const unsigned char key[32],
+                            const unsigned char nonce[12],
+                            uint32_t counter,
+                            size_t data_len,
+                            const unsigned char* input,
+                            unsigned char* output )
+{
+    mbedtls_chacha20_context ctx;
+    int ret;
+
+    mbedtls_chacha20_init( &ctx );
+
+    ret = mbedtls_chacha20_setkey( &ctx, key );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_chacha20_starts( &ctx, nonce, counter );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_chacha20_update( &ctx, data_len, input, output );
+
+cleanup:
+    mbedtls_chacha20_free( &ctx );
+    return( ret );
+}
+
+#endif /* MBEDTLS_CHACHA20_ALT */
+#endif /* MBEDTLS_CHACHA20_C */
@@ -0,0 +1,54 @@
+/**
+ * \file chacha20.h
+ *
+ * \brief   This file contains ChaCha20 definitions and functions.
+ *
+ *          ChaCha20 is a stream cipher that can encrypt and decrypt
+ *          information. ChaCha was created by Daniel Bernstein as a variant of
+ *          its Salsa cipher https://cr.yp.to/chacha/chacha-20080128.pdf
+ *          ChaCha20 is the variant with 20 rounds, that was also standardized
+ *          in RFC 7539.
+ */
+/*
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a ChaCha20 software path tuned for the Cortex-M33
+ *  based on mbed TLS API
+ */
+
+#ifndef MBEDTLS_CHACHA20_ALT_H
+#define MBEDTLS_CHACHA20_ALT_H
+
+#if defined (MBEDTLS_CHACHA20_ALT)
+#include <stdint.h>
+#include <stddef.h>
+
+#define ST_CHACHA20_BLOCK_SIZE_BYTES  ((size_t) 64)    /*!< Size of one keystream block */
+
+/**
+ * \brief          ChaCha20 context structure
+ */
+typedef struct mbedtls_chacha20_context
+{
+    uint32_t state[16];                              /*!< The state (before round operations). */
+    uint8_t  keystream8[ST_CHACHA20_BLOCK_SIZE_BYTES];
+                                                     /*!< Leftover keystream bytes. */
+    size_t keystream_bytes_used;                     /*!< Number of keystream bytes already used. */
+}
+mbedtls_chacha20_context;
+
+#endif /* MBEDTLS_CHACHA20_ALT */
+#endif /* chacha20_alt.h */
@@ -20,13 +20,15 @@
 
 /* Includes ------------------------------------------------------------------*/
 #if !defined(MBEDTLS_CONFIG_FILE)
-#include "config.h"
+#include "mbedtls/mbedtls_config.h"
 #else
 #include MBEDTLS_CONFIG_FILE
 #endif
 
 #if defined(MBEDTLS_AES_ALT) || defined(MBEDTLS_CCM_ALT) || defined(MBEDTLS_GCM_ALT)
 
+#include <string.h>
+
 #include "cryp_stm32.h"
 
 
@@ -40,6 +42,14 @@ unsigned char cryp_mutex_started = 0;
 
 unsigned int cryp_context_count = 0;
 
+/* Context whose key and state are currently loaded in the CRYP              */
+static const void *cryp_active_ctx = NULL;
+
+/* Number of callers holding or waiting for the CRYP                          */
+static unsigned int cryp_users = 0;
+
+static cryp_stats_t cryp_stats = { 0 };
+
 /* Functions -----------------------------------------------------------------*/
 
 /* Implementation that should never be optimized out by the compiler */
@@ -51,6 +61,125 @@ void cryp_zeroize(void *v, size_t n)
     }
 }
 
+void cryp_context_init(void)
+{
+    __disable_irq();
+#if defined(MBEDTLS_THREADING_C)
+    /* mutex cannot be initialized twice */
+    if ( !cryp_mutex_started )
+    {
+        mbedtls_mutex_init( &cryp_mutex );
+        cryp_mutex_started = 1;
+    }
+#endif /* MBEDTLS_THREADING_C */
+    cryp_context_count++;
+    __enable_irq();
+}
+
+int cryp_context_free(void *ctx)
+{
+    int last = 0;
+
+    __disable_irq();
+    if ( cryp_context_count > 0 )
+        cryp_context_count--;
+
+    /* A new context allocated at the same address must not inherit the state */
+    if ( cryp_active_ctx == ctx )
+        cryp_active_ctx = NULL;
+
+    if ( cryp_context_count == 0 )
+    {
+#if defined(MBEDTLS_THREADING_C)
+        /* Only free the mutex once no other context can use it */
+        if ( cryp_mutex_started )
+        {
+            mbedtls_mutex_free( &cryp_mutex );
+            cryp_mutex_started = 0;
+        }
+#endif /* MBEDTLS_THREADING_C */
+        last = 1;
+    }
+    __enable_irq();
+
+    return( last );
+}
+
+int cryp_lock(void)
+{
+    __disable_irq();
+    cryp_stats.acquisitions++;
+    if ( cryp_users > 0 )
+        cryp_stats.contended++;
+    cryp_users++;
+    __enable_irq();
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
+    {
+        __disable_irq();
+        cryp_users--;
+        __enable_irq();
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+#endif /* MBEDTLS_THREADING_C */
+
+    return( 0 );
+}
+
+int cryp_unlock(int ret)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif /* MBEDTLS_THREADING_C */
+
+    __disable_irq();
+    if ( cryp_users > 0 )
+        cryp_users--;
+    __enable_irq();
+
+    return( ret );
+}
+
+int cryp_claim(const void *ctx)
+{
+    int loaded = ( cryp_active_ctx == ctx );
+
+    if ( loaded )
+    {
+        cryp_stats.ctx_reuses++;
+    }
+    else
+    {
+        cryp_stats.ctx_switches++;
+        cryp_active_ctx = ctx;
+    }
+
+    return( loaded );
+}
+
+void cryp_count_dma_transfer(void)
+{
+    __disable_irq();
+    cryp_stats.dma_transfers++;
+    __enable_irq();
+}
+
+void cryp_get_stats(cryp_stats_t *stats)
+{
+    __disable_irq();
+    *stats = cryp_stats;
+    __enable_irq();
+}
+
+void cryp_reset_stats(void)
+{
+    __disable_irq();
+    memset( &cryp_stats, 0, sizeof( cryp_stats ) );
+    __enable_irq();
+}
+
 
 /* HAL function that should be implemented in the user file */
 /**
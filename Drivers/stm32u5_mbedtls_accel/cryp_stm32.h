@@ -68,6 +68,17 @@ do {                                                    \
 #define USE_AES_KEY192			0
 #endif /* USE_AES_KEY192 */
 
+/* types ---------------------------------------------------------------------*/
+/* Usage counters of the CRYP instance shared by the AES and GCM contexts      */
+typedef struct
+{
+    uint32_t acquisitions;  /* number of cryp_lock() calls                     */
+    uint32_t contended;     /* acquisitions which found the CRYP already taken */
+    uint32_t ctx_switches;  /* CRYP state reloaded for a different context     */
+    uint32_t ctx_reuses;    /* CRYP state still loaded for the same context    */
+    uint32_t dma_transfers; /* payload requests transferred by GPDMA           */
+} cryp_stats_t;
+
 /* variables -----------------------------------------------------------------*/
 #if defined(MBEDTLS_THREADING_C)
 extern mbedtls_threading_mutex_t cryp_mutex;
@@ -79,6 +90,37 @@ extern unsigned int cryp_context_count;
 /* functions prototypes ------------------------------------------------------*/
 extern void cryp_zeroize(void *v, size_t n);
 
+/* Register / unregister a context using the CRYP instance.                   */
+/* cryp_context_free() returns 1 when the last context was released.          */
+extern void cryp_context_init(void);
+extern int cryp_context_free(void *ctx);
+
+/* Take / release exclusive access to the CRYP instance. cryp_unlock() returns */
+/* ret, or a threading error if the mutex could not be released               */
+extern int cryp_lock(void);
+extern int cryp_unlock(int ret);
+
+/* Record ctx as the owner of the CRYP state, must be called with the lock    */
+/* held. Returns 1 if the CRYP still holds the state of ctx, in which case    */
+/* the key and context restore can be skipped.                               */
+extern int cryp_claim(const void *ctx);
+
+extern void cryp_count_dma_transfer(void);
+extern void cryp_get_stats(cryp_stats_t *stats);
+extern void cryp_reset_stats(void);
+
+#if defined(MBEDTLS_AES_ALT)
+/* Known answer test of AES-128/256 ECB and AES-128 CBC, with several        */
+/* contexts taking turns on the CRYP. Returns 0 if every result matches.     */
+extern int cryp_aes_self_test(void);
+#endif /* MBEDTLS_AES_ALT */
+
+#if defined(MBEDTLS_GCM_ALT)
+/* Known answer test of AES-128 GCM, including a message split over two     */
+/* updates, the chunked polling path and the DMA path. Returns 0 on match.  */
+extern int cryp_gcm_self_test(void);
+#endif /* MBEDTLS_GCM_ALT */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,377 @@
+/*
+ *  Elliptic curve Diffie-Hellman
+ *
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Copyright (C) 2019, STMicroelectronics, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements ST ECDH key generation and shared secret HW services
+ *  based on mbed TLS API
+ *
+ *  Montgomery curves (Curve25519, Curve448), and all curves while
+ *  pka_set_enabled( 0 ), use the mbed TLS ECP arithmetic.
+ *
+ *  mbedtls_ecdh_gen_public() first takes a key pair generated ahead of time
+ *  by pka_ecdh_pool_fill(), each pair is handed out once.
+ */
+
+/*
+ * References:
+ *
+ * SEC1 http://www.secg.org/index.php?action=secg,docs_secg
+ * RFC 4492
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mbedtls/ecdh.h"
+
+#if defined(MBEDTLS_ECDH_C)
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "pka_stm32.h"
+
+/* Private typedef -----------------------------------------------------------*/
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) && ( ST_PKA_ECDH_POOL_SIZE > 0 )
+typedef struct
+{
+    mbedtls_ecp_group_id id;    /* curve of d and Q, MBEDTLS_ECP_DP_NONE if free */
+    mbedtls_mpi d;
+    mbedtls_ecp_point Q;
+} ecdh_pool_slot_t;
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT and ST_PKA_ECDH_POOL_SIZE > 0 */
+
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Parameter validation macros based on platform_util.h */
+#define ECDH_VALIDATE_RET( cond )    \
+    MBEDTLS_INTERNAL_VALIDATE_RET( cond, MBEDTLS_ERR_ECP_BAD_INPUT_DATA )
+
+/* Private variables ---------------------------------------------------------*/
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) && ( ST_PKA_ECDH_POOL_SIZE > 0 )
+/* Slots are only read or swapped with interrupts disabled, the mpi limbs    */
+/* are allocated and freed by pka_ecdh_pool_fill() outside of that section.  */
+static ecdh_pool_slot_t ecdh_pool[ST_PKA_ECDH_POOL_SIZE];
+
+/* Curve of the last key generation, the one the pool is filled for         */
+static mbedtls_ecp_group_id ecdh_pool_curve = MBEDTLS_ECP_DP_SECP256R1;
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT and ST_PKA_ECDH_POOL_SIZE > 0 */
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+/*
+ * Generate public key (SEC1 3.2.1): Q = d G, d random in 1..n-1
+ */
+static int ecdh_gen_public_compute( mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                                    int (*f_rng)(void *, unsigned char *, size_t),
+                                    void *p_rng )
+{
+    int ret;
+    const pka_curve_t *curve;
+    PKA_HandleTypeDef hpka;
+
+    if( !pka_grp_capable( grp ) )
+    {
+        pka_count_sw_op();
+        return( mbedtls_ecp_gen_keypair( grp, d, Q, f_rng, p_rng ) );
+    }
+
+    MBEDTLS_MPI_CHK( mbedtls_ecp_gen_privkey( grp, d, f_rng, p_rng ) );
+
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
+
+    ret = pka_curve_get( grp, &curve );
+
+    if( ret == 0 )
+        ret = pka_ecc_mul( &hpka, grp, curve, Q, d, &grp->G );
+
+    ret = pka_release( &hpka, ret );
+
+cleanup:
+    return( ret );
+}
+
+#if ( ST_PKA_ECDH_POOL_SIZE > 0 )
+/* Exchange the key pair of slot with d and Q, no allocation involved */
+static void ecdh_pool_swap( ecdh_pool_slot_t *slot, mbedtls_mpi *d, mbedtls_ecp_point *Q )
+{
+    mbedtls_mpi_swap( &slot->d, d );
+    mbedtls_mpi_swap( &slot->Q.X, &Q->X );
+    mbedtls_mpi_swap( &slot->Q.Y, &Q->Y );
+    mbedtls_mpi_swap( &slot->Q.Z, &Q->Z );
+}
+
+/* Move a pooled key pair for curve id to d and Q. Returns 1 if one was found */
+static int ecdh_pool_take( mbedtls_ecp_group_id id, mbedtls_mpi *d, mbedtls_ecp_point *Q )
+{
+    int found = 0;
+    unsigned int i;
+
+    if ( id == MBEDTLS_ECP_DP_NONE )
+        return( 0 );
+
+    __disable_irq();
+
+    ecdh_pool_curve = id;
+
+    for ( i = 0; ( i < ST_PKA_ECDH_POOL_SIZE ) && !found; i++ )
+    {
+        if ( ecdh_pool[i].id == id )
+        {
+            /* The previous values of d and Q stay in the slot until the */
+            /* next pka_ecdh_pool_fill() frees them                      */
+            ecdh_pool_swap( &ecdh_pool[i], d, Q );
+            ecdh_pool[i].id = MBEDTLS_ECP_DP_NONE;
+            found = 1;
+        }
+    }
+
+    __enable_irq();
+
+    return( found );
+}
+
+int pka_ecdh_pool_fill( int (*f_rng)(void *, unsigned char *, size_t), void *p_rng )
+{
+    int ret;
+    int room = 0;
+    unsigned int i;
+    mbedtls_ecp_group_id id;
+    mbedtls_ecp_group grp;
+    mbedtls_mpi d;
+    mbedtls_ecp_point Q;
+
+    ECDH_VALIDATE_RET( f_rng != NULL );
+
+    /* Slots which are free or hold a key for another curve are refilled */
+    __disable_irq();
+
+    id = ecdh_pool_curve;
+
+    for ( i = 0; i < ST_PKA_ECDH_POOL_SIZE; i++ )
+        room |= ( ecdh_pool[i].id != id );
+
+    __enable_irq();
+
+    if ( !room )
+        return( 0 );
+
+    mbedtls_ecp_group_init( &grp );
+    mbedtls_mpi_init( &d );
+    mbedtls_ecp_point_init( &Q );
+
+    MBEDTLS_MPI_CHK( mbedtls_ecp_group_load( &grp, id ) );
+    MBEDTLS_MPI_CHK( ecdh_gen_public_compute( &grp, &d, &Q, f_rng, p_rng ) );
+
+    ret = 0;
+
+    __disable_irq();
+
+    /* The pair is dropped if the curve changed while it was generated */
+    for ( i = 0; ( i < ST_PKA_ECDH_POOL_SIZE ) && ( id == ecdh_pool_curve ) && ( ret == 0 ); i++ )
+    {
+        if ( ecdh_pool[i].id != id )
+        {
+            ecdh_pool_swap( &ecdh_pool[i], &d, &Q );
+            ecdh_pool[i].id = id;
+            ret = 1;
+        }
+    }
+
+    __enable_irq();
+
+cleanup:
+    /* d and Q now hold the previous content of the slot, if any */
+    mbedtls_ecp_group_free( &grp );
+    mbedtls_mpi_free( &d );
+    mbedtls_ecp_point_free( &Q );
+
+    return( ret );
+}
+#endif /* ST_PKA_ECDH_POOL_SIZE > 0 */
+
+int mbedtls_ecdh_gen_public( mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                     int (*f_rng)(void *, unsigned char *, size_t),
+                     void *p_rng )
+{
+    ECDH_VALIDATE_RET( grp != NULL );
+    ECDH_VALIDATE_RET( d != NULL );
+    ECDH_VALIDATE_RET( Q != NULL );
+    ECDH_VALIDATE_RET( f_rng != NULL );
+
+#if ( ST_PKA_ECDH_POOL_SIZE > 0 )
+    if( ecdh_pool_take( grp->id, d, Q ) )
+        return( 0 );
+#endif /* ST_PKA_ECDH_POOL_SIZE > 0 */
+
+    return( ecdh_gen_public_compute( grp, d, Q, f_rng, p_rng ) );
+}
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT */
+
+#if defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+/*
+ * Compute shared secret (SEC1 3.3.1): z = x( d Q )
+ */
+int mbedtls_ecdh_compute_shared( mbedtls_ecp_group *grp, mbedtls_mpi *z,
+                         const mbedtls_ecp_point *Q, const mbedtls_mpi *d,
+                         int (*f_rng)(void *, unsigned char *, size_t),
+                         void *p_rng )
+{
+    int ret;
+    mbedtls_ecp_point P;
+    const pka_curve_t *curve;
+    PKA_HandleTypeDef hpka;
+
+    ECDH_VALIDATE_RET( grp != NULL );
+    ECDH_VALIDATE_RET( Q != NULL );
+    ECDH_VALIDATE_RET( d != NULL );
+    ECDH_VALIDATE_RET( z != NULL );
+
+    mbedtls_ecp_point_init( &P );
+
+    if( !pka_grp_capable( grp ) )
+    {
+        pka_count_sw_op();
+        MBEDTLS_MPI_CHK( mbedtls_ecp_mul( grp, &P, d, Q, f_rng, p_rng ) );
+    }
+    else
+    {
+        /* The peer point is checked on the PKA as well, d is only range checked */
+        MBEDTLS_MPI_CHK( mbedtls_ecp_check_privkey( grp, d ) );
+
+        MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
+
+        ret = pka_curve_get( grp, &curve );
+
+        if( ret == 0 )
+            ret = pka_check_point( &hpka, grp, curve, Q );
+
+        if( ret == 0 )
+            ret = pka_ecc_mul( &hpka, grp, curve, &P, d, Q );
+
+        MBEDTLS_MPI_CHK( pka_release( &hpka, ret ) );
+    }
+
+    if( mbedtls_ecp_is_zero( &P ) )
+    {
+        ret = MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+        goto cleanup;
+    }
+
+    MBEDTLS_MPI_CHK( mbedtls_mpi_copy( z, &P.X ) );
+
+cleanup:
+    mbedtls_ecp_point_free( &P );
+
+    return( ret );
+}
+#endif /* MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
+
+/*
+ * Known answer test, RFC 5903 8.1: 256-bit random ECP group, private key i of
+ * the initiator drawn through pka_test_rng(), public key g^r of the responder
+ */
+static const unsigned char ecdh_test_i[32] =
+{
+    0xC8, 0x8F, 0x01, 0xF5, 0x10, 0xD9, 0xAC, 0x3F,
+    0x70, 0xA2, 0x92, 0xDA, 0xA2, 0x31, 0x6D, 0xE5,
+    0x44, 0xE9, 0xAA, 0xB8, 0xAF, 0xE8, 0x40, 0x49,
+    0xC6, 0x2A, 0x9C, 0x57, 0x86, 0x2D, 0x14, 0x33
+};
+
+static const unsigned char ecdh_test_gi[65] =
+{
+    0x04, 0xDA, 0xD0, 0xB6, 0x53, 0x94, 0x22, 0x1C,
+    0xF9, 0xB0, 0x51, 0xE1, 0xFE, 0xCA, 0x57, 0x87,
+    0xD0, 0x98, 0xDF, 0xE6, 0x37, 0xFC, 0x90, 0xB9,
+    0xEF, 0x94, 0x5D, 0x0C, 0x37, 0x72, 0x58, 0x11,
+    0x80, 0x52, 0x71, 0xA0, 0x46, 0x1C, 0xDB, 0x82,
+    0x52, 0xD6, 0x1F, 0x1C, 0x45, 0x6F, 0xA3, 0xE5,
+    0x9A, 0xB1, 0xF4, 0x5B, 0x33, 0xAC, 0xCF, 0x5F,
+    0x58, 0x38, 0x9E, 0x05, 0x77, 0xB8, 0x99, 0x0B,
+    0xB3
+};
+
+static const unsigned char ecdh_test_gr[65] =
+{
+    0x04, 0xD1, 0x2D, 0xFB, 0x52, 0x89, 0xC8, 0xD4,
+    0xF8, 0x12, 0x08, 0xB7, 0x02, 0x70, 0x39, 0x8C,
+    0x34, 0x22, 0x96, 0x97, 0x0A, 0x0B, 0xCC, 0xB7,
+    0x4C, 0x73, 0x6F, 0xC7, 0x55, 0x44, 0x94, 0xBF,
+    0x63, 0x56, 0xFB, 0xF3, 0xCA, 0x36, 0x6C, 0xC2,
+    0x3E, 0x81, 0x57, 0x85, 0x4C, 0x13, 0xC5, 0x8D,
+    0x6A, 0xAC, 0x23, 0xF0, 0x46, 0xAD, 0xA3, 0x0F,
+    0x83, 0x53, 0xE7, 0x4F, 0x33, 0x03, 0x98, 0x72,
+    0xAB
+};
+
+static const unsigned char ecdh_test_gir[32] =
+{
+    0xD6, 0x84, 0x0F, 0x6B, 0x42, 0xF6, 0xED, 0xAF,
+    0xD1, 0x31, 0x16, 0xE0, 0xE1, 0x25, 0x65, 0x20,
+    0x2F, 0xEF, 0x8E, 0x9E, 0xCE, 0x7D, 0xCE, 0x03,
+    0x81, 0x24, 0x64, 0xD0, 0x4B, 0x94, 0x42, 0xDE
+};
+
+int pka_ecdh_self_test( void )
+{
+    int ret;
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q, Q_exp;
+    mbedtls_mpi d, z, z_exp;
+    pka_test_rng_t rng = { ecdh_test_i, sizeof( ecdh_test_i ) };
+
+    mbedtls_ecp_group_init( &grp );
+    mbedtls_ecp_point_init( &Q ); mbedtls_ecp_point_init( &Q_exp );
+    mbedtls_mpi_init( &d ); mbedtls_mpi_init( &z ); mbedtls_mpi_init( &z_exp );
+
+    MBEDTLS_MPI_CHK( mbedtls_ecp_group_load( &grp, MBEDTLS_ECP_DP_SECP256R1 ) );
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+    /* Computed here rather than through mbedtls_ecdh_gen_public(), which may */
+    /* hand out a pooled key pair                                             */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( &grp, &Q_exp, ecdh_test_gi, sizeof( ecdh_test_gi ) ) );
+    MBEDTLS_MPI_CHK( ecdh_gen_public_compute( &grp, &d, &Q, pka_test_rng, &rng ) );
+
+    if( mbedtls_ecp_point_cmp( &Q, &Q_exp ) != 0 )
+    {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
+    }
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT */
+
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &d, ecdh_test_i, sizeof( ecdh_test_i ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( &grp, &Q, ecdh_test_gr, sizeof( ecdh_test_gr ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &z_exp, ecdh_test_gir, sizeof( ecdh_test_gir ) ) );
+
+    MBEDTLS_MPI_CHK( mbedtls_ecdh_compute_shared( &grp, &z, &Q, &d, pka_test_rng, &rng ) );
+
+    if( mbedtls_mpi_cmp_mpi( &z, &z_exp ) != 0 )
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+
+cleanup:
+    mbedtls_ecp_group_free( &grp );
+    mbedtls_ecp_point_free( &Q ); mbedtls_ecp_point_free( &Q_exp );
+    mbedtls_mpi_free( &d ); mbedtls_mpi_free( &z ); mbedtls_mpi_free( &z_exp );
+
+    return( ret );
+}
+
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT or MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
+#endif /* MBEDTLS_ECDH_C */
@@ -18,19 +18,30 @@
  *  limitations under the License.
  *
  *  This file implements ST ECDSA sign and verify HW services based on mbed TLS API
+ *
+ *  The PKA works on the stock mbed TLS group (MBEDTLS_ECP_ALT is not needed).
+ *  Curves the PKA cannot take, and all curves while pka_set_enabled( 0 ),
+ *  run the same algorithm on the mbed TLS bignum and ECP arithmetic.
  */
 
 /* Includes ------------------------------------------------------------------*/
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
 #include "mbedtls/ecdsa.h"
 
 #if defined(MBEDTLS_ECDSA_C)
+#if defined(MBEDTLS_ECDSA_SIGN_ALT) || defined(MBEDTLS_ECDSA_VERIFY_ALT)
+#include <string.h>
+
+#include "mbedtls/error.h"
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
-#include "stm32u5xx_hal.h"
+#include "pka_stm32.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-#define ST_ECDSA_TIMEOUT     (5000U)
+/* Maximum number of random draws of k before giving up                      */
+#define ST_ECDSA_MAX_TRIES   10
 
 /* Private macro -------------------------------------------------------------*/
 /* Parameter validation macros based on platform_util.h */
@@ -43,11 +54,125 @@
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
+/*
+ * Derive a suitable integer for group grp from a buffer of length len
+ * SEC1 4.1.3 step 5 aka SEC1 4.1.4 step 3
+ */
+static int ecdsa_derive_mpi( const mbedtls_ecp_group *grp, mbedtls_mpi *x,
+                             const unsigned char *buf, size_t blen )
+{
+    int ret;
+    size_t n_size = ( grp->nbits + 7 ) / 8;
+    size_t use_size = blen > n_size ? n_size : blen;
+
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( x, buf, use_size ) );
+    if( use_size * 8 > grp->nbits )
+        MBEDTLS_MPI_CHK( mbedtls_mpi_shift_r( x, use_size * 8 - grp->nbits ) );
+
+    /* While at it, reduce modulo N */
+    if( mbedtls_mpi_cmp_mpi( x, &grp->N ) >= 0 )
+        MBEDTLS_MPI_CHK( mbedtls_mpi_sub_mpi( x, x, &grp->N ) );
+
+cleanup:
+    return( ret );
+}
+
+/*
+ * The PKA reads the hash in an array of order size: pass it the truncated
+ * and reduced integer e instead of the caller's buffer
+ */
+static int ecdsa_hash_binary( const mbedtls_ecp_group *grp, uint8_t *e_binary,
+                              size_t order_size, const unsigned char *buf, size_t blen )
+{
+    int ret;
+    mbedtls_mpi e;
+
+    mbedtls_mpi_init( &e );
+
+    MBEDTLS_MPI_CHK( ecdsa_derive_mpi( grp, &e, buf, blen ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &e, e_binary, order_size ) );
+
+cleanup:
+    mbedtls_mpi_free( &e );
+    return( ret );
+}
+
 #if defined(MBEDTLS_ECDSA_SIGN_ALT)
 
-#if !defined(MBEDTLS_ECP_ALT)
-#error "MBEDTLS_ECP_ALT must be defined, if MBEDTLS_ECDSA_SIGN_ALT is"
-#endif
+/*
+ * Compute ECDSA signature of a hashed message (SEC1 4.1.3), software path
+ * Obviously, compared to SEC1 4.1.3, we skip step 4 (hash message)
+ */
+static int ecdsa_sign_sw( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
+                          const mbedtls_mpi *d, const unsigned char *buf, size_t blen,
+                          int (*f_rng)(void *, unsigned char *, size_t), void *p_rng )
+{
+    int ret, key_tries, sign_tries;
+    mbedtls_ecp_point R;
+    mbedtls_mpi k, e, t;
+
+    mbedtls_ecp_point_init( &R );
+    mbedtls_mpi_init( &k ); mbedtls_mpi_init( &e ); mbedtls_mpi_init( &t );
+
+    sign_tries = 0;
+    do
+    {
+        if( sign_tries++ > ST_ECDSA_MAX_TRIES )
+        {
+            ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+            goto cleanup;
+        }
+
+        /*
+         * Steps 1-3: generate a suitable ephemeral keypair
+         * and set r = xR mod n
+         */
+        key_tries = 0;
+        do
+        {
+            if( key_tries++ > ST_ECDSA_MAX_TRIES )
+            {
+                ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+                goto cleanup;
+            }
+
+            MBEDTLS_MPI_CHK( mbedtls_ecp_gen_privkey( grp, &k, f_rng, p_rng ) );
+            MBEDTLS_MPI_CHK( mbedtls_ecp_mul( grp, &R, &k, &grp->G, f_rng, p_rng ) );
+            MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( r, &R.X, &grp->N ) );
+        }
+        while( mbedtls_mpi_cmp_int( r, 0 ) == 0 );
+
+        /*
+         * Step 5: derive MPI from hashed message
+         */
+        MBEDTLS_MPI_CHK( ecdsa_derive_mpi( grp, &e, buf, blen ) );
+
+        /*
+         * Generate a random value to blind inv_mod in next step,
+         * avoiding a potential timing leak.
+         */
+        MBEDTLS_MPI_CHK( mbedtls_ecp_gen_privkey( grp, &t, f_rng, p_rng ) );
+
+        /*
+         * Step 6: compute s = (e + r * d) / k = t (e + rd) / (kt) mod n
+         */
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( s, r, d ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_add_mpi( &e, &e, s ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &e, &e, &t ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &k, &k, &t ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &k, &k, &grp->N ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_inv_mod( s, &k, &grp->N ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( s, s, &e ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( s, s, &grp->N ) );
+    }
+    while( mbedtls_mpi_cmp_int( s, 0 ) == 0 );
+
+cleanup:
+    mbedtls_ecp_point_free( &R );
+    mbedtls_mpi_free( &k ); mbedtls_mpi_free( &e ); mbedtls_mpi_free( &t );
+
+    return( ret );
+}
 
 /*
  * Compute ECDSA signature of a hashed message
@@ -57,11 +182,16 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
                 int (*f_rng)(void *, unsigned char *, size_t), void *p_rng )
 {
     int ret = 0;
-    uint8_t *d_binary;
-    uint8_t *k_binary = NULL;
+    uint8_t d_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t k_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t e_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t r_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t s_binary[MBEDTLS_ECP_MAX_BYTES];
+    size_t order_size;
 
     mbedtls_mpi k;
-    PKA_HandleTypeDef hpka = {0};
+    const pka_curve_t *curve;
+    PKA_HandleTypeDef hpka;
     PKA_ECDSASignInTypeDef ECDSA_SignIn = {0};
     PKA_ECDSASignOutTypeDef ECDSA_SignOut;
 
@@ -80,111 +210,148 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
     if( mbedtls_mpi_cmp_int( d, 1 ) < 0 || mbedtls_mpi_cmp_mpi( d, &grp->N ) >= 0 )
         return ( MBEDTLS_ERR_ECP_INVALID_KEY);
 
-    /* Set HW peripheral Input parameter: curve coefs */
-    ECDSA_SignIn.primeOrderSize = grp->st_order_size;
-    ECDSA_SignIn.modulusSize    = grp->st_modulus_size;
-    ECDSA_SignIn.modulus        = grp->st_p;
-    ECDSA_SignIn.coefSign       = grp->st_a_sign;
-    ECDSA_SignIn.coef           = grp->st_a_abs;
-    ECDSA_SignIn.basePointX     = grp->st_gx;
-    ECDSA_SignIn.basePointY     = grp->st_gy;
-    ECDSA_SignIn.primeOrder     = grp->st_n;
-
-    /* Set HW peripheral input parameter: hash content buffer to be signed */
-    ECDSA_SignIn.hash = buf;
+    if( !pka_grp_capable( grp ) )
+    {
+        pka_count_sw_op();
+        return( ecdsa_sign_sw( grp, r, s, d, buf, blen, f_rng, p_rng ) );
+    }
 
-    /* Set HW peripheral input parameter: private signing key */
-    d_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((d_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    order_size = mbedtls_mpi_size( &grp->N );
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( d, d_binary, grp->st_order_size ) );
+    /* Set HW peripheral input parameter: hash content, private signing key */
+    /* and random integer                                                   */
+    mbedtls_mpi_init( &k );
 
-    ECDSA_SignIn.privateKey = d_binary;
+    MBEDTLS_MPI_CHK( ecdsa_hash_binary( grp, e_binary, order_size, buf, blen ) );
 
-    /* Set HW peripheral input parameter: random integer */
-    mbedtls_mpi_init( &k );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( d, d_binary, order_size ) );
 
     MBEDTLS_MPI_CHK( mbedtls_ecp_gen_privkey( grp, &k, f_rng, p_rng ) );
 
-    k_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((k_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &k, k_binary, order_size ) );
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &k, k_binary, grp->st_order_size ) );
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    ECDSA_SignIn.integer = k_binary;
+    ret = pka_curve_get( grp, &curve );
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
+    if( ret == 0 )
+    {
+        /* Set HW peripheral Input parameter: curve coefs */
+        ECDSA_SignIn.primeOrderSize = curve->order_size;
+        ECDSA_SignIn.modulusSize    = curve->modulus_size;
+        ECDSA_SignIn.modulus        = curve->p;
+        ECDSA_SignIn.coefSign       = curve->a_sign;
+        ECDSA_SignIn.coef           = curve->a_abs;
+        ECDSA_SignIn.coefB          = curve->b;
+        ECDSA_SignIn.basePointX     = curve->gx;
+        ECDSA_SignIn.basePointY     = curve->gy;
+        ECDSA_SignIn.primeOrder     = curve->n;
+        ECDSA_SignIn.hash           = e_binary;
+        ECDSA_SignIn.privateKey     = d_binary;
+        ECDSA_SignIn.integer        = k_binary;
+
+        /* Launch the signature */
+        if( HAL_PKA_ECDSASign( &hpka, &ECDSA_SignIn, ST_PKA_TIMEOUT ) != HAL_OK )
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+        else
+        {
+            /* Get the signature */
+            ECDSA_SignOut.RSign = r_binary;
+            ECDSA_SignOut.SSign = s_binary;
+            HAL_PKA_ECDSASign_GetResult( &hpka, &ECDSA_SignOut, NULL );
+        }
+    }
 
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+    MBEDTLS_MPI_CHK( pka_release( &hpka, ret ) );
 
-    HAL_PKA_RAMReset(&hpka);
+    /* Convert the signature into mpi format */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( r, r_binary, order_size ) );
 
-    /* Launch the signature */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSASign(&hpka, &ECDSA_SignIn, ST_ECDSA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( s, s_binary, order_size ) );
 
-    /* Allocate memory space for signature */
-    ECDSA_SignOut.RSign = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((ECDSA_SignOut.RSign == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+cleanup:
+    /* Free memory */
+    mbedtls_mpi_free( &k );
 
-    ECDSA_SignOut.SSign = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((ECDSA_SignOut.SSign == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    mbedtls_platform_zeroize( d_binary, sizeof( d_binary ) );
+    mbedtls_platform_zeroize( k_binary, sizeof( k_binary ) );
 
-    /* Get the signature into allocated space */
-    HAL_PKA_ECDSASign_GetResult(&hpka, &ECDSA_SignOut, NULL);
+    return ret;
+}
 
-    /* Convert the signature into mpi format */
-    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( r, ECDSA_SignOut.RSign, grp->st_order_size ) );
+#endif /* MBEDTLS_ECDSA_SIGN_ALT*/
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( s, ECDSA_SignOut.SSign, grp->st_order_size ) );
+#if defined(MBEDTLS_ECDSA_VERIFY_ALT)
 
-cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
+/*
+ * Verify ECDSA signature of hashed message (SEC1 4.1.4), software path
+ * Obviously, compared to SEC1 4.1.3, we skip step 2 (hash message)
+ */
+static int ecdsa_verify_sw( mbedtls_ecp_group *grp,
+                            const unsigned char *buf, size_t blen,
+                            const mbedtls_ecp_point *Q,
+                            const mbedtls_mpi *r,
+                            const mbedtls_mpi *s )
+{
+    int ret;
+    mbedtls_mpi e, s_inv, u1, u2;
+    mbedtls_ecp_point R;
 
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    mbedtls_ecp_point_init( &R );
+    mbedtls_mpi_init( &e ); mbedtls_mpi_init( &s_inv );
+    mbedtls_mpi_init( &u1 ); mbedtls_mpi_init( &u2 );
 
-    /* Free memory */
-    mbedtls_mpi_free( &k );
+    /*
+     * Step 3: derive MPI from hashed message
+     */
+    MBEDTLS_MPI_CHK( ecdsa_derive_mpi( grp, &e, buf, blen ) );
 
-    if (d_binary != NULL)
-    {
-        mbedtls_platform_zeroize(d_binary, grp->st_order_size);
-        mbedtls_free(d_binary);
-    }
+    /*
+     * Step 4: u1 = e / s mod n, u2 = r / s mod n
+     */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_inv_mod( &s_inv, s, &grp->N ) );
 
-    if (k_binary != NULL)
-    {
-        mbedtls_platform_zeroize(k_binary, grp->st_order_size);
-        mbedtls_free(k_binary);
-    }
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &u1, &e, &s_inv ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &u1, &u1, &grp->N ) );
 
-    if (ECDSA_SignOut.RSign != NULL)
-    {
-        mbedtls_platform_zeroize(ECDSA_SignOut.RSign, grp->st_order_size);
-        mbedtls_free(ECDSA_SignOut.RSign);
-    }
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &u2, r, &s_inv ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &u2, &u2, &grp->N ) );
+
+    /*
+     * Step 5: R = u1 G + u2 Q
+     */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_muladd( grp, &R, &u1, &grp->G, &u2, Q ) );
 
-    if (ECDSA_SignOut.SSign != NULL)
+    if( mbedtls_ecp_is_zero( &R ) )
     {
-        mbedtls_platform_zeroize(ECDSA_SignOut.SSign, grp->st_order_size);
-        mbedtls_free(ECDSA_SignOut.SSign);
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
     }
 
-    return ret;
-}
-
-#endif /* MBEDTLS_ECDSA_SIGN_ALT*/
+    /*
+     * Step 6: convert xR to an integer (no-op)
+     * Step 7: reduce xR mod n (gives v)
+     */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &R.X, &R.X, &grp->N ) );
 
-#if defined(MBEDTLS_ECDSA_VERIFY_ALT)
+    /*
+     * Step 8: check if v (that is, R.X) is equal to r
+     */
+    if( mbedtls_mpi_cmp_mpi( &R.X, r ) != 0 )
+    {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
+    }
 
-#if !defined(MBEDTLS_ECP_ALT)
-#error "MBEDTLS_ECP_ALT must be defined, if MBEDTLS_ECDSA_VERIFY_ALT is"
-#endif
+cleanup:
+    mbedtls_ecp_point_free( &R );
+    mbedtls_mpi_free( &e ); mbedtls_mpi_free( &s_inv );
+    mbedtls_mpi_free( &u1 ); mbedtls_mpi_free( &u2 );
 
+    return( ret );
+}
 
 /*
  * Verify ECDSA signature of hashed message
@@ -197,11 +364,15 @@ int mbedtls_ecdsa_verify( mbedtls_ecp_group *grp,
 {
     int ret = 0;
     size_t olen;
-    uint8_t *Q_binary;
-    uint8_t *r_binary = NULL;
-    uint8_t *s_binary = NULL;
-    PKA_HandleTypeDef hpka = {0};
-    PKA_ECDSAVerifInTypeDef ECDSA_VerifyIn;
+    size_t order_size;
+    size_t pt_len;
+    uint8_t Q_binary[MBEDTLS_ECP_MAX_PT_LEN];
+    uint8_t e_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t r_binary[MBEDTLS_ECP_MAX_BYTES];
+    uint8_t s_binary[MBEDTLS_ECP_MAX_BYTES];
+    const pka_curve_t *curve;
+    PKA_HandleTypeDef hpka;
+    PKA_ECDSAVerifInTypeDef ECDSA_VerifyIn = {0};
 
     /* Check parameters */
     ECDSA_VALIDATE_RET( grp != NULL );
@@ -219,85 +390,174 @@ int mbedtls_ecdsa_verify( mbedtls_ecp_group *grp,
         mbedtls_mpi_cmp_int( s, 1 ) < 0 || mbedtls_mpi_cmp_mpi( s, &grp->N ) >= 0 )
         return( MBEDTLS_ERR_ECP_VERIFY_FAILED );
 
-    /* Set HW peripheral Input parameter: curve coefs */
-    ECDSA_VerifyIn.primeOrderSize = grp->st_order_size;
-    ECDSA_VerifyIn.modulusSize    = grp->st_modulus_size;
-    ECDSA_VerifyIn.modulus        = grp->st_p;
-    ECDSA_VerifyIn.coefSign       = grp->st_a_sign;
-    ECDSA_VerifyIn.coef           = grp->st_a_abs;
-    ECDSA_VerifyIn.basePointX     = grp->st_gx;
-    ECDSA_VerifyIn.basePointY     = grp->st_gy;
-    ECDSA_VerifyIn.primeOrder     = grp->st_n;
+    if( !pka_grp_capable( grp ) )
+    {
+        pka_count_sw_op();
+        return( ecdsa_verify_sw( grp, buf, blen, Q, r, s ) );
+    }
+
+    order_size = mbedtls_mpi_size( &grp->N );
+    pt_len = ( 2U * mbedtls_mpi_size( &grp->P ) ) + 1U;
 
     /* Set HW peripheral input parameter: hash content buffer that was signed */
-    ECDSA_VerifyIn.hash = buf;
+    MBEDTLS_MPI_CHK( ecdsa_hash_binary( grp, e_binary, order_size, buf, blen ) );
 
     /* Set HW peripheral input parameter: public key */
-    Q_binary = mbedtls_calloc( ( 2U * grp->st_modulus_size ) + 1U, sizeof( uint8_t ) );
-    MBEDTLS_MPI_CHK((Q_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, Q_binary, pt_len ) );
+    MBEDTLS_MPI_CHK( ( olen != pt_len ) ? MBEDTLS_ERR_ECP_BAD_INPUT_DATA : 0 );
 
-    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, Q_binary, ( 2U * grp->st_modulus_size ) + 1U ) );
+    /* Set HW peripheral input parameter: signature to be verified */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( r, r_binary, order_size ) );
 
-    ECDSA_VerifyIn.pPubKeyCurvePtX = Q_binary + 1U;
-    ECDSA_VerifyIn.pPubKeyCurvePtY = Q_binary + grp->st_modulus_size + 1U;
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( s, s_binary, order_size ) );
 
-    /* Set HW peripheral input parameter: signature to be verified */
-    r_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((r_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    s_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((s_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    ret = pka_curve_get( grp, &curve );
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( r, r_binary, grp->st_order_size ) );
-    ECDSA_VerifyIn.RSign = r_binary;
+    if( ret == 0 )
+    {
+        /* Set HW peripheral Input parameter: curve coefs */
+        ECDSA_VerifyIn.primeOrderSize  = curve->order_size;
+        ECDSA_VerifyIn.modulusSize     = curve->modulus_size;
+        ECDSA_VerifyIn.modulus         = curve->p;
+        ECDSA_VerifyIn.coefSign        = curve->a_sign;
+        ECDSA_VerifyIn.coef            = curve->a_abs;
+        ECDSA_VerifyIn.basePointX      = curve->gx;
+        ECDSA_VerifyIn.basePointY      = curve->gy;
+        ECDSA_VerifyIn.primeOrder      = curve->n;
+        ECDSA_VerifyIn.hash            = e_binary;
+        ECDSA_VerifyIn.pPubKeyCurvePtX = Q_binary + 1U;
+        ECDSA_VerifyIn.pPubKeyCurvePtY = Q_binary + curve->modulus_size + 1U;
+        ECDSA_VerifyIn.RSign           = r_binary;
+        ECDSA_VerifyIn.SSign           = s_binary;
+
+        /* Launch the signature verification */
+        if( HAL_PKA_ECDSAVerif( &hpka, &ECDSA_VerifyIn, ST_PKA_TIMEOUT ) != HAL_OK )
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+
+        /* Check the result */
+        else if( HAL_PKA_ECDSAVerif_IsValidSignature( &hpka ) != 1U )
+            ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+    }
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( s, s_binary, grp->st_order_size ) );
-    ECDSA_VerifyIn.SSign = s_binary;
+    ret = pka_release( &hpka, ret );
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
+cleanup:
+    return ret;
+}
 
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+#endif /* MBEDTLS_ECDSA_VERIFY_ALT*/
 
-    HAL_PKA_RAMReset(&hpka);
+/*
+ * Known answer test, RFC 6979 A.2.5: P-256 key, SHA-256 of "sample" and the
+ * deterministic k of the RFC, drawn through pka_test_rng()
+ */
+static const unsigned char ecdsa_test_d[32] =
+{
+    0xC9, 0xAF, 0xA9, 0xD8, 0x45, 0xBA, 0x75, 0x16,
+    0x6B, 0x5C, 0x21, 0x57, 0x67, 0xB1, 0xD6, 0x93,
+    0x4E, 0x50, 0xC3, 0xDB, 0x36, 0xE8, 0x9B, 0x12,
+    0x7B, 0x8A, 0x62, 0x2B, 0x12, 0x0F, 0x67, 0x21
+};
 
-    /* Launch the signature verification */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSAVerif(&hpka, &ECDSA_VerifyIn, ST_ECDSA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+static const unsigned char ecdsa_test_Q[65] =
+{
+    0x04, 0x60, 0xFE, 0xD4, 0xBA, 0x25, 0x5A, 0x9D,
+    0x31, 0xC9, 0x61, 0xEB, 0x74, 0xC6, 0x35, 0x6D,
+    0x68, 0xC0, 0x49, 0xB8, 0x92, 0x3B, 0x61, 0xFA,
+    0x6C, 0xE6, 0x69, 0x62, 0x2E, 0x60, 0xF2, 0x9F,
+    0xB6, 0x79, 0x03, 0xFE, 0x10, 0x08, 0xB8, 0xBC,
+    0x99, 0xA4, 0x1A, 0xE9, 0xE9, 0x56, 0x28, 0xBC,
+    0x64, 0xF2, 0xF1, 0xB2, 0x0C, 0x2D, 0x7E, 0x9F,
+    0x51, 0x77, 0xA3, 0xC2, 0x94, 0xD4, 0x46, 0x22,
+    0x99
+};
+
+static const unsigned char ecdsa_test_hash[32] =
+{
+    0xAF, 0x2B, 0xDB, 0xE1, 0xAA, 0x9B, 0x6E, 0xC1,
+    0xE2, 0xAD, 0xE1, 0xD6, 0x94, 0xF4, 0x1F, 0xC7,
+    0x1A, 0x83, 0x1D, 0x02, 0x68, 0xE9, 0x89, 0x15,
+    0x62, 0x11, 0x3D, 0x8A, 0x62, 0xAD, 0xD1, 0xBF
+};
 
-    /* Check the result */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSAVerif_IsValidSignature(&hpka) != 1U) ? MBEDTLS_ERR_ECP_VERIFY_FAILED : 0);
+static const unsigned char ecdsa_test_k[32] =
+{
+    0xA6, 0xE3, 0xC5, 0x7D, 0xD0, 0x1A, 0xBE, 0x90,
+    0x08, 0x65, 0x38, 0x39, 0x83, 0x55, 0xDD, 0x4C,
+    0x3B, 0x17, 0xAA, 0x87, 0x33, 0x82, 0xB0, 0xF2,
+    0x4D, 0x61, 0x29, 0x49, 0x3D, 0x8A, 0xAD, 0x60
+};
 
-cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
+static const unsigned char ecdsa_test_r[32] =
+{
+    0xEF, 0xD4, 0x8B, 0x2A, 0xAC, 0xB6, 0xA8, 0xFD,
+    0x11, 0x40, 0xDD, 0x9C, 0xD4, 0x5E, 0x81, 0xD6,
+    0x9D, 0x2C, 0x87, 0x7B, 0x56, 0xAA, 0xF9, 0x91,
+    0xC3, 0x4D, 0x0E, 0xA8, 0x4E, 0xAF, 0x37, 0x16
+};
 
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+static const unsigned char ecdsa_test_s[32] =
+{
+    0xF7, 0xCB, 0x1C, 0x94, 0x2D, 0x65, 0x7C, 0x41,
+    0xD4, 0x36, 0xC7, 0xA1, 0xB6, 0xE2, 0x9F, 0x65,
+    0xF3, 0xE9, 0x00, 0xDB, 0xB9, 0xAF, 0xF4, 0x06,
+    0x4D, 0xC4, 0xAB, 0x2F, 0x84, 0x3A, 0xCD, 0xA8
+};
 
-    /* Free memory */
-    if (Q_binary != NULL)
+int pka_ecdsa_self_test( void )
+{
+    int ret;
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q;
+    mbedtls_mpi d, r, s, r_exp, s_exp;
+    unsigned char hash[sizeof( ecdsa_test_hash )];
+    pka_test_rng_t rng = { ecdsa_test_k, sizeof( ecdsa_test_k ) };
+
+    mbedtls_ecp_group_init( &grp );
+    mbedtls_ecp_point_init( &Q );
+    mbedtls_mpi_init( &d ); mbedtls_mpi_init( &r ); mbedtls_mpi_init( &s );
+    mbedtls_mpi_init( &r_exp ); mbedtls_mpi_init( &s_exp );
+
+    MBEDTLS_MPI_CHK( mbedtls_ecp_group_load( &grp, MBEDTLS_ECP_DP_SECP256R1 ) );
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( &grp, &Q, ecdsa_test_Q, sizeof( ecdsa_test_Q ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &d, ecdsa_test_d, sizeof( ecdsa_test_d ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &r_exp, ecdsa_test_r, sizeof( ecdsa_test_r ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &s_exp, ecdsa_test_s, sizeof( ecdsa_test_s ) ) );
+
+    /* With the k of the RFC, the signature is the one of the RFC */
+    MBEDTLS_MPI_CHK( mbedtls_ecdsa_sign( &grp, &r, &s, &d, ecdsa_test_hash, sizeof( ecdsa_test_hash ),
+                                         pka_test_rng, &rng ) );
+
+    if( mbedtls_mpi_cmp_mpi( &r, &r_exp ) != 0 || mbedtls_mpi_cmp_mpi( &s, &s_exp ) != 0 )
     {
-        mbedtls_platform_zeroize(Q_binary, ( 2U * grp->st_modulus_size ) + 1U );
-        mbedtls_free(Q_binary);
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
     }
 
-    if (r_binary != NULL)
-    {
-        mbedtls_platform_zeroize(r_binary, grp->st_order_size);
-        mbedtls_free(r_binary);
-    }
+    MBEDTLS_MPI_CHK( mbedtls_ecdsa_verify( &grp, ecdsa_test_hash, sizeof( ecdsa_test_hash ),
+                                           &Q, &r_exp, &s_exp ) );
 
-    if (s_binary != NULL)
-    {
-        mbedtls_platform_zeroize(s_binary, grp->st_order_size);
-        mbedtls_free(s_binary);
-    }
+    /* The same signature on another hash must be rejected */
+    memcpy( hash, ecdsa_test_hash, sizeof( hash ) );
+    hash[0] ^= 0x01U;
 
-    return ret;
-}
+    ret = mbedtls_ecdsa_verify( &grp, hash, sizeof( hash ), &Q, &r_exp, &s_exp );
 
-#endif /* MBEDTLS_ECDSA_VERIFY_ALT*/
+    if( ret == MBEDTLS_ERR_ECP_VERIFY_FAILED )
+        ret = 0;
+    else if( ret == 0 )
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+
+cleanup:
+    mbedtls_ecp_group_free( &grp );
+    mbedtls_ecp_point_free( &Q );
+    mbedtls_mpi_free( &d ); mbedtls_mpi_free( &r ); mbedtls_mpi_free( &s );
+    mbedtls_mpi_free( &r_exp ); mbedtls_mpi_free( &s_exp );
+
+    return( ret );
+}
 
+#endif /* MBEDTLS_ECDSA_SIGN_ALT or MBEDTLS_ECDSA_VERIFY_ALT */
 #endif /* MBEDTLS_ECDSA_C */
@@ -28,6 +28,14 @@
 
 #include "mbedtls/platform_util.h"
 #include "mbedtls/platform.h"
+#include "mbedtls/error.h"
+
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "dma_copy.h"
+#endif
 
 
 /* Parameter validation macros */
@@ -45,11 +53,364 @@
                               /* a buffer multiple of 32 bits                 */
 #endif
 
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+/* GPDMA channels feeding the CRYP input and draining its output FIFO. With   */
+/* DMA_COPY_ENABLED they belong to dma_copy.c and are borrowed per request    */
+#define GCM_DMA_IN_CHANNEL       GPDMA1_Channel14
+#define GCM_DMA_IN_IRQn          GPDMA1_Channel14_IRQn
+#define GCM_DMA_OUT_CHANNEL      GPDMA1_Channel15
+#define GCM_DMA_OUT_IRQn         GPDMA1_Channel15_IRQn
+#define GCM_DMA_IRQ_PRIORITY     5U
+#endif /* ST_GCM_DMA_THRESHOLD > 0 */
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+static DMA_HandleTypeDef gcm_dma_in;
+static DMA_HandleTypeDef gcm_dma_out;
+static SemaphoreHandle_t gcm_dma_done = NULL;
+static StaticSemaphore_t gcm_dma_done_buffer;
+static volatile int gcm_dma_error = 0;
+static size_t gcm_dma_threshold = ST_GCM_DMA_THRESHOLD;
+#endif /* ST_GCM_DMA_THRESHOLD > 0 */
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+#if ( DMA_COPY_ENABLED != 1 )
+static void gcm_dma_in_irq_handler( void )
+{
+    HAL_DMA_IRQHandler( &gcm_dma_in );
+}
+
+static void gcm_dma_out_irq_handler( void )
+{
+    HAL_DMA_IRQHandler( &gcm_dma_out );
+}
+#endif /* DMA_COPY_ENABLED != 1 */
+
+/*
+ * Called by the HAL once the last output word was written by the DMA
+ */
+void HAL_CRYP_OutCpltCallback( CRYP_HandleTypeDef *hcryp )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ( void ) hcryp;
+
+    ( void ) xSemaphoreGiveFromISR( gcm_dma_done, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+void HAL_CRYP_ErrorCallback( CRYP_HandleTypeDef *hcryp )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ( void ) hcryp;
+
+    gcm_dma_error = 1;
+    ( void ) xSemaphoreGiveFromISR( gcm_dma_done, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+static int gcm_dma_channel_init( DMA_HandleTypeDef *hdma,
+                                 DMA_Channel_TypeDef *channel,
+                                 uint32_t request,
+                                 uint32_t direction )
+{
+    hdma->Instance = channel;
+    hdma->Init.Request = request;
+    hdma->Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    hdma->Init.Direction = direction;
+    hdma->Init.SrcInc = ( direction == DMA_MEMORY_TO_PERIPH ) ? DMA_SINC_INCREMENTED : DMA_SINC_FIXED;
+    hdma->Init.DestInc = ( direction == DMA_MEMORY_TO_PERIPH ) ? DMA_DINC_FIXED : DMA_DINC_INCREMENTED;
+    hdma->Init.SrcDataWidth = DMA_SRC_DATAWIDTH_WORD;
+    hdma->Init.DestDataWidth = DMA_DEST_DATAWIDTH_WORD;
+    hdma->Init.Priority = DMA_HIGH_PRIORITY;
+    hdma->Init.SrcBurstLength = 1;
+    hdma->Init.DestBurstLength = 1;
+    hdma->Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    hdma->Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    hdma->Init.Mode = DMA_NORMAL;
+
+    if ( HAL_DMA_Init( hdma ) != HAL_OK )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    if ( HAL_DMA_ConfigChannelAttributes( hdma, DMA_CHANNEL_NPRIV ) != HAL_OK )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    return( 0 );
+}
+
+/*
+ * Set up both DMA channels on first use, must be called with the CRYP lock held.
+ * With DMA_COPY_ENABLED the channels and their interrupts belong to dma_copy.c,
+ * they are set up for the CRYP each time gcm_dma_claim borrows them.
+ */
+static int gcm_dma_init( void )
+{
+    int ret = 0;
+
+    if ( gcm_dma_done != NULL )
+        return( 0 );
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+#if ( DMA_COPY_ENABLED != 1 )
+    ret = gcm_dma_channel_init( &gcm_dma_in, GCM_DMA_IN_CHANNEL,
+                                GPDMA1_REQUEST_AES_IN, DMA_MEMORY_TO_PERIPH );
+
+    if ( ret == 0 )
+        ret = gcm_dma_channel_init( &gcm_dma_out, GCM_DMA_OUT_CHANNEL,
+                                    GPDMA1_REQUEST_AES_OUT, DMA_PERIPH_TO_MEMORY );
+
+    if ( ret == 0 )
+    {
+        /* Set the vectors, requires sram located vector table */
+        NVIC_SetVector( GCM_DMA_IN_IRQn, ( uint32_t ) gcm_dma_in_irq_handler );
+        NVIC_SetVector( GCM_DMA_OUT_IRQn, ( uint32_t ) gcm_dma_out_irq_handler );
+
+        HAL_NVIC_SetPriority( GCM_DMA_IN_IRQn, GCM_DMA_IRQ_PRIORITY, 0 );
+        HAL_NVIC_EnableIRQ( GCM_DMA_IN_IRQn );
+        HAL_NVIC_SetPriority( GCM_DMA_OUT_IRQn, GCM_DMA_IRQ_PRIORITY, 0 );
+        HAL_NVIC_EnableIRQ( GCM_DMA_OUT_IRQn );
+    }
+#endif /* DMA_COPY_ENABLED != 1 */
+
+    if ( ret == 0 )
+        gcm_dma_done = xSemaphoreCreateBinaryStatic( &gcm_dma_done_buffer );
+
+    return( ret );
+}
+
+/*
+ * Make both DMA channels ready for a CRYP request, must be called with the
+ * CRYP lock held. Fails while a memory copy of dma_copy.c holds a channel,
+ * the caller then uses the polling path. Undone by gcm_dma_release.
+ */
+static int gcm_dma_claim( void )
+{
+    int ret = gcm_dma_init();
+
+#if ( DMA_COPY_ENABLED == 1 )
+    if ( ret != 0 )
+        return( ret );
+
+    if ( xDmaCopyLend( &gcm_dma_in, &gcm_dma_out ) != pdTRUE )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    ret = gcm_dma_channel_init( &gcm_dma_in, GCM_DMA_IN_CHANNEL,
+                                GPDMA1_REQUEST_AES_IN, DMA_MEMORY_TO_PERIPH );
+
+    if ( ret == 0 )
+        ret = gcm_dma_channel_init( &gcm_dma_out, GCM_DMA_OUT_CHANNEL,
+                                    GPDMA1_REQUEST_AES_OUT, DMA_PERIPH_TO_MEMORY );
+
+    if ( ret != 0 )
+        vDmaCopyReturn();
+#endif /* DMA_COPY_ENABLED == 1 */
+
+    return( ret );
+}
+
+static void gcm_dma_release( void )
+{
+#if ( DMA_COPY_ENABLED == 1 )
+    vDmaCopyReturn();
+#endif
+}
+
+/*
+ * Return the number of bytes of the next request which should be transferred
+ * by DMA, or 0 to use the polling path. DMA needs word aligned buffers and a
+ * running scheduler to block on; the partial last block is left to polling.
+ */
+static size_t gcm_dma_length( const unsigned char *input,
+                              const unsigned char *output,
+                              size_t length )
+{
+    size_t dma_len = length & ~( size_t ) 0xFU;
+
+    if ( ( length < gcm_dma_threshold ) ||
+         ( dma_len == 0 ) ||
+         ( ( ( ( uintptr_t ) input ) & 0x3U ) != 0 ) ||
+         ( ( ( ( uintptr_t ) output ) & 0x3U ) != 0 ) ||
+         ( xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ) )
+    {
+        dma_len = 0;
+    }
+    else if ( dma_len > ST_GCM_DMA_CHUNK_LEN )
+    {
+        dma_len = ST_GCM_DMA_CHUNK_LEN;
+    }
+
+    return( dma_len );
+}
+
+/*
+ * Feed length bytes to the CRYP by DMA and block until the output is written,
+ * must be called with the CRYP lock held and the channels claimed
+ */
+static int gcm_dma_process( mbedtls_gcm_context *ctx,
+                            const unsigned char *input,
+                            size_t length,
+                            unsigned char *output )
+{
+    HAL_StatusTypeDef status;
+    int ret = 0;
+
+    __HAL_LINKDMA( &ctx->hcryp_gcm, hdmain, gcm_dma_in );
+    __HAL_LINKDMA( &ctx->hcryp_gcm, hdmaout, gcm_dma_out );
+
+    gcm_dma_error = 0;
+    ( void ) xSemaphoreTake( gcm_dma_done, 0 );
+
+    if( ctx->mode == MBEDTLS_GCM_DECRYPT )
+    {
+        status = HAL_CRYP_Decrypt_DMA( &ctx->hcryp_gcm, (uint32_t *)input,
+                                       ( uint16_t ) length, (uint32_t *)output );
+    }
+    else
+    {
+        status = HAL_CRYP_Encrypt_DMA( &ctx->hcryp_gcm, (uint32_t *)input,
+                                       ( uint16_t ) length, (uint32_t *)output );
+    }
+
+    if ( status != HAL_OK )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    cryp_count_dma_transfer();
+
+    if ( xSemaphoreTake( gcm_dma_done, pdMS_TO_TICKS( ST_CRYP_TIMEOUT ) ) != pdTRUE )
+    {
+        ( void ) HAL_DMA_Abort( &gcm_dma_in );
+        ( void ) HAL_DMA_Abort( &gcm_dma_out );
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+    else if ( gcm_dma_error != 0 )
+    {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    return( ret );
+}
+
+void mbedtls_gcm_alt_set_dma_threshold( size_t threshold )
+{
+    gcm_dma_threshold = threshold;
+}
+
+size_t mbedtls_gcm_alt_get_dma_threshold( void )
+{
+    return( gcm_dma_threshold );
+}
+#endif /* ST_GCM_DMA_THRESHOLD > 0 */
+
+/*
+ * Save the payload phase state (counter and GHASH) of the context so that
+ * the CRYP can be used by another context before the next update
+ */
+static void gcm_suspend( mbedtls_gcm_context *ctx )
+{
+    AES_TypeDef *aes = ctx->hcryp_gcm.Instance;
+
+    ctx->ctx_save_cr = aes->CR;
+
+    ctx->ctx_save_ivr[0] = aes->IVR0;
+    ctx->ctx_save_ivr[1] = aes->IVR1;
+    ctx->ctx_save_ivr[2] = aes->IVR2;
+    ctx->ctx_save_ivr[3] = aes->IVR3;
+
+    ctx->ctx_save_susp[0] = aes->SUSP0R;
+    ctx->ctx_save_susp[1] = aes->SUSP1R;
+    ctx->ctx_save_susp[2] = aes->SUSP2R;
+    ctx->ctx_save_susp[3] = aes->SUSP3R;
+    ctx->ctx_save_susp[4] = aes->SUSP4R;
+    ctx->ctx_save_susp[5] = aes->SUSP5R;
+    ctx->ctx_save_susp[6] = aes->SUSP6R;
+    ctx->ctx_save_susp[7] = aes->SUSP7R;
+
+    ctx->ctx_suspended = 1;
+}
+
+/*
+ * Reload a context saved by gcm_suspend(): the key registers are write only
+ * so the key is written again from the context, followed by the counter and
+ * GHASH state, before the CRYP is re-enabled
+ */
+static void gcm_resume( mbedtls_gcm_context *ctx )
+{
+    AES_TypeDef *aes = ctx->hcryp_gcm.Instance;
+
+    aes->CR = ctx->ctx_save_cr & ~AES_CR_EN;
+
+    if ( ctx->hcryp_gcm.Init.KeySize == CRYP_KEYSIZE_256B )
+    {
+        aes->KEYR0 = ctx->gcm_key[7];
+        aes->KEYR1 = ctx->gcm_key[6];
+        aes->KEYR2 = ctx->gcm_key[5];
+        aes->KEYR3 = ctx->gcm_key[4];
+        aes->KEYR4 = ctx->gcm_key[3];
+        aes->KEYR5 = ctx->gcm_key[2];
+        aes->KEYR6 = ctx->gcm_key[1];
+        aes->KEYR7 = ctx->gcm_key[0];
+    }
+    else
+    {
+        aes->KEYR0 = ctx->gcm_key[3];
+        aes->KEYR1 = ctx->gcm_key[2];
+        aes->KEYR2 = ctx->gcm_key[1];
+        aes->KEYR3 = ctx->gcm_key[0];
+    }
+
+    aes->IVR0 = ctx->ctx_save_ivr[0];
+    aes->IVR1 = ctx->ctx_save_ivr[1];
+    aes->IVR2 = ctx->ctx_save_ivr[2];
+    aes->IVR3 = ctx->ctx_save_ivr[3];
+
+    aes->SUSP0R = ctx->ctx_save_susp[0];
+    aes->SUSP1R = ctx->ctx_save_susp[1];
+    aes->SUSP2R = ctx->ctx_save_susp[2];
+    aes->SUSP3R = ctx->ctx_save_susp[3];
+    aes->SUSP4R = ctx->ctx_save_susp[4];
+    aes->SUSP5R = ctx->ctx_save_susp[5];
+    aes->SUSP6R = ctx->ctx_save_susp[6];
+    aes->SUSP7R = ctx->ctx_save_susp[7];
+
+    aes->CR = ctx->ctx_save_cr;
+}
+
+/*
+ * Take the CRYP for ctx, restoring its state if another context used the
+ * CRYP since the last call with ctx
+ */
+static int gcm_acquire( mbedtls_gcm_context *ctx )
+{
+    int ret;
+
+    /* Protect context access                                  */
+    /* (it may occur at a same time in a threaded environment) */
+    ret = cryp_lock();
+    if( ret != 0 )
+        return( ret );
+
+    if ( !cryp_claim( ctx ) )
+    {
+        if ( ctx->ctx_suspended )
+        {
+            gcm_resume( ctx );
+        }
+        else
+        {
+            /* allow multi-context of CRYP use: restore context */
+            ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+        }
+    }
+
+    return( 0 );
+}
+
 /*
  * Initialize a context
  */
@@ -57,17 +418,7 @@ void mbedtls_gcm_init( mbedtls_gcm_context *ctx )
 {
     GCM_VALIDATE( ctx != NULL );
 
-    __disable_irq();
-#if defined(MBEDTLS_THREADING_C)
-    /* mutex cannot be initialized twice */
-if ( !cryp_mutex_started )
-{
-    mbedtls_mutex_init( &cryp_mutex );
-    cryp_mutex_started = 1;
-}
-#endif /* MBEDTLS_THREADING_C */
-    cryp_context_count++;
-    __enable_irq();
+    cryp_context_init();
 
     cryp_zeroize( (void*)ctx, sizeof(mbedtls_gcm_context) );
 }
@@ -85,10 +436,13 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
 
     /* Protect context access                                  */
     /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
+    ret = cryp_lock();
+    if( ret != 0 )
+        return( ret );
+
+    /* The CRYP is reinitialized below, any saved state is lost */
+    ( void ) cryp_claim( ctx );
+    ctx->ctx_suspended = 0;
 
     switch (keybits)
     {
@@ -145,35 +499,26 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
 
 exit :
     /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+    ret = cryp_unlock( ret );
 
     return( ret );
 }
 
 int mbedtls_gcm_starts( mbedtls_gcm_context *ctx,
-                int mode,
-                const unsigned char *iv,
-                size_t iv_len,
-                const unsigned char *add,
-                size_t add_len )
+                        int mode,
+                        const unsigned char *iv,
+                        size_t iv_len )
 {
     int ret = 0;
     unsigned int i;
-   __ALIGN_BEGIN static uint32_t iv_32B[4] __ALIGN_END;
 
     GCM_VALIDATE_RET( ctx != NULL );
-    GCM_VALIDATE_RET( mode != MBEDTLS_GCM_ENCRYPT || mode != MBEDTLS_GCM_DECRYPT );
+    GCM_VALIDATE_RET( mode == MBEDTLS_GCM_ENCRYPT || mode == MBEDTLS_GCM_DECRYPT );
     GCM_VALIDATE_RET( iv != NULL );
-    GCM_VALIDATE_RET( add_len == 0 || add != NULL );
 
-    /* IV and AD are limited to 2^64 bits, so 2^61 bytes */
+    /* IV is limited to 2^64 bits, so 2^61 bytes */
     /* IV is not allowed to be zero length */
-    if( iv_len == 0 ||
-      ( (uint64_t) iv_len  ) >> 61 != 0 ||
-      ( (uint64_t) add_len ) >> 61 != 0 )
+    if( iv_len == 0 || ( (uint64_t) iv_len ) >> 61 != 0 )
     {
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
     }
@@ -184,59 +529,46 @@ int mbedtls_gcm_starts( mbedtls_gcm_context *ctx,
         return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
     }
 
-#if !defined(STM32_AAD_ANY_LENGTH_SUPPORT)
-    /* implementation restrict support to a buffer multiple of 32 bits */
-    if ((add_len % AAD_WORD_ALIGN) != 0U)
-    {
-        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
-    }
-#endif
-
     /* Protect context access                                  */
     /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
+    ret = cryp_lock();
+    if( ret != 0 )
+        return( ret );
 
-    if ( HAL_CRYP_Init( &ctx->hcryp_gcm ) != HAL_OK )
+    /* A new message discards any suspended payload state. The CRYP only */
+    /* needs to be reinitialized if another context used it meanwhile.  */
+    ctx->ctx_suspended = 0;
+
+    if ( !cryp_claim( ctx ) )
     {
-        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        goto exit;
-    }
+        if ( HAL_CRYP_Init( &ctx->hcryp_gcm ) != HAL_OK )
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            goto exit;
+        }
 
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+        /* allow multi-context of CRYP use: restore context */
+        ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+    }
 
     ctx->mode = mode;
     ctx->len = 0;
+    ctx->started = 0;
 
-    /* Set IV with invert endianness */
+    /* Set IV with invert endianness. The IV is kept in the context as */
+    /* the HAL only loads it on the first request.                     */
     for( i=0; i < 3; i++ )
-        GET_UINT32_BE( iv_32B[i], iv, 4*i );
+        GET_UINT32_BE( ctx->gcm_iv[i], iv, 4*i );
 
     /* According to NIST specification, the counter value is 0x2 when
        processing the first block of payload */
-    iv_32B[3] = 0x00000002;
+    ctx->gcm_iv[3] = 0x00000002;
 
-    ctx->hcryp_gcm.Init.pInitVect = iv_32B;
+    ctx->hcryp_gcm.Init.pInitVect = ctx->gcm_iv;
 
-    if ( add_len > 0 )
-    {
-        ctx->hcryp_gcm.Init.Header = (uint32_t *)add;
-#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
-        /* header buffer in byte length */
-        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)add_len;
-#else
-        /* header buffer in word length */
-        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)(add_len/AAD_WORD_ALIGN);
-#endif
-    }
-    else
-    {
-      ctx->hcryp_gcm.Init.Header = NULL;
-      ctx->hcryp_gcm.Init.HeaderSize = 0;
-    }
+    /* The additional data, if any, is given by mbedtls_gcm_update_ad() */
+    ctx->hcryp_gcm.Init.Header = NULL;
+    ctx->hcryp_gcm.Init.HeaderSize = 0;
 
 #if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
     /* Additional Authentication Data in bytes unit */
@@ -258,28 +590,131 @@ int mbedtls_gcm_starts( mbedtls_gcm_context *ctx,
 
 exit:
     /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+    ret = cryp_unlock( ret );
+
+    return( ret );
+}
+
+/*
+ * Run one polling request of the current message, must be called with the
+ * CRYP lock held. The first request of a message also runs the init phase
+ * and the header phase over ctx->hcryp_gcm.Init.Header, length may be 0.
+ */
+static int gcm_process( mbedtls_gcm_context *ctx,
+                        const unsigned char *input,
+                        size_t length,
+                        unsigned char *output )
+{
+    HAL_StatusTypeDef status;
+
+    if( ctx->mode == MBEDTLS_GCM_DECRYPT )
+    {
+        status = HAL_CRYP_Decrypt( &ctx->hcryp_gcm, (uint32_t *)input, length,
+                                   (uint32_t *)output, ST_CRYP_TIMEOUT );
+    }
+    else
+    {
+        status = HAL_CRYP_Encrypt( &ctx->hcryp_gcm, (uint32_t *)input, length,
+                                   (uint32_t *)output, ST_CRYP_TIMEOUT );
+    }
+
+    if ( status != HAL_OK )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    ctx->started = 1;
+
+    return( 0 );
+}
+
+/*
+ * The CRYP runs the header phase once per message, before the payload:
+ * this implementation takes the additional data in a single call, made
+ * before the first mbedtls_gcm_update()
+ */
+int mbedtls_gcm_update_ad( mbedtls_gcm_context *ctx,
+                           const unsigned char *add,
+                           size_t add_len )
+{
+    int ret;
+
+    GCM_VALIDATE_RET( ctx != NULL );
+    GCM_VALIDATE_RET( add_len == 0 || add != NULL );
+
+    if( add_len == 0 )
+        return( 0 );
+
+    /* AD is limited to 2^64 bits, so 2^61 bytes */
+    if( ( (uint64_t) add_len ) >> 61 != 0 )
+        return( MBEDTLS_ERR_GCM_BAD_INPUT );
+
+    if( ctx->started )
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
+
+#if !defined(STM32_AAD_ANY_LENGTH_SUPPORT)
+    /* implementation restrict support to a buffer multiple of 32 bits */
+    if ((add_len % AAD_WORD_ALIGN) != 0U)
+    {
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
+    }
+#endif
+
+    ret = gcm_acquire( ctx );
+    if( ret != 0 )
+        return( ret );
+
+    ctx->hcryp_gcm.Init.Header = (uint32_t *)add;
+#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
+    /* header buffer in byte length */
+    ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)add_len;
+#else
+    /* header buffer in word length */
+    ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)(add_len/AAD_WORD_ALIGN);
+#endif
+
+    /* Header phase only, the caller may release add once this returns. */
+    /* HeaderSize is kept, the tag covers the length of the header.      */
+    ret = gcm_process( ctx, NULL, 0, NULL );
+    ctx->hcryp_gcm.Init.Header = NULL;
+
+    /* allow multi-context of CRYP : save context */
+    if( ret == 0 )
+        gcm_suspend( ctx );
+
+    /* Free context access */
+    ret = cryp_unlock( ret );
 
     return( ret );
 }
 
+/*
+ * The output is immediate, input_length bytes are written to output. The
+ * CRYP pads a partial block, so only the last update of a message may have
+ * an input_length which is not a multiple of 16.
+ */
 int mbedtls_gcm_update( mbedtls_gcm_context *ctx,
-                size_t length,
-                const unsigned char *input,
-                unsigned char *output )
+                        const unsigned char *input, size_t input_length,
+                        unsigned char *output, size_t output_size,
+                        size_t *output_length )
 {
     int ret = 0;
+    size_t length = input_length;
 
     GCM_VALIDATE_RET( ctx != NULL );
     GCM_VALIDATE_RET( length == 0 || input != NULL );
     GCM_VALIDATE_RET( length == 0 || output != NULL );
+    GCM_VALIDATE_RET( output_length != NULL );
+
+    *output_length = 0;
+
+    if( output_size < input_length )
+        return( MBEDTLS_ERR_GCM_BUFFER_TOO_SMALL );
 
     if( output > input && (size_t) ( output - input ) < length )
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
+    if( length == 0 )
+        return( 0 );
+
     /* Total length is restricted to 2^39 - 256 bits, ie 2^36 - 2^5 bytes
      * Also check for possible overflow */
     if( ( (ctx->len + length) < ctx->len ) ||
@@ -288,78 +723,104 @@ int mbedtls_gcm_update( mbedtls_gcm_context *ctx,
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
     }
 
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
-
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+    /* The previous update ended on a padded partial block */
+    if( ( ctx->len % 16U ) != 0U )
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
 
     ctx->len += length;
 
-    if( ctx->mode == MBEDTLS_GCM_DECRYPT )
-    {
-         if ( HAL_CRYP_Decrypt( &ctx->hcryp_gcm,
-                               (uint32_t *)input,
-                               length,
-                               (uint32_t *)output,
-                               ST_CRYP_TIMEOUT ) != HAL_OK )
-         {
-            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            goto exit;
-         }
-    }
-    else
+    /* Process the payload in chunks, releasing the CRYP in between so that */
+    /* other contexts are not blocked for the whole length                  */
+    do
     {
-         if ( HAL_CRYP_Encrypt( &ctx->hcryp_gcm,
-                               (uint32_t *)input,
-                               length,
-                               (uint32_t *)output,
-                               ST_CRYP_TIMEOUT ) != HAL_OK )
-         {
-            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            goto exit;
-         }
-    }
+        size_t chunk = ( length > ST_GCM_CHUNK_LEN ) ? ST_GCM_CHUNK_LEN : length;
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+        size_t dma_chunk = gcm_dma_length( input, output, length );
 
-    /* allow multi-context of CRYP : save context */
-    ctx->ctx_save_cr = ctx->hcryp_gcm.Instance->CR;
+        if ( dma_chunk > 0 )
+            chunk = dma_chunk;
+#endif
 
-exit:
-    /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+        ret = gcm_acquire( ctx );
+        if( ret != 0 )
+            return( ret );
+
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+        if ( ( dma_chunk > 0 ) && ( gcm_dma_claim() != 0 ) )
+        {
+            /* A memory copy holds the channels or they failed to set up, poll */
+            dma_chunk = 0;
+            chunk = ( length > ST_GCM_CHUNK_LEN ) ? ST_GCM_CHUNK_LEN : length;
+        }
+
+        if ( dma_chunk > 0 )
+        {
+            ret = gcm_dma_process( ctx, input, chunk, output );
+            gcm_dma_release();
+
+            if( ret == 0 )
+                ctx->started = 1;
+        }
+        else
+#endif
+        {
+            ret = gcm_process( ctx, input, chunk, output );
+        }
+
+        /* allow multi-context of CRYP : save context */
+        if( ret == 0 )
+            gcm_suspend( ctx );
+
+        /* Free context access */
+        ret = cryp_unlock( ret );
+
+        input += chunk;
+        output += chunk;
+        length -= chunk;
+    }
+    while( ( ret == 0 ) && ( length > 0 ) );
+
+    if( ret == 0 )
+        *output_length = input_length;
 
     return( ret );
 }
 
 int mbedtls_gcm_finish( mbedtls_gcm_context *ctx,
-                unsigned char *tag,
-                size_t tag_len )
+                        unsigned char *output, size_t output_size,
+                        size_t *output_length,
+                        unsigned char *tag, size_t tag_len )
 {
     int ret = 0;
     __ALIGN_BEGIN uint8_t mac[16]      __ALIGN_END; /* temporary mac         */
 
     GCM_VALIDATE_RET( ctx != NULL );
+    GCM_VALIDATE_RET( output_length != NULL );
     GCM_VALIDATE_RET( tag != NULL );
 
+    /* The updates do not buffer any input, there is nothing left to output */
+    ( void ) output;
+    ( void ) output_size;
+    *output_length = 0;
+
     if( tag_len > 16 || tag_len < 4 )
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
+    ret = gcm_acquire( ctx );
+    if( ret != 0 )
+        return( ret );
 
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+    /* Neither additional data nor payload: the init phase is still to run */
+    if( !ctx->started )
+    {
+        ret = gcm_process( ctx, NULL, 0, NULL );
+        if( ret != 0 )
+            goto exit;
+    }
+
+    /* The message is complete, its payload state is no longer needed */
+    ctx->ctx_suspended = 0;
+    ctx->started = 0;
 
     /* Tag has a variable length */
     memset(mac, 0, sizeof(mac));
@@ -380,10 +841,7 @@ int mbedtls_gcm_finish( mbedtls_gcm_context *ctx,
 
 exit:
     /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+    ret = cryp_unlock( ret );
 
     return( ret );
 }
@@ -401,6 +859,7 @@ int mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx,
                        unsigned char *tag )
 {
     int ret;
+    size_t olen;
 
     GCM_VALIDATE_RET( ctx != NULL );
     GCM_VALIDATE_RET( iv != NULL );
@@ -409,13 +868,17 @@ int mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx,
     GCM_VALIDATE_RET( length == 0 || output != NULL );
     GCM_VALIDATE_RET( tag != NULL );
 
-    if( ( ret = mbedtls_gcm_starts( ctx, mode, iv, iv_len, add, add_len ) ) != 0 )
+    if( ( ret = mbedtls_gcm_starts( ctx, mode, iv, iv_len ) ) != 0 )
         return( ret );
 
-    if( ( ret = mbedtls_gcm_update( ctx, length, input, output ) ) != 0 )
+    if( ( ret = mbedtls_gcm_update_ad( ctx, add, add_len ) ) != 0 )
         return( ret );
 
-    if( ( ret = mbedtls_gcm_finish( ctx, tag, tag_len ) ) != 0 )
+    if( ( ret = mbedtls_gcm_update( ctx, input, length,
+                                    output, length, &olen ) ) != 0 )
+        return( ret );
+
+    if( ( ret = mbedtls_gcm_finish( ctx, NULL, 0, &olen, tag, tag_len ) ) != 0 )
         return( ret );
 
     return( 0 );
@@ -469,24 +932,241 @@ void mbedtls_gcm_free( mbedtls_gcm_context *ctx )
     if( ctx == NULL )
         return;
 
-    __disable_irq();
-    if ( cryp_context_count > 0 )
-        cryp_context_count--;
+    /* Shut down CRYP on last context */
+    if ( cryp_context_free( ctx ) )
+        HAL_CRYP_DeInit( &ctx->hcryp_gcm );
+
+    cryp_zeroize( (void*)ctx, sizeof(mbedtls_gcm_context) );
+}
 
-#if defined(MBEDTLS_THREADING_C)
-    if ( cryp_mutex_started )
+/*
+ * Known answer test: test cases 1, 2 and 4 of D. McGrew, J. Viega, "The
+ * Galois/Counter Mode of Operation (GCM)", and the tag of a 2048 byte
+ * message (test case 4 key, IV and additional data, byte i of the
+ * plaintext is i & 0xFF) computed with OpenSSL
+ */
+#define GCM_TEST_BIG_LEN    2048U
+
+/* Key, IV and plaintext of test cases 1 and 2 */
+static const unsigned char gcm_test_zero[16] = { 0 };
+
+static const unsigned char gcm_test_tag1[16] =
+{
+    0x58, 0xE2, 0xFC, 0xCE, 0xFA, 0x7E, 0x30, 0x61,
+    0x36, 0x7F, 0x1D, 0x57, 0xA4, 0xE7, 0x45, 0x5A
+};
+
+static const unsigned char gcm_test_ct2[16] =
+{
+    0x03, 0x88, 0xDA, 0xCE, 0x60, 0xB6, 0xA3, 0x92,
+    0xF3, 0x28, 0xC2, 0xB9, 0x71, 0xB2, 0xFE, 0x78
+};
+
+static const unsigned char gcm_test_tag2[16] =
+{
+    0xAB, 0x6E, 0x47, 0xD4, 0x2C, 0xEC, 0x13, 0xBD,
+    0xF5, 0x3A, 0x67, 0xB2, 0x12, 0x57, 0xBD, 0xDF
+};
+
+static const unsigned char gcm_test_key4[16] =
+{
+    0xFE, 0xFF, 0xE9, 0x92, 0x86, 0x65, 0x73, 0x1C,
+    0x6D, 0x6A, 0x8F, 0x94, 0x67, 0x30, 0x83, 0x08
+};
+
+static const unsigned char gcm_test_iv4[12] =
+{
+    0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD,
+    0xDE, 0xCA, 0xF8, 0x88
+};
+
+static const unsigned char gcm_test_add4[20] =
+{
+    0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF,
+    0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF,
+    0xAB, 0xAD, 0xDA, 0xD2
+};
+
+static const unsigned char gcm_test_pt4[60] =
+{
+    0xD9, 0x31, 0x32, 0x25, 0xF8, 0x84, 0x06, 0xE5,
+    0xA5, 0x59, 0x09, 0xC5, 0xAF, 0xF5, 0x26, 0x9A,
+    0x86, 0xA7, 0xA9, 0x53, 0x15, 0x34, 0xF7, 0xDA,
+    0x2E, 0x4C, 0x30, 0x3D, 0x8A, 0x31, 0x8A, 0x72,
+    0x1C, 0x3C, 0x0C, 0x95, 0x95, 0x68, 0x09, 0x53,
+    0x2F, 0xCF, 0x0E, 0x24, 0x49, 0xA6, 0xB5, 0x25,
+    0xB1, 0x6A, 0xED, 0xF5, 0xAA, 0x0D, 0xE6, 0x57,
+    0xBA, 0x63, 0x7B, 0x39
+};
+
+static const unsigned char gcm_test_ct4[60] =
+{
+    0x42, 0x83, 0x1E, 0xC2, 0x21, 0x77, 0x74, 0x24,
+    0x4B, 0x72, 0x21, 0xB7, 0x84, 0xD0, 0xD4, 0x9C,
+    0xE3, 0xAA, 0x21, 0x2F, 0x2C, 0x02, 0xA4, 0xE0,
+    0x35, 0xC1, 0x7E, 0x23, 0x29, 0xAC, 0xA1, 0x2E,
+    0x21, 0xD5, 0x14, 0xB2, 0x54, 0x66, 0x93, 0x1C,
+    0x7D, 0x8F, 0x6A, 0x5A, 0xAC, 0x84, 0xAA, 0x05,
+    0x1B, 0xA3, 0x0B, 0x39, 0x6A, 0x0A, 0xAC, 0x97,
+    0x3D, 0x58, 0xE0, 0x91
+};
+
+static const unsigned char gcm_test_tag4[16] =
+{
+    0x5B, 0xC9, 0x4F, 0xBC, 0x32, 0x21, 0xA5, 0xDB,
+    0x94, 0xFA, 0xE9, 0x5A, 0xE7, 0x12, 0x1A, 0x47
+};
+
+static const unsigned char gcm_test_tag_big[16] =
+{
+    0x3E, 0x8D, 0x18, 0xDA, 0x8A, 0x44, 0x34, 0x7A,
+    0xD8, 0xCB, 0x34, 0x82, 0xD9, 0xFE, 0x6D, 0xB9
+};
+
+/*
+ * Run one message through ctx, compare the output with expected unless it
+ * is NULL, and the tag with tag
+ */
+static int gcm_test_message( mbedtls_gcm_context *ctx, int mode,
+                             const unsigned char *iv,
+                             const unsigned char *add, size_t add_len,
+                             const unsigned char *input, size_t length,
+                             unsigned char *output,
+                             const unsigned char *expected,
+                             const unsigned char *tag )
+{
+    unsigned char check_tag[16];
+    int ret;
+
+    ret = mbedtls_gcm_crypt_and_tag( ctx, mode, length, iv, IV_LENGTH, add, add_len,
+                                     input, output, sizeof( check_tag ), check_tag );
+
+    if( ( ret == 0 ) &&
+        ( ( memcmp( check_tag, tag, sizeof( check_tag ) ) != 0 ) ||
+          ( ( expected != NULL ) && ( memcmp( output, expected, length ) != 0 ) ) ) )
     {
-        mbedtls_mutex_free( &cryp_mutex );
-        cryp_mutex_started = 0;
+        ret = MBEDTLS_ERR_GCM_AUTH_FAILED;
     }
-#endif /* MBEDTLS_THREADING_C */
-    __enable_irq();
 
-    /* Shut down CRYP on last context */
-    if ( cryp_context_count == 0 )
-        HAL_CRYP_DeInit( &ctx->hcryp_gcm );
+    return( ret );
+}
 
-    cryp_zeroize( (void*)ctx, sizeof(mbedtls_gcm_context) );
+int cryp_gcm_self_test( void )
+{
+    mbedtls_gcm_context ctx;
+    mbedtls_gcm_context other;
+    __ALIGN_BEGIN unsigned char buf[sizeof( gcm_test_ct4 )] __ALIGN_END;
+    unsigned char tag[16];
+    unsigned char *big_pt = NULL;
+    unsigned char *big_ct = NULL;
+    size_t olen;
+    size_t i;
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+    size_t threshold = mbedtls_gcm_alt_get_dma_threshold();
+    int pass;
+#endif
+    int ret;
+
+    mbedtls_gcm_init( &ctx );
+    mbedtls_gcm_init( &other );
+
+    ret = mbedtls_gcm_setkey( &ctx, MBEDTLS_CIPHER_ID_AES, gcm_test_key4, 128 );
+    if( ret == 0 )
+        ret = mbedtls_gcm_setkey( &other, MBEDTLS_CIPHER_ID_AES, gcm_test_zero, 128 );
+    if( ret != 0 )
+        goto exit;
+
+    /* Test case 1 has neither additional data nor payload */
+    ret = gcm_test_message( &other, MBEDTLS_GCM_ENCRYPT, gcm_test_zero, NULL, 0,
+                            NULL, 0, buf, NULL, gcm_test_tag1 );
+    if( ret == 0 )
+        ret = gcm_test_message( &other, MBEDTLS_GCM_ENCRYPT, gcm_test_zero, NULL, 0,
+                                gcm_test_zero, sizeof( gcm_test_zero ), buf,
+                                gcm_test_ct2, gcm_test_tag2 );
+    if( ret == 0 )
+        ret = gcm_test_message( &ctx, MBEDTLS_GCM_ENCRYPT, gcm_test_iv4,
+                                gcm_test_add4, sizeof( gcm_test_add4 ),
+                                gcm_test_pt4, sizeof( gcm_test_pt4 ), buf,
+                                gcm_test_ct4, gcm_test_tag4 );
+    if( ret == 0 )
+        ret = gcm_test_message( &ctx, MBEDTLS_GCM_DECRYPT, gcm_test_iv4,
+                                gcm_test_add4, sizeof( gcm_test_add4 ),
+                                gcm_test_ct4, sizeof( gcm_test_ct4 ), buf,
+                                gcm_test_pt4, gcm_test_tag4 );
+    if( ret != 0 )
+        goto exit;
+
+    /* Test case 4 in two updates with a message of another context in     */
+    /* between, the payload state of ctx is suspended and resumed           */
+    ret = mbedtls_gcm_starts( &ctx, MBEDTLS_GCM_ENCRYPT, gcm_test_iv4, sizeof( gcm_test_iv4 ) );
+    if( ret == 0 )
+        ret = mbedtls_gcm_update_ad( &ctx, gcm_test_add4, sizeof( gcm_test_add4 ) );
+    if( ret == 0 )
+        ret = mbedtls_gcm_update( &ctx, gcm_test_pt4, 32, buf, sizeof( buf ), &olen );
+    if( ret == 0 )
+        ret = gcm_test_message( &other, MBEDTLS_GCM_ENCRYPT, gcm_test_zero, NULL, 0,
+                                gcm_test_zero, sizeof( gcm_test_zero ), tag,
+                                gcm_test_ct2, gcm_test_tag2 );
+    if( ret == 0 )
+        ret = mbedtls_gcm_update( &ctx, gcm_test_pt4 + 32, sizeof( gcm_test_pt4 ) - 32,
+                                  buf + 32, sizeof( buf ) - 32, &olen );
+    if( ret == 0 )
+        ret = mbedtls_gcm_finish( &ctx, NULL, 0, &olen, tag, sizeof( tag ) );
+    if( ( ret == 0 ) &&
+        ( ( memcmp( buf, gcm_test_ct4, sizeof( buf ) ) != 0 ) ||
+          ( memcmp( tag, gcm_test_tag4, sizeof( tag ) ) != 0 ) ) )
+    {
+        ret = MBEDTLS_ERR_GCM_AUTH_FAILED;
+    }
+    if( ret != 0 )
+        goto exit;
+
+    /* Longer than ST_GCM_CHUNK_LEN and the default DMA threshold */
+    big_pt = mbedtls_calloc( 1, GCM_TEST_BIG_LEN );
+    big_ct = mbedtls_calloc( 1, GCM_TEST_BIG_LEN );
+    if( ( big_pt == NULL ) || ( big_ct == NULL ) )
+    {
+        ret = MBEDTLS_ERR_CIPHER_ALLOC_FAILED;
+        goto exit;
+    }
+
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+    /* First the polling path in chunks, then the DMA path */
+    for( pass = 0; ( ret == 0 ) && ( pass < 2 ); pass++ )
+    {
+        mbedtls_gcm_alt_set_dma_threshold( ( pass == 0 ) ? SIZE_MAX : ST_GCM_DMA_THRESHOLD );
+#endif
+        for( i = 0; i < GCM_TEST_BIG_LEN; i++ )
+            big_pt[i] = ( unsigned char ) i;
+
+        /* The tag covers the ciphertext, decrypting it back checks the output */
+        ret = gcm_test_message( &ctx, MBEDTLS_GCM_ENCRYPT, gcm_test_iv4,
+                                gcm_test_add4, sizeof( gcm_test_add4 ),
+                                big_pt, GCM_TEST_BIG_LEN, big_ct, NULL, gcm_test_tag_big );
+        if( ret == 0 )
+            ret = gcm_test_message( &ctx, MBEDTLS_GCM_DECRYPT, gcm_test_iv4,
+                                    gcm_test_add4, sizeof( gcm_test_add4 ),
+                                    big_ct, GCM_TEST_BIG_LEN, big_pt, NULL, gcm_test_tag_big );
+
+        for( i = 0; ( ret == 0 ) && ( i < GCM_TEST_BIG_LEN ); i++ )
+        {
+            if( big_pt[i] != ( unsigned char ) i )
+                ret = MBEDTLS_ERR_GCM_AUTH_FAILED;
+        }
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+    }
+#endif
+
+exit:
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+    mbedtls_gcm_alt_set_dma_threshold( threshold );
+#endif
+    mbedtls_free( big_ct );
+    mbedtls_free( big_pt );
+    mbedtls_gcm_free( &other );
+    mbedtls_gcm_free( &ctx );
+
+    return( ret );
 }
 
 #endif /*MBEDTLS_GCM_ALT*/
@@ -53,8 +53,16 @@ typedef struct mbedtls_gcm_context
     /* Encryption/Decryption key */
     uint32_t gcm_key[8];
 
+    uint32_t gcm_iv[4];                /* IV and initial counter              */
+
     CRYP_HandleTypeDef hcryp_gcm;      /* HW driver handle                    */
     uint32_t ctx_save_cr;              /* save context for multi-context  */
+    uint32_t ctx_save_ivr[4];          /* counter saved on suspend            */
+    uint32_t ctx_save_susp[8];         /* GHASH state saved on suspend        */
+    int ctx_suspended;                 /* 1 when the payload phase state is   */
+                                       /* saved in this context               */
+    int started;                       /* 1 once the init and header phases   */
+                                       /* of the message ran                  */
     uint64_t len;                      /* total length of the encrypted data. */
     int mode;                          /* The operation to perform:
                                                #MBEDTLS_GCM_ENCRYPT or
@@ -63,11 +71,34 @@ typedef struct mbedtls_gcm_context
 mbedtls_gcm_context;
 
 /* Exported constants --------------------------------------------------------*/
+/* Maximum payload processed in one CRYP request. Longer updates release the  */
+/* CRYP between chunks so that other contexts can interleave                  */
+#ifndef ST_GCM_CHUNK_LEN
+#define ST_GCM_CHUNK_LEN      512U
+#endif
+
+/* Updates of at least this many bytes are fed to the CRYP by GPDMA while the */
+/* calling task blocks. Set to 0 to always use the polling path.              */
+#ifndef ST_GCM_DMA_THRESHOLD
+#define ST_GCM_DMA_THRESHOLD  1024U
+#endif
+
+/* Maximum payload of one DMA request, multiple of the AES block size         */
+#ifndef ST_GCM_DMA_CHUNK_LEN
+#define ST_GCM_DMA_CHUNK_LEN  16384U
+#endif
+
 /* Uncomment if ADD (Additional Authentication Data) may have not a length    */
 /* over a multiple of 32 bits  (Hw implementation dependance)                 */
 #define STM32_AAD_ANY_LENGTH_SUPPORT
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
+#if ( ST_GCM_DMA_THRESHOLD > 0 )
+/* Change the DMA threshold at run time, e.g. to compare both paths. Updates  */
+/* shorter than the threshold use the polling path.                           */
+void mbedtls_gcm_alt_set_dma_threshold( size_t threshold );
+size_t mbedtls_gcm_alt_get_dma_threshold( void );
+#endif /* ST_GCM_DMA_THRESHOLD > 0 */
 
 #ifdef __cplusplus
 }
@@ -20,13 +20,15 @@
 
 /* Includes ------------------------------------------------------------------*/
 #if !defined(MBEDTLS_CONFIG_FILE)
-#include "config.h"
+#include "mbedtls/mbedtls_config.h"
 #else
 #include MBEDTLS_CONFIG_FILE
 #endif
 
 #if defined(MBEDTLS_SHA1_ALT) || defined(MBEDTLS_SHA256_ALT) || defined(MBEDTLS_MD5_ALT)
 
+#include <string.h>
+
 #include "hash_stm32.h"
 
 /* Variables -----------------------------------------------------------------*/
@@ -39,6 +41,15 @@ unsigned char hash_mutex_started = 0;
 
 unsigned int hash_context_count = 0;
 
+/* Handle whose state is currently loaded in the HASH, and where to save it   */
+static HASH_HandleTypeDef *hash_active = NULL;
+static uint8_t *hash_active_regs = NULL;
+
+/* Number of callers holding or waiting for the HASH                          */
+static unsigned int hash_users = 0;
+
+static hash_stats_t hash_stats = { 0 };
+
 /* Functions -----------------------------------------------------------------*/
 
 /* Implementation that should never be optimized out by the compiler */
@@ -51,4 +62,141 @@ void hash_zeroize( void *v, size_t n )
     }
 }
 
+void hash_context_init(void)
+{
+    __disable_irq();
+#if defined(MBEDTLS_THREADING_C)
+    /* mutex cannot be initialized twice */
+    if ( !hash_mutex_started )
+    {
+        mbedtls_mutex_init( &hash_mutex );
+        hash_mutex_started = 1;
+    }
+#endif /* MBEDTLS_THREADING_C */
+    hash_context_count++;
+    __enable_irq();
+}
+
+void hash_context_free(const HASH_HandleTypeDef *hhash)
+{
+    __disable_irq();
+    if ( hash_context_count > 0 )
+        hash_context_count--;
+
+    /* A new context allocated at the same address must not inherit the state */
+    if ( hash_active == hhash )
+    {
+        hash_active = NULL;
+        hash_active_regs = NULL;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    /* Only free the mutex once no other context can use it */
+    if ( ( hash_context_count == 0 ) && hash_mutex_started )
+    {
+        mbedtls_mutex_free( &hash_mutex );
+        hash_mutex_started = 0;
+    }
+#endif /* MBEDTLS_THREADING_C */
+    __enable_irq();
+}
+
+int hash_lock(void)
+{
+    __disable_irq();
+    hash_stats.acquisitions++;
+    if ( hash_users > 0 )
+        hash_stats.contended++;
+    hash_users++;
+    __enable_irq();
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &hash_mutex ) != 0 )
+    {
+        __disable_irq();
+        hash_users--;
+        __enable_irq();
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+#endif /* MBEDTLS_THREADING_C */
+
+    return( 0 );
+}
+
+int hash_unlock(int ret)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &hash_mutex ) != 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif /* MBEDTLS_THREADING_C */
+
+    __disable_irq();
+    if ( hash_users > 0 )
+        hash_users--;
+    __enable_irq();
+
+    return( ret );
+}
+
+int hash_claim(HASH_HandleTypeDef *hhash, uint8_t *save_regs)
+{
+    if ( hash_active == hhash )
+    {
+        hash_stats.ctx_reuses++;
+        return( 1 );
+    }
+
+    /* Another context leaves the HASH: keep its intermediate digest */
+    if ( hash_active != NULL )
+    {
+        HAL_HASH_ContextSaving( hash_active, hash_active_regs );
+        hash_stats.ctx_saves++;
+    }
+
+    hash_stats.ctx_switches++;
+    hash_active = hhash;
+    hash_active_regs = save_regs;
+
+    return( 0 );
+}
+
+void hash_sync(const HASH_HandleTypeDef *hhash)
+{
+    if ( ( hash_active != NULL ) && ( hash_active == hhash ) )
+    {
+        HAL_HASH_ContextSaving( hash_active, hash_active_regs );
+        hash_stats.ctx_saves++;
+    }
+}
+
+void hash_release(const HASH_HandleTypeDef *hhash)
+{
+    if ( hash_active == hhash )
+    {
+        hash_active = NULL;
+        hash_active_regs = NULL;
+    }
+}
+
+void hash_count_dma_transfer(void)
+{
+    __disable_irq();
+    hash_stats.dma_transfers++;
+    __enable_irq();
+}
+
+void hash_get_stats(hash_stats_t *stats)
+{
+    __disable_irq();
+    *stats = hash_stats;
+    __enable_irq();
+}
+
+void hash_reset_stats(void)
+{
+    __disable_irq();
+    memset( &hash_stats, 0, sizeof( hash_stats ) );
+    __enable_irq();
+}
+
 #endif /* MBEDTLS_SHA1_ALT or MBEDTLS_SHA256_ALT or MBEDTLS_MD5_ALT */
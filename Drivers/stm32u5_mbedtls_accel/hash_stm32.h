@@ -38,6 +38,19 @@
 #define ST_HASH_TIMEOUT ((uint32_t) 1000)  /* TO in ms for the hash processor */
 
 /* defines -------------------------------------------------------------------*/
+/* types ---------------------------------------------------------------------*/
+/* Usage counters of the HASH instance shared by the MD5, SHA-1, SHA-256      */
+/* contexts                                                                   */
+typedef struct
+{
+    uint32_t acquisitions;  /* number of hash_lock() calls                     */
+    uint32_t contended;     /* acquisitions which found the HASH already taken */
+    uint32_t ctx_switches;  /* HASH state restored for a different context     */
+    uint32_t ctx_saves;     /* HASH state of the previous owner saved          */
+    uint32_t ctx_reuses;    /* HASH state still loaded for the same context    */
+    uint32_t dma_transfers; /* accumulations transferred by GPDMA              */
+} hash_stats_t;
+
 /* variables -----------------------------------------------------------------*/
 #if defined(MBEDTLS_THREADING_C)
 extern mbedtls_threading_mutex_t hash_mutex;
@@ -49,6 +62,40 @@ extern unsigned int hash_context_count;
 /* functions prototypes ------------------------------------------------------*/
 extern void hash_zeroize(void *v, size_t n);
 
+/* Register / unregister a context using the HASH instance. hash_context_free */
+/* forgets hhash if it still owns the HASH.                                   */
+extern void hash_context_init(void);
+extern void hash_context_free(const HASH_HandleTypeDef *hhash);
+
+/* Take / release exclusive access to the HASH instance. hash_unlock() returns */
+/* ret, or a threading error if the mutex could not be released               */
+extern int hash_lock(void);
+extern int hash_unlock(int ret);
+
+/* Make hhash the owner of the HASH state, must be called with the lock held. */
+/* The state of the previous owner is saved into its save_regs first, so a    */
+/* context is only saved when another one actually takes over the HASH.       */
+/* Returns 1 if the HASH still holds the state of hhash, otherwise the caller */
+/* restores it from save_regs (or starts a new computation).                  */
+extern int hash_claim(HASH_HandleTypeDef *hhash, uint8_t *save_regs);
+
+/* Save the state of hhash into its save_regs if it owns the HASH, so that    */
+/* the context can be copied. Must be called with the lock held.             */
+extern void hash_sync(const HASH_HandleTypeDef *hhash);
+
+/* Give up ownership without saving, once the digest has been read out       */
+extern void hash_release(const HASH_HandleTypeDef *hhash);
+
+extern void hash_count_dma_transfer(void);
+extern void hash_get_stats(hash_stats_t *stats);
+extern void hash_reset_stats(void);
+
+#if defined(MBEDTLS_SHA256_ALT)
+/* Known answer test of SHA-256 and SHA-224, including a context switch, a  */
+/* clone and a long message through the DMA path. Returns 0 on match.       */
+extern int hash_sha256_self_test(void);
+#endif /* MBEDTLS_SHA256_ALT */
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,6 +33,7 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "hash_stm32.h"
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,6 +59,27 @@ static void mbedtls_zeroize(void *v, size_t n)
     }
 }
 
+/*
+ * Take the HASH and load the intermediate digest of ctx, unless the HASH
+ * still holds it from the previous call on the same context
+ */
+static int md5_acquire(mbedtls_md5_context *ctx)
+{
+    int ret = hash_lock();
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    if (!hash_claim(&ctx->hhash, ctx->ctx_save_regs))
+    {
+        HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    }
+
+    return 0;
+}
+
 void mbedtls_md5_init(mbedtls_md5_context *ctx)
 {
     MD5_VALIDATE( ctx != NULL );
@@ -66,6 +88,8 @@ void mbedtls_md5_init(mbedtls_md5_context *ctx)
 
     /* Enable HASH clock */
     __HAL_RCC_HASH_CLK_ENABLE();
+
+    hash_context_init();
 }
 
 void mbedtls_md5_free(mbedtls_md5_context *ctx)
@@ -74,6 +98,9 @@ void mbedtls_md5_free(mbedtls_md5_context *ctx)
     {
         return;
     }
+
+    hash_context_free(&ctx->hhash);
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_md5_context));
 }
 
@@ -83,22 +110,48 @@ void mbedtls_md5_clone(mbedtls_md5_context *dst,
     MD5_VALIDATE( dst != NULL );
     MD5_VALIDATE( src != NULL );
 
-    *dst = *src;
+    /* The intermediate digest of src may only be held by the HASH, and the */
+    /* HASH no longer holds the state of dst once it is overwritten          */
+    if (hash_lock() == 0)
+    {
+        hash_sync(&src->hhash);
+        hash_release(&dst->hhash);
+        *dst = *src;
+        (void) hash_unlock(0);
+    }
+    else
+    {
+        *dst = *src;
+    }
 }
 
 int mbedtls_md5_starts_ret(mbedtls_md5_context *ctx)
 {
+    int ret;
+
     MD5_VALIDATE_RET( ctx != NULL );
 
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* Save the state of the previous owner before the HASH is reinitialized */
+    (void) hash_claim(&ctx->hhash, ctx->ctx_save_regs);
+
     /* HASH Configuration */
     if (HAL_HASH_DeInit(&ctx->hhash) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
-    ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
-    if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+    else
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
+        if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
     }
 
     /* first block on 17 words */
@@ -106,68 +159,74 @@ int mbedtls_md5_starts_ret(mbedtls_md5_context *ctx)
 
     ctx->sbuf_len = 0;
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_internal_md5_process( mbedtls_md5_context *ctx, const unsigned char data[ST_MD5_BLOCK_SIZE] )
 {
+    int ret;
+
     MD5_VALIDATE_RET( ctx != NULL );
     MD5_VALIDATE_RET( (const unsigned char *)data != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    ret = md5_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
+    }
 
     if (HAL_HASH_MD5_Accmlt(&ctx->hhash, (uint8_t *) data, ST_MD5_BLOCK_SIZE) != 0)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_md5_update_ret(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen)
 {
+    int ret = 0;
     size_t currentlen = ilen;
 
     MD5_VALIDATE_RET( ctx != NULL );
     MD5_VALIDATE_RET( ilen == 0 || input != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-
     if (currentlen < (ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
     {
-        /* only store input data in context buffer */
+        /* only store input data in context buffer, the HASH is not needed */
         memcpy(ctx->sbuf + ctx->sbuf_len, input, currentlen);
         ctx->sbuf_len += currentlen;
+
+        return 0;
     }
-    else
+
+    ret = md5_acquire(ctx);
+    if (ret != 0)
     {
-        /* fill context buffer until ST_MD5_BLOCK_SIZE bytes, and process it */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
-        currentlen -= (ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+        return ret;
+    }
 
-        if (HAL_HASH_MD5_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_MD5_BLOCK_SIZE + ctx->first) != 0)
-        {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
+    /* fill context buffer until ST_MD5_BLOCK_SIZE bytes, and process it */
+    memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
+    currentlen -= (ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+
+    if (HAL_HASH_MD5_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_MD5_BLOCK_SIZE + ctx->first) != 0)
+    {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
 
-        /* Process following input data with size multiple of ST_MD5_BLOCK_SIZE bytes */
-        size_t iter = currentlen / ST_MD5_BLOCK_SIZE;
-        if (iter != 0)
+    /* Process following input data with size multiple of ST_MD5_BLOCK_SIZE bytes */
+    size_t iter = currentlen / ST_MD5_BLOCK_SIZE;
+    if ((ret == 0) && (iter != 0))
+    {
+        if (HAL_HASH_MD5_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_MD5_BLOCK_SIZE)) != 0)
         {
-            if (HAL_HASH_MD5_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_MD5_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_MD5_BLOCK_SIZE)) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
+    }
 
+    if (ret == 0)
+    {
         /* following blocks on 16 words */
         ctx->first = 0;
 
@@ -179,29 +238,34 @@ int mbedtls_md5_update_ret(mbedtls_md5_context *ctx, const unsigned char *input,
         }
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_md5_finish_ret(mbedtls_md5_context *ctx, unsigned char output[32])
 {
+    int ret;
+
     MD5_VALIDATE_RET( ctx != NULL );
     MD5_VALIDATE_RET( (unsigned char *)output != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    ret = md5_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
+    }
 
     /* Last accumulation for pending bytes in sbuf_len, then trig processing and get digest */
     if (HAL_HASH_MD5_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_MD5_TIMEOUT) != 0)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
+    /* Nothing left worth saving once the digest has been read out */
+    hash_release(&ctx->hhash);
+
     ctx->sbuf_len = 0;
 
-    return 0;
+    return hash_unlock(ret);
 }
 
 #endif /* MBEDTLS_MD5_ALT*/
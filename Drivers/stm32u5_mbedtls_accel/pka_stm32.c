@@ -0,0 +1,347 @@
+/*
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Copyright (C) 2019 STMicroelectronics, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements ST shared PKA services based on API from mbed TLS
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/mbedtls_config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_ECDSA_SIGN_ALT) || defined(MBEDTLS_ECDSA_VERIFY_ALT) || \
+    defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT) || \
+    defined(MBEDTLS_RSA_ALT)
+
+#include <string.h>
+
+#include "pka_stm32.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+
+/* Variables -----------------------------------------------------------------*/
+/* Mutex protection because the PKA instance is shared by the RSA, ECDSA and */
+/* ECDH implementations, which may run from several tasks                     */
+#if defined(MBEDTLS_THREADING_C)
+mbedtls_threading_mutex_t pka_mutex;
+unsigned char pka_mutex_started = 0;
+#endif /* MBEDTLS_THREADING_C */
+
+#if defined(ST_PKA_ECC_ALT)
+static int pka_enabled = 1;
+
+/* Curves already converted to the PKA input format, protected by pka_mutex  */
+static pka_curve_t pka_curves[ST_PKA_CURVE_CACHE_SIZE];
+static unsigned int pka_curve_next = 0;
+#endif /* ST_PKA_ECC_ALT */
+
+static pka_stats_t pka_stats = { 0 };
+
+/* Functions -----------------------------------------------------------------*/
+
+#if defined(ST_PKA_ECC_ALT)
+int pka_grp_capable(const mbedtls_ecp_group *grp)
+{
+    if ( !pka_enabled )
+        return( 0 );
+
+    if ( mbedtls_ecp_get_type( grp ) != MBEDTLS_ECP_TYPE_SHORT_WEIERSTRASS )
+        return( 0 );
+
+    /* The PKA takes the prime order in an array of modulus size */
+    return( mbedtls_mpi_size( &grp->N ) == mbedtls_mpi_size( &grp->P ) );
+}
+
+void pka_set_enabled(int enabled)
+{
+    pka_enabled = ( enabled != 0 );
+}
+
+int pka_is_enabled(void)
+{
+    return( pka_enabled );
+}
+#endif /* ST_PKA_ECC_ALT */
+
+int pka_acquire(PKA_HandleTypeDef *hpka)
+{
+#if defined(MBEDTLS_THREADING_C)
+    __disable_irq();
+    /* mutex cannot be initialized twice */
+    if ( !pka_mutex_started )
+    {
+        mbedtls_mutex_init( &pka_mutex );
+        pka_mutex_started = 1;
+    }
+    __enable_irq();
+
+    if( mbedtls_mutex_lock( &pka_mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif /* MBEDTLS_THREADING_C */
+
+    pka_stats.hw_ops++;
+
+    /* Enable HW peripheral clock */
+    __HAL_RCC_PKA_CLK_ENABLE();
+
+    /* Initialize HW peripheral */
+    memset( hpka, 0, sizeof( *hpka ) );
+    hpka->Instance = PKA;
+
+    if ( HAL_PKA_Init( hpka ) != HAL_OK )
+        return( pka_release( hpka, MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED ) );
+
+    /* Reset PKA RAM */
+    HAL_PKA_RAMReset( hpka );
+
+    return( 0 );
+}
+
+int pka_release(PKA_HandleTypeDef *hpka, int ret)
+{
+    /* De-initialize HW peripheral */
+    HAL_PKA_DeInit( hpka );
+
+    /* Disable HW peripheral clock */
+    __HAL_RCC_PKA_CLK_DISABLE();
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &pka_mutex ) != 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif /* MBEDTLS_THREADING_C */
+
+    return( ret );
+}
+
+#if defined(ST_PKA_ECC_ALT)
+/*
+ * Convert the group parameters into the big endian arrays taken by the PKA
+ */
+static int pka_curve_load(const mbedtls_ecp_group *grp, pka_curve_t *curve)
+{
+    int ret;
+    size_t size = mbedtls_mpi_size( &grp->P );
+
+    curve->id = MBEDTLS_ECP_DP_NONE;
+    curve->modulus_size = (uint32_t) size;
+    curve->order_size = (uint32_t) mbedtls_mpi_size( &grp->N );
+
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->P, curve->p, size ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->B, curve->b, size ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->G.X, curve->gx, size ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->G.Y, curve->gy, size ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->N, curve->n, curve->order_size ) );
+
+    /* mbed TLS leaves A unset for the curves with A = -3 */
+    if ( grp->A.p == NULL )
+    {
+        curve->a_sign = 1U;
+        memset( curve->a_abs, 0, size );
+        curve->a_abs[size - 1U] = 3U;
+    }
+    else
+    {
+        curve->a_sign = 0U;
+        MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &grp->A, curve->a_abs, size ) );
+    }
+
+    curve->id = grp->id;
+    pka_stats.curve_loads++;
+
+cleanup:
+    return( ret );
+}
+
+int pka_curve_get(const mbedtls_ecp_group *grp, const pka_curve_t **curve)
+{
+    int ret;
+    pka_curve_t *slot;
+    unsigned int i;
+
+    /* Custom groups have no identifier and are converted for every use */
+    if ( grp->id != MBEDTLS_ECP_DP_NONE )
+    {
+        for ( i = 0; i < ST_PKA_CURVE_CACHE_SIZE; i++ )
+        {
+            if ( pka_curves[i].id == grp->id )
+            {
+                *curve = &pka_curves[i];
+                return( 0 );
+            }
+        }
+    }
+
+    slot = &pka_curves[pka_curve_next];
+    pka_curve_next = ( pka_curve_next + 1U ) % ST_PKA_CURVE_CACHE_SIZE;
+
+    ret = pka_curve_load( grp, slot );
+
+    *curve = ( ret == 0 ) ? slot : NULL;
+
+    return( ret );
+}
+
+int pka_ecc_mul(PKA_HandleTypeDef *hpka, const mbedtls_ecp_group *grp,
+                const pka_curve_t *curve, mbedtls_ecp_point *R,
+                const mbedtls_mpi *m, const mbedtls_ecp_point *P)
+{
+    int ret;
+    size_t olen;
+    uint8_t P_binary[MBEDTLS_ECP_MAX_PT_LEN];
+    uint8_t R_binary[MBEDTLS_ECP_MAX_PT_LEN];
+    uint8_t m_binary[MBEDTLS_ECP_MAX_BYTES];
+    size_t pt_len = 2U * curve->modulus_size + 1U;
+    PKA_ECCMulInTypeDef ECC_MulIn = {0};
+    PKA_ECCMulOutTypeDef ECC_MulOut;
+
+    /* Set HW peripheral input parameter: coordinates of P point */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, P, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, P_binary, pt_len ) );
+    MBEDTLS_MPI_CHK( ( olen != pt_len ) ? MBEDTLS_ERR_ECP_BAD_INPUT_DATA : 0 );
+
+    /* Set HW peripheral input parameter: scalar m, padded to the order size */
+    /* so that its length does not depend on the value                      */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( m, m_binary, curve->order_size ) );
+
+    /* Set HW peripheral Input parameter: curve coefs */
+    ECC_MulIn.scalarMulSize = curve->order_size;
+    ECC_MulIn.modulusSize   = curve->modulus_size;
+    ECC_MulIn.coefSign      = curve->a_sign;
+    ECC_MulIn.coefA         = curve->a_abs;
+    ECC_MulIn.coefB         = curve->b;
+    ECC_MulIn.modulus       = curve->p;
+    ECC_MulIn.primeOrder    = curve->n;
+    ECC_MulIn.pointX        = P_binary + 1U;
+    ECC_MulIn.pointY        = P_binary + curve->modulus_size + 1U;
+    ECC_MulIn.scalarMul     = m_binary;
+
+    /* Launch the scalar multiplication */
+    MBEDTLS_MPI_CHK((HAL_PKA_ECCMul(hpka, &ECC_MulIn, ST_PKA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+
+    ECC_MulOut.ptX = R_binary + 1U;
+    ECC_MulOut.ptY = R_binary + curve->modulus_size + 1U;
+
+    /* Get the scalar multiplication result */
+    HAL_PKA_ECCMul_GetResult(hpka, &ECC_MulOut);
+
+    /* Convert the scalar multiplication result into ecp point format */
+    R_binary[0] = 0x04U;
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( grp, R, R_binary, pt_len ) );
+
+cleanup:
+    mbedtls_platform_zeroize( m_binary, sizeof( m_binary ) );
+    mbedtls_platform_zeroize( R_binary, sizeof( R_binary ) );
+
+    return( ret );
+}
+
+int pka_check_point(PKA_HandleTypeDef *hpka, const mbedtls_ecp_group *grp,
+                    const pka_curve_t *curve, const mbedtls_ecp_point *pt)
+{
+    int ret;
+    size_t olen;
+    uint8_t pt_binary[MBEDTLS_ECP_MAX_PT_LEN];
+    size_t pt_len = 2U * curve->modulus_size + 1U;
+    PKA_PointCheckInTypeDef ECC_PointCheck = {0};
+
+    /* pt coordinates must be normalized for our checks */
+    if( mbedtls_mpi_cmp_int( &pt->Z, 1 ) != 0 ||
+        mbedtls_mpi_cmp_int( &pt->X, 0 ) < 0 ||
+        mbedtls_mpi_cmp_int( &pt->Y, 0 ) < 0 ||
+        mbedtls_mpi_cmp_mpi( &pt->X, &grp->P ) >= 0 ||
+        mbedtls_mpi_cmp_mpi( &pt->Y, &grp->P ) >= 0 )
+        return( MBEDTLS_ERR_ECP_INVALID_KEY );
+
+    /* Set HW peripheral input parameter: coordinates of point to check */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, pt, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, pt_binary, pt_len ) );
+
+    /* Set HW peripheral Input parameter: curve coefs */
+    ECC_PointCheck.modulusSize = curve->modulus_size;
+    ECC_PointCheck.modulus     = curve->p;
+    ECC_PointCheck.coefSign    = curve->a_sign;
+    ECC_PointCheck.coefA       = curve->a_abs;
+    ECC_PointCheck.coefB       = curve->b;
+    ECC_PointCheck.pointX      = pt_binary + 1U;
+    ECC_PointCheck.pointY      = pt_binary + curve->modulus_size + 1U;
+
+    /* Launch the point check */
+    MBEDTLS_MPI_CHK((HAL_PKA_PointCheck(hpka, &ECC_PointCheck, ST_PKA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+
+    /* Get the result of the point check */
+    if( HAL_PKA_PointCheck_IsOnCurve(hpka) != 1U)
+        ret = MBEDTLS_ERR_ECP_INVALID_KEY;
+
+cleanup:
+    return( ret );
+}
+
+void pka_count_sw_op(void)
+{
+    __disable_irq();
+    pka_stats.sw_ops++;
+    __enable_irq();
+}
+
+int pka_ecc_self_test(void)
+{
+    int ret = 0;
+
+#if defined(MBEDTLS_ECDSA_SIGN_ALT) || defined(MBEDTLS_ECDSA_VERIFY_ALT)
+    ret = pka_ecdsa_self_test();
+#endif
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+    if ( ret == 0 )
+        ret = pka_ecdh_self_test();
+#endif
+
+    return( ret );
+}
+
+#endif /* ST_PKA_ECC_ALT */
+
+int pka_test_rng(void *p_rng, unsigned char *output, size_t len)
+{
+    const pka_test_rng_t *rng = (const pka_test_rng_t *) p_rng;
+
+    if ( len > rng->len )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    memcpy( output, rng->buf, len );
+
+    return( 0 );
+}
+
+void pka_get_stats(pka_stats_t *stats)
+{
+    __disable_irq();
+    *stats = pka_stats;
+    __enable_irq();
+}
+
+void pka_reset_stats(void)
+{
+    __disable_irq();
+    memset( &pka_stats, 0, sizeof( pka_stats ) );
+    __enable_irq();
+}
+
+#endif /* MBEDTLS_ECDSA_xxx_ALT, MBEDTLS_ECDH_xxx_ALT or MBEDTLS_RSA_ALT */
@@ -0,0 +1,178 @@
+/**
+  ******************************************************************************
+  * @brief   Header file of mbed TLS HW crypto (PKA) implementation.
+  ******************************************************************************
+  * @attention
+  *
+  *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+  *  Copyright (C) 2019 STMicroelectronics, All Rights Reserved
+  *
+  * This software component is licensed by ST under Apache 2.0 license,
+  * the "License"; You may not use this file except in compliance with the
+  * License. You may obtain a copy of the License at:
+  * https://opensource.org/licenses/Apache-2.0
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PKA_H
+#define __PKA_H
+
+#if defined(MBEDTLS_ECDSA_SIGN_ALT) || defined(MBEDTLS_ECDSA_VERIFY_ALT) || \
+    defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+#define ST_PKA_ECC_ALT
+#endif
+
+#if defined(ST_PKA_ECC_ALT) || defined(MBEDTLS_RSA_ALT)
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+/* include the appropriate header file */
+#include "stm32u5xx_hal.h"
+
+#if defined(ST_PKA_ECC_ALT)
+#include "mbedtls/ecp.h"
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/* macros --------------------------------------------------------------------*/
+/* constants -----------------------------------------------------------------*/
+#define ST_PKA_TIMEOUT    ((uint32_t) 5000)  /* TO in ms for the PKA          */
+
+/* defines -------------------------------------------------------------------*/
+/* Number of curves kept in the PKA input format, P-256 and P-384 by default  */
+#ifndef ST_PKA_CURVE_CACHE_SIZE
+#define ST_PKA_CURVE_CACHE_SIZE   2U
+#endif
+
+/* ECDH key pairs generated ahead of time by pka_ecdh_pool_fill(), 0 to      */
+/* generate every key pair when it is requested                              */
+#ifndef ST_PKA_ECDH_POOL_SIZE
+#define ST_PKA_ECDH_POOL_SIZE     2U
+#endif
+
+/* types ---------------------------------------------------------------------*/
+#if defined(ST_PKA_ECC_ALT)
+/* Short Weierstrass curve parameters in the big endian, fixed length format  */
+/* expected by the PKA. Converted once from the mbed TLS group, then reused   */
+/* by every operation on the same curve.                                      */
+typedef struct
+{
+    mbedtls_ecp_group_id id;              /* curve, MBEDTLS_ECP_DP_NONE if free */
+    uint32_t modulus_size;                /* number of bytes in p              */
+    uint32_t order_size;                  /* number of bytes in n              */
+    uint32_t a_sign;                      /* 1 if the A coefficient < 0        */
+    uint8_t p[MBEDTLS_ECP_MAX_BYTES];     /* prime modulus p                   */
+    uint8_t a_abs[MBEDTLS_ECP_MAX_BYTES]; /* abs(A) coefficient                */
+    uint8_t b[MBEDTLS_ECP_MAX_BYTES];     /* B coefficient                     */
+    uint8_t gx[MBEDTLS_ECP_MAX_BYTES];    /* Gx base point                     */
+    uint8_t gy[MBEDTLS_ECP_MAX_BYTES];    /* Gy base point                     */
+    uint8_t n[MBEDTLS_ECP_MAX_BYTES];     /* prime order n                     */
+} pka_curve_t;
+#endif /* ST_PKA_ECC_ALT */
+
+/* Random generator of the known answer tests, see pka_test_rng()             */
+typedef struct
+{
+    const unsigned char *buf;             /* bytes returned by every call      */
+    size_t len;                           /* longest request served            */
+} pka_test_rng_t;
+
+/* Usage counters of the RSA / ECDSA / ECDH alt implementations               */
+typedef struct
+{
+    uint32_t hw_ops;        /* operations run on the PKA                       */
+    uint32_t sw_ops;        /* operations run by the mbed TLS software path    */
+    uint32_t curve_loads;   /* curves converted to the PKA format              */
+} pka_stats_t;
+
+/* variables -----------------------------------------------------------------*/
+#if defined(MBEDTLS_THREADING_C)
+extern mbedtls_threading_mutex_t pka_mutex;
+extern unsigned char pka_mutex_started;
+#endif /* MBEDTLS_THREADING_C */
+
+/* functions prototypes ------------------------------------------------------*/
+/* Take exclusive access to the PKA and power it up / power it down and       */
+/* release it. pka_release() returns ret, or a threading error if the mutex  */
+/* could not be released.                                                     */
+extern int pka_acquire(PKA_HandleTypeDef *hpka);
+extern int pka_release(PKA_HandleTypeDef *hpka, int ret);
+
+#if defined(ST_PKA_ECC_ALT)
+/* Returns 1 if operations on grp run on the PKA: short Weierstrass curve     */
+/* with an order as long as the modulus, and the PKA path enabled.            */
+extern int pka_grp_capable(const mbedtls_ecp_group *grp);
+
+/* Select the PKA (1, default) or the mbed TLS software path (0) at run time  */
+/* for the ECC operations. RSA always runs on the PKA.                        */
+extern void pka_set_enabled(int enabled);
+extern int pka_is_enabled(void);
+
+/* Curve parameters of grp in the PKA format, must be called with the PKA     */
+/* acquired. The pointer stays valid until pka_release().                     */
+extern int pka_curve_get(const mbedtls_ecp_group *grp, const pka_curve_t **curve);
+
+/* R = m * P, m in 1..n-1 and P a valid affine point. Must be called with    */
+/* the PKA acquired and curve returned by pka_curve_get() for grp.           */
+extern int pka_ecc_mul(PKA_HandleTypeDef *hpka, const mbedtls_ecp_group *grp,
+                       const pka_curve_t *curve, mbedtls_ecp_point *R,
+                       const mbedtls_mpi *m, const mbedtls_ecp_point *P);
+
+/* Check that the affine point pt is on the curve, same conditions as above  */
+extern int pka_check_point(PKA_HandleTypeDef *hpka, const mbedtls_ecp_group *grp,
+                           const pka_curve_t *curve, const mbedtls_ecp_point *pt);
+
+extern void pka_count_sw_op(void);
+#endif /* ST_PKA_ECC_ALT */
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) && ( ST_PKA_ECDH_POOL_SIZE > 0 )
+/* Generate one ECDH key pair for the curve of the last mbedtls_ecdh_gen_public() */
+/* call (P-256 until then) and keep it for the next call on that curve.       */
+/* Returns 1 if a pair was added, 0 if the pool is full, or an error code.    */
+/* Meant for a low priority task, the pairs are handed out once.              */
+extern int pka_ecdh_pool_fill(int (*f_rng)(void *, unsigned char *, size_t),
+                              void *p_rng);
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT and ST_PKA_ECDH_POOL_SIZE > 0 */
+
+/* f_rng of the known answer tests: copies the first len bytes of the        */
+/* pka_test_rng_t buffer p_rng on every call, so that the "random" integers  */
+/* drawn by mbedtls_ecp_gen_privkey() are the ones of the test vector.       */
+extern int pka_test_rng(void *p_rng, unsigned char *output, size_t len);
+
+#if defined(MBEDTLS_RSA_ALT)
+/* Known answer test of the RSA-2048 PKCS#1 v1.5 signature and verification, */
+/* returns 0 if the results match the test vector                           */
+extern int pka_rsa_self_test(void);
+#endif
+
+#if defined(ST_PKA_ECC_ALT)
+/* Known answer tests on P-256, through the PKA unless pka_set_enabled( 0 ). */
+/* Return 0 if every result matches the test vector.                         */
+#if defined(MBEDTLS_ECDSA_SIGN_ALT) || defined(MBEDTLS_ECDSA_VERIFY_ALT)
+extern int pka_ecdsa_self_test(void);
+#endif
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+extern int pka_ecdh_self_test(void);
+#endif
+
+/* Runs the tests above which are built in                                   */
+extern int pka_ecc_self_test(void);
+#endif /* ST_PKA_ECC_ALT */
+
+extern void pka_get_stats(pka_stats_t *stats);
+extern void pka_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ST_PKA_ECC_ALT or MBEDTLS_RSA_ALT */
+#endif /*__PKA_H */
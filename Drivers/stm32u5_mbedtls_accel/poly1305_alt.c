@@ -0,0 +1,370 @@
+/**
+ * \file poly1305.c
+ *
+ * \brief Poly1305 authentication algorithm.
+ */
+/*
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a Poly1305 software path tuned for the Cortex-M33
+ *  based on mbed TLS API.
+ *
+ *  The generic mbed TLS implementation works on 32-bit limbs and needs
+ *  64x64 bit products for the reduction. Here the accumulator and 'r' are
+ *  held in five 26-bit limbs (as in poly1305-donna), so every product of a
+ *  block fits in a 32x32->64 bit UMULL / UMLAL and the carries are a few
+ *  shifts per block. The multiplication by 5 of the reduction is folded into
+ *  precomputed copies of 'r'.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mbedtls/poly1305.h"
+
+#if defined(MBEDTLS_POLY1305_C)
+#if defined(MBEDTLS_POLY1305_ALT)
+#include <string.h>
+#include "mbedtls/platform_util.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define POLY1305_LIMB_MASK    ( 0x3ffffffU )
+#define POLY1305_HIBIT        ( 1UL << 24 )     /*!< 2^128 in the top limb */
+
+/* Private macro -------------------------------------------------------------*/
+#define MUL64( a, b )         ( (uint64_t) ( a ) * ( b ) )
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static inline uint32_t poly1305_get_le32( const unsigned char *p )
+{
+#if defined(__BYTE_ORDER__) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+    uint32_t w;
+
+    /* Single (unaligned) LDR on the Cortex-M33 */
+    memcpy( &w, p, sizeof( w ) );
+    return( w );
+#else
+    return( (uint32_t) p[0]         |
+            ( (uint32_t) p[1] << 8 )  |
+            ( (uint32_t) p[2] << 16 ) |
+            ( (uint32_t) p[3] << 24 ) );
+#endif
+}
+
+static inline void poly1305_put_le32( unsigned char *p, uint32_t w )
+{
+#if defined(__BYTE_ORDER__) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+    memcpy( p, &w, sizeof( w ) );
+#else
+    p[0] = (unsigned char) w;
+    p[1] = (unsigned char) ( w >> 8 );
+    p[2] = (unsigned char) ( w >> 16 );
+    p[3] = (unsigned char) ( w >> 24 );
+#endif
+}
+
+/**
+ * \brief                   Process blocks with Poly1305.
+ *
+ * \param ctx               The Poly1305 context.
+ * \param nblocks           Number of blocks to process. Note that this
+ *                          function only processes full blocks.
+ * \param input             Buffer containing the input block(s).
+ * \param needs_padding     Set to 0 if the padding bit has already been
+ *                          applied to the input data before calling this
+ *                          function.  Otherwise, set this parameter to 1.
+ */
+static void poly1305_process( mbedtls_poly1305_context *ctx,
+                              size_t nblocks,
+                              const unsigned char *input,
+                              uint32_t needs_padding )
+{
+    const uint32_t hibit = ( needs_padding != 0U ) ? POLY1305_HIBIT : 0U;
+    const uint32_t r0 = ctx->r[0];
+    const uint32_t r1 = ctx->r[1];
+    const uint32_t r2 = ctx->r[2];
+    const uint32_t r3 = ctx->r[3];
+    const uint32_t r4 = ctx->r[4];
+    const uint32_t s1 = r1 * 5U;
+    const uint32_t s2 = r2 * 5U;
+    const uint32_t s3 = r3 * 5U;
+    const uint32_t s4 = r4 * 5U;
+    uint32_t h0 = ctx->acc[0];
+    uint32_t h1 = ctx->acc[1];
+    uint32_t h2 = ctx->acc[2];
+    uint32_t h3 = ctx->acc[3];
+    uint32_t h4 = ctx->acc[4];
+    uint64_t d0, d1, d2, d3, d4;
+    uint32_t c;
+
+    while( nblocks-- > 0U )
+    {
+        /* h += m[i] */
+        h0 += ( poly1305_get_le32( input      )      ) & POLY1305_LIMB_MASK;
+        h1 += ( poly1305_get_le32( input +  3 ) >> 2 ) & POLY1305_LIMB_MASK;
+        h2 += ( poly1305_get_le32( input +  6 ) >> 4 ) & POLY1305_LIMB_MASK;
+        h3 += ( poly1305_get_le32( input +  9 ) >> 6 ) & POLY1305_LIMB_MASK;
+        h4 += ( poly1305_get_le32( input + 12 ) >> 8 ) | hibit;
+
+        /* h *= r, with 2^130 = 5 (mod p) folded into s1..s4 */
+        d0 = MUL64( h0, r0 ) + MUL64( h1, s4 ) + MUL64( h2, s3 ) + MUL64( h3, s2 ) + MUL64( h4, s1 );
+        d1 = MUL64( h0, r1 ) + MUL64( h1, r0 ) + MUL64( h2, s4 ) + MUL64( h3, s3 ) + MUL64( h4, s2 );
+        d2 = MUL64( h0, r2 ) + MUL64( h1, r1 ) + MUL64( h2, r0 ) + MUL64( h3, s4 ) + MUL64( h4, s3 );
+        d3 = MUL64( h0, r3 ) + MUL64( h1, r2 ) + MUL64( h2, r1 ) + MUL64( h3, r0 ) + MUL64( h4, s4 );
+        d4 = MUL64( h0, r4 ) + MUL64( h1, r3 ) + MUL64( h2, r2 ) + MUL64( h3, r1 ) + MUL64( h4, r0 );
+
+        /* (partial) h %= p */
+        c = (uint32_t) ( d0 >> 26 ); h0 = (uint32_t) d0 & POLY1305_LIMB_MASK;
+        d1 += c; c = (uint32_t) ( d1 >> 26 ); h1 = (uint32_t) d1 & POLY1305_LIMB_MASK;
+        d2 += c; c = (uint32_t) ( d2 >> 26 ); h2 = (uint32_t) d2 & POLY1305_LIMB_MASK;
+        d3 += c; c = (uint32_t) ( d3 >> 26 ); h3 = (uint32_t) d3 & POLY1305_LIMB_MASK;
+        d4 += c; c = (uint32_t) ( d4 >> 26 ); h4 = (uint32_t) d4 & POLY1305_LIMB_MASK;
+        h0 += c * 5U; c = h0 >> 26; h0 &= POLY1305_LIMB_MASK;
+        h1 += c;
+
+        input += ST_POLY1305_BLOCK_SIZE_BYTES;
+    }
+
+    ctx->acc[0] = h0;
+    ctx->acc[1] = h1;
+    ctx->acc[2] = h2;
+    ctx->acc[3] = h3;
+    ctx->acc[4] = h4;
+}
+
+/**
+ * \brief                   Compute the Poly1305 MAC
+ *
+ * \param ctx               The Poly1305 context.
+ * \param mac               The buffer to where the MAC is written. Must be
+ *                          big enough to contain the 16-byte MAC.
+ */
+static void poly1305_compute_mac( const mbedtls_poly1305_context *ctx,
+                                  unsigned char mac[16] )
+{
+    uint32_t h0 = ctx->acc[0];
+    uint32_t h1 = ctx->acc[1];
+    uint32_t h2 = ctx->acc[2];
+    uint32_t h3 = ctx->acc[3];
+    uint32_t h4 = ctx->acc[4];
+    uint32_t g0, g1, g2, g3, g4;
+    uint32_t c, mask;
+    uint64_t f;
+
+    /* Fully carry h */
+                 c = h1 >> 26; h1 &= POLY1305_LIMB_MASK;
+    h2 += c;     c = h2 >> 26; h2 &= POLY1305_LIMB_MASK;
+    h3 += c;     c = h3 >> 26; h3 &= POLY1305_LIMB_MASK;
+    h4 += c;     c = h4 >> 26; h4 &= POLY1305_LIMB_MASK;
+    h0 += c * 5U; c = h0 >> 26; h0 &= POLY1305_LIMB_MASK;
+    h1 += c;
+
+    /* Compute g = h + -p = h - (2^130 - 5) */
+    g0 = h0 + 5U; c = g0 >> 26; g0 &= POLY1305_LIMB_MASK;
+    g1 = h1 + c;  c = g1 >> 26; g1 &= POLY1305_LIMB_MASK;
+    g2 = h2 + c;  c = g2 >> 26; g2 &= POLY1305_LIMB_MASK;
+    g3 = h3 + c;  c = g3 >> 26; g3 &= POLY1305_LIMB_MASK;
+    g4 = h4 + c - ( 1UL << 26 );
+
+    /* Select h if h < p, or h + -p if h >= p, in constant time */
+    mask = ( g4 >> 31 ) - 1U;
+    g0 &= mask;
+    g1 &= mask;
+    g2 &= mask;
+    g3 &= mask;
+    g4 &= mask;
+    mask = ~mask;
+    h0 = ( h0 & mask ) | g0;
+    h1 = ( h1 & mask ) | g1;
+    h2 = ( h2 & mask ) | g2;
+    h3 = ( h3 & mask ) | g3;
+    h4 = ( h4 & mask ) | g4;
+
+    /* h = h % (2^128) */
+    h0 = ( h0       ) | ( h1 << 26 );
+    h1 = ( h1 >>  6 ) | ( h2 << 20 );
+    h2 = ( h2 >> 12 ) | ( h3 << 14 );
+    h3 = ( h3 >> 18 ) | ( h4 <<  8 );
+
+    /* mac = (h + s) % (2^128) */
+    f = (uint64_t) h0 + ctx->s[0];             h0 = (uint32_t) f;
+    f = (uint64_t) h1 + ctx->s[1] + ( f >> 32 ); h1 = (uint32_t) f;
+    f = (uint64_t) h2 + ctx->s[2] + ( f >> 32 ); h2 = (uint32_t) f;
+    f = (uint64_t) h3 + ctx->s[3] + ( f >> 32 ); h3 = (uint32_t) f;
+
+    poly1305_put_le32( mac,      h0 );
+    poly1305_put_le32( mac +  4, h1 );
+    poly1305_put_le32( mac +  8, h2 );
+    poly1305_put_le32( mac + 12, h3 );
+}
+
+void mbedtls_poly1305_init( mbedtls_poly1305_context *ctx )
+{
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_poly1305_context ) );
+}
+
+void mbedtls_poly1305_free( mbedtls_poly1305_context *ctx )
+{
+    if( ctx == NULL )
+        return;
+
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_poly1305_context ) );
+}
+
+int mbedtls_poly1305_starts( mbedtls_poly1305_context *ctx,
+                             const unsigned char key[32] )
+{
+    /* r &= 0x0ffffffc0ffffffc0ffffffc0fffffff, split in 26-bit limbs */
+    ctx->r[0] = ( poly1305_get_le32( key      )      ) & 0x3ffffffU;
+    ctx->r[1] = ( poly1305_get_le32( key +  3 ) >> 2 ) & 0x3ffff03U;
+    ctx->r[2] = ( poly1305_get_le32( key +  6 ) >> 4 ) & 0x3ffc0ffU;
+    ctx->r[3] = ( poly1305_get_le32( key +  9 ) >> 6 ) & 0x3f03fffU;
+    ctx->r[4] = ( poly1305_get_le32( key + 12 ) >> 8 ) & 0x00fffffU;
+
+    ctx->s[0] = poly1305_get_le32( key + 16 );
+    ctx->s[1] = poly1305_get_le32( key + 20 );
+    ctx->s[2] = poly1305_get_le32( key + 24 );
+    ctx->s[3] = poly1305_get_le32( key + 28 );
+
+    /* Initial accumulator state */
+    ctx->acc[0] = 0U;
+    ctx->acc[1] = 0U;
+    ctx->acc[2] = 0U;
+    ctx->acc[3] = 0U;
+    ctx->acc[4] = 0U;
+
+    /* Queue initially empty */
+    mbedtls_platform_zeroize( ctx->queue, sizeof( ctx->queue ) );
+    ctx->queue_len = 0U;
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_update( mbedtls_poly1305_context *ctx,
+                             const unsigned char *input,
+                             size_t ilen )
+{
+    size_t offset    = 0U;
+    size_t remaining = ilen;
+    size_t queue_free_len;
+    size_t nblocks;
+
+    if( ( remaining > 0U ) && ( ctx->queue_len > 0U ) )
+    {
+        queue_free_len = ( ST_POLY1305_BLOCK_SIZE_BYTES - ctx->queue_len );
+
+        if( ilen < queue_free_len )
+        {
+            /* Not enough data to complete the block.
+             * Store this data with the other leftovers.
+             */
+            memcpy( &ctx->queue[ctx->queue_len],
+                    input,
+                    ilen );
+
+            ctx->queue_len += ilen;
+
+            remaining = 0U;
+        }
+        else
+        {
+            /* Enough data to produce a complete block */
+            memcpy( &ctx->queue[ctx->queue_len],
+                    input,
+                    queue_free_len );
+
+            ctx->queue_len = 0U;
+
+            poly1305_process( ctx, 1U, ctx->queue, 1U ); /* add padding bit */
+
+            offset    += queue_free_len;
+            remaining -= queue_free_len;
+        }
+    }
+
+    if( remaining >= ST_POLY1305_BLOCK_SIZE_BYTES )
+    {
+        nblocks = remaining / ST_POLY1305_BLOCK_SIZE_BYTES;
+
+        poly1305_process( ctx, nblocks, &input[offset], 1U );
+
+        offset += nblocks * ST_POLY1305_BLOCK_SIZE_BYTES;
+        remaining %= ST_POLY1305_BLOCK_SIZE_BYTES;
+    }
+
+    if( remaining > 0U )
+    {
+        /* Store partial block */
+        ctx->queue_len = remaining;
+        memcpy( ctx->queue, &input[offset], remaining );
+    }
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_finish( mbedtls_poly1305_context *ctx,
+                             unsigned char mac[16] )
+{
+    /* Process any leftover data */
+    if( ctx->queue_len > 0U )
+    {
+        /* Add padding bit */
+        ctx->queue[ctx->queue_len] = 1U;
+        ctx->queue_len++;
+
+        /* Pad with zeroes */
+        memset( &ctx->queue[ctx->queue_len],
+                0,
+                ST_POLY1305_BLOCK_SIZE_BYTES - ctx->queue_len );
+
+        poly1305_process( ctx, 1U,          /* Process 1 block */
+                          ctx->queue, 0U ); /* Already padded above */
+    }
+
+    poly1305_compute_mac( ctx, mac );
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_mac( const unsigned char key[32],
+                          const unsigned char *input,
+                          size_t ilen,
+                          unsigned char mac[16] )
+{
+    mbedtls_poly1305_context ctx;
+    int ret;
+
+    mbedtls_poly1305_init( &ctx );
+
+    ret = mbedtls_poly1305_starts( &ctx, key );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_poly1305_update( &ctx, input, ilen );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_poly1305_finish( &ctx, mac );
+
+cleanup:
+    mbedtls_poly1305_free( &ctx );
+    return( ret );
+}
+
+#endif /* MBEDTLS_POLY1305_ALT */
+#endif /* MBEDTLS_POLY1305_C */
@@ -0,0 +1,59 @@
+/**
+ * \file poly1305.h
+ *
+ * \brief   This file contains Poly1305 definitions and functions.
+ *
+ *          Poly1305 is a one-time message authenticator that can be used to
+ *          authenticate messages. Poly1305-AES was created by Daniel
+ *          Bernstein https://cr.yp.to/mac/poly1305-20050329.pdf The generic
+ *          Poly1305 algorithm (not tied to AES) was also standardized in RFC
+ *          7539.
+ */
+/*
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a Poly1305 software path tuned for the Cortex-M33
+ *  based on mbed TLS API
+ */
+
+#ifndef MBEDTLS_POLY1305_ALT_H
+#define MBEDTLS_POLY1305_ALT_H
+
+#if defined (MBEDTLS_POLY1305_ALT)
+#include <stdint.h>
+#include <stddef.h>
+
+#define ST_POLY1305_BLOCK_SIZE_BYTES  ((size_t) 16)    /*!< Size of one message block */
+
+/**
+ * \brief          Poly1305 context structure
+ *
+ *                 The accumulator and the clamped key are kept in radix 2^26
+ *                 so that each block only needs 32x32->64 bit multiply
+ *                 accumulates (UMULL / UMLAL on the Cortex-M33).
+ */
+typedef struct mbedtls_poly1305_context
+{
+    uint32_t r[5];                                   /*!< The value for 'r' (low 128 bits of the key), radix 2^26. */
+    uint32_t s[4];                                   /*!< The value for 's' (high 128 bits of the key). */
+    uint32_t acc[5];                                 /*!< The accumulator number, radix 2^26. */
+    uint8_t  queue[ST_POLY1305_BLOCK_SIZE_BYTES];    /*!< The current partial block of data. */
+    size_t queue_len;                                /*!< The number of bytes stored in 'queue'. */
+}
+mbedtls_poly1305_context;
+
+#endif /* MBEDTLS_POLY1305_ALT */
+#endif /* poly1305_alt.h */
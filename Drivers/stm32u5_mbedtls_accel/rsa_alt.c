@@ -41,10 +41,12 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
 #if defined(MBEDTLS_CONFIG_FILE)
 #include MBEDTLS_CONFIG_FILE
 #else
-#include "mbedtls/config.h"
+#include "mbedtls/mbedtls_config.h"
 #endif
 
 #if defined(MBEDTLS_RSA_C)
@@ -52,6 +54,7 @@
 #include "mbedtls/rsa.h"
 #include "rsa_alt_helpers.h"
 #include "mbedtls/oid.h"
+#include "mbedtls/error.h"
 #include "mbedtls/platform_util.h"
 
 #include <string.h>
@@ -74,6 +77,7 @@
 #endif
 
 #if defined(MBEDTLS_RSA_ALT)
+#include "pka_stm32.h"
 
 /* Parameter validation macros */
 #define RSA_VALIDATE_RET( cond )                                       \
@@ -83,8 +87,6 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-#define ST_PKA_TIMEOUT 5000      /* 5s timeout for the Public key accelerator */
-
 /* Private macro -------------------------------------------------------------*/
 /*
  * 32-bit integer manipulation macros (big endian)
@@ -147,27 +149,16 @@ static int rsa_pka_arithmetic_mul( const unsigned char *A,
     in.pOp1 = input_A;
     in.pOp2 = input_B;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
-
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Mul(&hpka, &in, ST_PKA_TIMEOUT) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    if ( HAL_PKA_Mul( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK )
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    else
+        HAL_PKA_Arithmetic_GetResult( &hpka, (uint32_t *)AxB );
 
-    HAL_PKA_Arithmetic_GetResult( &hpka, (uint32_t *)AxB );
+    ret = pka_release( &hpka, ret );
 
 cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
-
     if (input_A != NULL)
     {
         mbedtls_platform_zeroize( input_A, op_len );
@@ -249,6 +240,40 @@ cleanup:
 }
 
 
+/**
+ * @brief       Get the Montgomery parameter R^2 mod n of the key, computed by
+ *              the PKA on first use then cached in ctx->RN
+ * @param[in]   hpka         PKA handle, the PKA must be acquired
+ * @param[in]   ctx          RSA context
+ * @param[in]   n_binary     Modulus (with length of the modulus)
+ * @param[out]  mont         Montgomery parameter in the PKA word format,
+ *                           ( ctx->len + 3 ) / 4 words
+ * @retval      0                                       Ok
+ * @retval      MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED    Error in the HW
+ */
+static int rsa_pka_montgomery( PKA_HandleTypeDef *hpka,
+                               mbedtls_rsa_context *ctx,
+                               const uint8_t *n_binary,
+                               uint32_t *mont )
+{
+    PKA_MontgomeryParamInTypeDef in = {0};
+    size_t mlen = ( ( ctx->len + 3 ) / 4 ) * 4;
+
+    /* RN holds the value of the little endian word array read back from the PKA */
+    if ( mbedtls_mpi_cmp_int( &ctx->RN, 0 ) != 0 )
+        return( mbedtls_mpi_write_binary_le( &ctx->RN, (unsigned char *)mont, mlen ) );
+
+    in.size = ctx->len;          /* modulus length */
+    in.pOp1 = n_binary;          /* modulus */
+
+    if ( HAL_PKA_MontgomeryParam( hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK )
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+
+    HAL_PKA_MontgomeryParam_GetResult( hpka, mont );
+
+    return( mbedtls_mpi_read_binary_le( &ctx->RN, (const unsigned char *)mont, mlen ) );
+}
+
 /**
  * @brief       Call the PKA modular exponentiation : output = input^e mod n
  * @param[in]   input        Input of the modexp
@@ -266,10 +291,12 @@ static int rsa_pka_modexp( mbedtls_rsa_context *ctx,
     int ret = 0;
     size_t nlen;
     size_t elen;
-    PKA_HandleTypeDef hpka = {0};
-    PKA_ModExpInTypeDef in = {0};
+    size_t mlen;
+    PKA_HandleTypeDef hpka;
+    PKA_ModExpFastModeInTypeDef in = {0};
     uint8_t *e_binary = NULL;
     uint8_t *n_binary = NULL;
+    uint32_t *mont = NULL;
 
     RSA_VALIDATE_RET( ctx != NULL );
     RSA_VALIDATE_RET( input != NULL );
@@ -296,35 +323,33 @@ static int rsa_pka_modexp( mbedtls_rsa_context *ctx,
     MBEDTLS_MPI_CHK( ( n_binary == NULL ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
     MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &ctx->N, n_binary, nlen ) );
 
-    in.expSize = elen;           /* Exponent length */
-    in.OpSize  = nlen;           /* modulus length */
-    in.pOp1    = input;
-    in.pExp    = e_binary;       /* Exponent */
-    in.pMod    = n_binary;       /* modulus */
+    mlen = ((nlen + 3)/4)*4;
+    mont = mbedtls_calloc( 1, mlen );
+    MBEDTLS_MPI_CHK( ( mont == NULL ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    ret = rsa_pka_montgomery( &hpka, ctx, n_binary, mont );
 
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    if ( ret == 0 )
+    {
+        in.expSize          = elen;             /* Exponent length */
+        in.OpSize           = nlen;             /* modulus length */
+        in.pOp1             = input;
+        in.pExp             = e_binary;         /* Exponent */
+        in.pMod             = n_binary;         /* modulus */
+        in.pMontgomeryParam = mont;             /* R^2 mod n */
 
-    /* output = input ^ e_binary mod n */
-    MBEDTLS_MPI_CHK( ( HAL_PKA_ModExp( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+        /* output = input ^ e_binary mod n */
+        if ( HAL_PKA_ModExpFastMode( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK )
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        else
+            HAL_PKA_ModExp_GetResult( &hpka, (uint8_t *)output );
+    }
 
-    HAL_PKA_ModExp_GetResult( &hpka, (uint8_t *)output );
+    ret = pka_release( &hpka, ret );
 
 cleanup:
-
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
-
     if (e_binary != NULL)
     {
         mbedtls_platform_zeroize( e_binary, elen );
@@ -337,6 +362,11 @@ cleanup:
         mbedtls_free( n_binary );
     }
 
+    if (mont != NULL)
+    {
+        mbedtls_platform_zeroize( mont, mlen );
+        mbedtls_free( mont );
+    }
 
     return ret;
 }
@@ -415,28 +445,16 @@ static int rsa_crt_pka_modexp( const mbedtls_mpi *dp,
     in.pPrimeQ = q_binary;
     in.popA    = input;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
-
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
-
-    MBEDTLS_MPI_CHK( ( HAL_PKA_RSACRTExp( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    if ( HAL_PKA_RSACRTExp( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK )
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    else
+        HAL_PKA_RSACRTExp_GetResult( &hpka, (uint8_t *)output );
 
-    HAL_PKA_RSACRTExp_GetResult( &hpka, (uint8_t *)output );
+    ret = pka_release( &hpka, ret );
 
 cleanup:
-
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
-
     if (dp_binary != NULL)
     {
         mbedtls_platform_zeroize( dp_binary, dplen );
@@ -505,7 +523,10 @@ int mbedtls_rsa_import( mbedtls_rsa_context *ctx,
     }
 
     if( N != NULL )
+    {
         ctx->len = mbedtls_mpi_size( &ctx->N );
+        mbedtls_mpi_free( &ctx->RN );
+    }
 
     return( 0 );
 }
@@ -524,6 +545,7 @@ int mbedtls_rsa_import_raw( mbedtls_rsa_context *ctx,
     {
         MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &ctx->N, N, N_len ) );
         ctx->len = mbedtls_mpi_size( &ctx->N );
+        mbedtls_mpi_free( &ctx->RN );
     }
 
     if( P != NULL )
@@ -687,6 +709,7 @@ int mbedtls_rsa_complete( mbedtls_rsa_context *ctx )
         }
 
         ctx->len = mbedtls_mpi_size( &ctx->N );
+        mbedtls_mpi_free( &ctx->RN );
     }
 
     /*
@@ -866,17 +889,14 @@ int mbedtls_rsa_export_crt( const mbedtls_rsa_context *ctx,
 /*
  * Initialize an RSA context
  */
-void mbedtls_rsa_init( mbedtls_rsa_context *ctx,
-               int padding,
-               int hash_id )
+void mbedtls_rsa_init( mbedtls_rsa_context *ctx )
 {
     RSA_VALIDATE( ctx != NULL );
-    RSA_VALIDATE( padding == MBEDTLS_RSA_PKCS_V15 ||
-                  padding == MBEDTLS_RSA_PKCS_V21 );
 
     memset( ctx, 0, sizeof( mbedtls_rsa_context ) );
 
-    mbedtls_rsa_set_padding( ctx, padding, hash_id );
+    ctx->padding = MBEDTLS_RSA_PKCS_V15;
+    ctx->hash_id = MBEDTLS_MD_NONE;
 
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_init( &ctx->mutex );
@@ -886,15 +906,28 @@ void mbedtls_rsa_init( mbedtls_rsa_context *ctx,
 /*
  * Set padding for an existing RSA context
  */
-void mbedtls_rsa_set_padding( mbedtls_rsa_context *ctx, int padding,
-                              int hash_id )
+int mbedtls_rsa_set_padding( mbedtls_rsa_context *ctx, int padding,
+                             mbedtls_md_type_t hash_id )
 {
-    RSA_VALIDATE( ctx != NULL );
-    RSA_VALIDATE( padding == MBEDTLS_RSA_PKCS_V15 ||
-                  padding == MBEDTLS_RSA_PKCS_V21 );
+    RSA_VALIDATE_RET( ctx != NULL );
+
+    if( ( padding != MBEDTLS_RSA_PKCS_V15 ) &&
+        ( padding != MBEDTLS_RSA_PKCS_V21 ) )
+        return( MBEDTLS_ERR_RSA_INVALID_PADDING );
+
+#if defined(MBEDTLS_PKCS1_V21)
+    if( ( padding == MBEDTLS_RSA_PKCS_V21 ) &&
+        ( hash_id != MBEDTLS_MD_NONE ) )
+    {
+        if( mbedtls_md_info_from_type( hash_id ) == NULL )
+            return( MBEDTLS_ERR_RSA_INVALID_PADDING );
+    }
+#endif /* MBEDTLS_PKCS1_V21 */
 
     ctx->padding = padding;
     ctx->hash_id = hash_id;
+
+    return( 0 );
 }
 
 /*
@@ -995,6 +1028,7 @@ int mbedtls_rsa_gen_key( mbedtls_rsa_context *ctx,
     MBEDTLS_MPI_CHK( rsa_mpi2pka_mul( &ctx->N, &ctx->P, &ctx->Q ) );
 
     ctx->len = mbedtls_mpi_size( &ctx->N );
+    mbedtls_mpi_free( &ctx->RN );
 
 #if !defined(MBEDTLS_RSA_NO_CRT)
     /*
@@ -1206,6 +1240,9 @@ int mbedtls_rsa_private( mbedtls_rsa_context *ctx,
     RSA_VALIDATE_RET( input  != NULL );
     RSA_VALIDATE_RET( output != NULL );
 
+    if( f_rng == NULL )
+        return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
+
     if( rsa_check_context( ctx, 1             /* private key checks */,
                                 f_rng != NULL /* blinding y/n       */ ) != 0 )
     {
@@ -1324,7 +1361,6 @@ exit:
 int mbedtls_rsa_rsaes_oaep_encrypt( mbedtls_rsa_context *ctx,
                             int (*f_rng)(void *, unsigned char *, size_t),
                             void *p_rng,
-                            int mode,
                             const unsigned char *label, size_t label_len,
                             size_t ilen,
                             const unsigned char *input,
@@ -1338,13 +1374,11 @@ int mbedtls_rsa_rsaes_oaep_encrypt( mbedtls_rsa_context *ctx,
     mbedtls_md_context_t md_ctx;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output != NULL );
     RSA_VALIDATE_RET( ilen == 0 || input != NULL );
     RSA_VALIDATE_RET( label_len == 0 || label != NULL );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V21 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V21 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     if( f_rng == NULL )
@@ -1400,9 +1434,7 @@ exit:
     if( ret != 0 )
         return( ret );
 
-    return( ( mode == MBEDTLS_RSA_PUBLIC )
-            ? mbedtls_rsa_public(  ctx, output, output )
-            : mbedtls_rsa_private( ctx, f_rng, p_rng, output, output ) );
+    return( mbedtls_rsa_public(  ctx, output, output ) );
 }
 #endif /* MBEDTLS_PKCS1_V21 */
 
@@ -1412,8 +1444,7 @@ exit:
  */
 int mbedtls_rsa_rsaes_pkcs1_v15_encrypt( mbedtls_rsa_context *ctx,
                                  int (*f_rng)(void *, unsigned char *, size_t),
-                                 void *p_rng,
-                                 int mode, size_t ilen,
+                                 void *p_rng, size_t ilen,
                                  const unsigned char *input,
                                  unsigned char *output )
 {
@@ -1422,12 +1453,10 @@ int mbedtls_rsa_rsaes_pkcs1_v15_encrypt( mbedtls_rsa_context *ctx,
     unsigned char *p = output;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output != NULL );
     RSA_VALIDATE_RET( ilen == 0 || input != NULL );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V15 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V15 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     olen = ctx->len;
@@ -1438,44 +1467,32 @@ int mbedtls_rsa_rsaes_pkcs1_v15_encrypt( mbedtls_rsa_context *ctx,
 
     nb_pad = olen - 3 - ilen;
 
-    *p++ = 0;
-    if( mode == MBEDTLS_RSA_PUBLIC )
-    {
-        if( f_rng == NULL )
-            return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
-
-        *p++ = MBEDTLS_RSA_CRYPT;
+    if( f_rng == NULL )
+        return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
-        while( nb_pad-- > 0 )
-        {
-            int rng_dl = 100;
+    *p++ = 0;
+    *p++ = MBEDTLS_RSA_CRYPT;
 
-            do {
-                ret = f_rng( p_rng, p, 1 );
-            } while( *p == 0 && --rng_dl && ret == 0 );
+    while( nb_pad-- > 0 )
+    {
+        int rng_dl = 100;
 
-            /* Check if RNG failed to generate data */
-            if( rng_dl == 0 || ret != 0 )
-                return( MBEDTLS_ERR_RSA_RNG_FAILED + ret );
+        do {
+            ret = f_rng( p_rng, p, 1 );
+        } while( *p == 0 && --rng_dl && ret == 0 );
 
-            p++;
-        }
-    }
-    else
-    {
-        *p++ = MBEDTLS_RSA_SIGN;
+        /* Check if RNG failed to generate data */
+        if( rng_dl == 0 || ret != 0 )
+            return( MBEDTLS_ERR_RSA_RNG_FAILED + ret );
 
-        while( nb_pad-- > 0 )
-            *p++ = 0xFF;
+        p++;
     }
 
     *p++ = 0;
     if( ilen != 0 )
         memcpy( p, input, ilen );
 
-    return( ( mode == MBEDTLS_RSA_PUBLIC )
-            ? mbedtls_rsa_public(  ctx, output, output )
-            : mbedtls_rsa_private( ctx, f_rng, p_rng, output, output ) );
+    return( mbedtls_rsa_public(  ctx, output, output ) );
 }
 #endif /* MBEDTLS_PKCS1_V15 */
 
@@ -1484,14 +1501,11 @@ int mbedtls_rsa_rsaes_pkcs1_v15_encrypt( mbedtls_rsa_context *ctx,
  */
 int mbedtls_rsa_pkcs1_encrypt( mbedtls_rsa_context *ctx,
                        int (*f_rng)(void *, unsigned char *, size_t),
-                       void *p_rng,
-                       int mode, size_t ilen,
+                       void *p_rng, size_t ilen,
                        const unsigned char *input,
                        unsigned char *output )
 {
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output != NULL );
     RSA_VALIDATE_RET( ilen == 0 || input != NULL );
 
@@ -1499,13 +1513,13 @@ int mbedtls_rsa_pkcs1_encrypt( mbedtls_rsa_context *ctx,
     {
 #if defined(MBEDTLS_PKCS1_V15)
         case MBEDTLS_RSA_PKCS_V15:
-            return mbedtls_rsa_rsaes_pkcs1_v15_encrypt( ctx, f_rng, p_rng, mode, ilen,
+            return mbedtls_rsa_rsaes_pkcs1_v15_encrypt( ctx, f_rng, p_rng, ilen,
                                                 input, output );
 #endif
 
 #if defined(MBEDTLS_PKCS1_V21)
         case MBEDTLS_RSA_PKCS_V21:
-            return mbedtls_rsa_rsaes_oaep_encrypt( ctx, f_rng, p_rng, mode, NULL, 0,
+            return mbedtls_rsa_rsaes_oaep_encrypt( ctx, f_rng, p_rng, NULL, 0,
                                            ilen, input, output );
 #endif
 
@@ -1521,7 +1535,6 @@ int mbedtls_rsa_pkcs1_encrypt( mbedtls_rsa_context *ctx,
 int mbedtls_rsa_rsaes_oaep_decrypt( mbedtls_rsa_context *ctx,
                             int (*f_rng)(void *, unsigned char *, size_t),
                             void *p_rng,
-                            int mode,
                             const unsigned char *label, size_t label_len,
                             size_t *olen,
                             const unsigned char *input,
@@ -1538,8 +1551,6 @@ int mbedtls_rsa_rsaes_oaep_decrypt( mbedtls_rsa_context *ctx,
     mbedtls_md_context_t md_ctx;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output_max_len == 0 || output != NULL );
     RSA_VALIDATE_RET( label_len == 0 || label != NULL );
     RSA_VALIDATE_RET( input != NULL );
@@ -1548,7 +1559,7 @@ int mbedtls_rsa_rsaes_oaep_decrypt( mbedtls_rsa_context *ctx,
     /*
      * Parameters sanity checks
      */
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V21 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V21 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     ilen = ctx->len;
@@ -1569,9 +1580,7 @@ int mbedtls_rsa_rsaes_oaep_decrypt( mbedtls_rsa_context *ctx,
     /*
      * RSA operation
      */
-    ret = ( mode == MBEDTLS_RSA_PUBLIC )
-          ? mbedtls_rsa_public(  ctx, input, buf )
-          : mbedtls_rsa_private( ctx, f_rng, p_rng, input, buf );
+    ret = mbedtls_rsa_private( ctx, f_rng, p_rng, input, buf );
 
     if( ret != 0 )
         goto cleanup;
@@ -1758,8 +1767,7 @@ static void mem_move_to_left( void *start,
  */
 int mbedtls_rsa_rsaes_pkcs1_v15_decrypt( mbedtls_rsa_context *ctx,
                                  int (*f_rng)(void *, unsigned char *, size_t),
-                                 void *p_rng,
-                                 int mode, size_t *olen,
+                                 void *p_rng, size_t *olen,
                                  const unsigned char *input,
                                  unsigned char *output,
                                  size_t output_max_len )
@@ -1784,8 +1792,6 @@ int mbedtls_rsa_rsaes_pkcs1_v15_decrypt( mbedtls_rsa_context *ctx,
     unsigned output_too_large;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output_max_len == 0 || output != NULL );
     RSA_VALIDATE_RET( input != NULL );
     RSA_VALIDATE_RET( olen != NULL );
@@ -1795,15 +1801,13 @@ int mbedtls_rsa_rsaes_pkcs1_v15_decrypt( mbedtls_rsa_context *ctx,
                            ilen - 11 :
                            output_max_len );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V15 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V15 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     if( ilen < 16 || ilen > sizeof( buf ) )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
-    ret = ( mode == MBEDTLS_RSA_PUBLIC )
-          ? mbedtls_rsa_public(  ctx, input, buf )
-          : mbedtls_rsa_private( ctx, f_rng, p_rng, input, buf );
+    ret = mbedtls_rsa_private( ctx, f_rng, p_rng, input, buf );
 
     if( ret != 0 )
         goto cleanup;
@@ -1812,35 +1816,16 @@ int mbedtls_rsa_rsaes_pkcs1_v15_decrypt( mbedtls_rsa_context *ctx,
      * memory trace. The first byte must be 0. */
     bad |= buf[0];
 
-    if( mode == MBEDTLS_RSA_PRIVATE )
-    {
-        /* Decode EME-PKCS1-v1_5 padding: 0x00 || 0x02 || PS || 0x00
-         * where PS must be at least 8 nonzero bytes. */
-        bad |= buf[1] ^ MBEDTLS_RSA_CRYPT;
+    /* Decode EME-PKCS1-v1_5 padding: 0x00 || 0x02 || PS || 0x00
+     * where PS must be at least 8 nonzero bytes. */
+    bad |= buf[1] ^ MBEDTLS_RSA_CRYPT;
 
-        /* Read the whole buffer. Set pad_done to nonzero if we find
-         * the 0x00 byte and remember the padding length in pad_count. */
-        for( i = 2; i < ilen; i++ )
-        {
-            pad_done  |= ((buf[i] | (unsigned char)-buf[i]) >> 7) ^ 1;
-            pad_count += ((pad_done | (unsigned char)-pad_done) >> 7) ^ 1;
-        }
-    }
-    else
+    /* Read the whole buffer. Set pad_done to nonzero if we find
+     * the 0x00 byte and remember the padding length in pad_count. */
+    for( i = 2; i < ilen; i++ )
     {
-        /* Decode EMSA-PKCS1-v1_5 padding: 0x00 || 0x01 || PS || 0x00
-         * where PS must be at least 8 bytes with the value 0xFF. */
-        bad |= buf[1] ^ MBEDTLS_RSA_SIGN;
-
-        /* Read the whole buffer. Set pad_done to nonzero if we find
-         * the 0x00 byte and remember the padding length in pad_count.
-         * If there's a non-0xff byte in the padding, the padding is bad. */
-        for( i = 2; i < ilen; i++ )
-        {
-            pad_done |= if_int( buf[i], 0, 1 );
-            pad_count += if_int( pad_done, 0, 1 );
-            bad |= if_int( pad_done, 0, buf[i] ^ 0xFF );
-        }
+        pad_done  |= ((buf[i] | (unsigned char)-buf[i]) >> 7) ^ 1;
+        pad_count += ((pad_done | (unsigned char)-pad_done) >> 7) ^ 1;
     }
 
     /* If pad_done is still zero, there's no data, only unfinished padding. */
@@ -1930,15 +1915,12 @@ cleanup:
  */
 int mbedtls_rsa_pkcs1_decrypt( mbedtls_rsa_context *ctx,
                        int (*f_rng)(void *, unsigned char *, size_t),
-                       void *p_rng,
-                       int mode, size_t *olen,
+                       void *p_rng, size_t *olen,
                        const unsigned char *input,
                        unsigned char *output,
                        size_t output_max_len)
 {
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( output_max_len == 0 || output != NULL );
     RSA_VALIDATE_RET( input != NULL );
     RSA_VALIDATE_RET( olen != NULL );
@@ -1947,13 +1929,13 @@ int mbedtls_rsa_pkcs1_decrypt( mbedtls_rsa_context *ctx,
     {
 #if defined(MBEDTLS_PKCS1_V15)
         case MBEDTLS_RSA_PKCS_V15:
-            return mbedtls_rsa_rsaes_pkcs1_v15_decrypt( ctx, f_rng, p_rng, mode, olen,
+            return mbedtls_rsa_rsaes_pkcs1_v15_decrypt( ctx, f_rng, p_rng, olen,
                                                 input, output, output_max_len );
 #endif
 
 #if defined(MBEDTLS_PKCS1_V21)
         case MBEDTLS_RSA_PKCS_V21:
-            return mbedtls_rsa_rsaes_oaep_decrypt( ctx, f_rng, p_rng, mode, NULL, 0,
+            return mbedtls_rsa_rsaes_oaep_decrypt( ctx, f_rng, p_rng, NULL, 0,
                                            olen, input, output,
                                            output_max_len );
 #endif
@@ -1965,15 +1947,16 @@ int mbedtls_rsa_pkcs1_decrypt( mbedtls_rsa_context *ctx,
 
 #if defined(MBEDTLS_PKCS1_V21)
 /*
- * Implementation of the PKCS#1 v2.1 RSASSA-PSS-SIGN function
+ * Implementation of the PKCS#1 v2.1 RSASSA-PSS-SIGN function,
+ * saltlen MBEDTLS_RSA_SALT_LEN_ANY selects the longest salt that fits
  */
-int mbedtls_rsa_rsassa_pss_sign( mbedtls_rsa_context *ctx,
+static int rsa_rsassa_pss_sign( mbedtls_rsa_context *ctx,
                          int (*f_rng)(void *, unsigned char *, size_t),
                          void *p_rng,
-                         int mode,
                          mbedtls_md_type_t md_alg,
                          unsigned int hashlen,
                          const unsigned char *hash,
+                         int saltlen,
                          unsigned char *sig )
 {
     size_t olen;
@@ -1985,14 +1968,12 @@ int mbedtls_rsa_rsassa_pss_sign( mbedtls_rsa_context *ctx,
     const mbedtls_md_info_t *md_info;
     mbedtls_md_context_t md_ctx;
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
                       hash != NULL );
     RSA_VALIDATE_RET( sig != NULL );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V21 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V21 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     if( f_rng == NULL )
@@ -2022,13 +2003,24 @@ int mbedtls_rsa_rsassa_pss_sign( mbedtls_rsa_context *ctx,
      * that the hash length plus the salt length plus 2 bytes must be at most
      * the key length. This complies with FIPS 186-4 §5.5 (e) and RFC 8017
      * (PKCS#1 v2.2) §9.1.1 step 3. */
-    min_slen = hlen - 2;
-    if( olen < hlen + min_slen + 2 )
+    if( saltlen == MBEDTLS_RSA_SALT_LEN_ANY )
+    {
+        min_slen = hlen - 2;
+        if( olen < hlen + min_slen + 2 )
+            return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
+        else if( olen >= hlen + hlen + 2 )
+            slen = hlen;
+        else
+            slen = olen - hlen - 2;
+    }
+    else if( ( saltlen < 0 ) || ( saltlen + hlen + 2 > olen ) )
+    {
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
-    else if( olen >= hlen + hlen + 2 )
-        slen = hlen;
+    }
     else
-        slen = olen - hlen - 2;
+    {
+        slen = (size_t) saltlen;
+    }
 
     memset( sig, 0, olen );
 
@@ -2082,9 +2074,38 @@ exit:
     if( ret != 0 )
         return( ret );
 
-    return( ( mode == MBEDTLS_RSA_PUBLIC )
-            ? mbedtls_rsa_public(  ctx, sig, sig )
-            : mbedtls_rsa_private( ctx, f_rng, p_rng, sig, sig ) );
+    return( mbedtls_rsa_private( ctx, f_rng, p_rng, sig, sig ) );
+}
+
+/*
+ * PKCS#1 v2.1 RSASSA-PSS-SIGN with a caller selected salt length
+ */
+int mbedtls_rsa_rsassa_pss_sign_ext( mbedtls_rsa_context *ctx,
+                         int (*f_rng)(void *, unsigned char *, size_t),
+                         void *p_rng,
+                         mbedtls_md_type_t md_alg,
+                         unsigned int hashlen,
+                         const unsigned char *hash,
+                         int saltlen,
+                         unsigned char *sig )
+{
+    return( rsa_rsassa_pss_sign( ctx, f_rng, p_rng, md_alg,
+                                 hashlen, hash, saltlen, sig ) );
+}
+
+/*
+ * PKCS#1 v2.1 RSASSA-PSS-SIGN with the longest salt that fits
+ */
+int mbedtls_rsa_rsassa_pss_sign( mbedtls_rsa_context *ctx,
+                         int (*f_rng)(void *, unsigned char *, size_t),
+                         void *p_rng,
+                         mbedtls_md_type_t md_alg,
+                         unsigned int hashlen,
+                         const unsigned char *hash,
+                         unsigned char *sig )
+{
+    return( rsa_rsassa_pss_sign( ctx, f_rng, p_rng, md_alg,
+                                 hashlen, hash, MBEDTLS_RSA_SALT_LEN_ANY, sig ) );
 }
 #endif /* MBEDTLS_PKCS1_V21 */
 
@@ -2229,7 +2250,6 @@ static int rsa_rsassa_pkcs1_v15_encode( mbedtls_md_type_t md_alg,
 int mbedtls_rsa_rsassa_pkcs1_v15_sign( mbedtls_rsa_context *ctx,
                                int (*f_rng)(void *, unsigned char *, size_t),
                                void *p_rng,
-                               int mode,
                                mbedtls_md_type_t md_alg,
                                unsigned int hashlen,
                                const unsigned char *hash,
@@ -2239,14 +2259,12 @@ int mbedtls_rsa_rsassa_pkcs1_v15_sign( mbedtls_rsa_context *ctx,
     unsigned char *sig_try = NULL, *verif = NULL;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
                       hash != NULL );
     RSA_VALIDATE_RET( sig != NULL );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V15 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V15 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     /*
@@ -2257,16 +2275,6 @@ int mbedtls_rsa_rsassa_pkcs1_v15_sign( mbedtls_rsa_context *ctx,
                                              ctx->len, sig ) ) != 0 )
         return( ret );
 
-    /*
-     * Call respective RSA primitive
-     */
-
-    if( mode == MBEDTLS_RSA_PUBLIC )
-    {
-        /* Skip verification on a public key operation */
-        return( mbedtls_rsa_public( ctx, sig, sig ) );
-    }
-
     /* Private key operation
      *
      * In order to prevent Lenstra's attack, make the signature in a
@@ -2309,15 +2317,12 @@ cleanup:
 int mbedtls_rsa_pkcs1_sign( mbedtls_rsa_context *ctx,
                     int (*f_rng)(void *, unsigned char *, size_t),
                     void *p_rng,
-                    int mode,
                     mbedtls_md_type_t md_alg,
                     unsigned int hashlen,
                     const unsigned char *hash,
                     unsigned char *sig )
 {
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
                       hash != NULL );
@@ -2327,13 +2332,13 @@ int mbedtls_rsa_pkcs1_sign( mbedtls_rsa_context *ctx,
     {
 #if defined(MBEDTLS_PKCS1_V15)
         case MBEDTLS_RSA_PKCS_V15:
-            return mbedtls_rsa_rsassa_pkcs1_v15_sign( ctx, f_rng, p_rng, mode, md_alg,
+            return mbedtls_rsa_rsassa_pkcs1_v15_sign( ctx, f_rng, p_rng, md_alg,
                                               hashlen, hash, sig );
 #endif
 
 #if defined(MBEDTLS_PKCS1_V21)
         case MBEDTLS_RSA_PKCS_V21:
-            return mbedtls_rsa_rsassa_pss_sign( ctx, f_rng, p_rng, mode, md_alg,
+            return mbedtls_rsa_rsassa_pss_sign( ctx, f_rng, p_rng, md_alg,
                                         hashlen, hash, sig );
 #endif
 
@@ -2347,9 +2352,6 @@ int mbedtls_rsa_pkcs1_sign( mbedtls_rsa_context *ctx,
  * Implementation of the PKCS#1 v2.1 RSASSA-PSS-VERIFY function
  */
 int mbedtls_rsa_rsassa_pss_verify_ext( mbedtls_rsa_context *ctx,
-                               int (*f_rng)(void *, unsigned char *, size_t),
-                               void *p_rng,
-                               int mode,
                                mbedtls_md_type_t md_alg,
                                unsigned int hashlen,
                                const unsigned char *hash,
@@ -2370,14 +2372,12 @@ int mbedtls_rsa_rsassa_pss_verify_ext( mbedtls_rsa_context *ctx,
     unsigned char buf[MBEDTLS_MPI_MAX_SIZE];
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( sig != NULL );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
                       hash != NULL );
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V21 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V21 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     siglen = ctx->len;
@@ -2385,9 +2385,7 @@ int mbedtls_rsa_rsassa_pss_verify_ext( mbedtls_rsa_context *ctx,
     if( siglen < 16 || siglen > sizeof( buf ) )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
-    ret = ( mode == MBEDTLS_RSA_PUBLIC )
-          ? mbedtls_rsa_public(  ctx, sig, buf )
-          : mbedtls_rsa_private( ctx, f_rng, p_rng, sig, buf );
+    ret = mbedtls_rsa_public(  ctx, sig, buf );
 
     if( ret != 0 )
         return( ret );
@@ -2497,9 +2495,6 @@ exit:
  * Simplified PKCS#1 v2.1 RSASSA-PSS-VERIFY function
  */
 int mbedtls_rsa_rsassa_pss_verify( mbedtls_rsa_context *ctx,
-                           int (*f_rng)(void *, unsigned char *, size_t),
-                           void *p_rng,
-                           int mode,
                            mbedtls_md_type_t md_alg,
                            unsigned int hashlen,
                            const unsigned char *hash,
@@ -2507,8 +2502,6 @@ int mbedtls_rsa_rsassa_pss_verify( mbedtls_rsa_context *ctx,
 {
     mbedtls_md_type_t mgf1_hash_id;
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( sig != NULL );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
@@ -2518,7 +2511,7 @@ int mbedtls_rsa_rsassa_pss_verify( mbedtls_rsa_context *ctx,
                              ? (mbedtls_md_type_t) ctx->hash_id
                              : md_alg;
 
-    return( mbedtls_rsa_rsassa_pss_verify_ext( ctx, f_rng, p_rng, mode,
+    return( mbedtls_rsa_rsassa_pss_verify_ext( ctx,
                                        md_alg, hashlen, hash,
                                        mgf1_hash_id, MBEDTLS_RSA_SALT_LEN_ANY,
                                        sig ) );
@@ -2531,9 +2524,6 @@ int mbedtls_rsa_rsassa_pss_verify( mbedtls_rsa_context *ctx,
  * Implementation of the PKCS#1 v2.1 RSASSA-PKCS1-v1_5-VERIFY function
  */
 int mbedtls_rsa_rsassa_pkcs1_v15_verify( mbedtls_rsa_context *ctx,
-                                 int (*f_rng)(void *, unsigned char *, size_t),
-                                 void *p_rng,
-                                 int mode,
                                  mbedtls_md_type_t md_alg,
                                  unsigned int hashlen,
                                  const unsigned char *hash,
@@ -2544,8 +2534,6 @@ int mbedtls_rsa_rsassa_pkcs1_v15_verify( mbedtls_rsa_context *ctx,
     unsigned char *encoded = NULL, *encoded_expected = NULL;
 
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( sig != NULL );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
@@ -2553,7 +2541,7 @@ int mbedtls_rsa_rsassa_pkcs1_v15_verify( mbedtls_rsa_context *ctx,
 
     sig_len = ctx->len;
 
-    if( mode == MBEDTLS_RSA_PRIVATE && ctx->padding != MBEDTLS_RSA_PKCS_V15 )
+    if( ctx->padding != MBEDTLS_RSA_PKCS_V15 )
         return( MBEDTLS_ERR_RSA_BAD_INPUT_DATA );
 
     /*
@@ -2575,9 +2563,7 @@ int mbedtls_rsa_rsassa_pkcs1_v15_verify( mbedtls_rsa_context *ctx,
      * Apply RSA primitive to get what should be PKCS1 encoded hash.
      */
 
-    ret = ( mode == MBEDTLS_RSA_PUBLIC )
-          ? mbedtls_rsa_public(  ctx, sig, encoded )
-          : mbedtls_rsa_private( ctx, f_rng, p_rng, sig, encoded );
+    ret = mbedtls_rsa_public(  ctx, sig, encoded );
     if( ret != 0 )
         goto cleanup;
 
@@ -2614,17 +2600,12 @@ cleanup:
  * Do an RSA operation and check the message digest
  */
 int mbedtls_rsa_pkcs1_verify( mbedtls_rsa_context *ctx,
-                      int (*f_rng)(void *, unsigned char *, size_t),
-                      void *p_rng,
-                      int mode,
                       mbedtls_md_type_t md_alg,
                       unsigned int hashlen,
                       const unsigned char *hash,
                       const unsigned char *sig )
 {
     RSA_VALIDATE_RET( ctx != NULL );
-    RSA_VALIDATE_RET( mode == MBEDTLS_RSA_PRIVATE ||
-                      mode == MBEDTLS_RSA_PUBLIC );
     RSA_VALIDATE_RET( sig != NULL );
     RSA_VALIDATE_RET( ( md_alg  == MBEDTLS_MD_NONE &&
                         hashlen == 0 ) ||
@@ -2634,13 +2615,13 @@ int mbedtls_rsa_pkcs1_verify( mbedtls_rsa_context *ctx,
     {
 #if defined(MBEDTLS_PKCS1_V15)
         case MBEDTLS_RSA_PKCS_V15:
-            return mbedtls_rsa_rsassa_pkcs1_v15_verify( ctx, f_rng, p_rng, mode, md_alg,
+            return mbedtls_rsa_rsassa_pkcs1_v15_verify( ctx, md_alg,
                                                 hashlen, hash, sig );
 #endif
 
 #if defined(MBEDTLS_PKCS1_V21)
         case MBEDTLS_RSA_PKCS_V21:
-            return mbedtls_rsa_rsassa_pss_verify( ctx, f_rng, p_rng, mode, md_alg,
+            return mbedtls_rsa_rsassa_pss_verify( ctx, md_alg,
                                           hashlen, hash, sig );
 #endif
 
@@ -2721,6 +2702,186 @@ void mbedtls_rsa_free( mbedtls_rsa_context *ctx )
 #endif
 }
 
+/*
+ * Known answer test: RSA-2048 key generated with OpenSSL, PKCS#1 v1.5
+ * signature of the SHA-256 of "sample" made by "openssl dgst -sha256 -sign"
+ */
+static const unsigned char rsa_test_N[256] =
+{
+    0xEA, 0x90, 0xEE, 0x52, 0x42, 0x3A, 0xCB, 0x47,
+    0x04, 0x5A, 0x07, 0xA6, 0xFB, 0xB5, 0x81, 0xB0,
+    0x81, 0x53, 0xD5, 0x8A, 0xD6, 0x0B, 0x46, 0x41,
+    0xF4, 0x2C, 0xE9, 0x57, 0x10, 0x5F, 0xE2, 0xBF,
+    0x16, 0xDB, 0x9B, 0x77, 0x8B, 0x93, 0x3D, 0xCA,
+    0xCD, 0xFC, 0x8F, 0xFB, 0x57, 0x5D, 0xEB, 0x74,
+    0x5F, 0x4E, 0x91, 0xB7, 0x44, 0xDE, 0x72, 0x7B,
+    0x99, 0x5D, 0x0A, 0x5F, 0xB7, 0x2E, 0x5F, 0xE9,
+    0xD4, 0x48, 0x9C, 0x61, 0x02, 0xB3, 0xD0, 0xA7,
+    0x50, 0x94, 0x94, 0x9D, 0x6C, 0x11, 0x98, 0x8F,
+    0x1E, 0xCB, 0x8C, 0x66, 0xAD, 0xAD, 0xDD, 0xD1,
+    0x58, 0x2B, 0x8B, 0x24, 0xBD, 0x06, 0x4F, 0x76,
+    0x77, 0x17, 0xEF, 0xF7, 0x1A, 0xFA, 0xB1, 0x0E,
+    0xBD, 0xA2, 0x2A, 0x6D, 0x1F, 0x86, 0xB0, 0xBD,
+    0x90, 0x8B, 0x57, 0xA5, 0xC2, 0x9A, 0x9C, 0x51,
+    0x35, 0xCD, 0xC7, 0xF1, 0xF6, 0x5E, 0x0D, 0x78,
+    0x4D, 0xF0, 0xC7, 0xC2, 0x69, 0x5A, 0x06, 0x32,
+    0x80, 0x7D, 0x28, 0x9D, 0x1E, 0x40, 0x65, 0xC9,
+    0xD6, 0x83, 0x30, 0xCA, 0xD4, 0xC9, 0x87, 0xFF,
+    0x20, 0x38, 0x34, 0x0D, 0x13, 0x85, 0xBC, 0x03,
+    0x1F, 0x2C, 0x95, 0xF9, 0x78, 0x4A, 0xFA, 0xBC,
+    0xBF, 0x06, 0x70, 0x68, 0x4D, 0xE8, 0x9A, 0x46,
+    0xF1, 0xEB, 0x6F, 0x22, 0xA1, 0x55, 0xF8, 0x16,
+    0x19, 0x6C, 0xA6, 0x70, 0x25, 0x02, 0x0D, 0x32,
+    0xF8, 0xAD, 0xE9, 0xA6, 0xD8, 0x5C, 0x0B, 0xB2,
+    0xD5, 0x77, 0xB5, 0x7D, 0x40, 0xD2, 0x23, 0xCB,
+    0x33, 0xC9, 0xD1, 0x08, 0xA4, 0x13, 0x1A, 0x6B,
+    0x02, 0x4A, 0xBD, 0x59, 0x54, 0x1E, 0x1B, 0xEF,
+    0x15, 0x06, 0x4E, 0x46, 0xBC, 0xD4, 0xC0, 0xD5,
+    0x5A, 0x34, 0x9E, 0x36, 0xAD, 0x51, 0xDF, 0x8C,
+    0x7A, 0xDC, 0x16, 0xD4, 0xCE, 0x24, 0xB7, 0x3F,
+    0x84, 0xCA, 0x5F, 0xB6, 0x78, 0x61, 0x7C, 0x27
+};
+
+static const unsigned char rsa_test_P[128] =
+{
+    0xFE, 0x4C, 0x30, 0x30, 0xFF, 0x57, 0xAF, 0xB2,
+    0x6A, 0x84, 0xB3, 0x68, 0xFE, 0xB9, 0xBA, 0x76,
+    0x6C, 0xE6, 0x5F, 0x4C, 0xB2, 0x28, 0xB0, 0x01,
+    0xA5, 0xEE, 0x99, 0x17, 0x89, 0x76, 0xE6, 0x65,
+    0xFE, 0x9A, 0xFE, 0x55, 0xD1, 0xF0, 0x04, 0x67,
+    0xA9, 0x82, 0xAA, 0xF3, 0xFD, 0x62, 0x7C, 0x86,
+    0x9D, 0xB8, 0x7E, 0xD6, 0x37, 0x31, 0x7C, 0x16,
+    0x7D, 0x47, 0x6E, 0xAB, 0x44, 0xB0, 0x62, 0x08,
+    0x1D, 0x4C, 0xC7, 0x47, 0x0D, 0x04, 0xF5, 0x8A,
+    0x63, 0x2E, 0xA0, 0xA9, 0x7F, 0x7D, 0x90, 0x16,
+    0x37, 0xF1, 0x33, 0x98, 0xD3, 0x3D, 0xE3, 0x38,
+    0x71, 0x33, 0x3D, 0xA8, 0x8C, 0x70, 0x84, 0x91,
+    0x63, 0x1E, 0x6A, 0xED, 0xA2, 0x83, 0x84, 0x65,
+    0xA8, 0x5D, 0x33, 0x6F, 0x86, 0x0E, 0xE7, 0xDC,
+    0xB2, 0x3C, 0x2E, 0x6B, 0x1E, 0xFE, 0x75, 0x2C,
+    0x9F, 0x3D, 0xD7, 0x8D, 0x69, 0xC0, 0xED, 0xAD
+};
+
+static const unsigned char rsa_test_Q[128] =
+{
+    0xEC, 0x22, 0xED, 0x5A, 0xC2, 0x38, 0x61, 0x81,
+    0x94, 0x16, 0x8E, 0x10, 0xE9, 0xEA, 0x91, 0xCD,
+    0x06, 0x22, 0x39, 0x20, 0xD9, 0x91, 0x3C, 0x65,
+    0x35, 0x6C, 0x46, 0x14, 0xFB, 0x7F, 0x35, 0x3B,
+    0x89, 0xAD, 0x6A, 0x7D, 0x0B, 0x86, 0xDC, 0x81,
+    0x97, 0x5E, 0x6D, 0x4B, 0x14, 0x0E, 0x69, 0xBC,
+    0xAC, 0x6C, 0x39, 0xFE, 0x2E, 0xCB, 0x28, 0xF4,
+    0x93, 0x15, 0xF7, 0x00, 0xE8, 0x6E, 0x09, 0x64,
+    0x04, 0x3F, 0x75, 0xA1, 0xEB, 0xC2, 0x69, 0x39,
+    0xDF, 0x7C, 0x00, 0x9B, 0x71, 0x0C, 0x19, 0x48,
+    0xA7, 0xC5, 0x5F, 0x8A, 0x74, 0x18, 0x53, 0x9C,
+    0x60, 0x64, 0x9A, 0xEA, 0x29, 0xA3, 0xBC, 0x2F,
+    0x2B, 0xEA, 0xE3, 0x43, 0xDC, 0x95, 0x33, 0xF6,
+    0x3D, 0x01, 0x9C, 0x5A, 0x6E, 0xB1, 0xDD, 0x88,
+    0x09, 0x4F, 0x33, 0x89, 0x33, 0xB5, 0xDE, 0x08,
+    0x09, 0x89, 0xFE, 0x43, 0x74, 0xA9, 0xA3, 0xA3
+};
+
+static const unsigned char rsa_test_E[3] =
+{
+    0x01, 0x00, 0x01
+};
+
+static const unsigned char rsa_test_hash[32] =
+{
+    0xAF, 0x2B, 0xDB, 0xE1, 0xAA, 0x9B, 0x6E, 0xC1,
+    0xE2, 0xAD, 0xE1, 0xD6, 0x94, 0xF4, 0x1F, 0xC7,
+    0x1A, 0x83, 0x1D, 0x02, 0x68, 0xE9, 0x89, 0x15,
+    0x62, 0x11, 0x3D, 0x8A, 0x62, 0xAD, 0xD1, 0xBF
+};
+
+static const unsigned char rsa_test_sig[256] =
+{
+    0x10, 0xEA, 0xB7, 0xB8, 0x0B, 0xD9, 0x7B, 0x96,
+    0x67, 0x89, 0xE1, 0x75, 0xE5, 0x70, 0x65, 0x7B,
+    0x71, 0xD3, 0x7A, 0xF8, 0xC6, 0x82, 0x5F, 0xA6,
+    0xF8, 0x06, 0xDB, 0x68, 0x35, 0x53, 0x43, 0xCD,
+    0xB0, 0x0A, 0x0E, 0x41, 0xCD, 0x13, 0x53, 0x03,
+    0x71, 0x37, 0xC1, 0xE3, 0x99, 0xC8, 0x32, 0xDA,
+    0xB8, 0x8A, 0x1D, 0xA3, 0x43, 0x6D, 0x8C, 0x3B,
+    0x96, 0xB3, 0x05, 0xC0, 0xE4, 0xCD, 0x32, 0xEE,
+    0x7D, 0x4C, 0x11, 0xED, 0xAB, 0x70, 0x95, 0x43,
+    0x21, 0xB1, 0x99, 0xD9, 0xD3, 0xDF, 0x55, 0xC3,
+    0x86, 0xDC, 0x51, 0xCC, 0xEE, 0xCB, 0xD3, 0x1C,
+    0x06, 0x9F, 0x84, 0x90, 0x22, 0x27, 0x06, 0xE3,
+    0x23, 0x35, 0xA4, 0x54, 0xAE, 0xB4, 0x01, 0xB4,
+    0xA7, 0xBA, 0x05, 0x9F, 0xF8, 0xEF, 0xA4, 0x56,
+    0x95, 0xD3, 0x2C, 0x68, 0xA9, 0xF2, 0x6E, 0xFB,
+    0xC5, 0x02, 0x21, 0xA8, 0xFC, 0x25, 0xE6, 0xCB,
+    0x3A, 0x5C, 0x62, 0x62, 0xF1, 0xD9, 0xB8, 0x2B,
+    0x8B, 0xAF, 0x76, 0x0E, 0xE9, 0xC8, 0x40, 0xD7,
+    0xB5, 0x01, 0x5C, 0xC7, 0xC2, 0xE2, 0xD0, 0xCD,
+    0x61, 0xED, 0x02, 0x6B, 0xC8, 0xA2, 0xD5, 0xF7,
+    0x0F, 0xCF, 0xD5, 0xA2, 0x6F, 0x8A, 0x0D, 0x22,
+    0x73, 0x0C, 0x0B, 0x56, 0x3B, 0x17, 0xE4, 0xA6,
+    0x90, 0x70, 0xF6, 0x79, 0x75, 0xFC, 0x8C, 0x31,
+    0xC2, 0x18, 0xB9, 0x04, 0x72, 0x6A, 0x97, 0x30,
+    0xFF, 0x52, 0xEF, 0xD5, 0x95, 0x84, 0x88, 0x45,
+    0x1E, 0x4C, 0xB9, 0x92, 0x54, 0xDC, 0x46, 0x74,
+    0x8C, 0x09, 0x81, 0x05, 0x06, 0xEF, 0xD8, 0xF6,
+    0x8E, 0x3C, 0x0F, 0x1D, 0xFF, 0xC1, 0x27, 0x63,
+    0x7F, 0x01, 0x14, 0x1D, 0x18, 0x68, 0x06, 0xB4,
+    0x2B, 0x79, 0xB9, 0x16, 0x8D, 0x9E, 0x09, 0xD7,
+    0x7B, 0x06, 0x15, 0x08, 0xE7, 0xD1, 0x00, 0x56,
+    0xD7, 0xD0, 0x47, 0xCE, 0x70, 0x74, 0xD2, 0x9D
+};
+
+int pka_rsa_self_test( void )
+{
+    int ret;
+    mbedtls_rsa_context ctx;
+    unsigned char hash[sizeof( rsa_test_hash )];
+    unsigned char sig[sizeof( rsa_test_sig )];
+
+    /* The private operation draws no random numbers, any request fails */
+    pka_test_rng_t rng = { NULL, 0 };
+
+    mbedtls_rsa_init( &ctx );
+
+    /* D and the CRT parameters are computed by mbedtls_rsa_complete() */
+    MBEDTLS_MPI_CHK( mbedtls_rsa_import_raw( &ctx, rsa_test_N, sizeof( rsa_test_N ),
+                                             rsa_test_P, sizeof( rsa_test_P ),
+                                             rsa_test_Q, sizeof( rsa_test_Q ),
+                                             NULL, 0,
+                                             rsa_test_E, sizeof( rsa_test_E ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_rsa_complete( &ctx ) );
+
+    /* PKCS#1 v1.5 signatures are deterministic: CRT private operation */
+    MBEDTLS_MPI_CHK( mbedtls_rsa_pkcs1_sign( &ctx, pka_test_rng, &rng, MBEDTLS_MD_SHA256,
+                                             sizeof( rsa_test_hash ), rsa_test_hash, sig ) );
+
+    if( memcmp( sig, rsa_test_sig, sizeof( sig ) ) != 0 )
+    {
+        ret = MBEDTLS_ERR_RSA_VERIFY_FAILED;
+        goto cleanup;
+    }
+
+    /* Public operation */
+    MBEDTLS_MPI_CHK( mbedtls_rsa_pkcs1_verify( &ctx, MBEDTLS_MD_SHA256, sizeof( rsa_test_hash ),
+                                               rsa_test_hash, rsa_test_sig ) );
+
+    /* The same signature on another hash must be rejected */
+    memcpy( hash, rsa_test_hash, sizeof( hash ) );
+    hash[0] ^= 0x01U;
+
+    ret = mbedtls_rsa_pkcs1_verify( &ctx, MBEDTLS_MD_SHA256, sizeof( hash ), hash, rsa_test_sig );
+
+    if( ret == MBEDTLS_ERR_RSA_VERIFY_FAILED )
+        ret = 0;
+    else if( ret == 0 )
+        ret = MBEDTLS_ERR_RSA_VERIFY_FAILED;
+
+cleanup:
+    mbedtls_rsa_free( &ctx );
+
+    return( ret );
+}
+
 #endif /* MBEDTLS_RSA_ALT */
 
 #endif /* MBEDTLS_RSA_C */
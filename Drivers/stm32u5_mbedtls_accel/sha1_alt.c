@@ -33,6 +33,7 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "hash_stm32.h"
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,6 +59,27 @@ static void mbedtls_zeroize(void *v, size_t n)
     }
 }
 
+/*
+ * Take the HASH and load the intermediate digest of ctx, unless the HASH
+ * still holds it from the previous call on the same context
+ */
+static int sha1_acquire(mbedtls_sha1_context *ctx)
+{
+    int ret = hash_lock();
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    if (!hash_claim(&ctx->hhash, ctx->ctx_save_regs))
+    {
+        HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    }
+
+    return 0;
+}
+
 void mbedtls_sha1_init(mbedtls_sha1_context *ctx)
 {
     SHA1_VALIDATE( ctx != NULL );
@@ -66,6 +88,8 @@ void mbedtls_sha1_init(mbedtls_sha1_context *ctx)
 
     /* Enable HASH clock */
     __HAL_RCC_HASH_CLK_ENABLE();
+
+    hash_context_init();
 }
 
 void mbedtls_sha1_free(mbedtls_sha1_context *ctx)
@@ -74,6 +98,9 @@ void mbedtls_sha1_free(mbedtls_sha1_context *ctx)
     {
         return;
     }
+
+    hash_context_free(&ctx->hhash);
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_sha1_context));
 }
 
@@ -83,22 +110,48 @@ void mbedtls_sha1_clone(mbedtls_sha1_context *dst,
     SHA1_VALIDATE( dst != NULL );
     SHA1_VALIDATE( src != NULL );
 
-    *dst = *src;
+    /* The intermediate digest of src may only be held by the HASH, and the */
+    /* HASH no longer holds the state of dst once it is overwritten          */
+    if (hash_lock() == 0)
+    {
+        hash_sync(&src->hhash);
+        hash_release(&dst->hhash);
+        *dst = *src;
+        (void) hash_unlock(0);
+    }
+    else
+    {
+        *dst = *src;
+    }
 }
 
 int mbedtls_sha1_starts_ret(mbedtls_sha1_context *ctx)
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
 
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* Save the state of the previous owner before the HASH is reinitialized */
+    (void) hash_claim(&ctx->hhash, ctx->ctx_save_regs);
+
     /* HASH Configuration */
     if (HAL_HASH_DeInit(&ctx->hhash) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
-    ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
-    if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+    else
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
+        if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
     }
 
     /* first block on 17 words */
@@ -106,68 +159,74 @@ int mbedtls_sha1_starts_ret(mbedtls_sha1_context *ctx)
 
     ctx->sbuf_len = 0;
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_internal_sha1_process( mbedtls_sha1_context *ctx, const unsigned char data[ST_SHA1_BLOCK_SIZE] )
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( (const unsigned char *)data != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    ret = sha1_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
+    }
 
     if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA1_BLOCK_SIZE) != 0)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_sha1_update_ret(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
 {
+    int ret = 0;
     size_t currentlen = ilen;
 
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( ilen == 0 || input != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-
     if (currentlen < (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
     {
-        /* only store input data in context buffer */
+        /* only store input data in context buffer, the HASH is not needed */
         memcpy(ctx->sbuf + ctx->sbuf_len, input, currentlen);
         ctx->sbuf_len += currentlen;
+
+        return 0;
     }
-    else
+
+    ret = sha1_acquire(ctx);
+    if (ret != 0)
     {
-        /* fill context buffer until ST_SHA1_BLOCK_SIZE bytes, and process it */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
-        currentlen -= (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+        return ret;
+    }
 
-        if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA1_BLOCK_SIZE + ctx->first) != 0)
-        {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
+    /* fill context buffer until ST_SHA1_BLOCK_SIZE bytes, and process it */
+    memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
+    currentlen -= (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+
+    if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA1_BLOCK_SIZE + ctx->first) != 0)
+    {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
 
-        /* Process following input data with size multiple of ST_SHA1_BLOCK_SIZE bytes */
-        size_t iter = currentlen / ST_SHA1_BLOCK_SIZE;
-        if (iter != 0)
+    /* Process following input data with size multiple of ST_SHA1_BLOCK_SIZE bytes */
+    size_t iter = currentlen / ST_SHA1_BLOCK_SIZE;
+    if ((ret == 0) && (iter != 0))
+    {
+        if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA1_BLOCK_SIZE)) != 0)
         {
-            if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA1_BLOCK_SIZE)) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
+    }
 
+    if (ret == 0)
+    {
         /* following blocks on 16 words */
         ctx->first = 0;
 
@@ -179,29 +238,34 @@ int mbedtls_sha1_update_ret(mbedtls_sha1_context *ctx, const unsigned char *inpu
         }
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_sha1_finish_ret(mbedtls_sha1_context *ctx, unsigned char output[32])
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( (unsigned char *)output != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    ret = sha1_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
+    }
 
     /* Last accumulation for pending bytes in sbuf_len, then trig processing and get digest */
     if (HAL_HASH_SHA1_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA1_TIMEOUT) != 0)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
+    /* Nothing left worth saving once the digest has been read out */
+    hash_release(&ctx->hhash);
+
     ctx->sbuf_len = 0;
 
-    return 0;
+    return hash_unlock(ret);
 }
 
 #endif /* MBEDTLS_SHA1_ALT*/
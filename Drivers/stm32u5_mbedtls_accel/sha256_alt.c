@@ -33,18 +33,41 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+#include "mbedtls/md.h"
+#include "hash_stm32.h"
+
+#if ( ST_SHA256_DMA_THRESHOLD > 0 )
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#endif
 
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define ST_SHA256_TIMEOUT     ((uint32_t) 3)
 
+#if ( ST_SHA256_DMA_THRESHOLD > 0 )
+/* GPDMA channel feeding the HASH input FIFO                                  */
+#define SHA256_DMA_CHANNEL        GPDMA1_Channel11
+#define SHA256_DMA_IRQn           GPDMA1_Channel11_IRQn
+#define SHA256_DMA_IRQ_PRIORITY   5U
+#endif /* ST_SHA256_DMA_THRESHOLD > 0 */
+
 /* Private macro -------------------------------------------------------------*/
 #define SHA256_VALIDATE_RET(cond)                           \
     MBEDTLS_INTERNAL_VALIDATE_RET( cond, MBEDTLS_ERR_SHA256_BAD_INPUT_DATA )
 #define SHA256_VALIDATE(cond)  MBEDTLS_INTERNAL_VALIDATE( cond )
 
 /* Private variables ---------------------------------------------------------*/
+#if ( ST_SHA256_DMA_THRESHOLD > 0 )
+static DMA_HandleTypeDef sha256_dma_in;
+static SemaphoreHandle_t sha256_dma_done = NULL;
+static StaticSemaphore_t sha256_dma_done_buffer;
+static volatile int sha256_dma_error = 0;
+#endif /* ST_SHA256_DMA_THRESHOLD > 0 */
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
@@ -58,6 +81,219 @@ static void mbedtls_zeroize(void *v, size_t n)
     }
 }
 
+/*
+ * Take the HASH and load the intermediate digest of ctx, unless the HASH
+ * still holds it from the previous call on the same context
+ */
+static int sha256_acquire(mbedtls_sha256_context *ctx)
+{
+    int ret = hash_lock();
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    if (!hash_claim(&ctx->hhash, ctx->ctx_save_regs))
+    {
+        HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    }
+
+    return 0;
+}
+
+static int sha256_accumulate(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    if (ctx->is224 == 0)
+    {
+        if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)input, ilen) != 0)
+        {
+            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+    else
+    {
+        if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)input, ilen) != 0)
+        {
+            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+
+    return 0;
+}
+
+#if ( ST_SHA256_DMA_THRESHOLD > 0 )
+static void sha256_dma_irq_handler(void)
+{
+    HAL_DMA_IRQHandler(&sha256_dma_in);
+}
+
+/*
+ * Called by the HAL once the DMA has written the last input word
+ */
+void HAL_HASH_InCpltCallback(HASH_HandleTypeDef *hhash)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    (void) hhash;
+
+    (void) xSemaphoreGiveFromISR(sha256_dma_done, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void HAL_HASH_ErrorCallback(HASH_HandleTypeDef *hhash)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    (void) hhash;
+
+    sha256_dma_error = 1;
+    (void) xSemaphoreGiveFromISR(sha256_dma_done, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/*
+ * Set up the DMA channel on first use, must be called with the HASH lock held
+ */
+static int sha256_dma_init(void)
+{
+    if (sha256_dma_done != NULL)
+    {
+        return 0;
+    }
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    sha256_dma_in.Instance = SHA256_DMA_CHANNEL;
+    sha256_dma_in.Init.Request = GPDMA1_REQUEST_HASH_IN;
+    sha256_dma_in.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    sha256_dma_in.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    sha256_dma_in.Init.SrcInc = DMA_SINC_INCREMENTED;
+    sha256_dma_in.Init.DestInc = DMA_DINC_FIXED;
+    sha256_dma_in.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_WORD;
+    sha256_dma_in.Init.DestDataWidth = DMA_DEST_DATAWIDTH_WORD;
+    sha256_dma_in.Init.Priority = DMA_HIGH_PRIORITY;
+    sha256_dma_in.Init.SrcBurstLength = 1;
+    sha256_dma_in.Init.DestBurstLength = 1;
+    sha256_dma_in.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    sha256_dma_in.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    sha256_dma_in.Init.Mode = DMA_NORMAL;
+
+    if ((HAL_DMA_Init(&sha256_dma_in) != HAL_OK) ||
+        (HAL_DMA_ConfigChannelAttributes(&sha256_dma_in, DMA_CHANNEL_NPRIV) != HAL_OK))
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    /* Set the vector, requires sram located vector table */
+    NVIC_SetVector(SHA256_DMA_IRQn, (uint32_t) sha256_dma_irq_handler);
+    HAL_NVIC_SetPriority(SHA256_DMA_IRQn, SHA256_DMA_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(SHA256_DMA_IRQn);
+
+    sha256_dma_done = xSemaphoreCreateBinaryStatic(&sha256_dma_done_buffer);
+
+    return 0;
+}
+
+/*
+ * Return the number of bytes of a whole block span which should go to the
+ * HASH by DMA, or 0 to use HAL_HASHEx_SHA256_Accmlt. DMA needs word aligned
+ * input and a running scheduler to block on.
+ */
+static size_t sha256_dma_length(const unsigned char *input, size_t ilen)
+{
+    if ((ilen < ST_SHA256_DMA_THRESHOLD) ||
+        ((((uintptr_t) input) & 0x3U) != 0) ||
+        (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+    {
+        return 0;
+    }
+
+    return (ilen > ST_SHA256_DMA_CHUNK_LEN) ? ST_SHA256_DMA_CHUNK_LEN : ilen;
+}
+
+/*
+ * Accumulate ilen bytes (a multiple of the block size) by DMA and block until
+ * the transfer completes. MDMAT keeps the HASH from computing the final digest
+ * at the end of the transfer. Must be called with the HASH lock held.
+ */
+static int sha256_dma_accumulate(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    HAL_StatusTypeDef status;
+    int ret = sha256_dma_init();
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    __HAL_LINKDMA(&ctx->hhash, hdmain, sha256_dma_in);
+
+    sha256_dma_error = 0;
+    (void) xSemaphoreTake(sha256_dma_done, 0);
+
+    __HAL_HASH_SET_MDMAT();
+
+    if (ctx->is224 == 0)
+    {
+        status = HAL_HASHEx_SHA256_Start_DMA(&ctx->hhash, (uint8_t *)input, ilen);
+    }
+    else
+    {
+        status = HAL_HASHEx_SHA224_Start_DMA(&ctx->hhash, (uint8_t *)input, ilen);
+    }
+
+    if (status != HAL_OK)
+    {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+    else
+    {
+        hash_count_dma_transfer();
+
+        if (xSemaphoreTake(sha256_dma_done, pdMS_TO_TICKS(ST_HASH_TIMEOUT)) != pdTRUE)
+        {
+            (void) HAL_DMA_Abort(&sha256_dma_in);
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+        else if (sha256_dma_error != 0)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+
+    __HAL_HASH_RESET_MDMAT();
+
+    return ret;
+}
+#endif /* ST_SHA256_DMA_THRESHOLD > 0 */
+
+/*
+ * Accumulate a span of whole blocks, by DMA when it is large enough
+ */
+static int sha256_accumulate_blocks(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    int ret = 0;
+
+#if ( ST_SHA256_DMA_THRESHOLD > 0 )
+    size_t dma_len;
+
+    while ((ret == 0) && ((dma_len = sha256_dma_length(input, ilen)) > 0))
+    {
+        ret = sha256_dma_accumulate(ctx, input, dma_len);
+        input += dma_len;
+        ilen -= dma_len;
+    }
+#endif /* ST_SHA256_DMA_THRESHOLD > 0 */
+
+    if ((ret == 0) && (ilen > 0))
+    {
+        ret = sha256_accumulate(ctx, input, ilen);
+    }
+
+    return ret;
+}
+
 void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
 {
     SHA256_VALIDATE( ctx != NULL );
@@ -66,6 +302,8 @@ void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
 
     /* Enable HASH clock */
     __HAL_RCC_HASH_CLK_ENABLE();
+
+    hash_context_init();
 }
 
 void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
@@ -74,6 +312,9 @@ void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
     {
         return;
     }
+
+    hash_context_free(&ctx->hhash);
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_sha256_context));
 }
 
@@ -83,23 +324,49 @@ void mbedtls_sha256_clone(mbedtls_sha256_context *dst,
     SHA256_VALIDATE( dst != NULL );
     SHA256_VALIDATE( src != NULL );
 
-    *dst = *src;
+    /* The intermediate digest of src may only be held by the HASH, and the */
+    /* HASH no longer holds the state of dst once it is overwritten          */
+    if (hash_lock() == 0)
+    {
+        hash_sync(&src->hhash);
+        hash_release(&dst->hhash);
+        *dst = *src;
+        (void) hash_unlock(0);
+    }
+    else
+    {
+        *dst = *src;
+    }
 }
 
-int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( is224 == 0 || is224 == 1 );
 
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* Save the state of the previous owner before the HASH is reinitialized */
+    (void) hash_claim(&ctx->hhash, ctx->ctx_save_regs);
+
     /* HASH Configuration */
     if (HAL_HASH_DeInit(&ctx->hhash) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
-    ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
-    if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+    else
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
+        if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
     }
 
     ctx->is224 = is224;
@@ -109,101 +376,67 @@ int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
 
     ctx->sbuf_len = 0;
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-
-    return 0;
+    return hash_unlock(ret);
 }
 
 int mbedtls_internal_sha256_process( mbedtls_sha256_context *ctx, const unsigned char data[ST_SHA256_BLOCK_SIZE] )
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( (const unsigned char *)data != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-
-    if (ctx->is224 == 0) {
-        if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA256_BLOCK_SIZE) != 0) {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
-    } else {
-        if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA256_BLOCK_SIZE) != 0) {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
+    ret = sha256_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
     }
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
+    ret = sha256_accumulate(ctx, data, ST_SHA256_BLOCK_SIZE);
 
-    return 0;
+    return hash_unlock(ret);
 }
 
-int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
 {
+    int ret = 0;
     size_t currentlen = ilen;
 
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( ilen == 0 || input != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-
     if (currentlen < (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
     {
-        /* only store input data in context buffer */
+        /* only store input data in context buffer, the HASH is not needed */
         memcpy(ctx->sbuf + ctx->sbuf_len, input, currentlen);
         ctx->sbuf_len += currentlen;
+
+        return 0;
     }
-    else
+
+    ret = sha256_acquire(ctx);
+    if (ret != 0)
     {
-        /* fill context buffer until ST_SHA256_BLOCK_SIZE bytes, and process it */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
-        currentlen -= (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+        return ret;
+    }
 
-        if (ctx->is224 == 0)
-        {
-            if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA256_BLOCK_SIZE + ctx->first) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
-        }
-        else
-        {
-            if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA256_BLOCK_SIZE + ctx->first) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
-        }
+    /* fill context buffer until ST_SHA256_BLOCK_SIZE bytes, and process it */
+    memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
+    currentlen -= (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
 
-        /* Process following input data with size multiple of ST_SHA256_BLOCK_SIZE bytes */
-        size_t iter = currentlen / ST_SHA256_BLOCK_SIZE;
-        if (iter != 0)
-        {
-            if (ctx->is224 == 0)
-            {
-                if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA256_BLOCK_SIZE)) != 0)
-                {
-                    return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-                }
-            }
-            else
-            {
-                if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA256_BLOCK_SIZE)) != 0)
-                {
-                    return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-                }
-            }
-        }
+    ret = sha256_accumulate(ctx, ctx->sbuf, ST_SHA256_BLOCK_SIZE + ctx->first);
+
+    /* Process following input data with size multiple of ST_SHA256_BLOCK_SIZE bytes */
+    /* in one span                                                                 */
+    size_t iter = currentlen / ST_SHA256_BLOCK_SIZE;
+    if ((ret == 0) && (iter != 0))
+    {
+        ret = sha256_accumulate_blocks(ctx, input + ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len,
+                                       iter * ST_SHA256_BLOCK_SIZE);
+    }
 
+    if (ret == 0)
+    {
         /* following blocks on 16 words */
         ctx->first = 0;
 
@@ -215,42 +448,198 @@ int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *
         }
     }
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-    return 0;
+    return hash_unlock(ret);
 }
 
-int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( (unsigned char *)output != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
+    ret = sha256_acquire(ctx);
+    if (ret != 0)
+    {
+        return ret;
+    }
 
     /* Last accumulation for pending bytes in sbuf_len, then trig processing and get digest */
     if (ctx->is224 == 0)
     {
         if (HAL_HASHEx_SHA256_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != 0)
         {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
     }
     else
     {
         if (HAL_HASHEx_SHA224_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != 0)
         {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
     }
 
+    /* Nothing left worth saving once the digest has been read out */
+    hash_release(&ctx->hhash);
+
     ctx->sbuf_len = 0;
 
-    return 0;
+    return hash_unlock(ret);
+}
+
+/*
+ * Known answer test: FIPS 180-2 appendix B.1, B.2 and B.3 for SHA-256, and
+ * the one block example of its change notice for SHA-224
+ */
+#define SHA256_TEST_CHUNK_LEN    4000U
+#define SHA256_TEST_CHUNKS       250U
+
+static const char sha256_test_abc[] = "abc";
+static const char sha256_test_two[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+static const unsigned char sha256_test_sum_abc[32] =
+{
+    0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA,
+    0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+    0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C,
+    0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD
+};
+
+static const unsigned char sha224_test_sum_abc[28] =
+{
+    0x23, 0x09, 0x7D, 0x22, 0x34, 0x05, 0xD8, 0x22,
+    0x86, 0x42, 0xA4, 0x77, 0xBD, 0xA2, 0x55, 0xB3,
+    0x2A, 0xAD, 0xBC, 0xE4, 0xBD, 0xA0, 0xB3, 0xF7,
+    0xE3, 0x6C, 0x9D, 0xA7
+};
+
+static const unsigned char sha256_test_sum_two[32] =
+{
+    0x24, 0x8D, 0x6A, 0x61, 0xD2, 0x06, 0x38, 0xB8,
+    0xE5, 0xC0, 0x26, 0x93, 0x0C, 0x3E, 0x60, 0x39,
+    0xA3, 0x3C, 0xE4, 0x59, 0x64, 0xFF, 0x21, 0x67,
+    0xF6, 0xEC, 0xED, 0xD4, 0x19, 0xDB, 0x06, 0xC1
+};
+
+static const unsigned char sha256_test_sum_million[32] =
+{
+    0xCD, 0xC7, 0x6E, 0x5C, 0x99, 0x14, 0xFB, 0x92,
+    0x81, 0xA1, 0xC7, 0xE2, 0x84, 0xD7, 0x3E, 0x67,
+    0xF1, 0x80, 0x9A, 0x48, 0xA4, 0x97, 0x20, 0x0E,
+    0x04, 0x6D, 0x39, 0xCC, 0xC7, 0x11, 0x2C, 0xD0
+};
+
+/*
+ * Finish ctx and compare the digest with expected, 28 bytes for SHA-224
+ */
+static int sha256_test_finish(mbedtls_sha256_context *ctx, const unsigned char *expected)
+{
+    unsigned char digest[32];
+    size_t len = (ctx->is224 == 0) ? 32U : 28U;
+    int ret = mbedtls_sha256_finish(ctx, digest);
+
+    if ((ret == 0) && (memcmp(digest, expected, len) != 0))
+    {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    return ret;
+}
+
+static int sha256_test_digest(mbedtls_sha256_context *ctx, int is224,
+                              const char *input, const unsigned char *expected)
+{
+    int ret = mbedtls_sha256_starts(ctx, is224);
+
+    if (ret == 0)
+    {
+        ret = mbedtls_sha256_update(ctx, (const unsigned char *)input, strlen(input));
+    }
+
+    if (ret == 0)
+    {
+        ret = sha256_test_finish(ctx, expected);
+    }
+
+    return ret;
+}
+
+int hash_sha256_self_test(void)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_context other;
+    mbedtls_sha256_context copy;
+    unsigned char *buf = NULL;
+    unsigned int i;
+    int ret;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_init(&other);
+    mbedtls_sha256_init(&copy);
+
+    ret = sha256_test_digest(&ctx, 0, sha256_test_abc, sha256_test_sum_abc);
+    if (ret == 0)
+    {
+        ret = sha256_test_digest(&ctx, 1, sha256_test_abc, sha224_test_sum_abc);
+    }
+    if (ret == 0)
+    {
+        ret = sha256_test_digest(&ctx, 0, sha256_test_two, sha256_test_sum_two);
+    }
+    if (ret != 0)
+    {
+        goto exit;
+    }
+
+    /* B.3 in updates whose block spans are over ST_SHA256_DMA_THRESHOLD.   */
+    /* Halfway, a SHA-224 of another context takes the HASH, so the         */
+    /* intermediate digest of ctx is saved and restored, and a clone of ctx */
+    /* is taken which must reach the same digest.                           */
+    buf = mbedtls_calloc(1, SHA256_TEST_CHUNK_LEN);
+    if (buf == NULL)
+    {
+        ret = MBEDTLS_ERR_MD_ALLOC_FAILED;
+        goto exit;
+    }
+
+    memset(buf, 'a', SHA256_TEST_CHUNK_LEN);
+
+    ret = mbedtls_sha256_starts(&ctx, 0);
+    for (i = 0; (ret == 0) && (i < SHA256_TEST_CHUNKS); i++)
+    {
+        if (i == SHA256_TEST_CHUNKS / 2U)
+        {
+            ret = sha256_test_digest(&other, 1, sha256_test_abc, sha224_test_sum_abc);
+            mbedtls_sha256_clone(&copy, &ctx);
+        }
+
+        if (ret == 0)
+        {
+            ret = mbedtls_sha256_update(&ctx, buf, SHA256_TEST_CHUNK_LEN);
+        }
+    }
+    if (ret == 0)
+    {
+        ret = sha256_test_finish(&ctx, sha256_test_sum_million);
+    }
+
+    for (i = SHA256_TEST_CHUNKS / 2U; (ret == 0) && (i < SHA256_TEST_CHUNKS); i++)
+    {
+        ret = mbedtls_sha256_update(&copy, buf, SHA256_TEST_CHUNK_LEN);
+    }
+    if (ret == 0)
+    {
+        ret = sha256_test_finish(&copy, sha256_test_sum_million);
+    }
+
+exit:
+    mbedtls_free(buf);
+    mbedtls_sha256_free(&copy);
+    mbedtls_sha256_free(&other);
+    mbedtls_sha256_free(&ctx);
+
+    return ret;
 }
 
 #endif /* MBEDTLS_SHA256_ALT*/
@@ -38,12 +38,23 @@
 #define ST_SHA256_NB_HASH_REG ((uint32_t)57)        /*!< Number of HASH HW context Registers:
                                                          CR + STR + IMR + CSR[54] */
 
+/* Spans of whole blocks of at least this many bytes are fed to the HASH by   */
+/* GPDMA while the calling task blocks. Set to 0 to always use the CPU.       */
+#ifndef ST_SHA256_DMA_THRESHOLD
+#define ST_SHA256_DMA_THRESHOLD   1024U
+#endif
+
+/* Maximum length of one DMA transfer, multiple of ST_SHA256_BLOCK_SIZE       */
+#ifndef ST_SHA256_DMA_CHUNK_LEN
+#define ST_SHA256_DMA_CHUNK_LEN   32768U
+#endif
+
 /**
  * \brief          SHA-256 context structure
  *
  *                 The structure is used both for SHA-256 and for SHA-224
  *                 checksum calculations. The choice between these two is
- *                 made in the call to mbedtls_sha256_starts_ret().
+ *                 made in the call to mbedtls_sha256_starts().
  */
 typedef struct mbedtls_sha256_context
 {
@@ -0,0 +1,373 @@
+/*
+ *  FIPS-180-2 compliant SHA-384/512 implementation
+ *
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a SHA-384 / SHA-512 software path tuned for the
+ *  Cortex-M33 based on mbed TLS API. The HASH peripheral of the STM32U5 only
+ *  supports MD5, SHA-1, SHA-224 and SHA-256, so these digests (P-384 ECDSA
+ *  and the SHA-384 TLS cipher suites) always run on the CPU.
+ *
+ *  Compared to the generic mbed TLS implementation built with
+ *  MBEDTLS_SHA512_SMALLER:
+ *  - eight rounds are written out with the working variables renamed
+ *    instead of shifted, so no register moves are spent between rounds;
+ *  - the message schedule is kept in a 16 word ring updated in place,
+ *    which saves 512 bytes of stack compared to the 80 word array;
+ *  - big endian words are loaded with one unaligned LDR and a REV each.
+ */
+/*
+ *  The SHA-512 Secure Hash Standard was published by NIST in 2002.
+ *
+ *  http://csrc.nist.gov/publications/fips/fips180-2/fips180-2.pdf
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mbedtls/sha512.h"
+
+#if defined(MBEDTLS_SHA512_C)
+#if defined(MBEDTLS_SHA512_ALT)
+#include <string.h>
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SHA512_SCHED_WORDS    ( 16U )
+#define SHA512_ROUNDS         ( 80U )
+
+/* Private macro -------------------------------------------------------------*/
+#define ROTR64( x, n )    ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 64 - ( n ) ) ) )
+
+#define S0( x )           ( ROTR64( x, 28 ) ^ ROTR64( x, 34 ) ^ ROTR64( x, 39 ) )
+#define S1( x )           ( ROTR64( x, 14 ) ^ ROTR64( x, 18 ) ^ ROTR64( x, 41 ) )
+#define s0( x )           ( ROTR64( x,  1 ) ^ ROTR64( x,  8 ) ^ ( ( x ) >> 7 ) )
+#define s1( x )           ( ROTR64( x, 19 ) ^ ROTR64( x, 61 ) ^ ( ( x ) >> 6 ) )
+
+#define CH( x, y, z )     ( ( z ) ^ ( ( x ) & ( ( y ) ^ ( z ) ) ) )
+#define MAJ( x, y, z )    ( ( ( x ) & ( y ) ) | ( ( z ) & ( ( x ) | ( y ) ) ) )
+
+/* Next word of the message schedule, updated in place in the 16 word ring */
+#define SCHED( i )                                                       \
+    ( W[( i ) & 15U] += s1( W[( ( i ) + 14U ) & 15U] ) +                 \
+                        W[( ( i ) +  9U ) & 15U] +                       \
+                        s0( W[( ( i ) +  1U ) & 15U] ) )
+
+#define ROUND( a, b, c, d, e, f, g, h, k, w )                            \
+    do                                                                   \
+    {                                                                    \
+        uint64_t t1 = ( h ) + S1( e ) + CH( e, f, g ) + ( k ) + ( w );   \
+        ( d ) += t1;                                                     \
+        ( h ) = t1 + S0( a ) + MAJ( a, b, c );                           \
+    } while( 0 )
+
+/* Eight rounds starting at round i, wv( i ) gives the message word */
+#define EIGHT_ROUNDS( i, wv )                                            \
+    do                                                                   \
+    {                                                                    \
+        ROUND( A, B, C, D, E, F, G, H, K[( i ) + 0U], wv( ( i ) + 0U ) );\
+        ROUND( H, A, B, C, D, E, F, G, K[( i ) + 1U], wv( ( i ) + 1U ) );\
+        ROUND( G, H, A, B, C, D, E, F, K[( i ) + 2U], wv( ( i ) + 2U ) );\
+        ROUND( F, G, H, A, B, C, D, E, K[( i ) + 3U], wv( ( i ) + 3U ) );\
+        ROUND( E, F, G, H, A, B, C, D, K[( i ) + 4U], wv( ( i ) + 4U ) );\
+        ROUND( D, E, F, G, H, A, B, C, K[( i ) + 5U], wv( ( i ) + 5U ) );\
+        ROUND( C, D, E, F, G, H, A, B, K[( i ) + 6U], wv( ( i ) + 6U ) );\
+        ROUND( B, C, D, E, F, G, H, A, K[( i ) + 7U], wv( ( i ) + 7U ) );\
+    } while( 0 )
+
+#define LOADED( i )       ( W[( i )] )
+
+/* Private variables ---------------------------------------------------------*/
+/*
+ * Round constants
+ */
+static const uint64_t K[SHA512_ROUNDS] =
+{
+    0x428A2F98D728AE22ULL, 0x7137449123EF65CDULL, 0xB5C0FBCFEC4D3B2FULL, 0xE9B5DBA58189DBBCULL,
+    0x3956C25BF348B538ULL, 0x59F111F1B605D019ULL, 0x923F82A4AF194F9BULL, 0xAB1C5ED5DA6D8118ULL,
+    0xD807AA98A3030242ULL, 0x12835B0145706FBEULL, 0x243185BE4EE4B28CULL, 0x550C7DC3D5FFB4E2ULL,
+    0x72BE5D74F27B896FULL, 0x80DEB1FE3B1696B1ULL, 0x9BDC06A725C71235ULL, 0xC19BF174CF692694ULL,
+    0xE49B69C19EF14AD2ULL, 0xEFBE4786384F25E3ULL, 0x0FC19DC68B8CD5B5ULL, 0x240CA1CC77AC9C65ULL,
+    0x2DE92C6F592B0275ULL, 0x4A7484AA6EA6E483ULL, 0x5CB0A9DCBD41FBD4ULL, 0x76F988DA831153B5ULL,
+    0x983E5152EE66DFABULL, 0xA831C66D2DB43210ULL, 0xB00327C898FB213FULL, 0xBF597FC7BEEF0EE4ULL,
+    0xC6E00BF33DA88FC2ULL, 0xD5A79147930AA725ULL, 0x06CA6351E003826FULL, 0x142929670A0E6E70ULL,
+    0x27B70A8546D22FFCULL, 0x2E1B21385C26C926ULL, 0x4D2C6DFC5AC42AEDULL, 0x53380D139D95B3DFULL,
+    0x650A73548BAF63DEULL, 0x766A0ABB3C77B2A8ULL, 0x81C2C92E47EDAEE6ULL, 0x92722C851482353BULL,
+    0xA2BFE8A14CF10364ULL, 0xA81A664BBC423001ULL, 0xC24B8B70D0F89791ULL, 0xC76C51A30654BE30ULL,
+    0xD192E819D6EF5218ULL, 0xD69906245565A910ULL, 0xF40E35855771202AULL, 0x106AA07032BBD1B8ULL,
+    0x19A4C116B8D2D0C8ULL, 0x1E376C085141AB53ULL, 0x2748774CDF8EEB99ULL, 0x34B0BCB5E19B48A8ULL,
+    0x391C0CB3C5C95A63ULL, 0x4ED8AA4AE3418ACBULL, 0x5B9CCA4F7763E373ULL, 0x682E6FF3D6B2B8A3ULL,
+    0x748F82EE5DEFB2FCULL, 0x78A5636F43172F60ULL, 0x84C87814A1F0AB72ULL, 0x8CC702081A6439ECULL,
+    0x90BEFFFA23631E28ULL, 0xA4506CEBDE82BDE9ULL, 0xBEF9A3F7B2C67915ULL, 0xC67178F2E372532BULL,
+    0xCA273ECEEA26619CULL, 0xD186B8C721C0C207ULL, 0xEADA7DD6CDE0EB1EULL, 0xF57D4F7FEE6ED178ULL,
+    0x06F067AA72176FBAULL, 0x0A637DC5A2C898A6ULL, 0x113F9804BEF90DAEULL, 0x1B710B35131C471BULL,
+    0x28DB77F523047D84ULL, 0x32CAAB7B40C72493ULL, 0x3C9EBE0A15C9BEBCULL, 0x431D67C49C100D4CULL,
+    0x4CC5D4BECB3E42B6ULL, 0x597F299CFC657E2AULL, 0x5FCB6FAB3AD6FAECULL, 0x6C44198C4A475817ULL
+};
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static inline uint64_t sha512_get_be64( const unsigned char *p )
+{
+#if defined(__BYTE_ORDER__) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+    uint32_t hi;
+    uint32_t lo;
+
+    /* Two (unaligned) LDR and REV on the Cortex-M33 */
+    memcpy( &hi, p, sizeof( hi ) );
+    memcpy( &lo, p + 4, sizeof( lo ) );
+    return( ( (uint64_t) __builtin_bswap32( hi ) << 32 ) | __builtin_bswap32( lo ) );
+#else
+    return( ( (uint64_t) p[0] << 56 ) |
+            ( (uint64_t) p[1] << 48 ) |
+            ( (uint64_t) p[2] << 40 ) |
+            ( (uint64_t) p[3] << 32 ) |
+            ( (uint64_t) p[4] << 24 ) |
+            ( (uint64_t) p[5] << 16 ) |
+            ( (uint64_t) p[6] <<  8 ) |
+            ( (uint64_t) p[7]       ) );
+#endif
+}
+
+static inline void sha512_put_be64( unsigned char *p, uint64_t w )
+{
+    size_t i;
+
+    for( i = 0U; i < 8U; i++ )
+    {
+        p[i] = (unsigned char) ( w >> ( 56U - 8U * i ) );
+    }
+}
+
+void mbedtls_sha512_init( mbedtls_sha512_context *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_sha512_context ) );
+}
+
+void mbedtls_sha512_free( mbedtls_sha512_context *ctx )
+{
+    if( ctx != NULL )
+    {
+        mbedtls_platform_zeroize( ctx, sizeof( mbedtls_sha512_context ) );
+    }
+}
+
+void mbedtls_sha512_clone( mbedtls_sha512_context *dst,
+                           const mbedtls_sha512_context *src )
+{
+    *dst = *src;
+}
+
+int mbedtls_sha512_starts( mbedtls_sha512_context *ctx, int is384 )
+{
+#if defined(MBEDTLS_SHA384_C)
+    if( ( is384 != 0 ) && ( is384 != 1 ) )
+        return( MBEDTLS_ERR_SHA512_BAD_INPUT_DATA );
+#else
+    if( is384 != 0 )
+        return( MBEDTLS_ERR_SHA512_BAD_INPUT_DATA );
+#endif
+
+    ctx->total[0] = 0;
+    ctx->total[1] = 0;
+
+    if( is384 == 0 )
+    {
+        /* SHA-512 */
+        ctx->state[0] = 0x6A09E667F3BCC908ULL;
+        ctx->state[1] = 0xBB67AE8584CAA73BULL;
+        ctx->state[2] = 0x3C6EF372FE94F82BULL;
+        ctx->state[3] = 0xA54FF53A5F1D36F1ULL;
+        ctx->state[4] = 0x510E527FADE682D1ULL;
+        ctx->state[5] = 0x9B05688C2B3E6C1FULL;
+        ctx->state[6] = 0x1F83D9ABFB41BD6BULL;
+        ctx->state[7] = 0x5BE0CD19137E2179ULL;
+    }
+    else
+    {
+        /* SHA-384 */
+        ctx->state[0] = 0xCBBB9D5DC1059ED8ULL;
+        ctx->state[1] = 0x629A292A367CD507ULL;
+        ctx->state[2] = 0x9159015A3070DD17ULL;
+        ctx->state[3] = 0x152FECD8F70E5939ULL;
+        ctx->state[4] = 0x67332667FFC00B31ULL;
+        ctx->state[5] = 0x8EB44A8768581511ULL;
+        ctx->state[6] = 0xDB0C2E0D64F98FA7ULL;
+        ctx->state[7] = 0x47B5481DBEFA4FA4ULL;
+    }
+
+    ctx->is384 = is384;
+
+    return( 0 );
+}
+
+int mbedtls_internal_sha512_process( mbedtls_sha512_context *ctx,
+                                     const unsigned char data[128] )
+{
+    uint64_t W[SHA512_SCHED_WORDS];
+    uint64_t A = ctx->state[0];
+    uint64_t B = ctx->state[1];
+    uint64_t C = ctx->state[2];
+    uint64_t D = ctx->state[3];
+    uint64_t E = ctx->state[4];
+    uint64_t F = ctx->state[5];
+    uint64_t G = ctx->state[6];
+    uint64_t H = ctx->state[7];
+    size_t i;
+
+    for( i = 0U; i < SHA512_SCHED_WORDS; i++ )
+    {
+        W[i] = sha512_get_be64( data + 8U * i );
+    }
+
+    /* Rounds 0 to 15 use the message words as loaded */
+    for( i = 0U; i < SHA512_SCHED_WORDS; i += 8U )
+    {
+        EIGHT_ROUNDS( i, LOADED );
+    }
+
+    /* Rounds 16 to 79 extend the schedule in the ring */
+    for( ; i < SHA512_ROUNDS; i += 8U )
+    {
+        EIGHT_ROUNDS( i, SCHED );
+    }
+
+    ctx->state[0] += A;
+    ctx->state[1] += B;
+    ctx->state[2] += C;
+    ctx->state[3] += D;
+    ctx->state[4] += E;
+    ctx->state[5] += F;
+    ctx->state[6] += G;
+    ctx->state[7] += H;
+
+    mbedtls_platform_zeroize( W, sizeof( W ) );
+
+    return( 0 );
+}
+
+int mbedtls_sha512_update( mbedtls_sha512_context *ctx,
+                           const unsigned char *input,
+                           size_t ilen )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t fill;
+    size_t left;
+
+    if( ilen == 0U )
+        return( 0 );
+
+    left = (size_t) ( ctx->total[0] & 0x7FU );
+    fill = ST_SHA512_BLOCK_SIZE - left;
+
+    ctx->total[0] += (uint64_t) ilen;
+
+    if( ctx->total[0] < (uint64_t) ilen )
+        ctx->total[1]++;
+
+    if( ( left != 0U ) && ( ilen >= fill ) )
+    {
+        memcpy( ctx->buffer + left, input, fill );
+
+        if( ( ret = mbedtls_internal_sha512_process( ctx, ctx->buffer ) ) != 0 )
+            return( ret );
+
+        input += fill;
+        ilen  -= fill;
+        left = 0U;
+    }
+
+    /* Whole blocks are hashed straight from the input */
+    while( ilen >= ST_SHA512_BLOCK_SIZE )
+    {
+        if( ( ret = mbedtls_internal_sha512_process( ctx, input ) ) != 0 )
+            return( ret );
+
+        input += ST_SHA512_BLOCK_SIZE;
+        ilen  -= ST_SHA512_BLOCK_SIZE;
+    }
+
+    if( ilen > 0U )
+        memcpy( ctx->buffer + left, input, ilen );
+
+    return( 0 );
+}
+
+int mbedtls_sha512_finish( mbedtls_sha512_context *ctx,
+                           unsigned char *output )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned used;
+    uint64_t high;
+    uint64_t low;
+
+    /*
+     * Add padding: 0x80 then 0x00 until 16 bytes remain for the length
+     */
+    used = ctx->total[0] & 0x7FU;
+
+    ctx->buffer[used++] = 0x80;
+
+    if( used <= 112U )
+    {
+        /* Enough room for padding + length in current block */
+        memset( ctx->buffer + used, 0, 112U - used );
+    }
+    else
+    {
+        /* We'll need an extra block */
+        memset( ctx->buffer + used, 0, ST_SHA512_BLOCK_SIZE - used );
+
+        if( ( ret = mbedtls_internal_sha512_process( ctx, ctx->buffer ) ) != 0 )
+            return( ret );
+
+        memset( ctx->buffer, 0, 112U );
+    }
+
+    /*
+     * Add message length
+     */
+    high = ( ctx->total[0] >> 61 ) | ( ctx->total[1] << 3 );
+    low  = ( ctx->total[0] << 3 );
+
+    sha512_put_be64( ctx->buffer + 112, high );
+    sha512_put_be64( ctx->buffer + 120, low );
+
+    if( ( ret = mbedtls_internal_sha512_process( ctx, ctx->buffer ) ) != 0 )
+        return( ret );
+
+    /*
+     * Output final state
+     */
+    sha512_put_be64( output,      ctx->state[0] );
+    sha512_put_be64( output +  8, ctx->state[1] );
+    sha512_put_be64( output + 16, ctx->state[2] );
+    sha512_put_be64( output + 24, ctx->state[3] );
+    sha512_put_be64( output + 32, ctx->state[4] );
+    sha512_put_be64( output + 40, ctx->state[5] );
+
+    if( ctx->is384 == 0 )
+    {
+        sha512_put_be64( output + 48, ctx->state[6] );
+        sha512_put_be64( output + 56, ctx->state[7] );
+    }
+
+    return( 0 );
+}
+
+#endif /* MBEDTLS_SHA512_ALT */
+#endif /* MBEDTLS_SHA512_C */
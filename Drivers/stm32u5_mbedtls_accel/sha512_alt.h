@@ -0,0 +1,55 @@
+/**
+ * \file sha512.h
+ *
+ * \brief This file contains SHA-384 and SHA-512 definitions and functions.
+ *
+ * The Secure Hash Algorithms 384 and 512 (SHA-384 and SHA-512) cryptographic
+ * hash functions are defined in <em>FIPS 180-4: Secure Hash Standard (SHS)</em>.
+ */
+/*
+ *  Copyright (C) 2006-2018, Arm Limited (or its affiliates), All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements a SHA-384 / SHA-512 software path tuned for the
+ *  Cortex-M33 based on mbed TLS API
+ */
+
+#ifndef MBEDTLS_SHA512_ALT_H
+#define MBEDTLS_SHA512_ALT_H
+
+#if defined (MBEDTLS_SHA512_ALT)
+#include <stdint.h>
+#include <stddef.h>
+
+#define ST_SHA512_BLOCK_SIZE  ((size_t) 128)        /*!< Size of one message block */
+
+/**
+ * \brief          SHA-512 context structure
+ *
+ *                 The structure is used both for SHA-384 and for SHA-512
+ *                 checksum calculations. The choice between these two is
+ *                 made in the call to mbedtls_sha512_starts().
+ */
+typedef struct mbedtls_sha512_context
+{
+    uint64_t total[2];                              /*!< The number of Bytes processed. */
+    uint64_t state[8];                              /*!< The intermediate digest state. */
+    unsigned char buffer[ST_SHA512_BLOCK_SIZE];     /*!< The data block being processed. */
+    int is384;                                      /*!< 0 = use SHA512, 1 = use SHA384 */
+}
+mbedtls_sha512_context;
+
+#endif /* MBEDTLS_SHA512_ALT */
+#endif /* MBEDTLS_SHA512_ALT_H */
@@ -32,9 +32,16 @@
 /* Define KV_STORE_NVIMPL_ENABLE to 1 to enable storage of all key / value pairs in non-volatile storage */
 #define KV_STORE_NVIMPL_ENABLE      1
 
-#define KV_STORE_NVIMPL_LITTLEFS    1
+/* Define KV_STORE_NVIMPL_LITTLEFS to 1 to store each key in its own littlefs file */
+#define KV_STORE_NVIMPL_LITTLEFS        0
 
-#define KV_STORE_NVIMPL_ARM_PSA     0
+/* Define KV_STORE_NVIMPL_LITTLEFS_LOG to 1 to store all keys in a single append-only littlefs log */
+#define KV_STORE_NVIMPL_LITTLEFS_LOG    1
+
+#define KV_STORE_NVIMPL_ARM_PSA         0
+
+/* Number of keys which the application may add at runtime with KVStore_registerKey */
+#define KVSTORE_DYNAMIC_KEYS_MAX    32
 
 #define KVSTORE_KEY_MAX_LEN         16
 #define KVSTORE_VAL_MAX_LEN         256
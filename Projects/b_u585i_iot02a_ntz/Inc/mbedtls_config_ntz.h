@@ -184,6 +184,9 @@ void * mbedtls_platform_calloc( size_t nmemb,
                                 size_t size );
 void mbedtls_platform_free( void * ptr );
 
+/* Serve small allocations from the size class arena in mbedtls_freertos_port.c */
+#define MBEDTLS_FREERTOS_SLAB_ARENA
+
 /**
  * \def MBEDTLS_PLATFORM_NO_STD_FUNCTIONS
  *
@@ -310,25 +313,25 @@ void mbedtls_platform_free( void * ptr );
  *            digests and ciphers instead.
  *
  */
-/*#define MBEDTLS_AES_ALT */
+#define MBEDTLS_AES_ALT
 /*#define MBEDTLS_ARIA_ALT */
 /*#define MBEDTLS_CAMELLIA_ALT */
 /*#define MBEDTLS_CCM_ALT */
-/*#define MBEDTLS_CHACHA20_ALT */
+#define MBEDTLS_CHACHA20_ALT
 /*#define MBEDTLS_CHACHAPOLY_ALT */
 /*#define MBEDTLS_CMAC_ALT */
 /*#define MBEDTLS_DES_ALT */
 /*#define MBEDTLS_DHM_ALT */
 /*#define MBEDTLS_ECJPAKE_ALT */
-/*#define MBEDTLS_GCM_ALT */
+#define MBEDTLS_GCM_ALT
 /*#define MBEDTLS_NIST_KW_ALT */
 /*#define MBEDTLS_MD5_ALT */
-/*#define MBEDTLS_POLY1305_ALT */
+#define MBEDTLS_POLY1305_ALT
 /*#define MBEDTLS_RIPEMD160_ALT */
-/*#define MBEDTLS_RSA_ALT */
+#define MBEDTLS_RSA_ALT
 /*#define MBEDTLS_SHA1_ALT */
-/*#define MBEDTLS_SHA256_ALT */
-/*#define MBEDTLS_SHA512_ALT */
+#define MBEDTLS_SHA256_ALT
+#define MBEDTLS_SHA512_ALT
 
 /*
  * When replacing the elliptic curve module, pleace consider, that it is
@@ -390,10 +393,11 @@ void mbedtls_platform_free( void * ptr );
 /*#define MBEDTLS_AES_SETKEY_DEC_ALT */
 /*#define MBEDTLS_AES_ENCRYPT_ALT */
 /*#define MBEDTLS_AES_DECRYPT_ALT */
-/*#define MBEDTLS_ECDH_GEN_PUBLIC_ALT */
-/*#define MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
-/*#define MBEDTLS_ECDSA_VERIFY_ALT */
-/*#define MBEDTLS_ECDSA_SIGN_ALT */
+/* P-256 on the PKA (Drivers/stm32u5_mbedtls_accel), checked at boot by pka_ecc_self_test() */
+#define MBEDTLS_ECDH_GEN_PUBLIC_ALT
+#define MBEDTLS_ECDH_COMPUTE_SHARED_ALT
+#define MBEDTLS_ECDSA_VERIFY_ALT
+#define MBEDTLS_ECDSA_SIGN_ALT
 /*#define MBEDTLS_ECDSA_GENKEY_ALT */
 
 /**
@@ -3180,8 +3184,11 @@ void mbedtls_platform_free( void * ptr );
  * certificate data which is sent during the handshake.
  *
  * Uncomment to set the maximum plaintext size of the outgoing I/O buffer.
+ *
+ * Outgoing records are limited to the 4096 byte fragment length requested by
+ * the transport, so a larger output buffer is never filled.
  */
-/*#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384 */
+#define MBEDTLS_SSL_OUT_CONTENT_LEN             4096
 
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
@@ -45,5 +45,17 @@
  */
 /*#define MBEDTLS_TRANSPORT_PSA */
 
+/*
+ * Define MBEDTLS_TRANSPORT_SESSION_RESUMPTION to cache the TLS session in RAM and offer it
+ * (session ticket or session id) when reconnecting to the same endpoint.
+ */
+#define MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+
+/*
+ * Define MBEDTLS_TRANSPORT_NETCONN_RECV to read received TLS records directly from the lwIP
+ * netconn pbuf chain instead of through lwip_recv.
+ */
+/* #define MBEDTLS_TRANSPORT_NETCONN_RECV */
+
 
 #endif /* TLS_TRANSPORT_CONFIG */
@@ -31,6 +31,9 @@
 
 #include "FreeRTOS.h"
 #include "atomic.h"
+#include "semphr.h"
+
+#include <string.h>
 
 /* PKCS 11 includes. */
 #include "core_pkcs11_config.h"
@@ -46,8 +49,240 @@
 
 /*-----------------------------------------------------------*/
 
+/* Number of non-private objects kept in RAM after they are first read. Set to 0 to disable the cache. */
+#ifndef PKCS11_PAL_CACHE_ENTRIES
+#define PKCS11_PAL_CACHE_ENTRIES            4
+#endif
+
+/* Objects larger than this are always read from the filesystem */
+#ifndef PKCS11_PAL_CACHE_MAX_OBJECT_SIZE
+#define PKCS11_PAL_CACHE_MAX_OBJECT_SIZE    2048
+#endif
+
+#define PKCS11_PAL_NUM_HANDLES              ( eAwsCaCertificate + 1 )
+
+typedef enum
+{
+    eObjectUnknown = 0,
+    eObjectPresent,
+    eObjectAbsent
+} ObjectPresence_t;
+
+typedef struct
+{
+    CK_OBJECT_HANDLE xHandle; /* eInvalidHandle when the entry is free */
+    CK_BYTE_PTR pucData;
+    CK_ULONG ulDataSize;
+    uint32_t ulRefCount;      /* Callers which have not yet called PKCS11_PAL_GetObjectValueCleanup */
+    uint32_t ulLastUse;
+    BaseType_t xStale;        /* Object was overwritten or destroyed while still referenced */
+} ObjectCacheEntry_t;
+
 static lfs_t * pLfsCtx = NULL;
 
+/* Result of the last filesystem lookup for each handle, so FindObject does not stat the file every time */
+static ObjectPresence_t xObjectPresence[ PKCS11_PAL_NUM_HANDLES ] = { eObjectUnknown };
+
+static SemaphoreHandle_t xCacheMutex = NULL;
+
+#if PKCS11_PAL_CACHE_ENTRIES > 0
+    static ObjectCacheEntry_t xObjectCache[ PKCS11_PAL_CACHE_ENTRIES ] = { 0 };
+    static uint32_t ulCacheUseCounter = 0;
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvSetPresence( CK_OBJECT_HANDLE xHandle,
+                            ObjectPresence_t xPresence )
+{
+    if( ( xHandle != ( CK_OBJECT_HANDLE ) eInvalidHandle ) &&
+        ( xHandle < PKCS11_PAL_NUM_HANDLES ) )
+    {
+        xObjectPresence[ xHandle ] = xPresence;
+    }
+}
+
+static ObjectPresence_t prvGetPresence( CK_OBJECT_HANDLE xHandle )
+{
+    ObjectPresence_t xPresence = eObjectUnknown;
+
+    if( ( xHandle != ( CK_OBJECT_HANDLE ) eInvalidHandle ) &&
+        ( xHandle < PKCS11_PAL_NUM_HANDLES ) )
+    {
+        xPresence = xObjectPresence[ xHandle ];
+    }
+
+    return xPresence;
+}
+
+#if PKCS11_PAL_CACHE_ENTRIES > 0
+
+/*
+ * @brief Look up a cached copy of an object and take a reference to it.
+ * Must be called with xCacheMutex held.
+ */
+    static BaseType_t prvCacheGet( CK_OBJECT_HANDLE xHandle,
+                                   CK_BYTE_PTR * ppucData,
+                                   CK_ULONG_PTR pulDataSize )
+    {
+        BaseType_t xFound = pdFALSE;
+
+        for( uint32_t i = 0; i < PKCS11_PAL_CACHE_ENTRIES; i++ )
+        {
+            ObjectCacheEntry_t * pxEntry = &( xObjectCache[ i ] );
+
+            if( ( pxEntry->xHandle == xHandle ) &&
+                ( pxEntry->xStale == pdFALSE ) )
+            {
+                pxEntry->ulRefCount++;
+                pxEntry->ulLastUse = ++ulCacheUseCounter;
+                *ppucData = pxEntry->pucData;
+                *pulDataSize = pxEntry->ulDataSize;
+                xFound = pdTRUE;
+                break;
+            }
+        }
+
+        return xFound;
+    }
+
+/*
+ * @brief Take ownership of a freshly read object, replacing the least recently used unreferenced entry.
+ * Returns pdFALSE if no entry is available, in which case the caller keeps ownership of pucData.
+ * Must be called with xCacheMutex held.
+ */
+    static BaseType_t prvCachePut( CK_OBJECT_HANDLE xHandle,
+                                   CK_BYTE_PTR pucData,
+                                   CK_ULONG ulDataSize )
+    {
+        ObjectCacheEntry_t * pxVictim = NULL;
+
+        for( uint32_t i = 0; i < PKCS11_PAL_CACHE_ENTRIES; i++ )
+        {
+            ObjectCacheEntry_t * pxEntry = &( xObjectCache[ i ] );
+
+            if( pxEntry->xHandle == ( CK_OBJECT_HANDLE ) eInvalidHandle )
+            {
+                pxVictim = pxEntry;
+                break;
+            }
+            else if( ( pxEntry->ulRefCount == 0 ) &&
+                     ( ( pxVictim == NULL ) ||
+                       ( ( ulCacheUseCounter - pxEntry->ulLastUse ) > ( ulCacheUseCounter - pxVictim->ulLastUse ) ) ) )
+            {
+                pxVictim = pxEntry;
+            }
+            else
+            {
+                /* Entry is in use */
+            }
+        }
+
+        if( pxVictim != NULL )
+        {
+            if( pxVictim->pucData != NULL )
+            {
+                vPortFree( pxVictim->pucData );
+            }
+
+            pxVictim->xHandle = xHandle;
+            pxVictim->pucData = pucData;
+            pxVictim->ulDataSize = ulDataSize;
+            pxVictim->ulRefCount = 1;
+            pxVictim->ulLastUse = ++ulCacheUseCounter;
+            pxVictim->xStale = pdFALSE;
+        }
+
+        return( pxVictim != NULL );
+    }
+
+/*
+ * @brief Drop the cached copy of an object after it was overwritten or destroyed.
+ * Entries which are still referenced are freed by PKCS11_PAL_GetObjectValueCleanup.
+ * Must be called with xCacheMutex held.
+ */
+    static void prvCacheInvalidate( CK_OBJECT_HANDLE xHandle )
+    {
+        for( uint32_t i = 0; i < PKCS11_PAL_CACHE_ENTRIES; i++ )
+        {
+            ObjectCacheEntry_t * pxEntry = &( xObjectCache[ i ] );
+
+            if( ( pxEntry->xHandle == xHandle ) &&
+                ( pxEntry->xStale == pdFALSE ) )
+            {
+                if( pxEntry->ulRefCount == 0 )
+                {
+                    vPortFree( pxEntry->pucData );
+                    ( void ) memset( pxEntry, 0, sizeof( ObjectCacheEntry_t ) );
+                }
+                else
+                {
+                    pxEntry->xStale = pdTRUE;
+                }
+            }
+        }
+    }
+
+/*
+ * @brief Release a reference taken by PKCS11_PAL_GetObjectValue.
+ * Returns pdFALSE if pucData is not owned by the cache.
+ * Must be called with xCacheMutex held.
+ */
+    static BaseType_t prvCacheRelease( CK_BYTE_PTR pucData )
+    {
+        BaseType_t xFound = pdFALSE;
+
+        for( uint32_t i = 0; i < PKCS11_PAL_CACHE_ENTRIES; i++ )
+        {
+            ObjectCacheEntry_t * pxEntry = &( xObjectCache[ i ] );
+
+            if( ( pxEntry->xHandle != ( CK_OBJECT_HANDLE ) eInvalidHandle ) &&
+                ( pxEntry->pucData == pucData ) )
+            {
+                configASSERT( pxEntry->ulRefCount > 0 );
+
+                pxEntry->ulRefCount--;
+
+                if( ( pxEntry->ulRefCount == 0 ) &&
+                    ( pxEntry->xStale == pdTRUE ) )
+                {
+                    vPortFree( pxEntry->pucData );
+                    ( void ) memset( pxEntry, 0, sizeof( ObjectCacheEntry_t ) );
+                }
+
+                xFound = pdTRUE;
+                break;
+            }
+        }
+
+        return xFound;
+    }
+
+#endif /* PKCS11_PAL_CACHE_ENTRIES > 0 */
+
+/*
+ * @brief Invalidate everything known about an object after it was written or removed.
+ */
+static void prvObjectChanged( CK_OBJECT_HANDLE xHandle,
+                              ObjectPresence_t xPresence )
+{
+    if( xCacheMutex != NULL )
+    {
+        ( void ) xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+    }
+
+    prvSetPresence( xHandle, xPresence );
+
+    #if PKCS11_PAL_CACHE_ENTRIES > 0
+        prvCacheInvalidate( xHandle );
+    #endif
+
+    if( xCacheMutex != NULL )
+    {
+        ( void ) xSemaphoreGive( xCacheMutex );
+    }
+}
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -195,8 +430,22 @@ static CK_RV prvReadData( const char * pcFileName,
 
 CK_RV PKCS11_PAL_Initialize( void )
 {
+    CK_RV xReturn = CKR_OK;
+
     pLfsCtx = pxGetDefaultFsCtx();
-    return CKR_OK;
+
+    if( xCacheMutex == NULL )
+    {
+        xCacheMutex = xSemaphoreCreateMutex();
+
+        if( xCacheMutex == NULL )
+        {
+            LogError( ( "Failed to allocate the PKCS #11 PAL object cache mutex." ) );
+            xReturn = CKR_HOST_MEMORY;
+        }
+    }
+
+    return xReturn;
 }
 
 CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
@@ -265,6 +514,17 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
         LogError( ( "Could not save object. Unable to open the correct file." ) );
     }
 
+    if( pcFileName != NULL )
+    {
+        CK_OBJECT_HANDLE xSavedHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
+
+        PAL_UTILS_LabelToFilenameHandle( pxLabel->pValue, &pcFileName, &xSavedHandle );
+
+        /* A failed write may have left a truncated file behind */
+        prvObjectChanged( xSavedHandle,
+                          ( xHandle == xSavedHandle ) ? eObjectPresent : eObjectUnknown );
+    }
+
     return xHandle;
 }
 
@@ -285,10 +545,31 @@ CK_OBJECT_HANDLE PKCS11_PAL_FindObject( CK_BYTE_PTR pxLabel,
                                          &pcFileName,
                                          &xHandle );
 
-        if( ( pcFileName == NULL ) || ( CKR_OK != prvFileExists( pcFileName ) ) )
+        if( pcFileName == NULL )
         {
             xHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
         }
+        else
+        {
+            ObjectPresence_t xPresence = prvGetPresence( xHandle );
+
+            if( xPresence == eObjectUnknown )
+            {
+                xPresence = ( prvFileExists( pcFileName ) == CKR_OK ) ? eObjectPresent : eObjectAbsent;
+
+                if( xCacheMutex != NULL )
+                {
+                    ( void ) xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+                    prvSetPresence( xHandle, xPresence );
+                    ( void ) xSemaphoreGive( xCacheMutex );
+                }
+            }
+
+            if( xPresence != eObjectPresent )
+            {
+                xHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
+            }
+        }
     }
     else
     {
@@ -306,7 +587,7 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
 {
     CK_RV xReturn = CKR_OK;
     const char * pcFileName = NULL;
-
+    BaseType_t xUseCache = pdFALSE;
 
     if( ( ppucData == NULL ) || ( pulDataSize == NULL ) || ( pIsPrivate == NULL ) )
     {
@@ -318,11 +599,42 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
         xReturn = PAL_UTILS_HandleToFilename( xHandle, &pcFileName, pIsPrivate );
     }
 
-    if( xReturn == CKR_OK )
+    #if PKCS11_PAL_CACHE_ENTRIES > 0
+        /* Private objects are never kept in RAM beyond the lifetime of the caller's buffer */
+        if( ( xReturn == CKR_OK ) &&
+            ( *pIsPrivate == ( CK_BBOOL ) CK_FALSE ) &&
+            ( xCacheMutex != NULL ) )
+        {
+            xUseCache = pdTRUE;
+        }
+    #endif
+
+    if( ( xReturn == CKR_OK ) &&
+        ( xUseCache == pdFALSE ) )
     {
         xReturn = prvReadData( pcFileName, ppucData, pulDataSize );
     }
 
+    #if PKCS11_PAL_CACHE_ENTRIES > 0
+        if( xUseCache == pdTRUE )
+        {
+            ( void ) xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+
+            if( prvCacheGet( xHandle, ppucData, pulDataSize ) == pdFALSE )
+            {
+                xReturn = prvReadData( pcFileName, ppucData, pulDataSize );
+
+                if( ( xReturn == CKR_OK ) &&
+                    ( *pulDataSize <= PKCS11_PAL_CACHE_MAX_OBJECT_SIZE ) )
+                {
+                    ( void ) prvCachePut( xHandle, *ppucData, *pulDataSize );
+                }
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+    #endif /* PKCS11_PAL_CACHE_ENTRIES > 0 */
+
     return xReturn;
 }
 
@@ -336,7 +648,21 @@ void PKCS11_PAL_GetObjectValueCleanup( CK_BYTE_PTR pucData,
 
     if( NULL != pucData )
     {
-        vPortFree( pucData );
+        BaseType_t xCached = pdFALSE;
+
+        #if PKCS11_PAL_CACHE_ENTRIES > 0
+            if( xCacheMutex != NULL )
+            {
+                ( void ) xSemaphoreTake( xCacheMutex, portMAX_DELAY );
+                xCached = prvCacheRelease( pucData );
+                ( void ) xSemaphoreGive( xCacheMutex );
+            }
+        #endif
+
+        if( xCached == pdFALSE )
+        {
+            vPortFree( pucData );
+        }
     }
 }
 
@@ -362,6 +688,8 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
         {
             xResult = CKR_FUNCTION_FAILED;
         }
+
+        prvObjectChanged( xHandle, ( ret == 0 ) ? eObjectAbsent : eObjectUnknown );
     }
 
     return xResult;
@@ -33,6 +33,15 @@
 
     #define MBEDTLS_ENTROPY_TIMEOUT_MS    100
 
+/*
+ * Number of 32 bit TRNG words kept in RAM. The pool is refilled from the RNG
+ * interrupt in the background, so most polls are served without waiting for
+ * the peripheral.
+ */
+    #ifndef RNG_POOL_WORDS
+        #define RNG_POOL_WORDS    64
+    #endif
+
 /*
  * include the correct headerfile depending on the STM32 family */
 
@@ -44,11 +53,45 @@
 
     static volatile TaskHandle_t xRngTaskToNotify = NULL;
 
+/* Pool state. Written by the RNG interrupt and, under xRngMutex, in a critical section by the consumer */
+    static uint32_t ulRngPool[ RNG_POOL_WORDS ];
+    static volatile size_t uxPoolTail = 0;
+    static volatile size_t uxPoolCount = 0;
+    static volatile BaseType_t xRefillActive = pdFALSE;
+    static volatile BaseType_t xRngFault = pdFALSE;
+
+/* Last word produced by the RNG, for the continuous test */
+    static uint32_t ulLastWord = 0;
+    static BaseType_t xLastWordValid = pdFALSE;
+
     static void vRngIrqHandler( void )
     {
         HAL_RNG_IRQHandler( pxHndlRng );
     }
 
+/* Start a background refill unless one is running or the pool is full. Called from task context. */
+    static HAL_StatusTypeDef xRngRefillStart( void )
+    {
+        HAL_StatusTypeDef xResult = HAL_OK;
+
+        taskENTER_CRITICAL();
+
+        if( ( xRefillActive == pdFALSE ) &&
+            ( uxPoolCount < RNG_POOL_WORDS ) )
+        {
+            xResult = HAL_RNG_GenerateRandomNumber_IT( pxHndlRng );
+
+            if( xResult == HAL_OK )
+            {
+                xRefillActive = pdTRUE;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+
+        return xResult;
+    }
+
     static void vRngInit( void )
     {
         taskENTER_CRITICAL();
@@ -63,15 +106,36 @@
         }
 
         taskEXIT_CRITICAL();
+
+        /* Fill the pool ahead of the first request */
+        if( xRngMutex != NULL )
+        {
+            ( void ) xRngRefillStart();
+        }
     }
 
-    void HAL_RNG_ReadyDataCallback( RNG_HandleTypeDef * hrng,
-                                    uint32_t random32bit )
+/* Recover the peripheral after a seed / clock error or a failed continuous test */
+    static void vRngRecover( void )
     {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS ) )
+        {
+            RNG_RecoverSeedError( pxHndlRng );
+        }
+        else
+        {
+            __HAL_RCC_RNG_CLK_DISABLE();
+            __HAL_RCC_RNG_CLK_ENABLE();
+            __HAL_RCC_RNG_FORCE_RESET();
+            __HAL_RCC_RNG_RELEASE_RESET();
+        }
 
-        ( void ) random32bit;
-        ( void ) hrng;
+        xLastWordValid = pdFALSE;
+        xRngFault = pdFALSE;
+    }
+
+    static void vRngNotifyFromISR( void )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
         if( xRngTaskToNotify )
         {
@@ -80,17 +144,89 @@
         }
     }
 
-    void HAL_RNG_ErrorCallback( RNG_HandleTypeDef * hrng )
+    void HAL_RNG_ReadyDataCallback( RNG_HandleTypeDef * hrng,
+                                    uint32_t random32bit )
     {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xRefillActive = pdFALSE;
 
+        /* Continuous test: two identical consecutive words mean the source is stuck */
+        if( ( xLastWordValid != pdFALSE ) &&
+            ( random32bit == ulLastWord ) )
+        {
+            xRngFault = pdTRUE;
+        }
+        else if( __HAL_RNG_GET_FLAG( hrng, RNG_FLAG_SECS | RNG_FLAG_CECS ) )
+        {
+            xRngFault = pdTRUE;
+        }
+        else
+        {
+            ulLastWord = random32bit;
+            xLastWordValid = pdTRUE;
+
+            ulRngPool[ ( uxPoolTail + uxPoolCount ) % RNG_POOL_WORDS ] = random32bit;
+            uxPoolCount++;
+
+            if( ( uxPoolCount < RNG_POOL_WORDS ) &&
+                ( HAL_RNG_GenerateRandomNumber_IT( hrng ) == HAL_OK ) )
+            {
+                xRefillActive = pdTRUE;
+            }
+        }
+
+        vRngNotifyFromISR();
+    }
+
+    void HAL_RNG_ErrorCallback( RNG_HandleTypeDef * hrng )
+    {
         ( void ) hrng;
 
-        if( xRngTaskToNotify )
+        xRefillActive = pdFALSE;
+        xRngFault = pdTRUE;
+
+        vRngNotifyFromISR();
+    }
+
+/* Move up to uxLen bytes out of the pool. Must be called with xRngMutex held. */
+    static size_t uxRngPoolRead( unsigned char * pucOutputBuffer,
+                                 size_t uxLen )
+    {
+        size_t uxWords = ( uxLen + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t );
+        size_t uxBytesWritten = 0;
+        size_t uxTail = uxPoolTail;
+
+        taskENTER_CRITICAL();
+
+        if( uxWords > uxPoolCount )
         {
-            vTaskNotifyGiveFromISR( xRngTaskToNotify, &xHigherPriorityTaskWoken );
-            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+            uxWords = uxPoolCount;
         }
+
+        taskEXIT_CRITICAL();
+
+        /* The interrupt only writes past the last available word, so the words can be copied outside of the critical section */
+        for( size_t i = 0; i < uxWords; i++ )
+        {
+            size_t uxCopy = uxLen - uxBytesWritten;
+
+            if( uxCopy > sizeof( uint32_t ) )
+            {
+                uxCopy = sizeof( uint32_t );
+            }
+
+            ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &( ulRngPool[ uxTail ] ), uxCopy );
+            ulRngPool[ uxTail ] = 0;
+
+            uxBytesWritten += uxCopy;
+            uxTail = ( uxTail + 1 ) % RNG_POOL_WORDS;
+        }
+
+        taskENTER_CRITICAL();
+        uxPoolTail = uxTail;
+        uxPoolCount -= uxWords;
+        taskEXIT_CRITICAL();
+
+        return uxBytesWritten;
     }
 
     int mbedtls_hardware_poll( void * pvCtx,
@@ -123,64 +259,34 @@
         else if( xSemaphoreTake( xRngMutex, xTicksToWait ) )
         {
             size_t uxBytesWritten = 0;
-            size_t uxBytesRemaining = uxBufferLen;
 
             xRngTaskToNotify = xTaskGetCurrentTaskHandle();
 
-            while( uxBytesRemaining > 0 &&
-                   xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+            while( ( uxBytesWritten < uxBufferLen ) &&
+                   ( lError == 0 ) )
             {
-                HAL_StatusTypeDef xResult = HAL_RNG_GenerateRandomNumber_IT( pxHndlRng );
+                uxBytesWritten += uxRngPoolRead( &( pucOutputBuffer[ uxBytesWritten ] ),
+                                                 uxBufferLen - uxBytesWritten );
+
+                if( ( xRngFault != pdFALSE ) &&
+                    ( xRefillActive == pdFALSE ) )
+                {
+                    vRngRecover();
+                }
 
-                if( xResult != HAL_OK )
+                /* Keep the pool topped up, even once this request is served */
+                if( xRngRefillStart() != HAL_OK )
                 {
                     lError = MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
                 }
-                else if( ulTaskNotifyTake( pdTRUE, xTicksToWait ) > 0 )
+                else if( uxBytesWritten < uxBufferLen )
                 {
-                    /* Check for error state */
-                    if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS | RNG_FLAG_CECS ) )
+                    if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) != pdFALSE )
                     {
-                        if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS ) )
-                        {
-                            RNG_RecoverSeedError( pxHndlRng );
-                        }
-                        else
-                        {
-                            __HAL_RCC_RNG_CLK_DISABLE();
-                            __HAL_RCC_RNG_CLK_ENABLE();
-                            __HAL_RCC_RNG_FORCE_RESET();
-                            __HAL_RCC_RNG_RELEASE_RESET();
-                        }
+                        break;
                     }
-                    else
-                    {
-                        uint32_t ulRandomValue = HAL_RNG_ReadLastRandomNumber( pxHndlRng );
-
-                        if( uxBytesRemaining > sizeof( uint32_t ) )
-                        {
-                            ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &ulRandomValue, sizeof( uint32_t ) );
-
-                            uxBytesWritten += sizeof( uint32_t );
-                            uxBytesRemaining -= sizeof( uint32_t );
-                        }
-                        else if( uxBytesRemaining > 0 )
-                        {
-                            ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &ulRandomValue, uxBytesRemaining );
-
-                            uxBytesWritten = uxBufferLen;
-                            uxBytesRemaining = 0;
-                        }
-                        else
-                        {
-                            uxBytesRemaining = 0;
-                        }
-                    }
-                }
-                else
-                {
-                    uxBytesRemaining = 0;
-                    break;
+
+                    ( void ) ulTaskNotifyTake( pdTRUE, xTicksToWait );
                 }
             }
 
@@ -0,0 +1,148 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file lfs_maint.c
+ * @brief Background littlefs garbage collection and metadata compaction.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lfs.h"
+#include "lfs_port.h"
+#include "lfs_port_stats.h"
+#include "lfs_maint.h"
+
+#if ( LFS_MAINT_ENABLED == 1 )
+
+static LfsMaintStats_t xMaintStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+#if LFS_MAINT_HAS_GC
+
+    static void prvRunGc( lfs_t * pxLfs )
+    {
+        TickType_t xStart = xTaskGetTickCount();
+        int lResult = lfs_fs_gc( pxLfs );
+        uint32_t ulElapsedMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS );
+
+        taskENTER_CRITICAL();
+        {
+            xMaintStats.ulRuns++;
+            xMaintStats.ulTotalMs += ulElapsedMs;
+            xMaintStats.lLastResult = lResult;
+
+            if( ulElapsedMs > xMaintStats.ulMaxMs )
+            {
+                xMaintStats.ulMaxMs = ulElapsedMs;
+            }
+
+            if( lResult < 0 )
+            {
+                xMaintStats.ulErrors++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( lResult < 0 )
+        {
+            LogWarn( "lfs_fs_gc failed: %d.", lResult );
+        }
+    }
+
+#endif /* LFS_MAINT_HAS_GC */
+
+/*-----------------------------------------------------------*/
+
+void vLfsMaintTask( void * pvParameters )
+{
+    lfs_t * pxLfs = pxGetDefaultFsCtx();
+
+    ( void ) pvParameters;
+
+    #if LFS_PORT_STATS_ENABLE
+        vLfsPortStatsSetBackgroundTask( xTaskGetCurrentTaskHandle() );
+    #endif
+
+    #if LFS_MAINT_HAS_MKCONSISTENT
+    {
+        int lResult = lfs_fs_mkconsistent( pxLfs );
+
+        if( lResult < 0 )
+        {
+            LogWarn( "lfs_fs_mkconsistent failed: %d.", lResult );
+
+            taskENTER_CRITICAL();
+            {
+                xMaintStats.ulErrors++;
+                xMaintStats.lLastResult = lResult;
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+    #endif /* LFS_MAINT_HAS_MKCONSISTENT */
+
+    #if LFS_MAINT_HAS_GC
+        for( ; ; )
+        {
+            vTaskDelay( pdMS_TO_TICKS( LFS_MAINT_PERIOD_MS ) );
+
+            prvRunGc( pxLfs );
+        }
+    #else
+        ( void ) pxLfs;
+
+        LogInfo( "littlefs %lx has no lfs_fs_gc, background maintenance is off.", ( unsigned long ) LFS_VERSION );
+
+        #if LFS_PORT_STATS_ENABLE
+            vLfsPortStatsSetBackgroundTask( NULL );
+        #endif
+
+        vTaskDelete( NULL );
+    #endif /* LFS_MAINT_HAS_GC */
+}
+
+/*-----------------------------------------------------------*/
+
+void vLfsMaintGetStats( LfsMaintStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        *pxStats = xMaintStats;
+    }
+    taskEXIT_CRITICAL();
+}
+
+#endif /* LFS_MAINT_ENABLED == 1 */
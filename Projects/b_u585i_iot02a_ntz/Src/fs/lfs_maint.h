@@ -0,0 +1,94 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file lfs_maint.h
+ * @brief Background littlefs maintenance, run at idle priority.
+ *
+ * Once the filesystem is mounted, the task finishes any orphan or move left by an interrupted
+ * operation with lfs_fs_mkconsistent, then calls lfs_fs_gc every LFS_MAINT_PERIOD_MS. lfs_fs_gc
+ * refills the lookahead buffer when allocations have drained it, so that the next write does not
+ * scan the whole filesystem for free blocks, and from littlefs 2.9 compacts the metadata pairs
+ * which are above compact_thresh before a write finds them full.
+ *
+ * The work goes through the littlefs lock like any other call. A writer waiting on the lock
+ * raises the task to its own priority until the current call returns.
+ */
+#ifndef _LFS_MAINT_H_
+#define _LFS_MAINT_H_
+
+#include <stdint.h>
+
+#include "lfs.h"
+
+#ifndef LFS_MAINT_ENABLED
+    #define LFS_MAINT_ENABLED    1
+#endif
+
+/* Interval between two lfs_fs_gc calls */
+#ifndef LFS_MAINT_PERIOD_MS
+    #define LFS_MAINT_PERIOD_MS    ( 30 * 1000 )
+#endif
+
+/*
+ * compact_thresh of both flash ports, used by lfs_fs_gc from littlefs 2.9. 0 selects the littlefs
+ * default of about 88% of block_size, -1 turns the compaction off.
+ */
+#ifndef LFS_MAINT_COMPACT_THRESH
+    #define LFS_MAINT_COMPACT_THRESH    0
+#endif
+
+/* lfs_fs_gc appeared in littlefs 2.8, lfs_fs_mkconsistent in 2.6 and compact_thresh in 2.9 */
+#define LFS_MAINT_HAS_GC             ( LFS_VERSION >= 0x00020008 )
+#define LFS_MAINT_HAS_MKCONSISTENT   ( LFS_VERSION >= 0x00020006 )
+#define LFS_MAINT_HAS_COMPACT        ( LFS_VERSION >= 0x00020009 )
+
+typedef struct
+{
+    uint32_t ulRuns;      /* lfs_fs_gc calls */
+    uint32_t ulErrors;    /* lfs_fs_gc or lfs_fs_mkconsistent calls which failed */
+    uint32_t ulTotalMs;   /* Time spent in lfs_fs_gc */
+    uint32_t ulMaxMs;     /* Longest lfs_fs_gc call */
+    int32_t lLastResult;  /* Result of the last call */
+} LfsMaintStats_t;
+
+#if ( LFS_MAINT_ENABLED == 1 )
+
+/*
+ * @brief Maintenance task, started at tskIDLE_PRIORITY once the default filesystem is mounted.
+ * Deletes itself when littlefs is older than 2.8.
+ */
+    void vLfsMaintTask( void * pvParameters );
+
+/*
+ * @brief Copy the maintenance counters.
+ */
+    void vLfsMaintGetStats( LfsMaintStats_t * pxStats );
+
+#endif /* LFS_MAINT_ENABLED == 1 */
+
+#endif /* _LFS_MAINT_H_ */
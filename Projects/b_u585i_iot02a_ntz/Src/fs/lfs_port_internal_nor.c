@@ -33,6 +33,9 @@
 #include "lfs_util.h"
 #include "lfs.h"
 #include "lfs_port_prv.h"
+#include "lfs_port_stats.h"
+#include "lfs_maint.h"
+#include "trace_rec.h"
 
 #include "stm32u585xx.h"
 #include "stm32u5xx.h"
@@ -47,12 +50,21 @@
 /* Use second bank to avoid program flash. TODO: Should add variable in linker script to mark end of program flash */
 #define CONFIG_LFS_FLASH_BASE        ( FLASH_BASE + FLASH_BANK_SIZE )
 #define LFS_CONFIG_LOOKAHEAD_SIZE    16
-#define LFS_CONFIG_CACHE_SIZE        16
+
+/*
+ * Size of the littlefs read and program caches. Large enough that metadata reads
+ * are served from RAM and that cache flushes can use burst programming.
+ */
+#define LFS_CONFIG_CACHE_SIZE        256
+
+/* Quad-word programming unit and 8 quad-word burst size of the U5 flash controller */
+#define LFS_FLASH_QUADWORD_SZ        ( 4 * sizeof( uint32_t ) )
+#define LFS_FLASH_BURST_SZ           ( 8 * LFS_FLASH_QUADWORD_SZ )
 
 #ifdef LFS_NO_MALLOC
-static uint8_t __ALIGN_BEGIN ucReadBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucProgBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucLookAheadBuffer[ CONFIG_SIZE_LOOKAHEAD_BUFFER ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucReadBuffer[ LFS_CONFIG_CACHE_SIZE ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucProgBuffer[ LFS_CONFIG_CACHE_SIZE ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucLookAheadBuffer[ LFS_CONFIG_LOOKAHEAD_SIZE ] __ALIGN_END = { 0 };
 static struct lfs_config xLfsCfg = { 0 };
 static struct LfsPortCtx xLfsCtx = { 0 };
 static StaticSemaphore_t xMutexStatic;
@@ -64,15 +76,11 @@ static int lfs_port_read( const struct lfs_config * c,
                           void * buffer,
                           lfs_size_t size )
 {
-    HAL_FLASH_Unlock();
-    __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
-
     uint32_t src_address = CONFIG_LFS_FLASH_BASE + block * c->block_size + off;
 
+    /* Reads do not need the flash control registers unlocked */
     ( void ) memcpy( buffer, ( void * ) src_address, size );
 
-    HAL_FLASH_Lock();
-
     return 0;
 }
 
@@ -83,34 +91,44 @@ static int lfs_port_prog( const struct lfs_config * c,
                           lfs_size_t size )
 {
     HAL_StatusTypeDef xHAL_Status = HAL_OK;
-    uint32_t n_rows = size / c->prog_size;
-    uint32_t dest_address = 0;
-    uint32_t src_address = 0;
-    uint32_t block_base_addr = CONFIG_LFS_FLASH_BASE + block * c->block_size;
+    uint32_t dest_address = CONFIG_LFS_FLASH_BASE + block * c->block_size + off;
+    uint32_t src_address = ( uint32_t ) buffer;
+    uint32_t end_address = dest_address + size;
 
     struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
 
     configASSERT( xQueueGetMutexHolder( pxCtx->xMutex ) == xTaskGetCurrentTaskHandle() );
+    configASSERT( ( size % LFS_FLASH_QUADWORD_SZ ) == 0 );
+
+    vTraceRecBegin( TraceRecSliceFlashProg, 0 );
 
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
 
-    for( uint32_t i_row = 0; i_row < n_rows; i_row++ )
+    while( ( xHAL_Status == HAL_OK ) &&
+           ( dest_address < end_address ) )
     {
-        dest_address = block_base_addr + off + i_row * 4 * sizeof( uint32_t );
-        src_address = ( uint32_t ) buffer + i_row * 4 * sizeof( uint32_t );
-        xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, dest_address, src_address );
-
-        if( xHAL_Status != HAL_OK )
+        /* Program 8 quad-words per operation where the destination allows it */
+        if( ( ( dest_address % LFS_FLASH_BURST_SZ ) == 0 ) &&
+            ( ( end_address - dest_address ) >= LFS_FLASH_BURST_SZ ) )
         {
-            HAL_FLASH_Lock();
-            return -1;
+            xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_BURST, dest_address, src_address );
+            dest_address += LFS_FLASH_BURST_SZ;
+            src_address += LFS_FLASH_BURST_SZ;
+        }
+        else
+        {
+            xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, dest_address, src_address );
+            dest_address += LFS_FLASH_QUADWORD_SZ;
+            src_address += LFS_FLASH_QUADWORD_SZ;
         }
     }
 
     HAL_FLASH_Lock();
 
-    return 0;
+    vTraceRecEnd( TraceRecSliceFlashProg, size );
+
+    return( xHAL_Status == HAL_OK ? 0 : -1 );
 }
 
 static int lfs_port_erase( const struct lfs_config * c,
@@ -127,12 +145,16 @@ static int lfs_port_erase( const struct lfs_config * c,
     xErase_Config.Page = block;
     xErase_Config.NbPages = 1;
 
+    vTraceRecBegin( TraceRecSliceFlashErase, block );
+
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
     HAL_StatusTypeDef xHAL_Status = HAL_FLASHEx_Erase( &xErase_Config, &ulPageError );
 
     HAL_FLASH_Lock();
 
+    vTraceRecEnd( TraceRecSliceFlashErase, block );
+
     return xHAL_Status == HAL_OK ? 0 : -1;
 }
 
@@ -158,7 +180,7 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     #endif
 
     pxCfg->read_size = 1;
-    pxCfg->prog_size = 16;
+    pxCfg->prog_size = LFS_FLASH_QUADWORD_SZ;
     pxCfg->block_size = FLASH_PAGE_SIZE;
 
     pxCfg->block_count = FLASH_PAGE_NB;
@@ -182,6 +204,15 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     pxCfg->file_max = 0;
     pxCfg->attr_max = 0;
     pxCfg->metadata_max = 0;
+
+    #if LFS_MAINT_HAS_COMPACT
+        /* Metadata pairs above this are compacted by the background lfs_fs_gc */
+        pxCfg->compact_thresh = ( lfs_size_t ) LFS_MAINT_COMPACT_THRESH;
+    #endif
+
+    #if LFS_PORT_STATS_ENABLE
+        vLfsPortStatsAttach( pxCfg, "internal" );
+    #endif
 }
 
 #ifdef LFS_NO_MALLOC
@@ -214,7 +245,7 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
 
         configASSERT( pxCfg != NULL );
 
-        struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) ( pvPortMalloc( sizeof( struct lfs_config ) ) );
+        struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) ( pvPortMalloc( sizeof( struct LfsPortCtx ) ) );
 
         configASSERT( pxCtx != NULL );
 
@@ -236,7 +267,7 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
         const char * path = "boot_count";
 
         #ifdef LFS_NO_MALLOC
-        static uint8_t __ALIGN_BEGIN ucFileCache[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
+        static uint8_t __ALIGN_BEGIN ucFileCache[ LFS_CONFIG_CACHE_SIZE ] __ALIGN_END = { 0 };
         struct lfs_file_config xFileConfig = { 0 };
 
         xFileConfig.buffer = ( void * ) ucFileCache;
@@ -35,16 +35,29 @@
 #include "lfs_util.h"
 #include "lfs.h"
 #include "lfs_port_prv.h"
+#include "lfs_port_stats.h"
+#include "lfs_maint.h"
 #include "ospi_nor_mx25lmxxx45g.h"
 
 /*
  * LittleFS port for the external NOR flash connected to the STM32U5 octo-spi interface
  */
 
+#define LFS_CONFIG_BLOCK_COUNT       ( MX25LM_MEM_SZ_USABLE / MX25LM_SECTOR_SZ )
+
+/* One NOR page per program operation */
+#define LFS_CONFIG_PROG_SIZE         MX25LM_PROGRAM_FIFO_LEN
+
+/* A full erase block, so that a cache flush is a single multi-page program request */
+#define LFS_CONFIG_CACHE_SIZE        MX25LM_SECTOR_SZ
+
+/* Enough bits to track every block in one lookahead window, rounded up to 8 bytes */
+#define LFS_CONFIG_LOOKAHEAD_SIZE    ( ( ( LFS_CONFIG_BLOCK_COUNT + 63 ) / 64 ) * 8 )
+
 #ifdef LFS_NO_MALLOC
-static uint8_t __ALIGN_BEGIN ucReadBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucProgBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucLookAheadBuffer[ CONFIG_SIZE_LOOKAHEAD_BUFFER ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucReadBuffer[ LFS_CONFIG_CACHE_SIZE ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucProgBuffer[ LFS_CONFIG_CACHE_SIZE ] __ALIGN_END = { 0 };
+static uint8_t __ALIGN_BEGIN ucLookAheadBuffer[ LFS_CONFIG_LOOKAHEAD_SIZE ] __ALIGN_END = { 0 };
 static struct lfs_config xLfsCfg = { 0 };
 static struct LfsPortCtx xLfsCtx = { 0 };
 static StaticSemaphore_t xMutexStatic;
@@ -76,10 +89,10 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
 {
     /* Read size is one word */
     pxCfg->read_size = 1;
-    pxCfg->prog_size = 256;
+    pxCfg->prog_size = LFS_CONFIG_PROG_SIZE;
 
     /* Number of erasable blocks */
-    pxCfg->block_count = ( MX25LM_MEM_SZ_USABLE / MX25LM_SECTOR_SZ );
+    pxCfg->block_count = LFS_CONFIG_BLOCK_COUNT;
     pxCfg->block_size = MX25LM_SECTOR_SZ;
 
     pxCfg->context = pxCtx;
@@ -95,8 +108,8 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     #endif
     /* controls wear leveling */
     pxCfg->block_cycles = 500;
-    pxCfg->cache_size = 4096;
-    pxCfg->lookahead_size = 256;
+    pxCfg->cache_size = LFS_CONFIG_CACHE_SIZE;
+    pxCfg->lookahead_size = LFS_CONFIG_LOOKAHEAD_SIZE;
 
     #ifdef LFS_NO_MALLOC
         pxCfg->read_buffer = ucReadBuffer;
@@ -113,6 +126,15 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     pxCfg->file_max = 0;
     pxCfg->attr_max = 0;
     pxCfg->metadata_max = 0;
+
+    #if LFS_MAINT_HAS_COMPACT
+        /* Metadata pairs above this are compacted by the background lfs_fs_gc */
+        pxCfg->compact_thresh = ( lfs_size_t ) LFS_MAINT_COMPACT_THRESH;
+    #endif
+
+    #if LFS_PORT_STATS_ENABLE
+        vLfsPortStatsAttach( pxCfg, "ospi" );
+    #endif
 }
 
 #ifndef LFS_THREADSAFE
@@ -234,24 +256,17 @@ static int lfs_port_prog( const struct lfs_config * pxCfg,
     /* Determine the 4-byte write address */
     uint32_t ulStartAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size ) + off;
 
-    uint32_t ulLastAddr = ulStartAddr + size - MX25LM_PROGRAM_FIFO_LEN;
+    LogDebug( "Programming Start Addr: 0x%010lX, size: %lu, block: %lu, offset: %lu",
+              ulStartAddr, size, block, off );
 
-    LogDebug( "Programming Start Addr: 0x%010lX, End Addr: 0x%010lX, size: %lu, block: %lu, offset: %lu, rv: %ld",
-              ulStartAddr, ulLastAddr, size, block, off, lReturnValue );
-
-    for( uint32_t ulWriteAddr = ulStartAddr; ulWriteAddr <= ulLastAddr; ulWriteAddr += MX25LM_PROGRAM_FIFO_LEN )
+    /* The driver splits the program into pages without returning to this task between them */
+    if( ospi_WriteAddr( &( pxCtx->xOSPIHandle ),
+                        ulStartAddr,
+                        pvBuffer,
+                        size,
+                        pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) ) != pdTRUE )
     {
-        LogDebug( "Writing block at addr: 0x%010lX, len: %lu", ulWriteAddr, MX25LM_PROGRAM_FIFO_LEN );
-
-        if( ospi_WriteAddr( &( pxCtx->xOSPIHandle ),
-                            ulWriteAddr,
-                            &( ( ( uint8_t * ) pvBuffer )[ ulWriteAddr - ulStartAddr ] ),
-                            MX25LM_PROGRAM_FIFO_LEN,
-                            pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) ) != pdTRUE )
-        {
-            lReturnValue = -1;
-            break;
-        }
+        lReturnValue = -1;
     }
 
     return lReturnValue;
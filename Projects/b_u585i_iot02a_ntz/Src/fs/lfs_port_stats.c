@@ -0,0 +1,739 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file lfs_port_stats.c
+ * @brief Profiling wrappers for the littlefs block device callbacks and the "fs" CLI command.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* DWT cycle counter */
+#include "stm32u5xx.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include "lfs.h"
+#include "lfs_port_stats.h"
+#include "lfs_maint.h"
+#include "cli/cli_prv.h"
+
+#if LFS_PORT_STATS_ENABLE
+
+typedef struct
+{
+    struct lfs_config * pxCfg;
+    const char * pcName;
+
+    /* Callbacks populated by the flash port */
+    int ( * read )( const struct lfs_config * c,
+                    lfs_block_t block,
+                    lfs_off_t off,
+                    void * buffer,
+                    lfs_size_t size );
+    int ( * prog )( const struct lfs_config * c,
+                    lfs_block_t block,
+                    lfs_off_t off,
+                    const void * buffer,
+                    lfs_size_t size );
+    int ( * erase )( const struct lfs_config * c,
+                     lfs_block_t block );
+    int ( * sync )( const struct lfs_config * c );
+    #ifdef LFS_THREADSAFE
+        int ( * lock )( const struct lfs_config * c );
+        int ( * unlock )( const struct lfs_config * c );
+    #endif
+
+    /* State of the call holding the lock */
+    uint32_t ulCallStart;
+    uint32_t ulCallWrites;
+
+    LfsPortLatHist_t xWriteFg;
+    LfsPortLatHist_t xWriteBg;
+
+    LfsPortOpStats_t xOps[ LFS_PORT_OP_NUM ];
+    uint32_t ulMountUs;
+    uint32_t ulMountCount;
+
+    LfsPortSlotStats_t * pxSlots;
+    uint32_t ulNumSlots;
+    uint32_t ulBlocksPerSlot;
+} LfsPortStatsCtx_t;
+
+static LfsPortStatsCtx_t xPorts[ LFS_PORT_STATS_MAX_PORTS ] = { 0 };
+
+static TaskHandle_t xBackgroundTask = NULL;
+
+static const char * const pcOpNames[ LFS_PORT_OP_NUM ] = { "read", "prog", "erase", "sync" };
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvStartCycles( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    return DWT->CYCCNT;
+}
+
+static uint32_t prvElapsedUs( uint32_t ulStartCycles )
+{
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+
+    return ( DWT->CYCCNT - ulStartCycles ) / ( ulCyclesPerUs > 0 ? ulCyclesPerUs : 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+static LfsPortStatsCtx_t * prvGetCtx( const struct lfs_config * pxCfg )
+{
+    LfsPortStatsCtx_t * pxCtx = NULL;
+
+    for( uint32_t i = 0; i < LFS_PORT_STATS_MAX_PORTS; i++ )
+    {
+        if( xPorts[ i ].pxCfg == pxCfg )
+        {
+            pxCtx = &( xPorts[ i ] );
+            break;
+        }
+    }
+
+    configASSERT( pxCtx != NULL );
+
+    return pxCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef LFS_THREADSAFE
+
+/* Four buckets per power of two: values below 4 have their own, then the two bits after the msb */
+static uint32_t prvLatBucket( uint32_t ulUs )
+{
+    uint32_t ulBucket = ulUs;
+
+    if( ulUs >= 4U )
+    {
+        uint32_t ulMsb = 31U - ( uint32_t ) __builtin_clz( ulUs );
+
+        ulBucket = ( 4U * ( ulMsb - 1U ) ) + ( ( ulUs >> ( ulMsb - 2U ) ) & 3U );
+    }
+
+    if( ulBucket >= LFS_PORT_STATS_LAT_BUCKETS )
+    {
+        ulBucket = LFS_PORT_STATS_LAT_BUCKETS - 1U;
+    }
+
+    return ulBucket;
+}
+
+/* Largest value counted in a bucket */
+static uint32_t prvLatBucketMax( uint32_t ulBucket )
+{
+    uint32_t ulMax = ulBucket;
+
+    if( ulBucket >= 4U )
+    {
+        uint32_t ulShift = ( ulBucket / 4U ) - 1U;
+
+        ulMax = ( ( ( 4U + ( ulBucket % 4U ) ) << ulShift ) + ( 1U << ulShift ) ) - 1U;
+    }
+
+    return ulMax;
+}
+
+static void prvLatRecord( LfsPortLatHist_t * pxHist,
+                          uint32_t ulUs )
+{
+    pxHist->ulCount++;
+    pxHist->ullTotalUs += ulUs;
+    pxHist->ulBuckets[ prvLatBucket( ulUs ) ]++;
+
+    if( ulUs > pxHist->ulMaxUs )
+    {
+        pxHist->ulMaxUs = ulUs;
+    }
+}
+
+/*
+ * Upper bound of the bucket holding the given per mille rank, within 25% of the exact value.
+ * Clipped to the largest value recorded.
+ */
+static uint32_t prvLatPercentile( const LfsPortLatHist_t * pxHist,
+                                  uint32_t ulPerMille )
+{
+    uint32_t ulRank = ( uint32_t ) ( ( ( ( uint64_t ) pxHist->ulCount * ulPerMille ) + 999U ) / 1000U );
+    uint32_t ulSeen = 0;
+    uint32_t ulUs = 0;
+
+    for( uint32_t ulBucket = 0; ( ulBucket < LFS_PORT_STATS_LAT_BUCKETS ) && ( ulRank > 0 ); ulBucket++ )
+    {
+        ulSeen += pxHist->ulBuckets[ ulBucket ];
+
+        if( ulSeen >= ulRank )
+        {
+            ulUs = prvLatBucketMax( ulBucket );
+            break;
+        }
+    }
+
+    if( ulUs > pxHist->ulMaxUs )
+    {
+        ulUs = pxHist->ulMaxUs;
+    }
+
+    return ulUs;
+}
+
+#endif /* LFS_THREADSAFE */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Account for one completed callback. littlefs serializes calls per configuration through
+ * the lock / unlock callbacks, so the counters of a port are only written by one task at a time.
+ */
+static void prvRecord( LfsPortStatsCtx_t * pxCtx,
+                       LfsPortOp_t xOp,
+                       lfs_block_t xBlock,
+                       uint32_t ulBytes,
+                       uint32_t ulStartCycles,
+                       int lResult )
+{
+    LfsPortOpStats_t * pxOp = &( pxCtx->xOps[ xOp ] );
+    uint32_t ulElapsedUs = prvElapsedUs( ulStartCycles );
+
+    pxOp->ulCalls++;
+    pxOp->ullBytes += ulBytes;
+    pxOp->ullTotalUs += ulElapsedUs;
+
+    if( ulElapsedUs > pxOp->ulMaxUs )
+    {
+        pxOp->ulMaxUs = ulElapsedUs;
+    }
+
+    if( lResult != LFS_ERR_OK )
+    {
+        pxOp->ulErrors++;
+    }
+
+    if( ( xOp != LFS_PORT_OP_SYNC ) &&
+        ( pxCtx->pxSlots != NULL ) )
+    {
+        uint32_t ulSlot = xBlock / pxCtx->ulBlocksPerSlot;
+
+        if( ulSlot < pxCtx->ulNumSlots )
+        {
+            LfsPortSlotStats_t * pxSlot = &( pxCtx->pxSlots[ ulSlot ] );
+
+            pxSlot->ulTotalUs += ulElapsedUs;
+
+            if( pxSlot->usOps < UINT16_MAX )
+            {
+                pxSlot->usOps++;
+            }
+
+            if( ( xOp == LFS_PORT_OP_ERASE ) &&
+                ( pxSlot->usErases < UINT16_MAX ) )
+            {
+                pxSlot->usErases++;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_stats_read( const struct lfs_config * c,
+                                lfs_block_t block,
+                                lfs_off_t off,
+                                void * buffer,
+                                lfs_size_t size )
+{
+    LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+    uint32_t ulStart = prvStartCycles();
+    int lResult = pxCtx->read( c, block, off, buffer, size );
+
+    prvRecord( pxCtx, LFS_PORT_OP_READ, block, size, ulStart, lResult );
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_stats_prog( const struct lfs_config * c,
+                                lfs_block_t block,
+                                lfs_off_t off,
+                                const void * buffer,
+                                lfs_size_t size )
+{
+    LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+    uint32_t ulStart = prvStartCycles();
+    int lResult = pxCtx->prog( c, block, off, buffer, size );
+
+    pxCtx->ulCallWrites++;
+
+    prvRecord( pxCtx, LFS_PORT_OP_PROG, block, size, ulStart, lResult );
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_stats_erase( const struct lfs_config * c,
+                                 lfs_block_t block )
+{
+    LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+    uint32_t ulStart = prvStartCycles();
+    int lResult = pxCtx->erase( c, block );
+
+    pxCtx->ulCallWrites++;
+
+    prvRecord( pxCtx, LFS_PORT_OP_ERASE, block, c->block_size, ulStart, lResult );
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_stats_sync( const struct lfs_config * c )
+{
+    LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+    uint32_t ulStart = prvStartCycles();
+    int lResult = pxCtx->sync( c );
+
+    prvRecord( pxCtx, LFS_PORT_OP_SYNC, 0, 0, ulStart, lResult );
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef LFS_THREADSAFE
+
+/*
+ * The call state is written once the lock is held, the start timestamp is taken before so that
+ * the time spent waiting for another task is counted.
+ */
+    static int lfs_port_stats_lock( const struct lfs_config * c )
+    {
+        LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+        uint32_t ulStart = prvStartCycles();
+        int lResult = pxCtx->lock( c );
+
+        if( lResult == LFS_ERR_OK )
+        {
+            pxCtx->ulCallStart = ulStart;
+            pxCtx->ulCallWrites = 0;
+        }
+
+        return lResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int lfs_port_stats_unlock( const struct lfs_config * c )
+    {
+        LfsPortStatsCtx_t * pxCtx = prvGetCtx( c );
+
+        if( pxCtx->ulCallWrites > 0 )
+        {
+            uint32_t ulElapsedUs = prvElapsedUs( pxCtx->ulCallStart );
+
+            if( ( xBackgroundTask != NULL ) &&
+                ( xTaskGetCurrentTaskHandle() == xBackgroundTask ) )
+            {
+                prvLatRecord( &( pxCtx->xWriteBg ), ulElapsedUs );
+            }
+            else
+            {
+                prvLatRecord( &( pxCtx->xWriteFg ), ulElapsedUs );
+            }
+
+            pxCtx->ulCallWrites = 0;
+        }
+
+        return pxCtx->unlock( c );
+    }
+
+#endif /* LFS_THREADSAFE */
+
+/*-----------------------------------------------------------*/
+
+void vLfsPortStatsAttach( struct lfs_config * pxCfg,
+                          const char * pcName )
+{
+    LfsPortStatsCtx_t * pxCtx = NULL;
+
+    configASSERT( pxCfg != NULL );
+    configASSERT( pxCfg->block_count > 0 );
+
+    for( uint32_t i = 0; i < LFS_PORT_STATS_MAX_PORTS; i++ )
+    {
+        if( ( xPorts[ i ].pxCfg == NULL ) ||
+            ( xPorts[ i ].pxCfg == pxCfg ) )
+        {
+            pxCtx = &( xPorts[ i ] );
+            break;
+        }
+    }
+
+    if( pxCtx == NULL )
+    {
+        LogError( "No free slot to profile littlefs port %s.", pcName );
+    }
+    else if( pxCtx->pxCfg == pxCfg )
+    {
+        LogWarn( "littlefs port %s is already profiled.", pcName );
+    }
+    else
+    {
+        pxCtx->read = pxCfg->read;
+        pxCtx->prog = pxCfg->prog;
+        pxCtx->erase = pxCfg->erase;
+        pxCtx->sync = pxCfg->sync;
+        #ifdef LFS_THREADSAFE
+            pxCtx->lock = pxCfg->lock;
+            pxCtx->unlock = pxCfg->unlock;
+        #endif
+        pxCtx->pcName = pcName;
+
+        pxCtx->ulBlocksPerSlot = ( pxCfg->block_count + LFS_PORT_STATS_MAX_SLOTS - 1 ) / LFS_PORT_STATS_MAX_SLOTS;
+        pxCtx->ulNumSlots = ( pxCfg->block_count + pxCtx->ulBlocksPerSlot - 1 ) / pxCtx->ulBlocksPerSlot;
+        pxCtx->pxSlots = pvPortMalloc( pxCtx->ulNumSlots * sizeof( LfsPortSlotStats_t ) );
+
+        if( pxCtx->pxSlots == NULL )
+        {
+            LogWarn( "Failed to allocate per block statistics for littlefs port %s.", pcName );
+            pxCtx->ulNumSlots = 0;
+        }
+        else
+        {
+            ( void ) memset( pxCtx->pxSlots, 0, pxCtx->ulNumSlots * sizeof( LfsPortSlotStats_t ) );
+        }
+
+        pxCtx->pxCfg = pxCfg;
+
+        pxCfg->read = lfs_port_stats_read;
+        pxCfg->prog = lfs_port_stats_prog;
+        pxCfg->erase = lfs_port_stats_erase;
+        pxCfg->sync = lfs_port_stats_sync;
+        #ifdef LFS_THREADSAFE
+            pxCfg->lock = lfs_port_stats_lock;
+            pxCfg->unlock = lfs_port_stats_unlock;
+        #endif
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulLfsPortStatsMountStart( void )
+{
+    return prvStartCycles();
+}
+
+/*-----------------------------------------------------------*/
+
+void vLfsPortStatsMountDone( const struct lfs_config * pxCfg,
+                             uint32_t ulStart )
+{
+    uint32_t ulElapsedUs = prvElapsedUs( ulStart );
+
+    for( uint32_t i = 0; i < LFS_PORT_STATS_MAX_PORTS; i++ )
+    {
+        if( xPorts[ i ].pxCfg == pxCfg )
+        {
+            xPorts[ i ].ulMountUs = ulElapsedUs;
+            xPorts[ i ].ulMountCount++;
+            break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLfsPortStatsSetBackgroundTask( TaskHandle_t xTask )
+{
+    xBackgroundTask = xTask;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLfsPortStatsReset( void )
+{
+    for( uint32_t i = 0; i < LFS_PORT_STATS_MAX_PORTS; i++ )
+    {
+        LfsPortStatsCtx_t * pxCtx = &( xPorts[ i ] );
+
+        if( pxCtx->pxCfg != NULL )
+        {
+            taskENTER_CRITICAL();
+            {
+                ( void ) memset( pxCtx->xOps, 0, sizeof( pxCtx->xOps ) );
+                ( void ) memset( &( pxCtx->xWriteFg ), 0, sizeof( pxCtx->xWriteFg ) );
+                ( void ) memset( &( pxCtx->xWriteBg ), 0, sizeof( pxCtx->xWriteBg ) );
+
+                if( pxCtx->pxSlots != NULL )
+                {
+                    ( void ) memset( pxCtx->pxSlots, 0, pxCtx->ulNumSlots * sizeof( LfsPortSlotStats_t ) );
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef LFS_THREADSAFE
+
+static void vPrintLatHist( ConsoleIO_t * const pxCIO,
+                           const char * pcName,
+                           const LfsPortLatHist_t * pxHist )
+{
+    uint32_t ulAvgUs = ( pxHist->ulCount > 0 ) ? ( uint32_t ) ( pxHist->ullTotalUs / pxHist->ulCount ) : 0;
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "  %-10s %10lu %10lu %10lu %10lu %10lu\r\n",
+                       pcName,
+                       ( unsigned long ) pxHist->ulCount,
+                       ( unsigned long ) prvLatPercentile( pxHist, 500 ),
+                       ( unsigned long ) prvLatPercentile( pxHist, 990 ),
+                       ( unsigned long ) pxHist->ulMaxUs,
+                       ( unsigned long ) ulAvgUs );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+#endif /* LFS_THREADSAFE */
+
+/*-----------------------------------------------------------*/
+
+static void vPrintPortStats( ConsoleIO_t * const pxCIO,
+                             const LfsPortStatsCtx_t * pxCtx )
+{
+    const struct lfs_config * pxCfg = pxCtx->pxCfg;
+    uint32_t ulHot[ LFS_PORT_STATS_HOT_BLOCKS ];
+    uint32_t ulNumHot = 0;
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "littlefs port: %s\r\n"
+                       "  block_size: %lu block_count: %lu block_cycles: %ld\r\n"
+                       "  read_size: %lu prog_size: %lu cache_size: %lu lookahead_size: %lu\r\n"
+                       "  last mount: %lu us (%lu mounts)\r\n",
+                       pxCtx->pcName,
+                       ( unsigned long ) pxCfg->block_size,
+                       ( unsigned long ) pxCfg->block_count,
+                       ( long ) pxCfg->block_cycles,
+                       ( unsigned long ) pxCfg->read_size,
+                       ( unsigned long ) pxCfg->prog_size,
+                       ( unsigned long ) pxCfg->cache_size,
+                       ( unsigned long ) pxCfg->lookahead_size,
+                       ( unsigned long ) pxCtx->ulMountUs,
+                       ( unsigned long ) pxCtx->ulMountCount );
+    pxCIO->print( pcCliScratchBuffer );
+
+    pxCIO->print( "  op        calls     errors          bytes   total ms     avg us     max us\r\n" );
+
+    for( uint32_t ulOp = 0; ulOp < LFS_PORT_OP_NUM; ulOp++ )
+    {
+        const LfsPortOpStats_t * pxOp = &( pxCtx->xOps[ ulOp ] );
+        uint32_t ulAvgUs = ( pxOp->ulCalls > 0 ) ? ( uint32_t ) ( pxOp->ullTotalUs / pxOp->ulCalls ) : 0;
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "  %-5s %10lu %10lu %14llu %10lu %10lu %10lu\r\n",
+                           pcOpNames[ ulOp ],
+                           ( unsigned long ) pxOp->ulCalls,
+                           ( unsigned long ) pxOp->ulErrors,
+                           ( unsigned long long ) pxOp->ullBytes,
+                           ( unsigned long ) ( pxOp->ullTotalUs / 1000U ),
+                           ( unsigned long ) ulAvgUs,
+                           ( unsigned long ) pxOp->ulMaxUs );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    #ifdef LFS_THREADSAFE
+        pxCIO->print( "  writes          calls     p50 us     p99 us     max us     avg us\r\n" );
+        vPrintLatHist( pxCIO, "foreground", &( pxCtx->xWriteFg ) );
+        vPrintLatHist( pxCIO, "background", &( pxCtx->xWriteBg ) );
+    #endif
+
+    /* Insertion sort of the slots with the most accumulated time */
+    for( uint32_t ulSlot = 0; ulSlot < pxCtx->ulNumSlots; ulSlot++ )
+    {
+        uint32_t ulUs = pxCtx->pxSlots[ ulSlot ].ulTotalUs;
+        uint32_t ulPos = ulNumHot;
+
+        if( ulUs == 0 )
+        {
+            continue;
+        }
+
+        while( ( ulPos > 0 ) &&
+               ( pxCtx->pxSlots[ ulHot[ ulPos - 1 ] ].ulTotalUs < ulUs ) )
+        {
+            if( ulPos < LFS_PORT_STATS_HOT_BLOCKS )
+            {
+                ulHot[ ulPos ] = ulHot[ ulPos - 1 ];
+            }
+
+            ulPos--;
+        }
+
+        if( ulPos < LFS_PORT_STATS_HOT_BLOCKS )
+        {
+            ulHot[ ulPos ] = ulSlot;
+
+            if( ulNumHot < LFS_PORT_STATS_HOT_BLOCKS )
+            {
+                ulNumHot++;
+            }
+        }
+    }
+
+    if( ulNumHot > 0 )
+    {
+        pxCIO->print( "  hot blocks     total us      ops   erases\r\n" );
+    }
+
+    for( uint32_t i = 0; i < ulNumHot; i++ )
+    {
+        const LfsPortSlotStats_t * pxSlot = &( pxCtx->pxSlots[ ulHot[ i ] ] );
+        uint32_t ulFirst = ulHot[ i ] * pxCtx->ulBlocksPerSlot;
+
+        if( pxCtx->ulBlocksPerSlot > 1 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "  %5lu-%-5lu %12lu %8u %8u\r\n",
+                               ( unsigned long ) ulFirst,
+                               ( unsigned long ) ( ulFirst + pxCtx->ulBlocksPerSlot - 1 ),
+                               ( unsigned long ) pxSlot->ulTotalUs,
+                               ( unsigned int ) pxSlot->usOps,
+                               ( unsigned int ) pxSlot->usErases );
+        }
+        else
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "  %11lu %12lu %8u %8u\r\n",
+                               ( unsigned long ) ulFirst,
+                               ( unsigned long ) pxSlot->ulTotalUs,
+                               ( unsigned int ) pxSlot->usOps,
+                               ( unsigned int ) pxSlot->usErases );
+        }
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vFsCommand( ConsoleIO_t * const pxCIO,
+                        uint32_t ulArgc,
+                        char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_fs =
+{
+    "fs",
+    "fs:\r\n"
+    "    Usage:\r\n"
+    "    fs stats\r\n"
+    "        Print call counts, bytes and latency of the littlefs block device callbacks\r\n"
+    "        together with the mount time and the blocks with the most accumulated time.\r\n\n"
+    "    fs stats reset\r\n"
+    "        Reset the littlefs block device statistics.\r\n\n",
+    vFsCommand
+};
+
+static void vFsCommand( ConsoleIO_t * const pxCIO,
+                        uint32_t ulArgc,
+                        char * ppcArgv[] )
+{
+    if( ( ulArgc == 2 ) &&
+        ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        BaseType_t xFound = pdFALSE;
+
+        for( uint32_t i = 0; i < LFS_PORT_STATS_MAX_PORTS; i++ )
+        {
+            if( xPorts[ i ].pxCfg != NULL )
+            {
+                vPrintPortStats( pxCIO, &( xPorts[ i ] ) );
+                xFound = pdTRUE;
+            }
+        }
+
+        if( xFound == pdFALSE )
+        {
+            pxCIO->print( "No littlefs port is being profiled.\r\n" );
+        }
+
+        #if ( LFS_MAINT_ENABLED == 1 )
+        {
+            LfsMaintStats_t xMaint;
+
+            vLfsMaintGetStats( &xMaint );
+
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "maintenance: gc runs: %lu errors: %lu total ms: %lu max ms: %lu last result: %ld\r\n",
+                               ( unsigned long ) xMaint.ulRuns,
+                               ( unsigned long ) xMaint.ulErrors,
+                               ( unsigned long ) xMaint.ulTotalMs,
+                               ( unsigned long ) xMaint.ulMaxMs,
+                               ( long ) xMaint.lLastResult );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        #endif /* LFS_MAINT_ENABLED == 1 */
+    }
+    else if( ( ulArgc == 3 ) &&
+             ( strcmp( "stats", ppcArgv[ 1 ] ) == 0 ) &&
+             ( strcmp( "reset", ppcArgv[ 2 ] ) == 0 ) )
+    {
+        vLfsPortStatsReset();
+        pxCIO->print( "littlefs statistics reset.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_fs.pcHelpString );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLfsPortStatsRegisterCli( void )
+{
+    ( void ) FreeRTOS_CLIRegisterCommand( &xCommandDef_fs );
+}
+
+#endif /* LFS_PORT_STATS_ENABLE */
@@ -0,0 +1,143 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file lfs_port_stats.h
+ * @brief Call, byte and latency statistics for the littlefs block device callbacks.
+ */
+#ifndef _LFS_PORT_STATS_H_
+#define _LFS_PORT_STATS_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lfs.h"
+
+/* Set to 0 to remove the profiling layer from both flash ports */
+#ifndef LFS_PORT_STATS_ENABLE
+#define LFS_PORT_STATS_ENABLE    1
+#endif
+
+/* Number of blocks listed by "fs stats", ordered by accumulated time */
+#ifndef LFS_PORT_STATS_HOT_BLOCKS
+#define LFS_PORT_STATS_HOT_BLOCKS    8
+#endif
+
+/* Size of the per block table. Larger devices track adjacent blocks in a shared slot. */
+#ifndef LFS_PORT_STATS_MAX_SLOTS
+#define LFS_PORT_STATS_MAX_SLOTS     1024
+#endif
+
+/* Maximum number of littlefs configurations which can be profiled at the same time */
+#ifndef LFS_PORT_STATS_MAX_PORTS
+#define LFS_PORT_STATS_MAX_PORTS     2
+#endif
+
+/* Buckets of the write latency histograms, four per power of two up to about 2 s */
+#ifndef LFS_PORT_STATS_LAT_BUCKETS
+#define LFS_PORT_STATS_LAT_BUCKETS    80
+#endif
+
+typedef enum
+{
+    LFS_PORT_OP_READ,
+    LFS_PORT_OP_PROG,
+    LFS_PORT_OP_ERASE,
+    LFS_PORT_OP_SYNC,
+    LFS_PORT_OP_NUM
+} LfsPortOp_t;
+
+typedef struct
+{
+    uint32_t ulCalls;
+    uint32_t ulErrors;
+    uint64_t ullBytes;
+    uint64_t ullTotalUs;
+    uint32_t ulMaxUs;
+} LfsPortOpStats_t;
+
+typedef struct
+{
+    uint32_t ulTotalUs; /* Time spent in all callbacks for this block */
+    uint16_t usOps;     /* Read, prog and erase calls, saturating */
+    uint16_t usErases;  /* Erase calls, saturating */
+} LfsPortSlotStats_t;
+
+/*
+ * Latency of the littlefs calls which programmed or erased the flash, from the lock request to
+ * the unlock, so including the wait for another task and any compaction done on the way.
+ */
+typedef struct
+{
+    uint32_t ulCount;
+    uint32_t ulMaxUs;
+    uint64_t ullTotalUs;
+    uint32_t ulBuckets[ LFS_PORT_STATS_LAT_BUCKETS ];
+} LfsPortLatHist_t;
+
+#if LFS_PORT_STATS_ENABLE
+
+/*
+ * @brief Replace the read, prog, erase and sync callbacks of pxCfg with profiling wrappers.
+ * Must be called after the callbacks are populated and before the filesystem is mounted.
+ * @param pcName Name shown by the "fs stats" command.
+ */
+    void vLfsPortStatsAttach( struct lfs_config * pxCfg,
+                              const char * pcName );
+
+/*
+ * @brief Return a cycle counter timestamp marking the start of a mount.
+ */
+    uint32_t ulLfsPortStatsMountStart( void );
+
+/*
+ * @brief Record the duration of lfs_mount for the given configuration.
+ * @param ulStart Timestamp returned by ulLfsPortStatsMountStart before lfs_mount was called.
+ */
+    void vLfsPortStatsMountDone( const struct lfs_config * pxCfg,
+                                 uint32_t ulStart );
+
+/*
+ * @brief Count the write calls of xTask apart from the others, NULL to stop. Used for the
+ * background maintenance task, whose calls are not seen by the foreground.
+ */
+    void vLfsPortStatsSetBackgroundTask( TaskHandle_t xTask );
+
+/*
+ * @brief Reset all statistics, keeping the attached configurations.
+ */
+    void vLfsPortStatsReset( void );
+
+/*
+ * @brief Register the "fs" CLI command.
+ */
+    void vLfsPortStatsRegisterCli( void );
+
+#endif /* LFS_PORT_STATS_ENABLE */
+
+#endif /* _LFS_PORT_STATS_H_ */
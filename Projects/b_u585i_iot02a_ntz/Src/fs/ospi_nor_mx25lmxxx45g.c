@@ -29,14 +29,117 @@
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_DEBUG
 #include "logging.h"
+#include <string.h>
+
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "static_alloc.h"
 
 #include "ospi_nor_mx25lmxxx45g.h"
+#include "lowpower.h"
+#include "dma_copy.h"
+#include "dvfs.h"
+
+/* Use GPDMA for data phases. Set to 0 to fall back to interrupt driven FIFO transfers. */
+#ifndef OSPI_USE_DMA
+#define OSPI_USE_DMA                  1
+#endif
+
+/* Largest transfer a single GPDMA block can carry */
+#define OSPI_DMA_MAX_LEN              ( 0xFFFFU )
+
+/*
+ * Keep the flash in memory mapped mode while no program or erase is in progress so
+ * that reads are a memcpy from the (DCACHE1 cached) OCTOSPI2 address window.
+ */
+#ifndef OSPI_USE_MEMORY_MAPPED
+#define OSPI_USE_MEMORY_MAPPED        1
+#endif
+
+#define OSPI_MEM_MAPPED_BASE          ( OCTOSPI2_BASE )
+
+/*
+ * Set to 1 to run the flash in 8 bit DTR mode, which moves two bytes per clock. ospi_Init returns
+ * to STR mode if the SFDP header does not read back the same after the delay block calibration.
+ * Off by default until the DTR path has been validated on hardware.
+ */
+#ifndef OSPI_USE_DTR
+#define OSPI_USE_DTR                  0
+#endif
+
+/* SYSCLK dividers, 40 MHz in STR and 80 MHz in DTR mode at HW_CLOCK_LEVEL_HIGH */
+#define OSPI_STR_CLOCK_PRESCALER      ( 4 )
+
+#ifndef OSPI_DTR_CLOCK_PRESCALER
+#define OSPI_DTR_CLOCK_PRESCALER      ( 2 )
+#endif
+
+/* Release nCS after this many idle clock cycles in memory mapped mode */
+#define OSPI_MEM_MAPPED_TIMEOUT       ( 0x34 )
+
+#ifndef OSPI_REQUEST_QUEUE_LEN
+#define OSPI_REQUEST_QUEUE_LEN        ( 8 )
+#endif
+
+#define OSPI_TASK_STACK_SIZE          ( 1024 )
+#define OSPI_TASK_PRIORITY            ( 25 )
+
+/* Interval between status polls while a sector erase is in progress */
+#define OSPI_ERASE_POLL_TICKS         ( pdMS_TO_TICKS( 2 ) )
+
+/* Minimum time an erase is allowed to run after a resume before it may be suspended again */
+#define OSPI_RESUME_HOLDOFF_TICKS     ( 1 )
+
+/* Notification index used to wake a task blocked in one of the synchronous calls */
+#define OSPI_SYNC_NOTIFY_INDEX        ( 1 )
+
+typedef enum
+{
+    OSPI_OP_READ,
+    OSPI_OP_WRITE,
+    OSPI_OP_ERASE
+} OspiOperation_t;
+
+typedef struct
+{
+    OspiOperation_t xOperation;
+    OSPI_HandleTypeDef * pxOSPI;
+    uint32_t ulAddr;
+    void * pvBuffer;
+    uint32_t ulBufferLen;
+    TickType_t xTimeout;
+    OspiCallback_t xCallback;
+    void * pvCtx;
+} OspiRequest_t;
 
 static TaskHandle_t xTaskHandle = NULL;
 static OSPI_HandleTypeDef * s_pxOSPI = NULL;
 
+static QueueHandle_t xRequestQueue = NULL;
+static TaskHandle_t xDriverTaskHandle = NULL;
+
+/* Requests received while an erase was in progress which could not be serviced during a suspend */
+static OspiRequest_t xDeferredRequests[ OSPI_REQUEST_QUEUE_LEN ];
+static uint32_t ulDeferredCount = 0;
+
+#if OSPI_USE_DMA
+static DMA_HandleTypeDef xDmaHandle = { 0 };
+#endif
+
+#if OSPI_USE_MEMORY_MAPPED
+/* Guards xMemoryMapped. Held by readers for the duration of a memory mapped copy. */
+static SemaphoreHandle_t xMemMapMutex = NULL;
+static volatile BaseType_t xMemoryMapped = pdFALSE;
+
+/* Set when the flash contents changed since DCACHE1 was last invalidated */
+static BaseType_t xCacheStale = pdFALSE;
+#endif
+
+/* The flash and the OCTOSPI are in 8 bit DTR mode */
+static BaseType_t xDtrMode = pdFALSE;
+
 static inline void ospi_HandleCallback( OSPI_HandleTypeDef * pxOSPI,
                                         HAL_OSPI_CallbackIDTypeDef xCallbackId )
 {
@@ -97,6 +200,9 @@ static BaseType_t ospi_WaitForCallback( HAL_OSPI_CallbackIDTypeDef xCallbackID,
 
     vTaskSetTimeOutState( &xTimeOut );
 
+    /* The OCTOSPI stops in STOP2 */
+    vLowPowerInhibit();
+
     while( ulNotifyValue != xCallbackID )
     {
         ( void ) xTaskNotifyWaitIndexed( 1, 0x0, 0xFFFFFFFF, &ulNotifyValue, xRemainingTicks );
@@ -108,6 +214,8 @@ static BaseType_t ospi_WaitForCallback( HAL_OSPI_CallbackIDTypeDef xCallbackID,
         }
     }
 
+    vLowPowerRelease();
+
     return( ulNotifyValue == xCallbackID );
 }
 
@@ -123,6 +231,13 @@ static void ospi_IRQHandler( void )
     HAL_OSPI_IRQHandler( s_pxOSPI );
 }
 
+#if OSPI_USE_DMA
+    static void ospi_DmaIRQHandler( void )
+    {
+        HAL_DMA_IRQHandler( &xDmaHandle );
+    }
+#endif
+
 /* Initialize static variables for the current operation */
 static inline void ospi_OpInit( OSPI_HandleTypeDef * pxOSPI )
 {
@@ -241,7 +356,7 @@ static BaseType_t ospi_InitDriver( OSPI_HandleTypeDef * pxOSPI )
     pxOSPI->Init.FreeRunningClock = HAL_OSPI_FREERUNCLK_ENABLE;
     pxOSPI->Init.ClockMode = HAL_OSPI_CLOCK_MODE_0;
     pxOSPI->Init.WrapSize = HAL_OSPI_WRAP_NOT_SUPPORTED;
-    pxOSPI->Init.ClockPrescaler = 4;
+    pxOSPI->Init.ClockPrescaler = OSPI_STR_CLOCK_PRESCALER;
     pxOSPI->Init.SampleShifting = HAL_OSPI_SAMPLE_SHIFTING_NONE;
     pxOSPI->Init.DelayHoldQuarterCycle = HAL_OSPI_DHQC_ENABLE;
     pxOSPI->Init.ChipSelectBoundary = 0;
@@ -267,6 +382,47 @@ static BaseType_t ospi_InitDriver( OSPI_HandleTypeDef * pxOSPI )
         return pdFALSE;
     }
 
+#if OSPI_USE_DMA
+    /* The direction is reprogrammed by the HAL on each Transmit_DMA / Receive_DMA call */
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    xDmaHandle.Instance = GPDMA1_Channel12;
+    xDmaHandle.Init.Request = GPDMA1_REQUEST_OCTOSPI2;
+    xDmaHandle.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    xDmaHandle.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    xDmaHandle.Init.SrcInc = DMA_SINC_FIXED;
+    xDmaHandle.Init.DestInc = DMA_DINC_INCREMENTED;
+    xDmaHandle.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+    xDmaHandle.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+    xDmaHandle.Init.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+    xDmaHandle.Init.SrcBurstLength = 1;
+    xDmaHandle.Init.DestBurstLength = 1;
+    xDmaHandle.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    xDmaHandle.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    xDmaHandle.Init.Mode = DMA_NORMAL;
+
+    xHalStatus = HAL_DMA_Init( &xDmaHandle );
+
+    if( xHalStatus == HAL_OK )
+    {
+        xHalStatus = HAL_DMA_ConfigChannelAttributes( &xDmaHandle, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xHalStatus != HAL_OK )
+    {
+        LogError( "Error while Initializing OSPI DMA channel." );
+        return pdFALSE;
+    }
+
+    __HAL_LINKDMA( pxOSPI, hdma, xDmaHandle );
+
+    /* Set the vector, requires sram located vector table */
+    NVIC_SetVector( GPDMA1_Channel12_IRQn, ( uint32_t ) ospi_DmaIRQHandler );
+
+    HAL_NVIC_SetPriority( GPDMA1_Channel12_IRQn, 5, 0 );
+    HAL_NVIC_EnableIRQ( GPDMA1_Channel12_IRQn );
+#endif /* OSPI_USE_DMA */
+
     /* Register additional callbacks */
     xHalStatus = HAL_OSPI_RegisterCallback( pxOSPI, HAL_OSPI_RX_CPLT_CB_ID, ospi_RxCpltCallback );
     xHalStatus &= HAL_OSPI_RegisterCallback( pxOSPI, HAL_OSPI_TX_CPLT_CB_ID, ospi_TxCpltCallback );
@@ -344,8 +500,54 @@ static void ospi_AbortTransaction( OSPI_HandleTypeDef * pxOSPI,
     ( void ) ospi_WaitForCallback( HAL_OSPI_ABORT_CB_ID, xTimeout );
 }
 
-static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
-                                     TickType_t xTimeout )
+/*
+ * Commands are written for STR mode. In DTR mode every phase is double rated, 8READ becomes
+ * 8DTRD, register reads take one more dummy cycle and return each byte twice, and read data
+ * is sampled on DQS.
+ */
+static void ospi_OPI_ApplyMode( OSPI_RegularCmdTypeDef * pxCmd )
+{
+    if( xDtrMode == pdTRUE )
+    {
+        pxCmd->InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_ENABLE;
+
+        if( pxCmd->AddressMode != HAL_OSPI_ADDRESS_NONE )
+        {
+            pxCmd->AddressDtrMode = HAL_OSPI_ADDRESS_DTR_ENABLE;
+        }
+
+        if( pxCmd->DataMode != HAL_OSPI_DATA_NONE )
+        {
+            pxCmd->DataDtrMode = HAL_OSPI_DATA_DTR_ENABLE;
+        }
+
+        if( pxCmd->Instruction == MX25LM_OPI_8READ )
+        {
+            pxCmd->Instruction = MX25LM_OPI_8DTRD;
+        }
+
+        if( pxCmd->Instruction == MX25LM_OPI_RDSR )
+        {
+            pxCmd->DummyCycles = MX25LM_REG_DUMMY_CYCLES_DTR;
+            pxCmd->NbData = 2;
+        }
+
+        if( ( pxCmd->DataMode != HAL_OSPI_DATA_NONE ) &&
+            ( pxCmd->Instruction != MX25LM_OPI_PP ) )
+        {
+            pxCmd->DQSMode = HAL_OSPI_DQS_ENABLE;
+        }
+        else
+        {
+            pxCmd->DQSMode = HAL_OSPI_DQS_DISABLE;
+        }
+    }
+}
+
+/* Send an OPI instruction which has no address or data phase */
+static BaseType_t ospi_cmd_OPI_Instruction( OSPI_HandleTypeDef * pxOSPI,
+                                            uint32_t ulInstruction,
+                                            TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
@@ -355,7 +557,7 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
         .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
         .FlashId            = HAL_OSPI_FLASH_ID_1,
 
-        .Instruction        = MX25LM_OPI_WREN,
+        .Instruction        = ulInstruction,
         .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
         .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
         .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
@@ -371,6 +573,8 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
         .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
     };
 
+    ospi_OPI_ApplyMode( &xCmd );
+
     /* Clear notification state */
     ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
@@ -390,6 +594,63 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
     return( xSuccess );
 }
 
+static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
+                                     TickType_t xTimeout )
+{
+    return ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_WREN, xTimeout );
+}
+
+/* Read the status register once */
+static BaseType_t ospi_OPI_ReadStatus( OSPI_HandleTypeDef * pxOSPI,
+                                       uint8_t * pucStatus,
+                                       TickType_t xTimeout )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+    /* DTR mode returns the register twice */
+    uint8_t ucStatus[ 2 ] = { 0xFF, 0xFF };
+
+    OSPI_RegularCmdTypeDef xCmd =
+    {
+        .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
+        .FlashId            = HAL_OSPI_FLASH_ID_1,
+
+        .Instruction        = MX25LM_OPI_RDSR,
+        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+        .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
+        .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
+
+        .Address            = 0x00000000,                   /* Address = 0 for RDSR */
+        .AddressMode        = HAL_OSPI_ADDRESS_8_LINES,
+        .AddressSize        = HAL_OSPI_ADDRESS_32_BITS,
+        .AddressDtrMode     = HAL_OSPI_DATA_DTR_DISABLE,
+
+        .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+
+        .DataMode           = HAL_OSPI_DATA_8_LINES,
+        .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
+        .NbData             = 1,                            /* RDSR reg is 1 byte of data */
+
+        .DummyCycles        = MX25LM_REG_DUMMY_CYCLES_STR,  /* PM2357 R1.1 pg 23, Note 5 => 4 dummy cycles */
+        .DQSMode            = HAL_OSPI_DQS_DISABLE,
+        .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
+    };
+
+    ospi_OPI_ApplyMode( &xCmd );
+
+    xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
+
+    if( xHalStatus == HAL_OK )
+    {
+        /* A single byte is not worth an interrupt round trip */
+        xHalStatus = HAL_OSPI_Receive( pxOSPI, ucStatus, xTimeout );
+    }
+
+    *pucStatus = ucStatus[ 0 ];
+
+    return( xHalStatus == HAL_OK );
+}
+
 static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
                                           uint32_t ulMask,
                                           uint32_t ulMatch,
@@ -420,11 +681,13 @@ static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
         .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
         .NbData             = 1,                            /* RDSR reg is 1 byte of data */
 
-        .DummyCycles        = 4,                            /* PM2357 R1.1 pg 23, Note 5 => 4 dummy cycles */
+        .DummyCycles        = MX25LM_REG_DUMMY_CYCLES_STR,  /* PM2357 R1.1 pg 23, Note 5 => 4 dummy cycles */
         .DQSMode            = HAL_OSPI_DQS_DISABLE,
         .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
     };
 
+    ospi_OPI_ApplyMode( &xCmd );
+
     /* Send command */
     xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
 
@@ -538,16 +801,17 @@ static BaseType_t ospi_SPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
 }
 
 
-/* send Write enable command (WREN) in SPI mode */
-static BaseType_t ospi_cmd_SPI_WREN( OSPI_HandleTypeDef * pxOSPI,
-                                     TickType_t xTimeout )
+/* Send a SPI instruction which has no address or data phase */
+static BaseType_t ospi_cmd_SPI_Instruction( OSPI_HandleTypeDef * pxOSPI,
+                                            uint32_t ulInstruction,
+                                            TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
     OSPI_RegularCmdTypeDef xCmd =
     {
         .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
         .FlashId            = HAL_OSPI_FLASH_ID_1,
-        .Instruction        = MX25LM_SPI_WREN,
+        .Instruction        = ulInstruction,
         .InstructionMode    = HAL_OSPI_INSTRUCTION_1_LINE,
         .InstructionSize    = HAL_OSPI_INSTRUCTION_8_BITS,
         .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
@@ -579,6 +843,13 @@ static BaseType_t ospi_cmd_SPI_WREN( OSPI_HandleTypeDef * pxOSPI,
     return( xHalStatus == HAL_OK );
 }
 
+/* send Write enable command (WREN) in SPI mode */
+static BaseType_t ospi_cmd_SPI_WREN( OSPI_HandleTypeDef * pxOSPI,
+                                     TickType_t xTimeout )
+{
+    return ospi_cmd_SPI_Instruction( pxOSPI, MX25LM_SPI_WREN, xTimeout );
+}
+
 
 /*
  * Switch flash from 1 bit SPI mode to 8 bit STR mode (single bit per clock)
@@ -632,102 +903,22 @@ static BaseType_t ospi_cmd_SPI_8BitSTRMode( OSPI_HandleTypeDef * pxOSPI,
 
 
 
-/*
- * @Brief Initialize octospi flash controller and related peripherals
- */
-BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI )
-{
-    BaseType_t xSuccess = pdTRUE;
-
-    ospi_OpInit( pxOSPI );
-
-    xSuccess = ospi_InitDriver( pxOSPI );
-
-    if( xSuccess != pdTRUE )
-    {
-        LogError( "Failed to initialize ospi driver." );
-    }
-    else
-    {
-        /* Set Write enable bit */
-        xSuccess = ospi_cmd_SPI_WREN( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
-    }
-
-    if( xSuccess != pdTRUE )
-    {
-        LogError( "Failed to send WREN command." );
-    }
-    else
-    {
-        xSuccess = ospi_SPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
-                                           MX25LM_REG_SR_WEL,
-                                           MX25LM_DEFAULT_TIMEOUT_MS );
-    }
-
-    if( xSuccess != pdTRUE )
-    {
-        LogError( "Timed out while waiting for write enable." );
-    }
-    else
-    {
-        /* Enter 8 bit data mode */
-        xSuccess = ospi_cmd_SPI_8BitSTRMode( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
-    }
-
-    if( xSuccess != pdTRUE )
-    {
-        LogError( "Failed to set data mode to 8Bit STR." );
-    }
-    else
-    {
-        /* Wait for WEL and WIP bits to clear */
-        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
-                                           0x0,
-                                           MX25LM_DEFAULT_TIMEOUT_MS );
-    }
 
-    return xSuccess;
-}
 
-BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
-                          uint32_t ulAddr,
-                          void * pxBuffer,
-                          uint32_t ulBufferLen,
-                          TickType_t xTimeout )
+/*
+ * Read with the given OPI read instruction once the device is idle. In DTR mode ulAddr and
+ * ulBufferLen must be even.
+ */
+static BaseType_t ospi_OPI_Read( OSPI_HandleTypeDef * pxOSPI,
+                                 uint32_t ulInstruction,
+                                 uint32_t ulAddr,
+                                 void * pxBuffer,
+                                 uint32_t ulBufferLen,
+                                 TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
 
-    ospi_OpInit( pxOSPI );
-
-    if( pxOSPI == NULL )
-    {
-        xSuccess = pdFALSE;
-        LogError( "pxOSPI is NULL." );
-    }
-
-    if( ulAddr >= MX25LM_MEM_SZ_BYTES )
-    {
-        xSuccess = pdFALSE;
-        LogError( "Address is out of range." );
-    }
-
-    if( pxBuffer == NULL )
-    {
-        xSuccess = pdFALSE;
-        LogError( "pxBuffer is NULL." );
-    }
-
-    if( ulBufferLen == 0 )
-    {
-        xSuccess = pdFALSE;
-        LogError( "ulBufferLen is 0." );
-    }
-
-    /*TODO is there a limit to the number of bytes read? */
-
     /* Wait for idle condition (WIP bit should be 0) */
     xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                        MX25LM_REG_SR_WIP,
@@ -739,7 +930,8 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
         ospi_AbortTransaction( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
         LogError( "Timed out while waiting for OSPI IDLE condition." );
     }
-    else
+
+    if( xSuccess == pdTRUE )
     {
         /* Setup an 8READ transaction */
         OSPI_RegularCmdTypeDef xCmd =
@@ -747,7 +939,7 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
             .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
             .FlashId            = HAL_OSPI_FLASH_ID_1,
 
-            .Instruction        = MX25LM_OPI_8READ,
+            .Instruction        = ulInstruction,
             .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
             .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
             .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
@@ -768,6 +960,8 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
             .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
         };
 
+        ospi_OPI_ApplyMode( &xCmd );
+
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
@@ -778,7 +972,7 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
         {
             xSuccess = pdFALSE;
             ospi_AbortTransaction( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
-            LogError( "Failed to send 8READ command." );
+            LogError( "Failed to send read command 0x%04lX.", ulInstruction );
         }
     }
 
@@ -787,63 +981,124 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
-        xHalStatus = HAL_OSPI_Receive_IT( pxOSPI, pxBuffer );
+#if OSPI_USE_DMA
+        if( ulBufferLen <= OSPI_DMA_MAX_LEN )
+        {
+            xHalStatus = HAL_OSPI_Receive_DMA( pxOSPI, pxBuffer );
+        }
+        else
+#endif
+        {
+            xHalStatus = HAL_OSPI_Receive_IT( pxOSPI, pxBuffer );
+        }
 
         /* Wait for receive op to complete */
         if( xHalStatus == HAL_OK )
         {
             xSuccess = ospi_WaitForCallback( HAL_OSPI_RX_CPLT_CB_ID, xTimeout );
         }
+        else
+        {
+            xSuccess = pdFALSE;
+        }
+
+        if( xSuccess != pdTRUE )
+        {
+            ospi_AbortTransaction( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+        }
     }
 
     return( xSuccess );
 }
 
-/*
- * @Brief write up to 256 bytes to the given address.
- */
-BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
-                           uint32_t ulAddr,
-                           const void * pxBuffer,
-                           uint32_t ulBufferLen,
-                           TickType_t xTimeout )
+static BaseType_t ospi_DoRead( OSPI_HandleTypeDef * pxOSPI,
+                               uint32_t ulAddr,
+                               void * pxBuffer,
+                               uint32_t ulBufferLen,
+                               TickType_t xTimeout )
 {
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
-
-    ospi_OpInit( pxOSPI );
+    uint8_t * pucBuffer = ( uint8_t * ) pxBuffer;
 
     if( pxOSPI == NULL )
     {
         xSuccess = pdFALSE;
+        LogError( "pxOSPI is NULL." );
     }
 
-    if( ( ulBufferLen > 256 ) ||
-        ( ulBufferLen == 0 ) )
+    if( ulAddr >= MX25LM_MEM_SZ_BYTES )
     {
         xSuccess = pdFALSE;
+        LogError( "Address is out of range." );
     }
 
     if( pxBuffer == NULL )
     {
         xSuccess = pdFALSE;
+        LogError( "pxBuffer is NULL." );
     }
 
-    if( xSuccess == pdTRUE )
+    if( ulBufferLen == 0 )
     {
-        /* Wait for idle condition (WIP bit should be 0) */
-        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP,
-                                           0x0,
-                                           xTimeout );
+        xSuccess = pdFALSE;
+        LogError( "ulBufferLen is 0." );
     }
 
-    if( xSuccess == pdTRUE )
+    /*TODO is there a limit to the number of bytes read? */
+
+    /* DTR reads move byte pairs from an even address, read the pair around an odd first or last byte */
+    if( ( xSuccess == pdTRUE ) &&
+        ( xDtrMode == pdTRUE ) &&
+        ( ( ulAddr & 1U ) != 0 ) )
     {
-        /* Enable write */
-        xSuccess = ospi_cmd_OPI_WREN( pxOSPI, xTimeout );
+        uint8_t ucPair[ 2 ];
+
+        xSuccess = ospi_OPI_Read( pxOSPI, MX25LM_OPI_8READ, ulAddr - 1U, ucPair, 2, xTimeout );
+
+        pucBuffer[ 0 ] = ucPair[ 1 ];
+        pucBuffer++;
+        ulAddr++;
+        ulBufferLen--;
+    }
+
+    if( ( xSuccess == pdTRUE ) &&
+        ( xDtrMode == pdTRUE ) &&
+        ( ( ulBufferLen & 1U ) != 0 ) )
+    {
+        uint8_t ucPair[ 2 ];
+
+        ulBufferLen--;
+
+        xSuccess = ospi_OPI_Read( pxOSPI, MX25LM_OPI_8READ, ulAddr + ulBufferLen, ucPair, 2, xTimeout );
+
+        pucBuffer[ ulBufferLen ] = ucPair[ 0 ];
+    }
+
+    if( ( xSuccess == pdTRUE ) &&
+        ( ulBufferLen > 0 ) )
+    {
+        xSuccess = ospi_OPI_Read( pxOSPI, MX25LM_OPI_8READ, ulAddr, pucBuffer, ulBufferLen, xTimeout );
     }
 
+    return( xSuccess );
+}
+
+/*
+ * @Brief Program a single page. ulAddr to ulAddr + ulBufferLen must not cross a page boundary
+ * and the device must be idle.
+ */
+static BaseType_t ospi_ProgramPage( OSPI_HandleTypeDef * pxOSPI,
+                                    uint32_t ulAddr,
+                                    const uint8_t * pucBuffer,
+                                    uint32_t ulBufferLen,
+                                    TickType_t xTimeout )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    BaseType_t xSuccess = pdTRUE;
+
+    /* Enable write */
+    xSuccess = ospi_cmd_OPI_WREN( pxOSPI, xTimeout );
+
     /* Wait for Write Enable Latch */
     if( xSuccess == pdTRUE )
     {
@@ -882,6 +1137,8 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
             .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
         };
 
+        ospi_OPI_ApplyMode( &xCmd );
+
         /* Send command */
         xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
     }
@@ -889,7 +1146,8 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
     /* Clear notification state */
     ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
-    if( xHalStatus != HAL_OK )
+    if( ( xHalStatus != HAL_OK ) ||
+        ( xSuccess != pdTRUE ) )
     {
         xSuccess = pdFALSE;
     }
@@ -897,42 +1155,118 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
     {
         #pragma GCC diagnostic push
         #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-        xHalStatus = HAL_OSPI_Transmit_IT( pxOSPI, pxBuffer );
+        #if OSPI_USE_DMA
+            xHalStatus = HAL_OSPI_Transmit_DMA( pxOSPI, pucBuffer );
+        #else
+            xHalStatus = HAL_OSPI_Transmit_IT( pxOSPI, pucBuffer );
+        #endif
         #pragma GCC diagnostic pop
+
+        if( xHalStatus != HAL_OK )
+        {
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            xSuccess = ospi_WaitForCallback( HAL_OSPI_TX_CPLT_CB_ID, xTimeout );
+        }
     }
 
-    if( xHalStatus != HAL_OK )
+    if( xSuccess == pdTRUE )
+    {
+        /*
+         * WEL stays set until the program completes, so polling can start as soon as
+         * the data phase is done. This also serves as the idle check for the next page.
+         */
+        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
+                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
+                                           0x0,
+                                           xTimeout );
+    }
+
+    return xSuccess;
+}
+
+/*
+ * @Brief write ulBufferLen bytes to the given address, one page program per MX25LM page.
+ */
+static BaseType_t ospi_DoWrite( OSPI_HandleTypeDef * pxOSPI,
+                                uint32_t ulAddr,
+                                const void * pxBuffer,
+                                uint32_t ulBufferLen,
+                                TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    if( pxOSPI == NULL )
     {
         xSuccess = pdFALSE;
     }
-    else
+
+    if( ( ulBufferLen == 0 ) ||
+        ( ulAddr >= MX25LM_MEM_SZ_BYTES ) ||
+        ( ulBufferLen > ( MX25LM_MEM_SZ_BYTES - ulAddr ) ) )
     {
-        xSuccess = ospi_WaitForCallback( HAL_OSPI_TX_CPLT_CB_ID, xTimeout );
+        xSuccess = pdFALSE;
     }
 
-    if( xSuccess == pdTRUE )
+    if( pxBuffer == NULL )
     {
-        vTaskDelay( 1 );
+        xSuccess = pdFALSE;
+    }
+
+    /* DTR programs byte pairs, littlefs only writes whole prog_size units */
+    if( ( xDtrMode == pdTRUE ) &&
+        ( ( ( ulAddr | ulBufferLen ) & 1U ) != 0 ) )
+    {
+        LogError( "Unaligned write of %lu bytes at 0x%08lX in DTR mode.", ulBufferLen, ulAddr );
+        xSuccess = pdFALSE;
+    }
 
+    if( xSuccess == pdTRUE )
+    {
         /* Wait for idle condition (WIP bit should be 0) */
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
+                                           MX25LM_REG_SR_WIP,
                                            0x0,
                                            xTimeout );
     }
 
+    for( uint32_t ulOffset = 0; ( xSuccess == pdTRUE ) && ( ulOffset < ulBufferLen ); )
+    {
+        uint32_t ulPageAddr = ulAddr + ulOffset;
+        uint32_t ulChunkLen = MX25LM_PROGRAM_FIFO_LEN - ( ulPageAddr % MX25LM_PROGRAM_FIFO_LEN );
+
+        if( ulChunkLen > ( ulBufferLen - ulOffset ) )
+        {
+            ulChunkLen = ulBufferLen - ulOffset;
+        }
+
+        xSuccess = ospi_ProgramPage( pxOSPI, ulPageAddr,
+                                     &( ( ( const uint8_t * ) pxBuffer )[ ulOffset ] ),
+                                     ulChunkLen, xTimeout );
+
+        if( xSuccess != pdTRUE )
+        {
+            LogError( "Failed to program page at address 0x%08lX.", ulPageAddr );
+        }
+
+        ulOffset += ulChunkLen;
+    }
+
     return xSuccess;
 }
 
-BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
-                             uint32_t ulAddr,
-                             TickType_t xTimeout )
+/*
+ * @Brief Issue a sector erase command and return without waiting for the erase to complete.
+ */
+static BaseType_t ospi_StartEraseSector( OSPI_HandleTypeDef * pxOSPI,
+                                         uint32_t ulAddr,
+                                         TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
 
-    ospi_OpInit( pxOSPI );
-
     if( pxOSPI == NULL )
     {
         xSuccess = pdFALSE;
@@ -997,31 +1331,950 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
             .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
         };
 
+        ospi_OPI_ApplyMode( &xCmd );
+
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
         /* Send command */
         xHalStatus = HAL_OSPI_Command_IT( pxOSPI, &xCmd );
+
+        if( xHalStatus != HAL_OK )
+        {
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            xSuccess = ospi_WaitForCallback( HAL_OSPI_CMD_CPLT_CB_ID, xTimeout );
+        }
     }
 
-    if( xHalStatus != HAL_OK )
+    return( xSuccess );
+}
+
+/*
+ * Returns pdTRUE if the given request is a read which can be serviced while the
+ * erase of the sector containing ulEraseAddr is suspended.
+ */
+static BaseType_t ospi_CanReadDuringErase( const OspiRequest_t * pxRequest,
+                                           uint32_t ulEraseAddr )
+{
+    uint32_t ulSectorStart = ulEraseAddr & ~( MX25LM_SECTOR_SZ - 1 );
+    uint32_t ulSectorEnd = ulSectorStart + MX25LM_SECTOR_SZ;
+    BaseType_t xResult = pdFALSE;
+
+    if( pxRequest->xOperation == OSPI_OP_READ )
     {
-        xSuccess = pdFALSE;
+        /* Data within the sector being erased is undefined while the erase is suspended */
+        xResult = ( ( pxRequest->ulAddr >= ulSectorEnd ) ||
+                    ( ( pxRequest->ulAddr + pxRequest->ulBufferLen ) <= ulSectorStart ) );
     }
-    else
+
+    return xResult;
+}
+
+static void ospi_CompleteRequest( const OspiRequest_t * pxRequest,
+                                  BaseType_t xSuccess )
+{
+    if( pxRequest->xCallback != NULL )
     {
-        xSuccess = ospi_WaitForCallback( HAL_OSPI_CMD_CPLT_CB_ID, xTimeout );
+        pxRequest->xCallback( xSuccess, pxRequest->pvCtx );
     }
+}
+
+/*
+ * Suspend the ongoing erase, service pxRequest and any other reads waiting in the
+ * queue which do not target the sector being erased, then resume the erase.
+ * Returns pdFALSE if the erase could not be resumed.
+ */
+static BaseType_t ospi_ReadDuringErase( OSPI_HandleTypeDef * pxOSPI,
+                                        const OspiRequest_t * pxRequest,
+                                        uint32_t ulEraseAddr )
+{
+    BaseType_t xSuccess;
+    OspiRequest_t xRequest = *pxRequest;
+
+    xSuccess = ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_PES, MX25LM_DEFAULT_TIMEOUT_MS );
 
     if( xSuccess == pdTRUE )
     {
-        vTaskDelay( 1 );
-        /* Wait for idle condition (WIP bit should be 0) */
+        /* WIP drops once the device has entered the suspended state */
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WEL | MX25LM_REG_SR_WIP,
+                                           MX25LM_REG_SR_WIP,
                                            0x0,
-                                           xTimeout );
+                                           pdMS_TO_TICKS( MX25LM_SUSPEND_TIMEOUT_MS ) );
+    }
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Failed to suspend erase operation." );
+
+        /* Retry the read once the erase has completed */
+        xDeferredRequests[ ulDeferredCount ] = xRequest;
+        ulDeferredCount++;
+    }
+    else
+    {
+        BaseType_t xMoreReads = pdTRUE;
+
+        while( xMoreReads == pdTRUE )
+        {
+            BaseType_t xReadSuccess = ospi_DoRead( pxOSPI, xRequest.ulAddr, xRequest.pvBuffer,
+                                                   xRequest.ulBufferLen, xRequest.xTimeout );
+
+            ospi_CompleteRequest( &xRequest, xReadSuccess );
+
+            /* Batch any further compatible reads into the same suspend window */
+            xMoreReads = ( xQueuePeek( xRequestQueue, &xRequest, 0 ) == pdTRUE ) &&
+                         ( ospi_CanReadDuringErase( &xRequest, ulEraseAddr ) == pdTRUE );
+
+            if( xMoreReads == pdTRUE )
+            {
+                ( void ) xQueueReceive( xRequestQueue, &xRequest, 0 );
+            }
+        }
+    }
+
+    /* Resume is ignored by the device if the erase completed before it was suspended */
+    xSuccess = ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_PER, MX25LM_DEFAULT_TIMEOUT_MS );
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Failed to resume erase operation." );
+    }
+
+    /* Give the erase time to make progress before it can be suspended again */
+    vTaskDelay( OSPI_RESUME_HOLDOFF_TICKS );
+
+    return xSuccess;
+}
+
+/*
+ * Erase a sector, servicing reads of other sectors while the erase is in progress.
+ */
+static BaseType_t ospi_DoEraseSector( OSPI_HandleTypeDef * pxOSPI,
+                                      uint32_t ulAddr,
+                                      TickType_t xTimeout )
+{
+    BaseType_t xSuccess = ospi_StartEraseSector( pxOSPI, ulAddr, xTimeout );
+    BaseType_t xComplete = pdFALSE;
+    TickType_t xRemainingTicks = xTimeout;
+    TimeOut_t xTimeOut;
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    if( xSuccess == pdTRUE )
+    {
+        vTaskDelay( 1 );
+    }
+
+    while( ( xSuccess == pdTRUE ) &&
+           ( xComplete == pdFALSE ) )
+    {
+        uint8_t ucStatus = 0xFF;
+        OspiRequest_t xRequest;
+
+        if( ulDeferredCount < OSPI_REQUEST_QUEUE_LEN )
+        {
+            if( xQueueReceive( xRequestQueue, &xRequest, OSPI_ERASE_POLL_TICKS ) == pdTRUE )
+            {
+                if( ospi_CanReadDuringErase( &xRequest, ulAddr ) == pdTRUE )
+                {
+                    xSuccess = ospi_ReadDuringErase( pxOSPI, &xRequest, ulAddr );
+                }
+                else
+                {
+                    xDeferredRequests[ ulDeferredCount ] = xRequest;
+                    ulDeferredCount++;
+                }
+            }
+        }
+        else
+        {
+            vTaskDelay( OSPI_ERASE_POLL_TICKS );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_OPI_ReadStatus( pxOSPI, &ucStatus, MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        if( xSuccess != pdTRUE )
+        {
+            LogError( "Error while waiting for erase of address 0x%08lX to complete.", ulAddr );
+        }
+        else if( ( ucStatus & ( MX25LM_REG_SR_WEL | MX25LM_REG_SR_WIP ) ) == 0x0 )
+        {
+            xComplete = pdTRUE;
+        }
+        else if( xTaskCheckForTimeOut( &xTimeOut, &xRemainingTicks ) == pdTRUE )
+        {
+            LogError( "Timed out while erasing address 0x%08lX.", ulAddr );
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            /* Erase still in progress */
+        }
     }
 
     return( xSuccess );
 }
+
+#if OSPI_USE_MEMORY_MAPPED
+
+/*
+ * Configure the read (8READ) and write (PP) commands used by the OCTOSPI in memory
+ * mapped mode and enable it. Must be called from the driver task.
+ */
+    static BaseType_t ospi_EnterMemoryMapped( OSPI_HandleTypeDef * pxOSPI )
+    {
+        HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+        OSPI_RegularCmdTypeDef xCmd =
+        {
+            .OperationType      = HAL_OSPI_OPTYPE_READ_CFG,
+            .FlashId            = HAL_OSPI_FLASH_ID_1,
+
+            .Instruction        = MX25LM_OPI_8READ,
+            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+            .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
+            .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
+
+            .AddressMode        = HAL_OSPI_ADDRESS_8_LINES,
+            .AddressSize        = HAL_OSPI_ADDRESS_32_BITS,
+            .AddressDtrMode     = HAL_OSPI_DATA_DTR_DISABLE,
+
+            .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+
+            .DataMode           = HAL_OSPI_DATA_8_LINES,
+            .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
+
+            .DummyCycles        = MX25LM_8READ_DUMMY_CYCLES,
+            .DQSMode            = HAL_OSPI_DQS_DISABLE,
+            .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
+        };
+
+        OSPI_MemoryMappedTypeDef xMemMappedCfg =
+        {
+            .TimeOutActivation = HAL_OSPI_TIMEOUT_COUNTER_ENABLE,
+            .TimeOutPeriod     = OSPI_MEM_MAPPED_TIMEOUT,
+        };
+
+        ospi_OPI_ApplyMode( &xCmd );
+
+        xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, MX25LM_DEFAULT_TIMEOUT_MS );
+
+        /* The HAL requires both a read and a write configuration before entering memory mapped mode */
+        if( xHalStatus == HAL_OK )
+        {
+            xCmd.OperationType = HAL_OSPI_OPTYPE_WRITE_CFG;
+            xCmd.Instruction = MX25LM_OPI_PP;
+            xCmd.DummyCycles = 0;
+
+            ospi_OPI_ApplyMode( &xCmd );
+
+            xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        /* Drop any lines cached before the last program or erase */
+        if( ( xHalStatus == HAL_OK ) &&
+            ( xCacheStale == pdTRUE ) &&
+            ( pxHndlDCache != NULL ) )
+        {
+            xHalStatus = HAL_DCACHE_Invalidate( pxHndlDCache );
+        }
+
+        if( xHalStatus == HAL_OK )
+        {
+            xCacheStale = pdFALSE;
+            xHalStatus = HAL_OSPI_MemoryMapped( pxOSPI, &xMemMappedCfg );
+        }
+
+        if( xHalStatus != HAL_OK )
+        {
+            LogError( "Failed to enter memory mapped mode." );
+        }
+
+        return( xHalStatus == HAL_OK );
+    }
+
+/*
+ * Switch between memory mapped and indirect mode. Must be called from the driver task.
+ */
+    static void ospi_SetMemoryMapped( OSPI_HandleTypeDef * pxOSPI,
+                                      BaseType_t xEnable )
+    {
+        if( xMemoryMapped != xEnable )
+        {
+            ( void ) xSemaphoreTake( xMemMapMutex, portMAX_DELAY );
+
+            if( xEnable == pdTRUE )
+            {
+                xMemoryMapped = ospi_EnterMemoryMapped( pxOSPI );
+            }
+            else
+            {
+                /* Aborting is the only way out of memory mapped mode */
+                if( HAL_OSPI_Abort( pxOSPI ) != HAL_OK )
+                {
+                    LogError( "Failed to exit memory mapped mode." );
+                }
+
+                xMemoryMapped = pdFALSE;
+            }
+
+            ( void ) xSemaphoreGive( xMemMapMutex );
+        }
+    }
+
+/*
+ * Copy from the memory mapped window if the driver is currently in memory mapped mode.
+ * Returns pdFALSE if the read must go through the driver task instead.
+ */
+    static BaseType_t ospi_ReadMemoryMapped( uint32_t ulAddr,
+                                             void * pxBuffer,
+                                             uint32_t ulBufferLen )
+    {
+        BaseType_t xSuccess = pdFALSE;
+
+        if( ( xMemMapMutex != NULL ) &&
+            ( pxBuffer != NULL ) &&
+            ( ulBufferLen > 0 ) &&
+            ( ulAddr < MX25LM_MEM_SZ_BYTES ) &&
+            ( ulBufferLen <= ( MX25LM_MEM_SZ_BYTES - ulAddr ) ) &&
+            ( xMemoryMapped == pdTRUE ) )
+        {
+            ( void ) xSemaphoreTake( xMemMapMutex, portMAX_DELAY );
+
+            if( xMemoryMapped == pdTRUE )
+            {
+                /* Large reads, such as littlefs cache fills, are moved by GPDMA while the task sleeps */
+                ( void ) pvDmaCopy( pxBuffer, ( const void * ) ( OSPI_MEM_MAPPED_BASE + ulAddr ), ulBufferLen );
+                xSuccess = pdTRUE;
+            }
+
+            ( void ) xSemaphoreGive( xMemMapMutex );
+        }
+
+        return xSuccess;
+    }
+
+#endif /* OSPI_USE_MEMORY_MAPPED */
+
+static void ospi_ProcessRequest( const OspiRequest_t * pxRequest )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    configASSERT( pxRequest->pxOSPI == s_pxOSPI );
+
+#if OSPI_USE_MEMORY_MAPPED
+    if( ( pxRequest->xOperation == OSPI_OP_READ ) &&
+        ( ospi_ReadMemoryMapped( pxRequest->ulAddr, pxRequest->pvBuffer,
+                                 pxRequest->ulBufferLen ) == pdTRUE ) )
+    {
+        ospi_CompleteRequest( pxRequest, pdTRUE );
+        return;
+    }
+
+    /* Program, erase and status polling all need indirect mode */
+    ospi_SetMemoryMapped( pxRequest->pxOSPI, pdFALSE );
+
+    if( pxRequest->xOperation != OSPI_OP_READ )
+    {
+        xCacheStale = pdTRUE;
+    }
+#endif
+
+    switch( pxRequest->xOperation )
+    {
+        case OSPI_OP_READ:
+            xSuccess = ospi_DoRead( pxRequest->pxOSPI, pxRequest->ulAddr, pxRequest->pvBuffer,
+                                    pxRequest->ulBufferLen, pxRequest->xTimeout );
+            break;
+
+        case OSPI_OP_WRITE:
+            xSuccess = ospi_DoWrite( pxRequest->pxOSPI, pxRequest->ulAddr, pxRequest->pvBuffer,
+                                     pxRequest->ulBufferLen, pxRequest->xTimeout );
+            break;
+
+        case OSPI_OP_ERASE:
+            xSuccess = ospi_DoEraseSector( pxRequest->pxOSPI, pxRequest->ulAddr, pxRequest->xTimeout );
+            break;
+
+        default:
+            LogError( "Unknown OSPI operation: %d", pxRequest->xOperation );
+            break;
+    }
+
+    ospi_CompleteRequest( pxRequest, xSuccess );
+}
+
+/*
+ * The driver task owns the OCTOSPI peripheral and services requests in order,
+ * except for reads which may be serviced while an erase is suspended.
+ */
+static void ospi_DriverTask( void * pvParameters )
+{
+    OSPI_HandleTypeDef * pxOSPI = ( OSPI_HandleTypeDef * ) pvParameters;
+    OspiRequest_t xRequest;
+
+    /* HAL callbacks notify this task from now on */
+    ospi_OpInit( pxOSPI );
+
+    for( ; ; )
+    {
+        if( ulDeferredCount > 0 )
+        {
+            xRequest = xDeferredRequests[ 0 ];
+            ulDeferredCount--;
+
+            ( void ) memmove( &( xDeferredRequests[ 0 ] ), &( xDeferredRequests[ 1 ] ),
+                              ulDeferredCount * sizeof( OspiRequest_t ) );
+
+            ospi_ProcessRequest( &xRequest );
+        }
+        else
+        {
+#if OSPI_USE_MEMORY_MAPPED
+            /* Return to memory mapped mode whenever the driver goes idle */
+            if( uxQueueMessagesWaiting( xRequestQueue ) == 0 )
+            {
+                ospi_SetMemoryMapped( pxOSPI, pdTRUE );
+            }
+#endif
+
+            if( xQueueReceive( xRequestQueue, &xRequest, portMAX_DELAY ) == pdTRUE )
+            {
+                ospi_ProcessRequest( &xRequest );
+            }
+        }
+    }
+}
+
+static BaseType_t ospi_SubmitRequest( OspiOperation_t xOperation,
+                                      OSPI_HandleTypeDef * pxOSPI,
+                                      uint32_t ulAddr,
+                                      void * pvBuffer,
+                                      uint32_t ulBufferLen,
+                                      TickType_t xTimeout,
+                                      OspiCallback_t xCallback,
+                                      void * pvCtx,
+                                      TickType_t xQueueTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    OspiRequest_t xRequest =
+    {
+        .xOperation  = xOperation,
+        .pxOSPI      = pxOSPI,
+        .ulAddr      = ulAddr,
+        .pvBuffer    = pvBuffer,
+        .ulBufferLen = ulBufferLen,
+        .xTimeout    = xTimeout,
+        .xCallback   = xCallback,
+        .pvCtx       = pvCtx,
+    };
+
+    if( xRequestQueue == NULL )
+    {
+        LogError( "OSPI driver is not initialized." );
+        xSuccess = pdFALSE;
+    }
+    else if( pxOSPI != s_pxOSPI )
+    {
+        LogError( "Request for an OSPI handle which was not initialized." );
+        xSuccess = pdFALSE;
+    }
+    else if( xQueueSend( xRequestQueue, &xRequest, xQueueTimeout ) != pdTRUE )
+    {
+        LogError( "OSPI request queue is full." );
+        xSuccess = pdFALSE;
+    }
+    else
+    {
+        /* Request queued */
+    }
+
+    return xSuccess;
+}
+
+static void ospi_SyncCallback( BaseType_t xSuccess,
+                               void * pvCtx )
+{
+    ( void ) xTaskNotifyIndexed( ( TaskHandle_t ) pvCtx, OSPI_SYNC_NOTIFY_INDEX,
+                                 ( uint32_t ) xSuccess, eSetValueWithOverwrite );
+}
+
+/*
+ * Queue a request and block until the driver task reports completion. The request
+ * is always allowed to finish since the caller's buffer is in use until then; the
+ * driver task enforces xTimeout on the flash operation itself.
+ */
+static BaseType_t ospi_SubmitRequestSync( OspiOperation_t xOperation,
+                                          OSPI_HandleTypeDef * pxOSPI,
+                                          uint32_t ulAddr,
+                                          void * pvBuffer,
+                                          uint32_t ulBufferLen,
+                                          TickType_t xTimeout )
+{
+    BaseType_t xSuccess;
+    uint32_t ulNotifyValue = pdFALSE;
+
+    configASSERT( xTaskGetCurrentTaskHandle() != xDriverTaskHandle );
+
+    ( void ) xTaskNotifyStateClearIndexed( NULL, OSPI_SYNC_NOTIFY_INDEX );
+
+    xSuccess = ospi_SubmitRequest( xOperation, pxOSPI, ulAddr, pvBuffer, ulBufferLen, xTimeout,
+                                   ospi_SyncCallback, ( void * ) xTaskGetCurrentTaskHandle(),
+                                   portMAX_DELAY );
+
+    if( xSuccess == pdTRUE )
+    {
+        ( void ) xTaskNotifyWaitIndexed( OSPI_SYNC_NOTIFY_INDEX, 0x0, 0xFFFFFFFF, &ulNotifyValue, portMAX_DELAY );
+        xSuccess = ( BaseType_t ) ulNotifyValue;
+    }
+
+    return xSuccess;
+}
+
+/*
+ * Reset the flash to 1 bit SPI mode from any of the three modes. The commands of the other
+ * modes are ignored by the device, so they are sent without checking the result.
+ */
+static void ospi_ResetMemory( OSPI_HandleTypeDef * pxOSPI )
+{
+    ( void ) ospi_cmd_SPI_Instruction( pxOSPI, MX25LM_SPI_RSTEN, MX25LM_DEFAULT_TIMEOUT_MS );
+    ( void ) ospi_cmd_SPI_Instruction( pxOSPI, MX25LM_SPI_RST, MX25LM_DEFAULT_TIMEOUT_MS );
+
+    xDtrMode = pdFALSE;
+    ( void ) ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_RSTEN, MX25LM_DEFAULT_TIMEOUT_MS );
+    ( void ) ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_RST, MX25LM_DEFAULT_TIMEOUT_MS );
+
+    xDtrMode = pdTRUE;
+    ( void ) ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_RSTEN, MX25LM_DEFAULT_TIMEOUT_MS );
+    ( void ) ospi_cmd_OPI_Instruction( pxOSPI, MX25LM_OPI_RST, MX25LM_DEFAULT_TIMEOUT_MS );
+
+    xDtrMode = pdFALSE;
+
+    vTaskDelay( pdMS_TO_TICKS( MX25LM_RESET_RECOVERY_MS ) + 1 );
+}
+
+/*
+ * Switch the flash from 1 bit SPI mode to 8 bit STR mode.
+ */
+static BaseType_t ospi_EnterSOPI( OSPI_HandleTypeDef * pxOSPI )
+{
+    /* Set Write enable bit */
+    BaseType_t xSuccess = ospi_cmd_SPI_WREN( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Failed to send WREN command." );
+    }
+    else
+    {
+        xSuccess = ospi_SPI_WaitForStatus( pxOSPI,
+                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
+                                           MX25LM_REG_SR_WEL,
+                                           MX25LM_DEFAULT_TIMEOUT_MS );
+    }
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Timed out while waiting for write enable." );
+    }
+    else
+    {
+        /* Enter 8 bit data mode */
+        xSuccess = ospi_cmd_SPI_8BitSTRMode( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+    }
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Failed to set data mode to 8Bit STR." );
+    }
+    else
+    {
+        /* Wait for WEL and WIP bits to clear */
+        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
+                                           MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
+                                           0x0,
+                                           MX25LM_DEFAULT_TIMEOUT_MS );
+    }
+
+    return xSuccess;
+}
+
+#if OSPI_USE_DTR
+
+/*
+ * Write configuration register 2 in 8 bit STR mode. The flash switches to the new mode at the
+ * end of the command when the mode field is written.
+ */
+    static BaseType_t ospi_cmd_OPI_WriteCR2( OSPI_HandleTypeDef * pxOSPI,
+                                             uint32_t ulRegAddr,
+                                             uint8_t ucValue,
+                                             TickType_t xTimeout )
+    {
+        HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+        OSPI_RegularCmdTypeDef xCmd =
+        {
+            .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
+            .FlashId            = HAL_OSPI_FLASH_ID_1,
+
+            .Instruction        = MX25LM_OPI_WRCR2,
+            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+            .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
+            .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
+
+            .Address            = ulRegAddr,
+            .AddressMode        = HAL_OSPI_ADDRESS_8_LINES,
+            .AddressSize        = HAL_OSPI_ADDRESS_32_BITS,
+            .AddressDtrMode     = HAL_OSPI_ADDRESS_DTR_DISABLE,
+
+            .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+
+            .DataMode           = HAL_OSPI_DATA_8_LINES,
+            .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
+            .NbData             = 1,
+
+            .DummyCycles        = 0,
+            .DQSMode            = HAL_OSPI_DQS_DISABLE,
+            .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
+        };
+
+        configASSERT( xDtrMode == pdFALSE );
+
+        xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
+
+        if( xHalStatus == HAL_OK )
+        {
+            xHalStatus = HAL_OSPI_Transmit( pxOSPI, &ucValue, xTimeout );
+        }
+
+        return( xHalStatus == HAL_OK );
+    }
+
+/*
+ * Change the OCTOSPI clock divider, the peripheral must be idle.
+ */
+    static void ospi_SetClockPrescaler( OSPI_HandleTypeDef * pxOSPI,
+                                        uint32_t ulPrescaler )
+    {
+        __HAL_OSPI_DISABLE( pxOSPI );
+        MODIFY_REG( pxOSPI->Instance->DCR2, OCTOSPI_DCR2_PRESCALER,
+                    ( ( ulPrescaler - 1U ) << OCTOSPI_DCR2_PRESCALER_Pos ) );
+        pxOSPI->Init.ClockPrescaler = ulPrescaler;
+        __HAL_OSPI_ENABLE( pxOSPI );
+    }
+
+/*
+ * Measure the clock period with the delay block and delay DQS by a quarter of it, which puts
+ * the sampling point in the middle of the data eye. Done at HW_CLOCK_LEVEL_HIGH, the absolute
+ * delay stays inside the longer eye at the low DVFS level.
+ */
+    static BaseType_t ospi_CalibrateDelayBlock( OSPI_HandleTypeDef * pxOSPI )
+    {
+        HAL_OSPI_DLYB_CfgTypeDef xDlybCfg = { 0 };
+        HAL_OSPI_DLYB_CfgTypeDef xDlybCheck = { 0 };
+        HAL_StatusTypeDef xHalStatus = HAL_OSPI_DLYB_GetClockPeriod( pxOSPI, &xDlybCfg );
+
+        if( xHalStatus == HAL_OK )
+        {
+            xDlybCfg.PhaseSel /= 4U;
+            xHalStatus = HAL_OSPI_DLYB_SetConfig( pxOSPI, &xDlybCfg );
+        }
+
+        if( xHalStatus == HAL_OK )
+        {
+            xHalStatus = HAL_OSPI_DLYB_GetConfig( pxOSPI, &xDlybCheck );
+        }
+
+        if( ( xHalStatus == HAL_OK ) &&
+            ( ( xDlybCheck.Units != xDlybCfg.Units ) ||
+              ( xDlybCheck.PhaseSel != xDlybCfg.PhaseSel ) ) )
+        {
+            xHalStatus = HAL_ERROR;
+        }
+
+        if( xHalStatus == HAL_OK )
+        {
+            LogInfo( "OSPI delay block: %lu units, phase %lu.",
+                     ( unsigned long ) xDlybCfg.Units, ( unsigned long ) xDlybCfg.PhaseSel );
+        }
+        else
+        {
+            LogError( "OSPI delay block calibration failed." );
+        }
+
+        return( xHalStatus == HAL_OK );
+    }
+
+/*
+ * Switch the flash from 8 bit STR to 8 bit DTR mode. The SFDP header is read in STR mode first
+ * and must read back the same in DTR mode once the delay block is calibrated. On any failure the
+ * flash is reset and brought back to STR mode with the STR clock and delay block settings.
+ * Returns pdFALSE only if the flash is usable in neither mode.
+ */
+    static BaseType_t ospi_EnterDOPI( OSPI_HandleTypeDef * pxOSPI )
+    {
+        uint8_t ucStrHeader[ MX25LM_SFDP_HEADER_LEN ] = { 0 };
+        uint8_t ucDtrHeader[ MX25LM_SFDP_HEADER_LEN ] = { 0 };
+        HAL_OSPI_DLYB_CfgTypeDef xStrDlybCfg = { 0 };
+        BaseType_t xSuccess = pdTRUE;
+        BaseType_t xSwitched = pdFALSE;
+
+        vDvfsRequest( DVFS_CLIENT_BULK );
+
+        xSuccess = ospi_OPI_Read( pxOSPI, MX25LM_OPI_RDSFDP, 0, ucStrHeader,
+                                  sizeof( ucStrHeader ), MX25LM_DEFAULT_TIMEOUT_MS );
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( ( ( uint32_t ) ucStrHeader[ 0 ] |
+                ( ( uint32_t ) ucStrHeader[ 1 ] << 8 ) |
+                ( ( uint32_t ) ucStrHeader[ 2 ] << 16 ) |
+                ( ( uint32_t ) ucStrHeader[ 3 ] << 24 ) ) != MX25LM_SFDP_SIGNATURE ) )
+        {
+            LogWarn( "No SFDP signature in STR mode, staying in STR mode." );
+            xSuccess = pdFALSE;
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ( HAL_OSPI_DLYB_GetConfig( pxOSPI, &xStrDlybCfg ) == HAL_OK );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_cmd_OPI_WREN( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
+                                               MX25LM_REG_SR_WEL | MX25LM_REG_SR_WIP,
+                                               MX25LM_REG_SR_WEL,
+                                               MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_cmd_OPI_WriteCR2( pxOSPI, MX25LM_REG_CR2_0_ADDR,
+                                              MX25LM_REG_CR2_0_DOPI, MX25LM_DEFAULT_TIMEOUT_MS );
+
+            /* The device may have switched even if the command did not complete */
+            xSwitched = pdTRUE;
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xDtrMode = pdTRUE;
+            ospi_SetClockPrescaler( pxOSPI, OSPI_DTR_CLOCK_PRESCALER );
+            xSuccess = ospi_CalibrateDelayBlock( pxOSPI );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
+                                               MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
+                                               0x0,
+                                               MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = ospi_OPI_Read( pxOSPI, MX25LM_OPI_RDSFDP, 0, ucDtrHeader,
+                                      sizeof( ucDtrHeader ), MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( memcmp( ucStrHeader, ucDtrHeader, sizeof( ucStrHeader ) ) != 0 ) )
+        {
+            LogWarn( "SFDP header differs in DTR mode." );
+            xSuccess = pdFALSE;
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            LogInfo( "OSPI flash in 8 bit DTR mode, prescaler %u.", OSPI_DTR_CLOCK_PRESCALER );
+        }
+        else if( xSwitched == pdTRUE )
+        {
+            LogWarn( "DTR mode check failed, returning to STR mode." );
+
+            ospi_ResetMemory( pxOSPI );
+            ospi_SetClockPrescaler( pxOSPI, OSPI_STR_CLOCK_PRESCALER );
+            ( void ) HAL_OSPI_DLYB_SetConfig( pxOSPI, &xStrDlybCfg );
+
+            xSuccess = ospi_EnterSOPI( pxOSPI );
+        }
+        else
+        {
+            /* Still in STR mode */
+            xDtrMode = pdFALSE;
+            xSuccess = pdTRUE;
+        }
+
+        vDvfsRelease( DVFS_CLIENT_BULK );
+
+        return xSuccess;
+    }
+
+#endif /* OSPI_USE_DTR */
+
+/*
+ * @Brief Initialize octospi flash controller and related peripherals
+ */
+BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    ospi_OpInit( pxOSPI );
+
+    xSuccess = ospi_InitDriver( pxOSPI );
+
+    if( xSuccess != pdTRUE )
+    {
+        LogError( "Failed to initialize ospi driver." );
+    }
+    else
+    {
+        /* The device keeps its mode across a reset of the MCU */
+        ospi_ResetMemory( pxOSPI );
+
+        xSuccess = ospi_EnterSOPI( pxOSPI );
+    }
+
+#if OSPI_USE_DTR
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = ospi_EnterDOPI( pxOSPI );
+    }
+#endif
+
+#if OSPI_USE_MEMORY_MAPPED
+    if( ( xSuccess == pdTRUE ) &&
+        ( xMemMapMutex == NULL ) )
+    {
+        xMemMapMutex = xAppSemaphoreCreateMutex();
+
+        if( xMemMapMutex == NULL )
+        {
+            LogError( "Failed to allocate OSPI memory mapped mode mutex." );
+            xSuccess = pdFALSE;
+        }
+    }
+#endif
+
+    if( ( xSuccess == pdTRUE ) &&
+        ( xRequestQueue == NULL ) )
+    {
+        xRequestQueue = xAppQueueCreate( OSPI_REQUEST_QUEUE_LEN, sizeof( OspiRequest_t ) );
+
+        if( xRequestQueue == NULL )
+        {
+            LogError( "Failed to allocate OSPI request queue." );
+            xSuccess = pdFALSE;
+        }
+        else if( xAppTaskCreate( ospi_DriverTask, "OSPI", OSPI_TASK_STACK_SIZE,
+                                 ( void * ) pxOSPI, OSPI_TASK_PRIORITY, &xDriverTaskHandle ) != pdPASS )
+        {
+            LogError( "Failed to start OSPI driver task." );
+            vQueueDelete( xRequestQueue );
+            xRequestQueue = NULL;
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            /* Driver task started */
+        }
+    }
+
+    return xSuccess;
+}
+
+BaseType_t ospi_IsDtrMode( void )
+{
+    return xDtrMode;
+}
+
+BaseType_t ospi_ReadAddrAsync( OSPI_HandleTypeDef * pxOSPI,
+                               uint32_t ulAddr,
+                               void * pxBuffer,
+                               uint32_t ulBufferLen,
+                               TickType_t xTimeout,
+                               OspiCallback_t xCallback,
+                               void * pvCtx )
+{
+    return ospi_SubmitRequest( OSPI_OP_READ, pxOSPI, ulAddr, pxBuffer, ulBufferLen,
+                               xTimeout, xCallback, pvCtx, 0 );
+}
+
+BaseType_t ospi_WriteAddrAsync( OSPI_HandleTypeDef * pxOSPI,
+                                uint32_t ulAddr,
+                                const void * pxBuffer,
+                                uint32_t ulBufferLen,
+                                TickType_t xTimeout,
+                                OspiCallback_t xCallback,
+                                void * pvCtx )
+{
+    return ospi_SubmitRequest( OSPI_OP_WRITE, pxOSPI, ulAddr, ( void * ) pxBuffer, ulBufferLen,
+                               xTimeout, xCallback, pvCtx, 0 );
+}
+
+BaseType_t ospi_EraseSectorAsync( OSPI_HandleTypeDef * pxOSPI,
+                                  uint32_t ulAddr,
+                                  TickType_t xTimeout,
+                                  OspiCallback_t xCallback,
+                                  void * pvCtx )
+{
+    return ospi_SubmitRequest( OSPI_OP_ERASE, pxOSPI, ulAddr, NULL, 0,
+                               xTimeout, xCallback, pvCtx, 0 );
+}
+
+BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
+                          uint32_t ulAddr,
+                          void * pxBuffer,
+                          uint32_t ulBufferLen,
+                          TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+#if OSPI_USE_MEMORY_MAPPED
+    /* Skip the driver task entirely when the flash is memory mapped */
+    if( ( pxOSPI == s_pxOSPI ) &&
+        ( xTaskGetCurrentTaskHandle() != xDriverTaskHandle ) )
+    {
+        xSuccess = ospi_ReadMemoryMapped( ulAddr, pxBuffer, ulBufferLen );
+    }
+#endif
+
+    if( xSuccess != pdTRUE )
+    {
+        xSuccess = ospi_SubmitRequestSync( OSPI_OP_READ, pxOSPI, ulAddr, pxBuffer, ulBufferLen, xTimeout );
+    }
+
+    return xSuccess;
+}
+
+/*
+ * @Brief write ulBufferLen bytes to the given address. Programs which span several
+ * pages are handled in a single request.
+ */
+BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
+                           uint32_t ulAddr,
+                           const void * pxBuffer,
+                           uint32_t ulBufferLen,
+                           TickType_t xTimeout )
+{
+    return ospi_SubmitRequestSync( OSPI_OP_WRITE, pxOSPI, ulAddr, ( void * ) pxBuffer, ulBufferLen, xTimeout );
+}
+
+BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
+                             uint32_t ulAddr,
+                             TickType_t xTimeout )
+{
+    return ospi_SubmitRequestSync( OSPI_OP_ERASE, pxOSPI, ulAddr, NULL, 0, xTimeout );
+}
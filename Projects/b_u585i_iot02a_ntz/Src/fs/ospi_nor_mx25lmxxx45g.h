@@ -51,16 +51,28 @@
 
 
 #define MX25LM_8READ_DUMMY_CYCLES    ( 20 )
+#define MX25LM_REG_DUMMY_CYCLES_STR  ( 4 )
+#define MX25LM_REG_DUMMY_CYCLES_DTR  ( 5 )
 
 /* SPI mode command codes */
 #define MX25LM_SPI_WREN              ( 0x06 )
 #define MX25LM_SPI_WRCR2             ( 0x72 )
 #define MX25LM_SPI_RDSR              ( 0x05 )
+#define MX25LM_SPI_RSTEN             ( 0x66 )
+#define MX25LM_SPI_RST               ( 0x99 )
+
+/* Time to recover from a software reset which interrupted an erase (tREADY2) */
+#define MX25LM_RESET_RECOVERY_MS     ( 12 )
 
 /* CR2 register definition */
 #define MX25LM_REG_CR2_0_SPI         ( 0x00 )
 #define MX25LM_REG_CR2_0_SOPI        ( 0x01 )
 #define MX25LM_REG_CR2_0_DOPI        ( 0x02 )
+#define MX25LM_REG_CR2_0_ADDR        ( 0x00000000 )
+
+/* "SFDP" read from address 0 of the SFDP table, checked when switching to DTR mode */
+#define MX25LM_SFDP_SIGNATURE        ( 0x50444653UL )
+#define MX25LM_SFDP_HEADER_LEN       ( 16 )
 
 #define MX25LM_REG_SR_WIP            ( 0x01 )   /* Write in progress  */
 #define MX25LM_REG_SR_WEL            ( 0x02 )   /* Write enable latch */
@@ -69,17 +81,40 @@
 #define MX25LM_OPI_RDSR              ( 0x05FA )
 #define MX25LM_OPI_WREN              ( 0x06F9 )
 #define MX25LM_OPI_8READ             ( 0xEC13 )
+#define MX25LM_OPI_8DTRD             ( 0xEE11 ) /* 8READ in DTR OPI mode */
+#define MX25LM_OPI_RDSFDP            ( 0x5AA5 )
+#define MX25LM_OPI_WRCR2             ( 0x728D )
+#define MX25LM_OPI_RSTEN             ( 0x6699 )
+#define MX25LM_OPI_RST               ( 0x9966 )
 #define MX25LM_OPI_PP                ( 0x12ED ) /* Page Program, starting address must be 0 in DTR OPI mode */
 #define MX25LM_PROGRAM_FIFO_LEN      ( 256 )
 #define MX25LM_OPI_SE                ( 0x21DE ) /* Sector Erase */
+#define MX25LM_OPI_PES               ( 0xB04F ) /* Program / Erase Suspend */
+#define MX25LM_OPI_PER               ( 0x30CF ) /* Program / Erase Resume */
 
 #define MX25LM_WRITE_TIMEOUT_MS      ( 10 * 1000 )
 #define MX25LM_ERASE_TIMEOUT_MS      ( 10 * 1000 )
 #define MX25LM_READ_TIMEOUT_MS       ( 10 * 1000 )
+#define MX25LM_SUSPEND_TIMEOUT_MS    ( 5 )
+
 
+/*
+ * Completion callback for the asynchronous API. Called from the OSPI driver task
+ * once the request has completed (xSuccess == pdTRUE) or failed. Callbacks should
+ * be short since they delay servicing of the next request.
+ */
+typedef void ( * OspiCallback_t )( BaseType_t xSuccess,
+                                   void * pvCtx );
 
+/*
+ * Reset the flash and switch it to 8 bit DTR mode, or 8 bit STR mode when OSPI_USE_DTR is 0 or
+ * the delay block calibration for DTR could not be verified.
+ */
 BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI );
 
+/* Returns pdTRUE once ospi_Init left the flash in DTR mode */
+BaseType_t ospi_IsDtrMode( void );
+
 BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
                            uint32_t ulAddr,
                            const void * pxBuffer,
@@ -96,5 +131,33 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
                           uint32_t ulBufferLen,
                           TickType_t xTimeout );
 
+/*
+ * Asynchronous variants of the calls above. Each returns pdTRUE once the request
+ * has been queued to the driver task and pdFALSE if the queue is full. The buffer
+ * must remain valid until xCallback is called. Reads outside of the sector being
+ * erased are serviced while an erase is in progress by suspending the erase.
+ */
+BaseType_t ospi_ReadAddrAsync( OSPI_HandleTypeDef * pxOSPI,
+                               uint32_t ulAddr,
+                               void * pxBuffer,
+                               uint32_t ulBufferLen,
+                               TickType_t xTimeout,
+                               OspiCallback_t xCallback,
+                               void * pvCtx );
+
+BaseType_t ospi_WriteAddrAsync( OSPI_HandleTypeDef * pxOSPI,
+                                uint32_t ulAddr,
+                                const void * pxBuffer,
+                                uint32_t ulBufferLen,
+                                TickType_t xTimeout,
+                                OspiCallback_t xCallback,
+                                void * pvCtx );
+
+BaseType_t ospi_EraseSectorAsync( OSPI_HandleTypeDef * pxOSPI,
+                                  uint32_t ulAddr,
+                                  TickType_t xTimeout,
+                                  OspiCallback_t xCallback,
+                                  void * pvCtx );
+
 
 #endif /* _OSPI_NOR_DRV */
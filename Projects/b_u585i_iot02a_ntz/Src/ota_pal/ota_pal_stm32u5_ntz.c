@@ -30,9 +30,11 @@
 #include "logging.h"
 
 #include <string.h>
+#include <stddef.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 
 #include "ota.h"
 #include "ota_pal.h"
@@ -46,17 +48,64 @@
 #include "mbedtls_error_utils.h"
 
 #include "PkiObject.h"
+#include "ota_delta.h"
+#include "ota_decompress.h"
+#include "ota_manifest.h"
+#include "ota_timing.h"
+#include "watchdog.h"
 
 #define FLASH_START_INACTIVE_BANK    ( ( uint32_t ) ( FLASH_BASE + FLASH_BANK_SIZE ) )
 
-#define NUM_QUAD_WORDS( length )         ( length >> 4UL )
+/* Smallest unit which can be programmed */
+#define FLASH_QUADWORD_SIZE          ( 16UL )
 
-#define NUM_REMAINING_BYTES( length )    ( length & 0x0F )
+/* FLASH_TYPEPROGRAM_BURST programs 8 quad-words at a burst aligned address */
+#define FLASH_BURST_SIZE             ( 8UL * FLASH_QUADWORD_SIZE )
 
 #define IMAGE_CONTEXT_FILE_NAME    "/ota/image_state"
 
+/*
+ * TAMP backup register marking the boot of a new image, below the ones used by time_hwm.c.
+ * It is set on the first boot and moves to CONNECTED once the image reached the MQTT broker,
+ * so a reset during the self test is detected without a write to the file system.
+ */
+#ifndef OTA_PAL_BOOT_MARKER_REG
+    #define OTA_PAL_BOOT_MARKER_REG    ( 15U )
+#endif
+
+#define OTA_PAL_BOOT_MARKER_TESTING      ( 0x4F544154UL ) /* "OTAT" */
+#define OTA_PAL_BOOT_MARKER_CONNECTED    ( 0x4F544143UL ) /* "OTAC" */
+
+/* Blocks received so far by an interrupted download */
+#define DOWNLOAD_CONTEXT_FILE_NAME    "/ota/download"
+
 #define OTA_IMAGE_MIN_SIZE         ( 16 )
 
+/* A full image is written as is, a patch is applied against the active bank */
+#define OTA_IMAGE_FILE_NAME        "b_u585i_iot02a_ntz.bin"
+#define OTA_PATCH_FILE_NAME        "b_u585i_iot02a_ntz.patch"
+
+/* Suffix of heatshrink compressed images and patches */
+#define OTA_COMPRESSED_SUFFIX      ".hs"
+
+/* Suffix of images led by a signed manifest of their block hashes, see ota_manifest.h */
+#define OTA_MANIFEST_SUFFIX        ".bhm"
+
+/* Blocks of an image with a manifest which may fail their check and be requested again */
+#ifndef OTA_PAL_MAX_REQUEUED_BLOCKS
+    #define OTA_PAL_MAX_REQUEUED_BLOCKS    ( 32U )
+#endif
+
+/* Number of bytes hashed or patched from flash between watchdog check-ins on close */
+#define OTA_FLASH_CHUNK_SIZE         ( 16 * 1024 )
+
+/* Longest time between two check-ins of a flash erase, hash or patch loop */
+#define OTA_PAL_WATCHDOG_DEADLINE    pdMS_TO_TICKS( 2000 )
+
+/* The inactive bank is erased page by page in the background after boot */
+#define OTA_PAL_ERASE_TASK_STACK       ( 512 )
+#define OTA_PAL_ERASE_TASK_PRIORITY    ( tskIDLE_PRIORITY )
+
 
 typedef enum
 {
@@ -88,12 +137,17 @@ static const char * ppcPalStateString[] =
     "Invalid"
 };
 
+/* The timing report of an activation is written along with the state, in the same file */
 typedef struct
 {
     OtaPalState_t xPalState;
     uint32_t ulFileTargetBank;
+    OtaTimingReport_t xTimingReport;
 } OtaPalNvContext_t;
 
+/* Size of the context written by earlier versions, without the timing report */
+#define OTA_PAL_NV_CONTEXT_V1_SIZE    ( offsetof( OtaPalNvContext_t, xTimingReport ) )
+
 typedef struct
 {
     uint32_t ulTargetBank;
@@ -101,6 +155,26 @@ typedef struct
     uint32_t ulBaseAddress;
     uint32_t ulImageSize;
     OtaPalState_t xPalState;
+
+    /* Size of the file being received, which differs from the image for staged updates */
+    uint32_t ulFileSize;
+
+    /* Delta and compressed files are staged at the end of the target bank and
+     * decoded from there into the start of the bank */
+    BaseType_t xDeltaUpdate;
+    BaseType_t xCompressed;
+    uint32_t ulStageAddress;
+    uint32_t ulStageApplied;
+    uint32_t ulImageWritten;
+
+    /* An image led by a manifest starts ulImageOffset bytes into the file */
+    BaseType_t xManifest;
+    uint32_t ulImageOffset;
+
+    /* Running SHA-256 of the image, fed as blocks arrive in order */
+    mbedtls_md_context_t xHashCtx;
+    uint32_t ulHashedBytes;
+    BaseType_t xHashActive;
 } OtaPalContext_t;
 
 
@@ -113,10 +187,90 @@ static OtaPalContext_t xPalContext =
     .ulPendingBank = 0,
     .ulBaseAddress = 0,
     .ulImageSize   = 0,
+    .ulHashedBytes = 0,
+    .xHashActive   = pdFALSE,
 };
 
 static uint32_t ulBankAtBootup = 0;
 
+/* Timing report read along with the NV context, restored on the first boot of a new image */
+static OtaTimingReport_t xNvTimingReport = { 0 };
+
+/* Erase progress of the inactive bank */
+typedef struct
+{
+    SemaphoreHandle_t xMutex;
+    StaticSemaphore_t xMutexBuffer;
+    TaskHandle_t xTaskHandle;
+    volatile BaseType_t xStop;
+    uint32_t ulBank;
+
+    /* Pages [ 0, ulErasedPages ) of ulBank are known to be erased */
+    uint32_t ulErasedPages;
+} OtaPalEraseCtx_t;
+
+static OtaPalEraseCtx_t xEraseCtx = { 0 };
+
+typedef struct
+{
+    const char * pcFileName;
+    BaseType_t xDeltaUpdate;
+    BaseType_t xCompressed;
+    BaseType_t xManifest;
+} OtaPalFileType_t;
+
+static const OtaPalFileType_t xFileTypes[] =
+{
+    { OTA_IMAGE_FILE_NAME,                         pdFALSE, pdFALSE, pdFALSE },
+    { OTA_PATCH_FILE_NAME,                         pdTRUE,  pdFALSE, pdFALSE },
+    { OTA_IMAGE_FILE_NAME OTA_COMPRESSED_SUFFIX,   pdFALSE, pdTRUE,  pdFALSE },
+    { OTA_PATCH_FILE_NAME OTA_COMPRESSED_SUFFIX,   pdTRUE,  pdTRUE,  pdFALSE },
+    { OTA_IMAGE_FILE_NAME OTA_MANIFEST_SUFFIX,     pdFALSE, pdFALSE, pdTRUE  },
+};
+
+static OtaDeltaCtx_t xDeltaCtx;
+static OtaDecompressCtx_t xDecompressCtx;
+
+static OtaManifestCtx_t xManifestCtx;
+static uint8_t * pucManifestBuffer = NULL;
+
+#define OTA_RESUME_MAGIC           ( 0x4D535352UL )
+#define OTA_RESUME_DIGEST_LEN      ( 32U )
+#define OTA_RESUME_MAX_BLOCKS      ( FLASH_BANK_SIZE >> otaconfigLOG2_FILE_BLOCK_SIZE )
+
+/* Number of new blocks after which the download progress is flushed to the file system */
+#define OTA_RESUME_FLUSH_BLOCKS    ( 16U )
+
+/* Progress of a plain image download, kept across resets so that the same job can resume */
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t ulTargetBank;
+    uint32_t ulFileSize;
+    uint32_t ulImageOffset;                        /* Size of the manifest leading the image */
+    uint8_t pucJobDigest[ OTA_RESUME_DIGEST_LEN ]; /* SHA-256 of the image signature */
+    uint8_t pucReceived[ ( OTA_RESUME_MAX_BLOCKS + 7U ) / 8U ]; /* Blocks of the image */
+} OtaPalResumeCtx_t;
+
+static OtaPalResumeCtx_t xResumeCtx;
+static BaseType_t xResumeActive = pdFALSE;
+static uint32_t ulResumeUnflushed = 0;
+
+/*
+ * Blocks refused by the PAL after the agent counted them as received. The agent clears the bit
+ * of a block in its bitmap once otaPal_WriteBlock returns, so the bits are set again before the
+ * next write and before the next request is built from the bitmap.
+ */
+typedef struct
+{
+    OtaFileContext_t * pxFileContext;
+    uint32_t ulPending;
+    uint32_t ulTotal;
+    uint8_t pucBlocks[ ( OTA_RESUME_MAX_BLOCKS + 7U ) / 8U ];
+} OtaPalRequeueCtx_t;
+
+static OtaPalRequeueCtx_t xRequeueCtx = { 0 };
+
 /* Static function forward declarations */
 
 /* Load/Save/Delete */
@@ -124,6 +278,10 @@ static BaseType_t prvInitializePalContext( OtaPalContext_t * pxContext );
 static BaseType_t prvWritePalNvContext( OtaPalContext_t * pxContext );
 static BaseType_t prvDeletePalNvContext( void );
 static OtaPalContext_t * prvGetImageContext( void );
+static void prvRestoreTimingReport( void );
+static uint32_t prvBootMarkerGet( void );
+static void prvBootMarkerSet( uint32_t ulMarker );
+static inline uint32_t prvCycleCount( void );
 
 /* Active / Inactive bank helpers */
 static uint32_t prvGetActiveBank( void );
@@ -137,11 +295,67 @@ static uint32_t prvGetBankSettingFromOB( void );
 static void prvOptionByteApply( void );
 
 /* Flash write./erase */
+static HAL_StatusTypeDef prvProgramAndVerify( uint32_t ulTypeProgram,
+                                              uint32_t ulDestination,
+                                              const uint8_t * pucData,
+                                              uint32_t ulLength );
+
 static HAL_StatusTypeDef prvWriteToFlash( uint32_t destination,
                                           uint8_t * pSource,
                                           uint32_t length );
 
 static BaseType_t prvEraseBank( uint32_t bankNumber );
+static BaseType_t prvEraseImageArea( uint32_t bankNumber,
+                                     uint32_t ulImageSize );
+static void prvBackgroundEraseStart( uint32_t bankNumber );
+static void prvBackgroundEraseStop( void );
+
+/* Download resume */
+static BaseType_t prvResumeJobDigest( const OtaFileContext_t * pxFileContext,
+                                      uint8_t * pucDigest );
+static BaseType_t prvResumeSave( void );
+static void prvResumeDelete( void );
+static BaseType_t prvResumeExists( void );
+static BaseType_t prvResumeLoad( const OtaFileContext_t * pxFileContext,
+                                 uint32_t ulTargetBank );
+static BaseType_t prvResumeRepair( uint32_t ulBank,
+                                   uint32_t ulBaseAddress,
+                                   uint32_t ulFileSize );
+static void prvResumeApply( OtaFileContext_t * pxFileContext,
+                            OtaPalContext_t * pxContext );
+static void prvResumeRecordBlock( uint32_t ulOffset );
+
+/* Block hash manifest */
+static void prvRequeueReset( void );
+static BaseType_t prvRequeueBlock( OtaFileContext_t * pxFileContext,
+                                   uint32_t ulOffset );
+static void prvRequeueApply( void );
+static BaseType_t prvManifestStart( const OtaFileContext_t * pxFileContext );
+static void prvManifestFree( void );
+static BaseType_t prvManifestVerify( const OtaFileContext_t * pxFileContext,
+                                     OtaPalContext_t * pxContext );
+static int16_t prvManifestWriteBlock( OtaFileContext_t * pxFileContext,
+                                      OtaPalContext_t * pxContext,
+                                      uint32_t ulOffset,
+                                      uint8_t * pucData,
+                                      uint32_t ulLength );
+
+/* Staged (delta and / or compressed) updates */
+static const OtaPalFileType_t * prvGetFileType( const OtaFileContext_t * pxFileContext );
+static BaseType_t prvImageWrite( void * pvCtx,
+                                 uint32_t ulOffset,
+                                 const uint8_t * pucData,
+                                 uint32_t ulLength );
+static BaseType_t prvDeltaFeed( const uint8_t * pucPatch,
+                                uint32_t ulLength );
+static BaseType_t prvDecompressOutput( void * pvCtx,
+                                       const uint8_t * pucData,
+                                       uint32_t ulLength );
+static BaseType_t prvStageApply( OtaPalContext_t * pxContext,
+                                 uint32_t ulOffset,
+                                 const uint8_t * pucData,
+                                 uint32_t ulLength );
+static BaseType_t prvStageFinish( OtaPalContext_t * pxContext );
 
 /* Verify signature */
 static OtaPalStatus_t prvValidateSignature( const char * pcPubKeyLabel,
@@ -150,11 +364,17 @@ static OtaPalStatus_t prvValidateSignature( const char * pcPubKeyLabel,
                                             const unsigned char * pucImageHash,
                                             const size_t uxHashLength );
 
-static BaseType_t xCalculateImageHash( const unsigned char * pucImageAddress,
-                                       const size_t uxImageLength,
-                                       unsigned char * pucHashBuffer,
-                                       size_t uxHashBufferLength,
-                                       size_t * puxHashLength );
+/* Incremental image hash */
+static void prvImageHashStart( OtaPalContext_t * pxContext );
+static void prvImageHashUpdate( OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                const uint8_t * pucData,
+                                uint32_t ulLength );
+static void prvImageHashFree( OtaPalContext_t * pxContext );
+static BaseType_t xFinishImageHash( OtaPalContext_t * pxContext,
+                                    unsigned char * pucHashBuffer,
+                                    size_t uxHashBufferLength,
+                                    size_t * puxHashLength );
 
 const char * otaImageStateToString( OtaImageState_t xState )
 {
@@ -283,7 +503,8 @@ static BaseType_t prvInitializePalContext( OtaPalContext_t * pxContext )
 
             xLfsErr = lfs_file_read( pxLfsCtx, &xFile, &xNvContext, sizeof( OtaPalNvContext_t ) );
 
-            if( xLfsErr != sizeof( OtaPalNvContext_t ) )
+            if( ( xLfsErr != sizeof( OtaPalNvContext_t ) ) &&
+                ( xLfsErr != OTA_PAL_NV_CONTEXT_V1_SIZE ) )
             {
                 LogError( " Failed to read OTA image context from file: %s, rc: %d", IMAGE_CONTEXT_FILE_NAME, xLfsErr );
             }
@@ -293,6 +514,9 @@ static BaseType_t prvInitializePalContext( OtaPalContext_t * pxContext )
                 pxContext->ulTargetBank = xNvContext.ulFileTargetBank;
                 pxContext->ulBaseAddress = 0;
                 pxContext->ulImageSize = 0;
+
+                /* A context without a report leaves the magic cleared, xOtaTimingRestore rejects it */
+                xNvTimingReport = xNvContext.xTimingReport;
             }
 
             ( void ) lfs_file_close( pxLfsCtx, &xFile );
@@ -322,6 +546,7 @@ static BaseType_t prvWritePalNvContext( OtaPalContext_t * pxContext )
 
         xNvContext.ulFileTargetBank = pxContext->ulTargetBank;
         xNvContext.xPalState = pxContext->xPalState;
+        vOtaTimingGetReport( &( xNvContext.xTimingReport ) );
 
         /* Open the file */
         xLfsErr = lfs_file_open( pxLfsCtx, &xFile, IMAGE_CONTEXT_FILE_NAME, ( LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC ) );
@@ -382,6 +607,47 @@ static BaseType_t prvDeletePalNvContext( void )
 }
 
 
+static void prvRestoreTimingReport( void )
+{
+    if( ( xNvTimingReport.ulMagic != 0 ) &&
+        ( xOtaTimingRestore( &xNvTimingReport ) != pdTRUE ) )
+    {
+        LogWarn( "Discarding an invalid OTA timing report." );
+    }
+
+    ( void ) memset( &xNvTimingReport, 0, sizeof( xNvTimingReport ) );
+}
+
+static inline volatile uint32_t * prvBootMarkerReg( void )
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    return &( ( &( TAMP->BKP0R ) )[ OTA_PAL_BOOT_MARKER_REG ] );
+}
+
+static uint32_t prvBootMarkerGet( void )
+{
+    return *prvBootMarkerReg();
+}
+
+static void prvBootMarkerSet( uint32_t ulMarker )
+{
+    *prvBootMarkerReg() = ulMarker;
+}
+
+static inline uint32_t prvCycleCount( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    return DWT->CYCCNT;
+}
+
 static OtaPalContext_t * prvGetImageContext( void )
 {
     OtaPalContext_t * pxCtx = NULL;
@@ -510,229 +776,1221 @@ static void prvOptionByteApply( void )
         vTaskSuspendAll();
     }
 
-    LogSys( "Option Byte Launch in progress." );
-
-    /* Drain log buffers */
-    vDyingGasp();
+    LogSys( "Option Byte Launch in progress." );
+
+    /* Drain log buffers */
+    vDyingGasp();
+
+
+    ( void ) HAL_FLASH_Unlock();
+    ( void ) HAL_FLASH_OB_Unlock();
+    /* Generate System Reset to load the new option byte values ***************/
+    /* On successful option bytes loading the system should reset and control should not return from this function. */
+    ( void ) HAL_FLASH_OB_Launch();
+}
+
+static uint32_t prvGetActiveBank( void )
+{
+    if( ulBankAtBootup == 0 )
+    {
+        ulBankAtBootup = prvGetBankSettingFromOB();
+    }
+
+    return ulBankAtBootup;
+}
+
+static uint32_t prvGetBankSettingFromOB( void )
+{
+    uint32_t ulCurrentBank = 0UL;
+    FLASH_OBProgramInitTypeDef xObContext = { 0 };
+
+    /* Get the Dual boot configuration status */
+    HAL_FLASHEx_OBGetConfig( &xObContext );
+
+    if( ( xObContext.USERConfig & OB_SWAP_BANK_ENABLE ) == OB_SWAP_BANK_ENABLE )
+    {
+        ulCurrentBank = FLASH_BANK_2;
+    }
+    else
+    {
+        ulCurrentBank = FLASH_BANK_1;
+    }
+
+    return ulCurrentBank;
+}
+
+static uint32_t prvGetInactiveBank( void )
+{
+    uint32_t ulActiveBank = prvGetActiveBank();
+
+    uint32_t ulInactiveBank;
+
+    if( ulActiveBank == FLASH_BANK_1 )
+    {
+        ulInactiveBank = FLASH_BANK_2;
+    }
+    else if( ulActiveBank == FLASH_BANK_2 )
+    {
+        ulInactiveBank = FLASH_BANK_1;
+    }
+    else
+    {
+        ulInactiveBank = 0UL;
+    }
+
+    return ulInactiveBank;
+}
+
+
+static HAL_StatusTypeDef prvProgramAndVerify( uint32_t ulTypeProgram,
+                                              uint32_t ulDestination,
+                                              const uint8_t * pucData,
+                                              uint32_t ulLength )
+{
+    HAL_StatusTypeDef status = HAL_FLASH_Program( ulTypeProgram, ulDestination, ( uint32_t ) pucData );
+
+    if( status == HAL_OK )
+    {
+        /* Check the written value */
+        if( memcmp( ( void * ) ulDestination, pucData, ulLength ) != 0 )
+        {
+            /* Flash content doesn't match SRAM content */
+            status = HAL_ERROR;
+        }
+    }
+
+    return status;
+}
+
+static HAL_StatusTypeDef prvWriteToFlash( uint32_t destination,
+                                          uint8_t * pSource,
+                                          uint32_t ulLength )
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    /* Word aligned staging buffer, the source block may have any alignment */
+    static uint32_t pulStaging[ FLASH_BURST_SIZE / sizeof( uint32_t ) ];
+    uint8_t * const pucStaging = ( uint8_t * ) pulStaging;
+
+    configASSERT( ( destination % FLASH_QUADWORD_SIZE ) == 0 );
+
+    /* Unlock the Flash to enable the flash control register access *************/
+    HAL_FLASH_Unlock();
+
+    while( ( status == HAL_OK ) &&
+           ( ulLength > 0 ) )
+    {
+        uint32_t ulChunk = 0;
+        uint32_t ulTypeProgram = FLASH_TYPEPROGRAM_QUADWORD;
+        uint32_t ulProgramLen = FLASH_QUADWORD_SIZE;
+
+        if( ( ( destination % FLASH_BURST_SIZE ) == 0 ) &&
+            ( ulLength >= FLASH_BURST_SIZE ) )
+        {
+            /* Program 8 quad-words with a single burst */
+            ulChunk = FLASH_BURST_SIZE;
+            ulTypeProgram = FLASH_TYPEPROGRAM_BURST;
+            ulProgramLen = FLASH_BURST_SIZE;
+            memcpy( pucStaging, pSource, FLASH_BURST_SIZE );
+        }
+        else if( ulLength >= FLASH_QUADWORD_SIZE )
+        {
+            /* Unaligned head or tail of the block */
+            ulChunk = FLASH_QUADWORD_SIZE;
+            memcpy( pucStaging, pSource, FLASH_QUADWORD_SIZE );
+        }
+        else
+        {
+            /* Pad the last partial quad-word with the erased value */
+            ulChunk = ulLength;
+            memcpy( pucStaging, pSource, ulLength );
+            memset( ( pucStaging + ulLength ), 0xFF, ( FLASH_QUADWORD_SIZE - ulLength ) );
+        }
+
+        status = prvProgramAndVerify( ulTypeProgram, destination, pucStaging, ulProgramLen );
+
+        if( status == HAL_OK )
+        {
+            /* Increment FLASH destination address and the source address. */
+            destination += ulChunk;
+            pSource += ulChunk;
+            ulLength -= ulChunk;
+        }
+    }
+
+    /* Lock the Flash to disable the flash control register access (recommended
+     *  to protect the FLASH memory against possible unwanted operation) *********/
+    HAL_FLASH_Lock();
+
+    return status;
+}
+
+static void prvEraseLock( void )
+{
+    if( xEraseCtx.xMutex == NULL )
+    {
+        vTaskSuspendAll();
+
+        if( xEraseCtx.xMutex == NULL )
+        {
+            xEraseCtx.xMutex = xSemaphoreCreateMutexStatic( &( xEraseCtx.xMutexBuffer ) );
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+    ( void ) xSemaphoreTake( xEraseCtx.xMutex, portMAX_DELAY );
+}
+
+static void prvEraseUnlock( void )
+{
+    ( void ) xSemaphoreGive( xEraseCtx.xMutex );
+}
+
+/* Must be called with the erase lock held */
+static BaseType_t prvErasePage( uint32_t bankNumber,
+                                uint32_t ulPage )
+{
+    BaseType_t xResult = pdTRUE;
+
+    configASSERT( bankNumber != prvGetActiveBank() );
+    configASSERT( ulPage < FLASH_PAGE_NB );
+
+    if( xEraseCtx.ulBank != bankNumber )
+    {
+        xEraseCtx.ulBank = bankNumber;
+        xEraseCtx.ulErasedPages = 0;
+    }
+
+    if( HAL_FLASH_Unlock() == HAL_OK )
+    {
+        uint32_t pageError = 0U;
+        FLASH_EraseInitTypeDef pEraseInit;
+
+        pEraseInit.Banks = bankNumber;
+        pEraseInit.NbPages = 1U;
+        pEraseInit.Page = ulPage;
+        pEraseInit.TypeErase = FLASH_TYPEERASE_PAGES;
+
+        if( HAL_FLASHEx_Erase( &pEraseInit, &pageError ) != HAL_OK )
+        {
+            LogError( "Failed to erase flash page %u, errorCode = %u.", ulPage, HAL_FLASH_GetError() );
+            xResult = pdFALSE;
+        }
+
+        ( void ) HAL_FLASH_Lock();
+    }
+    else
+    {
+        LogError( "Failed to lock flash for erase, errorCode = %u.", HAL_FLASH_GetError() );
+        xResult = pdFALSE;
+    }
+
+    /* Pages are erased in order, so only extend the erased range from its end */
+    if( ( xResult == pdTRUE ) &&
+        ( ulPage == xEraseCtx.ulErasedPages ) )
+    {
+        xEraseCtx.ulErasedPages++;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvEraseImageArea( uint32_t bankNumber,
+                                     uint32_t ulImageSize )
+{
+    static WatchdogClient_t xWatch;
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulPagesNeeded = ( ulImageSize + FLASH_PAGE_SIZE - 1U ) / FLASH_PAGE_SIZE;
+
+    configASSERT( ulPagesNeeded <= FLASH_PAGE_NB );
+
+    prvEraseLock();
+
+    if( xEraseCtx.ulBank != bankNumber )
+    {
+        xEraseCtx.ulBank = bankNumber;
+        xEraseCtx.ulErasedPages = 0;
+    }
+
+    if( xEraseCtx.ulErasedPages < ulPagesNeeded )
+    {
+        LogInfo( "Erasing %u of the %u flash pages needed for the image.",
+                 ulPagesNeeded - xEraseCtx.ulErasedPages, ulPagesNeeded );
+    }
+
+    vWatchdogStart( &xWatch, "ota_erase", OTA_PAL_WATCHDOG_DEADLINE );
+
+    while( ( xResult == pdTRUE ) &&
+           ( xEraseCtx.ulErasedPages < ulPagesNeeded ) )
+    {
+        vWatchdogCheckIn( &xWatch );
+        xResult = prvErasePage( bankNumber, xEraseCtx.ulErasedPages );
+    }
+
+    vWatchdogStop( &xWatch );
+
+    /* The pages will be programmed from here on */
+    xEraseCtx.ulErasedPages = 0;
+
+    prvEraseUnlock();
+
+    return xResult;
+}
+
+static BaseType_t prvResumeJobDigest( const OtaFileContext_t * pxFileContext,
+                                      uint8_t * pucDigest )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxFileContext->pSignature != NULL ) &&
+        ( pxFileContext->pSignature->size > 0 ) )
+    {
+        int lRslt = mbedtls_md( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ),
+                                pxFileContext->pSignature->data,
+                                pxFileContext->pSignature->size,
+                                pucDigest );
+
+        xResult = ( lRslt == 0 ) ? pdTRUE : pdFALSE;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvResumeSave( void )
+{
+    BaseType_t xResult = pdFALSE;
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+
+    if( pxLfsCtx != NULL )
+    {
+        lfs_file_t xFile = { 0 };
+        lfs_ssize_t xLfsErr = lfs_file_open( pxLfsCtx, &xFile, DOWNLOAD_CONTEXT_FILE_NAME, ( LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC ) );
+
+        if( xLfsErr == LFS_ERR_OK )
+        {
+            xLfsErr = lfs_file_write( pxLfsCtx, &xFile, &xResumeCtx, sizeof( OtaPalResumeCtx_t ) );
+            ( void ) lfs_file_close( pxLfsCtx, &xFile );
+        }
+
+        if( xLfsErr == sizeof( OtaPalResumeCtx_t ) )
+        {
+            xResult = pdTRUE;
+        }
+        else
+        {
+            LogWarn( "Failed to save the OTA download progress, error = %d.", xLfsErr );
+        }
+    }
+
+    return xResult;
+}
+
+static void prvResumeDelete( void )
+{
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+
+    xResumeActive = pdFALSE;
+    ulResumeUnflushed = 0;
+
+    if( pxLfsCtx != NULL )
+    {
+        ( void ) lfs_remove( pxLfsCtx, DOWNLOAD_CONTEXT_FILE_NAME );
+    }
+}
+
+static BaseType_t prvResumeExists( void )
+{
+    BaseType_t xResult = pdFALSE;
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+
+    if( pxLfsCtx != NULL )
+    {
+        struct lfs_info xFileInfo = { 0 };
+
+        xResult = ( lfs_stat( pxLfsCtx, DOWNLOAD_CONTEXT_FILE_NAME, &xFileInfo ) == LFS_ERR_OK ) ? pdTRUE : pdFALSE;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvResumeLoad( const OtaFileContext_t * pxFileContext,
+                                 uint32_t ulTargetBank )
+{
+    BaseType_t xResult = pdFALSE;
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+    uint8_t pucDigest[ OTA_RESUME_DIGEST_LEN ];
+
+    if( ( pxLfsCtx != NULL ) &&
+        ( prvResumeJobDigest( pxFileContext, pucDigest ) == pdTRUE ) )
+    {
+        lfs_file_t xFile = { 0 };
+        lfs_ssize_t xLfsErr = lfs_file_open( pxLfsCtx, &xFile, DOWNLOAD_CONTEXT_FILE_NAME, LFS_O_RDONLY );
+
+        if( xLfsErr == LFS_ERR_OK )
+        {
+            xLfsErr = lfs_file_read( pxLfsCtx, &xFile, &xResumeCtx, sizeof( OtaPalResumeCtx_t ) );
+            ( void ) lfs_file_close( pxLfsCtx, &xFile );
+
+            /* Only the same job into the same bank can pick up where it stopped */
+            if( ( xLfsErr == sizeof( OtaPalResumeCtx_t ) ) &&
+                ( xResumeCtx.ulMagic == OTA_RESUME_MAGIC ) &&
+                ( xResumeCtx.ulTargetBank == ulTargetBank ) &&
+                ( xResumeCtx.ulFileSize == pxFileContext->fileSize ) &&
+                ( memcmp( xResumeCtx.pucJobDigest, pucDigest, OTA_RESUME_DIGEST_LEN ) == 0 ) )
+            {
+                xResult = pdTRUE;
+            }
+            else
+            {
+                LogInfo( "Discarding the progress of a different OTA download." );
+            }
+        }
+    }
+
+    if( xResult == pdFALSE )
+    {
+        ( void ) memset( &xResumeCtx, 0, sizeof( OtaPalResumeCtx_t ) );
+        xResumeCtx.ulMagic = OTA_RESUME_MAGIC;
+        xResumeCtx.ulTargetBank = ulTargetBank;
+        xResumeCtx.ulFileSize = pxFileContext->fileSize;
+
+        xResumeActive = prvResumeJobDigest( pxFileContext, xResumeCtx.pucJobDigest );
+    }
+    else
+    {
+        xResumeActive = pdTRUE;
+    }
+
+    ulResumeUnflushed = 0;
+
+    return xResult;
+}
+
+static inline BaseType_t prvResumeIsReceived( uint32_t ulBlock )
+{
+    return ( ( xResumeCtx.pucReceived[ ulBlock >> 3 ] & ( 1U << ( ulBlock & 7U ) ) ) != 0U ) ? pdTRUE : pdFALSE;
+}
+
+static BaseType_t prvIsErased( uint32_t ulAddress,
+                               uint32_t ulLength )
+{
+    const uint32_t * pulWord = ( const uint32_t * ) ulAddress;
+    BaseType_t xResult = pdTRUE;
+
+    for( uint32_t ulIdx = 0; ( xResult == pdTRUE ) && ( ulIdx < ( ulLength / sizeof( uint32_t ) ) ); ulIdx++ )
+    {
+        if( pulWord[ ulIdx ] != 0xFFFFFFFFUL )
+        {
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvResumeRepair( uint32_t ulBank,
+                                   uint32_t ulBaseAddress,
+                                   uint32_t ulFileSize )
+{
+    static WatchdogClient_t xWatch;
+    BaseType_t xResult = pdTRUE;
+    const uint32_t ulBlockSize = ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE );
+    const uint32_t ulUnitSize = ( ulBlockSize > FLASH_PAGE_SIZE ) ? ulBlockSize : FLASH_PAGE_SIZE;
+
+    prvEraseLock();
+
+    vWatchdogStart( &xWatch, "ota_repair", OTA_PAL_WATCHDOG_DEADLINE );
+
+    /* Blocks written after the last flush were programmed but not recorded. Flash can not be
+     * programmed twice, so erase every unit of whole pages and blocks holding such a block. */
+    for( uint32_t ulUnit = 0; ( xResult == pdTRUE ) && ( ulUnit < ulFileSize ); ulUnit += ulUnitSize )
+    {
+        uint32_t ulUnitEnd = ( ( ulUnit + ulUnitSize ) < ulFileSize ) ? ( ulUnit + ulUnitSize ) : ulFileSize;
+        BaseType_t xDirty = pdFALSE;
+
+        vWatchdogCheckIn( &xWatch );
+
+        for( uint32_t ulOffset = ulUnit; ( xDirty == pdFALSE ) && ( ulOffset < ulUnitEnd ); ulOffset += ulBlockSize )
+        {
+            uint32_t ulLength = ( ( ulOffset + ulBlockSize ) < ulUnitEnd ) ? ulBlockSize : ( ulUnitEnd - ulOffset );
+
+            if( ( prvResumeIsReceived( ulOffset >> otaconfigLOG2_FILE_BLOCK_SIZE ) == pdFALSE ) &&
+                ( prvIsErased( ulBaseAddress + ulOffset, ulLength ) == pdFALSE ) )
+            {
+                xDirty = pdTRUE;
+            }
+        }
+
+        if( xDirty == pdTRUE )
+        {
+            for( uint32_t ulPage = ulUnit / FLASH_PAGE_SIZE;
+                 ( xResult == pdTRUE ) && ( ulPage < ( ( ulUnit + ulUnitSize ) / FLASH_PAGE_SIZE ) );
+                 ulPage++ )
+            {
+                vWatchdogCheckIn( &xWatch );
+                xResult = prvErasePage( ulBank, ulPage );
+            }
+
+            for( uint32_t ulOffset = ulUnit; ulOffset < ulUnitEnd; ulOffset += ulBlockSize )
+            {
+                uint32_t ulBlock = ulOffset >> otaconfigLOG2_FILE_BLOCK_SIZE;
+
+                xResumeCtx.pucReceived[ ulBlock >> 3 ] &= ( uint8_t ) ~( 1U << ( ulBlock & 7U ) );
+            }
+        }
+    }
+
+    vWatchdogStop( &xWatch );
+
+    /* The pages will be programmed from here on */
+    xEraseCtx.ulErasedPages = 0;
+
+    prvEraseUnlock();
+
+    return xResult;
+}
+
+static void prvResumeApply( OtaFileContext_t * pxFileContext,
+                            OtaPalContext_t * pxContext )
+{
+    static WatchdogClient_t xWatch;
+    const uint32_t ulBlockSize = ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE );
+    const uint32_t ulImageLen = pxFileContext->fileSize - pxContext->ulImageOffset;
+    const uint32_t ulFirstBlock = pxContext->ulImageOffset >> otaconfigLOG2_FILE_BLOCK_SIZE;
+    uint32_t ulBlocks = ( ulImageLen + ulBlockSize - 1U ) >> otaconfigLOG2_FILE_BLOCK_SIZE;
+    uint32_t ulReceived = 0;
+    uint32_t ulPrefix = 0;
+
+    for( uint32_t ulBlock = 0; ulBlock < ulBlocks; ulBlock++ )
+    {
+        if( prvResumeIsReceived( ulBlock ) == pdTRUE )
+        {
+            uint32_t ulFileBlock = ulFirstBlock + ulBlock;
+
+            /* A set bit in the agent's bitmap marks a block which is still needed */
+            pxFileContext->pRxBlockBitmap[ ulFileBlock >> 3 ] &= ( uint8_t ) ~( 1U << ( ulFileBlock & 7U ) );
+            ulReceived++;
+
+            if( ulPrefix == ( ulBlock << otaconfigLOG2_FILE_BLOCK_SIZE ) )
+            {
+                ulPrefix = ( ( ulBlock + 1U ) << otaconfigLOG2_FILE_BLOCK_SIZE );
+            }
+        }
+    }
+
+    if( ulPrefix > ulImageLen )
+    {
+        ulPrefix = ulImageLen;
+    }
+
+    pxFileContext->blocksRemaining = ( pxFileContext->blocksRemaining > ulReceived ) ?
+                                     ( pxFileContext->blocksRemaining - ulReceived ) : 0U;
+
+    /* Bring the running hash up to the first missing block */
+    vWatchdogStart( &xWatch, "ota_resume", OTA_PAL_WATCHDOG_DEADLINE );
+
+    for( uint32_t ulOffset = 0; ulOffset < ulPrefix; ulOffset += OTA_FLASH_CHUNK_SIZE )
+    {
+        uint32_t ulChunk = ( ( ulPrefix - ulOffset ) > OTA_FLASH_CHUNK_SIZE ) ? OTA_FLASH_CHUNK_SIZE : ( ulPrefix - ulOffset );
+
+        vWatchdogCheckIn( &xWatch );
+        prvImageHashUpdate( pxContext, ulOffset, ( const uint8_t * ) ( pxContext->ulBaseAddress + ulOffset ), ulChunk );
+    }
+
+    vWatchdogStop( &xWatch );
+
+    LogInfo( "Resuming the OTA download with %u of %u blocks already received.", ulReceived, ulBlocks );
+}
+
+static void prvResumeRecordBlock( uint32_t ulOffset )
+{
+    uint32_t ulBlock = ulOffset >> otaconfigLOG2_FILE_BLOCK_SIZE;
+
+    if( ( xResumeActive == pdTRUE ) &&
+        ( ulBlock < OTA_RESUME_MAX_BLOCKS ) )
+    {
+        xResumeCtx.pucReceived[ ulBlock >> 3 ] |= ( uint8_t ) ( 1U << ( ulBlock & 7U ) );
+        ulResumeUnflushed++;
+
+        /* Batch the flushes to limit file system wear */
+        if( ulResumeUnflushed >= OTA_RESUME_FLUSH_BLOCKS )
+        {
+            ( void ) prvResumeSave();
+            ulResumeUnflushed = 0;
+        }
+    }
+}
+
+static void prvRequeueReset( void )
+{
+    ( void ) memset( &xRequeueCtx, 0, sizeof( OtaPalRequeueCtx_t ) );
+}
+
+static BaseType_t prvRequeueBlock( OtaFileContext_t * pxFileContext,
+                                   uint32_t ulOffset )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulBlock = ulOffset >> otaconfigLOG2_FILE_BLOCK_SIZE;
+
+    if( ( ulBlock >= OTA_RESUME_MAX_BLOCKS ) ||
+        ( xRequeueCtx.ulTotal >= OTA_PAL_MAX_REQUEUED_BLOCKS ) )
+    {
+        LogError( "Too many OTA blocks refused, failing the download." );
+        xResult = pdFALSE;
+    }
+    else if( ( xRequeueCtx.pucBlocks[ ulBlock >> 3 ] & ( 1U << ( ulBlock & 7U ) ) ) == 0U )
+    {
+        xRequeueCtx.pucBlocks[ ulBlock >> 3 ] |= ( uint8_t ) ( 1U << ( ulBlock & 7U ) );
+        xRequeueCtx.pxFileContext = pxFileContext;
+        xRequeueCtx.ulPending++;
+        xRequeueCtx.ulTotal++;
+
+        /* Offsets the decrement by the agent, so that the file is not complete without it */
+        pxFileContext->blocksRemaining++;
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return xResult;
+}
+
+static void prvRequeueApply( void )
+{
+    OtaFileContext_t * pxFileContext = xRequeueCtx.pxFileContext;
+
+    if( ( xRequeueCtx.ulPending > 0 ) &&
+        ( pxFileContext != NULL ) &&
+        ( pxFileContext->pRxBlockBitmap != NULL ) )
+    {
+        uint32_t ulBlocks = ( pxFileContext->fileSize + ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE ) - 1U ) >> otaconfigLOG2_FILE_BLOCK_SIZE;
+
+        for( uint32_t ulIdx = 0; ulIdx < ( ( ulBlocks + 7U ) / 8U ); ulIdx++ )
+        {
+            pxFileContext->pRxBlockBitmap[ ulIdx ] |= xRequeueCtx.pucBlocks[ ulIdx ];
+            xRequeueCtx.pucBlocks[ ulIdx ] = 0;
+        }
+
+        xRequeueCtx.ulPending = 0;
+    }
+}
+
+void otaPal_RequeueRejectedBlocks( void )
+{
+    prvRequeueApply();
+}
+
+static BaseType_t prvManifestStart( const OtaFileContext_t * pxFileContext )
+{
+    BaseType_t xResult = pdFALSE;
+    size_t uxBufferLen = uxOtaManifestBufferSize( pxFileContext->fileSize, otaconfigLOG2_FILE_BLOCK_SIZE );
+
+    if( uxBufferLen == 0 )
+    {
+        LogError( "The manifest of a %u byte file would not fit in %u blocks.",
+                  pxFileContext->fileSize, OTA_MANIFEST_MAX_BLOCKS );
+    }
+    else if( ( pucManifestBuffer = pvPortMalloc( uxBufferLen ) ) == NULL )
+    {
+        LogError( "Failed to allocate %u bytes for the OTA manifest.", uxBufferLen );
+    }
+    else
+    {
+        vOtaManifestInit( &xManifestCtx, pucManifestBuffer, uxBufferLen,
+                          pxFileContext->fileSize, otaconfigLOG2_FILE_BLOCK_SIZE );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static void prvManifestFree( void )
+{
+    if( pucManifestBuffer != NULL )
+    {
+        vPortFree( pucManifestBuffer );
+        pucManifestBuffer = NULL;
+    }
+
+    ( void ) memset( &xManifestCtx, 0, sizeof( OtaManifestCtx_t ) );
+}
+
+static BaseType_t prvManifestVerify( const OtaFileContext_t * pxFileContext,
+                                     OtaPalContext_t * pxContext )
+{
+    BaseType_t xResult = pdFALSE;
+    uint8_t pucDigest[ OTA_MANIFEST_HASH_LEN ];
+    const uint8_t * pucSignature = NULL;
+    size_t uxSignatureLen = 0;
+
+    if( xOtaManifestDigest( &xManifestCtx, pucDigest, &pucSignature, &uxSignatureLen ) != pdTRUE )
+    {
+        LogError( "Failed to hash the OTA manifest." );
+    }
+    else if( OTA_PAL_MAIN_ERR( prvValidateSignature( ( const char * ) pxFileContext->pCertFilepath,
+                                                     pucSignature, uxSignatureLen,
+                                                     pucDigest, sizeof( pucDigest ) ) ) != OtaPalSuccess )
+    {
+        LogError( "OTA manifest signature verification failed." );
+    }
+    else if( ( xResumeActive == pdTRUE ) &&
+             ( xResumeCtx.ulImageOffset != 0 ) &&
+             ( xResumeCtx.ulImageOffset != ulOtaManifestSize( &xManifestCtx ) ) )
+    {
+        LogError( "OTA manifest does not match the resumed download." );
+    }
+    else
+    {
+        vOtaManifestSetVerified( &xManifestCtx );
+
+        pxContext->ulImageOffset = ulOtaManifestSize( &xManifestCtx );
+        pxContext->ulImageSize = ulOtaManifestImageSize( &xManifestCtx );
+        xResumeCtx.ulImageOffset = pxContext->ulImageOffset;
+
+        LogInfo( "OTA manifest verified: %u byte image at offset %u.",
+                 pxContext->ulImageSize, pxContext->ulImageOffset );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*
+ * Image blocks are checked against the manifest before they are programmed, so a refused block
+ * leaves the flash erased and is simply requested again. Image blocks which arrive before the
+ * manifest has been verified are refused the same way.
+ */
+static int16_t prvManifestWriteBlock( OtaFileContext_t * pxFileContext,
+                                      OtaPalContext_t * pxContext,
+                                      uint32_t ulOffset,
+                                      uint8_t * pucData,
+                                      uint32_t ulLength )
+{
+    int16_t sBytesWritten = -1;
+    BaseType_t xRequeue = pdFALSE;
+
+    if( xOtaManifestIsVerified( &xManifestCtx ) == pdFALSE )
+    {
+        switch( xOtaManifestFeed( &xManifestCtx, ulOffset, pucData, ulLength ) )
+        {
+            case OTA_MANIFEST_OK:
+                sBytesWritten = ( int16_t ) ulLength;
+                break;
+
+            case OTA_MANIFEST_COMPLETE:
+
+                if( prvManifestVerify( pxFileContext, pxContext ) == pdTRUE )
+                {
+                    sBytesWritten = ( int16_t ) ulLength;
+                }
+
+                break;
+
+            case OTA_MANIFEST_SKIP:
+                xRequeue = pdTRUE;
+                break;
+
+            default:
+                LogError( "Invalid OTA manifest block at offset %u.", ulOffset );
+                break;
+        }
+    }
+    else if( ulOffset < pxContext->ulImageOffset )
+    {
+        /* Manifest block received again */
+        sBytesWritten = ( int16_t ) ulLength;
+    }
+    else if( xOtaManifestCheckBlock( &xManifestCtx, ulOffset - pxContext->ulImageOffset, pucData, ulLength ) != OTA_MANIFEST_OK )
+    {
+        LogWarn( "OTA block at offset %u does not match the manifest, requesting it again.", ulOffset );
+        xRequeue = pdTRUE;
+    }
+    else if( prvWriteToFlash( ( pxContext->ulBaseAddress + ulOffset - pxContext->ulImageOffset ), pucData, ulLength ) == HAL_OK )
+    {
+        sBytesWritten = ( int16_t ) ulLength;
+
+        prvImageHashUpdate( pxContext, ulOffset - pxContext->ulImageOffset, pucData, ulLength );
+        prvResumeRecordBlock( ulOffset - pxContext->ulImageOffset );
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    if( ( xRequeue == pdTRUE ) &&
+        ( prvRequeueBlock( pxFileContext, ulOffset ) == pdTRUE ) )
+    {
+        /* Nothing was written, the block counts as received until the bitmap is restored */
+        sBytesWritten = ( int16_t ) ulLength;
+    }
+
+    return sBytesWritten;
+}
+
+static void prvBackgroundEraseTask( void * pvParameters )
+{
+    uint32_t ulBank = ( uint32_t ) pvParameters;
+    BaseType_t xResult = pdTRUE;
+
+    LogInfo( "Background erase of flash bank %u started.", ulBank );
+
+    while( ( xResult == pdTRUE ) &&
+           ( xEraseCtx.xStop == pdFALSE ) )
+    {
+        prvEraseLock();
+
+        if( ( xEraseCtx.xStop == pdFALSE ) &&
+            ( ( xEraseCtx.ulBank != ulBank ) ||
+              ( xEraseCtx.ulErasedPages < FLASH_PAGE_NB ) ) )
+        {
+            xResult = prvErasePage( ulBank, ( xEraseCtx.ulBank == ulBank ) ? xEraseCtx.ulErasedPages : 0U );
+        }
+        else
+        {
+            xEraseCtx.xStop = pdTRUE;
+        }
+
+        prvEraseUnlock();
+
+        /* Give way to other low priority work between pages */
+        vTaskDelay( 1 );
+    }
+
+    LogInfo( "Background erase of flash bank %u ended with %u pages erased.", ulBank, xEraseCtx.ulErasedPages );
+
+    xEraseCtx.xTaskHandle = NULL;
+
+    vTaskDelete( NULL );
+}
+
+static void prvBackgroundEraseStop( void )
+{
+    xEraseCtx.xStop = pdTRUE;
+
+    /* Wait for a page erase in progress, the task does not erase again once stopped */
+    prvEraseLock();
+    prvEraseUnlock();
+}
+
+static void prvBackgroundEraseStart( uint32_t bankNumber )
+{
+    if( ( xEraseCtx.xTaskHandle == NULL ) &&
+        ( bankNumber != 0UL ) &&
+        ( bankNumber != prvGetActiveBank() ) &&
+        ( READ_BIT( FLASH->OPTR, FLASH_OPTR_DUALBANK ) != 0U ) &&
+        ( ( xEraseCtx.ulBank != bankNumber ) ||
+          ( xEraseCtx.ulErasedPages < FLASH_PAGE_NB ) ) )
+    {
+        xEraseCtx.xStop = pdFALSE;
+
+        if( xTaskCreate( prvBackgroundEraseTask, "OtaErase", OTA_PAL_ERASE_TASK_STACK,
+                         ( void * ) bankNumber, OTA_PAL_ERASE_TASK_PRIORITY,
+                         &( xEraseCtx.xTaskHandle ) ) != pdPASS )
+        {
+            LogWarn( "Failed to start the background erase task." );
+            xEraseCtx.xTaskHandle = NULL;
+        }
+    }
+}
+
+static BaseType_t prvEraseBank( uint32_t bankNumber )
+{
+    BaseType_t xResult = pdTRUE;
+
+    configASSERT( ( bankNumber == FLASH_BANK_1 ) || ( bankNumber == FLASH_BANK_2 ) );
+
+    configASSERT( bankNumber != prvGetActiveBank() );
+
+    prvEraseLock();
+
+    xEraseCtx.ulBank = bankNumber;
+    xEraseCtx.ulErasedPages = 0;
+
+    if( HAL_FLASH_Unlock() == HAL_OK )
+    {
+        uint32_t pageError = 0U;
+        FLASH_EraseInitTypeDef pEraseInit;
+
+        pEraseInit.Banks = bankNumber;
+        pEraseInit.NbPages = FLASH_PAGE_NB;
+        pEraseInit.Page = 0U;
+        pEraseInit.TypeErase = FLASH_TYPEERASE_MASSERASE;
+
+        if( HAL_FLASHEx_Erase( &pEraseInit, &pageError ) != HAL_OK )
+        {
+            LogError( "Failed to erase the flash bank, errorCode = %u, pageError = %u.", HAL_FLASH_GetError(), pageError );
+            xResult = pdFALSE;
+        }
+        else
+        {
+            xEraseCtx.ulErasedPages = FLASH_PAGE_NB;
+        }
+
+        ( void ) HAL_FLASH_Lock();
+    }
+    else
+    {
+        LogError( "Failed to lock flash for erase, errorCode = %u.", HAL_FLASH_GetError() );
+        xResult = pdFALSE;
+    }
+
+    prvEraseUnlock();
+
+    return xResult;
+}
+
+/*
+ * The image hash is accumulated while the image is received so that
+ * otaPal_CloseFile only hashes what was not seen in order. SHA-256 runs
+ * through mbedtls_md, i.e. on the HASH peripheral when MBEDTLS_SHA256_ALT is
+ * enabled. The context stays live across blocks while TLS uses the peripheral
+ * in between: hash_claim() saves the intermediate digest of the previous owner
+ * when the peripheral changes hands, and that owner restores it when it comes
+ * back.
+ */
+static void prvImageHashFree( OtaPalContext_t * pxContext )
+{
+    if( pxContext != NULL )
+    {
+        if( pxContext->xHashActive == pdTRUE )
+        {
+            mbedtls_md_free( &( pxContext->xHashCtx ) );
+        }
+
+        pxContext->xHashActive = pdFALSE;
+        pxContext->ulHashedBytes = 0;
+    }
+}
+
+static void prvImageHashStart( OtaPalContext_t * pxContext )
+{
+    int lRslt = 0;
+
+    configASSERT( pxContext != NULL );
+
+    prvImageHashFree( pxContext );
+
+    mbedtls_md_init( &( pxContext->xHashCtx ) );
+    pxContext->xHashActive = pdTRUE;
+
+    lRslt = mbedtls_md_setup( &( pxContext->xHashCtx ),
+                              mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ), 0 );
+
+    if( lRslt == 0 )
+    {
+        lRslt = mbedtls_md_starts( &( pxContext->xHashCtx ) );
+    }
+
+    if( lRslt != 0 )
+    {
+        MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to start the image hash. The image will be hashed on close." );
+        prvImageHashFree( pxContext );
+    }
+}
+
+static void prvImageHashUpdate( OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                const uint8_t * pucData,
+                                uint32_t ulLength )
+{
+    configASSERT( pxContext != NULL );
+
+    /* Blocks received out of order are picked up from flash on close */
+    if( ( pxContext->xHashActive == pdTRUE ) &&
+        ( ulOffset == pxContext->ulHashedBytes ) )
+    {
+        int lRslt = mbedtls_md_update( &( pxContext->xHashCtx ), pucData, ulLength );
+
+        if( lRslt != 0 )
+        {
+            MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to update the image hash." );
+            prvImageHashFree( pxContext );
+        }
+        else
+        {
+            pxContext->ulHashedBytes += ulLength;
+        }
+    }
+}
+
+static BaseType_t xFinishImageHash( OtaPalContext_t * pxContext,
+                                    unsigned char * pucHashBuffer,
+                                    size_t uxHashBufferLength,
+                                    size_t * puxHashLength )
+{
+    static WatchdogClient_t xWatch;
+    BaseType_t xResult = pdTRUE;
+    const mbedtls_md_info_t * pxMdInfo = NULL;
+    int lRslt = 0;
+
+    configASSERT( pxContext != NULL );
+    configASSERT( pucHashBuffer != NULL );
+    configASSERT( pxContext->ulImageSize > 0 );
+    configASSERT( uxHashBufferLength > 0 );
+
+    pxMdInfo = mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 );
+
+    if( pxMdInfo == NULL )
+    {
+        LogError( "Failed to initialize mbedtls md_info object." );
+        xResult = pdFALSE;
+    }
+    else if( mbedtls_md_get_size( pxMdInfo ) > uxHashBufferLength )
+    {
+        LogError( "Hash buffer is too small." );
+        xResult = pdFALSE;
+    }
+    else if( pxContext->xHashActive == pdFALSE )
+    {
+        /* No running hash, start over from the beginning of the staged image */
+        prvImageHashStart( pxContext );
+
+        if( pxContext->xHashActive == pdFALSE )
+        {
+            xResult = pdFALSE;
+        }
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    if( xResult == pdTRUE )
+    {
+        LogInfo( "Image hash: %lu bytes hashed during transfer, %lu bytes remaining.",
+                 pxContext->ulHashedBytes,
+                 pxContext->ulImageSize - pxContext->ulHashedBytes );
+    }
+
+    /* Hash whatever was not received in order directly from flash */
+    vWatchdogStart( &xWatch, "ota_hash", OTA_PAL_WATCHDOG_DEADLINE );
+
+    while( ( xResult == pdTRUE ) &&
+           ( pxContext->ulHashedBytes < pxContext->ulImageSize ) )
+    {
+        uint32_t ulChunk = pxContext->ulImageSize - pxContext->ulHashedBytes;
+
+        if( ulChunk > OTA_FLASH_CHUNK_SIZE )
+        {
+            ulChunk = OTA_FLASH_CHUNK_SIZE;
+        }
+
+        vWatchdogCheckIn( &xWatch );
+
+        lRslt = mbedtls_md_update( &( pxContext->xHashCtx ),
+                                   ( const unsigned char * ) ( pxContext->ulBaseAddress + pxContext->ulHashedBytes ),
+                                   ulChunk );
+
+        if( lRslt != 0 )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            pxContext->ulHashedBytes += ulChunk;
+        }
+    }
+
+    vWatchdogStop( &xWatch );
+
+    if( xResult == pdTRUE )
+    {
+        lRslt = mbedtls_md_finish( &( pxContext->xHashCtx ), pucHashBuffer );
+
+        if( lRslt != 0 )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            *puxHashLength = mbedtls_md_get_size( pxMdInfo );
+        }
+    }
+
+    MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to compute hash of the staged firmware image." );
 
+    prvImageHashFree( pxContext );
 
-    ( void ) HAL_FLASH_Unlock();
-    ( void ) HAL_FLASH_OB_Unlock();
-    /* Generate System Reset to load the new option byte values ***************/
-    /* On successful option bytes loading the system should reset and control should not return from this function. */
-    ( void ) HAL_FLASH_OB_Launch();
+    return xResult;
 }
 
-static uint32_t prvGetActiveBank( void )
+static const OtaPalFileType_t * prvGetFileType( const OtaFileContext_t * pxFileContext )
 {
-    if( ulBankAtBootup == 0 )
+    const OtaPalFileType_t * pxFileType = NULL;
+
+    for( size_t uxIdx = 0; uxIdx < ( sizeof( xFileTypes ) / sizeof( xFileTypes[ 0 ] ) ); uxIdx++ )
     {
-        ulBankAtBootup = prvGetBankSettingFromOB();
+        if( strncmp( xFileTypes[ uxIdx ].pcFileName, ( char * ) pxFileContext->pFilePath,
+                     pxFileContext->filePathMaxSize ) == 0 )
+        {
+            pxFileType = &( xFileTypes[ uxIdx ] );
+            break;
+        }
     }
 
-    return ulBankAtBootup;
+    return pxFileType;
 }
 
-static uint32_t prvGetBankSettingFromOB( void )
+static BaseType_t prvImageWrite( void * pvCtx,
+                                 uint32_t ulOffset,
+                                 const uint8_t * pucData,
+                                 uint32_t ulLength )
 {
-    uint32_t ulCurrentBank = 0UL;
-    FLASH_OBProgramInitTypeDef xObContext = { 0 };
+    OtaPalContext_t * pxContext = ( OtaPalContext_t * ) pvCtx;
+    BaseType_t xResult = pdTRUE;
 
-    /* Get the Dual boot configuration status */
-    HAL_FLASHEx_OBGetConfig( &xObContext );
+    configASSERT( pxContext != NULL );
 
-    if( ( xObContext.USERConfig & OB_SWAP_BANK_ENABLE ) == OB_SWAP_BANK_ENABLE )
+    if( ( pxContext->ulBaseAddress + ulOffset + ulLength ) > pxContext->ulStageAddress )
     {
-        ulCurrentBank = FLASH_BANK_2;
+        LogError( "Reconstructed image would overwrite the staged file." );
+        xResult = pdFALSE;
+    }
+    else if( prvWriteToFlash( ( pxContext->ulBaseAddress + ulOffset ), ( uint8_t * ) pucData, ulLength ) != HAL_OK )
+    {
+        xResult = pdFALSE;
     }
     else
     {
-        ulCurrentBank = FLASH_BANK_1;
+        prvImageHashUpdate( pxContext, ulOffset, pucData, ulLength );
     }
 
-    return ulCurrentBank;
+    return xResult;
 }
 
-static uint32_t prvGetInactiveBank( void )
+static BaseType_t prvDeltaFeed( const uint8_t * pucPatch,
+                                uint32_t ulLength )
 {
-    uint32_t ulActiveBank = prvGetActiveBank();
-
-    uint32_t ulInactiveBank;
+    BaseType_t xResult = pdTRUE;
+    OtaDeltaStatus_t xStatus = xOtaDeltaProcess( &xDeltaCtx, pucPatch, ulLength );
 
-    if( ulActiveBank == FLASH_BANK_1 )
+    if( ( xStatus != OTA_DELTA_OK ) &&
+        ( xStatus != OTA_DELTA_COMPLETE ) )
     {
-        ulInactiveBank = FLASH_BANK_2;
+        LogError( "Failed to apply the delta patch, error: %d.", xStatus );
+        xResult = pdFALSE;
     }
-    else if( ulActiveBank == FLASH_BANK_2 )
+
+    return xResult;
+}
+
+static BaseType_t prvDecompressOutput( void * pvCtx,
+                                       const uint8_t * pucData,
+                                       uint32_t ulLength )
+{
+    OtaPalContext_t * pxContext = ( OtaPalContext_t * ) pvCtx;
+    BaseType_t xResult = pdTRUE;
+
+    configASSERT( pxContext != NULL );
+
+    if( pxContext->xDeltaUpdate == pdTRUE )
     {
-        ulInactiveBank = FLASH_BANK_1;
+        xResult = prvDeltaFeed( pucData, ulLength );
     }
     else
     {
-        ulInactiveBank = 0UL;
+        xResult = prvImageWrite( pxContext, pxContext->ulImageWritten, pucData, ulLength );
+        pxContext->ulImageWritten += ulLength;
     }
 
-    return ulInactiveBank;
+    return xResult;
 }
 
-
-static HAL_StatusTypeDef prvWriteToFlash( uint32_t destination,
-                                          uint8_t * pSource,
-                                          uint32_t ulLength )
+static BaseType_t prvStageApply( OtaPalContext_t * pxContext,
+                                 uint32_t ulOffset,
+                                 const uint8_t * pucData,
+                                 uint32_t ulLength )
 {
-    HAL_StatusTypeDef status = HAL_OK;
-    uint32_t i = 0U;
-    uint8_t quadWord[ 16 ] = { 0 };
-    uint32_t numQuadWords = NUM_QUAD_WORDS( ulLength );
-    uint32_t remainingBytes = NUM_REMAINING_BYTES( ulLength );
-
-    /* Unlock the Flash to enable the flash control register access *************/
-    HAL_FLASH_Unlock();
+    BaseType_t xResult = pdTRUE;
 
-    for( i = 0U; i < numQuadWords; i++ )
+    /* Blocks received out of order are applied from the staged copy on close */
+    if( ulOffset == pxContext->ulStageApplied )
     {
-        /* Pet the watchdog */
-        vPetWatchdog();
-
-        /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-         * be done by word */
-
-        memcpy( quadWord, pSource, 16UL );
-        status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, destination, ( uint32_t ) quadWord );
-
-        if( status == HAL_OK )
+        if( pxContext->xCompressed == pdTRUE )
         {
-            /* Check the written value */
-            if( memcmp( ( void * ) destination, quadWord, 16UL ) != 0 )
+            if( xOtaDecompressProcess( &xDecompressCtx, pucData, ulLength ) != OTA_DECOMPRESS_OK )
             {
-                /* Flash content doesn't match SRAM content */
-                status = HAL_ERROR;
+                LogError( "Failed to decompress the OTA file at offset %u.", ulOffset );
+                xResult = pdFALSE;
             }
         }
-
-        if( status == HAL_OK )
-        {
-            /* Increment FLASH destination address and the source address. */
-            destination += 16UL;
-            pSource += 16UL;
-        }
         else
         {
-            break;
+            xResult = prvDeltaFeed( pucData, ulLength );
         }
-    }
 
-    if( status == HAL_OK )
-    {
-        if( remainingBytes > 0 )
+        if( xResult == pdTRUE )
         {
-            memcpy( quadWord, pSource, remainingBytes );
-            memset( ( quadWord + remainingBytes ), 0xFF, ( 16UL - remainingBytes ) );
-
-            status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, destination, ( uint32_t ) quadWord );
-
-            if( status == HAL_OK )
-            {
-                /* Check the written value */
-                if( memcmp( ( void * ) destination, quadWord, 16UL ) != 0 )
-                {
-                    /* Flash content doesn't match SRAM content */
-                    status = HAL_ERROR;
-                }
-            }
+            pxContext->ulStageApplied += ulLength;
         }
     }
 
-    /* Lock the Flash to disable the flash control register access (recommended
-     *  to protect the FLASH memory against possible unwanted operation) *********/
-    HAL_FLASH_Lock();
-
-    return status;
+    return xResult;
 }
 
-static BaseType_t prvEraseBank( uint32_t bankNumber )
+static BaseType_t prvStageFinish( OtaPalContext_t * pxContext )
 {
+    static WatchdogClient_t xWatch;
     BaseType_t xResult = pdTRUE;
 
-    configASSERT( ( bankNumber == FLASH_BANK_1 ) || ( bankNumber == FLASH_BANK_2 ) );
-
-    configASSERT( bankNumber != prvGetActiveBank() );
+    vWatchdogStart( &xWatch, "ota_stage", OTA_PAL_WATCHDOG_DEADLINE );
 
-    if( HAL_FLASH_Unlock() == HAL_OK )
+    while( ( xResult == pdTRUE ) &&
+           ( pxContext->ulStageApplied < pxContext->ulFileSize ) )
     {
-        uint32_t pageError = 0U;
-        FLASH_EraseInitTypeDef pEraseInit;
-
-        pEraseInit.Banks = bankNumber;
-        pEraseInit.NbPages = FLASH_PAGE_NB;
-        pEraseInit.Page = 0U;
-        pEraseInit.TypeErase = FLASH_TYPEERASE_MASSERASE;
+        uint32_t ulChunk = pxContext->ulFileSize - pxContext->ulStageApplied;
 
-        if( HAL_FLASHEx_Erase( &pEraseInit, &pageError ) != HAL_OK )
+        if( ulChunk > OTA_FLASH_CHUNK_SIZE )
         {
-            LogError( "Failed to erase the flash bank, errorCode = %u, pageError = %u.", HAL_FLASH_GetError(), pageError );
-            xResult = pdFALSE;
+            ulChunk = OTA_FLASH_CHUNK_SIZE;
         }
 
-        ( void ) HAL_FLASH_Lock();
-    }
-    else
-    {
-        LogError( "Failed to lock flash for erase, errorCode = %u.", HAL_FLASH_GetError() );
-        xResult = pdFALSE;
-    }
-
-    return xResult;
-}
-
-static BaseType_t xCalculateImageHash( const unsigned char * pucImageAddress,
-                                       const size_t uxImageLength,
-                                       unsigned char * pucHashBuffer,
-                                       size_t uxHashBufferLength,
-                                       size_t * puxHashLength )
-{
-    BaseType_t xResult = pdTRUE;
-    const mbedtls_md_info_t * pxMdInfo = NULL;
+        vWatchdogCheckIn( &xWatch );
 
-    pxMdInfo = mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 );
+        xResult = prvStageApply( pxContext, pxContext->ulStageApplied,
+                                 ( const uint8_t * ) ( pxContext->ulStageAddress + pxContext->ulStageApplied ),
+                                 ulChunk );
+    }
 
-    configASSERT( pucHashBuffer != NULL );
-    configASSERT( pucImageAddress != NULL );
-    configASSERT( uxImageLength > 0 );
-    configASSERT( uxHashBufferLength > 0 );
+    vWatchdogStop( &xWatch );
 
-    if( pxMdInfo == NULL )
+    if( ( xResult == pdTRUE ) &&
+        ( pxContext->xCompressed == pdTRUE ) &&
+        ( xOtaDecompressFinish( &xDecompressCtx, NULL ) != OTA_DECOMPRESS_OK ) )
     {
-        LogError( "Failed to initialize mbedtls md_info object." );
         xResult = pdFALSE;
     }
-    else if( mbedtls_md_get_size( pxMdInfo ) > uxHashBufferLength )
+
+    if( xResult != pdTRUE )
     {
-        LogError( "Hash buffer is too small." );
-        xResult = pdFALSE;
+        /* Empty */
     }
-    else
+    else if( pxContext->xDeltaUpdate == pdTRUE )
     {
-        int lRslt = 0;
-        size_t uxHashLength = 0;
-
-        uxHashLength = mbedtls_md_get_size( pxMdInfo );
-
-        configASSERT( uxHashLength <= MBEDTLS_MD_MAX_SIZE );
-
-        lRslt = mbedtls_md( pxMdInfo, pucImageAddress, uxImageLength, pucHashBuffer );
-
-        MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to compute hash of the staged firmware image." );
-
-        if( lRslt != 0 )
+        if( xOtaDeltaProcess( &xDeltaCtx, NULL, 0 ) != OTA_DELTA_COMPLETE )
         {
+            LogError( "Delta patch ended before the image was complete." );
             xResult = pdFALSE;
         }
         else
         {
-            *puxHashLength = uxHashLength;
+            pxContext->ulImageSize = ulOtaDeltaNewSize( &xDeltaCtx );
         }
     }
+    else
+    {
+        LogInfo( "Decompressed a %u byte OTA file to %u bytes.", pxContext->ulFileSize, pxContext->ulImageWritten );
+        pxContext->ulImageSize = pxContext->ulImageWritten;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( pxContext->ulImageSize < OTA_IMAGE_MIN_SIZE ) )
+    {
+        LogError( "Reconstructed image is too small." );
+        xResult = pdFALSE;
+    }
 
     return xResult;
 }
@@ -791,6 +2049,7 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
 {
     OtaPalStatus_t uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
     OtaPalContext_t * pxContext = prvGetImageContext();
+    const OtaPalFileType_t * pxFileType = NULL;
 
     /* Handle back to back updates */
     if( ( pxContext->xPalState == OTA_PAL_ACCEPTED ) ||
@@ -806,7 +2065,7 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
     {
         uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
     }
-    else if( strncmp( "b_u585i_iot02a_ntz.bin", ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) != 0 )
+    else if( ( pxFileType = prvGetFileType( pxFileContext ) ) == NULL )
     {
         uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
     }
@@ -819,9 +2078,25 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
     else
     {
         uint32_t ulTargetBank = 0UL;
+        BaseType_t xStaged = ( ( pxFileType->xDeltaUpdate == pdTRUE ) ||
+                               ( pxFileType->xCompressed == pdTRUE ) ) ? pdTRUE : pdFALSE;
+        BaseType_t xResumed = pdFALSE;
+
+        /* The image area is erased below, no need to finish the rest of the bank now */
+        prvBackgroundEraseStop();
+
+        prvRequeueReset();
+        prvManifestFree();
+
+        if( ( pxFileType->xManifest == pdTRUE ) &&
+            ( prvManifestStart( pxFileContext ) != pdTRUE ) )
+        {
+            uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+        }
 
         /* Set dual bank mode if not already set. */
-        if( prvFlashSetDualBankMode() != HAL_OK )
+        if( ( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess ) &&
+            ( prvFlashSetDualBankMode() != HAL_OK ) )
         {
             uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
         }
@@ -836,20 +2111,107 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
             }
         }
 
+        /* The decoder state of staged updates is not kept, so only plain images resume */
         if( ( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess ) &&
-            ( prvEraseBank( ulTargetBank ) != pdTRUE ) )
+            ( xStaged == pdFALSE ) &&
+            ( pxFileContext->pRxBlockBitmap != NULL ) )
+        {
+            xResumed = prvResumeLoad( pxFileContext, ulTargetBank );
+        }
+        else
+        {
+            prvResumeDelete();
+        }
+
+        vOtaTimingStart( OTA_TIMING_ERASE );
+
+        if( xResumed == pdTRUE )
+        {
+            if( prvResumeRepair( ulTargetBank, FLASH_START_INACTIVE_BANK,
+                                 pxFileContext->fileSize - xResumeCtx.ulImageOffset ) != pdTRUE )
+            {
+                uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
+            }
+        }
+        else if( ( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess ) &&
+                 ( prvEraseImageArea( ulTargetBank,
+                                      ( xStaged == pdTRUE ) ? FLASH_BANK_SIZE : pxFileContext->fileSize ) != pdTRUE ) )
         {
             uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
         }
+        else
+        {
+            /* Empty */
+        }
+
+        vOtaTimingStop( OTA_TIMING_ERASE );
 
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
         {
             pxContext->ulTargetBank = ulTargetBank;
             pxContext->ulPendingBank = prvGetActiveBank();
             pxContext->ulBaseAddress = FLASH_START_INACTIVE_BANK;
-            pxContext->ulImageSize = pxFileContext->fileSize;
+            pxContext->ulFileSize = pxFileContext->fileSize;
+            pxContext->xDeltaUpdate = pxFileType->xDeltaUpdate;
+            pxContext->xCompressed = pxFileType->xCompressed;
+            pxContext->xManifest = pxFileType->xManifest;
+            pxContext->ulImageOffset = ( xResumed == pdTRUE ) ? xResumeCtx.ulImageOffset : 0U;
             pxContext->xPalState = OTA_PAL_FILE_OPEN;
             pxFileContext->pFile = pxContext;
+
+            if( xStaged == pdTRUE )
+            {
+                /* The image size is known once the staged file has been decoded */
+                pxContext->ulImageSize = 0;
+                pxContext->ulImageWritten = 0;
+                pxContext->ulStageApplied = 0;
+                pxContext->ulStageAddress = FLASH_START_INACTIVE_BANK + FLASH_BANK_SIZE -
+                                            ( ( pxFileContext->fileSize + FLASH_PAGE_SIZE - 1U ) & ~( FLASH_PAGE_SIZE - 1U ) );
+
+                if( pxContext->xDeltaUpdate == pdTRUE )
+                {
+                    /* The running image is always mapped at FLASH_BASE */
+                    vOtaDeltaInit( &xDeltaCtx, ( const uint8_t * ) FLASH_BASE, FLASH_BANK_SIZE,
+                                   prvImageWrite, pxContext );
+                }
+
+                if( pxContext->xCompressed == pdTRUE )
+                {
+                    vOtaDecompressInit( &xDecompressCtx, prvDecompressOutput, pxContext );
+                }
+
+                LogInfo( "%s%s update: staging a %u byte file at 0x%08x.",
+                         ( pxContext->xCompressed == pdTRUE ) ? "Compressed " : "",
+                         ( pxContext->xDeltaUpdate == pdTRUE ) ? "delta" : "image",
+                         pxFileContext->fileSize, pxContext->ulStageAddress );
+            }
+            else if( pxContext->xManifest == pdTRUE )
+            {
+                /* The image size is known once the manifest has been verified */
+                pxContext->ulImageSize = 0;
+            }
+            else
+            {
+                pxContext->ulImageSize = pxFileContext->fileSize;
+            }
+
+            prvImageHashStart( pxContext );
+
+            if( xResumed == pdTRUE )
+            {
+                prvResumeApply( pxFileContext, pxContext );
+            }
+            else if( xResumeActive == pdTRUE )
+            {
+                /* Drop the progress of any other download */
+                ( void ) prvResumeSave();
+            }
+            else
+            {
+                /* Empty */
+            }
+
+            vOtaTimingStart( OTA_TIMING_DOWNLOAD );
         }
 
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
@@ -871,6 +2233,7 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pxFileContext,
 {
     int16_t sBytesWritten = -1;
     OtaPalContext_t * pxContext = prvGetImageContext();
+    uint32_t ulStartCycles = prvCycleCount();
 
     configASSERT( pxContext->ulTargetBank != prvGetActiveBank() );
 
@@ -885,7 +2248,7 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pxFileContext,
     {
         LogError( "PAL context is invalid." );
     }
-    else if( ( offset + blockSize ) > pxContext->ulImageSize )
+    else if( ( offset + blockSize ) > pxContext->ulFileSize )
     {
         LogError( "Offset and blockSize exceeds image size" );
     }
@@ -897,9 +2260,31 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pxFileContext,
     {
         LogError( "pData is NULL." );
     }
+    else if( pxContext->xManifest == pdTRUE )
+    {
+        prvRequeueApply();
+        sBytesWritten = prvManifestWriteBlock( pxFileContext, pxContext, offset, pData, blockSize );
+    }
+    else if( ( pxContext->xDeltaUpdate == pdTRUE ) ||
+             ( pxContext->xCompressed == pdTRUE ) )
+    {
+        if( ( prvWriteToFlash( ( pxContext->ulStageAddress + offset ), pData, blockSize ) == HAL_OK ) &&
+            ( prvStageApply( pxContext, offset, pData, blockSize ) == pdTRUE ) )
+        {
+            sBytesWritten = ( int16_t ) blockSize;
+        }
+    }
     else if( prvWriteToFlash( ( pxContext->ulBaseAddress + offset ), pData, blockSize ) == HAL_OK )
     {
         sBytesWritten = ( int16_t ) blockSize;
+
+        prvImageHashUpdate( pxContext, offset, pData, blockSize );
+        prvResumeRecordBlock( offset );
+    }
+
+    if( sBytesWritten > 0 )
+    {
+        vOtaTimingRecordBlock( blockSize, ( prvCycleCount() - ulStartCycles ) / ( SystemCoreClock / 1000000U ) );
     }
 
     return sBytesWritten;
@@ -922,20 +2307,42 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pxFileContext )
         unsigned char pucHashBuffer[ MBEDTLS_MD_MAX_SIZE ];
         size_t uxHashLength = 0;
 
-        if( xCalculateImageHash( ( unsigned char * ) ( pxContext->ulBaseAddress ),
-                                 ( size_t ) pxContext->ulImageSize,
-                                 pucHashBuffer, MBEDTLS_MD_MAX_SIZE, &uxHashLength ) != pdTRUE )
+        vOtaTimingStop( OTA_TIMING_DOWNLOAD );
+        vOtaTimingStart( OTA_TIMING_HASH );
+
+        /* Every block is in, a failed image is downloaded again from the start */
+        prvResumeDelete();
+        prvRequeueReset();
+
+        if( ( pxContext->xManifest == pdTRUE ) &&
+            ( xOtaManifestIsVerified( &xManifestCtx ) == pdFALSE ) )
+        {
+            uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+        }
+        else if( ( ( pxContext->xDeltaUpdate == pdTRUE ) ||
+              ( pxContext->xCompressed == pdTRUE ) ) &&
+            ( prvStageFinish( pxContext ) != pdTRUE ) )
         {
             uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
         }
+        else if( xFinishImageHash( pxContext, pucHashBuffer, MBEDTLS_MD_MAX_SIZE, &uxHashLength ) != pdTRUE )
+        {
+            uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+        }
+
+        vOtaTimingStop( OTA_TIMING_HASH );
+
+        prvManifestFree();
 
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
         {
+            vOtaTimingStart( OTA_TIMING_SIGNATURE );
             uxOtaStatus = prvValidateSignature( ( char * ) pxFileContext->pCertFilepath,
                                                 pxFileContext->pSignature->data,
                                                 pxFileContext->pSignature->size,
                                                 pucHashBuffer,
                                                 uxHashLength );
+            vOtaTimingStop( OTA_TIMING_SIGNATURE );
         }
 
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
@@ -964,6 +2371,11 @@ OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const pxFileContext )
 {
     OtaPalStatus_t palStatus = otaPal_SetPlatformImageState( pxFileContext, OtaImageStateAborted );
 
+    prvImageHashFree( prvGetImageContext() );
+    prvResumeDelete();
+    prvRequeueReset();
+    prvManifestFree();
+
     pxFileContext->pFile = NULL;
 
     return palStatus;
@@ -1003,13 +2415,38 @@ void otaPal_EarlyInit( void )
         switch( pxCtx->xPalState )
         {
             case OTA_PAL_PENDING_SELF_TEST:
-                configASSERT( pxCtx->ulTargetBank == prvGetActiveBank() );
 
-                /* Update the state to show that the new image was booted successfully */
-                pxCtx->xPalState = OTA_PAL_NEW_IMAGE_BOOTED;
-                ( void ) prvWritePalNvContext( pxCtx );
+                if( pxCtx->ulTargetBank != prvGetActiveBank() )
+                {
+                    /* The option bytes were never loaded, drop the image rather than retry */
+                    LogError( "New image in bank %d was not booted, rejecting it.", pxCtx->ulTargetBank );
+                    pxCtx->xPalState = OTA_PAL_REJECTED;
+                    ( void ) prvDeletePalNvContext();
+                    ( void ) prvEraseBank( pxCtx->ulTargetBank );
+                }
+                else if( prvBootMarkerGet() != OTA_PAL_BOOT_MARKER_TESTING )
+                {
+                    /* First boot of the new image, or a reset after it reached the broker.
+                     * The file keeps PENDING_SELF_TEST, the marker tells a later boot apart. */
+                    prvBootMarkerSet( OTA_PAL_BOOT_MARKER_TESTING );
+                    pxCtx->xPalState = OTA_PAL_NEW_IMAGE_BOOTED;
+
+                    prvRestoreTimingReport();
+                    vOtaTimingStart( OTA_TIMING_SELF_TEST );
+                }
+                else
+                {
+                    LogError( "Detected a reset during the self test of the new image. Reverting to bank: %d", ulGetOtherBank( pxCtx->ulTargetBank ) );
+                    prvBootMarkerSet( 0 );
+                    pxCtx->xPalState = OTA_PAL_NEW_IMAGE_WDT_RESET;
+                    pxCtx->ulPendingBank = ulGetOtherBank( pxCtx->ulTargetBank );
+                    ( void ) prvWritePalNvContext( pxCtx );
+                    ( void ) otaPal_ResetDevice( NULL );
+                }
+
                 break;
 
+            /* Only written by earlier versions, which recorded the first boot in the file */
             case OTA_PAL_NEW_IMAGE_BOOTED:
                 pxCtx->xPalState = OTA_PAL_NEW_IMAGE_WDT_RESET;
                 pxCtx->ulPendingBank = ulGetOtherBank( pxCtx->ulTargetBank );
@@ -1031,6 +2468,33 @@ void otaPal_EarlyInit( void )
         }
 
         LogSys( "OTA EarlyInit: Ending State: %s.", pcPalStateToString( pxCtx->xPalState ) );
+
+        /* Nothing in the inactive bank is needed any more, prepare it for the next update.
+         * A download interrupted by the reset keeps its blocks so that it can resume. */
+        if( ( ( pxCtx->xPalState == OTA_PAL_READY ) && ( prvResumeExists() == pdFALSE ) ) ||
+            ( pxCtx->xPalState == OTA_PAL_ACCEPTED ) ||
+            ( pxCtx->xPalState == OTA_PAL_REJECTED ) )
+        {
+            prvBackgroundEraseStart( prvGetInactiveBank() );
+        }
+    }
+}
+
+/*
+ * Called by the OTA task once MQTT is connected. A new image which made it this far is no
+ * longer reverted by a reset, the next boot runs its self test again instead. The job is
+ * still accepted or rejected through otaPal_SetPlatformImageState.
+ */
+void otaPal_CommitOnConnect( void )
+{
+    OtaPalContext_t * pxCtx = prvGetImageContext();
+
+    if( ( pxCtx != NULL ) &&
+        ( pxCtx->xPalState == OTA_PAL_NEW_IMAGE_BOOTED ) &&
+        ( prvBootMarkerGet() == OTA_PAL_BOOT_MARKER_TESTING ) )
+    {
+        prvBootMarkerSet( OTA_PAL_BOOT_MARKER_CONNECTED );
+        LogSys( "New image in bank %d reached the broker.", pxCtx->ulTargetBank );
     }
 }
 
@@ -1057,11 +2521,17 @@ OtaPalStatus_t otaPal_SetPlatformImageState( OtaFileContext_t * const pxFileCont
                         configASSERT( prvGetActiveBank() == pxContext->ulTargetBank );
                         pxContext->ulPendingBank = pxContext->ulTargetBank;
 
+                        vOtaTimingStop( OTA_TIMING_SELF_TEST );
+
                         /* Delete context from flash */
                         if( prvDeletePalNvContext() == pdTRUE )
                         {
+                            prvBootMarkerSet( 0 );
                             uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalSuccess, 0 );
                             pxContext->xPalState = OTA_PAL_ACCEPTED;
+
+                            /* The previous image is no longer needed for a rollback */
+                            prvBackgroundEraseStart( prvGetInactiveBank() );
                         }
                         else
                         {
@@ -1280,6 +2750,7 @@ OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pxFileContext )
 
 
                 pxContext->xPalState = OTA_PAL_SELF_TEST_FAILED;
+                prvBootMarkerSet( 0 );
 
                 if( prvWritePalNvContext( pxContext ) != pdTRUE )
                 {
@@ -1290,18 +2761,12 @@ OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pxFileContext )
                 pxContext->ulPendingBank = ulGetOtherBank( pxContext->ulTargetBank );
                 break;
 
-            /* Need to reset and start self test */
+            /* Need to reset and start self test, the context is written once the bank is selected */
             case OTA_PAL_PENDING_SELF_TEST:
                 configASSERT( prvGetActiveBank() == ulGetOtherBank( pxContext->ulTargetBank ) );
 
                 pxContext->ulPendingBank = pxContext->ulTargetBank;
-
-                if( prvWritePalNvContext( pxContext ) != pdTRUE )
-                {
-                    LogError( "Failed to write to NV context." );
-                    uxStatus = OTA_PAL_COMBINE_ERR( OtaPalActivateFailed, 0 );
-                }
-
+                prvBootMarkerSet( 0 );
                 break;
 
             case OTA_PAL_NEW_IMAGE_WDT_RESET:
@@ -1309,6 +2774,7 @@ OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pxFileContext )
 
             case OTA_PAL_SELF_TEST_FAILED:
                 pxContext->ulPendingBank = ulGetOtherBank( pxContext->ulTargetBank );
+                prvBootMarkerSet( 0 );
 
                 if( prvDeletePalNvContext() == pdFALSE )
                 {
@@ -1333,9 +2799,26 @@ OtaPalStatus_t otaPal_ResetDevice( OtaFileContext_t * const pxFileContext )
         {
             LogSys( "Selecting Bank #%d.", pxContext->ulPendingBank );
 
+            vOtaTimingStart( OTA_TIMING_BANK_SWAP );
+
             if( prvSelectBank( pxContext->ulPendingBank ) == pdTRUE )
             {
-                prvOptionByteApply();
+                vOtaTimingStop( OTA_TIMING_BANK_SWAP );
+
+                /* Activating a new image: the state and the timing report for the job status go
+                 * out in a single write. A power loss before it boots the new image without a
+                 * context, it then runs as a plain image and the job is reported as failed. */
+                if( ( pxContext->xPalState == OTA_PAL_PENDING_SELF_TEST ) &&
+                    ( prvWritePalNvContext( pxContext ) != pdTRUE ) )
+                {
+                    LogError( "Failed to write to NV context." );
+                    ( void ) prvSelectBank( prvGetActiveBank() );
+                    uxStatus = OTA_PAL_COMBINE_ERR( OtaPalActivateFailed, 0 );
+                }
+                else
+                {
+                    prvOptionByteApply();
+                }
             }
             else
             {
@@ -45,6 +45,15 @@ defined in linker script */
 .word	_sbss
 /* end address for the .bss section. defined in linker script */
 .word	_ebss
+/* start and end addresses of the SRAM bank sections. defined in linker script */
+.word	_ssram_dma
+.word	_esram_dma
+.word	_ssram_cpu
+.word	_esram_cpu
+/* load, start and end addresses of the code run from SRAM. defined in linker script */
+.word	_siramfunc
+.word	_sramfunc
+.word	_eramfunc
 
 .equ  BootRAM,        0xF1E0F85F
 /**
@@ -90,6 +99,22 @@ LoopFillZerobss:
 	cmp	r2, r3
 	bcc	FillZerobss
 
+/* Zero fill the SRAM bank sections, which are not part of .bss */
+	ldr	r2, =_ssram_dma
+	ldr	r3, =_esram_dma
+	bl	FillZeroRange
+	ldr	r2, =_ssram_cpu
+	ldr	r3, =_esram_cpu
+	bl	FillZeroRange
+
+/* Copy the RAMFUNC code from flash to SRAM */
+	ldr	r0, =_siramfunc
+	ldr	r2, =_sramfunc
+	ldr	r3, =_eramfunc
+	bl	CopyRange
+	dsb
+	isb
+
 /* Call the clock system initialization function.*/
     bl  SystemInit
 /* Call static constructors */
@@ -100,6 +125,32 @@ LoopFillZerobss:
 LoopForever:
     b LoopForever
 
+/* Zero fill the words from r2 up to r3 */
+FillZeroRange:
+	movs	r1, #0
+	b	LoopFillZeroRange
+
+FillZeroRangeWord:
+	str	r1, [r2], #4
+
+LoopFillZeroRange:
+	cmp	r2, r3
+	bcc	FillZeroRangeWord
+	bx	lr
+
+/* Copy the words from r0 to r2, up to r3 */
+CopyRange:
+	b	LoopCopyRange
+
+CopyRangeWord:
+	ldr	r1, [r0], #4
+	str	r1, [r2], #4
+
+LoopCopyRange:
+	cmp	r2, r3
+	bcc	CopyRangeWord
+	bx	lr
+
 .size	Reset_Handler, .-Reset_Handler
 
 /**
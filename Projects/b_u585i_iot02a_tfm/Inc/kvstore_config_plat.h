@@ -34,8 +34,13 @@
 
 #define KV_STORE_NVIMPL_LITTLEFS    0
 
+#define KV_STORE_NVIMPL_LITTLEFS_LOG    0
+
 #define KV_STORE_NVIMPL_ARM_PSA     1
 
+/* Pack all values into one ITS object so that init and commits need few secure calls */
+#define KVSTORE_PSA_PACKED          1
+
 #define KVSTORE_KEY_MAX_LEN         16
 #define KVSTORE_VAL_MAX_LEN         256
 
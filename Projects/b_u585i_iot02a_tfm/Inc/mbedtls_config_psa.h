@@ -3180,8 +3180,11 @@ void mbedtls_platform_free( void * ptr );
  * certificate data which is sent during the handshake.
  *
  * Uncomment to set the maximum plaintext size of the outgoing I/O buffer.
+ *
+ * Outgoing records are limited to the 4096 byte fragment length requested by
+ * the transport, so a larger output buffer is never filled.
  */
-/*#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384 */
+#define MBEDTLS_SSL_OUT_CONTENT_LEN             4096
 
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
@@ -0,0 +1,69 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _TFM_NS_INTERFACE_FREERTOS_H
+#define _TFM_NS_INTERFACE_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Number of distinct veneers tracked by ns_interface_get_stats, further veneers share the last entry */
+#ifndef NS_INTF_STATS_MAX_VENEERS
+#define NS_INTF_STATS_MAX_VENEERS    8
+#endif
+
+/* Secure call counters of one veneer. Times are in DWT cycles. */
+typedef struct
+{
+    uintptr_t uxVeneer;      /* Veneer address, 0 for the shared overflow entry */
+    uint32_t ulCalls;        /* Secure calls made through the veneer */
+    uint32_t ulContended;    /* Calls that found the interface held by another task */
+    uint64_t ullWaitCycles;  /* Total time spent waiting for the interface */
+    uint32_t ulMaxWaitCycles;
+    uint64_t ullRunCycles;   /* Total time spent in the secure call */
+} NsInterfaceVeneerStats_t;
+
+int32_t ns_interface_lock_init( void );
+
+/*
+ * Hold the secure interface across several PSA calls made by the calling task.
+ * Calls made between ns_interface_batch_begin and ns_interface_batch_end
+ * run back to back, without taking the lock or yielding to another task's
+ * secure call in between. Batches may nest. Returns 0 on success.
+ */
+int32_t ns_interface_batch_begin( void );
+void ns_interface_batch_end( void );
+
+/*
+ * Copy the counters of up to uxMaxEntries veneers to pxStats, return the
+ * number of entries written.
+ */
+size_t ns_interface_get_stats( NsInterfaceVeneerStats_t * pxStats,
+                               size_t uxMaxEntries );
+void ns_interface_reset_stats( void );
+
+#endif /* _TFM_NS_INTERFACE_FREERTOS_H */
@@ -15,6 +15,7 @@
 #define OTA_SIGNING_KEY_ID         0x10000002UL
 #define PSA_TLS_CERT_ID            0x1000000000000101ULL
 #define PSA_TLS_ROOT_CA_CERT_ID    0x1000000000000201ULL
+#define PSA_TLS_SESSION_ID         0x1000000000000301ULL
 
 /*
  * Define MBEDTLS_TRANSPORT_PKCS11 to enable certificate and key storage via the PKCS#11 API.
@@ -28,5 +29,23 @@
  */
 #define MBEDTLS_TRANSPORT_PSA
 
+/*
+ * Define MBEDTLS_TRANSPORT_SESSION_RESUMPTION to cache the TLS session in RAM and offer it
+ * (session ticket or session id) when reconnecting to the same endpoint.
+ */
+#define MBEDTLS_TRANSPORT_SESSION_RESUMPTION
+
+/*
+ * Define MBEDTLS_TRANSPORT_NETCONN_RECV to read received TLS records directly from the lwIP
+ * netconn pbuf chain instead of through lwip_recv.
+ */
+/* #define MBEDTLS_TRANSPORT_NETCONN_RECV */
+
+/*
+ * Define MBEDTLS_TRANSPORT_PERSIST_SESSION to also keep the cached session in PSA ITS so that it
+ * survives a reset, one entry per host and port (PSA_TLS_SESSION_ID with a hash of the host name and
+ * port in bits 16 to 47). Requires MBEDTLS_TRANSPORT_PSA.
+ */
+/*#define MBEDTLS_TRANSPORT_PERSIST_SESSION */
 
 #endif /* TLS_TRANSPORT_CONFIG */
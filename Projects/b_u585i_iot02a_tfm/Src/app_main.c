@@ -37,8 +37,22 @@
 #include "task.h"
 #include "stm32u5xx.h"
 #include "kvstore.h"
+#include "time_hwm.h"
+#include "cpu_load.h"
+#include "heap_trace.h"
+#include "mem_pressure.h"
+#include "sntp_time.h"
+#include "stack_watch.h"
+#include "lowpower.h"
+#include "dvfs.h"
+#include "watchdog.h"
+#include "periodic_work.h"
+#include "boot_prof.h"
+#include "postmortem.h"
+#include "static_alloc.h"
 #include "hw_defs.h"
 #include "psa/crypto.h"
+#include "tfm_ns_interface_freertos.h"
 #include <string.h>
 
 #include "test_execution_config.h"
@@ -47,13 +61,15 @@
 
 /* Definition for Qualification Test */
 #if ( DEVICE_ADVISOR_TEST_ENABLED == 1 ) || ( MQTT_TEST_ENABLED == 1 ) || ( TRANSPORT_INTERFACE_TEST_ENABLED == 1 ) || \
-    ( OTA_PAL_TEST_ENABLED == 1 ) || ( OTA_E2E_TEST_ENABLED == 1 ) || ( CORE_PKCS11_TEST_ENABLED == 1 )
+    ( OTA_PAL_TEST_ENABLED == 1 ) || ( OTA_E2E_TEST_ENABLED == 1 ) || ( CORE_PKCS11_TEST_ENABLED == 1 ) || \
+    ( PERFORMANCE_TEST_ENABLED == 1 )
     #define DEMO_QUALIFICATION_TEST    ( 1 )
 
 #else
     #define DEMO_QUALIFICATION_TEST    ( 0 )
 #endif /* ( DEVICE_ADVISOR_TEST_ENABLED == 1 ) || ( MQTT_TEST_ENABLED == 1 ) || ( TRANSPORT_INTERFACE_TEST_ENABLED == 1 ) || \
-        * ( OTA_PAL_TEST_ENABLED == 1 ) || ( OTA_E2E_TEST_ENABLED == 1 ) || ( CORE_PKCS11_TEST_ENABLED == 1 ) */
+        * ( OTA_PAL_TEST_ENABLED == 1 ) || ( OTA_E2E_TEST_ENABLED == 1 ) || ( CORE_PKCS11_TEST_ENABLED == 1 ) || \
+        * ( PERFORMANCE_TEST_ENABLED == 1 ) */
 
 EventGroupHandle_t xSystemEvents = NULL;
 
@@ -65,8 +81,6 @@ typedef void ( * VectorTable_t )( void );
 
 static VectorTable_t pulVectorTableSRAM[ VECTOR_TABLE_SIZE ] __attribute__( ( aligned( VECTOR_TABLE_ALIGN_CM33 ) ) );
 
-extern int32_t ns_interface_lock_init( void );
-
 /* Relocate vector table to ram for runtime interrupt registration */
 static void vRelocateVectorTable( void )
 {
@@ -95,15 +109,31 @@ static void vRelocateVectorTable( void )
 
 static void vHeartbeatTask( void * pvParameters )
 {
+    static PeriodicWork_t xBlinkWork;
+
     ( void ) pvParameters;
 
     HAL_GPIO_WritePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin, GPIO_PIN_RESET );
     HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET );
 
+    #if ( LOW_POWER_ENABLED == 1 )
+        vPeriodicWorkStart( &xBlinkWork, pdMS_TO_TICKS( LOW_POWER_HEARTBEAT_MS ), pdMS_TO_TICKS( LOW_POWER_HEARTBEAT_MS / 10 ) );
+    #else
+        vPeriodicWorkStart( &xBlinkWork, pdMS_TO_TICKS( 1000 ), pdMS_TO_TICKS( 100 ) );
+    #endif
+
     while( 1 )
     {
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-        HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+        vPeriodicWorkWait( &xBlinkWork );
+
+        #if ( LOW_POWER_ENABLED == 1 )
+            /* A short flash, at the same time as the other periodic wakeups */
+            HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+            vTaskDelay( pdMS_TO_TICKS( 20 ) );
+            HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+        #else
+            HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+        #endif
     }
 }
 
@@ -111,9 +141,12 @@ extern void net_main( void * pvParameters );
 extern void vMQTTAgentTask( void * );
 extern void vMotionSensorsPublish( void * );
 extern void vEnvironmentSensorPublishTask( void * );
+extern void vSensorPublishTask( void * );
 extern void vShadowDeviceTask( void * );
 extern void vOTAUpdateTask( void * pvParam );
 extern void vDefenderAgentTask( void * );
+extern void vLogPublishTask( void * );
+extern void vMetricsPublishTask( void * );
 #if DEMO_QUALIFICATION_TEST
     extern void run_qualification_main( void * );
 #endif /* DEMO_QUALIFICATION_TEST */
@@ -122,41 +155,87 @@ void vInitTask( void * pvArgs )
 {
     BaseType_t xResult;
 
+    vBootPhaseMark( BOOT_PHASE_SCHEDULER );
+
     /* Initialize PSA crypto api */
     psa_crypto_init();
 
-    xResult = xTaskCreate( Task_CLI, "cli", 2048, NULL, 10, NULL );
+    vPeriodicWorkInit();
+    vWatchdogInit();
+    vCpuLoadInit();
+    vStackWatchInit();
+
+    #if ( HEAP_TRACE_ENABLED == 1 )
+        vHeapTraceInit();
+    #endif
+
+    #if ( MEM_PRESSURE_ENABLED == 1 )
+        vMemPressureInit();
+    #endif
+
+    #if ( LOW_POWER_ENABLED == 1 )
+        vLowPowerInit();
+    #endif
+
+    #if ( DVFS_ENABLED == 1 )
+        vDvfsInit();
+    #endif
+
+    xResult = xAppTaskCreate( Task_CLI, "cli", 2048, NULL, 10, NULL );
+
+    /* Started first so that the lwIP start and the wifi module reset overlap with KVStore_init */
+    xResult = xAppTaskCreateCpuBank( &net_main, "MxNet", 1024, NULL, 23, NULL );
+    configASSERT( xResult == pdTRUE );
 
     ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_FS_READY );
 
     KVStore_init();
 
-    xResult = xTaskCreate( vHeartbeatTask, "Heartbeat", 128, NULL, tskIDLE_PRIORITY, NULL );
-    configASSERT( xResult == pdTRUE );
+    vBootPhaseMark( BOOT_PHASE_KV_READY );
+    ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_KV_READY );
 
-    xResult = xTaskCreate( &net_main, "MxNet", 1024, NULL, 23, NULL );
+    vLoggingLoadModuleLevels();
+
+    vTimeHwmInit();
+
+    xResult = xAppTaskCreate( vHeartbeatTask, "Heartbeat", 128, NULL, tskIDLE_PRIORITY, NULL );
     configASSERT( xResult == pdTRUE );
 
+    #if ( SNTP_TIME_ENABLED == 1 )
+        /* Above the publishing tasks, so that the receive time of each answer is taken promptly */
+        xResult = xAppTaskCreate( vSntpTimeTask, "SNTP", 1024, NULL, 7, NULL );
+        configASSERT( xResult == pdTRUE );
+    #endif
+
     #if DEMO_QUALIFICATION_TEST
-        xResult = xTaskCreate( run_qualification_main, "QualTest", 4096, NULL, 10, NULL );
+        xResult = xAppTaskCreate( run_qualification_main, "QualTest", 4096, NULL, 10, NULL );
         configASSERT( xResult == pdTRUE );
     #else
-        xResult = xTaskCreate( vMQTTAgentTask, "MQTTAgent", 2048, NULL, tskIDLE_PRIORITY + 3, NULL );
+        xResult = xAppTaskCreateCpuBank( vMQTTAgentTask, "MQTTAgent", 2048, NULL, tskIDLE_PRIORITY + 3, NULL );
         configASSERT( xResult == pdTRUE );
 
-        xResult = xTaskCreate( vOTAUpdateTask, "OTAUpdate", 2048, NULL, tskIDLE_PRIORITY + 3, NULL );
+        xResult = xAppTaskCreate( vOTAUpdateTask, "OTAUpdate", 2048, NULL, tskIDLE_PRIORITY + 3, NULL );
         configASSERT( xResult == pdTRUE );
 
-        xResult = xTaskCreate( vEnvironmentSensorPublishTask, "EnvSense", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
+        xResult = xAppTaskCreate( vSensorPublishTask, "SensorPub", 512, NULL, tskIDLE_PRIORITY + 2, NULL );
         configASSERT( xResult == pdTRUE );
 
-        xResult = xTaskCreate( vMotionSensorsPublish, "MotionS", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
+        xResult = xAppTaskCreate( vEnvironmentSensorPublishTask, "EnvSense", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
         configASSERT( xResult == pdTRUE );
 
-        xResult = xTaskCreate( vShadowDeviceTask, "ShadowDevice", 1024, NULL, tskIDLE_PRIORITY + 1, NULL );
+        xResult = xAppTaskCreate( vMotionSensorsPublish, "MotionS", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
         configASSERT( xResult == pdTRUE );
 
-        xResult = xTaskCreate( vDefenderAgentTask, "AWSDefender", 2048, NULL, tskIDLE_PRIORITY + 1, NULL );
+        xResult = xAppTaskCreate( vShadowDeviceTask, "ShadowDevice", 1024, NULL, tskIDLE_PRIORITY + 1, NULL );
+        configASSERT( xResult == pdTRUE );
+
+        xResult = xAppTaskCreate( vDefenderAgentTask, "AWSDefender", 2048, NULL, tskIDLE_PRIORITY + 1, NULL );
+        configASSERT( xResult == pdTRUE );
+
+        xResult = xAppTaskCreate( vLogPublishTask, "LogPublish", 1024, NULL, tskIDLE_PRIORITY + 1, NULL );
+        configASSERT( xResult == pdTRUE );
+
+        xResult = xAppTaskCreate( vMetricsPublishTask, "MetricsPub", 1024, NULL, tskIDLE_PRIORITY + 1, NULL );
         configASSERT( xResult == pdTRUE );
     #endif /* DEMO_QUALIFICATION_TEST */
 
@@ -170,6 +249,8 @@ int main( void )
 {
     hw_init();
 
+    vBootPhaseMark( BOOT_PHASE_HW_INIT );
+
     vRelocateVectorTable();
 
     vLoggingInit();
@@ -181,9 +262,9 @@ int main( void )
         configASSERT( 0 );
     }
 
-    xSystemEvents = xEventGroupCreate();
+    xSystemEvents = xAppEventGroupCreate();
 
-    xTaskCreate( vInitTask, "Init", 1024, NULL, 8, NULL );
+    ( void ) xAppTaskCreate( vInitTask, "Init", 1024, NULL, 8, NULL );
 
     /* Start scheduler */
     vTaskStartScheduler();
@@ -223,8 +304,8 @@ void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
     /* If the buffers to be provided to the Idle task are declared inside this
      * function then they must be declared static - otherwise they will be allocated on
      * the stack and so not exists after this function exits. */
-    static StaticTask_t xIdleTaskTCB;
-    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+    static StaticTask_t xIdleTaskTCB STATIC_ALLOC_DATA;
+    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ] STATIC_ALLOC_STACK;
 
     /* Pass out a pointer to the StaticTask_t structure in which the Idle task's
      * state will be stored. */
@@ -250,8 +331,8 @@ void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
     /* If the buffers to be provided to the Timer task are declared inside this
      * function then they must be declared static - otherwise they will be allocated on
      * the stack and so not exists after this function exits. */
-    static StaticTask_t xTimerTaskTCB;
-    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+    static StaticTask_t xTimerTaskTCB STATIC_ALLOC_DATA;
+    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ] STATIC_ALLOC_STACK;
 
     /* Pass out a pointer to the StaticTask_t structure in which the Timer
      * task's state will be stored. */
@@ -271,6 +352,8 @@ void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
 
 void vApplicationMallocFailedHook( void )
 {
+    vPostMortemCapture( PostMortemMallocFailed, NULL, 0 );
+
     LogError( "Malloc failed" );
 
     while( 1 )
@@ -288,6 +371,8 @@ void vApplicationStackOverflowHook( TaskHandle_t xTask,
 
     taskENTER_CRITICAL();
 
+    vPostMortemCapture( PostMortemStackOverflow, pcTaskName, 0 );
+
     LogDebug( "Stack overflow in %s", pcTaskName );
     ( void ) xTask;
     ( void ) pcTaskName; /* Remove compiler warnings if LogDebug() is not defined. */
@@ -305,11 +390,7 @@ void vApplicationStackOverflowHook( TaskHandle_t xTask,
 #if configUSE_IDLE_HOOK == 1
     void vApplicationIdleHook( void )
     {
-        /* Check / pet the watchdog */
-        if( pxHwndIwdg != NULL )
-        {
-            HAL_IWDG_Refresh( pxHwndIwdg );
-        }
+        vWatchdogIdleCheckIn();
     }
 #endif /* configUSE_IDLE_HOOK == 1 */
 
@@ -20,25 +20,89 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
 
+#include "FreeRTOS.h"
+#include "semphr.h"
 #include "entropy_poll.h"
 #include "psa/crypto.h"
 
+/*
+ * Requests up to this size are served from a RAM cache refilled by one secure
+ * call, so the many small polls issued during a handshake do not each cross
+ * into the secure side. Larger requests go to psa_generate_random directly.
+ */
+#ifndef ENTROPY_CACHE_LEN
+    #define ENTROPY_CACHE_LEN    64
+#endif
+
+#define ENTROPY_MUTEX_TIMEOUT_MS    100
+
+static SemaphoreHandle_t xEntropyMutex = NULL;
+static unsigned char ucEntropyCache[ ENTROPY_CACHE_LEN ];
+static size_t uxCacheAvailable = 0;
+
 int mbedtls_hardware_poll( void * data,
                            unsigned char * output,
                            size_t len,
                            size_t * olen )
 {
+    int lReturn = PSA_SUCCESS;
+
     ( void ) data;
-    int lReturn = psa_generate_random( output, len );
 
-    if( lReturn == PSA_SUCCESS )
+    *olen = 0;
+
+    if( xEntropyMutex == NULL )
+    {
+        taskENTER_CRITICAL();
+
+        if( xEntropyMutex == NULL )
+        {
+            xEntropyMutex = xSemaphoreCreateMutex();
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( len > ENTROPY_CACHE_LEN )
     {
-        *olen = len;
+        lReturn = psa_generate_random( output, len );
+
+        if( lReturn == PSA_SUCCESS )
+        {
+            *olen = len;
+        }
+    }
+    else if( ( xEntropyMutex != NULL ) &&
+             ( xSemaphoreTake( xEntropyMutex, pdMS_TO_TICKS( ENTROPY_MUTEX_TIMEOUT_MS ) ) == pdTRUE ) )
+    {
+        if( uxCacheAvailable < len )
+        {
+            lReturn = psa_generate_random( ucEntropyCache, ENTROPY_CACHE_LEN );
+            uxCacheAvailable = ( lReturn == PSA_SUCCESS ) ? ENTROPY_CACHE_LEN : 0;
+        }
+
+        if( lReturn == PSA_SUCCESS )
+        {
+            /* Serve from the end of the cache and wipe what was handed out */
+            uxCacheAvailable -= len;
+            ( void ) memcpy( output, &( ucEntropyCache[ uxCacheAvailable ] ), len );
+            ( void ) memset( &( ucEntropyCache[ uxCacheAvailable ] ), 0, len );
+            *olen = len;
+        }
+
+        ( void ) xSemaphoreGive( xEntropyMutex );
     }
     else
     {
-        *olen = 0;
+        /* Cache busy or unavailable, ask the secure side directly */
+        lReturn = psa_generate_random( output, len );
+
+        if( lReturn == PSA_SUCCESS )
+        {
+            *olen = len;
+        }
     }
 
     return lReturn;
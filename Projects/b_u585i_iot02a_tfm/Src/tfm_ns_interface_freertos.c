@@ -28,7 +28,10 @@
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include <stdint.h>
+#include <string.h>
+#include "stm32u5xx.h"
 #include "tfm_ns_interface.h"
+#include "tfm_ns_interface_freertos.h"
 
 #if ( configSUPPORT_STATIC_ALLOCATION == 1 && configSUPPORT_DYNAMIC_ALLOCATION == 0 )
 
@@ -39,19 +42,87 @@
 static StaticSemaphore_t xNsIntfMutexBuffer = { 0 };
 #endif
 
+/*
+ * Recursive, so that a task holding the interface for a batch can make its
+ * PSA calls through tfm_ns_interface_dispatch without blocking on itself.
+ */
 static SemaphoreHandle_t xNsIntfMutex = NULL;
 
+/* Only accessed with xNsIntfMutex held */
+static NsInterfaceVeneerStats_t xVeneerStats[ NS_INTF_STATS_MAX_VENEERS ] = { 0 };
+
 int32_t ns_interface_lock_init( void )
 {
     int32_t lReturn = -1;
 
     #if ( configSUPPORT_STATIC_ALLOCATION == 1 && configSUPPORT_DYNAMIC_ALLOCATION == 0 )
-        xNsIntfMutex = xSemaphoreCreateMutexStatic( &xNsIntfMutexBuffer );
+        xNsIntfMutex = xSemaphoreCreateRecursiveMutexStatic( &xNsIntfMutexBuffer );
     #else
-        xNsIntfMutex = xSemaphoreCreateMutex();
+        xNsIntfMutex = xSemaphoreCreateRecursiveMutex();
     #endif
 
     if( xNsIntfMutex != NULL )
+    {
+        /* Cycle counter used for the wait and run times */
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+        lReturn = 0;
+    }
+
+    return lReturn;
+}
+
+/*
+ * Take the interface, counting the wait as contended when another task held
+ * it. Returns the cycles spent waiting, or UINT32_MAX if the lock was not taken.
+ */
+static uint32_t ulNsInterfaceTake( BaseType_t * pxContended )
+{
+    uint32_t ulStart = DWT->CYCCNT;
+    uint32_t ulWait = UINT32_MAX;
+
+    *pxContended = pdFALSE;
+
+    if( xSemaphoreTakeRecursive( xNsIntfMutex, 0 ) == pdTRUE )
+    {
+        ulWait = 0;
+    }
+    else if( xSemaphoreTakeRecursive( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    {
+        *pxContended = pdTRUE;
+        ulWait = DWT->CYCCNT - ulStart;
+    }
+
+    return ulWait;
+}
+
+static NsInterfaceVeneerStats_t * pxVeneerStatsEntry( veneer_fn fn )
+{
+    NsInterfaceVeneerStats_t * pxEntry = &( xVeneerStats[ NS_INTF_STATS_MAX_VENEERS - 1 ] );
+
+    for( size_t i = 0; i < ( NS_INTF_STATS_MAX_VENEERS - 1 ); i++ )
+    {
+        if( ( xVeneerStats[ i ].uxVeneer == ( uintptr_t ) fn ) ||
+            ( xVeneerStats[ i ].uxVeneer == 0 ) )
+        {
+            xVeneerStats[ i ].uxVeneer = ( uintptr_t ) fn;
+            pxEntry = &( xVeneerStats[ i ] );
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+int32_t ns_interface_batch_begin( void )
+{
+    BaseType_t xContended;
+    int32_t lReturn = -1;
+
+    configASSERT( xNsIntfMutex != NULL );
+
+    if( ulNsInterfaceTake( &xContended ) != UINT32_MAX )
     {
         lReturn = 0;
     }
@@ -59,6 +130,56 @@ int32_t ns_interface_lock_init( void )
     return lReturn;
 }
 
+void ns_interface_batch_end( void )
+{
+    configASSERT( xNsIntfMutex != NULL );
+
+    ( void ) xSemaphoreGiveRecursive( xNsIntfMutex );
+}
+
+size_t ns_interface_get_stats( NsInterfaceVeneerStats_t * pxStats,
+                               size_t uxMaxEntries )
+{
+    size_t uxCount = 0;
+
+    configASSERT( xNsIntfMutex != NULL );
+
+    if( ( pxStats != NULL ) &&
+        ( xSemaphoreTakeRecursive( xNsIntfMutex, portMAX_DELAY ) == pdTRUE ) )
+    {
+        for( size_t i = 0; ( i < NS_INTF_STATS_MAX_VENEERS ) && ( uxCount < uxMaxEntries ); i++ )
+        {
+            if( xVeneerStats[ i ].ulCalls > 0 )
+            {
+                pxStats[ uxCount ] = xVeneerStats[ i ];
+
+                /* The last entry is shared by every veneer that did not get one of its own */
+                if( i == ( NS_INTF_STATS_MAX_VENEERS - 1 ) )
+                {
+                    pxStats[ uxCount ].uxVeneer = 0;
+                }
+
+                uxCount++;
+            }
+        }
+
+        ( void ) xSemaphoreGiveRecursive( xNsIntfMutex );
+    }
+
+    return uxCount;
+}
+
+void ns_interface_reset_stats( void )
+{
+    configASSERT( xNsIntfMutex != NULL );
+
+    if( xSemaphoreTakeRecursive( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    {
+        ( void ) memset( xVeneerStats, 0, sizeof( xVeneerStats ) );
+
+        ( void ) xSemaphoreGiveRecursive( xNsIntfMutex );
+    }
+}
 
 int32_t tfm_ns_interface_dispatch( veneer_fn fn,
                                    uint32_t arg0,
@@ -67,14 +188,36 @@ int32_t tfm_ns_interface_dispatch( veneer_fn fn,
                                    uint32_t arg3 )
 {
     int32_t lResult = -1;
+    BaseType_t xContended;
+    uint32_t ulWait;
 
     configASSERT( xNsIntfMutex != NULL );
 
-    if( xSemaphoreTake( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    ulWait = ulNsInterfaceTake( &xContended );
+
+    if( ulWait != UINT32_MAX )
     {
+        NsInterfaceVeneerStats_t * pxEntry;
+        uint32_t ulStart = DWT->CYCCNT;
+
         lResult = fn( arg0, arg1, arg2, arg3 );
 
-        xSemaphoreGive( xNsIntfMutex );
+        pxEntry = pxVeneerStatsEntry( fn );
+        pxEntry->ullRunCycles += ( uint32_t ) ( DWT->CYCCNT - ulStart );
+        pxEntry->ullWaitCycles += ulWait;
+        pxEntry->ulCalls++;
+
+        if( xContended == pdTRUE )
+        {
+            pxEntry->ulContended++;
+        }
+
+        if( ulWait > pxEntry->ulMaxWaitCycles )
+        {
+            pxEntry->ulMaxWaitCycles = ulWait;
+        }
+
+        ( void ) xSemaphoreGiveRecursive( xNsIntfMutex );
     }
 
     return lResult;
@@ -0,0 +1,122 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#include "logging.h"
+
+/*
+ * Kernel configuration of the host build, for the FreeRTOS POSIX port.
+ *
+ * The values which change the behaviour of the Common modules (priorities, notification
+ * indexes, static allocation, timers) follow Common/config/FreeRTOSConfig.h so that the code
+ * under test takes the same paths as on the board. The ones tied to the Cortex-M33 (interrupt
+ * priorities, tickless idle, FPU, run time counter) are left out.
+ */
+
+#if defined( __GNUC__ )
+    #include <stdint.h>
+
+/* Prints the location and aborts, so that a debugger or valgrind stops at the caller */
+    void vHostAssert( const char * pcFile,
+                      uint32_t ulLine );
+#endif
+
+#define configUSE_PREEMPTION                       1
+#define configSUPPORT_STATIC_ALLOCATION            1
+#define configSUPPORT_DYNAMIC_ALLOCATION           1
+#define configUSE_IDLE_HOOK                        0
+#define configUSE_TICK_HOOK                        0
+#define configUSE_MALLOC_FAILED_HOOK               1
+#define configTICK_RATE_HZ                         ( ( TickType_t ) 1000 )
+#define configMAX_PRIORITIES                       ( 56 )
+#define configMINIMAL_STACK_SIZE                   ( ( uint16_t ) 4096 )
+#define configTOTAL_HEAP_SIZE                      ( ( size_t ) 300 * 1024 )
+#define configMAX_TASK_NAME_LEN                    ( 32 )
+#define configUSE_TRACE_FACILITY                   1
+#define configUSE_16_BIT_TICKS                     0
+#define configIDLE_SHOULD_YIELD                    1
+#define configUSE_MUTEXES                          1
+#define configQUEUE_REGISTRY_SIZE                  8
+#define configUSE_RECURSIVE_MUTEXES                1
+#define configUSE_COUNTING_SEMAPHORES              1
+#define configENABLE_BACKWARD_COMPATIBILITY        0
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS    5
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION    0
+#define configCHECK_FOR_STACK_OVERFLOW             0
+#define configRECORD_STACK_HIGH_ADDRESS            1
+#define configMESSAGE_BUFFER_LENGTH_TYPE           size_t
+#define configGENERATE_RUN_TIME_STATS              0
+#define configUSE_STATS_FORMATTING_FUNCTIONS       0
+#define configUSE_CO_ROUTINES                      0
+#define configMAX_CO_ROUTINE_PRIORITIES            ( 2 )
+
+/* Software timer definitions. */
+#define configUSE_TIMERS                           1
+#define configTIMER_TASK_PRIORITY                  ( 24 )
+#define configTIMER_QUEUE_LENGTH                   10
+#define configTIMER_TASK_STACK_DEPTH               ( configMINIMAL_STACK_SIZE * 2 )
+
+/* Number of task notification slots */
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES      8
+
+/* Set the following definitions to 1 to include the API function, or zero
+ * to exclude the API function. */
+#define INCLUDE_vTaskPrioritySet                   1
+#define INCLUDE_uxTaskPriorityGet                  1
+#define INCLUDE_vTaskDelete                        1
+#define INCLUDE_vTaskCleanUpResources              1
+#define INCLUDE_vTaskSuspend                       1
+#define INCLUDE_vTaskDelayUntil                    1
+#define INCLUDE_xTaskAbortDelay                    1
+#define INCLUDE_vTaskDelay                         1
+#define INCLUDE_xTaskGetSchedulerState             1
+#define INCLUDE_xTaskResumeFromISR                 0
+#define INCLUDE_xTaskGetHandle                     1
+#define INCLUDE_xTaskGetIdleTaskHandle             1
+#define INCLUDE_xTimerPendFunctionCall             1
+#define INCLUDE_xQueueGetMutexHolder               1
+#define INCLUDE_uxTaskGetStackHighWaterMark        1
+#define INCLUDE_xTaskGetCurrentTaskHandle          1
+#define INCLUDE_eTaskGetState                      1
+
+#define configASSERT( x )                              \
+    do {                                               \
+        if( ( x ) == 0 ) {                             \
+            vHostAssert( __NAME_ARG__, __LINE__ );     \
+        }                                              \
+    } while( 0 )
+
+#define configASSERT_CONTINUE( x )                      \
+    do {                                                \
+        if( ( x ) == 0 ) {                              \
+            LogAssert( "Non-fatal assertion failed." ); \
+        }                                               \
+    } while( 0 )
+
+#endif /* FREERTOS_CONFIG_H */
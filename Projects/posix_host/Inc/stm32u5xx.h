@@ -0,0 +1,94 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _HOST_STM32U5XX_H
+#define _HOST_STM32U5XX_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Stand-in for the CMSIS device header in the host build.
+ *
+ * Only the core registers read by the Common modules built on the host are provided. DWT->CYCCNT
+ * counts TSC ticks on x86 and nanoseconds elsewhere, so "cycles" in a host report are in that
+ * unit and only compare with other host runs. Writes to DWT and CoreDebug have no effect.
+ */
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} HostDwt_t;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} HostCoreDebug_t;
+
+#define DWT_CTRL_CYCCNTENA_Msk          ( 1UL << 0 )
+#define CoreDebug_DEMCR_TRCENA_Msk      ( 1UL << 24 )
+
+static inline uint32_t ulHostCycleCount( void )
+{
+    #if defined( __x86_64__ ) || defined( __i386__ )
+        return ( uint32_t ) __builtin_ia32_rdtsc();
+    #else
+        struct timespec xNow;
+
+        ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+        return ( uint32_t ) ( ( ( uint64_t ) xNow.tv_sec * 1000000000ULL ) + ( uint64_t ) xNow.tv_nsec );
+    #endif
+}
+
+/* Each access through DWT latches the current count into CYCCNT */
+static inline HostDwt_t * pxHostDwt( void )
+{
+    static HostDwt_t xDwt = { 0 };
+
+    xDwt.CYCCNT = ulHostCycleCount();
+
+    return &xDwt;
+}
+
+static inline HostCoreDebug_t * pxHostCoreDebug( void )
+{
+    static HostCoreDebug_t xCoreDebug = { 0 };
+
+    return &xCoreDebug;
+}
+
+#define DWT          ( pxHostDwt() )
+#define CoreDebug    ( pxHostCoreDebug() )
+
+/* Current stack pointer of the thread which runs the calling task */
+#define __get_PSP()    ( ( uint32_t ) ( uintptr_t ) __builtin_frame_address( 0 ) )
+
+#define __NOP()        __asm volatile ( "nop" )
+
+#endif /* _HOST_STM32U5XX_H */
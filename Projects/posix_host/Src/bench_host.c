@@ -0,0 +1,190 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Kernels timed by the host build.
+ *
+ * The telemetry and fmt_* kernels are the payloads of Common/cli/cli_bench.c, so a host profile of
+ * them points at the same code as the board figures. fmt_json_libc runs the payload through the C
+ * library of the host in place of newlib. The kvstore_* kernels go through the cache and the
+ * littlefs log backend on the RAM block device.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "kvstore.h"
+#include "micro_bench.h"
+#include "printf_lite.h"
+#include "telemetry_encode.h"
+
+#include "bench_host.h"
+
+#define BENCH_HOST_OUT_LEN    ( 512 )
+
+static uint8_t pucBenchOut[ BENCH_HOST_OUT_LEN ];
+
+/*-----------------------------------------------------------*/
+
+/* The environment sensor payload, with the encoder of the format pointed to by pvCtx */
+static int prvBenchTelemetry( void * pvCtx )
+{
+    TelemetryEncoder_t xEncoder;
+
+    vTelemetryBegin( &xEncoder, *( ( BaseType_t * ) pvCtx ), pucBenchOut, BENCH_HOST_OUT_LEN );
+    vTelemetryAddFloat( &xEncoder, "temp_0_c", 23.25f, 2 );
+    vTelemetryAddFloat( &xEncoder, "rh_pct", 41.5f, 2 );
+    vTelemetryAddFloat( &xEncoder, "temp_1_c", 23.75f, 2 );
+    vTelemetryAddFloat( &xEncoder, "baro_mbar", 1013.25f, 2 );
+
+    return ( xTelemetryEnd( &xEncoder ) > 0 ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+typedef int ( * BenchVFormat_t )( char * pcBuffer,
+                                  size_t uxLen,
+                                  const char * pcFormat,
+                                  va_list xArgs );
+
+static BenchVFormat_t xBenchFmtLite = lPrintfLiteV;
+static BenchVFormat_t xBenchFmtLibc = vsnprintf;
+
+static int prvBenchFormat( const BenchVFormat_t * pxFormat,
+                           const char * pcFormat,
+                           ... )
+{
+    va_list xArgs;
+    int lLen;
+
+    va_start( xArgs, pcFormat );
+    lLen = ( *pxFormat )( ( char * ) pucBenchOut, BENCH_HOST_OUT_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    return ( ( lLen > 0 ) && ( lLen < ( int ) BENCH_HOST_OUT_LEN ) ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvBenchFmtJson( void * pvCtx )
+{
+    return prvBenchFormat( ( const BenchVFormat_t * ) pvCtx,
+                           "{\"temp_0_c\":%.2f,\"rh_pct\":%.2f,\"temp_1_c\":%.2f,\"baro_mbar\":%.2f}",
+                           23.25, 41.5, 23.75, 1013.25 );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvBenchFmtLog( void * pvCtx )
+{
+    return prvBenchFormat( ( const BenchVFormat_t * ) pvCtx,
+                           "<%-3.3s> %8lu [%-10.10s] %s:%d Published %lu bytes to %.*s, packet id %u, status 0x%08lX\r\n",
+                           "INF", 1234567UL, "MQTTAgent", "mqtt_agent_task.c", 412,
+                           152UL, 24, "thing-0123456789/env_sensor_data", 17U, 0x1000UL );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reads from the cache */
+static int prvBenchKvGet( void * pvCtx )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char pcThingName[ KVSTORE_VAL_MAX_LEN ];
+
+    ( void ) pvCtx;
+
+    ( void ) KVStore_getString( CS_CORE_THING_NAME, pcThingName, sizeof( pcThingName ) );
+    ( void ) KVStore_getUInt32( CS_CORE_MQTT_PORT, &xSuccess );
+
+    return ( xSuccess == pdTRUE ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+/* A changed value written through to the littlefs log */
+static int prvBenchKvCommit( void * pvCtx )
+{
+    uint32_t * pulValue = ( uint32_t * ) pvCtx;
+    BaseType_t xSuccess;
+
+    ( *pulValue )++;
+
+    xSuccess = KVStore_setUInt32( CS_TIME_HWM_S_1970, *pulValue );
+
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = KVStore_xCommitChanges();
+    }
+
+    return ( xSuccess == pdTRUE ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xBenchFormatJson = TELEMETRY_FORMAT_JSON;
+static BaseType_t xBenchFormatCbor = TELEMETRY_FORMAT_CBOR;
+static uint32_t ulBenchKvValue = 0;
+
+static MICRO_BENCH( xBenchTelemetryJson, "telemetry_json", prvBenchTelemetry, &xBenchFormatJson,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchTelemetryCbor, "telemetry_cbor", prvBenchTelemetry, &xBenchFormatCbor,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtJsonLite, "fmt_json_lite", prvBenchFmtJson, &xBenchFmtLite,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtJsonLibc, "fmt_json_libc", prvBenchFmtJson, &xBenchFmtLibc,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtLogLite, "fmt_log_lite", prvBenchFmtLog, &xBenchFmtLite,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchFmtLogLibc, "fmt_log_libc", prvBenchFmtLog, &xBenchFmtLibc,
+                    0, MICRO_BENCH_FLAG_NO_PREEMPT );
+static MICRO_BENCH( xBenchKvGet, "kvstore_get", prvBenchKvGet, NULL,
+                    0, 0 );
+static MICRO_BENCH( xBenchKvCommit, "kvstore_commit", prvBenchKvCommit, &ulBenchKvValue,
+                    0, 0 );
+
+/*-----------------------------------------------------------*/
+
+void vBenchHostRegister( void )
+{
+    vMicroBenchRegister( &xBenchTelemetryJson );
+    vMicroBenchRegister( &xBenchTelemetryCbor );
+    vMicroBenchRegister( &xBenchFmtJsonLite );
+    vMicroBenchRegister( &xBenchFmtJsonLibc );
+    vMicroBenchRegister( &xBenchFmtLogLite );
+    vMicroBenchRegister( &xBenchFmtLogLibc );
+    vMicroBenchRegister( &xBenchKvGet );
+    vMicroBenchRegister( &xBenchKvCommit );
+}
@@ -0,0 +1,1263 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * See fleet_sim.h.
+ *
+ * Tasks of the POSIX port run one at a time. The broker task has the highest priority of the
+ * simulation, so a device task only runs while the broker waits for work: the broker never sees a
+ * link half way through being reset, and the buffers it owns are only touched by a device while
+ * its link is down.
+ *
+ * MQTTAgentMessageInterface_t has no context for the command pool, so the pool of a device is
+ * found through a thread local storage pointer set by both of its tasks.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "stream_buffer.h"
+
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_stats.h"
+#include "telemetry_encode.h"
+
+#include "fleet_sim.h"
+
+#define FLEET_SIM_CONTROL_PRIORITY      ( tskIDLE_PRIORITY + 5 )
+#define FLEET_SIM_BROKER_PRIORITY       ( tskIDLE_PRIORITY + 4 )
+#define FLEET_SIM_AGENT_PRIORITY        ( tskIDLE_PRIORITY + 3 )
+#define FLEET_SIM_PUBLISH_PRIORITY      ( tskIDLE_PRIORITY + 2 )
+
+#define FLEET_SIM_AGENT_STACK           ( configMINIMAL_STACK_SIZE * 2 )
+#define FLEET_SIM_TASK_STACK            ( configMINIMAL_STACK_SIZE )
+
+#define FLEET_SIM_TLS_INDEX             ( configNUM_THREAD_LOCAL_STORAGE_POINTERS - 1 )
+#define FLEET_SIM_CONNECTED_NOTIFY_IDX  ( 1 )
+#define FLEET_SIM_SUBACK_NOTIFY_IDX     ( 2 )
+
+#define FLEET_SIM_LINK_BUFFER_LEN       ( 2048 )
+#define FLEET_SIM_NETWORK_BUFFER_LEN    ( 1024 )
+#define FLEET_SIM_BROKER_RX_LEN         ( 1024 )
+#define FLEET_SIM_PAYLOAD_LEN           ( 192 )
+#define FLEET_SIM_TOPIC_LEN             ( 48 )
+#define FLEET_SIM_CLIENT_ID_LEN         ( 24 )
+
+#define FLEET_SIM_KEEP_ALIVE_S          ( 60 )
+#define FLEET_SIM_CONNACK_TIMEOUT_MS    ( 2000 )
+#define FLEET_SIM_CONNECT_POLL_MS       ( 10 )
+#define FLEET_SIM_SUBACK_TIMEOUT_MS     ( 5000 )
+
+/* A new link is brought up after a random delay of up to this long, so connects are spread out like the firmware's back-off */
+#define FLEET_SIM_CONNECT_SPREAD_MS     ( 1000 )
+
+/* Key of the send time in the telemetry payload, read back by the broker */
+#define FLEET_SIM_TS_KEY                "ts_us"
+
+/* MQTT control packet types */
+#define FLEET_PKT_CONNECT               ( 1U )
+#define FLEET_PKT_PUBLISH               ( 3U )
+#define FLEET_PKT_PUBREL                ( 6U )
+#define FLEET_PKT_SUBSCRIBE             ( 8U )
+#define FLEET_PKT_UNSUBSCRIBE           ( 10U )
+#define FLEET_PKT_PINGREQ               ( 12U )
+#define FLEET_PKT_DISCONNECT            ( 14U )
+
+typedef enum
+{
+    FLEET_HIST_CONNECT,   /* From bringing a link up until the CONNACK */
+    FLEET_HIST_RECONNECT, /* From losing a link until the CONNACK on the next one */
+    FLEET_HIST_SUBSCRIBE, /* From MQTTAgent_Subscribe until the SUBACK */
+    FLEET_HIST_PUBLISH,   /* From encoding a payload until the PUBACK, seen by the device */
+    FLEET_HIST_BROKER_RX, /* From encoding a payload until the broker reads it */
+    FLEET_HIST_COMMAND,   /* From the broker sending a command until the device receives it */
+    FLEET_HIST_COUNT
+} FleetHist_t;
+
+static const char * const pcHistNames[ FLEET_HIST_COUNT ] =
+{
+    "connect", "reconnect", "subscribe", "publish", "broker_rx", "command"
+};
+
+typedef struct
+{
+    uint32_t ulConnects;
+    uint32_t ulConnectFailures;
+    uint32_t ulLinkDrops;
+    uint32_t ulStorms;
+    uint32_t ulPublishes;
+    uint32_t ulPublishFailures; /* Completed with an error, e.g. cancelled by a reconnect */
+    uint32_t ulPublishRejected; /* Not accepted by MQTTAgent_Publish */
+    uint32_t ulPoolEmpty;       /* Command pool empty when a command was needed */
+    uint32_t ulSubscriptions;
+    uint32_t ulSubscribeFailures;
+    uint32_t ulCommandsSent;
+    uint32_t ulCommandsReceived;
+    uint32_t ulBrokerDrops; /* Packets the broker could not queue to a device */
+} FleetCounters_t;
+
+typedef struct FleetDevice FleetDevice_t;
+
+struct NetworkContext
+{
+    FleetDevice_t * pxDevice;
+    StreamBufferHandle_t xRx; /* Broker to device */
+    StreamBufferHandle_t xTx; /* Device to broker */
+    TickType_t xRecvBlockTicks;
+    volatile BaseType_t xLinkUp;
+};
+
+struct MQTTAgentMessageContext
+{
+    QueueHandle_t xQueue;
+};
+
+/* A publish or subscribe in flight, the agent keeps pointers to its publish info until completion */
+struct MQTTAgentCommandContext
+{
+    FleetDevice_t * pxDevice;
+    MQTTPublishInfo_t xPublishInfo;
+    uint32_t ulStartUs;
+    volatile BaseType_t xInUse;
+    uint8_t pucPayload[ FLEET_SIM_PAYLOAD_LEN ];
+};
+
+struct FleetDevice
+{
+    uint32_t ulIndex;
+    uint32_t ulSeed;
+    char pcClientId[ FLEET_SIM_CLIENT_ID_LEN ];
+    char pcTelemetryTopic[ FLEET_SIM_TOPIC_LEN ];
+    char pcTopics[ FLEET_SIM_MAX_SUBSCRIPTIONS ][ FLEET_SIM_TOPIC_LEN ]; /* The command topic comes first */
+
+    MQTTAgentContext_t xAgentContext;
+    MQTTAgentMessageContext_t xMessageCtx;
+    MQTTAgentMessageInterface_t xMessageInterface;
+    NetworkContext_t xNetworkContext;
+    TransportInterface_t xTransport;
+    MQTTFixedBuffer_t xNetworkBuffer;
+    uint8_t pucNetworkBuffer[ FLEET_SIM_NETWORK_BUFFER_LEN ];
+    MQTTAgentCommand_t xCommands[ FLEET_SIM_COMMAND_POOL_SIZE ];
+    QueueHandle_t xCommandPool;
+
+    MQTTSubscribeInfo_t xSubscribeInfo[ FLEET_SIM_MAX_SUBSCRIPTIONS ];
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+    MQTTAgentCommandContext_t xSubscribeCtx;
+    MQTTAgentCommandContext_t xSlots[ FLEET_SIM_MAX_BURST ];
+
+    TaskHandle_t xAgentTask;
+    TaskHandle_t xPublishTask;
+    volatile BaseType_t xConnected;
+    volatile uint32_t ulConnectCount; /* Incremented on each CONNACK, so the publisher resubscribes */
+
+    float fTemperature;
+    float fHumidity;
+    float fPressure;
+
+    /* Owned by the broker task */
+    volatile BaseType_t xBrokerPending;
+    BaseType_t xBrokerConnected;
+    uint32_t ulBrokerSubscriptions;
+    size_t uxBrokerRxLen;
+    uint8_t pucBrokerRx[ FLEET_SIM_BROKER_RX_LEN ];
+};
+
+typedef struct
+{
+    FleetSimConfig_t xConfig;
+    FleetDevice_t ** pxDevices;
+    QueueHandle_t xBrokerReady; /* Devices with data for the broker */
+    FleetCounters_t xCounters;
+    MqttAgentHistogram_t xHist[ FLEET_HIST_COUNT ];
+} FleetSim_t;
+
+static FleetSim_t xSim = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvNowUs( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( uint32_t ) ( ( ( uint64_t ) xNow.tv_sec * 1000000ULL ) + ( ( uint64_t ) xNow.tv_nsec / 1000ULL ) );
+}
+
+static uint32_t prvGetTimeMs( void )
+{
+    return ( uint32_t ) pdTICKS_TO_MS( xTaskGetTickCount() );
+}
+
+/* xorshift32, each device has its own state */
+static uint32_t prvRandom( uint32_t * pulSeed )
+{
+    uint32_t ulX = *pulSeed;
+
+    ulX ^= ulX << 13;
+    ulX ^= ulX >> 17;
+    ulX ^= ulX << 5;
+    *pulSeed = ulX;
+
+    return ulX;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Same buckets as the MQTT agent statistics: bucket n counts [ 2^(n-1), 2^n ) us */
+static void prvHistRecord( FleetHist_t xHist,
+                           uint32_t ulElapsedUs )
+{
+    MqttAgentHistogram_t * pxHist = &( xSim.xHist[ xHist ] );
+    uint32_t ulBucket = 0;
+
+    if( ulElapsedUs > 0 )
+    {
+        ulBucket = 32 - ( uint32_t ) __builtin_clz( ulElapsedUs );
+    }
+
+    if( ulBucket >= MQTT_AGENT_STATS_HIST_BUCKETS )
+    {
+        ulBucket = MQTT_AGENT_STATS_HIST_BUCKETS - 1;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        pxHist->ulBuckets[ ulBucket ]++;
+        pxHist->ulCount++;
+        pxHist->ullTotalUs += ulElapsedUs;
+
+        if( ulElapsedUs > pxHist->ulMaxUs )
+        {
+            pxHist->ulMaxUs = ulElapsedUs;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/* Upper edge of the bucket holding the given percentile, the maximum for the open ended last bucket */
+static uint32_t prvHistPercentile( const MqttAgentHistogram_t * pxHist,
+                                   uint32_t ulPercent )
+{
+    uint32_t ulTarget = ( uint32_t ) ( ( ( uint64_t ) pxHist->ulCount * ulPercent + 99U ) / 100U );
+    uint32_t ulSeen = 0;
+    uint32_t ulValue = pxHist->ulMaxUs;
+
+    for( uint32_t ulBucket = 0; ulBucket < ( MQTT_AGENT_STATS_HIST_BUCKETS - 1 ); ulBucket++ )
+    {
+        ulSeen += pxHist->ulBuckets[ ulBucket ];
+
+        if( ( ulTarget > 0 ) && ( ulSeen >= ulTarget ) )
+        {
+            ulValue = ( ulBucket == 0 ) ? 1U : ( 1UL << ulBucket );
+            break;
+        }
+    }
+
+    return ( ulValue < pxHist->ulMaxUs ) ? ulValue : pxHist->ulMaxUs;
+}
+
+#define FLEET_COUNT( xField )            \
+    do {                                 \
+        taskENTER_CRITICAL();            \
+        xSim.xCounters.xField++;         \
+        taskEXIT_CRITICAL();             \
+    } while( 0 )
+
+/*-----------------------------------------------------------*/
+
+/* Queue the device for the broker task, once until the broker services it */
+static void prvBrokerNotify( FleetDevice_t * pxDev )
+{
+    BaseType_t xQueueIt;
+
+    taskENTER_CRITICAL();
+    {
+        xQueueIt = ( pxDev->xBrokerPending == pdFALSE ) ? pdTRUE : pdFALSE;
+        pxDev->xBrokerPending = pdTRUE;
+    }
+    taskEXIT_CRITICAL();
+
+    if( xQueueIt == pdTRUE )
+    {
+        ( void ) xQueueSendToBack( xSim.xBrokerReady, &pxDev, 0 );
+    }
+}
+
+/* A NULL command makes the agent run its process loop */
+static void prvWakeAgent( FleetDevice_t * pxDev )
+{
+    MQTTAgentCommand_t * pxNone = NULL;
+
+    ( void ) xQueueSendToBack( pxDev->xMessageCtx.xQueue, &pxNone, 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvLinkRecv( NetworkContext_t * pxNetworkContext,
+                            void * pvBuffer,
+                            size_t uxBytesToRecv )
+{
+    int32_t lRslt = -1;
+
+    if( pxNetworkContext->xLinkUp == pdTRUE )
+    {
+        lRslt = ( int32_t ) xStreamBufferReceive( pxNetworkContext->xRx, pvBuffer, uxBytesToRecv,
+                                                  pxNetworkContext->xRecvBlockTicks );
+    }
+
+    return lRslt;
+}
+
+static int32_t prvLinkSend( NetworkContext_t * pxNetworkContext,
+                            const void * pvBuffer,
+                            size_t uxBytesToSend )
+{
+    int32_t lRslt = -1;
+
+    if( pxNetworkContext->xLinkUp == pdTRUE )
+    {
+        lRslt = ( int32_t ) xStreamBufferSend( pxNetworkContext->xTx, pvBuffer, uxBytesToSend, 0 );
+
+        prvBrokerNotify( pxNetworkContext->pxDevice );
+    }
+
+    return lRslt;
+}
+
+/* Called by the agent task of the device, with the link down */
+static void prvLinkReset( FleetDevice_t * pxDev )
+{
+    ( void ) xStreamBufferReset( pxDev->xNetworkContext.xRx );
+    ( void ) xStreamBufferReset( pxDev->xNetworkContext.xTx );
+
+    pxDev->uxBrokerRxLen = 0;
+    pxDev->xBrokerConnected = pdFALSE;
+    pxDev->ulBrokerSubscriptions = 0;
+    pxDev->xNetworkContext.xLinkUp = pdTRUE;
+}
+
+static void prvLinkDrop( FleetDevice_t * pxDev )
+{
+    pxDev->xNetworkContext.xLinkUp = pdFALSE;
+    pxDev->xBrokerConnected = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTAgentCommand_t * prvGetCommand( uint32_t ulBlockTimeMs )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pvTaskGetThreadLocalStoragePointer( NULL, FLEET_SIM_TLS_INDEX );
+    MQTTAgentCommand_t * pxCommand = NULL;
+
+    configASSERT( pxDev != NULL );
+
+    if( xQueueReceive( pxDev->xCommandPool, &pxCommand, pdMS_TO_TICKS( ulBlockTimeMs ) ) != pdTRUE )
+    {
+        FLEET_COUNT( ulPoolEmpty );
+        pxCommand = NULL;
+    }
+
+    return pxCommand;
+}
+
+static bool prvReleaseCommand( MQTTAgentCommand_t * pxCommand )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pvTaskGetThreadLocalStoragePointer( NULL, FLEET_SIM_TLS_INDEX );
+    bool xReleased = false;
+
+    configASSERT( pxDev != NULL );
+
+    if( ( pxCommand >= &( pxDev->xCommands[ 0 ] ) ) &&
+        ( pxCommand < &( pxDev->xCommands[ FLEET_SIM_COMMAND_POOL_SIZE ] ) ) )
+    {
+        xReleased = ( xQueueSendToBack( pxDev->xCommandPool, &pxCommand, 0 ) == pdTRUE );
+    }
+
+    return xReleased;
+}
+
+static bool prvMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                            MQTTAgentCommand_t * const * pxCommandToSend,
+                            uint32_t ulBlockTimeMs )
+{
+    return ( xQueueSendToBack( pxMsgCtx->xQueue, pxCommandToSend, pdMS_TO_TICKS( ulBlockTimeMs ) ) == pdTRUE );
+}
+
+static bool prvMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                               MQTTAgentCommand_t ** ppxReceivedCommand,
+                               uint32_t ulBlockTimeMs )
+{
+    return ( xQueueReceive( pxMsgCtx->xQueue, ppxReceivedCommand, pdMS_TO_TICKS( ulBlockTimeMs ) ) == pdTRUE );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Commands from the broker carry their send time as a decimal string */
+static void prvIncomingPublishCallback( MQTTAgentContext_t * pxAgentContext,
+                                        uint16_t usPacketId,
+                                        MQTTPublishInfo_t * pxPublishInfo )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pxAgentContext->pIncomingCallbackContext;
+    char pcSentUs[ 12 ] = { 0 };
+
+    ( void ) usPacketId;
+
+    if( ( pxPublishInfo->topicNameLength == strlen( pxDev->pcTopics[ 0 ] ) ) &&
+        ( strncmp( pxPublishInfo->pTopicName, pxDev->pcTopics[ 0 ], pxPublishInfo->topicNameLength ) == 0 ) &&
+        ( pxPublishInfo->payloadLength < sizeof( pcSentUs ) ) )
+    {
+        ( void ) memcpy( pcSentUs, pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+
+        prvHistRecord( FLEET_HIST_COMMAND, prvNowUs() - ( uint32_t ) strtoul( pcSentUs, NULL, 10 ) );
+        FLEET_COUNT( ulCommandsReceived );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscribeComplete( MQTTAgentCommandContext_t * pxCtx,
+                                  MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    FleetDevice_t * pxDev = pxCtx->pxDevice;
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        prvHistRecord( FLEET_HIST_SUBSCRIBE, prvNowUs() - pxCtx->ulStartUs );
+
+        taskENTER_CRITICAL();
+        xSim.xCounters.ulSubscriptions += pxDev->xSubscribeArgs.numSubscriptions;
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        FLEET_COUNT( ulSubscribeFailures );
+    }
+
+    pxCtx->xInUse = pdFALSE;
+
+    ( void ) xTaskNotifyGiveIndexed( pxDev->xPublishTask, FLEET_SIM_SUBACK_NOTIFY_IDX );
+}
+
+/* Subscribe to the command topic and the extra filters of the device, waiting for the SUBACK */
+static void prvSubscribe( FleetDevice_t * pxDev )
+{
+    MQTTAgentCommandContext_t * pxCtx = &( pxDev->xSubscribeCtx );
+    MQTTAgentCommandInfo_t xCommandInfo =
+    {
+        .cmdCompleteCallback          = prvSubscribeComplete,
+        .pCmdCompleteCallbackContext  = pxCtx,
+        .blockTimeMs                  = 0
+    };
+
+    /* A subscribe cancelled by a reconnect has released its context already */
+    if( pxCtx->xInUse == pdFALSE )
+    {
+        for( uint32_t i = 0; i < xSim.xConfig.ulSubscriptions; i++ )
+        {
+            pxDev->xSubscribeInfo[ i ].qos = MQTTQoS1;
+            pxDev->xSubscribeInfo[ i ].pTopicFilter = pxDev->pcTopics[ i ];
+            pxDev->xSubscribeInfo[ i ].topicFilterLength = ( uint16_t ) strlen( pxDev->pcTopics[ i ] );
+        }
+
+        pxDev->xSubscribeArgs.pSubscribeInfo = pxDev->xSubscribeInfo;
+        pxDev->xSubscribeArgs.numSubscriptions = xSim.xConfig.ulSubscriptions;
+
+        pxCtx->ulStartUs = prvNowUs();
+        pxCtx->xInUse = pdTRUE;
+
+        ( void ) ulTaskNotifyTakeIndexed( FLEET_SIM_SUBACK_NOTIFY_IDX, pdTRUE, 0 );
+
+        if( MQTTAgent_Subscribe( &( pxDev->xAgentContext ), &( pxDev->xSubscribeArgs ), &xCommandInfo ) == MQTTSuccess )
+        {
+            ( void ) ulTaskNotifyTakeIndexed( FLEET_SIM_SUBACK_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( FLEET_SIM_SUBACK_TIMEOUT_MS ) );
+        }
+        else
+        {
+            pxCtx->xInUse = pdFALSE;
+            FLEET_COUNT( ulSubscribeFailures );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishComplete( MQTTAgentCommandContext_t * pxCtx,
+                                MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        prvHistRecord( FLEET_HIST_PUBLISH, prvNowUs() - pxCtx->ulStartUs );
+        FLEET_COUNT( ulPublishes );
+    }
+    else
+    {
+        FLEET_COUNT( ulPublishFailures );
+    }
+
+    pxCtx->xInUse = pdFALSE;
+}
+
+/* Random walk of the environment sensor readings */
+static float prvWalk( FleetDevice_t * pxDev,
+                      float fValue,
+                      float fStep )
+{
+    int32_t lStep = ( int32_t ) ( prvRandom( &( pxDev->ulSeed ) ) % 201U ) - 100;
+
+    return fValue + ( ( fStep * ( float ) lStep ) / 100.0f );
+}
+
+static void prvPublish( FleetDevice_t * pxDev,
+                        MQTTAgentCommandContext_t * pxSlot )
+{
+    TelemetryEncoder_t xEncoder;
+    MQTTAgentCommandInfo_t xCommandInfo =
+    {
+        .cmdCompleteCallback          = prvPublishComplete,
+        .pCmdCompleteCallbackContext  = pxSlot,
+        .blockTimeMs                  = 0
+    };
+
+    pxDev->fTemperature = prvWalk( pxDev, pxDev->fTemperature, 0.05f );
+    pxDev->fHumidity = prvWalk( pxDev, pxDev->fHumidity, 0.2f );
+    pxDev->fPressure = prvWalk( pxDev, pxDev->fPressure, 0.1f );
+
+    pxSlot->ulStartUs = prvNowUs();
+
+    vTelemetryBegin( &xEncoder, TELEMETRY_FORMAT_JSON, pxSlot->pucPayload, FLEET_SIM_PAYLOAD_LEN );
+    vTelemetryAddUint( &xEncoder, FLEET_SIM_TS_KEY, pxSlot->ulStartUs );
+    vTelemetryAddFloat( &xEncoder, "temp_0_c", pxDev->fTemperature, 2 );
+    vTelemetryAddFloat( &xEncoder, "rh_pct", pxDev->fHumidity, 2 );
+    vTelemetryAddFloat( &xEncoder, "baro_mbar", pxDev->fPressure, 2 );
+
+    pxSlot->xPublishInfo.qos = MQTTQoS1;
+    pxSlot->xPublishInfo.retain = false;
+    pxSlot->xPublishInfo.dup = false;
+    pxSlot->xPublishInfo.pTopicName = pxDev->pcTelemetryTopic;
+    pxSlot->xPublishInfo.topicNameLength = ( uint16_t ) strlen( pxDev->pcTelemetryTopic );
+    pxSlot->xPublishInfo.pPayload = pxSlot->pucPayload;
+    pxSlot->xPublishInfo.payloadLength = xTelemetryEnd( &xEncoder );
+
+    if( pxSlot->xPublishInfo.payloadLength > 0 )
+    {
+        pxSlot->xInUse = pdTRUE;
+
+        if( MQTTAgent_Publish( &( pxDev->xAgentContext ), &( pxSlot->xPublishInfo ), &xCommandInfo ) != MQTTSuccess )
+        {
+            pxSlot->xInUse = pdFALSE;
+            FLEET_COUNT( ulPublishRejected );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishTask( void * pvParameters )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pvParameters;
+    uint32_t ulSubscribedCount = 0;
+
+    vTaskSetThreadLocalStoragePointer( NULL, FLEET_SIM_TLS_INDEX, pxDev );
+
+    for( ; ; )
+    {
+        uint32_t ulPeriodMs = xSim.xConfig.ulPublishPeriodMs;
+
+        while( pxDev->xConnected == pdFALSE )
+        {
+            ( void ) ulTaskNotifyTakeIndexed( FLEET_SIM_CONNECTED_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+        }
+
+        /* Sessions are clean, so every connection needs its subscriptions again */
+        if( ulSubscribedCount != pxDev->ulConnectCount )
+        {
+            ulSubscribedCount = pxDev->ulConnectCount;
+            prvSubscribe( pxDev );
+        }
+
+        for( uint32_t i = 0; ( i < xSim.xConfig.ulBurst ) && ( pxDev->xConnected == pdTRUE ); i++ )
+        {
+            /* A slot still waiting for its PUBACK counts as rejected, like a full outbox */
+            if( pxDev->xSlots[ i ].xInUse == pdFALSE )
+            {
+                prvPublish( pxDev, &( pxDev->xSlots[ i ] ) );
+            }
+            else
+            {
+                FLEET_COUNT( ulPublishRejected );
+            }
+        }
+
+        /* +-10% so that the devices drift apart */
+        ulPeriodMs = ( ulPeriodMs * 9U / 10U ) + ( prvRandom( &( pxDev->ulSeed ) ) % ( ( ulPeriodMs / 5U ) + 1U ) );
+
+        vTaskDelay( pdMS_TO_TICKS( ulPeriodMs ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvAgentTask( void * pvParameters )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pvParameters;
+    MQTTConnectInfo_t xConnectInfo = { 0 };
+    BaseType_t xReconnect = pdFALSE;
+    uint32_t ulLinkLostUs = 0;
+    MQTTStatus_t xStatus;
+
+    vTaskSetThreadLocalStoragePointer( NULL, FLEET_SIM_TLS_INDEX, pxDev );
+
+    xStatus = MQTTAgent_Init( &( pxDev->xAgentContext ),
+                              &( pxDev->xMessageInterface ),
+                              &( pxDev->xNetworkBuffer ),
+                              &( pxDev->xTransport ),
+                              prvGetTimeMs,
+                              prvIncomingPublishCallback,
+                              pxDev );
+    configASSERT( xStatus == MQTTSuccess );
+
+    xConnectInfo.cleanSession = true;
+    xConnectInfo.keepAliveIntervalSec = FLEET_SIM_KEEP_ALIVE_S;
+    xConnectInfo.pClientIdentifier = pxDev->pcClientId;
+    xConnectInfo.clientIdentifierLength = ( uint16_t ) strlen( pxDev->pcClientId );
+
+    for( ; ; )
+    {
+        bool xSessionPresent = false;
+        uint32_t ulConnectUs;
+
+        vTaskDelay( pdMS_TO_TICKS( prvRandom( &( pxDev->ulSeed ) ) % FLEET_SIM_CONNECT_SPREAD_MS ) );
+
+        /* Fail whatever was queued or waiting for an ack on the previous link */
+        ( void ) MQTTAgent_CancelAll( &( pxDev->xAgentContext ) );
+
+        prvLinkReset( pxDev );
+
+        ulConnectUs = prvNowUs();
+        pxDev->xNetworkContext.xRecvBlockTicks = pdMS_TO_TICKS( FLEET_SIM_CONNECT_POLL_MS );
+
+        xStatus = MQTT_Connect( &( pxDev->xAgentContext.mqttContext ),
+                                &xConnectInfo,
+                                NULL,
+                                FLEET_SIM_CONNACK_TIMEOUT_MS,
+                                &xSessionPresent );
+
+        pxDev->xNetworkContext.xRecvBlockTicks = 0;
+
+        if( xStatus == MQTTSuccess )
+        {
+            uint32_t ulNowUs = prvNowUs();
+
+            prvHistRecord( FLEET_HIST_CONNECT, ulNowUs - ulConnectUs );
+
+            if( xReconnect == pdTRUE )
+            {
+                prvHistRecord( FLEET_HIST_RECONNECT, ulNowUs - ulLinkLostUs );
+            }
+
+            FLEET_COUNT( ulConnects );
+
+            pxDev->ulConnectCount++;
+            pxDev->xConnected = pdTRUE;
+            ( void ) xTaskNotifyGiveIndexed( pxDev->xPublishTask, FLEET_SIM_CONNECTED_NOTIFY_IDX );
+
+            xStatus = MQTTAgent_CommandLoop( &( pxDev->xAgentContext ) );
+
+            pxDev->xConnected = pdFALSE;
+            ulLinkLostUs = prvNowUs();
+            xReconnect = pdTRUE;
+
+            FLEET_COUNT( ulLinkDrops );
+            LogDebug( "%s: agent loop returned %s.", pxDev->pcClientId, MQTT_Status_strerror( xStatus ) );
+        }
+        else
+        {
+            FLEET_COUNT( ulConnectFailures );
+        }
+
+        prvLinkDrop( pxDev );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBrokerSend( FleetDevice_t * pxDev,
+                           const uint8_t * pucPacket,
+                           size_t uxLen )
+{
+    StreamBufferHandle_t xRx = pxDev->xNetworkContext.xRx;
+
+    if( ( pxDev->xNetworkContext.xLinkUp == pdTRUE ) &&
+        ( xStreamBufferSpacesAvailable( xRx ) >= uxLen ) )
+    {
+        ( void ) xStreamBufferSend( xRx, pucPacket, uxLen, 0 );
+    }
+    else
+    {
+        FLEET_COUNT( ulBrokerDrops );
+    }
+}
+
+static void prvBrokerSendAck( FleetDevice_t * pxDev,
+                              uint8_t ucHeader,
+                              const uint8_t * pucPacketId )
+{
+    uint8_t pucAck[ 4 ] = { ucHeader, 2, pucPacketId[ 0 ], pucPacketId[ 1 ] };
+
+    prvBrokerSend( pxDev, pucAck, sizeof( pucAck ) );
+}
+
+/* Send time of a telemetry payload, 0 if it has none */
+static uint32_t prvPayloadTimestamp( const uint8_t * pucPayload,
+                                     size_t uxLen )
+{
+    static const char pcKey[] = "\"" FLEET_SIM_TS_KEY "\":";
+    const size_t uxKeyLen = sizeof( pcKey ) - 1;
+    uint32_t ulValue = 0;
+
+    for( size_t i = 0; ( i + uxKeyLen ) < uxLen; i++ )
+    {
+        if( memcmp( &( pucPayload[ i ] ), pcKey, uxKeyLen ) == 0 )
+        {
+            for( i += uxKeyLen; ( i < uxLen ) && ( pucPayload[ i ] >= '0' ) && ( pucPayload[ i ] <= '9' ); i++ )
+            {
+                ulValue = ( ulValue * 10U ) + ( uint32_t ) ( pucPayload[ i ] - '0' );
+            }
+
+            break;
+        }
+    }
+
+    return ulValue;
+}
+
+static void prvBrokerHandlePublish( FleetDevice_t * pxDev,
+                                    uint8_t ucHeader,
+                                    const uint8_t * pucBody,
+                                    size_t uxLen )
+{
+    uint32_t ulQoS = ( ucHeader >> 1 ) & 0x3U;
+    size_t uxIndex = 2;
+    uint32_t ulSentUs;
+
+    if( uxLen >= 2 )
+    {
+        uxIndex += ( ( size_t ) pucBody[ 0 ] << 8 ) | pucBody[ 1 ];
+    }
+
+    if( ( ulQoS > 0 ) && ( ( uxIndex + 2 ) <= uxLen ) )
+    {
+        prvBrokerSendAck( pxDev, ( ulQoS == 1 ) ? 0x40 : 0x50, &( pucBody[ uxIndex ] ) );
+        uxIndex += 2;
+    }
+
+    if( uxIndex <= uxLen )
+    {
+        ulSentUs = prvPayloadTimestamp( &( pucBody[ uxIndex ] ), uxLen - uxIndex );
+
+        if( ulSentUs != 0 )
+        {
+            prvHistRecord( FLEET_HIST_BROKER_RX, prvNowUs() - ulSentUs );
+        }
+    }
+}
+
+static void prvBrokerHandleSubscribe( FleetDevice_t * pxDev,
+                                      const uint8_t * pucBody,
+                                      size_t uxLen )
+{
+    uint8_t pucSuback[ 4 + FLEET_SIM_MAX_SUBSCRIPTIONS ];
+    size_t uxCount = 0;
+    size_t uxIndex = 2;
+
+    while( ( uxIndex + 2 ) < uxLen )
+    {
+        uxIndex += 2 + ( ( ( size_t ) pucBody[ uxIndex ] << 8 ) | pucBody[ uxIndex + 1 ] );
+
+        if( ( uxIndex < uxLen ) && ( uxCount < FLEET_SIM_MAX_SUBSCRIPTIONS ) )
+        {
+            pucSuback[ 4 + uxCount ] = pucBody[ uxIndex ] & 0x3U;
+            uxCount++;
+        }
+
+        uxIndex++;
+    }
+
+    if( uxLen >= 2 )
+    {
+        pucSuback[ 0 ] = 0x90;
+        pucSuback[ 1 ] = ( uint8_t ) ( 2 + uxCount );
+        pucSuback[ 2 ] = pucBody[ 0 ];
+        pucSuback[ 3 ] = pucBody[ 1 ];
+
+        prvBrokerSend( pxDev, pucSuback, 4 + uxCount );
+
+        pxDev->ulBrokerSubscriptions += ( uint32_t ) uxCount;
+    }
+}
+
+static void prvBrokerHandlePacket( FleetDevice_t * pxDev,
+                                   uint8_t ucHeader,
+                                   const uint8_t * pucBody,
+                                   size_t uxLen )
+{
+    static const uint8_t pucConnack[] = { 0x20, 2, 0, 0 };
+    static const uint8_t pucPingresp[] = { 0xD0, 0 };
+
+    switch( ucHeader >> 4 )
+    {
+        case FLEET_PKT_CONNECT:
+            pxDev->xBrokerConnected = pdTRUE;
+            prvBrokerSend( pxDev, pucConnack, sizeof( pucConnack ) );
+            break;
+
+        case FLEET_PKT_PUBLISH:
+            prvBrokerHandlePublish( pxDev, ucHeader, pucBody, uxLen );
+            break;
+
+        case FLEET_PKT_PUBREL:
+
+            if( uxLen >= 2 )
+            {
+                prvBrokerSendAck( pxDev, 0x70, pucBody );
+            }
+
+            break;
+
+        case FLEET_PKT_SUBSCRIBE:
+            prvBrokerHandleSubscribe( pxDev, pucBody, uxLen );
+            break;
+
+        case FLEET_PKT_UNSUBSCRIBE:
+
+            if( uxLen >= 2 )
+            {
+                prvBrokerSendAck( pxDev, 0xB0, pucBody );
+            }
+
+            break;
+
+        case FLEET_PKT_PINGREQ:
+            prvBrokerSend( pxDev, pucPingresp, sizeof( pucPingresp ) );
+            break;
+
+        case FLEET_PKT_DISCONNECT:
+            pxDev->xBrokerConnected = pdFALSE;
+            break;
+
+        default:
+            /* Acks of the QoS0 commands are not expected */
+            break;
+    }
+}
+
+/* Handle the complete packets at the start of the receive buffer, pdFALSE on a malformed one */
+static BaseType_t prvBrokerParse( FleetDevice_t * pxDev )
+{
+    BaseType_t xValid = pdTRUE;
+    size_t uxOffset = 0;
+
+    while( ( xValid == pdTRUE ) && ( ( uxOffset + 2 ) <= pxDev->uxBrokerRxLen ) )
+    {
+        const uint8_t * pucPacket = &( pxDev->pucBrokerRx[ uxOffset ] );
+        size_t uxAvailable = pxDev->uxBrokerRxLen - uxOffset;
+        size_t uxRemaining = 0;
+        size_t uxHeaderLen = 1;
+        BaseType_t xLengthDone = pdFALSE;
+
+        /* Remaining length, 7 bits per byte, at most 4 bytes */
+        while( ( xLengthDone == pdFALSE ) && ( uxHeaderLen < 5 ) && ( uxHeaderLen < uxAvailable ) )
+        {
+            uxRemaining |= ( size_t ) ( pucPacket[ uxHeaderLen ] & 0x7FU ) << ( 7U * ( uxHeaderLen - 1U ) );
+            xLengthDone = ( ( pucPacket[ uxHeaderLen ] & 0x80U ) == 0 ) ? pdTRUE : pdFALSE;
+            uxHeaderLen++;
+        }
+
+        if( xLengthDone == pdFALSE )
+        {
+            xValid = ( uxHeaderLen < 5 ) ? pdTRUE : pdFALSE;
+            break;
+        }
+
+        if( ( uxHeaderLen + uxRemaining ) > FLEET_SIM_BROKER_RX_LEN )
+        {
+            xValid = pdFALSE;
+        }
+        else if( ( uxHeaderLen + uxRemaining ) <= uxAvailable )
+        {
+            prvBrokerHandlePacket( pxDev, pucPacket[ 0 ], &( pucPacket[ uxHeaderLen ] ), uxRemaining );
+            uxOffset += uxHeaderLen + uxRemaining;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( uxOffset > 0 )
+    {
+        ( void ) memmove( pxDev->pucBrokerRx, &( pxDev->pucBrokerRx[ uxOffset ] ), pxDev->uxBrokerRxLen - uxOffset );
+        pxDev->uxBrokerRxLen -= uxOffset;
+    }
+
+    return xValid;
+}
+
+/* Read everything the device has sent, answer it and wake the device's agent */
+static void prvBrokerService( FleetDevice_t * pxDev )
+{
+    size_t uxRead;
+
+    taskENTER_CRITICAL();
+    pxDev->xBrokerPending = pdFALSE;
+    taskEXIT_CRITICAL();
+
+    do
+    {
+        uxRead = 0;
+
+        if( pxDev->xNetworkContext.xLinkUp == pdTRUE )
+        {
+            uxRead = xStreamBufferReceive( pxDev->xNetworkContext.xTx,
+                                           &( pxDev->pucBrokerRx[ pxDev->uxBrokerRxLen ] ),
+                                           FLEET_SIM_BROKER_RX_LEN - pxDev->uxBrokerRxLen,
+                                           0 );
+            pxDev->uxBrokerRxLen += uxRead;
+
+            if( prvBrokerParse( pxDev ) == pdFALSE )
+            {
+                LogError( "%s: malformed packet, dropping the link.", pxDev->pcClientId );
+                prvLinkDrop( pxDev );
+            }
+        }
+    } while( uxRead > 0 );
+
+    prvWakeAgent( pxDev );
+}
+
+/* A QoS0 publish to the command topic of every device which has subscribed */
+static void prvBrokerSendCommands( void )
+{
+    for( uint32_t i = 0; i < xSim.xConfig.ulDevices; i++ )
+    {
+        FleetDevice_t * pxDev = xSim.pxDevices[ i ];
+        uint8_t pucPacket[ 2 + 2 + FLEET_SIM_TOPIC_LEN + 12 ];
+        size_t uxTopicLen = strlen( pxDev->pcTopics[ 0 ] );
+        int lPayloadLen;
+
+        if( ( pxDev->xBrokerConnected == pdTRUE ) && ( pxDev->ulBrokerSubscriptions > 0 ) )
+        {
+            pucPacket[ 0 ] = 0x30;
+            pucPacket[ 2 ] = ( uint8_t ) ( uxTopicLen >> 8 );
+            pucPacket[ 3 ] = ( uint8_t ) uxTopicLen;
+            ( void ) memcpy( &( pucPacket[ 4 ] ), pxDev->pcTopics[ 0 ], uxTopicLen );
+
+            lPayloadLen = snprintf( ( char * ) &( pucPacket[ 4 + uxTopicLen ] ), 12, "%lu", ( unsigned long ) prvNowUs() );
+
+            /* Topics and payloads are short, so the remaining length fits in one byte */
+            pucPacket[ 1 ] = ( uint8_t ) ( 2 + uxTopicLen + ( size_t ) lPayloadLen );
+
+            prvBrokerSend( pxDev, pucPacket, 2 + pucPacket[ 1 ] );
+            prvWakeAgent( pxDev );
+
+            FLEET_COUNT( ulCommandsSent );
+        }
+    }
+}
+
+static void prvBrokerDropAll( void )
+{
+    LogInfo( "Dropping the links of all devices." );
+
+    for( uint32_t i = 0; i < xSim.xConfig.ulDevices; i++ )
+    {
+        prvLinkDrop( xSim.pxDevices[ i ] );
+        prvWakeAgent( xSim.pxDevices[ i ] );
+    }
+
+    FLEET_COUNT( ulStorms );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvDue( TickType_t xNow,
+                          TickType_t xDeadline )
+{
+    return ( ( TickType_t ) ( xNow - xDeadline ) < ( portMAX_DELAY / 2 ) ) ? pdTRUE : pdFALSE;
+}
+
+static TickType_t prvWaitUntil( TickType_t xNow,
+                                TickType_t xDeadline,
+                                TickType_t xWait )
+{
+    TickType_t xUntil = ( prvDue( xNow, xDeadline ) == pdTRUE ) ? 0 : ( xDeadline - xNow );
+
+    return ( xUntil < xWait ) ? xUntil : xWait;
+}
+
+static void prvBrokerTask( void * pvParameters )
+{
+    TickType_t xCommandPeriod = pdMS_TO_TICKS( xSim.xConfig.ulCommandPeriodMs );
+    TickType_t xStormPeriod = pdMS_TO_TICKS( xSim.xConfig.ulStormPeriodS * 1000U );
+    TickType_t xNextCommand = xTaskGetTickCount() + xCommandPeriod;
+    TickType_t xNextStorm = xTaskGetTickCount() + xStormPeriod;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        FleetDevice_t * pxDev = NULL;
+        TickType_t xNow = xTaskGetTickCount();
+        TickType_t xWait = portMAX_DELAY;
+
+        if( xCommandPeriod > 0 )
+        {
+            xWait = prvWaitUntil( xNow, xNextCommand, xWait );
+        }
+
+        if( xStormPeriod > 0 )
+        {
+            xWait = prvWaitUntil( xNow, xNextStorm, xWait );
+        }
+
+        if( xQueueReceive( xSim.xBrokerReady, &pxDev, xWait ) == pdTRUE )
+        {
+            prvBrokerService( pxDev );
+        }
+
+        xNow = xTaskGetTickCount();
+
+        if( ( xCommandPeriod > 0 ) && ( prvDue( xNow, xNextCommand ) == pdTRUE ) )
+        {
+            prvBrokerSendCommands();
+            xNextCommand = xNow + xCommandPeriod;
+        }
+
+        if( ( xStormPeriod > 0 ) && ( prvDue( xNow, xNextStorm ) == pdTRUE ) )
+        {
+            prvBrokerDropAll();
+            xNextStorm = xNow + xStormPeriod;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static FleetDevice_t * prvDeviceCreate( uint32_t ulIndex )
+{
+    FleetDevice_t * pxDev = ( FleetDevice_t * ) pvPortMalloc( sizeof( FleetDevice_t ) );
+    BaseType_t xResult;
+
+    configASSERT( pxDev != NULL );
+
+    ( void ) memset( pxDev, 0, sizeof( FleetDevice_t ) );
+
+    pxDev->ulIndex = ulIndex;
+    pxDev->ulSeed = 0x9E3779B9UL ^ ( ( ulIndex + 1U ) * 2654435761UL );
+    pxDev->fTemperature = 20.0f + ( float ) ( ulIndex % 10U );
+    pxDev->fHumidity = 40.0f;
+    pxDev->fPressure = 1013.25f;
+
+    ( void ) snprintf( pxDev->pcClientId, sizeof( pxDev->pcClientId ), "fleet-%04lu", ( unsigned long ) ulIndex );
+    ( void ) snprintf( pxDev->pcTelemetryTopic, FLEET_SIM_TOPIC_LEN, "%s/env_sensor_data", pxDev->pcClientId );
+    ( void ) snprintf( pxDev->pcTopics[ 0 ], FLEET_SIM_TOPIC_LEN, "%s/cmd", pxDev->pcClientId );
+
+    for( uint32_t i = 1; i < FLEET_SIM_MAX_SUBSCRIPTIONS; i++ )
+    {
+        ( void ) snprintf( pxDev->pcTopics[ i ], FLEET_SIM_TOPIC_LEN, "%s/sub/%lu", pxDev->pcClientId, ( unsigned long ) i );
+    }
+
+    pxDev->xNetworkContext.pxDevice = pxDev;
+    pxDev->xNetworkContext.xRx = xStreamBufferCreate( FLEET_SIM_LINK_BUFFER_LEN, 1 );
+    pxDev->xNetworkContext.xTx = xStreamBufferCreate( FLEET_SIM_LINK_BUFFER_LEN, 1 );
+    configASSERT( pxDev->xNetworkContext.xRx != NULL );
+    configASSERT( pxDev->xNetworkContext.xTx != NULL );
+
+    pxDev->xTransport.pNetworkContext = &( pxDev->xNetworkContext );
+    pxDev->xTransport.send = prvLinkSend;
+    pxDev->xTransport.recv = prvLinkRecv;
+
+    pxDev->xNetworkBuffer.pBuffer = pxDev->pucNetworkBuffer;
+    pxDev->xNetworkBuffer.size = FLEET_SIM_NETWORK_BUFFER_LEN;
+
+    pxDev->xMessageCtx.xQueue = xQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH, sizeof( MQTTAgentCommand_t * ) );
+    pxDev->xCommandPool = xQueueCreate( FLEET_SIM_COMMAND_POOL_SIZE, sizeof( MQTTAgentCommand_t * ) );
+    configASSERT( pxDev->xMessageCtx.xQueue != NULL );
+    configASSERT( pxDev->xCommandPool != NULL );
+
+    for( uint32_t i = 0; i < FLEET_SIM_COMMAND_POOL_SIZE; i++ )
+    {
+        MQTTAgentCommand_t * pxCommand = &( pxDev->xCommands[ i ] );
+
+        ( void ) xQueueSendToBack( pxDev->xCommandPool, &pxCommand, 0 );
+    }
+
+    pxDev->xMessageInterface.pMsgCtx = &( pxDev->xMessageCtx );
+    pxDev->xMessageInterface.send = prvMessageSend;
+    pxDev->xMessageInterface.recv = prvMessageReceive;
+    pxDev->xMessageInterface.getCommand = prvGetCommand;
+    pxDev->xMessageInterface.releaseCommand = prvReleaseCommand;
+
+    pxDev->xSubscribeCtx.pxDevice = pxDev;
+
+    for( uint32_t i = 0; i < FLEET_SIM_MAX_BURST; i++ )
+    {
+        pxDev->xSlots[ i ].pxDevice = pxDev;
+    }
+
+    /* The publisher first, the agent notifies it */
+    xResult = xTaskCreate( prvPublishTask, "FleetPub", FLEET_SIM_TASK_STACK, pxDev,
+                           FLEET_SIM_PUBLISH_PRIORITY, &( pxDev->xPublishTask ) );
+    configASSERT( xResult == pdPASS );
+
+    xResult = xTaskCreate( prvAgentTask, "FleetAgent", FLEET_SIM_AGENT_STACK, pxDev,
+                           FLEET_SIM_AGENT_PRIORITY, &( pxDev->xAgentTask ) );
+    configASSERT( xResult == pdPASS );
+
+    return pxDev;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReport( void )
+{
+    MqttAgentHistogram_t xHist[ FLEET_HIST_COUNT ];
+    FleetCounters_t xCounters;
+
+    taskENTER_CRITICAL();
+    {
+        ( void ) memcpy( xHist, xSim.xHist, sizeof( xHist ) );
+        xCounters = xSim.xCounters;
+    }
+    taskEXIT_CRITICAL();
+
+    ( void ) fputs( FLEET_SIM_CSV_HEADER, stdout );
+
+    for( uint32_t i = 0; i < FLEET_HIST_COUNT; i++ )
+    {
+        ( void ) printf( "FLEET,%s,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                         pcHistNames[ i ],
+                         ( unsigned long ) xHist[ i ].ulCount,
+                         ( unsigned long ) ( ( xHist[ i ].ulCount > 0 ) ? ( xHist[ i ].ullTotalUs / xHist[ i ].ulCount ) : 0 ),
+                         ( unsigned long ) prvHistPercentile( &( xHist[ i ] ), 50 ),
+                         ( unsigned long ) prvHistPercentile( &( xHist[ i ] ), 90 ),
+                         ( unsigned long ) prvHistPercentile( &( xHist[ i ] ), 99 ),
+                         ( unsigned long ) xHist[ i ].ulMaxUs );
+    }
+
+    ( void ) fputs( FLEET_SIM_COUNTERS_HEADER, stdout );
+    ( void ) printf( "FLEET_COUNTERS,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                     ( unsigned long ) xSim.xConfig.ulDevices,
+                     ( unsigned long ) xCounters.ulConnects,
+                     ( unsigned long ) xCounters.ulConnectFailures,
+                     ( unsigned long ) xCounters.ulLinkDrops,
+                     ( unsigned long ) xCounters.ulStorms,
+                     ( unsigned long ) xCounters.ulPublishes,
+                     ( unsigned long ) xCounters.ulPublishFailures,
+                     ( unsigned long ) xCounters.ulPublishRejected,
+                     ( unsigned long ) xCounters.ulPoolEmpty,
+                     ( unsigned long ) xCounters.ulSubscriptions,
+                     ( unsigned long ) xCounters.ulSubscribeFailures,
+                     ( unsigned long ) xCounters.ulCommandsSent,
+                     ( unsigned long ) xCounters.ulCommandsReceived,
+                     ( unsigned long ) xCounters.ulBrokerDrops );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvControlTask( void * pvParameters )
+{
+    BaseType_t xResult;
+
+    ( void ) pvParameters;
+
+    xSim.pxDevices = ( FleetDevice_t ** ) pvPortMalloc( xSim.xConfig.ulDevices * sizeof( FleetDevice_t * ) );
+    xSim.xBrokerReady = xQueueCreate( xSim.xConfig.ulDevices, sizeof( FleetDevice_t * ) );
+    configASSERT( xSim.pxDevices != NULL );
+    configASSERT( xSim.xBrokerReady != NULL );
+
+    for( uint32_t i = 0; i < xSim.xConfig.ulDevices; i++ )
+    {
+        xSim.pxDevices[ i ] = prvDeviceCreate( i );
+    }
+
+    xResult = xTaskCreate( prvBrokerTask, "FleetBroker", FLEET_SIM_AGENT_STACK, NULL,
+                           FLEET_SIM_BROKER_PRIORITY, NULL );
+    configASSERT( xResult == pdPASS );
+
+    LogInfo( "Simulating %lu devices for %lu s.", ( unsigned long ) xSim.xConfig.ulDevices,
+             ( unsigned long ) xSim.xConfig.ulDurationS );
+
+    vTaskDelay( pdMS_TO_TICKS( xSim.xConfig.ulDurationS * 1000U ) );
+
+    prvReport();
+
+    vDyingGasp();
+
+    exit( EXIT_SUCCESS );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvClamp( uint32_t ulValue,
+                          uint32_t ulMin,
+                          uint32_t ulMax )
+{
+    return ( ulValue < ulMin ) ? ulMin : ( ( ulValue > ulMax ) ? ulMax : ulValue );
+}
+
+void vFleetSimStart( const FleetSimConfig_t * pxConfig )
+{
+    BaseType_t xResult;
+
+    configASSERT( pxConfig != NULL );
+
+    xSim.xConfig = *pxConfig;
+    xSim.xConfig.ulDevices = prvClamp( pxConfig->ulDevices, 1, FLEET_SIM_MAX_DEVICES );
+    xSim.xConfig.ulDurationS = prvClamp( pxConfig->ulDurationS, 1, UINT32_MAX / 1000U );
+    xSim.xConfig.ulPublishPeriodMs = prvClamp( pxConfig->ulPublishPeriodMs, 1, UINT32_MAX / 10U );
+    xSim.xConfig.ulBurst = prvClamp( pxConfig->ulBurst, 0, FLEET_SIM_MAX_BURST );
+    xSim.xConfig.ulSubscriptions = prvClamp( pxConfig->ulSubscriptions, 1, FLEET_SIM_MAX_SUBSCRIPTIONS );
+    xSim.xConfig.ulStormPeriodS = prvClamp( pxConfig->ulStormPeriodS, 0, UINT32_MAX / 1000U );
+
+    xResult = xTaskCreate( prvControlTask, "FleetCtrl", FLEET_SIM_TASK_STACK, NULL,
+                           FLEET_SIM_CONTROL_PRIORITY, NULL );
+    configASSERT( xResult == pdPASS );
+}
@@ -0,0 +1,94 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _FLEET_SIM_H
+#define _FLEET_SIM_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Simulation of many devices in one host process.
+ *
+ * Each virtual device runs its own coreMQTT agent context in an agent task, with its own command
+ * queue and command pool, and a publisher task which subscribes to its command topic and sends
+ * bursts of telemetry encoded by telemetry_encode.c with synthetic sensor values. The devices are
+ * connected over stream buffers to a loopback broker task, which acknowledges their packets, sends
+ * commands to every subscribed device and can drop all links at once to cause a reconnect storm.
+ *
+ * At the end of the run the latency distributions and counters are written to stdout in the
+ * format of FLEET_SIM_CSV_HEADER and FLEET_SIM_COUNTERS_HEADER.
+ */
+
+#ifndef FLEET_SIM_MAX_DEVICES
+    #define FLEET_SIM_MAX_DEVICES    ( 1000U )
+#endif
+
+/* Publishes in flight per device, which is also the longest burst */
+#ifndef FLEET_SIM_MAX_BURST
+    #define FLEET_SIM_MAX_BURST    ( 16U )
+#endif
+
+/* Topic filters per device, including its command topic */
+#ifndef FLEET_SIM_MAX_SUBSCRIPTIONS
+    #define FLEET_SIM_MAX_SUBSCRIPTIONS    ( 8U )
+#endif
+
+/* Commands available to each device, as MQTT_COMMAND_CONTEXTS_POOL_SIZE is on the board */
+#ifndef FLEET_SIM_COMMAND_POOL_SIZE
+    #define FLEET_SIM_COMMAND_POOL_SIZE    ( 8U )
+#endif
+
+#define FLEET_SIM_CSV_HEADER         "FLEET,metric,count,mean_us,p50_us,p90_us,p99_us,max_us\r\n"
+#define FLEET_SIM_COUNTERS_HEADER    "FLEET_COUNTERS,devices,connects,connect_failures,link_drops,storms,publishes,publish_failures,publish_rejected,pool_empty,subscriptions,subscribe_failures,commands_sent,commands_received,broker_drops\r\n"
+
+typedef struct
+{
+    uint32_t ulDevices;
+    uint32_t ulDurationS;
+    uint32_t ulPublishPeriodMs; /* Time between the bursts of a device */
+    uint32_t ulBurst;           /* Publishes per burst */
+    uint32_t ulSubscriptions;   /* Topic filters per device */
+    uint32_t ulCommandPeriodMs; /* Time between commands sent to each device, 0 for none */
+    uint32_t ulStormPeriodS;    /* Time between drops of all links, 0 for none */
+} FleetSimConfig_t;
+
+#define FLEET_SIM_CONFIG_DEFAULT                                                           \
+    {                                                                                      \
+        .ulDevices = 100, .ulDurationS = 30, .ulPublishPeriodMs = 1000, .ulBurst = 1,      \
+        .ulSubscriptions = 2, .ulCommandPeriodMs = 5000, .ulStormPeriodS = 0               \
+    }
+
+/*
+ * @brief Create the control task of a simulation with the settings in pxConfig, which are
+ * clamped to the limits above. The control task starts the broker and the devices, and exits the
+ * process once the results are written. Call before starting the scheduler.
+ */
+void vFleetSimStart( const FleetSimConfig_t * pxConfig );
+
+#endif /* _FLEET_SIM_H */
@@ -0,0 +1,446 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Known answer tests of Common/kvstore/kvstore_nv_littlefs_log.c, run by "posix_host selftest".
+ *
+ * The tests drive the backend through its kvstore_prv.h interface, below the cache, and compare
+ * /cfg.log byte for byte with the log format: an 8 byte header ("KLOG", version 1) followed by
+ * records of key length, type and little endian value length, then the key name and the value. A
+ * reset is simulated with vprvNvImplDeinit, so that the next access replays the log from the
+ * RAM block device.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "kvstore_prv.h"
+#include "lfs.h"
+#include "fs/lfs_port.h"
+#include "kvstore_log_test.h"
+
+#define LOG_TEST_FILE        "/cfg.log"
+#define LOG_TEST_TMP_FILE    "/cfg.log.tmp"
+#define LOG_TEST_BUF_LEN     ( 512 )
+
+/* As in kvstore_nv_littlefs_log.c */
+#ifndef KVSTORE_LOG_COMPACT_SIZE
+    #define KVSTORE_LOG_COMPACT_SIZE    ( 4096 )
+#endif
+
+#define LOG_TEST_HEADER      'K', 'L', 'O', 'G', 0x01, 0x00, 0x00, 0x00
+
+/* thing_name = "dev1", mqtt_port = 8883, thing_name = "dev22" */
+static const uint8_t ucLogWriteKat[] =
+{
+    LOG_TEST_HEADER,
+    0x0A, KV_TYPE_STRING, 0x04, 0x00, 't', 'h', 'i', 'n', 'g', '_', 'n', 'a', 'm', 'e', 'd', 'e', 'v', '1',
+    0x09, KV_TYPE_UINT32, 0x04, 0x00, 'm', 'q', 't', 't', '_', 'p', 'o', 'r', 't', 0xB3, 0x22, 0x00, 0x00,
+    0x0A, KV_TYPE_STRING, 0x05, 0x00, 't', 'h', 'i', 'n', 'g', '_', 'n', 'a', 'm', 'e', 'd', 'e', 'v', '2', '2'
+};
+
+/*-----------------------------------------------------------*/
+
+/* Append the expected bytes of a record to pucBuf, encoded field by field */
+static size_t prvAppendRecord( uint8_t * pucBuf,
+                             size_t xOffset,
+                             KVStoreKey_t xKey,
+                             KVStoreValueType_t xType,
+                             const void * pvValue,
+                             size_t xLength )
+{
+    const char * pcKey = kvKeyToString( xKey );
+    size_t xKeyLen = strlen( pcKey );
+
+    configASSERT( ( xOffset + 4 + xKeyLen + xLength ) <= LOG_TEST_BUF_LEN );
+
+    pucBuf[ xOffset++ ] = ( uint8_t ) xKeyLen;
+    pucBuf[ xOffset++ ] = ( uint8_t ) xType;
+    pucBuf[ xOffset++ ] = ( uint8_t ) ( xLength & 0xFF );
+    pucBuf[ xOffset++ ] = ( uint8_t ) ( xLength >> 8 );
+
+    ( void ) memcpy( &( pucBuf[ xOffset ] ), pcKey, xKeyLen );
+    xOffset += xKeyLen;
+
+    ( void ) memcpy( &( pucBuf[ xOffset ] ), pvValue, xLength );
+    xOffset += xLength;
+
+    return xOffset;
+}
+
+static size_t prvAppendHeader( uint8_t * pucBuf )
+{
+    static const uint8_t ucHeader[] = { LOG_TEST_HEADER };
+
+    ( void ) memcpy( pucBuf, ucHeader, sizeof( ucHeader ) );
+
+    return sizeof( ucHeader );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvWriteLogFile( const uint8_t * pucData,
+                                 size_t xLength )
+{
+    lfs_t * pxLfs = pxGetDefaultFsCtx();
+    lfs_file_t xFile = { 0 };
+    lfs_ssize_t lReturn = lfs_file_open( pxLfs, &xFile, LOG_TEST_FILE, LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT );
+
+    if( lReturn == LFS_ERR_OK )
+    {
+        lReturn = lfs_file_write( pxLfs, &xFile, pucData, xLength );
+
+        if( lfs_file_close( pxLfs, &xFile ) != LFS_ERR_OK )
+        {
+            lReturn = LFS_ERR_IO;
+        }
+    }
+
+    if( lReturn != ( lfs_ssize_t ) xLength )
+    {
+        LogError( "Failed to write %lu bytes to " LOG_TEST_FILE ": %ld", ( unsigned long ) xLength, ( long ) lReturn );
+    }
+
+    return( lReturn == ( lfs_ssize_t ) xLength );
+}
+
+/* Compare the whole log file with an expected image */
+static BaseType_t prvCheckLogFile( const char * pcTest,
+                                 const uint8_t * pucExpected,
+                                 size_t xLength )
+{
+    static uint8_t ucActual[ LOG_TEST_BUF_LEN ];
+    lfs_t * pxLfs = pxGetDefaultFsCtx();
+    lfs_file_t xFile = { 0 };
+    lfs_ssize_t lRead = lfs_file_open( pxLfs, &xFile, LOG_TEST_FILE, LFS_O_RDONLY );
+    BaseType_t xPass = pdFALSE;
+
+    if( lRead == LFS_ERR_OK )
+    {
+        lRead = lfs_file_read( pxLfs, &xFile, ucActual, sizeof( ucActual ) );
+        ( void ) lfs_file_close( pxLfs, &xFile );
+    }
+
+    if( lRead != ( lfs_ssize_t ) xLength )
+    {
+        LogError( "%s: log is %ld bytes, expected %lu", pcTest, ( long ) lRead, ( unsigned long ) xLength );
+    }
+    else
+    {
+        xPass = pdTRUE;
+
+        for( size_t i = 0; ( xPass == pdTRUE ) && ( i < xLength ); i++ )
+        {
+            if( ucActual[ i ] != pucExpected[ i ] )
+            {
+                LogError( "%s: log byte %lu is 0x%02x, expected 0x%02x", pcTest, ( unsigned long ) i,
+                          ucActual[ i ], pucExpected[ i ] );
+                xPass = pdFALSE;
+            }
+        }
+    }
+
+    return xPass;
+}
+
+static lfs_soff_t prvLogFileSize( void )
+{
+    struct lfs_info xInfo = { 0 };
+    int lReturn = lfs_stat( pxGetDefaultFsCtx(), LOG_TEST_FILE, &xInfo );
+
+    return( ( lReturn == LFS_ERR_OK ) ? ( lfs_soff_t ) xInfo.size : ( lfs_soff_t ) lReturn );
+}
+
+/* Forget the loaded values and delete the log, as on a freshly formatted device */
+static void prvResetEmpty( void )
+{
+    vprvNvImplDeinit();
+    ( void ) lfs_remove( pxGetDefaultFsCtx(), LOG_TEST_FILE );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvCheckValue( const char * pcTest,
+                               KVStoreKey_t xKey,
+                               KVStoreValueType_t xType,
+                               const void * pvExpected,
+                               size_t xLength )
+{
+    uint8_t ucValue[ KVSTORE_VAL_MAX_LEN ];
+    KVStoreValueType_t xReadType = KV_TYPE_LAST;
+    size_t xReadLength = SIZE_MAX;
+    BaseType_t xRead = xprvReadValueFromImpl( xKey, &xReadType, &xReadLength, ucValue, sizeof( ucValue ) );
+    BaseType_t xPass = pdFALSE;
+
+    if( xType == KV_TYPE_NONE )
+    {
+        xPass = ( ( xRead == pdFALSE ) &&
+                  ( xReadType == KV_TYPE_NONE ) &&
+                  ( xprvGetValueLengthFromImpl( xKey ) == 0 ) );
+    }
+    else
+    {
+        xPass = ( ( xRead == pdTRUE ) &&
+                  ( xReadType == xType ) &&
+                  ( xReadLength == xLength ) &&
+                  ( xprvGetValueLengthFromImpl( xKey ) == xLength ) &&
+                  ( memcmp( ucValue, pvExpected, xLength ) == 0 ) );
+    }
+
+    if( xPass == pdFALSE )
+    {
+        LogError( "%s: unexpected value of %s: read %d, type %d, length %lu", pcTest, kvKeyToString( xKey ),
+                  ( int ) xRead, ( int ) xReadType, ( unsigned long ) xReadLength );
+    }
+
+    return xPass;
+}
+
+/*-----------------------------------------------------------*/
+
+/* The bytes appended for each write, then the values replayed from them after a reset */
+static BaseType_t prvTestReplay( void )
+{
+    const uint32_t ulPort = 8883;
+    BaseType_t xPass = pdTRUE;
+
+    prvResetEmpty();
+
+    xPass &= xprvWriteValueToImpl( CS_CORE_THING_NAME, KV_TYPE_STRING, 4, "dev1" );
+    xPass &= xprvWriteValueToImpl( CS_CORE_MQTT_PORT, KV_TYPE_UINT32, sizeof( ulPort ), &ulPort );
+    xPass &= xprvWriteValueToImpl( CS_CORE_THING_NAME, KV_TYPE_STRING, 5, "dev22" );
+
+    if( xPass != pdTRUE )
+    {
+        LogError( "replay: write failed" );
+    }
+
+    xPass &= prvCheckLogFile( "replay", ucLogWriteKat, sizeof( ucLogWriteKat ) );
+
+    vprvNvImplDeinit();
+
+    xPass &= prvCheckValue( "replay", CS_CORE_THING_NAME, KV_TYPE_STRING, "dev22", 5 );
+    xPass &= prvCheckValue( "replay", CS_CORE_MQTT_PORT, KV_TYPE_UINT32, &ulPort, sizeof( ulPort ) );
+    xPass &= prvCheckValue( "replay", CS_CORE_MQTT_ENDPOINT, KV_TYPE_NONE, NULL, 0 );
+
+    /* Replaying a log does not rewrite it */
+    xPass &= prvCheckLogFile( "replay", ucLogWriteKat, sizeof( ucLogWriteKat ) );
+
+    return xPass;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * A log cut at every offset inside its last record, as by a reset in the middle of an append,
+ * and a log with a bad header. The records before the cut are kept, the rest is dropped and the
+ * next write rewrites the log with the live values only.
+ */
+static BaseType_t prvTestTruncation( void )
+{
+    static uint8_t ucLog[ LOG_TEST_BUF_LEN ];
+    static uint8_t ucExpected[ LOG_TEST_BUF_LEN ];
+    const uint32_t ulPort = 8883;
+    size_t xValidLen = 0;
+    size_t xFullLen = 0;
+    size_t xExpectedLen = 0;
+    BaseType_t xPass = pdTRUE;
+
+    xValidLen = prvAppendHeader( ucLog );
+    xValidLen = prvAppendRecord( ucLog, xValidLen, CS_CORE_THING_NAME, KV_TYPE_STRING, "dev1", 4 );
+    xFullLen = prvAppendRecord( ucLog, xValidLen, CS_CORE_MQTT_ENDPOINT, KV_TYPE_STRING, "host1", 5 );
+
+    xExpectedLen = prvAppendHeader( ucExpected );
+    xExpectedLen = prvAppendRecord( ucExpected, xExpectedLen, CS_CORE_THING_NAME, KV_TYPE_STRING, "dev1", 4 );
+    xExpectedLen = prvAppendRecord( ucExpected, xExpectedLen, CS_CORE_MQTT_PORT, KV_TYPE_UINT32, &ulPort, sizeof( ulPort ) );
+
+    for( size_t xCut = xValidLen + 1; ( xPass == pdTRUE ) && ( xCut < xFullLen ); xCut++ )
+    {
+        prvResetEmpty();
+
+        xPass &= prvWriteLogFile( ucLog, xCut );
+
+        xPass &= prvCheckValue( "truncation", CS_CORE_THING_NAME, KV_TYPE_STRING, "dev1", 4 );
+        xPass &= prvCheckValue( "truncation", CS_CORE_MQTT_ENDPOINT, KV_TYPE_NONE, NULL, 0 );
+
+        xPass &= xprvWriteValueToImpl( CS_CORE_MQTT_PORT, KV_TYPE_UINT32, sizeof( ulPort ), &ulPort );
+        xPass &= prvCheckLogFile( "truncation", ucExpected, xExpectedLen );
+
+        if( xPass != pdTRUE )
+        {
+            LogError( "truncation: failed with the log cut at %lu of %lu bytes",
+                      ( unsigned long ) xCut, ( unsigned long ) xFullLen );
+        }
+    }
+
+    /* A log with a bad header holds no values and is replaced by the next write */
+    prvResetEmpty();
+
+    ( void ) memcpy( ucLog, "KLOG\x02\x00\x00\x00", 8 );
+    xPass &= prvWriteLogFile( ucLog, xValidLen );
+
+    xPass &= prvCheckValue( "bad header", CS_CORE_THING_NAME, KV_TYPE_NONE, NULL, 0 );
+
+    xPass &= xprvWriteValueToImpl( CS_CORE_MQTT_PORT, KV_TYPE_UINT32, sizeof( ulPort ), &ulPort );
+
+    xExpectedLen = prvAppendHeader( ucExpected );
+    xExpectedLen = prvAppendRecord( ucExpected, xExpectedLen, CS_CORE_MQTT_PORT, KV_TYPE_UINT32, &ulPort, sizeof( ulPort ) );
+    xPass &= prvCheckLogFile( "bad header", ucExpected, xExpectedLen );
+
+    return xPass;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Rewrites of one key grow the log by one record each until the superseded records exceed both
+ * KVSTORE_LOG_COMPACT_SIZE and the live records. That write rewrites the log with one record
+ * per key, in key order. Resets between the writes check that a replayed log counts the same
+ * superseded bytes as the writes which made it.
+ */
+static BaseType_t prvTestCompaction( void )
+{
+    static uint8_t ucExpected[ LOG_TEST_BUF_LEN ];
+    struct lfs_info xInfo = { 0 };
+    const size_t xPortRecordLen = 4 + strlen( kvKeyToString( CS_CORE_MQTT_PORT ) ) + sizeof( uint32_t );
+    const uint32_t ulWrites = 3 * ( ( KVSTORE_LOG_COMPACT_SIZE / xPortRecordLen ) + 1 );
+    uint32_t ulCompactions = 0;
+    size_t xLiveLen = 0;
+    lfs_soff_t xSize = 0;
+    BaseType_t xPass = pdTRUE;
+
+    prvResetEmpty();
+
+    xPass &= xprvWriteValueToImpl( CS_CORE_THING_NAME, KV_TYPE_STRING, 4, "dev1" );
+
+    for( uint32_t ulValue = 0; ( xPass == pdTRUE ) && ( ulValue < ulWrites ); ulValue++ )
+    {
+        size_t xExpectedLen = prvAppendHeader( ucExpected );
+        lfs_soff_t xNewSize = 0;
+        size_t xDeadLen = 0;
+
+        xExpectedLen = prvAppendRecord( ucExpected, xExpectedLen, CS_CORE_THING_NAME, KV_TYPE_STRING, "dev1", 4 );
+        xExpectedLen = prvAppendRecord( ucExpected, xExpectedLen, CS_CORE_MQTT_PORT, KV_TYPE_UINT32, &ulValue, sizeof( ulValue ) );
+
+        xSize = prvLogFileSize();
+
+        if( ( ulValue % 97 ) == 0 )
+        {
+            vprvNvImplDeinit();
+        }
+
+        /* Superseded bytes once this write is made, the record of the previous value included */
+        if( ulValue > 0 )
+        {
+            xLiveLen = xExpectedLen;
+            xDeadLen = ( ( size_t ) xSize - xLiveLen ) + xPortRecordLen;
+        }
+
+        xPass &= xprvWriteValueToImpl( CS_CORE_MQTT_PORT, KV_TYPE_UINT32, sizeof( ulValue ), &ulValue );
+        xNewSize = prvLogFileSize();
+
+        if( ( xDeadLen > KVSTORE_LOG_COMPACT_SIZE ) &&
+            ( xDeadLen > xLiveLen ) )
+        {
+            ulCompactions++;
+            xPass &= prvCheckLogFile( "compaction", ucExpected, xExpectedLen );
+            xPass &= ( lfs_stat( pxGetDefaultFsCtx(), LOG_TEST_TMP_FILE, &xInfo ) == LFS_ERR_NOENT );
+        }
+        else if( xNewSize != ( xSize + ( lfs_soff_t ) xPortRecordLen ) )
+        {
+            xPass = pdFALSE;
+        }
+
+        if( xPass != pdTRUE )
+        {
+            LogError( "compaction: write %lu: log is %ld bytes, was %ld", ( unsigned long ) ulValue,
+                      ( long ) xNewSize, ( long ) xSize );
+        }
+    }
+
+    if( ulCompactions < 2 )
+    {
+        LogError( "compaction: %lu compactions in %lu writes", ( unsigned long ) ulCompactions, ( unsigned long ) ulWrites );
+        xPass = pdFALSE;
+    }
+
+    vprvNvImplDeinit();
+
+    if( xPass == pdTRUE )
+    {
+        const uint32_t ulLast = ulWrites - 1;
+
+        xPass &= prvCheckValue( "compaction", CS_CORE_THING_NAME, KV_TYPE_STRING, "dev1", 4 );
+        xPass &= prvCheckValue( "compaction", CS_CORE_MQTT_PORT, KV_TYPE_UINT32, &ulLast, sizeof( ulLast ) );
+    }
+
+    return xPass;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xKvStoreLogSelfTest( void )
+{
+    static const struct
+    {
+        const char * pcName;
+        BaseType_t ( * pxTest )( void );
+    }
+    xTests[] =
+    {
+        { "replay",     prvTestReplay     },
+        { "truncation", prvTestTruncation },
+        { "compaction", prvTestCompaction },
+    };
+    BaseType_t xPass = pdTRUE;
+
+    for( size_t i = 0; i < ( sizeof( xTests ) / sizeof( xTests[ 0 ] ) ); i++ )
+    {
+        BaseType_t xResult = xTests[ i ].pxTest();
+
+        ( void ) printf( "kvstore_log_%s: %s\n", xTests[ i ].pcName, ( xResult == pdTRUE ) ? "PASS" : "FAIL" );
+
+        if( xResult != pdTRUE )
+        {
+            xPass = pdFALSE;
+        }
+    }
+
+    /* Leave an empty store behind */
+    prvResetEmpty();
+
+    return xPass;
+}
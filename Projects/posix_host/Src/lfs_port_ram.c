@@ -0,0 +1,212 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#include "lfs_util.h"
+#include "lfs.h"
+#include "lfs_port_ram.h"
+
+/*
+ * littlefs block device in host memory with the geometry of the MX25LM51245G used on the board:
+ * 4 KB sectors, 256 byte program pages and the same caches, so the file system does the same
+ * work per operation as on the OSPI flash. Erased bytes read as 0xFF and programming can only
+ * clear bits, as on NOR flash.
+ */
+
+#define LFS_RAM_SECTOR_SZ            ( 4096 )
+#define LFS_RAM_PROG_SIZE            ( 256 )
+
+#ifndef LFS_RAM_BLOCK_COUNT
+    #define LFS_RAM_BLOCK_COUNT      ( 2048 )
+#endif
+
+#define LFS_CONFIG_CACHE_SIZE        LFS_RAM_SECTOR_SZ
+#define LFS_CONFIG_LOOKAHEAD_SIZE    ( ( ( LFS_RAM_BLOCK_COUNT + 63 ) / 64 ) * 8 )
+
+struct LfsPortCtx
+{
+    SemaphoreHandle_t xMutex;
+    TickType_t xBlockTime;
+    uint8_t * pucStorage;
+};
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_read( const struct lfs_config * c,
+                          lfs_block_t block,
+                          lfs_off_t off,
+                          void * buffer,
+                          lfs_size_t size )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    ( void ) memcpy( buffer, &( pxCtx->pucStorage[ ( block * c->block_size ) + off ] ), size );
+
+    return 0;
+}
+
+static int lfs_port_prog( const struct lfs_config * c,
+                          lfs_block_t block,
+                          lfs_off_t off,
+                          const void * buffer,
+                          lfs_size_t size )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+    uint8_t * pucDest = &( pxCtx->pucStorage[ ( block * c->block_size ) + off ] );
+    const uint8_t * pucSrc = ( const uint8_t * ) buffer;
+
+    for( lfs_size_t i = 0; i < size; i++ )
+    {
+        pucDest[ i ] &= pucSrc[ i ];
+    }
+
+    return 0;
+}
+
+static int lfs_port_erase( const struct lfs_config * c,
+                           lfs_block_t block )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    ( void ) memset( &( pxCtx->pucStorage[ block * c->block_size ] ), 0xFF, c->block_size );
+
+    return 0;
+}
+
+static int lfs_port_sync( const struct lfs_config * c )
+{
+    ( void ) c;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef LFS_THREADSAFE
+    static int lfs_port_lock( const struct lfs_config * c )
+    {
+        struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+        return ( xSemaphoreTake( pxCtx->xMutex, pxCtx->xBlockTime ) == pdTRUE ) ? 0 : -1;
+    }
+
+    static int lfs_port_unlock( const struct lfs_config * c )
+    {
+        struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+        return ( xSemaphoreGive( pxCtx->xMutex ) == pdTRUE ) ? 0 : -1;
+    }
+#endif /* LFS_THREADSAFE */
+
+/*-----------------------------------------------------------*/
+
+/* The following function lfs_crc is derived from lfs_util.c and
+ * is available under the following terms:
+ * Copyright (c) 2017, Arm Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+uint32_t lfs_crc( uint32_t crc,
+                  const void * buffer,
+                  size_t size )
+{
+    static const uint32_t rtable[ 16 ] =
+    {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    const uint8_t * data = buffer;
+
+    for( size_t i = 0; i < size; i++ )
+    {
+        crc = ( crc >> 4 ) ^ rtable[ ( crc ^ ( data[ i ] >> 0 ) ) & 0xf ];
+        crc = ( crc >> 4 ) ^ rtable[ ( crc ^ ( data[ i ] >> 4 ) ) & 0xf ];
+    }
+
+    return crc;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Initializes littlefs on an erased area of host memory.
+ * @param xBlockTime Amount of time to wait for the file system lock
+ */
+const struct lfs_config * pxInitializeRamFs( TickType_t xBlockTime )
+{
+    struct lfs_config * pxCfg = ( struct lfs_config * ) pvPortMalloc( sizeof( struct lfs_config ) );
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) pvPortMalloc( sizeof( struct LfsPortCtx ) );
+
+    configASSERT( pxCfg != NULL );
+    configASSERT( pxCtx != NULL );
+
+    ( void ) memset( pxCfg, 0, sizeof( struct lfs_config ) );
+
+    pxCtx->xBlockTime = xBlockTime;
+    pxCtx->xMutex = xSemaphoreCreateMutex();
+    pxCtx->pucStorage = ( uint8_t * ) pvPortMalloc( LFS_RAM_BLOCK_COUNT * LFS_RAM_SECTOR_SZ );
+
+    configASSERT( pxCtx->xMutex != NULL );
+    configASSERT( pxCtx->pucStorage != NULL );
+
+    ( void ) memset( pxCtx->pucStorage, 0xFF, LFS_RAM_BLOCK_COUNT * LFS_RAM_SECTOR_SZ );
+
+    pxCfg->context = pxCtx;
+
+    pxCfg->read = lfs_port_read;
+    pxCfg->prog = lfs_port_prog;
+    pxCfg->erase = lfs_port_erase;
+    pxCfg->sync = lfs_port_sync;
+
+    #ifdef LFS_THREADSAFE
+        pxCfg->lock = &lfs_port_lock;
+        pxCfg->unlock = &lfs_port_unlock;
+    #endif
+
+    pxCfg->read_size = 1;
+    pxCfg->prog_size = LFS_RAM_PROG_SIZE;
+    pxCfg->block_size = LFS_RAM_SECTOR_SZ;
+    pxCfg->block_count = LFS_RAM_BLOCK_COUNT;
+    pxCfg->block_cycles = 500;
+
+    pxCfg->cache_size = LFS_CONFIG_CACHE_SIZE;
+    pxCfg->lookahead_size = LFS_CONFIG_LOOKAHEAD_SIZE;
+
+    return pxCfg;
+}
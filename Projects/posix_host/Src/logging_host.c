@@ -0,0 +1,148 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Logging backend of the host build.
+ *
+ * Lines are formatted and written to stderr by the calling task, so that benchmark results on
+ * stdout stay separate. There is no deferred formatting and no runtime module levels: each
+ * module logs at its LOG_LEVEL.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "logging.h"
+
+#define HOST_LOG_LINE_LENGTH    ( 512 )
+
+/*-----------------------------------------------------------*/
+
+static void vLoggingPrintfV( const char * const pcLogLevel,
+                             const char * const pcFileName,
+                             const unsigned long ulLineNumber,
+                             const char * const pcFormat,
+                             va_list args )
+{
+    char pcLine[ HOST_LOG_LINE_LENGTH ];
+    const char * pcTaskName = "None";
+    int lLen;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pcTaskName = pcTaskGetName( NULL );
+    }
+
+    lLen = snprintf( pcLine, sizeof( pcLine ), "<%s> %lu [%s] ",
+                     pcLogLevel, ( unsigned long ) xTaskGetTickCount(), pcTaskName );
+
+    if( ( lLen > 0 ) && ( lLen < ( int ) sizeof( pcLine ) ) )
+    {
+        int lMsgLen = vsnprintf( &( pcLine[ lLen ] ), sizeof( pcLine ) - ( size_t ) lLen, pcFormat, args );
+
+        if( lMsgLen > 0 )
+        {
+            lLen += lMsgLen;
+        }
+    }
+
+    if( lLen >= ( int ) sizeof( pcLine ) )
+    {
+        lLen = ( int ) sizeof( pcLine ) - 1;
+    }
+
+    if( lLen > 0 )
+    {
+        ( void ) fprintf( stderr, "%.*s (%s:%lu)\n", lLen, pcLine, pcFileName, ulLineNumber );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintf( const char * const pcLogLevel,
+                     const char * const pcFileName,
+                     const unsigned long ulLineNumber,
+                     const char * const pcFormat,
+                     ... )
+{
+    va_list args;
+
+    va_start( args, pcFormat );
+    vLoggingPrintfV( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+    va_end( args );
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintfModule( LogModule_t * pxModule,
+                           const uint8_t ucLevel,
+                           const char * const pcLogLevel,
+                           const char * const pcFileName,
+                           const unsigned long ulLineNumber,
+                           const char * const pcFormat,
+                           ... )
+{
+    if( pxModule->ucLevel == LOG_LEVEL_UNRESOLVED )
+    {
+        pxModule->pcName = pcFileName;
+        pxModule->ucLevel = pxModule->ucDefaultLevel;
+    }
+
+    if( pxModule->ucLevel >= ucLevel )
+    {
+        va_list args;
+
+        va_start( args, pcFormat );
+        vLoggingPrintfV( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+        va_end( args );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vInitLoggingEarly( void )
+{
+    setvbuf( stderr, NULL, _IOLBF, 0 );
+}
+
+void vLoggingInit( void )
+{
+}
+
+void vLoggingDeInit( void )
+{
+}
+
+void vDyingGasp( void )
+{
+    ( void ) fflush( stdout );
+    ( void ) fflush( stderr );
+}
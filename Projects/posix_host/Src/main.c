@@ -0,0 +1,303 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Entry point of the host build: mounts littlefs on the RAM block device, starts the kvstore,
+ * times the registered kernels from a task and writes the results to stdout in the CSV format of
+ * micro_bench.h. With "fleet" as the first argument, runs the device simulation of fleet_sim.h
+ * instead, and with "selftest" the known answer tests of kvstore_log_test.h. Log output goes to
+ * stderr.
+ *
+ * Usage: posix_host [runs [warmup]]
+ *        posix_host selftest
+ *        posix_host fleet [devices [seconds [publish_ms [burst [subscriptions [command_ms [storm_s]]]]]]]
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "kvstore.h"
+#include "micro_bench.h"
+#include "lfs.h"
+#include "fs/lfs_port.h"
+#include "lfs_port_ram.h"
+#include "bench_host.h"
+#include "fleet_sim.h"
+#include "kvstore_log_test.h"
+
+#define BENCH_HOST_TASK_STACK    ( configMINIMAL_STACK_SIZE * 4 )
+#define BENCH_HOST_LINE_LEN      ( 192 )
+
+typedef struct
+{
+    uint32_t ulRuns;
+    uint32_t ulWarmup;
+    int lExitCode;
+} BenchHostRun_t;
+
+static lfs_t * pxLfsCtx = NULL;
+
+/*-----------------------------------------------------------*/
+
+lfs_t * pxGetDefaultFsCtx( void )
+{
+    return pxLfsCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+static int fs_init( void )
+{
+    static lfs_t xLfsCtx = { 0 };
+    struct lfs_info xDirInfo = { 0 };
+
+    const struct lfs_config * pxCfg = pxInitializeRamFs( pdMS_TO_TICKS( 30 * 1000 ) );
+
+    /* The device starts erased, so it always needs a format */
+    int err = lfs_format( &xLfsCtx, pxCfg );
+
+    if( err == LFS_ERR_OK )
+    {
+        err = lfs_mount( &xLfsCtx, pxCfg );
+    }
+
+    if( ( err == LFS_ERR_OK ) && ( lfs_stat( &xLfsCtx, "/cfg", &xDirInfo ) == LFS_ERR_NOENT ) )
+    {
+        err = lfs_mkdir( &xLfsCtx, "/cfg" );
+    }
+
+    if( ( err == LFS_ERR_OK ) && ( lfs_stat( &xLfsCtx, "/ota", &xDirInfo ) == LFS_ERR_NOENT ) )
+    {
+        err = lfs_mkdir( &xLfsCtx, "/ota" );
+    }
+
+    if( err == LFS_ERR_OK )
+    {
+        /* Export the FS context */
+        pxLfsCtx = &xLfsCtx;
+    }
+    else
+    {
+        LogError( "Failed to initialize the RAM file system: %d", err );
+    }
+
+    return err;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRunBench( MicroBench_t * pxBench,
+                               void * pvCtx )
+{
+    BenchHostRun_t * pxRun = ( BenchHostRun_t * ) pvCtx;
+    MicroBenchStats_t xStats;
+    char pcLine[ BENCH_HOST_LINE_LEN ];
+
+    if( xMicroBenchRun( pxBench, pxRun->ulWarmup, pxRun->ulRuns, &xStats ) != pdTRUE )
+    {
+        LogError( "Kernel %s failed: %d", pxBench->pcName, xStats.lError );
+        pxRun->lExitCode = EXIT_FAILURE;
+    }
+
+    if( lMicroBenchFormatCsv( pxBench, &xStats, pcLine, sizeof( pcLine ) ) > 0 )
+    {
+        ( void ) fputs( pcLine, stdout );
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vBenchTask( void * pvParameters )
+{
+    BenchHostRun_t * pxRun = ( BenchHostRun_t * ) pvParameters;
+
+    if( fs_init() == LFS_ERR_OK )
+    {
+        KVStore_init();
+
+        vBenchHostRegister();
+
+        ( void ) fputs( MICRO_BENCH_CSV_HEADER, stdout );
+        vMicroBenchForEach( prvRunBench, pxRun );
+    }
+    else
+    {
+        pxRun->lExitCode = EXIT_FAILURE;
+    }
+
+    vDyingGasp();
+
+    exit( pxRun->lExitCode );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vSelfTestTask( void * pvParameters )
+{
+    int lExitCode = EXIT_FAILURE;
+
+    ( void ) pvParameters;
+
+    if( ( fs_init() == LFS_ERR_OK ) &&
+        ( xKvStoreLogSelfTest() == pdTRUE ) )
+    {
+        lExitCode = EXIT_SUCCESS;
+    }
+
+    vDyingGasp();
+
+    exit( lExitCode );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Settings of the fleet mode, in the order they are given on the command line */
+static void prvParseFleetArgs( int argc,
+                               char ** argv,
+                               FleetSimConfig_t * pxConfig )
+{
+    uint32_t * const pulArgs[] =
+    {
+        &( pxConfig->ulDevices ),
+        &( pxConfig->ulDurationS ),
+        &( pxConfig->ulPublishPeriodMs ),
+        &( pxConfig->ulBurst ),
+        &( pxConfig->ulSubscriptions ),
+        &( pxConfig->ulCommandPeriodMs ),
+        &( pxConfig->ulStormPeriodS )
+    };
+
+    for( int i = 2; ( i < argc ) && ( ( size_t ) ( i - 2 ) < ( sizeof( pulArgs ) / sizeof( pulArgs[ 0 ] ) ) ); i++ )
+    {
+        *( pulArgs[ i - 2 ] ) = ( uint32_t ) strtoul( argv[ i ], NULL, 10 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    static BenchHostRun_t xRun = { .ulRuns = MICRO_BENCH_MAX_RUNS, .ulWarmup = 8, .lExitCode = EXIT_SUCCESS };
+    BaseType_t xResult = pdPASS;
+
+    vInitLoggingEarly();
+
+    if( ( argc > 1 ) && ( strcmp( argv[ 1 ], "fleet" ) == 0 ) )
+    {
+        FleetSimConfig_t xConfig = FLEET_SIM_CONFIG_DEFAULT;
+
+        prvParseFleetArgs( argc, argv, &xConfig );
+        vFleetSimStart( &xConfig );
+    }
+    else if( ( argc > 1 ) && ( strcmp( argv[ 1 ], "selftest" ) == 0 ) )
+    {
+        xResult = xTaskCreate( vSelfTestTask, "SelfTest", BENCH_HOST_TASK_STACK, NULL, 10, NULL );
+    }
+    else
+    {
+        if( argc > 1 )
+        {
+            xRun.ulRuns = ( uint32_t ) strtoul( argv[ 1 ], NULL, 10 );
+        }
+
+        if( argc > 2 )
+        {
+            xRun.ulWarmup = ( uint32_t ) strtoul( argv[ 2 ], NULL, 10 );
+        }
+
+        xResult = xTaskCreate( vBenchTask, "Bench", BENCH_HOST_TASK_STACK, &xRun, 10, NULL );
+    }
+
+    configASSERT( xResult == pdPASS );
+
+    vTaskStartScheduler();
+
+    /* Only reached if the scheduler could not start */
+    LogError( "Failed to start the scheduler." );
+
+    return EXIT_FAILURE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vHostAssert( const char * pcFile,
+                  uint32_t ulLine )
+{
+    ( void ) fprintf( stderr, "Assertion failed at %s:%lu\n", pcFile, ( unsigned long ) ulLine );
+    vDyingGasp();
+    abort();
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationMallocFailedHook( void )
+{
+    LogError( "Malloc failed" );
+    vDyingGasp();
+    abort();
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
+                                    StackType_t ** ppxIdleTaskStackBuffer,
+                                    uint32_t * pulIdleTaskStackSize )
+{
+    static StaticTask_t xIdleTaskTCB;
+    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+
+    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+    *ppxIdleTaskStackBuffer = uxIdleTaskStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
+                                     StackType_t ** ppxTimerTaskStackBuffer,
+                                     uint32_t * pulTimerTaskStackSize )
+{
+    static StaticTask_t xTimerTaskTCB;
+    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+
+    *ppxTimerTaskTCBBuffer = &xTimerTaskTCB;
+    *ppxTimerTaskStackBuffer = uxTimerTaskStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
@@ -32,6 +32,8 @@ import logging
 import os
 import random
 import string
+import struct
+import zlib
 from time import monotonic
 
 import boto3
@@ -40,7 +42,12 @@ import serial
 import serial.tools.list_ports
 from cryptography import x509
 from cryptography.hazmat.primitives.asymmetric import ec, rsa
-from cryptography.hazmat.primitives.serialization import load_pem_public_key
+from cryptography.hazmat.primitives.serialization import (
+    Encoding,
+    PublicFormat,
+    load_der_public_key,
+    load_pem_public_key,
+)
 from cryptography.x509.oid import NameOID
 
 logger = logging.getLogger()
@@ -324,6 +331,182 @@ class TargetDevice:
             self._staged_config[key_b] = value_b
 
 
+class BinarySession:
+    """Binary provisioning mode of the target, entered with the "prov" command.
+
+    Frames are COBS encoded [ payload ][ crc32 le ] followed by 0x00. Requests are
+    [ type ][ seq ][ body ], responses [ type | 0x80 ][ seq ][ status ][ body ].
+    """
+
+    HELLO = 0x01
+    KV_SET = 0x02
+    KV_COMMIT = 0x03
+    CERT_IMPORT = 0x04
+    PUBKEY_IMPORT = 0x05
+    KEY_GENERATE = 0x06
+    CSR = 0x07
+    CERT_EXPORT = 0x08
+    PUBKEY_EXPORT = 0x09
+    END = 0x0F
+
+    _status_str = (
+        "ok",
+        "bad frame",
+        "unknown type",
+        "bad argument",
+        "failed",
+        "too long",
+    )
+
+    class ProtocolError(Exception):
+        """Raised when the target refuses a request or the response is malformed"""
+
+        pass
+
+    def __init__(self, target, timeout=10.0):
+        self.ser = target.ser
+        self.timeout = timeout
+        self.seq = 0
+
+        target._send_cmd(b"prov")
+        # Drop the end of the echoed command line, then flush any partial frame
+        self.ser.reset_input_buffer()
+        self.ser.write(b"\x00")
+
+        version, max_payload = struct.unpack("<BH", self.request(self.HELLO))
+        self.max_payload = max_payload
+        logging.debug(
+            "Binary provisioning v{}, {} bytes per frame".format(version, max_payload)
+        )
+
+    @staticmethod
+    def _cobs_encode(data):
+        out = bytearray(b"\x00")
+        code_idx = 0
+        for idx, byte in enumerate(data):
+            if byte == 0:
+                out[code_idx] = len(out) - code_idx
+                code_idx = len(out)
+                out.append(0)
+            else:
+                out.append(byte)
+                # A full group is closed unless the data ends with it
+                if len(out) - code_idx == 0xFF and idx + 1 < len(data):
+                    out[code_idx] = 0xFF
+                    code_idx = len(out)
+                    out.append(0)
+        out[code_idx] = len(out) - code_idx
+        return bytes(out)
+
+    @staticmethod
+    def _cobs_decode(data):
+        out = bytearray()
+        idx = 0
+        while idx < len(data):
+            code = data[idx]
+            if code == 0 or idx + code > len(data):
+                raise BinarySession.ProtocolError("Malformed COBS frame")
+            out += data[idx + 1 : idx + code]
+            idx += code
+            if code < 0xFF and idx < len(data):
+                out.append(0)
+        return bytes(out)
+
+    def _read_frame(self):
+        frame = bytearray()
+        timeoutTime = monotonic() + self.timeout
+        while timeoutTime > monotonic():
+            byte = self.ser.read(1)
+            if len(byte) == 0:
+                continue
+            elif byte == b"\x00":
+                if len(frame) > 0:
+                    return bytes(frame)
+            else:
+                frame += byte
+        raise TargetDevice.ResponseTimeout()
+
+    def request(self, msg_type, body=b""):
+        """Send one request and return the body of its response"""
+        self.seq = (self.seq + 1) & 0xFF
+        payload = bytes([msg_type, self.seq]) + body
+        payload += struct.pack("<I", zlib.crc32(payload))
+        self.ser.write(self._cobs_encode(payload) + b"\x00")
+        self.ser.flush()
+
+        while True:
+            try:
+                resp = self._cobs_decode(self._read_frame())
+            except BinarySession.ProtocolError:
+                continue
+
+            # Skip anything which is not an intact response to this request
+            if (
+                len(resp) < 7
+                or struct.unpack("<I", resp[-4:])[0] != zlib.crc32(resp[:-4])
+                or resp[1] != self.seq
+            ):
+                continue
+
+            status = resp[2]
+            if status != 0:
+                raise BinarySession.ProtocolError(
+                    "Request 0x{:02x} failed: {}".format(
+                        msg_type,
+                        self._status_str[status]
+                        if status < len(self._status_str)
+                        else status,
+                    )
+                )
+            return resp[3:-4]
+
+    @staticmethod
+    def _label(label):
+        label = bytes(label, "ascii") if label else b""
+        return bytes([len(label)]) + label
+
+    def kv_set(self, config):
+        """Stage a dict of byte string keys and values, in as few frames as fit"""
+        body = b""
+        for key, value in config.items():
+            record = bytes([len(key)]) + key + struct.pack("<H", len(value)) + value
+            if len(body) + len(record) > self.max_payload - 2:
+                self.request(self.KV_SET, body)
+                body = b""
+            body += record
+        if len(body) > 0:
+            self.request(self.KV_SET, body)
+
+    def kv_commit(self):
+        self.request(self.KV_COMMIT)
+
+    def import_cert(self, der, label=None):
+        self.request(self.CERT_IMPORT, self._label(label) + der)
+
+    def import_pubkey(self, der, label=None):
+        self.request(self.PUBKEY_IMPORT, self._label(label) + der)
+
+    def generate_key(self, prv_label=None, pub_label=None):
+        """Returns the DER public key of a newly generated key pair"""
+        return self.request(
+            self.KEY_GENERATE, self._label(prv_label) + self._label(pub_label)
+        )
+
+    def generate_csr(self, label=None):
+        """Returns a DER certificate signing request"""
+        return self.request(self.CSR, self._label(label))
+
+    def export_cert(self, label=None):
+        return self.request(self.CERT_EXPORT, self._label(label))
+
+    def export_pubkey(self, label=None):
+        return self.request(self.PUBKEY_EXPORT, self._label(label))
+
+    def end(self):
+        """Commit and return the target to the text console"""
+        self.request(self.END)
+
+
 class AwsHelper:
     session = None
     session_valid = False
@@ -829,6 +1012,72 @@ def provision_pki(target, aws, cert_issuer):
                 target.write_cert(cert["pem"], label="root_ca_cert")
 
 
+def provision_binary(target, aws, cert_issuer):
+    """Write the staged configuration and the credentials in one binary provisioning session."""
+    session = BinarySession(target)
+
+    print("Commiting target configuration...")
+    session.kv_set(target._staged_config)
+    session.kv_commit()
+
+    thing_name = target.conf_get("thing_name")
+
+    print("Generating a new public/private key pair")
+    pub_key = (
+        load_der_public_key(session.generate_key())
+        .public_bytes(Encoding.PEM, PublicFormat.SubjectPublicKeyInfo)
+    )
+
+    if not validate_pubkey(pub_key):
+        print("Error: Could not parse public key.")
+        raise SystemExit
+
+    if cert_issuer == "aws":
+        print("Generating a Certificate Signing Request")
+        csr = x509.load_der_x509_csr(session.generate_csr()).public_bytes(Encoding.PEM)
+
+        if not validate_csr(csr, pub_key, thing_name):
+            print("Error: CSR is invalid.")
+            raise SystemExit
+
+        thing_data = aws.register_thing_csr(thing_name, csr.decode("utf-8"))
+
+        if "certificatePem" in thing_data:
+            cert = x509.load_pem_x509_certificate(
+                thing_data["certificatePem"].encode("ascii")
+            )
+            session.import_cert(cert.public_bytes(Encoding.DER))
+        else:
+            print("Error: No certificate returned from register_thing_csr call.")
+            raise SystemExit
+
+    ca_certs = get_amazon_rootca_certs()
+    if ca_certs:
+        for ca_cert in ca_certs:
+            if ca_cert["label"] == "SFSRootCAG2":
+                print('Importing root ca certificate: "{}"'.format(ca_cert["CN"]))
+                der = x509.load_pem_x509_certificate(ca_cert["pem"]).public_bytes(
+                    Encoding.DER
+                )
+                session.import_cert(der, label="root_ca_cert")
+
+    session.end()
+
+    # Self signed certificates are only generated by the text console
+    if cert_issuer == "self":
+        print("Generating a self-signed Certificate")
+        cert = target.generate_cert()
+
+        if not validate_certificate(cert, pub_key, thing_name):
+            print("Error: Certificate is invalid.")
+            raise SystemExit
+
+        aws.register_thing_cert(thing_name, cert.decode("utf-8"))
+    elif cert_issuer != "aws":
+        print("Error: Unknown certificate issuer.")
+        raise SystemExit
+
+
 def process_args():
     parser = argparse.ArgumentParser(argument_default=argparse.SUPPRESS)
 
@@ -836,9 +1085,15 @@ def process_args():
     parser.add_argument("-i", "--interactive", action="store_true")
     parser.add_argument("-v", "--verbose", action="store_true")
 
+    # Use the binary provisioning mode of the console instead of text commands
+    parser.add_argument("-b", "--binary", action="store_true")
+
     # Default to stlink vid/pid if only one is connected, otherwise error.
     parser.add_argument("-d", "--device", type=str)
 
+    # Console baud rate, CLI_UART_BAUD_RATE in Common/cli/cli.h
+    parser.add_argument("--baud", type=int, default=921600)
+
     # Wifi config
     parser.add_argument("--wifi-ssid", type=str)
     parser.add_argument("--wifi-credential", type=str)
@@ -912,7 +1167,7 @@ def main():
 
     print("Connecting to target...")
 
-    target = TargetDevice(devpath, 115200)
+    target = TargetDevice(devpath, args.baud)
 
     configure_target(args, target)
 
@@ -928,10 +1183,13 @@ def main():
     if "interactive" in args:
         interactive_config(target)
 
-    print("Commiting target configuration...")
-    target.conf_commit()
+    if "binary" in args:
+        provision_binary(target, aws, args.cert_issuer)
+    else:
+        print("Commiting target configuration...")
+        target.conf_commit()
 
-    provision_pki(target, aws, args.cert_issuer)
+        provision_pki(target, aws, args.cert_issuer)
 
     print("Provisioning process complete. Resetting target device...")
     target.reset()